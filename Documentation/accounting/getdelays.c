@@ -204,6 +204,10 @@ static void print_delayacct(struct taskstats *t)
 	       "SWAP  %15s%15s%15s\n"
 	       "      %15llu%15llu%15llums\n"
 	       "RECLAIM  %12s%15s%15s\n"
+	       "      %15llu%15llu%15llums\n"
+	       "READ  %15s%15s%15s\n"
+	       "      %15llu%15llu%15llums\n"
+	       "THROTTLE %12s%15s%15s\n"
 	       "      %15llu%15llu%15llums\n",
 	       "count", "real total", "virtual total",
 	       "delay total", "delay average",
@@ -223,7 +227,15 @@ static void print_delayacct(struct taskstats *t)
 	       "count", "delay total", "delay average",
 	       (unsigned long long)t->freepages_count,
 	       (unsigned long long)t->freepages_delay_total,
-	       average_ms(t->freepages_delay_total, t->freepages_count));
+	       average_ms(t->freepages_delay_total, t->freepages_count),
+	       "count", "delay total", "delay average",
+	       (unsigned long long)t->read_count,
+	       (unsigned long long)t->read_delay_total,
+	       average_ms(t->read_delay_total, t->read_count),
+	       "count", "delay total", "delay average",
+	       (unsigned long long)t->throttle_count,
+	       (unsigned long long)t->throttle_delay_total,
+	       average_ms(t->throttle_delay_total, t->throttle_count));
 }
 
 static void task_context_switch_counts(struct taskstats *t)
@@ -365,6 +365,10 @@ struct thash_cb {
 };
 
 struct kvm_vcpu_stat {
+	u32 halt_successful_poll;
+	u32 halt_attempted_poll;
+	u32 directed_yield_attempted;
+	u32 directed_yield_successful;
 };
 
 struct kvm_vcpu_arch {
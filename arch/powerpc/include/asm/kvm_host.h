@@ -90,6 +90,10 @@ struct kvm_vcpu_stat {
 	u32 emulated_inst_exits;
 	u32 dec_exits;
 	u32 ext_intr_exits;
+	u32 halt_successful_poll;
+	u32 halt_attempted_poll;
+	u32 directed_yield_attempted;
+	u32 directed_yield_successful;
 	u32 halt_wakeup;
 #ifdef CONFIG_PPC_BOOK3S
 	u32 pf_storage;
@@ -31,6 +31,7 @@
 #include <crypto/internal/hash.h>
 
 #include <asm/cpufeature.h>
+#include <asm/i387.h>
 
 #define CHKSUM_BLOCK_SIZE	1
 #define CHKSUM_DIGEST_SIZE	4
@@ -79,6 +80,140 @@ static u32 __pure crc32c_intel_le_hw(u32 crc, unsigned char const *p, size_t len
 	return crc;
 }
 
+#ifdef CONFIG_X86_64
+/*
+ * crc32q has a latency of three cycles but a throughput of one per cycle,
+ * so the loop above keeps the unit a third busy.  For large buffers the
+ * input is split into three equal blocks, checksummed as three independent
+ * chains and merged afterwards: advancing a crc over n zero bytes is a
+ * multiplication by x^(8n) mod P, done as a carry-less multiply by a
+ * constant computed at init followed by a crc32q reduction.  The short
+ * blocks are only worth it when the merge can use PCLMULQDQ.
+ */
+#define CRC32C_3WAY_LONG	8192
+#define CRC32C_3WAY_SHORT	256
+
+static u32 crc32c_long_k __read_mostly;
+static u32 crc32c_short_k __read_mostly;
+
+static u64 crc32c_clmul_soft(u32 a, u32 b)
+{
+	u64 r = 0;
+	int i;
+
+	for (i = 0; i < 32; i++)
+		r ^= ((u64)b << i) & -(u64)((a >> i) & 1);
+
+	return r;
+}
+
+/* movq %rax,%xmm0; movq %rdx,%xmm1; pclmulqdq $0,%xmm1,%xmm0; movq %xmm0,%rax */
+static u64 crc32c_clmul_hw(u32 a, u32 b)
+{
+	u64 r;
+
+	__asm__ __volatile__(
+		".byte 0x66, 0x48, 0xf, 0x6e, 0xc0;"
+		".byte 0x66, 0x48, 0xf, 0x6e, 0xca;"
+		".byte 0x66, 0xf, 0x3a, 0x44, 0xc1, 0x00;"
+		".byte 0x66, 0x48, 0xf, 0x7e, 0xc0;"
+		:"=a"(r)
+		:"0"((u64)a), "d"((u64)b)
+	);
+
+	return r;
+}
+
+static u32 crc32c_shift(u32 crc, u32 k, bool clmul)
+{
+	u64 v = clmul ? crc32c_clmul_hw(crc, k) : crc32c_clmul_soft(crc, k);
+	u32 r = 0;
+
+	/* the 63-bit product is bit-reflected: shift it into place */
+	__asm__ __volatile__(
+		".byte 0xf2, 0x48, 0xf, 0x38, 0xf1, 0xf1;"
+		:"=S"(r)
+		:"0"(r), "c"(v << 1)
+	);
+
+	return r;
+}
+
+/* checksum three consecutive blocks of @n words each */
+static u32 crc32c_3way_block(u32 crc, const unsigned long *p, unsigned int n,
+			     u32 k, bool clmul)
+{
+	const unsigned long *end = p + n;
+	u32 c0 = crc, c1 = 0, c2 = 0;
+
+	for (; p < end; p++) {
+		__asm__ __volatile__(
+			".byte 0xf2, 0x48, 0xf, 0x38, 0xf1, 0xc1;"
+			".byte 0xf2, 0x48, 0xf, 0x38, 0xf1, 0xda;"
+			".byte 0xf2, 0x48, 0xf, 0x38, 0xf1, 0xf7;"
+			:"=a"(c0), "=b"(c1), "=S"(c2)
+			:"0"(c0), "1"(c1), "2"(c2),
+			 "c"(p[0]), "d"(p[n]), "D"(p[2 * n])
+		);
+	}
+
+	return crc32c_shift(crc32c_shift(c0, k, clmul) ^ c1, k, clmul) ^ c2;
+}
+
+static u32 crc32c_intel_le_hw_3way(u32 crc, unsigned char const *p,
+				   size_t len)
+{
+	bool clmul = false;
+
+	if (len < 3 * CRC32C_3WAY_SHORT)
+		return crc32c_intel_le_hw(crc, p, len);
+
+	if (cpu_has_pclmulqdq && irq_fpu_usable()) {
+		kernel_fpu_begin();
+		clmul = true;
+	}
+
+	while (len >= 3 * CRC32C_3WAY_LONG) {
+		crc = crc32c_3way_block(crc, (const unsigned long *)p,
+					CRC32C_3WAY_LONG / SCALE_F,
+					crc32c_long_k, clmul);
+		p += 3 * CRC32C_3WAY_LONG;
+		len -= 3 * CRC32C_3WAY_LONG;
+	}
+
+	while (clmul && len >= 3 * CRC32C_3WAY_SHORT) {
+		crc = crc32c_3way_block(crc, (const unsigned long *)p,
+					CRC32C_3WAY_SHORT / SCALE_F,
+					crc32c_short_k, clmul);
+		p += 3 * CRC32C_3WAY_SHORT;
+		len -= 3 * CRC32C_3WAY_SHORT;
+	}
+
+	if (clmul)
+		kernel_fpu_end();
+
+	return crc32c_intel_le_hw(crc, p, len);
+}
+
+/* x^(8 * len - 32) mod P, bit-reflected */
+static u32 __init crc32c_shift_const(unsigned int len)
+{
+	static const unsigned char zero[CRC32C_3WAY_LONG] __initconst;
+
+	return crc32c_intel_le_hw(0x80000000, zero, len - 4);
+}
+
+static void __init crc32c_3way_init(void)
+{
+	crc32c_long_k = crc32c_shift_const(CRC32C_3WAY_LONG);
+	crc32c_short_k = crc32c_shift_const(CRC32C_3WAY_SHORT);
+}
+#else
+#define crc32c_intel_le_hw_3way	crc32c_intel_le_hw
+
+static inline void crc32c_3way_init(void) { }
+#endif
+
 /*
  * Setting the seed allows arbitrary accumulators and flexible XOR policy
  * If your algorithm starts with ~0, then XOR with ~0 before you set
@@ -112,14 +247,14 @@ static int crc32c_intel_update(struct shash_desc *desc, const u8 *data,
 {
 	u32 *crcp = shash_desc_ctx(desc);
 
-	*crcp = crc32c_intel_le_hw(*crcp, data, len);
+	*crcp = crc32c_intel_le_hw_3way(*crcp, data, len);
 	return 0;
 }
 
 static int __crc32c_intel_finup(u32 *crcp, const u8 *data, unsigned int len,
 				u8 *out)
 {
-	*(__le32 *)out = ~cpu_to_le32(crc32c_intel_le_hw(*crcp, data, len));
+	*(__le32 *)out = ~cpu_to_le32(crc32c_intel_le_hw_3way(*crcp, data, len));
 	return 0;
 }
 
@@ -176,10 +311,11 @@ static struct shash_alg alg = {
 
 static int __init crc32c_intel_mod_init(void)
 {
-	if (cpu_has_xmm4_2)
-		return crypto_register_shash(&alg);
-	else
+	if (!cpu_has_xmm4_2)
 		return -ENODEV;
+
+	crc32c_3way_init();
+	return crypto_register_shash(&alg);
 }
 
 static void __exit crc32c_intel_mod_fini(void)
@@ -13,6 +13,9 @@ typedef struct {
 	unsigned int irq_spurious_count;
 #endif
 	unsigned int x86_platform_ipis;	/* arch dependent */
+#ifdef CONFIG_HAVE_KVM
+	unsigned int kvm_posted_intr_ipis;
+#endif
 	unsigned int apic_perf_irqs;
 	unsigned int apic_irq_work_irqs;
 #ifdef CONFIG_SMP
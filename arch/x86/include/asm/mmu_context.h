@@ -39,6 +39,8 @@ static inline void switch_mm(struct mm_struct *prev, struct mm_struct *next,
 #ifdef CONFIG_SMP
 		percpu_write(cpu_tlbstate.state, TLBSTATE_OK);
 		percpu_write(cpu_tlbstate.active_mm, next);
+		/* the CR3 load below flushes anything deferred */
+		percpu_write(cpu_tlbstate.lazy_flush, 0);
 #endif
 		cpumask_set_cpu(cpu, mm_cpumask(next));
 
@@ -66,6 +68,16 @@ static inline void switch_mm(struct mm_struct *prev, struct mm_struct *next,
 			 */
 			load_cr3(next->pgd);
 			load_LDT_nolock(&next->context);
+		} else if (percpu_read(cpu_tlbstate.lazy_flush)) {
+			/*
+			 * A range flush skipped us while lazy. The locked
+			 * test_and_set above orders our TLBSTATE_OK store
+			 * before this load, pairing with the barrier in
+			 * defer_lazy_flushes(): either it saw us leave lazy
+			 * mode and sent the IPI, or we see its flag here.
+			 */
+			percpu_write(cpu_tlbstate.lazy_flush, 0);
+			local_flush_tlb();
 		}
 	}
 #endif
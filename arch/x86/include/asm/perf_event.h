@@ -178,6 +178,15 @@ extern unsigned long perf_instruction_pointer(struct pt_regs *regs);
 extern unsigned long perf_misc_flags(struct pt_regs *regs);
 #define perf_misc_flags(regs)	perf_misc_flags(regs)
 
+/*
+ * User stack dumps are taken from NMI context, where only
+ * copy_from_user_nmi() is safe; it returns the bytes copied, the
+ * generic code wants the bytes left over like copy_from_user().
+ */
+#define perf_user_stack_pointer(regs)	((regs)->sp)
+#define arch_perf_out_copy_user(dst, src, n)	\
+	((n) - copy_from_user_nmi(dst, src, n))
+
 #include <asm/stacktrace.h>
 
 /*
@@ -0,0 +1,46 @@
+#ifndef _ASM_X86_QSPINLOCK_H
+#define _ASM_X86_QSPINLOCK_H
+
+#include <asm/cpufeature.h>
+#include <asm-generic/qspinlock_types.h>
+
+#if !defined(CONFIG_X86_32) || \
+	!(defined(CONFIG_X86_OOSTORE) || defined(CONFIG_X86_PPRO_FENCE))
+#define	queued_spin_unlock queued_spin_unlock
+/**
+ * queued_spin_unlock - release a queued spinlock
+ * @lock : Pointer to queued spinlock structure
+ *
+ * A plain byte store clears the locked byte: x86 stores are not reordered
+ * with earlier loads or stores.
+ */
+static inline void queued_spin_unlock(struct qspinlock *lock)
+{
+	barrier();
+	ACCESS_ONCE(*(u8 *)lock) = 0;
+}
+#endif
+
+#define virt_spin_lock virt_spin_lock
+/*
+ * In a guest, a vCPU preempted while queued stalls every waiter behind
+ * it, and there is no way here to kick a halted waiter.  Fall back to a
+ * test-and-set lock there, which lets whichever vCPU is running take the
+ * lock next.
+ */
+static inline bool virt_spin_lock(struct qspinlock *lock)
+{
+	if (!static_cpu_has(X86_FEATURE_HYPERVISOR))
+		return false;
+
+	do {
+		while (atomic_read(&lock->val) != 0)
+			cpu_relax();
+	} while (atomic_cmpxchg(&lock->val, 0, _Q_LOCKED_VAL) != 0);
+
+	return true;
+}
+
+#include <asm-generic/qspinlock.h>
+
+#endif /* _ASM_X86_QSPINLOCK_H */
@@ -13,7 +13,7 @@
  * on the local processor, one does not.
  *
  * These are fair FIFO ticket locks, which are currently limited to 256
- * CPUs.
+ * CPUs, or queued (MCS) spinlocks with CONFIG_QUEUED_SPINLOCKS.
  *
  * (the type definitions are in asm/spinlock_types.h)
  */
@@ -37,6 +37,9 @@
 # define UNLOCK_LOCK_PREFIX
 #endif
 
+#ifdef CONFIG_QUEUED_SPINLOCKS
+#include <asm/qspinlock.h>
+#else
 /*
  * Ticket locks are conceptually two parts, one indicating the current head of
  * the queue, and the other indicating the current tail. The lock is acquired
@@ -152,6 +155,7 @@ static inline void arch_spin_unlock_wait(arch_spinlock_t *lock)
 	while (arch_spin_is_locked(lock))
 		cpu_relax();
 }
+#endif	/* CONFIG_QUEUED_SPINLOCKS */
 
 /*
  * Read-write spinlocks, allowing multiple readers
@@ -68,6 +68,23 @@ static inline void __flush_tlb_one(unsigned long addr)
 # define TLB_FLUSH_ALL	-1ULL
 #endif
 
+/*
+ * Ranges of up to this many pages are flushed a page at a time, larger
+ * ones by flushing the whole TLB.
+ */
+#define TLB_FLUSH_PAGES_MAX	32
+
+static inline void __flush_tlb_range(unsigned long start, unsigned long end)
+{
+	if (end == TLB_FLUSH_ALL ||
+	    end - start > (TLB_FLUSH_PAGES_MAX << PAGE_SHIFT)) {
+		__flush_tlb();
+		return;
+	}
+	for (; start < end; start += PAGE_SIZE)
+		__flush_tlb_one(start);
+}
+
 /*
  * TLB flushing:
  *
@@ -76,15 +93,17 @@ static inline void __flush_tlb_one(unsigned long addr)
  *  - flush_tlb_mm(mm) flushes the specified mm context TLB's
  *  - flush_tlb_page(vma, vmaddr) flushes one page
  *  - flush_tlb_range(vma, start, end) flushes a range of pages
+ *  - flush_tlb_mm_range(mm, start, end) flushes a range of pages of an mm
  *  - flush_tlb_kernel_range(start, end) flushes a range of kernel pages
- *  - flush_tlb_others(cpumask, mm, va) flushes TLBs on other cpus
+ *  - flush_tlb_others(cpumask, mm, start, end) flushes TLBs on other cpus
  *
  * ..but the i386 has somewhat limited tlb flushing capabilities,
  * and page-granular flushes are available only on i486 and up.
  *
- * x86-64 can only flush individual pages or full VMs. For a range flush
- * we always do the full VM. Might be worth trying if for a small
- * range a few INVLPGs in a row are a win.
+ * x86 can only flush individual pages or full VMs. Ranges of up to
+ * TLB_FLUSH_PAGES_MAX pages are flushed with a few INVLPGs in a row,
+ * larger ones flush the full VM. An end of TLB_FLUSH_ALL flushes the
+ * full VM, and also covers page tables which have been freed.
  */
 
 #ifndef CONFIG_SMP
@@ -106,16 +125,23 @@ static inline void flush_tlb_page(struct vm_area_struct *vma,
 		__flush_tlb_one(addr);
 }
 
+static inline void flush_tlb_mm_range(struct mm_struct *mm,
+				      unsigned long start, unsigned long end)
+{
+	if (mm == current->active_mm)
+		__flush_tlb_range(start, end);
+}
+
 static inline void flush_tlb_range(struct vm_area_struct *vma,
 				   unsigned long start, unsigned long end)
 {
-	if (vma->vm_mm == current->active_mm)
-		__flush_tlb();
+	flush_tlb_mm_range(vma->vm_mm, start, end);
 }
 
 static inline void native_flush_tlb_others(const struct cpumask *cpumask,
 					   struct mm_struct *mm,
-					   unsigned long va)
+					   unsigned long start,
+					   unsigned long end)
 {
 }
 
@@ -132,6 +158,8 @@ static inline void reset_lazy_tlbstate(void)
 extern void flush_tlb_all(void);
 extern void flush_tlb_current_task(void);
 extern void flush_tlb_mm(struct mm_struct *);
+extern void flush_tlb_mm_range(struct mm_struct *mm,
+			       unsigned long start, unsigned long end);
 extern void flush_tlb_page(struct vm_area_struct *, unsigned long);
 
 #define flush_tlb()	flush_tlb_current_task()
@@ -139,11 +167,16 @@ extern void flush_tlb_page(struct vm_area_struct *, unsigned long);
 static inline void flush_tlb_range(struct vm_area_struct *vma,
 				   unsigned long start, unsigned long end)
 {
-	flush_tlb_mm(vma->vm_mm);
+	/* Unsharing a hugetlb pmd may have freed a page table */
+	if (vma->vm_flags & VM_HUGETLB)
+		flush_tlb_mm(vma->vm_mm);
+	else
+		flush_tlb_mm_range(vma->vm_mm, start, end);
 }
 
 void native_flush_tlb_others(const struct cpumask *cpumask,
-			     struct mm_struct *mm, unsigned long va);
+			     struct mm_struct *mm,
+			     unsigned long start, unsigned long end);
 
 #define TLBSTATE_OK	1
 #define TLBSTATE_LAZY	2
@@ -151,6 +184,11 @@ void native_flush_tlb_others(const struct cpumask *cpumask,
 struct tlb_state {
 	struct mm_struct *active_mm;
 	int state;
+	/*
+	 * A range flush skipped this cpu while it was in lazy tlb mode,
+	 * switch_mm() flushes the TLB when leaving it.
+	 */
+	int lazy_flush;
 };
 DECLARE_PER_CPU_SHARED_ALIGNED(struct tlb_state, cpu_tlbstate);
 
@@ -158,12 +196,14 @@ static inline void reset_lazy_tlbstate(void)
 {
 	percpu_write(cpu_tlbstate.state, 0);
 	percpu_write(cpu_tlbstate.active_mm, &init_mm);
+	percpu_write(cpu_tlbstate.lazy_flush, 0);
 }
 
 #endif	/* SMP */
 
 #ifndef CONFIG_PARAVIRT
-#define flush_tlb_others(mask, mm, va)	native_flush_tlb_others(mask, mm, va)
+#define flush_tlb_others(mask, mm, start, end)	\
+	native_flush_tlb_others(mask, mm, start, end)
 #endif
 
 static inline void flush_tlb_kernel_range(unsigned long start,
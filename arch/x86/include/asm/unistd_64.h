@@ -686,6 +686,12 @@ __SYSCALL(__NR_getcpu, sys_getcpu)
 __SYSCALL(__NR_process_vm_readv, sys_process_vm_readv)
 #define __NR_process_vm_writev			311
 __SYSCALL(__NR_process_vm_writev, sys_process_vm_writev)
+#define __NR_sched_setattr			312
+__SYSCALL(__NR_sched_setattr, sys_sched_setattr)
+#define __NR_sched_getattr			313
+__SYSCALL(__NR_sched_getattr, sys_sched_getattr)
+#define __NR_io_setup2				314
+__SYSCALL(__NR_io_setup2, sys_io_setup2)
 
 #ifndef __NO_STUBS
 #define __ARCH_WANT_OLD_READDIR
@@ -17,10 +17,13 @@ struct vsyscall_gtod_data {
 		cycle_t	cycle_last;
 		cycle_t	mask;
 		u32	mult;
+		u32	raw_mult;
 		u32	shift;
 	} clock;
 	struct timespec wall_to_monotonic;
 	struct timespec wall_time_coarse;
+	struct timespec raw_time;
+	struct timespec monotonic_to_boot;
 };
 extern struct vsyscall_gtod_data vsyscall_gtod_data;
 
@@ -81,6 +81,12 @@ int arch_show_interrupts(struct seq_file *p, int prec)
 			seq_printf(p, "%10u ", irq_stats(j)->x86_platform_ipis);
 		seq_printf(p, "  Platform interrupts\n");
 	}
+#ifdef CONFIG_HAVE_KVM
+	seq_printf(p, "%*s: ", prec, "PIN");
+	for_each_online_cpu(j)
+		seq_printf(p, "%10u ", irq_stats(j)->kvm_posted_intr_ipis);
+	seq_printf(p, "  Posted-interrupt notification event\n");
+#endif
 #ifdef CONFIG_SMP
 	seq_printf(p, "%*s: ", prec, "RES");
 	for_each_online_cpu(j)
@@ -139,6 +145,9 @@ u64 arch_irq_stat_cpu(unsigned int cpu)
 #endif
 	if (x86_platform_ipi_callback)
 		sum += irq_stats(cpu)->x86_platform_ipis;
+#ifdef CONFIG_HAVE_KVM
+	sum += irq_stats(cpu)->kvm_posted_intr_ipis;
+#endif
 #ifdef CONFIG_SMP
 	sum += irq_stats(cpu)->irq_resched_count;
 	sum += irq_stats(cpu)->irq_call_count;
@@ -219,6 +228,31 @@ void smp_x86_platform_ipi(struct pt_regs *regs)
 	set_irq_regs(old_regs);
 }
 
+#ifdef CONFIG_HAVE_KVM
+/*
+ * Handler for POSTED_INTR_VECTOR. The notification only matters while
+ * the target vCPU runs in guest mode, where the CPU consumes it without
+ * an exit; when it arrives in the host, the pending interrupts are
+ * picked up from the descriptor on the next VM entry.
+ */
+void smp_kvm_posted_intr_ipi(struct pt_regs *regs)
+{
+	struct pt_regs *old_regs = set_irq_regs(regs);
+
+	ack_APIC_irq();
+
+	exit_idle();
+
+	irq_enter();
+
+	inc_irq_stat(kvm_posted_intr_ipis);
+
+	irq_exit();
+
+	set_irq_regs(old_regs);
+}
+#endif
+
 EXPORT_SYMBOL_GPL(vector_used_by_percpu_irq);
 
 #ifdef CONFIG_HOTPLUG_CPU
@@ -363,7 +397,17 @@ void fixup_irqs(void)
 	 *
 	 * So for now, retain mdelay(1) and check the IRR and then send those
 	 * interrupts to new targets as this cpu is already offlined...
+	 *
+	 * Every other cpu spins in stop_machine meanwhile, so skip it if no
+	 * device vector is left on this cpu, e.g. because its irqs were
+	 * moved away when it was isolated: nothing can be in flight to it.
 	 */
+	for (vector = FIRST_EXTERNAL_VECTOR; vector < NR_VECTORS; vector++)
+		if (__this_cpu_read(vector_irq[vector]) >= 0)
+			break;
+	if (vector == NR_VECTORS)
+		return;
+
 	mdelay(1);
 
 	for (vector = FIRST_EXTERNAL_VECTOR; vector < NR_VECTORS; vector++) {
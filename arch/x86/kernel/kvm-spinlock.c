@@ -0,0 +1,178 @@
+/*
+ * KVM paravirtual spinlocks
+ *
+ * Split spinlock implementation out into its own file, so it can be
+ * compiled in a FTRACE-compatible way.
+ *
+ * The lock keeps the native ticket layout, so locks taken before the
+ * ops are switched are released correctly afterwards.  A waiter spins
+ * for SPIN_THRESHOLD iterations, then records the lock and ticket it
+ * wants and halts its vcpu; the unlocker kicks the vcpu waiting for the
+ * ticket it just passed on with the KVM_HC_KICK_CPU hypercall.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/kvm_para.h>
+#include <linux/spinlock.h>
+#include <linux/hardirq.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
+
+#include <asm/paravirt.h>
+#include <asm/apic.h>
+
+#define SPIN_THRESHOLD	(1 << 15)
+
+struct kvm_lock_waiting {
+	struct arch_spinlock *lock;
+	__ticket_t want;
+};
+
+/* cpus halted in kvm_lock_spinning(), and what each is waiting for */
+static cpumask_t waiting_cpus;
+static DEFINE_PER_CPU(struct kvm_lock_waiting, lock_waiting);
+
+/* Kick a cpu by its apicid; the host makes its halted vcpu runnable. */
+static void kvm_kick_cpu(int cpu)
+{
+	int apicid;
+	unsigned long flags = 0;
+
+	apicid = per_cpu(x86_cpu_to_apicid, cpu);
+	kvm_hypercall2(KVM_HC_KICK_CPU, flags, apicid);
+}
+
+static noinline void kvm_lock_spinning(struct arch_spinlock *lock,
+				       __ticket_t want)
+{
+	struct kvm_lock_waiting *w;
+	unsigned long flags;
+	int cpu;
+
+	/* An NMI cannot be woken up again once it halts. */
+	if (in_nmi())
+		return;
+
+	/*
+	 * Make sure an interrupt handler can't upset things in a
+	 * partially setup state.
+	 */
+	local_irq_save(flags);
+
+	w = &__get_cpu_var(lock_waiting);
+	cpu = smp_processor_id();
+
+	w->want = want;
+	smp_wmb();
+	w->lock = lock;
+
+	/*
+	 * cpumask_set_cpu() is a locked operation on x86, so it orders
+	 * the stores above before the read of the lock head below.  The
+	 * unlocker bumps the head with a locked operation before looking
+	 * at waiting_cpus, so either we see our ticket come up or it sees
+	 * us waiting and kicks us.
+	 */
+	cpumask_set_cpu(cpu, &waiting_cpus);
+	barrier();
+
+	if (ACCESS_ONCE(lock->tickets.head) == want)
+		goto out;
+
+	/*
+	 * A kick that arrives before we halt leaves the vcpu runnable,
+	 * so the halt below returns immediately.  If interrupts were
+	 * enabled we halt with them enabled; an interrupt only causes a
+	 * spurious wakeup, after which the caller checks the lock again.
+	 */
+	if (arch_irqs_disabled_flags(flags))
+		halt();
+	else
+		safe_halt();
+
+out:
+	cpumask_clear_cpu(cpu, &waiting_cpus);
+	w->lock = NULL;
+	local_irq_restore(flags);
+}
+
+static noinline void kvm_unlock_kick(struct arch_spinlock *lock,
+				     __ticket_t ticket)
+{
+	int cpu;
+
+	for_each_cpu(cpu, &waiting_cpus) {
+		const struct kvm_lock_waiting *w = &per_cpu(lock_waiting, cpu);
+
+		if (ACCESS_ONCE(w->lock) == lock &&
+		    ACCESS_ONCE(w->want) == ticket) {
+			kvm_kick_cpu(cpu);
+			break;
+		}
+	}
+}
+
+static void kvm_spin_lock(struct arch_spinlock *lock)
+{
+	register struct __raw_tickets inc = { .tail = 1 };
+
+	inc = xadd(&lock->tickets, inc);
+
+	for (;;) {
+		unsigned count = SPIN_THRESHOLD;
+
+		do {
+			if (inc.head == inc.tail)
+				goto out;
+			cpu_relax();
+			inc.head = ACCESS_ONCE(lock->tickets.head);
+		} while (--count);
+		kvm_lock_spinning(lock, inc.tail);
+		inc.head = ACCESS_ONCE(lock->tickets.head);
+	}
+out:
+	barrier();	/* make sure nothing creeps before the lock is taken */
+}
+
+static void kvm_spin_lock_flags(struct arch_spinlock *lock,
+				unsigned long flags)
+{
+	kvm_spin_lock(lock);
+}
+
+static void kvm_spin_unlock(struct arch_spinlock *lock)
+{
+	__ticket_t head;
+
+	/*
+	 * A locked add, unlike the native unlock, so that the read of the
+	 * tail and of waiting_cpus cannot pass the release.
+	 */
+	head = xadd(&lock->tickets.head, 1) + 1;
+
+	/* Anyone queued behind us may have gone to sleep. */
+	if (unlikely(ACCESS_ONCE(lock->tickets.tail) != head))
+		kvm_unlock_kick(lock, head);
+}
+
+void __init kvm_spinlock_init(void)
+{
+	if (!kvm_para_available())
+		return;
+	/* Does host kernel support KVM_FEATURE_PV_UNHALT? */
+	if (!kvm_para_has_feature(KVM_FEATURE_PV_UNHALT))
+		return;
+	if (num_possible_cpus() == 1)
+		return;
+
+	pv_lock_ops.spin_lock = kvm_spin_lock;
+	pv_lock_ops.spin_lock_flags = kvm_spin_lock_flags;
+	pv_lock_ops.spin_unlock = kvm_spin_unlock;
+
+	printk(KERN_INFO "KVM setup paravirtual spinlock\n");
+}
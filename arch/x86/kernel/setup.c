@@ -44,6 +44,7 @@
 #include <linux/iscsi_ibft.h>
 #include <linux/nodemask.h>
 #include <linux/kexec.h>
+#include <linux/kexec_preserve.h>
 #include <linux/dmi.h>
 #include <linux/pfn.h>
 #include <linux/pci.h>
@@ -586,6 +587,49 @@ static void __init reserve_crashkernel(void)
 }
 #endif
 
+#ifdef CONFIG_KEXEC_PRESERVE
+static struct resource kexec_preserve_res = {
+	.name	= "Kexec preserved memory",
+	.start	= 0,
+	.end	= 0,
+	.flags	= IORESOURCE_BUSY | IORESOURCE_MEM
+};
+
+/*
+ * Done right after memblock is filled so that nothing allocated at boot,
+ * page tables included, lands on the data the previous kernel left here.
+ */
+static void __init reserve_kexec_preserve(void)
+{
+	unsigned long long base = kexec_preserve_base;
+	unsigned long long size = kexec_preserve_size;
+
+	if (!size)
+		return;
+
+	if (!e820_all_mapped(base, base + size, E820_RAM) ||
+	    memblock_is_region_reserved(base, size)) {
+		pr_info("kexec_preserve reservation failed - memory is in use.\n");
+		kexec_preserve_size = 0;
+		return;
+	}
+	memblock_x86_reserve_range(base, base + size, "KEXEC PRESERVE");
+
+	printk(KERN_INFO "Reserving %ldMB of memory at %ldMB "
+			"preserved across kexec\n",
+			(unsigned long)(size >> 20),
+			(unsigned long)(base >> 20));
+
+	kexec_preserve_res.start = base;
+	kexec_preserve_res.end = base + size - 1;
+	insert_resource(&iomem_resource, &kexec_preserve_res);
+}
+#else
+static void __init reserve_kexec_preserve(void)
+{
+}
+#endif
+
 static struct resource standard_io_resources[] = {
 	{ .name = "dma1", .start = 0x00, .end = 0x1f,
 		.flags = IORESOURCE_BUSY | IORESOURCE_IO },
@@ -989,6 +1033,8 @@ void __init setup_arch(char **cmdline_p)
 	memblock.current_limit = get_max_mapped();
 	memblock_x86_fill();
 
+	reserve_kexec_preserve();
+
 	/*
 	 * The EFI specification says that boot service code won't be called
 	 * after ExitBootServices(). This is, in fact, a lie.
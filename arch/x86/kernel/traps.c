@@ -418,8 +418,7 @@ dotraplinkage void __kprobes do_int3(struct pt_regs *regs, long error_code)
 				SIGTRAP) == NOTIFY_STOP)
 		return;
 #endif /* CONFIG_KGDB_LOW_LEVEL_TRAP */
-#ifdef CONFIG_KPROBES
-
+#if defined(CONFIG_KPROBES) || defined(CONFIG_UPROBES)
 	if (notify_die(DIE_INT3, "int3", regs, error_code, X86_TRAP_BP,
 			SIGTRAP) == NOTIFY_STOP)
 		return;
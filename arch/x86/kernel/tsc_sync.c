@@ -36,16 +36,25 @@ static __cpuinitdata atomic_t stop_count;
 static __cpuinitdata arch_spinlock_t sync_lock = __ARCH_SPIN_LOCK_UNLOCKED;
 
 static __cpuinitdata cycles_t last_tsc;
+static __cpuinitdata int last_tsc_cpu;
 static __cpuinitdata cycles_t max_warp;
 static __cpuinitdata int nr_warps;
 
+/*
+ * Number of times a CPU read the TSC right after the other one. A warp
+ * can only be seen across such a hand-over, so with few of them the
+ * measurement proves little:
+ */
+static __cpuinitdata int nr_handovers;
+#define TSC_SYNC_MIN_HANDOVERS	100
+
 /*
  * TSC-warp measurement loop running on both CPUs:
  */
 static __cpuinit void check_tsc_warp(void)
 {
 	cycles_t start, now, prev, end;
-	int i;
+	int i, cpu = smp_processor_id();
 
 	rdtsc_barrier();
 	start = get_cycles();
@@ -68,6 +77,10 @@ static __cpuinit void check_tsc_warp(void)
 		now = get_cycles();
 		rdtsc_barrier();
 		last_tsc = now;
+		if (last_tsc_cpu != cpu) {
+			last_tsc_cpu = cpu;
+			nr_handovers++;
+		}
 		arch_spin_unlock(&sync_lock);
 
 		/*
@@ -146,6 +159,10 @@ void __cpuinit check_tsc_sync_source(int cpu)
 		pr_warning("Measured %Ld cycles TSC warp between CPUs, "
 			   "turning off TSC clock.\n", max_warp);
 		mark_tsc_unstable("check_tsc_sync_source failed");
+	} else if (nr_handovers < TSC_SYNC_MIN_HANDOVERS) {
+		pr_warning("TSC synchronization [CPU#%d -> CPU#%d]: "
+			   "inconclusive, only %d CPU hand-overs measured\n",
+			   smp_processor_id(), cpu, nr_handovers);
 	} else {
 		pr_debug("TSC synchronization [CPU#%d -> CPU#%d]: passed\n",
 			smp_processor_id(), cpu);
@@ -156,6 +173,7 @@ void __cpuinit check_tsc_sync_source(int cpu)
 	 */
 	atomic_set(&start_count, 0);
 	nr_warps = 0;
+	nr_handovers = 0;
 	max_warp = 0;
 	last_tsc = 0;
 
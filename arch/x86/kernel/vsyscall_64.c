@@ -100,11 +100,14 @@ void update_vsyscall(struct timespec *wall_time, struct timespec *wtm,
 	vsyscall_gtod_data.clock.cycle_last	= clock->cycle_last;
 	vsyscall_gtod_data.clock.mask		= clock->mask;
 	vsyscall_gtod_data.clock.mult		= mult;
+	vsyscall_gtod_data.clock.raw_mult	= clock->mult;
 	vsyscall_gtod_data.clock.shift		= clock->shift;
 	vsyscall_gtod_data.wall_time_sec	= wall_time->tv_sec;
 	vsyscall_gtod_data.wall_time_nsec	= wall_time->tv_nsec;
 	vsyscall_gtod_data.wall_to_monotonic	= *wtm;
 	vsyscall_gtod_data.wall_time_coarse	= __current_kernel_time();
+	vsyscall_gtod_data.raw_time		= __current_raw_time();
+	vsyscall_gtod_data.monotonic_to_boot	= __current_sleep_time();
 
 	write_sequnlock_irqrestore(&vsyscall_gtod_data.lock, flags);
 }
@@ -361,6 +361,8 @@ static void do_cpuid_ent(struct kvm_cpuid_entry2 *entry, u32 function,
 		if (sched_info_on())
 			entry->eax |= (1 << KVM_FEATURE_STEAL_TIME);
 
+		entry->eax |= (1 << KVM_FEATURE_PV_UNHALT);
+
 		entry->ebx = 0;
 		entry->ecx = 0;
 		entry->edx = 0;
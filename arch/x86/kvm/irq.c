@@ -37,6 +37,35 @@ int kvm_cpu_has_pending_timer(struct kvm_vcpu *vcpu)
 }
 EXPORT_SYMBOL(kvm_cpu_has_pending_timer);
 
+/*
+ * check if there is pending interrupt from
+ * non-APIC source without intack.
+ */
+static int kvm_cpu_has_extint(struct kvm_vcpu *v)
+{
+	if (kvm_apic_accept_pic_intr(v))
+		return pic_irqchip(v->kvm)->output;	/* PIC */
+	else
+		return 0;
+}
+
+/*
+ * check if there is an interrupt that has to be injected by software.
+ * With virtual interrupt delivery, interrupts from the APIC are
+ * delivered by the processor and only the PIC is left.
+ */
+int kvm_cpu_has_injectable_intr(struct kvm_vcpu *v)
+{
+	if (!irqchip_in_kernel(v->kvm))
+		return v->arch.interrupt.pending;
+
+	if (!kvm_apic_vid_enabled(v->kvm))
+		return kvm_cpu_has_interrupt(v);
+
+	return kvm_cpu_has_extint(v);
+}
+EXPORT_SYMBOL_GPL(kvm_cpu_has_injectable_intr);
+
 /*
  * check if there is pending interrupt without
  * intack.
@@ -70,7 +99,10 @@ int kvm_cpu_get_interrupt(struct kvm_vcpu *v)
 	if (!irqchip_in_kernel(v->kvm))
 		return v->arch.interrupt.nr;
 
-	vector = kvm_get_apic_interrupt(v);	/* APIC */
+	if (kvm_apic_vid_enabled(v->kvm))
+		vector = -1;	/* APIC delivers by itself */
+	else
+		vector = kvm_get_apic_interrupt(v);	/* APIC */
 	if (vector == -1) {
 		if (kvm_apic_accept_pic_intr(v)) {
 			s = pic_irqchip(v->kvm);
@@ -213,6 +213,19 @@ static inline int apic_search_irr(struct kvm_lapic *apic)
 	return find_highest_vector(apic->regs + APIC_IRR);
 }
 
+void kvm_apic_update_irr(struct kvm_vcpu *vcpu, u32 *pir)
+{
+	struct kvm_lapic *apic = vcpu->arch.apic;
+	u32 i, pir_val;
+
+	for (i = 0; i <= 7; i++) {
+		pir_val = xchg(&pir[i], 0);
+		if (pir_val)
+			*((u32 *)(apic->regs + APIC_IRR + i * 0x10)) |= pir_val;
+	}
+}
+EXPORT_SYMBOL_GPL(kvm_apic_update_irr);
+
 static inline int apic_find_highest_irr(struct kvm_lapic *apic)
 {
 	int result;
@@ -220,6 +233,8 @@ static inline int apic_find_highest_irr(struct kvm_lapic *apic)
 	if (!apic->irr_pending)
 		return -1;
 
+	if (kvm_x86_ops->sync_pir_to_irr)
+		kvm_x86_ops->sync_pir_to_irr(apic->vcpu);
 	result = apic_search_irr(apic);
 	ASSERT(result == -1 || result >= 16);
 
@@ -401,6 +416,14 @@ static int __apic_accept_irq(struct kvm_lapic *apic, int delivery_mode,
 		} else
 			apic_clear_vector(vector, apic->regs + APIC_TMR);
 
+		if (kvm_x86_ops->deliver_posted_interrupt) {
+			result = 1;
+			kvm_x86_ops->deliver_posted_interrupt(vcpu, vector);
+			trace_kvm_apic_accept_irq(vcpu->vcpu_id, delivery_mode,
+						  trig_mode, vector, false);
+			break;
+		}
+
 		result = !apic_test_and_set_irr(vector, apic);
 		trace_kvm_apic_accept_irq(vcpu->vcpu_id, delivery_mode,
 					  trig_mode, vector, !result);
@@ -416,7 +439,11 @@ static int __apic_accept_irq(struct kvm_lapic *apic, int delivery_mode,
 		break;
 
 	case APIC_DM_REMRD:
-		apic_debug("Ignoring delivery mode 3\n");
+		/* KVM_HC_KICK_CPU uses this to wake a halted vcpu */
+		result = 1;
+		vcpu->arch.pv_unhalted = true;
+		kvm_make_request(KVM_REQ_EVENT, vcpu);
+		kvm_vcpu_kick(vcpu);
 		break;
 
 	case APIC_DM_SMI:
@@ -474,10 +501,22 @@ int kvm_apic_compare_prio(struct kvm_vcpu *vcpu1, struct kvm_vcpu *vcpu2)
 	return vcpu1->arch.apic_arb_prio - vcpu2->arch.apic_arb_prio;
 }
 
+static void apic_send_eoi(struct kvm_lapic *apic, int vector)
+{
+	int trigger_mode;
+
+	if (apic_test_and_clear_vector(vector, apic->regs + APIC_TMR))
+		trigger_mode = IOAPIC_LEVEL_TRIG;
+	else
+		trigger_mode = IOAPIC_EDGE_TRIG;
+	if (!(apic_get_reg(apic, APIC_SPIV) & APIC_SPIV_DIRECTED_EOI))
+		kvm_ioapic_update_eoi(apic->vcpu->kvm, vector, trigger_mode);
+	kvm_make_request(KVM_REQ_EVENT, apic->vcpu);
+}
+
 static void apic_set_eoi(struct kvm_lapic *apic)
 {
 	int vector = apic_find_highest_isr(apic);
-	int trigger_mode;
 	/*
 	 * Not every write EOI will has corresponding ISR,
 	 * one example is when Kernel check timer on setup_IO_APIC
@@ -487,15 +526,23 @@ static void apic_set_eoi(struct kvm_lapic *apic)
 
 	apic_clear_vector(vector, apic->regs + APIC_ISR);
 	apic_update_ppr(apic);
+	if (kvm_apic_vid_enabled(apic->vcpu->kvm))
+		kvm_x86_ops->hwapic_isr_update(apic->vcpu,
+					       apic_find_highest_isr(apic));
 
-	if (apic_test_and_clear_vector(vector, apic->regs + APIC_TMR))
-		trigger_mode = IOAPIC_LEVEL_TRIG;
-	else
-		trigger_mode = IOAPIC_EDGE_TRIG;
-	if (!(apic_get_reg(apic, APIC_SPIV) & APIC_SPIV_DIRECTED_EOI))
-		kvm_ioapic_update_eoi(apic->vcpu->kvm, vector, trigger_mode);
-	kvm_make_request(KVM_REQ_EVENT, apic->vcpu);
+	apic_send_eoi(apic, vector);
+}
+
+/*
+ * EOI-induced exit with virtual interrupt delivery: the processor has
+ * already cleared the ISR bit and updated PPR, only the ioapic side is
+ * left to do.
+ */
+void kvm_apic_set_eoi_accelerated(struct kvm_vcpu *vcpu, int vector)
+{
+	apic_send_eoi(vcpu->arch.apic, vector);
 }
+EXPORT_SYMBOL_GPL(kvm_apic_set_eoi_accelerated);
 
 static void apic_send_ipi(struct kvm_lapic *apic)
 {
@@ -940,6 +987,20 @@ void kvm_lapic_set_eoi(struct kvm_vcpu *vcpu)
 }
 EXPORT_SYMBOL_GPL(kvm_lapic_set_eoi);
 
+/*
+ * APIC-write exit: the value is already in the virtual-APIC page, so
+ * read it back and run the side effects of the write.
+ */
+void kvm_apic_write_nodecode(struct kvm_vcpu *vcpu, u32 offset)
+{
+	u32 val = 0;
+
+	offset &= 0xff0;
+	apic_reg_read(vcpu->arch.apic, offset, 4, &val);
+	apic_reg_write(vcpu->arch.apic, offset, val);
+}
+EXPORT_SYMBOL_GPL(kvm_apic_write_nodecode);
+
 void kvm_free_lapic(struct kvm_vcpu *vcpu)
 {
 	if (!vcpu->arch.apic)
@@ -1071,7 +1132,13 @@ void kvm_lapic_reset(struct kvm_vcpu *vcpu)
 		apic_set_reg(apic, APIC_ISR + 0x10 * i, 0);
 		apic_set_reg(apic, APIC_TMR + 0x10 * i, 0);
 	}
-	apic->irr_pending = false;
+	/*
+	 * With virtual interrupt delivery the processor moves vectors from
+	 * IRR to ISR behind our back, so irr_pending cannot be maintained.
+	 */
+	apic->irr_pending = kvm_apic_vid_enabled(vcpu->kvm);
+	if (apic->irr_pending)
+		kvm_make_request(KVM_REQ_SCAN_IOAPIC, vcpu);
 	update_divide_count(apic);
 	atomic_set(&apic->lapic_timer.pending, 0);
 	if (kvm_vcpu_is_bsp(vcpu))
@@ -1257,6 +1324,13 @@ void kvm_apic_post_state_restore(struct kvm_vcpu *vcpu)
 	update_divide_count(apic);
 	start_apic_timer(apic);
 	apic->irr_pending = true;
+	if (kvm_apic_vid_enabled(vcpu->kvm)) {
+		kvm_x86_ops->hwapic_irr_update(vcpu,
+					       apic_find_highest_irr(apic));
+		kvm_x86_ops->hwapic_isr_update(vcpu,
+					       apic_find_highest_isr(apic));
+		kvm_make_request(KVM_REQ_SCAN_IOAPIC, vcpu);
+	}
 	kvm_make_request(KVM_REQ_EVENT, vcpu);
 }
 
@@ -3152,7 +3152,10 @@ static int interrupt_window_interception(struct vcpu_svm *svm)
 
 static int pause_interception(struct vcpu_svm *svm)
 {
-	kvm_vcpu_on_spin(&(svm->vcpu));
+	struct kvm_vcpu *vcpu = &svm->vcpu;
+
+	++vcpu->stat.pause_exits;
+	kvm_vcpu_on_spin(vcpu, svm_get_cpl(vcpu) == 0);
 	return 1;
 }
 
@@ -3469,6 +3472,11 @@ static void update_cr8_intercept(struct kvm_vcpu *vcpu, int tpr, int irr)
 		set_cr_intercept(svm, INTERCEPT_CR8_WRITE);
 }
 
+static int svm_vm_has_apicv(struct kvm *kvm)
+{
+	return 0;
+}
+
 static int svm_nmi_allowed(struct kvm_vcpu *vcpu)
 {
 	struct vcpu_svm *svm = to_svm(vcpu);
@@ -3830,6 +3838,11 @@ static void svm_vcpu_run(struct kvm_vcpu *vcpu)
 	mark_all_clean(svm->vmcb);
 }
 
+static void svm_handle_external_intr(struct kvm_vcpu *vcpu)
+{
+	local_irq_enable();
+}
+
 #undef R
 
 static void svm_set_cr3(struct kvm_vcpu *vcpu, unsigned long root)
@@ -4173,6 +4186,7 @@ static struct kvm_x86_ops svm_x86_ops = {
 	.tlb_flush = svm_flush_tlb,
 
 	.run = svm_vcpu_run,
+	.handle_external_intr = svm_handle_external_intr,
 	.handle_exit = handle_exit,
 	.skip_emulated_instruction = skip_emulated_instruction,
 	.set_interrupt_shadow = svm_set_interrupt_shadow,
@@ -4189,6 +4203,7 @@ static struct kvm_x86_ops svm_x86_ops = {
 	.enable_nmi_window = enable_nmi_window,
 	.enable_irq_window = enable_irq_window,
 	.update_cr8_intercept = update_cr8_intercept,
+	.vm_has_apicv = svm_vm_has_apicv,
 
 	.set_tss_addr = svm_set_tss_addr,
 	.get_tdp_level = get_npt_level,
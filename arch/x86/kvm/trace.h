@@ -216,6 +216,8 @@ TRACE_EVENT(kvm_apic,
 	{ EXIT_REASON_MCE_DURING_VMENTRY,	"MCE_DURING_VMENTRY" }, \
 	{ EXIT_REASON_TPR_BELOW_THRESHOLD,	"TPR_BELOW_THRESHOLD" },	\
 	{ EXIT_REASON_APIC_ACCESS,		"APIC_ACCESS" }, \
+	{ EXIT_REASON_EOI_INDUCED,		"EOI_INDUCED" }, \
+	{ EXIT_REASON_APIC_WRITE,		"APIC_WRITE" }, \
 	{ EXIT_REASON_EPT_VIOLATION,		"EPT_VIOLATION" }, \
 	{ EXIT_REASON_EPT_MISCONFIG,		"EPT_MISCONFIG" }, \
 	{ EXIT_REASON_WBINVD,			"WBINVD" }
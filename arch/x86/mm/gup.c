@@ -127,6 +127,12 @@ static noinline int gup_huge_pmd(pmd_t pmd, unsigned long addr,
 
 	refs = 0;
 	head = pte_page(pte);
+	/*
+	 * Page cache pmds map small pages, each with its own count: leave
+	 * them to the slow path.
+	 */
+	if (!PageHead(head))
+		return 0;
 	page = head + ((addr & ~PMD_MASK) >> PAGE_SHIFT);
 	do {
 		VM_BUG_ON(compound_head(page) != head);
@@ -170,6 +176,9 @@ static int gup_pmd_range(pud_t pud, unsigned long addr, unsigned long end,
 			if (!gup_huge_pmd(pmd, addr, next, write, pages, nr))
 				return 0;
 		} else {
+			/* a page table shared after fork must be unshared */
+			if (write && !pmd_write(pmd))
+				return 0;
 			if (!gup_pte_range(pmd, addr, next, write, pages, nr))
 				return 0;
 		}
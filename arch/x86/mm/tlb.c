@@ -42,7 +42,8 @@ DEFINE_PER_CPU_SHARED_ALIGNED(struct tlb_state, cpu_tlbstate)
 union smp_flush_state {
 	struct {
 		struct mm_struct *flush_mm;
-		unsigned long flush_va;
+		unsigned long flush_start;
+		unsigned long flush_end;
 		raw_spinlock_t tlbstate_lock;
 		DECLARE_BITMAP(flush_cpumask, NR_CPUS);
 	};
@@ -115,6 +116,9 @@ EXPORT_SYMBOL_GPL(leave_mm);
  * 1) Flush the tlb entries if the cpu uses the mm that's being flushed.
  * 2) Leave the mm if we are in the lazy tlb mode.
  *
+ * Range flushes do not interrupt cpus in lazy tlb mode at all, see
+ * defer_lazy_flushes().
+ *
  * Interrupts are disabled.
  */
 
@@ -160,12 +164,9 @@ void smp_invalidate_interrupt(struct pt_regs *regs)
 		 */
 
 	if (f->flush_mm == percpu_read(cpu_tlbstate.active_mm)) {
-		if (percpu_read(cpu_tlbstate.state) == TLBSTATE_OK) {
-			if (f->flush_va == TLB_FLUSH_ALL)
-				local_flush_tlb();
-			else
-				__flush_tlb_one(f->flush_va);
-		} else
+		if (percpu_read(cpu_tlbstate.state) == TLBSTATE_OK)
+			__flush_tlb_range(f->flush_start, f->flush_end);
+		else
 			leave_mm(cpu);
 	}
 out:
@@ -176,8 +177,35 @@ out:
 	inc_irq_stat(irq_tlb_count);
 }
 
+/*
+ * A cpu in lazy tlb mode only uses the user part of @mm once it
+ * switches back to it, so instead of an IPI it gets a flag telling
+ * switch_mm() to flush its TLB then. This is only done for range
+ * flushes: once page tables are freed the lazy cpu has to let go of
+ * them right away, which leave_mm() in the IPI does.
+ */
+static void defer_lazy_flushes(struct cpumask *cpumask, struct mm_struct *mm)
+{
+	unsigned int cpu;
+
+	for_each_cpu(cpu, cpumask) {
+		struct tlb_state *ts = &per_cpu(cpu_tlbstate, cpu);
+
+		if (ACCESS_ONCE(ts->state) != TLBSTATE_LAZY)
+			continue;
+
+		ts->lazy_flush = 1;
+		/* pairs with the test_and_set in switch_mm() */
+		smp_mb();
+		if (ACCESS_ONCE(ts->state) == TLBSTATE_LAZY &&
+		    ACCESS_ONCE(ts->active_mm) == mm)
+			cpumask_clear_cpu(cpu, cpumask);
+	}
+}
+
 static void flush_tlb_others_ipi(const struct cpumask *cpumask,
-				 struct mm_struct *mm, unsigned long va)
+				 struct mm_struct *mm, unsigned long start,
+				 unsigned long end)
 {
 	unsigned int sender;
 	union smp_flush_state *f;
@@ -190,8 +218,12 @@ static void flush_tlb_others_ipi(const struct cpumask *cpumask,
 		raw_spin_lock(&f->tlbstate_lock);
 
 	f->flush_mm = mm;
-	f->flush_va = va;
-	if (cpumask_andnot(to_cpumask(f->flush_cpumask), cpumask, cpumask_of(smp_processor_id()))) {
+	f->flush_start = start;
+	f->flush_end = end;
+	if (cpumask_andnot(to_cpumask(f->flush_cpumask), cpumask, cpumask_of(smp_processor_id())) &&
+	    end != TLB_FLUSH_ALL)
+		defer_lazy_flushes(to_cpumask(f->flush_cpumask), mm);
+	if (!cpumask_empty(to_cpumask(f->flush_cpumask))) {
 		/*
 		 * We have to send the IPI only to
 		 * CPUs affected.
@@ -204,24 +236,31 @@ static void flush_tlb_others_ipi(const struct cpumask *cpumask,
 	}
 
 	f->flush_mm = NULL;
-	f->flush_va = 0;
+	f->flush_start = 0;
+	f->flush_end = 0;
 	if (nr_cpu_ids > NUM_INVALIDATE_TLB_VECTORS)
 		raw_spin_unlock(&f->tlbstate_lock);
 }
 
 void native_flush_tlb_others(const struct cpumask *cpumask,
-			     struct mm_struct *mm, unsigned long va)
+			     struct mm_struct *mm, unsigned long start,
+			     unsigned long end)
 {
 	if (is_uv_system()) {
 		unsigned int cpu;
+		unsigned long va = TLB_FLUSH_ALL;
+
+		/* the BAU flushes a single page or everything */
+		if (end != TLB_FLUSH_ALL && end - start == PAGE_SIZE)
+			va = start;
 
 		cpu = smp_processor_id();
 		cpumask = uv_flush_tlb_others(cpumask, mm, va, cpu);
 		if (cpumask)
-			flush_tlb_others_ipi(cpumask, mm, va);
+			flush_tlb_others_ipi(cpumask, mm, start, end);
 		return;
 	}
-	flush_tlb_others_ipi(cpumask, mm, va);
+	flush_tlb_others_ipi(cpumask, mm, start, end);
 }
 
 static void __cpuinit calculate_tlb_offset(void)
@@ -287,43 +326,40 @@ void flush_tlb_current_task(void)
 
 	local_flush_tlb();
 	if (cpumask_any_but(mm_cpumask(mm), smp_processor_id()) < nr_cpu_ids)
-		flush_tlb_others(mm_cpumask(mm), mm, TLB_FLUSH_ALL);
+		flush_tlb_others(mm_cpumask(mm), mm, 0UL, TLB_FLUSH_ALL);
 	preempt_enable();
 }
 
-void flush_tlb_mm(struct mm_struct *mm)
+/*
+ * Flush [start, end) of @mm, or all of it, and any freed page tables,
+ * when @end is TLB_FLUSH_ALL. Callers batch as much as they can into
+ * one call; the mmu_gather does so for a whole unmap.
+ */
+void flush_tlb_mm_range(struct mm_struct *mm, unsigned long start,
+			unsigned long end)
 {
 	preempt_disable();
 
 	if (current->active_mm == mm) {
 		if (current->mm)
-			local_flush_tlb();
+			__flush_tlb_range(start, end);
 		else
 			leave_mm(smp_processor_id());
 	}
 	if (cpumask_any_but(mm_cpumask(mm), smp_processor_id()) < nr_cpu_ids)
-		flush_tlb_others(mm_cpumask(mm), mm, TLB_FLUSH_ALL);
+		flush_tlb_others(mm_cpumask(mm), mm, start, end);
 
 	preempt_enable();
 }
 
-void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
+void flush_tlb_mm(struct mm_struct *mm)
 {
-	struct mm_struct *mm = vma->vm_mm;
-
-	preempt_disable();
-
-	if (current->active_mm == mm) {
-		if (current->mm)
-			__flush_tlb_one(va);
-		else
-			leave_mm(smp_processor_id());
-	}
-
-	if (cpumask_any_but(mm_cpumask(mm), smp_processor_id()) < nr_cpu_ids)
-		flush_tlb_others(mm_cpumask(mm), mm, va);
+	flush_tlb_mm_range(mm, 0UL, TLB_FLUSH_ALL);
+}
 
-	preempt_enable();
+void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
+{
+	flush_tlb_mm_range(vma->vm_mm, va, va + PAGE_SIZE);
 }
 
 static void do_flush_tlb_all(void *info)
@@ -11,6 +11,8 @@
 #include <asm/cacheflush.h>
 #include <linux/netdevice.h>
 #include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <net/netlink.h>
 
 /*
  * Conventions :
@@ -106,6 +108,70 @@ do {								\
 #define SEEN_DATAREF 1 /* might call external helpers */
 #define SEEN_XREG    2 /* ebx is used */
 #define SEEN_MEM     4 /* use mem[] for temporary storage */
+#define SEEN_CALL    8 /* calls a C helper, needs an aligned frame */
+
+#define PKT_TYPE_MAX 7
+
+/* pkt_type is a bitfield, find the byte holding it */
+static int pkt_type_offset(void)
+{
+	struct sk_buff skb_probe = { .pkt_type = ~0, };
+	u8 *ct = (u8 *)&skb_probe;
+	unsigned int off;
+
+	for (off = 0; off < sizeof(struct sk_buff); off++) {
+		if (ct[off] == PKT_TYPE_MAX)
+			return off;
+	}
+	pr_err_once("Please fix %s, as pkt_type couldn't be found!\n", __func__);
+	return -1;
+}
+
+/*
+ * Out of line helpers for the netlink attribute loads.  They return 0
+ * where sk_run_filter() aborts the filter, else 1 << 32 | new A.
+ */
+static u64 bpf_jit_nlattr(const struct sk_buff *skb, u32 A, u32 X)
+{
+	struct nlattr *nla;
+
+	if (skb_is_nonlinear(skb))
+		return 0;
+	if (skb->len < sizeof(struct nlattr))
+		return 0;
+	if (A > skb->len - sizeof(struct nlattr))
+		return 0;
+
+	nla = nla_find((struct nlattr *)&skb->data[A], skb->len - A, X);
+	if (nla)
+		A = (void *)nla - (void *)skb->data;
+	else
+		A = 0;
+	return (1ULL << 32) | A;
+}
+
+static u64 bpf_jit_nlattr_nest(const struct sk_buff *skb, u32 A, u32 X)
+{
+	struct nlattr *nla;
+
+	if (skb_is_nonlinear(skb))
+		return 0;
+	if (skb->len < sizeof(struct nlattr))
+		return 0;
+	if (A > skb->len - sizeof(struct nlattr))
+		return 0;
+
+	nla = (struct nlattr *)&skb->data[A];
+	if (nla->nla_len > skb->len - A)
+		return 0;
+
+	nla = nla_find_nested(nla, X);
+	if (nla)
+		A = (void *)nla - (void *)skb->data;
+	else
+		A = 0;
+	return (1ULL << 32) | A;
+}
 
 static inline void bpf_flush_icache(void *start, void *end)
 {
@@ -120,7 +186,7 @@ static inline void bpf_flush_icache(void *start, void *end)
 
 void bpf_jit_compile(struct sk_filter *fp)
 {
-	u8 temp[64];
+	u8 temp[128];
 	u8 *prog;
 	unsigned int proglen, oldproglen = 0;
 	int ilen, i;
@@ -151,7 +217,7 @@ void bpf_jit_compile(struct sk_filter *fp)
 	cleanup_addr = proglen; /* epilogue address */
 
 	for (pass = 0; pass < 10; pass++) {
-		u8 seen_or_pass0 = (pass == 0) ? (SEEN_XREG | SEEN_DATAREF | SEEN_MEM) : seen;
+		u8 seen_or_pass0 = (pass == 0) ? (SEEN_XREG | SEEN_DATAREF | SEEN_MEM | SEEN_CALL) : seen;
 		/* no prologue/epilogue for trivial filters (RET something) */
 		proglen = 0;
 		prog = temp;
@@ -203,11 +269,14 @@ void bpf_jit_compile(struct sk_filter *fp)
 		case BPF_S_RET_K:
 		case BPF_S_LD_W_LEN:
 		case BPF_S_ANC_PROTOCOL:
+		case BPF_S_ANC_PKTTYPE:
 		case BPF_S_ANC_IFINDEX:
+		case BPF_S_ANC_HATYPE:
 		case BPF_S_ANC_MARK:
 		case BPF_S_ANC_RXHASH:
 		case BPF_S_ANC_CPU:
 		case BPF_S_ANC_QUEUE:
+		case BPF_S_ANC_SECCOMP_LD_W:
 		case BPF_S_LD_W_ABS:
 		case BPF_S_LD_H_ABS:
 		case BPF_S_LD_B_ABS:
@@ -420,7 +489,23 @@ void bpf_jit_compile(struct sk_filter *fp)
 				}
 				EMIT2(0x86, 0xc4); /* ntohs() : xchg   %al,%ah */
 				break;
+			case BPF_S_ANC_PKTTYPE: {
+				int off = pkt_type_offset();
+
+				if (off < 0)
+					goto out;
+				if (is_imm8(off)) {
+					/* movzbl off8(%rdi),%eax */
+					EMIT4(0x0f, 0xb6, 0x47, off);
+				} else {
+					EMIT3(0x0f, 0xb6, 0x87); /* movzbl off32(%rdi),%eax */
+					EMIT(off, 4);
+				}
+				EMIT3(0x83, 0xe0, PKT_TYPE_MAX); /* and $7,%eax */
+				break;
+			}
 			case BPF_S_ANC_IFINDEX:
+			case BPF_S_ANC_HATYPE:
 				if (is_imm8(offsetof(struct sk_buff, dev))) {
 					/* movq off8(%rdi),%rax */
 					EMIT4(0x48, 0x8b, 0x47, offsetof(struct sk_buff, dev));
@@ -429,11 +514,51 @@ void bpf_jit_compile(struct sk_filter *fp)
 					EMIT(offsetof(struct sk_buff, dev), 4);
 				}
 				EMIT3(0x48, 0x85, 0xc0);	/* test %rax,%rax */
-				EMIT_COND_JMP(X86_JE, cleanup_addr - (addrs[i] - 6));
-				BUILD_BUG_ON(FIELD_SIZEOF(struct net_device, ifindex) != 4);
-				EMIT2(0x8b, 0x80);	/* mov off32(%rax),%eax */
-				EMIT(offsetof(struct net_device, ifindex), 4);
+				if (filter[i].code == BPF_S_ANC_IFINDEX) {
+					EMIT_COND_JMP(X86_JE, cleanup_addr - (addrs[i] - 6));
+					BUILD_BUG_ON(FIELD_SIZEOF(struct net_device, ifindex) != 4);
+					EMIT2(0x8b, 0x80);	/* mov off32(%rax),%eax */
+					EMIT(offsetof(struct net_device, ifindex), 4);
+				} else {
+					EMIT_COND_JMP(X86_JE, cleanup_addr - (addrs[i] - 7));
+					BUILD_BUG_ON(FIELD_SIZEOF(struct net_device, type) != 2);
+					EMIT3(0x0f, 0xb7, 0x80); /* movzwl off32(%rax),%eax */
+					EMIT(offsetof(struct net_device, type), 4);
+				}
+				break;
+			case BPF_S_ANC_NLATTR:
+			case BPF_S_ANC_NLATTR_NEST:
+				seen |= SEEN_XREG | SEEN_CALL;
+				if (filter[i].code == BPF_S_ANC_NLATTR)
+					func = (u8 *)bpf_jit_nlattr;
+				else
+					func = (u8 *)bpf_jit_nlattr_nest;
+				EMIT1(0x57);			/* push %rdi */
+				EMIT2(0x41, 0x50);		/* push %r8 */
+				EMIT2(0x41, 0x51);		/* push %r9 */
+				EMIT4(0x48, 0x83, 0xec, 0x08);	/* sub $8,%rsp */
+				EMIT2(0x89, 0xc6);		/* mov %eax,%esi */
+				EMIT2(0x89, 0xda);		/* mov %ebx,%edx */
+				t_offset = func - (image + proglen + (prog - temp) + 5);
+				EMIT1_off32(0xe8, t_offset);	/* call bpf_jit_nlattr* */
+				EMIT4(0x48, 0x83, 0xc4, 0x08);	/* add $8,%rsp */
+				EMIT2(0x41, 0x59);		/* pop %r9 */
+				EMIT2(0x41, 0x58);		/* pop %r8 */
+				EMIT1(0x5f);			/* pop %rdi */
+				EMIT3(0x48, 0x85, 0xc0);	/* test %rax,%rax */
+				EMIT_COND_JMP(X86_JE, cleanup_addr - (addrs[i] - 2));
+				EMIT2(0x89, 0xc0);		/* mov %eax,%eax */
+				break;
+#ifdef CONFIG_SECCOMP_FILTER
+			case BPF_S_ANC_SECCOMP_LD_W:
+				/* A = seccomp_bpf_load(K), skb is NULL here */
+				seen |= SEEN_CALL;
+				func = (u8 *)seccomp_bpf_load;
+				t_offset = func - (image + addrs[i]);
+				EMIT1_off32(0xbf, K);		/* mov imm32,%edi */
+				EMIT1_off32(0xe8, t_offset);	/* call seccomp_bpf_load */
 				break;
+#endif
 			case BPF_S_ANC_MARK:
 				BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, mark) != 4);
 				if (is_imm8(offsetof(struct sk_buff, mark))) {
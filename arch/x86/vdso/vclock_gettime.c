@@ -70,16 +70,25 @@ notrace static long vdso_fallback_gettime(long clock, struct timespec *ts)
 	return ret;
 }
 
-notrace static inline long vgetns(void)
+notrace static inline long vgetcycles(void)
 {
-	long v;
 	cycles_t cycles;
 	if (gtod->clock.vclock_mode == VCLOCK_TSC)
 		cycles = vread_tsc();
 	else
 		cycles = vread_hpet();
-	v = (cycles - gtod->clock.cycle_last) & gtod->clock.mask;
-	return (v * gtod->clock.mult) >> gtod->clock.shift;
+	return (cycles - gtod->clock.cycle_last) & gtod->clock.mask;
+}
+
+notrace static inline long vgetns(void)
+{
+	return (vgetcycles() * gtod->clock.mult) >> gtod->clock.shift;
+}
+
+/* Not NTP adjusted, as for CLOCK_MONOTONIC_RAW */
+notrace static inline long vgetns_raw(void)
+{
+	return (vgetcycles() * gtod->clock.raw_mult) >> gtod->clock.shift;
 }
 
 notrace static noinline int do_realtime(struct timespec *ts)
@@ -119,6 +128,51 @@ notrace static noinline int do_monotonic(struct timespec *ts)
 	return 0;
 }
 
+notrace static noinline int do_monotonic_raw(struct timespec *ts)
+{
+	unsigned long seq, ns, secs;
+	do {
+		seq = read_seqbegin(&gtod->lock);
+		secs = gtod->raw_time.tv_sec;
+		ns = gtod->raw_time.tv_nsec + vgetns_raw();
+	} while (unlikely(read_seqretry(&gtod->lock, seq)));
+
+	while (ns >= NSEC_PER_SEC) {
+		ns -= NSEC_PER_SEC;
+		++secs;
+	}
+	ts->tv_sec = secs;
+	ts->tv_nsec = ns;
+
+	return 0;
+}
+
+notrace static noinline int do_boottime(struct timespec *ts)
+{
+	unsigned long seq, ns, secs;
+	do {
+		seq = read_seqbegin(&gtod->lock);
+		secs = gtod->wall_time_sec;
+		ns = gtod->wall_time_nsec + vgetns();
+		secs += gtod->wall_to_monotonic.tv_sec;
+		ns += gtod->wall_to_monotonic.tv_nsec;
+		secs += gtod->monotonic_to_boot.tv_sec;
+		ns += gtod->monotonic_to_boot.tv_nsec;
+	} while (unlikely(read_seqretry(&gtod->lock, seq)));
+
+	/* All of the nanosecond parts are nonnegative, as for
+	 * do_monotonic().
+	 */
+	while (ns >= NSEC_PER_SEC) {
+		ns -= NSEC_PER_SEC;
+		++secs;
+	}
+	ts->tv_sec = secs;
+	ts->tv_nsec = ns;
+
+	return 0;
+}
+
 notrace static noinline int do_realtime_coarse(struct timespec *ts)
 {
 	unsigned long seq;
@@ -165,6 +219,14 @@ notrace int __vdso_clock_gettime(clockid_t clock, struct timespec *ts)
 		if (likely(gtod->clock.vclock_mode != VCLOCK_NONE))
 			return do_monotonic(ts);
 		break;
+	case CLOCK_MONOTONIC_RAW:
+		if (likely(gtod->clock.vclock_mode != VCLOCK_NONE))
+			return do_monotonic_raw(ts);
+		break;
+	case CLOCK_BOOTTIME:
+		if (likely(gtod->clock.vclock_mode != VCLOCK_NONE))
+			return do_boottime(ts);
+		break;
 	case CLOCK_REALTIME_COARSE:
 		return do_realtime_coarse(ts);
 	case CLOCK_MONOTONIC_COARSE:
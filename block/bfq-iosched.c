@@ -0,0 +1,1594 @@
+/*
+ *  BFQ, or budget fair queueing, disk scheduler.
+ *
+ *  Like CFQ, every process gets its own queue, but queues are served one
+ *  at a time for a budget of sectors instead of a time slice.  The next
+ *  queue is picked by B-WF2Q+ (eligible queue with the smallest virtual
+ *  finish time), so each gets a share of the disk throughput in
+ *  proportion to its weight, whatever its request pattern.  Sync queues
+ *  of interactive and soft real-time processes have their weight raised
+ *  for a while, which keeps them responsive next to streaming readers
+ *  and writers.
+ *
+ *  See Documentation/block/bfq-iosched.txt
+ */
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/blkdev.h>
+#include <linux/elevator.h>
+#include <linux/jiffies.h>
+#include <linux/rbtree.h>
+#include <linux/ioprio.h>
+#include <linux/hash.h>
+#include "blk-cgroup.h"
+
+/*
+ * tunables
+ */
+/* max requests of the in-service queue in the driver */
+static const int bfq_quantum = 8;
+static const int bfq_fifo_expire[2] = { HZ / 4, HZ / 8 };
+static int bfq_slice_idle = HZ / 125;
+/* max budget, in sectors */
+static const int bfq_max_budget = 16 * 1024;
+/* max time a queue may take to use its budget */
+static const int bfq_timeout_sync = HZ / 8;
+static int bfq_timeout_async = HZ / 25;
+/* weight raising */
+static const int bfq_wr_coeff = 20;
+static const int bfq_wr_max_time = 6 * HZ;
+static const int bfq_wr_rt_max_time = HZ * 3 / 10;
+static const int bfq_wr_min_idle_time = 2 * HZ;
+/* sectors per second */
+static const int bfq_wr_max_softrt_rate = 7000;
+
+#define BFQ_HASH_SHIFT		6
+#define BFQ_HASH_SIZE		(1 << BFQ_HASH_SHIFT)
+#define BFQ_HW_QUEUE_MIN	(5)
+#define BFQ_SERVICE_SHIFT	22
+#define BFQ_WEIGHT_PER_PRIO	10
+/* min budget is max budget >> this */
+#define BFQ_MIN_BUDGET_SHIFT	5
+
+#define BFQQ_SEEK_THR		(sector_t)(8 * 100)
+#define BFQQ_SEEKY(bfqq)	(hweight32(bfqq->seek_history) > 32/8)
+
+#define RQ_BFQQ(rq)		(struct bfq_queue *) ((rq)->elevator_private[0])
+#define RQ_IOC(rq)		\
+	((struct io_context *) (rq)->elevator_private[1])
+
+/*
+ * Sync queues are keyed by io_context, async ones are shared per ioprio
+ * and looked up by a key that can't be a pointer.
+ */
+#define BFQ_ASYNC_KEY(class, prio)	((((class) << 3 | (prio)) << 1) | 1)
+
+/* service trees, one per ioprio class: rt, be, idle */
+#define BFQ_NR_CLASSES		3
+
+#define bfq_class_idle(bfqq)	((bfqq)->ioprio_class == IOPRIO_CLASS_IDLE)
+
+static struct kmem_cache *bfq_pool;
+
+/*
+ * Busy queues of one ioprio class, sorted by virtual finish time.
+ */
+struct bfq_service_tree {
+	struct rb_root tree;
+	/* virtual time, advanced by service over the sum of weights */
+	u64 vtime;
+	/* weights of the busy queues, the one in service included */
+	unsigned long wsum;
+};
+
+/*
+ * Per process-grouping structure
+ */
+struct bfq_queue {
+	/* reference count: the hash, plus one per allocated request */
+	int ref;
+	/* various state flags, see below */
+	unsigned int flags;
+	/* parent bfq_data */
+	struct bfq_data *bfqd;
+	/* queue_hash member, and its key */
+	struct hlist_node hash_node;
+	unsigned long key;
+	pid_t pid;
+
+	/* sorted list of pending requests */
+	struct rb_root sort_list;
+	/* if fifo isn't expired, next request to serve */
+	struct request *next_rq;
+	/* requests queued in sort_list */
+	int queued[2];
+	/* currently allocated requests */
+	int allocated[2];
+	/* fifo list of requests in sort_list */
+	struct list_head fifo;
+	/* number of requests that are on the dispatch list or inside driver */
+	int dispatched;
+
+	/* io prio and blkio cgroup weight, as of the last request */
+	unsigned short ioprio, ioprio_class;
+	unsigned int cg_weight;
+
+	/* service tree member, and the class of the tree it is counted in */
+	struct rb_node rb_node;
+	unsigned short st_class;
+	/* virtual start and finish time */
+	u64 start, finish;
+	/* weight in use, raised or not */
+	unsigned int weight;
+	/* sectors it may dispatch per turn, and how many it did this turn */
+	unsigned int budget;
+	unsigned int service;
+	unsigned long budget_timeout;
+
+	/* weight raising */
+	unsigned int wr_coeff;
+	unsigned long wr_start;
+	unsigned long wr_duration;
+	/* when it last became busy, and last went idle */
+	unsigned long last_busy;
+	unsigned long last_idle;
+	/* sectors dispatched since last_busy */
+	unsigned long service_from_busy;
+	/* may be raised as soft real-time if it gets busy after this */
+	unsigned long soft_rt_next_start;
+
+	/* seek and think time, to decide about idling */
+	sector_t last_request_pos;
+	u32 seek_history;
+	unsigned long last_end_request;
+	unsigned long ttime_mean;
+};
+
+/*
+ * Per block device queue structure
+ */
+struct bfq_data {
+	struct request_queue *queue;
+
+	struct bfq_service_tree st[BFQ_NR_CLASSES];
+	struct bfq_queue *in_service_queue;
+	unsigned int busy_queues;
+
+	int queued;
+	int rq_in_driver;
+	sector_t last_position;
+
+	/* does the device queue requests itself, -1 while unknown */
+	int hw_tag;
+	int hw_tag_samples;
+	int max_rq_in_driver;
+
+	struct hlist_head queue_hash[BFQ_HASH_SIZE];
+	unsigned long last_gc;
+	dev_t devt;
+
+	/*
+	 * idle window management
+	 */
+	struct timer_list idle_slice_timer;
+	struct work_struct unplug_work;
+
+	/*
+	 * tunables, see top of file
+	 */
+	unsigned int bfq_quantum;
+	unsigned int bfq_fifo_expire[2];
+	unsigned int bfq_slice_idle;
+	unsigned int bfq_max_budget;
+	unsigned int bfq_timeout[2];
+	unsigned int bfq_low_latency;
+	unsigned int bfq_wr_coeff;
+	unsigned int bfq_wr_max_time;
+	unsigned int bfq_wr_rt_max_time;
+	unsigned int bfq_wr_min_idle_time;
+	unsigned int bfq_wr_max_softrt_rate;
+
+	/*
+	 * Fallback dummy bfqq for extreme OOM conditions
+	 */
+	struct bfq_queue oom_bfqq;
+};
+
+enum bfqq_state_flags {
+	BFQ_BFQQ_FLAG_busy = 0,		/* on a service tree or in service */
+	BFQ_BFQQ_FLAG_wait_request,	/* waiting on the idle timer */
+	BFQ_BFQQ_FLAG_idle_window,	/* worth idling for */
+	BFQ_BFQQ_FLAG_sync,		/* synchronous queue */
+	BFQ_BFQQ_FLAG_fifo_expire,	/* fifo checked this turn */
+	BFQ_BFQQ_FLAG_new,		/* never been busy */
+};
+
+#define BFQ_BFQQ_FNS(name)						\
+static inline void bfq_mark_bfqq_##name(struct bfq_queue *bfqq)		\
+{									\
+	(bfqq)->flags |= (1 << BFQ_BFQQ_FLAG_##name);			\
+}									\
+static inline void bfq_clear_bfqq_##name(struct bfq_queue *bfqq)	\
+{									\
+	(bfqq)->flags &= ~(1 << BFQ_BFQQ_FLAG_##name);			\
+}									\
+static inline int bfq_bfqq_##name(const struct bfq_queue *bfqq)		\
+{									\
+	return ((bfqq)->flags & (1 << BFQ_BFQQ_FLAG_##name)) != 0;	\
+}
+
+BFQ_BFQQ_FNS(busy);
+BFQ_BFQQ_FNS(wait_request);
+BFQ_BFQQ_FNS(idle_window);
+BFQ_BFQQ_FNS(sync);
+BFQ_BFQQ_FNS(fifo_expire);
+BFQ_BFQQ_FNS(new);
+#undef BFQ_BFQQ_FNS
+
+/* why the in-service queue lost the disk */
+enum bfqq_expiration {
+	BFQ_EXP_TOO_IDLE,		/* idle timer fired, nothing came */
+	BFQ_EXP_NO_MORE_REQ,		/* ran dry and not worth idling */
+	BFQ_EXP_BUDGET_TIMEOUT,		/* too slow using its budget */
+	BFQ_EXP_BUDGET_EXHAUSTED,	/* next request doesn't fit */
+	BFQ_EXP_FORCED,			/* drain, exit or preemption */
+};
+
+static inline bool bfq_bio_sync(struct bio *bio)
+{
+	return bio_data_dir(bio) == READ || (bio->bi_rw & REQ_SYNC);
+}
+
+static inline bool bfq_gt(u64 a, u64 b)
+{
+	return (s64)(a - b) > 0;
+}
+
+static inline struct bfq_service_tree *
+bfqq_st(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	return &bfqd->st[bfqq->st_class - IOPRIO_CLASS_RT];
+}
+
+/* virtual time it takes to serve @service sectors at @weight */
+static inline u64 bfq_delta(unsigned long service, unsigned long weight)
+{
+	return div_u64((u64) service << BFQ_SERVICE_SHIFT, weight);
+}
+
+static inline unsigned int bfq_min_budget(struct bfq_data *bfqd)
+{
+	return max(bfqd->bfq_max_budget >> BFQ_MIN_BUDGET_SHIFT, 1U);
+}
+
+static inline unsigned int bfq_budget_left(struct bfq_queue *bfqq)
+{
+	return bfqq->budget > bfqq->service ? bfqq->budget - bfqq->service : 0;
+}
+
+static inline void bfq_schedule_dispatch(struct bfq_data *bfqd)
+{
+	if (bfqd->busy_queues)
+		kblockd_schedule_work(bfqd->queue, &bfqd->unplug_work);
+}
+
+static void bfq_st_insert(struct bfq_service_tree *st, struct bfq_queue *bfqq)
+{
+	struct rb_node **p = &st->tree.rb_node;
+	struct rb_node *parent = NULL;
+	struct bfq_queue *__bfqq;
+
+	while (*p) {
+		parent = *p;
+		__bfqq = rb_entry(parent, struct bfq_queue, rb_node);
+
+		if (bfq_gt(__bfqq->finish, bfqq->finish))
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	rb_link_node(&bfqq->rb_node, parent, p);
+	rb_insert_color(&bfqq->rb_node, &st->tree);
+}
+
+static void bfq_st_remove(struct bfq_service_tree *st, struct bfq_queue *bfqq)
+{
+	if (!RB_EMPTY_NODE(&bfqq->rb_node)) {
+		rb_erase(&bfqq->rb_node, &st->tree);
+		RB_CLEAR_NODE(&bfqq->rb_node);
+	}
+}
+
+/*
+ * The eligible queue (virtual start not after the virtual time) with the
+ * smallest finish time.  If none is eligible yet, the virtual time jumps
+ * ahead to the earliest start: the disk must not sit idle.
+ */
+static struct bfq_queue *bfq_st_lookup(struct bfq_service_tree *st)
+{
+	struct bfq_queue *bfqq, *first = NULL;
+	struct rb_node *n;
+
+	for (n = rb_first(&st->tree); n; n = rb_next(n)) {
+		bfqq = rb_entry(n, struct bfq_queue, rb_node);
+		if (!bfq_gt(bfqq->start, st->vtime))
+			return bfqq;
+		if (!first || bfq_gt(first->start, bfqq->start))
+			first = bfqq;
+	}
+
+	if (first)
+		st->vtime = first->start;
+	return first;
+}
+
+/*
+ * Weight from the ioprio level and the blkio cgroup, before raising.
+ */
+static unsigned int bfq_orig_weight(struct bfq_queue *bfqq)
+{
+	unsigned int weight = (IOPRIO_BE_NR - bfqq->ioprio) *
+				BFQ_WEIGHT_PER_PRIO;
+
+	return max(weight * bfqq->cg_weight / BLKIO_WEIGHT_DEFAULT, 1U);
+}
+
+/*
+ * Apply ioprio, cgroup and weight raising changes.  Only called while
+ * @bfqq is not on a service tree: its timestamps are about to be
+ * recomputed anyway.
+ */
+static void bfq_update_entity(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_service_tree *st;
+
+	if (bfqq->wr_coeff > 1 && (!bfqd->bfq_low_latency ||
+	    time_after(jiffies, bfqq->wr_start + bfqq->wr_duration)))
+		bfqq->wr_coeff = 1;
+
+	if (bfq_bfqq_busy(bfqq))
+		bfqq_st(bfqd, bfqq)->wsum -= bfqq->weight;
+
+	if (bfqq->st_class != bfqq->ioprio_class) {
+		bfqq->st_class = bfqq->ioprio_class;
+		/* old timestamps mean nothing in the new class */
+		bfqq->finish = bfqq_st(bfqd, bfqq)->vtime;
+	}
+	bfqq->weight = bfq_orig_weight(bfqq) * bfqq->wr_coeff;
+
+	st = bfqq_st(bfqd, bfqq);
+	if (bfq_bfqq_busy(bfqq))
+		st->wsum += bfqq->weight;
+}
+
+/*
+ * A sync queue getting busy after a long pause, or for the first time,
+ * most likely belongs to a task the user is waiting for: raise its
+ * weight for a few seconds.  One that comes back at short intervals but
+ * asks for little bandwidth each time (audio, video) is soft real-time
+ * and gets raised for a shorter period, renewed as long as it behaves.
+ */
+static void bfq_weight_raise(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	bool interactive, soft_rt;
+
+	if (!bfqd->bfq_low_latency || !bfq_bfqq_sync(bfqq) ||
+	    bfq_class_idle(bfqq))
+		return;
+
+	interactive = bfq_bfqq_new(bfqq) ||
+		time_after(jiffies, bfqq->last_idle +
+				    bfqd->bfq_wr_min_idle_time);
+	soft_rt = bfqd->bfq_wr_max_softrt_rate &&
+		time_after(jiffies, bfqq->soft_rt_next_start);
+
+	if (interactive) {
+		bfqq->wr_coeff = bfqd->bfq_wr_coeff;
+		bfqq->wr_duration = bfqd->bfq_wr_max_time;
+		bfqq->wr_start = jiffies;
+	} else if (soft_rt && (bfqq->wr_coeff == 1 ||
+		   bfqq->wr_duration == bfqd->bfq_wr_rt_max_time)) {
+		bfqq->wr_coeff = bfqd->bfq_wr_coeff;
+		bfqq->wr_duration = bfqd->bfq_wr_rt_max_time;
+		bfqq->wr_start = jiffies;
+	}
+}
+
+static void bfq_add_bfqq_busy(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_service_tree *st;
+
+	BUG_ON(bfq_bfqq_busy(bfqq));
+
+	bfq_weight_raise(bfqd, bfqq);
+	bfq_update_entity(bfqd, bfqq);
+	st = bfqq_st(bfqd, bfqq);
+
+	/*
+	 * A queue that was idle for a while gets no credit for it: start at
+	 * the current virtual time.
+	 */
+	if (bfq_bfqq_new(bfqq) || !bfq_gt(bfqq->finish, st->vtime))
+		bfqq->start = st->vtime;
+	else
+		bfqq->start = bfqq->finish;
+	bfqq->finish = bfqq->start + bfq_delta(bfqq->budget, bfqq->weight);
+	bfq_st_insert(st, bfqq);
+
+	st->wsum += bfqq->weight;
+	bfqd->busy_queues++;
+	bfq_mark_bfqq_busy(bfqq);
+	bfq_clear_bfqq_new(bfqq);
+
+	bfqq->last_busy = jiffies;
+	bfqq->service_from_busy = 0;
+}
+
+static void bfq_del_bfqq_busy(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	struct bfq_service_tree *st = bfqq_st(bfqd, bfqq);
+
+	BUG_ON(!bfq_bfqq_busy(bfqq));
+
+	bfq_st_remove(st, bfqq);
+	st->wsum -= bfqq->weight;
+	BUG_ON(!bfqd->busy_queues);
+	bfqd->busy_queues--;
+	bfq_clear_bfqq_busy(bfqq);
+
+	bfqq->last_idle = jiffies;
+
+	/*
+	 * Soft real-time means the queue did not ask for more than
+	 * bfq_wr_max_softrt_rate since it became busy.  It can't be that
+	 * if it's back before the rate allows, nor right after an idle
+	 * window (it would be greedy, but just slower than the disk).
+	 */
+	if (bfqd->bfq_wr_max_softrt_rate) {
+		unsigned long next = bfqq->last_busy +
+			div_u64((u64) HZ * bfqq->service_from_busy,
+				bfqd->bfq_wr_max_softrt_rate);
+		unsigned long min_next = jiffies + bfqd->bfq_slice_idle + 4;
+
+		bfqq->soft_rt_next_start = time_after(next, min_next) ?
+						next : min_next;
+	}
+}
+
+/*
+ * Lifted from AS - choose which of rq1 and rq2 that is best served now.
+ * Sync and meta first, then C-LOOK from the last position.
+ */
+static struct request *
+bfq_choose_req(struct bfq_data *bfqd, struct request *rq1, struct request *rq2)
+{
+	sector_t last = bfqd->last_position, s1, s2;
+
+	if (rq1 == NULL || rq1 == rq2)
+		return rq2;
+	if (rq2 == NULL)
+		return rq1;
+
+	if (rq_is_sync(rq1) != rq_is_sync(rq2))
+		return rq_is_sync(rq1) ? rq1 : rq2;
+
+	if ((rq1->cmd_flags ^ rq2->cmd_flags) & REQ_META)
+		return rq1->cmd_flags & REQ_META ? rq1 : rq2;
+
+	s1 = blk_rq_pos(rq1);
+	s2 = blk_rq_pos(rq2);
+
+	if (s1 >= last && s2 >= last)
+		return s1 <= s2 ? rq1 : rq2;
+	if (s1 >= last)
+		return rq1;
+	if (s2 >= last)
+		return rq2;
+	return s1 <= s2 ? rq1 : rq2;
+}
+
+/*
+ * would be nice to take fifo expire time into account as well
+ */
+static struct request *
+bfq_find_next_rq(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+		 struct request *last)
+{
+	struct rb_node *rbnext = rb_next(&last->rb_node);
+	struct rb_node *rbprev = rb_prev(&last->rb_node);
+	struct request *next = NULL, *prev = NULL;
+
+	if (rbprev)
+		prev = rb_entry_rq(rbprev);
+
+	if (rbnext)
+		next = rb_entry_rq(rbnext);
+	else {
+		rbnext = rb_first(&bfqq->sort_list);
+		if (rbnext && rbnext != &last->rb_node)
+			next = rb_entry_rq(rbnext);
+	}
+
+	return bfq_choose_req(bfqd, next, prev);
+}
+
+static void bfq_add_rq_rb(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	bfqq->queued[rq_is_sync(rq)]++;
+	elv_rb_add(&bfqq->sort_list, rq);
+
+	bfqq->next_rq = bfq_choose_req(bfqd, bfqq->next_rq, rq);
+
+	if (!bfq_bfqq_busy(bfqq))
+		bfq_add_bfqq_busy(bfqd, bfqq);
+}
+
+static void bfq_remove_request(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	if (bfqq->next_rq == rq)
+		bfqq->next_rq = bfq_find_next_rq(bfqd, bfqq, rq);
+
+	list_del_init(&rq->queuelist);
+	elv_rb_del(&bfqq->sort_list, rq);
+	bfqq->queued[rq_is_sync(rq)]--;
+	bfqd->queued--;
+
+	/*
+	 * The in-service queue stays busy while empty, it may be idling.
+	 * Others leave the service tree with their last request.
+	 */
+	if (RB_EMPTY_ROOT(&bfqq->sort_list)) {
+		bfqq->next_rq = NULL;
+		if (bfq_bfqq_busy(bfqq) && bfqq != bfqd->in_service_queue)
+			bfq_del_bfqq_busy(bfqd, bfqq);
+	}
+}
+
+static void bfq_task_ioprio(struct io_context *ioc, unsigned short *class,
+			    unsigned short *prio)
+{
+	struct task_struct *tsk = current;
+
+	switch (ioc ? IOPRIO_PRIO_CLASS(ioc->ioprio) : IOPRIO_CLASS_NONE) {
+	case IOPRIO_CLASS_RT:
+		*class = IOPRIO_CLASS_RT;
+		*prio = task_ioprio(ioc);
+		break;
+	case IOPRIO_CLASS_BE:
+		*class = IOPRIO_CLASS_BE;
+		*prio = task_ioprio(ioc);
+		break;
+	case IOPRIO_CLASS_IDLE:
+		*class = IOPRIO_CLASS_IDLE;
+		*prio = IOPRIO_BE_NR - 1;
+		break;
+	default:
+		/*
+		 * no prio set, inherit CPU scheduling settings
+		 */
+		*class = task_nice_ioclass(tsk);
+		*prio = task_nice_ioprio(tsk);
+		break;
+	}
+}
+
+/*
+ * Weight of the blkio cgroup of the current task, the per-device one if
+ * set for this disk.
+ */
+static unsigned int bfq_task_cg_weight(struct bfq_data *bfqd)
+{
+	unsigned int weight = BLKIO_WEIGHT_DEFAULT;
+#if defined(CONFIG_BLK_CGROUP) || defined(CONFIG_BLK_CGROUP_MODULE)
+	struct backing_dev_info *bdi = &bfqd->queue->backing_dev_info;
+	struct blkio_cgroup *blkcg;
+	unsigned int major, minor;
+
+	if (!bfqd->devt && bdi->dev && dev_name(bdi->dev)) {
+		sscanf(dev_name(bdi->dev), "%u:%u", &major, &minor);
+		bfqd->devt = MKDEV(major, minor);
+	}
+
+	rcu_read_lock();
+	blkcg = task_blkio_cgroup(current);
+	if (blkcg)
+		weight = blkcg_get_weight(blkcg, bfqd->devt);
+	rcu_read_unlock();
+#endif
+	return weight;
+}
+
+static struct bfq_queue *bfq_find_queue(struct bfq_data *bfqd,
+					unsigned long key)
+{
+	struct hlist_head *head = &bfqd->queue_hash[hash_long(key,
+							BFQ_HASH_SHIFT)];
+	struct hlist_node *n;
+	struct bfq_queue *bfqq;
+
+	hlist_for_each_entry(bfqq, n, head, hash_node)
+		if (bfqq->key == key)
+			return bfqq;
+
+	return NULL;
+}
+
+/*
+ * The queue the current task's IO in direction @sync goes to, if any.
+ */
+static struct bfq_queue *bfq_current_queue(struct bfq_data *bfqd, bool sync)
+{
+	struct io_context *ioc = current->io_context;
+	unsigned short class, prio;
+
+	if (!ioc)
+		return NULL;
+	if (sync)
+		return bfq_find_queue(bfqd, (unsigned long) ioc);
+
+	bfq_task_ioprio(ioc, &class, &prio);
+	return bfq_find_queue(bfqd, BFQ_ASYNC_KEY(class, prio));
+}
+
+static void bfq_init_bfqq(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+			  unsigned long key, bool is_sync)
+{
+	RB_CLEAR_NODE(&bfqq->rb_node);
+	bfqq->sort_list = RB_ROOT;
+	INIT_LIST_HEAD(&bfqq->fifo);
+
+	bfqq->ref = 1;
+	bfqq->bfqd = bfqd;
+	bfqq->key = key;
+	bfqq->pid = current->pid;
+
+	bfqq->ioprio_class = bfqq->st_class = IOPRIO_CLASS_BE;
+	bfqq->ioprio = IOPRIO_NORM;
+	bfqq->cg_weight = BLKIO_WEIGHT_DEFAULT;
+	bfqq->weight = bfq_orig_weight(bfqq);
+	bfqq->wr_coeff = 1;
+	bfqq->budget = bfqd->bfq_max_budget;
+
+	bfqq->last_idle = jiffies;
+	bfqq->soft_rt_next_start = jiffies;
+	bfqq->last_end_request = jiffies;
+	bfq_mark_bfqq_new(bfqq);
+
+	if (is_sync) {
+		bfq_mark_bfqq_sync(bfqq);
+		bfq_mark_bfqq_idle_window(bfqq);
+	}
+
+	if (key)
+		hlist_add_head(&bfqq->hash_node,
+			&bfqd->queue_hash[hash_long(key, BFQ_HASH_SHIFT)]);
+}
+
+/*
+ * Drop a reference, free the queue with the last one.
+ * queue lock must be held here.
+ */
+static void bfq_put_queue(struct bfq_queue *bfqq)
+{
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	BUG_ON(bfqq->ref <= 0);
+
+	bfqq->ref--;
+	if (bfqq->ref)
+		return;
+
+	BUG_ON(bfq_bfqq_busy(bfqq));
+	BUG_ON(bfqd->in_service_queue == bfqq);
+	BUG_ON(bfqq == &bfqd->oom_bfqq);
+
+	kmem_cache_free(bfq_pool, bfqq);
+}
+
+/*
+ * Queues stay hashed while idle so they keep their budget and history.
+ * Free the ones unused for long enough to count as new again anyway.
+ */
+static void bfq_gc_queues(struct bfq_data *bfqd, bool all)
+{
+	struct hlist_node *n, *tmp;
+	struct bfq_queue *bfqq;
+	int i;
+
+	if (!all && time_before(jiffies, bfqd->last_gc + HZ))
+		return;
+	bfqd->last_gc = jiffies;
+
+	for (i = 0; i < BFQ_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(bfqq, n, tmp, &bfqd->queue_hash[i],
+					  hash_node) {
+			if (bfqq->ref > 1 || bfq_bfqq_busy(bfqq) ||
+			    bfqq == bfqd->in_service_queue)
+				continue;
+			if (!all && time_before(jiffies, bfqq->last_idle +
+						bfqd->bfq_wr_min_idle_time))
+				continue;
+
+			hlist_del(&bfqq->hash_node);
+			bfq_put_queue(bfqq);
+		}
+	}
+}
+
+static int bfq_merge(struct request_queue *q, struct request **req,
+		     struct bio *bio)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq;
+	struct request *__rq;
+
+	bfqq = bfq_current_queue(bfqd, bfq_bio_sync(bio));
+	if (bfqq) {
+		sector_t sector = bio->bi_sector + bio_sectors(bio);
+
+		__rq = elv_rb_find(&bfqq->sort_list, sector);
+		if (__rq && elv_rq_merge_ok(__rq, bio)) {
+			*req = __rq;
+			return ELEVATOR_FRONT_MERGE;
+		}
+	}
+
+	return ELEVATOR_NO_MERGE;
+}
+
+static void bfq_merged_request(struct request_queue *q, struct request *req,
+			       int type)
+{
+	if (type == ELEVATOR_FRONT_MERGE) {
+		struct bfq_queue *bfqq = RQ_BFQQ(req);
+
+		elv_rb_del(&bfqq->sort_list, req);
+		elv_rb_add(&bfqq->sort_list, req);
+		bfqq->next_rq = bfq_choose_req(bfqq->bfqd, bfqq->next_rq, req);
+	}
+}
+
+static void
+bfq_merged_requests(struct request_queue *q, struct request *rq,
+		    struct request *next)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+
+	/*
+	 * reposition in fifo if next is older than rq
+	 */
+	if (!list_empty(&rq->queuelist) && !list_empty(&next->queuelist) &&
+	    time_before(rq_fifo_time(next), rq_fifo_time(rq))) {
+		list_move(&rq->queuelist, &next->queuelist);
+		rq_set_fifo_time(rq, rq_fifo_time(next));
+	}
+
+	if (bfqq->next_rq == next)
+		bfqq->next_rq = rq;
+	bfq_remove_request(next);
+}
+
+static int bfq_allow_merge(struct request_queue *q, struct request *rq,
+			   struct bio *bio)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	/*
+	 * Disallow merge of a sync bio into an async request.
+	 */
+	if (bfq_bio_sync(bio) && !rq_is_sync(rq))
+		return false;
+
+	/*
+	 * Allow merge only if rq is queued where this bio would go.
+	 */
+	return bfq_current_queue(bfqd, bfq_bio_sync(bio)) == RQ_BFQQ(rq);
+}
+
+static void bfq_activate_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	bfqd->rq_in_driver++;
+	bfqd->last_position = blk_rq_pos(rq) + blk_rq_sectors(rq);
+}
+
+static void bfq_deactivate_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+
+	WARN_ON(!bfqd->rq_in_driver);
+	bfqd->rq_in_driver--;
+}
+
+/*
+ * Next budget from how the last one went.  Async queues always get the
+ * max budget, the timeout is what bounds them.
+ */
+static void bfq_update_budget(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+			      enum bfqq_expiration reason)
+{
+	unsigned int min_budget = bfq_min_budget(bfqd);
+	unsigned int budget = bfqq->budget;
+
+	if (!bfq_bfqq_sync(bfqq)) {
+		bfqq->budget = bfqd->bfq_max_budget;
+		return;
+	}
+
+	switch (reason) {
+	case BFQ_EXP_TOO_IDLE:
+		/*
+		 * Still waiting for its own requests means it was fast
+		 * enough, just deep in the device.  Otherwise it thinks too
+		 * long to use a big budget.
+		 */
+		if (bfqq->dispatched)
+			budget *= 2;
+		else
+			budget = budget > 4 * min_budget ?
+					budget - 4 * min_budget : min_budget;
+		break;
+	case BFQ_EXP_NO_MORE_REQ:
+		/* size it to what it actually used */
+		budget = bfqq->service;
+		break;
+	case BFQ_EXP_BUDGET_EXHAUSTED:
+		budget *= 2;
+		break;
+	default:
+		break;
+	}
+
+	bfqq->budget = clamp(budget, min_budget, bfqd->bfq_max_budget);
+}
+
+static void bfq_bfqq_expire(struct bfq_data *bfqd, struct bfq_queue *bfqq,
+			    enum bfqq_expiration reason)
+{
+	unsigned int charge = bfqq->service;
+	struct bfq_service_tree *st;
+
+	BUG_ON(bfqq != bfqd->in_service_queue);
+
+	/*
+	 * A queue that ran out of time was slow: seeky, or thinking long
+	 * between requests.  Charge it the full budget, for the disk time it
+	 * held rather than the little it transferred.
+	 */
+	if (reason == BFQ_EXP_BUDGET_TIMEOUT && bfqq->wr_coeff == 1)
+		charge = max(charge, bfqq->budget);
+	bfqq->finish = bfqq->start + bfq_delta(charge, bfqq->weight);
+
+	bfq_update_budget(bfqd, bfqq, reason);
+
+	bfqd->in_service_queue = NULL;
+	del_timer(&bfqd->idle_slice_timer);
+	bfq_clear_bfqq_wait_request(bfqq);
+	bfqq->service = 0;
+
+	if (RB_EMPTY_ROOT(&bfqq->sort_list)) {
+		bfq_del_bfqq_busy(bfqd, bfqq);
+		return;
+	}
+
+	/* still backlogged: its next turn starts where this one finished */
+	bfq_update_entity(bfqd, bfqq);
+	st = bfqq_st(bfqd, bfqq);
+	bfqq->start = bfqq->finish;
+	bfqq->finish = bfqq->start + bfq_delta(bfqq->budget, bfqq->weight);
+	bfq_st_insert(st, bfqq);
+}
+
+static struct bfq_queue *bfq_set_in_service_queue(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq = NULL;
+	int i;
+
+	/* strict priority between the ioprio classes */
+	for (i = 0; i < BFQ_NR_CLASSES && !bfqq; i++)
+		bfqq = bfq_st_lookup(&bfqd->st[i]);
+	if (!bfqq)
+		return NULL;
+
+	bfq_st_remove(bfqq_st(bfqd, bfqq), bfqq);
+
+	bfqq->service = 0;
+	if (bfqq->next_rq)
+		bfqq->budget = max(bfqq->budget,
+				   blk_rq_sectors(bfqq->next_rq));
+	bfqq->budget_timeout = jiffies +
+		bfqd->bfq_timeout[bfq_bfqq_sync(bfqq)];
+	bfq_clear_bfqq_fifo_expire(bfqq);
+	bfq_clear_bfqq_wait_request(bfqq);
+
+	bfqd->in_service_queue = bfqq;
+	return bfqq;
+}
+
+/*
+ * Whether to keep the disk for the in-service queue while it has nothing
+ * queued, in the hope its next request comes soon and close by.
+ */
+static bool bfq_may_idle(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	if (!bfqd->bfq_slice_idle || !bfq_bfqq_sync(bfqq) ||
+	    bfq_class_idle(bfqq))
+		return false;
+
+	/* that's what keeps raised queues ahead, whatever the device */
+	if (bfqq->wr_coeff > 1)
+		return true;
+
+	/*
+	 * A device queueing many commands (RAID, NCQ) keeps busy with the
+	 * requests of other queues; idling for one process only throws
+	 * that throughput away.
+	 */
+	if (bfqd->hw_tag == 1)
+		return false;
+
+	return bfq_bfqq_idle_window(bfqq);
+}
+
+static void bfq_arm_slice_timer(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq = bfqd->in_service_queue;
+
+	bfq_mark_bfqq_wait_request(bfqq);
+	mod_timer(&bfqd->idle_slice_timer, jiffies + bfqd->bfq_slice_idle);
+}
+
+/*
+ * Select a queue for service. If we have a current queue in service,
+ * check whether to continue servicing it, or retrieve and set a new one.
+ */
+static struct bfq_queue *bfq_select_queue(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq = bfqd->in_service_queue;
+	enum bfqq_expiration reason;
+
+	if (!bfqq)
+		goto new_queue;
+
+	if (time_after(jiffies, bfqq->budget_timeout)) {
+		reason = BFQ_EXP_BUDGET_TIMEOUT;
+		goto expire;
+	}
+
+	if (bfqq->next_rq) {
+		if (blk_rq_sectors(bfqq->next_rq) > bfq_budget_left(bfqq)) {
+			reason = BFQ_EXP_BUDGET_EXHAUSTED;
+			goto expire;
+		}
+		return bfqq;
+	}
+
+	/*
+	 * Nothing queued: hold on to the queue while the idle timer runs,
+	 * or while its requests in flight may still bring more.
+	 */
+	if (timer_pending(&bfqd->idle_slice_timer) ||
+	    (bfqq->dispatched && bfq_may_idle(bfqd, bfqq)))
+		return NULL;
+
+	reason = BFQ_EXP_NO_MORE_REQ;
+expire:
+	bfq_bfqq_expire(bfqd, bfqq, reason);
+new_queue:
+	return bfq_set_in_service_queue(bfqd);
+}
+
+static struct request *bfq_check_fifo(struct bfq_queue *bfqq)
+{
+	struct request *rq;
+
+	if (bfq_bfqq_fifo_expire(bfqq))
+		return NULL;
+
+	bfq_mark_bfqq_fifo_expire(bfqq);
+
+	if (list_empty(&bfqq->fifo))
+		return NULL;
+
+	rq = rq_entry_fifo(bfqq->fifo.next);
+	if (time_before(jiffies, rq_fifo_time(rq)))
+		return NULL;
+
+	return rq;
+}
+
+/*
+ * Move request from internal lists to the request queue dispatch list,
+ * charging its size to the queue and to the virtual time of its class.
+ */
+static void bfq_dispatch_insert(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_service_tree *st = bfqq_st(bfqd, bfqq);
+	unsigned int sectors = blk_rq_sectors(rq);
+
+	bfq_remove_request(rq);
+	bfqq->dispatched++;
+	elv_dispatch_sort(q, rq);
+
+	bfqq->service += sectors;
+	bfqq->service_from_busy += sectors;
+	if (st->wsum)
+		st->vtime += bfq_delta(sectors, st->wsum);
+}
+
+/*
+ * Drain our queues for an elevator switch or queue teardown.
+ */
+static int bfq_forced_dispatch(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq;
+	struct rb_node *n;
+	int dispatched = 0;
+	int i;
+
+	if (bfqd->in_service_queue)
+		bfq_bfqq_expire(bfqd, bfqd->in_service_queue, BFQ_EXP_FORCED);
+
+	for (i = 0; i < BFQ_NR_CLASSES; i++) {
+		while ((n = rb_first(&bfqd->st[i].tree)) != NULL) {
+			bfqq = rb_entry(n, struct bfq_queue, rb_node);
+			while (bfqq->next_rq) {
+				bfq_dispatch_insert(bfqd->queue, bfqq->next_rq);
+				dispatched++;
+			}
+		}
+	}
+
+	BUG_ON(bfqd->busy_queues);
+	return dispatched;
+}
+
+static int bfq_dispatch_requests(struct request_queue *q, int force)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq;
+	struct request *rq;
+
+	if (!bfqd->busy_queues)
+		return 0;
+
+	if (unlikely(force))
+		return bfq_forced_dispatch(bfqd);
+
+	bfqq = bfq_select_queue(bfqd);
+	if (!bfqq)
+		return 0;
+
+	/*
+	 * Keep switches between queues cheap: the device doesn't need the
+	 * whole budget in flight to stay busy.
+	 */
+	if (bfqq->dispatched >= bfqd->bfq_quantum)
+		return 0;
+
+	rq = bfq_check_fifo(bfqq);
+	if (!rq)
+		rq = bfqq->next_rq;
+
+	bfq_dispatch_insert(q, rq);
+	return 1;
+}
+
+static void
+bfq_update_io_thinktime(struct bfq_data *bfqd, struct bfq_queue *bfqq)
+{
+	unsigned long elapsed = jiffies - bfqq->last_end_request;
+
+	elapsed = min_t(unsigned long, elapsed, 2 * bfqd->bfq_slice_idle);
+	bfqq->ttime_mean = (7 * bfqq->ttime_mean + elapsed + 4) / 8;
+}
+
+static void
+bfq_update_io_seektime(struct bfq_queue *bfqq, struct request *rq)
+{
+	sector_t sdist = 0;
+
+	if (bfqq->last_request_pos) {
+		if (bfqq->last_request_pos < blk_rq_pos(rq))
+			sdist = blk_rq_pos(rq) - bfqq->last_request_pos;
+		else
+			sdist = bfqq->last_request_pos - blk_rq_pos(rq);
+	}
+
+	bfqq->seek_history <<= 1;
+	bfqq->seek_history |= (sdist > BFQQ_SEEK_THR);
+}
+
+/*
+ * Disable idle window if the process thinks too long or seeks so much
+ * that it doesn't matter.
+ */
+static void bfq_update_idle_window(struct bfq_data *bfqd,
+				   struct bfq_queue *bfqq)
+{
+	if (BFQQ_SEEKY(bfqq) || bfqq->ttime_mean > bfqd->bfq_slice_idle)
+		bfq_clear_bfqq_idle_window(bfqq);
+	else
+		bfq_mark_bfqq_idle_window(bfqq);
+}
+
+static void bfq_insert_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_queue *in_service = bfqd->in_service_queue;
+
+	if (bfq_bfqq_sync(bfqq)) {
+		bfq_update_io_thinktime(bfqd, bfqq);
+		bfq_update_io_seektime(bfqq, rq);
+		bfq_update_idle_window(bfqd, bfqq);
+	}
+	bfqq->last_request_pos = blk_rq_pos(rq) + blk_rq_sectors(rq);
+
+	rq_set_fifo_time(rq, jiffies + bfqd->bfq_fifo_expire[rq_is_sync(rq)]);
+	list_add_tail(&rq->queuelist, &bfqq->fifo);
+	bfqd->queued++;
+	bfq_add_rq_rb(rq);
+
+	if (bfqq == in_service) {
+		/* the request we were idling for */
+		if (bfq_bfqq_wait_request(bfqq)) {
+			del_timer(&bfqd->idle_slice_timer);
+			bfq_clear_bfqq_wait_request(bfqq);
+			__blk_run_queue(q);
+		}
+	} else if (in_service && bfq_bfqq_wait_request(in_service) &&
+		   bfqq->wr_coeff > 1 && in_service->wr_coeff == 1) {
+		/* don't keep a raised queue waiting on an idle disk */
+		bfq_bfqq_expire(bfqd, in_service, BFQ_EXP_FORCED);
+		__blk_run_queue(q);
+	}
+}
+
+/*
+ * Update hw_tag based on peak queue depth over 50 samples under
+ * sufficient load.
+ */
+static void bfq_update_hw_tag(struct bfq_data *bfqd)
+{
+	struct bfq_queue *bfqq = bfqd->in_service_queue;
+
+	if (bfqd->rq_in_driver > bfqd->max_rq_in_driver)
+		bfqd->max_rq_in_driver = bfqd->rq_in_driver;
+
+	if (bfqd->hw_tag == 1)
+		return;
+
+	if (bfqd->queued <= BFQ_HW_QUEUE_MIN &&
+	    bfqd->rq_in_driver <= BFQ_HW_QUEUE_MIN)
+		return;
+
+	/*
+	 * If the in-service queue hasn't enough requests and idles, we
+	 * might not dispatch enough to the hardware to tell.
+	 */
+	if (bfqq && bfq_may_idle(bfqd, bfqq) &&
+	    bfqq->dispatched + bfqq->queued[0] + bfqq->queued[1] <
+	    BFQ_HW_QUEUE_MIN && bfqd->rq_in_driver < BFQ_HW_QUEUE_MIN)
+		return;
+
+	if (bfqd->hw_tag_samples++ < 50)
+		return;
+
+	bfqd->hw_tag = bfqd->max_rq_in_driver >= BFQ_HW_QUEUE_MIN;
+}
+
+static void bfq_completed_request(struct request_queue *q, struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+	struct bfq_data *bfqd = bfqq->bfqd;
+
+	bfq_update_hw_tag(bfqd);
+
+	WARN_ON(!bfqd->rq_in_driver);
+	WARN_ON(!bfqq->dispatched);
+	bfqd->rq_in_driver--;
+	bfqq->dispatched--;
+
+	if (rq_is_sync(rq))
+		bfqq->last_end_request = jiffies;
+
+	/*
+	 * The in-service queue's last request is done and nothing else is
+	 * queued: wait for the next one, or give up the disk.
+	 */
+	if (bfqq == bfqd->in_service_queue && !bfqq->dispatched &&
+	    RB_EMPTY_ROOT(&bfqq->sort_list)) {
+		if (time_after(jiffies, bfqq->budget_timeout))
+			bfq_bfqq_expire(bfqd, bfqq, BFQ_EXP_BUDGET_TIMEOUT);
+		else if (bfq_may_idle(bfqd, bfqq))
+			bfq_arm_slice_timer(bfqd);
+		else
+			bfq_bfqq_expire(bfqd, bfqq, BFQ_EXP_NO_MORE_REQ);
+	}
+
+	if (!bfqd->rq_in_driver)
+		bfq_schedule_dispatch(bfqd);
+}
+
+static int bfq_may_queue(struct request_queue *q, int rw)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	struct bfq_queue *bfqq;
+
+	/*
+	 * The queue we're idling for must be able to allocate its
+	 * request, however full the request list is.
+	 */
+	bfqq = bfq_current_queue(bfqd, rw_is_sync(rw));
+	if (bfqq && bfqq == bfqd->in_service_queue &&
+	    bfq_bfqq_wait_request(bfqq))
+		return ELV_MQUEUE_MUST;
+
+	return ELV_MQUEUE_MAY;
+}
+
+/*
+ * queue lock held here
+ */
+static void bfq_put_request(struct request *rq)
+{
+	struct bfq_queue *bfqq = RQ_BFQQ(rq);
+
+	if (bfqq) {
+		const int rw = rq_data_dir(rq);
+
+		BUG_ON(!bfqq->allocated[rw]);
+		bfqq->allocated[rw]--;
+
+		put_io_context(RQ_IOC(rq));
+
+		rq->elevator_private[0] = NULL;
+		rq->elevator_private[1] = NULL;
+
+		bfq_put_queue(bfqq);
+	}
+}
+
+/*
+ * Allocate bfq data structures associated with this request.
+ */
+static int
+bfq_set_request(struct request_queue *q, struct request *rq, gfp_t gfp_mask)
+{
+	struct bfq_data *bfqd = q->elevator->elevator_data;
+	const int rw = rq_data_dir(rq);
+	const bool is_sync = rq_is_sync(rq);
+	struct bfq_queue *bfqq, *new_bfqq = NULL;
+	struct io_context *ioc;
+	unsigned short ioprio_class, ioprio;
+	unsigned long key, flags;
+
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	ioc = get_io_context(gfp_mask, q->node);
+	if (!ioc) {
+		spin_lock_irqsave(q->queue_lock, flags);
+		bfq_schedule_dispatch(bfqd);
+		spin_unlock_irqrestore(q->queue_lock, flags);
+		return 1;
+	}
+
+	bfq_task_ioprio(ioc, &ioprio_class, &ioprio);
+	if (is_sync)
+		key = (unsigned long) ioc;
+	else
+		key = BFQ_ASYNC_KEY(ioprio_class, ioprio);
+
+	spin_lock_irqsave(q->queue_lock, flags);
+
+	bfqq = bfq_find_queue(bfqd, key);
+	if (!bfqq) {
+		spin_unlock_irqrestore(q->queue_lock, flags);
+		new_bfqq = kmem_cache_alloc_node(bfq_pool,
+					gfp_mask | __GFP_ZERO, q->node);
+		spin_lock_irqsave(q->queue_lock, flags);
+
+		/* somebody else may have raced us to it */
+		bfqq = bfq_find_queue(bfqd, key);
+		if (!bfqq && new_bfqq) {
+			bfqq = new_bfqq;
+			new_bfqq = NULL;
+			bfq_init_bfqq(bfqd, bfqq, key, is_sync);
+		} else if (!bfqq)
+			bfqq = &bfqd->oom_bfqq;
+	}
+
+	bfqq->ioprio_class = ioprio_class;
+	bfqq->ioprio = ioprio;
+	bfqq->cg_weight = bfq_task_cg_weight(bfqd);
+
+	bfqq->allocated[rw]++;
+	bfqq->ref++;
+	rq->elevator_private[0] = bfqq;
+	rq->elevator_private[1] = ioc;
+
+	bfq_gc_queues(bfqd, false);
+
+	spin_unlock_irqrestore(q->queue_lock, flags);
+
+	if (new_bfqq)
+		kmem_cache_free(bfq_pool, new_bfqq);
+	return 0;
+}
+
+static void bfq_kick_queue(struct work_struct *work)
+{
+	struct bfq_data *bfqd =
+		container_of(work, struct bfq_data, unplug_work);
+	struct request_queue *q = bfqd->queue;
+
+	spin_lock_irq(q->queue_lock);
+	__blk_run_queue(bfqd->queue);
+	spin_unlock_irq(q->queue_lock);
+}
+
+/*
+ * Timer running if the in-service queue is idling
+ */
+static void bfq_idle_slice_timer(unsigned long data)
+{
+	struct bfq_data *bfqd = (struct bfq_data *) data;
+	struct bfq_queue *bfqq;
+	unsigned long flags;
+
+	spin_lock_irqsave(bfqd->queue->queue_lock, flags);
+
+	bfqq = bfqd->in_service_queue;
+	if (bfqq && bfq_bfqq_wait_request(bfqq)) {
+		bfq_clear_bfqq_wait_request(bfqq);
+		if (RB_EMPTY_ROOT(&bfqq->sort_list))
+			bfq_bfqq_expire(bfqd, bfqq, BFQ_EXP_TOO_IDLE);
+	}
+
+	bfq_schedule_dispatch(bfqd);
+
+	spin_unlock_irqrestore(bfqd->queue->queue_lock, flags);
+}
+
+static void bfq_shutdown_timer_wq(struct bfq_data *bfqd)
+{
+	del_timer_sync(&bfqd->idle_slice_timer);
+	cancel_work_sync(&bfqd->unplug_work);
+}
+
+static void bfq_exit_queue(struct elevator_queue *e)
+{
+	struct bfq_data *bfqd = e->elevator_data;
+	struct request_queue *q = bfqd->queue;
+
+	bfq_shutdown_timer_wq(bfqd);
+
+	spin_lock_irq(q->queue_lock);
+
+	if (bfqd->in_service_queue)
+		bfq_bfqq_expire(bfqd, bfqd->in_service_queue, BFQ_EXP_FORCED);
+
+	bfq_gc_queues(bfqd, true);
+
+	spin_unlock_irq(q->queue_lock);
+
+	bfq_shutdown_timer_wq(bfqd);
+
+	kfree(bfqd);
+}
+
+static void *bfq_init_queue(struct request_queue *q)
+{
+	struct bfq_data *bfqd;
+	int i;
+
+	bfqd = kmalloc_node(sizeof(*bfqd), GFP_KERNEL | __GFP_ZERO, q->node);
+	if (!bfqd)
+		return NULL;
+
+	for (i = 0; i < BFQ_NR_CLASSES; i++)
+		bfqd->st[i].tree = RB_ROOT;
+	for (i = 0; i < BFQ_HASH_SIZE; i++)
+		INIT_HLIST_HEAD(&bfqd->queue_hash[i]);
+
+	bfqd->queue = q;
+
+	bfqd->bfq_quantum = bfq_quantum;
+	bfqd->bfq_fifo_expire[0] = bfq_fifo_expire[0];
+	bfqd->bfq_fifo_expire[1] = bfq_fifo_expire[1];
+	bfqd->bfq_slice_idle = bfq_slice_idle;
+	bfqd->bfq_max_budget = bfq_max_budget;
+	bfqd->bfq_timeout[0] = bfq_timeout_async;
+	bfqd->bfq_timeout[1] = bfq_timeout_sync;
+	bfqd->bfq_low_latency = 1;
+	bfqd->bfq_wr_coeff = bfq_wr_coeff;
+	bfqd->bfq_wr_max_time = bfq_wr_max_time;
+	bfqd->bfq_wr_rt_max_time = bfq_wr_rt_max_time;
+	bfqd->bfq_wr_min_idle_time = bfq_wr_min_idle_time;
+	bfqd->bfq_wr_max_softrt_rate = bfq_wr_max_softrt_rate;
+
+	/*
+	 * The oom queue is shared, never hashed and never freed: it is
+	 * not sync, so nobody idles for it.
+	 */
+	bfq_init_bfqq(bfqd, &bfqd->oom_bfqq, 0, false);
+
+	init_timer(&bfqd->idle_slice_timer);
+	bfqd->idle_slice_timer.function = bfq_idle_slice_timer;
+	bfqd->idle_slice_timer.data = (unsigned long) bfqd;
+
+	INIT_WORK(&bfqd->unplug_work, bfq_kick_queue);
+
+	bfqd->hw_tag = -1;
+	bfqd->last_gc = jiffies;
+	return bfqd;
+}
+
+/*
+ * sysfs parts below -->
+ */
+static ssize_t
+bfq_var_show(unsigned int var, char *page)
+{
+	return sprintf(page, "%d\n", var);
+}
+
+static ssize_t
+bfq_var_store(unsigned int *var, const char *page, size_t count)
+{
+	char *p = (char *) page;
+
+	*var = simple_strtoul(p, &p, 10);
+	return count;
+}
+
+#define SHOW_FUNCTION(__FUNC, __VAR, __CONV)				\
+static ssize_t __FUNC(struct elevator_queue *e, char *page)		\
+{									\
+	struct bfq_data *bfqd = e->elevator_data;			\
+	unsigned int __data = __VAR;					\
+	if (__CONV)							\
+		__data = jiffies_to_msecs(__data);			\
+	return bfq_var_show(__data, (page));				\
+}
+SHOW_FUNCTION(bfq_quantum_show, bfqd->bfq_quantum, 0);
+SHOW_FUNCTION(bfq_fifo_expire_sync_show, bfqd->bfq_fifo_expire[1], 1);
+SHOW_FUNCTION(bfq_fifo_expire_async_show, bfqd->bfq_fifo_expire[0], 1);
+SHOW_FUNCTION(bfq_slice_idle_show, bfqd->bfq_slice_idle, 1);
+SHOW_FUNCTION(bfq_max_budget_show, bfqd->bfq_max_budget, 0);
+SHOW_FUNCTION(bfq_timeout_sync_show, bfqd->bfq_timeout[1], 1);
+SHOW_FUNCTION(bfq_timeout_async_show, bfqd->bfq_timeout[0], 1);
+SHOW_FUNCTION(bfq_low_latency_show, bfqd->bfq_low_latency, 0);
+SHOW_FUNCTION(bfq_wr_coeff_show, bfqd->bfq_wr_coeff, 0);
+SHOW_FUNCTION(bfq_wr_max_time_show, bfqd->bfq_wr_max_time, 1);
+SHOW_FUNCTION(bfq_wr_rt_max_time_show, bfqd->bfq_wr_rt_max_time, 1);
+SHOW_FUNCTION(bfq_wr_min_idle_time_show, bfqd->bfq_wr_min_idle_time, 1);
+SHOW_FUNCTION(bfq_wr_max_softrt_rate_show, bfqd->bfq_wr_max_softrt_rate, 0);
+#undef SHOW_FUNCTION
+
+#define STORE_FUNCTION(__FUNC, __PTR, MIN, MAX, __CONV)			\
+static ssize_t __FUNC(struct elevator_queue *e, const char *page, size_t count)	\
+{									\
+	struct bfq_data *bfqd = e->elevator_data;			\
+	unsigned int __data;						\
+	int ret = bfq_var_store(&__data, (page), count);		\
+	if (__data < (MIN))						\
+		__data = (MIN);						\
+	else if (__data > (MAX))					\
+		__data = (MAX);						\
+	if (__CONV)							\
+		*(__PTR) = msecs_to_jiffies(__data);			\
+	else								\
+		*(__PTR) = __data;					\
+	return ret;							\
+}
+STORE_FUNCTION(bfq_quantum_store, &bfqd->bfq_quantum, 1, UINT_MAX, 0);
+STORE_FUNCTION(bfq_fifo_expire_sync_store, &bfqd->bfq_fifo_expire[1], 1,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_fifo_expire_async_store, &bfqd->bfq_fifo_expire[0], 1,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_slice_idle_store, &bfqd->bfq_slice_idle, 0, UINT_MAX, 1);
+STORE_FUNCTION(bfq_max_budget_store, &bfqd->bfq_max_budget, 32,
+		1024 * 1024, 0);
+STORE_FUNCTION(bfq_timeout_sync_store, &bfqd->bfq_timeout[1], 1,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_timeout_async_store, &bfqd->bfq_timeout[0], 1,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_low_latency_store, &bfqd->bfq_low_latency, 0, 1, 0);
+STORE_FUNCTION(bfq_wr_coeff_store, &bfqd->bfq_wr_coeff, 1, 100, 0);
+STORE_FUNCTION(bfq_wr_max_time_store, &bfqd->bfq_wr_max_time, 0,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_wr_rt_max_time_store, &bfqd->bfq_wr_rt_max_time, 0,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_wr_min_idle_time_store, &bfqd->bfq_wr_min_idle_time, 0,
+		UINT_MAX, 1);
+STORE_FUNCTION(bfq_wr_max_softrt_rate_store, &bfqd->bfq_wr_max_softrt_rate,
+		0, UINT_MAX, 0);
+#undef STORE_FUNCTION
+
+#define BFQ_ATTR(name) \
+	__ATTR(name, S_IRUGO|S_IWUSR, bfq_##name##_show, bfq_##name##_store)
+
+static struct elv_fs_entry bfq_attrs[] = {
+	BFQ_ATTR(quantum),
+	BFQ_ATTR(fifo_expire_sync),
+	BFQ_ATTR(fifo_expire_async),
+	BFQ_ATTR(slice_idle),
+	BFQ_ATTR(max_budget),
+	BFQ_ATTR(timeout_sync),
+	BFQ_ATTR(timeout_async),
+	BFQ_ATTR(low_latency),
+	BFQ_ATTR(wr_coeff),
+	BFQ_ATTR(wr_max_time),
+	BFQ_ATTR(wr_rt_max_time),
+	BFQ_ATTR(wr_min_idle_time),
+	BFQ_ATTR(wr_max_softrt_rate),
+	__ATTR_NULL
+};
+
+static struct elevator_type iosched_bfq = {
+	.ops = {
+		.elevator_merge_fn = 		bfq_merge,
+		.elevator_merged_fn =		bfq_merged_request,
+		.elevator_merge_req_fn =	bfq_merged_requests,
+		.elevator_allow_merge_fn =	bfq_allow_merge,
+		.elevator_dispatch_fn =		bfq_dispatch_requests,
+		.elevator_add_req_fn =		bfq_insert_request,
+		.elevator_activate_req_fn =	bfq_activate_request,
+		.elevator_deactivate_req_fn =	bfq_deactivate_request,
+		.elevator_completed_req_fn =	bfq_completed_request,
+		.elevator_former_req_fn =	elv_rb_former_request,
+		.elevator_latter_req_fn =	elv_rb_latter_request,
+		.elevator_set_req_fn =		bfq_set_request,
+		.elevator_put_req_fn =		bfq_put_request,
+		.elevator_may_queue_fn =	bfq_may_queue,
+		.elevator_init_fn =		bfq_init_queue,
+		.elevator_exit_fn =		bfq_exit_queue,
+	},
+	.elevator_attrs =	bfq_attrs,
+	.elevator_name =	"bfq",
+	.elevator_owner =	THIS_MODULE,
+};
+
+static int __init bfq_init(void)
+{
+	/*
+	 * could be 0 on HZ < 1000 setups
+	 */
+	if (!bfq_slice_idle)
+		bfq_slice_idle = 1;
+	if (!bfq_timeout_async)
+		bfq_timeout_async = 1;
+
+	bfq_pool = KMEM_CACHE(bfq_queue, 0);
+	if (!bfq_pool)
+		return -ENOMEM;
+
+	elv_register(&iosched_bfq);
+
+	return 0;
+}
+
+static void __exit bfq_exit(void)
+{
+	elv_unregister(&iosched_bfq);
+	rcu_barrier();
+	kmem_cache_destroy(bfq_pool);
+}
+
+module_init(bfq_init);
+module_exit(bfq_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Budget Fair Queueing IO scheduler");
@@ -154,6 +154,16 @@ static inline void blkio_update_group_bps(struct blkio_group *blkg, u64 bps,
 		    && blkiop->ops.blkio_update_group_write_bps_fn)
 			blkiop->ops.blkio_update_group_write_bps_fn(blkg->key,
 								blkg, bps);
+
+		if (fileid == BLKIO_THROTL_read_bps_low_device
+		    && blkiop->ops.blkio_update_group_read_bps_low_fn)
+			blkiop->ops.blkio_update_group_read_bps_low_fn(
+							blkg->key, blkg, bps);
+
+		if (fileid == BLKIO_THROTL_write_bps_low_device
+		    && blkiop->ops.blkio_update_group_write_bps_low_fn)
+			blkiop->ops.blkio_update_group_write_bps_low_fn(
+							blkg->key, blkg, bps);
 	}
 }
 
@@ -841,6 +851,8 @@ static int blkio_policy_parse_and_set(char *buf,
 		switch(fileid) {
 		case BLKIO_THROTL_read_bps_device:
 		case BLKIO_THROTL_write_bps_device:
+		case BLKIO_THROTL_read_bps_low_device:
+		case BLKIO_THROTL_write_bps_low_device:
 			newpn->plid = plid;
 			newpn->fileid = fileid;
 			newpn->val.bps = temp;
@@ -951,6 +963,38 @@ unsigned int blkcg_get_write_iops(struct blkio_cgroup *blkcg, dev_t dev)
 	return iops;
 }
 
+uint64_t blkcg_get_read_bps_low(struct blkio_cgroup *blkcg, dev_t dev)
+{
+	struct blkio_policy_node *pn;
+	unsigned long flags;
+	uint64_t bps = 0;
+
+	spin_lock_irqsave(&blkcg->lock, flags);
+	pn = blkio_policy_search_node(blkcg, dev, BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_read_bps_low_device);
+	if (pn)
+		bps = pn->val.bps;
+	spin_unlock_irqrestore(&blkcg->lock, flags);
+
+	return bps;
+}
+
+uint64_t blkcg_get_write_bps_low(struct blkio_cgroup *blkcg, dev_t dev)
+{
+	struct blkio_policy_node *pn;
+	unsigned long flags;
+	uint64_t bps = 0;
+
+	spin_lock_irqsave(&blkcg->lock, flags);
+	pn = blkio_policy_search_node(blkcg, dev, BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_write_bps_low_device);
+	if (pn)
+		bps = pn->val.bps;
+	spin_unlock_irqrestore(&blkcg->lock, flags);
+
+	return bps;
+}
+
 /* Checks whether user asked for deleting a policy rule */
 static bool blkio_delete_rule_command(struct blkio_policy_node *pn)
 {
@@ -963,6 +1007,8 @@ static bool blkio_delete_rule_command(struct blkio_policy_node *pn)
 		switch(pn->fileid) {
 		case BLKIO_THROTL_read_bps_device:
 		case BLKIO_THROTL_write_bps_device:
+		case BLKIO_THROTL_read_bps_low_device:
+		case BLKIO_THROTL_write_bps_low_device:
 			if (pn->val.bps == 0)
 				return 1;
 			break;
@@ -990,6 +1036,8 @@ static void blkio_update_policy_rule(struct blkio_policy_node *oldpn,
 		switch(newpn->fileid) {
 		case BLKIO_THROTL_read_bps_device:
 		case BLKIO_THROTL_write_bps_device:
+		case BLKIO_THROTL_read_bps_low_device:
+		case BLKIO_THROTL_write_bps_low_device:
 			oldpn->val.bps = newpn->val.bps;
 			break;
 		case BLKIO_THROTL_read_iops_device:
@@ -1025,6 +1073,11 @@ static void blkio_update_blkg_policy(struct blkio_cgroup *blkcg,
 			bps = pn->val.bps ? pn->val.bps : (-1);
 			blkio_update_group_bps(blkg, bps, pn->fileid);
 			break;
+		case BLKIO_THROTL_read_bps_low_device:
+		case BLKIO_THROTL_write_bps_low_device:
+			/* no low limit is 0, not unlimited */
+			blkio_update_group_bps(blkg, pn->val.bps, pn->fileid);
+			break;
 		case BLKIO_THROTL_read_iops_device:
 		case BLKIO_THROTL_write_iops_device:
 			iops = pn->val.iops ? pn->val.iops : (-1);
@@ -1133,6 +1186,8 @@ blkio_print_policy_node(struct seq_file *m, struct blkio_policy_node *pn)
 			switch(pn->fileid) {
 			case BLKIO_THROTL_read_bps_device:
 			case BLKIO_THROTL_write_bps_device:
+			case BLKIO_THROTL_read_bps_low_device:
+			case BLKIO_THROTL_write_bps_low_device:
 				seq_printf(m, "%u:%u\t%llu\n", MAJOR(pn->dev),
 					MINOR(pn->dev), pn->val.bps);
 				break;
@@ -1190,6 +1245,8 @@ static int blkiocg_file_read(struct cgroup *cgrp, struct cftype *cft,
 		case BLKIO_THROTL_write_bps_device:
 		case BLKIO_THROTL_read_iops_device:
 		case BLKIO_THROTL_write_iops_device:
+		case BLKIO_THROTL_read_bps_low_device:
+		case BLKIO_THROTL_write_bps_low_device:
 			blkio_read_policy_node_files(cft, blkcg, m);
 			return 0;
 		default:
@@ -1469,6 +1526,24 @@ struct cftype blkio_files[] = {
 		.max_write_len = 256,
 	},
 
+	{
+		.name = "throttle.read_bps_low_device",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_read_bps_low_device),
+		.read_seq_string = blkiocg_file_read,
+		.write_string = blkiocg_file_write,
+		.max_write_len = 256,
+	},
+
+	{
+		.name = "throttle.write_bps_low_device",
+		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_THROTL,
+				BLKIO_THROTL_write_bps_low_device),
+		.read_seq_string = blkiocg_file_read,
+		.write_string = blkiocg_file_write,
+		.max_write_len = 256,
+	},
+
 	{
 		.name = "throttle.read_iops_device",
 		.private = BLKIOFILE_PRIVATE(BLKIO_POLICY_THROTL,
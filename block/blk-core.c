@@ -16,6 +16,7 @@
 #include <linux/backing-dev.h>
 #include <linux/bio.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/highmem.h>
 #include <linux/mm.h>
 #include <linux/kernel_stat.h>
@@ -29,11 +30,14 @@
 #include <linux/fault-inject.h>
 #include <linux/list_sort.h>
 #include <linux/delay.h>
+#include <linux/hrtimer.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/block.h>
 
 #include "blk.h"
+#include "blk-mq.h"
+#include "blk-wbt.h"
 
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_bio_remap);
 EXPORT_TRACEPOINT_SYMBOL_GPL(block_rq_remap);
@@ -54,7 +58,7 @@ struct kmem_cache *blk_requestq_cachep;
  */
 static struct workqueue_struct *kblockd_workqueue;
 
-static void drive_stat_acct(struct request *rq, int new_io)
+void drive_stat_acct(struct request *rq, int new_io)
 {
 	struct hd_struct *part;
 	int rw = rq_data_dir(rq);
@@ -285,6 +289,8 @@ void blk_sync_queue(struct request_queue *q)
 {
 	del_timer_sync(&q->timeout);
 	cancel_delayed_work_sync(&q->delay_work);
+	if (q->mq_ops)
+		blk_mq_sync_queue(q);
 }
 EXPORT_SYMBOL(blk_sync_queue);
 
@@ -419,7 +425,9 @@ void blk_cleanup_queue(struct request_queue *q)
 	 * be trying to tear down @q before its elevator is initialized, in
 	 * which case we don't want to call into draining.
 	 */
-	if (q->elevator)
+	if (q->mq_ops)
+		blk_mq_drain_queue(q);
+	else if (q->elevator)
 		blk_drain_queue(q, true);
 
 	/* @q won't process any more request, flush async actions */
@@ -475,6 +483,7 @@ struct request_queue *blk_alloc_queue_node(gfp_t gfp_mask, int node_id)
 	q->backing_dev_info.capabilities = BDI_CAP_MAP_COPY;
 	q->backing_dev_info.name = "block";
 	q->node = node_id;
+	q->poll_delay = -1;
 
 	err = bdi_init(&q->backing_dev_info);
 	if (err) {
@@ -910,6 +919,9 @@ struct request *blk_get_request(struct request_queue *q, int rw, gfp_t gfp_mask)
 
 	BUG_ON(rw != READ && rw != WRITE);
 
+	if (q->mq_ops)
+		return blk_mq_alloc_request(q, rw, gfp_mask);
+
 	spin_lock_irq(q->queue_lock);
 	if (gfp_mask & __GFP_WAIT)
 		rq = get_request_wait(q, rw, NULL);
@@ -1108,7 +1120,14 @@ void __blk_put_request(struct request_queue *q, struct request *req)
 	if (unlikely(--req->ref_count))
 		return;
 
+	if (q->mq_ops) {
+		WARN_ON(req->bio != NULL);
+		blk_mq_free_request(req);
+		return;
+	}
+
 	elv_completed_request(q, req);
+	wbt_free_request(q, req);
 
 	/* this is a bio leak */
 	WARN_ON(req->bio != NULL);
@@ -1300,6 +1319,7 @@ void blk_queue_bio(struct request_queue *q, struct bio *bio)
 	int el_ret, rw_flags, where = ELEVATOR_INSERT_SORT;
 	struct request *req;
 	unsigned int request_count = 0;
+	bool wb_tracked;
 
 	/*
 	 * low level driver can indicate that it wants pages above a
@@ -1348,12 +1368,20 @@ get_rq:
 	if (sync)
 		rw_flags |= REQ_SYNC;
 
+	/*
+	 * Keep background writeback from flooding the device, this may
+	 * sleep with the queue unlocked.
+	 */
+	wb_tracked = wbt_wait(q, bio);
+
 	/*
 	 * Grab a free request. This is might sleep but can not fail.
 	 * Returns with the queue unlocked.
 	 */
 	req = get_request_wait(q, rw_flags, bio);
 	if (unlikely(!req)) {
+		if (wb_tracked)
+			wbt_untrack(q);
 		bio_endio(bio, -ENODEV);	/* @q is dead */
 		goto out_unlock;
 	}
@@ -1365,6 +1393,8 @@ get_rq:
 	 * often, and the elevators are able to handle it.
 	 */
 	init_request_from_bio(req, bio);
+	if (wb_tracked)
+		req->cmd_flags |= REQ_WB_TRACKED;
 
 	if (test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags))
 		req->cpu = raw_smp_processor_id();
@@ -1844,7 +1874,7 @@ static void blk_account_io_completion(struct request *req, unsigned int bytes)
 	}
 }
 
-static void blk_account_io_done(struct request *req)
+void blk_account_io_done(struct request *req)
 {
 	/*
 	 * Account IO completion.  flush_rq isn't accounted as a
@@ -2018,6 +2048,7 @@ void blk_start_request(struct request *req)
 
 	BUG_ON(test_bit(REQ_ATOM_COMPLETE, &req->atomic_flags));
 	blk_add_timer(req);
+	wbt_issue(req->q, req);
 }
 EXPORT_SYMBOL(blk_start_request);
 
@@ -2276,7 +2307,7 @@ static void blk_finish_request(struct request *req, int error)
 	if (req->cmd_flags & REQ_DONTPREP)
 		blk_unprep_request(req);
 
-
+	wbt_done(req->q, req);
 	blk_account_io_done(req);
 
 	if (req->end_io)
@@ -2846,6 +2877,82 @@ void blk_finish_plug(struct blk_plug *plug)
 }
 EXPORT_SYMBOL(blk_finish_plug);
 
+/**
+ * blk_poll - reap completions without waiting for the interrupt
+ * @q:		queue the caller has IO outstanding on
+ *
+ * Description:
+ *    One pass of the driver's poll function.  Returns how many requests
+ *    it completed, 0 if none were done yet or the queue can't poll.
+ *    Callers loop until their own IO shows up as completed.
+ */
+int blk_poll(struct request_queue *q)
+{
+	if (!q->poll_fn || !blk_queue_poll(q))
+		return 0;
+
+	return q->poll_fn(q);
+}
+EXPORT_SYMBOL_GPL(blk_poll);
+
+/**
+ * blk_poll_sleep - sleep through the part of an IO not worth polling
+ * @q:		queue the IO was issued to
+ * @start_ns:	when it was issued, ktime_get() based
+ *
+ * Description:
+ *    Spinning for the whole device latency burns a cpu for nothing.  With
+ *    hybrid polling (io_poll_delay >= 0) sleep on an hrtimer until the IO
+ *    is expected to be nearly done, either half the mean polled latency
+ *    or a fixed delay, and only poll for the rest.
+ */
+void blk_poll_sleep(struct request_queue *q, u64 start_ns)
+{
+	int delay = ACCESS_ONCE(q->poll_delay);
+	u64 now, until;
+	ktime_t kt;
+
+	if (delay < 0)
+		return;
+	if (delay)
+		until = start_ns + (u64) delay * NSEC_PER_USEC;
+	else
+		until = start_ns + ACCESS_ONCE(q->poll_mean_ns) / 2;
+
+	now = ktime_to_ns(ktime_get());
+	if (until <= now)
+		return;
+
+	kt = ns_to_ktime(until - now);
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	schedule_hrtimeout(&kt, HRTIMER_MODE_REL);
+}
+EXPORT_SYMBOL_GPL(blk_poll_sleep);
+
+/**
+ * blk_poll_account - feed a polled completion into the mean latency
+ * @q:		queue the IO was issued to
+ * @start_ns:	when it was issued, ktime_get() based
+ *
+ * Description:
+ *    Keeps a running average (1/8 weight per sample) for the hybrid sleep
+ *    in blk_poll_sleep().  Updates race harmlessly.
+ */
+void blk_poll_account(struct request_queue *q, u64 start_ns)
+{
+	u64 lat = ktime_to_ns(ktime_get()) - start_ns;
+	unsigned long mean = ACCESS_ONCE(q->poll_mean_ns);
+
+	/* keep it sane on 32bit, nobody polls for seconds */
+	lat = min_t(u64, lat, NSEC_PER_SEC);
+	if (!mean)
+		mean = lat;
+	else
+		mean = mean - (mean >> 3) + ((unsigned long) lat >> 3);
+	q->poll_mean_ns = mean;
+}
+EXPORT_SYMBOL_GPL(blk_poll_account);
+
 int __init blk_dev_init(void)
 {
 	BUILD_BUG_ON(__REQ_NR_BITS > 8 *
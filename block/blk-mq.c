@@ -0,0 +1,745 @@
+/*
+ * Multiqueue request submission.
+ *
+ * Bios are turned into requests on a per-cpu software queue and moved
+ * from there, in batches, to one of the hardware queues the driver
+ * registered.  There is no elevator and no q->queue_lock on this path:
+ * software queues have their own lock, requests are preallocated per
+ * hardware queue and handed out by tag, and a hardware queue is only run
+ * by one cpu at a time, with everything queued meanwhile picked up by
+ * that run.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/slab.h>
+#include <linux/delay.h>
+#include <linux/log2.h>
+
+#include <trace/events/block.h>
+
+#include "blk.h"
+#include "blk-mq.h"
+
+static struct blk_mq_ctx *blk_mq_get_ctx(struct request_queue *q)
+{
+	return per_cpu_ptr(q->queue_ctx, raw_smp_processor_id());
+}
+
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *q, const int cpu)
+{
+	return q->queue_hw_ctx[q->mq_map[cpu]];
+}
+EXPORT_SYMBOL(blk_mq_map_queue);
+
+/*
+ * Tags.  Each cpu starts looking at its own word of the map so that
+ * submitters on different cpus don't fight over the same cacheline.
+ */
+static int blk_mq_get_tag(struct blk_mq_hw_ctx *hctx)
+{
+	unsigned int depth = hctx->queue_depth;
+	unsigned int start;
+	int tag;
+
+	start = (raw_smp_processor_id() * BITS_PER_LONG) % depth;
+	do {
+		tag = find_next_zero_bit(hctx->tag_map, depth, start);
+		if (tag >= depth) {
+			tag = find_first_zero_bit(hctx->tag_map, depth);
+			if (tag >= depth)
+				return -1;
+		}
+	} while (test_and_set_bit_lock(tag, hctx->tag_map));
+
+	return tag;
+}
+
+static int blk_mq_wait_tag(struct blk_mq_hw_ctx *hctx)
+{
+	DEFINE_WAIT(wait);
+	int tag;
+
+	for (;;) {
+		prepare_to_wait_exclusive(&hctx->tag_wait, &wait,
+					  TASK_UNINTERRUPTIBLE);
+		tag = blk_mq_get_tag(hctx);
+		if (tag >= 0)
+			break;
+		io_schedule();
+	}
+	finish_wait(&hctx->tag_wait, &wait);
+
+	return tag;
+}
+
+static void blk_mq_put_tag(struct blk_mq_hw_ctx *hctx, unsigned int tag)
+{
+	clear_bit_unlock(tag, hctx->tag_map);
+	smp_mb__after_clear_bit();
+	if (waitqueue_active(&hctx->tag_wait))
+		wake_up(&hctx->tag_wait);
+}
+
+static struct request *blk_mq_get_request(struct request_queue *q,
+					  unsigned int rw_flags, bool wait)
+{
+	struct blk_mq_ctx *ctx = blk_mq_get_ctx(q);
+	struct blk_mq_hw_ctx *hctx = ctx->hctx;
+	struct request *rq;
+	int tag;
+
+	tag = blk_mq_get_tag(hctx);
+	if (tag < 0) {
+		if (!wait)
+			return NULL;
+		tag = blk_mq_wait_tag(hctx);
+	}
+
+	rq = hctx->rqs[tag];
+	blk_rq_init(q, rq);
+	rq->tag = tag;
+	rq->mq_ctx = ctx;
+	rq->cmd_flags = rw_flags;
+	if (blk_queue_io_stat(q))
+		rq->cmd_flags |= REQ_IO_STAT;
+
+	return rq;
+}
+
+/**
+ * blk_mq_alloc_request - allocate a request for a multiqueue device
+ * @q:		queue to allocate on
+ * @rw:		READ or WRITE
+ * @gfp:	__GFP_WAIT waits for a free tag, otherwise NULL is returned
+ *		when the hardware queue is full
+ */
+struct request *blk_mq_alloc_request(struct request_queue *q, int rw,
+				     gfp_t gfp)
+{
+	if (unlikely(blk_queue_dead(q)))
+		return NULL;
+
+	return blk_mq_get_request(q, rw, gfp & __GFP_WAIT);
+}
+EXPORT_SYMBOL(blk_mq_alloc_request);
+
+void blk_mq_free_request(struct request *rq)
+{
+	struct blk_mq_hw_ctx *hctx = rq->mq_ctx->hctx;
+
+	rq->mq_ctx = NULL;
+	blk_mq_put_tag(hctx, rq->tag);
+}
+EXPORT_SYMBOL(blk_mq_free_request);
+
+static void blk_mq_add_to_ctx(struct request *rq, bool at_head)
+{
+	struct blk_mq_ctx *ctx = rq->mq_ctx;
+	unsigned long flags;
+
+	trace_block_rq_insert(rq->q, rq);
+
+	spin_lock_irqsave(&ctx->lock, flags);
+	if (at_head)
+		list_add(&rq->queuelist, &ctx->rq_list);
+	else
+		list_add_tail(&rq->queuelist, &ctx->rq_list);
+	spin_unlock_irqrestore(&ctx->lock, flags);
+
+	set_bit(ctx->index_hw, ctx->hctx->ctx_map);
+}
+
+/**
+ * blk_mq_insert_request - queue a prepared request
+ * @rq:		request from blk_mq_alloc_request()
+ * @at_head:	queue in front of the requests of the same cpu
+ * @run_queue:	run the hardware queue afterwards
+ * @async:	run it from kblockd instead of the calling context
+ */
+void blk_mq_insert_request(struct request *rq, bool at_head, bool run_queue,
+			   bool async)
+{
+	blk_mq_add_to_ctx(rq, at_head);
+	if (run_queue)
+		blk_mq_run_hw_queue(rq->mq_ctx->hctx, async);
+}
+EXPORT_SYMBOL(blk_mq_insert_request);
+
+static void __blk_mq_end_io(struct request *rq, int error)
+{
+	if (blk_update_request(rq, error, blk_rq_bytes(rq)))
+		BUG();
+
+	blk_account_io_done(rq);
+
+	if (rq->end_io)
+		rq->end_io(rq, error);
+	else
+		blk_mq_free_request(rq);
+}
+
+/*
+ * Flush sequencing.
+ *
+ * Data with REQ_FLUSH waits for a preceding flush, and a FUA write to a
+ * device without FUA support is followed by one, with REQ_FLUSH_SEQ
+ * marking that its completion is pending on that flush.  Drivers only
+ * ever see data-less flushes, all of them from hctx->flush_rq.  Requests
+ * wanting a flush while it is in flight wait for the next one, so
+ * concurrent flushes coalesce.
+ */
+static void blk_mq_flush_end_io(struct request *flush_rq, int error);
+
+static void blk_mq_issue_flush(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	struct request *flush_rq = hctx->flush_rq;
+	struct request *first;
+
+	first = list_first_entry(&hctx->flush_running, struct request,
+				 queuelist);
+
+	blk_rq_init(hctx->queue, flush_rq);
+	flush_rq->cmd_type = REQ_TYPE_FS;
+	flush_rq->cmd_flags = WRITE_FLUSH;
+	flush_rq->rq_disk = first->rq_disk;
+	flush_rq->mq_ctx = hctx->ctxs[0];
+	flush_rq->end_io = blk_mq_flush_end_io;
+
+	blk_mq_insert_request(flush_rq, true, true, async);
+}
+
+static void blk_mq_queue_flush(struct blk_mq_hw_ctx *hctx, struct request *rq,
+			       bool async)
+{
+	unsigned long flags;
+	bool issue = false;
+
+	spin_lock_irqsave(&hctx->flush_lock, flags);
+	list_add_tail(&rq->queuelist, &hctx->flush_pending);
+	if (!hctx->flush_busy) {
+		list_splice_init(&hctx->flush_pending, &hctx->flush_running);
+		hctx->flush_busy = true;
+		issue = true;
+	}
+	spin_unlock_irqrestore(&hctx->flush_lock, flags);
+
+	if (issue)
+		blk_mq_issue_flush(hctx, async);
+}
+
+static void blk_mq_flush_end_io(struct request *flush_rq, int error)
+{
+	struct blk_mq_hw_ctx *hctx = flush_rq->mq_ctx->hctx;
+	struct request *rq, *n;
+	unsigned long flags;
+	bool issue = false;
+	LIST_HEAD(done);
+
+	spin_lock_irqsave(&hctx->flush_lock, flags);
+	list_splice_init(&hctx->flush_running, &done);
+	if (!list_empty(&hctx->flush_pending)) {
+		list_splice_init(&hctx->flush_pending, &hctx->flush_running);
+		issue = true;
+	} else
+		hctx->flush_busy = false;
+	spin_unlock_irqrestore(&hctx->flush_lock, flags);
+
+	list_for_each_entry_safe(rq, n, &done, queuelist) {
+		list_del_init(&rq->queuelist);
+
+		if (!error && (rq->cmd_flags & REQ_FLUSH) &&
+		    blk_rq_sectors(rq)) {
+			/* preflush done, on to the data */
+			rq->cmd_flags &= ~REQ_FLUSH;
+			blk_mq_add_to_ctx(rq, true);
+			continue;
+		}
+
+		rq->cmd_flags &= ~(REQ_FLUSH | REQ_FLUSH_SEQ);
+		__blk_mq_end_io(rq, error);
+	}
+
+	if (issue)
+		blk_mq_issue_flush(hctx, true);
+	else
+		blk_mq_run_hw_queue(hctx, true);
+}
+
+/*
+ * Returns true if @rq was taken over by flush sequencing.
+ */
+static bool blk_mq_flush_prepare(struct blk_mq_hw_ctx *hctx,
+				 struct request *rq)
+{
+	unsigned int flush_flags = hctx->queue->flush_flags;
+
+	if ((rq->cmd_flags & REQ_FUA) && !(flush_flags & REQ_FUA)) {
+		rq->cmd_flags &= ~REQ_FUA;
+		if (blk_rq_sectors(rq))
+			rq->cmd_flags |= REQ_FLUSH_SEQ;
+	}
+
+	if (rq->cmd_flags & REQ_FLUSH) {
+		blk_mq_queue_flush(hctx, rq, false);
+		return true;
+	}
+
+	/* a data-less FUA, nothing to do */
+	if (!blk_rq_sectors(rq)) {
+		__blk_mq_end_io(rq, 0);
+		return true;
+	}
+
+	return false;
+}
+
+/**
+ * blk_mq_end_io - complete a request
+ * @rq:		request to complete
+ * @error:	%0 for success, < %0 for error
+ *
+ * Completes all of @rq and frees it, or calls its end_io callback.  May be
+ * called from interrupt context.
+ */
+void blk_mq_end_io(struct request *rq, int error)
+{
+	if (unlikely(rq->cmd_flags & REQ_FLUSH_SEQ)) {
+		if (!error) {
+			/* data done, now the postflush */
+			blk_mq_queue_flush(rq->mq_ctx->hctx, rq, true);
+			return;
+		}
+		rq->cmd_flags &= ~REQ_FLUSH_SEQ;
+	}
+
+	__blk_mq_end_io(rq, error);
+}
+EXPORT_SYMBOL(blk_mq_end_io);
+
+static void blk_mq_start_request(struct request *rq)
+{
+	trace_block_rq_issue(rq->q, rq);
+	rq->cmd_flags |= REQ_STARTED;
+}
+
+static bool blk_mq_hctx_has_pending(struct blk_mq_hw_ctx *hctx)
+{
+	if (test_bit(BLK_MQ_S_STOPPED, &hctx->state))
+		return false;
+
+	return !bitmap_empty(hctx->ctx_map, hctx->nr_ctx) ||
+		!list_empty_careful(&hctx->dispatch);
+}
+
+static void __blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	struct request_queue *q = hctx->queue;
+	unsigned int i, queued = 0;
+	LIST_HEAD(rq_list);
+
+	hctx->run++;
+
+	/* Whatever the driver could not take last time goes first */
+	if (!list_empty_careful(&hctx->dispatch)) {
+		spin_lock_irq(&hctx->lock);
+		list_splice_init(&hctx->dispatch, &rq_list);
+		spin_unlock_irq(&hctx->lock);
+	}
+
+	for_each_set_bit(i, hctx->ctx_map, hctx->nr_ctx) {
+		struct blk_mq_ctx *ctx = hctx->ctxs[i];
+
+		clear_bit(i, hctx->ctx_map);
+		spin_lock_irq(&ctx->lock);
+		list_splice_tail_init(&ctx->rq_list, &rq_list);
+		spin_unlock_irq(&ctx->lock);
+	}
+
+	while (!list_empty(&rq_list)) {
+		struct request *rq;
+		int ret;
+
+		rq = list_first_entry(&rq_list, struct request, queuelist);
+		list_del_init(&rq->queuelist);
+
+		blk_mq_start_request(rq);
+		ret = q->mq_ops->queue_rq(hctx, rq);
+		if (ret == BLK_MQ_RQ_QUEUE_OK) {
+			queued++;
+			continue;
+		}
+		if (ret == BLK_MQ_RQ_QUEUE_BUSY) {
+			list_add(&rq->queuelist, &rq_list);
+			break;
+		}
+
+		pr_err("blk-mq: bad return on queue: %d\n", ret);
+		blk_mq_end_io(rq, rq->errors ? rq->errors : -EIO);
+	}
+
+	if (queued && q->mq_ops->commit_rqs)
+		q->mq_ops->commit_rqs(hctx);
+
+	if (!queued)
+		hctx->dispatched[0]++;
+	else
+		hctx->dispatched[min_t(unsigned int, fls(queued),
+				       BLK_MQ_MAX_DISPATCH_ORDER - 1)]++;
+	hctx->queued += queued;
+
+	if (!list_empty(&rq_list)) {
+		spin_lock_irq(&hctx->lock);
+		list_splice(&rq_list, &hctx->dispatch);
+		spin_unlock_irq(&hctx->lock);
+	}
+}
+
+/**
+ * blk_mq_run_hw_queue - hand queued requests to the driver
+ * @hctx:	hardware queue to run
+ * @async:	run from kblockd, required from atomic context
+ *
+ * If another cpu is running @hctx already, that run picks up what was
+ * queued here: it checks for new requests again before giving up the
+ * queue.
+ */
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *hctx, bool async)
+{
+	if (unlikely(test_bit(BLK_MQ_S_STOPPED, &hctx->state)))
+		return;
+
+	if (async) {
+		kblockd_schedule_delayed_work(hctx->queue, &hctx->run_work, 0);
+		return;
+	}
+
+	while (blk_mq_hctx_has_pending(hctx)) {
+		if (test_and_set_bit_lock(BLK_MQ_S_RUNNING, &hctx->state))
+			return;
+		__blk_mq_run_hw_queue(hctx);
+		clear_bit_unlock(BLK_MQ_S_RUNNING, &hctx->state);
+		smp_mb__after_clear_bit();
+	}
+}
+EXPORT_SYMBOL(blk_mq_run_hw_queue);
+
+void blk_mq_run_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		blk_mq_run_hw_queue(hctx, async);
+}
+EXPORT_SYMBOL(blk_mq_run_queues);
+
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *hctx)
+{
+	set_bit(BLK_MQ_S_STOPPED, &hctx->state);
+}
+EXPORT_SYMBOL(blk_mq_stop_hw_queue);
+
+void blk_mq_start_stopped_hw_queues(struct request_queue *q, bool async)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (!test_and_clear_bit(BLK_MQ_S_STOPPED, &hctx->state))
+			continue;
+		smp_mb__after_clear_bit();
+		blk_mq_run_hw_queue(hctx, async);
+	}
+}
+EXPORT_SYMBOL(blk_mq_start_stopped_hw_queues);
+
+/*
+ * Polled IO was queued on the submitting cpu's hardware queue, and the
+ * poller spins on that same cpu.
+ */
+static int blk_mq_poll(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = blk_mq_map_queue(q, raw_smp_processor_id());
+	return q->mq_ops->poll(hctx);
+}
+
+static void blk_mq_run_work_fn(struct work_struct *work)
+{
+	struct blk_mq_hw_ctx *hctx;
+
+	hctx = container_of(work, struct blk_mq_hw_ctx, run_work.work);
+	blk_mq_run_hw_queue(hctx, false);
+}
+
+static void blk_mq_make_request(struct request_queue *q, struct bio *bio)
+{
+	unsigned int rw_flags = bio_data_dir(bio);
+	struct blk_mq_hw_ctx *hctx;
+	struct request *rq;
+
+	blk_queue_bounce(q, &bio);
+
+	if (unlikely(blk_queue_dead(q))) {
+		bio_endio(bio, -ENODEV);
+		return;
+	}
+
+	if (rw_is_sync(bio->bi_rw))
+		rw_flags |= REQ_SYNC;
+
+	rq = blk_mq_get_request(q, rw_flags, true);
+	hctx = rq->mq_ctx->hctx;
+
+	init_request_from_bio(rq, bio);
+	drive_stat_acct(rq, 1);
+
+	if (unlikely(rq->cmd_flags & (REQ_FLUSH | REQ_FUA)) &&
+	    blk_mq_flush_prepare(hctx, rq))
+		return;
+
+	blk_mq_insert_request(rq, false, true, false);
+}
+
+/*
+ * Wait for every request to come back, e.g. before the driver goes away.
+ */
+void blk_mq_drain_queue(struct request_queue *q)
+{
+	while (true) {
+		struct blk_mq_hw_ctx *hctx;
+		bool busy = false;
+		int i;
+
+		queue_for_each_hw_ctx(q, hctx, i) {
+			if (!bitmap_empty(hctx->tag_map, hctx->queue_depth) ||
+			    hctx->flush_busy)
+				busy = true;
+		}
+		if (!busy)
+			break;
+
+		blk_mq_run_queues(q, false);
+		msleep(10);
+	}
+}
+
+void blk_mq_sync_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i)
+		cancel_delayed_work_sync(&hctx->run_work);
+}
+
+static void blk_mq_free_hw_ctx(struct blk_mq_hw_ctx *hctx)
+{
+	int i;
+
+	if (hctx->rqs) {
+		for (i = 0; i < hctx->queue_depth; i++)
+			kfree(hctx->rqs[i]);
+		kfree(hctx->rqs);
+	}
+	kfree(hctx->flush_rq);
+	kfree(hctx->tag_map);
+	kfree(hctx->ctx_map);
+	kfree(hctx->ctxs);
+	free_cpumask_var(hctx->cpumask);
+	kfree(hctx);
+}
+
+static void blk_mq_free_hw_queues(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (hctx)
+			blk_mq_free_hw_ctx(hctx);
+	}
+
+	free_percpu(q->queue_ctx);
+	kfree(q->queue_hw_ctx);
+	kfree(q->mq_map);
+
+	q->queue_ctx = NULL;
+	q->queue_hw_ctx = NULL;
+	q->mq_map = NULL;
+}
+
+void blk_mq_free_queue(struct request_queue *q)
+{
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		cancel_delayed_work_sync(&hctx->run_work);
+		if (q->mq_ops->exit_hctx)
+			q->mq_ops->exit_hctx(hctx, i);
+	}
+
+	blk_mq_free_hw_queues(q);
+}
+
+static struct blk_mq_hw_ctx *blk_mq_alloc_hw_ctx(struct request_queue *q,
+						 struct blk_mq_reg *reg,
+						 unsigned int index)
+{
+	size_t rq_size = sizeof(struct request) + reg->cmd_size;
+	int node = reg->numa_node;
+	struct blk_mq_hw_ctx *hctx;
+	int i;
+
+	hctx = kzalloc_node(sizeof(*hctx), GFP_KERNEL, node);
+	if (!hctx)
+		return NULL;
+
+	spin_lock_init(&hctx->lock);
+	INIT_LIST_HEAD(&hctx->dispatch);
+	INIT_DELAYED_WORK(&hctx->run_work, blk_mq_run_work_fn);
+	init_waitqueue_head(&hctx->tag_wait);
+	spin_lock_init(&hctx->flush_lock);
+	INIT_LIST_HEAD(&hctx->flush_pending);
+	INIT_LIST_HEAD(&hctx->flush_running);
+	hctx->queue = q;
+	hctx->queue_num = index;
+	hctx->queue_depth = reg->queue_depth;
+
+	if (!zalloc_cpumask_var_node(&hctx->cpumask, GFP_KERNEL, node))
+		goto fail;
+
+	hctx->ctxs = kzalloc_node(nr_cpu_ids * sizeof(void *), GFP_KERNEL,
+				  node);
+	hctx->ctx_map = kzalloc_node(BITS_TO_LONGS(nr_cpu_ids) *
+				     sizeof(unsigned long), GFP_KERNEL, node);
+	hctx->tag_map = kzalloc_node(BITS_TO_LONGS(hctx->queue_depth) *
+				     sizeof(unsigned long), GFP_KERNEL, node);
+	hctx->rqs = kzalloc_node(hctx->queue_depth * sizeof(struct request *),
+				 GFP_KERNEL, node);
+	hctx->flush_rq = kzalloc_node(rq_size, GFP_KERNEL, node);
+	if (!hctx->ctxs || !hctx->ctx_map || !hctx->tag_map || !hctx->rqs ||
+	    !hctx->flush_rq)
+		goto fail;
+
+	for (i = 0; i < hctx->queue_depth; i++) {
+		hctx->rqs[i] = kzalloc_node(rq_size, GFP_KERNEL, node);
+		if (!hctx->rqs[i])
+			goto fail;
+	}
+
+	return hctx;
+fail:
+	blk_mq_free_hw_ctx(hctx);
+	return NULL;
+}
+
+static int blk_mq_init_rqs(struct blk_mq_hw_ctx *hctx, struct blk_mq_reg *reg,
+			   void *driver_data)
+{
+	int i, ret;
+
+	if (!reg->ops->init_request)
+		return 0;
+
+	for (i = 0; i < hctx->queue_depth; i++) {
+		ret = reg->ops->init_request(driver_data, hctx->rqs[i],
+					     hctx->queue_num);
+		if (ret)
+			return ret;
+	}
+
+	return reg->ops->init_request(driver_data, hctx->flush_rq,
+				      hctx->queue_num);
+}
+
+/**
+ * blk_mq_init_queue - create a multiqueue request queue
+ * @reg:	hardware queues and driver operations
+ * @driver_data: passed to ->init_hctx()
+ *
+ * Cpus are spread evenly over @reg->nr_hw_queues hardware queues, in
+ * order, so that neighbouring cpus share one.
+ */
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *reg,
+					void *driver_data)
+{
+	struct blk_mq_hw_ctx *hctx;
+	struct request_queue *q;
+	unsigned int i;
+	int cpu;
+
+	if (!reg->nr_hw_queues || !reg->ops->queue_rq || !reg->queue_depth ||
+	    reg->queue_depth > BLK_MQ_MAX_DEPTH)
+		return ERR_PTR(-EINVAL);
+
+	q = blk_alloc_queue_node(GFP_KERNEL, reg->numa_node);
+	if (!q)
+		return ERR_PTR(-ENOMEM);
+
+	q->mq_ops = reg->ops;
+	q->nr_hw_queues = reg->nr_hw_queues;
+	q->queue_ctx = alloc_percpu(struct blk_mq_ctx);
+	q->queue_hw_ctx = kzalloc_node(reg->nr_hw_queues * sizeof(void *),
+				       GFP_KERNEL, reg->numa_node);
+	q->mq_map = kzalloc_node(nr_cpu_ids * sizeof(unsigned int),
+				 GFP_KERNEL, reg->numa_node);
+	if (!q->queue_ctx || !q->queue_hw_ctx || !q->mq_map)
+		goto fail;
+
+	for (i = 0; i < reg->nr_hw_queues; i++) {
+		q->queue_hw_ctx[i] = blk_mq_alloc_hw_ctx(q, reg, i);
+		if (!q->queue_hw_ctx[i])
+			goto fail;
+	}
+
+	for_each_possible_cpu(cpu) {
+		struct blk_mq_ctx *ctx = per_cpu_ptr(q->queue_ctx, cpu);
+
+		q->mq_map[cpu] = cpu * reg->nr_hw_queues / nr_cpu_ids;
+		hctx = blk_mq_map_queue(q, cpu);
+
+		spin_lock_init(&ctx->lock);
+		INIT_LIST_HEAD(&ctx->rq_list);
+		ctx->cpu = cpu;
+		ctx->queue = q;
+		ctx->hctx = hctx;
+		ctx->index_hw = hctx->nr_ctx;
+		hctx->ctxs[hctx->nr_ctx++] = ctx;
+		cpumask_set_cpu(cpu, hctx->cpumask);
+	}
+
+	queue_for_each_hw_ctx(q, hctx, i) {
+		if (reg->ops->init_hctx &&
+		    reg->ops->init_hctx(hctx, driver_data, i))
+			goto fail_hctx;
+		if (blk_mq_init_rqs(hctx, reg, driver_data)) {
+			i++;
+			goto fail_hctx;
+		}
+	}
+
+	blk_queue_make_request(q, blk_mq_make_request);
+	if (reg->ops->poll)
+		blk_queue_poll_fn(q, blk_mq_poll);
+	q->nr_requests = reg->queue_depth;
+
+	return q;
+
+fail_hctx:
+	while (i-- > 0) {
+		if (reg->ops->exit_hctx)
+			reg->ops->exit_hctx(q->queue_hw_ctx[i], i);
+	}
+fail:
+	blk_mq_free_hw_queues(q);
+	q->mq_ops = NULL;
+	blk_cleanup_queue(q);
+	return ERR_PTR(-ENOMEM);
+}
+EXPORT_SYMBOL(blk_mq_init_queue);
@@ -0,0 +1,23 @@
+#ifndef INT_BLK_MQ_H
+#define INT_BLK_MQ_H
+
+/*
+ * Per-cpu software queue.  Submitters queue requests here, and the
+ * hardware queue the cpu is mapped to pulls them out in batches.
+ */
+struct blk_mq_ctx {
+	spinlock_t		lock;
+	struct list_head	rq_list;
+
+	unsigned int		cpu;
+	unsigned int		index_hw;	/* bit in hctx->ctx_map */
+
+	struct blk_mq_hw_ctx	*hctx;
+	struct request_queue	*queue;
+} ____cacheline_aligned_in_smp;
+
+void blk_mq_drain_queue(struct request_queue *q);
+void blk_mq_sync_queue(struct request_queue *q);
+void blk_mq_free_queue(struct request_queue *q);
+
+#endif
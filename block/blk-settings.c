@@ -99,6 +99,21 @@ void blk_queue_lld_busy(struct request_queue *q, lld_busy_fn *fn)
 }
 EXPORT_SYMBOL_GPL(blk_queue_lld_busy);
 
+/**
+ * blk_queue_poll_fn - set driver completion polling function
+ * @q:		queue
+ * @fn:		reaps completed requests without waiting for an interrupt,
+ *		returns how many it found
+ *
+ * Lets synchronous IO spin for its completion instead of sleeping, once
+ * enabled through the io_poll queue attribute.
+ */
+void blk_queue_poll_fn(struct request_queue *q, poll_q_fn *fn)
+{
+	q->poll_fn = fn;
+}
+EXPORT_SYMBOL_GPL(blk_queue_poll_fn);
+
 /**
  * blk_set_default_limits - reset limits to default values
  * @lim:  the queue_limits structure to reset
@@ -9,6 +9,8 @@
 #include <linux/blktrace_api.h>
 
 #include "blk.h"
+#include "blk-mq.h"
+#include "blk-wbt.h"
 
 struct queue_sysfs_entry {
 	struct attribute attr;
@@ -243,6 +245,93 @@ static ssize_t queue_nomerges_store(struct request_queue *q, const char *page,
 	return ret;
 }
 
+static ssize_t queue_poll_show(struct request_queue *q, char *page)
+{
+	return queue_var_show(blk_queue_poll(q), page);
+}
+
+static ssize_t queue_poll_store(struct request_queue *q, const char *page,
+				size_t count)
+{
+	unsigned long poll;
+	ssize_t ret = queue_var_store(&poll, page, count);
+
+	if (poll && !q->poll_fn)
+		return -EINVAL;
+
+	spin_lock_irq(q->queue_lock);
+	if (poll)
+		queue_flag_set(QUEUE_FLAG_POLL, q);
+	else
+		queue_flag_clear(QUEUE_FLAG_POLL, q);
+	spin_unlock_irq(q->queue_lock);
+
+	return ret;
+}
+
+static ssize_t queue_poll_delay_show(struct request_queue *q, char *page)
+{
+	return sprintf(page, "%d\n", q->poll_delay);
+}
+
+static ssize_t queue_poll_delay_store(struct request_queue *q,
+				      const char *page, size_t count)
+{
+	long delay = simple_strtol(page, NULL, 10);
+
+	if (delay < -1 || delay > USEC_PER_SEC)
+		return -EINVAL;
+
+	q->poll_delay = delay;
+	return count;
+}
+
+#ifdef CONFIG_BLK_WBT
+static ssize_t queue_wb_lat_show(struct request_queue *q, char *page)
+{
+	if (!q->rq_wb)
+		return -EINVAL;
+
+	return sprintf(page, "%llu\n",
+		       div_u64(q->rq_wb->min_lat_nsec, NSEC_PER_USEC));
+}
+
+static ssize_t queue_wb_lat_store(struct request_queue *q, const char *page,
+				  size_t count)
+{
+	unsigned long val;
+	ssize_t ret;
+
+	if (!q->rq_wb)
+		return -EINVAL;
+
+	ret = queue_var_store(&val, page, count);
+	spin_lock_irq(q->queue_lock);
+	wbt_set_min_lat(q, (u64) val * NSEC_PER_USEC);
+	spin_unlock_irq(q->queue_lock);
+	return ret;
+}
+
+static ssize_t queue_wb_stats_show(struct request_queue *q, char *page)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	ssize_t ret;
+
+	if (!rwb)
+		return -EINVAL;
+
+	spin_lock_irq(q->queue_lock);
+	ret = sprintf(page, "inflight %u\nlimit %u\nscale_step %d\n"
+		      "throttled %lu\nscale_down %lu\nscale_up %lu\n"
+		      "min_read_lat_usec %llu\n",
+		      rwb->inflight, wbt_limit(rwb), rwb->scale_step,
+		      rwb->nr_throttled, rwb->nr_scale_down, rwb->nr_scale_up,
+		      div_u64(rwb->last_min_lat, NSEC_PER_USEC));
+	spin_unlock_irq(q->queue_lock);
+	return ret;
+}
+#endif
+
 static ssize_t queue_rq_affinity_show(struct request_queue *q, char *page)
 {
 	bool set = test_bit(QUEUE_FLAG_SAME_COMP, &q->queue_flags);
@@ -377,6 +466,31 @@ static struct queue_sysfs_entry queue_rq_affinity_entry = {
 	.store = queue_rq_affinity_store,
 };
 
+static struct queue_sysfs_entry queue_poll_entry = {
+	.attr = {.name = "io_poll", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_show,
+	.store = queue_poll_store,
+};
+
+static struct queue_sysfs_entry queue_poll_delay_entry = {
+	.attr = {.name = "io_poll_delay", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_poll_delay_show,
+	.store = queue_poll_delay_store,
+};
+
+#ifdef CONFIG_BLK_WBT
+static struct queue_sysfs_entry queue_wb_lat_entry = {
+	.attr = {.name = "wbt_lat_usec", .mode = S_IRUGO | S_IWUSR },
+	.show = queue_wb_lat_show,
+	.store = queue_wb_lat_store,
+};
+
+static struct queue_sysfs_entry queue_wb_stats_entry = {
+	.attr = {.name = "wbt_stats", .mode = S_IRUGO },
+	.show = queue_wb_stats_show,
+};
+#endif
+
 static struct queue_sysfs_entry queue_iostats_entry = {
 	.attr = {.name = "iostats", .mode = S_IRUGO | S_IWUSR },
 	.show = queue_show_iostats,
@@ -411,6 +525,12 @@ static struct attribute *default_attrs[] = {
 	&queue_rq_affinity_entry.attr,
 	&queue_iostats_entry.attr,
 	&queue_random_entry.attr,
+	&queue_poll_entry.attr,
+	&queue_poll_delay_entry.attr,
+#ifdef CONFIG_BLK_WBT
+	&queue_wb_lat_entry.attr,
+	&queue_wb_stats_entry.attr,
+#endif
 	NULL,
 };
 
@@ -484,7 +604,11 @@ static void blk_release_queue(struct kobject *kobj)
 	if (q->elevator)
 		elevator_exit(q->elevator);
 
+	if (q->mq_ops)
+		blk_mq_free_queue(q);
+
 	blk_throtl_exit(q);
+	wbt_exit(q);
 
 	if (rl->rq_pool)
 		mempool_destroy(rl->rq_pool);
@@ -534,6 +658,14 @@ int blk_register_queue(struct gendisk *disk)
 	if (!q->request_fn)
 		return 0;
 
+	/*
+	 * Set up here rather than at allocation, drivers have told us by
+	 * now whether the device is rotational.
+	 */
+	if (wbt_init(q))
+		printk(KERN_WARNING "%s: no writeback throttling\n",
+		       disk->disk_name);
+
 	ret = elv_register_queue(q);
 	if (ret) {
 		kobject_uevent(&q->kobj, KOBJ_REMOVE);
@@ -21,6 +21,17 @@ static int throtl_quantum = 32;
 /* Throttling is performed over 100ms slice and after that slice is renewed */
 static unsigned long throtl_slice = HZ/10;	/* 100 ms */
 
+/*
+ * While groups with a low limit are short of it, groups without one are
+ * held to this.
+ */
+#define THROTL_LOW_FLOOR_BPS	(320 * 1024)
+
+enum {
+	LIMIT_LOW,	/* groups capped at their low limits */
+	LIMIT_MAX,	/* groups capped at their max limits */
+};
+
 /* A workqueue to queue throttle related work */
 static struct workqueue_struct *kthrotld_workqueue;
 static void throtl_schedule_delayed_work(struct throtl_data *td,
@@ -56,6 +67,16 @@ struct throtl_grp {
 	atomic_t ref;
 	unsigned int flags;
 
+	/*
+	 * Group of the parent cgroup on the same queue, NULL for the root
+	 * group.  IO of a group is also charged to, and limited by, all
+	 * its ancestors.
+	 */
+	struct throtl_grp *parent;
+	unsigned int nr_children;
+	/* some ancestor has a max limit, see throtl_update_ancestor_limits */
+	bool ancestor_limited[2];
+
 	/* Two lists for READ and WRITE */
 	struct bio_list bio_lists[2];
 
@@ -65,6 +86,16 @@ struct throtl_grp {
 	/* bytes per second rate limits */
 	uint64_t bps[2];
 
+	/*
+	 * Bandwidth guaranteed to the group, 0 if none.  While a group with
+	 * a low limit is short of it, all groups are capped at their low
+	 * limit rather than the max one.
+	 */
+	uint64_t bps_low[2];
+	/* when IO was last dispatched, and how much since the last check */
+	unsigned long last_dispatch[2];
+	uint64_t bytes_window[2];
+
 	/* IOPS limits */
 	unsigned int iops[2];
 
@@ -106,6 +137,11 @@ struct throtl_data
 	struct delayed_work throtl_work;
 
 	int limits_changed;
+
+	/* LIMIT_LOW or LIMIT_MAX, and groups having a low limit */
+	int limit_index;
+	unsigned int nr_low_grps;
+	unsigned long low_check_time;
 };
 
 enum tg_state_flags {
@@ -154,11 +190,15 @@ static inline struct throtl_grp *throtl_ref_get_tg(struct throtl_grp *tg)
 	return tg;
 }
 
+static void throtl_put_tg(struct throtl_grp *tg);
+
 static void throtl_free_tg(struct rcu_head *head)
 {
 	struct throtl_grp *tg;
 
 	tg = container_of(head, struct throtl_grp, rcu_head);
+	if (tg->parent)
+		throtl_put_tg(tg->parent);
 	free_percpu(tg->blkg.stats_cpu);
 	kfree(tg);
 }
@@ -192,6 +232,7 @@ static void throtl_init_group(struct throtl_grp *tg)
 	/* Practically unlimited BW */
 	tg->bps[0] = tg->bps[1] = -1;
 	tg->iops[0] = tg->iops[1] = -1;
+	tg->last_dispatch[0] = tg->last_dispatch[1] = jiffies;
 
 	/*
 	 * Take the initial reference that will be released on destroy
@@ -246,11 +287,59 @@ throtl_tg_fill_dev_details(struct throtl_data *td, struct throtl_grp *tg)
 	spin_unlock_irq(td->queue->queue_lock);
 }
 
+static inline bool tg_has_max_rule(struct throtl_grp *tg, bool rw)
+{
+	return tg->bps[rw] != -1 || tg->iops[rw] != -1;
+}
+
+static inline bool tg_has_low_rule(struct throtl_grp *tg)
+{
+	return tg->bps_low[READ] || tg->bps_low[WRITE];
+}
+
+/* Cache whether any ancestor has a max limit, for the lockless fast path */
+static void throtl_update_ancestor_limits(struct throtl_grp *tg)
+{
+	struct throtl_grp *p;
+	int rw;
+
+	for (rw = READ; rw <= WRITE; rw++) {
+		tg->ancestor_limited[rw] = false;
+		for (p = tg->parent; p; p = p->parent)
+			if (tg_has_max_rule(p, rw))
+				tg->ancestor_limited[rw] = true;
+	}
+}
+
+static struct blkio_cgroup *blkcg_parent(struct blkio_cgroup *blkcg)
+{
+	struct cgroup *parent;
+
+	if (blkcg == &blkio_root_cgroup)
+		return NULL;
+
+	parent = blkcg->css.cgroup->parent;
+	return parent ? cgroup_to_blkio_cgroup(parent) : NULL;
+}
+
+static struct
+throtl_grp *throtl_find_tg(struct throtl_data *td, struct blkio_cgroup *blkcg);
+
 static void throtl_init_add_tg_lists(struct throtl_data *td,
 			struct throtl_grp *tg, struct blkio_cgroup *blkcg)
 {
+	struct blkio_cgroup *parent = blkcg_parent(blkcg);
+
 	__throtl_tg_fill_dev_details(td, tg);
 
+	/* Ancestor groups are always created first, see throtl_get_tg() */
+	if (parent) {
+		tg->parent = throtl_find_tg(td, parent);
+		BUG_ON(!tg->parent);
+		throtl_ref_get_tg(tg->parent);
+		tg->parent->nr_children++;
+	}
+
 	/* Add group onto cgroup list */
 	blkiocg_add_blkio_group(blkcg, &tg->blkg, (void *)td,
 				tg->blkg.dev, BLKIO_POLICY_THROTL);
@@ -259,6 +348,11 @@ static void throtl_init_add_tg_lists(struct throtl_data *td,
 	tg->bps[WRITE] = blkcg_get_write_bps(blkcg, tg->blkg.dev);
 	tg->iops[READ] = blkcg_get_read_iops(blkcg, tg->blkg.dev);
 	tg->iops[WRITE] = blkcg_get_write_iops(blkcg, tg->blkg.dev);
+	tg->bps_low[READ] = blkcg_get_read_bps_low(blkcg, tg->blkg.dev);
+	tg->bps_low[WRITE] = blkcg_get_write_bps_low(blkcg, tg->blkg.dev);
+	if (tg_has_low_rule(tg))
+		td->nr_low_grps++;
+	throtl_update_ancestor_limits(tg);
 
 	throtl_add_group_to_td_list(td, tg);
 }
@@ -303,10 +397,26 @@ throtl_grp *throtl_find_tg(struct throtl_data *td, struct blkio_cgroup *blkcg)
 	return tg;
 }
 
+/*
+ * The topmost cgroup on the way from @blkcg to the root without a group on
+ * @td yet, NULL if there is none.  Called under rcu and queue lock.
+ */
+static struct blkio_cgroup *
+throtl_missing_blkcg(struct throtl_data *td, struct blkio_cgroup *blkcg)
+{
+	struct blkio_cgroup *missing = NULL;
+
+	for (; blkcg; blkcg = blkcg_parent(blkcg))
+		if (!throtl_find_tg(td, blkcg))
+			missing = blkcg;
+
+	return missing;
+}
+
 static struct throtl_grp * throtl_get_tg(struct throtl_data *td)
 {
-	struct throtl_grp *tg = NULL, *__tg = NULL;
-	struct blkio_cgroup *blkcg;
+	struct throtl_grp *tg = NULL;
+	struct blkio_cgroup *blkcg, *missing;
 	struct request_queue *q = td->queue;
 
 	/* no throttling for dead queue */
@@ -316,57 +426,59 @@ static struct throtl_grp * throtl_get_tg(struct throtl_data *td)
 	rcu_read_lock();
 	blkcg = task_blkio_cgroup(current);
 	tg = throtl_find_tg(td, blkcg);
-	if (tg) {
-		rcu_read_unlock();
+	rcu_read_unlock();
+	if (tg)
 		return tg;
-	}
 
 	/*
-	 * Need to allocate a group. Allocation of group also needs allocation
-	 * of per cpu stats which in-turn takes a mutex() and can block. Hence
-	 * we need to drop rcu lock and queue_lock before we call alloc.
+	 * Need to allocate the group, and those of its ancestors which
+	 * don't exist yet, top down so every group finds its parent.
+	 * Allocation of group also needs allocation of per cpu stats which
+	 * in-turn takes a mutex() and can block. Hence we need to drop rcu
+	 * lock and queue_lock before we call alloc.
 	 */
-	rcu_read_unlock();
-	spin_unlock_irq(q->queue_lock);
+	while (1) {
+		spin_unlock_irq(q->queue_lock);
 
-	tg = throtl_alloc_tg(td);
+		tg = throtl_alloc_tg(td);
 
-	/* Group allocated and queue is still alive. take the lock */
-	spin_lock_irq(q->queue_lock);
+		/* Group allocated and queue is still alive. take the lock */
+		spin_lock_irq(q->queue_lock);
 
-	/* Make sure @q is still alive */
-	if (unlikely(blk_queue_dead(q))) {
-		kfree(tg);
-		return NULL;
-	}
+		/* Make sure @q is still alive */
+		if (unlikely(blk_queue_dead(q))) {
+			kfree(tg);
+			return NULL;
+		}
 
-	/*
-	 * Initialize the new group. After sleeping, read the blkcg again.
-	 */
-	rcu_read_lock();
-	blkcg = task_blkio_cgroup(current);
+		/*
+		 * After sleeping, read the blkcg again.  If some other thread
+		 * already allocated the groups while we were not holding
+		 * queue lock, free up the group
+		 */
+		rcu_read_lock();
+		blkcg = task_blkio_cgroup(current);
+		missing = throtl_missing_blkcg(td, blkcg);
 
-	/*
-	 * If some other thread already allocated the group while we were
-	 * not holding queue lock, free up the group
-	 */
-	__tg = throtl_find_tg(td, blkcg);
+		if (!missing) {
+			kfree(tg);
+			tg = throtl_find_tg(td, blkcg);
+			rcu_read_unlock();
+			return tg;
+		}
 
-	if (__tg) {
-		kfree(tg);
+		/* Group allocation failed. Account the IO to root group */
+		if (!tg) {
+			rcu_read_unlock();
+			return td->root_tg;
+		}
+
+		throtl_init_add_tg_lists(td, tg, missing);
 		rcu_read_unlock();
-		return __tg;
-	}
 
-	/* Group allocation failed. Account the IO to root group */
-	if (!tg) {
-		tg = td->root_tg;
-		return tg;
+		if (missing == blkcg)
+			return tg;
 	}
-
-	throtl_init_add_tg_lists(td, tg, blkcg);
-	rcu_read_unlock();
-	return tg;
 }
 
 static struct throtl_grp *throtl_rb_first(struct throtl_rb_root *root)
@@ -484,6 +596,23 @@ static void throtl_schedule_next_dispatch(struct throtl_data *td)
 		throtl_schedule_delayed_work(td, (st->min_disptime - jiffies));
 }
 
+/* bps limit of @tg in the current limit state of @td */
+static uint64_t tg_bps_limit(struct throtl_data *td, struct throtl_grp *tg,
+			     bool rw)
+{
+	if (td->limit_index == LIMIT_MAX)
+		return tg->bps[rw];
+
+	if (tg->bps_low[rw])
+		return min(tg->bps_low[rw], tg->bps[rw]);
+
+	/* IO of groups with a low limit passes through their ancestors */
+	if (tg->nr_children)
+		return tg->bps[rw];
+
+	return min_t(uint64_t, THROTL_LOW_FLOOR_BPS, tg->bps[rw]);
+}
+
 static inline void
 throtl_start_new_slice(struct throtl_data *td, struct throtl_grp *tg, bool rw)
 {
@@ -526,7 +655,7 @@ static inline void
 throtl_trim_slice(struct throtl_data *td, struct throtl_grp *tg, bool rw)
 {
 	unsigned long nr_slices, time_elapsed, io_trim;
-	u64 bytes_trim, tmp;
+	u64 bytes_trim, tmp, bps = tg_bps_limit(td, tg, rw);
 
 	BUG_ON(time_before(tg->slice_end[rw], tg->slice_start[rw]));
 
@@ -554,7 +683,7 @@ throtl_trim_slice(struct throtl_data *td, struct throtl_grp *tg, bool rw)
 
 	if (!nr_slices)
 		return;
-	tmp = tg->bps[rw] * throtl_slice * nr_slices;
+	tmp = bps * throtl_slice * nr_slices;
 	do_div(tmp, HZ);
 	bytes_trim = tmp;
 
@@ -635,7 +764,7 @@ static bool tg_with_in_bps_limit(struct throtl_data *td, struct throtl_grp *tg,
 		struct bio *bio, unsigned long *wait)
 {
 	bool rw = bio_data_dir(bio);
-	u64 bytes_allowed, extra_bytes, tmp;
+	u64 bytes_allowed, extra_bytes, tmp, bps = tg_bps_limit(td, tg, rw);
 	unsigned long jiffy_elapsed, jiffy_wait, jiffy_elapsed_rnd;
 
 	jiffy_elapsed = jiffy_elapsed_rnd = jiffies - tg->slice_start[rw];
@@ -646,7 +775,7 @@ static bool tg_with_in_bps_limit(struct throtl_data *td, struct throtl_grp *tg,
 
 	jiffy_elapsed_rnd = roundup(jiffy_elapsed_rnd, throtl_slice);
 
-	tmp = tg->bps[rw] * jiffy_elapsed_rnd;
+	tmp = bps * jiffy_elapsed_rnd;
 	do_div(tmp, HZ);
 	bytes_allowed = tmp;
 
@@ -658,7 +787,7 @@ static bool tg_with_in_bps_limit(struct throtl_data *td, struct throtl_grp *tg,
 
 	/* Calc approx time to dispatch */
 	extra_bytes = tg->bytes_disp[rw] + bio->bi_size - bytes_allowed;
-	jiffy_wait = div64_u64(extra_bytes * HZ, tg->bps[rw]);
+	jiffy_wait = div64_u64(extra_bytes * HZ, bps);
 
 	if (!jiffy_wait)
 		jiffy_wait = 1;
@@ -673,32 +802,29 @@ static bool tg_with_in_bps_limit(struct throtl_data *td, struct throtl_grp *tg,
 	return 0;
 }
 
-static bool tg_no_rule_group(struct throtl_grp *tg, bool rw) {
-	if (tg->bps[rw] == -1 && tg->iops[rw] == -1)
-		return 1;
-	return 0;
-}
-
 /*
- * Returns whether one can dispatch a bio or not. Also returns approx number
- * of jiffies to wait before this bio is with-in IO rate and can be dispatched
+ * Whether bios of @tg in direction @rw can skip throttling altogether.
+ * Only looks at fields which are safe to read under rcu.
  */
-static bool tg_may_dispatch(struct throtl_data *td, struct throtl_grp *tg,
+static bool tg_no_rule_group(struct throtl_data *td, struct throtl_grp *tg,
+			     bool rw)
+{
+	if (td->nr_low_grps)
+		return 0;
+	if (tg_has_max_rule(tg, rw) || tg->ancestor_limited[rw])
+		return 0;
+	return 1;
+}
+
+/* Whether @tg alone, ignoring its ancestors, allows @bio now */
+static bool __tg_may_dispatch(struct throtl_data *td, struct throtl_grp *tg,
 				struct bio *bio, unsigned long *wait)
 {
 	bool rw = bio_data_dir(bio);
 	unsigned long bps_wait = 0, iops_wait = 0, max_wait = 0;
 
-	/*
- 	 * Currently whole state machine of group depends on first bio
-	 * queued in the group bio list. So one should not be calling
-	 * this function with a different bio if there are other bios
-	 * queued.
-	 */
-	BUG_ON(tg->nr_queued[rw] && bio != bio_list_peek(&tg->bio_lists[rw]));
-
 	/* If tg->bps = -1, then BW is unlimited */
-	if (tg->bps[rw] == -1 && tg->iops[rw] == -1) {
+	if (tg_bps_limit(td, tg, rw) == -1 && tg->iops[rw] == -1) {
 		if (wait)
 			*wait = 0;
 		return 1;
@@ -734,16 +860,59 @@ static bool tg_may_dispatch(struct throtl_data *td, struct throtl_grp *tg,
 	return 0;
 }
 
+/*
+ * Returns whether one can dispatch a bio or not. Also returns approx number
+ * of jiffies to wait before this bio is with-in IO rate and can be dispatched
+ * Limits of all ancestors apply too, the longest wait wins.
+ */
+static bool tg_may_dispatch(struct throtl_data *td, struct throtl_grp *tg,
+				struct bio *bio, unsigned long *wait)
+{
+	bool rw = bio_data_dir(bio);
+	unsigned long tg_wait, max_wait = 0;
+	bool may = true;
+
+	/*
+ 	 * Currently whole state machine of group depends on first bio
+	 * queued in the group bio list. So one should not be calling
+	 * this function with a different bio if there are other bios
+	 * queued.
+	 */
+	BUG_ON(tg->nr_queued[rw] && bio != bio_list_peek(&tg->bio_lists[rw]));
+
+	for (; tg; tg = tg->parent) {
+		if (!__tg_may_dispatch(td, tg, bio, &tg_wait)) {
+			may = false;
+			max_wait = max(max_wait, tg_wait);
+		}
+	}
+
+	if (wait)
+		*wait = max_wait;
+	return may;
+}
+
 static void throtl_charge_bio(struct throtl_grp *tg, struct bio *bio)
 {
 	bool rw = bio_data_dir(bio);
 	bool sync = rw_is_sync(bio->bi_rw);
 
-	/* Charge the bio to the group */
-	tg->bytes_disp[rw] += bio->bi_size;
-	tg->io_disp[rw]++;
-
 	blkiocg_update_dispatch_stats(&tg->blkg, bio->bi_size, rw, sync);
+
+	/* Charge the bio to the group and its ancestors */
+	for (; tg; tg = tg->parent) {
+		tg->bytes_disp[rw] += bio->bi_size;
+		tg->io_disp[rw]++;
+		tg->bytes_window[rw] += bio->bi_size;
+		tg->last_dispatch[rw] = jiffies;
+	}
+}
+
+static void
+throtl_trim_slices(struct throtl_data *td, struct throtl_grp *tg, bool rw)
+{
+	for (; tg; tg = tg->parent)
+		throtl_trim_slice(td, tg, rw);
 }
 
 static void throtl_add_bio_tg(struct throtl_data *td, struct throtl_grp *tg,
@@ -796,7 +965,7 @@ static void tg_dispatch_one_bio(struct throtl_data *td, struct throtl_grp *tg,
 	bio_list_add(bl, bio);
 	bio->bi_rw |= REQ_THROTTLED;
 
-	throtl_trim_slice(td, tg, rw);
+	throtl_trim_slices(td, tg, rw);
 }
 
 static int throtl_dispatch_tg(struct throtl_data *td, struct throtl_grp *tg,
@@ -863,6 +1032,143 @@ static int throtl_select_dispatch(struct throtl_data *td, struct bio_list *bl)
 	return nr_disp;
 }
 
+static void throtl_count_low_grps(struct throtl_data *td)
+{
+	struct throtl_grp *tg;
+	struct hlist_node *pos;
+
+	td->nr_low_grps = 0;
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node)
+		if (tg_has_low_rule(tg))
+			td->nr_low_grps++;
+}
+
+/* Limits or the limit state changed, recompute when groups may dispatch */
+static void throtl_update_disptimes(struct throtl_data *td)
+{
+	struct throtl_grp *tg;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node)
+		if (throtl_tg_on_rr(tg))
+			tg_update_disptime(td, tg);
+}
+
+/* Whether @tg got (about) its low limit over the last @elapsed jiffies */
+static bool tg_reached_low(struct throtl_grp *tg, bool rw,
+			   unsigned long elapsed)
+{
+	if (tg->nr_queued[rw])
+		return true;
+
+	return tg->bytes_window[rw] * HZ * 4 >= tg->bps_low[rw] * elapsed * 3;
+}
+
+static bool tg_idle(struct throtl_grp *tg, bool rw)
+{
+	return time_after(jiffies, tg->last_dispatch[rw] + throtl_slice);
+}
+
+/*
+ * Lift the groups to their max limits once every group with a low limit
+ * gets it, or doesn't do IO.
+ */
+static bool throtl_can_upgrade(struct throtl_data *td, unsigned long elapsed)
+{
+	struct throtl_grp *tg;
+	struct hlist_node *pos;
+	int rw;
+
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node) {
+		for (rw = READ; rw <= WRITE; rw++) {
+			if (!tg->bps_low[rw] || tg_idle(tg, rw))
+				continue;
+			if (!tg_reached_low(tg, rw, elapsed))
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Go back to the low limits when a group doing IO falls short of its low
+ * limit while others use the device.
+ */
+static bool
+throtl_should_downgrade(struct throtl_data *td, unsigned long elapsed)
+{
+	struct throtl_grp *tg, *root = td->root_tg;
+	struct hlist_node *pos;
+	uint64_t total, own;
+	int rw;
+
+	total = root->bytes_window[READ] + root->bytes_window[WRITE];
+
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node) {
+		own = tg->bytes_window[READ] + tg->bytes_window[WRITE];
+		for (rw = READ; rw <= WRITE; rw++) {
+			if (!tg->bps_low[rw] || tg_idle(tg, rw))
+				continue;
+			if (!tg_reached_low(tg, rw, elapsed) && total > own)
+				return true;
+		}
+	}
+
+	return false;
+}
+
+static void throtl_set_limit_index(struct throtl_data *td, int index)
+{
+	struct throtl_grp *tg;
+	struct hlist_node *pos;
+
+	td->limit_index = index;
+	throtl_log(td, "limit %s", index == LIMIT_LOW ? "low" : "max");
+
+	/* Don't judge IO dispatched so far by the new limits */
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node) {
+		throtl_start_new_slice(td, tg, READ);
+		throtl_start_new_slice(td, tg, WRITE);
+	}
+
+	throtl_update_disptimes(td);
+	throtl_schedule_next_dispatch(td);
+}
+
+/*
+ * Switch between low and max limits, at most once per throtl_slice.
+ * Called with queue lock held.
+ */
+static void throtl_update_limit_index(struct throtl_data *td)
+{
+	unsigned long elapsed = jiffies - td->low_check_time;
+	int index = td->limit_index;
+	struct throtl_grp *tg;
+	struct hlist_node *pos;
+
+	if (!td->nr_low_grps) {
+		if (index != LIMIT_MAX)
+			throtl_set_limit_index(td, LIMIT_MAX);
+		return;
+	}
+
+	if (elapsed < throtl_slice)
+		return;
+
+	if (index == LIMIT_LOW && throtl_can_upgrade(td, elapsed))
+		index = LIMIT_MAX;
+	else if (index == LIMIT_MAX && throtl_should_downgrade(td, elapsed))
+		index = LIMIT_LOW;
+
+	hlist_for_each_entry(tg, pos, &td->tg_list, tg_node)
+		tg->bytes_window[READ] = tg->bytes_window[WRITE] = 0;
+	td->low_check_time = jiffies;
+
+	if (index != td->limit_index)
+		throtl_set_limit_index(td, index);
+}
+
 static void throtl_process_limit_change(struct throtl_data *td)
 {
 	struct throtl_grp *tg;
@@ -875,7 +1181,11 @@ static void throtl_process_limit_change(struct throtl_data *td)
 
 	throtl_log(td, "limits changed");
 
+	throtl_count_low_grps(td);
+
 	hlist_for_each_entry_safe(tg, pos, n, &td->tg_list, tg_node) {
+		throtl_update_ancestor_limits(tg);
+
 		if (!tg->limits_changed)
 			continue;
 
@@ -894,10 +1204,10 @@ static void throtl_process_limit_change(struct throtl_data *td)
 		 */
 		throtl_start_new_slice(td, tg, 0);
 		throtl_start_new_slice(td, tg, 1);
-
-		if (throtl_tg_on_rr(tg))
-			tg_update_disptime(td, tg);
 	}
+
+	/* with ancestors' limits changed, descendants may wait longer */
+	throtl_update_disptimes(td);
 }
 
 /* Dispatch throttled bios. Should be called without queue lock held. */
@@ -912,6 +1222,7 @@ static int throtl_dispatch(struct request_queue *q)
 	spin_lock_irq(q->queue_lock);
 
 	throtl_process_limit_change(td);
+	throtl_update_limit_index(td);
 
 	if (!total_nr_queued(td))
 		goto out;
@@ -980,6 +1291,9 @@ throtl_destroy_tg(struct throtl_data *td, struct throtl_grp *tg)
 	BUG_ON(hlist_unhashed(&tg->tg_node));
 
 	hlist_del_init(&tg->tg_node);
+	if (tg->parent)
+		tg->parent->nr_children--;
+	throtl_count_low_grps(td);
 
 	/*
 	 * Put the reference taken at the time of creation so that when all
@@ -1087,6 +1401,26 @@ static void throtl_update_blkio_group_write_iops(void *key,
 	throtl_update_blkio_group_common(td, tg);
 }
 
+static void throtl_update_blkio_group_read_bps_low(void *key,
+				struct blkio_group *blkg, u64 read_bps)
+{
+	struct throtl_data *td = key;
+	struct throtl_grp *tg = tg_of_blkg(blkg);
+
+	tg->bps_low[READ] = read_bps;
+	throtl_update_blkio_group_common(td, tg);
+}
+
+static void throtl_update_blkio_group_write_bps_low(void *key,
+				struct blkio_group *blkg, u64 write_bps)
+{
+	struct throtl_data *td = key;
+	struct throtl_grp *tg = tg_of_blkg(blkg);
+
+	tg->bps_low[WRITE] = write_bps;
+	throtl_update_blkio_group_common(td, tg);
+}
+
 static void throtl_shutdown_wq(struct request_queue *q)
 {
 	struct throtl_data *td = q->td;
@@ -1105,6 +1439,10 @@ static struct blkio_policy_type blkio_policy_throtl = {
 					throtl_update_blkio_group_read_iops,
 		.blkio_update_group_write_iops_fn =
 					throtl_update_blkio_group_write_iops,
+		.blkio_update_group_read_bps_low_fn =
+					throtl_update_blkio_group_read_bps_low,
+		.blkio_update_group_write_bps_low_fn =
+					throtl_update_blkio_group_write_bps_low,
 	},
 	.plid = BLKIO_POLICY_THROTL,
 };
@@ -1124,8 +1462,9 @@ bool blk_throtl_bio(struct request_queue *q, struct bio *bio)
 
 	/*
 	 * A throtl_grp pointer retrieved under rcu can be used to access
-	 * basic fields like stats and io rates. If a group has no rules,
-	 * just update the dispatch stats in lockless manner and return.
+	 * basic fields like stats and io rates. If neither a group nor its
+	 * ancestors have rules, just update the per cpu dispatch stats in
+	 * lockless manner and return.
 	 */
 
 	rcu_read_lock();
@@ -1134,7 +1473,7 @@ bool blk_throtl_bio(struct request_queue *q, struct bio *bio)
 	if (tg) {
 		throtl_tg_fill_dev_details(td, tg);
 
-		if (tg_no_rule_group(tg, rw)) {
+		if (tg_no_rule_group(td, tg, rw)) {
 			blkiocg_update_dispatch_stats(&tg->blkg, bio->bi_size,
 					rw, rw_is_sync(bio->bi_rw));
 			rcu_read_unlock();
@@ -1152,6 +1491,8 @@ bool blk_throtl_bio(struct request_queue *q, struct bio *bio)
 	if (unlikely(!tg))
 		goto out_unlock;
 
+	throtl_update_limit_index(td);
+
 	if (tg->nr_queued[rw]) {
 		/*
 		 * There is already another bio queued in same dir. No
@@ -1177,7 +1518,7 @@ bool blk_throtl_bio(struct request_queue *q, struct bio *bio)
 		 *
 		 * So keep on trimming slice even if bio is not queued.
 		 */
-		throtl_trim_slice(td, tg, rw);
+		throtl_trim_slices(td, tg, rw);
 		goto out_unlock;
 	}
 
@@ -1250,6 +1591,8 @@ int blk_throtl_init(struct request_queue *q)
 	INIT_HLIST_HEAD(&td->tg_list);
 	td->tg_service_tree = THROTL_RB_ROOT;
 	td->limits_changed = false;
+	td->limit_index = LIMIT_MAX;
+	td->low_check_time = jiffies;
 	INIT_DELAYED_WORK(&td->throtl_work, blk_throtl_work);
 
 	/* alloc and Init root group. */
@@ -0,0 +1,256 @@
+/*
+ * Writeback throttling
+ *
+ * The dirty page limits keep writers from dirtying too much memory, but
+ * not the flusher threads from filling the device queue with writeback.
+ * Reads issued behind that wait for all of it.  This caps the number of
+ * buffered writeback requests a queue may have allocated, and scales the
+ * cap from the latency of reads: if even the fastest read of a window
+ * completed slower than the target, writeback gets half as many requests,
+ * if reads are fine (or there are none), it gets more again.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/bio.h>
+#include <linux/blkdev.h>
+#include <linux/swap.h>
+
+#include "blk.h"
+#include "blk-wbt.h"
+
+/* depth at scale step 0, for queues without tags */
+#define WBT_DEF_DEPTH		16
+
+/* default read latency targets */
+#define WBT_DEF_LAT_NONROT	(2 * NSEC_PER_MSEC)
+#define WBT_DEF_LAT_ROT		(75 * NSEC_PER_MSEC)
+
+/* latency is looked at over windows this long */
+#define WBT_WINDOW		(HZ / 10)
+
+/*
+ * Plain buffered writeback only: sync writes have somebody waiting on
+ * them, and kswapd must not get stuck behind the flusher threads.
+ */
+static bool wbt_should_throttle(struct bio *bio)
+{
+	const unsigned long mask = REQ_WRITE | REQ_SYNC | REQ_META |
+				   REQ_DISCARD | REQ_FLUSH | REQ_FUA;
+
+	if ((bio->bi_rw & mask) != REQ_WRITE)
+		return false;
+
+	return !current_is_kswapd();
+}
+
+unsigned int wbt_limit(struct rq_wb *rwb)
+{
+	struct request_queue *q = rwb->q;
+	unsigned int depth = WBT_DEF_DEPTH;
+
+	if (q->queue_tags)
+		depth = q->queue_tags->max_depth;
+	depth = min_t(unsigned int, depth, q->nr_requests);
+
+	return max(depth >> rwb->scale_step, 1U);
+}
+
+static void wbt_arm_window(struct rq_wb *rwb)
+{
+	if (!timer_pending(&rwb->window_timer))
+		mod_timer(&rwb->window_timer, jiffies + WBT_WINDOW);
+}
+
+static void wbt_scale_down(struct rq_wb *rwb)
+{
+	if (wbt_limit(rwb) > 1) {
+		rwb->scale_step++;
+		rwb->nr_scale_down++;
+	}
+}
+
+static void wbt_scale_up(struct rq_wb *rwb)
+{
+	if (rwb->scale_step > 0) {
+		rwb->scale_step--;
+		rwb->nr_scale_up++;
+		wake_up_all(&rwb->wait);
+	}
+}
+
+static void wbt_window_timer(unsigned long data)
+{
+	struct rq_wb *rwb = (struct rq_wb *) data;
+	struct request_queue *q = rwb->q;
+	unsigned long flags;
+	bool writing;
+
+	spin_lock_irqsave(q->queue_lock, flags);
+
+	writing = rwb->win_writes || rwb->inflight;
+
+	if (rwb->win_reads) {
+		rwb->last_min_lat = rwb->win_min_lat;
+		if (rwb->win_min_lat > rwb->min_lat_nsec && writing)
+			wbt_scale_down(rwb);
+		else
+			wbt_scale_up(rwb);
+	} else if (writing)
+		wbt_scale_up(rwb);
+
+	rwb->win_reads = 0;
+	rwb->win_writes = 0;
+	rwb->win_min_lat = 0;
+
+	/*
+	 * Nothing going on, start over from the full depth next time.
+	 */
+	if (writing)
+		wbt_arm_window(rwb);
+	else
+		rwb->scale_step = 0;
+
+	spin_unlock_irqrestore(q->queue_lock, flags);
+}
+
+/**
+ * wbt_wait - wait for a writeback slot
+ * @q:		request queue @bio is going to
+ * @bio:	bio about to get a request
+ *
+ * Description:
+ *    Called with the queue lock held before allocating a request for
+ *    @bio, which may be dropped to sleep.  Returns true if @bio was
+ *    counted, in which case its request must be marked %REQ_WB_TRACKED,
+ *    or wbt_untrack() called if it gets none.
+ */
+bool wbt_wait(struct request_queue *q, struct bio *bio)
+	__releases(q->queue_lock) __acquires(q->queue_lock)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	DEFINE_WAIT(wait);
+
+	if (!rwb || !wbt_should_throttle(bio))
+		return false;
+
+	rwb->win_writes++;
+	wbt_arm_window(rwb);
+
+	if (rwb->min_lat_nsec && rwb->inflight >= wbt_limit(rwb)) {
+		rwb->nr_throttled++;
+		do {
+			prepare_to_wait_exclusive(&rwb->wait, &wait,
+						  TASK_UNINTERRUPTIBLE);
+			spin_unlock_irq(q->queue_lock);
+			io_schedule();
+			spin_lock_irq(q->queue_lock);
+		} while (rwb->min_lat_nsec && rwb->inflight >= wbt_limit(rwb));
+		finish_wait(&rwb->wait, &wait);
+	}
+
+	rwb->inflight++;
+	return true;
+}
+
+/*
+ * queue lock must be held
+ */
+void wbt_untrack(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	WARN_ON_ONCE(!rwb->inflight);
+	rwb->inflight--;
+
+	if (waitqueue_active(&rwb->wait) && rwb->inflight < wbt_limit(rwb))
+		wake_up(&rwb->wait);
+}
+
+/*
+ * A tracked request lets the next writer in when it is freed, which also
+ * covers requests merged away before they ever reached the driver.
+ */
+void wbt_free_request(struct request_queue *q, struct request *rq)
+{
+	if (rq->cmd_flags & REQ_WB_TRACKED) {
+		rq->cmd_flags &= ~REQ_WB_TRACKED;
+		wbt_untrack(q);
+	}
+}
+
+void wbt_issue(struct request_queue *q, struct request *rq)
+{
+	if (!q->rq_wb)
+		return;
+
+	if (rq->cmd_type == REQ_TYPE_FS && rq_data_dir(rq) == READ)
+		rq->wbt_issue_ns = ktime_to_ns(ktime_get());
+	else
+		rq->wbt_issue_ns = 0;
+}
+
+void wbt_done(struct request_queue *q, struct request *rq)
+{
+	struct rq_wb *rwb = q->rq_wb;
+	u64 lat;
+
+	if (!rwb || !rq->wbt_issue_ns)
+		return;
+
+	lat = ktime_to_ns(ktime_get()) - rq->wbt_issue_ns;
+	rq->wbt_issue_ns = 0;
+
+	if (!rwb->win_reads || lat < rwb->win_min_lat)
+		rwb->win_min_lat = lat;
+	rwb->win_reads++;
+}
+
+/*
+ * queue lock must be held, 0 disables throttling
+ */
+void wbt_set_min_lat(struct request_queue *q, u64 nsec)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	rwb->min_lat_nsec = nsec;
+	if (!nsec) {
+		rwb->scale_step = 0;
+		wake_up_all(&rwb->wait);
+	}
+}
+
+int wbt_init(struct request_queue *q)
+{
+	struct rq_wb *rwb;
+
+	if (q->rq_wb)
+		return 0;
+
+	rwb = kzalloc_node(sizeof(*rwb), GFP_KERNEL, q->node);
+	if (!rwb)
+		return -ENOMEM;
+
+	rwb->q = q;
+	init_waitqueue_head(&rwb->wait);
+	setup_timer(&rwb->window_timer, wbt_window_timer, (unsigned long) rwb);
+
+	if (blk_queue_nonrot(q))
+		rwb->min_lat_nsec = WBT_DEF_LAT_NONROT;
+	else
+		rwb->min_lat_nsec = WBT_DEF_LAT_ROT;
+
+	q->rq_wb = rwb;
+	return 0;
+}
+
+void wbt_exit(struct request_queue *q)
+{
+	struct rq_wb *rwb = q->rq_wb;
+
+	if (rwb) {
+		del_timer_sync(&rwb->window_timer);
+		q->rq_wb = NULL;
+		kfree(rwb);
+	}
+}
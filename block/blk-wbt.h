@@ -0,0 +1,63 @@
+#ifndef BLK_WBT_H
+#define BLK_WBT_H
+
+struct request_queue;
+struct request;
+struct bio;
+
+#ifdef CONFIG_BLK_WBT
+
+/*
+ * Writeback throttling state of a request queue, protected by the queue
+ * lock.
+ */
+struct rq_wb {
+	struct request_queue	*q;
+
+	/* buffered writeback requests allocated, and how many may be */
+	unsigned int		inflight;
+	int			scale_step;	/* limit is depth >> scale_step */
+	wait_queue_head_t	wait;
+
+	u64			min_lat_nsec;	/* target read latency, 0: off */
+	struct timer_list	window_timer;
+
+	/* current window */
+	unsigned int		win_reads;
+	unsigned int		win_writes;
+	u64			win_min_lat;
+
+	/* statistics */
+	unsigned long		nr_throttled;
+	unsigned long		nr_scale_down;
+	unsigned long		nr_scale_up;
+	u64			last_min_lat;
+};
+
+int wbt_init(struct request_queue *);
+void wbt_exit(struct request_queue *);
+bool wbt_wait(struct request_queue *, struct bio *);
+void wbt_untrack(struct request_queue *);
+void wbt_free_request(struct request_queue *, struct request *);
+void wbt_issue(struct request_queue *, struct request *);
+void wbt_done(struct request_queue *, struct request *);
+unsigned int wbt_limit(struct rq_wb *);
+void wbt_set_min_lat(struct request_queue *, u64 nsec);
+
+#else
+
+static inline int wbt_init(struct request_queue *q) { return 0; }
+static inline void wbt_exit(struct request_queue *q) { }
+static inline bool wbt_wait(struct request_queue *q, struct bio *bio)
+{
+	return false;
+}
+static inline void wbt_untrack(struct request_queue *q) { }
+static inline void wbt_free_request(struct request_queue *q,
+				    struct request *rq) { }
+static inline void wbt_issue(struct request_queue *q, struct request *rq) { }
+static inline void wbt_done(struct request_queue *q, struct request *rq) { }
+
+#endif /* CONFIG_BLK_WBT */
+
+#endif
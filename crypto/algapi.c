@@ -861,6 +861,71 @@ int crypto_tfm_in_queue(struct crypto_queue *queue, struct crypto_tfm *tfm)
 }
 EXPORT_SYMBOL_GPL(crypto_tfm_in_queue);
 
+/**
+ * crypto_dequeue_batch - take up to @max requests off @queue
+ * @queue: queue to dequeue from, locked by the caller
+ * @batch: batch to fill; any previous contents are discarded
+ * @max: maximum number of requests, clamped to CRYPTO_BATCH_MAX
+ *
+ * Returns the number of requests moved onto @batch->reqs, in queue order.
+ */
+unsigned int crypto_dequeue_batch(struct crypto_queue *queue,
+				  struct crypto_batch *batch,
+				  unsigned int max)
+{
+	struct crypto_async_request *req, *backlog;
+
+	INIT_LIST_HEAD(&batch->reqs);
+	batch->nr = 0;
+	batch->nr_backlog = 0;
+
+	max = clamp_t(unsigned int, max, 1, CRYPTO_BATCH_MAX);
+	while (batch->nr < max) {
+		backlog = crypto_get_backlog(queue);
+		req = crypto_dequeue_request(queue);
+		if (!req)
+			break;
+		if (backlog)
+			batch->backlog[batch->nr_backlog++] = backlog;
+		list_add_tail(&req->list, &batch->reqs);
+		batch->nr++;
+	}
+
+	return batch->nr;
+}
+EXPORT_SYMBOL_GPL(crypto_dequeue_batch);
+
+void crypto_batch_notify_backlog(struct crypto_batch *batch)
+{
+	unsigned int i;
+
+	for (i = 0; i < batch->nr_backlog; i++)
+		batch->backlog[i]->complete(batch->backlog[i], -EINPROGRESS);
+	batch->nr_backlog = 0;
+}
+EXPORT_SYMBOL_GPL(crypto_batch_notify_backlog);
+
+/**
+ * crypto_batch_complete - complete every request left on @batch
+ * @batch: batch to sweep
+ * @err: status passed to each completion
+ *
+ * Requests that finished with a status of their own should be unlinked
+ * from @batch->reqs and completed individually before the sweep.  The
+ * completion callbacks may free or resubmit their request.
+ */
+void crypto_batch_complete(struct crypto_batch *batch, int err)
+{
+	struct crypto_async_request *req, *n;
+
+	list_for_each_entry_safe(req, n, &batch->reqs, list) {
+		list_del(&req->list);
+		req->complete(req, err);
+	}
+	batch->nr = 0;
+}
+EXPORT_SYMBOL_GPL(crypto_batch_complete);
+
 static inline void crypto_inc_byte(u8 *a, unsigned int size)
 {
 	u8 *b = (a + size);
@@ -33,6 +33,10 @@
 
 #define CRYPTD_MAX_CPU_QLEN 100
 
+static unsigned int cryptd_batch = 16;
+module_param(cryptd_batch, uint, 0644);
+MODULE_PARM_DESC(cryptd_batch, "Requests handled per worker run (1-32)");
+
 struct cryptd_cpu_queue {
 	struct crypto_queue queue;
 	struct work_struct work;
@@ -128,34 +132,34 @@ static int cryptd_enqueue_request(struct cryptd_queue *queue,
 	return err;
 }
 
-/* Called in workqueue context, do one real cryption work (via
+/* Called in workqueue context, do a batch of real cryption work (via
  * req->complete) and reschedule itself if there are more work to
  * do. */
 static void cryptd_queue_worker(struct work_struct *work)
 {
 	struct cryptd_cpu_queue *cpu_queue;
-	struct crypto_async_request *req, *backlog;
+	struct crypto_batch batch;
 
 	cpu_queue = container_of(work, struct cryptd_cpu_queue, work);
 	/*
-	 * Only handle one request at a time to avoid hogging crypto workqueue.
-	 * preempt_disable/enable is used to prevent being preempted by
-	 * cryptd_enqueue_request(). local_bh_disable/enable is used to prevent
-	 * cryptd_enqueue_request() being accessed from software interrupts.
+	 * Handle at most cryptd_batch requests per run to avoid hogging
+	 * crypto workqueue, while sparing back to back requests a queue
+	 * cycle each.  preempt_disable/enable is used to prevent being
+	 * preempted by cryptd_enqueue_request(). local_bh_disable/enable is
+	 * used to prevent cryptd_enqueue_request() being accessed from
+	 * software interrupts.
 	 */
 	local_bh_disable();
 	preempt_disable();
-	backlog = crypto_get_backlog(&cpu_queue->queue);
-	req = crypto_dequeue_request(&cpu_queue->queue);
+	crypto_dequeue_batch(&cpu_queue->queue, &batch, cryptd_batch);
 	preempt_enable();
 	local_bh_enable();
 
-	if (!req)
+	if (!batch.nr)
 		return;
 
-	if (backlog)
-		backlog->complete(backlog, -EINPROGRESS);
-	req->complete(req, 0);
+	crypto_batch_notify_backlog(&batch);
+	crypto_batch_complete(&batch, 0);
 
 	if (cpu_queue->queue.qlen)
 		queue_work(kcrypto_wq, &cpu_queue->work);
@@ -0,0 +1,121 @@
+/*
+ * Batching request engine for crypto offload drivers.
+ *
+ * Each worker run takes up to max_batch requests off the queue and hands
+ * them to the driver in one submission; completions are swept in one go
+ * when the driver finalizes the batch.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#include <crypto/algapi.h>
+#include <crypto/crypto_wq.h>
+#include <crypto/engine.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+static void crypto_engine_worker(struct work_struct *work)
+{
+	struct crypto_engine *engine;
+	unsigned long flags;
+	int err;
+
+	engine = container_of(work, struct crypto_engine, work);
+
+	spin_lock_irqsave(&engine->lock, flags);
+	if (engine->busy ||
+	    !crypto_dequeue_batch(&engine->queue, &engine->cur,
+				  engine->max_batch)) {
+		spin_unlock_irqrestore(&engine->lock, flags);
+		return;
+	}
+	engine->busy = true;
+	spin_unlock_irqrestore(&engine->lock, flags);
+
+	crypto_batch_notify_backlog(&engine->cur);
+
+	err = engine->run_batch(engine, &engine->cur);
+	if (err != -EINPROGRESS)
+		crypto_engine_finalize(engine, err);
+}
+
+void crypto_engine_init(struct crypto_engine *engine, const char *name,
+			unsigned int max_qlen, unsigned int max_batch,
+			int (*run_batch)(struct crypto_engine *engine,
+					 struct crypto_batch *batch))
+{
+	engine->name = name;
+	spin_lock_init(&engine->lock);
+	crypto_init_queue(&engine->queue, max_qlen);
+	INIT_WORK(&engine->work, crypto_engine_worker);
+	engine->max_batch = max_batch;
+	engine->busy = false;
+	INIT_LIST_HEAD(&engine->cur.reqs);
+	engine->cur.nr = 0;
+	engine->cur.nr_backlog = 0;
+	engine->run_batch = run_batch;
+}
+EXPORT_SYMBOL_GPL(crypto_engine_init);
+
+/* The caller must have stopped submitting and seen its last batch finish. */
+void crypto_engine_exit(struct crypto_engine *engine)
+{
+	cancel_work_sync(&engine->work);
+	WARN_ON(engine->busy);
+	WARN_ON(engine->queue.qlen);
+}
+EXPORT_SYMBOL_GPL(crypto_engine_exit);
+
+int crypto_engine_enqueue(struct crypto_engine *engine,
+			  struct crypto_async_request *req)
+{
+	unsigned long flags;
+	bool kick;
+	int err;
+
+	spin_lock_irqsave(&engine->lock, flags);
+	err = crypto_enqueue_request(&engine->queue, req);
+	kick = !engine->busy;
+	spin_unlock_irqrestore(&engine->lock, flags);
+
+	if (kick)
+		queue_work(kcrypto_wq, &engine->work);
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(crypto_engine_enqueue);
+
+/**
+ * crypto_engine_finalize - complete the batch in flight
+ * @engine: engine whose batch finished
+ * @err: status for every request still on the batch
+ *
+ * Called by the driver, possibly from interrupt context, once the hardware
+ * is done with the batch passed to ->run_batch.  Requests with a status of
+ * their own may be completed and unlinked from the batch beforehand.
+ */
+void crypto_engine_finalize(struct crypto_engine *engine, int err)
+{
+	unsigned long flags;
+	bool more;
+
+	crypto_batch_complete(&engine->cur, err);
+
+	spin_lock_irqsave(&engine->lock, flags);
+	engine->busy = false;
+	more = engine->queue.qlen != 0;
+	spin_unlock_irqrestore(&engine->lock, flags);
+
+	if (more)
+		queue_work(kcrypto_wq, &engine->work);
+}
+EXPORT_SYMBOL_GPL(crypto_engine_finalize);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Batching crypto request engine");
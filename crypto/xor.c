@@ -152,6 +152,27 @@ calibrate_xor_blocks(void)
 	return 0;
 }
 
+/* /sys/module/xor/parameters/speeds: one line per measured template */
+static int xor_speeds_get(char *buffer, const struct kernel_param *kp)
+{
+	struct xor_block_template *f;
+	int len = 0;
+
+	for (f = template_list; f; f = f->next)
+		len += snprintf(buffer + len, PAGE_SIZE - len,
+				"%-10s %5d.%03d MB/sec%s\n", f->name,
+				f->speed / 1000, f->speed % 1000,
+				f == active_template ? " *" : "");
+
+	return len;
+}
+
+static struct kernel_param_ops xor_speeds_ops = {
+	.get = xor_speeds_get,
+};
+module_param_cb(speeds, &xor_speeds_ops, NULL, 0444);
+MODULE_PARM_DESC(speeds, "Measured checksumming speeds");
+
 static __exit void xor_exit(void) { }
 
 MODULE_LICENSE("GPL");
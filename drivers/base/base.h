@@ -1,4 +1,5 @@
 #include <linux/notifier.h>
+#include <linux/async.h>
 
 /**
  * struct subsys_private - structure to hold the private to the driver core portions of the bus_type/class structure.
@@ -106,6 +107,8 @@ extern void bus_remove_driver(struct device_driver *drv);
 
 extern void driver_detach(struct device_driver *drv);
 extern int driver_probe_device(struct device_driver *drv, struct device *dev);
+extern bool driver_allows_async_probing(struct device_driver *drv);
+extern void driver_attach_async(void *data, async_cookie_t cookie);
 static inline int driver_match_device(struct device_driver *drv,
 				      struct device *dev)
 {
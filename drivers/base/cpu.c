@@ -11,6 +11,7 @@
 #include <linux/device.h>
 #include <linux/node.h>
 #include <linux/gfp.h>
+#include <linux/pm_qos.h>
 
 #include "base.h"
 
@@ -24,6 +25,62 @@ EXPORT_SYMBOL(cpu_sysdev_class);
 
 static DEFINE_PER_CPU(struct sys_device *, cpu_sys_devices);
 
+#ifdef CONFIG_PM
+/*
+ * The resume latency limit user space sets for a cpu through
+ * /sys/devices/system/cpu/cpuN/pm_qos_resume_latency_us.
+ */
+static DEFINE_PER_CPU(struct cpu_pm_qos_request, cpu_resume_latency_req);
+
+static ssize_t show_pm_qos_resume_latency(struct sys_device *dev,
+					  struct sysdev_attribute *attr,
+					  char *buf)
+{
+	struct cpu_pm_qos_request *req;
+
+	req = &per_cpu(cpu_resume_latency_req, dev->id);
+	return sprintf(buf, "%d\n", req->node.prio);
+}
+
+static ssize_t store_pm_qos_resume_latency(struct sys_device *dev,
+					   struct sysdev_attribute *attr,
+					   const char *buf, size_t count)
+{
+	s32 value;
+
+	if (kstrtos32(buf, 0, &value) || value < 0)
+		return -EINVAL;
+
+	cpu_pm_qos_update_request(&per_cpu(cpu_resume_latency_req, dev->id),
+				  value);
+	return count;
+}
+static SYSDEV_ATTR(pm_qos_resume_latency_us, 0644,
+		   show_pm_qos_resume_latency, store_pm_qos_resume_latency);
+
+static void __cpuinit register_cpu_pm_qos(struct cpu *cpu)
+{
+	cpu_pm_qos_add_request(&per_cpu(cpu_resume_latency_req, cpu->sysdev.id),
+			       cpu->sysdev.id, PM_QOS_DEFAULT_VALUE);
+	sysdev_create_file(&cpu->sysdev, &attr_pm_qos_resume_latency_us);
+}
+
+static void unregister_cpu_pm_qos(struct cpu *cpu)
+{
+	sysdev_remove_file(&cpu->sysdev, &attr_pm_qos_resume_latency_us);
+	cpu_pm_qos_remove_request(&per_cpu(cpu_resume_latency_req,
+					   cpu->sysdev.id));
+}
+#else
+static inline void register_cpu_pm_qos(struct cpu *cpu)
+{
+}
+
+static inline void unregister_cpu_pm_qos(struct cpu *cpu)
+{
+}
+#endif /* CONFIG_PM */
+
 #ifdef CONFIG_HOTPLUG_CPU
 static ssize_t show_online(struct sys_device *dev, struct sysdev_attribute *attr,
 			   char *buf)
@@ -73,6 +130,7 @@ void unregister_cpu(struct cpu *cpu)
 	unregister_cpu_under_node(logical_cpu, cpu_to_node(logical_cpu));
 
 	sysdev_remove_file(&cpu->sysdev, &attr_online);
+	unregister_cpu_pm_qos(cpu);
 
 	sysdev_unregister(&cpu->sysdev);
 	per_cpu(cpu_sys_devices, logical_cpu) = NULL;
@@ -230,6 +288,8 @@ int __cpuinit register_cpu(struct cpu *cpu, int num)
 		per_cpu(cpu_sys_devices, num) = &cpu->sysdev;
 	if (!error)
 		register_cpu_under_node(num, cpu_to_node(num));
+	if (!error)
+		register_cpu_pm_qos(cpu);
 
 #ifdef CONFIG_KEXEC
 	if (!error)
@@ -24,6 +24,7 @@
 #include <linux/wait.h>
 #include <linux/async.h>
 #include <linux/pm_runtime.h>
+#include <linux/init.h>
 
 #include "base.h"
 #include "power/power.h"
@@ -183,12 +184,34 @@ int driver_probe_done(void)
  */
 void wait_for_device_probe(void)
 {
+	ktime_t calltime;
+
+	calltime = ktime_get();
 	/* wait for the known devices to complete their probing */
 	wait_event(probe_waitqueue, atomic_read(&probe_count) == 0);
 	async_synchronize_full();
+	/* what is left of the asynchronous probes is on the critical path */
+	if (initcall_debug)
+		printk(KERN_DEBUG "waited %lld usecs for device probing\n",
+		       ktime_to_us(ktime_sub(ktime_get(), calltime)));
 }
 EXPORT_SYMBOL_GPL(wait_for_device_probe);
 
+static int really_probe_debug(struct device *dev, struct device_driver *drv)
+{
+	ktime_t calltime, delta, rettime;
+	int ret;
+
+	calltime = ktime_get();
+	ret = really_probe(dev, drv);
+	rettime = ktime_get();
+	delta = ktime_sub(rettime, calltime);
+	printk(KERN_DEBUG "probe of %s (%s) @ %i returned %d after %lld usecs\n",
+	       dev_name(dev), drv->name, task_pid_nr(current), ret,
+	       ktime_to_us(delta));
+	return ret;
+}
+
 /**
  * driver_probe_device - attempt to bind device & driver together
  * @drv: driver to bind a device to
@@ -212,12 +235,55 @@ int driver_probe_device(struct device_driver *drv, struct device *dev)
 
 	pm_runtime_get_noresume(dev);
 	pm_runtime_barrier(dev);
-	ret = really_probe(dev, drv);
+	if (initcall_debug)
+		ret = really_probe_debug(dev, drv);
+	else
+		ret = really_probe(dev, drv);
 	pm_runtime_put_sync(dev);
 
 	return ret;
 }
 
+static char async_probe_drv_names[256];
+
+static int __init save_async_options(char *buf)
+{
+	strlcpy(async_probe_drv_names, buf, sizeof(async_probe_drv_names));
+	return 1;
+}
+__setup("driver_async_probe=", save_async_options);
+
+/* Is @name, or "*", in the driver_async_probe= list? */
+static bool driver_async_probe_requested(const char *name)
+{
+	const char *p = async_probe_drv_names;
+	size_t len = strlen(name);
+
+	while (*p) {
+		const char *end = strchr(p, ',');
+
+		if (!end)
+			end = p + strlen(p);
+		if ((end - p == 1 && *p == '*') ||
+		    (end - p == len && !strncmp(p, name, len)))
+			return true;
+		p = *end ? end + 1 : end;
+	}
+	return false;
+}
+
+bool driver_allows_async_probing(struct device_driver *drv)
+{
+	switch (drv->probe_type) {
+	case PROBE_PREFER_ASYNCHRONOUS:
+		return true;
+	case PROBE_FORCE_SYNCHRONOUS:
+		return false;
+	default:
+		return driver_async_probe_requested(drv->name);
+	}
+}
+
 static int __device_attach(struct device_driver *drv, void *data)
 {
 	struct device *dev = data;
@@ -314,6 +380,25 @@ int driver_attach(struct device_driver *drv)
 }
 EXPORT_SYMBOL_GPL(driver_attach);
 
+/*
+ * Probe the devices of a driver registered with asynchronous probing.
+ * A device's probe still excludes its parent's, __driver_attach() holding
+ * the parent's lock.
+ */
+void driver_attach_async(void *data, async_cookie_t cookie)
+{
+	struct device_driver *drv = data;
+	ktime_t calltime;
+	int ret;
+
+	calltime = ktime_get();
+	ret = driver_attach(drv);
+	if (initcall_debug)
+		printk(KERN_DEBUG "bus: '%s': async probe of driver %s returned %d after %lld usecs\n",
+		       drv->bus->name, drv->name, ret,
+		       ktime_to_us(ktime_sub(ktime_get(), calltime)));
+}
+
 /*
  * __device_release_driver() must be called with @dev lock held.
  * When called for a USB interface, @dev->parent lock must be held as well.
@@ -77,6 +77,9 @@
 #include <linux/sysfs.h>
 #include <linux/miscdevice.h>
 #include <linux/falloc.h>
+#include <linux/fiemap.h>
+#include <linux/mempool.h>
+#include <linux/vmalloc.h>
 
 #include <asm/uaccess.h>
 
@@ -457,6 +460,283 @@ out:
 	return ret;
 }
 
+/*
+ * Direct I/O mode (LO_FLAGS_DIRECT_IO).
+ *
+ * Instead of going through the page cache of the backing file from
+ * loop_thread, bios are remapped onto the blocks backing the file and
+ * submitted straight to the underlying block device, the way swap files
+ * are driven.  Nothing is cached twice and any number of bios can be in
+ * flight, completing asynchronously.
+ *
+ * This needs a stable file layout: the file must be fully allocated and
+ * written (no holes, preallocated or delayed extents) on a filesystem
+ * that implements ->bmap and ->fiemap, and it is marked S_SWAPFILE while
+ * mapped so that it cannot be truncated, unlinked or defragmented under
+ * us.  Loop over a block device is a plain offset remap.
+ */
+struct loop_dio {
+	struct loop_device	*lo;
+	struct bio		*bio;		/* bio submitted to loop */
+	atomic_t		pending;	/* clones in flight, plus one */
+	int			error;
+};
+
+static struct kmem_cache *loop_dio_cache;
+static mempool_t *loop_dio_pool;
+static struct bio_set *loop_dio_bs;
+
+#define LOOP_DIO_BAD_EXTENT	(FIEMAP_EXTENT_UNKNOWN |		\
+				 FIEMAP_EXTENT_DELALLOC |		\
+				 FIEMAP_EXTENT_ENCODED |		\
+				 FIEMAP_EXTENT_DATA_ENCRYPTED |		\
+				 FIEMAP_EXTENT_NOT_ALIGNED |		\
+				 FIEMAP_EXTENT_DATA_INLINE |		\
+				 FIEMAP_EXTENT_DATA_TAIL |		\
+				 FIEMAP_EXTENT_UNWRITTEN |		\
+				 FIEMAP_EXTENT_SHARED)
+
+static int loop_fiemap(struct inode *inode, struct fiemap_extent *fe,
+		       unsigned int max)
+{
+	struct fiemap_extent_info fieinfo = {
+		.fi_extents_max		= max,
+		.fi_extents_start	= (struct fiemap_extent __user *)fe,
+	};
+	mm_segment_t old_fs = get_fs();
+	int ret;
+
+	set_fs(get_ds());
+	ret = inode->i_op->fiemap(inode, &fieinfo, 0, FIEMAP_MAX_OFFSET);
+	set_fs(old_fs);
+
+	return ret ? ret : fieinfo.fi_extents_mapped;
+}
+
+/*
+ * Build lo->lo_dio_extents for @file.  The caller has written back and
+ * invalidated its page cache.
+ */
+static int loop_dio_map(struct loop_device *lo, struct file *file)
+{
+	struct inode *inode = file->f_mapping->host;
+	struct fiemap_extent *fe = NULL;
+	struct loop_extent *ext;
+	u64 size = i_size_read(inode);
+	u64 pos = 0;
+	int i, nr, nr_ext = 0, ret;
+
+	if (S_ISBLK(inode->i_mode)) {
+		ext = vmalloc(sizeof(*ext));
+		if (!ext)
+			return -ENOMEM;
+		ext->start = 0;
+		ext->nr_sects = size >> 9;
+		ext->disk_start = 0;
+		lo->lo_dio_bdev = I_BDEV(inode);
+		lo->lo_dio_extents = ext;
+		lo->lo_dio_nr_extents = 1;
+		return 0;
+	}
+
+	if (!S_ISREG(inode->i_mode) || !inode->i_sb->s_bdev ||
+	    !inode->i_mapping->a_ops->bmap || !inode->i_op->fiemap)
+		return -EINVAL;
+
+	nr = loop_fiemap(inode, NULL, 0);
+	if (nr <= 0)
+		return nr ? nr : -EINVAL;
+
+	fe = vmalloc(nr * sizeof(*fe));
+	ext = vmalloc(nr * sizeof(*ext));
+	ret = -ENOMEM;
+	if (!fe || !ext)
+		goto out;
+
+	ret = loop_fiemap(inode, fe, nr);
+	if (ret < 0)
+		goto out;
+	nr = ret;
+
+	ret = -EINVAL;
+	for (i = 0; i < nr && pos < size; i++) {
+		if (fe[i].fe_flags & LOOP_DIO_BAD_EXTENT ||
+		    fe[i].fe_logical != pos ||
+		    (fe[i].fe_physical | fe[i].fe_length) & 511)
+			goto out;
+
+		if (nr_ext && ext[nr_ext - 1].disk_start +
+		    ext[nr_ext - 1].nr_sects == fe[i].fe_physical >> 9) {
+			ext[nr_ext - 1].nr_sects += fe[i].fe_length >> 9;
+		} else {
+			ext[nr_ext].start = pos >> 9;
+			ext[nr_ext].nr_sects = fe[i].fe_length >> 9;
+			ext[nr_ext].disk_start = fe[i].fe_physical >> 9;
+			nr_ext++;
+		}
+		pos += fe[i].fe_length;
+	}
+	if (pos < size)
+		goto out;
+
+	lo->lo_dio_bdev = inode->i_sb->s_bdev;
+	lo->lo_dio_extents = ext;
+	lo->lo_dio_nr_extents = nr_ext;
+	ext = NULL;
+	ret = 0;
+out:
+	vfree(ext);
+	vfree(fe);
+	return ret;
+}
+
+static struct loop_extent *loop_dio_lookup(struct loop_device *lo,
+					   sector_t sector)
+{
+	struct loop_extent *ext = lo->lo_dio_extents;
+	unsigned int lo_idx = 0, hi_idx = lo->lo_dio_nr_extents;
+
+	while (lo_idx < hi_idx) {
+		unsigned int mid = (lo_idx + hi_idx) / 2;
+
+		if (sector < ext[mid].start)
+			hi_idx = mid;
+		else if (sector >= ext[mid].start + ext[mid].nr_sects)
+			lo_idx = mid + 1;
+		else
+			return &ext[mid];
+	}
+	return NULL;
+}
+
+static void loop_dio_put(struct loop_dio *dio)
+{
+	struct loop_device *lo = dio->lo;
+
+	if (!atomic_dec_and_test(&dio->pending))
+		return;
+
+	bio_endio(dio->bio, dio->error);
+	mempool_free(dio, loop_dio_pool);
+
+	if (atomic_dec_and_test(&lo->lo_dio_pending))
+		wake_up(&lo->lo_event);
+}
+
+static void loop_dio_end_io(struct bio *clone, int error)
+{
+	struct loop_dio *dio = clone->bi_private;
+
+	if (error)
+		dio->error = error;
+	bio_put(clone);
+	loop_dio_put(dio);
+}
+
+static void loop_dio_bio_destructor(struct bio *bio)
+{
+	bio_free(bio, loop_dio_bs);
+}
+
+static struct bio *loop_dio_clone(struct loop_dio *dio, unsigned long rw,
+				  sector_t sector, int nr_vecs)
+{
+	struct bio *clone;
+
+	clone = bio_alloc_bioset(GFP_NOIO, nr_vecs, loop_dio_bs);
+	clone->bi_destructor = loop_dio_bio_destructor;
+	clone->bi_bdev = dio->lo->lo_dio_bdev;
+	clone->bi_sector = sector;
+	clone->bi_rw = rw;
+	clone->bi_end_io = loop_dio_end_io;
+	clone->bi_private = dio;
+	return clone;
+}
+
+static void loop_dio_submit_clone(struct loop_dio *dio, struct bio *clone)
+{
+	atomic_inc(&dio->pending);
+	generic_make_request(clone);
+}
+
+/*
+ * Split @bio along the extent map and send the pieces to the backing
+ * device.  Called with lo_dio_pending already raised for @bio.
+ */
+static void loop_dio_submit(struct loop_device *lo, struct bio *bio)
+{
+	struct loop_dio *dio;
+	struct bio *clone = NULL;
+	struct bio_vec *bvec;
+	unsigned long rw;
+	sector_t sector;
+	int i;
+
+	dio = mempool_alloc(loop_dio_pool, GFP_NOIO);
+	dio->lo = lo;
+	dio->bio = bio;
+	atomic_set(&dio->pending, 1);
+	dio->error = 0;
+
+	/* a preflush only needs to go out once, ahead of the data */
+	rw = bio->bi_rw;
+
+	if (!bio->bi_size) {
+		loop_dio_submit_clone(dio, loop_dio_clone(dio, rw, 0, 0));
+		goto out;
+	}
+
+	sector = bio->bi_sector + (lo->lo_offset >> 9);
+	bio_for_each_segment(bvec, bio, i) {
+		unsigned int offset = bvec->bv_offset;
+		unsigned int len = bvec->bv_len;
+
+		while (len) {
+			struct loop_extent *ext = loop_dio_lookup(lo, sector);
+			sector_t disk_sector;
+			unsigned int run;
+
+			if (unlikely(!ext)) {
+				dio->error = -EIO;
+				goto out_clone;
+			}
+			run = min_t(sector_t, len >> 9,
+				    ext->start + ext->nr_sects - sector) << 9;
+			disk_sector = ext->disk_start + (sector - ext->start);
+
+			if (clone && (clone->bi_sector +
+				      (clone->bi_size >> 9) != disk_sector ||
+				      bio_add_page(clone, bvec->bv_page, run,
+						   offset) != run)) {
+				loop_dio_submit_clone(dio, clone);
+				rw &= ~REQ_FLUSH;
+				clone = NULL;
+			}
+			if (!clone) {
+				clone = loop_dio_clone(dio, rw, disk_sector,
+						       bio->bi_vcnt - i);
+				if (bio_add_page(clone, bvec->bv_page, run,
+						 offset) != run) {
+					bio_put(clone);
+					clone = NULL;
+					dio->error = -EIO;
+					goto out;
+				}
+			}
+
+			sector += run >> 9;
+			offset += run;
+			len -= run;
+		}
+	}
+
+out_clone:
+	if (clone)
+		loop_dio_submit_clone(dio, clone);
+out:
+	loop_dio_put(dio);
+}
+
 /*
  * Add bio to back of pending list
  */
@@ -488,6 +768,14 @@ static void loop_make_request(struct request_queue *q, struct bio *old_bio)
 		goto out;
 	if (unlikely(rw == WRITE && (lo->lo_flags & LO_FLAGS_READ_ONLY)))
 		goto out;
+	if (lo->lo_flags & LO_FLAGS_DIRECT_IO) {
+		if (old_bio->bi_rw & REQ_DISCARD)
+			goto out;
+		atomic_inc(&lo->lo_dio_pending);
+		spin_unlock_irq(&lo->lo_lock);
+		loop_dio_submit(lo, old_bio);
+		return;
+	}
 	loop_add_bio(lo, old_bio);
 	wake_up(&lo->lo_event);
 	spin_unlock_irq(&lo->lo_lock);
@@ -582,6 +870,9 @@ static int loop_flush(struct loop_device *lo)
 	/* loop not yet configured, no running thread, nothing to flush */
 	if (!lo->lo_thread)
 		return 0;
+	/* direct I/O never queues to the thread */
+	if (lo->lo_flags & LO_FLAGS_DIRECT_IO)
+		return 0;
 
 	return loop_switch(lo, NULL);
 }
@@ -630,9 +921,10 @@ static int loop_change_fd(struct loop_device *lo, struct block_device *bdev,
 	if (lo->lo_state != Lo_bound)
 		goto out;
 
-	/* the loop device has to be read-only */
+	/* the loop device has to be read-only and not mapped directly */
 	error = -EINVAL;
-	if (!(lo->lo_flags & LO_FLAGS_READ_ONLY))
+	if (!(lo->lo_flags & LO_FLAGS_READ_ONLY) ||
+	    lo->lo_flags & LO_FLAGS_DIRECT_IO)
 		goto out;
 
 	error = -EBADF;
@@ -742,11 +1034,19 @@ static ssize_t loop_attr_partscan_show(struct loop_device *lo, char *buf)
 	return sprintf(buf, "%s\n", partscan ? "1" : "0");
 }
 
+static ssize_t loop_attr_dio_show(struct loop_device *lo, char *buf)
+{
+	int dio = (lo->lo_flags & LO_FLAGS_DIRECT_IO);
+
+	return sprintf(buf, "%s\n", dio ? "1" : "0");
+}
+
 LOOP_ATTR_RO(backing_file);
 LOOP_ATTR_RO(offset);
 LOOP_ATTR_RO(sizelimit);
 LOOP_ATTR_RO(autoclear);
 LOOP_ATTR_RO(partscan);
+LOOP_ATTR_RO(dio);
 
 static struct attribute *loop_attrs[] = {
 	&loop_attr_backing_file.attr,
@@ -754,6 +1054,7 @@ static struct attribute *loop_attrs[] = {
 	&loop_attr_sizelimit.attr,
 	&loop_attr_autoclear.attr,
 	&loop_attr_partscan.attr,
+	&loop_attr_dio.attr,
 	NULL,
 };
 
@@ -787,7 +1088,7 @@ static void loop_config_discard(struct loop_device *lo)
 	 * useful information.
 	 */
 	if ((!file->f_op->fallocate) ||
-	    lo->lo_encrypt_key_size) {
+	    lo->lo_encrypt_key_size || lo->lo_flags & LO_FLAGS_DIRECT_IO) {
 		q->limits.discard_granularity = 0;
 		q->limits.discard_alignment = 0;
 		q->limits.max_discard_sectors = 0;
@@ -803,6 +1104,76 @@ static void loop_config_discard(struct loop_device *lo)
 	queue_flag_set_unlocked(QUEUE_FLAG_DISCARD, q);
 }
 
+/*
+ * Switch @lo to direct I/O, or back to buffered I/O through loop_thread.
+ * Only the ioctl caller may have the device open.
+ */
+static int loop_set_direct_io(struct loop_device *lo, bool enable)
+{
+	struct file *file = lo->lo_backing_file;
+	struct inode *inode = file->f_mapping->host;
+	int err = 0;
+
+	if (enable == !!(lo->lo_flags & LO_FLAGS_DIRECT_IO))
+		return 0;
+	if (lo->lo_refcnt > 1)
+		return -EBUSY;
+
+	if (!enable) {
+		spin_lock_irq(&lo->lo_lock);
+		lo->lo_flags &= ~LO_FLAGS_DIRECT_IO;
+		spin_unlock_irq(&lo->lo_lock);
+		wait_event(lo->lo_event, !atomic_read(&lo->lo_dio_pending));
+		goto out_unmap;
+	}
+
+	if (lo->transfer != transfer_none || lo->lo_offset & 511)
+		return -EINVAL;
+
+	/* nothing may be left in flight or dirty in the page cache */
+	loop_flush(lo);
+	err = filemap_write_and_wait(file->f_mapping);
+	if (!err)
+		err = invalidate_inode_pages2(file->f_mapping);
+	if (err)
+		return err;
+
+	err = loop_dio_map(lo, file);
+	if (err)
+		return err;
+
+	if (S_ISREG(inode->i_mode)) {
+		mutex_lock(&inode->i_mutex);
+		if (IS_SWAPFILE(inode))
+			err = -ETXTBSY;
+		else
+			inode->i_flags |= S_SWAPFILE;
+		mutex_unlock(&inode->i_mutex);
+		if (err)
+			goto out_free;
+	}
+
+	spin_lock_irq(&lo->lo_lock);
+	lo->lo_flags |= LO_FLAGS_DIRECT_IO;
+	spin_unlock_irq(&lo->lo_lock);
+	loop_config_discard(lo);
+	return 0;
+
+out_unmap:
+	if (S_ISREG(inode->i_mode)) {
+		mutex_lock(&inode->i_mutex);
+		inode->i_flags &= ~S_SWAPFILE;
+		mutex_unlock(&inode->i_mutex);
+	}
+	loop_config_discard(lo);
+out_free:
+	vfree(lo->lo_dio_extents);
+	lo->lo_dio_extents = NULL;
+	lo->lo_dio_nr_extents = 0;
+	lo->lo_dio_bdev = NULL;
+	return err;
+}
+
 static int loop_set_fd(struct loop_device *lo, fmode_t mode,
 		       struct block_device *bdev, unsigned int arg)
 {
@@ -990,6 +1361,7 @@ static int loop_clr_fd(struct loop_device *lo)
 	lo->lo_state = Lo_rundown;
 	spin_unlock_irq(&lo->lo_lock);
 
+	loop_set_direct_io(lo, false);
 	kthread_stop(lo->lo_thread);
 
 	spin_lock_irq(&lo->lo_lock);
@@ -1054,6 +1426,15 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 		return -ENXIO;
 	if ((unsigned int) info->lo_encrypt_key_size > LO_KEY_SIZE)
 		return -EINVAL;
+	if ((info->lo_flags & LO_FLAGS_DIRECT_IO) &&
+	    (info->lo_encrypt_type || info->lo_offset & 511))
+		return -EINVAL;
+
+	if (!(info->lo_flags & LO_FLAGS_DIRECT_IO)) {
+		err = loop_set_direct_io(lo, false);
+		if (err)
+			return err;
+	}
 
 	err = loop_release_xfer(lo);
 	if (err)
@@ -1111,6 +1492,9 @@ loop_set_status(struct loop_device *lo, const struct loop_info64 *info)
 		lo->lo_key_owner = uid;
 	}	
 
+	if (info->lo_flags & LO_FLAGS_DIRECT_IO)
+		return loop_set_direct_io(lo, true);
+
 	return 0;
 }
 
@@ -1262,6 +1646,10 @@ static int loop_set_capacity(struct loop_device *lo, struct block_device *bdev)
 	err = -ENXIO;
 	if (unlikely(lo->lo_state != Lo_bound))
 		goto out;
+	/* the extent map only covers the file as it was when mapped */
+	err = -EBUSY;
+	if (lo->lo_flags & LO_FLAGS_DIRECT_IO)
+		goto out;
 	err = figure_loop_size(lo, lo->lo_offset, lo->lo_sizelimit);
 	if (unlikely(err))
 		goto out;
@@ -1824,9 +2212,20 @@ static int __init loop_init(void)
 	struct loop_device *lo;
 	int err;
 
+	loop_dio_cache = KMEM_CACHE(loop_dio, 0);
+	if (!loop_dio_cache)
+		return -ENOMEM;
+	err = -ENOMEM;
+	loop_dio_pool = mempool_create_slab_pool(BIO_POOL_SIZE, loop_dio_cache);
+	if (!loop_dio_pool)
+		goto cache_out;
+	loop_dio_bs = bioset_create(BIO_POOL_SIZE, 0);
+	if (!loop_dio_bs)
+		goto pool_out;
+
 	err = misc_register(&loop_misc);
 	if (err < 0)
-		return err;
+		goto bs_out;
 
 	part_shift = 0;
 	if (max_part > 0) {
@@ -1888,6 +2287,12 @@ static int __init loop_init(void)
 
 misc_out:
 	misc_deregister(&loop_misc);
+bs_out:
+	bioset_free(loop_dio_bs);
+pool_out:
+	mempool_destroy(loop_dio_pool);
+cache_out:
+	kmem_cache_destroy(loop_dio_cache);
 	return err;
 }
 
@@ -1913,6 +2318,10 @@ static void __exit loop_exit(void)
 	unregister_blkdev(LOOP_MAJOR, "loop");
 
 	misc_deregister(&loop_misc);
+
+	bioset_free(loop_dio_bs);
+	mempool_destroy(loop_dio_pool);
+	kmem_cache_destroy(loop_dio_cache);
 }
 
 module_init(loop_init);
@@ -2,6 +2,7 @@
 #include <linux/spinlock.h>
 #include <linux/slab.h>
 #include <linux/blkdev.h>
+#include <linux/blk-mq.h>
 #include <linux/hdreg.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
@@ -19,16 +20,27 @@ static DEFINE_IDA(vd_index_ida);
 
 struct workqueue_struct *virtblk_wq;
 
+/* One request virtqueue, driven by one blk-mq hardware queue */
+struct virtio_blk_vq {
+	struct virtqueue *vq;
+
+	/* Serializes virtqueue access between submission and completion */
+	spinlock_t lock;
+
+	char name[16];
+} ____cacheline_aligned_in_smp;
+
 struct virtio_blk
 {
 	struct virtio_device *vdev;
-	struct virtqueue *vq;
+
+	/* Request virtqueues, one per hardware queue */
+	unsigned int num_vqs;
+	struct virtio_blk_vq *vqs;
 
 	/* The disk structure for the kernel. */
 	struct gendisk *disk;
 
-	mempool_t *pool;
-
 	/* Process context for config space updates */
 	struct work_struct config_work;
 
@@ -43,73 +55,101 @@ struct virtio_blk
 
 	/* Ida index - used to track minor number allocations. */
 	int index;
-
-	/* Scatterlist: can be too big for stack. */
-	struct scatterlist sg[/*sg_elems*/];
 };
 
+/* Lives behind each request, see blk_mq_rq_to_pdu() */
 struct virtblk_req
 {
 	struct request *req;
 	struct virtio_blk_outhdr out_hdr;
 	struct virtio_scsi_inhdr in_hdr;
 	u8 status;
+	struct scatterlist sg[/*sg_elems*/];
 };
 
-static void blk_done(struct virtqueue *vq)
+static void virtblk_end_request(struct virtblk_req *vbr)
+{
+	struct request *req = vbr->req;
+	int error;
+
+	switch (vbr->status) {
+	case VIRTIO_BLK_S_OK:
+		error = 0;
+		break;
+	case VIRTIO_BLK_S_UNSUPP:
+		error = -ENOTTY;
+		break;
+	default:
+		error = -EIO;
+		break;
+	}
+
+	switch (req->cmd_type) {
+	case REQ_TYPE_BLOCK_PC:
+		req->resid_len = vbr->in_hdr.residual;
+		req->sense_len = vbr->in_hdr.sense_len;
+		req->errors = vbr->in_hdr.errors;
+		break;
+	case REQ_TYPE_SPECIAL:
+		req->errors = (error != 0);
+		break;
+	default:
+		break;
+	}
+
+	blk_mq_end_io(req, error);
+}
+
+static int virtblk_reap(struct virtio_blk *vblk, struct virtio_blk_vq *bvq)
 {
-	struct virtio_blk *vblk = vq->vdev->priv;
 	struct virtblk_req *vbr;
+	struct request *req, *n;
 	unsigned int len;
 	unsigned long flags;
+	int nr = 0;
+	LIST_HEAD(done);
+
+	spin_lock_irqsave(&bvq->lock, flags);
+	while ((vbr = virtqueue_get_buf(bvq->vq, &len)) != NULL)
+		list_add_tail(&vbr->req->queuelist, &done);
+	spin_unlock_irqrestore(&bvq->lock, flags);
+
+	list_for_each_entry_safe(req, n, &done, queuelist) {
+		list_del_init(&req->queuelist);
+		virtblk_end_request(blk_mq_rq_to_pdu(req));
+		nr++;
+	}
 
-	spin_lock_irqsave(vblk->disk->queue->queue_lock, flags);
-	while ((vbr = virtqueue_get_buf(vblk->vq, &len)) != NULL) {
-		int error;
+	/* In case queue is stopped waiting for more buffers. */
+	if (nr)
+		blk_mq_start_stopped_hw_queues(vblk->disk->queue, true);
 
-		switch (vbr->status) {
-		case VIRTIO_BLK_S_OK:
-			error = 0;
-			break;
-		case VIRTIO_BLK_S_UNSUPP:
-			error = -ENOTTY;
-			break;
-		default:
-			error = -EIO;
-			break;
-		}
+	return nr;
+}
 
-		switch (vbr->req->cmd_type) {
-		case REQ_TYPE_BLOCK_PC:
-			vbr->req->resid_len = vbr->in_hdr.residual;
-			vbr->req->sense_len = vbr->in_hdr.sense_len;
-			vbr->req->errors = vbr->in_hdr.errors;
-			break;
-		case REQ_TYPE_SPECIAL:
-			vbr->req->errors = (error != 0);
-			break;
-		default:
-			break;
-		}
+static void blk_done(struct virtqueue *vq)
+{
+	struct virtio_blk *vblk = vq->vdev->priv;
+	unsigned int i;
 
-		__blk_end_request_all(vbr->req, error);
-		mempool_free(vbr, vblk->pool);
+	for (i = 0; i < vblk->num_vqs; i++) {
+		if (vblk->vqs[i].vq == vq) {
+			virtblk_reap(vblk, &vblk->vqs[i]);
+			return;
+		}
 	}
-	/* In case queue is stopped waiting for more buffers. */
-	blk_start_queue(vblk->disk->queue);
-	spin_unlock_irqrestore(vblk->disk->queue->queue_lock, flags);
 }
 
-static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
-		   struct request *req)
+static int virtio_queue_rq(struct blk_mq_hw_ctx *hctx, struct request *req)
 {
+	struct virtio_blk *vblk = hctx->queue->queuedata;
+	struct virtio_blk_vq *bvq = hctx->driver_data;
+	struct virtblk_req *vbr = blk_mq_rq_to_pdu(req);
 	unsigned long num, out = 0, in = 0;
-	struct virtblk_req *vbr;
+	unsigned long flags;
+	int err;
 
-	vbr = mempool_alloc(vblk->pool, GFP_ATOMIC);
-	if (!vbr)
-		/* When another request finishes we'll try again. */
-		return false;
+	BUG_ON(req->nr_phys_segments + 2 > vblk->sg_elems);
 
 	vbr->req = req;
 
@@ -140,7 +180,7 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		}
 	}
 
-	sg_set_buf(&vblk->sg[out++], &vbr->out_hdr, sizeof(vbr->out_hdr));
+	sg_set_buf(&vbr->sg[out++], &vbr->out_hdr, sizeof(vbr->out_hdr));
 
 	/*
 	 * If this is a packet command we need a couple of additional headers.
@@ -149,17 +189,17 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 	 * inhdr with additional status information before the normal inhdr.
 	 */
 	if (vbr->req->cmd_type == REQ_TYPE_BLOCK_PC)
-		sg_set_buf(&vblk->sg[out++], vbr->req->cmd, vbr->req->cmd_len);
+		sg_set_buf(&vbr->sg[out++], vbr->req->cmd, vbr->req->cmd_len);
 
-	num = blk_rq_map_sg(q, vbr->req, vblk->sg + out);
+	num = blk_rq_map_sg(hctx->queue, vbr->req, vbr->sg + out);
 
 	if (vbr->req->cmd_type == REQ_TYPE_BLOCK_PC) {
-		sg_set_buf(&vblk->sg[num + out + in++], vbr->req->sense, SCSI_SENSE_BUFFERSIZE);
-		sg_set_buf(&vblk->sg[num + out + in++], &vbr->in_hdr,
+		sg_set_buf(&vbr->sg[num + out + in++], vbr->req->sense, SCSI_SENSE_BUFFERSIZE);
+		sg_set_buf(&vbr->sg[num + out + in++], &vbr->in_hdr,
 			   sizeof(vbr->in_hdr));
 	}
 
-	sg_set_buf(&vblk->sg[num + out + in++], &vbr->status,
+	sg_set_buf(&vbr->sg[num + out + in++], &vbr->status,
 		   sizeof(vbr->status));
 
 	if (num) {
@@ -172,35 +212,140 @@ static bool do_req(struct request_queue *q, struct virtio_blk *vblk,
 		}
 	}
 
-	if (virtqueue_add_buf(vblk->vq, vblk->sg, out, in, vbr) < 0) {
-		mempool_free(vbr, vblk->pool);
-		return false;
+	spin_lock_irqsave(&bvq->lock, flags);
+	err = virtqueue_add_buf(bvq->vq, vbr->sg, out, in, vbr);
+	if (err < 0) {
+		/*
+		 * Ring full: blk_done() restarts the queue once something
+		 * completes.  Stop it under the vq lock so that can't be
+		 * missed.
+		 */
+		blk_mq_stop_hw_queue(hctx);
+		spin_unlock_irqrestore(&bvq->lock, flags);
+		return BLK_MQ_RQ_QUEUE_BUSY;
 	}
+	spin_unlock_irqrestore(&bvq->lock, flags);
 
-	return true;
+	return BLK_MQ_RQ_QUEUE_OK;
 }
 
-static void do_virtblk_request(struct request_queue *q)
+/* One notification for the whole batch blk-mq just queued. */
+static void virtio_commit_rqs(struct blk_mq_hw_ctx *hctx)
 {
-	struct virtio_blk *vblk = q->queuedata;
-	struct request *req;
-	unsigned int issued = 0;
+	struct virtio_blk_vq *bvq = hctx->driver_data;
+	unsigned long flags;
 
-	while ((req = blk_peek_request(q)) != NULL) {
-		BUG_ON(req->nr_phys_segments + 2 > vblk->sg_elems);
+	spin_lock_irqsave(&bvq->lock, flags);
+	virtqueue_kick(bvq->vq);
+	spin_unlock_irqrestore(&bvq->lock, flags);
+}
 
-		/* If this request fails, stop queue and wait for something to
-		   finish to restart it. */
-		if (!do_req(q, vblk, req)) {
-			blk_stop_queue(q);
-			break;
-		}
-		blk_start_request(req);
-		issued++;
+/*
+ * Hardware queue @index drives virtqueue @index.  Point its interrupt at
+ * the cpus that submit to it, so completions run where the I/O came from.
+ */
+static int virtblk_init_hctx(struct blk_mq_hw_ctx *hctx, void *data,
+			     unsigned int index)
+{
+	struct virtio_blk *vblk = data;
+	struct virtio_blk_vq *bvq = &vblk->vqs[index];
+
+	hctx->driver_data = bvq;
+	if (vblk->num_vqs > 1)
+		virtqueue_set_affinity(bvq->vq, hctx->cpumask);
+	return 0;
+}
+
+static int virtblk_init_request(void *data, struct request *rq,
+				unsigned int hctx_idx)
+{
+	struct virtio_blk *vblk = data;
+	struct virtblk_req *vbr = blk_mq_rq_to_pdu(rq);
+
+	sg_init_table(vbr->sg, vblk->sg_elems);
+	return 0;
+}
+
+/* Used buffers show up in the ring whether or not the host notifies us. */
+static int virtio_poll(struct blk_mq_hw_ctx *hctx)
+{
+	return virtblk_reap(hctx->queue->queuedata, hctx->driver_data);
+}
+
+static struct blk_mq_ops virtio_mq_ops = {
+	.queue_rq	= virtio_queue_rq,
+	.commit_rqs	= virtio_commit_rqs,
+	.init_hctx	= virtblk_init_hctx,
+	.init_request	= virtblk_init_request,
+	.poll		= virtio_poll,
+};
+
+static unsigned int virtblk_queue_depth;
+module_param_named(queue_depth, virtblk_queue_depth, uint, 0444);
+MODULE_PARM_DESC(queue_depth, "Requests per queue, 0 for the ring size");
+
+static unsigned int virtblk_num_queues;
+module_param_named(num_queues, virtblk_num_queues, uint, 0444);
+MODULE_PARM_DESC(num_queues,
+		 "Most request queues per device, 0 for one per cpu");
+
+static int virtblk_find_vqs(struct virtio_blk *vblk)
+{
+	struct virtio_device *vdev = vblk->vdev;
+	vq_callback_t **callbacks;
+	const char **names;
+	struct virtqueue **vqs;
+	unsigned int i;
+	u16 num_vqs;
+	int err;
+
+	/* One queue per cpu at most, as many as the host offers */
+	err = virtio_config_val(vdev, VIRTIO_BLK_F_MQ,
+				offsetof(struct virtio_blk_config, num_queues),
+				&num_vqs);
+	if (err || !num_vqs)
+		num_vqs = 1;
+	num_vqs = min_t(unsigned int, num_vqs, nr_cpu_ids);
+	if (virtblk_num_queues)
+		num_vqs = min_t(unsigned int, num_vqs, virtblk_num_queues);
+
+	vblk->vqs = kcalloc(num_vqs, sizeof(*vblk->vqs), GFP_KERNEL);
+	callbacks = kmalloc(num_vqs * sizeof(*callbacks), GFP_KERNEL);
+	names = kmalloc(num_vqs * sizeof(*names), GFP_KERNEL);
+	vqs = kmalloc(num_vqs * sizeof(*vqs), GFP_KERNEL);
+	err = -ENOMEM;
+	if (!vblk->vqs || !callbacks || !names || !vqs)
+		goto out;
+
+	for (i = 0; i < num_vqs; i++) {
+		callbacks[i] = blk_done;
+		if (num_vqs == 1)
+			strcpy(vblk->vqs[i].name, "requests");
+		else
+			snprintf(vblk->vqs[i].name, sizeof(vblk->vqs[i].name),
+				 "req.%u", i);
+		names[i] = vblk->vqs[i].name;
+	}
+
+	err = vdev->config->find_vqs(vdev, num_vqs, vqs, callbacks, names);
+	if (err)
+		goto out;
+
+	for (i = 0; i < num_vqs; i++) {
+		spin_lock_init(&vblk->vqs[i].lock);
+		vblk->vqs[i].vq = vqs[i];
 	}
+	vblk->num_vqs = num_vqs;
 
-	if (issued)
-		virtqueue_kick(vblk->vq);
+out:
+	kfree(vqs);
+	kfree(names);
+	kfree(callbacks);
+	if (err) {
+		kfree(vblk->vqs);
+		vblk->vqs = NULL;
+	}
+	return err;
 }
 
 /* return id (s/n) string for *disk to *id_str
@@ -359,6 +504,7 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 {
 	struct virtio_blk *vblk;
 	struct request_queue *q;
+	struct blk_mq_reg reg;
 	int err, index;
 	u64 cap;
 	u32 v, blk_size, sg_elems, opt_io_size;
@@ -382,8 +528,7 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 
 	/* We need an extra sg elements at head and tail. */
 	sg_elems += 2;
-	vdev->priv = vblk = kmalloc(sizeof(*vblk) +
-				    sizeof(vblk->sg[0]) * sg_elems, GFP_KERNEL);
+	vdev->priv = vblk = kzalloc(sizeof(*vblk), GFP_KERNEL);
 	if (!vblk) {
 		err = -ENOMEM;
 		goto out_free_index;
@@ -391,34 +536,36 @@ static int __devinit virtblk_probe(struct virtio_device *vdev)
 
 	vblk->vdev = vdev;
 	vblk->sg_elems = sg_elems;
-	sg_init_table(vblk->sg, vblk->sg_elems);
 	mutex_init(&vblk->config_lock);
 	INIT_WORK(&vblk->config_work, virtblk_config_changed_work);
 	vblk->config_enable = true;
 
-	/* We expect one virtqueue, for output. */
-	vblk->vq = virtio_find_single_vq(vdev, blk_done, "requests");
-	if (IS_ERR(vblk->vq)) {
-		err = PTR_ERR(vblk->vq);
+	err = virtblk_find_vqs(vblk);
+	if (err)
 		goto out_free_vblk;
-	}
-
-	vblk->pool = mempool_create_kmalloc_pool(1,sizeof(struct virtblk_req));
-	if (!vblk->pool) {
-		err = -ENOMEM;
-		goto out_free_vq;
-	}
 
 	/* FIXME: How many partitions?  How long is a piece of string? */
 	vblk->disk = alloc_disk(1 << PART_BITS);
 	if (!vblk->disk) {
 		err = -ENOMEM;
-		goto out_mempool;
+		goto out_free_vq;
 	}
 
-	q = vblk->disk->queue = blk_init_queue(do_virtblk_request, NULL);
-	if (!q) {
-		err = -ENOMEM;
+	memset(&reg, 0, sizeof(reg));
+	reg.ops = &virtio_mq_ops;
+	reg.nr_hw_queues = vblk->num_vqs;
+	reg.queue_depth = virtblk_queue_depth;
+	if (!reg.queue_depth)
+		reg.queue_depth = virtqueue_get_vring_size(vblk->vqs[0].vq);
+	reg.queue_depth = min_t(unsigned int, reg.queue_depth,
+				BLK_MQ_MAX_DEPTH);
+	reg.cmd_size = sizeof(struct virtblk_req) +
+		       sizeof(struct scatterlist) * sg_elems;
+	reg.numa_node = NUMA_NO_NODE;
+
+	q = vblk->disk->queue = blk_mq_init_queue(&reg, vblk);
+	if (IS_ERR(q)) {
+		err = PTR_ERR(q);
 		goto out_put_disk;
 	}
 
@@ -531,10 +678,9 @@ out_del_disk:
 	blk_cleanup_queue(vblk->disk->queue);
 out_put_disk:
 	put_disk(vblk->disk);
-out_mempool:
-	mempool_destroy(vblk->pool);
 out_free_vq:
 	vdev->config->del_vqs(vdev);
+	kfree(vblk->vqs);
 out_free_vblk:
 	kfree(vblk);
 out_free_index:
@@ -564,8 +710,8 @@ static void __devexit virtblk_remove(struct virtio_device *vdev)
 
 	refc = atomic_read(&disk_to_dev(vblk->disk)->kobj.kref.refcount);
 	put_disk(vblk->disk);
-	mempool_destroy(vblk->pool);
 	vdev->config->del_vqs(vdev);
+	kfree(vblk->vqs);
 	kfree(vblk);
 
 	/* Only free device id if we don't have any users */
@@ -581,7 +727,7 @@ static const struct virtio_device_id id_table[] = {
 static unsigned int features[] = {
 	VIRTIO_BLK_F_SEG_MAX, VIRTIO_BLK_F_SIZE_MAX, VIRTIO_BLK_F_GEOMETRY,
 	VIRTIO_BLK_F_RO, VIRTIO_BLK_F_BLK_SIZE, VIRTIO_BLK_F_SCSI,
-	VIRTIO_BLK_F_FLUSH, VIRTIO_BLK_F_TOPOLOGY
+	VIRTIO_BLK_F_FLUSH, VIRTIO_BLK_F_TOPOLOGY, VIRTIO_BLK_F_MQ
 };
 
 /*
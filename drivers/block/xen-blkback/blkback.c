@@ -63,10 +63,25 @@ static int xen_blkif_reqs = 64;
 module_param_named(reqs, xen_blkif_reqs, int, 0);
 MODULE_PARM_DESC(reqs, "Number of blkback requests to allocate");
 
+/*
+ * Maximum number of grants to keep mapped persistently per device.  Once
+ * a device holds this many, further grants are mapped and unmapped around
+ * each request as they would be without the feature.
+ */
+static unsigned int max_persistent_grants = 1056;
+module_param_named(max_persistent_grants, max_persistent_grants, uint, 0644);
+MODULE_PARM_DESC(max_persistent_grants,
+		 "Maximum number of grants to map persistently per device");
+
 /* Run-time switchable: /sys/module/blkback/parameters/ */
 static unsigned int log_stats;
 module_param(log_stats, int, 0644);
 
+struct seg_buf {
+	unsigned int offset;
+	unsigned int nsec;
+};
+
 /*
  * Each outstanding request that we've passed to the lower device layers has a
  * 'pending_req' allocated to it. Each buffer_head that completes decrements
@@ -81,6 +96,13 @@ struct pending_req {
 	unsigned short		operation;
 	int			status;
 	struct list_head	free_list;
+	/* Private copy of the segments, read from indirect pages if need be */
+	struct blkif_request_segment segments[MAX_INDIRECT_SEGMENTS];
+	struct seg_buf		seg[MAX_INDIRECT_SEGMENTS];
+	/* The page each segment is mapped at, and its grant if persistent */
+	struct page		*pages[MAX_INDIRECT_SEGMENTS];
+	struct persistent_gnt	*persistent_gnts[MAX_INDIRECT_SEGMENTS];
+	struct bio		*biolist[MAX_INDIRECT_SEGMENTS];
 };
 
 #define BLKBACK_INVALID_HANDLE (~0)
@@ -103,13 +125,12 @@ static struct xen_blkbk *blkbk;
 /*
  * Little helpful macro to figure out the index and virtual address of the
  * pending_pages[..]. For each 'pending_req' we have have up to
- * BLKIF_MAX_SEGMENTS_PER_REQUEST (11) pages. The seg would be from 0 through
- * 10 and would index in the pending_pages[..].
+ * MAX_INDIRECT_SEGMENTS (32) pages. The seg would be from 0 through
+ * 31 and would index in the pending_pages[..].
  */
 static inline int vaddr_pagenr(struct pending_req *req, int seg)
 {
-	return (req - blkbk->pending_reqs) *
-		BLKIF_MAX_SEGMENTS_PER_REQUEST + seg;
+	return (req - blkbk->pending_reqs) * MAX_INDIRECT_SEGMENTS + seg;
 }
 
 #define pending_page(req, seg) pending_pages[vaddr_pagenr(req, seg)]
@@ -166,6 +187,89 @@ static void free_req(struct pending_req *req)
 		wake_up(&blkbk->pending_free_wq);
 }
 
+/*
+ * The grants a device keeps mapped are looked up by grant reference in a
+ * red-black tree.  Only the xenblkd thread of the device touches it.
+ */
+static int add_persistent_gnt(struct rb_root *root,
+			      struct persistent_gnt *persistent_gnt)
+{
+	struct rb_node **new = &(root->rb_node), *parent = NULL;
+	struct persistent_gnt *this;
+
+	while (*new) {
+		this = container_of(*new, struct persistent_gnt, node);
+
+		parent = *new;
+		if (persistent_gnt->gnt < this->gnt)
+			new = &((*new)->rb_left);
+		else if (persistent_gnt->gnt > this->gnt)
+			new = &((*new)->rb_right);
+		else
+			return -EEXIST;
+	}
+
+	rb_link_node(&(persistent_gnt->node), parent, new);
+	rb_insert_color(&(persistent_gnt->node), root);
+	return 0;
+}
+
+static struct persistent_gnt *get_persistent_gnt(struct rb_root *root,
+						 grant_ref_t gref)
+{
+	struct persistent_gnt *data;
+	struct rb_node *node = root->rb_node;
+
+	while (node) {
+		data = container_of(node, struct persistent_gnt, node);
+
+		if (gref < data->gnt)
+			node = node->rb_left;
+		else if (gref > data->gnt)
+			node = node->rb_right;
+		else
+			return data;
+	}
+	return NULL;
+}
+
+/*
+ * Unmap and free every grant the device holds persistently.  Called once
+ * all of its requests have completed.
+ */
+void xen_blkbk_free_persistent_gnts(struct xen_blkif *blkif)
+{
+	struct gnttab_unmap_grant_ref unmap[MAX_INDIRECT_SEGMENTS];
+	struct persistent_gnt *gnts[MAX_INDIRECT_SEGMENTS];
+	struct rb_node *node;
+	int i, n, ret;
+
+	while ((node = rb_first(&blkif->persistent_gnts)) != NULL) {
+		for (n = 0; node && n < MAX_INDIRECT_SEGMENTS; n++) {
+			gnts[n] = container_of(node, struct persistent_gnt, node);
+			node = rb_next(node);
+			rb_erase(&gnts[n]->node, &blkif->persistent_gnts);
+			gnttab_set_unmap_op(&unmap[n],
+				(unsigned long)pfn_to_kaddr(page_to_pfn(gnts[n]->page)),
+				GNTMAP_host_map, gnts[n]->handle);
+		}
+
+		ret = HYPERVISOR_grant_table_op(GNTTABOP_unmap_grant_ref,
+						unmap, n);
+		BUG_ON(ret);
+
+		for (i = 0; i < n; i++) {
+			if (m2p_remove_override(gnts[i]->page, false))
+				pr_alert(DRV_PFX "Failed to remove M2P override for %lx\n",
+					 (unsigned long)unmap[i].host_addr);
+			__free_page(gnts[i]->page);
+			kfree(gnts[i]);
+		}
+		blkif->persistent_gnt_c -= n;
+	}
+	BUG_ON(blkif->persistent_gnt_c != 0);
+}
+
 /*
  * Routines for managing virtual block devices (vbds).
  */
@@ -318,22 +422,20 @@ int xen_blkif_schedule(void *arg)
 	return 0;
 }
 
-struct seg_buf {
-	unsigned long buf;
-	unsigned int nsec;
-};
 /*
  * Unmap the grant references, and also remove the M2P over-rides
- * used in the 'pending_req'.
+ * used in the 'pending_req'.  Persistent grants stay mapped.
  */
 static void xen_blkbk_unmap(struct pending_req *req)
 {
-	struct gnttab_unmap_grant_ref unmap[BLKIF_MAX_SEGMENTS_PER_REQUEST];
+	struct gnttab_unmap_grant_ref unmap[MAX_INDIRECT_SEGMENTS];
 	unsigned int i, invcount = 0;
 	grant_handle_t handle;
 	int ret;
 
 	for (i = 0; i < req->nr_pages; i++) {
+		if (req->persistent_gnts[i])
+			continue;
 		handle = pending_handle(req, i);
 		if (handle == BLKBACK_INVALID_HANDLE)
 			continue;
@@ -342,6 +444,8 @@ static void xen_blkbk_unmap(struct pending_req *req)
 		pending_handle(req, i) = BLKBACK_INVALID_HANDLE;
 		invcount++;
 	}
+	if (!invcount)
+		return;
 
 	ret = HYPERVISOR_grant_table_op(
 		GNTTABOP_unmap_grant_ref, unmap, invcount);
@@ -361,64 +465,210 @@ static void xen_blkbk_unmap(struct pending_req *req)
 	}
 }
 
-static int xen_blkbk_map(struct blkif_request *req,
-			 struct pending_req *pending_req,
-			 struct seg_buf seg[])
+/*
+ * Decide whether the grant of segment @i should be kept mapped: the
+ * frontend must have asked for it, the device must be below its limit,
+ * and the same grant must not already be going to be kept for an earlier
+ * segment of this request.
+ */
+static bool xen_blkbk_keep_gnt(struct xen_blkif *blkif,
+			       struct pending_req *pending_req,
+			       int i, unsigned int kept)
 {
-	struct gnttab_map_grant_ref map[BLKIF_MAX_SEGMENTS_PER_REQUEST];
-	int i;
-	int nseg = req->nr_segments;
+	int j;
+
+	if (!blkif->vbd.feature_gnt_persistent ||
+	    blkif->persistent_gnt_c + kept >= max_persistent_grants)
+		return false;
+
+	for (j = 0; j < i; j++)
+		if (pending_req->segments[j].gref ==
+		    pending_req->segments[i].gref)
+			return false;
+	return true;
+}
+
+/*
+ * Map the data pages of a request.  A grant already held persistently is
+ * used as it is.  Others are mapped either into a new page which is then
+ * kept in the persistent tree, or into the request's own pending pages
+ * from where xen_blkbk_unmap() removes them when the request completes.
+ */
+static int xen_blkbk_map(struct pending_req *pending_req)
+{
+	struct xen_blkif *blkif = pending_req->blkif;
+	struct gnttab_map_grant_ref map[MAX_INDIRECT_SEGMENTS];
+	struct persistent_gnt *new_gnts[MAX_INDIRECT_SEGMENTS];
+	int map_seg[MAX_INDIRECT_SEGMENTS];
+	struct persistent_gnt *persistent_gnt;
+	int nseg = pending_req->nr_pages;
+	int i, j, nmap = 0;
+	unsigned int kept = 0;
 	int ret = 0;
 
 	/*
-	 * Fill out preq.nr_sects with proper amount of sectors, and setup
-	 * assign map[..] with the PFN of the page in our domain with the
-	 * corresponding grant reference for each page.
+	 * Fill out map[..] with the PFN of the page in our domain with the
+	 * corresponding grant reference for each page not yet mapped.
 	 */
 	for (i = 0; i < nseg; i++) {
+		grant_ref_t gref = pending_req->segments[i].gref;
 		uint32_t flags;
 
+		pending_req->seg[i].offset =
+			pending_req->segments[i].first_sect << 9;
+
+		persistent_gnt = NULL;
+		if (blkif->vbd.feature_gnt_persistent)
+			persistent_gnt = get_persistent_gnt(
+				&blkif->persistent_gnts, gref);
+		pending_req->persistent_gnts[i] = persistent_gnt;
+		if (persistent_gnt) {
+			pending_req->pages[i] = persistent_gnt->page;
+			continue;
+		}
+
 		flags = GNTMAP_host_map;
-		if (pending_req->operation != BLKIF_OP_READ)
-			flags |= GNTMAP_readonly;
-		gnttab_set_map_op(&map[i], vaddr(pending_req, i), flags,
-				  req->u.rw.seg[i].gref,
-				  pending_req->blkif->domid);
+		new_gnts[nmap] = NULL;
+		if (xen_blkbk_keep_gnt(blkif, pending_req, i, kept)) {
+			persistent_gnt = kmalloc(sizeof(*persistent_gnt),
+						 GFP_KERNEL);
+			if (persistent_gnt) {
+				persistent_gnt->page = alloc_page(GFP_KERNEL);
+				if (!persistent_gnt->page) {
+					kfree(persistent_gnt);
+					persistent_gnt = NULL;
+				}
+			}
+		}
+		if (persistent_gnt) {
+			/* The frontend may reuse it for reads and writes. */
+			persistent_gnt->gnt = gref;
+			new_gnts[nmap] = persistent_gnt;
+			pending_req->pages[i] = persistent_gnt->page;
+			kept++;
+		} else {
+			pending_req->pages[i] =
+				blkbk->pending_page(pending_req, i);
+			if (pending_req->operation != BLKIF_OP_READ)
+				flags |= GNTMAP_readonly;
+		}
+		gnttab_set_map_op(&map[nmap],
+			(unsigned long)pfn_to_kaddr(
+				page_to_pfn(pending_req->pages[i])),
+			flags, gref, blkif->domid);
+		map_seg[nmap++] = i;
 	}
 
-	ret = HYPERVISOR_grant_table_op(GNTTABOP_map_grant_ref, map, nseg);
+	if (!nmap)
+		return 0;
+
+	ret = HYPERVISOR_grant_table_op(GNTTABOP_map_grant_ref, map, nmap);
 	BUG_ON(ret);
 
 	/*
 	 * Now swizzle the MFN in our domain with the MFN from the other domain
-	 * so that when we access vaddr(pending_req,i) it has the contents of
-	 * the page from the other domain.
+	 * so that when we access the page it has the contents of the page
+	 * from the other domain.
 	 */
-	for (i = 0; i < nseg; i++) {
-		if (unlikely(map[i].status != 0)) {
+	for (j = 0; j < nmap; j++) {
+		i = map_seg[j];
+		persistent_gnt = new_gnts[j];
+
+		if (unlikely(map[j].status != 0)) {
 			pr_debug(DRV_PFX "invalid buffer -- could not remap it\n");
-			map[i].handle = BLKBACK_INVALID_HANDLE;
+			if (persistent_gnt) {
+				__free_page(persistent_gnt->page);
+				kfree(persistent_gnt);
+				/* Keep xen_blkbk_unmap() away from it. */
+				pending_req->persistent_gnts[i] =
+					ERR_PTR(-EINVAL);
+			}
 			ret |= 1;
+			continue;
 		}
 
-		pending_handle(pending_req, i) = map[i].handle;
+		if (!persistent_gnt)
+			pending_handle(pending_req, i) = map[j].handle;
 
-		if (ret)
+		if (m2p_add_override(PFN_DOWN(map[j].dev_bus_addr),
+				     pending_req->pages[i], NULL)) {
+			pr_alert(DRV_PFX "Failed to install M2P override for %lx\n",
+				 (unsigned long)map[j].dev_bus_addr);
+			ret |= 1;
+			if (persistent_gnt) {
+				struct gnttab_unmap_grant_ref unmap;
+
+				gnttab_set_unmap_op(&unmap,
+					map[j].host_addr, GNTMAP_host_map,
+					map[j].handle);
+				BUG_ON(HYPERVISOR_grant_table_op(
+					GNTTABOP_unmap_grant_ref, &unmap, 1));
+				__free_page(persistent_gnt->page);
+				kfree(persistent_gnt);
+				pending_req->persistent_gnts[i] =
+					ERR_PTR(-EINVAL);
+			}
 			continue;
+		}
 
-		ret = m2p_add_override(PFN_DOWN(map[i].dev_bus_addr),
-			blkbk->pending_page(pending_req, i), NULL);
-		if (ret) {
-			pr_alert(DRV_PFX "Failed to install M2P override for %lx (ret: %d)\n",
-				 (unsigned long)map[i].dev_bus_addr, ret);
-			/* We could switch over to GNTTABOP_copy */
+		if (persistent_gnt) {
+			persistent_gnt->handle = map[j].handle;
+			BUG_ON(add_persistent_gnt(&blkif->persistent_gnts,
+						  persistent_gnt));
+			blkif->persistent_gnt_c++;
+			pending_req->persistent_gnts[i] = persistent_gnt;
+		}
+	}
+	return ret;
+}
+
+/*
+ * Copy the segments of an indirect request out of the pages the frontend
+ * granted for them, mapping those pages for a moment into the pending
+ * pages of the request.
+ */
+static int xen_blkbk_parse_indirect(struct blkif_request *req,
+				    struct pending_req *pending_req)
+{
+	struct gnttab_map_grant_ref map[MAX_INDIRECT_PAGES];
+	struct gnttab_unmap_grant_ref unmap[MAX_INDIRECT_PAGES];
+	struct blkif_request_segment_aligned *segments;
+	int nseg = pending_req->nr_pages;
+	int indirect_pages = INDIRECT_PAGES(nseg);
+	int i, n, nunmap = 0, rc = 0;
+
+	for (i = 0; i < indirect_pages; i++)
+		gnttab_set_map_op(&map[i], vaddr(pending_req, i),
+				  GNTMAP_host_map | GNTMAP_readonly,
+				  req->u.indirect.indirect_grefs[i],
+				  pending_req->blkif->domid);
+
+	BUG_ON(HYPERVISOR_grant_table_op(GNTTABOP_map_grant_ref, map,
+					 indirect_pages));
+
+	for (i = 0; i < indirect_pages; i++) {
+		if (unlikely(map[i].status != 0)) {
+			pr_debug(DRV_PFX "invalid indirect page -- could not map it\n");
+			rc = -EINVAL;
 			continue;
 		}
+		gnttab_set_unmap_op(&unmap[nunmap++], vaddr(pending_req, i),
+				    GNTMAP_host_map, map[i].handle);
+	}
 
-		seg[i].buf  = map[i].dev_bus_addr |
-			(req->u.rw.seg[i].first_sect << 9);
+	for (i = 0; !rc && i < nseg; i++) {
+		n = i / SEGS_PER_INDIRECT_FRAME;
+		segments = (void *)vaddr(pending_req, n);
+		n = i % SEGS_PER_INDIRECT_FRAME;
+		pending_req->segments[i].gref = segments[n].gref;
+		pending_req->segments[i].first_sect = segments[n].first_sect;
+		pending_req->segments[i].last_sect = segments[n].last_sect;
 	}
-	return ret;
+
+	if (nunmap)
+		BUG_ON(HYPERVISOR_grant_table_op(GNTTABOP_unmap_grant_ref,
+						 unmap, nunmap));
+	return rc;
 }
 
 static void xen_blk_discard(struct xen_blkif *blkif, struct blkif_request *req)
@@ -454,7 +704,7 @@ static void xen_blk_discard(struct xen_blkif *blkif, struct blkif_request *req)
 	} else if (err)
 		status = BLKIF_RSP_ERROR;
 
-	make_response(blkif, req->id, req->operation, status);
+	make_response(blkif, req->u.discard.id, req->operation, status);
 }
 
 static void xen_blk_drain_io(struct xen_blkif *blkif)
@@ -620,16 +870,28 @@ static int dispatch_rw_block_io(struct xen_blkif *blkif,
 				struct pending_req *pending_req)
 {
 	struct phys_req preq;
-	struct seg_buf seg[BLKIF_MAX_SEGMENTS_PER_REQUEST];
+	struct seg_buf *seg = pending_req->seg;
 	unsigned int nseg;
 	struct bio *bio = NULL;
-	struct bio *biolist[BLKIF_MAX_SEGMENTS_PER_REQUEST];
+	struct bio **biolist = pending_req->biolist;
 	int i, nbio = 0;
 	int operation;
 	struct blk_plug plug;
 	bool drain = false;
+	unsigned short req_operation;
+
+	req_operation = req->operation;
+	if (req->operation == BLKIF_OP_INDIRECT) {
+		req_operation = req->u.indirect.indirect_op;
+		if (req_operation != BLKIF_OP_READ &&
+		    req_operation != BLKIF_OP_WRITE) {
+			pr_debug(DRV_PFX "Invalid indirect operation (%u)\n",
+				 req_operation);
+			goto fail_response;
+		}
+	}
 
-	switch (req->operation) {
+	switch (req_operation) {
 	case BLKIF_OP_READ:
 		blkif->st_rd_req++;
 		operation = READ;
@@ -655,41 +917,58 @@ static int dispatch_rw_block_io(struct xen_blkif *blkif,
 	}
 
 	/* Check that the number of segments is sane. */
-	nseg = req->nr_segments;
+	if (req->operation == BLKIF_OP_INDIRECT)
+		nseg = req->u.indirect.nr_segments;
+	else if (operation == REQ_DISCARD)
+		nseg = 0;
+	else
+		nseg = req->u.rw.nr_segments;
 	if (unlikely(nseg == 0 && operation != WRITE_FLUSH &&
 				operation != REQ_DISCARD) ||
-	    unlikely(nseg > BLKIF_MAX_SEGMENTS_PER_REQUEST)) {
+	    unlikely(req->operation != BLKIF_OP_INDIRECT &&
+		     nseg > BLKIF_MAX_SEGMENTS_PER_REQUEST) ||
+	    unlikely(req->operation == BLKIF_OP_INDIRECT &&
+		     nseg > MAX_INDIRECT_SEGMENTS)) {
 		pr_debug(DRV_PFX "Bad number of segments in request (%d)\n",
 			 nseg);
 		/* Haven't submitted any bio's yet. */
 		goto fail_response;
 	}
 
-	preq.dev           = req->handle;
-	if (operation == REQ_DISCARD) {
-		/*
-		 * It's safe to initialise preq.nr_sects here because the
-		 * 'for' loop below won't iterate as req->nr_segments = 0
-		 * (see blkif_queue_request)
-		 */
+	if (req->operation == BLKIF_OP_INDIRECT) {
+		preq.dev           = req->u.indirect.handle;
+		preq.sector_number = req->u.indirect.sector_number;
+		preq.nr_sects      = 0;
+	} else if (operation == REQ_DISCARD) {
+		preq.dev           = blkif->vbd.handle;
 		preq.sector_number = req->u.discard.sector_number;
 		preq.nr_sects      = req->u.discard.nr_sectors;
 	} else {
+		preq.dev           = req->u.rw.handle;
 		preq.sector_number = req->u.rw.sector_number;
 		preq.nr_sects      = 0;
 	}
 
 	pending_req->blkif     = blkif;
-	pending_req->id        = req->id;
-	pending_req->operation = req->operation;
+	pending_req->id        = req->u.rw.id;
+	pending_req->operation = req_operation;
 	pending_req->status    = BLKIF_RSP_OKAY;
 	pending_req->nr_pages  = nseg;
 
+	if (req->operation == BLKIF_OP_INDIRECT) {
+		if (xen_blkbk_parse_indirect(req, pending_req))
+			goto fail_response;
+	} else {
+		for (i = 0; i < nseg; i++)
+			pending_req->segments[i] = req->u.rw.seg[i];
+	}
+
 	for (i = 0; i < nseg; i++) {
-		seg[i].nsec = req->u.rw.seg[i].last_sect -
-			req->u.rw.seg[i].first_sect + 1;
-		if ((req->u.rw.seg[i].last_sect >= (PAGE_SIZE >> 9)) ||
-		    (req->u.rw.seg[i].last_sect < req->u.rw.seg[i].first_sect))
+		struct blkif_request_segment *s = &pending_req->segments[i];
+
+		seg[i].nsec = s->last_sect - s->first_sect + 1;
+		if ((s->last_sect >= (PAGE_SIZE >> 9)) ||
+		    (s->last_sect < s->first_sect))
 			goto fail_response;
 		preq.nr_sects += seg[i].nsec;
 
@@ -728,7 +1007,7 @@ static int dispatch_rw_block_io(struct xen_blkif *blkif,
 	 * the hypercall to unmap the grants - that is all done in
 	 * xen_blkbk_unmap.
 	 */
-	if (operation != REQ_DISCARD && xen_blkbk_map(req, pending_req, seg))
+	if (operation != REQ_DISCARD && xen_blkbk_map(pending_req))
 		goto fail_flush;
 
 	/*
@@ -740,9 +1019,9 @@ static int dispatch_rw_block_io(struct xen_blkif *blkif,
 	for (i = 0; i < nseg; i++) {
 		while ((bio == NULL) ||
 		       (bio_add_page(bio,
-				     blkbk->pending_page(pending_req, i),
+				     pending_req->pages[i],
 				     seg[i].nsec << 9,
-				     seg[i].buf & ~PAGE_MASK) == 0)) {
+				     seg[i].offset) == 0)) {
 
 			bio = bio_alloc(GFP_KERNEL, nseg-i);
 			if (unlikely(bio == NULL))
@@ -799,7 +1078,7 @@ static int dispatch_rw_block_io(struct xen_blkif *blkif,
 	xen_blkbk_unmap(pending_req);
  fail_response:
 	/* Haven't submitted any bio's yet. */
-	make_response(blkif, req->id, req->operation, BLKIF_RSP_ERROR);
+	make_response(blkif, req->u.rw.id, req_operation, BLKIF_RSP_ERROR);
 	free_req(pending_req);
 	msleep(1); /* back off a bit */
 	return -EIO;
@@ -869,7 +1148,7 @@ static int __init xen_blkif_init(void)
 		return -ENOMEM;
 	}
 
-	mmap_pages = xen_blkif_reqs * BLKIF_MAX_SEGMENTS_PER_REQUEST;
+	mmap_pages = xen_blkif_reqs * MAX_INDIRECT_SEGMENTS;
 
 	blkbk->pending_reqs          = kzalloc(sizeof(blkbk->pending_reqs[0]) *
 					xen_blkif_reqs, GFP_KERNEL);
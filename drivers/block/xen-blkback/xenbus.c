@@ -19,8 +19,19 @@
 #include <linux/kthread.h>
 #include <xen/events.h>
 #include <xen/grant_table.h>
+#include <asm/xen/page.h>
+#include <asm/xen/hypercall.h>
 #include "common.h"
 
+/*
+ * Number of pages the frontend may use for its shared ring, advertised as
+ * "max-ring-pages".
+ */
+static unsigned int xen_blkif_max_ring_pages = BLKIF_MAX_NUM_RING_PAGES_DFLT;
+module_param_named(max_ring_pages, xen_blkif_max_ring_pages, uint, S_IRUGO);
+MODULE_PARM_DESC(max_ring_pages,
+		 "Maximum number of pages in a shared ring (default 4)");
+
 struct backend_info {
 	struct xenbus_device	*dev;
 	struct xen_blkif	*blkif;
@@ -119,20 +130,109 @@ static struct xen_blkif *xen_blkif_alloc(domid_t domid)
 	blkif->st_print = jiffies;
 	init_waitqueue_head(&blkif->waiting_to_free);
 	init_waitqueue_head(&blkif->shutdown_wq);
+	blkif->persistent_gnts = RB_ROOT;
 
 	return blkif;
 }
 
-static int xen_blkif_map(struct xen_blkif *blkif, unsigned long shared_page,
-			 unsigned int evtchn)
+/*
+ * Map the pages of the shared ring contiguously into a new area of
+ * kernel address space, as xenbus_map_ring_valloc() does for one page.
+ */
+static int xen_blkif_map_ring(struct xen_blkif *blkif, grant_ref_t *gref,
+			      unsigned int nr_pages)
+{
+	struct gnttab_map_grant_ref op[BLKIF_MAX_NUM_RING_PAGES];
+	struct gnttab_unmap_grant_ref unop[BLKIF_MAX_NUM_RING_PAGES];
+	pte_t *pte[BLKIF_MAX_NUM_RING_PAGES];
+	struct vm_struct *area;
+	unsigned int i, nunmap = 0;
+	int err = 0;
+
+	area = alloc_vm_area(nr_pages * PAGE_SIZE, pte);
+	if (!area)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_pages; i++)
+		gnttab_set_map_op(&op[i], arbitrary_virt_to_machine(pte[i]).maddr,
+				  GNTMAP_host_map | GNTMAP_contains_pte,
+				  gref[i], blkif->domid);
+
+	if (HYPERVISOR_grant_table_op(GNTTABOP_map_grant_ref, op, nr_pages))
+		BUG();
+
+	for (i = 0; i < nr_pages; i++) {
+		if (op[i].status != GNTST_okay) {
+			err = op[i].status;
+			continue;
+		}
+		blkif->ring_handles[i] = op[i].handle;
+		gnttab_set_unmap_op(&unop[nunmap++],
+				    arbitrary_virt_to_machine(pte[i]).maddr,
+				    GNTMAP_host_map | GNTMAP_contains_pte,
+				    op[i].handle);
+	}
+
+	if (err) {
+		if (nunmap &&
+		    HYPERVISOR_grant_table_op(GNTTABOP_unmap_grant_ref,
+					      unop, nunmap))
+			BUG();
+		free_vm_area(area);
+		xenbus_dev_fatal(blkif->be->dev, err,
+				 "mapping in shared ring of %u pages",
+				 nr_pages);
+		return -EINVAL;
+	}
+
+	blkif->blk_ring_area = area;
+	blkif->blk_ring = area->addr;
+	blkif->nr_ring_pages = nr_pages;
+	return 0;
+}
+
+static void xen_blkif_unmap_ring(struct xen_blkif *blkif)
 {
+	struct gnttab_unmap_grant_ref op[BLKIF_MAX_NUM_RING_PAGES];
+	unsigned int i, level;
+	unsigned long addr;
+
+	for (i = 0; i < blkif->nr_ring_pages; i++) {
+		addr = (unsigned long)blkif->blk_ring + i * PAGE_SIZE;
+		gnttab_set_unmap_op(&op[i],
+			arbitrary_virt_to_machine(
+				lookup_address(addr, &level)).maddr,
+			GNTMAP_host_map | GNTMAP_contains_pte,
+			blkif->ring_handles[i]);
+	}
+
+	if (HYPERVISOR_grant_table_op(GNTTABOP_unmap_grant_ref, op,
+				      blkif->nr_ring_pages))
+		BUG();
+
+	for (i = 0; i < blkif->nr_ring_pages; i++)
+		if (op[i].status != GNTST_okay)
+			xenbus_dev_error(blkif->be->dev, op[i].status,
+					 "unmapping page %u of shared ring",
+					 i);
+
+	free_vm_area(blkif->blk_ring_area);
+	blkif->blk_ring_area = NULL;
+	blkif->blk_ring = NULL;
+	blkif->nr_ring_pages = 0;
+}
+
+static int xen_blkif_map(struct xen_blkif *blkif, grant_ref_t *gref,
+			 unsigned int nr_pages, unsigned int evtchn)
+{
+	unsigned int size = nr_pages * PAGE_SIZE;
 	int err;
 
 	/* Already connected through? */
 	if (blkif->irq)
 		return 0;
 
-	err = xenbus_map_ring_valloc(blkif->be->dev, shared_page, &blkif->blk_ring);
+	err = xen_blkif_map_ring(blkif, gref, nr_pages);
 	if (err < 0)
 		return err;
 
@@ -141,21 +241,21 @@ static int xen_blkif_map(struct xen_blkif *blkif, unsigned long shared_page,
 	{
 		struct blkif_sring *sring;
 		sring = (struct blkif_sring *)blkif->blk_ring;
-		BACK_RING_INIT(&blkif->blk_rings.native, sring, PAGE_SIZE);
+		BACK_RING_INIT(&blkif->blk_rings.native, sring, size);
 		break;
 	}
 	case BLKIF_PROTOCOL_X86_32:
 	{
 		struct blkif_x86_32_sring *sring_x86_32;
 		sring_x86_32 = (struct blkif_x86_32_sring *)blkif->blk_ring;
-		BACK_RING_INIT(&blkif->blk_rings.x86_32, sring_x86_32, PAGE_SIZE);
+		BACK_RING_INIT(&blkif->blk_rings.x86_32, sring_x86_32, size);
 		break;
 	}
 	case BLKIF_PROTOCOL_X86_64:
 	{
 		struct blkif_x86_64_sring *sring_x86_64;
 		sring_x86_64 = (struct blkif_x86_64_sring *)blkif->blk_ring;
-		BACK_RING_INIT(&blkif->blk_rings.x86_64, sring_x86_64, PAGE_SIZE);
+		BACK_RING_INIT(&blkif->blk_rings.x86_64, sring_x86_64, size);
 		break;
 	}
 	default:
@@ -166,7 +266,7 @@ static int xen_blkif_map(struct xen_blkif *blkif, unsigned long shared_page,
 						    xen_blkif_be_int, 0,
 						    "blkif-backend", blkif);
 	if (err < 0) {
-		xenbus_unmap_ring_vfree(blkif->be->dev, blkif->blk_ring);
+		xen_blkif_unmap_ring(blkif);
 		blkif->blk_rings.common.sring = NULL;
 		return err;
 	}
@@ -187,13 +287,16 @@ static void xen_blkif_disconnect(struct xen_blkif *blkif)
 	wait_event(blkif->waiting_to_free, atomic_read(&blkif->refcnt) == 0);
 	atomic_inc(&blkif->refcnt);
 
+	/* No request is using them any more. */
+	xen_blkbk_free_persistent_gnts(blkif);
+
 	if (blkif->irq) {
 		unbind_from_irqhandler(blkif->irq, blkif);
 		blkif->irq = 0;
 	}
 
 	if (blkif->blk_rings.common.sring) {
-		xenbus_unmap_ring_vfree(blkif->be->dev, blkif->blk_ring);
+		xen_blkif_unmap_ring(blkif);
 		blkif->blk_rings.common.sring = NULL;
 	}
 }
@@ -488,6 +591,13 @@ static int xen_blkbk_probe(struct xenbus_device *dev,
 	if (err)
 		goto fail;
 
+	err = xenbus_printf(XBT_NIL, dev->nodename, "max-ring-pages", "%u",
+			    xen_blkif_max_ring_pages);
+	if (err) {
+		xenbus_dev_fatal(dev, err, "writing max-ring-pages");
+		goto fail;
+	}
+
 	err = xenbus_switch_state(dev, XenbusStateInitWait);
 	if (err)
 		goto fail;
@@ -687,6 +797,20 @@ again:
 	/* If we can't advertise it is OK. */
 	err = xen_blkbk_barrier(xbt, be, be->blkif->vbd.flush_support);
 
+	err = xenbus_printf(xbt, dev->nodename, "feature-persistent", "%u", 1);
+	if (err) {
+		xenbus_dev_fatal(dev, err, "writing %s/feature-persistent",
+				 dev->nodename);
+		goto abort;
+	}
+
+	err = xenbus_printf(xbt, dev->nodename,
+			    "feature-max-indirect-segments", "%u",
+			    MAX_INDIRECT_SEGMENTS);
+	if (err)
+		dev_warn(&dev->dev, "writing %s/feature-max-indirect-segments (%d)",
+			 dev->nodename, err);
+
 	err = xenbus_printf(xbt, dev->nodename, "sectors", "%llu",
 			    (unsigned long long)vbd_sz(&be->blkif->vbd));
 	if (err) {
@@ -733,22 +857,56 @@ again:
 static int connect_ring(struct backend_info *be)
 {
 	struct xenbus_device *dev = be->dev;
-	unsigned long ring_ref;
+	grant_ref_t ring_ref[BLKIF_MAX_NUM_RING_PAGES];
+	unsigned int nr_pages, pers_grants;
 	unsigned int evtchn;
 	char protocol[64] = "";
-	int err;
+	char name[16];
+	int err, i;
 
 	DPRINTK("%s", dev->otherend);
 
-	err = xenbus_gather(XBT_NIL, dev->otherend, "ring-ref", "%lu",
-			    &ring_ref, "event-channel", "%u", &evtchn, NULL);
-	if (err) {
-		xenbus_dev_fatal(dev, err,
-				 "reading %s/ring-ref and event-channel",
+	err = xenbus_scanf(XBT_NIL, dev->otherend, "event-channel", "%u",
+			   &evtchn);
+	if (err != 1) {
+		err = -EINVAL;
+		xenbus_dev_fatal(dev, err, "reading %s/event-channel",
 				 dev->otherend);
 		return err;
 	}
 
+	err = xenbus_scanf(XBT_NIL, dev->otherend, "num-ring-pages", "%u",
+			   &nr_pages);
+	if (err != 1) {
+		nr_pages = 1;
+		err = xenbus_scanf(XBT_NIL, dev->otherend, "ring-ref", "%u",
+				   &ring_ref[0]);
+		if (err != 1) {
+			err = -EINVAL;
+			xenbus_dev_fatal(dev, err, "reading %s/ring-ref",
+					 dev->otherend);
+			return err;
+		}
+	} else {
+		if (nr_pages == 0 || nr_pages > xen_blkif_max_ring_pages) {
+			err = -EINVAL;
+			xenbus_dev_fatal(dev, err, "%s/num-ring-pages %u",
+					 dev->otherend, nr_pages);
+			return err;
+		}
+		for (i = 0; i < nr_pages; i++) {
+			snprintf(name, sizeof(name), "ring-ref%d", i);
+			err = xenbus_scanf(XBT_NIL, dev->otherend, name,
+					   "%u", &ring_ref[i]);
+			if (err != 1) {
+				err = -EINVAL;
+				xenbus_dev_fatal(dev, err, "reading %s/%s",
+						 dev->otherend, name);
+				return err;
+			}
+		}
+	}
+
 	be->blkif->blk_protocol = BLKIF_PROTOCOL_NATIVE;
 	err = xenbus_gather(XBT_NIL, dev->otherend, "protocol",
 			    "%63s", protocol, NULL);
@@ -764,14 +922,21 @@ static int connect_ring(struct backend_info *be)
 		xenbus_dev_fatal(dev, err, "unknown fe protocol %s", protocol);
 		return -1;
 	}
-	pr_info(DRV_PFX "ring-ref %ld, event-channel %d, protocol %d (%s)\n",
-		ring_ref, evtchn, be->blkif->blk_protocol, protocol);
+	err = xenbus_scanf(XBT_NIL, dev->otherend, "feature-persistent", "%u",
+			   &pers_grants);
+	if (err != 1)
+		pers_grants = 0;
+	be->blkif->vbd.feature_gnt_persistent = pers_grants;
+
+	pr_info(DRV_PFX "ring-ref %u, ring pages %u, event-channel %d, protocol %d (%s) %s\n",
+		ring_ref[0], nr_pages, evtchn, be->blkif->blk_protocol,
+		protocol, pers_grants ? "persistent grants" : "");
 
 	/* Map the shared frame, irq etc. */
-	err = xen_blkif_map(be->blkif, ring_ref, evtchn);
+	err = xen_blkif_map(be->blkif, ring_ref, nr_pages, evtchn);
 	if (err) {
-		xenbus_dev_fatal(dev, err, "mapping ring-ref %lu port %u",
-				 ring_ref, evtchn);
+		xenbus_dev_fatal(dev, err, "mapping ring-ref %u port %u",
+				 ring_ref[0], evtchn);
 		return err;
 	}
 
@@ -800,5 +965,12 @@ static struct xenbus_driver xen_blkbk = {
 
 int xen_blkif_xenbus_init(void)
 {
+	if (xen_blkif_max_ring_pages < 1 ||
+	    xen_blkif_max_ring_pages > BLKIF_MAX_NUM_RING_PAGES) {
+		pr_info(DRV_PFX "Invalid max_ring_pages (%u), will use default max: %d.\n",
+			xen_blkif_max_ring_pages, BLKIF_MAX_NUM_RING_PAGES_DFLT);
+		xen_blkif_max_ring_pages = BLKIF_MAX_NUM_RING_PAGES_DFLT;
+	}
+
 	return xenbus_register_backend(&xen_blkbk);
 }
@@ -43,6 +43,8 @@
 #include <linux/slab.h>
 #include <linux/mutex.h>
 #include <linux/scatterlist.h>
+#include <linux/highmem.h>
+#include <linux/list.h>
 
 #include <xen/xen.h>
 #include <xen/xenbus.h>
@@ -63,15 +65,42 @@ enum blkif_state {
 	BLKIF_STATE_SUSPENDED,
 };
 
+/*
+ * A page of the pool the data of all requests is copied through, and the
+ * grant the backend has on it.  The backend may keep the grant mapped
+ * across requests (see "feature-persistent" in blkif.h).
+ */
+struct grant {
+	grant_ref_t gref;
+	unsigned long pfn;
+	struct list_head node;
+};
+
 struct blk_shadow {
 	struct blkif_request req;
 	struct request *request;
-	unsigned long frame[BLKIF_MAX_SEGMENTS_PER_REQUEST];
+	/* Sized for the segments of the largest request we issue. */
+	struct grant **grants_used;
+	struct grant **indirect_grants;
+	struct scatterlist *sg;
 };
 
 static DEFINE_MUTEX(blkfront_mutex);
 static const struct block_device_operations xlvbd_block_fops;
 
+/*
+ * Maximum number of segments in an indirect request; the backend may
+ * offer fewer.
+ */
+static unsigned int xen_blkif_max_segments = 32;
+module_param_named(max, xen_blkif_max_segments, int, S_IRUGO);
+MODULE_PARM_DESC(max, "Maximum amount of segments in indirect requests (default is 32)");
+
+#define SEGS_PER_INDIRECT_FRAME \
+	(PAGE_SIZE/sizeof(struct blkif_request_segment_aligned))
+#define INDIRECT_GREFS(_segs) \
+	((_segs + SEGS_PER_INDIRECT_FRAME - 1)/SEGS_PER_INDIRECT_FRAME)
+
 #define BLK_MAX_RING_AREA_SIZE (BLKIF_MAX_NUM_RING_PAGES * PAGE_SIZE)
 #define BLK_MAX_RING_SIZE __CONST_RING_SIZE(blkif, BLK_MAX_RING_AREA_SIZE)
 
@@ -91,7 +120,6 @@ struct blkfront_info
 	int num_ring_pages;
 	int ring_ref[BLKIF_MAX_NUM_RING_PAGES];
 	struct blkif_front_ring ring;
-	struct scatterlist sg[BLKIF_MAX_SEGMENTS_PER_REQUEST];
 	unsigned int evtchn, irq;
 	struct request_queue *rq;
 	struct work_struct work;
@@ -103,6 +131,13 @@ struct blkfront_info
 	unsigned int feature_discard;
 	unsigned int discard_granularity;
 	unsigned int discard_alignment;
+	unsigned int feature_persistent:1;
+	/* 0 if the backend does not take indirect requests */
+	unsigned int max_indirect_segments;
+	/* Free pages of the pool, those with a grant first. */
+	struct list_head grants;
+	unsigned int persistent_gnts_c;
+	unsigned int free_gnts_c;
 	int is_ready;
 };
 
@@ -133,24 +168,129 @@ static DEFINE_SPINLOCK(minor_lock);
 
 #define DEV_NAME	"xvd"	/* name in /dev */
 
+static inline int blkif_ring_size(struct blkfront_info *info)
+{
+	return __RING_SIZE((struct blkif_sring *)0,
+			   info->num_ring_pages * PAGE_SIZE);
+}
+
 static int get_id_from_freelist(struct blkfront_info *info)
 {
 	unsigned long free = info->shadow_free;
-	int ring_size = __RING_SIZE((struct blkif_sring *)0, info->num_ring_pages * PAGE_SIZE);
-	BUG_ON(free >= ring_size);
-	info->shadow_free = info->shadow[free].req.id;
-	info->shadow[free].req.id = 0x0fffffee; /* debug */
+	BUG_ON(free >= blkif_ring_size(info));
+	info->shadow_free = info->shadow[free].req.u.rw.id;
+	info->shadow[free].req.u.rw.id = 0x0fffffee; /* debug */
 	return free;
 }
 
 static void add_id_to_freelist(struct blkfront_info *info,
 			       unsigned long id)
 {
-	info->shadow[id].req.id  = info->shadow_free;
+	info->shadow[id].req.u.rw.id  = info->shadow_free;
 	info->shadow[id].request = NULL;
 	info->shadow_free = id;
 }
 
+static unsigned int blkif_shadow_nr_segments(struct blk_shadow *s)
+{
+	switch (s->req.operation) {
+	case BLKIF_OP_DISCARD:
+		return 0;
+	case BLKIF_OP_INDIRECT:
+		return s->req.u.indirect.nr_segments;
+	default:
+		return s->req.u.rw.nr_segments;
+	}
+}
+
+/* Pool pages a request of @nseg segments takes, indirect pages included. */
+static unsigned int blkif_nr_grefs(unsigned int nseg)
+{
+	if (nseg > BLKIF_MAX_SEGMENTS_PER_REQUEST)
+		nseg += INDIRECT_GREFS(nseg);
+	return nseg;
+}
+
+/*
+ * Grow the pool to at least @num free pages.  The pages get a grant when
+ * they are first used.
+ */
+static int fill_grant_buffer(struct blkfront_info *info, unsigned int num,
+			     gfp_t gfp)
+{
+	struct grant *gnt_list_entry;
+	struct page *granted_page;
+
+	while (info->free_gnts_c < num) {
+		gnt_list_entry = kzalloc(sizeof(struct grant), gfp);
+		if (!gnt_list_entry)
+			return -ENOMEM;
+
+		granted_page = alloc_page(gfp);
+		if (!granted_page) {
+			kfree(gnt_list_entry);
+			return -ENOMEM;
+		}
+
+		gnt_list_entry->pfn = page_to_pfn(granted_page);
+		gnt_list_entry->gref = GRANT_INVALID_REF;
+		list_add_tail(&gnt_list_entry->node, &info->grants);
+		info->free_gnts_c++;
+	}
+	return 0;
+}
+
+static struct grant *get_grant(grant_ref_t *gref_head,
+			       struct blkfront_info *info)
+{
+	struct grant *gnt_list_entry;
+	unsigned long buffer_mfn;
+
+	BUG_ON(list_empty(&info->grants));
+	gnt_list_entry = list_first_entry(&info->grants, struct grant,
+					  node);
+	list_del(&gnt_list_entry->node);
+	info->free_gnts_c--;
+
+	if (gnt_list_entry->gref != GRANT_INVALID_REF) {
+		info->persistent_gnts_c--;
+		return gnt_list_entry;
+	}
+
+	/* Assign a gref to this page */
+	gnt_list_entry->gref = gnttab_claim_grant_reference(gref_head);
+	BUG_ON(gnt_list_entry->gref == -ENOSPC);
+	buffer_mfn = pfn_to_mfn(gnt_list_entry->pfn);
+	gnttab_grant_foreign_access_ref(gnt_list_entry->gref,
+					info->xbdev->otherend_id,
+					buffer_mfn, 0);
+	return gnt_list_entry;
+}
+
+/* Back to the head of the pool, so that it is reused first. */
+static void put_grant(struct grant *gnt, struct blkfront_info *info)
+{
+	list_add(&gnt->node, &info->grants);
+	info->persistent_gnts_c++;
+	info->free_gnts_c++;
+}
+
+static void free_grant(struct grant *gnt)
+{
+	if (gnt->gref != GRANT_INVALID_REF) {
+		if (!gnttab_end_foreign_access_ref(gnt->gref, 0)) {
+			/* Leak the page rather than free one it can reach. */
+			printk(KERN_WARNING "blkfront: grant %u still in use by backend\n",
+			       gnt->gref);
+			kfree(gnt);
+			return;
+		}
+		gnttab_free_grant_reference(gnt->gref);
+	}
+	__free_page(pfn_to_page(gnt->pfn));
+	kfree(gnt);
+}
+
 static int xlbd_reserve_minors(unsigned int minor, unsigned int nr)
 {
 	unsigned int end = minor + nr;
@@ -257,87 +397,177 @@ static int blkif_ioctl(struct block_device *bdev, fmode_t mode,
 
 /*
  * Generate a Xen blkfront IO request from a blk layer request.  Reads
- * and writes are handled as expected.
+ * and writes are handled as expected.  The data goes through pages of
+ * the grant pool; requests with more segments than fit in a ring slot
+ * list them in indirect pages, also taken from the pool.
  *
  * @req: a request struct
  */
 static int blkif_queue_request(struct request *req)
 {
 	struct blkfront_info *info = req->rq_disk->private_data;
-	unsigned long buffer_mfn;
 	struct blkif_request *ring_req;
 	unsigned long id;
 	unsigned int fsect, lsect;
-	int i, ref;
+	int i, ref, n;
+	struct blkif_request_segment_aligned *segments = NULL;
+	/*
+	 * Whether the free pages of the pool that already have a grant are
+	 * enough for this request, or new grant references are needed.
+	 */
+	bool new_persistent_gnts;
 	grant_ref_t gref_head;
+	struct grant *gnt_list_entry = NULL;
 	struct scatterlist *sg;
+	int nseg, max_grefs;
 
 	if (unlikely(info->connected != BLKIF_STATE_CONNECTED))
 		return 1;
 
-	if (gnttab_alloc_grant_references(
-		BLKIF_MAX_SEGMENTS_PER_REQUEST, &gref_head) < 0) {
-		gnttab_request_free_callback(
-			&info->callback,
-			blkif_restart_queue_callback,
-			info,
-			BLKIF_MAX_SEGMENTS_PER_REQUEST);
+	max_grefs = blkif_nr_grefs(req->nr_phys_segments);
+
+	/*
+	 * The pool always holds enough for one request of the largest size,
+	 * so a shortage here means requests are in flight, and their
+	 * completion restarts the queue.
+	 */
+	if (info->free_gnts_c < max_grefs &&
+	    fill_grant_buffer(info, max_grefs, GFP_ATOMIC))
 		return 1;
-	}
+
+	/* Check if we have enough grants to allocate a requests */
+	if (info->persistent_gnts_c < max_grefs) {
+		new_persistent_gnts = 1;
+		if (gnttab_alloc_grant_references(
+		    max_grefs - info->persistent_gnts_c,
+		    &gref_head) < 0) {
+			gnttab_request_free_callback(
+				&info->callback,
+				blkif_restart_queue_callback,
+				info,
+				max_grefs);
+			return 1;
+		}
+	} else
+		new_persistent_gnts = 0;
 
 	/* Fill out a communications ring structure. */
 	ring_req = RING_GET_REQUEST(&info->ring, info->ring.req_prod_pvt);
 	id = get_id_from_freelist(info);
 	info->shadow[id].request = req;
 
-	ring_req->id = id;
-	ring_req->u.rw.sector_number = (blkif_sector_t)blk_rq_pos(req);
-	ring_req->handle = info->handle;
-
-	ring_req->operation = rq_data_dir(req) ?
-		BLKIF_OP_WRITE : BLKIF_OP_READ;
-
-	if (req->cmd_flags & (REQ_FLUSH | REQ_FUA)) {
-		/*
-		 * Ideally we can do an unordered flush-to-disk. In case the
-		 * backend onlysupports barriers, use that. A barrier request
-		 * a superset of FUA, so we can implement it the same
-		 * way.  (It's also a FLUSH+FUA, since it is
-		 * guaranteed ordered WRT previous writes.)
-		 */
-		ring_req->operation = info->flush_op;
-	}
-
 	if (unlikely(req->cmd_flags & REQ_DISCARD)) {
-		/* id, sector_number and handle are set above. */
 		ring_req->operation = BLKIF_OP_DISCARD;
-		ring_req->nr_segments = 0;
+		/* nr_segments to backends not knowing the discard layout */
+		ring_req->u.discard._pad1 = 0;
+		ring_req->u.discard.id = id;
+		ring_req->u.discard.sector_number =
+			(blkif_sector_t)blk_rq_pos(req);
 		ring_req->u.discard.nr_sectors = blk_rq_sectors(req);
 	} else {
-		ring_req->nr_segments = blk_rq_map_sg(req->q, req, info->sg);
-		BUG_ON(ring_req->nr_segments > BLKIF_MAX_SEGMENTS_PER_REQUEST);
+		BUG_ON(info->max_indirect_segments == 0 &&
+		       req->nr_phys_segments > BLKIF_MAX_SEGMENTS_PER_REQUEST);
+		BUG_ON(info->max_indirect_segments &&
+		       req->nr_phys_segments > info->max_indirect_segments);
+		nseg = blk_rq_map_sg(req->q, req, info->shadow[id].sg);
+		ring_req->u.rw.id = id;
+		if (nseg > BLKIF_MAX_SEGMENTS_PER_REQUEST) {
+			/*
+			 * The indirect operation can only be a BLKIF_OP_READ
+			 * or BLKIF_OP_WRITE: it is not used with barriers.
+			 */
+			BUG_ON(req->cmd_flags & (REQ_FLUSH | REQ_FUA));
+			ring_req->operation = BLKIF_OP_INDIRECT;
+			ring_req->u.indirect.indirect_op = rq_data_dir(req) ?
+				BLKIF_OP_WRITE : BLKIF_OP_READ;
+			ring_req->u.indirect.sector_number =
+				(blkif_sector_t)blk_rq_pos(req);
+			ring_req->u.indirect.handle = info->handle;
+			ring_req->u.indirect.nr_segments = nseg;
+		} else {
+			ring_req->u.rw.sector_number =
+				(blkif_sector_t)blk_rq_pos(req);
+			ring_req->u.rw.handle = info->handle;
+			ring_req->operation = rq_data_dir(req) ?
+				BLKIF_OP_WRITE : BLKIF_OP_READ;
+			if (req->cmd_flags & (REQ_FLUSH | REQ_FUA)) {
+				/*
+				 * Ideally we can do an unordered flush-to-disk.
+				 * In case the backend onlysupports barriers, use
+				 * that. A barrier request a superset of FUA, so
+				 * we can implement it the same way.  (It's also
+				 * a FLUSH+FUA, since it is guaranteed ordered WRT
+				 * previous writes.)
+				 */
+				ring_req->operation = info->flush_op;
+			}
+			ring_req->u.rw.nr_segments = nseg;
+		}
 
-		for_each_sg(info->sg, sg, ring_req->nr_segments, i) {
-			buffer_mfn = pfn_to_mfn(page_to_pfn(sg_page(sg)));
+		for_each_sg(info->shadow[id].sg, sg, nseg, i) {
 			fsect = sg->offset >> 9;
 			lsect = fsect + (sg->length >> 9) - 1;
-			/* install a grant reference. */
-			ref = gnttab_claim_grant_reference(&gref_head);
-			BUG_ON(ref == -ENOSPC);
 
-			gnttab_grant_foreign_access_ref(
-					ref,
-					info->xbdev->otherend_id,
-					buffer_mfn,
-					rq_data_dir(req));
+			if ((ring_req->operation == BLKIF_OP_INDIRECT) &&
+			    (i % SEGS_PER_INDIRECT_FRAME == 0)) {
+				if (segments)
+					kunmap_atomic(segments);
+
+				n = i / SEGS_PER_INDIRECT_FRAME;
+				gnt_list_entry = get_grant(&gref_head, info);
+				info->shadow[id].indirect_grants[n] =
+					gnt_list_entry;
+				segments = kmap_atomic(
+					pfn_to_page(gnt_list_entry->pfn));
+				ring_req->u.indirect.indirect_grefs[n] =
+					gnt_list_entry->gref;
+			}
+
+			gnt_list_entry = get_grant(&gref_head, info);
+			ref = gnt_list_entry->gref;
+
+			info->shadow[id].grants_used[i] = gnt_list_entry;
+
+			if (rq_data_dir(req)) {
+				char *bvec_data;
+				void *shared_data;
 
-			info->shadow[id].frame[i] = mfn_to_pfn(buffer_mfn);
-			ring_req->u.rw.seg[i] =
+				BUG_ON(sg->offset + sg->length > PAGE_SIZE);
+
+				shared_data = kmap_atomic(
+					pfn_to_page(gnt_list_entry->pfn));
+				bvec_data = kmap_atomic(sg_page(sg));
+
+				/*
+				 * This does not wipe data stored outside the
+				 * range sg->offset..sg->offset+sg->length, so
+				 * the backend may see data of earlier requests
+				 * to this device.  It only ever sees our own.
+				 */
+				memcpy(shared_data + sg->offset,
+				       bvec_data   + sg->offset,
+				       sg->length);
+
+				kunmap_atomic(bvec_data);
+				kunmap_atomic(shared_data);
+			}
+			if (ring_req->operation != BLKIF_OP_INDIRECT) {
+				ring_req->u.rw.seg[i] =
 					(struct blkif_request_segment) {
 						.gref       = ref,
 						.first_sect = fsect,
 						.last_sect  = lsect };
+			} else {
+				n = i % SEGS_PER_INDIRECT_FRAME;
+				segments[n] =
+					(struct blkif_request_segment_aligned) {
+						.gref       = ref,
+						.first_sect = fsect,
+						.last_sect  = lsect };
+			}
 		}
+		if (segments)
+			kunmap_atomic(segments);
 	}
 
 	info->ring.req_prod_pvt++;
@@ -345,7 +575,8 @@ static int blkif_queue_request(struct request *req)
 	/* Keep a private copy so we can reissue requests when recovering. */
 	info->shadow[id].req = *ring_req;
 
-	gnttab_free_grant_references(gref_head);
+	if (new_persistent_gnts)
+		gnttab_free_grant_references(gref_head);
 
 	return 0;
 }
@@ -415,6 +646,8 @@ static int xlvbd_init_blk_queue(struct gendisk *gd, u16 sector_size)
 {
 	struct request_queue *rq;
 	struct blkfront_info *info = gd->private_data;
+	unsigned int segments = info->max_indirect_segments ? :
+				BLKIF_MAX_SEGMENTS_PER_REQUEST;
 
 	rq = blk_init_queue(do_blkif_request, &blkif_io_lock);
 	if (rq == NULL)
@@ -431,14 +664,15 @@ static int xlvbd_init_blk_queue(struct gendisk *gd, u16 sector_size)
 
 	/* Hard sector size and max sectors impersonate the equiv. hardware. */
 	blk_queue_logical_block_size(rq, sector_size);
-	blk_queue_max_hw_sectors(rq, 512);
+	blk_queue_max_hw_sectors(rq, max_t(unsigned int, 512,
+					   segments * PAGE_SIZE / 512));
 
 	/* Each segment in a request is up to an aligned page in size. */
 	blk_queue_segment_boundary(rq, PAGE_SIZE - 1);
 	blk_queue_max_segment_size(rq, PAGE_SIZE);
 
-	/* Ensure a merged request will fit in a single I/O ring slot. */
-	blk_queue_max_segments(rq, BLKIF_MAX_SEGMENTS_PER_REQUEST);
+	/* Ensure a merged request will fit in a single I/O ring request. */
+	blk_queue_max_segments(rq, segments);
 
 	/* Make sure buffer addresses are sector-aligned. */
 	blk_queue_dma_alignment(rq, 511);
@@ -455,12 +689,14 @@ static int xlvbd_init_blk_queue(struct gendisk *gd, u16 sector_size)
 static void xlvbd_flush(struct blkfront_info *info)
 {
 	blk_queue_flush(info->rq, info->feature_flush);
-	printk(KERN_INFO "blkfront: %s: %s: %s\n",
+	printk(KERN_INFO "blkfront: %s: %s: %s; persistent grants: %s; indirect descriptors: %s\n",
 	       info->gd->disk_name,
 	       info->flush_op == BLKIF_OP_WRITE_BARRIER ?
 		"barrier" : (info->flush_op == BLKIF_OP_FLUSH_DISKCACHE ?
 		"flush diskcache" : "barrier or flush"),
-	       info->feature_flush ? "enabled" : "disabled");
+	       info->feature_flush ? "enabled" : "disabled",
+	       info->feature_persistent ? "enabled" : "disabled",
+	       info->max_indirect_segments ? "enabled" : "disabled");
 }
 
 static int xen_translate_vdev(int vdevice, int *minor, unsigned int *offset)
@@ -676,6 +912,81 @@ static void blkif_restart_queue(struct work_struct *work)
 	spin_unlock_irq(&blkif_io_lock);
 }
 
+/*
+ * Release the pool along with the pages of the requests still in flight,
+ * and the per-request arrays.
+ */
+static void blkif_free_grants(struct blkfront_info *info)
+{
+	struct grant *gnt, *n;
+	struct blk_shadow *s;
+	unsigned int nseg;
+	int i, j;
+
+	list_for_each_entry_safe(gnt, n, &info->grants, node) {
+		list_del(&gnt->node);
+		free_grant(gnt);
+	}
+	info->persistent_gnts_c = 0;
+	info->free_gnts_c = 0;
+
+	for (i = 0; i < blkif_ring_size(info); i++) {
+		s = &info->shadow[i];
+		if (s->request && s->grants_used) {
+			nseg = blkif_shadow_nr_segments(s);
+			for (j = 0; j < nseg; j++)
+				free_grant(s->grants_used[j]);
+			if (s->req.operation == BLKIF_OP_INDIRECT)
+				for (j = 0; j < INDIRECT_GREFS(nseg); j++)
+					free_grant(s->indirect_grants[j]);
+		}
+		kfree(s->grants_used);
+		s->grants_used = NULL;
+		kfree(s->indirect_grants);
+		s->indirect_grants = NULL;
+		kfree(s->sg);
+		s->sg = NULL;
+	}
+}
+
+/*
+ * Allocate the per-request arrays for the largest request we will issue,
+ * and enough pages in the pool for one of those.
+ */
+static int blkfront_setup_indirect(struct blkfront_info *info)
+{
+	unsigned int segs = info->max_indirect_segments ? :
+			    BLKIF_MAX_SEGMENTS_PER_REQUEST;
+	struct blk_shadow *s;
+	int i;
+
+	for (i = 0; i < blkif_ring_size(info); i++) {
+		s = &info->shadow[i];
+		s->sg = kzalloc(sizeof(s->sg[0]) * segs, GFP_NOIO);
+		s->grants_used = kzalloc(sizeof(s->grants_used[0]) * segs,
+					 GFP_NOIO);
+		if (!s->sg || !s->grants_used)
+			goto out_of_memory;
+		if (info->max_indirect_segments) {
+			s->indirect_grants = kzalloc(
+				sizeof(s->indirect_grants[0]) *
+				INDIRECT_GREFS(segs), GFP_NOIO);
+			if (!s->indirect_grants)
+				goto out_of_memory;
+		}
+		sg_init_table(s->sg, segs);
+	}
+
+	if (fill_grant_buffer(info, blkif_nr_grefs(segs), GFP_NOIO))
+		goto out_of_memory;
+
+	return 0;
+
+out_of_memory:
+	blkif_free_grants(info);
+	return -ENOMEM;
+}
+
 static void blkif_free(struct blkfront_info *info, int suspend)
 {
 	int i;
@@ -712,13 +1023,44 @@ static void blkif_free(struct blkfront_info *info, int suspend)
 		unbind_from_irqhandler(info->irq, info);
 	info->evtchn = info->irq = 0;
 
+	/* Requests in flight keep their pages to be reissued on resume. */
+	if (!suspend)
+		blkif_free_grants(info);
 }
 
-static void blkif_completion(struct blk_shadow *s)
+static void blkif_completion(struct blk_shadow *s, struct blkfront_info *info)
 {
+	struct scatterlist *sg;
+	char *bvec_data;
+	void *shared_data;
+	unsigned int nseg;
 	int i;
-	for (i = 0; i < s->req.nr_segments; i++)
-		gnttab_end_foreign_access(s->req.u.rw.seg[i].gref, 0, 0UL);
+
+	nseg = blkif_shadow_nr_segments(s);
+
+	if (s->req.operation == BLKIF_OP_READ ||
+	    (s->req.operation == BLKIF_OP_INDIRECT &&
+	     s->req.u.indirect.indirect_op == BLKIF_OP_READ)) {
+		/* Copy the data received from the backend into the bvec. */
+		for_each_sg(s->sg, sg, nseg, i) {
+			BUG_ON(sg->offset + sg->length > PAGE_SIZE);
+			shared_data = kmap_atomic(
+				pfn_to_page(s->grants_used[i]->pfn));
+			bvec_data = kmap_atomic(sg_page(sg));
+			memcpy(bvec_data   + sg->offset,
+			       shared_data + sg->offset,
+			       sg->length);
+			kunmap_atomic(bvec_data);
+			kunmap_atomic(shared_data);
+		}
+	}
+
+	/* The grants stay in place for the next request to use. */
+	for (i = 0; i < nseg; i++)
+		put_grant(s->grants_used[i], info);
+	if (s->req.operation == BLKIF_OP_INDIRECT)
+		for (i = 0; i < INDIRECT_GREFS(nseg); i++)
+			put_grant(s->indirect_grants[i], info);
 }
 
 static irqreturn_t blkif_interrupt(int irq, void *dev_id)
@@ -748,7 +1090,7 @@ static irqreturn_t blkif_interrupt(int irq, void *dev_id)
 		id   = bret->id;
 		req  = info->shadow[id].request;
 
-		blkif_completion(&info->shadow[id]);
+		blkif_completion(&info->shadow[id], info);
 
 		add_id_to_freelist(info, id);
 
@@ -775,7 +1117,7 @@ static irqreturn_t blkif_interrupt(int irq, void *dev_id)
 				error = -EOPNOTSUPP;
 			}
 			if (unlikely(bret->status == BLKIF_RSP_ERROR &&
-				     info->shadow[id].req.nr_segments == 0)) {
+				     info->shadow[id].req.u.rw.nr_segments == 0)) {
 				printk(KERN_WARNING "blkfront: %s: empty write %s op failed\n",
 				       info->flush_op == BLKIF_OP_WRITE_BARRIER ?
 				       "barrier" :  "flush disk cache",
@@ -936,6 +1278,11 @@ again:
 		message = "writing protocol";
 		goto abort_transaction;
 	}
+	err = xenbus_printf(xbt, dev->nodename,
+			    "feature-persistent", "%u", 1);
+	if (err)
+		dev_warn(&dev->dev,
+			 "writing persistent grants feature to xenbus");
 
 	err = xenbus_transaction_end(xbt, 0);
 	if (err) {
@@ -1029,14 +1376,14 @@ static int blkfront_probe(struct xenbus_device *dev,
 	info->vdevice = vdevice;
 	info->connected = BLKIF_STATE_DISCONNECTED;
 	INIT_WORK(&info->work, blkif_restart_queue);
+	INIT_LIST_HEAD(&info->grants);
 
 	info->num_ring_pages = min(max_ring_pages, BLKIF_MAX_NUM_RING_PAGES);
 
-	ring_size = __RING_SIZE((struct blkif_sring *)0,
-				info->num_ring_pages * PAGE_SIZE);
+	ring_size = blkif_ring_size(info);
 	for (i = 0; i < ring_size; i++)
-		info->shadow[i].req.id = i+1;
-	info->shadow[ring_size-1].req.id = 0x0fffffff;
+		info->shadow[i].req.u.rw.id = i+1;
+	info->shadow[ring_size-1].req.u.rw.id = 0x0fffffff;
 
 	/* Front end dir is a number, which is used as the id. */
 	info->handle = simple_strtoul(strrchr(dev->nodename, '/')+1, NULL, 0);
@@ -1056,56 +1403,64 @@ static int blkfront_probe(struct xenbus_device *dev,
 }
 
 
+static void blkif_regrant(struct grant *gnt, struct blkfront_info *info)
+{
+	gnttab_grant_foreign_access_ref(gnt->gref, info->xbdev->otherend_id,
+					pfn_to_mfn(gnt->pfn), 0);
+}
+
 static int blkif_recover(struct blkfront_info *info)
 {
-	int i;
+	int i, j;
 	struct blkif_request *req;
-	struct blk_shadow *copy;
-	int j;
-	int ring_size = __RING_SIZE((struct blkif_sring *)0, info->num_ring_pages * PAGE_SIZE);
-
-	/* Stage 1: Make a safe copy of the shadow state. */
-	copy = kmalloc(sizeof(info->shadow),
-		       GFP_NOIO | __GFP_REPEAT | __GFP_HIGH);
-	if (!copy)
-		return -ENOMEM;
-	memcpy(copy, info->shadow, sizeof(info->shadow));
+	struct blk_shadow *s;
+	struct grant *gnt;
+	unsigned int nseg;
+	int ring_size = blkif_ring_size(info);
 
-	/* Stage 2: Set up free list. */
-	memset(&info->shadow, 0, sizeof(info->shadow));
-	for (i = 0; i < ring_size; i++)
-		info->shadow[i].req.id = i+1;
-	info->shadow_free = info->ring.req_prod_pvt;
-	info->shadow[ring_size-1].req.id = 0x0fffffff;
+	/*
+	 * Stage 1: The grant references survive, but must point at our new
+	 * frame numbers.  Those of the free pool are done here, those of the
+	 * requests in flight as they are requeued.
+	 */
+	list_for_each_entry(gnt, &info->grants, node)
+		if (gnt->gref != GRANT_INVALID_REF)
+			blkif_regrant(gnt, info);
+
+	/*
+	 * Stage 2: Rebuild the free list from the unused slots.  Requests in
+	 * flight keep their id, and with it the pages they hold.
+	 */
+	info->shadow_free = 0x0fffffff;
+	for (i = ring_size - 1; i >= 0; i--) {
+		if (info->shadow[i].request)
+			continue;
+		info->shadow[i].req.u.rw.id = info->shadow_free;
+		info->shadow_free = i;
+	}
 
 	/* Stage 3: Find pending requests and requeue them. */
 	for (i = 0; i < ring_size; i++) {
+		s = &info->shadow[i];
 		/* Not in use? */
-		if (!copy[i].request)
+		if (!s->request)
 			continue;
 
 		/* Grab a request slot and copy shadow state into it. */
 		req = RING_GET_REQUEST(&info->ring, info->ring.req_prod_pvt);
-		*req = copy[i].req;
-
-		/* We get a new request id, and must reset the shadow state. */
-		req->id = get_id_from_freelist(info);
-		memcpy(&info->shadow[req->id], &copy[i], sizeof(copy[i]));
+		*req = s->req;
 
 		/* Rewrite any grant references invalidated by susp/resume. */
-		for (j = 0; j < req->nr_segments; j++)
-			gnttab_grant_foreign_access_ref(
-				req->u.rw.seg[j].gref,
-				info->xbdev->otherend_id,
-				pfn_to_mfn(info->shadow[req->id].frame[j]),
-				rq_data_dir(info->shadow[req->id].request));
-		info->shadow[req->id].req = *req;
+		nseg = blkif_shadow_nr_segments(s);
+		for (j = 0; j < nseg; j++)
+			blkif_regrant(s->grants_used[j], info);
+		if (req->operation == BLKIF_OP_INDIRECT)
+			for (j = 0; j < INDIRECT_GREFS(nseg); j++)
+				blkif_regrant(s->indirect_grants[j], info);
 
 		info->ring.req_prod_pvt++;
 	}
 
-	kfree(copy);
-
 	xenbus_switch_state(info->xbdev, XenbusStateConnected);
 
 	spin_lock_irq(&blkif_io_lock);
@@ -1222,6 +1577,7 @@ static void blkfront_connect(struct blkfront_info *info)
 	unsigned int binfo;
 	int err;
 	int barrier, flush, discard;
+	unsigned int persistent, indirect_segments;
 
 	switch (info->connected) {
 	case BLKIF_STATE_CONNECTED:
@@ -1299,6 +1655,35 @@ static void blkfront_connect(struct blkfront_info *info)
 	if (!err && discard)
 		blkfront_setup_discard(info);
 
+	err = xenbus_gather(XBT_NIL, info->xbdev->otherend,
+			    "feature-persistent", "%u", &persistent,
+			    NULL);
+	info->feature_persistent = !err && persistent;
+
+	/*
+	 * Requests carrying a barrier cannot be indirect, so only use them
+	 * with backends that flush.
+	 */
+	info->max_indirect_segments = 0;
+	err = xenbus_gather(XBT_NIL, info->xbdev->otherend,
+			    "feature-max-indirect-segments", "%u", &indirect_segments,
+			    NULL);
+	if (!err && info->flush_op != BLKIF_OP_WRITE_BARRIER) {
+		indirect_segments = min3(indirect_segments,
+					 xen_blkif_max_segments,
+					 (unsigned int)(SEGS_PER_INDIRECT_FRAME *
+					 BLKIF_MAX_INDIRECT_PAGES_PER_REQUEST));
+		if (indirect_segments > BLKIF_MAX_SEGMENTS_PER_REQUEST)
+			info->max_indirect_segments = indirect_segments;
+	}
+
+	err = blkfront_setup_indirect(info);
+	if (err) {
+		xenbus_dev_fatal(info->xbdev, err, "setup_indirect at %s",
+				 info->xbdev->otherend);
+		return;
+	}
+
 	err = xlvbd_alloc_gendisk(sectors, info, binfo, sector_size);
 	if (err) {
 		xenbus_dev_fatal(info->xbdev, err, "xlvbd_add at %s",
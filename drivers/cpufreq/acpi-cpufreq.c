@@ -371,6 +371,38 @@ out:
 	return result;
 }
 
+/*
+ * Write PERF_CTL on the local cpu only.  Used from scheduler context when
+ * the local cpu setting the P-state is enough for the whole policy, see
+ * acpi_cpufreq_cpu_init().
+ */
+static unsigned int acpi_cpufreq_fast_switch(struct cpufreq_policy *policy,
+					     unsigned int target_freq)
+{
+	struct acpi_cpufreq_data *data = per_cpu(acfreq_data, policy->cpu);
+	struct acpi_processor_performance *perf = data->acpi_data;
+	unsigned int next_state, next_perf_state;
+	struct drv_cmd cmd;
+
+	if (cpufreq_frequency_table_target(policy, data->freq_table,
+					   target_freq, CPUFREQ_RELATION_L,
+					   &next_state))
+		return 0;
+
+	next_perf_state = data->freq_table[next_state].index;
+	if (perf->state == next_perf_state && !data->resume)
+		return data->freq_table[next_state].frequency;
+
+	cmd.type = SYSTEM_INTEL_MSR_CAPABLE;
+	cmd.addr.msr.reg = MSR_IA32_PERF_CTL;
+	cmd.val = (u32) perf->states[next_perf_state].control;
+	do_drv_write(&cmd);
+
+	data->resume = 0;
+	perf->state = next_perf_state;
+	return data->freq_table[next_state].frequency;
+}
+
 static int acpi_cpufreq_verify(struct cpufreq_policy *policy)
 {
 	struct acpi_cpufreq_data *data = per_cpu(acfreq_data, policy->cpu);
@@ -651,6 +683,16 @@ static int acpi_cpufreq_cpu_init(struct cpufreq_policy *policy)
 		break;
 	}
 
+	/*
+	 * A PERF_CTL write on any one cpu of the policy sets the P-state for
+	 * all of them unless software has to coordinate (SHARED_TYPE_ALL).
+	 */
+	policy->fast_switch_possible =
+		data->cpu_feature == SYSTEM_INTEL_MSR_CAPABLE &&
+		!acpi_pstate_strict &&
+		!(cpumask_weight(policy->cpus) > 1 &&
+		  policy->shared_type != CPUFREQ_SHARED_TYPE_ANY);
+
 	/* notify BIOS that we exist */
 	acpi_processor_notify_smm(THIS_MODULE);
 
@@ -724,6 +766,7 @@ static struct freq_attr *acpi_cpufreq_attr[] = {
 static struct cpufreq_driver acpi_cpufreq_driver = {
 	.verify		= acpi_cpufreq_verify,
 	.target		= acpi_cpufreq_target,
+	.fast_switch	= acpi_cpufreq_fast_switch,
 	.bios_limit	= acpi_processor_get_bios_limit,
 	.init		= acpi_cpufreq_cpu_init,
 	.exit		= acpi_cpufreq_cpu_exit,
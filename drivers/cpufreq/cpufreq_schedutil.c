@@ -0,0 +1,399 @@
+/*
+ *  drivers/cpufreq/cpufreq_schedutil.c
+ *
+ *  CPU frequency selection driven by the scheduler.
+ *
+ *  Instead of sampling idle time from a timer like ondemand, this governor
+ *  is called by the scheduler whenever the number of runnable tasks on a
+ *  cpu changes and on every tick (see struct update_util_data).  The share
+ *  of time a cpu had runnable tasks since the last evaluation decides the
+ *  next frequency; while realtime or deadline tasks are queued the policy
+ *  goes to its maximum right away.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/cpufreq.h>
+#include <linux/irq_work.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/tick.h>
+
+/* Default rate limit is this many times the transition latency */
+#define LATENCY_MULTIPLIER			(1000)
+#define TRANSITION_LATENCY_LIMIT		(10 * 1000 * 1000)
+
+/* Utilization is a fraction of SUGOV_UTIL_SCALE */
+#define SUGOV_UTIL_SHIFT			10
+#define SUGOV_UTIL_SCALE			(1UL << SUGOV_UTIL_SHIFT)
+
+struct sugov_policy {
+	struct cpufreq_policy *policy;
+
+	/* Serializes the update hooks of the cpus sharing the policy */
+	raw_spinlock_t update_lock;
+	u64 last_freq_update_time;
+	unsigned int next_freq;
+
+	/* Frequency changes that cannot be done from scheduler context */
+	struct irq_work irq_work;
+	struct kthread_work work;
+	struct kthread_worker worker;
+	struct task_struct *thread;
+	struct mutex work_lock;
+	bool work_in_progress;
+};
+
+struct sugov_cpu {
+	struct update_util_data update_util;
+	struct sugov_policy *sg_policy;
+
+	/* rq clock and busy time at the start of the current window */
+	u64 window_start;
+	u64 window_busy;
+	/* busy share of the last full window */
+	unsigned long util;
+	u64 last_update;
+	unsigned int flags;
+};
+
+static DEFINE_PER_CPU(struct sugov_cpu, sugov_cpu);
+
+static int cpufreq_governor_schedutil(struct cpufreq_policy *policy,
+				      unsigned int event);
+
+#ifndef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL
+static
+#endif
+struct cpufreq_governor cpufreq_gov_schedutil = {
+	.name			= "schedutil",
+	.governor		= cpufreq_governor_schedutil,
+	.max_transition_latency	= TRANSITION_LATENCY_LIMIT,
+	.owner			= THIS_MODULE,
+};
+
+static unsigned int sugov_enable;	/* number of policies using us */
+
+/* sugov_mutex protects sugov_enable in governor start/stop */
+static DEFINE_MUTEX(sugov_mutex);
+
+static struct sugov_tuners {
+	unsigned int rate_limit_us;
+} sugov_tuners_ins;
+
+static inline s64 sugov_delay_ns(void)
+{
+	return (s64)ACCESS_ONCE(sugov_tuners_ins.rate_limit_us) *
+		NSEC_PER_USEC;
+}
+
+/************************** sysfs interface ************************/
+
+static ssize_t show_rate_limit_us(struct kobject *kobj,
+				  struct attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", sugov_tuners_ins.rate_limit_us);
+}
+
+static ssize_t store_rate_limit_us(struct kobject *a, struct attribute *b,
+				   const char *buf, size_t count)
+{
+	unsigned int input;
+	int ret;
+
+	ret = sscanf(buf, "%u", &input);
+	if (ret != 1)
+		return -EINVAL;
+	sugov_tuners_ins.rate_limit_us = input;
+	return count;
+}
+
+define_one_global_rw(rate_limit_us);
+
+static struct attribute *sugov_attributes[] = {
+	&rate_limit_us.attr,
+	NULL
+};
+
+static struct attribute_group sugov_attr_group = {
+	.attrs = sugov_attributes,
+	.name = "schedutil",
+};
+
+/************************** sysfs end ************************/
+
+static bool sugov_should_update_freq(struct sugov_policy *sg_policy,
+				     u64 time, unsigned int flags)
+{
+	if (sg_policy->work_in_progress)
+		return false;
+
+	/* Don't make an RT task wait for the rate limit */
+	if ((flags & SCHED_CPUFREQ_RT) &&
+	    sg_policy->policy->cur != sg_policy->policy->max)
+		return true;
+
+	return (s64)(time - sg_policy->last_freq_update_time) >=
+		sugov_delay_ns();
+}
+
+/*
+ * The busy share was measured at the current frequency, so aim for the
+ * frequency at which it would be 80%: 1.25 * cur * util.
+ */
+static unsigned int sugov_next_freq(struct sugov_policy *sg_policy, u64 time)
+{
+	struct cpufreq_policy *policy = sg_policy->policy;
+	s64 stale_ns = sugov_delay_ns() + TICK_NSEC;
+	unsigned long util = 0;
+	unsigned int j;
+	u64 freq;
+
+	for_each_cpu(j, policy->cpus) {
+		struct sugov_cpu *j_sg_cpu = &per_cpu(sugov_cpu, j);
+
+		if (j_sg_cpu->flags & SCHED_CPUFREQ_RT)
+			return policy->max;
+
+		/* Not called for a while: the cpu is idle with the tick off */
+		if ((s64)(time - j_sg_cpu->last_update) > stale_ns)
+			continue;
+
+		util = max(util, j_sg_cpu->util);
+	}
+
+	freq = policy->cur + (policy->cur >> 2);
+	freq = (freq * util) >> SUGOV_UTIL_SHIFT;
+
+	return clamp_val(freq, policy->min, policy->max);
+}
+
+static void sugov_update_window(struct sugov_cpu *sg_cpu, u64 time,
+				u64 busy_time)
+{
+	u64 delta = time - sg_cpu->window_start;
+
+	if (!sg_cpu->window_start)
+		goto new_window;
+
+	if ((s64)delta < sugov_delay_ns() || !delta)
+		return;
+
+	sg_cpu->util = div64_u64((busy_time - sg_cpu->window_busy) <<
+				 SUGOV_UTIL_SHIFT, delta);
+	sg_cpu->util = min(sg_cpu->util, SUGOV_UTIL_SCALE);
+
+new_window:
+	sg_cpu->window_start = time;
+	sg_cpu->window_busy = busy_time;
+}
+
+static void sugov_update(struct update_util_data *data, u64 time,
+			 u64 busy_time, unsigned int flags)
+{
+	struct sugov_cpu *sg_cpu = container_of(data, struct sugov_cpu,
+						update_util);
+	struct sugov_policy *sg_policy = sg_cpu->sg_policy;
+	struct cpufreq_policy *policy = sg_policy->policy;
+	unsigned int next_f;
+
+	raw_spin_lock(&sg_policy->update_lock);
+
+	sugov_update_window(sg_cpu, time, busy_time);
+	sg_cpu->flags = flags;
+	sg_cpu->last_update = time;
+
+	if (!sugov_should_update_freq(sg_policy, time, flags))
+		goto unlock;
+
+	sg_policy->last_freq_update_time = time;
+	next_f = sugov_next_freq(sg_policy, time);
+	if (next_f == policy->cur)
+		goto unlock;
+
+	/*
+	 * The hook also runs for remote rqs on wakeup; only a cpu of the
+	 * policy can switch the frequency directly.
+	 */
+	if (policy->fast_switch_enabled &&
+	    cpumask_test_cpu(smp_processor_id(), policy->cpus)) {
+		cpufreq_driver_fast_switch(policy, next_f);
+	} else {
+		sg_policy->next_freq = next_f;
+		sg_policy->work_in_progress = true;
+		irq_work_queue(&sg_policy->irq_work);
+	}
+unlock:
+	raw_spin_unlock(&sg_policy->update_lock);
+}
+
+static void sugov_work(struct kthread_work *work)
+{
+	struct sugov_policy *sg_policy = container_of(work, struct sugov_policy,
+						      work);
+
+	mutex_lock(&sg_policy->work_lock);
+	__cpufreq_driver_target(sg_policy->policy, sg_policy->next_freq,
+				CPUFREQ_RELATION_L);
+	mutex_unlock(&sg_policy->work_lock);
+
+	sg_policy->work_in_progress = false;
+}
+
+static void sugov_irq_work(struct irq_work *irq_work)
+{
+	struct sugov_policy *sg_policy = container_of(irq_work,
+						      struct sugov_policy,
+						      irq_work);
+
+	queue_kthread_work(&sg_policy->worker, &sg_policy->work);
+}
+
+static int sugov_start(struct cpufreq_policy *policy)
+{
+	struct sched_param param = { .sched_priority = MAX_USER_RT_PRIO / 2 };
+	struct sugov_policy *sg_policy;
+	struct task_struct *thread;
+	unsigned int j;
+
+	sg_policy = kzalloc(sizeof(*sg_policy), GFP_KERNEL);
+	if (!sg_policy)
+		return -ENOMEM;
+
+	sg_policy->policy = policy;
+	raw_spin_lock_init(&sg_policy->update_lock);
+	mutex_init(&sg_policy->work_lock);
+	init_irq_work(&sg_policy->irq_work, sugov_irq_work);
+	init_kthread_worker(&sg_policy->worker);
+	init_kthread_work(&sg_policy->work, sugov_work);
+
+	/* RT so that it is not starved by the tasks that asked for speed */
+	thread = kthread_create(kthread_worker_fn, &sg_policy->worker,
+				"sugov:%u", policy->cpu);
+	if (IS_ERR(thread)) {
+		kfree(sg_policy);
+		return PTR_ERR(thread);
+	}
+	sched_setscheduler_nocheck(thread, SCHED_FIFO, &param);
+	sg_policy->thread = thread;
+	wake_up_process(thread);
+
+	cpufreq_enable_fast_switch(policy);
+
+	for_each_cpu(j, policy->cpus) {
+		struct sugov_cpu *j_sg_cpu = &per_cpu(sugov_cpu, j);
+
+		memset(j_sg_cpu, 0, sizeof(*j_sg_cpu));
+		j_sg_cpu->sg_policy = sg_policy;
+		cpufreq_add_update_util_hook(j, &j_sg_cpu->update_util,
+					     sugov_update);
+	}
+	/* found again by sugov_stop() and sugov_limits() */
+	per_cpu(sugov_cpu, policy->cpu).sg_policy = sg_policy;
+	return 0;
+}
+
+static void sugov_stop(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = per_cpu(sugov_cpu, policy->cpu).sg_policy;
+	unsigned int j;
+
+	for_each_cpu(j, policy->related_cpus)
+		cpufreq_remove_update_util_hook(j);
+
+	/* Wait for the hooks to finish, then for the work they queued */
+	synchronize_sched();
+	irq_work_sync(&sg_policy->irq_work);
+	flush_kthread_work(&sg_policy->work);
+	kthread_stop(sg_policy->thread);
+
+	cpufreq_disable_fast_switch(policy);
+	mutex_destroy(&sg_policy->work_lock);
+	kfree(sg_policy);
+}
+
+static void sugov_limits(struct cpufreq_policy *policy)
+{
+	struct sugov_policy *sg_policy = per_cpu(sugov_cpu, policy->cpu).sg_policy;
+
+	mutex_lock(&sg_policy->work_lock);
+	if (policy->max < policy->cur)
+		__cpufreq_driver_target(policy, policy->max, CPUFREQ_RELATION_H);
+	else if (policy->min > policy->cur)
+		__cpufreq_driver_target(policy, policy->min, CPUFREQ_RELATION_L);
+	mutex_unlock(&sg_policy->work_lock);
+}
+
+static int cpufreq_governor_schedutil(struct cpufreq_policy *policy,
+				      unsigned int event)
+{
+	unsigned int latency;
+	int rc = 0;
+
+	switch (event) {
+	case CPUFREQ_GOV_START:
+		if (!cpu_online(policy->cpu) || !policy->cur)
+			return -EINVAL;
+
+		mutex_lock(&sugov_mutex);
+		if (!sugov_enable) {
+			rc = sysfs_create_group(cpufreq_global_kobject,
+						&sugov_attr_group);
+			if (rc)
+				goto out;
+
+			/* policy latency is in nS. Convert it to uS first */
+			latency = policy->cpuinfo.transition_latency / 1000;
+			if (latency == 0)
+				latency = 1;
+			sugov_tuners_ins.rate_limit_us =
+				latency * LATENCY_MULTIPLIER;
+		}
+
+		rc = sugov_start(policy);
+		if (rc) {
+			if (!sugov_enable)
+				sysfs_remove_group(cpufreq_global_kobject,
+						   &sugov_attr_group);
+			goto out;
+		}
+		sugov_enable++;
+out:
+		mutex_unlock(&sugov_mutex);
+		break;
+
+	case CPUFREQ_GOV_STOP:
+		sugov_stop(policy);
+
+		mutex_lock(&sugov_mutex);
+		sugov_enable--;
+		if (!sugov_enable)
+			sysfs_remove_group(cpufreq_global_kobject,
+					   &sugov_attr_group);
+		mutex_unlock(&sugov_mutex);
+		break;
+
+	case CPUFREQ_GOV_LIMITS:
+		sugov_limits(policy);
+		break;
+	}
+	return rc;
+}
+
+static int __init cpufreq_gov_schedutil_init(void)
+{
+	return cpufreq_register_governor(&cpufreq_gov_schedutil);
+}
+
+#ifdef CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL
+fs_initcall(cpufreq_gov_schedutil_init);
+#else
+module_init(cpufreq_gov_schedutil_init);
+#endif
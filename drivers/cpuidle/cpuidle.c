@@ -17,12 +17,14 @@
 #include <linux/cpuidle.h>
 #include <linux/ktime.h>
 #include <linux/hrtimer.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <trace/events/power.h>
 
 #include "cpuidle.h"
 
 DEFINE_PER_CPU(struct cpuidle_device *, cpuidle_devices);
+DEFINE_PER_CPU(struct cpuidle_irq_history, cpuidle_irq_history);
 
 DEFINE_MUTEX(cpuidle_lock);
 LIST_HEAD(cpuidle_detected_devices);
@@ -366,6 +368,26 @@ void cpuidle_unregister_device(struct cpuidle_device *dev)
 
 EXPORT_SYMBOL_GPL(cpuidle_unregister_device);
 
+/* Intervals this long say nothing about when the next interrupt comes */
+#define CPUIDLE_IRQ_INTERVAL_MAX	(50 * USEC_PER_MSEC)
+
+/**
+ * cpuidle_note_irq - records the arrival of a device interrupt
+ *
+ * Called from the interrupt handling core, with interrupts disabled.
+ */
+void cpuidle_note_irq(void)
+{
+	struct cpuidle_irq_history *h = &__get_cpu_var(cpuidle_irq_history);
+	u64 now = local_clock();
+	u64 interval = div_u64(now - h->last_ns, NSEC_PER_USEC);
+
+	h->last_ns = now;
+	h->intervals[h->ptr++] = min_t(u64, interval, CPUIDLE_IRQ_INTERVAL_MAX);
+	if (h->ptr >= CPUIDLE_IRQ_INTERVALS)
+		h->ptr = 0;
+}
+
 #ifdef CONFIG_SMP
 
 static void smp_callback(void *v)
@@ -390,9 +412,14 @@ static struct notifier_block cpuidle_latency_notifier = {
 	.notifier_call = cpuidle_latency_notify,
 };
 
+static struct notifier_block cpuidle_cpu_latency_notifier = {
+	.notifier_call = cpuidle_latency_notify,
+};
+
 static inline void latency_notifier_init(struct notifier_block *n)
 {
 	pm_qos_add_notifier(PM_QOS_CPU_DMA_LATENCY, n);
+	cpu_pm_qos_add_notifier(&cpuidle_cpu_latency_notifier);
 }
 
 #else /* CONFIG_SMP */
@@ -22,7 +22,7 @@
 #include <linux/module.h>
 
 #define BUCKETS 12
-#define INTERVALS 8
+#define INTERVALS CPUIDLE_IRQ_INTERVALS
 #define RESOLUTION 1024
 #define DECAY 8
 #define MAX_INTERESTING 50000
@@ -192,12 +192,12 @@ static u64 div_round64(u64 dividend, u32 divisor)
 }
 
 /*
- * Try detecting repeating patterns by keeping track of the last 8
- * intervals, and checking if the standard deviation of that set
- * of points is below a threshold. If it is... then use the
- * average of these 8 points as the estimated value.
+ * Return the average of the last 8 @intervals if their standard
+ * deviation is below a threshold and the average is not beyond the
+ * known next timer event; 0 otherwise.
  */
-static void detect_repeating_patterns(struct menu_device *data)
+static uint64_t repeating_interval(struct menu_device *data,
+				   const u32 *intervals)
 {
 	int i;
 	uint64_t avg = 0;
@@ -205,16 +205,15 @@ static void detect_repeating_patterns(struct menu_device *data)
 
 	/* first calculate average and standard deviation of the past */
 	for (i = 0; i < INTERVALS; i++)
-		avg += data->intervals[i];
+		avg += intervals[i];
 	avg = avg / INTERVALS;
 
 	/* if the avg is beyond the known next tick, it's worthless */
 	if (avg > data->expected_us)
-		return;
+		return 0;
 
 	for (i = 0; i < INTERVALS; i++)
-		stddev += (data->intervals[i] - avg) *
-			  (data->intervals[i] - avg);
+		stddev += (intervals[i] - avg) * (intervals[i] - avg);
 
 	stddev = stddev / INTERVALS;
 
@@ -222,9 +221,36 @@ static void detect_repeating_patterns(struct menu_device *data)
 	 * now.. if stddev is small.. then assume we have a
 	 * repeating pattern and predict we keep doing this.
 	 */
+	return stddev < STDDEV_THRESH ? avg : 0;
+}
 
-	if (avg && stddev < STDDEV_THRESH)
+/*
+ * Try detecting repeating patterns by keeping track of the last 8
+ * intervals, and checking if the standard deviation of that set
+ * of points is below a threshold. If it is... then use the
+ * average of these 8 points as the estimated value.
+ *
+ * The same is done for the intervals between the device interrupts
+ * of this cpu, which wake it up without a timer telling us in
+ * advance: if they are regular, the next one is due one average
+ * interval after the last one.
+ */
+static void detect_repeating_patterns(struct menu_device *data)
+{
+	struct cpuidle_irq_history *irqs = &__get_cpu_var(cpuidle_irq_history);
+	uint64_t avg, since;
+
+	avg = repeating_interval(data, data->intervals);
+	if (avg)
 		data->predicted_us = avg;
+
+	avg = repeating_interval(data, irqs->intervals);
+	if (!avg)
+		return;
+
+	since = div_u64(local_clock() - irqs->last_ns, NSEC_PER_USEC);
+	if (avg > since && avg - since < data->predicted_us)
+		data->predicted_us = avg - since;
 }
 
 /**
@@ -235,7 +261,8 @@ static void detect_repeating_patterns(struct menu_device *data)
 static int menu_select(struct cpuidle_driver *drv, struct cpuidle_device *dev)
 {
 	struct menu_device *data = &__get_cpu_var(menu_devices);
-	int latency_req = pm_qos_request(PM_QOS_CPU_DMA_LATENCY);
+	int latency_req = min(pm_qos_request(PM_QOS_CPU_DMA_LATENCY),
+			      cpu_pm_qos_read_value(dev->cpu));
 	unsigned int power_usage = -1;
 	int i;
 	int multiplier;
@@ -2657,6 +2657,64 @@ out:
 	return ret;
 }
 
+/*
+ * Sleep until the vblank before the one @page_flip targets.  Drivers
+ * latch a flip at the first vblank after it is queued, so queueing it
+ * then makes it complete on the target.
+ */
+static int drm_mode_page_flip_wait(struct drm_device *dev,
+				   struct drm_mode_crtc_page_flip *page_flip)
+{
+	struct drm_mode_object *obj;
+	struct drm_crtc *crtc;
+	unsigned int pipe = 0;
+	u32 seq, target;
+	int ret;
+
+	mutex_lock(&dev->mode_config.mutex);
+	obj = drm_mode_object_find(dev, page_flip->crtc_id, DRM_MODE_OBJECT_CRTC);
+	if (obj) {
+		list_for_each_entry(crtc, &dev->mode_config.crtc_list, head) {
+			if (crtc == obj_to_crtc(obj))
+				break;
+			pipe++;
+		}
+	}
+	mutex_unlock(&dev->mode_config.mutex);
+	if (!obj || pipe >= dev->num_crtcs)
+		return -EINVAL;
+
+	ret = drm_vblank_get(dev, pipe);
+	if (ret)
+		return ret;
+
+	seq = drm_vblank_count(dev, pipe);
+	target = page_flip->reserved;
+	if (page_flip->flags & DRM_MODE_PAGE_FLIP_TARGET_RELATIVE)
+		target += seq;
+	if ((int)(target - seq) <= 0) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	while ((int)(target - 1 - seq) > 0) {
+		DRM_WAIT_ON(ret, dev->vbl_queue[pipe], 3 * DRM_HZ,
+			    drm_vblank_count(dev, pipe) != seq ||
+			    !dev->irq_enabled);
+		if (ret)
+			goto out;
+		if (!dev->irq_enabled) {
+			ret = -EINVAL;
+			goto out;
+		}
+		seq = drm_vblank_count(dev, pipe);
+	}
+
+out:
+	drm_vblank_put(dev, pipe);
+	return ret;
+}
+
 int drm_mode_page_flip_ioctl(struct drm_device *dev,
 			     void *data, struct drm_file *file_priv)
 {
@@ -2668,8 +2726,18 @@ int drm_mode_page_flip_ioctl(struct drm_device *dev,
 	unsigned long flags;
 	int ret = -EINVAL;
 
-	if (page_flip->flags & ~DRM_MODE_PAGE_FLIP_FLAGS ||
-	    page_flip->reserved != 0)
+	if (page_flip->flags & ~DRM_MODE_PAGE_FLIP_FLAGS)
+		return -EINVAL;
+
+	if (page_flip->flags & DRM_MODE_PAGE_FLIP_TARGET) {
+		if ((page_flip->flags & DRM_MODE_PAGE_FLIP_TARGET) ==
+		    DRM_MODE_PAGE_FLIP_TARGET)
+			return -EINVAL;
+		ret = drm_mode_page_flip_wait(dev, page_flip);
+		if (ret)
+			return ret;
+		ret = -EINVAL;
+	} else if (page_flip->reserved != 0)
 		return -EINVAL;
 
 	mutex_lock(&dev->mode_config.mutex);
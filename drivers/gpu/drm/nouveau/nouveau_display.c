@@ -353,8 +353,19 @@ nouveau_finish_page_flip(struct nouveau_channel *chan,
 		struct drm_pending_vblank_event *e = s->event;
 		struct timeval now;
 
-		do_gettimeofday(&now);
-		e->event.sequence = 0;
+		/*
+		 * Flips complete behind a vblank semaphore: while vblank
+		 * interrupts run, report the vblank's own count and
+		 * timestamp rather than when this method got to run.
+		 */
+		if (s->crtc < dev->num_crtcs &&
+		    dev->vblank_enabled[s->crtc]) {
+			e->event.sequence =
+				drm_vblank_count_and_time(dev, s->crtc, &now);
+		} else {
+			do_gettimeofday(&now);
+			e->event.sequence = 0;
+		}
 		e->event.tv_sec = now.tv_sec;
 		e->event.tv_usec = now.tv_usec;
 		list_add_tail(&e->base.link, &e->base.file_priv->event_list);
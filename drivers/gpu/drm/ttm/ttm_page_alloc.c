@@ -29,6 +29,7 @@
  * - Pool collects resently freed pages for reuse
  * - Use page->lru to keep a free list
  * - doesn't track currently in use pages
+ * - one set of pools per NUMA node, pages go back to their node's pool
  */
 #include <linux/list.h>
 #include <linux/spinlock.h>
@@ -54,6 +55,13 @@
 #define FREE_ALL_PAGES			(~0U)
 /* times are in msecs */
 #define PAGE_FREE_INTERVAL		1000
+/*
+ * Pool refills try to get a physically contiguous chunk of this order, so
+ * that changing its caching changes (and splits) as few kernel linear
+ * mapping large pages as possible.
+ */
+#define HUGE_ALLOC_ORDER		min_t(unsigned, PMD_SHIFT - PAGE_SHIFT, \
+					      MAX_ORDER - 1)
 
 /**
  * struct ttm_page_pool - Pool to reuse recently allocated uc/wc pages.
@@ -65,6 +73,7 @@
  * @list: Pool of free uc/wc pages for fast reuse.
  * @gfp_flags: Flags to pass for alloc_page.
  * @npages: Number of pages in pool.
+ * @nid: Node the pages in the pool are on.
  */
 struct ttm_page_pool {
 	spinlock_t		lock;
@@ -72,6 +81,7 @@ struct ttm_page_pool {
 	struct list_head	list;
 	gfp_t			gfp_flags;
 	unsigned		npages;
+	int			nid;
 	char			*name;
 	unsigned long		nfrees;
 	unsigned long		nrefills;
@@ -102,24 +112,24 @@ struct ttm_pool_opts {
  * some pages to free.
  * @small_allocation: Limit in number of pages what is small allocation.
  *
- * @pools: All pool objects in use.
+ * @pools: All pool objects in use, NUM_POOLS for each node.
  **/
 struct ttm_pool_manager {
 	struct kobject		kobj;
 	struct shrinker		mm_shrink;
 	struct ttm_pool_opts	options;
 
-	union {
-		struct ttm_page_pool	pools[NUM_POOLS];
-		struct {
-			struct ttm_page_pool	wc_pool;
-			struct ttm_page_pool	uc_pool;
-			struct ttm_page_pool	wc_pool_dma32;
-			struct ttm_page_pool	uc_pool_dma32;
-		} ;
-	};
+	struct ttm_page_pool	*pools;
 };
 
+/* wc, uc, wc dma32, uc dma32 - see ttm_get_pool() */
+static char *ttm_pool_names[NUM_POOLS] = { "wc", "uc", "wc dma", "uc dma" };
+
+static inline unsigned ttm_nr_pools(void)
+{
+	return NUM_POOLS * nr_node_ids;
+}
+
 static struct attribute ttm_page_pool_max = {
 	.name = "pool_max_size",
 	.mode = S_IRUGO | S_IWUSR
@@ -144,6 +154,7 @@ static void ttm_pool_kobj_release(struct kobject *kobj)
 {
 	struct ttm_pool_manager *m =
 		container_of(kobj, struct ttm_pool_manager, kobj);
+	kfree(m->pools);
 	kfree(m);
 }
 
@@ -254,9 +265,10 @@ static int set_pages_array_uc(struct page **pages, int addrinarray)
 #endif
 
 /**
- * Select the right pool or requested caching state and ttm flags. */
+ * Select the right pool or requested caching state and ttm flags on node
+ * nid. */
 static struct ttm_page_pool *ttm_get_pool(int flags,
-		enum ttm_caching_state cstate)
+		enum ttm_caching_state cstate, int nid)
 {
 	int pool_index;
 
@@ -271,7 +283,7 @@ static struct ttm_page_pool *ttm_get_pool(int flags,
 	if (flags & TTM_PAGE_FLAG_DMA32)
 		pool_index |= 0x2;
 
-	return &_manager->pools[pool_index];
+	return &_manager->pools[nid * NUM_POOLS + pool_index];
 }
 
 /* set memory back to wb and free the pages. */
@@ -386,7 +398,7 @@ static int ttm_pool_get_num_unused_pages(void)
 {
 	unsigned i;
 	int total = 0;
-	for (i = 0; i < NUM_POOLS; ++i)
+	for (i = 0; i < ttm_nr_pools(); ++i)
 		total += _manager->pools[i].npages;
 
 	return total;
@@ -409,13 +421,13 @@ static int ttm_pool_mm_shrink(struct shrinker *shrink,
 		goto out;
 	if (!mutex_trylock(&lock))
 		return -1;
-	pool_offset = ++start_pool % NUM_POOLS;
+	pool_offset = ++start_pool % ttm_nr_pools();
 	/* select start pool in round robin fashion */
-	for (i = 0; i < NUM_POOLS; ++i) {
+	for (i = 0; i < ttm_nr_pools(); ++i) {
 		unsigned nr_free = shrink_pages;
 		if (shrink_pages == 0)
 			break;
-		pool = &_manager->pools[(i + pool_offset)%NUM_POOLS];
+		pool = &_manager->pools[(i + pool_offset) % ttm_nr_pools()];
 		shrink_pages = ttm_page_pool_free(pool, nr_free);
 	}
 	mutex_unlock(&lock);
@@ -491,9 +503,10 @@ static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 	struct page **caching_array;
 	struct page *p;
 	int r = 0;
-	unsigned i, cpages;
+	unsigned i, j, cpages, order;
 	unsigned max_cpages = min(count,
 			(unsigned)(PAGE_SIZE/sizeof(struct page *)));
+	bool try_huge = true;
 
 	/* allocate array for page caching change */
 	caching_array = kmalloc(max_cpages*sizeof(struct page *), GFP_KERNEL);
@@ -504,8 +517,21 @@ static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 		return -ENOMEM;
 	}
 
-	for (i = 0, cpages = 0; i < count; ++i) {
-		p = alloc_page(gfp_flags);
+	for (i = 0, cpages = 0; i < count; ) {
+		p = NULL;
+		order = 0;
+		/* don't dig for contiguous memory, nor keep trying */
+		if (try_huge && count - i >= (1 << HUGE_ALLOC_ORDER)) {
+			p = alloc_pages(gfp_flags | __GFP_NORETRY |
+					__GFP_NOWARN, HUGE_ALLOC_ORDER);
+			if (p) {
+				order = HUGE_ALLOC_ORDER;
+				split_page(p, order);
+			} else
+				try_huge = false;
+		}
+		if (!p)
+			p = alloc_page(gfp_flags);
 
 		if (!p) {
 			printk(KERN_ERR TTM_PFX "Unable to get page %u.\n", i);
@@ -524,29 +550,35 @@ static int ttm_alloc_new_pages(struct list_head *pages, gfp_t gfp_flags,
 			goto out;
 		}
 
+		for (j = 0; j < (1 << order); ++j, ++i, ++p) {
 #ifdef CONFIG_HIGHMEM
-		/* gfp flags of highmem page should never be dma32 so we
-		 * we should be fine in such case
-		 */
-		if (!PageHighMem(p))
+			/* gfp flags of highmem page should never be dma32 so
+			 * we should be fine in such case
+			 */
+			if (!PageHighMem(p))
 #endif
-		{
-			caching_array[cpages++] = p;
-			if (cpages == max_cpages) {
-
-				r = ttm_set_pages_caching(caching_array,
-						cstate, cpages);
-				if (r) {
-					ttm_handle_caching_state_failure(pages,
-						ttm_flags, cstate,
-						caching_array, cpages);
-					goto out;
+			{
+				caching_array[cpages++] = p;
+				if (cpages == max_cpages) {
+
+					r = ttm_set_pages_caching(caching_array,
+							cstate, cpages);
+					if (r) {
+						ttm_handle_caching_state_failure(
+							pages, ttm_flags,
+							cstate, caching_array,
+							cpages);
+						/* and the rest of the chunk */
+						while (++j < (1 << order))
+							__free_page(++p);
+						goto out;
+					}
+					cpages = 0;
 				}
-				cpages = 0;
 			}
-		}
 
-		list_add(&p->lru, pages);
+			list_add(&p->lru, pages);
+		}
 	}
 
 	if (cpages) {
@@ -675,10 +707,11 @@ int ttm_get_pages(struct list_head *pages, int flags,
 		  enum ttm_caching_state cstate, unsigned count,
 		  dma_addr_t *dma_address)
 {
-	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
+	int nid = numa_node_id();
+	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate, nid);
 	struct page *p = NULL;
 	gfp_t gfp_flags = GFP_USER;
-	int r;
+	int r, n;
 
 	/* set zero flag for page allocation if required */
 	if (flags & TTM_PAGE_FLAG_ZERO_ALLOC)
@@ -712,6 +745,19 @@ int ttm_get_pages(struct list_head *pages, int flags,
 	/* First we take pages from the pool */
 	count = ttm_page_pool_get_pages(pool, pages, flags, cstate, count);
 
+	/*
+	 * A remote page with the right caching still beats a new one, which
+	 * needs its caching changed.
+	 */
+	for (n = 0; count > 0 && n < nr_node_ids; ++n) {
+		if (n == nid || !node_online(n))
+			continue;
+		pool = ttm_get_pool(flags, cstate, n);
+		if (pool->npages)
+			count = ttm_page_pool_get_pages(pool, pages, flags,
+							cstate, count);
+	}
+
 	/* clear the pages coming from the pool if requested */
 	if (flags & TTM_PAGE_FLAG_ZERO_ALLOC) {
 		list_for_each_entry(p, pages, lru) {
@@ -743,15 +789,38 @@ int ttm_get_pages(struct list_head *pages, int flags,
 	return 0;
 }
 
+/* Put page_count pages, all from pool's node, into pool */
+static void ttm_page_pool_put_pages(struct ttm_page_pool *pool,
+		struct list_head *pages, unsigned page_count)
+{
+	unsigned long irq_flags;
+
+	spin_lock_irqsave(&pool->lock, irq_flags);
+	list_splice_init(pages, &pool->list);
+	pool->npages += page_count;
+	/* Check that we don't go over the pool limit */
+	page_count = 0;
+	if (pool->npages > _manager->options.max_size) {
+		page_count = pool->npages - _manager->options.max_size;
+		/* free at least NUM_PAGES_TO_ALLOC number of pages
+		 * to reduce calls to set_memory_wb */
+		if (page_count < NUM_PAGES_TO_ALLOC)
+			page_count = NUM_PAGES_TO_ALLOC;
+	}
+	spin_unlock_irqrestore(&pool->lock, irq_flags);
+	if (page_count)
+		ttm_page_pool_free(pool, page_count);
+}
+
 /* Put all pages in pages list to correct pool to wait for reuse */
 void ttm_put_pages(struct list_head *pages, unsigned page_count, int flags,
 		   enum ttm_caching_state cstate, dma_addr_t *dma_address)
 {
-	unsigned long irq_flags;
-	struct ttm_page_pool *pool = ttm_get_pool(flags, cstate);
 	struct page *p, *tmp;
+	struct list_head node_pages;
+	int nid;
 
-	if (pool == NULL) {
+	if (cstate == tt_cached) {
 		/* No pool for this memory type so free the pages */
 
 		list_for_each_entry_safe(p, tmp, pages, lru) {
@@ -761,59 +830,62 @@ void ttm_put_pages(struct list_head *pages, unsigned page_count, int flags,
 		INIT_LIST_HEAD(pages);
 		return;
 	}
-	if (page_count == 0) {
+
+	/* Sort the pages by node so each node's pool only hands out
+	 * local pages. */
+	while (!list_empty(pages)) {
+		nid = page_to_nid(list_first_entry(pages, struct page, lru));
+		INIT_LIST_HEAD(&node_pages);
+		page_count = 0;
 		list_for_each_entry_safe(p, tmp, pages, lru) {
+			if (page_to_nid(p) != nid)
+				continue;
+			list_move_tail(&p->lru, &node_pages);
 			++page_count;
 		}
+		ttm_page_pool_put_pages(ttm_get_pool(flags, cstate, nid),
+					&node_pages, page_count);
 	}
-
-	spin_lock_irqsave(&pool->lock, irq_flags);
-	list_splice_init(pages, &pool->list);
-	pool->npages += page_count;
-	/* Check that we don't go over the pool limit */
-	page_count = 0;
-	if (pool->npages > _manager->options.max_size) {
-		page_count = pool->npages - _manager->options.max_size;
-		/* free at least NUM_PAGES_TO_ALLOC number of pages
-		 * to reduce calls to set_memory_wb */
-		if (page_count < NUM_PAGES_TO_ALLOC)
-			page_count = NUM_PAGES_TO_ALLOC;
-	}
-	spin_unlock_irqrestore(&pool->lock, irq_flags);
-	if (page_count)
-		ttm_page_pool_free(pool, page_count);
 }
 
 static void ttm_page_pool_init_locked(struct ttm_page_pool *pool, int flags,
-		char *name)
+		char *name, int nid)
 {
 	spin_lock_init(&pool->lock);
 	pool->fill_lock = false;
 	INIT_LIST_HEAD(&pool->list);
 	pool->npages = pool->nfrees = 0;
 	pool->gfp_flags = flags;
+	pool->nid = nid;
 	pool->name = name;
 }
 
 int ttm_page_alloc_init(struct ttm_mem_global *glob, unsigned max_pages)
 {
 	int ret;
+	unsigned i;
 
 	WARN_ON(_manager);
 
 	printk(KERN_INFO TTM_PFX "Initializing pool allocator.\n");
 
 	_manager = kzalloc(sizeof(*_manager), GFP_KERNEL);
+	if (!_manager)
+		return -ENOMEM;
+	_manager->pools = kcalloc(ttm_nr_pools(), sizeof(*_manager->pools),
+				  GFP_KERNEL);
+	if (!_manager->pools) {
+		kfree(_manager);
+		_manager = NULL;
+		return -ENOMEM;
+	}
 
-	ttm_page_pool_init_locked(&_manager->wc_pool, GFP_HIGHUSER, "wc");
-
-	ttm_page_pool_init_locked(&_manager->uc_pool, GFP_HIGHUSER, "uc");
-
-	ttm_page_pool_init_locked(&_manager->wc_pool_dma32,
-				  GFP_USER | GFP_DMA32, "wc dma");
-
-	ttm_page_pool_init_locked(&_manager->uc_pool_dma32,
-				  GFP_USER | GFP_DMA32, "uc dma");
+	for (i = 0; i < ttm_nr_pools(); ++i)
+		ttm_page_pool_init_locked(&_manager->pools[i],
+					  (i & 0x2) ? GFP_USER | GFP_DMA32 :
+						      GFP_HIGHUSER,
+					  ttm_pool_names[i % NUM_POOLS],
+					  i / NUM_POOLS);
 
 	_manager->options.max_size = max_pages;
 	_manager->options.small = SMALL_ALLOCATION;
@@ -839,7 +911,7 @@ void ttm_page_alloc_fini(void)
 	printk(KERN_INFO TTM_PFX "Finalizing pool allocator.\n");
 	ttm_pool_mm_shrink_fini(_manager);
 
-	for (i = 0; i < NUM_POOLS; ++i)
+	for (i = 0; i < ttm_nr_pools(); ++i)
 		ttm_page_pool_free(&_manager->pools[i], FREE_ALL_PAGES);
 
 	kobject_put(&_manager->kobj);
@@ -850,18 +922,20 @@ int ttm_page_alloc_debugfs(struct seq_file *m, void *data)
 {
 	struct ttm_page_pool *p;
 	unsigned i;
-	char *h[] = {"pool", "refills", "pages freed", "size"};
+	char *h[] = {"pool", "node", "refills", "pages freed", "size"};
 	if (!_manager) {
 		seq_printf(m, "No pool allocator running.\n");
 		return 0;
 	}
-	seq_printf(m, "%6s %12s %13s %8s\n",
-			h[0], h[1], h[2], h[3]);
-	for (i = 0; i < NUM_POOLS; ++i) {
+	seq_printf(m, "%6s %4s %12s %13s %8s\n",
+			h[0], h[1], h[2], h[3], h[4]);
+	for (i = 0; i < ttm_nr_pools(); ++i) {
 		p = &_manager->pools[i];
+		if (!node_online(p->nid))
+			continue;
 
-		seq_printf(m, "%6s %12ld %13ld %8d\n",
-				p->name, p->nrefills,
+		seq_printf(m, "%6s %4d %12ld %13ld %8d\n",
+				p->name, p->nid, p->nrefills,
 				p->nfrees, p->npages);
 	}
 	return 0;
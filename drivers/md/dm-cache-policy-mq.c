@@ -0,0 +1,930 @@
+/*
+ * Copyright (C) 2012 Red Hat. All rights reserved.
+ *
+ * This file is released under the GPL.
+ */
+
+#include "dm-cache-policy.h"
+
+#include <linux/hash.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#define DM_MSG_PREFIX "cache-policy-mq"
+
+/*----------------------------------------------------------------*/
+
+/*
+ * The mq policy keeps every block it knows about in one of three
+ * multiqueues, ordered by how often the block has been hit recently:
+ *
+ * - pre_cache: blocks on the origin that have been hit, but not often
+ *   enough to be worth promoting yet.
+ *
+ * - cache_clean and cache_dirty: blocks in the cache.  Only clean blocks
+ *   are ever demoted, dirty ones are handed to the core for writeback,
+ *   least used first.
+ *
+ * A block is promoted once its hit count reaches the hit count of the
+ * least used clean block in the cache, plus an adjustment that makes
+ * writes more expensive to promote than reads.  Hit counts are halved
+ * every generation so that blocks that used to be hot lose their place
+ * again.
+ *
+ * Sequential io is not worth caching, the origin is good at it.  The io
+ * tracker spots streams and the policy leaves them alone.
+ */
+
+/*----------------------------------------------------------------*/
+
+/*
+ * Tracks whether the io is sequential or random.
+ */
+enum io_pattern {
+	PATTERN_SEQUENTIAL,
+	PATTERN_RANDOM
+};
+
+struct io_tracker {
+	enum io_pattern pattern;
+
+	unsigned nr_seq_samples;
+	unsigned nr_rand_samples;
+	unsigned thresholds[2];
+
+	sector_t next_start_sector;
+};
+
+static void iot_init(struct io_tracker *t,
+		     int sequential_threshold, int random_threshold)
+{
+	t->pattern = PATTERN_RANDOM;
+	t->nr_seq_samples = 0;
+	t->nr_rand_samples = 0;
+	t->next_start_sector = 0;
+	t->thresholds[PATTERN_RANDOM] = random_threshold;
+	t->thresholds[PATTERN_SEQUENTIAL] = sequential_threshold;
+}
+
+static enum io_pattern iot_pattern(struct io_tracker *t)
+{
+	return t->pattern;
+}
+
+static void iot_update_stats(struct io_tracker *t, struct bio *bio)
+{
+	if (bio->bi_sector == t->next_start_sector)
+		t->nr_seq_samples++;
+	else {
+		/*
+		 * Just one non-sequential IO is enough to reset the
+		 * counters.
+		 */
+		if (t->nr_seq_samples) {
+			t->nr_seq_samples = 0;
+			t->nr_rand_samples = 0;
+		}
+
+		t->nr_rand_samples++;
+	}
+
+	t->next_start_sector = bio->bi_sector + bio_sectors(bio);
+}
+
+static void iot_check_for_pattern_switch(struct io_tracker *t)
+{
+	switch (t->pattern) {
+	case PATTERN_SEQUENTIAL:
+		if (t->nr_rand_samples >= t->thresholds[PATTERN_RANDOM]) {
+			t->pattern = PATTERN_RANDOM;
+			t->nr_seq_samples = t->nr_rand_samples = 0;
+		}
+		break;
+
+	case PATTERN_RANDOM:
+		if (t->nr_seq_samples >= t->thresholds[PATTERN_SEQUENTIAL]) {
+			t->pattern = PATTERN_SEQUENTIAL;
+			t->nr_seq_samples = t->nr_rand_samples = 0;
+		}
+		break;
+	}
+}
+
+static void iot_examine_bio(struct io_tracker *t, struct bio *bio)
+{
+	iot_update_stats(t, bio);
+	iot_check_for_pattern_switch(t);
+}
+
+/*----------------------------------------------------------------*/
+
+/*
+ * This queue is divided up into different levels.  Allowing us to push
+ * entries to the back of any of the levels.  Think of it as a partially
+ * sorted queue.
+ */
+#define NR_QUEUE_LEVELS 16u
+
+struct queue {
+	struct list_head qs[NR_QUEUE_LEVELS];
+};
+
+static void queue_init(struct queue *q)
+{
+	unsigned i;
+
+	for (i = 0; i < NR_QUEUE_LEVELS; i++)
+		INIT_LIST_HEAD(q->qs + i);
+}
+
+static void queue_push(struct queue *q, unsigned level, struct list_head *elt)
+{
+	list_add_tail(elt, q->qs + level);
+}
+
+static void queue_remove(struct list_head *elt)
+{
+	list_del(elt);
+}
+
+/*
+ * Gives us the oldest entry of the lowest populated level.
+ */
+static struct list_head *queue_peek(struct queue *q)
+{
+	unsigned level;
+
+	for (level = 0; level < NR_QUEUE_LEVELS; level++)
+		if (!list_empty(q->qs + level))
+			return q->qs[level].next;
+
+	return NULL;
+}
+
+static struct list_head *queue_pop(struct queue *q)
+{
+	struct list_head *r = queue_peek(q);
+
+	if (r)
+		list_del(r);
+
+	return r;
+}
+
+/*----------------------------------------------------------------*/
+
+/*
+ * Describes a cache entry.  Used in both the cache and the pre_cache.
+ */
+struct entry {
+	struct hlist_node hlist;
+	struct list_head list;
+	dm_oblock_t oblock;
+
+	unsigned hit_count;
+	unsigned generation;
+	unsigned tick;
+
+	bool in_cache:1;
+	bool dirty:1;
+};
+
+/*
+ * Promotion thresholds over the least used clean block in the cache.
+ */
+#define READ_PROMOTE_ADJUSTMENT 4
+#define WRITE_PROMOTE_ADJUSTMENT 8
+
+#define DEFAULT_SEQUENTIAL_THRESHOLD 512
+#define DEFAULT_RANDOM_THRESHOLD 4
+
+/*
+ * Hit counts are halved every this many hits, but at least every
+ * cache_size hits.
+ */
+#define MIN_GENERATION_PERIOD 1024
+
+struct mq_policy {
+	struct dm_cache_policy policy;
+
+	/* protects everything */
+	struct mutex lock;
+
+	struct io_tracker tracker;
+
+	/*
+	 * The cache entries are indexed by cblock, those not in use sit on
+	 * the free list.  The pre_cache entries have a pool of their own.
+	 */
+	dm_cblock_t cache_size;
+	unsigned nr_cache_entries_allocated;
+	struct entry *cache_entries;
+	struct list_head free_cache;
+
+	unsigned nr_pre_cache_entries;
+	struct entry *pre_cache_entries;
+	struct list_head free_pre_cache;
+
+	struct queue pre_cache;
+	struct queue cache_clean;
+	struct queue cache_dirty;
+
+	/*
+	 * Hits only count once per tick and block, so a flurry of small
+	 * bios to one block doesn't make it look hot.
+	 */
+	unsigned tick;
+
+	unsigned generation;
+	unsigned generation_period;
+	unsigned hits_this_generation;
+
+	unsigned promote_threshold;
+	unsigned read_promote_adjustment;
+	unsigned write_promote_adjustment;
+
+	/*
+	 * The hash table allows us to quickly find an entry by origin
+	 * block.  Both pre_cache and cache entries are in here.
+	 */
+	unsigned hash_bits;
+	struct hlist_head *table;
+};
+
+static struct mq_policy *to_mq_policy(struct dm_cache_policy *p)
+{
+	return container_of(p, struct mq_policy, policy);
+}
+
+/*----------------------------------------------------------------*/
+
+static dm_cblock_t infer_cblock(struct mq_policy *mq, struct entry *e)
+{
+	return to_cblock(e - mq->cache_entries);
+}
+
+static void hash_insert(struct mq_policy *mq, struct entry *e)
+{
+	unsigned h = hash_64(from_oblock(e->oblock), mq->hash_bits);
+
+	hlist_add_head(&e->hlist, mq->table + h);
+}
+
+static struct entry *hash_lookup(struct mq_policy *mq, dm_oblock_t oblock)
+{
+	unsigned h = hash_64(from_oblock(oblock), mq->hash_bits);
+	struct hlist_head *bucket = mq->table + h;
+	struct hlist_node *tmp;
+	struct entry *e;
+
+	hlist_for_each_entry(e, tmp, bucket, hlist)
+		if (e->oblock == oblock)
+			return e;
+
+	return NULL;
+}
+
+static void hash_remove(struct entry *e)
+{
+	hlist_del(&e->hlist);
+}
+
+/*----------------------------------------------------------------*/
+
+static unsigned queue_level(struct entry *e)
+{
+	return min((unsigned) ilog2(e->hit_count + 1), NR_QUEUE_LEVELS - 1u);
+}
+
+static struct queue *entry_queue(struct mq_policy *mq, struct entry *e)
+{
+	if (!e->in_cache)
+		return &mq->pre_cache;
+
+	return e->dirty ? &mq->cache_dirty : &mq->cache_clean;
+}
+
+static void push(struct mq_policy *mq, struct entry *e)
+{
+	queue_push(entry_queue(mq, e), queue_level(e), &e->list);
+}
+
+/*
+ * Brings the hit count of an entry up to date with the generation.
+ */
+static void age_entry(struct mq_policy *mq, struct entry *e)
+{
+	unsigned delta = mq->generation - e->generation;
+
+	if (delta) {
+		e->hit_count = delta < 32 ? e->hit_count >> delta : 0;
+		e->generation = mq->generation;
+	}
+}
+
+static void next_generation(struct mq_policy *mq)
+{
+	if (++mq->hits_this_generation >= mq->generation_period) {
+		mq->generation++;
+		mq->hits_this_generation = 0;
+	}
+}
+
+static void hit(struct mq_policy *mq, struct entry *e)
+{
+	age_entry(mq, e);
+
+	if (e->tick == mq->tick)
+		return;
+
+	e->tick = mq->tick;
+	e->hit_count++;
+	next_generation(mq);
+
+	queue_remove(&e->list);
+	push(mq, e);
+}
+
+static void init_entry(struct mq_policy *mq, struct entry *e, dm_oblock_t oblock,
+		       unsigned hit_count)
+{
+	e->oblock = oblock;
+	e->hit_count = hit_count;
+	e->generation = mq->generation;
+	e->tick = mq->tick - 1;
+	e->dirty = false;
+}
+
+/*
+ * Finds a pre_cache entry for a new block, recycling the least used one
+ * if they're all taken.
+ */
+static struct entry *alloc_pre_cache_entry(struct mq_policy *mq)
+{
+	struct entry *e;
+
+	if (!list_empty(&mq->free_pre_cache)) {
+		e = list_first_entry(&mq->free_pre_cache, struct entry, list);
+		list_del(&e->list);
+		return e;
+	}
+
+	e = list_entry(queue_pop(&mq->pre_cache), struct entry, list);
+	hash_remove(e);
+
+	return e;
+}
+
+static void free_pre_cache_entry(struct mq_policy *mq, struct entry *e)
+{
+	list_add(&e->list, &mq->free_pre_cache);
+}
+
+static struct entry *alloc_cache_entry(struct mq_policy *mq)
+{
+	struct entry *e;
+
+	if (list_empty(&mq->free_cache))
+		return NULL;
+
+	e = list_first_entry(&mq->free_cache, struct entry, list);
+	list_del(&e->list);
+	mq->nr_cache_entries_allocated++;
+
+	return e;
+}
+
+static void free_cache_entry(struct mq_policy *mq, struct entry *e)
+{
+	e->in_cache = false;
+	list_add(&e->list, &mq->free_cache);
+	mq->nr_cache_entries_allocated--;
+}
+
+static bool any_free_cblocks(struct mq_policy *mq)
+{
+	return !list_empty(&mq->free_cache);
+}
+
+/*----------------------------------------------------------------*/
+
+/*
+ * The hit count a block on the origin needs before it displaces the least
+ * used clean block of a full cache.
+ */
+static void update_promote_threshold(struct mq_policy *mq)
+{
+	struct list_head *l;
+	struct entry *e;
+
+	if (any_free_cblocks(mq)) {
+		mq->promote_threshold = 0;
+		return;
+	}
+
+	l = queue_peek(&mq->cache_clean);
+	if (!l)
+		l = queue_peek(&mq->cache_dirty);
+	if (!l)
+		return;
+
+	e = list_entry(l, struct entry, list);
+	age_entry(mq, e);
+	mq->promote_threshold = e->hit_count;
+}
+
+static unsigned adjusted_promote_threshold(struct mq_policy *mq, int data_dir)
+{
+	return mq->promote_threshold + (data_dir == READ ?
+					mq->read_promote_adjustment :
+					mq->write_promote_adjustment);
+}
+
+/*
+ * Moves the block of pre_cache entry @e into the cache, demoting the least
+ * used clean block if there's no free one.
+ */
+static int promote(struct mq_policy *mq, struct entry *e,
+		   struct policy_result *result)
+{
+	struct entry *ce;
+	struct list_head *l;
+	dm_oblock_t oblock = e->oblock;
+	unsigned hit_count = e->hit_count;
+
+	ce = alloc_cache_entry(mq);
+	if (ce) {
+		result->op = POLICY_NEW;
+
+		queue_remove(&e->list);
+		hash_remove(e);
+		free_pre_cache_entry(mq, e);
+	} else {
+		l = queue_pop(&mq->cache_clean);
+		if (!l) {
+			/* everything is dirty, wait for writeback */
+			result->op = POLICY_MISS;
+			return 0;
+		}
+
+		ce = list_entry(l, struct entry, list);
+		hash_remove(ce);
+
+		result->op = POLICY_REPLACE;
+		result->old_oblock = ce->oblock;
+
+		/*
+		 * The pre_cache entry takes over the demoted block, so it
+		 * may come back if it stays busy.
+		 */
+		age_entry(mq, ce);
+		hash_remove(e);
+		queue_remove(&e->list);
+		init_entry(mq, e, ce->oblock, ce->hit_count);
+		hash_insert(mq, e);
+		push(mq, e);
+	}
+
+	init_entry(mq, ce, oblock, hit_count);
+	ce->in_cache = true;
+	ce->tick = mq->tick;
+	hash_insert(mq, ce);
+	push(mq, ce);
+
+	result->cblock = infer_cblock(mq, ce);
+	update_promote_threshold(mq);
+
+	return 0;
+}
+
+static int map(struct mq_policy *mq, dm_oblock_t oblock,
+	       bool can_migrate, struct bio *bio,
+	       struct policy_result *result)
+{
+	struct entry *e = hash_lookup(mq, oblock);
+
+	if (e && e->in_cache) {
+		hit(mq, e);
+		result->op = POLICY_HIT;
+		result->cblock = infer_cblock(mq, e);
+		return 0;
+	}
+
+	if (iot_pattern(&mq->tracker) == PATTERN_SEQUENTIAL) {
+		result->op = POLICY_MISS;
+		return 0;
+	}
+
+	if (!e) {
+		e = alloc_pre_cache_entry(mq);
+		init_entry(mq, e, oblock, 0);
+		e->in_cache = false;
+		hash_insert(mq, e);
+		push(mq, e);
+	}
+
+	hit(mq, e);
+
+	if (e->hit_count < adjusted_promote_threshold(mq, bio_data_dir(bio))) {
+		result->op = POLICY_MISS;
+		return 0;
+	}
+
+	if (!can_migrate)
+		return -EWOULDBLOCK;
+
+	return promote(mq, e, result);
+}
+
+/*----------------------------------------------------------------
+ * Public interface, via the policy struct.  See dm-cache-policy.h for a
+ * description of these.
+ *--------------------------------------------------------------*/
+static void mq_destroy(struct dm_cache_policy *p)
+{
+	struct mq_policy *mq = to_mq_policy(p);
+
+	vfree(mq->table);
+	vfree(mq->pre_cache_entries);
+	vfree(mq->cache_entries);
+	kfree(mq);
+}
+
+static int mq_map(struct dm_cache_policy *p, dm_oblock_t oblock,
+		  bool can_block, bool can_migrate, struct bio *bio,
+		  struct policy_result *result)
+{
+	int r;
+	struct mq_policy *mq = to_mq_policy(p);
+
+	result->op = POLICY_MISS;
+
+	if (can_block)
+		mutex_lock(&mq->lock);
+	else if (!mutex_trylock(&mq->lock))
+		return -EWOULDBLOCK;
+
+	iot_examine_bio(&mq->tracker, bio);
+	r = map(mq, oblock, can_migrate, bio, result);
+
+	mutex_unlock(&mq->lock);
+
+	return r;
+}
+
+static int mq_lookup(struct dm_cache_policy *p, dm_oblock_t oblock, dm_cblock_t *cblock)
+{
+	int r;
+	struct mq_policy *mq = to_mq_policy(p);
+	struct entry *e;
+
+	if (!mutex_trylock(&mq->lock))
+		return -EWOULDBLOCK;
+
+	e = hash_lookup(mq, oblock);
+	if (e && e->in_cache) {
+		*cblock = infer_cblock(mq, e);
+		r = 0;
+	} else
+		r = -ENOENT;
+
+	mutex_unlock(&mq->lock);
+
+	return r;
+}
+
+static void __mq_set_clear_dirty(struct mq_policy *mq, dm_oblock_t oblock, bool set)
+{
+	struct entry *e = hash_lookup(mq, oblock);
+
+	BUG_ON(!e || !e->in_cache);
+
+	if (e->dirty == set)
+		return;
+
+	queue_remove(&e->list);
+	e->dirty = set;
+	push(mq, e);
+}
+
+static void mq_set_dirty(struct dm_cache_policy *p, dm_oblock_t oblock)
+{
+	struct mq_policy *mq = to_mq_policy(p);
+
+	mutex_lock(&mq->lock);
+	__mq_set_clear_dirty(mq, oblock, true);
+	mutex_unlock(&mq->lock);
+}
+
+static void mq_clear_dirty(struct dm_cache_policy *p, dm_oblock_t oblock)
+{
+	struct mq_policy *mq = to_mq_policy(p);
+
+	mutex_lock(&mq->lock);
+	__mq_set_clear_dirty(mq, oblock, false);
+	mutex_unlock(&mq->lock);
+}
+
+static int mq_load_mapping(struct dm_cache_policy *p,
+			   dm_oblock_t oblock, dm_cblock_t cblock)
+{
+	struct mq_policy *mq = to_mq_policy(p);
+	struct entry *e;
+
+	if (from_cblock(cblock) >= from_cblock(mq->cache_size))
+		return -EINVAL;
+
+	e = mq->cache_entries + from_cblock(cblock);
+	if (e->in_cache || hash_lookup(mq, oblock))
+		return -EINVAL;
+
+	list_del(&e->list);
+	mq->nr_cache_entries_allocated++;
+
+	init_entry(mq, e, oblock, 0);
+	e->in_cache = true;
+	hash_insert(mq, e);
+	push(mq, e);
+
+	update_promote_threshold(mq);
+
+	return 0;
+}
+
+static void mq_remove_mapping(struct dm_cache_policy *p, dm_oblock_t oblock)
+{
+	struct mq_policy *mq = to_mq_policy(p);
+	struct entry *e;
+
+	mutex_lock(&mq->lock);
+
+	e = hash_lookup(mq, oblock);
+	BUG_ON(!e || !e->in_cache);
+
+	hash_remove(e);
+	queue_remove(&e->list);
+	free_cache_entry(mq, e);
+	update_promote_threshold(mq);
+
+	mutex_unlock(&mq->lock);
+}
+
+static void mq_force_mapping(struct dm_cache_policy *p,
+			     dm_oblock_t current_oblock, dm_oblock_t new_oblock)
+{
+	struct mq_policy *mq = to_mq_policy(p);
+	struct entry *e;
+
+	mutex_lock(&mq->lock);
+
+	/*
+	 * The block we're putting back may have been given a pre_cache
+	 * entry when it was demoted.
+	 */
+	e = hash_lookup(mq, new_oblock);
+	if (e) {
+		BUG_ON(e->in_cache);
+		hash_remove(e);
+		queue_remove(&e->list);
+		free_pre_cache_entry(mq, e);
+	}
+
+	e = hash_lookup(mq, current_oblock);
+	BUG_ON(!e || !e->in_cache);
+
+	hash_remove(e);
+	e->oblock = new_oblock;
+	hash_insert(mq, e);
+
+	mutex_unlock(&mq->lock);
+}
+
+static int mq_writeback_work(struct dm_cache_policy *p, dm_oblock_t *oblock,
+			     dm_cblock_t *cblock)
+{
+	int r = -ENODATA;
+	struct mq_policy *mq = to_mq_policy(p);
+	struct list_head *l;
+	struct entry *e;
+
+	mutex_lock(&mq->lock);
+
+	l = queue_pop(&mq->cache_dirty);
+	if (l) {
+		e = list_entry(l, struct entry, list);
+		e->dirty = false;
+		push(mq, e);
+
+		*oblock = e->oblock;
+		*cblock = infer_cblock(mq, e);
+		r = 0;
+	}
+
+	mutex_unlock(&mq->lock);
+
+	return r;
+}
+
+static dm_cblock_t mq_residency(struct dm_cache_policy *p)
+{
+	dm_cblock_t r;
+	struct mq_policy *mq = to_mq_policy(p);
+
+	mutex_lock(&mq->lock);
+	r = to_cblock(mq->nr_cache_entries_allocated);
+	mutex_unlock(&mq->lock);
+
+	return r;
+}
+
+static void mq_tick(struct dm_cache_policy *p)
+{
+	struct mq_policy *mq = to_mq_policy(p);
+
+	mutex_lock(&mq->lock);
+	mq->tick++;
+	update_promote_threshold(mq);
+	mutex_unlock(&mq->lock);
+}
+
+static int mq_set_config_value(struct dm_cache_policy *p,
+			       const char *key, const char *value)
+{
+	struct mq_policy *mq = to_mq_policy(p);
+	unsigned long tmp;
+
+	if (kstrtoul(value, 10, &tmp))
+		return -EINVAL;
+
+	mutex_lock(&mq->lock);
+
+	if (!strcasecmp(key, "random_threshold"))
+		mq->tracker.thresholds[PATTERN_RANDOM] = tmp;
+
+	else if (!strcasecmp(key, "sequential_threshold"))
+		mq->tracker.thresholds[PATTERN_SEQUENTIAL] = tmp;
+
+	else if (!strcasecmp(key, "read_promote_adjustment"))
+		mq->read_promote_adjustment = tmp;
+
+	else if (!strcasecmp(key, "write_promote_adjustment"))
+		mq->write_promote_adjustment = tmp;
+
+	else {
+		mutex_unlock(&mq->lock);
+		return -EINVAL;
+	}
+
+	mutex_unlock(&mq->lock);
+
+	return 0;
+}
+
+static int mq_emit_config_values(struct dm_cache_policy *p, char *result, unsigned maxlen)
+{
+	unsigned sz = 0;
+	struct mq_policy *mq = to_mq_policy(p);
+
+	DMEMIT("8 random_threshold %u sequential_threshold %u "
+	       "read_promote_adjustment %u write_promote_adjustment %u",
+	       mq->tracker.thresholds[PATTERN_RANDOM],
+	       mq->tracker.thresholds[PATTERN_SEQUENTIAL],
+	       mq->read_promote_adjustment,
+	       mq->write_promote_adjustment);
+
+	return 0;
+}
+
+/* Init the policy plugin interface function pointers. */
+static void init_policy_functions(struct mq_policy *mq)
+{
+	mq->policy.map = mq_map;
+	mq->policy.lookup = mq_lookup;
+	mq->policy.set_dirty = mq_set_dirty;
+	mq->policy.clear_dirty = mq_clear_dirty;
+	mq->policy.load_mapping = mq_load_mapping;
+	mq->policy.remove_mapping = mq_remove_mapping;
+	mq->policy.force_mapping = mq_force_mapping;
+	mq->policy.writeback_work = mq_writeback_work;
+	mq->policy.residency = mq_residency;
+	mq->policy.tick = mq_tick;
+	mq->policy.emit_config_values = mq_emit_config_values;
+	mq->policy.set_config_value = mq_set_config_value;
+	mq->policy.destroy = mq_destroy;
+}
+
+static struct dm_cache_policy *mq_create(dm_cblock_t cache_size,
+					 sector_t origin_size,
+					 sector_t cache_block_size)
+{
+	unsigned i, nr_buckets;
+	struct mq_policy *mq = kzalloc(sizeof(*mq), GFP_KERNEL);
+
+	if (!mq)
+		return NULL;
+
+	init_policy_functions(mq);
+	mutex_init(&mq->lock);
+	iot_init(&mq->tracker, DEFAULT_SEQUENTIAL_THRESHOLD, DEFAULT_RANDOM_THRESHOLD);
+
+	mq->cache_size = cache_size;
+	mq->nr_pre_cache_entries = max(from_cblock(cache_size), 128u);
+
+	mq->tick = 1;
+	mq->generation = 0;
+	mq->generation_period = max(from_cblock(cache_size), (uint32_t) MIN_GENERATION_PERIOD);
+	mq->hits_this_generation = 0;
+	mq->promote_threshold = 0;
+	mq->read_promote_adjustment = READ_PROMOTE_ADJUSTMENT;
+	mq->write_promote_adjustment = WRITE_PROMOTE_ADJUSTMENT;
+
+	queue_init(&mq->pre_cache);
+	queue_init(&mq->cache_clean);
+	queue_init(&mq->cache_dirty);
+
+	INIT_LIST_HEAD(&mq->free_cache);
+	if (from_cblock(cache_size)) {
+		mq->cache_entries = vzalloc(sizeof(struct entry) * from_cblock(cache_size));
+		if (!mq->cache_entries)
+			goto bad_cache_entries;
+	}
+	for (i = 0; i < from_cblock(cache_size); i++)
+		list_add_tail(&mq->cache_entries[i].list, &mq->free_cache);
+
+	INIT_LIST_HEAD(&mq->free_pre_cache);
+	mq->pre_cache_entries = vzalloc(sizeof(struct entry) * mq->nr_pre_cache_entries);
+	if (!mq->pre_cache_entries)
+		goto bad_pre_cache_entries;
+	for (i = 0; i < mq->nr_pre_cache_entries; i++)
+		list_add_tail(&mq->pre_cache_entries[i].list, &mq->free_pre_cache);
+
+	nr_buckets = roundup_pow_of_two(max((from_cblock(cache_size) + mq->nr_pre_cache_entries) / 4, 16u));
+	mq->hash_bits = ffs(nr_buckets) - 1;
+	mq->table = vzalloc(sizeof(*mq->table) * nr_buckets);
+	if (!mq->table)
+		goto bad_alloc_table;
+
+	for (i = 0; i < nr_buckets; i++)
+		INIT_HLIST_HEAD(mq->table + i);
+
+	return &mq->policy;
+
+bad_alloc_table:
+	vfree(mq->pre_cache_entries);
+bad_pre_cache_entries:
+	vfree(mq->cache_entries);
+bad_cache_entries:
+	kfree(mq);
+
+	return NULL;
+}
+
+/*----------------------------------------------------------------*/
+
+static struct dm_cache_policy_type mq_policy_type = {
+	.name = "mq",
+	.owner = THIS_MODULE,
+	.create = mq_create
+};
+
+static struct dm_cache_policy_type default_policy_type = {
+	.name = "default",
+	.owner = THIS_MODULE,
+	.create = mq_create
+};
+
+static int __init mq_init(void)
+{
+	int r;
+
+	r = dm_cache_policy_register(&mq_policy_type);
+	if (r) {
+		DMERR("register failed %d", r);
+		return r;
+	}
+
+	r = dm_cache_policy_register(&default_policy_type);
+	if (r) {
+		DMERR("register failed (as default) %d", r);
+		dm_cache_policy_unregister(&mq_policy_type);
+	}
+
+	return r;
+}
+
+static void __exit mq_exit(void)
+{
+	dm_cache_policy_unregister(&mq_policy_type);
+	dm_cache_policy_unregister(&default_policy_type);
+}
+
+module_init(mq_init);
+module_exit(mq_exit);
+
+MODULE_AUTHOR("Joe Thornber <dm-devel@redhat.com>");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("mq cache policy");
+
+MODULE_ALIAS("dm-cache-default");
@@ -0,0 +1,1916 @@
+/*
+ * Copyright (C) 2012 Red Hat. All rights reserved.
+ *
+ * This file is released under the GPL.
+ */
+
+#include "dm.h"
+#include "dm-bio-prison.h"
+#include "dm-bio-record.h"
+#include "dm-cache-metadata.h"
+#include "dm-cache-policy-internal.h"
+
+#include <linux/dm-io.h>
+#include <linux/dm-kcopyd.h>
+#include <linux/init.h>
+#include <linux/mempool.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+
+#define DM_MSG_PREFIX "cache"
+
+/*----------------------------------------------------------------*/
+
+/*
+ * Glossary:
+ *
+ * oblock: index of an origin block
+ * cblock: index of a cache block
+ * promotion: movement of a block from origin to cache
+ * demotion: movement of a block from cache to origin
+ * migration: movement of a block between the origin and cache device,
+ *	      either direction
+ */
+
+/*----------------------------------------------------------------*/
+
+/*
+ * Tunable constants
+ */
+#define ENDIO_HOOK_POOL_SIZE 1024
+#define MIGRATION_POOL_SIZE 128
+#define PRISON_CELLS 1024
+#define COMMIT_PERIOD HZ
+#define DEFAULT_MIGRATION_THRESHOLD 2048
+
+/*
+ * The block size of the device holding cache data must be
+ * between 32KB and 1GB.
+ */
+#define DATA_DEV_BLOCK_SIZE_MIN_SECTORS (32 * 1024 >> SECTOR_SHIFT)
+#define DATA_DEV_BLOCK_SIZE_MAX_SECTORS (1024 * 1024 * 1024 >> SECTOR_SHIFT)
+
+enum cache_io_mode {
+	/*
+	 * Data is written to cached blocks only.  These blocks are marked
+	 * dirty.  If you lose the cache device you will lose data.
+	 */
+	CM_IO_WRITEBACK,
+
+	/*
+	 * Data is written to both cache and origin.  Blocks are never
+	 * dirty.  Potential performance benfit for reads only.
+	 */
+	CM_IO_WRITETHROUGH
+};
+
+struct cache_features {
+	enum cache_io_mode io_mode;
+};
+
+struct cache_stats {
+	atomic_t read_hit;
+	atomic_t read_miss;
+	atomic_t write_hit;
+	atomic_t write_miss;
+	atomic_t demotion;
+	atomic_t promotion;
+};
+
+struct cache {
+	struct dm_target *ti;
+	struct dm_target_callbacks callbacks;
+
+	/*
+	 * Metadata is written to this device.
+	 */
+	struct dm_dev *metadata_dev;
+
+	/*
+	 * The slower of the two data devices.  Typically a spindle.
+	 */
+	struct dm_dev *origin_dev;
+
+	/*
+	 * The faster of the two data devices.  Typically an SSD.
+	 */
+	struct dm_dev *cache_dev;
+
+	/*
+	 * Size of the origin device in _complete_ blocks.  A partial
+	 * block at the end is never cached.
+	 */
+	dm_oblock_t origin_blocks;
+
+	/*
+	 * Size of the cache device in blocks.
+	 */
+	dm_cblock_t cache_size;
+
+	sector_t sectors_per_block;
+	int sectors_per_block_shift;
+
+	struct dm_cache_metadata *cmd;
+	struct dm_cache_policy *policy;
+	struct cache_features features;
+
+	spinlock_t lock;
+	struct bio_list deferred_bios;
+	struct bio_list deferred_writethrough_bios;
+	struct list_head quiesced_migrations;
+	struct list_head completed_migrations;
+	struct list_head need_commit_migrations;
+	bool commit_requested:1;
+	bool quiescing:1;
+
+	atomic_t nr_migrations;
+	wait_queue_head_t migration_wait;
+	unsigned migration_threshold;
+
+	/*
+	 * One bit per cache block, set while the block differs from the
+	 * origin.
+	 */
+	unsigned long *dirty_bitset;
+	atomic_t nr_dirty;
+
+	struct dm_kcopyd_client *copier;
+	struct workqueue_struct *wq;
+	struct work_struct worker;
+	struct delayed_work waker;
+
+	struct dm_bio_prison *prison;
+	struct dm_deferred_set all_io_ds;
+
+	mempool_t *endio_hook_pool;
+	mempool_t *migration_pool;
+	struct dm_cache_migration *next_migration;
+
+	struct cache_stats stats;
+
+	/*
+	 * The table line, for the status output.
+	 */
+	unsigned nr_ctr_args;
+	const char **ctr_args;
+};
+
+/*
+ * Every bio gets one of these while it's mapped.  The writethrough fields
+ * are only allocated in writethrough mode.
+ */
+struct per_bio_data {
+	struct dm_deferred_entry *all_io_entry;
+
+	struct cache *cache;
+	dm_cblock_t cblock;
+	bio_end_io_t *saved_bi_end_io;
+	struct dm_bio_details bio_details;
+};
+
+#define PB_DATA_SIZE_WB (offsetof(struct per_bio_data, cache))
+#define PB_DATA_SIZE_WT (sizeof(struct per_bio_data))
+
+static struct kmem_cache *migration_cache;
+
+struct dm_cache_migration {
+	struct list_head list;
+	struct cache *cache;
+
+	dm_oblock_t old_oblock;
+	dm_oblock_t new_oblock;
+	dm_cblock_t cblock;
+
+	bool err:1;
+	bool writeback:1;
+	bool demote:1;
+	bool promote:1;
+
+	/*
+	 * Set once the metadata has been changed, the migration then
+	 * waits for a commit.
+	 */
+	bool demoted:1;
+	bool promoted:1;
+
+	struct dm_bio_prison_cell *old_ocell;
+	struct dm_bio_prison_cell *new_ocell;
+};
+
+/*----------------------------------------------------------------*/
+
+static void wake_worker(struct cache *cache)
+{
+	queue_work(cache->wq, &cache->worker);
+}
+
+static void build_key(dm_oblock_t oblock, struct dm_cell_key *key)
+{
+	key->virtual = 0;
+	key->dev = 0;
+	key->block = from_oblock(oblock);
+}
+
+/*
+ * This sends the bios in the cell back to the deferred_bios list.
+ */
+static void cell_defer(struct cache *cache, struct dm_bio_prison_cell *cell,
+		       bool holder)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	if (holder)
+		dm_cell_release(cell, &cache->deferred_bios);
+	else
+		dm_cell_release_no_holder(cell, &cache->deferred_bios);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	wake_worker(cache);
+}
+
+/*----------------------------------------------------------------*/
+
+static void set_dirty(struct cache *cache, dm_oblock_t oblock, dm_cblock_t cblock)
+{
+	if (!test_and_set_bit(from_cblock(cblock), cache->dirty_bitset)) {
+		atomic_inc(&cache->nr_dirty);
+		policy_set_dirty(cache->policy, oblock);
+	}
+}
+
+static void clear_dirty(struct cache *cache, dm_oblock_t oblock, dm_cblock_t cblock)
+{
+	if (test_and_clear_bit(from_cblock(cblock), cache->dirty_bitset)) {
+		policy_clear_dirty(cache->policy, oblock);
+		atomic_dec(&cache->nr_dirty);
+	}
+}
+
+static bool is_dirty(struct cache *cache, dm_cblock_t cblock)
+{
+	return test_bit(from_cblock(cblock), cache->dirty_bitset);
+}
+
+static bool writethrough_mode(struct cache_features *f)
+{
+	return f->io_mode == CM_IO_WRITETHROUGH;
+}
+
+/*----------------------------------------------------------------
+ * Remapping
+ *--------------------------------------------------------------*/
+static dm_oblock_t get_bio_block(struct cache *cache, struct bio *bio)
+{
+	return to_oblock(bio->bi_sector >> cache->sectors_per_block_shift);
+}
+
+static void remap_to_origin(struct cache *cache, struct bio *bio)
+{
+	bio->bi_bdev = cache->origin_dev->bdev;
+}
+
+static void remap_to_cache(struct cache *cache, struct bio *bio,
+			   dm_cblock_t cblock)
+{
+	bio->bi_bdev = cache->cache_dev->bdev;
+	bio->bi_sector = ((sector_t) from_cblock(cblock) << cache->sectors_per_block_shift) |
+		(bio->bi_sector & (cache->sectors_per_block - 1));
+}
+
+/*
+ * Bios that are issued get counted in all_io_ds, so migrations can wait
+ * for the io in flight to their blocks.
+ */
+static void inc_ds(struct cache *cache, struct bio *bio)
+{
+	struct per_bio_data *pb = dm_get_mapinfo(bio)->ptr;
+
+	BUG_ON(pb->all_io_entry);
+	pb->all_io_entry = dm_deferred_entry_inc(&cache->all_io_ds);
+}
+
+static void inc_and_issue(struct cache *cache, struct bio *bio)
+{
+	inc_ds(cache, bio);
+	generic_make_request(bio);
+}
+
+static void remap_to_cache_dirty(struct cache *cache, struct bio *bio,
+				 dm_oblock_t oblock, dm_cblock_t cblock)
+{
+	remap_to_cache(cache, bio, cblock);
+	if (bio_data_dir(bio) == WRITE)
+		set_dirty(cache, oblock, cblock);
+}
+
+/*
+ * In writethrough mode a write hit is issued to the origin first.  When
+ * that completes the bio is reissued to the cache by the worker.
+ */
+static void writethrough_endio(struct bio *bio, int err)
+{
+	unsigned long flags;
+	struct per_bio_data *pb = dm_get_mapinfo(bio)->ptr;
+	struct cache *cache = pb->cache;
+
+	bio->bi_end_io = pb->saved_bi_end_io;
+
+	if (err) {
+		bio_endio(bio, err);
+		return;
+	}
+
+	dm_bio_restore(&pb->bio_details, bio);
+	remap_to_cache(cache, bio, pb->cblock);
+
+	/*
+	 * We can't issue this bio directly, since we're in interrupt
+	 * context.  So it gets put on a bio list for processing by the
+	 * worker thread.
+	 */
+	spin_lock_irqsave(&cache->lock, flags);
+	bio_list_add(&cache->deferred_writethrough_bios, bio);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	wake_worker(cache);
+}
+
+static void remap_to_origin_then_cache(struct cache *cache, struct bio *bio,
+				       dm_cblock_t cblock)
+{
+	struct per_bio_data *pb = dm_get_mapinfo(bio)->ptr;
+
+	pb->cache = cache;
+	pb->cblock = cblock;
+	pb->saved_bi_end_io = bio->bi_end_io;
+	dm_bio_record(&pb->bio_details, bio);
+	bio->bi_end_io = writethrough_endio;
+
+	remap_to_origin(cache, bio);
+}
+
+static void remap_hit(struct cache *cache, struct bio *bio,
+		      dm_oblock_t oblock, dm_cblock_t cblock)
+{
+	if (bio_data_dir(bio) == WRITE) {
+		atomic_inc(&cache->stats.write_hit);
+
+		if (writethrough_mode(&cache->features)) {
+			remap_to_origin_then_cache(cache, bio, cblock);
+			return;
+		}
+	} else
+		atomic_inc(&cache->stats.read_hit);
+
+	remap_to_cache_dirty(cache, bio, oblock, cblock);
+}
+
+static void remap_miss(struct cache *cache, struct bio *bio)
+{
+	atomic_inc(bio_data_dir(bio) == WRITE ?
+		   &cache->stats.write_miss : &cache->stats.read_miss);
+	remap_to_origin(cache, bio);
+}
+
+/*----------------------------------------------------------------
+ * Migration processing
+ *
+ * Migration covers moving data from the origin device to the cache, or
+ * vice versa.  Each migration holds the cells of the origin blocks it
+ * touches, waits for the io already in flight to them (quiescing), has
+ * kcopyd copy the data and finally updates and commits the metadata
+ * before releasing the cells.
+ *--------------------------------------------------------------*/
+static void free_migration(struct dm_cache_migration *mg)
+{
+	struct cache *cache = mg->cache;
+
+	mempool_free(mg, cache->migration_pool);
+
+	if (atomic_dec_and_test(&cache->nr_migrations))
+		wake_up(&cache->migration_wait);
+}
+
+static bool spare_migration_bandwidth(struct cache *cache)
+{
+	sector_t current_volume = (atomic_read(&cache->nr_migrations) + 1) *
+		cache->sectors_per_block;
+
+	return current_volume <= cache->migration_threshold;
+}
+
+static void copy_complete(int read_err, unsigned long write_err, void *context)
+{
+	unsigned long flags;
+	struct dm_cache_migration *mg = context;
+	struct cache *cache = mg->cache;
+
+	if (read_err || write_err)
+		mg->err = true;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	list_add_tail(&mg->list, &cache->completed_migrations);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	wake_worker(cache);
+}
+
+static void issue_copy(struct dm_cache_migration *mg, bool to_origin)
+{
+	int r;
+	struct dm_io_region o_region, c_region;
+	struct cache *cache = mg->cache;
+
+	c_region.bdev = cache->cache_dev->bdev;
+	c_region.sector = from_cblock(mg->cblock) * cache->sectors_per_block;
+	c_region.count = cache->sectors_per_block;
+
+	o_region.bdev = cache->origin_dev->bdev;
+	o_region.count = cache->sectors_per_block;
+
+	if (to_origin) {
+		o_region.sector = from_oblock(mg->old_oblock) * cache->sectors_per_block;
+		r = dm_kcopyd_copy(cache->copier, &c_region, 1, &o_region, 0, copy_complete, mg);
+	} else {
+		o_region.sector = from_oblock(mg->new_oblock) * cache->sectors_per_block;
+		r = dm_kcopyd_copy(cache->copier, &o_region, 1, &c_region, 0, copy_complete, mg);
+	}
+
+	if (r < 0) {
+		DMERR("issuing migration failed");
+		mg->err = true;
+		copy_complete(0, 0, mg);
+	}
+}
+
+static void queue_for_commit(struct dm_cache_migration *mg)
+{
+	unsigned long flags;
+	struct cache *cache = mg->cache;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	list_add_tail(&mg->list, &cache->need_commit_migrations);
+	spin_unlock_irqrestore(&cache->lock, flags);
+}
+
+/*
+ * Undoes the policy's view of a migration that went wrong, and lets the
+ * held bios go.
+ */
+static void migration_failure(struct dm_cache_migration *mg)
+{
+	struct cache *cache = mg->cache;
+
+	if (mg->writeback && !mg->demote) {
+		DMWARN_LIMIT("writeback failed; couldn't copy block");
+		policy_set_dirty(cache->policy, mg->old_oblock);
+		cell_defer(cache, mg->old_ocell, false);
+
+	} else if (mg->demote && !mg->demoted) {
+		DMWARN_LIMIT("demotion failed; couldn't copy block");
+		policy_force_mapping(cache->policy, mg->new_oblock, mg->old_oblock);
+
+		cell_defer(cache, mg->old_ocell, false);
+		cell_defer(cache, mg->new_ocell, true);
+
+	} else {
+		DMWARN_LIMIT("promotion failed; couldn't copy block");
+		policy_remove_mapping(cache->policy, mg->new_oblock);
+
+		/* best effort, the mapping was never committed */
+		if (mg->promoted)
+			dm_cache_remove_mapping(cache->cmd, mg->cblock);
+
+		cell_defer(cache, mg->new_ocell, true);
+	}
+
+	free_migration(mg);
+}
+
+static void demote(struct dm_cache_migration *mg)
+{
+	int r;
+	struct cache *cache = mg->cache;
+
+	r = dm_cache_remove_mapping(cache->cmd, mg->cblock);
+	if (r) {
+		DMERR("failed to remove cache mapping");
+		migration_failure(mg);
+		return;
+	}
+
+	clear_dirty(cache, mg->old_oblock, mg->cblock);
+	mg->demoted = true;
+	queue_for_commit(mg);
+}
+
+static void promote(struct dm_cache_migration *mg)
+{
+	int r;
+	struct cache *cache = mg->cache;
+
+	r = dm_cache_insert_mapping(cache->cmd, mg->cblock, mg->new_oblock);
+	if (r) {
+		DMERR("failed to insert cache mapping");
+		migration_failure(mg);
+		return;
+	}
+
+	mg->promoted = true;
+	queue_for_commit(mg);
+}
+
+/*
+ * A migration whose io to the blocks in question has drained.
+ */
+static void issue_migration(struct dm_cache_migration *mg)
+{
+	if (mg->writeback)
+		issue_copy(mg, true);
+
+	else if (mg->demote)
+		demote(mg);
+
+	else
+		issue_copy(mg, false);
+}
+
+/*
+ * kcopyd has finished a copy for this migration.
+ */
+static void complete_migration(struct dm_cache_migration *mg)
+{
+	struct cache *cache = mg->cache;
+
+	if (mg->err) {
+		migration_failure(mg);
+		return;
+	}
+
+	if (mg->writeback && !mg->demoted && !mg->promote) {
+		/* plain writeback */
+		clear_dirty(cache, mg->old_oblock, mg->cblock);
+		cell_defer(cache, mg->old_ocell, false);
+		free_migration(mg);
+
+	} else if (mg->demote && !mg->demoted)
+		demote(mg);
+
+	else
+		promote(mg);
+}
+
+/*
+ * The metadata change of this migration has been committed.
+ */
+static void migration_committed(struct dm_cache_migration *mg)
+{
+	struct cache *cache = mg->cache;
+
+	if (mg->err) {
+		/* a demotion that didn't commit still holds the old cell */
+		if (mg->demoted && !mg->promoted)
+			cell_defer(cache, mg->old_ocell, false);
+
+		migration_failure(mg);
+		return;
+	}
+
+	if (mg->promoted) {
+		atomic_inc(&cache->stats.promotion);
+		cell_defer(cache, mg->new_ocell, true);
+		free_migration(mg);
+		return;
+	}
+
+	/*
+	 * Demoted; the old block is on the origin again, so its io may
+	 * proceed while we bring the new block in.
+	 */
+	atomic_inc(&cache->stats.demotion);
+	cell_defer(cache, mg->old_ocell, false);
+	issue_copy(mg, false);
+}
+
+static void process_migrations(struct cache *cache, struct list_head *head,
+			       void (*fn)(struct dm_cache_migration *))
+{
+	unsigned long flags;
+	struct list_head list;
+	struct dm_cache_migration *mg, *tmp;
+
+	INIT_LIST_HEAD(&list);
+	spin_lock_irqsave(&cache->lock, flags);
+	list_splice_init(head, &list);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	list_for_each_entry_safe(mg, tmp, &list, list) {
+		list_del_init(&mg->list);
+		fn(mg);
+	}
+}
+
+/*
+ * Sends the migration off to wait for the io in flight to its blocks.
+ */
+static void quiesce_migration(struct dm_cache_migration *mg)
+{
+	unsigned long flags;
+	struct cache *cache = mg->cache;
+
+	if (!dm_deferred_set_add_work(&cache->all_io_ds, &mg->list)) {
+		spin_lock_irqsave(&cache->lock, flags);
+		list_add_tail(&mg->list, &cache->quiesced_migrations);
+		spin_unlock_irqrestore(&cache->lock, flags);
+	}
+}
+
+static int ensure_next_migration(struct cache *cache)
+{
+	if (cache->next_migration)
+		return 0;
+
+	cache->next_migration = mempool_alloc(cache->migration_pool, GFP_ATOMIC);
+
+	return cache->next_migration ? 0 : -ENOMEM;
+}
+
+static struct dm_cache_migration *get_next_migration(struct cache *cache)
+{
+	struct dm_cache_migration *mg = cache->next_migration;
+
+	BUG_ON(!mg);
+	cache->next_migration = NULL;
+
+	memset(mg, 0, sizeof(*mg));
+	INIT_LIST_HEAD(&mg->list);
+	mg->cache = cache;
+	atomic_inc(&cache->nr_migrations);
+
+	return mg;
+}
+
+static void start_promotion(struct cache *cache, dm_oblock_t oblock,
+			    dm_cblock_t cblock, struct dm_bio_prison_cell *cell)
+{
+	struct dm_cache_migration *mg = get_next_migration(cache);
+
+	mg->promote = true;
+	mg->new_oblock = oblock;
+	mg->cblock = cblock;
+	mg->new_ocell = cell;
+
+	quiesce_migration(mg);
+}
+
+static void start_writeback(struct cache *cache, dm_oblock_t oblock,
+			    dm_cblock_t cblock, struct dm_bio_prison_cell *cell)
+{
+	struct dm_cache_migration *mg = get_next_migration(cache);
+
+	mg->writeback = true;
+	mg->old_oblock = oblock;
+	mg->cblock = cblock;
+	mg->old_ocell = cell;
+
+	quiesce_migration(mg);
+}
+
+static void start_demote_then_promote(struct cache *cache,
+				      dm_oblock_t old_oblock, dm_oblock_t new_oblock,
+				      dm_cblock_t cblock,
+				      struct dm_bio_prison_cell *old_ocell,
+				      struct dm_bio_prison_cell *new_ocell)
+{
+	struct dm_cache_migration *mg = get_next_migration(cache);
+
+	mg->writeback = is_dirty(cache, cblock);
+	mg->demote = true;
+	mg->promote = true;
+	mg->old_oblock = old_oblock;
+	mg->new_oblock = new_oblock;
+	mg->cblock = cblock;
+	mg->old_ocell = old_ocell;
+	mg->new_ocell = new_ocell;
+
+	quiesce_migration(mg);
+}
+
+/*----------------------------------------------------------------
+ * bio processing
+ *--------------------------------------------------------------*/
+static void process_bio(struct cache *cache, struct bio *bio)
+{
+	int r;
+	bool release_cell = true;
+	dm_oblock_t block = get_bio_block(cache, bio);
+	struct dm_bio_prison_cell *old_ocell, *new_ocell;
+	struct policy_result lookup_result;
+	struct dm_cell_key key;
+
+	/*
+	 * Check to see if that block is currently migrating.
+	 */
+	build_key(block, &key);
+	r = dm_bio_detain(cache->prison, &key, bio, &new_ocell);
+	if (r > 0)
+		return;
+
+	r = policy_map(cache->policy, block, true,
+		       spare_migration_bandwidth(cache), bio, &lookup_result);
+	if (r == -EWOULDBLOCK)
+		/* migration has been denied */
+		lookup_result.op = POLICY_MISS;
+
+	switch (lookup_result.op) {
+	case POLICY_HIT:
+		remap_hit(cache, bio, block, lookup_result.cblock);
+		inc_and_issue(cache, bio);
+		break;
+
+	case POLICY_MISS:
+		remap_miss(cache, bio);
+		inc_and_issue(cache, bio);
+		break;
+
+	case POLICY_NEW:
+		start_promotion(cache, block, lookup_result.cblock, new_ocell);
+		release_cell = false;
+		break;
+
+	case POLICY_REPLACE:
+		build_key(lookup_result.old_oblock, &key);
+		r = dm_bio_detain(cache->prison, &key, bio, &old_ocell);
+		if (r > 0) {
+			/*
+			 * We have to be careful to avoid lock inversion of
+			 * the cells.  So we back off, and wait for the
+			 * old_ocell to become free.
+			 */
+			policy_force_mapping(cache->policy, block,
+					     lookup_result.old_oblock);
+			break;
+		}
+
+		start_demote_then_promote(cache, lookup_result.old_oblock, block,
+					  lookup_result.cblock, old_ocell, new_ocell);
+		release_cell = false;
+		break;
+
+	default:
+		DMERR_LIMIT("%s: erroring bio, unknown policy op: %u", __func__,
+			    (unsigned) lookup_result.op);
+		bio_io_error(bio);
+	}
+
+	if (release_cell)
+		cell_defer(cache, new_ocell, false);
+}
+
+static void process_deferred_bios(struct cache *cache)
+{
+	unsigned long flags;
+	struct bio_list bios;
+	struct bio *bio;
+
+	bio_list_init(&bios);
+
+	spin_lock_irqsave(&cache->lock, flags);
+	bio_list_merge(&bios, &cache->deferred_bios);
+	bio_list_init(&cache->deferred_bios);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	while ((bio = bio_list_pop(&bios))) {
+		/*
+		 * If we've got no free migration structs, and processing
+		 * this bio might require one, we pause until there are some
+		 * prepared mappings to process.
+		 */
+		if (ensure_next_migration(cache)) {
+			spin_lock_irqsave(&cache->lock, flags);
+			bio_list_add(&cache->deferred_bios, bio);
+			bio_list_merge(&cache->deferred_bios, &bios);
+			spin_unlock_irqrestore(&cache->lock, flags);
+			break;
+		}
+
+		process_bio(cache, bio);
+	}
+}
+
+static void process_deferred_writethrough_bios(struct cache *cache)
+{
+	unsigned long flags;
+	struct bio_list bios;
+	struct bio *bio;
+
+	bio_list_init(&bios);
+
+	spin_lock_irqsave(&cache->lock, flags);
+	bio_list_merge(&bios, &cache->deferred_writethrough_bios);
+	bio_list_init(&cache->deferred_writethrough_bios);
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	while ((bio = bio_list_pop(&bios)))
+		generic_make_request(bio);
+}
+
+/*
+ * Hands dirty blocks the policy wants cleaned to kcopyd, as long as there
+ * is migration bandwidth to spare.
+ */
+static void writeback_some_dirty_blocks(struct cache *cache)
+{
+	int r;
+	dm_oblock_t oblock;
+	dm_cblock_t cblock;
+	struct dm_bio_prison_cell *old_ocell;
+	struct dm_cell_key key;
+
+	while (!cache->quiescing && spare_migration_bandwidth(cache)) {
+		if (ensure_next_migration(cache))
+			break;
+
+		r = policy_writeback_work(cache->policy, &oblock, &cblock);
+		if (r)
+			break;
+
+		build_key(oblock, &key);
+		r = dm_bio_detain(cache->prison, &key, NULL, &old_ocell);
+		if (r > 0) {
+			/* the block is busy, try again later */
+			policy_set_dirty(cache->policy, oblock);
+			break;
+		}
+
+		start_writeback(cache, oblock, cblock, old_ocell);
+	}
+}
+
+/*----------------------------------------------------------------
+ * Main worker loop
+ *--------------------------------------------------------------*/
+static bool need_commit(struct cache *cache)
+{
+	bool r;
+	unsigned long flags;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	r = cache->commit_requested || !list_empty(&cache->need_commit_migrations);
+	cache->commit_requested = false;
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	return r;
+}
+
+static void commit_migrations(struct cache *cache)
+{
+	int r;
+	unsigned long flags;
+	struct dm_cache_migration *mg;
+
+	if (!need_commit(cache))
+		return;
+
+	r = dm_cache_commit(cache->cmd, false);
+	if (r) {
+		DMERR("%s: dm_cache_commit() failed, error = %d", __func__, r);
+
+		spin_lock_irqsave(&cache->lock, flags);
+		list_for_each_entry(mg, &cache->need_commit_migrations, list)
+			mg->err = true;
+		spin_unlock_irqrestore(&cache->lock, flags);
+	}
+
+	process_migrations(cache, &cache->need_commit_migrations, migration_committed);
+}
+
+static void do_worker(struct work_struct *ws)
+{
+	struct cache *cache = container_of(ws, struct cache, worker);
+
+	process_deferred_bios(cache);
+	process_migrations(cache, &cache->quiesced_migrations, issue_migration);
+	process_migrations(cache, &cache->completed_migrations, complete_migration);
+	writeback_some_dirty_blocks(cache);
+	process_deferred_writethrough_bios(cache);
+	commit_migrations(cache);
+}
+
+/*
+ * We want to commit periodically so that not too much
+ * unwritten metadata builds up, and to tick the policy.
+ */
+static void do_waker(struct work_struct *ws)
+{
+	unsigned long flags;
+	struct cache *cache = container_of(to_delayed_work(ws), struct cache, waker);
+
+	policy_tick(cache->policy);
+
+	spin_lock_irqsave(&cache->lock, flags);
+	cache->commit_requested = true;
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	wake_worker(cache);
+	queue_delayed_work(cache->wq, &cache->waker, COMMIT_PERIOD);
+}
+
+/*----------------------------------------------------------------*/
+
+static int is_congested(struct dm_dev *dev, int bdi_bits)
+{
+	struct request_queue *q = bdev_get_queue(dev->bdev);
+
+	return bdi_congested(&q->backing_dev_info, bdi_bits);
+}
+
+static int cache_is_congested(struct dm_target_callbacks *cb, int bdi_bits)
+{
+	struct cache *cache = container_of(cb, struct cache, callbacks);
+
+	return is_congested(cache->origin_dev, bdi_bits) ||
+		is_congested(cache->cache_dev, bdi_bits);
+}
+
+/*----------------------------------------------------------------
+ * Target methods
+ *--------------------------------------------------------------*/
+static void destroy(struct cache *cache)
+{
+	unsigned i;
+
+	if (cache->next_migration)
+		mempool_free(cache->next_migration, cache->migration_pool);
+
+	if (cache->migration_pool)
+		mempool_destroy(cache->migration_pool);
+
+	if (cache->endio_hook_pool)
+		mempool_destroy(cache->endio_hook_pool);
+
+	if (cache->prison)
+		dm_bio_prison_destroy(cache->prison);
+
+	if (cache->wq) {
+		cancel_delayed_work_sync(&cache->waker);
+		destroy_workqueue(cache->wq);
+	}
+
+	if (cache->dirty_bitset)
+		vfree(cache->dirty_bitset);
+
+	if (cache->copier)
+		dm_kcopyd_client_destroy(cache->copier);
+
+	if (cache->cmd)
+		dm_cache_metadata_close(cache->cmd);
+
+	if (cache->metadata_dev)
+		dm_put_device(cache->ti, cache->metadata_dev);
+
+	if (cache->origin_dev)
+		dm_put_device(cache->ti, cache->origin_dev);
+
+	if (cache->cache_dev)
+		dm_put_device(cache->ti, cache->cache_dev);
+
+	if (cache->policy)
+		dm_cache_policy_destroy(cache->policy);
+
+	for (i = 0; i < cache->nr_ctr_args; i++)
+		kfree(cache->ctr_args[i]);
+	kfree(cache->ctr_args);
+
+	kfree(cache);
+}
+
+static void cache_dtr(struct dm_target *ti)
+{
+	struct cache *cache = ti->private;
+
+	destroy(cache);
+}
+
+static sector_t get_dev_size(struct dm_dev *dev)
+{
+	return i_size_read(dev->bdev->bd_inode) >> SECTOR_SHIFT;
+}
+
+/*----------------------------------------------------------------*/
+
+/*
+ * Construct a cache device mapping.
+ *
+ * cache <metadata dev> <cache dev> <origin dev> <block size>
+ *       <#feature args> [<feature arg>]*
+ *       <policy> <#policy args> [<policy arg>]*
+ *
+ * metadata dev    : fast device holding the persistent metadata
+ * cache dev	   : fast device holding cached data blocks
+ * origin dev	   : slow device holding original data blocks
+ * block size	   : cache unit size in sectors
+ *
+ * #feature args   : number of feature arguments passed
+ * feature args    : writethrough.  (The default is writeback.)
+ *
+ * policy	   : the replacement policy to use
+ * #policy args    : an even number of policy arguments corresponding
+ *		     to key/value pairs passed to the policy
+ * policy args	   : key/value pairs passed to the policy
+ *		     E.g. 'sequential_threshold 1024'
+ *		     See Documentation/device-mapper/cache.txt.
+ *
+ * Optional feature arguments are:
+ *   writethrough  : write through caching that prohibits cache block
+ *		     content from being different from origin block content.
+ *		     Without this argument, the default behaviour is to write
+ *		     back cache block contents later for performance reasons,
+ *		     so they may differ from the corresponding origin blocks.
+ */
+struct cache_args {
+	struct dm_target *ti;
+
+	struct dm_dev *metadata_dev;
+
+	struct dm_dev *cache_dev;
+	sector_t cache_sectors;
+
+	struct dm_dev *origin_dev;
+	sector_t origin_sectors;
+
+	uint32_t block_size;
+
+	const char *policy_name;
+	unsigned policy_argc;
+	const char **policy_argv;
+
+	struct cache_features features;
+};
+
+static void destroy_cache_args(struct cache_args *ca)
+{
+	if (ca->metadata_dev)
+		dm_put_device(ca->ti, ca->metadata_dev);
+
+	if (ca->cache_dev)
+		dm_put_device(ca->ti, ca->cache_dev);
+
+	if (ca->origin_dev)
+		dm_put_device(ca->ti, ca->origin_dev);
+
+	kfree(ca);
+}
+
+static bool at_least_one_arg(struct dm_arg_set *as, char **error)
+{
+	if (!as->argc) {
+		*error = "Insufficient args";
+		return false;
+	}
+
+	return true;
+}
+
+static int parse_metadata_dev(struct cache_args *ca, struct dm_arg_set *as,
+			      char **error)
+{
+	int r;
+	sector_t metadata_dev_size;
+
+	if (!at_least_one_arg(as, error))
+		return -EINVAL;
+
+	r = dm_get_device(ca->ti, dm_shift_arg(as), FMODE_READ | FMODE_WRITE,
+			  &ca->metadata_dev);
+	if (r) {
+		*error = "Error opening metadata device";
+		return r;
+	}
+
+	metadata_dev_size = get_dev_size(ca->metadata_dev);
+	if (metadata_dev_size > DM_CACHE_METADATA_MAX_SECTORS) {
+		*error = "Metadata device is too large";
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int parse_cache_dev(struct cache_args *ca, struct dm_arg_set *as,
+			   char **error)
+{
+	int r;
+
+	if (!at_least_one_arg(as, error))
+		return -EINVAL;
+
+	r = dm_get_device(ca->ti, dm_shift_arg(as), FMODE_READ | FMODE_WRITE,
+			  &ca->cache_dev);
+	if (r) {
+		*error = "Error opening cache device";
+		return r;
+	}
+	ca->cache_sectors = get_dev_size(ca->cache_dev);
+
+	return 0;
+}
+
+static int parse_origin_dev(struct cache_args *ca, struct dm_arg_set *as,
+			    char **error)
+{
+	int r;
+
+	if (!at_least_one_arg(as, error))
+		return -EINVAL;
+
+	r = dm_get_device(ca->ti, dm_shift_arg(as), FMODE_READ | FMODE_WRITE,
+			  &ca->origin_dev);
+	if (r) {
+		*error = "Error opening origin device";
+		return r;
+	}
+
+	ca->origin_sectors = get_dev_size(ca->origin_dev);
+	if (ca->ti->len > ca->origin_sectors) {
+		*error = "Device size larger than cached device";
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int parse_block_size(struct cache_args *ca, struct dm_arg_set *as,
+			    char **error)
+{
+	unsigned long tmp;
+
+	if (!at_least_one_arg(as, error))
+		return -EINVAL;
+
+	if (kstrtoul(dm_shift_arg(as), 10, &tmp) || !tmp ||
+	    tmp < DATA_DEV_BLOCK_SIZE_MIN_SECTORS ||
+	    tmp > DATA_DEV_BLOCK_SIZE_MAX_SECTORS ||
+	    !is_power_of_2(tmp)) {
+		*error = "Invalid data block size";
+		return -EINVAL;
+	}
+
+	if (tmp > ca->cache_sectors) {
+		*error = "Data block size is larger than the cache device";
+		return -EINVAL;
+	}
+
+	ca->block_size = tmp;
+
+	return 0;
+}
+
+static void init_features(struct cache_features *cf)
+{
+	cf->io_mode = CM_IO_WRITEBACK;
+}
+
+static int parse_features(struct cache_args *ca, struct dm_arg_set *as,
+			  char **error)
+{
+	static struct dm_arg _args[] = {
+		{0, 1, "Invalid number of cache feature arguments"},
+	};
+
+	int r;
+	unsigned argc;
+	const char *arg;
+	struct cache_features *cf = &ca->features;
+
+	init_features(cf);
+
+	r = dm_read_arg_group(_args, as, &argc, error);
+	if (r)
+		return -EINVAL;
+
+	while (argc--) {
+		arg = dm_shift_arg(as);
+
+		if (!strcasecmp(arg, "writeback"))
+			cf->io_mode = CM_IO_WRITEBACK;
+
+		else if (!strcasecmp(arg, "writethrough"))
+			cf->io_mode = CM_IO_WRITETHROUGH;
+
+		else {
+			*error = "Unrecognised cache feature requested";
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+static int parse_policy(struct cache_args *ca, struct dm_arg_set *as,
+			char **error)
+{
+	static struct dm_arg _args[] = {
+		{0, 1024, "Invalid number of policy arguments"},
+	};
+
+	int r;
+
+	if (!at_least_one_arg(as, error))
+		return -EINVAL;
+
+	ca->policy_name = dm_shift_arg(as);
+
+	r = dm_read_arg_group(_args, as, &ca->policy_argc, error);
+	if (r)
+		return -EINVAL;
+
+	ca->policy_argv = (const char **)as->argv;
+	dm_consume_args(as, ca->policy_argc);
+
+	return 0;
+}
+
+static int parse_cache_args(struct cache_args *ca, int argc, char **argv,
+			    char **error)
+{
+	int r;
+	struct dm_arg_set as;
+
+	as.argc = argc;
+	as.argv = argv;
+
+	r = parse_metadata_dev(ca, &as, error);
+	if (r)
+		return r;
+
+	r = parse_cache_dev(ca, &as, error);
+	if (r)
+		return r;
+
+	r = parse_origin_dev(ca, &as, error);
+	if (r)
+		return r;
+
+	r = parse_block_size(ca, &as, error);
+	if (r)
+		return r;
+
+	r = parse_features(ca, &as, error);
+	if (r)
+		return r;
+
+	r = parse_policy(ca, &as, error);
+	if (r)
+		return r;
+
+	return 0;
+}
+
+/*----------------------------------------------------------------*/
+
+static int set_config_value(struct cache *cache, const char *key, const char *value)
+{
+	unsigned long tmp;
+
+	if (!strcasecmp(key, "migration_threshold")) {
+		if (kstrtoul(value, 10, &tmp))
+			return -EINVAL;
+
+		cache->migration_threshold = tmp;
+		return 0;
+	}
+
+	return policy_set_config_value(cache->policy, key, value);
+}
+
+static int set_config_values(struct cache *cache, unsigned argc, const char **argv)
+{
+	int r = 0;
+
+	if (argc & 1) {
+		DMWARN("Odd number of policy arguments given but they should be <key> <value> pairs.");
+		return -EINVAL;
+	}
+
+	while (argc) {
+		r = set_config_value(cache, argv[0], argv[1]);
+		if (r) {
+			DMWARN("set_config_value failed for key '%s'", argv[0]);
+			break;
+		}
+
+		argc -= 2;
+		argv += 2;
+	}
+
+	return r;
+}
+
+static int create_cache_policy(struct cache *cache, struct cache_args *ca,
+			       char **error)
+{
+	cache->policy =	dm_cache_policy_create(ca->policy_name,
+					       cache->cache_size,
+					       cache->origin_blocks,
+					       cache->sectors_per_block);
+	if (!cache->policy) {
+		*error = "Error creating cache's policy";
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static int load_mapping(void *context, dm_oblock_t oblock, dm_cblock_t cblock,
+			bool dirty)
+{
+	int r;
+	struct cache *cache = context;
+
+	r = policy_load_mapping(cache->policy, oblock, cblock);
+	if (r)
+		return r;
+
+	if (dirty)
+		set_dirty(cache, oblock, cblock);
+
+	return 0;
+}
+
+static int cache_create(struct cache_args *ca, struct cache **result)
+{
+	int r = 0;
+	char **error = &ca->ti->error;
+	struct cache *cache;
+	struct dm_target *ti = ca->ti;
+	struct dm_cache_statistics stats;
+	struct dm_cache_metadata *cmd;
+
+	cache = kzalloc(sizeof(*cache), GFP_KERNEL);
+	if (!cache)
+		return -ENOMEM;
+
+	cache->ti = ca->ti;
+	ti->private = cache;
+	ti->split_io = ca->block_size;
+	ti->num_flush_requests = 2;
+	ti->num_discard_requests = 0;
+
+	cache->features = ca->features;
+
+	cache->metadata_dev = ca->metadata_dev;
+	cache->origin_dev = ca->origin_dev;
+	cache->cache_dev = ca->cache_dev;
+
+	ca->metadata_dev = ca->origin_dev = ca->cache_dev = NULL;
+
+	cache->sectors_per_block = ca->block_size;
+	cache->sectors_per_block_shift = __ffs(ca->block_size);
+	cache->origin_blocks = to_oblock(ti->len >> cache->sectors_per_block_shift);
+	cache->cache_size = to_cblock(ca->cache_sectors >> cache->sectors_per_block_shift);
+
+	cache->migration_threshold = DEFAULT_MIGRATION_THRESHOLD;
+
+	r = create_cache_policy(cache, ca, error);
+	if (r)
+		goto bad;
+
+	r = set_config_values(cache, ca->policy_argc, ca->policy_argv);
+	if (r) {
+		*error = "Error setting cache policy's config values";
+		goto bad;
+	}
+
+	cmd = dm_cache_metadata_open(cache->metadata_dev->bdev,
+				     ca->block_size);
+	if (IS_ERR(cmd)) {
+		*error = "Error creating metadata object";
+		r = PTR_ERR(cmd);
+		goto bad;
+	}
+	cache->cmd = cmd;
+
+	if (from_cblock(dm_cache_size(cmd)) != from_cblock(cache->cache_size)) {
+		r = dm_cache_resize(cmd, cache->cache_size);
+		if (r) {
+			*error = "Couldn't resize cache device, mapped blocks beyond its end";
+			goto bad;
+		}
+	}
+
+	spin_lock_init(&cache->lock);
+	bio_list_init(&cache->deferred_bios);
+	bio_list_init(&cache->deferred_writethrough_bios);
+	INIT_LIST_HEAD(&cache->quiesced_migrations);
+	INIT_LIST_HEAD(&cache->completed_migrations);
+	INIT_LIST_HEAD(&cache->need_commit_migrations);
+	atomic_set(&cache->nr_migrations, 0);
+	init_waitqueue_head(&cache->migration_wait);
+	dm_deferred_set_init(&cache->all_io_ds);
+
+	cache->dirty_bitset = vzalloc(BITS_TO_LONGS(from_cblock(cache->cache_size)) *
+				      sizeof(unsigned long));
+	if (!cache->dirty_bitset) {
+		*error = "could not allocate dirty bitset";
+		r = -ENOMEM;
+		goto bad;
+	}
+	atomic_set(&cache->nr_dirty, 0);
+
+	cache->copier = dm_kcopyd_client_create();
+	if (IS_ERR(cache->copier)) {
+		*error = "could not create kcopyd client";
+		r = PTR_ERR(cache->copier);
+		cache->copier = NULL;
+		goto bad;
+	}
+
+	cache->wq = alloc_ordered_workqueue("dm-" DM_MSG_PREFIX, WQ_MEM_RECLAIM);
+	if (!cache->wq) {
+		*error = "could not create workqueue for metadata object";
+		r = -ENOMEM;
+		goto bad;
+	}
+	INIT_WORK(&cache->worker, do_worker);
+	INIT_DELAYED_WORK(&cache->waker, do_waker);
+
+	cache->prison = dm_bio_prison_create(PRISON_CELLS);
+	if (!cache->prison) {
+		*error = "could not create bio prison";
+		r = -ENOMEM;
+		goto bad;
+	}
+
+	cache->endio_hook_pool = mempool_create_kmalloc_pool(ENDIO_HOOK_POOL_SIZE,
+		writethrough_mode(&cache->features) ? PB_DATA_SIZE_WT : PB_DATA_SIZE_WB);
+	if (!cache->endio_hook_pool) {
+		*error = "Error creating cache's endio_hook mempool";
+		r = -ENOMEM;
+		goto bad;
+	}
+
+	cache->migration_pool = mempool_create_slab_pool(MIGRATION_POOL_SIZE,
+							 migration_cache);
+	if (!cache->migration_pool) {
+		*error = "Error creating cache's migration mempool";
+		r = -ENOMEM;
+		goto bad;
+	}
+
+	r = dm_cache_load_mappings(cache->cmd, load_mapping, cache);
+	if (r) {
+		*error = "could not load cache mappings";
+		goto bad;
+	}
+
+	dm_cache_metadata_get_stats(cache->cmd, &stats);
+	atomic_set(&cache->stats.read_hit, stats.read_hits);
+	atomic_set(&cache->stats.read_miss, stats.read_misses);
+	atomic_set(&cache->stats.write_hit, stats.write_hits);
+	atomic_set(&cache->stats.write_miss, stats.write_misses);
+	atomic_set(&cache->stats.demotion, 0);
+	atomic_set(&cache->stats.promotion, 0);
+
+	cache->callbacks.congested_fn = cache_is_congested;
+	dm_table_add_target_callbacks(ti->table, &cache->callbacks);
+
+	*result = cache;
+	return 0;
+
+bad:
+	destroy(cache);
+	return r;
+}
+
+static int copy_ctr_args(struct cache *cache, int argc, const char **argv)
+{
+	unsigned i;
+	const char **copy;
+
+	copy = kcalloc(argc, sizeof(*copy), GFP_KERNEL);
+	if (!copy)
+		return -ENOMEM;
+	for (i = 0; i < argc; i++) {
+		copy[i] = kstrdup(argv[i], GFP_KERNEL);
+		if (!copy[i]) {
+			while (i--)
+				kfree(copy[i]);
+			kfree(copy);
+			return -ENOMEM;
+		}
+	}
+
+	cache->nr_ctr_args = argc;
+	cache->ctr_args = copy;
+
+	return 0;
+}
+
+static int cache_ctr(struct dm_target *ti, unsigned argc, char **argv)
+{
+	int r = -EINVAL;
+	struct cache_args *ca;
+	struct cache *cache = NULL;
+
+	ca = kzalloc(sizeof(*ca), GFP_KERNEL);
+	if (!ca) {
+		ti->error = "Error allocating memory for cache";
+		return -ENOMEM;
+	}
+	ca->ti = ti;
+
+	r = parse_cache_args(ca, argc, argv, &ti->error);
+	if (r)
+		goto out;
+
+	r = cache_create(ca, &cache);
+	if (r)
+		goto out;
+
+	r = copy_ctr_args(cache, argc - 3, (const char **)argv + 3);
+	if (r) {
+		destroy(cache);
+		goto out;
+	}
+
+	ti->private = cache;
+
+out:
+	destroy_cache_args(ca);
+	return r;
+}
+
+static int cache_map(struct dm_target *ti, struct bio *bio,
+		     union map_info *map_context)
+{
+	struct cache *cache = ti->private;
+
+	int r;
+	dm_oblock_t block;
+	struct dm_bio_prison_cell *cell;
+	struct policy_result lookup_result;
+	struct per_bio_data *pb;
+	struct dm_cell_key key;
+	struct bio_list inmates;
+	unsigned long flags;
+
+	pb = mempool_alloc(cache->endio_hook_pool, GFP_NOIO);
+	pb->all_io_entry = NULL;
+	map_context->ptr = pb;
+
+	bio->bi_sector = dm_target_offset(ti, bio->bi_sector);
+
+	if (bio->bi_rw & REQ_FLUSH && !bio_sectors(bio)) {
+		/*
+		 * Mapping changes are committed before any io to the
+		 * blocks concerned completes, and the dirty bits only
+		 * matter after a clean shutdown, so there's nothing to
+		 * commit for a flush.
+		 */
+		if (map_context->target_request_nr)
+			remap_to_cache(cache, bio, to_cblock(0));
+		else
+			remap_to_origin(cache, bio);
+
+		return DM_MAPIO_REMAPPED;
+	}
+
+	block = get_bio_block(cache, bio);
+	if (from_oblock(block) >= from_oblock(cache->origin_blocks)) {
+		/*
+		 * This can only occur if the io goes to a partial block at
+		 * the end of the origin device.  We don't cache these.
+		 * Just remap to the origin and carry on.
+		 */
+		remap_to_origin(cache, bio);
+		return DM_MAPIO_REMAPPED;
+	}
+
+	/*
+	 * Check to see if that block is currently migrating.
+	 */
+	build_key(block, &key);
+	r = dm_bio_detain(cache->prison, &key, bio, &cell);
+	if (r > 0)
+		return DM_MAPIO_SUBMITTED;
+
+	r = policy_map(cache->policy, block, false, false, bio, &lookup_result);
+	if (r == -EWOULDBLOCK) {
+		/*
+		 * The policy wants to promote, or couldn't decide without
+		 * blocking.  Either way the worker takes over.
+		 */
+		cell_defer(cache, cell, true);
+		return DM_MAPIO_SUBMITTED;
+
+	} else if (r) {
+		DMERR_LIMIT("Unexpected return from cache replacement policy: %d", r);
+		bio_io_error(bio);
+		r = DM_MAPIO_SUBMITTED;
+		goto out;
+	}
+
+	switch (lookup_result.op) {
+	case POLICY_HIT:
+		remap_hit(cache, bio, block, lookup_result.cblock);
+		inc_ds(cache, bio);
+		break;
+
+	case POLICY_MISS:
+		remap_miss(cache, bio);
+		inc_ds(cache, bio);
+		break;
+
+	default:
+		DMERR_LIMIT("%s: erroring bio: unknown policy op: %u", __func__,
+			    (unsigned) lookup_result.op);
+		bio_io_error(bio);
+		r = DM_MAPIO_SUBMITTED;
+		goto out;
+	}
+	r = DM_MAPIO_REMAPPED;
+
+out:
+	/*
+	 * Other bios may have piled up in the cell meanwhile.
+	 */
+	bio_list_init(&inmates);
+	dm_cell_release_no_holder(cell, &inmates);
+	if (!bio_list_empty(&inmates)) {
+		spin_lock_irqsave(&cache->lock, flags);
+		bio_list_merge(&cache->deferred_bios, &inmates);
+		spin_unlock_irqrestore(&cache->lock, flags);
+		wake_worker(cache);
+	}
+
+	return r;
+}
+
+static int cache_end_io(struct dm_target *ti, struct bio *bio,
+			int error, union map_info *map_context)
+{
+	struct cache *cache = ti->private;
+	struct per_bio_data *pb = map_context->ptr;
+	struct list_head work;
+	unsigned long flags;
+
+	if (pb->all_io_entry) {
+		INIT_LIST_HEAD(&work);
+		dm_deferred_entry_dec(pb->all_io_entry, &work);
+
+		if (!list_empty(&work)) {
+			spin_lock_irqsave(&cache->lock, flags);
+			list_splice_tail(&work, &cache->quiesced_migrations);
+			spin_unlock_irqrestore(&cache->lock, flags);
+			wake_worker(cache);
+		}
+	}
+
+	mempool_free(pb, cache->endio_hook_pool);
+
+	return 0;
+}
+
+static int write_dirty_bits(struct cache *cache)
+{
+	unsigned i;
+	int r = 0;
+
+	for (i = 0; i < from_cblock(cache->cache_size); i++) {
+		r = dm_cache_set_dirty(cache->cmd, to_cblock(i),
+				       is_dirty(cache, to_cblock(i)));
+		if (r)
+			return r;
+	}
+
+	return r;
+}
+
+static void save_stats(struct cache *cache)
+{
+	struct dm_cache_statistics stats;
+
+	stats.read_hits = atomic_read(&cache->stats.read_hit);
+	stats.read_misses = atomic_read(&cache->stats.read_miss);
+	stats.write_hits = atomic_read(&cache->stats.write_hit);
+	stats.write_misses = atomic_read(&cache->stats.write_miss);
+
+	dm_cache_metadata_set_stats(cache->cmd, &stats);
+}
+
+static void cache_postsuspend(struct dm_target *ti)
+{
+	int r;
+	unsigned long flags;
+	struct cache *cache = ti->private;
+
+	cancel_delayed_work_sync(&cache->waker);
+
+	/*
+	 * No new writebacks, and wait for those in flight.  The worker
+	 * completes them.
+	 */
+	spin_lock_irqsave(&cache->lock, flags);
+	cache->quiescing = true;
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	wait_event(cache->migration_wait, !atomic_read(&cache->nr_migrations));
+	flush_workqueue(cache->wq);
+
+	r = write_dirty_bits(cache);
+	if (r)
+		DMERR("could not write dirty bitset");
+
+	save_stats(cache);
+
+	r = dm_cache_commit(cache->cmd, !r);
+	if (r)
+		DMERR("%s: dm_cache_commit() failed, error = %d", __func__, r);
+}
+
+static void cache_resume(struct dm_target *ti)
+{
+	unsigned long flags;
+	struct cache *cache = ti->private;
+
+	spin_lock_irqsave(&cache->lock, flags);
+	cache->quiescing = false;
+	spin_unlock_irqrestore(&cache->lock, flags);
+
+	/*
+	 * The on-disk dirty bits go stale as soon as we resume, so the
+	 * clean shutdown flag is cleared.
+	 */
+	if (dm_cache_commit(cache->cmd, false))
+		DMERR("%s: dm_cache_commit() failed", __func__);
+
+	do_waker(&cache->waker.work);
+}
+
+/*
+ * Status format:
+ *
+ * <#used metadata blocks>/<#total metadata blocks>
+ * <#read hits> <#read misses> <#write hits> <#write misses>
+ * <#demotions> <#promotions> <#blocks in cache> <#dirty>
+ * <#features> <features>*
+ * <#core args> <core args>
+ * <policy name> <#policy args> <policy args>*
+ */
+static void cache_status(struct dm_target *ti, status_type_t type,
+			 char *result, unsigned maxlen)
+{
+	int r = 0;
+	unsigned i;
+	unsigned sz = 0;
+	dm_block_t nr_free_blocks_metadata = 0;
+	dm_block_t nr_blocks_metadata = 0;
+	struct cache *cache = ti->private;
+	dm_cblock_t residency;
+
+	switch (type) {
+	case STATUSTYPE_INFO:
+		r = dm_cache_get_free_metadata_block_count(cache->cmd,
+							   &nr_free_blocks_metadata);
+		if (r) {
+			DMERR("could not get metadata free block count");
+			goto err;
+		}
+
+		r = dm_cache_get_metadata_dev_size(cache->cmd, &nr_blocks_metadata);
+		if (r) {
+			DMERR("could not get metadata device size");
+			goto err;
+		}
+
+		residency = policy_residency(cache->policy);
+
+		DMEMIT("%llu/%llu %u %u %u %u %u %u %llu %u ",
+		       (unsigned long long)(nr_blocks_metadata - nr_free_blocks_metadata),
+		       (unsigned long long)nr_blocks_metadata,
+		       (unsigned) atomic_read(&cache->stats.read_hit),
+		       (unsigned) atomic_read(&cache->stats.read_miss),
+		       (unsigned) atomic_read(&cache->stats.write_hit),
+		       (unsigned) atomic_read(&cache->stats.write_miss),
+		       (unsigned) atomic_read(&cache->stats.demotion),
+		       (unsigned) atomic_read(&cache->stats.promotion),
+		       (unsigned long long) from_cblock(residency),
+		       (unsigned) atomic_read(&cache->nr_dirty));
+
+		if (writethrough_mode(&cache->features))
+			DMEMIT("1 writethrough ");
+		else
+			DMEMIT("0 ");
+
+		DMEMIT("2 migration_threshold %u ", cache->migration_threshold);
+		DMEMIT("%s ", dm_cache_policy_get_name(cache->policy));
+		r = policy_emit_config_values(cache->policy, result + sz, maxlen - sz);
+		if (r)
+			DMERR("policy_emit_config_values returned %d", r);
+
+		break;
+
+	case STATUSTYPE_TABLE:
+		DMEMIT("%s", cache->metadata_dev->name);
+		DMEMIT(" %s", cache->cache_dev->name);
+		DMEMIT(" %s", cache->origin_dev->name);
+
+		for (i = 0; i < cache->nr_ctr_args; i++)
+			DMEMIT(" %s", cache->ctr_args[i]);
+		break;
+	}
+
+	return;
+
+err:
+	DMEMIT("Error");
+}
+
+/*
+ * Supports <key> <value>.
+ *
+ * The key migration_threshold is supported by the cache target core.
+ */
+static int cache_message(struct dm_target *ti, unsigned argc, char **argv)
+{
+	struct cache *cache = ti->private;
+
+	if (argc != 2)
+		return -EINVAL;
+
+	return set_config_value(cache, argv[0], argv[1]);
+}
+
+static int cache_iterate_devices(struct dm_target *ti,
+				 iterate_devices_callout_fn fn, void *data)
+{
+	int r = 0;
+	struct cache *cache = ti->private;
+
+	r = fn(ti, cache->cache_dev, 0, get_dev_size(cache->cache_dev), data);
+	if (!r)
+		r = fn(ti, cache->origin_dev, 0, ti->len, data);
+
+	return r;
+}
+
+static void cache_io_hints(struct dm_target *ti, struct queue_limits *limits)
+{
+	struct cache *cache = ti->private;
+
+	blk_limits_io_min(limits, 0);
+	blk_limits_io_opt(limits, cache->sectors_per_block << SECTOR_SHIFT);
+}
+
+/*----------------------------------------------------------------*/
+
+static struct target_type cache_target = {
+	.name = "cache",
+	.version = {1, 0, 0},
+	.module = THIS_MODULE,
+	.ctr = cache_ctr,
+	.dtr = cache_dtr,
+	.map = cache_map,
+	.end_io = cache_end_io,
+	.postsuspend = cache_postsuspend,
+	.resume = cache_resume,
+	.status = cache_status,
+	.message = cache_message,
+	.iterate_devices = cache_iterate_devices,
+	.io_hints = cache_io_hints,
+};
+
+static int __init dm_cache_init(void)
+{
+	int r;
+
+	r = dm_register_target(&cache_target);
+	if (r) {
+		DMERR("cache target registration failed: %d", r);
+		return r;
+	}
+
+	migration_cache = KMEM_CACHE(dm_cache_migration, 0);
+	if (!migration_cache) {
+		dm_unregister_target(&cache_target);
+		return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void __exit dm_cache_exit(void)
+{
+	dm_unregister_target(&cache_target);
+	kmem_cache_destroy(migration_cache);
+}
+
+module_init(dm_cache_init);
+module_exit(dm_cache_exit);
+
+MODULE_DESCRIPTION(DM_NAME " cache target");
+MODULE_AUTHOR("Joe Thornber <ejt@redhat.com>");
+MODULE_LICENSE("GPL");
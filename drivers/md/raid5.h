@@ -208,6 +208,9 @@ struct stripe_head {
 	atomic_t		count;	      /* nr of active thread/requests */
 	int			bm_seq;	/* sequence number for bitmap flushes */
 	int			disks;		/* disks in stripe */
+	int			cpu;		/* cpu the stripe was set up on */
+	struct r5worker_group	*group;		/* worker group whose handle_list
+						 * holds this stripe, if any */
 	enum check_states	check_state;
 	enum reconstruct_states reconstruct_state;
 	/**
@@ -347,6 +350,24 @@ struct disk_info {
 	struct md_rdev	*rdev;
 };
 
+/*
+ * Optional worker threads that handle stripes instead of raid5d.  There
+ * is one group per NUMA node; a stripe is queued to the group of the
+ * cpu it was set up on and handled by that group's workers.
+ */
+struct r5worker {
+	struct work_struct	work;
+	struct r5worker_group	*group;
+	bool			working;
+};
+
+struct r5worker_group {
+	struct list_head	handle_list; /* stripes for this group */
+	struct r5conf		*conf;
+	struct r5worker		*workers;
+	int			stripes_cnt;
+};
+
 struct r5conf {
 	struct hlist_head	*stripe_hashtbl;
 	struct mddev		*mddev;
@@ -437,6 +458,9 @@ struct r5conf {
 	 * the new thread here until we fully activate the array.
 	 */
 	struct md_thread	*thread;
+	struct r5worker_group	*worker_groups;
+	int			group_cnt;
+	int			worker_cnt_per_group;
 };
 
 /*
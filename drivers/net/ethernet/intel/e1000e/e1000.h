@@ -41,6 +41,7 @@
 #include <linux/pci-aspm.h>
 #include <linux/crc32.h>
 #include <linux/if_vlan.h>
+#include <linux/net_dim.h>
 
 #include "hw.h"
 
@@ -294,8 +295,7 @@ struct e1000_adapter {
 	/* Interrupt Throttle Rate */
 	u32 itr;
 	u32 itr_setting;
-	u16 tx_itr;
-	u16 rx_itr;
+	struct net_dim dim;	/* dynamic ITR state, itr_setting 1-3 */
 
 	/*
 	 * Tx
@@ -475,13 +475,6 @@ enum e1000_state_t {
 	__E1000_DOWN
 };
 
-enum latency_range {
-	lowest_latency = 0,
-	low_latency = 1,
-	bulk_latency = 2,
-	latency_invalid = 255
-};
-
 extern char e1000e_driver_name[];
 extern const char e1000e_driver_version[];
 
@@ -492,6 +485,7 @@ extern int e1000e_up(struct e1000_adapter *adapter);
 extern void e1000e_down(struct e1000_adapter *adapter);
 extern void e1000e_reinit_locked(struct e1000_adapter *adapter);
 extern void e1000e_reset(struct e1000_adapter *adapter);
+extern void e1000e_init_itr(struct e1000_adapter *adapter);
 extern void e1000e_power_up_phy(struct e1000_adapter *adapter);
 extern int e1000e_setup_rx_resources(struct e1000_adapter *adapter);
 extern int e1000e_setup_tx_resources(struct e1000_adapter *adapter);
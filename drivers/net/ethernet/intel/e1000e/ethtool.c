@@ -1858,6 +1858,8 @@ static int e1000_get_coalesce(struct net_device *netdev,
 		ec->rx_coalesce_usecs = adapter->itr_setting;
 	else
 		ec->rx_coalesce_usecs = 1000000 / adapter->itr_setting;
+	ec->use_adaptive_rx_coalesce =
+		net_dim_usecs_is_dynamic(adapter->itr_setting);
 
 	return 0;
 }
@@ -1870,8 +1872,7 @@ static int e1000_set_coalesce(struct net_device *netdev,
 
 	if ((ec->rx_coalesce_usecs > E1000_MAX_ITR_USECS) ||
 	    ((ec->rx_coalesce_usecs > 4) &&
-	     (ec->rx_coalesce_usecs < E1000_MIN_ITR_USECS)) ||
-	    (ec->rx_coalesce_usecs == 2))
+	     (ec->rx_coalesce_usecs < E1000_MIN_ITR_USECS)))
 		return -EINVAL;
 
 	if (ec->rx_coalesce_usecs == 4) {
@@ -1879,6 +1880,7 @@ static int e1000_set_coalesce(struct net_device *netdev,
 	} else if (ec->rx_coalesce_usecs <= 3) {
 		adapter->itr = 20000;
 		adapter->itr_setting = ec->rx_coalesce_usecs;
+		e1000e_init_itr(adapter);
 	} else {
 		adapter->itr = (1000000 / ec->rx_coalesce_usecs);
 		adapter->itr_setting = adapter->itr & ~3;
@@ -106,7 +106,8 @@ E1000_PARAM(RxAbsIntDelay, "Receive Absolute Interrupt Delay");
 /*
  * Interrupt Throttle Rate (interrupts/sec)
  *
- * Valid Range: 100-100000 (0=off, 1=dynamic, 3=dynamic conservative)
+ * Valid Range: 100-100000 (0=off, 1=dynamic, 2=dynamic low latency,
+ *                          3=dynamic throughput, 4=simplified)
  */
 E1000_PARAM(InterruptThrottleRate, "Interrupt Throttling Rate");
 #define DEFAULT_ITR 3
@@ -344,8 +345,14 @@ void __devinit e1000e_check_options(struct e1000_adapter *adapter)
 				adapter->itr_setting = adapter->itr;
 				adapter->itr = 20000;
 				break;
+			case 2:
+				e_info("%s set to dynamic low latency mode\n",
+				       opt.name);
+				adapter->itr_setting = adapter->itr;
+				adapter->itr = 20000;
+				break;
 			case 3:
-				e_info("%s set to dynamic conservative mode\n",
+				e_info("%s set to dynamic throughput mode\n",
 					opt.name);
 				adapter->itr_setting = adapter->itr;
 				adapter->itr = 20000;
@@ -365,7 +372,7 @@ void __devinit e1000e_check_options(struct e1000_adapter *adapter)
 				    (adapter->itr == 3)) {
 					/*
 					 * In case of invalid user value,
-					 * default to conservative mode.
+					 * default to throughput mode.
 					 */
 					adapter->itr_setting = adapter->itr;
 					adapter->itr = 20000;
@@ -383,6 +390,7 @@ void __devinit e1000e_check_options(struct e1000_adapter *adapter)
 			adapter->itr_setting = opt.def;
 			adapter->itr = 20000;
 		}
+		e1000e_init_itr(adapter);
 	}
 	{ /* Interrupt Mode */
 		static struct e1000_option opt = {
@@ -39,14 +39,14 @@
 #include <linux/net_tstamp.h>
 #include <linux/bitops.h>
 #include <linux/if_vlan.h>
+#include <linux/net_dim.h>
+#include <net/busy_poll.h>
 
 struct igb_adapter;
 
 /* Interrupt defines */
 #define IGB_START_ITR                    648 /* ~6000 ints/sec */
 #define IGB_4K_ITR                       980
-#define IGB_20K_ITR                      196
-#define IGB_70K_ITR                       56
 
 /* TX/RX descriptor defines */
 #define IGB_DEFAULT_TXD                  256
@@ -121,6 +121,17 @@ struct vf_data_storage {
 #define IGB_RXBUFFER_16384 16384
 #define IGB_RX_HDR_LEN     IGB_RXBUFFER_512
 
+/*
+ * Without header split, standard frames are received straight into half
+ * pages laid out as headroom, frame (plus a possible timestamp header)
+ * and skb_shared_info, and wrapped by build_skb().
+ */
+#define IGB_SKB_PAD	(NET_SKB_PAD + NET_IP_ALIGN)
+#define IGB_RX_BUILD_SKB_FITS \
+	(SKB_DATA_ALIGN(IGB_SKB_PAD + IGB_TS_HDR_LEN + \
+			MAXIMUM_ETHERNET_VLAN_SIZE) + \
+	 SKB_DATA_ALIGN(sizeof(struct skb_shared_info)) <= PAGE_SIZE / 2)
+
 /* How many Tx Descriptors do we need to call netif_wake_queue ? */
 #define IGB_TX_QUEUE_WAKE	16
 /* How many Rx Buffers do we bundle into one write to the hardware ? */
@@ -187,7 +198,6 @@ struct igb_ring_container {
 	unsigned int total_packets;	/* total packets processed this int */
 	u16 work_limit;			/* total work allowed per interrupt */
 	u8 count;			/* total number of rings in vector */
-	u8 itr;				/* current ITR setting for ring */
 };
 
 struct igb_q_vector {
@@ -203,10 +213,155 @@ struct igb_q_vector {
 	u16 itr_val;
 	u8 set_itr;
 	void __iomem *itr_register;
+	struct net_dim dim;		/* dynamic ITR state, itr_setting 1-3 */
 
 	char name[IFNAMSIZ + 9];
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int state;
+#define IGB_QV_STATE_IDLE        0
+#define IGB_QV_STATE_NAPI        1     /* NAPI owns this QV */
+#define IGB_QV_STATE_POLL        2     /* poll owns this QV */
+#define IGB_QV_STATE_DISABLED    4     /* QV is disabled */
+#define IGB_QV_OWNED (IGB_QV_STATE_NAPI | IGB_QV_STATE_POLL)
+#define IGB_QV_LOCKED (IGB_QV_OWNED | IGB_QV_STATE_DISABLED)
+#define IGB_QV_STATE_NAPI_YIELD  8     /* NAPI yielded this QV */
+#define IGB_QV_STATE_POLL_YIELD  16    /* poll yielded this QV */
+#define IGB_QV_YIELD (IGB_QV_STATE_NAPI_YIELD | IGB_QV_STATE_POLL_YIELD)
+#define IGB_QV_USER_PEND (IGB_QV_STATE_POLL | IGB_QV_STATE_POLL_YIELD)
+	spinlock_t lock;
+#endif  /* CONFIG_NET_RX_BUSY_POLL */
+
+	/* for dynamic allocation of q_vectors */
+	struct rcu_head rcu;
 };
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+static inline void igb_qv_init_lock(struct igb_q_vector *q_vector)
+{
+	spin_lock_init(&q_vector->lock);
+	q_vector->state = IGB_QV_STATE_IDLE;
+}
+
+/* called from the device poll routine to get ownership of a q_vector */
+static inline bool igb_qv_lock_napi(struct igb_q_vector *q_vector)
+{
+	int rc = true;
+	spin_lock_bh(&q_vector->lock);
+	if (q_vector->state & IGB_QV_LOCKED) {
+		WARN_ON(q_vector->state & IGB_QV_STATE_NAPI);
+		q_vector->state |= IGB_QV_STATE_NAPI_YIELD;
+		rc = false;
+	} else
+		/* we don't care if someone yielded */
+		q_vector->state = IGB_QV_STATE_NAPI;
+	spin_unlock_bh(&q_vector->lock);
+	return rc;
+}
+
+/* returns true is someone tried to get the qv while napi had it */
+static inline bool igb_qv_unlock_napi(struct igb_q_vector *q_vector)
+{
+	int rc = false;
+	spin_lock_bh(&q_vector->lock);
+	WARN_ON(q_vector->state & (IGB_QV_STATE_POLL |
+			       IGB_QV_STATE_NAPI_YIELD));
+
+	if (q_vector->state & IGB_QV_STATE_POLL_YIELD)
+		rc = true;
+	/* will reset state to idle, unless QV is disabled */
+	q_vector->state &= IGB_QV_STATE_DISABLED;
+	spin_unlock_bh(&q_vector->lock);
+	return rc;
+}
+
+/* called from igb_busy_poll_recv() */
+static inline bool igb_qv_lock_poll(struct igb_q_vector *q_vector)
+{
+	int rc = true;
+	spin_lock_bh(&q_vector->lock);
+	if ((q_vector->state & IGB_QV_LOCKED)) {
+		q_vector->state |= IGB_QV_STATE_POLL_YIELD;
+		rc = false;
+	} else
+		/* preserve yield marks */
+		q_vector->state |= IGB_QV_STATE_POLL;
+	spin_unlock_bh(&q_vector->lock);
+	return rc;
+}
+
+/* returns true if someone tried to get the qv while it was locked */
+static inline bool igb_qv_unlock_poll(struct igb_q_vector *q_vector)
+{
+	int rc = false;
+	spin_lock_bh(&q_vector->lock);
+	WARN_ON(q_vector->state & (IGB_QV_STATE_NAPI));
+
+	if (q_vector->state & IGB_QV_STATE_POLL_YIELD)
+		rc = true;
+	/* will reset state to idle, unless QV is disabled */
+	q_vector->state &= IGB_QV_STATE_DISABLED;
+	spin_unlock_bh(&q_vector->lock);
+	return rc;
+}
+
+/* true if a socket is polling, even if it did not get the lock */
+static inline bool igb_qv_busy_polling(struct igb_q_vector *q_vector)
+{
+	WARN_ON(!(q_vector->state & IGB_QV_OWNED));
+	return q_vector->state & IGB_QV_USER_PEND;
+}
+
+/* false if QV is currently owned */
+static inline bool igb_qv_disable(struct igb_q_vector *q_vector)
+{
+	int rc = true;
+	spin_lock_bh(&q_vector->lock);
+	if (q_vector->state & IGB_QV_OWNED)
+		rc = false;
+	q_vector->state |= IGB_QV_STATE_DISABLED;
+	spin_unlock_bh(&q_vector->lock);
+
+	return rc;
+}
+
+#else /* CONFIG_NET_RX_BUSY_POLL */
+static inline void igb_qv_init_lock(struct igb_q_vector *q_vector)
+{
+}
+
+static inline bool igb_qv_lock_napi(struct igb_q_vector *q_vector)
+{
+	return true;
+}
+
+static inline bool igb_qv_unlock_napi(struct igb_q_vector *q_vector)
+{
+	return false;
+}
+
+static inline bool igb_qv_lock_poll(struct igb_q_vector *q_vector)
+{
+	return false;
+}
+
+static inline bool igb_qv_unlock_poll(struct igb_q_vector *q_vector)
+{
+	return false;
+}
+
+static inline bool igb_qv_busy_polling(struct igb_q_vector *q_vector)
+{
+	return false;
+}
+
+static inline bool igb_qv_disable(struct igb_q_vector *q_vector)
+{
+	return true;
+}
+
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 struct igb_ring {
 	struct igb_q_vector *q_vector;	/* backlink to q_vector */
 	struct net_device *netdev;	/* back pointer to net_device */
@@ -249,6 +404,7 @@ struct igb_ring {
 enum e1000_ring_flags_t {
 	IGB_RING_FLAG_RX_SCTP_CSUM,
 	IGB_RING_FLAG_RX_LB_VLAN_BSWAP,
+	IGB_RING_FLAG_RX_BUILD_SKB,
 	IGB_RING_FLAG_TX_CTX_IDX,
 	IGB_RING_FLAG_TX_DETECT_HANG
 };
@@ -270,6 +426,11 @@ static inline __le32 igb_test_staterr(union e1000_adv_rx_desc *rx_desc,
 }
 
 /* igb_desc_unused - calculate if we have unused descriptors */
+static inline struct netdev_queue *txring_txq(const struct igb_ring *tx_ring)
+{
+	return netdev_get_tx_queue(tx_ring->netdev, tx_ring->queue_index);
+}
+
 static inline int igb_desc_unused(struct igb_ring *ring)
 {
 	if (ring->next_to_clean > ring->next_to_use)
@@ -414,6 +575,7 @@ extern void igb_update_stats(struct igb_adapter *, struct rtnl_link_stats64 *);
 extern bool igb_has_link(struct igb_adapter *adapter);
 extern void igb_set_ethtool_ops(struct net_device *);
 extern void igb_power_up_link(struct igb_adapter *);
+extern void igb_init_itr(struct igb_q_vector *, u32 itr_setting);
 
 static inline s32 igb_reset_phy(struct e1000_hw *hw)
 {
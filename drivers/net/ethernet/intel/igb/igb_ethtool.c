@@ -1558,12 +1558,12 @@ static void igb_create_lbtest_frame(struct sk_buff *skb,
 	memset(&skb->data[frame_size + 12], 0xAF, 1);
 }
 
-static int igb_check_lbtest_frame(struct sk_buff *skb, unsigned int frame_size)
+static int igb_check_lbtest_frame(unsigned char *data, unsigned int frame_size)
 {
 	frame_size /= 2;
-	if (*(skb->data + 3) == 0xFF) {
-		if ((*(skb->data + frame_size + 10) == 0xBE) &&
-		   (*(skb->data + frame_size + 12) == 0xAF)) {
+	if (*(data + 3) == 0xFF) {
+		if ((*(data + frame_size + 10) == 0xBE) &&
+		   (*(data + frame_size + 12) == 0xAF)) {
 			return 0;
 		}
 	}
@@ -1577,6 +1577,7 @@ static int igb_clean_test_rings(struct igb_ring *rx_ring,
 	union e1000_adv_rx_desc *rx_desc;
 	struct igb_rx_buffer *rx_buffer_info;
 	struct igb_tx_buffer *tx_buffer_info;
+	unsigned char *data;
 	u16 rx_ntc, tx_ntc, count = 0;
 
 	/* initialize next to clean and descriptor values */
@@ -1588,16 +1589,35 @@ static int igb_clean_test_rings(struct igb_ring *rx_ring,
 		/* check rx buffer */
 		rx_buffer_info = &rx_ring->rx_buffer_info[rx_ntc];
 
-		/* unmap rx buffer, will be remapped by alloc_rx_buffers */
-		dma_unmap_single(rx_ring->dev,
-				 rx_buffer_info->dma,
-				 IGB_RX_HDR_LEN,
-				 DMA_FROM_DEVICE);
-		rx_buffer_info->dma = 0;
-
-		/* verify contents of skb */
-		if (!igb_check_lbtest_frame(rx_buffer_info->skb, size))
-			count++;
+		if (test_bit(IGB_RING_FLAG_RX_BUILD_SKB, &rx_ring->flags)) {
+			/* the page stays mapped, just look at the frame */
+			unsigned int offset = rx_buffer_info->page_offset +
+					      IGB_SKB_PAD;
+
+			dma_sync_single_range_for_cpu(rx_ring->dev,
+						      rx_buffer_info->page_dma,
+						      offset, size,
+						      DMA_FROM_DEVICE);
+			data = page_address(rx_buffer_info->page) + offset;
+			if (!igb_check_lbtest_frame(data, size))
+				count++;
+			dma_sync_single_range_for_device(rx_ring->dev,
+						rx_buffer_info->page_dma,
+						offset, size,
+						DMA_FROM_DEVICE);
+		} else {
+			/* unmap rx buffer, will be remapped by alloc_rx_buffers */
+			dma_unmap_single(rx_ring->dev,
+					 rx_buffer_info->dma,
+					 IGB_RX_HDR_LEN,
+					 DMA_FROM_DEVICE);
+			rx_buffer_info->dma = 0;
+
+			/* verify contents of skb */
+			if (!igb_check_lbtest_frame(rx_buffer_info->skb->data,
+						    size))
+				count++;
+		}
 
 		/* unmap buffer on tx side */
 		tx_buffer_info = &tx_ring->tx_buffer_info[tx_ntc];
@@ -1971,14 +1991,12 @@ static int igb_set_coalesce(struct net_device *netdev,
 
 	if ((ec->rx_coalesce_usecs > IGB_MAX_ITR_USECS) ||
 	    ((ec->rx_coalesce_usecs > 3) &&
-	     (ec->rx_coalesce_usecs < IGB_MIN_ITR_USECS)) ||
-	    (ec->rx_coalesce_usecs == 2))
+	     (ec->rx_coalesce_usecs < IGB_MIN_ITR_USECS)))
 		return -EINVAL;
 
 	if ((ec->tx_coalesce_usecs > IGB_MAX_ITR_USECS) ||
 	    ((ec->tx_coalesce_usecs > 3) &&
-	     (ec->tx_coalesce_usecs < IGB_MIN_ITR_USECS)) ||
-	    (ec->tx_coalesce_usecs == 2))
+	     (ec->tx_coalesce_usecs < IGB_MIN_ITR_USECS)))
 		return -EINVAL;
 
 	if ((adapter->flags & IGB_FLAG_QUEUE_PAIRS) && ec->tx_coalesce_usecs)
@@ -1990,7 +2008,7 @@ static int igb_set_coalesce(struct net_device *netdev,
 			adapter->flags &= ~IGB_FLAG_DMAC;
 	}
 
-	/* convert to rate of irq's per second */
+	/* 1-3 select a dynamic ITR profile, see igb_init_itr() */
 	if (ec->rx_coalesce_usecs && ec->rx_coalesce_usecs <= 3)
 		adapter->rx_itr_setting = ec->rx_coalesce_usecs;
 	else
@@ -2008,12 +2026,9 @@ static int igb_set_coalesce(struct net_device *netdev,
 		struct igb_q_vector *q_vector = adapter->q_vector[i];
 		q_vector->tx.work_limit = adapter->tx_work_limit;
 		if (q_vector->rx.ring)
-			q_vector->itr_val = adapter->rx_itr_setting;
+			igb_init_itr(q_vector, adapter->rx_itr_setting);
 		else
-			q_vector->itr_val = adapter->tx_itr_setting;
-		if (q_vector->itr_val && q_vector->itr_val <= 3)
-			q_vector->itr_val = IGB_START_ITR;
-		q_vector->set_itr = 1;
+			igb_init_itr(q_vector, adapter->tx_itr_setting);
 	}
 
 	return 0;
@@ -2028,12 +2043,16 @@ static int igb_get_coalesce(struct net_device *netdev,
 		ec->rx_coalesce_usecs = adapter->rx_itr_setting;
 	else
 		ec->rx_coalesce_usecs = adapter->rx_itr_setting >> 2;
+	ec->use_adaptive_rx_coalesce =
+		net_dim_usecs_is_dynamic(adapter->rx_itr_setting);
 
 	if (!(adapter->flags & IGB_FLAG_QUEUE_PAIRS)) {
 		if (adapter->tx_itr_setting <= 3)
 			ec->tx_coalesce_usecs = adapter->tx_itr_setting;
 		else
 			ec->tx_coalesce_usecs = adapter->tx_itr_setting >> 2;
+		ec->use_adaptive_tx_coalesce =
+			net_dim_usecs_is_dynamic(adapter->tx_itr_setting);
 	}
 
 	return 0;
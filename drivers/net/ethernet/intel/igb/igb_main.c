@@ -141,7 +141,10 @@ static void igb_setup_dca(struct igb_adapter *);
 #endif /* CONFIG_IGB_DCA */
 static int igb_poll(struct napi_struct *, int);
 static bool igb_clean_tx_irq(struct igb_q_vector *);
-static bool igb_clean_rx_irq(struct igb_q_vector *, int);
+static int igb_clean_rx_irq(struct igb_q_vector *, int);
+#ifdef CONFIG_NET_RX_BUSY_POLL
+static int igb_busy_poll_recv(struct napi_struct *);
+#endif
 static int igb_ioctl(struct net_device *, struct ifreq *, int cmd);
 static void igb_tx_timeout(struct net_device *);
 static void igb_reset_task(struct work_struct *);
@@ -524,11 +527,12 @@ rx_ring_summary:
 					buffer_info->skb);
 
 				if (netif_msg_pktdata(adapter)) {
-					print_hex_dump(KERN_INFO, "",
-						DUMP_PREFIX_ADDRESS,
-						16, 1,
-						phys_to_virt(buffer_info->dma),
-						IGB_RX_HDR_LEN, true);
+					if (buffer_info->dma)
+						print_hex_dump(KERN_INFO, "",
+						  DUMP_PREFIX_ADDRESS,
+						  16, 1,
+						  phys_to_virt(buffer_info->dma),
+						  IGB_RX_HDR_LEN, true);
 					print_hex_dump(KERN_INFO, "",
 					  DUMP_PREFIX_ADDRESS,
 					  16, 1,
@@ -1016,8 +1020,10 @@ static void igb_free_q_vectors(struct igb_adapter *adapter)
 		adapter->q_vector[v_idx] = NULL;
 		if (!q_vector)
 			continue;
+		napi_hash_del(&q_vector->napi);
 		netif_napi_del(&q_vector->napi);
-		kfree(q_vector);
+		/* busy pollers may still hold a pointer under rcu */
+		kfree_rcu(q_vector, rcu);
 	}
 	adapter->num_q_vectors = 0;
 }
@@ -1150,6 +1156,7 @@ static int igb_alloc_q_vectors(struct igb_adapter *adapter)
 		q_vector->itr_register = hw->hw_addr + E1000_EITR(0);
 		q_vector->itr_val = IGB_START_ITR;
 		netif_napi_add(adapter->netdev, &q_vector->napi, igb_poll, 64);
+		napi_hash_add(&q_vector->napi);
 		adapter->q_vector[v_idx] = q_vector;
 	}
 	/* Restore the adapter's original node */
@@ -1172,9 +1179,7 @@ static void igb_map_rx_ring_to_vector(struct igb_adapter *adapter,
 	q_vector->rx.ring = adapter->rx_ring[ring_idx];
 	q_vector->rx.ring->q_vector = q_vector;
 	q_vector->rx.count++;
-	q_vector->itr_val = adapter->rx_itr_setting;
-	if (q_vector->itr_val && q_vector->itr_val <= 3)
-		q_vector->itr_val = IGB_START_ITR;
+	igb_init_itr(q_vector, adapter->rx_itr_setting);
 }
 
 static void igb_map_tx_ring_to_vector(struct igb_adapter *adapter,
@@ -1185,10 +1190,8 @@ static void igb_map_tx_ring_to_vector(struct igb_adapter *adapter,
 	q_vector->tx.ring = adapter->tx_ring[ring_idx];
 	q_vector->tx.ring->q_vector = q_vector;
 	q_vector->tx.count++;
-	q_vector->itr_val = adapter->tx_itr_setting;
 	q_vector->tx.work_limit = adapter->tx_work_limit;
-	if (q_vector->itr_val && q_vector->itr_val <= 3)
-		q_vector->itr_val = IGB_START_ITR;
+	igb_init_itr(q_vector, adapter->tx_itr_setting);
 }
 
 /**
@@ -1540,8 +1543,10 @@ int igb_up(struct igb_adapter *adapter)
 
 	clear_bit(__IGB_DOWN, &adapter->state);
 
-	for (i = 0; i < adapter->num_q_vectors; i++)
+	for (i = 0; i < adapter->num_q_vectors; i++) {
+		igb_qv_init_lock(adapter->q_vector[i]);
 		napi_enable(&(adapter->q_vector[i]->napi));
+	}
 
 	if (adapter->msix_entries)
 		igb_configure_msix(adapter);
@@ -1594,8 +1599,13 @@ void igb_down(struct igb_adapter *adapter)
 	wrfl();
 	msleep(10);
 
-	for (i = 0; i < adapter->num_q_vectors; i++)
+	for (i = 0; i < adapter->num_q_vectors; i++) {
 		napi_disable(&(adapter->q_vector[i]->napi));
+		while (!igb_qv_disable(adapter->q_vector[i])) {
+			pr_info("QV %d locked\n", i);
+			usleep_range(1000, 20000);
+		}
+	}
 
 	igb_irq_disable(adapter);
 
@@ -1795,6 +1805,9 @@ static const struct net_device_ops igb_netdev_ops = {
 	.ndo_get_vf_config	= igb_ndo_get_vf_config,
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller	= igb_netpoll,
+#endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	.ndo_busy_poll		= igb_busy_poll_recv,
 #endif
 	.ndo_fix_features	= igb_fix_features,
 	.ndo_set_features	= igb_set_features,
@@ -2522,8 +2535,10 @@ static int igb_open(struct net_device *netdev)
 	/* From here on the code is the same as igb_up() */
 	clear_bit(__IGB_DOWN, &adapter->state);
 
-	for (i = 0; i < adapter->num_q_vectors; i++)
+	for (i = 0; i < adapter->num_q_vectors; i++) {
+		igb_qv_init_lock(adapter->q_vector[i]);
 		napi_enable(&(adapter->q_vector[i]->napi));
+	}
 
 	/* Clear any pending interrupts. */
 	rd32(E1000_ICR);
@@ -3085,14 +3100,28 @@ void igb_configure_rx_ring(struct igb_adapter *adapter,
 	wr32(E1000_RDH(reg_idx), 0);
 	writel(0, ring->tail);
 
+	/*
+	 * Standard frames skip header split and land in recycled half
+	 * pages that build_skb() wraps; RLPML keeps them within the buffer.
+	 */
+	if (adapter->max_frame_size <= MAXIMUM_ETHERNET_VLAN_SIZE &&
+	    IGB_RX_BUILD_SKB_FITS)
+		set_bit(IGB_RING_FLAG_RX_BUILD_SKB, &ring->flags);
+	else
+		clear_bit(IGB_RING_FLAG_RX_BUILD_SKB, &ring->flags);
+
 	/* set descriptor configuration */
-	srrctl = IGB_RX_HDR_LEN << E1000_SRRCTL_BSIZEHDRSIZE_SHIFT;
 #if (PAGE_SIZE / 2) > IGB_RXBUFFER_16384
-	srrctl |= IGB_RXBUFFER_16384 >> E1000_SRRCTL_BSIZEPKT_SHIFT;
+	srrctl = IGB_RXBUFFER_16384 >> E1000_SRRCTL_BSIZEPKT_SHIFT;
 #else
-	srrctl |= (PAGE_SIZE / 2) >> E1000_SRRCTL_BSIZEPKT_SHIFT;
+	srrctl = (PAGE_SIZE / 2) >> E1000_SRRCTL_BSIZEPKT_SHIFT;
 #endif
-	srrctl |= E1000_SRRCTL_DESCTYPE_HDR_SPLIT_ALWAYS;
+	if (test_bit(IGB_RING_FLAG_RX_BUILD_SKB, &ring->flags)) {
+		srrctl |= E1000_SRRCTL_DESCTYPE_ADV_ONEBUF;
+	} else {
+		srrctl |= IGB_RX_HDR_LEN << E1000_SRRCTL_BSIZEHDRSIZE_SHIFT;
+		srrctl |= E1000_SRRCTL_DESCTYPE_HDR_SPLIT_ALWAYS;
+	}
 	if (hw->mac.type >= e1000_82580)
 		srrctl |= E1000_SRRCTL_TIMESTAMP;
 	/* Only set Drop Enable if we are supporting multiple queues */
@@ -3217,6 +3246,8 @@ static void igb_clean_tx_ring(struct igb_ring *tx_ring)
 	size = sizeof(struct igb_tx_buffer) * tx_ring->count;
 	memset(tx_ring->tx_buffer_info, 0, size);
 
+	netdev_tx_reset_queue(txring_txq(tx_ring));
+
 	/* Zero out the descriptor ring */
 	memset(tx_ring->desc, 0, tx_ring->size);
 
@@ -3303,7 +3334,7 @@ static void igb_clean_rx_ring(struct igb_ring *rx_ring)
 		if (buffer_info->page_dma) {
 			dma_unmap_page(rx_ring->dev,
 			               buffer_info->page_dma,
-				       PAGE_SIZE / 2,
+				       PAGE_SIZE,
 				       DMA_FROM_DEVICE);
 			buffer_info->page_dma = 0;
 		}
@@ -3758,81 +3789,28 @@ static void igb_watchdog_task(struct work_struct *work)
 			  round_jiffies(jiffies + 2 * HZ));
 }
 
-enum latency_range {
-	lowest_latency = 0,
-	low_latency = 1,
-	bulk_latency = 2,
-	latency_invalid = 255
-};
-
 /**
- * igb_update_ring_itr - update the dynamic ITR value based on packet size
- *
- *      Stores a new ITR value based on strictly on packet size.  This
- *      algorithm is less sophisticated than that used in igb_update_itr,
- *      due to the difficulty of synchronizing statistics across multiple
- *      receive rings.  The divisors and thresholds used by this function
- *      were determined based on theoretical maximum wire speed and testing
- *      data, in order to minimize response time while increasing bulk
- *      throughput.
- *      This functionality is controlled by the InterruptThrottleRate module
- *      parameter (see igb_param.c)
- *      NOTE:  This function is called only when operating in a multiqueue
- *             receive environment.
+ * igb_init_itr - set the starting ITR of a q_vector
  * @q_vector: pointer to q_vector
+ * @itr_setting: rx_itr_setting or tx_itr_setting that governs the vector
+ *
+ * Settings 1-3 select dynamic ITR (balanced, latency, throughput profile)
+ * and start at the profile's default level, anything else is a constant
+ * ITR value.  The value is written on the next interrupt.
  **/
-static void igb_update_ring_itr(struct igb_q_vector *q_vector)
+void igb_init_itr(struct igb_q_vector *q_vector, u32 itr_setting)
 {
-	int new_val = q_vector->itr_val;
-	int avg_wire_size = 0;
-	struct igb_adapter *adapter = q_vector->adapter;
-	unsigned int packets;
+	q_vector->set_itr = 1;
 
-	/* For non-gigabit speeds, just fix the interrupt rate at 4000
-	 * ints/sec - ITR timer value of 120 ticks.
-	 */
-	if (adapter->link_speed != SPEED_1000) {
-		new_val = IGB_4K_ITR;
-		goto set_itr_val;
+	if (!net_dim_usecs_is_dynamic(itr_setting)) {
+		q_vector->itr_val = itr_setting;
+		return;
 	}
 
-	packets = q_vector->rx.total_packets;
-	if (packets)
-		avg_wire_size = q_vector->rx.total_bytes / packets;
-
-	packets = q_vector->tx.total_packets;
-	if (packets)
-		avg_wire_size = max_t(u32, avg_wire_size,
-				      q_vector->tx.total_bytes / packets);
-
-	/* if avg_wire_size isn't set no work was done */
-	if (!avg_wire_size)
-		goto clear_counts;
+	net_dim_init(&q_vector->dim, net_dim_usecs_to_profile(itr_setting));
+	q_vector->itr_val = net_dim_usecs(&q_vector->dim) << 2;
 
-	/* Add 24 bytes to size to account for CRC, preamble, and gap */
-	avg_wire_size += 24;
-
-	/* Don't starve jumbo frames */
-	avg_wire_size = min(avg_wire_size, 3000);
-
-	/* Give a little boost to mid-size frames */
-	if ((avg_wire_size > 300) && (avg_wire_size < 1200))
-		new_val = avg_wire_size / 3;
-	else
-		new_val = avg_wire_size / 2;
-
-	/* conservative mode (itr 3) eliminates the lowest_latency setting */
-	if (new_val < IGB_20K_ITR &&
-	    ((q_vector->rx.ring && adapter->rx_itr_setting == 3) ||
-	     (!q_vector->rx.ring && adapter->tx_itr_setting == 3)))
-		new_val = IGB_20K_ITR;
-
-set_itr_val:
-	if (new_val != q_vector->itr_val) {
-		q_vector->itr_val = new_val;
-		q_vector->set_itr = 1;
-	}
-clear_counts:
+	/* counters kept running in constant mode, don't feed them to dim */
 	q_vector->rx.total_bytes = 0;
 	q_vector->rx.total_packets = 0;
 	q_vector->tx.total_bytes = 0;
@@ -3840,123 +3818,36 @@ clear_counts:
 }
 
 /**
- * igb_update_itr - update the dynamic ITR value based on statistics
- *      Stores a new ITR value based on packets and byte
- *      counts during the last interrupt.  The advantage of per interrupt
- *      computation is faster updates and more accurate ITR for the current
- *      traffic pattern.  Constants in this function were computed
- *      based on theoretical maximum wire speed and thresholds were set based
- *      on testing data as well as attempting to minimize response time
- *      while increasing bulk throughput.
- *      this functionality is controlled by the InterruptThrottleRate module
- *      parameter (see igb_param.c)
- *      NOTE:  These calculations are only valid when operating in a single-
- *             queue environment.
+ * igb_set_itr - update the dynamic ITR at the end of a poll
  * @q_vector: pointer to q_vector
- * @ring_container: ring info to update the itr for
+ *
+ * The Rx and Tx work done since the previous poll completion is one
+ * net_dim sample, see include/linux/net_dim.h.
  **/
-static void igb_update_itr(struct igb_q_vector *q_vector,
-			   struct igb_ring_container *ring_container)
-{
-	unsigned int packets = ring_container->total_packets;
-	unsigned int bytes = ring_container->total_bytes;
-	u8 itrval = ring_container->itr;
-
-	/* no packets, exit with status unchanged */
-	if (packets == 0)
-		return;
-
-	switch (itrval) {
-	case lowest_latency:
-		/* handle TSO and jumbo frames */
-		if (bytes/packets > 8000)
-			itrval = bulk_latency;
-		else if ((packets < 5) && (bytes > 512))
-			itrval = low_latency;
-		break;
-	case low_latency:  /* 50 usec aka 20000 ints/s */
-		if (bytes > 10000) {
-			/* this if handles the TSO accounting */
-			if (bytes/packets > 8000) {
-				itrval = bulk_latency;
-			} else if ((packets < 10) || ((bytes/packets) > 1200)) {
-				itrval = bulk_latency;
-			} else if ((packets > 35)) {
-				itrval = lowest_latency;
-			}
-		} else if (bytes/packets > 2000) {
-			itrval = bulk_latency;
-		} else if (packets <= 2 && bytes < 512) {
-			itrval = lowest_latency;
-		}
-		break;
-	case bulk_latency: /* 250 usec aka 4000 ints/s */
-		if (bytes > 25000) {
-			if (packets > 35)
-				itrval = low_latency;
-		} else if (bytes < 1500) {
-			itrval = low_latency;
-		}
-		break;
-	}
-
-	/* clear work counters since we have the values we need */
-	ring_container->total_bytes = 0;
-	ring_container->total_packets = 0;
-
-	/* write updated itr to ring container */
-	ring_container->itr = itrval;
-}
-
 static void igb_set_itr(struct igb_q_vector *q_vector)
 {
 	struct igb_adapter *adapter = q_vector->adapter;
-	u32 new_itr = q_vector->itr_val;
-	u8 current_itr = 0;
+	unsigned int packets = q_vector->rx.total_packets +
+			       q_vector->tx.total_packets;
+	unsigned int bytes = q_vector->rx.total_bytes +
+			     q_vector->tx.total_bytes;
+	u32 new_itr;
+
+	/* clear work counters since we have the values we need */
+	q_vector->rx.total_bytes = 0;
+	q_vector->rx.total_packets = 0;
+	q_vector->tx.total_bytes = 0;
+	q_vector->tx.total_packets = 0;
 
 	/* for non-gigabit speeds, just fix the interrupt rate at 4000 */
 	if (adapter->link_speed != SPEED_1000) {
-		current_itr = 0;
 		new_itr = IGB_4K_ITR;
-		goto set_itr_now;
-	}
-
-	igb_update_itr(q_vector, &q_vector->tx);
-	igb_update_itr(q_vector, &q_vector->rx);
-
-	current_itr = max(q_vector->rx.itr, q_vector->tx.itr);
-
-	/* conservative mode (itr 3) eliminates the lowest_latency setting */
-	if (current_itr == lowest_latency &&
-	    ((q_vector->rx.ring && adapter->rx_itr_setting == 3) ||
-	     (!q_vector->rx.ring && adapter->tx_itr_setting == 3)))
-		current_itr = low_latency;
-
-	switch (current_itr) {
-	/* counts and packets in update_itr are dependent on these numbers */
-	case lowest_latency:
-		new_itr = IGB_70K_ITR; /* 70,000 ints/sec */
-		break;
-	case low_latency:
-		new_itr = IGB_20K_ITR; /* 20,000 ints/sec */
-		break;
-	case bulk_latency:
-		new_itr = IGB_4K_ITR;  /* 4,000 ints/sec */
-		break;
-	default:
-		break;
+	} else {
+		net_dim_update(&q_vector->dim, packets, bytes);
+		new_itr = net_dim_usecs(&q_vector->dim) << 2;
 	}
 
-set_itr_now:
 	if (new_itr != q_vector->itr_val) {
-		/* this attempts to bias the interrupt rate towards Bulk
-		 * by adding intermediate steps when interrupt rate is
-		 * increasing */
-		new_itr = new_itr > q_vector->itr_val ?
-		             max((new_itr * q_vector->itr_val) /
-		                 (new_itr + (q_vector->itr_val >> 2)),
-				 new_itr) :
-			     new_itr;
 		/* Don't write the value here; it resets the adapter's
 		 * internal timer, and causes us to delay far longer than
 		 * we should between interrupts.  Instead, we write the ITR
@@ -4255,6 +4146,8 @@ static void igb_tx_map(struct igb_ring *tx_ring,
 	cmd_type |= cpu_to_le32(size) | cpu_to_le32(IGB_TXD_DCMD);
 	tx_desc->read.cmd_type_len = cmd_type;
 
+	netdev_tx_sent_queue(txring_txq(tx_ring), first->bytecount);
+
 	/* set the timestamp */
 	first->time_stamp = jiffies;
 
@@ -5594,13 +5487,10 @@ void igb_ring_irq_enable(struct igb_q_vector *q_vector)
 	struct igb_adapter *adapter = q_vector->adapter;
 	struct e1000_hw *hw = &adapter->hw;
 
-	if ((q_vector->rx.ring && (adapter->rx_itr_setting & 3)) ||
-	    (!q_vector->rx.ring && (adapter->tx_itr_setting & 3))) {
-		if ((adapter->num_q_vectors == 1) && !adapter->vf_data)
-			igb_set_itr(q_vector);
-		else
-			igb_update_ring_itr(q_vector);
-	}
+	if (net_dim_usecs_is_dynamic(q_vector->rx.ring ?
+				     adapter->rx_itr_setting :
+				     adapter->tx_itr_setting))
+		igb_set_itr(q_vector);
 
 	if (!test_bit(__IGB_DOWN, &adapter->state)) {
 		if (adapter->msix_entries)
@@ -5629,8 +5519,14 @@ static int igb_poll(struct napi_struct *napi, int budget)
 	if (q_vector->tx.ring)
 		clean_complete = igb_clean_tx_irq(q_vector);
 
-	if (q_vector->rx.ring)
-		clean_complete &= igb_clean_rx_irq(q_vector, budget);
+	if (q_vector->rx.ring) {
+		/* a socket busy polling this vector owns the rx ring */
+		if (!igb_qv_lock_napi(q_vector))
+			return budget;
+
+		clean_complete &= (igb_clean_rx_irq(q_vector, budget) < budget);
+		igb_qv_unlock_napi(q_vector);
+	}
 
 	/* If all work not completed, return budget and keep polling */
 	if (!clean_complete)
@@ -5643,6 +5539,39 @@ static int igb_poll(struct napi_struct *napi, int budget)
 	return 0;
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/**
+ * igb_busy_poll_recv - busy poll a q_vector on behalf of a socket
+ * @napi: napi struct of the q_vector to poll
+ *
+ * Cleans a few rx descriptors of the vector without waiting for the
+ * interrupt.  Returns the number of packets received.
+ **/
+static int igb_busy_poll_recv(struct napi_struct *napi)
+{
+	struct igb_q_vector *q_vector = container_of(napi,
+						     struct igb_q_vector,
+						     napi);
+	struct igb_adapter *adapter = q_vector->adapter;
+	int found;
+
+	if (test_bit(__IGB_DOWN, &adapter->state))
+		return LL_FLUSH_FAILED;
+
+	if (!q_vector->rx.ring)
+		return LL_FLUSH_FAILED;
+
+	if (!igb_qv_lock_poll(q_vector))
+		return LL_FLUSH_BUSY;
+
+	found = igb_clean_rx_irq(q_vector, 4);
+
+	igb_qv_unlock_poll(q_vector);
+
+	return found;
+}
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 /**
  * igb_systim_to_hwtstamp - convert system time value to hw timestamp
  * @adapter: board private structure
@@ -5793,6 +5722,8 @@ static bool igb_clean_tx_irq(struct igb_q_vector *q_vector)
 		}
 	}
 
+	netdev_tx_completed_queue(txring_txq(tx_ring),
+				  total_packets, total_bytes);
 	i += tx_ring->count;
 	tx_ring->next_to_clean = i;
 	u64_stats_update_begin(&tx_ring->tx_syncp);
@@ -5984,11 +5915,139 @@ static inline u16 igb_get_hlen(union e1000_adv_rx_desc *rx_desc)
 	return hlen;
 }
 
-static bool igb_clean_rx_irq(struct igb_q_vector *q_vector, int budget)
+/**
+ * igb_reuse_rx_page - hand a half page to the stack, keep the other half
+ * @rx_ring: ring the buffer belongs to
+ * @buffer_info: buffer whose current half was just attached to an skb
+ * @current_node: NUMA node of the cpu cleaning the ring
+ *
+ * If nobody else holds a reference to the page, the half the stack had
+ * before is free again: take a new reference for the ring and point the
+ * buffer at it, so the page neither has to be allocated nor mapped again.
+ **/
+static void igb_reuse_rx_page(struct igb_ring *rx_ring,
+			      struct igb_rx_buffer *buffer_info,
+			      const int current_node)
+{
+	if ((page_count(buffer_info->page) == 1) &&
+	    (page_to_nid(buffer_info->page) == current_node)) {
+		get_page(buffer_info->page);
+		buffer_info->page_offset ^= PAGE_SIZE / 2;
+		dma_sync_single_range_for_device(rx_ring->dev,
+						 buffer_info->page_dma,
+						 buffer_info->page_offset,
+						 PAGE_SIZE / 2,
+						 DMA_FROM_DEVICE);
+	} else {
+		dma_unmap_page(rx_ring->dev, buffer_info->page_dma,
+			       PAGE_SIZE, DMA_FROM_DEVICE);
+		buffer_info->page = NULL;
+		buffer_info->page_dma = 0;
+	}
+}
+
+/**
+ * igb_build_rx_buffer - turn a received half page into (part of) an skb
+ * @rx_ring: ring the buffer belongs to
+ * @buffer_info: buffer the hardware wrote to
+ * @rx_desc: descriptor written back for @buffer_info
+ * @skb: frame in progress, or NULL if @buffer_info starts a new frame
+ * @current_node: NUMA node of the cpu cleaning the ring
+ *
+ * A frame that starts in @buffer_info gets an skb built around the half
+ * page itself; a continuation buffer is added to @skb as a page fragment.
+ * Returns NULL only if a new skb could not be allocated, in which case
+ * the buffer is left untouched.
+ **/
+static struct sk_buff *igb_build_rx_buffer(struct igb_ring *rx_ring,
+					   struct igb_rx_buffer *buffer_info,
+					   union e1000_adv_rx_desc *rx_desc,
+					   struct sk_buff *skb,
+					   const int current_node)
+{
+	unsigned int size = le16_to_cpu(rx_desc->wb.upper.length);
+	void *va = page_address(buffer_info->page) + buffer_info->page_offset;
+
+	dma_sync_single_range_for_cpu(rx_ring->dev, buffer_info->page_dma,
+				      buffer_info->page_offset + IGB_SKB_PAD,
+				      size, DMA_FROM_DEVICE);
+
+	if (likely(!skb)) {
+		prefetch(va + IGB_SKB_PAD);
+
+		skb = build_skb(va, PAGE_SIZE / 2);
+		if (unlikely(!skb)) {
+			rx_ring->rx_stats.alloc_failed++;
+			return NULL;
+		}
+
+		skb_reserve(skb, IGB_SKB_PAD);
+		__skb_put(skb, size);
+		skb_record_rx_queue(skb, rx_ring->queue_index);
+	} else {
+		skb_fill_page_desc(skb, skb_shinfo(skb)->nr_frags,
+				   buffer_info->page,
+				   buffer_info->page_offset + IGB_SKB_PAD,
+				   size);
+		skb->len += size;
+		skb->data_len += size;
+		skb->truesize += PAGE_SIZE / 2;
+	}
+
+	igb_reuse_rx_page(rx_ring, buffer_info, current_node);
+
+	return skb;
+}
+
+/**
+ * igb_add_rx_split_buffer - add a header split buffer to an skb
+ * @rx_ring: ring the buffer belongs to
+ * @buffer_info: buffer the hardware wrote to
+ * @rx_desc: descriptor written back for @buffer_info
+ * @skb: header skb of the frame
+ * @current_node: NUMA node of the cpu cleaning the ring
+ **/
+static void igb_add_rx_split_buffer(struct igb_ring *rx_ring,
+				    struct igb_rx_buffer *buffer_info,
+				    union e1000_adv_rx_desc *rx_desc,
+				    struct sk_buff *skb,
+				    const int current_node)
+{
+	if (!skb_is_nonlinear(skb)) {
+		__skb_put(skb, igb_get_hlen(rx_desc));
+		dma_unmap_single(rx_ring->dev, buffer_info->dma,
+				 IGB_RX_HDR_LEN,
+				 DMA_FROM_DEVICE);
+		buffer_info->dma = 0;
+	}
+
+	if (rx_desc->wb.upper.length) {
+		u16 length = le16_to_cpu(rx_desc->wb.upper.length);
+
+		dma_sync_single_range_for_cpu(rx_ring->dev,
+					      buffer_info->page_dma,
+					      buffer_info->page_offset,
+					      length, DMA_FROM_DEVICE);
+		skb_fill_page_desc(skb, skb_shinfo(skb)->nr_frags,
+					buffer_info->page,
+					buffer_info->page_offset,
+					length);
+
+		skb->len += length;
+		skb->data_len += length;
+		skb->truesize += PAGE_SIZE / 2;
+
+		igb_reuse_rx_page(rx_ring, buffer_info, current_node);
+	}
+}
+
+static int igb_clean_rx_irq(struct igb_q_vector *q_vector, int budget)
 {
 	struct igb_ring *rx_ring = q_vector->rx.ring;
 	union e1000_adv_rx_desc *rx_desc;
 	const int current_node = numa_node_id();
+	const bool rx_build_skb = test_bit(IGB_RING_FLAG_RX_BUILD_SKB,
+					   &rx_ring->flags);
 	unsigned int total_bytes = 0, total_packets = 0;
 	u16 cleaned_count = igb_desc_unused(rx_ring);
 	u16 i = rx_ring->next_to_clean;
@@ -6000,16 +6059,6 @@ static bool igb_clean_rx_irq(struct igb_q_vector *q_vector, int budget)
 		struct sk_buff *skb = buffer_info->skb;
 		union e1000_adv_rx_desc *next_rxd;
 
-		buffer_info->skb = NULL;
-		prefetch(skb->data);
-
-		i++;
-		if (i == rx_ring->count)
-			i = 0;
-
-		next_rxd = IGB_RX_DESC(rx_ring, i);
-		prefetch(next_rxd);
-
 		/*
 		 * This memory barrier is needed to keep us from reading
 		 * any other fields out of the rx_desc until we know the
@@ -6017,44 +6066,36 @@ static bool igb_clean_rx_irq(struct igb_q_vector *q_vector, int budget)
 		 */
 		rmb();
 
-		if (!skb_is_nonlinear(skb)) {
-			__skb_put(skb, igb_get_hlen(rx_desc));
-			dma_unmap_single(rx_ring->dev, buffer_info->dma,
-					 IGB_RX_HDR_LEN,
-					 DMA_FROM_DEVICE);
-			buffer_info->dma = 0;
+		if (rx_build_skb) {
+			skb = igb_build_rx_buffer(rx_ring, buffer_info, rx_desc,
+						  skb, current_node);
+			if (unlikely(!skb))
+				break;
+		} else {
+			prefetch(skb->data);
 		}
+		buffer_info->skb = NULL;
 
-		if (rx_desc->wb.upper.length) {
-			u16 length = le16_to_cpu(rx_desc->wb.upper.length);
-
-			skb_fill_page_desc(skb, skb_shinfo(skb)->nr_frags,
-						buffer_info->page,
-						buffer_info->page_offset,
-						length);
-
-			skb->len += length;
-			skb->data_len += length;
-			skb->truesize += PAGE_SIZE / 2;
+		i++;
+		if (i == rx_ring->count)
+			i = 0;
 
-			if ((page_count(buffer_info->page) != 1) ||
-			    (page_to_nid(buffer_info->page) != current_node))
-				buffer_info->page = NULL;
-			else
-				get_page(buffer_info->page);
+		next_rxd = IGB_RX_DESC(rx_ring, i);
+		prefetch(next_rxd);
 
-			dma_unmap_page(rx_ring->dev, buffer_info->page_dma,
-				       PAGE_SIZE / 2, DMA_FROM_DEVICE);
-			buffer_info->page_dma = 0;
-		}
+		if (!rx_build_skb)
+			igb_add_rx_split_buffer(rx_ring, buffer_info, rx_desc,
+						skb, current_node);
 
 		if (!igb_test_staterr(rx_desc, E1000_RXD_STAT_EOP)) {
 			struct igb_rx_buffer *next_buffer;
 			next_buffer = &rx_ring->rx_buffer_info[i];
-			buffer_info->skb = next_buffer->skb;
-			buffer_info->dma = next_buffer->dma;
+			if (!rx_build_skb) {
+				buffer_info->skb = next_buffer->skb;
+				buffer_info->dma = next_buffer->dma;
+				next_buffer->dma = 0;
+			}
 			next_buffer->skb = skb;
-			next_buffer->dma = 0;
 			goto next_desc;
 		}
 
@@ -6074,7 +6115,11 @@ static bool igb_clean_rx_irq(struct igb_q_vector *q_vector, int budget)
 
 		skb->protocol = eth_type_trans(skb, rx_ring->netdev);
 
-		napi_gro_receive(&q_vector->napi, skb);
+		skb_mark_napi_id(skb, &q_vector->napi);
+		if (igb_qv_busy_polling(q_vector))
+			netif_receive_skb(skb);
+		else
+			napi_gro_receive(&q_vector->napi, skb);
 
 		budget--;
 next_desc:
@@ -6103,7 +6148,7 @@ next_desc:
 	if (cleaned_count)
 		igb_alloc_rx_buffers(rx_ring, cleaned_count);
 
-	return !!budget;
+	return total_packets;
 }
 
 static bool igb_alloc_mapped_skb(struct igb_ring *rx_ring,
@@ -6140,36 +6185,37 @@ static bool igb_alloc_mapped_skb(struct igb_ring *rx_ring,
 	return true;
 }
 
+/*
+ * The whole page is mapped once and stays mapped for as long as the
+ * driver keeps recycling its halves, see igb_reuse_rx_page().
+ */
 static bool igb_alloc_mapped_page(struct igb_ring *rx_ring,
 				  struct igb_rx_buffer *bi)
 {
 	struct page *page = bi->page;
-	dma_addr_t page_dma = bi->page_dma;
-	unsigned int page_offset = bi->page_offset ^ (PAGE_SIZE / 2);
+	dma_addr_t page_dma;
 
-	if (page_dma)
+	if (likely(page))
 		return true;
 
-	if (!page) {
-		page = netdev_alloc_page(rx_ring->netdev);
-		bi->page = page;
-		if (unlikely(!page)) {
-			rx_ring->rx_stats.alloc_failed++;
-			return false;
-		}
+	page = netdev_alloc_page(rx_ring->netdev);
+	if (unlikely(!page)) {
+		rx_ring->rx_stats.alloc_failed++;
+		return false;
 	}
 
-	page_dma = dma_map_page(rx_ring->dev, page,
-				page_offset, PAGE_SIZE / 2,
+	page_dma = dma_map_page(rx_ring->dev, page, 0, PAGE_SIZE,
 				DMA_FROM_DEVICE);
 
 	if (dma_mapping_error(rx_ring->dev, page_dma)) {
+		put_page(page);
 		rx_ring->rx_stats.alloc_failed++;
 		return false;
 	}
 
+	bi->page = page;
 	bi->page_dma = page_dma;
-	bi->page_offset = page_offset;
+	bi->page_offset = 0;
 	return true;
 }
 
@@ -6181,6 +6227,9 @@ void igb_alloc_rx_buffers(struct igb_ring *rx_ring, u16 cleaned_count)
 {
 	union e1000_adv_rx_desc *rx_desc;
 	struct igb_rx_buffer *bi;
+	bool rx_build_skb = test_bit(IGB_RING_FLAG_RX_BUILD_SKB,
+				     &rx_ring->flags);
+	unsigned int pad = rx_build_skb ? IGB_SKB_PAD : 0;
 	u16 i = rx_ring->next_to_use;
 
 	rx_desc = IGB_RX_DESC(rx_ring, i);
@@ -6188,17 +6237,22 @@ void igb_alloc_rx_buffers(struct igb_ring *rx_ring, u16 cleaned_count)
 	i -= rx_ring->count;
 
 	while (cleaned_count--) {
-		if (!igb_alloc_mapped_skb(rx_ring, bi))
-			break;
+		if (rx_build_skb) {
+			rx_desc->read.hdr_addr = 0;
+		} else {
+			if (!igb_alloc_mapped_skb(rx_ring, bi))
+				break;
 
-		/* Refresh the desc even if buffer_addrs didn't change
-		 * because each write-back erases this info. */
-		rx_desc->read.hdr_addr = cpu_to_le64(bi->dma);
+			/* Refresh the desc even if buffer_addrs didn't change
+			 * because each write-back erases this info. */
+			rx_desc->read.hdr_addr = cpu_to_le64(bi->dma);
+		}
 
 		if (!igb_alloc_mapped_page(rx_ring, bi))
 			break;
 
-		rx_desc->read.pkt_addr = cpu_to_le64(bi->page_dma);
+		rx_desc->read.pkt_addr = cpu_to_le64(bi->page_dma +
+						     bi->page_offset + pad);
 
 		rx_desc++;
 		bi++;
@@ -2091,21 +2091,24 @@ static int ixgbe_get_coalesce(struct net_device *netdev,
 
 	ec->tx_max_coalesced_frames_irq = adapter->tx_work_limit;
 
-	/* only valid if in constant ITR mode */
-	if (adapter->rx_itr_setting <= 1)
+	/* 1-3 select a dynamic ITR profile and are reported as is */
+	if (adapter->rx_itr_setting <= NET_DIM_USECS_THROUGHPUT)
 		ec->rx_coalesce_usecs = adapter->rx_itr_setting;
 	else
 		ec->rx_coalesce_usecs = adapter->rx_itr_setting >> 2;
+	ec->use_adaptive_rx_coalesce =
+		net_dim_usecs_is_dynamic(adapter->rx_itr_setting);
 
 	/* if in mixed tx/rx queues per vector mode, report only rx settings */
 	if (adapter->q_vector[0]->tx.count && adapter->q_vector[0]->rx.count)
 		return 0;
 
-	/* only valid if in constant ITR mode */
-	if (adapter->tx_itr_setting <= 1)
+	if (adapter->tx_itr_setting <= NET_DIM_USECS_THROUGHPUT)
 		ec->tx_coalesce_usecs = adapter->tx_itr_setting;
 	else
 		ec->tx_coalesce_usecs = adapter->tx_itr_setting >> 2;
+	ec->use_adaptive_tx_coalesce =
+		net_dim_usecs_is_dynamic(adapter->tx_itr_setting);
 
 	return 0;
 }
@@ -2122,9 +2125,14 @@ static bool ixgbe_update_rsc(struct ixgbe_adapter *adapter,
 	if (!(adapter->flags2 & IXGBE_FLAG2_RSC_CAPABLE))
 		return false;
 
-	/* if interrupt rate is too high then disable RSC */
-	if (ec->rx_coalesce_usecs != 1 &&
-	    ec->rx_coalesce_usecs <= (IXGBE_MIN_RSC_ITR >> 2)) {
+	/*
+	 * if interrupt rate is too high then disable RSC, this includes the
+	 * latency profile of dynamic ITR whose shortest level is below
+	 * IXGBE_MIN_RSC_ITR
+	 */
+	if (ec->rx_coalesce_usecs == NET_DIM_USECS_LATENCY ||
+	    (!net_dim_usecs_is_dynamic(ec->rx_coalesce_usecs) &&
+	     ec->rx_coalesce_usecs <= (IXGBE_MIN_RSC_ITR >> 2))) {
 		if (adapter->flags2 & IXGBE_FLAG2_RSC_ENABLED) {
 			e_info(probe, "rx-usecs set too low, disabling RSC\n");
 			adapter->flags2 &= ~IXGBE_FLAG2_RSC_ENABLED;
@@ -2150,7 +2158,6 @@ static int ixgbe_set_coalesce(struct net_device *netdev,
 	struct ixgbe_q_vector *q_vector;
 	int i;
 	int num_vectors;
-	u16 tx_itr_param, rx_itr_param;
 	bool need_reset = false;
 
 	/* don't accept tx specific changes if we've got mixed RxTx vectors */
@@ -2168,26 +2175,17 @@ static int ixgbe_set_coalesce(struct net_device *netdev,
 	/* check the old value and enable RSC if necessary */
 	need_reset = ixgbe_update_rsc(adapter, ec);
 
-	if (ec->rx_coalesce_usecs > 1)
+	/* 1-3 select a dynamic ITR profile, see ixgbe_init_itr() */
+	if (ec->rx_coalesce_usecs > NET_DIM_USECS_THROUGHPUT)
 		adapter->rx_itr_setting = ec->rx_coalesce_usecs << 2;
 	else
 		adapter->rx_itr_setting = ec->rx_coalesce_usecs;
 
-	if (adapter->rx_itr_setting == 1)
-		rx_itr_param = IXGBE_20K_ITR;
-	else
-		rx_itr_param = adapter->rx_itr_setting;
-
-	if (ec->tx_coalesce_usecs > 1)
+	if (ec->tx_coalesce_usecs > NET_DIM_USECS_THROUGHPUT)
 		adapter->tx_itr_setting = ec->tx_coalesce_usecs << 2;
 	else
 		adapter->tx_itr_setting = ec->tx_coalesce_usecs;
 
-	if (adapter->tx_itr_setting == 1)
-		tx_itr_param = IXGBE_10K_ITR;
-	else
-		tx_itr_param = adapter->tx_itr_setting;
-
 	if (adapter->flags & IXGBE_FLAG_MSIX_ENABLED)
 		num_vectors = adapter->num_msix_vectors - NON_Q_VECTORS;
 	else
@@ -2198,10 +2196,10 @@ static int ixgbe_set_coalesce(struct net_device *netdev,
 		q_vector->tx.work_limit = adapter->tx_work_limit;
 		if (q_vector->tx.count && !q_vector->rx.count)
 			/* tx only */
-			q_vector->itr = tx_itr_param;
+			ixgbe_init_itr(q_vector, adapter->tx_itr_setting);
 		else
 			/* rx only or mixed */
-			q_vector->itr = rx_itr_param;
+			ixgbe_init_itr(q_vector, adapter->rx_itr_setting);
 		ixgbe_write_eitr(q_vector);
 	}
 
@@ -801,6 +801,8 @@ static bool ixgbe_clean_tx_irq(struct ixgbe_q_vector *q_vector,
 	}
 
 	tx_ring->next_to_clean = i;
+	netdev_tx_completed_queue(txring_txq(tx_ring),
+				  total_packets, total_bytes);
 	u64_stats_update_begin(&tx_ring->syncp);
 	tx_ring->stats.bytes += total_bytes;
 	tx_ring->stats.packets += total_packets;
@@ -1035,10 +1037,14 @@ static void ixgbe_receive_skb(struct ixgbe_q_vector *q_vector,
 	if (is_vlan && (tag & VLAN_VID_MASK))
 		__vlan_hwaccel_put_tag(skb, tag);
 
-	if (!(adapter->flags & IXGBE_FLAG_IN_NETPOLL))
-		napi_gro_receive(napi, skb);
-	else
+	skb_mark_napi_id(skb, napi);
+
+	if (adapter->flags & IXGBE_FLAG_IN_NETPOLL)
 		netif_rx(skb);
+	else if (ixgbe_qv_busy_polling(q_vector))
+		netif_receive_skb(skb);
+	else
+		napi_gro_receive(napi, skb);
 }
 
 /**
@@ -1100,6 +1106,42 @@ static inline void ixgbe_release_rx_desc(struct ixgbe_ring *rx_ring, u32 val)
 	writel(val, rx_ring->tail);
 }
 
+/**
+ * ixgbe_alloc_mapped_page - make sure a buffer has a DMA-mapped page
+ * @rx_ring: ring the buffer belongs to
+ * @bi: buffer to fill
+ *
+ * The whole page is mapped once and stays mapped for as long as the
+ * driver keeps recycling its halves, see ixgbe_reuse_rx_page().
+ **/
+static bool ixgbe_alloc_mapped_page(struct ixgbe_ring *rx_ring,
+				    struct ixgbe_rx_buffer *bi)
+{
+	struct page *page = bi->page;
+	dma_addr_t dma;
+
+	if (likely(page))
+		return true;
+
+	page = netdev_alloc_page(rx_ring->netdev);
+	if (unlikely(!page)) {
+		rx_ring->rx_stats.alloc_rx_page_failed++;
+		return false;
+	}
+
+	dma = dma_map_page(rx_ring->dev, page, 0, PAGE_SIZE, DMA_FROM_DEVICE);
+	if (dma_mapping_error(rx_ring->dev, dma)) {
+		put_page(page);
+		rx_ring->rx_stats.alloc_rx_page_failed++;
+		return false;
+	}
+
+	bi->page = page;
+	bi->page_dma = dma;
+	bi->page_offset = 0;
+	return true;
+}
+
 /**
  * ixgbe_alloc_rx_buffers - Replace used receive buffers; packet split
  * @rx_ring: ring to place buffers on
@@ -1119,8 +1161,19 @@ void ixgbe_alloc_rx_buffers(struct ixgbe_ring *rx_ring, u16 cleaned_count)
 	while (cleaned_count--) {
 		rx_desc = IXGBE_RX_DESC_ADV(rx_ring, i);
 		bi = &rx_ring->rx_buffer_info[i];
-		skb = bi->skb;
 
+		if (ring_is_build_skb_enabled(rx_ring)) {
+			if (!ixgbe_alloc_mapped_page(rx_ring, bi))
+				goto no_buffers;
+
+			rx_desc->read.pkt_addr = cpu_to_le64(bi->page_dma +
+							     bi->page_offset +
+							     IXGBE_SKB_PAD);
+			rx_desc->read.hdr_addr = 0;
+			goto next;
+		}
+
+		skb = bi->skb;
 		if (!skb) {
 			skb = netdev_alloc_skb_ip_align(rx_ring->netdev,
 							rx_ring->rx_buf_len);
@@ -1146,39 +1199,19 @@ void ixgbe_alloc_rx_buffers(struct ixgbe_ring *rx_ring, u16 cleaned_count)
 		}
 
 		if (ring_is_ps_enabled(rx_ring)) {
-			if (!bi->page) {
-				bi->page = netdev_alloc_page(rx_ring->netdev);
-				if (!bi->page) {
-					rx_ring->rx_stats.alloc_rx_page_failed++;
-					goto no_buffers;
-				}
-			}
-
-			if (!bi->page_dma) {
-				/* use a half page if we're re-using */
-				bi->page_offset ^= PAGE_SIZE / 2;
-				bi->page_dma = dma_map_page(rx_ring->dev,
-							    bi->page,
-							    bi->page_offset,
-							    PAGE_SIZE / 2,
-							    DMA_FROM_DEVICE);
-				if (dma_mapping_error(rx_ring->dev,
-						      bi->page_dma)) {
-					rx_ring->rx_stats.alloc_rx_page_failed++;
-					bi->page_dma = 0;
-					goto no_buffers;
-				}
-			}
+			if (!ixgbe_alloc_mapped_page(rx_ring, bi))
+				goto no_buffers;
 
 			/* Refresh the desc even if buffer_addrs didn't change
 			 * because each write-back erases this info. */
-			rx_desc->read.pkt_addr = cpu_to_le64(bi->page_dma);
+			rx_desc->read.pkt_addr = cpu_to_le64(bi->page_dma +
+							     bi->page_offset);
 			rx_desc->read.hdr_addr = cpu_to_le64(bi->dma);
 		} else {
 			rx_desc->read.pkt_addr = cpu_to_le64(bi->dma);
 			rx_desc->read.hdr_addr = 0;
 		}
-
+next:
 		i++;
 		if (i == rx_ring->count)
 			i = 0;
@@ -1242,9 +1275,90 @@ static inline bool ixgbe_get_rsc_state(union ixgbe_adv_rx_desc *rx_desc)
 		IXGBE_RXDADV_RSCCNT_MASK);
 }
 
-static bool ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
-			       struct ixgbe_ring *rx_ring,
-			       int budget)
+/**
+ * ixgbe_reuse_rx_page - hand a half page to the stack, keep the other half
+ * @rx_ring: ring the buffer belongs to
+ * @bi: buffer whose current half was just attached to an skb
+ * @current_node: NUMA node of the cpu cleaning the ring
+ *
+ * If nobody else holds a reference to the page, the half the stack had
+ * before is free again: take a new reference for the ring and point the
+ * buffer at it, so the page neither has to be allocated nor mapped again.
+ **/
+static void ixgbe_reuse_rx_page(struct ixgbe_ring *rx_ring,
+				struct ixgbe_rx_buffer *bi,
+				const int current_node)
+{
+	if ((page_count(bi->page) == 1) &&
+	    (page_to_nid(bi->page) == current_node)) {
+		get_page(bi->page);
+		bi->page_offset ^= PAGE_SIZE / 2;
+		dma_sync_single_range_for_device(rx_ring->dev, bi->page_dma,
+						 bi->page_offset,
+						 PAGE_SIZE / 2,
+						 DMA_FROM_DEVICE);
+	} else {
+		dma_unmap_page(rx_ring->dev, bi->page_dma,
+			       PAGE_SIZE, DMA_FROM_DEVICE);
+		bi->page = NULL;
+		bi->page_dma = 0;
+	}
+}
+
+/**
+ * ixgbe_build_rx_buffer - turn a received half page into (part of) an skb
+ * @rx_ring: ring the buffer belongs to
+ * @bi: buffer the hardware wrote to
+ * @rx_desc: descriptor written back for @bi
+ * @skb: frame in progress, or NULL if @bi starts a new frame
+ * @current_node: NUMA node of the cpu cleaning the ring
+ *
+ * A frame that starts in @bi gets an skb built around the half page
+ * itself; a continuation buffer is added to @skb as a page fragment.
+ * Returns NULL only if a new skb could not be allocated, in which case
+ * the buffer is left untouched.
+ **/
+static struct sk_buff *ixgbe_build_rx_buffer(struct ixgbe_ring *rx_ring,
+					     struct ixgbe_rx_buffer *bi,
+					     union ixgbe_adv_rx_desc *rx_desc,
+					     struct sk_buff *skb,
+					     const int current_node)
+{
+	unsigned int size = le16_to_cpu(rx_desc->wb.upper.length);
+	void *va = page_address(bi->page) + bi->page_offset;
+
+	dma_sync_single_range_for_cpu(rx_ring->dev, bi->page_dma,
+				      bi->page_offset + IXGBE_SKB_PAD,
+				      size, DMA_FROM_DEVICE);
+
+	if (likely(!skb)) {
+		prefetch(va + IXGBE_SKB_PAD);
+
+		skb = build_skb(va, PAGE_SIZE / 2);
+		if (unlikely(!skb)) {
+			rx_ring->rx_stats.alloc_rx_buff_failed++;
+			return NULL;
+		}
+
+		skb_reserve(skb, IXGBE_SKB_PAD);
+		__skb_put(skb, size);
+		skb_record_rx_queue(skb, rx_ring->queue_index);
+	} else {
+		skb_fill_page_desc(skb, skb_shinfo(skb)->nr_frags, bi->page,
+				   bi->page_offset + IXGBE_SKB_PAD, size);
+		skb->len += size;
+		skb->data_len += size;
+		skb->truesize += PAGE_SIZE / 2;
+	}
+
+	ixgbe_reuse_rx_page(rx_ring, bi, current_node);
+
+	return skb;
+}
+
+static int ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
+			      struct ixgbe_ring *rx_ring,
+			      int budget)
 {
 	struct ixgbe_adapter *adapter = q_vector->adapter;
 	union ixgbe_adv_rx_desc *rx_desc, *next_rxd;
@@ -1273,13 +1387,19 @@ static bool ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 
 		skb = rx_buffer_info->skb;
 		rx_buffer_info->skb = NULL;
-		prefetch(skb->data);
+		if (skb)
+			prefetch(skb->data);
 
 		if (ring_is_rsc_enabled(rx_ring))
 			pkt_is_rsc = ixgbe_get_rsc_state(rx_desc);
 
+		if (ring_is_build_skb_enabled(rx_ring)) {
+			skb = ixgbe_build_rx_buffer(rx_ring, rx_buffer_info,
+						    rx_desc, skb, current_node);
+			if (unlikely(!skb))
+				break;
 		/* linear means we are building an skb from multiple pages */
-		if (!skb_is_nonlinear(skb)) {
+		} else if (!skb_is_nonlinear(skb)) {
 			u16 hlen;
 			if (pkt_is_rsc &&
 			    !(staterr & IXGBE_RXD_STAT_EOP) &&
@@ -1315,21 +1435,18 @@ static bool ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		}
 
 		if (upper_len) {
-			dma_unmap_page(rx_ring->dev,
-				       rx_buffer_info->page_dma,
-				       PAGE_SIZE / 2,
-				       DMA_FROM_DEVICE);
-			rx_buffer_info->page_dma = 0;
+			dma_sync_single_range_for_cpu(rx_ring->dev,
+						rx_buffer_info->page_dma,
+						rx_buffer_info->page_offset,
+						upper_len,
+						DMA_FROM_DEVICE);
 			skb_fill_page_desc(skb, skb_shinfo(skb)->nr_frags,
 					   rx_buffer_info->page,
 					   rx_buffer_info->page_offset,
 					   upper_len);
 
-			if ((page_count(rx_buffer_info->page) == 1) &&
-			    (page_to_nid(rx_buffer_info->page) == current_node))
-				get_page(rx_buffer_info->page);
-			else
-				rx_buffer_info->page = NULL;
+			ixgbe_reuse_rx_page(rx_ring, rx_buffer_info,
+					    current_node);
 
 			skb->len += upper_len;
 			skb->data_len += upper_len;
@@ -1353,7 +1470,9 @@ static bool ixgbe_clean_rx_irq(struct ixgbe_q_vector *q_vector,
 		}
 
 		if (!(staterr & IXGBE_RXD_STAT_EOP)) {
-			if (ring_is_ps_enabled(rx_ring)) {
+			if (ring_is_build_skb_enabled(rx_ring)) {
+				next_buffer->skb = skb;
+			} else if (ring_is_ps_enabled(rx_ring)) {
 				rx_buffer_info->skb = next_buffer->skb;
 				rx_buffer_info->dma = next_buffer->dma;
 				next_buffer->skb = skb;
@@ -1470,7 +1589,7 @@ next_desc:
 	q_vector->rx.total_packets += total_rx_packets;
 	q_vector->rx.total_bytes += total_rx_bytes;
 
-	return !!budget;
+	return total_rx_packets;
 }
 
 /**
@@ -1508,19 +1627,12 @@ static void ixgbe_configure_msix(struct ixgbe_adapter *adapter)
 		for (ring = q_vector->tx.ring; ring != NULL; ring = ring->next)
 			ixgbe_set_ivar(adapter, 1, ring->reg_idx, v_idx);
 
-		if (q_vector->tx.ring && !q_vector->rx.ring) {
+		if (q_vector->tx.ring && !q_vector->rx.ring)
 			/* tx only vector */
-			if (adapter->tx_itr_setting == 1)
-				q_vector->itr = IXGBE_10K_ITR;
-			else
-				q_vector->itr = adapter->tx_itr_setting;
-		} else {
+			ixgbe_init_itr(q_vector, adapter->tx_itr_setting);
+		else
 			/* rx or rx/tx vector */
-			if (adapter->rx_itr_setting == 1)
-				q_vector->itr = IXGBE_20K_ITR;
-			else
-				q_vector->itr = adapter->rx_itr_setting;
-		}
+			ixgbe_init_itr(q_vector, adapter->rx_itr_setting);
 
 		ixgbe_write_eitr(q_vector);
 	}
@@ -1548,75 +1660,6 @@ static void ixgbe_configure_msix(struct ixgbe_adapter *adapter)
 	IXGBE_WRITE_REG(&adapter->hw, IXGBE_EIAC, mask);
 }
 
-enum latency_range {
-	lowest_latency = 0,
-	low_latency = 1,
-	bulk_latency = 2,
-	latency_invalid = 255
-};
-
-/**
- * ixgbe_update_itr - update the dynamic ITR value based on statistics
- * @q_vector: structure containing interrupt and ring information
- * @ring_container: structure containing ring performance data
- *
- *      Stores a new ITR value based on packets and byte
- *      counts during the last interrupt.  The advantage of per interrupt
- *      computation is faster updates and more accurate ITR for the current
- *      traffic pattern.  Constants in this function were computed
- *      based on theoretical maximum wire speed and thresholds were set based
- *      on testing data as well as attempting to minimize response time
- *      while increasing bulk throughput.
- *      this functionality is controlled by the InterruptThrottleRate module
- *      parameter (see ixgbe_param.c)
- **/
-static void ixgbe_update_itr(struct ixgbe_q_vector *q_vector,
-			     struct ixgbe_ring_container *ring_container)
-{
-	u64 bytes_perint;
-	struct ixgbe_adapter *adapter = q_vector->adapter;
-	int bytes = ring_container->total_bytes;
-	int packets = ring_container->total_packets;
-	u32 timepassed_us;
-	u8 itr_setting = ring_container->itr;
-
-	if (packets == 0)
-		return;
-
-	/* simple throttlerate management
-	 *    0-20MB/s lowest (100000 ints/s)
-	 *   20-100MB/s low   (20000 ints/s)
-	 *  100-1249MB/s bulk (8000 ints/s)
-	 */
-	/* what was last interrupt timeslice? */
-	timepassed_us = q_vector->itr >> 2;
-	bytes_perint = bytes / timepassed_us; /* bytes/usec */
-
-	switch (itr_setting) {
-	case lowest_latency:
-		if (bytes_perint > adapter->eitr_low)
-			itr_setting = low_latency;
-		break;
-	case low_latency:
-		if (bytes_perint > adapter->eitr_high)
-			itr_setting = bulk_latency;
-		else if (bytes_perint <= adapter->eitr_low)
-			itr_setting = lowest_latency;
-		break;
-	case bulk_latency:
-		if (bytes_perint <= adapter->eitr_high)
-			itr_setting = low_latency;
-		break;
-	}
-
-	/* clear work counters since we have the values we need */
-	ring_container->total_bytes = 0;
-	ring_container->total_packets = 0;
-
-	/* write updated itr to ring container */
-	ring_container->itr = itr_setting;
-}
-
 /**
  * ixgbe_write_eitr - write EITR register in hardware specific way
  * @q_vector: structure containing interrupt and ring information
@@ -1651,41 +1694,58 @@ void ixgbe_write_eitr(struct ixgbe_q_vector *q_vector)
 	IXGBE_WRITE_REG(hw, IXGBE_EITR(v_idx), itr_reg);
 }
 
-static void ixgbe_set_itr(struct ixgbe_q_vector *q_vector)
+/**
+ * ixgbe_init_itr - set the starting EITR of a q_vector
+ * @q_vector: structure containing interrupt and ring information
+ * @itr_setting: rx_itr_setting or tx_itr_setting that governs the vector
+ *
+ * Settings 1-3 select dynamic ITR (balanced, latency, throughput profile)
+ * and start at the profile's default level, anything else is a constant
+ * EITR value.  The EITR register itself is written by the caller.
+ **/
+void ixgbe_init_itr(struct ixgbe_q_vector *q_vector, u32 itr_setting)
 {
-	u32 new_itr = q_vector->itr;
-	u8 current_itr;
+	if (!net_dim_usecs_is_dynamic(itr_setting)) {
+		q_vector->itr = itr_setting;
+		return;
+	}
 
-	ixgbe_update_itr(q_vector, &q_vector->tx);
-	ixgbe_update_itr(q_vector, &q_vector->rx);
+	net_dim_init(&q_vector->dim, net_dim_usecs_to_profile(itr_setting));
+	q_vector->itr = (net_dim_usecs(&q_vector->dim) << 2) & IXGBE_MAX_EITR;
 
-	current_itr = max(q_vector->rx.itr, q_vector->tx.itr);
+	/* counters kept running in constant mode, don't feed them to dim */
+	q_vector->rx.total_bytes = 0;
+	q_vector->rx.total_packets = 0;
+	q_vector->tx.total_bytes = 0;
+	q_vector->tx.total_packets = 0;
+}
 
-	switch (current_itr) {
-	/* counts and packets in update_itr are dependent on these numbers */
-	case lowest_latency:
-		new_itr = IXGBE_100K_ITR;
-		break;
-	case low_latency:
-		new_itr = IXGBE_20K_ITR;
-		break;
-	case bulk_latency:
-		new_itr = IXGBE_8K_ITR;
-		break;
-	default:
-		break;
-	}
+/**
+ * ixgbe_set_itr - update the dynamic ITR at the end of a poll
+ * @q_vector: structure containing interrupt and ring information
+ *
+ * The Rx and Tx work done since the previous poll completion is one
+ * net_dim sample; EITR is only rewritten when net_dim moves to another
+ * moderation level.
+ **/
+static void ixgbe_set_itr(struct ixgbe_q_vector *q_vector)
+{
+	unsigned int packets = q_vector->rx.total_packets +
+			       q_vector->tx.total_packets;
+	unsigned int bytes = q_vector->rx.total_bytes +
+			     q_vector->tx.total_bytes;
 
-	if (new_itr != q_vector->itr) {
-		/* do an exponential smoothing */
-		new_itr = (10 * new_itr * q_vector->itr) /
-			  ((9 * new_itr) + q_vector->itr);
+	/* clear work counters since we have the values we need */
+	q_vector->rx.total_bytes = 0;
+	q_vector->rx.total_packets = 0;
+	q_vector->tx.total_bytes = 0;
+	q_vector->tx.total_packets = 0;
 
-		/* save the algorithm value here */
-		q_vector->itr = new_itr & IXGBE_MAX_EITR;
+	if (!net_dim_update(&q_vector->dim, packets, bytes))
+		return;
 
-		ixgbe_write_eitr(q_vector);
-	}
+	q_vector->itr = (net_dim_usecs(&q_vector->dim) << 2) & IXGBE_MAX_EITR;
+	ixgbe_write_eitr(q_vector);
 }
 
 /**
@@ -2351,10 +2411,7 @@ static void ixgbe_configure_msi_and_legacy(struct ixgbe_adapter *adapter)
 	struct ixgbe_q_vector *q_vector = adapter->q_vector[0];
 
 	/* rx/tx vector */
-	if (adapter->rx_itr_setting == 1)
-		q_vector->itr = IXGBE_20K_ITR;
-	else
-		q_vector->itr = adapter->rx_itr_setting;
+	ixgbe_init_itr(q_vector, adapter->rx_itr_setting);
 
 	ixgbe_write_eitr(q_vector);
 
@@ -2978,6 +3035,19 @@ static void ixgbe_set_rx_buffer_len(struct ixgbe_adapter *adapter)
 			}
 		}
 #endif /* IXGBE_FCOE */
+
+		/*
+		 * Standard frames on rings without packet split or RSC are
+		 * received straight into recycled half pages and wrapped by
+		 * build_skb(), so no skb head is allocated and mapped per frame.
+		 */
+		if (!ring_is_ps_enabled(rx_ring) &&
+		    !ring_is_rsc_enabled(rx_ring) &&
+		    rx_ring->rx_buf_len == MAXIMUM_ETHERNET_VLAN_SIZE &&
+		    IXGBE_RX_BUILD_SKB_FITS)
+			set_ring_build_skb_enabled(rx_ring);
+		else
+			clear_ring_build_skb_enabled(rx_ring);
 	}
 }
 
@@ -3313,6 +3383,7 @@ static void ixgbe_napi_enable_all(struct ixgbe_adapter *adapter)
 
 	for (q_idx = 0; q_idx < q_vectors; q_idx++) {
 		q_vector = adapter->q_vector[q_idx];
+		ixgbe_qv_init_lock(q_vector);
 		napi_enable(&q_vector->napi);
 	}
 }
@@ -3330,6 +3401,10 @@ static void ixgbe_napi_disable_all(struct ixgbe_adapter *adapter)
 	for (q_idx = 0; q_idx < q_vectors; q_idx++) {
 		q_vector = adapter->q_vector[q_idx];
 		napi_disable(&q_vector->napi);
+		while (!ixgbe_qv_disable(q_vector)) {
+			pr_info("QV %d locked\n", q_idx);
+			usleep_range(1000, 20000);
+		}
 	}
 }
 
@@ -3904,7 +3979,7 @@ static void ixgbe_clean_rx_ring(struct ixgbe_ring *rx_ring)
 			continue;
 		if (rx_buffer_info->page_dma) {
 			dma_unmap_page(dev, rx_buffer_info->page_dma,
-				       PAGE_SIZE / 2, DMA_FROM_DEVICE);
+				       PAGE_SIZE, DMA_FROM_DEVICE);
 			rx_buffer_info->page_dma = 0;
 		}
 		put_page(rx_buffer_info->page);
@@ -3942,6 +4017,8 @@ static void ixgbe_clean_tx_ring(struct ixgbe_ring *tx_ring)
 		ixgbe_unmap_and_free_tx_resource(tx_ring, tx_buffer_info);
 	}
 
+	netdev_tx_reset_queue(txring_txq(tx_ring));
+
 	size = sizeof(struct ixgbe_tx_buffer) * tx_ring->count;
 	memset(tx_ring->tx_buffer_info, 0, size);
 
@@ -4106,6 +4183,10 @@ static int ixgbe_poll(struct napi_struct *napi, int budget)
 	for (ring = q_vector->tx.ring; ring != NULL; ring = ring->next)
 		clean_complete &= !!ixgbe_clean_tx_irq(q_vector, ring);
 
+	/* a socket busy polling this vector owns the rx rings */
+	if (!ixgbe_qv_lock_napi(q_vector))
+		return budget;
+
 	/* attempt to distribute budget to each queue fairly, but don't allow
 	 * the budget to go below 1 because we'll exit polling */
 	if (q_vector->rx.count > 1)
@@ -4114,8 +4195,10 @@ static int ixgbe_poll(struct napi_struct *napi, int budget)
 		per_ring_budget = budget;
 
 	for (ring = q_vector->rx.ring; ring != NULL; ring = ring->next)
-		clean_complete &= ixgbe_clean_rx_irq(q_vector, ring,
-						     per_ring_budget);
+		clean_complete &= (ixgbe_clean_rx_irq(q_vector, ring,
+				   per_ring_budget) < per_ring_budget);
+
+	ixgbe_qv_unlock_napi(q_vector);
 
 	/* If all work not completed, return budget and keep polling */
 	if (!clean_complete)
@@ -4123,7 +4206,9 @@ static int ixgbe_poll(struct napi_struct *napi, int budget)
 
 	/* all work done, exit the polling mode */
 	napi_complete(napi);
-	if (adapter->rx_itr_setting & 1)
+	if (net_dim_usecs_is_dynamic(q_vector->rx.count ?
+				     adapter->rx_itr_setting :
+				     adapter->tx_itr_setting))
 		ixgbe_set_itr(q_vector);
 	if (!test_bit(__IXGBE_DOWN, &adapter->state))
 		ixgbe_irq_enable_queues(adapter, ((u64)1 << q_vector->v_idx));
@@ -4131,6 +4216,40 @@ static int ixgbe_poll(struct napi_struct *napi, int budget)
 	return 0;
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/**
+ * ixgbe_busy_poll_recv - busy poll a q_vector on behalf of a socket
+ * @napi: napi struct of the q_vector to poll
+ *
+ * Cleans a few descriptors from each rx ring of the vector without
+ * waiting for the interrupt.  Returns the number of packets received.
+ **/
+static int ixgbe_busy_poll_recv(struct napi_struct *napi)
+{
+	struct ixgbe_q_vector *q_vector =
+			container_of(napi, struct ixgbe_q_vector, napi);
+	struct ixgbe_adapter *adapter = q_vector->adapter;
+	struct ixgbe_ring  *ring;
+	int found = 0;
+
+	if (test_bit(__IXGBE_DOWN, &adapter->state))
+		return LL_FLUSH_FAILED;
+
+	if (!ixgbe_qv_lock_poll(q_vector))
+		return LL_FLUSH_BUSY;
+
+	for (ring = q_vector->rx.ring; ring != NULL; ring = ring->next) {
+		found = ixgbe_clean_rx_irq(q_vector, ring, 4);
+		if (found)
+			break;
+	}
+
+	ixgbe_qv_unlock_poll(q_vector);
+
+	return found;
+}
+#endif	/* CONFIG_NET_RX_BUSY_POLL */
+
 /**
  * ixgbe_tx_timeout - Respond to a Tx Hang
  * @netdev: network interface device structure
@@ -4794,6 +4913,7 @@ static int ixgbe_alloc_q_vectors(struct ixgbe_adapter *adapter)
 		cpumask_set_cpu(v_idx, q_vector->affinity_mask);
 		netif_napi_add(adapter->netdev, &q_vector->napi,
 			       ixgbe_poll, 64);
+		napi_hash_add(&q_vector->napi);
 		adapter->q_vector[v_idx] = q_vector;
 	}
 
@@ -4803,9 +4923,10 @@ err_out:
 	while (v_idx) {
 		v_idx--;
 		q_vector = adapter->q_vector[v_idx];
+		napi_hash_del(&q_vector->napi);
 		netif_napi_del(&q_vector->napi);
 		free_cpumask_var(q_vector->affinity_mask);
-		kfree(q_vector);
+		kfree_rcu(q_vector, rcu);
 		adapter->q_vector[v_idx] = NULL;
 	}
 	return -ENOMEM;
@@ -4831,9 +4952,11 @@ static void ixgbe_free_q_vectors(struct ixgbe_adapter *adapter)
 	for (v_idx = 0; v_idx < num_q_vectors; v_idx++) {
 		struct ixgbe_q_vector *q_vector = adapter->q_vector[v_idx];
 		adapter->q_vector[v_idx] = NULL;
+		napi_hash_del(&q_vector->napi);
 		netif_napi_del(&q_vector->napi);
 		free_cpumask_var(q_vector->affinity_mask);
-		kfree(q_vector);
+		/* busy pollers may still hold a pointer under rcu */
+		kfree_rcu(q_vector, rcu);
 	}
 }
 
@@ -5054,10 +5177,6 @@ static int __devinit ixgbe_sw_init(struct ixgbe_adapter *adapter)
 	adapter->rx_itr_setting = 1;
 	adapter->tx_itr_setting = 1;
 
-	/* set defaults for eitr in MegaBytes */
-	adapter->eitr_low = 10;
-	adapter->eitr_high = 20;
-
 	/* set default ring sizes */
 	adapter->tx_ring_count = IXGBE_DEFAULT_TXD;
 	adapter->rx_ring_count = IXGBE_DEFAULT_RXD;
@@ -6600,6 +6719,8 @@ static void ixgbe_tx_map(struct ixgbe_ring *tx_ring,
 	tx_buffer_info->gso_segs = gso_segs;
 	tx_buffer_info->skb = skb;
 
+	netdev_tx_sent_queue(txring_txq(tx_ring), tx_buffer_info->bytecount);
+
 	/* set the timestamp */
 	first->time_stamp = jiffies;
 
@@ -7214,8 +7335,9 @@ static u32 ixgbe_fix_features(struct net_device *netdev, u32 data)
 	if (!(adapter->flags2 & IXGBE_FLAG2_RSC_CAPABLE)) {
 		data &= ~NETIF_F_LRO;
 	} else if (!(adapter->flags2 & IXGBE_FLAG2_RSC_ENABLED) &&
-		   (adapter->rx_itr_setting != 1 &&
-		    adapter->rx_itr_setting > IXGBE_MAX_RSC_INT_RATE)) {
+		   (adapter->rx_itr_setting == NET_DIM_USECS_LATENCY ||
+		    (!net_dim_usecs_is_dynamic(adapter->rx_itr_setting) &&
+		     adapter->rx_itr_setting > IXGBE_MAX_RSC_INT_RATE))) {
 		data &= ~NETIF_F_LRO;
 		e_info(probe, "rx-usecs set too low, not enabling RSC\n");
 	}
@@ -7298,6 +7420,9 @@ static const struct net_device_ops ixgbe_netdev_ops = {
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller	= ixgbe_netpoll,
 #endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	.ndo_busy_poll		= ixgbe_busy_poll_recv,
+#endif
 #ifdef IXGBE_FCOE
 	.ndo_fcoe_ddp_setup = ixgbe_fcoe_ddp_get,
 	.ndo_fcoe_ddp_target = ixgbe_fcoe_ddp_target,
@@ -132,6 +132,8 @@ int mlx4_en_activate_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq,
 		cq->timer.data = (unsigned long) cq;
 	} else {
 		netif_napi_add(cq->dev, &cq->napi, mlx4_en_poll_rx_cq, 64);
+		napi_hash_add(&cq->napi);
+		mlx4_en_cq_init_lock(cq);
 		napi_enable(&cq->napi);
 	}
 
@@ -159,6 +161,7 @@ void mlx4_en_deactivate_cq(struct mlx4_en_priv *priv, struct mlx4_en_cq *cq)
 		del_timer(&cq->timer);
 	else {
 		napi_disable(&cq->napi);
+		napi_hash_del(&cq->napi);
 		netif_napi_del(&cq->napi);
 	}
 
@@ -350,6 +350,29 @@ out:
 	mutex_unlock(&mdev->state_lock);
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/* Rx CQ polling - called by a socket busy polling for data */
+static int mlx4_en_busy_poll(struct napi_struct *napi)
+{
+	struct mlx4_en_cq *cq = container_of(napi, struct mlx4_en_cq, napi);
+	struct net_device *dev = cq->dev;
+	struct mlx4_en_priv *priv = netdev_priv(dev);
+	int done;
+
+	if (!priv->port_up)
+		return LL_FLUSH_FAILED;
+
+	if (!mlx4_en_cq_lock_poll(cq))
+		return LL_FLUSH_BUSY;
+
+	done = mlx4_en_process_rx_cq(dev, cq, 4);
+
+	mlx4_en_cq_unlock_poll(cq);
+
+	return done;
+}
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 #ifdef CONFIG_NET_POLL_CONTROLLER
 static void mlx4_en_netpoll(struct net_device *dev)
 {
@@ -760,10 +783,15 @@ void mlx4_en_stop_port(struct net_device *dev)
 
 	/* Free RX Rings */
 	for (i = 0; i < priv->rx_ring_num; i++) {
-		mlx4_en_deactivate_rx_ring(priv, &priv->rx_ring[i]);
-		while (test_bit(NAPI_STATE_SCHED, &priv->rx_cq[i].napi.state))
+		struct mlx4_en_cq *cq = &priv->rx_cq[i];
+
+		while (test_bit(NAPI_STATE_SCHED, &cq->napi.state))
+			msleep(1);
+		/* Wait for a socket busy polling the ring to leave it */
+		while (!mlx4_en_cq_disable(cq))
 			msleep(1);
-		mlx4_en_deactivate_cq(priv, &priv->rx_cq[i]);
+		mlx4_en_deactivate_rx_ring(priv, &priv->rx_ring[i]);
+		mlx4_en_deactivate_cq(priv, cq);
 	}
 
 	/* close port*/
@@ -986,8 +1014,41 @@ static const struct net_device_ops mlx4_netdev_ops = {
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller	= mlx4_en_netpoll,
 #endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	.ndo_busy_poll		= mlx4_en_busy_poll,
+#endif
 };
 
+/*
+ * Bind each of the hashed TX rings to a share of the online CPUs so that
+ * a CPU keeps transmitting on its own ring and doorbell.  The PFC rings
+ * stay reserved for tagged traffic.  Administrators can still override
+ * the binding through the queues' xps_cpus attributes.
+ */
+static void mlx4_en_set_default_xps(struct mlx4_en_priv *priv)
+{
+	int num = min_t(int, priv->tx_ring_num, MLX4_EN_NUM_TX_RINGS);
+	cpumask_var_t mask;
+	int cpu, i, n;
+
+	if (!zalloc_cpumask_var(&mask, GFP_KERNEL))
+		return;
+
+	for (i = 0; i < num; i++) {
+		cpumask_clear(mask);
+		n = 0;
+		for_each_online_cpu(cpu)
+			if (n++ % num == i)
+				cpumask_set_cpu(cpu, mask);
+		if (netif_set_xps_queue(priv->dev, mask, i)) {
+			en_warn(priv, "Failed setting XPS map of TX ring %d\n", i);
+			break;
+		}
+	}
+
+	free_cpumask_var(mask);
+}
+
 int mlx4_en_init_netdev(struct mlx4_en_dev *mdev, int port,
 			struct mlx4_en_port_profile *prof)
 {
@@ -1095,6 +1156,8 @@ int mlx4_en_init_netdev(struct mlx4_en_dev *mdev, int port,
 	}
 	priv->registered = 1;
 
+	mlx4_en_set_default_xps(priv);
+
 	en_warn(priv, "Using %d TX rings\n", prof->tx_ring_num);
 	en_warn(priv, "Using %d RX rings\n", prof->rx_ring_num);
 
@@ -582,7 +582,8 @@ u16 mlx4_en_select_queue(struct net_device *dev, struct sk_buff *skb)
 		return MLX4_EN_NUM_TX_RINGS + (vlan_tag >> 13);
 	}
 
-	return skb_tx_hash(dev, skb);
+	/* Everything else goes through XPS, then the flow hash */
+	return __netdev_pick_tx(dev, skb);
 }
 
 static void mlx4_bf_copy(unsigned long *dst, unsigned long *src, unsigned bytecnt)
@@ -40,6 +40,7 @@
 #include <linux/mutex.h>
 #include <linux/netdevice.h>
 #include <linux/if_vlan.h>
+#include <net/busy_poll.h>
 
 #include <linux/mlx4/device.h>
 #include <linux/mlx4/qp.h>
@@ -312,8 +313,154 @@ struct mlx4_en_cq {
 	u16 moder_cnt;
 	struct mlx4_cqe *buf;
 #define MLX4_EN_OPCODE_ERROR	0x1e
+
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int state;
+#define MLX4_EN_CQ_STATE_IDLE		0
+#define MLX4_EN_CQ_STATE_NAPI		1	/* NAPI owns this CQ */
+#define MLX4_EN_CQ_STATE_POLL		2	/* poll owns this CQ */
+#define MLX4_EN_CQ_STATE_DISABLED	4	/* CQ is disabled */
+#define MLX4_EN_CQ_OWNED	(MLX4_EN_CQ_STATE_NAPI | MLX4_EN_CQ_STATE_POLL)
+#define MLX4_EN_CQ_LOCKED	(MLX4_EN_CQ_OWNED | MLX4_EN_CQ_STATE_DISABLED)
+#define MLX4_EN_CQ_STATE_NAPI_YIELD	8	/* NAPI yielded this CQ */
+#define MLX4_EN_CQ_STATE_POLL_YIELD	16	/* poll yielded this CQ */
+#define MLX4_EN_CQ_YIELD	(MLX4_EN_CQ_STATE_NAPI_YIELD | \
+				 MLX4_EN_CQ_STATE_POLL_YIELD)
+#define MLX4_EN_CQ_USER_PEND	(MLX4_EN_CQ_STATE_POLL | \
+				 MLX4_EN_CQ_STATE_POLL_YIELD)
+	spinlock_t poll_lock;
+#endif /* CONFIG_NET_RX_BUSY_POLL */
 };
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+static inline void mlx4_en_cq_init_lock(struct mlx4_en_cq *cq)
+{
+	spin_lock_init(&cq->poll_lock);
+	cq->state = MLX4_EN_CQ_STATE_IDLE;
+}
+
+/* called from the NAPI poll routine to get ownership of a CQ */
+static inline bool mlx4_en_cq_lock_napi(struct mlx4_en_cq *cq)
+{
+	bool rc = true;
+
+	spin_lock_bh(&cq->poll_lock);
+	if (cq->state & MLX4_EN_CQ_LOCKED) {
+		WARN_ON(cq->state & MLX4_EN_CQ_STATE_NAPI);
+		cq->state |= MLX4_EN_CQ_STATE_NAPI_YIELD;
+		rc = false;
+	} else
+		/* we don't care if someone yielded */
+		cq->state = MLX4_EN_CQ_STATE_NAPI;
+	spin_unlock_bh(&cq->poll_lock);
+	return rc;
+}
+
+/* returns true if someone tried to get the CQ while NAPI had it */
+static inline bool mlx4_en_cq_unlock_napi(struct mlx4_en_cq *cq)
+{
+	bool rc = false;
+
+	spin_lock_bh(&cq->poll_lock);
+	WARN_ON(cq->state & (MLX4_EN_CQ_STATE_POLL |
+			     MLX4_EN_CQ_STATE_NAPI_YIELD));
+
+	if (cq->state & MLX4_EN_CQ_STATE_POLL_YIELD)
+		rc = true;
+	/* will reset state to idle, unless CQ is disabled */
+	cq->state &= MLX4_EN_CQ_STATE_DISABLED;
+	spin_unlock_bh(&cq->poll_lock);
+	return rc;
+}
+
+/* called from mlx4_en_busy_poll() */
+static inline bool mlx4_en_cq_lock_poll(struct mlx4_en_cq *cq)
+{
+	bool rc = true;
+
+	spin_lock_bh(&cq->poll_lock);
+	if (cq->state & MLX4_EN_CQ_LOCKED) {
+		cq->state |= MLX4_EN_CQ_STATE_POLL_YIELD;
+		rc = false;
+	} else
+		/* preserve yield marks */
+		cq->state |= MLX4_EN_CQ_STATE_POLL;
+	spin_unlock_bh(&cq->poll_lock);
+	return rc;
+}
+
+/* returns true if someone tried to get the CQ while it was locked */
+static inline bool mlx4_en_cq_unlock_poll(struct mlx4_en_cq *cq)
+{
+	bool rc = false;
+
+	spin_lock_bh(&cq->poll_lock);
+	WARN_ON(cq->state & MLX4_EN_CQ_STATE_NAPI);
+
+	if (cq->state & MLX4_EN_CQ_STATE_POLL_YIELD)
+		rc = true;
+	/* will reset state to idle, unless CQ is disabled */
+	cq->state &= MLX4_EN_CQ_STATE_DISABLED;
+	spin_unlock_bh(&cq->poll_lock);
+	return rc;
+}
+
+/* true if a socket is polling, even if it did not get the lock */
+static inline bool mlx4_en_cq_busy_polling(struct mlx4_en_cq *cq)
+{
+	WARN_ON(!(cq->state & MLX4_EN_CQ_OWNED));
+	return cq->state & MLX4_EN_CQ_USER_PEND;
+}
+
+/* false if CQ is currently owned */
+static inline bool mlx4_en_cq_disable(struct mlx4_en_cq *cq)
+{
+	bool rc = true;
+
+	spin_lock_bh(&cq->poll_lock);
+	if (cq->state & MLX4_EN_CQ_OWNED)
+		rc = false;
+	cq->state |= MLX4_EN_CQ_STATE_DISABLED;
+	spin_unlock_bh(&cq->poll_lock);
+	return rc;
+}
+
+#else /* CONFIG_NET_RX_BUSY_POLL */
+static inline void mlx4_en_cq_init_lock(struct mlx4_en_cq *cq)
+{
+}
+
+static inline bool mlx4_en_cq_lock_napi(struct mlx4_en_cq *cq)
+{
+	return true;
+}
+
+static inline bool mlx4_en_cq_unlock_napi(struct mlx4_en_cq *cq)
+{
+	return false;
+}
+
+static inline bool mlx4_en_cq_lock_poll(struct mlx4_en_cq *cq)
+{
+	return false;
+}
+
+static inline bool mlx4_en_cq_unlock_poll(struct mlx4_en_cq *cq)
+{
+	return false;
+}
+
+static inline bool mlx4_en_cq_busy_polling(struct mlx4_en_cq *cq)
+{
+	return false;
+}
+
+static inline bool mlx4_en_cq_disable(struct mlx4_en_cq *cq)
+{
+	return true;
+}
+#endif /* CONFIG_NET_RX_BUSY_POLL */
+
 struct mlx4_en_port_profile {
 	u32 flags;
 	u32 tx_ring_num;
@@ -134,6 +134,8 @@ void ath_descdma_cleanup(struct ath_softc *sc, struct ath_descdma *dd,
 #define ATH_AGGR_ENCRYPTDELIM      10
 /* minimum h/w qdepth to be sustained to maximize aggregation */
 #define ATH_AGGR_MIN_QDEPTH        2
+/* airtime granted to each station and AC per scheduling round, in usec */
+#define ATH_AIRTIME_QUANTUM        300
 #define ATH_AMPDU_SUBFRAME_DEFAULT 32
 
 #define IEEE80211_SEQ_SEQ_SHIFT    4
@@ -196,6 +198,7 @@ struct ath_atx_ac {
 	struct list_head list;
 	struct list_head tid_q;
 	bool clear_ps_filter;
+	int airtime_deficit;	/* usec, see ath_txq_schedule() */
 };
 
 struct ath_frame_info {
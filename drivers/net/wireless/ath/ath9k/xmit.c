@@ -353,6 +353,55 @@ static void ath_tx_count_frames(struct ath_softc *sc, struct ath_buf *bf,
 }
 
 
+static u32 ath_pkt_duration(struct ath_softc *sc, u8 rix, int pktlen,
+			    int width, int half_gi, bool shortPreamble);
+
+/*
+ * Estimate the airtime a completed transmission of @len bytes used, from
+ * its rate series and the number of tries on the final rate.
+ */
+static u32 ath_tx_airtime(struct ath_softc *sc,
+			  struct ieee80211_tx_info *tx_info,
+			  struct ieee80211_tx_rate *rates,
+			  struct ath_tx_status *ts, int len)
+{
+	const struct ieee80211_rate *rate;
+	u32 airtime = 0, duration;
+	int i, tries, phy;
+	bool is_sp;
+
+	for (i = 0; i <= ts->ts_rateindex && i < 4; i++) {
+		if (!rates[i].count || rates[i].idx < 0)
+			break;
+
+		if (i == ts->ts_rateindex)
+			tries = ts->ts_longretry + 1;
+		else
+			tries = rates[i].count;
+
+		is_sp = !!(rates[i].flags & IEEE80211_TX_RC_USE_SHORT_PREAMBLE);
+		if (rates[i].flags & IEEE80211_TX_RC_MCS) {
+			duration = ath_pkt_duration(sc, rates[i].idx, len,
+				!!(rates[i].flags & IEEE80211_TX_RC_40_MHZ_WIDTH),
+				!!(rates[i].flags & IEEE80211_TX_RC_SHORT_GI),
+				is_sp);
+		} else {
+			rate = &sc->sbands[tx_info->band].bitrates[rates[i].idx];
+			if ((tx_info->band == IEEE80211_BAND_2GHZ) &&
+			    !(rate->flags & IEEE80211_RATE_ERP_G))
+				phy = WLAN_RC_PHY_CCK;
+			else
+				phy = WLAN_RC_PHY_OFDM;
+			duration = ath9k_hw_computetxtime(sc->sc_ah, phy,
+				rate->bitrate * 100, len, rates[i].idx, is_sp);
+		}
+
+		airtime += duration * tries;
+	}
+
+	return airtime;
+}
+
 static void ath_tx_complete_aggr(struct ath_softc *sc, struct ath_txq *txq,
 				 struct ath_buf *bf, struct list_head *bf_q,
 				 struct ath_tx_status *ts, int txok, bool retry)
@@ -373,7 +422,7 @@ static void ath_tx_complete_aggr(struct ath_softc *sc, struct ath_txq *txq,
 	bool rc_update = true, isba;
 	struct ieee80211_tx_rate rates[4];
 	struct ath_frame_info *fi;
-	int nframes;
+	int nframes, len = 0;
 	u8 tidno;
 	bool flush = !!(ts->ts_status & ATH9K_TX_FLUSH);
 
@@ -410,6 +459,17 @@ static void ath_tx_complete_aggr(struct ath_softc *sc, struct ath_txq *txq,
 	tid = ATH_AN_2_TID(an, tidno);
 	isba = ts->ts_flags & ATH9K_TX_BA;
 
+	/* charge the station for the airtime of the whole aggregate */
+	if (!flush) {
+		for (bf_next = bf; bf_next; bf_next = bf_next->bf_next)
+			len += get_frame_info(bf_next->bf_mpdu)->framelen;
+
+		spin_lock_bh(&txq->axq_lock);
+		tid->ac->airtime_deficit -= ath_tx_airtime(sc, tx_info, rates,
+							   ts, len);
+		spin_unlock_bh(&txq->axq_lock);
+	}
+
 	/*
 	 * The hardware occasionally sends a tx status for the wrong TID.
 	 * In this case, the BA status cannot be considered valid and all
@@ -1525,17 +1585,24 @@ void ath_tx_cleanupq(struct ath_softc *sc, struct ath_txq *txq)
 
 /* For each axq_acq entry, for each tid, try to schedule packets
  * for transmit until ampdu_depth has reached min Q depth.
+ *
+ * Stations are served round-robin, weighted by the airtime their
+ * aggregates used (deficit round-robin): a station whose deficit is used
+ * up is refilled by ATH_AIRTIME_QUANTUM and waits for the next round, so
+ * a slow station cannot take the air from fast ones.
  */
 void ath_txq_schedule(struct ath_softc *sc, struct ath_txq *txq)
 {
 	struct ath_atx_ac *ac, *ac_tmp, *last_ac;
 	struct ath_atx_tid *tid, *last_tid;
+	bool sent, skipped;
 
 	if (work_pending(&sc->hw_reset_work) || list_empty(&txq->axq_acq) ||
 	    txq->axq_ampdu_depth >= ATH_AGGR_MIN_QDEPTH)
 		return;
 
-	ac = list_first_entry(&txq->axq_acq, struct ath_atx_ac, list);
+restart:
+	sent = skipped = false;
 	last_ac = list_entry(txq->axq_acq.prev, struct ath_atx_ac, list);
 
 	list_for_each_entry_safe(ac, ac_tmp, &txq->axq_acq, list) {
@@ -1543,6 +1610,12 @@ void ath_txq_schedule(struct ath_softc *sc, struct ath_txq *txq)
 		list_del(&ac->list);
 		ac->sched = false;
 
+		if (ac->airtime_deficit <= 0) {
+			ac->airtime_deficit += ATH_AIRTIME_QUANTUM;
+			skipped = true;
+			goto requeue;
+		}
+
 		while (!list_empty(&ac->tid_q)) {
 			tid = list_first_entry(&ac->tid_q, struct ath_atx_tid,
 					       list);
@@ -1553,6 +1626,7 @@ void ath_txq_schedule(struct ath_softc *sc, struct ath_txq *txq)
 				continue;
 
 			ath_tx_sched_aggr(sc, txq, tid);
+			sent = true;
 
 			/*
 			 * add tid to round-robin queue if more frames
@@ -1566,6 +1640,7 @@ void ath_txq_schedule(struct ath_softc *sc, struct ath_txq *txq)
 				break;
 		}
 
+requeue:
 		if (!list_empty(&ac->tid_q)) {
 			if (!ac->sched) {
 				ac->sched = true;
@@ -1573,9 +1648,18 @@ void ath_txq_schedule(struct ath_softc *sc, struct ath_txq *txq)
 			}
 		}
 
-		if (ac == last_ac ||
-		    txq->axq_ampdu_depth >= ATH_AGGR_MIN_QDEPTH)
+		if (txq->axq_ampdu_depth >= ATH_AGGR_MIN_QDEPTH)
+			return;
+
+		if (ac == last_ac) {
+			/*
+			 * Nothing may be left in flight to trigger another
+			 * round, keep going until some station gets to send.
+			 */
+			if (!sent && skipped && !list_empty(&txq->axq_acq))
+				goto restart;
 			return;
+		}
 	}
 }
 
@@ -2426,6 +2510,7 @@ void ath_tx_node_init(struct ath_softc *sc, struct ath_node *an)
 	     acno < WME_NUM_AC; acno++, ac++) {
 		ac->sched    = false;
 		ac->clear_ps_filter = true;
+		ac->airtime_deficit = ATH_AIRTIME_QUANTUM;
 		ac->txq = sc->tx.txq_map[acno];
 		INIT_LIST_HEAD(&ac->tid_q);
 	}
@@ -138,6 +138,13 @@ static void iscsi_sw_tcp_data_ready(struct sock *sk, int flag)
 	}
 	tcp_conn = conn->dd_data;
 
+	/*
+	 * Transmit from the CPU that receives, and so processes the acks,
+	 * for this connection: R2T driven data-out is queued from here and
+	 * finds the socket hot in cache.
+	 */
+	conn->xmit_cpu = raw_smp_processor_id();
+
 	/*
 	 * Use rd_desc to pass 'conn' to iscsi_tcp_recv.
 	 * We set count to 1 because we want the network layer to
@@ -85,12 +85,26 @@ MODULE_PARM_DESC(debug_libiscsi_eh,
 					     __func__, ##arg);		\
 	} while (0);
 
+/**
+ * iscsi_conn_queue_work - schedule the xmit worker of a connection
+ * @conn: iscsi conn
+ *
+ * The worker runs on conn->xmit_cpu when the LLD has picked one, else on
+ * the local CPU.  The host workqueue is non-reentrant, so a connection
+ * never transmits from two CPUs at once even when xmit_cpu changes.
+ */
 inline void iscsi_conn_queue_work(struct iscsi_conn *conn)
 {
 	struct Scsi_Host *shost = conn->session->host;
 	struct iscsi_host *ihost = shost_priv(shost);
+	int cpu = ACCESS_ONCE(conn->xmit_cpu);
 
-	if (ihost->workq)
+	if (!ihost->workq)
+		return;
+
+	if (cpu >= 0 && cpu_online(cpu))
+		queue_work_on(cpu, ihost->workq, &conn->xmitwork);
+	else
 		queue_work(ihost->workq, &conn->xmitwork);
 }
 EXPORT_SYMBOL_GPL(iscsi_conn_queue_work);
@@ -2588,7 +2602,9 @@ struct Scsi_Host *iscsi_host_alloc(struct scsi_host_template *sht,
 	if (xmit_can_sleep) {
 		snprintf(ihost->workq_name, sizeof(ihost->workq_name),
 			"iscsi_q_%d", shost->host_no);
-		ihost->workq = create_singlethread_workqueue(ihost->workq_name);
+		ihost->workq = alloc_workqueue(ihost->workq_name,
+					       WQ_NON_REENTRANT |
+					       WQ_MEM_RECLAIM, 1);
 		if (!ihost->workq)
 			goto free_host;
 	}
@@ -2864,6 +2880,7 @@ iscsi_conn_setup(struct iscsi_cls_session *cls_session, int dd_size,
 	INIT_LIST_HEAD(&conn->cmdqueue);
 	INIT_LIST_HEAD(&conn->requeue);
 	INIT_WORK(&conn->xmitwork, iscsi_xmitworker);
+	conn->xmit_cpu = -1;
 
 	/* allocate login_task used for the login/text sequences */
 	spin_lock_bh(&session->lock);
@@ -2927,7 +2944,7 @@ void iscsi_conn_teardown(struct iscsi_cls_conn *cls_conn)
 	 */
 	for (;;) {
 		spin_lock_irqsave(session->host->host_lock, flags);
-		if (!session->host->host_busy) { /* OK for ERL == 0 */
+		if (!atomic_read(&session->host->host_busy)) { /* OK for ERL == 0 */
 			spin_unlock_irqrestore(session->host->host_lock, flags);
 			break;
 		}
@@ -2935,7 +2952,7 @@ void iscsi_conn_teardown(struct iscsi_cls_conn *cls_conn)
 		msleep_interruptible(500);
 		iscsi_conn_printk(KERN_INFO, conn, "iscsi conn_destroy(): "
 				  "host_busy %d host_failed %d\n",
-				  session->host->host_busy,
+				  atomic_read(&session->host->host_busy),
 				  session->host->host_failed);
 		/*
 		 * force eh_abort() to unblock
@@ -40,6 +40,16 @@ static int link_quirk;
 module_param(link_quirk, int, S_IRUGO | S_IWUSR);
 MODULE_PARM_DESC(link_quirk, "Don't clear the chain bit on a link TRB");
 
+/*
+ * Minimum time between event ring interrupts.  Completions arriving in the
+ * meantime are handled by the next interrupt, which keeps isochronous
+ * streams of many small URBs from interrupting once per URB.
+ */
+static unsigned int imod_interval = 40000;
+module_param(imod_interval, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(imod_interval,
+		 "Interrupt moderation interval in ns (0-16383750, default 40000)");
+
 /* TODO: copied from ehci-hcd.c - can this be refactored? */
 /*
  * handshake - spin reading hc until handshake completes or fails
@@ -650,7 +660,7 @@ int xhci_run(struct usb_hcd *hcd)
 	xhci_dbg(xhci, "// Set the interrupt modulation register\n");
 	temp = xhci_readl(xhci, &xhci->ir_set->irq_control);
 	temp &= ~ER_IRQ_INTERVAL_MASK;
-	temp |= (u32) 160;
+	temp |= min_t(u32, imod_interval / 250, ER_IRQ_INTERVAL_MASK);
 	xhci_writel(xhci, temp, &xhci->ir_set->irq_control);
 
 	/* Set the HCD state before we enable the irqs */
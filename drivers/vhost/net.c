@@ -18,6 +18,7 @@
 #include <linux/rcupdate.h>
 #include <linux/file.h>
 #include <linux/slab.h>
+#include <linux/sched.h>
 
 #include <linux/net.h>
 #include <linux/if_packet.h>
@@ -41,6 +42,12 @@ MODULE_PARM_DESC(experimental_zcopytx, "Enable Experimental Zero Copy TX");
 #define VHOST_MAX_PEND 128
 #define VHOST_GOODCOPY_LEN 256
 
+/* Zerocopy is given up on for a while when more than one in
+ * VHOST_ZCOPY_ERR_RATIO zerocopy transmits ended up copied below us;
+ * the counters are reset every VHOST_ZCOPY_PERIOD transmits. */
+#define VHOST_ZCOPY_ERR_RATIO 64
+#define VHOST_ZCOPY_PERIOD 1024
+
 enum {
 	VHOST_NET_VQ_RX = 0,
 	VHOST_NET_VQ_TX = 1,
@@ -70,6 +77,32 @@ static bool vhost_sock_zcopy(struct socket *sock)
 }
 
 /* Pop first len bytes from iovec. Return number of segments used. */
+static bool vhost_net_tx_select_zcopy(struct vhost_virtqueue *vq)
+{
+	return vq->zcopy_packets / VHOST_ZCOPY_ERR_RATIO >= vq->zcopy_err;
+}
+
+static void vhost_net_tx_packet(struct vhost_virtqueue *vq)
+{
+	if (++vq->zcopy_packets < VHOST_ZCOPY_PERIOD)
+		return;
+	vq->zcopy_packets = 0;
+	vq->zcopy_err = 0;
+}
+
+static unsigned long busy_clock(void)
+{
+	return local_clock() >> 10;
+}
+
+static bool vhost_can_busy_poll(struct vhost_dev *dev, unsigned long endtime)
+{
+	return likely(!need_resched()) &&
+	       likely(!time_after(busy_clock(), endtime)) &&
+	       likely(!signal_pending(current)) &&
+	       !vhost_has_work(dev);
+}
+
 static int move_iovec_hdr(struct iovec *from, struct iovec *to,
 			  size_t len, int iov_count)
 {
@@ -125,6 +158,30 @@ static void tx_poll_start(struct vhost_net *net, struct socket *sock)
 	net->tx_poll_state = VHOST_NET_POLL_STARTED;
 }
 
+/* Like vhost_get_vq_desc(), but with busyloop_timeout set, keep polling an
+ * empty ring for a while before reporting it empty.  Guest notifications
+ * stay disabled meanwhile, so a guest that keeps up pays no exits. */
+static int vhost_net_tx_get_vq_desc(struct vhost_net *net,
+				    struct vhost_virtqueue *vq,
+				    unsigned int *out_num, unsigned int *in_num)
+{
+	unsigned long uninitialized_var(endtime);
+	int r;
+
+	r = vhost_get_vq_desc(&net->dev, vq, vq->iov, ARRAY_SIZE(vq->iov),
+			      out_num, in_num, NULL, NULL);
+	if (r == vq->num && vq->busyloop_timeout) {
+		endtime = busy_clock() + vq->busyloop_timeout;
+		while (vhost_can_busy_poll(&net->dev, endtime) &&
+		       vhost_vq_avail_empty(&net->dev, vq))
+			cpu_relax();
+		r = vhost_get_vq_desc(&net->dev, vq, vq->iov,
+				      ARRAY_SIZE(vq->iov),
+				      out_num, in_num, NULL, NULL);
+	}
+	return r;
+}
+
 /* Expects to be always run from workqueue - which acts as
  * read-size critical section for our kind of RCU. */
 static void handle_tx(struct vhost_net *net)
@@ -173,10 +230,7 @@ static void handle_tx(struct vhost_net *net)
 		if (zcopy)
 			vhost_zerocopy_signal_used(vq);
 
-		head = vhost_get_vq_desc(&net->dev, vq, vq->iov,
-					 ARRAY_SIZE(vq->iov),
-					 &out, &in,
-					 NULL, NULL);
+		head = vhost_net_tx_get_vq_desc(net, vq, &out, &in);
 		/* On error, stop handling until the next kick. */
 		if (unlikely(head < 0))
 			break;
@@ -226,7 +280,8 @@ static void handle_tx(struct vhost_net *net)
 		/* use msg_control to pass vhost zerocopy ubuf info to skb */
 		if (zcopy) {
 			vq->heads[vq->upend_idx].id = head;
-			if (len < VHOST_GOODCOPY_LEN) {
+			if (len < VHOST_GOODCOPY_LEN ||
+			    !vhost_net_tx_select_zcopy(vq)) {
 				/* copy don't need to wait for DMA done */
 				vq->heads[vq->upend_idx].len =
 							VHOST_DMA_DONE_LEN;
@@ -266,6 +321,8 @@ static void handle_tx(struct vhost_net *net)
 				 " len %d != %zd\n", err, len);
 		if (!zcopy)
 			vhost_add_used_and_signal(&net->dev, vq, head, 0);
+		else
+			vhost_net_tx_packet(vq);
 		total_len += len;
 		if (unlikely(total_len >= VHOST_NET_WEIGHT)) {
 			vhost_poll_queue(&vq->poll);
@@ -290,6 +347,22 @@ static int peek_head_len(struct sock *sk)
 	return len;
 }
 
+static int vhost_net_rx_peek_head_len(struct vhost_net *net, struct sock *sk)
+{
+	struct vhost_virtqueue *vq = &net->dev.vqs[VHOST_NET_VQ_RX];
+	unsigned long uninitialized_var(endtime);
+	int len = peek_head_len(sk);
+
+	if (!len && vq->busyloop_timeout) {
+		endtime = busy_clock() + vq->busyloop_timeout;
+		while (vhost_can_busy_poll(&net->dev, endtime) &&
+		       skb_queue_empty(&sk->sk_receive_queue))
+			cpu_relax();
+		len = peek_head_len(sk);
+	}
+	return len;
+}
+
 /* This is a multi-buffer version of vhost_get_desc, that works if
  *	vq has read descriptors only.
  * @vq		- the relevant virtqueue
@@ -401,7 +474,7 @@ static void handle_rx(struct vhost_net *net)
 		vq->log : NULL;
 	mergeable = vhost_has_feature(&net->dev, VIRTIO_NET_F_MRG_RXBUF);
 
-	while ((sock_len = peek_head_len(sock->sk))) {
+	while ((sock_len = vhost_net_rx_peek_head_len(net, sock->sk))) {
 		sock_len += sock_hlen;
 		vhost_len = sock_len + vhost_hlen;
 		headcount = get_rx_bufs(vq, vq->heads, vhost_len,
@@ -184,6 +184,9 @@ static void vhost_vq_reset(struct vhost_dev *dev,
 	vq->upend_idx = 0;
 	vq->done_idx = 0;
 	vq->ubufs = NULL;
+	vq->zcopy_packets = 0;
+	vq->zcopy_err = 0;
+	vq->busyloop_timeout = 0;
 }
 
 static int vhost_worker(void *data)
@@ -366,7 +369,10 @@ static long vhost_dev_set_owner(struct vhost_dev *dev)
 
 	/* No owner, become one */
 	dev->mm = get_task_mm(current);
-	worker = kthread_create(vhost_worker, dev, "vhost-%d", current->pid);
+	/* Keep the worker's stack and task on the owner's node; the cgroups
+	 * attached below bind it to the owner's cpuset as well. */
+	worker = kthread_create_on_node(vhost_worker, dev, numa_node_id(),
+					"vhost-%d", current->pid);
 	if (IS_ERR(worker)) {
 		err = PTR_ERR(worker);
 		goto err_worker;
@@ -423,7 +429,9 @@ int vhost_zerocopy_signal_used(struct vhost_virtqueue *vq)
 	int j = 0;
 
 	for (i = vq->done_idx; i != vq->upend_idx; i = (i + 1) % UIO_MAXIOV) {
-		if ((vq->heads[i].len == VHOST_DMA_DONE_LEN)) {
+		if (VHOST_DMA_IS_DONE(vq->heads[i].len)) {
+			if (vq->heads[i].len == VHOST_DMA_FAILED_LEN)
+				vq->zcopy_err++;
 			vq->heads[i].len = VHOST_DMA_CLEAR_LEN;
 			vhost_add_used_and_signal(vq->dev, vq,
 						  vq->heads[i].id, 0);
@@ -803,6 +811,19 @@ static long vhost_set_vring(struct vhost_dev *d, int ioctl, void __user *argp)
 		} else
 			filep = eventfp;
 		break;
+	case VHOST_SET_VRING_BUSYLOOP_TIMEOUT:
+		if (copy_from_user(&s, argp, sizeof s)) {
+			r = -EFAULT;
+			break;
+		}
+		vq->busyloop_timeout = s.num;
+		break;
+	case VHOST_GET_VRING_BUSYLOOP_TIMEOUT:
+		s.index = idx;
+		s.num = vq->busyloop_timeout;
+		if (copy_to_user(argp, &s, sizeof s))
+			r = -EFAULT;
+		break;
 	default:
 		r = -ENOIOCTLCMD;
 	}
@@ -1546,6 +1567,23 @@ bool vhost_enable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 	return avail_idx != vq->avail_idx;
 }
 
+/* Nothing was added to the available ring since we last looked. */
+bool vhost_vq_avail_empty(struct vhost_dev *dev, struct vhost_virtqueue *vq)
+{
+	u16 avail_idx;
+
+	if (__get_user(avail_idx, &vq->avail->idx))
+		return false;
+
+	return avail_idx == vq->avail_idx;
+}
+
+/* Some other work is waiting for the worker. */
+bool vhost_has_work(struct vhost_dev *dev)
+{
+	return !list_empty(&dev->work_list);
+}
+
 /* We don't need to be notified again. */
 void vhost_disable_notify(struct vhost_dev *dev, struct vhost_virtqueue *vq)
 {
@@ -1597,13 +1635,13 @@ void vhost_ubuf_put_and_wait(struct vhost_ubuf_ref *ubufs)
 	kfree(ubufs);
 }
 
-void vhost_zerocopy_callback(void *arg)
+void vhost_zerocopy_callback(struct ubuf_info *ubuf, bool zerocopy)
 {
-	struct ubuf_info *ubuf = arg;
 	struct vhost_ubuf_ref *ubufs = ubuf->arg;
 	struct vhost_virtqueue *vq = ubufs->vq;
 
-	/* set len = 1 to mark this desc buffers done DMA */
-	vq->heads[ubuf->desc].len = VHOST_DMA_DONE_LEN;
+	/* set len to mark this desc buffers done DMA */
+	vq->heads[ubuf->desc].len = zerocopy ?
+		VHOST_DMA_DONE_LEN : VHOST_DMA_FAILED_LEN;
 	kref_put(&ubufs->kref, vhost_zerocopy_done_signal);
 }
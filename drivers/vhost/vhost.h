@@ -14,10 +14,14 @@
 #include <linux/atomic.h>
 
 /* This is for zerocopy, used buffer len is set to 1 when lower device DMA
- * done */
+ * done, or to 2 when the lower device had to copy the buffer after all */
+#define VHOST_DMA_FAILED_LEN	2
 #define VHOST_DMA_DONE_LEN	1
 #define VHOST_DMA_CLEAR_LEN	0
 
+#define VHOST_DMA_IS_DONE(len) ((len) == VHOST_DMA_DONE_LEN || \
+				(len) == VHOST_DMA_FAILED_LEN)
+
 struct vhost_device;
 
 struct vhost_work;
@@ -111,6 +115,9 @@ struct vhost_virtqueue {
 	bool log_used;
 	u64 log_addr;
 
+	/* How long to poll an empty ring before re-enabling notification, us */
+	unsigned busyloop_timeout;
+
 	struct iovec iov[UIO_MAXIOV];
 	/* hdr is used to store the virtio header.
 	 * Since each iovec has >= 1 byte length, we never need more than
@@ -141,6 +148,10 @@ struct vhost_virtqueue {
 	/* Reference counting for outstanding ubufs.
 	 * Protected by vq mutex. Writers must also take device mutex. */
 	struct vhost_ubuf_ref *ubufs;
+	/* zerocopy transmits since the last reset of the counters below, and
+	 * how many of those were copied by the lower device anyway */
+	unsigned zcopy_packets;
+	unsigned zcopy_err;
 };
 
 struct vhost_dev {
@@ -185,10 +196,12 @@ void vhost_add_used_and_signal_n(struct vhost_dev *, struct vhost_virtqueue *,
 void vhost_signal(struct vhost_dev *, struct vhost_virtqueue *);
 void vhost_disable_notify(struct vhost_dev *, struct vhost_virtqueue *);
 bool vhost_enable_notify(struct vhost_dev *, struct vhost_virtqueue *);
+bool vhost_vq_avail_empty(struct vhost_dev *, struct vhost_virtqueue *);
+bool vhost_has_work(struct vhost_dev *);
 
 int vhost_log_write(struct vhost_virtqueue *vq, struct vhost_log *log,
 		    unsigned int log_num, u64 len);
-void vhost_zerocopy_callback(void *arg);
+void vhost_zerocopy_callback(struct ubuf_info *ubuf, bool zerocopy);
 int vhost_zerocopy_signal_used(struct vhost_virtqueue *vq);
 
 #define vq_err(vq, fmt, ...) do {                                  \
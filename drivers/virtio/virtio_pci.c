@@ -86,6 +86,9 @@ struct virtio_pci_vq_info
 
 	/* MSI-X vector (or none) */
 	unsigned msix_vector;
+
+	/* affinity hint of a per-vq vector, see vp_set_vq_affinity() */
+	cpumask_var_t affinity;
 };
 
 /* Qumranet donated their vendor ID for devices 0x1000 thru 0x10FF. */
@@ -397,6 +400,10 @@ static struct virtqueue *setup_vq(struct virtio_device *vdev, unsigned index,
 	info = kmalloc(sizeof(struct virtio_pci_vq_info), GFP_KERNEL);
 	if (!info)
 		return ERR_PTR(-ENOMEM);
+	if (!zalloc_cpumask_var(&info->affinity, GFP_KERNEL)) {
+		kfree(info);
+		return ERR_PTR(-ENOMEM);
+	}
 
 	info->queue_index = index;
 	info->num = num;
@@ -449,6 +456,7 @@ out_activate_queue:
 	iowrite32(0, vp_dev->ioaddr + VIRTIO_PCI_QUEUE_PFN);
 	free_pages_exact(info->queue, size);
 out_info:
+	free_cpumask_var(info->affinity);
 	kfree(info);
 	return ERR_PTR(err);
 }
@@ -479,6 +487,7 @@ static void vp_del_vq(struct virtqueue *vq)
 
 	size = PAGE_ALIGN(vring_size(info->num, VIRTIO_PCI_VRING_ALIGN));
 	free_pages_exact(info->queue, size);
+	free_cpumask_var(info->affinity);
 	kfree(info);
 }
 
@@ -492,9 +501,13 @@ static void vp_del_vqs(struct virtio_device *vdev)
 	list_for_each_entry_safe(vq, n, &vdev->vqs, list) {
 		info = vq->priv;
 		if (vp_dev->per_vq_vectors &&
-			info->msix_vector != VIRTIO_MSI_NO_VECTOR)
-			free_irq(vp_dev->msix_entries[info->msix_vector].vector,
-				 vq);
+			info->msix_vector != VIRTIO_MSI_NO_VECTOR) {
+			unsigned irq =
+				vp_dev->msix_entries[info->msix_vector].vector;
+
+			irq_set_affinity_hint(irq, NULL);
+			free_irq(irq, vq);
+		}
 		vp_del_vq(vq);
 	}
 	vp_dev->per_vq_vectors = false;
@@ -598,6 +611,23 @@ static int vp_find_vqs(struct virtio_device *vdev, unsigned nvqs,
 				  false, false);
 }
 
+/* the config->set_vq_affinity() implementation */
+static int vp_set_vq_affinity(struct virtqueue *vq, const struct cpumask *mask)
+{
+	struct virtio_pci_device *vp_dev = to_vp_device(vq->vdev);
+	struct virtio_pci_vq_info *info = vq->priv;
+
+	/* a shared or legacy interrupt can't follow a single queue */
+	if (!vp_dev->per_vq_vectors ||
+	    info->msix_vector == VIRTIO_MSI_NO_VECTOR)
+		return -EINVAL;
+
+	cpumask_copy(info->affinity, mask);
+	return irq_set_affinity_hint(
+			vp_dev->msix_entries[info->msix_vector].vector,
+			info->affinity);
+}
+
 static struct virtio_config_ops virtio_pci_config_ops = {
 	.get		= vp_get,
 	.set		= vp_set,
@@ -608,6 +638,7 @@ static struct virtio_config_ops virtio_pci_config_ops = {
 	.del_vqs	= vp_del_vqs,
 	.get_features	= vp_get_features,
 	.finalize_features = vp_finalize_features,
+	.set_vq_affinity = vp_set_vq_affinity,
 };
 
 static void virtio_pci_release_dev(struct device *_d)
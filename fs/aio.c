@@ -35,6 +35,10 @@
 #include <linux/eventfd.h>
 #include <linux/blkdev.h>
 #include <linux/compat.h>
+#include <linux/pagemap.h>
+#include <linux/vmalloc.h>
+#include <linux/kthread.h>
+#include <linux/cred.h>
 
 #include <asm/kmap_types.h>
 #include <asm/uaccess.h>
@@ -55,6 +59,7 @@ static struct kmem_cache	*kiocb_cachep;
 static struct kmem_cache	*kioctx_cachep;
 
 static struct workqueue_struct *aio_wq;
+static struct workqueue_struct *aio_buffered_wq;
 
 /* Used for rare fput completion. */
 static void aio_fput_routine(struct work_struct *);
@@ -65,6 +70,7 @@ static LIST_HEAD(fput_head);
 
 static void aio_kick_handler(struct work_struct *);
 static void aio_queue_work(struct kioctx *);
+static int aio_sq_thread(void *data);
 
 /* aio_setup
  *	Creates the slab caches used by the aio routines, panic on
@@ -77,6 +83,9 @@ static int __init aio_setup(void)
 
 	aio_wq = alloc_workqueue("aio", 0, 1);	/* used to limit concurrency */
 	BUG_ON(!aio_wq);
+	/* buffered io that may block; wants as many workers as it takes */
+	aio_buffered_wq = alloc_workqueue("aio_buffered", WQ_UNBOUND, 0);
+	BUG_ON(!aio_buffered_wq);
 
 	pr_debug("aio_setup: sizeof(struct page) = %d\n", (int)sizeof(struct page));
 
@@ -89,6 +98,11 @@ static void aio_free_ring(struct kioctx *ctx)
 	struct aio_ring_info *info = &ctx->ring_info;
 	long i;
 
+	if (ctx->sq_ring) {
+		vunmap(ctx->sq_ring);
+		ctx->sq_ring = NULL;
+	}
+
 	for (i=0; i<info->nr_pages; i++)
 		put_page(info->ring_pages[i]);
 
@@ -110,7 +124,7 @@ static int aio_setup_ring(struct kioctx *ctx)
 	struct aio_ring_info *info = &ctx->ring_info;
 	unsigned nr_events = ctx->max_reqs;
 	unsigned long size;
-	int nr_pages;
+	int nr_pages, sq_pages = 0;
 
 	/* Compensate for the ring buffer's head/tail overlap entry */
 	nr_events += 2;	/* 1 is required, 2 for good luck */
@@ -124,6 +138,14 @@ static int aio_setup_ring(struct kioctx *ctx)
 
 	nr_events = (PAGE_SIZE * nr_pages - sizeof(struct aio_ring)) / sizeof(struct io_event);
 
+	/* the submission ring, if any, follows the completion ring */
+	if (ctx->sq_nr) {
+		size = sizeof(struct aio_sq_ring);
+		size += sizeof(struct iocb) * ctx->sq_nr;
+		sq_pages = (size + PAGE_SIZE-1) >> PAGE_SHIFT;
+		nr_pages += sq_pages;
+	}
+
 	info->nr = 0;
 	info->ring_pages = info->internal_pages;
 	if (nr_pages > AIO_RING_PAGES) {
@@ -158,6 +180,22 @@ static int aio_setup_ring(struct kioctx *ctx)
 
 	ctx->user_id = info->mmap_base;
 
+	if (sq_pages) {
+		int sq_first = nr_pages - sq_pages;
+
+		ctx->sq_ring = vmap(info->ring_pages + sq_first, sq_pages,
+				    VM_MAP, PAGE_KERNEL);
+		if (!ctx->sq_ring) {
+			aio_free_ring(ctx);
+			return -ENOMEM;
+		}
+		ctx->sq_user = info->mmap_base + ((unsigned long)sq_first << PAGE_SHIFT);
+		ctx->sq_ring->head = ctx->sq_ring->tail = 0;
+		ctx->sq_ring->nr = ctx->sq_nr;
+		ctx->sq_ring->flags = 0;
+		ctx->sq_ring->dropped = 0;
+	}
+
 	info->nr = nr_events;		/* trusted copy */
 
 	ring = kmap_atomic(info->ring_pages[0], KM_USER0);
@@ -211,6 +249,17 @@ static void ctx_rcu_free(struct rcu_head *head)
 	}
 }
 
+static void aio_unregister_files(struct kioctx *ctx)
+{
+	unsigned i;
+
+	for (i = 0; i < ctx->nr_files; i++)
+		fput(ctx->files[i]);
+	kfree(ctx->files);
+	ctx->files = NULL;
+	ctx->nr_files = 0;
+}
+
 /* __put_ioctx
  *	Called when the last user of an aio context has gone away,
  *	and the struct needs to be freed.
@@ -222,6 +271,9 @@ static void __put_ioctx(struct kioctx *ctx)
 	cancel_delayed_work(&ctx->wq);
 	cancel_work_sync(&ctx->wq.work);
 	aio_free_ring(ctx);
+	aio_unregister_files(ctx);
+	if (ctx->sq_creds)
+		put_cred(ctx->sq_creds);
 	mmdrop(ctx->mm);
 	ctx->mm = NULL;
 	pr_debug("__put_ioctx: freeing %p\n", ctx);
@@ -243,7 +295,7 @@ static inline void put_ioctx(struct kioctx *kioctx)
 /* ioctx_alloc
  *	Allocates and initializes an ioctx.  Returns an ERR_PTR if it failed.
  */
-static struct kioctx *ioctx_alloc(unsigned nr_events)
+static struct kioctx *ioctx_alloc(unsigned nr_events, unsigned sq_entries)
 {
 	struct mm_struct *mm;
 	struct kioctx *ctx;
@@ -264,6 +316,7 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 		return ERR_PTR(-ENOMEM);
 
 	ctx->max_reqs = nr_events;
+	ctx->sq_nr = sq_entries;
 	mm = ctx->mm = current->mm;
 	atomic_inc(&mm->mm_count);
 
@@ -275,6 +328,8 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 	INIT_LIST_HEAD(&ctx->active_reqs);
 	INIT_LIST_HEAD(&ctx->run_list);
 	INIT_DELAYED_WORK(&ctx->wq, aio_kick_handler);
+	mutex_init(&ctx->sq_lock);
+	init_waitqueue_head(&ctx->sq_wait);
 
 	if (aio_setup_ring(ctx) < 0)
 		goto out_freectx;
@@ -331,6 +386,13 @@ static void aio_cancel_all(struct kioctx *ctx)
 {
 	int (*cancel)(struct kiocb *, struct io_event *);
 	struct io_event res;
+	struct task_struct *sq_thread;
+
+	/* no more submissions from the ring */
+	sq_thread = xchg(&ctx->sq_thread, NULL);
+	if (sq_thread)
+		kthread_stop(sq_thread);
+
 	spin_lock_irq(&ctx->ctx_lock);
 	ctx->dead = 1;
 	while (!list_empty(&ctx->active_reqs)) {
@@ -1339,7 +1401,7 @@ SYSCALL_DEFINE2(io_setup, unsigned, nr_events, aio_context_t __user *, ctxp)
 		goto out;
 	}
 
-	ioctx = ioctx_alloc(nr_events);
+	ioctx = ioctx_alloc(nr_events, 0);
 	ret = PTR_ERR(ioctx);
 	if (!IS_ERR(ioctx)) {
 		ret = put_user(ioctx->user_id, ctxp);
@@ -1354,6 +1416,133 @@ out:
 	return ret;
 }
 
+#define AIO_SQ_MAX_ENTRIES	4096
+#define AIO_MAX_FIXED_FILES	4096
+
+static int aio_register_files(struct kioctx *ctx, __s32 __user *fds,
+			      unsigned nr)
+{
+	struct file **files;
+	unsigned i;
+	__s32 fd;
+	int ret;
+
+	if (nr > AIO_MAX_FIXED_FILES)
+		return -EINVAL;
+
+	files = kcalloc(nr, sizeof(struct file *), GFP_KERNEL);
+	if (!files)
+		return -ENOMEM;
+
+	for (i = 0; i < nr; i++) {
+		ret = -EFAULT;
+		if (get_user(fd, &fds[i]))
+			goto err;
+		ret = -EBADF;
+		files[i] = fget(fd);
+		if (!files[i])
+			goto err;
+	}
+
+	ctx->files = files;
+	/* the table must be visible before anyone can index it */
+	smp_wmb();
+	ctx->nr_files = nr;
+	return 0;
+
+err:
+	while (i--)
+		fput(files[i]);
+	kfree(files);
+	return ret;
+}
+
+static int aio_sq_start_thread(struct kioctx *ctx, unsigned idle_ms)
+{
+	struct task_struct *p;
+
+	ctx->sq_idle = msecs_to_jiffies(idle_ms ? idle_ms : 1000);
+	ctx->sq_creds = get_current_cred();
+
+	p = kthread_create(aio_sq_thread, ctx, "aio_sq/%d",
+			   task_pid_nr(current));
+	if (IS_ERR(p))
+		return PTR_ERR(p);
+	ctx->sq_thread = p;
+	wake_up_process(p);
+	return 0;
+}
+
+/* sys_io_setup2:
+ *	Like io_setup(), with the extra setup described by *params:
+ *	optionally a submission ring mapped next to the completion ring,
+ *	a kernel thread polling it, and a table of pre-registered files
+ *	(see the IOCTX_FLAG_* comments in aio_abi.h).  On success the
+ *	actual ring size and its offset are written back to *params.
+ *	May fail with -EPERM if IOCTX_FLAG_SQPOLL is asked for without
+ *	CAP_SYS_ADMIN, and with -EBADF if one of the files is invalid,
+ *	in addition to the io_setup() errors.
+ */
+SYSCALL_DEFINE3(io_setup2, unsigned, nr_events,
+		struct aio_setup_params __user *, params,
+		aio_context_t __user *, ctxp)
+{
+	struct aio_setup_params p;
+	struct kioctx *ioctx;
+	unsigned long ctx;
+	long ret;
+
+	if (copy_from_user(&p, params, sizeof(p)))
+		return -EFAULT;
+	ret = get_user(ctx, ctxp);
+	if (unlikely(ret))
+		return ret;
+
+	if (unlikely(ctx || nr_events == 0))
+		return -EINVAL;
+	if (p.flags & ~(IOCTX_FLAG_SQRING | IOCTX_FLAG_SQPOLL) ||
+	    p.resv[0] || p.resv[1])
+		return -EINVAL;
+	if (p.flags & IOCTX_FLAG_SQPOLL) {
+		if (!capable(CAP_SYS_ADMIN))
+			return -EPERM;
+		p.flags |= IOCTX_FLAG_SQRING;
+	}
+	if (p.flags & IOCTX_FLAG_SQRING) {
+		if (!p.sq_entries || p.sq_entries > AIO_SQ_MAX_ENTRIES)
+			return -EINVAL;
+		p.sq_entries = roundup_pow_of_two(p.sq_entries);
+	} else
+		p.sq_entries = 0;
+
+	ioctx = ioctx_alloc(nr_events, p.sq_entries);
+	if (IS_ERR(ioctx))
+		return PTR_ERR(ioctx);
+#ifdef CONFIG_COMPAT
+	ioctx->sq_compat = is_compat_task();
+#endif
+
+	ret = 0;
+	if (p.nr_files)
+		ret = aio_register_files(ioctx,
+				(__s32 __user *)(unsigned long)p.files,
+				p.nr_files);
+	if (!ret && (p.flags & IOCTX_FLAG_SQPOLL))
+		ret = aio_sq_start_thread(ioctx, p.sq_thread_idle);
+	if (!ret) {
+		p.sq_offset = p.sq_entries ? ioctx->sq_user - ioctx->user_id : 0;
+		if (copy_to_user(params, &p, sizeof(p)) ||
+		    put_user(ioctx->user_id, ctxp))
+			ret = -EFAULT;
+	}
+	if (ret) {
+		io_destroy(ioctx);
+		return ret;
+	}
+	put_ioctx(ioctx);
+	return 0;
+}
+
 /* sys_io_destroy:
  *	Destroy the aio_context specified.  May cancel any outstanding 
  *	AIOs and block on completion.  Will fail with -ENOSYS if not
@@ -1394,6 +1583,72 @@ static void aio_advance_iovec(struct kiocb *iocb, ssize_t ret)
 	BUG_ON(ret > 0 && iocb->ki_left == 0);
 }
 
+/*
+ * Buffered reads and writes can block for a long time in the page cache
+ * (read misses, page allocation, dirty throttling), and io_submit() would
+ * stall with them.  Reads whose pages are all cached and uptodate are done
+ * inline; everything else runs from aio_buffered_wq in the submitter's mm,
+ * or fails straight away if the iocb asked for IOCB_FLAG_NOWAIT.
+ */
+static bool aio_range_cached(struct address_space *mapping, loff_t pos,
+			     size_t len)
+{
+	loff_t isize = i_size_read(mapping->host);
+	pgoff_t index, end;
+
+	if (!len || pos >= isize)
+		return true;
+	if (len > isize - pos)
+		len = isize - pos;
+
+	index = pos >> PAGE_CACHE_SHIFT;
+	end = (pos + len - 1) >> PAGE_CACHE_SHIFT;
+	for (; index <= end; index++) {
+		struct page *page = find_get_page(mapping, index);
+		int uptodate;
+
+		if (!page)
+			return false;
+		uptodate = PageUptodate(page);
+		page_cache_release(page);
+		if (!uptodate)
+			return false;
+	}
+	return true;
+}
+
+static void aio_buffered_work(struct work_struct *work)
+{
+	struct kiocb *iocb = container_of(work, struct kiocb, ki_work);
+	struct kioctx *ctx = iocb->ki_ctx;
+	mm_segment_t oldfs = get_fs();
+	struct mm_struct *mm = ctx->mm;
+
+	set_fs(USER_DS);
+	use_mm(mm);
+	spin_lock_irq(&ctx->ctx_lock);
+	aio_run_iocb(iocb);
+	__aio_put_req(ctx, iocb);
+	spin_unlock_irq(&ctx->ctx_lock);
+	/* ctx may be gone now */
+	unuse_mm(mm);
+	set_fs(oldfs);
+}
+
+static ssize_t aio_punt_buffered(struct kiocb *iocb)
+{
+	struct kioctx *ctx = iocb->ki_ctx;
+
+	spin_lock_irq(&ctx->ctx_lock);
+	iocb->ki_users++;	/* dropped by aio_buffered_work */
+	spin_unlock_irq(&ctx->ctx_lock);
+
+	kiocbSetPunted(iocb);
+	INIT_WORK(&iocb->ki_work, aio_buffered_work);
+	queue_work(aio_buffered_wq, &iocb->ki_work);
+	return -EIOCBRETRY;
+}
+
 static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 {
 	struct file *file = iocb->ki_filp;
@@ -1417,6 +1672,20 @@ static ssize_t aio_rw_vect_retry(struct kiocb *iocb)
 	if (iocb->ki_pos < 0)
 		return -EINVAL;
 
+	if (!kiocbIsPunted(iocb) && S_ISREG(inode->i_mode) &&
+	    !(file->f_flags & O_DIRECT)) {
+		if (opcode == IOCB_CMD_PWRITEV) {
+			if (kiocbIsNowait(iocb))
+				return -EOPNOTSUPP;
+			return aio_punt_buffered(iocb);
+		}
+		if (!aio_range_cached(mapping, iocb->ki_pos, iocb->ki_left)) {
+			if (kiocbIsNowait(iocb))
+				return -EAGAIN;
+			return aio_punt_buffered(iocb);
+		}
+	}
+
 	do {
 		ret = rw_op(iocb, &iocb->ki_iovec[iocb->ki_cur_seg],
 			    iocb->ki_nr_segs - iocb->ki_cur_seg,
@@ -1623,9 +1892,17 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 		return -EINVAL;
 	}
 
-	file = fget(iocb->aio_fildes);
-	if (unlikely(!file))
-		return -EBADF;
+	if (iocb->aio_flags & IOCB_FLAG_FIXED_FILE) {
+		/* the table is set up before the ctx id is handed out */
+		if (unlikely(iocb->aio_fildes >= ctx->nr_files))
+			return -EBADF;
+		file = ctx->files[iocb->aio_fildes];
+		get_file(file);
+	} else {
+		file = fget(iocb->aio_fildes);
+		if (unlikely(!file))
+			return -EBADF;
+	}
 
 	req = aio_get_req(ctx, batch);  /* returns with 2 references to req */
 	if (unlikely(!req)) {
@@ -1661,6 +1938,8 @@ static int io_submit_one(struct kioctx *ctx, struct iocb __user *user_iocb,
 	req->ki_buf = (char __user *)(unsigned long)iocb->aio_buf;
 	req->ki_left = req->ki_nbytes = iocb->aio_nbytes;
 	req->ki_opcode = iocb->aio_lio_opcode;
+	if (iocb->aio_flags & IOCB_FLAG_NOWAIT)
+		kiocbSetNowait(req);
 
 	ret = aio_setup_iocb(req, compat);
 
@@ -1702,6 +1981,111 @@ out_put_req:
 	return ret;
 }
 
+/*
+ * Submit everything queued on the submission ring.  Bad iocbs are skipped
+ * and counted in sq_ring->dropped; running out of request slots leaves
+ * the rest on the ring for the next call.
+ */
+static long aio_sq_submit(struct kioctx *ctx)
+{
+	struct aio_sq_ring *sq = ctx->sq_ring;
+	unsigned mask = ctx->sq_nr - 1;
+	struct kiocb_batch batch;
+	struct blk_plug plug;
+	unsigned head, tail;
+	long submitted = 0;
+	int ret;
+
+	mutex_lock(&ctx->sq_lock);
+	head = ctx->sq_head;
+	tail = ACCESS_ONCE(sq->tail);
+	/* read the tail before the iocbs it publishes */
+	smp_rmb();
+	if (tail - head > ctx->sq_nr)
+		tail = head + ctx->sq_nr;
+	if (head == tail)
+		goto out;
+
+	kiocb_batch_init(&batch, tail - head);
+	blk_start_plug(&plug);
+	while (head != tail) {
+		struct iocb __user *user_iocb;
+		struct iocb tmp;
+
+		tmp = sq->iocbs[head & mask];
+		user_iocb = (struct iocb __user *)(ctx->sq_user +
+				offsetof(struct aio_sq_ring, iocbs) +
+				(head & mask) * sizeof(struct iocb));
+
+		/* the poll thread has no fd table of its own */
+		if ((current->flags & PF_KTHREAD) &&
+		    !(tmp.aio_flags & IOCB_FLAG_FIXED_FILE))
+			ret = -EBADF;
+		else
+			ret = io_submit_one(ctx, user_iocb, &tmp, &batch,
+					    ctx->sq_compat);
+		if (ret == -EAGAIN)
+			break;
+		if (ret)
+			sq->dropped++;
+		head++;
+		submitted++;
+	}
+	blk_finish_plug(&plug);
+	kiocb_batch_free(ctx, &batch);
+
+	/* done reading the slots before handing them back */
+	smp_mb();
+	ctx->sq_head = head;
+	sq->head = head;
+out:
+	mutex_unlock(&ctx->sq_lock);
+	return submitted;
+}
+
+static int aio_sq_thread(void *data)
+{
+	struct kioctx *ctx = data;
+	struct aio_sq_ring *sq = ctx->sq_ring;
+	mm_segment_t oldfs = get_fs();
+	const struct cred *old_cred;
+	unsigned long timeout;
+	DEFINE_WAIT(wait);
+
+	set_fs(USER_DS);
+	use_mm(ctx->mm);
+	old_cred = override_creds(ctx->sq_creds);
+
+	timeout = jiffies + ctx->sq_idle;
+	while (!kthread_should_stop()) {
+		if (aio_sq_submit(ctx)) {
+			timeout = jiffies + ctx->sq_idle;
+			cond_resched();
+			continue;
+		}
+		if (time_before(jiffies, timeout)) {
+			cond_resched();
+			continue;
+		}
+
+		prepare_to_wait(&ctx->sq_wait, &wait, TASK_INTERRUPTIBLE);
+		sq->flags |= AIO_SQ_NEED_WAKEUP;
+		/* publish the flag before the final look at the tail */
+		smp_mb();
+		if (ACCESS_ONCE(sq->tail) == ctx->sq_head &&
+		    !kthread_should_stop())
+			schedule();
+		finish_wait(&ctx->sq_wait, &wait);
+		sq->flags &= ~AIO_SQ_NEED_WAKEUP;
+		timeout = jiffies + ctx->sq_idle;
+	}
+
+	revert_creds(old_cred);
+	unuse_mm(ctx->mm);
+	set_fs(oldfs);
+	return 0;
+}
+
 long do_io_submit(aio_context_t ctx_id, long nr,
 		  struct iocb __user *__user *iocbpp, bool compat)
 {
@@ -1726,6 +2110,16 @@ long do_io_submit(aio_context_t ctx_id, long nr,
 		return -EINVAL;
 	}
 
+	/* nr == 0 on a ring context means "go look at the ring" */
+	if (!nr && ctx->sq_ring) {
+		if (ctx->sq_thread)
+			wake_up(&ctx->sq_wait);
+		else
+			ret = aio_sq_submit(ctx);
+		put_ioctx(ctx);
+		return ret;
+	}
+
 	kiocb_batch_init(&batch, nr);
 
 	blk_start_plug(&plug);
@@ -958,6 +958,10 @@ static int load_elf_binary(struct linux_binprm *bprm, struct pt_regs *regs)
 	current->mm->end_data = end_data;
 	current->mm->start_stack = bprm->p;
 
+	/* don't fault the text in page by page if it is cached already */
+	if (sysctl_exec_prefault)
+		map_cached_pages(current->mm, start_code, end_code);
+
 #ifdef arch_randomize_brk
 	if ((current->flags & PF_RANDOMIZE) && (randomize_va_space > 1)) {
 		current->mm->brk = current->mm->start_brk =
@@ -32,6 +32,7 @@
 #include <linux/writeback.h>
 #include <linux/bit_spinlock.h>
 #include <linux/slab.h>
+#include <linux/ktime.h>
 #include "compat.h"
 #include "ctree.h"
 #include "disk-io.h"
@@ -732,6 +733,54 @@ struct btrfs_compress_op *btrfs_compress_op[] = {
 	&btrfs_lzo_compress,
 };
 
+static const char * const btrfs_compress_names[] = {
+	"zlib",
+	"lzo",
+};
+
+/*
+ * Throughput counters for each algorithm, reported through
+ * /sys/fs/btrfs/compress_stats.  Decompression is accounted by the
+ * compressed bytes consumed.
+ */
+struct btrfs_compress_stats {
+	atomic64_t comp_in;
+	atomic64_t comp_out;
+	atomic64_t comp_ns;
+	atomic64_t decomp_in;
+	atomic64_t decomp_ns;
+};
+
+static struct btrfs_compress_stats comp_stats[BTRFS_COMPRESS_TYPES];
+
+static inline u64 comp_elapsed_ns(ktime_t start)
+{
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+ssize_t btrfs_compress_show_stats(char *buf)
+{
+	struct btrfs_compress_stats *st;
+	ssize_t len;
+	int i;
+
+	len = scnprintf(buf, PAGE_SIZE, "%-6s %14s %14s %12s %14s %12s\n",
+			"type", "comp_in", "comp_out", "comp_us",
+			"decomp_in", "decomp_us");
+	for (i = 0; i < BTRFS_COMPRESS_TYPES; i++) {
+		st = &comp_stats[i];
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+			"%-6s %14llu %14llu %12llu %14llu %12llu\n",
+			btrfs_compress_names[i],
+			(unsigned long long)atomic64_read(&st->comp_in),
+			(unsigned long long)atomic64_read(&st->comp_out),
+			div_u64(atomic64_read(&st->comp_ns), NSEC_PER_USEC),
+			(unsigned long long)atomic64_read(&st->decomp_in),
+			div_u64(atomic64_read(&st->decomp_ns), NSEC_PER_USEC));
+	}
+	return len;
+}
+
 int __init btrfs_init_compress(void)
 {
 	int i;
@@ -857,7 +906,8 @@ static void free_workspaces(void)
  * max_out tells us the max number of bytes that we're allowed to
  * stuff into pages
  */
-int btrfs_compress_pages(int type, struct address_space *mapping,
+int btrfs_compress_pages(int type, unsigned int level,
+			 struct address_space *mapping,
 			 u64 start, unsigned long len,
 			 struct page **pages,
 			 unsigned long nr_dest_pages,
@@ -866,18 +916,27 @@ int btrfs_compress_pages(int type, struct address_space *mapping,
 			 unsigned long *total_out,
 			 unsigned long max_out)
 {
+	struct btrfs_compress_stats *st = &comp_stats[type - 1];
 	struct list_head *workspace;
+	ktime_t start_time;
 	int ret;
 
 	workspace = find_workspace(type);
 	if (IS_ERR(workspace))
 		return -1;
 
+	if (btrfs_compress_op[type-1]->set_level)
+		btrfs_compress_op[type-1]->set_level(workspace, level);
+
+	start_time = ktime_get();
 	ret = btrfs_compress_op[type-1]->compress_pages(workspace, mapping,
 						      start, len, pages,
 						      nr_dest_pages, out_pages,
 						      total_in, total_out,
 						      max_out);
+	atomic64_add(comp_elapsed_ns(start_time), &st->comp_ns);
+	atomic64_add(*total_in, &st->comp_in);
+	atomic64_add(*total_out, &st->comp_out);
 	free_workspace(type, workspace);
 	return ret;
 }
@@ -902,15 +961,20 @@ int btrfs_decompress_biovec(int type, struct page **pages_in, u64 disk_start,
 			    struct bio_vec *bvec, int vcnt, size_t srclen)
 {
 	struct list_head *workspace;
+	ktime_t start_time;
 	int ret;
 
 	workspace = find_workspace(type);
 	if (IS_ERR(workspace))
 		return -ENOMEM;
 
+	start_time = ktime_get();
 	ret = btrfs_compress_op[type-1]->decompress_biovec(workspace, pages_in,
 							 disk_start,
 							 bvec, vcnt, srclen);
+	atomic64_add(comp_elapsed_ns(start_time),
+		     &comp_stats[type - 1].decomp_ns);
+	atomic64_add(srclen, &comp_stats[type - 1].decomp_in);
 	free_workspace(type, workspace);
 	return ret;
 }
@@ -924,15 +988,20 @@ int btrfs_decompress(int type, unsigned char *data_in, struct page *dest_page,
 		     unsigned long start_byte, size_t srclen, size_t destlen)
 {
 	struct list_head *workspace;
+	ktime_t start_time;
 	int ret;
 
 	workspace = find_workspace(type);
 	if (IS_ERR(workspace))
 		return -ENOMEM;
 
+	start_time = ktime_get();
 	ret = btrfs_compress_op[type-1]->decompress(workspace, data_in,
 						  dest_page, start_byte,
 						  srclen, destlen);
+	atomic64_add(comp_elapsed_ns(start_time),
+		     &comp_stats[type - 1].decomp_ns);
+	atomic64_add(srclen, &comp_stats[type - 1].decomp_in);
 
 	free_workspace(type, workspace);
 	return ret;
@@ -19,10 +19,16 @@
 #ifndef __BTRFS_COMPRESSION_
 #define __BTRFS_COMPRESSION_
 
+/* zlib levels accepted by compress=zlib:<level>, and the default */
+#define BTRFS_ZLIB_MIN_LEVEL		1
+#define BTRFS_ZLIB_MAX_LEVEL		9
+#define BTRFS_ZLIB_DEFAULT_LEVEL	3
+
 int btrfs_init_compress(void);
 void btrfs_exit_compress(void);
 
-int btrfs_compress_pages(int type, struct address_space *mapping,
+int btrfs_compress_pages(int type, unsigned int level,
+			 struct address_space *mapping,
 			 u64 start, unsigned long len,
 			 struct page **pages,
 			 unsigned long nr_dest_pages,
@@ -48,11 +54,16 @@ int btrfs_submit_compressed_write(struct inode *inode, u64 start,
 int btrfs_submit_compressed_read(struct inode *inode, struct bio *bio,
 				 int mirror_num, unsigned long bio_flags);
 
+ssize_t btrfs_compress_show_stats(char *buf);
+
 struct btrfs_compress_op {
 	struct list_head *(*alloc_workspace)(void);
 
 	void (*free_workspace)(struct list_head *workspace);
 
+	/* optional, sets the level used by the next compress_pages call */
+	void (*set_level)(struct list_head *workspace, unsigned int level);
+
 	int (*compress_pages)(struct list_head *workspace,
 			      struct address_space *mapping,
 			      u64 start, unsigned long len,
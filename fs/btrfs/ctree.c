@@ -1652,10 +1652,16 @@ int btrfs_search_slot(struct btrfs_trans_handle *trans, struct btrfs_root
 		write_lock_level = 2;
 	} else if (ins_len > 0) {
 		/*
-		 * for inserting items, make sure we have a write lock on
-		 * level 1 so we can update keys
+		 * for inserting items we start out write locking only the
+		 * leaf.  Level 1 is often the root of the tree, and most
+		 * inserts go into a leaf with room to spare at a slot other
+		 * than zero, so they never touch it.  If we find we have to
+		 * split the leaf or update the keys above it we trade up to
+		 * a write lock on level 1 and retry.  write_lock_level only
+		 * ever grows, so the number of retries is bounded by the
+		 * height of the tree.
 		 */
-		write_lock_level = 1;
+		write_lock_level = 0;
 	}
 
 	if (!cow)
@@ -1837,6 +1843,16 @@ cow_done:
 			}
 		} else {
 			p->slots[level] = slot;
+			/*
+			 * inserting at slot zero changes the low key of the
+			 * leaf, which has to be fixed up in the parent
+			 */
+			if (ins_len > 0 && slot == 0 && p->nodes[1] &&
+			    write_lock_level < 1) {
+				write_lock_level = 1;
+				btrfs_release_path(p);
+				goto again;
+			}
 			if (ins_len > 0 &&
 			    btrfs_leaf_free_space(root, b) < ins_len) {
 				if (write_lock_level < 1) {
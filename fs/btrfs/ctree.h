@@ -973,6 +973,7 @@ struct btrfs_fs_info {
 	u64 last_trans_log_full_commit;
 	unsigned long mount_opt:20;
 	unsigned long compress_type:4;
+	unsigned long compress_level:4;
 	u64 max_inline;
 	u64 alloc_start;
 	struct btrfs_transaction *running_transaction;
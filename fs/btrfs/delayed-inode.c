@@ -24,6 +24,7 @@
 
 #define BTRFS_DELAYED_WRITEBACK		400
 #define BTRFS_DELAYED_BACKGROUND	100
+#define BTRFS_DELAYED_BATCH		16
 
 static struct kmem_cache *delayed_node_cache;
 
@@ -1194,126 +1195,119 @@ void btrfs_remove_delayed_node(struct inode *inode)
 	btrfs_release_delayed_node(delayed_node);
 }
 
-struct btrfs_async_delayed_node {
-	struct btrfs_root *root;
-	struct btrfs_delayed_node *delayed_node;
+struct btrfs_async_delayed_work {
+	struct btrfs_delayed_root *delayed_root;
 	struct btrfs_work work;
 };
 
-static void btrfs_async_run_delayed_node_done(struct btrfs_work *work)
+/*
+ * Each async work flushes up to BTRFS_DELAYED_BATCH prepared nodes under a
+ * single transaction handle, and balances the dirty btree pages once for
+ * the whole batch instead of once per inode.
+ *
+ * A node that still has items when we are done with it goes back on the
+ * prepare list, and an empty one is dequeued, both by
+ * btrfs_release_prepared_delayed_node().  Dequeueing the empty nodes here
+ * matters: a task adding lots of items to a node that is still in the
+ * node list but not in the prepare list assumes the worker is dealing with
+ * it, and would otherwise sleep in btrfs_balance_delayed_items() until the
+ * transaction is committed.
+ */
+static void btrfs_async_run_delayed_root(struct btrfs_work *work)
 {
-	struct btrfs_async_delayed_node *async_node;
-	struct btrfs_trans_handle *trans;
+	struct btrfs_async_delayed_work *async_work;
+	struct btrfs_delayed_root *delayed_root;
+	struct btrfs_trans_handle *trans = NULL;
 	struct btrfs_path *path;
-	struct btrfs_delayed_node *delayed_node = NULL;
-	struct btrfs_root *root;
-	struct btrfs_block_rsv *block_rsv;
-	unsigned long nr = 0;
-	int need_requeue = 0;
+	struct btrfs_delayed_node *delayed_node;
+	struct btrfs_root *root = NULL;
+	struct btrfs_block_rsv *block_rsv = NULL;
+	unsigned long nr;
+	int total_done = 0;
 	int ret;
 
-	async_node = container_of(work, struct btrfs_async_delayed_node, work);
+	async_work = container_of(work, struct btrfs_async_delayed_work, work);
+	delayed_root = async_work->delayed_root;
 
 	path = btrfs_alloc_path();
 	if (!path)
 		goto out;
 	path->leave_spinning = 1;
 
-	delayed_node = async_node->delayed_node;
-	root = delayed_node->root;
+	while (total_done < BTRFS_DELAYED_BATCH) {
+		if (atomic_read(&delayed_root->items) <
+		    BTRFS_DELAYED_BACKGROUND / 2)
+			break;
 
-	trans = btrfs_join_transaction(root);
-	if (IS_ERR(trans))
-		goto free_path;
+		delayed_node = btrfs_first_prepared_delayed_node(delayed_root);
+		if (!delayed_node)
+			break;
 
-	block_rsv = trans->block_rsv;
-	trans->block_rsv = &root->fs_info->delayed_block_rsv;
+		if (!trans) {
+			root = delayed_node->root;
+			trans = btrfs_join_transaction(root);
+			if (IS_ERR(trans)) {
+				trans = NULL;
+				btrfs_release_prepared_delayed_node(
+							delayed_node);
+				break;
+			}
+			block_rsv = trans->block_rsv;
+			trans->block_rsv = &root->fs_info->delayed_block_rsv;
+		}
 
-	ret = btrfs_insert_delayed_items(trans, path, root, delayed_node);
-	if (!ret)
-		ret = btrfs_delete_delayed_items(trans, path, root,
+		ret = btrfs_insert_delayed_items(trans, path,
+						 delayed_node->root,
 						 delayed_node);
+		if (!ret)
+			ret = btrfs_delete_delayed_items(trans, path,
+							 delayed_node->root,
+							 delayed_node);
+		if (!ret)
+			btrfs_update_delayed_inode(trans, delayed_node->root,
+						   path, delayed_node);
 
-	if (!ret)
-		btrfs_update_delayed_inode(trans, root, path, delayed_node);
-
-	/*
-	 * Maybe new delayed items have been inserted, so we need requeue
-	 * the work. Besides that, we must dequeue the empty delayed nodes
-	 * to avoid the race between delayed items balance and the worker.
-	 * The race like this:
-	 * 	Task1				Worker thread
-	 * 					count == 0, needn't requeue
-	 * 					  also needn't insert the
-	 * 					  delayed node into prepare
-	 * 					  list again.
-	 * 	add lots of delayed items
-	 * 	queue the delayed node
-	 * 	  already in the list,
-	 * 	  and not in the prepare
-	 * 	  list, it means the delayed
-	 * 	  node is being dealt with
-	 * 	  by the worker.
-	 * 	do delayed items balance
-	 * 	  the delayed node is being
-	 * 	  dealt with by the worker
-	 * 	  now, just wait.
-	 * 	  				the worker goto idle.
-	 * Task1 will sleep until the transaction is commited.
-	 */
-	mutex_lock(&delayed_node->mutex);
-	if (delayed_node->count)
-		need_requeue = 1;
-	else
-		btrfs_dequeue_delayed_node(root->fs_info->delayed_root,
-					   delayed_node);
-	mutex_unlock(&delayed_node->mutex);
-
-	nr = trans->blocks_used;
+		btrfs_release_prepared_delayed_node(delayed_node);
+		total_done++;
+	}
 
-	trans->block_rsv = block_rsv;
-	btrfs_end_transaction_dmeta(trans, root);
-	__btrfs_btree_balance_dirty(root, nr);
-free_path:
+	if (trans) {
+		nr = trans->blocks_used;
+		trans->block_rsv = block_rsv;
+		btrfs_end_transaction_dmeta(trans, root);
+		__btrfs_btree_balance_dirty(root, nr);
+	}
 	btrfs_free_path(path);
 out:
-	if (need_requeue)
-		btrfs_requeue_work(&async_node->work);
-	else {
-		btrfs_release_prepared_delayed_node(delayed_node);
-		kfree(async_node);
-	}
+	kfree(async_work);
 }
 
 static int btrfs_wq_run_delayed_node(struct btrfs_delayed_root *delayed_root,
 				     struct btrfs_root *root, int all)
 {
-	struct btrfs_async_delayed_node *async_node;
-	struct btrfs_delayed_node *curr;
-	int count = 0;
-
-again:
-	curr = btrfs_first_prepared_delayed_node(delayed_root);
-	if (!curr)
-		return 0;
-
-	async_node = kmalloc(sizeof(*async_node), GFP_NOFS);
-	if (!async_node) {
-		btrfs_release_prepared_delayed_node(curr);
-		return -ENOMEM;
+	struct btrfs_async_delayed_work *async_work;
+	int nr_works = 1;
+
+	/* enough batches to cover every node that is queued right now */
+	if (all) {
+		spin_lock(&delayed_root->lock);
+		nr_works = DIV_ROUND_UP(delayed_root->nodes,
+					BTRFS_DELAYED_BATCH);
+		spin_unlock(&delayed_root->lock);
 	}
 
-	async_node->root = root;
-	async_node->delayed_node = curr;
-
-	async_node->work.func = btrfs_async_run_delayed_node_done;
-	async_node->work.flags = 0;
+	while (nr_works-- > 0) {
+		async_work = kmalloc(sizeof(*async_work), GFP_NOFS);
+		if (!async_work)
+			return -ENOMEM;
 
-	btrfs_queue_worker(&root->fs_info->delayed_workers, &async_node->work);
-	count++;
+		async_work->delayed_root = delayed_root;
+		async_work->work.func = btrfs_async_run_delayed_root;
+		async_work->work.flags = 0;
 
-	if (all || count < 4)
-		goto again;
+		btrfs_queue_worker(&root->fs_info->delayed_workers,
+				   &async_work->work);
+	}
 
 	return 0;
 }
@@ -43,6 +43,7 @@
 #include "tree-log.h"
 #include "free-space-cache.h"
 #include "inode-map.h"
+#include "compression.h"
 
 static struct extent_io_ops btree_extent_io_ops;
 static void end_workqueue_fn(struct btrfs_work *work);
@@ -2097,6 +2098,7 @@ struct btrfs_root *open_ctree(struct super_block *sb,
 	 * block, and it'll be used for per file compression control.
 	 */
 	fs_info->compress_type = BTRFS_COMPRESS_ZLIB;
+	fs_info->compress_level = BTRFS_ZLIB_DEFAULT_LEVEL;
 
 	ret = btrfs_parse_options(tree_root, options);
 	if (ret) {
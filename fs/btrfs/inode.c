@@ -343,6 +343,7 @@ static noinline int compress_file_range(struct inode *inode,
 	int i;
 	int will_compress;
 	int compress_type = root->fs_info->compress_type;
+	unsigned int compress_level = root->fs_info->compress_level;
 	int redirty = 0;
 
 	/* if this is a small write inside eof, kick off a defragbot */
@@ -402,8 +403,11 @@ again:
 			goto cont;
 		}
 
-		if (BTRFS_I(inode)->force_compress)
+		if (BTRFS_I(inode)->force_compress &&
+		    BTRFS_I(inode)->force_compress != compress_type) {
 			compress_type = BTRFS_I(inode)->force_compress;
+			compress_level = BTRFS_ZLIB_DEFAULT_LEVEL;
+		}
 
 		/*
 		 * we need to call clear_page_dirty_for_io on each
@@ -416,7 +420,7 @@ again:
 		 */
 		extent_range_clear_dirty_for_io(inode, start, end);
 		redirty = 1;
-		ret = btrfs_compress_pages(compress_type,
+		ret = btrfs_compress_pages(compress_type, compress_level,
 					   inode->i_mapping, start,
 					   total_compressed, pages,
 					   nr_pages, &nr_pages_ret,
@@ -273,6 +273,23 @@ int btrfs_parse_options(struct btrfs_root *root, char *options)
 			    strcmp(args[0].from, "zlib") == 0) {
 				compress_type = "zlib";
 				info->compress_type = BTRFS_COMPRESS_ZLIB;
+				info->compress_level = BTRFS_ZLIB_DEFAULT_LEVEL;
+			} else if (strncmp(args[0].from, "zlib:", 5) == 0) {
+				unsigned long level;
+
+				if (strict_strtoul(args[0].from + 5, 10,
+						   &level) ||
+				    level < BTRFS_ZLIB_MIN_LEVEL ||
+				    level > BTRFS_ZLIB_MAX_LEVEL) {
+					printk(KERN_ERR "btrfs: invalid zlib "
+					       "compression level '%s'\n",
+					       args[0].from + 5);
+					ret = -EINVAL;
+					goto out;
+				}
+				compress_type = "zlib";
+				info->compress_type = BTRFS_COMPRESS_ZLIB;
+				info->compress_level = level;
 			} else if (strcmp(args[0].from, "lzo") == 0) {
 				compress_type = "lzo";
 				info->compress_type = BTRFS_COMPRESS_LZO;
@@ -289,6 +306,9 @@ int btrfs_parse_options(struct btrfs_root *root, char *options)
 			} else
 				pr_info("btrfs: use %s compression\n",
 					compress_type);
+			if (info->compress_type == BTRFS_COMPRESS_ZLIB)
+				pr_info("btrfs: zlib compression level %u\n",
+					(unsigned int)info->compress_level);
 			break;
 		case Opt_ssd:
 			printk(KERN_INFO "btrfs: use ssd allocation scheme\n");
@@ -666,6 +686,7 @@ static int btrfs_show_options(struct seq_file *seq, struct vfsmount *vfs)
 	struct btrfs_root *root = btrfs_sb(vfs->mnt_sb);
 	struct btrfs_fs_info *info = root->fs_info;
 	char *compress_type;
+	char compress_buf[8];
 
 	if (btrfs_test_opt(root, DEGRADED))
 		seq_puts(seq, ",degraded");
@@ -685,7 +706,12 @@ static int btrfs_show_options(struct seq_file *seq, struct vfsmount *vfs)
 					     num_online_cpus() + 2, 8))
 		seq_printf(seq, ",thread_pool=%d", info->thread_pool_size);
 	if (btrfs_test_opt(root, COMPRESS)) {
-		if (info->compress_type == BTRFS_COMPRESS_ZLIB)
+		if (info->compress_type == BTRFS_COMPRESS_ZLIB &&
+		    info->compress_level != BTRFS_ZLIB_DEFAULT_LEVEL) {
+			snprintf(compress_buf, sizeof(compress_buf), "zlib:%u",
+				 (unsigned int)info->compress_level);
+			compress_type = compress_buf;
+		} else if (info->compress_type == BTRFS_COMPRESS_ZLIB)
 			compress_type = "zlib";
 		else
 			compress_type = "lzo";
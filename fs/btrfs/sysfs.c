@@ -27,20 +27,38 @@
 #include "ctree.h"
 #include "disk-io.h"
 #include "transaction.h"
+#include "compression.h"
 
 /* /sys/fs/btrfs/ entry */
 static struct kset *btrfs_kset;
 
+static ssize_t compress_stats_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return btrfs_compress_show_stats(buf);
+}
+
+static struct kobj_attribute compress_stats_attr = __ATTR_RO(compress_stats);
+
 int btrfs_init_sysfs(void)
 {
+	int ret;
+
 	btrfs_kset = kset_create_and_add("btrfs", NULL, fs_kobj);
 	if (!btrfs_kset)
 		return -ENOMEM;
+
+	ret = sysfs_create_file(&btrfs_kset->kobj, &compress_stats_attr.attr);
+	if (ret) {
+		kset_unregister(btrfs_kset);
+		return ret;
+	}
 	return 0;
 }
 
 void btrfs_exit_sysfs(void)
 {
+	sysfs_remove_file(&btrfs_kset->kobj, &compress_stats_attr.attr);
 	kset_unregister(btrfs_kset);
 }
 
@@ -36,6 +36,7 @@ struct workspace {
 	z_stream inf_strm;
 	z_stream def_strm;
 	char *buf;
+	unsigned int level;
 	struct list_head list;
 };
 
@@ -65,6 +66,7 @@ static struct list_head *zlib_alloc_workspace(void)
 	    !workspace->inf_strm.workspace || !workspace->buf)
 		goto fail;
 
+	workspace->level = BTRFS_ZLIB_DEFAULT_LEVEL;
 	INIT_LIST_HEAD(&workspace->list);
 
 	return &workspace->list;
@@ -73,6 +75,13 @@ fail:
 	return ERR_PTR(-ENOMEM);
 }
 
+static void zlib_set_level(struct list_head *ws, unsigned int level)
+{
+	struct workspace *workspace = list_entry(ws, struct workspace, list);
+
+	workspace->level = level;
+}
+
 static int zlib_compress_pages(struct list_head *ws,
 			       struct address_space *mapping,
 			       u64 start, unsigned long len,
@@ -96,7 +105,7 @@ static int zlib_compress_pages(struct list_head *ws,
 	*total_out = 0;
 	*total_in = 0;
 
-	if (Z_OK != zlib_deflateInit(&workspace->def_strm, 3)) {
+	if (Z_OK != zlib_deflateInit(&workspace->def_strm, workspace->level)) {
 		printk(KERN_WARNING "deflateInit failed\n");
 		ret = -1;
 		goto out;
@@ -393,6 +402,7 @@ next:
 struct btrfs_compress_op btrfs_zlib_compress = {
 	.alloc_workspace	= zlib_alloc_workspace,
 	.free_workspace		= zlib_free_workspace,
+	.set_level		= zlib_set_level,
 	.compress_pages		= zlib_compress_pages,
 	.decompress_biovec	= zlib_decompress_biovec,
 	.decompress		= zlib_decompress,
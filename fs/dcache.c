@@ -81,6 +81,11 @@
 int sysctl_vfs_cache_pressure __read_mostly = 100;
 EXPORT_SYMBOL_GPL(sysctl_vfs_cache_pressure);
 
+/* Max unused negative dentries per superblock, 0 means no limit */
+int sysctl_negative_dentry_limit __read_mostly;
+
+static void prune_negative_dcache_sb(struct super_block *sb);
+
 static __cacheline_aligned_in_smp DEFINE_SPINLOCK(dcache_lru_lock);
 __cacheline_aligned_in_smp DEFINE_SEQLOCK(rename_lock);
 
@@ -228,14 +233,27 @@ static void dentry_unlink_inode(struct dentry * dentry)
 
 /*
  * dentry_lru_(add|del|prune|move_tail) must be called with d_lock held.
+ *
+ * Negative dentries are counted as such when they go onto the LRU.  A
+ * dentry that is instantiated while sitting on the LRU stays counted
+ * until it comes off again, so the count is only an upper bound.
  */
+static void __dentry_lru_account(struct dentry *dentry)
+{
+	dentry->d_sb->s_nr_dentry_unused++;
+	dentry_stat.nr_unused++;
+	if (!dentry->d_inode) {
+		dentry->d_flags |= DCACHE_LRU_NEGATIVE;
+		dentry->d_sb->s_nr_negative_unused++;
+	}
+}
+
 static void dentry_lru_add(struct dentry *dentry)
 {
 	if (list_empty(&dentry->d_lru)) {
 		spin_lock(&dcache_lru_lock);
 		list_add(&dentry->d_lru, &dentry->d_sb->s_dentry_lru);
-		dentry->d_sb->s_nr_dentry_unused++;
-		dentry_stat.nr_unused++;
+		__dentry_lru_account(dentry);
 		spin_unlock(&dcache_lru_lock);
 	}
 }
@@ -246,6 +264,10 @@ static void __dentry_lru_del(struct dentry *dentry)
 	dentry->d_flags &= ~DCACHE_SHRINK_LIST;
 	dentry->d_sb->s_nr_dentry_unused--;
 	dentry_stat.nr_unused--;
+	if (dentry->d_flags & DCACHE_LRU_NEGATIVE) {
+		dentry->d_flags &= ~DCACHE_LRU_NEGATIVE;
+		dentry->d_sb->s_nr_negative_unused--;
+	}
 }
 
 /*
@@ -282,8 +304,7 @@ static void dentry_lru_move_list(struct dentry *dentry, struct list_head *list)
 	spin_lock(&dcache_lru_lock);
 	if (list_empty(&dentry->d_lru)) {
 		list_add_tail(&dentry->d_lru, list);
-		dentry->d_sb->s_nr_dentry_unused++;
-		dentry_stat.nr_unused++;
+		__dentry_lru_account(dentry);
 	} else {
 		list_move_tail(&dentry->d_lru, list);
 	}
@@ -465,6 +486,8 @@ relock:
  */
 void dput(struct dentry *dentry)
 {
+	struct super_block *sb;
+
 	if (!dentry)
 		return;
 
@@ -498,7 +521,12 @@ repeat:
 	dentry_lru_add(dentry);
 
 	dentry->d_count--;
+	sb = dentry->d_sb;
 	spin_unlock(&dentry->d_lock);
+
+	if (unlikely(sysctl_negative_dentry_limit &&
+		     sb->s_nr_negative_unused > sysctl_negative_dentry_limit))
+		prune_negative_dcache_sb(sb);
 	return;
 
 kill_it:
@@ -821,6 +849,62 @@ relock:
 	shrink_dentry_list(&tmp);
 }
 
+/*
+ * Trim the unused negative dentries of @sb back under
+ * sysctl_negative_dentry_limit, oldest first.  Positive dentries are left
+ * where they are and referenced negative ones get a second chance, just
+ * like in prune_dcache_sb().  The scan is bounded by the LRU length.
+ */
+static void prune_negative_dcache_sb(struct super_block *sb)
+{
+	struct dentry *dentry;
+	LIST_HEAD(referenced);
+	LIST_HEAD(skipped);
+	LIST_HEAD(tmp);
+	int limit, count, scan;
+
+	spin_lock(&dcache_lru_lock);
+	limit = ACCESS_ONCE(sysctl_negative_dentry_limit);
+	if (!limit || sb->s_nr_negative_unused <= limit) {
+		spin_unlock(&dcache_lru_lock);
+		return;
+	}
+	count = sb->s_nr_negative_unused - limit;
+	scan = sb->s_nr_dentry_unused;
+	while (count > 0 && scan-- > 0 && !list_empty(&sb->s_dentry_lru)) {
+		dentry = list_entry(sb->s_dentry_lru.prev,
+				struct dentry, d_lru);
+
+		if (!spin_trylock(&dentry->d_lock)) {
+			list_move(&dentry->d_lru, &skipped);
+			continue;
+		}
+
+		if (dentry->d_inode) {
+			/* instantiated while on the LRU, fix up the count */
+			if (dentry->d_flags & DCACHE_LRU_NEGATIVE) {
+				dentry->d_flags &= ~DCACHE_LRU_NEGATIVE;
+				sb->s_nr_negative_unused--;
+				count--;
+			}
+			list_move(&dentry->d_lru, &skipped);
+		} else if (dentry->d_flags & DCACHE_REFERENCED) {
+			dentry->d_flags &= ~DCACHE_REFERENCED;
+			list_move(&dentry->d_lru, &referenced);
+		} else {
+			list_move_tail(&dentry->d_lru, &tmp);
+			dentry->d_flags |= DCACHE_SHRINK_LIST;
+			count--;
+		}
+		spin_unlock(&dentry->d_lock);
+	}
+	list_splice_tail(&skipped, &sb->s_dentry_lru);
+	list_splice(&referenced, &sb->s_dentry_lru);
+	spin_unlock(&dcache_lru_lock);
+
+	shrink_dentry_list(&tmp);
+}
+
 /**
  * shrink_dcache_sb - shrink dcache for a superblock
  * @sb: superblock
@@ -130,6 +130,10 @@ struct dio {
 	struct bio *bio_list;		/* singly linked via bi_private */
 	struct task_struct *waiter;	/* waiting task (NULL if none) */
 
+	/* Polled completion, sync IO only */
+	struct request_queue *poll_queue; /* NULL if not polling */
+	u64 poll_start;			/* last bio submission, ktime ns */
+
 	/* AIO related stuff */
 	struct kiocb *iocb;		/* kiocb */
 	ssize_t result;                 /* IO result */
@@ -422,6 +426,16 @@ static inline void dio_bio_submit(struct dio *dio, struct dio_submit *sdio)
 	if (dio->is_async && dio->rw == READ)
 		bio_set_pages_dirty(bio);
 
+	if (!dio->is_async) {
+		struct request_queue *q = bdev_get_queue(bio->bi_bdev);
+
+		if (q->poll_fn && blk_queue_poll(q)) {
+			bio->bi_rw |= REQ_POLLED;
+			dio->poll_queue = q;
+			dio->poll_start = ktime_to_ns(ktime_get());
+		}
+	}
+
 	if (sdio->submit_io)
 		sdio->submit_io(dio->rw, bio, dio->inode,
 			       sdio->logical_offset_in_bio);
@@ -452,6 +466,7 @@ static struct bio *dio_await_one(struct dio *dio)
 {
 	unsigned long flags;
 	struct bio *bio = NULL;
+	bool polled = false;
 
 	spin_lock_irqsave(&dio->bio_lock, flags);
 
@@ -460,8 +475,22 @@ static struct bio *dio_await_one(struct dio *dio)
 	 * completion drops the count, maybe adds to the list, and wakes while
 	 * holding the bio_lock so we don't need set_current_state()'s barrier
 	 * and can call it after testing our condition.
+	 *
+	 * On a polling queue, spin on the driver instead.  Completions that
+	 * still arrive by interrupt end the loop just the same.
 	 */
 	while (dio->refcount > 1 && dio->bio_list == NULL) {
+		if (dio->poll_queue) {
+			spin_unlock_irqrestore(&dio->bio_lock, flags);
+			if (!polled)
+				blk_poll_sleep(dio->poll_queue, dio->poll_start);
+			polled = true;
+			if (!blk_poll(dio->poll_queue))
+				cpu_relax();
+			cond_resched();
+			spin_lock_irqsave(&dio->bio_lock, flags);
+			continue;
+		}
 		__set_current_state(TASK_UNINTERRUPTIBLE);
 		dio->waiter = current;
 		spin_unlock_irqrestore(&dio->bio_lock, flags);
@@ -475,6 +504,9 @@ static struct bio *dio_await_one(struct dio *dio)
 		dio->bio_list = bio->bi_private;
 	}
 	spin_unlock_irqrestore(&dio->bio_lock, flags);
+
+	if (polled && bio)
+		blk_poll_account(dio->poll_queue, dio->poll_start);
 	return bio;
 }
 
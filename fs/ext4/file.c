@@ -143,6 +143,7 @@ ext4_file_write(struct kiocb *iocb, const struct iovec *iov,
 
 static const struct vm_operations_struct ext4_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
 	.page_mkwrite   = ext4_page_mkwrite,
 };
 
@@ -247,6 +248,43 @@ const struct file_operations ext4_file_operations = {
 	.fallocate	= ext4_fallocate,
 };
 
+#ifdef CONFIG_EXT4_FS_XIP
+static ssize_t ext4_xip_file_write(struct file *filp, const char __user *buf,
+				   size_t len, loff_t *ppos)
+{
+	struct inode *inode = filp->f_mapping->host;
+
+	/* see ext4_file_write() */
+	if (!(ext4_test_inode_flag(inode, EXT4_INODE_EXTENTS))) {
+		struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
+
+		if (*ppos > sbi->s_bitmap_maxbytes ||
+		    (*ppos == sbi->s_bitmap_maxbytes && len > 0))
+			return -EFBIG;
+
+		if (*ppos + len > sbi->s_bitmap_maxbytes)
+			len = sbi->s_bitmap_maxbytes - *ppos;
+	}
+
+	return xip_file_write(filp, buf, len, ppos);
+}
+
+const struct file_operations ext4_xip_file_operations = {
+	.llseek		= ext4_llseek,
+	.read		= xip_file_read,
+	.write		= ext4_xip_file_write,
+	.unlocked_ioctl = ext4_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl	= ext4_compat_ioctl,
+#endif
+	.mmap		= xip_file_mmap,
+	.open		= ext4_file_open,
+	.release	= ext4_release_file,
+	.fsync		= ext4_sync_file,
+	.fallocate	= ext4_fallocate,
+};
+#endif
+
 const struct inode_operations ext4_file_inode_operations = {
 	.setattr	= ext4_setattr,
 	.getattr	= ext4_getattr,
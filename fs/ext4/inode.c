@@ -44,6 +44,7 @@
 #include "xattr.h"
 #include "acl.h"
 #include "truncate.h"
+#include "xip.h"
 
 #include <trace/events/ext4.h>
 
@@ -3126,8 +3127,18 @@ static const struct address_space_operations ext4_da_aops = {
 	.error_remove_page	= generic_error_remove_page,
 };
 
+static const struct address_space_operations ext4_xip_aops = {
+	.bmap			= ext4_bmap,
+	.get_xip_mem		= ext4_get_xip_mem,
+};
+
 void ext4_set_aops(struct inode *inode)
 {
+	if (S_ISREG(inode->i_mode) && ext4_use_xip(inode->i_sb)) {
+		inode->i_mapping->a_ops = &ext4_xip_aops;
+		return;
+	}
+
 	switch (ext4_inode_journal_mode(inode)) {
 	case EXT4_INODE_ORDERED_DATA_MODE:
 		if (test_opt(inode->i_sb, DELALLOC))
@@ -3166,6 +3177,10 @@ int ext4_discard_partial_page_buffers(handle_t *handle,
 	struct page *page;
 	int err = 0;
 
+	/* there are no page cache pages to discard, zero the block */
+	if (mapping_is_xip(mapping))
+		return ext4_xip_zero_range(mapping, from, length);
+
 	page = find_or_create_page(mapping, from >> PAGE_CACHE_SHIFT,
 				   mapping_gfp_mask(mapping) & ~__GFP_FS);
 	if (!page)
@@ -3934,7 +3949,10 @@ struct inode *ext4_iget(struct super_block *sb, unsigned long ino)
 
 	if (S_ISREG(inode->i_mode)) {
 		inode->i_op = &ext4_file_inode_operations;
-		inode->i_fop = &ext4_file_operations;
+		if (ext4_use_xip(inode->i_sb))
+			inode->i_fop = &ext4_xip_file_operations;
+		else
+			inode->i_fop = &ext4_file_operations;
 		ext4_set_aops(inode);
 	} else if (S_ISDIR(inode->i_mode)) {
 		inode->i_op = &ext4_dir_inode_operations;
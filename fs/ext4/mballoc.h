@@ -94,6 +94,22 @@ extern u8 mb_enable_debug;
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * Number of groups scanned linearly from the goal before the
+ * per-order group lists are used to pick the next group
+ */
+#define MB_DEFAULT_LINEAR_LIMIT		4
+
+/*
+ * Filesystems with fewer groups than this scan linearly by default
+ */
+#define MB_DEFAULT_LINEAR_SCAN_THRESHOLD	16
+
+/*
+ * Number of orders tracked by bb_counters and the per-order group lists
+ */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 
 struct ext4_free_data {
 	/* this links the free block information from group_info */
@@ -180,6 +196,8 @@ struct ext4_allocation_context {
 
 	/* number of iterations done. we have to track to limit searching */
 	unsigned long ac_ex_scanned;
+	/* groups still to be scanned linearly before using the group lists */
+	ext4_group_t ac_groups_linear_remaining;
 	__u16 ac_groups_scanned;
 	__u16 ac_found;
 	__u16 ac_tail;
@@ -0,0 +1,101 @@
+/*
+ *  linux/fs/ext4/xip.c
+ *
+ * Execute in place for ext4, after fs/ext2/xip.c
+ *
+ * File data is mapped straight from a block device that implements
+ * direct_access(), bypassing the page cache for read, write and mmap.
+ * Requires the block size to equal PAGE_SIZE.
+ */
+
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/genhd.h>
+#include <linux/buffer_head.h>
+#include <linux/blkdev.h>
+#include "ext4.h"
+#include "xip.h"
+
+static inline int
+__inode_direct_access(struct inode *inode, sector_t block,
+		      void **kaddr, unsigned long *pfn)
+{
+	struct block_device *bdev = inode->i_sb->s_bdev;
+	const struct block_device_operations *ops = bdev->bd_disk->fops;
+	sector_t sector;
+
+	sector = block << (inode->i_blkbits - 9); /* ext4 block to bdev sector */
+
+	BUG_ON(!ops->direct_access);
+	return ops->direct_access(bdev, sector, kaddr, pfn);
+}
+
+void ext4_xip_verify_sb(struct super_block *sb)
+{
+	if (test_opt(sb, XIP) && !sb->s_bdev->bd_disk->fops->direct_access) {
+		clear_opt(sb, XIP);
+		ext4_msg(sb, KERN_WARNING,
+			 "ignoring xip option - not supported by bdev");
+	}
+}
+
+int ext4_get_xip_mem(struct address_space *mapping, pgoff_t pgoff, int create,
+		     void **kmem, unsigned long *pfn)
+{
+	struct inode *inode = mapping->host;
+	struct buffer_head tmp;
+	int rc;
+
+	/*
+	 * ext4_get_block() starts its own handle when allocating; an
+	 * unwritten extent is converted on create and reads as a hole
+	 * otherwise.
+	 */
+	memset(&tmp, 0, sizeof(struct buffer_head));
+	tmp.b_size = 1 << inode->i_blkbits;
+	rc = ext4_get_block(inode, pgoff, &tmp, create);
+	if (rc)
+		return rc;
+
+	/* did we get a sparse block (hole in the file)? */
+	if (!buffer_mapped(&tmp) || buffer_unwritten(&tmp)) {
+		BUG_ON(create);
+		return -ENODATA;
+	}
+
+	/* retrieve address of the target data */
+	rc = __inode_direct_access(inode, tmp.b_blocknr, kmem, pfn);
+
+	/* the old contents of a newly allocated block must not show */
+	if (!rc && buffer_new(&tmp))
+		clear_page(*kmem);
+	return rc;
+}
+
+/*
+ * Zero @length bytes from @from, within the block containing @from.
+ * Holes already read as zeroes and are left alone.
+ */
+int ext4_xip_zero_range(struct address_space *mapping, loff_t from,
+			loff_t length)
+{
+	unsigned offset = from & (PAGE_CACHE_SIZE - 1);
+	void *kaddr;
+	unsigned long pfn;
+	int rc;
+
+	if (length > PAGE_CACHE_SIZE - offset)
+		length = PAGE_CACHE_SIZE - offset;
+	if (!length)
+		return 0;
+
+	rc = ext4_get_xip_mem(mapping, from >> PAGE_CACHE_SHIFT, 0,
+			      &kaddr, &pfn);
+	if (rc == -ENODATA)
+		return 0;
+	if (rc)
+		return rc;
+
+	memset(kaddr + offset, 0, length);
+	return 0;
+}
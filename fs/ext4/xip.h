@@ -0,0 +1,24 @@
+/*
+ *  linux/fs/ext4/xip.h
+ *
+ * Execute in place for ext4, after fs/ext2/xip.h
+ */
+
+#ifdef CONFIG_EXT4_FS_XIP
+extern void ext4_xip_verify_sb(struct super_block *);
+extern int ext4_get_xip_mem(struct address_space *, pgoff_t, int,
+			    void **, unsigned long *);
+extern int ext4_xip_zero_range(struct address_space *, loff_t, loff_t);
+
+static inline int ext4_use_xip(struct super_block *sb)
+{
+	return test_opt(sb, XIP);
+}
+#define mapping_is_xip(map) unlikely(map->a_ops->get_xip_mem)
+#else
+#define mapping_is_xip(map)			0
+#define ext4_xip_verify_sb(sb)			do { } while (0)
+#define ext4_use_xip(sb)			0
+#define ext4_xip_zero_range(map, from, len)	0
+#define ext4_get_xip_mem			NULL
+#endif
@@ -35,6 +35,14 @@
 /** Number of dentries for each connection in the control filesystem */
 #define FUSE_CTL_NUM_DENTRIES 5
 
+/** The processing list is hashed by request ID into this many buckets */
+#define FUSE_PQ_HASH_BITS 8
+#define FUSE_PQ_HASH_SIZE (1 << FUSE_PQ_HASH_BITS)
+
+/** Request IDs are even; an interrupt uses the ID of its request | 1 */
+#define FUSE_INT_REQ_BIT (1ULL << 0)
+#define FUSE_REQ_ID_STEP (1ULL << 1)
+
 /** If the FUSE_DEFAULT_PERMISSIONS flag is given, the filesystem
     module will check permissions based on the file mode.  Otherwise no
     permission checking is done in the kernel */
@@ -136,6 +144,9 @@ struct fuse_file {
 	/** Refcount */
 	atomic_t count;
 
+	/** Number of device channels open on this connection */
+	atomic_t dev_count;
+
 	/** FOPEN_* flags returned by open */
 	u32 open_flags;
 
@@ -341,6 +352,9 @@ struct fuse_conn {
 	/** Refcount */
 	atomic_t count;
 
+	/** Number of device channels open on this connection */
+	atomic_t dev_count;
+
 	/** The user id for this mount */
 	uid_t user_id;
 
@@ -362,8 +376,8 @@ struct fuse_conn {
 	/** The list of pending requests */
 	struct list_head pending;
 
-	/** The list of requests being processed */
-	struct list_head processing;
+	/** The requests being processed, hashed by request ID */
+	struct list_head processing[FUSE_PQ_HASH_SIZE];
 
 	/** The list of requests under I/O */
 	struct list_head io;
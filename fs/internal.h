@@ -123,11 +123,6 @@ extern struct file *do_file_open_root(struct dentry *, struct vfsmount *,
 extern long do_handle_open(int mountdirfd,
 			   struct file_handle __user *ufh, int open_flag);
 
-/*
- * inode.c
- */
-extern spinlock_t inode_sb_list_lock;
-
 /*
  * fs-writeback.c
  */
@@ -179,6 +179,50 @@ void __jbd2_log_wait_for_space(journal_t *journal)
 	}
 }
 
+/*
+ * The background checkpointer starts once free log space falls below
+ * twice what a new transaction needs, so that the foreground path in
+ * __jbd2_log_wait_for_space() normally finds the room already there.
+ */
+static int jbd2_log_space_low(journal_t *journal)
+{
+	int low;
+
+	read_lock(&journal->j_state_lock);
+	low = __jbd2_log_space_left(journal) < 2 * jbd_space_needed(journal);
+	read_unlock(&journal->j_state_lock);
+	return low;
+}
+
+void jbd2_checkpoint_work(struct work_struct *work)
+{
+	journal_t *journal = container_of(work, journal_t, j_checkpoint_work);
+	int chkpt;
+
+	mutex_lock(&journal->j_checkpoint_mutex);
+	while (!is_journal_aborted(journal) && jbd2_log_space_low(journal)) {
+		spin_lock(&journal->j_list_lock);
+		chkpt = journal->j_checkpoint_transactions != NULL;
+		spin_unlock(&journal->j_list_lock);
+		if (!chkpt || jbd2_log_do_checkpoint(journal) < 0)
+			break;
+		cond_resched();
+	}
+	mutex_unlock(&journal->j_checkpoint_mutex);
+}
+
+/*
+ * jbd2_log_start_checkpoint: kick the background checkpointer if the log
+ * is getting full.  Called by the commit code once a transaction has been
+ * added to the checkpoint list.
+ */
+void jbd2_log_start_checkpoint(journal_t *journal)
+{
+	if (is_journal_aborted(journal) || !jbd2_log_space_low(journal))
+		return;
+	queue_work(system_long_wq, &journal->j_checkpoint_work);
+}
+
 /*
  * We were unable to perform jbd_trylock_bh_state() inside j_list_lock.
  * The caller must restart a list walk.  Wait for someone else to run
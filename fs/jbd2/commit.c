@@ -320,6 +320,7 @@ void jbd2_journal_commit_transaction(journal_t *journal)
 	unsigned long long blocknr;
 	ktime_t start_time;
 	u64 commit_time;
+	int hist;
 	char *tagp = NULL;
 	journal_header_t *header;
 	journal_block_tag_t *tag = NULL;
@@ -984,8 +985,13 @@ restart_loop:
 	/*
 	 * Calculate overall stats
 	 */
+	commit_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
+	hist = fls64(div_u64(commit_time, NSEC_PER_USEC));
+	if (hist >= JBD2_COMMIT_HIST_BUCKETS)
+		hist = JBD2_COMMIT_HIST_BUCKETS - 1;
 	spin_lock(&journal->j_history_lock);
 	journal->j_stats.ts_tid++;
+	journal->j_stats.ts_commit_hist[hist]++;
 	journal->j_stats.run.rs_wait += stats.run.rs_wait;
 	journal->j_stats.run.rs_running += stats.run.rs_running;
 	journal->j_stats.run.rs_locked += stats.run.rs_locked;
@@ -1000,7 +1006,6 @@ restart_loop:
 	J_ASSERT(commit_transaction == journal->j_committing_transaction);
 	journal->j_commit_sequence = commit_transaction->t_tid;
 	journal->j_committing_transaction = NULL;
-	commit_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
 
 	/*
 	 * weight the commit time higher than the average time so we don't
@@ -1051,4 +1056,7 @@ restart_loop:
 	spin_unlock(&journal->j_list_lock);
 	write_unlock(&journal->j_state_lock);
 	wake_up(&journal->j_wait_done_commit);
+
+	/* Get log space back before the next transactions need it */
+	jbd2_log_start_checkpoint(journal);
 }
@@ -795,6 +795,7 @@ static void *jbd2_seq_info_next(struct seq_file *seq, void *v, loff_t *pos)
 static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 {
 	struct jbd2_stats_proc_session *s = seq->private;
+	int i;
 
 	if (v != SEQ_START_TOKEN)
 		return 0;
@@ -821,6 +822,18 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 	    s->stats->run.rs_blocks / s->stats->ts_tid);
 	seq_printf(seq, "  %lu logged blocks per transaction\n",
 	    s->stats->run.rs_blocks_logged / s->stats->ts_tid);
+	seq_printf(seq, "commit time histogram (us):\n");
+	for (i = 0; i < JBD2_COMMIT_HIST_BUCKETS; i++) {
+		if (!s->stats->ts_commit_hist[i])
+			continue;
+		if (i == JBD2_COMMIT_HIST_BUCKETS - 1)
+			seq_printf(seq, "  %8lu -         : %lu\n",
+				   1UL << (i - 1), s->stats->ts_commit_hist[i]);
+		else
+			seq_printf(seq, "  %8lu - %8lu: %lu\n",
+				   i ? 1UL << (i - 1) : 0, (1UL << i) - 1,
+				   s->stats->ts_commit_hist[i]);
+	}
 	return 0;
 }
 
@@ -927,6 +940,7 @@ static journal_t * journal_init_common (void)
 	init_waitqueue_head(&journal->j_wait_updates);
 	mutex_init(&journal->j_barrier);
 	mutex_init(&journal->j_checkpoint_mutex);
+	INIT_WORK(&journal->j_checkpoint_work, jbd2_checkpoint_work);
 	spin_lock_init(&journal->j_revoke_lock);
 	spin_lock_init(&journal->j_list_lock);
 	rwlock_init(&journal->j_state_lock);
@@ -1409,6 +1423,7 @@ int jbd2_journal_destroy(journal_t *journal)
 		jbd2_journal_commit_transaction(journal);
 
 	/* Force any old transactions to disk */
+	cancel_work_sync(&journal->j_checkpoint_work);
 
 	/* Totally anal locking here... */
 	spin_lock(&journal->j_list_lock);
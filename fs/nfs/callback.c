@@ -283,7 +283,7 @@ int nfs_callback_up(u32 minorversion, struct rpc_xprt *xprt)
 	sprintf(svc_name, "nfsv4.%u-svc", minorversion);
 	cb_info->serv = serv;
 	cb_info->rqst = rqstp;
-	cb_info->task = kthread_run(callback_svc, cb_info->rqst, svc_name);
+	cb_info->task = kthread_create(callback_svc, cb_info->rqst, svc_name);
 	if (IS_ERR(cb_info->task)) {
 		ret = PTR_ERR(cb_info->task);
 		svc_exit_thread(cb_info->rqst);
@@ -291,6 +291,8 @@ int nfs_callback_up(u32 minorversion, struct rpc_xprt *xprt)
 		cb_info->task = NULL;
 		goto out_err;
 	}
+	rqstp->rq_task = cb_info->task;
+	wake_up_process(cb_info->task);
 out:
 	/*
 	 * svc_create creates the svc_serv with sv_nrthreads == 1, and then
@@ -845,6 +845,33 @@ int uncached_readdir(nfs_readdir_descriptor_t *desc, void *dirent,
 	goto out;
 }
 
+/*
+ * Use READDIRPLUS for the first pass over a directory, and afterwards
+ * only if the application has been looking up or stat()ing its entries
+ * since the last getdents call, i.e. for "ls -l" rather than "ls".
+ */
+static bool nfs_use_readdirplus(struct inode *dir, struct file *filp)
+{
+	if (!nfs_server_capable(dir, NFS_CAP_READDIRPLUS))
+		return false;
+	if (test_and_clear_bit(NFS_INO_ADVISE_RDPLUS, &NFS_I(dir)->flags))
+		return true;
+	if (filp->f_pos == 0)
+		return true;
+	return false;
+}
+
+/*
+ * This function is called by the lookup and getattr code to request the
+ * use of readdirplus to accelerate any future lookups in the same
+ * directory.
+ */
+void nfs_advise_use_readdirplus(struct inode *dir)
+{
+	if (nfs_server_capable(dir, NFS_CAP_READDIRPLUS))
+		set_bit(NFS_INO_ADVISE_RDPLUS, &NFS_I(dir)->flags);
+}
+
 /* The file offset position represents the dirent entry number.  A
    last cookie cache takes care of the common case of reading the
    whole directory.
@@ -874,7 +901,7 @@ static int nfs_readdir(struct file *filp, void *dirent, filldir_t filldir)
 	desc->file = filp;
 	desc->dir_cookie = &dir_ctx->dir_cookie;
 	desc->decode = NFS_PROTO(inode)->decode_dirent;
-	desc->plus = NFS_USE_READDIRPLUS(inode);
+	desc->plus = nfs_use_readdirplus(inode, filp) ? 1 : 0;
 
 	nfs_block_sillyrename(dentry);
 	res = nfs_revalidate_mapping(inode, filp->f_mapping);
@@ -991,9 +1018,15 @@ void nfs_force_lookup_revalidate(struct inode *dir)
  * A check for whether or not the parent directory has changed.
  * In the case it has, we assume that the dentries are untrustworthy
  * and may need to be looked up again.
+ *
+ * In RCU-walk mode we never go to the server; if the directory's attributes
+ * need revalidating we just report a mismatch.
  */
-static int nfs_check_verifier(struct inode *dir, struct dentry *dentry)
+static int nfs_check_verifier(struct inode *dir, struct dentry *dentry,
+			      int rcu_walk)
 {
+	int ret;
+
 	if (IS_ROOT(dentry))
 		return 1;
 	if (NFS_SERVER(dir)->flags & NFS_MOUNT_LOOKUP_CACHE_NONE)
@@ -1001,7 +1034,11 @@ static int nfs_check_verifier(struct inode *dir, struct dentry *dentry)
 	if (!nfs_verify_change_attribute(dir, dentry->d_time))
 		return 0;
 	/* Revalidate nfsi->cache_change_attribute before we declare a match */
-	if (nfs_revalidate_inode(NFS_SERVER(dir), dir) < 0)
+	if (rcu_walk)
+		ret = nfs_revalidate_inode_rcu(NFS_SERVER(dir), dir);
+	else
+		ret = nfs_revalidate_inode(NFS_SERVER(dir), dir);
+	if (ret < 0)
 		return 0;
 	if (!nfs_verify_change_attribute(dir, dentry->d_time))
 		return 0;
@@ -1080,7 +1117,51 @@ int nfs_neg_need_reval(struct inode *dir, struct dentry *dentry,
 		return 0;
 	if (NFS_SERVER(dir)->flags & NFS_MOUNT_LOOKUP_CACHE_NONEG)
 		return 1;
-	return !nfs_check_verifier(dir, dentry);
+	return !nfs_check_verifier(dir, dentry,
+				   nd != NULL && (nd->flags & LOOKUP_RCU));
+}
+
+/*
+ * RCU-walk flavour of nfs_lookup_revalidate(): we may not sleep, take
+ * references or change the dcache, so only answer when the cached
+ * state says the dentry is good and let the VFS retry in ref-walk mode
+ * (-ECHILD) for everything else.
+ */
+static int nfs_lookup_revalidate_rcu(struct dentry *dentry,
+				     struct nameidata *nd)
+{
+	struct dentry *parent = ACCESS_ONCE(dentry->d_parent);
+	struct inode *dir = ACCESS_ONCE(parent->d_inode);
+	struct inode *inode = ACCESS_ONCE(dentry->d_inode);
+
+	if (!dir)
+		return -ECHILD;
+	nfs_inc_stats(dir, NFSIOS_DENTRYREVALIDATE);
+
+	if (!inode) {
+		if (nfs_neg_need_reval(dir, dentry, nd))
+			return -ECHILD;
+		return 1;
+	}
+
+	if (is_bad_inode(inode) || IS_AUTOMOUNT(inode))
+		return -ECHILD;
+
+	if (nfs_have_delegation(inode, FMODE_READ))
+		return 1;
+
+	if (nfs_is_exclusive_create(dir, nd) ||
+	    !nfs_check_verifier(dir, dentry, 1))
+		return -ECHILD;
+
+	/* nfs_lookup_verify_inode() would go to the server for these */
+	if (nd->flags & LOOKUP_REVAL)
+		return -ECHILD;
+	if (nfs_lookup_check_intent(nd, LOOKUP_OPEN) != 0 &&
+	    !(NFS_SERVER(inode)->flags & NFS_MOUNT_NOCTO) &&
+	    (S_ISREG(inode->i_mode) || S_ISDIR(inode->i_mode)))
+		return -ECHILD;
+	return 1;
 }
 
 /*
@@ -1104,7 +1185,7 @@ static int nfs_lookup_revalidate(struct dentry *dentry, struct nameidata *nd)
 	int error;
 
 	if (nd && (nd->flags & LOOKUP_RCU))
-		return -ECHILD;
+		return nfs_lookup_revalidate_rcu(dentry, nd);
 
 	parent = dget_parent(dentry);
 	dir = parent->d_inode;
@@ -1128,7 +1209,8 @@ static int nfs_lookup_revalidate(struct dentry *dentry, struct nameidata *nd)
 		goto out_set_verifier;
 
 	/* Force a full look up iff the parent directory has changed */
-	if (!nfs_is_exclusive_create(dir, nd) && nfs_check_verifier(dir, dentry)) {
+	if (!nfs_is_exclusive_create(dir, nd) &&
+	    nfs_check_verifier(dir, dentry, 0)) {
 		if (nfs_lookup_verify_inode(inode, nd))
 			goto out_zap_parent;
 		goto out_valid;
@@ -1146,6 +1228,7 @@ static int nfs_lookup_revalidate(struct dentry *dentry, struct nameidata *nd)
 	error = NFS_PROTO(dir)->lookup(NFS_SERVER(dir)->client, dir, &dentry->d_name, fhandle, fattr);
 	if (error)
 		goto out_bad;
+	nfs_advise_use_readdirplus(dir);
 	if (nfs_compare_fh(NFS_FH(inode), fhandle))
 		goto out_bad;
 	if ((error = nfs_refresh_inode(inode, fattr)) != 0)
@@ -1311,6 +1394,9 @@ static struct dentry *nfs_lookup(struct inode *dir, struct dentry * dentry, stru
 	if (IS_ERR(res))
 		goto out_unblock_sillyrename;
 
+	/* Success: notify readdir to use READDIRPLUS */
+	nfs_advise_use_readdirplus(dir);
+
 no_entry:
 	res = d_materialise_unique(dentry, inode);
 	if (res != NULL) {
@@ -2151,21 +2237,32 @@ static struct nfs_access_entry *nfs_access_search_rbtree(struct inode *inode, st
 	return NULL;
 }
 
-static int nfs_access_get_cached(struct inode *inode, struct rpc_cred *cred, struct nfs_access_entry *res)
+/*
+ * With @may_block clear (RCU-walk) a missing, stale or invalidated entry is
+ * reported as -ECHILD and left for the ref-walk retry to clean up.
+ */
+static int nfs_access_get_cached(struct inode *inode, struct rpc_cred *cred,
+				 struct nfs_access_entry *res, int may_block)
 {
 	struct nfs_inode *nfsi = NFS_I(inode);
 	struct nfs_access_entry *cache;
-	int err = -ENOENT;
+	int err = may_block ? -ENOENT : -ECHILD;
 
 	spin_lock(&inode->i_lock);
-	if (nfsi->cache_validity & NFS_INO_INVALID_ACCESS)
+	if (nfsi->cache_validity & NFS_INO_INVALID_ACCESS) {
+		if (!may_block)
+			goto out;
 		goto out_zap;
+	}
 	cache = nfs_access_search_rbtree(inode, cred);
 	if (cache == NULL)
 		goto out;
 	if (!nfs_have_delegated_attributes(inode) &&
-	    !time_in_range_open(jiffies, cache->jiffies, cache->jiffies + nfsi->attrtimeo))
+	    !time_in_range_open(jiffies, cache->jiffies, cache->jiffies + nfsi->attrtimeo)) {
+		if (!may_block)
+			goto out;
 		goto out_stale;
+	}
 	res->jiffies = cache->jiffies;
 	res->cred = cache->cred;
 	res->mask = cache->mask;
@@ -2251,9 +2348,12 @@ static int nfs_do_access(struct inode *inode, struct rpc_cred *cred, int mask)
 	struct nfs_access_entry cache;
 	int status;
 
-	status = nfs_access_get_cached(inode, cred, &cache);
+	status = nfs_access_get_cached(inode, cred, &cache,
+				       !(mask & MAY_NOT_BLOCK));
 	if (status == 0)
 		goto out;
+	if (mask & MAY_NOT_BLOCK)
+		return status;
 
 	/* Be clever: ask server to check for all possible rights */
 	cache.mask = MAY_EXEC | MAY_WRITE | MAY_READ;
@@ -2298,9 +2398,6 @@ int nfs_permission(struct inode *inode, int mask)
 	struct rpc_cred *cred;
 	int res = 0;
 
-	if (mask & MAY_NOT_BLOCK)
-		return -ECHILD;
-
 	nfs_inc_stats(inode, NFSIOS_VFSACCESS);
 
 	if ((mask & (MAY_READ | MAY_WRITE | MAY_EXEC)) == 0)
@@ -2332,7 +2429,11 @@ force_lookup:
 	if (!NFS_PROTO(inode)->access)
 		goto out_notsup;
 
-	cred = rpc_lookup_cred();
+	/* In RCU-walk only the access cache may answer, see nfs_do_access() */
+	if (mask & MAY_NOT_BLOCK)
+		cred = rpc_lookup_cred_nonblock();
+	else
+		cred = rpc_lookup_cred();
 	if (!IS_ERR(cred)) {
 		res = nfs_do_access(inode, cred, mask);
 		put_rpccred(cred);
@@ -2346,6 +2447,9 @@ out:
 		inode->i_sb->s_id, inode->i_ino, mask, res);
 	return res;
 out_notsup:
+	if (mask & MAY_NOT_BLOCK)
+		return -ECHILD;
+
 	res = nfs_revalidate_inode(NFS_SERVER(inode), inode);
 	if (res == 0)
 		res = generic_permission(inode, mask);
@@ -60,6 +60,7 @@ static int enable_ino64 = NFS_64_BIT_INODE_NUMBERS_ENABLED;
 
 static void nfs_invalidate_inode(struct inode *);
 static int nfs_update_inode(struct inode *, struct nfs_fattr *);
+static int nfs_attribute_cache_expired(struct inode *inode);
 
 static struct kmem_cache * nfs_inode_cachep;
 
@@ -503,6 +504,28 @@ void nfs_setattr_update_inode(struct inode *inode, struct iattr *attr)
 	}
 }
 
+/*
+ * A stat() that has to go to the server for the attributes of an entry
+ * hints that readdir should have fetched them with READDIRPLUS.
+ */
+static void nfs_request_parent_use_readdirplus(struct dentry *dentry)
+{
+	struct dentry *parent;
+
+	parent = dget_parent(dentry);
+	nfs_advise_use_readdirplus(parent->d_inode);
+	dput(parent);
+}
+
+static bool nfs_need_revalidate_inode(struct inode *inode)
+{
+	if (NFS_I(inode)->cache_validity & NFS_INO_INVALID_ATTR)
+		return true;
+	if (nfs_attribute_cache_expired(inode))
+		return true;
+	return false;
+}
+
 int nfs_getattr(struct vfsmount *mnt, struct dentry *dentry, struct kstat *stat)
 {
 	struct inode *inode = dentry->d_inode;
@@ -529,9 +552,11 @@ int nfs_getattr(struct vfsmount *mnt, struct dentry *dentry, struct kstat *stat)
  	    ((mnt->mnt_flags & MNT_NODIRATIME) && S_ISDIR(inode->i_mode)))
 		need_atime = 0;
 
-	if (need_atime)
+	if (need_atime || nfs_need_revalidate_inode(inode)) {
+		if (!IS_ROOT(dentry))
+			nfs_request_parent_use_readdirplus(dentry);
 		err = __nfs_revalidate_inode(NFS_SERVER(inode), inode);
-	else
+	} else
 		err = nfs_revalidate_inode(NFS_SERVER(inode), inode);
 	if (!err) {
 		generic_fillattr(inode, stat);
@@ -846,6 +871,22 @@ int nfs_revalidate_inode(struct nfs_server *server, struct inode *inode)
 	return __nfs_revalidate_inode(server, inode);
 }
 
+/**
+ * nfs_revalidate_inode_rcu - check the attribute cache without blocking
+ * @server - pointer to nfs_server struct
+ * @inode - pointer to inode struct
+ *
+ * Like nfs_revalidate_inode(), but for use in RCU-walk: returns -ECHILD
+ * instead of going to the server when the cached attributes are no good.
+ */
+int nfs_revalidate_inode_rcu(struct nfs_server *server, struct inode *inode)
+{
+	if (!(NFS_I(inode)->cache_validity & NFS_INO_INVALID_ATTR)
+			&& !nfs_attribute_cache_expired(inode))
+		return NFS_STALE(inode) ? -ESTALE : 0;
+	return -ECHILD;
+}
+
 static int nfs_invalidate_mapping(struct inode *inode, struct address_space *mapping)
 {
 	struct nfs_inode *nfsi = NFS_I(inode);
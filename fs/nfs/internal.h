@@ -92,6 +92,7 @@ struct nfs_parsed_mount_data {
 	int			flags;
 	int			rsize, wsize;
 	int			timeo, retrans;
+	unsigned int		nconnect;
 	int			acregmin, acregmax,
 				acdirmin, acdirmax;
 	int			namlen;
@@ -246,6 +247,7 @@ extern int nfs_init_client(struct nfs_client *clp,
 /* dir.c */
 extern int nfs_access_cache_shrinker(struct shrinker *shrink,
 					struct shrink_control *sc);
+extern void nfs_advise_use_readdirplus(struct inode *dir);
 
 /* inode.c */
 extern struct workqueue_struct *nfsiod_workqueue;
@@ -258,6 +260,8 @@ extern void nfs4_evict_inode(struct inode *);
 #endif
 void nfs_zap_acl_cache(struct inode *inode);
 extern int nfs_wait_bit_killable(void *word);
+extern int nfs_revalidate_inode_rcu(struct nfs_server *server,
+				    struct inode *inode);
 
 /* super.c */
 extern struct file_system_type nfs_xdev_fs_type;
@@ -90,7 +90,7 @@ enum {
 	/* Mount options that take integer arguments */
 	Opt_port,
 	Opt_rsize, Opt_wsize, Opt_bsize,
-	Opt_timeo, Opt_retrans,
+	Opt_timeo, Opt_retrans, Opt_nconnect,
 	Opt_acregmin, Opt_acregmax,
 	Opt_acdirmin, Opt_acdirmax,
 	Opt_actimeo,
@@ -155,6 +155,7 @@ static const match_table_t nfs_mount_option_tokens = {
 	{ Opt_bsize, "bsize=%s" },
 	{ Opt_timeo, "timeo=%s" },
 	{ Opt_retrans, "retrans=%s" },
+	{ Opt_nconnect, "nconnect=%s" },
 	{ Opt_acregmin, "acregmin=%s" },
 	{ Opt_acregmax, "acregmax=%s" },
 	{ Opt_acdirmin, "acdirmin=%s" },
@@ -687,6 +688,8 @@ static void nfs_show_mount_options(struct seq_file *m, struct nfs_server *nfss,
 
 	seq_printf(m, ",timeo=%lu", 10U * nfss->client->cl_timeout->to_initval / HZ);
 	seq_printf(m, ",retrans=%u", nfss->client->cl_timeout->to_retries);
+	if (nfss->nfs_client->cl_nconnect > 1)
+		seq_printf(m, ",nconnect=%u", nfss->nfs_client->cl_nconnect);
 	seq_printf(m, ",sec=%s", nfs_pseudoflavour_to_name(nfss->client->cl_auth->au_flavor));
 
 	if (version != 4)
@@ -1251,6 +1254,12 @@ static int nfs_parse_mount_options(char *raw,
 				goto out_invalid_value;
 			mnt->retrans = option;
 			break;
+		case Opt_nconnect:
+			if (nfs_get_option_ul(args, &option) ||
+			    option < 1 || option > RPC_MAX_CONNECT)
+				goto out_invalid_value;
+			mnt->nconnect = option;
+			break;
 		case Opt_acregmin:
 			if (nfs_get_option_ul(args, &option))
 				goto out_invalid_value;
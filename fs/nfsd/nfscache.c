@@ -9,65 +9,151 @@
  */
 
 #include <linux/slab.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
+#include <linux/highmem.h>
+#include <linux/seq_file.h>
+#include <linux/sunrpc/clnt.h>
+#include <net/checksum.h>
 
 #include "nfsd.h"
 #include "cache.h"
 
-/* Size of reply cache. Common values are:
- * 4.3BSD:	128
- * 4.4BSD:	256
- * Solaris2:	1024
- * DEC Unix:	512-4096
+/*
+ * The cache is sized from the amount of low memory (see
+ * nfsd_cache_size_limit()). The number of hash buckets is chosen so that
+ * a full cache holds about this many entries per bucket.
+ */
+#define TARGET_BUCKET_SIZE	64
+
+/*
+ * Each bucket is an LRU list of its entries, oldest first, protected
+ * by its own lock.
  */
-#define CACHESIZE		1024
-#define HASHSIZE		64
+struct nfsd_drc_bucket {
+	struct list_head	lru_head;
+	spinlock_t		cache_lock;
+};
 
-static struct hlist_head *	cache_hash;
-static struct list_head 	lru_head;
-static int			cache_disabled = 1;
+static struct nfsd_drc_bucket	*drc_hashtbl;
+static struct kmem_cache	*drc_slab;
+
+/* max number of entries allowed in the cache */
+static unsigned int		max_drc_entries;
+
+/* number of significant bits in the hash value */
+static unsigned int		maskbits;
 
 /*
- * Calculate the hash index from an XID.
+ * Statistics, reported in /proc/fs/nfsd/reply_cache_stats. Like the "rc"
+ * counters in nfsdstats, they are updated under the bucket locks only,
+ * so they are not exact.
  */
-static inline u32 request_hash(u32 xid)
-{
-	u32 h = xid;
-	h ^= (xid >> 24);
-	return h & (HASHSIZE-1);
-}
+static atomic_t			num_drc_entries;
+static atomic_t			drc_mem_usage;
+/* cache misses due only to checksum comparison failures */
+static unsigned int		payload_misses;
+/* longest hash chain seen, and the cache size at that time */
+static unsigned int		longest_chain;
+static unsigned int		longest_chain_cachesize;
 
 static int	nfsd_cache_append(struct svc_rqst *rqstp, struct kvec *vec);
 
 /*
- * locking for the reply cache:
- * A cache entry is "single use" if c_state == RC_INPROG
- * Otherwise, it when accessing _prev or _next, the lock must be held.
+ * Limit the cache to 16 entries per square root of the low memory
+ * pages, scaled to kilobytes: ~8k entries with 1GB, ~32k with 16GB,
+ * and never more than 256k entries.
  */
-static DEFINE_SPINLOCK(cache_lock);
+static unsigned int
+nfsd_cache_size_limit(void)
+{
+	unsigned int limit;
+	unsigned long low_pages = totalram_pages - totalhigh_pages;
 
-int nfsd_reply_cache_init(void)
+	limit = (16 * int_sqrt(low_pages)) << (PAGE_SHIFT-10);
+	return min_t(unsigned int, limit, 256*1024);
+}
+
+static u32
+nfsd_cache_hash(__be32 xid)
+{
+	return hash_32(be32_to_cpu(xid), maskbits);
+}
+
+static struct svc_cacherep *
+nfsd_reply_cache_alloc(void)
 {
 	struct svc_cacherep	*rp;
-	int			i;
 
-	INIT_LIST_HEAD(&lru_head);
-	i = CACHESIZE;
-	while (i) {
-		rp = kmalloc(sizeof(*rp), GFP_KERNEL);
-		if (!rp)
-			goto out_nomem;
-		list_add(&rp->c_lru, &lru_head);
+	rp = kmem_cache_alloc(drc_slab, GFP_KERNEL);
+	if (rp) {
 		rp->c_state = RC_UNUSED;
 		rp->c_type = RC_NOCACHE;
-		INIT_HLIST_NODE(&rp->c_hash);
-		i--;
+		INIT_LIST_HEAD(&rp->c_lru);
 	}
+	return rp;
+}
+
+/*
+ * Drop the reply buffer of an entry, if any. Must hold the bucket lock
+ * or own the entry (RC_INPROG).
+ */
+static void
+nfsd_reply_cache_release_buf(struct svc_cacherep *rp)
+{
+	if (rp->c_type == RC_REPLBUFF && rp->c_replvec.iov_base) {
+		atomic_sub(rp->c_replvec.iov_len, &drc_mem_usage);
+		kfree(rp->c_replvec.iov_base);
+		rp->c_replvec.iov_base = NULL;
+	}
+}
+
+/*
+ * Free an entry. Must hold the bucket lock, unless the entry is not
+ * linked on a bucket yet.
+ */
+static void
+nfsd_reply_cache_free_locked(struct svc_cacherep *rp)
+{
+	nfsd_reply_cache_release_buf(rp);
+	list_del(&rp->c_lru);
+	atomic_dec(&num_drc_entries);
+	atomic_sub(sizeof(*rp), &drc_mem_usage);
+	kmem_cache_free(drc_slab, rp);
+}
+
+static void
+nfsd_reply_cache_free(struct nfsd_drc_bucket *b, struct svc_cacherep *rp)
+{
+	spin_lock(&b->cache_lock);
+	nfsd_reply_cache_free_locked(rp);
+	spin_unlock(&b->cache_lock);
+}
 
-	cache_hash = kcalloc (HASHSIZE, sizeof(struct hlist_head), GFP_KERNEL);
-	if (!cache_hash)
+int nfsd_reply_cache_init(void)
+{
+	unsigned int		hashsize;
+	unsigned int		i;
+
+	max_drc_entries = nfsd_cache_size_limit();
+	atomic_set(&num_drc_entries, 0);
+	atomic_set(&drc_mem_usage, 0);
+	hashsize = roundup_pow_of_two(max_drc_entries / TARGET_BUCKET_SIZE);
+	maskbits = ilog2(hashsize);
+
+	drc_slab = kmem_cache_create("nfsd_drc", sizeof(struct svc_cacherep),
+					0, 0, NULL);
+	if (!drc_slab)
 		goto out_nomem;
 
-	cache_disabled = 0;
+	drc_hashtbl = kcalloc(hashsize, sizeof(*drc_hashtbl), GFP_KERNEL);
+	if (!drc_hashtbl)
+		goto out_nomem;
+	for (i = 0; i < hashsize; i++) {
+		INIT_LIST_HEAD(&drc_hashtbl[i].lru_head);
+		spin_lock_init(&drc_hashtbl[i].cache_lock);
+	}
+
 	return 0;
 out_nomem:
 	printk(KERN_ERR "nfsd: failed to allocate reply cache\n");
@@ -78,133 +164,241 @@ out_nomem:
 void nfsd_reply_cache_shutdown(void)
 {
 	struct svc_cacherep	*rp;
+	unsigned int		i;
 
-	while (!list_empty(&lru_head)) {
-		rp = list_entry(lru_head.next, struct svc_cacherep, c_lru);
-		if (rp->c_state == RC_DONE && rp->c_type == RC_REPLBUFF)
-			kfree(rp->c_replvec.iov_base);
-		list_del(&rp->c_lru);
-		kfree(rp);
-	}
+	if (drc_hashtbl) {
+		for (i = 0; i < (1U << maskbits); i++) {
+			struct list_head *head = &drc_hashtbl[i].lru_head;
 
-	cache_disabled = 1;
+			while (!list_empty(head)) {
+				rp = list_first_entry(head, struct svc_cacherep,
+						      c_lru);
+				nfsd_reply_cache_free_locked(rp);
+			}
+		}
+		kfree(drc_hashtbl);
+		drc_hashtbl = NULL;
+	}
 
-	kfree (cache_hash);
-	cache_hash = NULL;
+	if (drc_slab) {
+		kmem_cache_destroy(drc_slab);
+		drc_slab = NULL;
+	}
 }
 
 /*
- * Move cache entry to end of LRU list
+ * Move cache entry to end of its bucket's LRU list
  */
 static void
-lru_put_end(struct svc_cacherep *rp)
+lru_put_end(struct nfsd_drc_bucket *b, struct svc_cacherep *rp)
 {
-	list_move_tail(&rp->c_lru, &lru_head);
+	rp->c_timestamp = jiffies;
+	list_move_tail(&rp->c_lru, &b->lru_head);
 }
 
 /*
- * Move a cache entry from one hash list to another
+ * Free the expired entries of a bucket, and while the cache is over its
+ * limit, also the oldest ones. Entries of calls still in progress are
+ * skipped.
  */
 static void
-hash_refile(struct svc_cacherep *rp)
+prune_bucket(struct nfsd_drc_bucket *b)
 {
-	hlist_del_init(&rp->c_hash);
-	hlist_add_head(&rp->c_hash, cache_hash + request_hash(rp->c_xid));
+	struct svc_cacherep *rp, *tmp;
+
+	list_for_each_entry_safe(rp, tmp, &b->lru_head, c_lru) {
+		if (rp->c_state == RC_INPROG)
+			continue;
+		if (atomic_read(&num_drc_entries) <= max_drc_entries &&
+		    time_before(jiffies, rp->c_timestamp + RC_EXPIRE))
+			break;
+		nfsd_reply_cache_free_locked(rp);
+	}
+}
+
+/*
+ * Checksum the first RC_CSUMLEN bytes of the call arguments, so that a
+ * new call reusing the XID of an old one is not answered from the cache.
+ */
+static __wsum
+nfsd_cache_csum(struct svc_rqst *rqstp)
+{
+	int idx;
+	unsigned int base;
+	__wsum csum;
+	struct xdr_buf *buf = &rqstp->rq_arg;
+	const unsigned char *p = buf->head[0].iov_base;
+	size_t csum_len = min_t(size_t, buf->head[0].iov_len + buf->page_len,
+				RC_CSUMLEN);
+	size_t len = min(buf->head[0].iov_len, csum_len);
+
+	/* rq_arg.head first */
+	csum = csum_partial(p, len, 0);
+	csum_len -= len;
+
+	/* Continue into page array */
+	idx = buf->page_base / PAGE_SIZE;
+	base = buf->page_base & ~PAGE_MASK;
+	while (csum_len) {
+		p = page_address(buf->pages[idx]) + base;
+		len = min_t(size_t, PAGE_SIZE - base, csum_len);
+		csum = csum_partial(p, len, csum);
+		csum_len -= len;
+		base = 0;
+		++idx;
+	}
+	return csum;
+}
+
+static bool
+nfsd_cache_match(struct svc_rqst *rqstp, __wsum csum, struct svc_cacherep *rp)
+{
+	struct sockaddr *sap = svc_addr(rqstp);
+
+	/* Check RPC XID first */
+	if (rqstp->rq_xid != rp->c_xid)
+		return false;
+	/* compare checksum of NFS data */
+	if (csum != rp->c_csum) {
+		++payload_misses;
+		return false;
+	}
+
+	/* Other discriminators */
+	if (rqstp->rq_proc != rp->c_proc ||
+	    rqstp->rq_prot != rp->c_prot ||
+	    rqstp->rq_vers != rp->c_vers ||
+	    rqstp->rq_arg.len != rp->c_len ||
+	    !rpc_cmp_addr(sap, (struct sockaddr *)&rp->c_addr) ||
+	    rpc_get_port(sap) != rpc_get_port((struct sockaddr *)&rp->c_addr))
+		return false;
+
+	return true;
+}
+
+/*
+ * Search a bucket for an entry matching the current call. Must hold the
+ * bucket lock.
+ */
+static struct svc_cacherep *
+nfsd_cache_search(struct nfsd_drc_bucket *b, struct svc_rqst *rqstp,
+		  __wsum csum)
+{
+	struct svc_cacherep	*rp, *ret = NULL;
+	unsigned int		entries = 0;
+
+	list_for_each_entry(rp, &b->lru_head, c_lru) {
+		++entries;
+		if (nfsd_cache_match(rqstp, csum, rp)) {
+			ret = rp;
+			break;
+		}
+	}
+
+	/* tally hash chain length stats */
+	if (entries > longest_chain) {
+		longest_chain = entries;
+		longest_chain_cachesize = atomic_read(&num_drc_entries);
+	} else if (entries == longest_chain) {
+		/* prefer to keep the smallest cachesize possible here */
+		longest_chain_cachesize = min_t(unsigned int,
+				longest_chain_cachesize,
+				atomic_read(&num_drc_entries));
+	}
+
+	return ret;
 }
 
 /*
  * Try to find an entry matching the current call in the cache. When none
- * is found, we grab the oldest unlocked entry off the LRU list.
- * Note that no operation within the loop may sleep.
+ * is found, a new entry is inserted for it; if none can be allocated, the
+ * oldest idle entry of the bucket is reused.
+ * Note that no operation under the bucket lock may sleep.
  */
 int
 nfsd_cache_lookup(struct svc_rqst *rqstp)
 {
-	struct hlist_node	*hn;
-	struct hlist_head 	*rh;
-	struct svc_cacherep	*rp;
+	struct svc_cacherep	*rp, *found;
+	struct nfsd_drc_bucket	*b;
 	__be32			xid = rqstp->rq_xid;
 	u32			proto =  rqstp->rq_prot,
 				vers = rqstp->rq_vers,
 				proc = rqstp->rq_proc;
+	__wsum			csum;
 	unsigned long		age;
 	int type = rqstp->rq_cachetype;
-	int rtn;
+	int rtn = RC_DOIT;
 
 	rqstp->rq_cacherep = NULL;
-	if (cache_disabled || type == RC_NOCACHE) {
+	if (!drc_hashtbl || type == RC_NOCACHE) {
 		nfsdstats.rcnocache++;
-		return RC_DOIT;
+		return rtn;
 	}
 
-	spin_lock(&cache_lock);
-	rtn = RC_DOIT;
-
-	rh = &cache_hash[request_hash(xid)];
-	hlist_for_each_entry(rp, hn, rh, c_hash) {
-		if (rp->c_state != RC_UNUSED &&
-		    xid == rp->c_xid && proc == rp->c_proc &&
-		    proto == rp->c_prot && vers == rp->c_vers &&
-		    time_before(jiffies, rp->c_timestamp + 120*HZ) &&
-		    memcmp((char*)&rqstp->rq_addr, (char*)&rp->c_addr, sizeof(rp->c_addr))==0) {
-			nfsdstats.rchits++;
-			goto found_entry;
-		}
+	csum = nfsd_cache_csum(rqstp);
+	b = &drc_hashtbl[nfsd_cache_hash(xid)];
+
+	/*
+	 * Since the common case is a cache miss followed by an insert,
+	 * preallocate an entry outside of the lock.
+	 */
+	rp = nfsd_reply_cache_alloc();
+	spin_lock(&b->cache_lock);
+	if (likely(rp)) {
+		atomic_inc(&num_drc_entries);
+		atomic_add(sizeof(*rp), &drc_mem_usage);
 	}
-	nfsdstats.rcmisses++;
 
-	/* This loop shouldn't take more than a few iterations normally */
-	{
-	int	safe = 0;
-	list_for_each_entry(rp, &lru_head, c_lru) {
-		if (rp->c_state != RC_INPROG)
-			break;
-		if (safe++ > CACHESIZE) {
-			printk("nfsd: loop in repcache LRU list\n");
-			cache_disabled = 1;
-			goto out;
-		}
-	}
+	/* go ahead and prune the bucket */
+	prune_bucket(b);
+
+	found = nfsd_cache_search(b, rqstp, csum);
+	if (found) {
+		if (likely(rp))
+			nfsd_reply_cache_free_locked(rp);
+		rp = found;
+		goto found_entry;
 	}
 
-	/* All entries on the LRU are in-progress. This should not happen */
-	if (&rp->c_lru == &lru_head) {
-		static int	complaints;
+	nfsdstats.rcmisses++;
 
-		printk(KERN_WARNING "nfsd: all repcache entries locked!\n");
-		if (++complaints > 5) {
-			printk(KERN_WARNING "nfsd: disabling repcache.\n");
-			cache_disabled = 1;
+	/* Out of memory: reuse the oldest idle entry of this bucket. */
+	if (unlikely(!rp)) {
+		list_for_each_entry(found, &b->lru_head, c_lru) {
+			if (found->c_state != RC_INPROG) {
+				rp = found;
+				break;
+			}
 		}
-		goto out;
+		if (!rp)
+			goto out;
+		nfsd_reply_cache_release_buf(rp);
 	}
 
 	rqstp->rq_cacherep = rp;
 	rp->c_state = RC_INPROG;
 	rp->c_xid = xid;
 	rp->c_proc = proc;
-	memcpy(&rp->c_addr, svc_addr_in(rqstp), sizeof(rp->c_addr));
+	rpc_copy_addr((struct sockaddr *)&rp->c_addr, svc_addr(rqstp));
+	rpc_set_port((struct sockaddr *)&rp->c_addr,
+		     rpc_get_port(svc_addr(rqstp)));
 	rp->c_prot = proto;
 	rp->c_vers = vers;
-	rp->c_timestamp = jiffies;
+	rp->c_len = rqstp->rq_arg.len;
+	rp->c_csum = csum;
 
-	hash_refile(rp);
+	lru_put_end(b, rp);
 
-	/* release any buffer */
-	if (rp->c_type == RC_REPLBUFF) {
-		kfree(rp->c_replvec.iov_base);
-		rp->c_replvec.iov_base = NULL;
-	}
 	rp->c_type = RC_NOCACHE;
  out:
-	spin_unlock(&cache_lock);
+	spin_unlock(&b->cache_lock);
 	return rtn;
 
 found_entry:
+	nfsdstats.rchits++;
 	/* We found a matching entry which is either in progress or done. */
 	age = jiffies - rp->c_timestamp;
-	rp->c_timestamp = jiffies;
-	lru_put_end(rp);
+	lru_put_end(b, rp);
 
 	rtn = RC_DROPIT;
 	/* Request being processed or excessive rexmits */
@@ -232,7 +426,7 @@ found_entry:
 		break;
 	default:
 		printk(KERN_WARNING "nfsd: bad repcache type %d\n", rp->c_type);
-		rp->c_state = RC_UNUSED;
+		nfsd_reply_cache_free_locked(rp);
 	}
 
 	goto out;
@@ -257,19 +451,22 @@ found_entry:
 void
 nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, __be32 *statp)
 {
-	struct svc_cacherep *rp;
+	struct svc_cacherep *rp = rqstp->rq_cacherep;
 	struct kvec	*resv = &rqstp->rq_res.head[0], *cachv;
+	struct nfsd_drc_bucket *b;
 	int		len;
 
-	if (!(rp = rqstp->rq_cacherep) || cache_disabled)
+	if (!rp)
 		return;
 
+	b = &drc_hashtbl[nfsd_cache_hash(rp->c_xid)];
+
 	len = resv->iov_len - ((char*)statp - (char*)resv->iov_base);
 	len >>= 2;
 
 	/* Don't cache excessive amounts of data and XDR failures */
 	if (!statp || len > (256 >> 2)) {
-		rp->c_state = RC_UNUSED;
+		nfsd_reply_cache_free(b, rp);
 		return;
 	}
 
@@ -283,22 +480,23 @@ nfsd_cache_update(struct svc_rqst *rqstp, int cachetype, __be32 *statp)
 		cachv = &rp->c_replvec;
 		cachv->iov_base = kmalloc(len << 2, GFP_KERNEL);
 		if (!cachv->iov_base) {
-			spin_lock(&cache_lock);
-			rp->c_state = RC_UNUSED;
-			spin_unlock(&cache_lock);
+			nfsd_reply_cache_free(b, rp);
 			return;
 		}
 		cachv->iov_len = len << 2;
 		memcpy(cachv->iov_base, statp, len << 2);
+		atomic_add(cachv->iov_len, &drc_mem_usage);
 		break;
+	case RC_NOCACHE:
+		nfsd_reply_cache_free(b, rp);
+		return;
 	}
-	spin_lock(&cache_lock);
-	lru_put_end(rp);
+	spin_lock(&b->cache_lock);
+	lru_put_end(b, rp);
 	rp->c_secure = rqstp->rq_secure;
 	rp->c_type = cachetype;
 	rp->c_state = RC_DONE;
-	rp->c_timestamp = jiffies;
-	spin_unlock(&cache_lock);
+	spin_unlock(&b->cache_lock);
 	return;
 }
 
@@ -321,3 +519,30 @@ nfsd_cache_append(struct svc_rqst *rqstp, struct kvec *data)
 	vec->iov_len += data->iov_len;
 	return 1;
 }
+
+/*
+ * Note that fields may be added, removed or reordered in the future. Programs
+ * scraping this file for info should test the labels to ensure they're
+ * getting the correct field.
+ */
+static int nfsd_reply_cache_stats_show(struct seq_file *m, void *v)
+{
+	seq_printf(m, "max entries:           %u\n", max_drc_entries);
+	seq_printf(m, "num entries:           %u\n",
+			atomic_read(&num_drc_entries));
+	seq_printf(m, "hash buckets:          %u\n", 1U << maskbits);
+	seq_printf(m, "mem usage:             %u\n",
+			atomic_read(&drc_mem_usage));
+	seq_printf(m, "cache hits:            %u\n", nfsdstats.rchits);
+	seq_printf(m, "cache misses:          %u\n", nfsdstats.rcmisses);
+	seq_printf(m, "not cached:            %u\n", nfsdstats.rcnocache);
+	seq_printf(m, "payload misses:        %u\n", payload_misses);
+	seq_printf(m, "longest chain len:     %u\n", longest_chain);
+	seq_printf(m, "cachesize at longest:  %u\n", longest_chain_cachesize);
+	return 0;
+}
+
+int nfsd_reply_cache_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nfsd_reply_cache_stats_show, NULL);
+}
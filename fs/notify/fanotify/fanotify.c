@@ -37,18 +37,25 @@ static bool should_merge(struct fsnotify_event *old, struct fsnotify_event *new)
 	return false;
 }
 
-/* and the list better be locked by something too! */
+/*
+ * Called under the group's notification_mutex.  Only the queued events for
+ * the same inode can merge, fanotify_init() set up q_hash to find those,
+ * most recent first.
+ */
 static struct fsnotify_event *fanotify_merge(struct list_head *list,
 					     struct fsnotify_event *event)
 {
+	struct fsnotify_group *group = container_of(list, struct fsnotify_group,
+						    notification_list);
 	struct fsnotify_event_holder *test_holder;
 	struct fsnotify_event *test_event = NULL;
 	struct fsnotify_event *new_event;
+	struct hlist_node *node;
 
 	pr_debug("%s: list=%p event=%p\n", __func__, list, event);
 
-
-	list_for_each_entry_reverse(test_holder, list, event_list) {
+	hlist_for_each_entry(test_holder, node,
+			     fsnotify_notify_hash(group, event), hash_node) {
 		if (should_merge(test_holder->event, event)) {
 			test_event = test_holder->event;
 			break;
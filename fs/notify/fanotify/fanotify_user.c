@@ -17,6 +17,7 @@
 #include <asm/ioctls.h>
 
 #define FANOTIFY_DEFAULT_MAX_EVENTS	16384
+#define FANOTIFY_MERGE_HASH_BITS	8
 #define FANOTIFY_DEFAULT_MAX_MARKS	8192
 #define FANOTIFY_DEFAULT_MAX_LISTENERS	128
 
@@ -721,6 +722,14 @@ SYSCALL_DEFINE2(fanotify_init, unsigned int, flags, unsigned int, event_f_flags)
 	group->fanotify_data.user = user;
 	atomic_inc(&user->fanotify_listeners);
 
+	group->q_hash = kcalloc(1 << FANOTIFY_MERGE_HASH_BITS,
+				sizeof(struct hlist_head), GFP_KERNEL);
+	if (!group->q_hash) {
+		fd = -ENOMEM;
+		goto out_destroy_group;
+	}
+	group->q_hash_bits = FANOTIFY_MERGE_HASH_BITS;
+
 	group->fanotify_data.f_flags = event_f_flags;
 #ifdef CONFIG_FANOTIFY_ACCESS_PERMISSIONS
 	mutex_init(&group->fanotify_data.access_mutex);
@@ -37,6 +37,7 @@ void fsnotify_final_destroy_group(struct fsnotify_group *group)
 	if (group->ops->free_group_priv)
 		group->ops->free_group_priv(group);
 
+	kfree(group->q_hash);
 	kfree(group);
 }
 
@@ -219,6 +219,10 @@ alloc_holder:
 
 	fsnotify_get_event(event);
 	list_add_tail(&holder->event_list, list);
+	if (group->q_hash)
+		hlist_add_head(&holder->hash_node, fsnotify_notify_hash(group, event));
+	else
+		INIT_HLIST_NODE(&holder->hash_node);
 	if (priv)
 		list_add_tail(&priv->event_list, &event->private_data_list);
 	spin_unlock(&event->lock);
@@ -249,6 +253,8 @@ struct fsnotify_event *fsnotify_remove_notify_event(struct fsnotify_group *group
 	spin_lock(&event->lock);
 	holder->event = NULL;
 	list_del_init(&holder->event_list);
+	if (!hlist_unhashed(&holder->hash_node))
+		hlist_del_init(&holder->hash_node);
 	spin_unlock(&event->lock);
 
 	/* event == holder means we are referenced through the in event holder */
@@ -304,6 +310,7 @@ void fsnotify_flush_notify(struct fsnotify_group *group)
 static void initialize_event(struct fsnotify_event *event)
 {
 	INIT_LIST_HEAD(&event->holder.event_list);
+	INIT_HLIST_NODE(&event->holder.hash_node);
 	atomic_set(&event->refcnt, 1);
 
 	spin_lock_init(&event->lock);
@@ -340,6 +347,10 @@ int fsnotify_replace_event(struct fsnotify_event_holder *old_holder,
 
 	new_holder->event = new_event;
 	list_replace_init(&old_holder->event_list, &new_holder->event_list);
+	if (!hlist_unhashed(&old_holder->hash_node)) {
+		hlist_add_before(&new_holder->hash_node, &old_holder->hash_node);
+		hlist_del_init(&old_holder->hash_node);
+	}
 
 	spin_unlock(&new_event->lock);
 	spin_unlock(&old_event->lock);
@@ -173,9 +173,49 @@ static int ovl_set_mode(struct dentry *upperdentry, umode_t mode)
 	return notify_change(upperdentry, &attr);
 }
 
+static int ovl_set_size(struct dentry *upperdentry, loff_t size)
+{
+	struct iattr attr = {
+		.ia_valid = ATTR_SIZE,
+		.ia_size = size,
+	};
+
+	return notify_change(upperdentry, &attr);
+}
+
+/*
+ * Credentials for copying up an object owned by @stat: create it with the
+ * original owner and allow writing private xattrs, mode and timestamps.
+ */
+static struct cred *ovl_copy_up_cred(struct kstat *stat)
+{
+	struct cred *override_cred;
+
+	override_cred = prepare_creds();
+	if (!override_cred)
+		return NULL;
+
+	override_cred->fsuid = stat->uid;
+	override_cred->fsgid = stat->gid;
+	/*
+	 * CAP_SYS_ADMIN for copying up extended attributes
+	 * CAP_DAC_OVERRIDE for create
+	 * CAP_FOWNER for chmod, timestamp update
+	 * CAP_FSETID for chmod
+	 * CAP_MKNOD for mknod
+	 */
+	cap_raise(override_cred->cap_effective, CAP_SYS_ADMIN);
+	cap_raise(override_cred->cap_effective, CAP_DAC_OVERRIDE);
+	cap_raise(override_cred->cap_effective, CAP_FOWNER);
+	cap_raise(override_cred->cap_effective, CAP_FSETID);
+	cap_raise(override_cred->cap_effective, CAP_MKNOD);
+
+	return override_cred;
+}
+
 static int ovl_copy_up_locked(struct dentry *upperdir, struct dentry *dentry,
 			      struct path *lowerpath, struct kstat *stat,
-			      const char *link)
+			      const char *link, bool metacopy)
 {
 	int err;
 	struct path newpath;
@@ -190,7 +230,23 @@ static int ovl_copy_up_locked(struct dentry *upperdir, struct dentry *dentry,
 	if (IS_ERR(newpath.dentry))
 		return PTR_ERR(newpath.dentry);
 
-	if (S_ISREG(stat->mode)) {
+	if (!S_ISREG(stat->mode) || !stat->size)
+		metacopy = false;
+
+	/*
+	 * The marker goes on before anything else, an upper file without it
+	 * is taken to hold all of the data.  Upper filesystems without
+	 * xattr support get a full copy.
+	 */
+	if (metacopy) {
+		err = vfs_setxattr(newpath.dentry, ovl_metacopy_xattr, "y", 1, 0);
+		if (err == -EOPNOTSUPP)
+			metacopy = false;
+		else if (err)
+			goto err_remove;
+	}
+
+	if (S_ISREG(stat->mode) && !metacopy) {
 		err = ovl_copy_up_data(lowerpath, &newpath, stat->size);
 		if (err)
 			goto err_remove;
@@ -201,7 +257,9 @@ static int ovl_copy_up_locked(struct dentry *upperdir, struct dentry *dentry,
 		goto err_remove;
 
 	mutex_lock(&newpath.dentry->d_inode->i_mutex);
-	if (!S_ISLNK(stat->mode))
+	if (metacopy)
+		err = ovl_set_size(newpath.dentry, stat->size);
+	if (!err && !S_ISLNK(stat->mode))
 		err = ovl_set_mode(newpath.dentry, mode);
 	if (!err)
 		err = ovl_set_timestamps(newpath.dentry, stat);
@@ -209,6 +267,18 @@ static int ovl_copy_up_locked(struct dentry *upperdir, struct dentry *dentry,
 	if (err)
 		goto err_remove;
 
+	if (metacopy) {
+		/*
+		 * Keep the lower dentry, reads are served from it until the
+		 * data is copied up.  Like any upper file hiding a lower one
+		 * it needs a whiteout when removed.
+		 */
+		ovl_dentry_set_metacopy(dentry, true);
+		ovl_dentry_set_opaque(dentry, true);
+		ovl_dentry_update(dentry, newpath.dentry);
+		return 0;
+	}
+
 	ovl_dentry_update(dentry, newpath.dentry);
 
 	/*
@@ -248,7 +318,8 @@ err_remove:
  * that point the file will have already been copied up anyway.
  */
 static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
-			   struct path *lowerpath, struct kstat *stat)
+			   struct path *lowerpath, struct kstat *stat,
+			   bool metacopy)
 {
 	int err;
 	struct kstat pstat;
@@ -272,24 +343,10 @@ static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 	}
 
 	err = -ENOMEM;
-	override_cred = prepare_creds();
+	override_cred = ovl_copy_up_cred(stat);
 	if (!override_cred)
 		goto out_free_link;
 
-	override_cred->fsuid = stat->uid;
-	override_cred->fsgid = stat->gid;
-	/*
-	 * CAP_SYS_ADMIN for copying up extended attributes
-	 * CAP_DAC_OVERRIDE for create
-	 * CAP_FOWNER for chmod, timestamp update
-	 * CAP_FSETID for chmod
-	 * CAP_MKNOD for mknod
-	 */
-	cap_raise(override_cred->cap_effective, CAP_SYS_ADMIN);
-	cap_raise(override_cred->cap_effective, CAP_DAC_OVERRIDE);
-	cap_raise(override_cred->cap_effective, CAP_FOWNER);
-	cap_raise(override_cred->cap_effective, CAP_FSETID);
-	cap_raise(override_cred->cap_effective, CAP_MKNOD);
 	old_cred = override_creds(override_cred);
 
 	mutex_lock_nested(&upperdir->d_inode->i_mutex, I_MUTEX_PARENT);
@@ -297,7 +354,7 @@ static int ovl_copy_up_one(struct dentry *parent, struct dentry *dentry,
 		err = 0;
 	} else {
 		err = ovl_copy_up_locked(upperdir, dentry, lowerpath,
-					 stat, link);
+					 stat, link, metacopy);
 		if (!err) {
 			/* Restore timestamps on parent (best effort) */
 			ovl_set_timestamps(upperdir, &pstat);
@@ -316,7 +373,56 @@ out_free_link:
 	return err;
 }
 
-int ovl_copy_up(struct dentry *dentry)
+/*
+ * Finish a metadata only copy up by copying the first @size bytes of data
+ * from the lower file and removing the marker
+ */
+static int ovl_copy_up_finish(struct dentry *dentry, loff_t size)
+{
+	int err;
+	struct kstat stat;
+	struct path lowerpath;
+	struct path upperpath;
+	struct dentry *parent;
+	struct dentry *upperdir;
+	const struct cred *old_cred;
+	struct cred *override_cred;
+
+	ovl_path_upper(dentry, &upperpath);
+	err = vfs_getattr(upperpath.mnt, upperpath.dentry, &stat);
+	if (err)
+		return err;
+
+	override_cred = ovl_copy_up_cred(&stat);
+	if (!override_cred)
+		return -ENOMEM;
+	old_cred = override_creds(override_cred);
+
+	parent = dget_parent(dentry);
+	upperdir = ovl_dentry_upper(parent);
+	mutex_lock_nested(&upperdir->d_inode->i_mutex, I_MUTEX_PARENT);
+	if (ovl_dentry_is_metacopy(dentry)) {
+		ovl_path_lower(dentry, &lowerpath);
+		err = ovl_copy_up_data(&lowerpath, &upperpath,
+				       min(size, stat.size));
+		if (!err)
+			err = vfs_removexattr(upperpath.dentry,
+					      ovl_metacopy_xattr);
+		if (!err) {
+			smp_wmb();
+			ovl_dentry_set_metacopy(dentry, false);
+		}
+	}
+	mutex_unlock(&upperdir->d_inode->i_mutex);
+	dput(parent);
+
+	revert_creds(old_cred);
+	put_cred(override_cred);
+
+	return err;
+}
+
+static int ovl_copy_up_common(struct dentry *dentry, bool metacopy)
 {
 	int err;
 
@@ -347,7 +453,8 @@ int ovl_copy_up(struct dentry *dentry)
 		ovl_path_lower(next, &lowerpath);
 		err = vfs_getattr(lowerpath.mnt, lowerpath.dentry, &stat);
 		if (!err)
-			err = ovl_copy_up_one(parent, next, &lowerpath, &stat);
+			err = ovl_copy_up_one(parent, next, &lowerpath, &stat,
+					      metacopy && next == dentry);
 
 		dput(parent);
 		dput(next);
@@ -356,14 +463,40 @@ int ovl_copy_up(struct dentry *dentry)
 	return err;
 }
 
+int ovl_copy_up(struct dentry *dentry)
+{
+	int err;
+
+	err = ovl_copy_up_common(dentry, false);
+	if (!err && ovl_dentry_is_metacopy(dentry))
+		err = ovl_copy_up_finish(dentry, LLONG_MAX);
+
+	return err;
+}
+
+/*
+ * Copy up only what is needed for a metadata change: regular files are
+ * created on upper without their data, which is copied up on the first
+ * open for write or truncate.  Until then reads go to the lower file and
+ * share its page cache.
+ */
+int ovl_copy_up_meta(struct dentry *dentry)
+{
+	return ovl_copy_up_common(dentry, true);
+}
+
 /* Optimize by not copying up the file first and truncating later */
 int ovl_copy_up_truncate(struct dentry *dentry, loff_t size)
 {
 	int err;
 	struct kstat stat;
 	struct path lowerpath;
-	struct dentry *parent = dget_parent(dentry);
+	struct dentry *parent;
+
+	if (ovl_dentry_is_metacopy(dentry))
+		return ovl_copy_up_finish(dentry, size);
 
+	parent = dget_parent(dentry);
 	err = ovl_copy_up(parent);
 	if (err)
 		goto out_dput_parent;
@@ -376,7 +509,7 @@ int ovl_copy_up_truncate(struct dentry *dentry, loff_t size)
 	if (size < stat.size)
 		stat.size = size;
 
-	err = ovl_copy_up_one(parent, dentry, &lowerpath, &stat);
+	err = ovl_copy_up_one(parent, dentry, &lowerpath, &stat, false);
 
 out_dput_parent:
 	dput(parent);
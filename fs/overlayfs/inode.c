@@ -19,7 +19,9 @@ int ovl_setattr(struct dentry *dentry, struct iattr *attr)
 	struct dentry *upperdentry;
 	int err;
 
-	if ((attr->ia_valid & ATTR_SIZE) && !ovl_dentry_upper(dentry))
+	if (!(attr->ia_valid & ATTR_SIZE))
+		err = ovl_copy_up_meta(dentry);
+	else if (!ovl_dentry_upper(dentry) || ovl_dentry_is_metacopy(dentry))
 		err = ovl_copy_up_truncate(dentry, attr->ia_size);
 	else
 		err = ovl_copy_up(dentry);
@@ -213,7 +215,7 @@ int ovl_setxattr(struct dentry *dentry, const char *name,
 	if (ovl_is_private_xattr(name))
 		return -EPERM;
 
-	err = ovl_copy_up(dentry);
+	err = ovl_copy_up_meta(dentry);
 	if (err)
 		return err;
 
@@ -277,7 +279,7 @@ int ovl_removexattr(struct dentry *dentry, const char *name)
 		if (err < 0)
 			return err;
 
-		err = ovl_copy_up(dentry);
+		err = ovl_copy_up_meta(dentry);
 		if (err)
 			return err;
 
@@ -288,9 +290,10 @@ int ovl_removexattr(struct dentry *dentry, const char *name)
 }
 
 static bool ovl_open_need_copy_up(int flags, enum ovl_path_type type,
+				  struct dentry *dentry,
 				  struct dentry *realdentry)
 {
-	if (type != OVL_PATH_LOWER)
+	if (type != OVL_PATH_LOWER && !ovl_dentry_is_metacopy(dentry))
 		return false;
 
 	if (special_file(realdentry->d_inode->i_mode))
@@ -310,7 +313,8 @@ static struct file *ovl_open(struct dentry *dentry, struct file *file,
 	enum ovl_path_type type;
 
 	type = ovl_path_real(dentry, &realpath);
-	if (ovl_open_need_copy_up(file->f_flags, type, realpath.dentry)) {
+	if (ovl_open_need_copy_up(file->f_flags, type, dentry,
+				  realpath.dentry)) {
 		if (file->f_flags & O_TRUNC)
 			err = ovl_copy_up_truncate(dentry, 0);
 		else
@@ -319,6 +323,9 @@ static struct file *ovl_open(struct dentry *dentry, struct file *file,
 			return ERR_PTR(err);
 
 		ovl_path_upper(dentry, &realpath);
+	} else if (ovl_dentry_is_metacopy(dentry)) {
+		/* data is not copied up yet */
+		ovl_path_lower(dentry, &realpath);
 	}
 
 	return vfs_open(&realpath, file, cred);
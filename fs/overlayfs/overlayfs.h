@@ -17,6 +17,7 @@ enum ovl_path_type {
 
 extern const char *ovl_opaque_xattr;
 extern const char *ovl_whiteout_xattr;
+extern const char *ovl_metacopy_xattr;
 extern const struct dentry_operations ovl_dentry_operations;
 
 enum ovl_path_type ovl_path_type(struct dentry *dentry);
@@ -31,6 +32,8 @@ struct dentry *ovl_dentry_real(struct dentry *dentry);
 struct dentry *ovl_entry_real(struct ovl_entry *oe, bool *is_upper);
 bool ovl_dentry_is_opaque(struct dentry *dentry);
 void ovl_dentry_set_opaque(struct dentry *dentry, bool opaque);
+bool ovl_dentry_is_metacopy(struct dentry *dentry);
+void ovl_dentry_set_metacopy(struct dentry *dentry, bool metacopy);
 bool ovl_is_whiteout(struct dentry *dentry);
 void ovl_dentry_update(struct dentry *dentry, struct dentry *upperdentry);
 struct dentry *ovl_lookup(struct inode *dir, struct dentry *dentry,
@@ -61,4 +64,5 @@ extern const struct inode_operations ovl_dir_inode_operations;
 
 /* copy_up.c */
 int ovl_copy_up(struct dentry *dentry);
+int ovl_copy_up_meta(struct dentry *dentry);
 int ovl_copy_up_truncate(struct dentry *dentry, loff_t size);
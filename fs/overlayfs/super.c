@@ -43,6 +43,8 @@ struct ovl_entry {
 	 */
 	struct dentry *__upperdentry;
 	struct dentry *lowerdentry;
+	/* upper holds only the metadata, data is still in lowerdentry */
+	bool metacopy;
 	union {
 		struct {
 			u64 version;
@@ -54,6 +56,7 @@ struct ovl_entry {
 
 const char *ovl_whiteout_xattr = "trusted.overlay.whiteout";
 const char *ovl_opaque_xattr = "trusted.overlay.opaque";
+const char *ovl_metacopy_xattr = "trusted.overlay.metacopy";
 
 
 enum ovl_path_type ovl_path_type(struct dentry *dentry)
@@ -160,6 +163,18 @@ void ovl_dentry_set_opaque(struct dentry *dentry, bool opaque)
 	oe->opaque = opaque;
 }
 
+bool ovl_dentry_is_metacopy(struct dentry *dentry)
+{
+	struct ovl_entry *oe = dentry->d_fsdata;
+	return ACCESS_ONCE(oe->metacopy);
+}
+
+void ovl_dentry_set_metacopy(struct dentry *dentry, bool metacopy)
+{
+	struct ovl_entry *oe = dentry->d_fsdata;
+	oe->metacopy = metacopy;
+}
+
 void ovl_dentry_update(struct dentry *dentry, struct dentry *upperdentry)
 {
 	struct ovl_entry *oe = dentry->d_fsdata;
@@ -221,6 +236,21 @@ static bool ovl_is_opaquedir(struct dentry *dentry)
 	return false;
 }
 
+static bool ovl_is_metacopy(struct dentry *dentry)
+{
+	int res;
+	char val;
+
+	if (!S_ISREG(dentry->d_inode->i_mode))
+		return false;
+
+	res = vfs_getxattr(dentry, ovl_metacopy_xattr, &val, 1);
+	if (res == 1 && val == 'y')
+		return true;
+
+	return false;
+}
+
 static void ovl_entry_free(struct rcu_head *head)
 {
 	struct ovl_entry *oe = container_of(head, struct ovl_entry, rcu);
@@ -293,7 +323,8 @@ static int ovl_do_lookup(struct dentry *dentry)
 
 		if (lowerdir && upperdentry &&
 		    (S_ISLNK(upperdentry->d_inode->i_mode) ||
-		     S_ISDIR(upperdentry->d_inode->i_mode))) {
+		     S_ISDIR(upperdentry->d_inode->i_mode) ||
+		     S_ISREG(upperdentry->d_inode->i_mode))) {
 			const struct cred *old_cred;
 			struct cred *override_cred;
 
@@ -312,6 +343,8 @@ static int ovl_do_lookup(struct dentry *dentry)
 				dput(upperdentry);
 				upperdentry = NULL;
 				oe->opaque = true;
+			} else if (ovl_is_metacopy(upperdentry)) {
+				oe->metacopy = true;
 			}
 			revert_creds(old_cred);
 			put_cred(override_cred);
@@ -327,9 +360,15 @@ static int ovl_do_lookup(struct dentry *dentry)
 	if (lowerdentry && upperdentry &&
 	    (!S_ISDIR(upperdentry->d_inode->i_mode) ||
 	     !S_ISDIR(lowerdentry->d_inode->i_mode))) {
-		dput(lowerdentry);
-		lowerdentry = NULL;
+		/* a metadata only copy up keeps reading data from lower */
+		if (!oe->metacopy || !S_ISREG(lowerdentry->d_inode->i_mode)) {
+			dput(lowerdentry);
+			lowerdentry = NULL;
+			oe->metacopy = false;
+		}
 		oe->opaque = true;
+	} else {
+		oe->metacopy = false;
 	}
 
 	if (lowerdentry || upperdentry) {
@@ -195,20 +195,46 @@ static void iov_fault_in_pages_read(struct iovec *iov, unsigned long len)
 	}
 }
 
-static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
-				  struct pipe_buffer *buf)
+static struct page *anon_pipe_get_page(struct pipe_inode_info *pipe)
 {
-	struct page *page = buf->page;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(pipe->tmp_page); i++) {
+		struct page *page = pipe->tmp_page[i];
+
+		if (page) {
+			pipe->tmp_page[i] = NULL;
+			return page;
+		}
+	}
+	return alloc_page(GFP_HIGHUSER);
+}
+
+static void anon_pipe_put_page(struct pipe_inode_info *pipe,
+			       struct page *page)
+{
+	int i;
 
 	/*
-	 * If nobody else uses this page, and we don't already have a
-	 * temporary page, let's keep track of it as a one-deep
-	 * allocation cache. (Otherwise just release our reference to it)
+	 * If nobody else uses this page, and we have room for another
+	 * temporary page, let's keep track of it in the small allocation
+	 * cache. (Otherwise just release our reference to it)
 	 */
-	if (page_count(page) == 1 && !pipe->tmp_page)
-		pipe->tmp_page = page;
-	else
-		page_cache_release(page);
+	if (page_count(page) == 1) {
+		for (i = 0; i < ARRAY_SIZE(pipe->tmp_page); i++) {
+			if (!pipe->tmp_page[i]) {
+				pipe->tmp_page[i] = page;
+				return;
+			}
+		}
+	}
+	page_cache_release(page);
+}
+
+static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
+				  struct pipe_buffer *buf)
+{
+	anon_pipe_put_page(pipe, buf->page);
 }
 
 /**
@@ -362,7 +388,7 @@ pipe_read(struct kiocb *iocb, const struct iovec *_iov,
 	struct file *filp = iocb->ki_filp;
 	struct inode *inode = filp->f_path.dentry->d_inode;
 	struct pipe_inode_info *pipe;
-	int do_wakeup;
+	int do_wakeup, was_full;
 	ssize_t ret;
 	struct iovec *iov = (struct iovec *)_iov;
 	size_t total_len;
@@ -372,7 +398,12 @@ pipe_read(struct kiocb *iocb, const struct iovec *_iov,
 	if (unlikely(total_len == 0))
 		return 0;
 
-	do_wakeup = 0;
+	/*
+	 * Writers only sleep on a full pipe, so their wait queue is only
+	 * woken when this read takes the pipe out of that state, or when
+	 * someone is polling.  fasync users still hear about every read.
+	 */
+	do_wakeup = was_full = 0;
 	ret = 0;
 	mutex_lock(&inode->i_mutex);
 	pipe = inode->i_pipe;
@@ -428,6 +459,8 @@ redo:
 				ops->release(pipe, buf);
 				curbuf = (curbuf + 1) & (pipe->buffers - 1);
 				pipe->curbuf = curbuf;
+				if (bufs == pipe->buffers)
+					was_full = 1;
 				pipe->nrbufs = --bufs;
 				do_wakeup = 1;
 			}
@@ -458,8 +491,10 @@ redo:
 			break;
 		}
 		if (do_wakeup) {
-			wake_up_interruptible_sync_poll(&pipe->wait, POLLOUT | POLLWRNORM);
+			if (was_full || pipe->poll_usage)
+				wake_up_interruptible_sync_poll(&pipe->wait, POLLOUT | POLLWRNORM);
  			kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
+			do_wakeup = was_full = 0;
 		}
 		pipe_wait(pipe);
 	}
@@ -467,7 +502,8 @@ redo:
 
 	/* Signal writers asynchronously that there is more room. */
 	if (do_wakeup) {
-		wake_up_interruptible_sync_poll(&pipe->wait, POLLOUT | POLLWRNORM);
+		if (was_full || pipe->poll_usage)
+			wake_up_interruptible_sync_poll(&pipe->wait, POLLOUT | POLLWRNORM);
 		kill_fasync(&pipe->fasync_writers, SIGIO, POLL_OUT);
 	}
 	if (ret > 0)
@@ -488,7 +524,7 @@ pipe_write(struct kiocb *iocb, const struct iovec *_iov,
 	struct inode *inode = filp->f_path.dentry->d_inode;
 	struct pipe_inode_info *pipe;
 	ssize_t ret;
-	int do_wakeup;
+	int do_wakeup, was_empty;
 	struct iovec *iov = (struct iovec *)_iov;
 	size_t total_len;
 	ssize_t chars;
@@ -498,7 +534,7 @@ pipe_write(struct kiocb *iocb, const struct iovec *_iov,
 	if (unlikely(total_len == 0))
 		return 0;
 
-	do_wakeup = 0;
+	do_wakeup = was_empty = 0;
 	ret = 0;
 	mutex_lock(&inode->i_mutex);
 	pipe = inode->i_pipe;
@@ -509,6 +545,13 @@ pipe_write(struct kiocb *iocb, const struct iovec *_iov,
 		goto out;
 	}
 
+	/*
+	 * Readers only sleep on an empty pipe, so their wait queue is only
+	 * woken when this write fills an empty pipe, or when someone is
+	 * polling.  fasync users still hear about every write.
+	 */
+	was_empty = pipe->nrbufs == 0;
+
 	/* We try to merge small writes */
 	chars = total_len & (PAGE_SIZE-1); /* size of the last buffer */
 	if (pipe->nrbufs && chars != 0) {
@@ -562,17 +605,14 @@ redo1:
 		if (bufs < pipe->buffers) {
 			int newbuf = (pipe->curbuf + bufs) & (pipe->buffers-1);
 			struct pipe_buffer *buf = pipe->bufs + newbuf;
-			struct page *page = pipe->tmp_page;
+			struct page *page;
 			char *src;
 			int error, atomic = 1;
 
-			if (!page) {
-				page = alloc_page(GFP_HIGHUSER);
-				if (unlikely(!page)) {
-					ret = ret ? : -ENOMEM;
-					break;
-				}
-				pipe->tmp_page = page;
+			page = anon_pipe_get_page(pipe);
+			if (unlikely(!page)) {
+				ret = ret ? : -ENOMEM;
+				break;
 			}
 			/* Always wake up, even if the copy fails. Otherwise
 			 * we lock up (O_NONBLOCK-)readers that sleep due to
@@ -603,6 +643,7 @@ redo2:
 					atomic = 0;
 					goto redo2;
 				}
+				anon_pipe_put_page(pipe, page);
 				if (!ret)
 					ret = error;
 				break;
@@ -620,7 +661,6 @@ redo2:
 				buf->flags = PIPE_BUF_FLAG_PACKET;
 			}
 			pipe->nrbufs = ++bufs;
-			pipe->tmp_page = NULL;
 
 			total_len -= chars;
 			if (!total_len)
@@ -639,18 +679,21 @@ redo2:
 			break;
 		}
 		if (do_wakeup) {
-			wake_up_interruptible_sync_poll(&pipe->wait, POLLIN | POLLRDNORM);
+			if (was_empty || pipe->poll_usage)
+				wake_up_interruptible_sync_poll(&pipe->wait, POLLIN | POLLRDNORM);
 			kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
 			do_wakeup = 0;
 		}
 		pipe->waiting_writers++;
 		pipe_wait(pipe);
 		pipe->waiting_writers--;
+		was_empty = pipe->nrbufs == 0;
 	}
 out:
 	mutex_unlock(&inode->i_mutex);
 	if (do_wakeup) {
-		wake_up_interruptible_sync_poll(&pipe->wait, POLLIN | POLLRDNORM);
+		if (was_empty || pipe->poll_usage)
+			wake_up_interruptible_sync_poll(&pipe->wait, POLLIN | POLLRDNORM);
 		kill_fasync(&pipe->fasync_readers, SIGIO, POLL_IN);
 	}
 	if (ret > 0)
@@ -706,6 +749,7 @@ pipe_poll(struct file *filp, poll_table *wait)
 	int nrbufs;
 
 	poll_wait(filp, &pipe->wait, wait);
+	pipe->poll_usage = 1;
 
 	/* Reading only -- no need for acquiring the semaphore.  */
 	nrbufs = pipe->nrbufs;
@@ -949,8 +993,9 @@ void __free_pipe_info(struct pipe_inode_info *pipe)
 		if (buf->ops)
 			buf->ops->release(pipe, buf);
 	}
-	if (pipe->tmp_page)
-		__free_page(pipe->tmp_page);
+	for (i = 0; i < ARRAY_SIZE(pipe->tmp_page); i++)
+		if (pipe->tmp_page[i])
+			__free_page(pipe->tmp_page[i]);
 	kfree(pipe->bufs);
 	kfree(pipe);
 }
@@ -1154,7 +1199,7 @@ SYSCALL_DEFINE1(pipe, int __user *, fildes)
  * Allocate a new array of pipe buffers and copy the info over. Returns the
  * pipe size if successful, or return -ERROR on error.
  */
-static long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages)
+long pipe_set_size(struct pipe_inode_info *pipe, unsigned long nr_pages)
 {
 	struct pipe_buffer *bufs;
 
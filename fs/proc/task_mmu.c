@@ -400,10 +400,16 @@ static int smaps_pte_range(pmd_t *pmd, unsigned long addr, unsigned long end,
 			spin_unlock(&walk->mm->page_table_lock);
 			wait_split_huge_page(vma->anon_vma, pmd);
 		} else {
+			/* like the small zero page, it is not counted */
+			if (is_huge_zero_pmd(*pmd)) {
+				spin_unlock(&walk->mm->page_table_lock);
+				return 0;
+			}
 			smaps_pte_entry(*(pte_t *)pmd, addr,
 					HPAGE_PMD_SIZE, walk);
+			if (PageAnon(pmd_page(*pmd)))
+				mss->anonymous_thp += HPAGE_PMD_SIZE;
 			spin_unlock(&walk->mm->page_table_lock);
-			mss->anonymous_thp += HPAGE_PMD_SIZE;
 			return 0;
 		}
 	} else {
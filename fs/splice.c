@@ -1169,6 +1169,30 @@ long do_splice_to(struct file *in, loff_t *ppos,
 }
 EXPORT_SYMBOL(do_splice_to);
 
+/*
+ * Size the internal pipe to the transfer, so that a large sendfile() moves
+ * up to pipe_max_size per read/actor cycle (one pipe lock and one
+ * ->sendpage batch) instead of PIPE_DEF_BUFFERS pages at a time.  The pipe
+ * is empty here; if the allocation fails we just keep the old size.
+ */
+static void splice_direct_size_pipe(struct pipe_inode_info *pipe, size_t len)
+{
+	unsigned long nr_pages, max_pages;
+
+	max_pages = max_t(unsigned long, pipe_max_size >> PAGE_SHIFT,
+			  PIPE_DEF_BUFFERS);
+	max_pages = rounddown_pow_of_two(max_pages);
+
+	nr_pages = min_t(unsigned long, DIV_ROUND_UP(len, PAGE_SIZE) + 1,
+			 max_pages);
+	nr_pages = roundup_pow_of_two(nr_pages);
+	if (nr_pages > max_pages)
+		nr_pages = max_pages;
+
+	if (nr_pages > pipe->buffers)
+		pipe_set_size(pipe, nr_pages);
+}
+
 /**
  * splice_direct_to_actor - splices data directly between two non-pipes
  * @in:		file to splice from
@@ -1220,6 +1244,8 @@ ssize_t splice_direct_to_actor(struct file *in, struct splice_desc *sd,
 		current->splice_pipe = pipe;
 	}
 
+	splice_direct_size_pipe(pipe, sd->total_len);
+
 	/*
 	 * Do the splice.
 	 */
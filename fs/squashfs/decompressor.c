@@ -25,6 +25,11 @@
 #include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/buffer_head.h>
+#include <linux/cpumask.h>
+#include <linux/list.h>
+#include <linux/sched.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -36,6 +41,28 @@
  * Squashfs, allowing multiple decompressors to be easily supported
  */
 
+/*
+ * Each filesystem keeps a pool of decompressor streams, so that blocks can
+ * be decompressed in parallel.  Only one stream is allocated at mount time,
+ * further streams are allocated on demand up to squashfs_max_decompressors()
+ * and kept until umount.  The decompressors wait for buffer I/O, so a stream
+ * is owned by a task for the whole call rather than being per cpu.
+ */
+struct squashfs_stream {
+	void			*stream;
+	struct list_head	list;
+};
+
+struct squashfs_stream_pool {
+	spinlock_t		lock;
+	struct list_head	free;
+	int			avail;
+	int			max;
+	wait_queue_head_t	wait;
+	void			*comp_opts;
+	int			comp_opts_len;
+};
+
 static const struct squashfs_decompressor squashfs_lzma_unsupported_comp_ops = {
 	NULL, NULL, NULL, LZMA_COMPRESSION, "lzma", 0
 };
@@ -83,34 +110,179 @@ const struct squashfs_decompressor *squashfs_lookup_decompressor(int id)
 }
 
 
+int squashfs_max_decompressors(void)
+{
+	return num_online_cpus();
+}
+
+
+static struct squashfs_stream *alloc_stream(struct squashfs_sb_info *msblk,
+	struct squashfs_stream_pool *pool)
+{
+	struct squashfs_stream *s;
+
+	s = kmalloc(sizeof(*s), GFP_KERNEL);
+	if (s == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	s->stream = msblk->decompressor->init(msblk, pool->comp_opts,
+		pool->comp_opts_len);
+	if (IS_ERR(s->stream)) {
+		int err = PTR_ERR(s->stream);
+
+		kfree(s);
+		return ERR_PTR(err);
+	}
+
+	return s;
+}
+
+
+static void free_stream(struct squashfs_sb_info *msblk,
+	struct squashfs_stream *s)
+{
+	msblk->decompressor->free(s->stream);
+	kfree(s);
+}
+
+
+/*
+ * Get a free stream from the pool, allocating a new one if the pool has
+ * not grown to its limit yet, otherwise wait for one to be put back
+ */
+static struct squashfs_stream *get_stream(struct squashfs_sb_info *msblk,
+	struct squashfs_stream_pool *pool)
+{
+	struct squashfs_stream *s;
+
+	while (1) {
+		spin_lock(&pool->lock);
+		if (!list_empty(&pool->free)) {
+			s = list_entry(pool->free.next, struct squashfs_stream,
+				list);
+			list_del(&s->list);
+			spin_unlock(&pool->lock);
+			return s;
+		}
+
+		if (pool->avail < pool->max) {
+			pool->avail++;
+			spin_unlock(&pool->lock);
+
+			s = alloc_stream(msblk, pool);
+			if (!IS_ERR(s))
+				return s;
+
+			/* don't try to grow the pool again, use what we have */
+			spin_lock(&pool->lock);
+			pool->avail--;
+			pool->max = pool->avail;
+		}
+		spin_unlock(&pool->lock);
+
+		wait_event(pool->wait, !list_empty(&pool->free));
+	}
+}
+
+
+static void put_stream(struct squashfs_stream_pool *pool,
+	struct squashfs_stream *s)
+{
+	spin_lock(&pool->lock);
+	list_add(&s->list, &pool->free);
+	spin_unlock(&pool->lock);
+	wake_up(&pool->wait);
+}
+
+
+int squashfs_decompress(struct squashfs_sb_info *msblk, void **buffer,
+	struct buffer_head **bh, int b, int offset, int length, int srclength,
+	int pages)
+{
+	struct squashfs_stream_pool *pool = msblk->stream;
+	struct squashfs_stream *s = get_stream(msblk, pool);
+	int res;
+
+	res = msblk->decompressor->decompress(msblk, s->stream, buffer, bh, b,
+		offset, length, srclength, pages);
+	put_stream(pool, s);
+
+	return res;
+}
+
+
+void squashfs_decompressor_free(struct squashfs_sb_info *msblk, void *strm)
+{
+	struct squashfs_stream_pool *pool = strm;
+	struct squashfs_stream *s, *next;
+
+	if (pool == NULL)
+		return;
+
+	list_for_each_entry_safe(s, next, &pool->free, list)
+		free_stream(msblk, s);
+	kfree(pool->comp_opts);
+	kfree(pool);
+}
+
+
 void *squashfs_decompressor_init(struct super_block *sb, unsigned short flags)
 {
 	struct squashfs_sb_info *msblk = sb->s_fs_info;
-	void *strm, *buffer = NULL;
+	struct squashfs_stream_pool *pool;
+	struct squashfs_stream *s;
+	void *buffer = NULL;
 	int length = 0;
 
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (pool == NULL)
+		return ERR_PTR(-ENOMEM);
+
+	spin_lock_init(&pool->lock);
+	INIT_LIST_HEAD(&pool->free);
+	init_waitqueue_head(&pool->wait);
+	pool->max = squashfs_max_decompressors();
+
 	/*
 	 * Read decompressor specific options from file system if present
 	 */
 	if (SQUASHFS_COMP_OPTS(flags)) {
 		buffer = kmalloc(PAGE_CACHE_SIZE, GFP_KERNEL);
-		if (buffer == NULL)
-			return ERR_PTR(-ENOMEM);
+		if (buffer == NULL) {
+			s = ERR_PTR(-ENOMEM);
+			goto failed;
+		}
 
+		/*
+		 * The options are kept to initialise the streams added to
+		 * the pool later on
+		 */
 		length = squashfs_read_data(sb, &buffer,
 			sizeof(struct squashfs_super_block), 0, NULL,
 			PAGE_CACHE_SIZE, 1);
 
 		if (length < 0) {
-			strm = ERR_PTR(length);
-			goto finished;
+			s = ERR_PTR(length);
+			goto failed;
 		}
+
+		pool->comp_opts = buffer;
+		pool->comp_opts_len = length;
 	}
 
-	strm = msblk->decompressor->init(msblk, buffer, length);
+	/* the first stream also validates the compression options */
+	s = alloc_stream(msblk, pool);
+	if (IS_ERR(s))
+		goto failed;
+
+	list_add(&s->list, &pool->free);
+	pool->avail = 1;
+
+	return pool;
 
-finished:
+failed:
 	kfree(buffer);
+	kfree(pool);
 
-	return strm;
+	return s;
 }
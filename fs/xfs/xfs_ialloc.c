@@ -38,6 +38,9 @@
 #include "xfs_bmap.h"
 
 
+STATIC int __xfs_read_agi(struct xfs_mount *mp, struct xfs_trans *tp,
+			  xfs_agnumber_t agno, int flags, struct xfs_buf **bpp);
+
 /*
  * Allocation group level functions.
  */
@@ -439,6 +442,23 @@ xfs_ialloc_next_ag(
 	return agno;
 }
 
+/*
+ * Read and lock the agi of an AG whose per-ag data is already initialised.
+ * On the first, trylock pass of xfs_ialloc_ag_select() we don't wait for an
+ * agi somebody else holds: *agbpp is set to NULL and zero returned instead.
+ */
+STATIC int
+xfs_ialloc_trylock_agi(
+	xfs_trans_t	*tp,		/* transaction pointer */
+	xfs_agnumber_t	agno,		/* allocation group number */
+	int		flags,		/* XFS_ALLOC_FLAG_TRYLOCK or zero */
+	xfs_buf_t	**agbpp)	/* allocation group header buffer */
+{
+	if (!(flags & XFS_ALLOC_FLAG_TRYLOCK))
+		return xfs_ialloc_read_agi(tp->t_mountp, tp, agno, agbpp);
+	return __xfs_read_agi(tp->t_mountp, tp, agno, XBF_TRYLOCK, agbpp);
+}
+
 /*
  * Select an allocation group to look for a free inode in, based on the parent
  * inode and then mode.  Return the allocation group buffer.
@@ -521,10 +541,30 @@ xfs_ialloc_ag_select(
 			     longest >= ineed &&
 			     okalloc)) {
 				if (agbp == NULL &&
-				    xfs_ialloc_read_agi(mp, tp, agno, &agbp)) {
+				    xfs_ialloc_trylock_agi(tp, agno, flags,
+							   &agbp)) {
 					agbp = NULL;
 					goto nextag;
 				}
+				if (agbp == NULL) {
+					/*
+					 * Somebody else is allocating inodes
+					 * in this AG.  Rather than queue on
+					 * the AGI lock, move on; if this was
+					 * the first AG we tried, continue
+					 * from one picked by the CPU we are
+					 * running on so that concurrent
+					 * creators fan out across the AGs
+					 * instead of convoying onto the
+					 * next one.
+					 */
+					if (agno == pagno && agcount > 1)
+						agno = (pagno +
+							raw_smp_processor_id() %
+							(agcount - 1)) %
+							agcount;
+					goto nextag;
+				}
 				xfs_perag_put(pag);
 				return agbp;
 			}
@@ -1467,13 +1507,15 @@ xfs_check_agi_unlinked(
 #endif
 
 /*
- * Read in the allocation group header (inode allocation section)
+ * Read in the agi.  With XBF_TRYLOCK in @flags, *bpp is set to NULL and zero
+ * returned if somebody else holds the buffer locked.
  */
-int
-xfs_read_agi(
+STATIC int
+__xfs_read_agi(
 	struct xfs_mount	*mp,	/* file system mount structure */
 	struct xfs_trans	*tp,	/* transaction pointer */
 	xfs_agnumber_t		agno,	/* allocation group number */
+	int			flags,	/* XBF_ flags */
 	struct xfs_buf		**bpp)	/* allocation group hdr buf */
 {
 	struct xfs_agi		*agi;	/* allocation group header */
@@ -1484,9 +1526,11 @@ xfs_read_agi(
 
 	error = xfs_trans_read_buf(mp, tp, mp->m_ddev_targp,
 			XFS_AG_DADDR(mp, agno, XFS_AGI_DADDR(mp)),
-			XFS_FSS_TO_BB(mp, 1), 0, bpp);
+			XFS_FSS_TO_BB(mp, 1), flags, bpp);
 	if (error)
 		return error;
+	if (!*bpp)
+		return 0;
 
 	ASSERT(!xfs_buf_geterror(*bpp));
 	agi = XFS_BUF_TO_AGI(*bpp);
@@ -1511,6 +1555,19 @@ xfs_read_agi(
 	return 0;
 }
 
+/*
+ * Read in the allocation group header (inode allocation section)
+ */
+int
+xfs_read_agi(
+	struct xfs_mount	*mp,	/* file system mount structure */
+	struct xfs_trans	*tp,	/* transaction pointer */
+	xfs_agnumber_t		agno,	/* allocation group number */
+	struct xfs_buf		**bpp)	/* allocation group hdr buf */
+{
+	return __xfs_read_agi(mp, tp, agno, 0, bpp);
+}
+
 int
 xfs_ialloc_read_agi(
 	struct xfs_mount	*mp,	/* file system mount structure */
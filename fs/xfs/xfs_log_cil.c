@@ -43,6 +43,7 @@ xlog_cil_init(
 {
 	struct xfs_cil	*cil;
 	struct xfs_cil_ctx *ctx;
+	int		cpu;
 
 	log->l_cilp = NULL;
 	if (!(log->l_mp->m_flags & XFS_MOUNT_DELAYLOG))
@@ -58,6 +59,15 @@ xlog_cil_init(
 		return ENOMEM;
 	}
 
+	cil->xc_pcp_cil = alloc_percpu(struct list_head);
+	if (!cil->xc_pcp_cil) {
+		kmem_free(ctx);
+		kmem_free(cil);
+		return ENOMEM;
+	}
+	for_each_possible_cpu(cpu)
+		INIT_LIST_HEAD(per_cpu_ptr(cil->xc_pcp_cil, cpu));
+
 	INIT_LIST_HEAD(&cil->xc_cil);
 	INIT_LIST_HEAD(&cil->xc_committing);
 	spin_lock_init(&cil->xc_cil_lock);
@@ -80,6 +90,8 @@ void
 xlog_cil_destroy(
 	struct log	*log)
 {
+	int		cpu;
+
 	if (!log->l_cilp)
 		return;
 
@@ -90,6 +102,9 @@ xlog_cil_destroy(
 	}
 
 	ASSERT(list_empty(&log->l_cilp->xc_cil));
+	for_each_possible_cpu(cpu)
+		ASSERT(list_empty(per_cpu_ptr(log->l_cilp->xc_pcp_cil, cpu)));
+	free_percpu(log->l_cilp->xc_pcp_cil);
 	kmem_free(log->l_cilp);
 }
 
@@ -268,9 +283,12 @@ xlog_cil_insert_items(
 	struct xfs_cil		*cil = log->l_cilp;
 	struct xfs_cil_ctx	*ctx = cil->xc_ctx;
 	struct xfs_log_vec	*lv;
+	struct list_head	*pcp_cil;
 	int			len = 0;
 	int			diff_iovecs = 0;
 	int			iclog_space;
+	int			nr_lv = 0;
+	int			order;
 
 	ASSERT(log_vector);
 
@@ -289,17 +307,32 @@ xlog_cil_insert_items(
 	 * We can do this safely because the context can't checkpoint until we
 	 * are done so it doesn't matter exactly how we update the CIL.
 	 */
-	for (lv = log_vector; lv; lv = lv->lv_next)
+	for (lv = log_vector; lv; lv = lv->lv_next) {
 		xfs_cil_prepare_item(log, lv, &len, &diff_iovecs);
+		nr_lv++;
+	}
 
 	/* account for space used by new iovec headers  */
 	len += diff_iovecs * sizeof(xlog_op_header_t);
 
-	spin_lock(&cil->xc_cil_lock);
+	/*
+	 * Rather than moving the items to the tail of a shared CIL list, stamp
+	 * them with their commit order and put the ones new to the CIL on this
+	 * CPU's list. Items already in the CIL stay on whatever list they are
+	 * on; xlog_cil_push() sorts everything back into commit order. The
+	 * items are locked by this transaction, so nobody else can be
+	 * inserting them concurrently.
+	 */
+	order = atomic_add_return(nr_lv, &ctx->order_id) - nr_lv;
+	pcp_cil = get_cpu_ptr(cil->xc_pcp_cil);
+	for (lv = log_vector; lv; lv = lv->lv_next) {
+		lv->lv_item->li_order_id = ++order;
+		if (list_empty(&lv->lv_item->li_cil))
+			list_add_tail(&lv->lv_item->li_cil, pcp_cil);
+	}
+	put_cpu_ptr(cil->xc_pcp_cil);
 
-	/* move the items to the tail of the CIL */
-	for (lv = log_vector; lv; lv = lv->lv_next)
-		list_move_tail(&lv->lv_item->li_cil, &cil->xc_cil);
+	spin_lock(&cil->xc_cil_lock);
 
 	ctx->nvecs += diff_iovecs;
 
@@ -387,6 +420,37 @@ xlog_cil_committed(
 	kmem_free(ctx);
 }
 
+/*
+ * list_sort() callback putting CIL items back into commit order.
+ */
+static int
+xlog_cil_order_cmp(
+	void			*priv,
+	struct list_head	*a,
+	struct list_head	*b)
+{
+	struct xfs_log_item	*l1 = container_of(a, struct xfs_log_item, li_cil);
+	struct xfs_log_item	*l2 = container_of(b, struct xfs_log_item, li_cil);
+
+	return l1->li_order_id - l2->li_order_id;
+}
+
+/*
+ * Gather the per-cpu CIL lists onto xc_cil in commit order. Must be called
+ * with the context lock held exclusively so no commits can race with us.
+ */
+static void
+xlog_cil_pcp_aggregate(
+	struct xfs_cil		*cil)
+{
+	int			cpu;
+
+	for_each_possible_cpu(cpu)
+		list_splice_tail_init(per_cpu_ptr(cil->xc_pcp_cil, cpu),
+				      &cil->xc_cil);
+	list_sort(NULL, &cil->xc_cil, xlog_cil_order_cmp);
+}
+
 /*
  * Push the Committed Item List to the log. If @push_seq flag is zero, then it
  * is a background flush and so we can chose to ignore it. Otherwise, if the
@@ -443,10 +507,6 @@ xlog_cil_push(
 	}
 	ctx = cil->xc_ctx;
 
-	/* check if we've anything to push */
-	if (list_empty(&cil->xc_cil))
-		goto out_skip;
-
 	/* check for spurious background flush */
 	if (!push_seq && cil->xc_ctx->space_used < XLOG_CIL_SPACE_LIMIT(log))
 		goto out_skip;
@@ -455,6 +515,11 @@ xlog_cil_push(
 	if (push_seq && push_seq < cil->xc_ctx->sequence)
 		goto out_skip;
 
+	/* check if we've anything to push */
+	xlog_cil_pcp_aggregate(cil);
+	if (list_empty(&cil->xc_cil))
+		goto out_skip;
+
 	/*
 	 * pull all the log vectors off the items in the CIL, and
 	 * remove the items from the CIL. We don't need the CIL lock
@@ -386,6 +386,7 @@ struct xfs_cil_ctx {
 	struct xlog_ticket	*ticket;	/* chkpt ticket */
 	int			nvecs;		/* number of regions */
 	int			space_used;	/* aggregate size of regions */
+	atomic_t		order_id;	/* item commit order */
 	struct list_head	busy_extents;	/* busy extents in chkpt */
 	struct xfs_log_vec	*lv_chain;	/* logvecs being pushed */
 	xfs_log_callback_t	log_cb;		/* completion callback hook. */
@@ -407,10 +408,16 @@ struct xfs_cil_ctx {
  * checkpoint is still in the process of committing, we can block waiting for
  * the commit LSN to be determined as well. This should make synchronous
  * operations almost as efficient as the old logging methods.
+ *
+ * Transaction commits add newly logged items to a per-cpu list so that
+ * concurrent committers don't all contend on the same list head. The push
+ * splices the per-cpu lists onto xc_cil and sorts them back into commit
+ * order using li_order_id.
  */
 struct xfs_cil {
 	struct log		*xc_log;
 	struct list_head	xc_cil;
+	struct list_head __percpu *xc_pcp_cil;
 	spinlock_t		xc_cil_lock;
 	struct xfs_cil_ctx	*xc_ctx;
 	struct rw_semaphore	xc_ctx_lock;
@@ -95,9 +95,12 @@ struct mmu_gather {
 	struct mmu_table_batch	*batch;
 #endif
 	unsigned int		need_flush : 1,	/* Did free PTEs */
-				fast_mode  : 1; /* No batching   */
+				fast_mode  : 1, /* No batching   */
+				need_flush_all : 1; /* Range below incomplete */
 
 	unsigned int		fullmm;
+	/* user addresses unmapped since the last flush, for tlb_flush() */
+	unsigned long		start, end;
 
 	struct mmu_gather_batch *active;
 	struct mmu_gather_batch	local;
@@ -120,6 +123,20 @@ static inline int tlb_fast_mode(struct mmu_gather *tlb)
 #endif
 }
 
+static inline void __tlb_reset_range(struct mmu_gather *tlb)
+{
+	tlb->need_flush_all = 0;
+	tlb->start = ~0UL;
+	tlb->end = 0;
+}
+
+static inline void __tlb_adjust_range(struct mmu_gather *tlb,
+				      unsigned long address)
+{
+	tlb->start = min(tlb->start, address);
+	tlb->end = max(tlb->end, address + PAGE_SIZE);
+}
+
 void tlb_gather_mmu(struct mmu_gather *tlb, struct mm_struct *mm, bool fullmm);
 void tlb_flush_mmu(struct mmu_gather *tlb);
 void tlb_finish_mmu(struct mmu_gather *tlb, unsigned long start, unsigned long end);
@@ -145,12 +162,18 @@ static inline void tlb_remove_page(struct mmu_gather *tlb, struct page *page)
 #define tlb_remove_tlb_entry(tlb, ptep, address)		\
 	do {							\
 		tlb->need_flush = 1;				\
+		__tlb_adjust_range(tlb, address);		\
 		__tlb_remove_tlb_entry(tlb, ptep, address);	\
 	} while (0)
 
+/*
+ * Freed page tables may still be cached by other cpus, so they need a
+ * full flush rather than one of the unmapped range.
+ */
 #define pte_free_tlb(tlb, ptep, address)			\
 	do {							\
 		tlb->need_flush = 1;				\
+		tlb->need_flush_all = 1;			\
 		__pte_free_tlb(tlb, ptep, address);		\
 	} while (0)
 
@@ -158,6 +181,7 @@ static inline void tlb_remove_page(struct mmu_gather *tlb, struct page *page)
 #define pud_free_tlb(tlb, pudp, address)			\
 	do {							\
 		tlb->need_flush = 1;				\
+		tlb->need_flush_all = 1;			\
 		__pud_free_tlb(tlb, pudp, address);		\
 	} while (0)
 #endif
@@ -165,6 +189,7 @@ static inline void tlb_remove_page(struct mmu_gather *tlb, struct page *page)
 #define pmd_free_tlb(tlb, pmdp, address)			\
 	do {							\
 		tlb->need_flush = 1;				\
+		tlb->need_flush_all = 1;			\
 		__pmd_free_tlb(tlb, pmdp, address);		\
 	} while (0)
 
@@ -73,6 +73,21 @@ struct crypto_queue {
 	unsigned int max_qlen;
 };
 
+#define CRYPTO_BATCH_MAX	32
+
+/*
+ * A batch of requests taken off a crypto_queue in one go.  Requests that
+ * moved from the backlog into the queue proper while the batch was taken
+ * are collected in @backlog; their owners are told -EINPROGRESS by
+ * crypto_batch_notify_backlog() outside the queue lock.
+ */
+struct crypto_batch {
+	struct list_head reqs;
+	unsigned int nr;
+	unsigned int nr_backlog;
+	struct crypto_async_request *backlog[CRYPTO_BATCH_MAX];
+};
+
 struct scatter_walk {
 	struct scatterlist *sg;
 	unsigned int offset;
@@ -177,6 +192,11 @@ int crypto_enqueue_request(struct crypto_queue *queue,
 void *__crypto_dequeue_request(struct crypto_queue *queue, unsigned int offset);
 struct crypto_async_request *crypto_dequeue_request(struct crypto_queue *queue);
 int crypto_tfm_in_queue(struct crypto_queue *queue, struct crypto_tfm *tfm);
+unsigned int crypto_dequeue_batch(struct crypto_queue *queue,
+				  struct crypto_batch *batch,
+				  unsigned int max);
+void crypto_batch_notify_backlog(struct crypto_batch *batch);
+void crypto_batch_complete(struct crypto_batch *batch, int err);
 
 /* These functions require the input/output to be aligned as u32. */
 void crypto_inc(u8 *a, unsigned int size);
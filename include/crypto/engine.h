@@ -0,0 +1,50 @@
+/*
+ * Batching request engine for crypto offload drivers.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#ifndef _CRYPTO_ENGINE_H
+#define _CRYPTO_ENGINE_H
+
+#include <crypto/algapi.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+/*
+ * An engine owns the request queue of one accelerator.  Requests are
+ * queued with crypto_engine_enqueue(); a worker hands them to the driver
+ * up to @max_batch at a time through ->run_batch.  The driver either
+ * processes the batch synchronously and returns its status, or returns
+ * -EINPROGRESS and later calls crypto_engine_finalize() from its
+ * completion path.  Only one batch is in flight per engine.
+ */
+struct crypto_engine {
+	const char *name;
+	spinlock_t lock;
+	struct crypto_queue queue;
+	struct work_struct work;
+	unsigned int max_batch;
+	bool busy;
+
+	struct crypto_batch cur;
+
+	int (*run_batch)(struct crypto_engine *engine,
+			 struct crypto_batch *batch);
+	void *priv;
+};
+
+void crypto_engine_init(struct crypto_engine *engine, const char *name,
+			unsigned int max_qlen, unsigned int max_batch,
+			int (*run_batch)(struct crypto_engine *engine,
+					 struct crypto_batch *batch));
+void crypto_engine_exit(struct crypto_engine *engine);
+int crypto_engine_enqueue(struct crypto_engine *engine,
+			  struct crypto_async_request *req);
+void crypto_engine_finalize(struct crypto_engine *engine, int err);
+
+#endif	/* _CRYPTO_ENGINE_H */
@@ -319,7 +319,12 @@ struct drm_mode_crtc_lut {
 };
 
 #define DRM_MODE_PAGE_FLIP_EVENT 0x01
-#define DRM_MODE_PAGE_FLIP_FLAGS DRM_MODE_PAGE_FLIP_EVENT
+#define DRM_MODE_PAGE_FLIP_TARGET_ABSOLUTE 0x4
+#define DRM_MODE_PAGE_FLIP_TARGET_RELATIVE 0x8
+#define DRM_MODE_PAGE_FLIP_TARGET (DRM_MODE_PAGE_FLIP_TARGET_ABSOLUTE | \
+				   DRM_MODE_PAGE_FLIP_TARGET_RELATIVE)
+#define DRM_MODE_PAGE_FLIP_FLAGS (DRM_MODE_PAGE_FLIP_EVENT | \
+				  DRM_MODE_PAGE_FLIP_TARGET)
 
 /*
  * Request a page flip on the specified crtc.
@@ -339,8 +344,12 @@ struct drm_mode_crtc_lut {
  * passed in with this ioctl will be returned as the user_data field
  * in the vblank event struct.
  *
- * The reserved field must be zero until we figure out something
- * clever to use it for.
+ * With DRM_MODE_PAGE_FLIP_TARGET_ABSOLUTE the reserved field holds the
+ * vblank count at which the new fb should first be displayed, with
+ * DRM_MODE_PAGE_FLIP_TARGET_RELATIVE the number of vblanks from now.
+ * The ioctl then waits until the vblank before the target, so that the
+ * flip completes on it; a target that is not in the future is rejected
+ * with EINVAL.  Without either flag the reserved field must be zero.
  */
 
 struct drm_mode_crtc_page_flip {
@@ -6,6 +6,7 @@
 #include <linux/aio_abi.h>
 #include <linux/uio.h>
 #include <linux/rcupdate.h>
+#include <linux/mutex.h>
 
 #include <linux/atomic.h>
 
@@ -34,6 +35,8 @@ struct kioctx;
 /* #define KIF_LOCKED		0 */
 #define KIF_KICKED		1
 #define KIF_CANCELLED		2
+#define KIF_NOWAIT		3	/* don't punt buffered io, fail it */
+#define KIF_PUNTED		4	/* buffered io running in a worker */
 
 #define kiocbTryLock(iocb)	test_and_set_bit(KIF_LOCKED, &(iocb)->ki_flags)
 #define kiocbTryKick(iocb)	test_and_set_bit(KIF_KICKED, &(iocb)->ki_flags)
@@ -41,6 +44,8 @@ struct kioctx;
 #define kiocbSetLocked(iocb)	set_bit(KIF_LOCKED, &(iocb)->ki_flags)
 #define kiocbSetKicked(iocb)	set_bit(KIF_KICKED, &(iocb)->ki_flags)
 #define kiocbSetCancelled(iocb)	set_bit(KIF_CANCELLED, &(iocb)->ki_flags)
+#define kiocbSetNowait(iocb)	set_bit(KIF_NOWAIT, &(iocb)->ki_flags)
+#define kiocbSetPunted(iocb)	set_bit(KIF_PUNTED, &(iocb)->ki_flags)
 
 #define kiocbClearLocked(iocb)	clear_bit(KIF_LOCKED, &(iocb)->ki_flags)
 #define kiocbClearKicked(iocb)	clear_bit(KIF_KICKED, &(iocb)->ki_flags)
@@ -49,6 +54,8 @@ struct kioctx;
 #define kiocbIsLocked(iocb)	test_bit(KIF_LOCKED, &(iocb)->ki_flags)
 #define kiocbIsKicked(iocb)	test_bit(KIF_KICKED, &(iocb)->ki_flags)
 #define kiocbIsCancelled(iocb)	test_bit(KIF_CANCELLED, &(iocb)->ki_flags)
+#define kiocbIsNowait(iocb)	test_bit(KIF_NOWAIT, &(iocb)->ki_flags)
+#define kiocbIsPunted(iocb)	test_bit(KIF_PUNTED, &(iocb)->ki_flags)
 
 /* is there a better place to document function pointer methods? */
 /**
@@ -118,6 +125,7 @@ struct kiocb {
 	struct list_head	ki_list;	/* the aio core uses this
 						 * for cancellation */
 	struct list_head	ki_batch;	/* batch allocation */
+	struct work_struct	ki_work;	/* punted buffered io */
 
 	/*
 	 * If the aio_resfd field of the userspace iocb is not zero,
@@ -201,6 +209,21 @@ struct kioctx {
 
 	struct delayed_work	wq;
 
+	/* optional submission ring and fixed files, see io_setup2() */
+	struct aio_sq_ring	*sq_ring;	/* vmap of the ring pages */
+	unsigned long		sq_user;	/* user address of sq_ring */
+	unsigned		sq_nr;		/* trusted copies */
+	unsigned		sq_head;
+	int			sq_compat;
+	struct mutex		sq_lock;	/* one consumer at a time */
+	struct task_struct	*sq_thread;
+	wait_queue_head_t	sq_wait;
+	unsigned long		sq_idle;	/* jiffies */
+	const struct cred	*sq_creds;
+
+	struct file		**files;
+	unsigned		nr_files;
+
 	struct rcu_head		rcu_head;
 };
 
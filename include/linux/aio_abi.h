@@ -51,8 +51,15 @@ enum {
  *
  * IOCB_FLAG_RESFD - Set if the "aio_resfd" member of the "struct iocb"
  *                   is valid.
+ * IOCB_FLAG_NOWAIT - Fail buffered reads that miss the page cache with
+ *                    -EAGAIN, and buffered writes with -EOPNOTSUPP, rather
+ *                    than handing them to a worker thread.
+ * IOCB_FLAG_FIXED_FILE - "aio_fildes" is an index into the files
+ *                        registered with io_setup2(), not an fd.
  */
 #define IOCB_FLAG_RESFD		(1 << 0)
+#define IOCB_FLAG_NOWAIT	(1 << 1)
+#define IOCB_FLAG_FIXED_FILE	(1 << 2)
 
 /* read() from /dev/aio returns these structures. */
 struct io_event {
@@ -104,6 +111,47 @@ struct iocb {
 	__u32	aio_resfd;
 }; /* 64 bytes */
 
+/*
+ * io_setup2() flags.
+ *
+ * IOCTX_FLAG_SQRING - Map a submission ring (struct aio_sq_ring) at
+ *                     sq_offset bytes from the context id.  Userspace
+ *                     fills iocbs[tail % nr] and advances tail, then
+ *                     calls io_submit(ctx, 0, NULL) to submit them all.
+ * IOCTX_FLAG_SQPOLL - Also start a kernel thread that polls the ring, so
+ *                     no syscall is needed while it is awake.  When it
+ *                     goes idle it sets AIO_SQ_NEED_WAKEUP, and
+ *                     io_submit(ctx, 0, NULL) wakes it up again.  Only
+ *                     IOCB_FLAG_FIXED_FILE iocbs are accepted.
+ *
+ * Completions are reaped from the mmap'ed struct aio_ring as usual, by
+ * advancing its head from userspace or with io_getevents().
+ */
+#define IOCTX_FLAG_SQRING	(1 << 0)
+#define IOCTX_FLAG_SQPOLL	(1 << 1)
+
+#define AIO_SQ_NEED_WAKEUP	(1 << 0)
+
+struct aio_sq_ring {
+	__u32	head;		/* next slot the kernel consumes */
+	__u32	tail;		/* next slot userspace fills */
+	__u32	nr;		/* number of slots, a power of two */
+	__u32	flags;		/* AIO_SQ_* */
+	__u32	dropped;	/* invalid iocbs skipped */
+	__u32	resv[3];
+	struct iocb	iocbs[0];
+};
+
+struct aio_setup_params {
+	__u32	flags;		/* IOCTX_FLAG_* */
+	__u32	sq_entries;	/* in: wanted, out: actual ring size */
+	__u32	sq_thread_idle;	/* ms the poll thread spins before sleeping */
+	__u32	nr_files;	/* number of fds in files */
+	__u64	files;		/* __s32 fds to register, or 0 */
+	__u64	sq_offset;	/* out: aio_sq_ring offset from the ctx id */
+	__u64	resv[2];
+};
+
 #undef IFBIG
 #undef IFLITTLE
 
@@ -42,11 +42,16 @@ enum bdi_stat_item {
 	BDI_WRITEBACK,
 	BDI_DIRTIED,
 	BDI_WRITTEN,
+	BDI_RA_HIT,
+	BDI_RA_MISS,
+	BDI_RA_PAGES,
 	NR_BDI_STAT_ITEMS
 };
 
 #define BDI_STAT_BATCH (8*(1+ilog2(nr_cpu_ids)))
 
+#define RA_AUTO_SCALE	16	/* max ra_auto_pages, in units of ra_pages */
+
 struct bdi_writeback {
 	struct backing_dev_info *bdi;	/* our parent bdi */
 	unsigned int nr;
@@ -80,6 +85,16 @@ struct backing_dev_info {
 	unsigned long write_bandwidth;	/* the estimated write bandwidth */
 	unsigned long avg_write_bandwidth; /* further smoothed write bw */
 
+	/*
+	 * Read side estimates, fed by readers waiting on synchronous
+	 * readahead.  @ra_auto_pages is the window that covers about four
+	 * request latencies at the measured bandwidth; it may raise the
+	 * readahead limit above @ra_pages, up to RA_AUTO_SCALE times.
+	 */
+	unsigned long ra_latency;	/* avg small read latency, in us */
+	unsigned long ra_bandwidth;	/* avg streaming read bw, pages/s */
+	unsigned long ra_auto_pages;	/* auto-tuned max readahead */
+
 	/*
 	 * The base dirty throttle rate, re-calculated on every 200ms.
 	 * All the bdi tasks' dirty rate will be curbed under it.
@@ -126,6 +141,8 @@ int bdi_has_dirty_io(struct backing_dev_info *bdi);
 void bdi_arm_supers_timer(void);
 void bdi_wakeup_thread_delayed(struct backing_dev_info *bdi);
 void bdi_lock_two(struct bdi_writeback *wb1, struct bdi_writeback *wb2);
+void bdi_update_read_bandwidth(struct backing_dev_info *bdi,
+				unsigned long nr_pages, s64 wait_us);
 
 extern spinlock_t bdi_lock;
 extern struct list_head bdi_list;
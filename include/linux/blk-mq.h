@@ -0,0 +1,145 @@
+#ifndef BLK_MQ_H
+#define BLK_MQ_H
+
+#include <linux/blkdev.h>
+
+struct blk_mq_ctx;
+
+/*
+ * One hardware submission queue.  Requests come in from the software
+ * queues (struct blk_mq_ctx) of the cpus mapped to it, and each carries
+ * one of the hardware queue's tags.
+ */
+struct blk_mq_hw_ctx {
+	struct {
+		spinlock_t		lock;	/* protects dispatch */
+		struct list_head	dispatch;
+	} ____cacheline_aligned_in_smp;
+
+	unsigned long		state;		/* BLK_MQ_S_* flags */
+	struct delayed_work	run_work;
+	cpumask_var_t		cpumask;
+
+	struct request_queue	*queue;
+	void			*driver_data;
+
+	/* software queues mapped here, and which of them have requests */
+	unsigned int		nr_ctx;
+	struct blk_mq_ctx	**ctxs;
+	unsigned long		*ctx_map;
+
+	/* preallocated requests, indexed by tag */
+	unsigned int		queue_depth;
+	struct request		**rqs;
+	unsigned long		*tag_map;
+	wait_queue_head_t	tag_wait;
+
+	/* flushes the device can't combine with a data transfer */
+	spinlock_t		flush_lock;
+	struct list_head	flush_pending;
+	struct list_head	flush_running;
+	struct request		*flush_rq;
+	bool			flush_busy;
+
+	unsigned int		queue_num;
+
+	unsigned long		queued;
+	unsigned long		run;
+#define BLK_MQ_MAX_DISPATCH_ORDER	10
+	unsigned long		dispatched[BLK_MQ_MAX_DISPATCH_ORDER];
+};
+
+typedef int (queue_rq_fn)(struct blk_mq_hw_ctx *, struct request *);
+typedef void (commit_rqs_fn)(struct blk_mq_hw_ctx *);
+typedef int (init_hctx_fn)(struct blk_mq_hw_ctx *, void *, unsigned int);
+typedef void (exit_hctx_fn)(struct blk_mq_hw_ctx *, unsigned int);
+typedef int (init_request_fn)(void *, struct request *, unsigned int);
+typedef int (poll_fn)(struct blk_mq_hw_ctx *);
+
+struct blk_mq_ops {
+	/*
+	 * Hand a request to the hardware.  Called in process context with
+	 * preemption enabled, but must not sleep.  Only one caller at a time
+	 * per hardware queue.  A driver returning BLK_MQ_RQ_QUEUE_BUSY must
+	 * stop the hardware queue and restart it once it can take requests
+	 * again.
+	 */
+	queue_rq_fn		*queue_rq;
+
+	/*
+	 * Optional, called after a batch of ->queue_rq() calls that queued
+	 * at least one request, e.g. to ring the doorbell once per batch.
+	 */
+	commit_rqs_fn		*commit_rqs;
+
+	/* Optional, set up and tear down hctx->driver_data */
+	init_hctx_fn		*init_hctx;
+	exit_hctx_fn		*exit_hctx;
+
+	/*
+	 * Optional, set up the command data of each preallocated request
+	 * once, with the driver_data given to blk_mq_init_queue() and the
+	 * hardware queue index.
+	 */
+	init_request_fn		*init_request;
+
+	/*
+	 * Optional, complete whatever the hardware queue has finished
+	 * without waiting for the interrupt and return how many requests
+	 * that was.  Called from process context, see blk_poll().
+	 */
+	poll_fn			*poll;
+};
+
+struct blk_mq_reg {
+	struct blk_mq_ops	*ops;
+	unsigned int		nr_hw_queues;
+	unsigned int		queue_depth;	/* tags per hardware queue */
+	unsigned int		cmd_size;	/* driver data behind each request */
+	int			numa_node;
+};
+
+enum {
+	BLK_MQ_RQ_QUEUE_OK	= 0,	/* queued fine */
+	BLK_MQ_RQ_QUEUE_BUSY	= 1,	/* requeue IO for later */
+	BLK_MQ_RQ_QUEUE_ERROR	= 2,	/* end IO with error */
+
+	BLK_MQ_S_STOPPED	= 0,
+	BLK_MQ_S_RUNNING	= 1,
+
+	BLK_MQ_MAX_DEPTH	= 2048,
+};
+
+struct request_queue *blk_mq_init_queue(struct blk_mq_reg *, void *);
+
+struct blk_mq_hw_ctx *blk_mq_map_queue(struct request_queue *, const int cpu);
+
+struct request *blk_mq_alloc_request(struct request_queue *, int rw, gfp_t);
+void blk_mq_free_request(struct request *);
+void blk_mq_insert_request(struct request *, bool at_head, bool run_queue,
+			   bool async);
+void blk_mq_end_io(struct request *, int error);
+
+void blk_mq_run_hw_queue(struct blk_mq_hw_ctx *, bool async);
+void blk_mq_run_queues(struct request_queue *, bool async);
+void blk_mq_stop_hw_queue(struct blk_mq_hw_ctx *);
+void blk_mq_start_stopped_hw_queues(struct request_queue *, bool async);
+
+/*
+ * Driver command data area, cmd_size bytes right behind the request.
+ */
+static inline void *blk_mq_rq_to_pdu(struct request *rq)
+{
+	return (void *) (rq + 1);
+}
+
+static inline struct request *blk_mq_rq_from_pdu(void *pdu)
+{
+	return pdu - sizeof(struct request);
+}
+
+#define queue_for_each_hw_ctx(q, hctx, i)				\
+	for ((i) = 0; (i) < (q)->nr_hw_queues &&			\
+	     ({ hctx = (q)->queue_hw_ctx[i]; 1; }); (i)++)
+
+#endif
@@ -265,8 +265,10 @@ struct css_set {
 
 	/*
 	 * List running through all tasks using this cgroup
-	 * group. Protected by css_set_lock
+	 * group. Protected by tasks_lock; moving a task to
+	 * another css_set also takes css_set_lock
 	 */
+	spinlock_t tasks_lock;
 	struct list_head tasks;
 
 	/*
@@ -26,6 +26,7 @@ typedef __compat_uid32_t	compat_uid_t;
 typedef __compat_gid32_t	compat_gid_t;
 
 struct compat_sel_arg_struct;
+struct aio_setup_params;
 struct rusage;
 
 struct compat_itimerspec {
@@ -399,6 +400,9 @@ asmlinkage long compat_sys_fcntl64(unsigned int fd, unsigned int cmd,
 asmlinkage long compat_sys_fcntl(unsigned int fd, unsigned int cmd,
 				 unsigned long arg);
 asmlinkage long compat_sys_io_setup(unsigned nr_reqs, u32 __user *ctx32p);
+asmlinkage long compat_sys_io_setup2(unsigned nr_reqs,
+				     struct aio_setup_params __user *params,
+				     u32 __user *ctx32p);
 asmlinkage long compat_sys_io_getevents(aio_context_t ctx_id,
 					unsigned long min_nr,
 					unsigned long nr,
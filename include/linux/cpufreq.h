@@ -104,6 +104,13 @@ struct cpufreq_policy {
 	struct work_struct	update; /* if update_policy() needs to be
 					 * called, but you're in IRQ context */
 
+	/*
+	 * Set by the driver if ->fast_switch() can be used for this policy
+	 * from any cpu in ->cpus, set by the governor while it uses it.
+	 */
+	bool			fast_switch_possible;
+	bool			fast_switch_enabled;
+
 	struct cpufreq_real_policy	user_policy;
 
 	struct kobject		kobj;
@@ -198,6 +205,11 @@ extern int __cpufreq_driver_target(struct cpufreq_policy *policy,
 extern int __cpufreq_driver_getavg(struct cpufreq_policy *policy,
 				   unsigned int cpu);
 
+extern void cpufreq_enable_fast_switch(struct cpufreq_policy *policy);
+extern void cpufreq_disable_fast_switch(struct cpufreq_policy *policy);
+extern unsigned int cpufreq_driver_fast_switch(struct cpufreq_policy *policy,
+					       unsigned int target_freq);
+
 int cpufreq_register_governor(struct cpufreq_governor *governor);
 void cpufreq_unregister_governor(struct cpufreq_governor *governor);
 
@@ -226,6 +238,15 @@ struct cpufreq_driver {
 				 unsigned int target_freq,
 				 unsigned int relation);
 
+	/*
+	 * optional, switch to the lowest frequency at or above target_freq
+	 * from scheduler context on a cpu of the policy, without sleeping
+	 * and without transition notifications.  Returns the new frequency,
+	 * 0 on error.
+	 */
+	unsigned int	(*fast_switch)	(struct cpufreq_policy *policy,
+					 unsigned int target_freq);
+
 	/* should be defined, if possible */
 	unsigned int	(*get)	(unsigned int cpu);
 
@@ -365,6 +386,9 @@ extern struct cpufreq_governor cpufreq_gov_ondemand;
 #elif defined(CONFIG_CPU_FREQ_DEFAULT_GOV_CONSERVATIVE)
 extern struct cpufreq_governor cpufreq_gov_conservative;
 #define CPUFREQ_DEFAULT_GOVERNOR	(&cpufreq_gov_conservative)
+#elif defined(CONFIG_CPU_FREQ_DEFAULT_GOV_SCHEDUTIL)
+extern struct cpufreq_governor cpufreq_gov_schedutil;
+#define CPUFREQ_DEFAULT_GOVERNOR	(&cpufreq_gov_schedutil)
 #endif
 
 
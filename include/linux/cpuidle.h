@@ -101,6 +101,17 @@ struct cpuidle_device {
 
 DECLARE_PER_CPU(struct cpuidle_device *, cpuidle_devices);
 
+#define CPUIDLE_IRQ_INTERVALS	8
+
+/* Recent intervals between device interrupts on a cpu, for the governors */
+struct cpuidle_irq_history {
+	u64			last_ns;	/* local_clock() of the last one */
+	u32			intervals[CPUIDLE_IRQ_INTERVALS]; /* usec */
+	int			ptr;
+};
+
+DECLARE_PER_CPU(struct cpuidle_irq_history, cpuidle_irq_history);
+
 /**
  * cpuidle_get_last_residency - retrieves the last state's residency time
  * @dev: the target CPU
@@ -141,6 +152,7 @@ extern void cpuidle_pause_and_lock(void);
 extern void cpuidle_resume_and_unlock(void);
 extern int cpuidle_enable_device(struct cpuidle_device *dev);
 extern void cpuidle_disable_device(struct cpuidle_device *dev);
+extern void cpuidle_note_irq(void);
 
 #else
 static inline void disable_cpuidle(void) { }
@@ -159,6 +171,7 @@ static inline void cpuidle_resume_and_unlock(void) { }
 static inline int cpuidle_enable_device(struct cpuidle_device *dev)
 {return -ENODEV; }
 static inline void cpuidle_disable_device(struct cpuidle_device *dev) { }
+static inline void cpuidle_note_irq(void) { }
 
 #endif
 
@@ -220,6 +220,7 @@ struct dentry_operations {
 	(DCACHE_MOUNTED|DCACHE_NEED_AUTOMOUNT|DCACHE_MANAGE_TRANSIT)
 
 #define DCACHE_DENTRY_KILLED	0x100000
+#define DCACHE_LRU_NEGATIVE	0x200000 /* counted in s_nr_negative_unused */
 
 extern seqlock_t rename_lock;
 
@@ -427,5 +428,6 @@ static inline bool d_need_lookup(struct dentry *dentry)
 extern void d_clear_need_lookup(struct dentry *dentry);
 
 extern int sysctl_vfs_cache_pressure;
+extern int sysctl_negative_dentry_limit;
 
 #endif	/* __LINUX_DCACHE_H */
@@ -27,6 +27,8 @@
  */
 #define DELAYACCT_PF_SWAPIN	0x00000001	/* I am doing a swapin */
 #define DELAYACCT_PF_BLKIO	0x00000002	/* I am waiting on IO */
+#define DELAYACCT_PF_READ	0x00000004	/* I am reading file data */
+#define DELAYACCT_PF_THROTTLE	0x00000008	/* I am throttled on dirty pages */
 
 #ifdef CONFIG_TASK_DELAY_ACCT
 
@@ -41,6 +43,8 @@ extern int __delayacct_add_tsk(struct taskstats *, struct task_struct *);
 extern __u64 __delayacct_blkio_ticks(struct task_struct *);
 extern void __delayacct_freepages_start(void);
 extern void __delayacct_freepages_end(void);
+struct seq_file;
+extern int proc_delayacct_show(struct seq_file *, struct task_struct *);
 
 static inline int delayacct_is_task_waiting_on_io(struct task_struct *p)
 {
@@ -121,6 +125,26 @@ static inline void delayacct_freepages_end(void)
 		__delayacct_freepages_end();
 }
 
+static inline void delayacct_read_start(void)
+{
+	delayacct_set_flag(DELAYACCT_PF_READ);
+}
+
+static inline void delayacct_read_end(void)
+{
+	delayacct_clear_flag(DELAYACCT_PF_READ);
+}
+
+static inline void delayacct_throttle_start(void)
+{
+	delayacct_set_flag(DELAYACCT_PF_THROTTLE);
+}
+
+static inline void delayacct_throttle_end(void)
+{
+	delayacct_clear_flag(DELAYACCT_PF_THROTTLE);
+}
+
 #else
 static inline void delayacct_set_flag(int flag)
 {}
@@ -147,6 +171,14 @@ static inline void delayacct_freepages_start(void)
 {}
 static inline void delayacct_freepages_end(void)
 {}
+static inline void delayacct_read_start(void)
+{}
+static inline void delayacct_read_end(void)
+{}
+static inline void delayacct_throttle_start(void)
+{}
+static inline void delayacct_throttle_end(void)
+{}
 
 #endif /* CONFIG_TASK_DELAY_ACCT */
 
@@ -158,6 +158,27 @@ extern int bus_unregister_notifier(struct bus_type *bus,
 extern struct kset *bus_get_kset(struct bus_type *bus);
 extern struct klist *bus_get_device_klist(struct bus_type *bus);
 
+/**
+ * enum probe_type - device driver probe type to try
+ * @PROBE_DEFAULT_STRATEGY: Probe synchronously, unless the driver is
+ *	named in the driver_async_probe= boot parameter.
+ * @PROBE_PREFER_ASYNCHRONOUS: Drivers for "slow" devices whose probing
+ *	order is not essential for booting the system may opt into having
+ *	their devices probed asynchronously, in parallel with the rest of
+ *	the boot.
+ * @PROBE_FORCE_SYNCHRONOUS: Drivers that other drivers or the boot
+ *	itself depend on being bound when their registration returns.
+ *
+ * All asynchronous probes are finished by the time
+ * wait_for_device_probe() returns, which the boot does before mounting
+ * the root filesystem.
+ */
+enum probe_type {
+	PROBE_DEFAULT_STRATEGY,
+	PROBE_PREFER_ASYNCHRONOUS,
+	PROBE_FORCE_SYNCHRONOUS,
+};
+
 /**
  * struct device_driver - The basic device driver structure
  * @name:	Name of the device driver.
@@ -165,6 +186,7 @@ extern struct klist *bus_get_device_klist(struct bus_type *bus);
  * @owner:	The module owner.
  * @mod_name:	Used for built-in modules.
  * @suppress_bind_attrs: Disables bind/unbind via sysfs.
+ * @probe_type:	Type of the probe (synchronous or asynchronous) to use.
  * @of_match_table: The open firmware table.
  * @probe:	Called to query the existence of a specific device,
  *		whether this driver can work with it, and bind the driver
@@ -197,6 +219,7 @@ struct device_driver {
 	const char		*mod_name;	/* used for built-in modules */
 
 	bool suppress_bind_attrs;	/* disables bind/unbind via sysfs */
+	enum probe_type probe_type;
 
 	const struct of_device_id	*of_match_table;
 
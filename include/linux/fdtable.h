@@ -9,7 +9,9 @@
 #include <linux/compiler.h>
 #include <linux/spinlock.h>
 #include <linux/rcupdate.h>
+#include <linux/bitops.h>
 #include <linux/types.h>
+#include <linux/wait.h>
 #include <linux/init.h>
 #include <linux/fs.h>
 
@@ -34,6 +36,7 @@ struct fdtable {
 	struct file __rcu **fd;      /* current fd array */
 	fd_set *close_on_exec;
 	fd_set *open_fds;
+	unsigned long *full_fds_bits;	/* open_fds words with no free fd */
 	struct rcu_head rcu;
 	struct fdtable *next;
 };
@@ -46,6 +49,9 @@ struct files_struct {
    * read mostly part
    */
 	atomic_t count;
+	bool resize_in_progress;
+	wait_queue_head_t resize_wait;
+
 	struct fdtable __rcu *fdt;
 	struct fdtable fdtab;
   /*
@@ -55,6 +61,7 @@ struct files_struct {
 	int next_fd;
 	struct embedded_fd_set close_on_exec_init;
 	struct embedded_fd_set open_fds_init;
+	unsigned long full_fds_bits_init[1];
 	struct file __rcu * fd_array[NR_OPEN_DEFAULT];
 };
 
@@ -80,6 +87,27 @@ static inline void free_fdtable(struct fdtable *fdt)
 	call_rcu(&fdt->rcu, free_fdtable_rcu);
 }
 
+/*
+ * Mark an fd in use or free.  full_fds_bits has a bit per word of
+ * open_fds that is entirely in use, so that looking for a free fd skips
+ * them a word at a time.  Called with files->file_lock held.
+ */
+static inline void __set_open_fd(unsigned int fd, struct fdtable *fdt)
+{
+	unsigned long *bits = fdt->open_fds->fds_bits;
+
+	__set_bit(fd, bits);
+	fd /= BITS_PER_LONG;
+	if (!~bits[fd])
+		__set_bit(fd, fdt->full_fds_bits);
+}
+
+static inline void __clear_open_fd(unsigned int fd, struct fdtable *fdt)
+{
+	__clear_bit(fd, fdt->open_fds->fds_bits);
+	__clear_bit(fd / BITS_PER_LONG, fdt->full_fds_bits);
+}
+
 static inline struct file * fcheck_files(struct files_struct *files, unsigned int fd)
 {
 	struct file * file = NULL;
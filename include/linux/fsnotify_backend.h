@@ -11,6 +11,7 @@
 
 #include <linux/idr.h> /* inotify uses this */
 #include <linux/fs.h> /* struct inode */
+#include <linux/hash.h>
 #include <linux/list.h>
 #include <linux/path.h> /* struct path */
 #include <linux/spinlock.h>
@@ -132,6 +133,9 @@ struct fsnotify_group {
 	wait_queue_head_t notification_waitq;	/* read() on the notification file blocks on this waitq */
 	unsigned int q_len;			/* events on the queue */
 	unsigned int max_events;		/* maximum events allowed on the list */
+	/* optional hash of the queued event_holders by to_tell, for merging */
+	struct hlist_head *q_hash;
+	unsigned int q_hash_bits;
 	/*
 	 * Valid fsnotify group priorities.  Events are send in order from highest
 	 * priority to lowest priority.  We default to the lowest priority.
@@ -190,6 +194,7 @@ struct fsnotify_group {
 struct fsnotify_event_holder {
 	struct fsnotify_event *event;
 	struct list_head event_list;
+	struct hlist_node hash_node;	/* in group->q_hash, if the group has one */
 };
 
 /*
@@ -387,6 +392,12 @@ extern bool fsnotify_notify_queue_is_empty(struct fsnotify_group *group);
 extern struct fsnotify_event *fsnotify_peek_notify_event(struct fsnotify_group *group);
 /* return AND dequeue the first event on the notification queue */
 extern struct fsnotify_event *fsnotify_remove_notify_event(struct fsnotify_group *group);
+/* the q_hash chain holding the queued events for the same to_tell as @event */
+static inline struct hlist_head *fsnotify_notify_hash(struct fsnotify_group *group,
+						      struct fsnotify_event *event)
+{
+	return &group->q_hash[hash_ptr(event->to_tell, group->q_hash_bits)];
+}
 
 /* functions used to manipulate the marks attached to inodes */
 
@@ -425,7 +436,7 @@ extern void fsnotify_clear_marks_by_group_flags(struct fsnotify_group *group, un
 extern void fsnotify_clear_marks_by_group(struct fsnotify_group *group);
 extern void fsnotify_get_mark(struct fsnotify_mark *mark);
 extern void fsnotify_put_mark(struct fsnotify_mark *mark);
-extern void fsnotify_unmount_inodes(struct list_head *list);
+extern void fsnotify_unmount_inodes(struct super_block *sb);
 
 /* put here because inotify does some weird stuff when destroying watches */
 extern struct fsnotify_event *fsnotify_create_event(struct inode *to_tell, __u32 mask,
@@ -468,7 +479,7 @@ static inline u32 fsnotify_get_cookie(void)
 	return 0;
 }
 
-static inline void fsnotify_unmount_inodes(struct list_head *list)
+static inline void fsnotify_unmount_inodes(struct super_block *sb)
 {}
 
 #endif	/* CONFIG_FSNOTIFY */
@@ -435,6 +435,9 @@ extern char __irqentry_text_end[];
 
 #define FTRACE_RETFUNC_DEPTH 50
 #define FTRACE_RETSTACK_ALLOC_SIZE 32
+#define FTRACE_RETSTACK_POOL_SIZE 16
+/* Offset of curr_ret_stack below a function in set_graph_notrace */
+#define FTRACE_NOTRACE_DEPTH 65536
 extern int register_ftrace_graph(trace_func_graph_ret_t retfunc,
 				trace_func_graph_ent_t entryfunc);
 
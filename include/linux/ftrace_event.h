@@ -175,6 +175,7 @@ enum {
 	TRACE_EVENT_FL_RECORDED_CMD_BIT,
 	TRACE_EVENT_FL_CAP_ANY_BIT,
 	TRACE_EVENT_FL_NO_SET_FILTER_BIT,
+	TRACE_EVENT_FL_HIST_BIT,
 };
 
 enum {
@@ -183,6 +184,7 @@ enum {
 	TRACE_EVENT_FL_RECORDED_CMD	= (1 << TRACE_EVENT_FL_RECORDED_CMD_BIT),
 	TRACE_EVENT_FL_CAP_ANY		= (1 << TRACE_EVENT_FL_CAP_ANY_BIT),
 	TRACE_EVENT_FL_NO_SET_FILTER	= (1 << TRACE_EVENT_FL_NO_SET_FILTER_BIT),
+	TRACE_EVENT_FL_HIST		= (1 << TRACE_EVENT_FL_HIST_BIT),
 };
 
 struct ftrace_event_call {
@@ -201,6 +203,7 @@ struct ftrace_event_call {
 	 *   bit 1:		enabled
 	 *   bit 2:		filter_active
 	 *   bit 3:		enabled cmd record
+	 *   bit 6:		hist active
 	 *
 	 * Changes to flags must hold the event_mutex.
 	 *
@@ -217,6 +220,9 @@ struct ftrace_event_call {
 	int				perf_refcount;
 	struct hlist_head __percpu	*perf_events;
 #endif
+#ifdef CONFIG_EVENT_HIST
+	struct event_hist __rcu		*hist;
+#endif
 };
 
 #define __TRACE_EVENT_FLAGS(name, value)				\
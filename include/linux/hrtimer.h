@@ -445,6 +445,7 @@ extern int schedule_hrtimeout(ktime_t *expires, const enum hrtimer_mode mode);
 /* Soft interrupt function to run the hrtimer queues: */
 extern void hrtimer_run_queues(void);
 extern void hrtimer_run_pending(void);
+extern int hrtimer_run_pending_needed(void);
 
 /* Bootup initialization: */
 extern void __init hrtimers_init(void);
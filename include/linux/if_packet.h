@@ -50,10 +50,16 @@ struct sockaddr_ll {
 #define PACKET_TX_TIMESTAMP		16
 #define PACKET_TIMESTAMP		17
 #define PACKET_FANOUT			18
+#define PACKET_QDISC_BYPASS		20
+#define PACKET_ROLLOVER_STATS		21
+#define PACKET_FANOUT_DATA		22
 
 #define PACKET_FANOUT_HASH		0
 #define PACKET_FANOUT_LB		1
 #define PACKET_FANOUT_CPU		2
+#define PACKET_FANOUT_ROLLOVER		3
+#define PACKET_FANOUT_CBPF		6
+#define PACKET_FANOUT_FLAG_ROLLOVER	0x1000
 #define PACKET_FANOUT_FLAG_DEFRAG	0x8000
 
 struct tpacket_stats {
@@ -72,6 +78,11 @@ union tpacket_stats_u {
 	struct tpacket_stats_v3 stats3;
 };
 
+struct tpacket_rollover_stats {
+	__aligned_u64	tp_all;		/* packets rolled over to another member */
+	__aligned_u64	tp_failed;	/* no member had room */
+};
+
 struct tpacket_auxdata {
 	__u32		tp_status;
 	__u32		tp_len;
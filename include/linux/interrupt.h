@@ -228,6 +228,15 @@ extern void disable_percpu_irq(unsigned int irq);
 extern void enable_irq(unsigned int irq);
 extern void enable_percpu_irq(unsigned int irq, unsigned int type);
 
+#ifdef CONFIG_GENERIC_HARDIRQS
+extern int irq_set_thread_sched(unsigned int irq, int policy, int prio);
+#else
+static inline int irq_set_thread_sched(unsigned int irq, int policy, int prio)
+{
+	return -EINVAL;
+}
+#endif
+
 /* The following three functions are for the core kernel use only. */
 #ifdef CONFIG_GENERIC_HARDIRQS
 extern void suspend_device_irqs(void);
@@ -250,6 +259,7 @@ extern cpumask_var_t irq_default_affinity;
 extern int irq_set_affinity(unsigned int irq, const struct cpumask *cpumask);
 extern int irq_can_set_affinity(unsigned int irq);
 extern int irq_select_affinity(unsigned int irq);
+extern void irq_move_off_cpus(const struct cpumask *mask);
 
 extern int irq_set_affinity_hint(unsigned int irq, const struct cpumask *m);
 
@@ -295,6 +305,8 @@ static inline int irq_can_set_affinity(unsigned int irq)
 
 static inline int irq_select_affinity(unsigned int irq)  { return 0; }
 
+static inline void irq_move_off_cpus(const struct cpumask *mask) { }
+
 static inline int irq_set_affinity_hint(unsigned int irq,
 					const struct cpumask *m)
 {
@@ -401,6 +413,12 @@ extern bool force_irqthreads;
 #define force_irqthreads	(0)
 #endif
 
+#ifdef CONFIG_SOFTIRQ_THREADS
+extern bool softirq_threads;
+#else
+#define softirq_threads		(0)
+#endif
+
 #ifndef __ARCH_SET_SOFTIRQ_PENDING
 #define set_softirq_pending(x) (local_softirq_pending() = (x))
 #define or_softirq_pending(x)  (local_softirq_pending() |= (x))
@@ -62,6 +62,8 @@ struct ipc_namespace {
 	unsigned int    mq_queues_max;   /* initialized to DFLT_QUEUESMAX */
 	unsigned int    mq_msg_max;      /* initialized to DFLT_MSGMAX */
 	unsigned int    mq_msgsize_max;  /* initialized to DFLT_MSGSIZEMAX */
+	unsigned int    mq_msg_default;  /* initialized to DFLT_MSG */
+	unsigned int    mq_msgsize_default; /* initialized to DFLT_MSGSIZE */
 
 	/* user_ns which owns the ipc ns */
 	struct user_namespace *user_ns;
@@ -90,11 +92,20 @@ static inline void shm_destroy_orphaned(struct ipc_namespace *ns) {}
 
 #ifdef CONFIG_POSIX_MQUEUE
 extern int mq_init_ns(struct ipc_namespace *ns);
-/* default values */
-#define DFLT_QUEUESMAX 256     /* max number of message queues */
-#define DFLT_MSGMAX    10      /* max number of messages in each queue */
-#define HARD_MSGMAX    (32768*sizeof(void *)/4)
-#define DFLT_MSGSIZEMAX 8192   /* max message size */
+/*
+ * Default values and limits.  Queues created without attributes get
+ * DFLT_MSG/DFLT_MSGSIZE, the *MAX values cap what unprivileged users may
+ * ask for, the HARD_* values cap everyone, including the sysctls.
+ */
+#define DFLT_QUEUESMAX	256	/* max number of message queues */
+#define MIN_MSGMAX	1	/* min value for msg_max */
+#define DFLT_MSG	10U	/* default number of messages in a queue */
+#define DFLT_MSGMAX	1024	/* max number of messages in each queue */
+#define HARD_MSGMAX	65536
+#define MIN_MSGSIZEMAX	128	/* min value for msgsize_max */
+#define DFLT_MSGSIZE	8192U	/* default message size */
+#define DFLT_MSGSIZEMAX	8192	/* max message size */
+#define HARD_MSGSIZEMAX	(16*1024*1024)
 #else
 static inline int mq_init_ns(struct ipc_namespace *ns) { return 0; }
 #endif
@@ -36,6 +36,8 @@ struct module;
  * @threads_oneshot:	bitfield to handle shared oneshot threads
  * @threads_active:	number of irqaction threads currently running
  * @wait_for_threads:	wait queue for sync_irq to wait for threaded handlers
+ * @thread_policy:	scheduling policy of the irqaction threads
+ * @thread_prio:	RT priority of the irqaction threads
  * @dir:		/proc/irq/ procfs entry
  * @name:		flow handler name for /proc/interrupts output
  */
@@ -69,6 +71,8 @@ struct irq_desc {
 	unsigned long		threads_oneshot;
 	atomic_t		threads_active;
 	wait_queue_head_t       wait_for_threads;
+	int			thread_policy;
+	int			thread_prio;
 #ifdef CONFIG_PROC_FS
 	struct proc_dir_entry	*dir;
 #endif
@@ -30,6 +30,7 @@
 #include <linux/bit_spinlock.h>
 #include <linux/mutex.h>
 #include <linux/timer.h>
+#include <linux/workqueue.h>
 #include <linux/slab.h>
 #endif
 
@@ -620,9 +621,17 @@ struct transaction_run_stats_s {
 	__u32			rs_blocks_logged;
 };
 
+/*
+ * Commit times are bucketed by powers of two in microseconds: bucket 0
+ * counts commits under 1us, bucket n those in [2^(n-1), 2^n) us, and the
+ * last bucket everything slower.
+ */
+#define JBD2_COMMIT_HIST_BUCKETS	24
+
 struct transaction_stats_s {
 	unsigned long		ts_tid;
 	struct transaction_run_stats_s run;
+	unsigned long		ts_commit_hist[JBD2_COMMIT_HIST_BUCKETS];
 };
 
 static inline unsigned long
@@ -660,6 +669,7 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_wait_commit: Wait queue to trigger commit
  * @j_wait_updates: Wait queue to wait for updates to complete
  * @j_checkpoint_mutex: Mutex for locking against concurrent checkpoints
+ * @j_checkpoint_work: Background checkpoint run when log space gets low
  * @j_head: Journal head - identifies the first unused block in the journal
  * @j_tail: Journal tail - identifies the oldest still-used block in the
  *  journal.
@@ -779,6 +789,13 @@ struct journal_s
 	/* Semaphore for locking against concurrent checkpoints */
 	struct mutex		j_checkpoint_mutex;
 
+	/*
+	 * Background checkpoint, kicked after a commit leaves the log
+	 * short of space so that new handles rarely have to checkpoint
+	 * synchronously in __jbd2_log_wait_for_space().
+	 */
+	struct work_struct	j_checkpoint_work;
+
 	/*
 	 * List of buffer heads used by the checkpoint routine.  This
 	 * was moved from jbd2_log_do_checkpoint() to reduce stack
@@ -1168,9 +1185,11 @@ int jbd2_journal_force_commit_nested(journal_t *journal);
 int jbd2_log_wait_commit(journal_t *journal, tid_t tid);
 int jbd2_complete_transaction(journal_t *journal, tid_t tid);
 int jbd2_log_do_checkpoint(journal_t *journal);
+void jbd2_log_start_checkpoint(journal_t *journal);
 int jbd2_trans_will_send_data_barrier(journal_t *journal, tid_t tid);
 
 void __jbd2_log_wait_for_space(journal_t *journal);
+extern void jbd2_checkpoint_work(struct work_struct *work);
 extern void __jbd2_journal_drop_transaction(journal_t *, transaction_t *);
 extern int jbd2_cleanup_journal_tail(journal_t *);
 
@@ -30,6 +30,7 @@
 #define KPF_NOPAGE		20
 
 #define KPF_KSM			21
+#define KPF_IDLE		22
 
 #ifdef __KERNEL__
 
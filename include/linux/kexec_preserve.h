@@ -0,0 +1,62 @@
+#ifndef _LINUX_KEXEC_PRESERVE_H
+#define _LINUX_KEXEC_PRESERVE_H
+/*
+ * Memory preserved across kexec.
+ *
+ * A physical range given with kexec_preserve=size@start is kept out of
+ * the page allocator and exported through /dev/kexec_preserve.  User
+ * space carves named extents out of it and mmaps them; when the next
+ * kernel is started with kexec and the same parameter, it finds the
+ * extents again and their contents are untouched.
+ */
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define KEXEC_PRESERVE_NAME_LEN	32
+
+struct kexec_preserve_extent {
+	char	name[KEXEC_PRESERVE_NAME_LEN];	/* NUL terminated */
+	__u64	offset;		/* mmap offset, page aligned */
+	__u64	size;		/* rounded up to a page */
+};
+
+struct kexec_preserve_info {
+	__u64	size;		/* of the whole range */
+	__u64	generation;	/* kexecs the extents survived */
+	__u32	adopted;	/* extents were handed over at boot */
+	__u32	nr_extents;
+};
+
+#define KEXEC_PRESERVE_IOC_MAGIC	0xB4
+
+#define KEXEC_PRESERVE_INFO	_IOR(KEXEC_PRESERVE_IOC_MAGIC, 0, \
+				     struct kexec_preserve_info)
+#define KEXEC_PRESERVE_CREATE	_IOWR(KEXEC_PRESERVE_IOC_MAGIC, 1, \
+				      struct kexec_preserve_extent)
+#define KEXEC_PRESERVE_LOOKUP	_IOWR(KEXEC_PRESERVE_IOC_MAGIC, 2, \
+				      struct kexec_preserve_extent)
+#define KEXEC_PRESERVE_REMOVE	_IOW(KEXEC_PRESERVE_IOC_MAGIC, 3, \
+				     struct kexec_preserve_extent)
+
+#ifdef __KERNEL__
+
+#ifdef CONFIG_KEXEC_PRESERVE
+extern unsigned long long kexec_preserve_base;
+extern unsigned long long kexec_preserve_size;
+
+extern bool kexec_preserve_overlaps(unsigned long start, unsigned long end);
+extern void kexec_preserve_handover(void);
+#else
+static inline bool kexec_preserve_overlaps(unsigned long start,
+					   unsigned long end)
+{
+	return false;
+}
+static inline void kexec_preserve_handover(void)
+{
+}
+#endif
+
+#endif /* __KERNEL__ */
+#endif /* _LINUX_KEXEC_PRESERVE_H */
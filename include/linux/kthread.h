@@ -38,6 +38,7 @@ int kthread_should_stop(void);
 void *kthread_data(struct task_struct *k);
 
 int kthreadd(void *unused);
+int kthread_set_affinity(const struct cpumask *mask);
 extern struct task_struct *kthreadd_task;
 extern int tsk_fork_get_node(struct task_struct *tsk);
 
@@ -0,0 +1,52 @@
+#ifndef _LINUX_LATENCY_HIST_H
+#define _LINUX_LATENCY_HIST_H
+
+#include <linux/types.h>
+#include <linux/ktime.h>
+
+enum latency_hist_type {
+	LATENCY_HIST_IRQSOFF,
+	LATENCY_HIST_PREEMPTOFF,
+	LATENCY_HIST_WAKEUP,
+	LATENCY_HIST_WAKEUP_RT,
+	LATENCY_HIST_TIMER_OFFSET,
+	LATENCY_HIST_NR_TYPES,
+};
+
+#ifdef CONFIG_LATENCY_HIST
+extern int latency_hist_enabled[LATENCY_HIST_NR_TYPES];
+
+extern void __latency_hist_start(int type);
+extern void __latency_hist_stop(int type);
+extern void __latency_hist_record(int type, s64 latency);
+
+/*
+ * Mark the start and the end of an irqs-off or preemption-off section
+ * on this cpu. Both are no-ops unless the histogram was enabled.
+ */
+static inline void latency_hist_start(int type)
+{
+	if (unlikely(latency_hist_enabled[type]))
+		__latency_hist_start(type);
+}
+
+static inline void latency_hist_stop(int type)
+{
+	if (unlikely(latency_hist_enabled[type]))
+		__latency_hist_stop(type);
+}
+
+/* How late an expired hrtimer is run, called from hrtimer_interrupt() */
+static inline void latency_hist_timer(ktime_t now, ktime_t expires)
+{
+	if (unlikely(latency_hist_enabled[LATENCY_HIST_TIMER_OFFSET]))
+		__latency_hist_record(LATENCY_HIST_TIMER_OFFSET,
+				      ktime_to_ns(ktime_sub(now, expires)));
+}
+#else
+static inline void latency_hist_start(int type) { }
+static inline void latency_hist_stop(int type) { }
+static inline void latency_hist_timer(ktime_t now, ktime_t expires) { }
+#endif
+
+#endif /* _LINUX_LATENCY_HIST_H */
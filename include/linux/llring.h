@@ -0,0 +1,130 @@
+#ifndef LLRING_H
+#define LLRING_H
+/*
+ * Lock-less bounded ring of pointers
+ *
+ * A fixed size ring of void * with separate producer and consumer
+ * head/tail pairs, each on its own cache line.  A producer reserves
+ * slots by moving prod.head, fills them, then publishes them by moving
+ * prod.tail; consumers do the same with cons.head and cons.tail.
+ *
+ * Whether several producers (or consumers) may use the ring at the same
+ * time is chosen when the ring is allocated:
+ *
+ *   LLRING_F_SP_ENQ	only one producer at a time, no atomic ops
+ *   LLRING_F_SC_DEQ	only one consumer at a time, no atomic ops
+ *
+ * Without the flag the side is multi-user and claims slots with
+ * cmpxchg.  A multi-user side publishes in reservation order, so a
+ * task that was interrupted between reserving and publishing holds up
+ * the others on that side; the ring disables preemption around each
+ * operation but callers that share a side with interrupt handlers must
+ * also disable interrupts.
+ *
+ * The bulk functions move all @n objects or none; the burst functions
+ * move as many as possible.  All of them return the number moved.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version
+ * 2 as published by the Free Software Foundation.
+ */
+
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/cache.h>
+#include <linux/types.h>
+#include <linux/gfp.h>
+
+#define LLRING_F_SP_ENQ		0x0001
+#define LLRING_F_SC_DEQ		0x0002
+
+struct llring_headtail {
+	u32 head;
+	u32 tail;
+};
+
+struct llring {
+	u32			size;
+	u32			mask;
+	unsigned int		flags;
+
+	struct llring_headtail	prod ____cacheline_aligned_in_smp;
+	struct llring_headtail	cons ____cacheline_aligned_in_smp;
+
+	void			*ring[0] ____cacheline_aligned_in_smp;
+};
+
+extern struct llring *llring_alloc(unsigned int count, unsigned int flags,
+				   gfp_t gfp);
+extern void llring_free(struct llring *r);
+
+extern unsigned int __llring_enqueue(struct llring *r, void * const *objs,
+				     unsigned int n, bool fixed);
+extern unsigned int __llring_dequeue(struct llring *r, void **objs,
+				     unsigned int n, bool fixed);
+
+static inline unsigned int llring_enqueue_bulk(struct llring *r,
+					       void * const *objs,
+					       unsigned int n)
+{
+	return __llring_enqueue(r, objs, n, true);
+}
+
+static inline unsigned int llring_enqueue_burst(struct llring *r,
+						void * const *objs,
+						unsigned int n)
+{
+	return __llring_enqueue(r, objs, n, false);
+}
+
+static inline unsigned int llring_dequeue_bulk(struct llring *r, void **objs,
+					       unsigned int n)
+{
+	return __llring_dequeue(r, objs, n, true);
+}
+
+static inline unsigned int llring_dequeue_burst(struct llring *r, void **objs,
+						unsigned int n)
+{
+	return __llring_dequeue(r, objs, n, false);
+}
+
+/* Returns 0 on success, -ENOBUFS when the ring is full */
+static inline int llring_enqueue(struct llring *r, void *obj)
+{
+	return __llring_enqueue(r, &obj, 1, true) ? 0 : -ENOBUFS;
+}
+
+/* Returns the oldest object, or NULL when the ring is empty */
+static inline void *llring_dequeue(struct llring *r)
+{
+	void *obj;
+
+	return __llring_dequeue(r, &obj, 1, true) ? obj : NULL;
+}
+
+/*
+ * The counts below are snapshots; with concurrent users they are only
+ * hints.
+ */
+static inline unsigned int llring_count(const struct llring *r)
+{
+	return ACCESS_ONCE(r->prod.tail) - ACCESS_ONCE(r->cons.tail);
+}
+
+static inline unsigned int llring_free_count(const struct llring *r)
+{
+	return r->size - llring_count(r);
+}
+
+static inline bool llring_empty(const struct llring *r)
+{
+	return llring_count(r) == 0;
+}
+
+static inline bool llring_full(const struct llring *r)
+{
+	return llring_count(r) == r->size;
+}
+
+#endif /* LLRING_H */
@@ -28,6 +28,13 @@ enum {
 
 struct loop_func_table;
 
+/* A run of the backing file that is contiguous on lo_dio_bdev */
+struct loop_extent {
+	sector_t	start;		/* first sector in the backing file */
+	sector_t	nr_sects;
+	sector_t	disk_start;	/* first sector on lo_dio_bdev */
+};
+
 struct loop_device {
 	int		lo_number;
 	int		lo_refcnt;
@@ -64,6 +71,12 @@ struct loop_device {
 
 	struct request_queue	*lo_queue;
 	struct gendisk		*lo_disk;
+
+	/* LO_FLAGS_DIRECT_IO: bios are remapped onto the backing blocks */
+	struct block_device	*lo_dio_bdev;
+	struct loop_extent	*lo_dio_extents;
+	unsigned int		lo_dio_nr_extents;
+	atomic_t		lo_dio_pending;	/* bios in flight */
 };
 
 #endif /* __KERNEL__ */
@@ -75,6 +88,7 @@ enum {
 	LO_FLAGS_READ_ONLY	= 1,
 	LO_FLAGS_AUTOCLEAR	= 4,
 	LO_FLAGS_PARTSCAN	= 8,
+	LO_FLAGS_DIRECT_IO	= 16,
 };
 
 #include <asm/posix_types.h>	/* for __kernel_old_dev_t */
@@ -194,6 +194,10 @@ struct vm_fault {
 					 * is set (which is also implied by
 					 * VM_FAULT_ERROR).
 					 */
+	/* for ->map_pages() only */
+	pgoff_t max_pgoff;		/* map pages for offset from pgoff till
+					 * max_pgoff inclusive */
+	pte_t *pte;			/* pte entry associated with ->pgoff */
 };
 
 /*
@@ -206,6 +210,16 @@ struct vm_operations_struct {
 	void (*close)(struct vm_area_struct * area);
 	int (*fault)(struct vm_area_struct *vma, struct vm_fault *vmf);
 
+	/* map the pages from vmf->pgoff to vmf->max_pgoff that are already
+	 * uptodate in memory, without blocking: called with the pte lock held
+	 * to save faults on the neighbours of a read fault */
+	void (*map_pages)(struct vm_area_struct *vma, struct vm_fault *vmf);
+
+	/* map a huge page with the pmd covering address, if the mapping can:
+	 * VM_FAULT_FALLBACK asks for the fault to be handled by ->fault */
+	int (*pmd_fault)(struct vm_area_struct *vma, unsigned long address,
+			 pmd_t *pmd, unsigned int flags);
+
 	/* notification that a previously read-only page is about to become
 	 * writable, if an error is returned it will cause a SIGBUS */
 	int (*page_mkwrite)(struct vm_area_struct *vma, struct vm_fault *vmf);
@@ -845,6 +859,7 @@ static inline int page_mapped(struct page *page)
 #define VM_FAULT_NOPAGE	0x0100	/* ->fault installed the pte, not return page */
 #define VM_FAULT_LOCKED	0x0200	/* ->fault locked the returned page */
 #define VM_FAULT_RETRY	0x0400	/* ->fault blocked, must retry */
+#define VM_FAULT_FALLBACK 0x0800	/* ->pmd_fault could not map a huge page */
 
 #define VM_FAULT_HWPOISON_LARGE_MASK 0xf000 /* encodes hpage index for large hwpoison */
 
@@ -967,6 +982,12 @@ extern int handle_mm_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 			unsigned long address, unsigned int flags);
 extern int fixup_user_fault(struct task_struct *tsk, struct mm_struct *mm,
 			    unsigned long address, unsigned int fault_flags);
+extern void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		       struct page *page, pte_t *pte);
+extern void map_cached_pages(struct mm_struct *mm, unsigned long start,
+			     unsigned long end);
+extern unsigned long sysctl_fault_around_bytes;
+extern int sysctl_exec_prefault;
 #else
 static inline int handle_mm_fault(struct mm_struct *mm,
 			struct vm_area_struct *vma, unsigned long address,
@@ -986,6 +1007,51 @@ static inline int fixup_user_fault(struct task_struct *tsk,
 }
 #endif
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags);
+
+/*
+ * Brackets a change of vm_start, vm_end, vm_pgoff, vm_flags or
+ * vm_page_prot, or of the page tables it covers, that is made under
+ * mmap_sem alone, so that speculative faults notice it.
+ */
+static inline void vm_write_begin(struct vm_area_struct *vma)
+{
+	write_seqcount_begin(&vma->vm_sequence);
+}
+
+static inline void vm_write_end(struct vm_area_struct *vma)
+{
+	write_seqcount_end(&vma->vm_sequence);
+}
+
+/* A copied vma starts out with its own sequence and no users */
+static inline void vm_sequence_init(struct vm_area_struct *vma)
+{
+	seqcount_init(&vma->vm_sequence);
+	atomic_set(&vma->vm_ref_count, 0);
+}
+#else
+static inline int handle_speculative_fault(struct mm_struct *mm,
+			unsigned long address, unsigned int flags)
+{
+	return VM_FAULT_RETRY;
+}
+
+static inline void vm_write_begin(struct vm_area_struct *vma)
+{
+}
+
+static inline void vm_write_end(struct vm_area_struct *vma)
+{
+}
+
+static inline void vm_sequence_init(struct vm_area_struct *vma)
+{
+}
+#endif
+
 extern int make_pages_present(unsigned long addr, unsigned long end);
 extern int access_process_vm(struct task_struct *tsk, unsigned long addr, void *buf, int len, int write);
 extern int access_remote_vm(struct mm_struct *mm, unsigned long addr,
@@ -1053,6 +1119,22 @@ extern int mprotect_fixup(struct vm_area_struct *vma,
 			  struct vm_area_struct **pprev, unsigned long start,
 			  unsigned long end, unsigned long newflags);
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * A PROT_NONE pte in a vma that is not itself PROT_NONE is a NUMA
+ * hinting entry installed by change_prot_numa().
+ */
+static inline int pte_numa(struct vm_area_struct *vma, pte_t pte)
+{
+	if (pgprot_val(vma->vm_page_prot) == pgprot_val(PAGE_NONE))
+		return 0;
+	return pte_same(pte, pte_modify(pte, PAGE_NONE));
+}
+
+extern unsigned long change_prot_numa(struct vm_area_struct *vma,
+				      unsigned long start, unsigned long end);
+#endif
+
 /*
  * doesn't attempt to fault and will return short.
  */
@@ -1253,6 +1335,66 @@ static inline void pgtable_page_dtor(struct page *page)
 	((unlikely(pmd_none(*(pmd))) && __pte_alloc_kernel(pmd, address))? \
 		NULL: pte_offset_kernel(pmd, address))
 
+#ifdef CONFIG_FORK_SHARE_PTE
+/*
+ * A page table shared copy-on-write between mms after fork is mapped by
+ * write-protected pmds in all of them.  Only valid on a present pmd that
+ * is not huge.
+ */
+static inline int pmd_shared_pte(pmd_t pmd)
+{
+	return !pmd_write(pmd);
+}
+
+extern bool pte_table_owner(struct mm_struct *mm, pmd_t *pmd, pmd_t pmde);
+extern void flush_shared_pte_table(struct mm_struct *mm,
+				   unsigned long address);
+extern int __unshare_pte_table(struct vm_area_struct *vma, pmd_t *pmd,
+			       unsigned long address);
+extern int unshare_pte_range(struct mm_struct *mm, unsigned long start,
+			     unsigned long end, bool edges);
+#else
+static inline int pmd_shared_pte(pmd_t pmd)
+{
+	return 0;
+}
+
+static inline bool pte_table_owner(struct mm_struct *mm, pmd_t *pmd,
+				   pmd_t pmde)
+{
+	return true;
+}
+
+static inline void flush_shared_pte_table(struct mm_struct *mm,
+					  unsigned long address)
+{
+}
+
+static inline int __unshare_pte_table(struct vm_area_struct *vma, pmd_t *pmd,
+				      unsigned long address)
+{
+	return 0;
+}
+
+static inline int unshare_pte_range(struct mm_struct *mm, unsigned long start,
+				    unsigned long end, bool edges)
+{
+	return 0;
+}
+#endif
+
+/*
+ * Give the mm its own copy of the page table @pmd points to before
+ * changing any of its ptes.
+ */
+static inline int unshare_pte_table(struct vm_area_struct *vma, pmd_t *pmd,
+				    unsigned long address)
+{
+	if (unlikely(pmd_shared_pte(*pmd)))
+		return __unshare_pte_table(vma, pmd, address);
+	return 0;
+}
+
 extern void free_area_init(unsigned long * zones_size);
 extern void free_area_init_node(int nid, unsigned long * zones_size,
 		unsigned long zone_start_pfn, unsigned long *zholes_size);
@@ -1438,6 +1580,7 @@ extern void truncate_inode_pages_range(struct address_space *,
 
 /* generic vm_area_ops exported for stackable file systems */
 extern int filemap_fault(struct vm_area_struct *, struct vm_fault *);
+extern void filemap_map_pages(struct vm_area_struct *vma, struct vm_fault *vmf);
 
 /* mm/page-writeback.c */
 int write_one_page(struct page *page, int wait);
@@ -1450,7 +1593,7 @@ void task_dirty_inc(struct task_struct *tsk);
 int force_page_cache_readahead(struct address_space *mapping, struct file *filp,
 			pgoff_t offset, unsigned long nr_to_read);
 
-void page_cache_sync_readahead(struct address_space *mapping,
+unsigned long page_cache_sync_readahead(struct address_space *mapping,
 			       struct file_ra_state *ra,
 			       struct file *filp,
 			       pgoff_t offset,
@@ -9,9 +9,11 @@
 #include <linux/prio_tree.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
+#include <linux/seqlock.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/page-debug-flags.h>
+#include <linux/uprobes.h>
 #include <asm/page.h>
 #include <asm/mmu.h>
 
@@ -253,6 +255,17 @@ struct vm_area_struct {
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+	/*
+	 * Odd while the layout or protection of the vma is changing, and
+	 * left odd once it is unlinked: a speculative fault validates
+	 * its work against it.  vm_ref_count counts the speculative
+	 * users; the vma is freed by RCU when it drops below zero.
+	 */
+	seqcount_t vm_sequence;
+	atomic_t vm_ref_count;
+	struct rcu_head vm_rcu;
+#endif
 };
 
 struct core_thread {
@@ -390,6 +403,17 @@ struct mm_struct {
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	pgtable_t pmd_huge_pte; /* protected by page_table_lock */
 #endif
+#ifdef CONFIG_NUMA_BALANCING
+	/*
+	 * numa_next_scan is the next time (in jiffies) when the address
+	 * space gets marked for NUMA hinting faults, numa_scan_offset is
+	 * where the next scan starts and numa_scan_seq counts full passes.
+	 */
+	unsigned long numa_next_scan;
+	unsigned long numa_scan_offset;
+	int numa_scan_seq;
+#endif
+	struct uprobes_state uprobes_state;
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
 #endif
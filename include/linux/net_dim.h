@@ -0,0 +1,110 @@
+/*
+ * Dynamic interrupt moderation (net_dim) - Definitions
+ *
+ * net_dim picks the interrupt moderation of a NAPI context from what that
+ * context actually did.  The driver reports every poll completion (the
+ * point where it re-enables its interrupt) together with the packets and
+ * bytes it processed since the previous one.  Every NET_DIM_NEVENTS
+ * completions net_dim turns the window into packet, byte and completion
+ * rates and compares them with the previous window:
+ *
+ *   - more bytes, or the same bytes in more packets, or the same traffic
+ *     with fewer interrupts is "better": keep moving the moderation in
+ *     the same direction;
+ *   - anything else is "worse": turn around.
+ *
+ * Moderation is a small table of levels per profile, from the shortest to
+ * the longest interrupt interval.  Once the search settles on a level it
+ * parks there until the traffic changes significantly, and a search that
+ * keeps oscillating parks for a while before trying again.
+ *
+ * The profile selects the table: latency, balanced or throughput.  Drivers
+ * whose ethtool rx-usecs/tx-usecs reserve the smallest values as mode
+ * selectors map them with net_dim_usecs_to_profile().
+ *
+ * net_dim keeps no locks; all calls for one struct net_dim must be
+ * serialized by the caller, which NAPI polling does naturally.
+ */
+
+#ifndef _LINUX_NET_DIM_H
+#define _LINUX_NET_DIM_H
+
+#ifdef __KERNEL__
+
+#include <linux/types.h>
+#include <linux/ktime.h>
+
+enum net_dim_profile {
+	NET_DIM_PROFILE_LATENCY,
+	NET_DIM_PROFILE_BALANCED,
+	NET_DIM_PROFILE_THROUGHPUT,
+	NET_DIM_NR_PROFILES
+};
+
+/* ethtool {rx,tx}-usecs values that select dynamic moderation */
+#define NET_DIM_USECS_BALANCED		1
+#define NET_DIM_USECS_LATENCY		2
+#define NET_DIM_USECS_THROUGHPUT	3
+
+#define NET_DIM_NR_LEVELS	5	/* Moderation levels per profile */
+#define NET_DIM_NEVENTS		64	/* Poll completions per decision */
+
+struct net_dim_stats {
+	unsigned int	ppms;		/* Packets per msec */
+	unsigned int	bpms;		/* Bytes per msec */
+	unsigned int	epms;		/* Poll completions per msec */
+};
+
+struct net_dim {
+	/* Current measurement window */
+	ktime_t		start;		/* Window start time */
+	u64		bytes;		/* Bytes seen in window */
+	unsigned int	packets;	/* Packets seen in window */
+	unsigned int	events;		/* Poll completions in window */
+
+	struct net_dim_stats prev_stats; /* Rates of previous window */
+
+	u8		profile;	/* enum net_dim_profile */
+	u8		level;		/* Index into the profile's table */
+	u8		tune_state;	/* Search state */
+	u8		steps_left;	/* Steps towards shorter intervals */
+	u8		steps_right;	/* Steps towards longer intervals */
+	u8		tired;		/* Steps since the search last parked */
+};
+
+/* Initialize net_dim state for @profile, starting at its default level */
+extern void net_dim_init(struct net_dim *dim, enum net_dim_profile profile);
+
+/*
+ * Record one poll completion that processed @packets and @bytes.  Returns
+ * true if the moderation level changed; the caller then reprograms its
+ * interrupt throttling from net_dim_usecs().
+ */
+extern bool net_dim_update(struct net_dim *dim, unsigned int packets,
+			   unsigned int bytes);
+
+/* Interrupt interval in usecs for the current level */
+extern unsigned int net_dim_usecs(const struct net_dim *dim);
+
+/* Does the ethtool {rx,tx}-usecs value @usecs select dynamic moderation? */
+static inline bool net_dim_usecs_is_dynamic(u32 usecs)
+{
+	return usecs >= NET_DIM_USECS_BALANCED &&
+	       usecs <= NET_DIM_USECS_THROUGHPUT;
+}
+
+static inline enum net_dim_profile net_dim_usecs_to_profile(u32 usecs)
+{
+	switch (usecs) {
+	case NET_DIM_USECS_LATENCY:
+		return NET_DIM_PROFILE_LATENCY;
+	case NET_DIM_USECS_THROUGHPUT:
+		return NET_DIM_PROFILE_THROUGHPUT;
+	default:
+		return NET_DIM_PROFILE_BALANCED;
+	}
+}
+
+#endif /* __KERNEL__ */
+
+#endif /* _LINUX_NET_DIM_H */
@@ -9,6 +9,7 @@
 #ifndef _NET_TIMESTAMPING_H
 #define _NET_TIMESTAMPING_H
 
+#include <linux/types.h>
 #include <linux/socket.h>   /* for SO_TIMESTAMPING */
 
 /* SO_TIMESTAMPING gets an integer bit field comprised of these values */
@@ -25,6 +26,31 @@ enum {
 	SOF_TIMESTAMPING_RAW_HARDWARE
 };
 
+/* SO_TXTIME gets a struct sock_txtime with flags being an integer bit
+ * field comprised of these values.
+ */
+enum txtime_flags {
+	SOF_TXTIME_DEADLINE_MODE = (1 << 0),
+
+	SOF_TXTIME_FLAGS_LAST = SOF_TXTIME_DEADLINE_MODE,
+	SOF_TXTIME_FLAGS_MASK = (SOF_TXTIME_FLAGS_LAST - 1) |
+				 SOF_TXTIME_FLAGS_LAST
+};
+
+/**
+ * struct sock_txtime - %SO_TXTIME parameter
+ *
+ * @clockid:	clock the SCM_TXTIME timestamps are expressed in
+ * @flags:	SOF_TXTIME_* flags
+ *
+ * Once set, each sendmsg() may carry a SCM_TXTIME control message with
+ * the __u64 nanosecond time at which the packet should leave the host.
+ */
+struct sock_txtime {
+	__kernel_clockid_t	clockid;
+	__u32			flags;
+};
+
 /**
  * struct hwtstamp_config - %SIOCSHWTSTAMP parameter
  *
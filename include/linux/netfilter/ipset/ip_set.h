@@ -274,6 +274,9 @@ struct ip_set_type_variant {
 	/* Return true if "b" set is the same as "a"
 	 * according to the create set parameters */
 	bool (*same_set)(const struct ip_set *a, const struct ip_set *b);
+
+	/* Kernel side testing is RCU safe, without taking the set lock */
+	bool lockless_test;
 };
 
 /* The core set type structure */
@@ -3,6 +3,7 @@
 
 #include <linux/rcupdate.h>
 #include <linux/jhash.h>
+#include <linux/bitmap.h>
 #include <linux/netfilter/ipset/ip_set_timeout.h>
 
 #define CONCAT(a, b, c)		a##b##c
@@ -23,12 +24,21 @@
  * are serialized by the nfnl mutex. During resizing the set is
  * read-locked, so the only possible concurrent operations are
  * the kernel side readers. Those must be protected by proper RCU locking.
+ *
+ * Kernel side tests don't take the set lock at all, so writers (still
+ * serialized by the write-locked set) never modify an entry a reader
+ * may be looking at: new entries are appended and become visible by
+ * setting their bit in the "used" bitmap, deleted entries just get
+ * their bit cleared. A bucket which has to grow or shrink is copied and
+ * the old copy is freed after a RCU-bh grace period.
  */
 
 /* Number of elements to store in an initial array block */
 #define AHASH_INIT_SIZE			4
 /* Max number of elements to store in an array block */
 #define AHASH_MAX_SIZE			(3*AHASH_INIT_SIZE)
+/* Hard limit of the tuned max, used to size the bitmap of the buckets */
+#define AHASH_MAX_TUNED			64
 
 /* Max number of elements can be tuned */
 #ifdef IP_SET_HASH_WITH_MULTI
@@ -46,7 +56,7 @@ tune_ahash_max(u8 curr, u32 multi)
 	/* Currently, at listing one hash bucket must fit into a message.
 	 * Therefore we have a hard limit here.
 	 */
-	return n > curr && n <= 64 ? n : curr;
+	return n > curr && n <= AHASH_MAX_TUNED ? n : curr;
 }
 #define TUNE_AHASH_MAX(h, multi)	\
 	((h)->ahash_max = tune_ahash_max((h)->ahash_max, multi))
@@ -57,18 +67,119 @@ tune_ahash_max(u8 curr, u32 multi)
 
 /* A hash bucket */
 struct hbucket {
-	void *value;		/* the array of the values */
+	struct rcu_head rcu;	/* for call_rcu_bh */
+	/* which positions are used in the array */
+	DECLARE_BITMAP(used, AHASH_MAX_TUNED);
 	u8 size;		/* size of the array */
 	u8 pos;			/* position of the first free entry */
+	unsigned char value[0]	/* the array of the values */
+		__aligned(__alignof__(u64));
 };
 
 /* The hash table: the table size stored here in order to make resizing easy */
 struct htable {
 	u8 htable_bits;		/* size of hash table == 2^htable_bits */
-	struct hbucket bucket[0]; /* hashtable buckets */
+	struct hbucket *bucket[0]; /* hashtable buckets */
 };
 
-#define hbucket(h, i)		(&((h)->bucket[i]))
+#define hbucket(h, i)		((h)->bucket[i])
+
+static void
+hbucket_free_rcu(struct rcu_head *head)
+{
+	kfree(container_of(head, struct hbucket, rcu));
+}
+
+/* Replace the bucket *pn by a new one of the given size, holding the
+ * used entries of the old one. Readers of the old bucket are not
+ * disturbed, it is freed after a grace period. */
+static int
+hbucket_copy(struct hbucket **pn, u8 size, size_t dsize)
+{
+	struct hbucket *n = *pn, *tmp;
+	u8 i, j = 0;
+
+	tmp = kzalloc(sizeof(*tmp) + size * dsize, GFP_ATOMIC);
+	if (!tmp)
+		return -ENOMEM;
+	if (n) {
+		for (i = 0; i < n->pos; i++) {
+			if (!test_bit(i, n->used))
+				continue;
+			memcpy(tmp->value + j * dsize, n->value + i * dsize,
+			       dsize);
+			__set_bit(j++, tmp->used);
+		}
+	}
+	tmp->size = size;
+	tmp->pos = j;
+	rcu_assign_pointer(*pn, tmp);
+	if (n)
+		call_rcu_bh(&n->rcu, hbucket_free_rcu);
+	return 0;
+}
+
+/* Return a free position at the end of the bucket *pn, compacting or
+ * growing the bucket when needed. */
+static int
+hbucket_reserve(struct hbucket **pn, size_t dsize, u8 ahash_max)
+{
+	struct hbucket *n = *pn;
+	u8 used, size;
+	int ret;
+
+	if (n && n->pos < n->size)
+		return n->pos;
+
+	used = n ? bitmap_weight(n->used, n->pos) : 0;
+	if (used >= ahash_max)
+		/* Trigger rehashing */
+		return -EAGAIN;
+	if (!n)
+		size = AHASH_INIT_SIZE;
+	else if (used < n->size)
+		/* Just squeeze out the deleted entries */
+		size = n->size;
+	else
+		size = n->size + AHASH_INIT_SIZE;
+
+	ret = hbucket_copy(pn, size, dsize);
+	if (ret < 0)
+		return ret;
+	return (*pn)->pos;
+}
+
+/* Make the entry filled in at position pos visible to the readers */
+static inline void
+hbucket_commit(struct hbucket *n, u8 pos)
+{
+	smp_wmb();
+	set_bit(pos, n->used);
+	n->pos++;
+}
+
+/* Free up space after entries were removed from the bucket *pn */
+static void
+hbucket_shrink(struct hbucket **pn, size_t dsize)
+{
+	struct hbucket *n = *pn;
+	u8 used = bitmap_weight(n->used, n->pos);
+
+	if (!used) {
+		RCU_INIT_POINTER(*pn, NULL);
+		call_rcu_bh(&n->rcu, hbucket_free_rcu);
+	} else if (used + AHASH_INIT_SIZE < n->size)
+		/* Failing to shrink is harmless */
+		hbucket_copy(pn, n->size - AHASH_INIT_SIZE, dsize);
+}
+
+/* Remove the entry at position pos from the bucket *pn */
+static inline void
+hbucket_del(struct hbucket **pn, u8 pos, size_t dsize)
+{
+	clear_bit(pos, (*pn)->used);
+	hbucket_shrink(pn, dsize);
+}
 
 /* Book-keeping of the prefixes added to the set */
 struct ip_set_hash_nets {
@@ -170,9 +281,9 @@ ahash_destroy(struct htable *t)
 
 	for (i = 0; i < jhash_size(t->htable_bits); i++) {
 		n = hbucket(t, i);
-		if (n->size)
+		if (n)
 			/* FIXME: use slab cache */
-			kfree(n->value);
+			kfree(n);
 	}
 
 	ip_set_free(t);
@@ -189,10 +300,12 @@ ahash_memsize(const struct ip_set_hash *h, size_t dsize, u8 host_mask)
 #ifdef IP_SET_HASH_WITH_NETS
 			 + sizeof(struct ip_set_hash_nets) * host_mask
 #endif
-			 + jhash_size(t->htable_bits) * sizeof(struct hbucket);
+			 + jhash_size(t->htable_bits) * sizeof(struct hbucket *);
 
 	for (i = 0; i < jhash_size(t->htable_bits); i++)
-			memsize += t->bucket[i].size * dsize;
+		if (t->bucket[i])
+			memsize += sizeof(struct hbucket)
+				   + t->bucket[i]->size * dsize;
 
 	return memsize;
 }
@@ -208,10 +321,9 @@ ip_set_hash_flush(struct ip_set *set)
 
 	for (i = 0; i < jhash_size(t->htable_bits); i++) {
 		n = hbucket(t, i);
-		if (n->size) {
-			n->size = n->pos = 0;
-			/* FIXME: use slab cache */
-			kfree(n->value);
+		if (n) {
+			RCU_INIT_POINTER(hbucket(t, i), NULL);
+			call_rcu_bh(&n->rcu, hbucket_free_rcu);
 		}
 	}
 #ifdef IP_SET_HASH_WITH_NETS
@@ -307,30 +419,16 @@ ip_set_hash_destroy(struct ip_set *set)
 /* Add an element to the hash table when resizing the set:
  * we spare the maintenance of the internal counters. */
 static int
-type_pf_elem_add(struct hbucket *n, const struct type_pf_elem *value,
+type_pf_elem_add(struct hbucket **pn, const struct type_pf_elem *value,
 		 u8 ahash_max)
 {
-	if (n->pos >= n->size) {
-		void *tmp;
-
-		if (n->size >= ahash_max)
-			/* Trigger rehashing */
-			return -EAGAIN;
-
-		tmp = kzalloc((n->size + AHASH_INIT_SIZE)
-			      * sizeof(struct type_pf_elem),
-			      GFP_ATOMIC);
-		if (!tmp)
-			return -ENOMEM;
-		if (n->size) {
-			memcpy(tmp, n->value,
-			       sizeof(struct type_pf_elem) * n->size);
-			kfree(n->value);
-		}
-		n->value = tmp;
-		n->size += AHASH_INIT_SIZE;
-	}
-	type_pf_data_copy(ahash_data(n, n->pos++), value);
+	int pos;
+
+	pos = hbucket_reserve(pn, sizeof(struct type_pf_elem), ahash_max);
+	if (pos < 0)
+		return pos;
+	type_pf_data_copy(ahash_data(*pn, pos), value);
+	hbucket_commit(*pn, pos);
 	return 0;
 }
 
@@ -344,7 +442,7 @@ type_pf_resize(struct ip_set *set, bool retried)
 	struct htable *t, *orig = h->table;
 	u8 htable_bits = orig->htable_bits;
 	const struct type_pf_elem *data;
-	struct hbucket *n, *m;
+	struct hbucket *n, **m;
 	u32 i, j;
 	int ret;
 
@@ -357,7 +455,7 @@ retry:
 		/* In case we have plenty of memory :-) */
 		return -IPSET_ERR_HASH_FULL;
 	t = ip_set_alloc(sizeof(*t)
-			 + jhash_size(htable_bits) * sizeof(struct hbucket));
+			 + jhash_size(htable_bits) * sizeof(struct hbucket *));
 	if (!t)
 		return -ENOMEM;
 	t->htable_bits = htable_bits;
@@ -365,9 +463,13 @@ retry:
 	read_lock_bh(&set->lock);
 	for (i = 0; i < jhash_size(orig->htable_bits); i++) {
 		n = hbucket(orig, i);
+		if (!n)
+			continue;
 		for (j = 0; j < n->pos; j++) {
+			if (!test_bit(j, n->used))
+				continue;
 			data = ahash_data(n, j);
-			m = hbucket(t, HKEY(data, h->initval, htable_bits));
+			m = &hbucket(t, HKEY(data, h->initval, htable_bits));
 			ret = type_pf_elem_add(m, data, AHASH_MAX(h));
 			if (ret < 0) {
 				read_unlock_bh(&set->lock);
@@ -414,13 +516,14 @@ type_pf_add(struct ip_set *set, void *value, u32 timeout, u32 flags)
 	t = rcu_dereference_bh(h->table);
 	key = HKEY(value, h->initval, t->htable_bits);
 	n = hbucket(t, key);
-	for (i = 0; i < n->pos; i++)
-		if (type_pf_data_equal(ahash_data(n, i), d, &multi)) {
+	for (i = 0; n && i < n->pos; i++)
+		if (test_bit(i, n->used) &&
+		    type_pf_data_equal(ahash_data(n, i), d, &multi)) {
 			ret = -IPSET_ERR_EXIST;
 			goto out;
 		}
 	TUNE_AHASH_MAX(h, multi);
-	ret = type_pf_elem_add(n, value, AHASH_MAX(h));
+	ret = type_pf_elem_add(&hbucket(t, key), value, AHASH_MAX(h));
 	if (ret != 0) {
 		if (ret == -EAGAIN)
 			type_pf_data_next(h, d);
@@ -436,8 +539,7 @@ out:
 	return ret;
 }
 
-/* Delete an element from the hash: swap it with the last element
- * and free up space if possible.
+/* Delete an element from the hash and free up space if possible.
  */
 static int
 type_pf_del(struct ip_set *set, void *value, u32 timeout, u32 flags)
@@ -452,31 +554,18 @@ type_pf_del(struct ip_set *set, void *value, u32 timeout, u32 flags)
 
 	key = HKEY(value, h->initval, t->htable_bits);
 	n = hbucket(t, key);
-	for (i = 0; i < n->pos; i++) {
+	for (i = 0; n && i < n->pos; i++) {
+		if (!test_bit(i, n->used))
+			continue;
 		data = ahash_data(n, i);
 		if (!type_pf_data_equal(data, d, &multi))
 			continue;
-		if (i != n->pos - 1)
-			/* Not last one */
-			type_pf_data_copy(data, ahash_data(n, n->pos - 1));
 
-		n->pos--;
 		h->elements--;
 #ifdef IP_SET_HASH_WITH_NETS
 		del_cidr(h, d->cidr, HOST_MASK);
 #endif
-		if (n->pos + AHASH_INIT_SIZE < n->size) {
-			void *tmp = kzalloc((n->size - AHASH_INIT_SIZE)
-					    * sizeof(struct type_pf_elem),
-					    GFP_ATOMIC);
-			if (!tmp)
-				return 0;
-			n->size -= AHASH_INIT_SIZE;
-			memcpy(tmp, n->value,
-			       n->size * sizeof(struct type_pf_elem));
-			kfree(n->value);
-			n->value = tmp;
-		}
+		hbucket_del(&hbucket(t, key), i, sizeof(struct type_pf_elem));
 		return 0;
 	}
 
@@ -491,7 +580,7 @@ static int
 type_pf_test_cidrs(struct ip_set *set, struct type_pf_elem *d, u32 timeout)
 {
 	struct ip_set_hash *h = set->data;
-	struct htable *t = h->table;
+	struct htable *t = rcu_dereference_bh(h->table);
 	struct hbucket *n;
 	const struct type_pf_elem *data;
 	int i, j = 0;
@@ -502,8 +591,10 @@ type_pf_test_cidrs(struct ip_set *set, struct type_pf_elem *d, u32 timeout)
 	for (; j < host_mask && h->nets[j].cidr && !multi; j++) {
 		type_pf_data_netmask(d, h->nets[j].cidr);
 		key = HKEY(d, h->initval, t->htable_bits);
-		n = hbucket(t, key);
-		for (i = 0; i < n->pos; i++) {
+		n = rcu_dereference_bh(hbucket(t, key));
+		for (i = 0; n && i < n->pos; i++) {
+			if (!test_bit(i, n->used))
+				continue;
 			data = ahash_data(n, i);
 			if (type_pf_data_equal(data, d, &multi))
 				return 1;
@@ -518,7 +609,7 @@ static int
 type_pf_test(struct ip_set *set, void *value, u32 timeout, u32 flags)
 {
 	struct ip_set_hash *h = set->data;
-	struct htable *t = h->table;
+	struct htable *t = rcu_dereference_bh(h->table);
 	struct type_pf_elem *d = value;
 	struct hbucket *n;
 	const struct type_pf_elem *data;
@@ -533,8 +624,10 @@ type_pf_test(struct ip_set *set, void *value, u32 timeout, u32 flags)
 #endif
 
 	key = HKEY(d, h->initval, t->htable_bits);
-	n = hbucket(t, key);
-	for (i = 0; i < n->pos; i++) {
+	n = rcu_dereference_bh(hbucket(t, key));
+	for (i = 0; n && i < n->pos; i++) {
+		if (!test_bit(i, n->used))
+			continue;
 		data = ahash_data(n, i);
 		if (type_pf_data_equal(data, d, &multi))
 			return 1;
@@ -601,7 +694,9 @@ type_pf_list(const struct ip_set *set,
 		incomplete = skb_tail_pointer(skb);
 		n = hbucket(t, cb->args[2]);
 		pr_debug("cb->args[2]: %lu, t %p n %p\n", cb->args[2], t, n);
-		for (i = 0; i < n->pos; i++) {
+		for (i = 0; n && i < n->pos; i++) {
+			if (!test_bit(i, n->used))
+				continue;
 			data = ahash_data(n, i);
 			pr_debug("list hash %lu hbucket %p i %u, data %p\n",
 				 cb->args[2], n, i, data);
@@ -658,6 +753,9 @@ static const struct ip_set_type_variant type_pf_variant = {
 	.list	= type_pf_list,
 	.resize	= type_pf_resize,
 	.same_set = type_pf_same_set,
+#ifndef IP_SET_HASH_WITH_RBTREE
+	.lockless_test = true,
+#endif
 };
 
 /* Flavour with timeout support */
@@ -692,34 +790,19 @@ type_pf_data_timeout_set(struct type_pf_elem *data, u32 timeout)
 }
 
 static int
-type_pf_elem_tadd(struct hbucket *n, const struct type_pf_elem *value,
+type_pf_elem_tadd(struct hbucket **pn, const struct type_pf_elem *value,
 		  u8 ahash_max, u32 timeout)
 {
 	struct type_pf_elem *data;
+	int pos;
 
-	if (n->pos >= n->size) {
-		void *tmp;
-
-		if (n->size >= ahash_max)
-			/* Trigger rehashing */
-			return -EAGAIN;
-
-		tmp = kzalloc((n->size + AHASH_INIT_SIZE)
-			      * sizeof(struct type_pf_telem),
-			      GFP_ATOMIC);
-		if (!tmp)
-			return -ENOMEM;
-		if (n->size) {
-			memcpy(tmp, n->value,
-			       sizeof(struct type_pf_telem) * n->size);
-			kfree(n->value);
-		}
-		n->value = tmp;
-		n->size += AHASH_INIT_SIZE;
-	}
-	data = ahash_tdata(n, n->pos++);
+	pos = hbucket_reserve(pn, sizeof(struct type_pf_telem), ahash_max);
+	if (pos < 0)
+		return pos;
+	data = ahash_tdata(*pn, pos);
 	type_pf_data_copy(data, value);
 	type_pf_data_timeout_set(data, timeout);
+	hbucket_commit(*pn, pos);
 	return 0;
 }
 
@@ -735,34 +818,22 @@ type_pf_expire(struct ip_set_hash *h)
 
 	for (i = 0; i < jhash_size(t->htable_bits); i++) {
 		n = hbucket(t, i);
+		if (!n)
+			continue;
 		for (j = 0; j < n->pos; j++) {
+			if (!test_bit(j, n->used))
+				continue;
 			data = ahash_tdata(n, j);
 			if (type_pf_data_expired(data)) {
 				pr_debug("expired %u/%u\n", i, j);
 #ifdef IP_SET_HASH_WITH_NETS
 				del_cidr(h, data->cidr, HOST_MASK);
 #endif
-				if (j != n->pos - 1)
-					/* Not last one */
-					type_pf_data_copy(data,
-						ahash_tdata(n, n->pos - 1));
-				n->pos--;
+				clear_bit(j, n->used);
 				h->elements--;
 			}
 		}
-		if (n->pos + AHASH_INIT_SIZE < n->size) {
-			void *tmp = kzalloc((n->size - AHASH_INIT_SIZE)
-					    * sizeof(struct type_pf_telem),
-					    GFP_ATOMIC);
-			if (!tmp)
-				/* Still try to delete expired elements */
-				continue;
-			n->size -= AHASH_INIT_SIZE;
-			memcpy(tmp, n->value,
-			       n->size * sizeof(struct type_pf_telem));
-			kfree(n->value);
-			n->value = tmp;
-		}
+		hbucket_shrink(&hbucket(t, i), sizeof(struct type_pf_telem));
 	}
 }
 
@@ -773,7 +844,7 @@ type_pf_tresize(struct ip_set *set, bool retried)
 	struct htable *t, *orig = h->table;
 	u8 htable_bits = orig->htable_bits;
 	const struct type_pf_elem *data;
-	struct hbucket *n, *m;
+	struct hbucket *n, **m;
 	u32 i, j;
 	int ret;
 
@@ -794,7 +865,7 @@ retry:
 		/* In case we have plenty of memory :-) */
 		return -IPSET_ERR_HASH_FULL;
 	t = ip_set_alloc(sizeof(*t)
-			 + jhash_size(htable_bits) * sizeof(struct hbucket));
+			 + jhash_size(htable_bits) * sizeof(struct hbucket *));
 	if (!t)
 		return -ENOMEM;
 	t->htable_bits = htable_bits;
@@ -802,9 +873,13 @@ retry:
 	read_lock_bh(&set->lock);
 	for (i = 0; i < jhash_size(orig->htable_bits); i++) {
 		n = hbucket(orig, i);
+		if (!n)
+			continue;
 		for (j = 0; j < n->pos; j++) {
+			if (!test_bit(j, n->used))
+				continue;
 			data = ahash_tdata(n, j);
-			m = hbucket(t, HKEY(data, h->initval, htable_bits));
+			m = &hbucket(t, HKEY(data, h->initval, htable_bits));
 			ret = type_pf_elem_tadd(m, data, AHASH_MAX(h),
 						type_pf_data_timeout(data));
 			if (ret < 0) {
@@ -837,7 +912,7 @@ type_pf_tadd(struct ip_set *set, void *value, u32 timeout, u32 flags)
 	struct hbucket *n;
 	struct type_pf_elem *data;
 	int ret = 0, i, j = AHASH_MAX(h) + 1;
-	bool flag_exist = flags & IPSET_FLAG_EXIST;
+	bool flag_exist = flags & IPSET_FLAG_EXIST, same = false;
 	u32 key, multi = 0;
 
 	if (h->elements >= h->maxelem)
@@ -850,12 +925,16 @@ type_pf_tadd(struct ip_set *set, void *value, u32 timeout, u32 flags)
 	t = rcu_dereference_bh(h->table);
 	key = HKEY(d, h->initval, t->htable_bits);
 	n = hbucket(t, key);
-	for (i = 0; i < n->pos; i++) {
+	for (i = 0; n && i < n->pos; i++) {
+		if (!test_bit(i, n->used))
+			continue;
 		data = ahash_tdata(n, i);
 		if (type_pf_data_equal(data, d, &multi)) {
-			if (type_pf_data_expired(data) || flag_exist)
+			if (type_pf_data_expired(data) || flag_exist) {
 				j = i;
-			else {
+				same = true;
+				break;
+			} else {
 				ret = -IPSET_ERR_EXIST;
 				goto out;
 			}
@@ -865,16 +944,21 @@ type_pf_tadd(struct ip_set *set, void *value, u32 timeout, u32 flags)
 	}
 	if (j != AHASH_MAX(h) + 1) {
 		data = ahash_tdata(n, j);
+		if (same) {
+			/* Only the timeout changes, readers may see either */
+			type_pf_data_timeout_set(data, timeout);
+			goto out;
+		}
+		/* Don't overwrite the expired entry under the readers,
+		 * remove it and add the new one as usual */
 #ifdef IP_SET_HASH_WITH_NETS
 		del_cidr(h, data->cidr, HOST_MASK);
-		add_cidr(h, d->cidr, HOST_MASK);
 #endif
-		type_pf_data_copy(data, d);
-		type_pf_data_timeout_set(data, timeout);
-		goto out;
+		h->elements--;
+		hbucket_del(&hbucket(t, key), j, sizeof(struct type_pf_telem));
 	}
 	TUNE_AHASH_MAX(h, multi);
-	ret = type_pf_elem_tadd(n, d, AHASH_MAX(h), timeout);
+	ret = type_pf_elem_tadd(&hbucket(t, key), d, AHASH_MAX(h), timeout);
 	if (ret != 0) {
 		if (ret == -EAGAIN)
 			type_pf_data_next(h, d);
@@ -903,33 +987,20 @@ type_pf_tdel(struct ip_set *set, void *value, u32 timeout, u32 flags)
 
 	key = HKEY(value, h->initval, t->htable_bits);
 	n = hbucket(t, key);
-	for (i = 0; i < n->pos; i++) {
+	for (i = 0; n && i < n->pos; i++) {
+		if (!test_bit(i, n->used))
+			continue;
 		data = ahash_tdata(n, i);
 		if (!type_pf_data_equal(data, d, &multi))
 			continue;
 		if (type_pf_data_expired(data))
 			return -IPSET_ERR_EXIST;
-		if (i != n->pos - 1)
-			/* Not last one */
-			type_pf_data_copy(data, ahash_tdata(n, n->pos - 1));
 
-		n->pos--;
 		h->elements--;
 #ifdef IP_SET_HASH_WITH_NETS
 		del_cidr(h, d->cidr, HOST_MASK);
 #endif
-		if (n->pos + AHASH_INIT_SIZE < n->size) {
-			void *tmp = kzalloc((n->size - AHASH_INIT_SIZE)
-					    * sizeof(struct type_pf_telem),
-					    GFP_ATOMIC);
-			if (!tmp)
-				return 0;
-			n->size -= AHASH_INIT_SIZE;
-			memcpy(tmp, n->value,
-			       n->size * sizeof(struct type_pf_telem));
-			kfree(n->value);
-			n->value = tmp;
-		}
+		hbucket_del(&hbucket(t, key), i, sizeof(struct type_pf_telem));
 		return 0;
 	}
 
@@ -941,7 +1012,7 @@ static int
 type_pf_ttest_cidrs(struct ip_set *set, struct type_pf_elem *d, u32 timeout)
 {
 	struct ip_set_hash *h = set->data;
-	struct htable *t = h->table;
+	struct htable *t = rcu_dereference_bh(h->table);
 	struct type_pf_elem *data;
 	struct hbucket *n;
 	int i, j = 0;
@@ -951,8 +1022,10 @@ type_pf_ttest_cidrs(struct ip_set *set, struct type_pf_elem *d, u32 timeout)
 	for (; j < host_mask && h->nets[j].cidr && !multi; j++) {
 		type_pf_data_netmask(d, h->nets[j].cidr);
 		key = HKEY(d, h->initval, t->htable_bits);
-		n = hbucket(t, key);
-		for (i = 0; i < n->pos; i++) {
+		n = rcu_dereference_bh(hbucket(t, key));
+		for (i = 0; n && i < n->pos; i++) {
+			if (!test_bit(i, n->used))
+				continue;
 			data = ahash_tdata(n, i);
 			if (type_pf_data_equal(data, d, &multi))
 				return !type_pf_data_expired(data);
@@ -966,7 +1039,7 @@ static int
 type_pf_ttest(struct ip_set *set, void *value, u32 timeout, u32 flags)
 {
 	struct ip_set_hash *h = set->data;
-	struct htable *t = h->table;
+	struct htable *t = rcu_dereference_bh(h->table);
 	struct type_pf_elem *data, *d = value;
 	struct hbucket *n;
 	int i;
@@ -977,8 +1050,10 @@ type_pf_ttest(struct ip_set *set, void *value, u32 timeout, u32 flags)
 		return type_pf_ttest_cidrs(set, d, timeout);
 #endif
 	key = HKEY(d, h->initval, t->htable_bits);
-	n = hbucket(t, key);
-	for (i = 0; i < n->pos; i++) {
+	n = rcu_dereference_bh(hbucket(t, key));
+	for (i = 0; n && i < n->pos; i++) {
+		if (!test_bit(i, n->used))
+			continue;
 		data = ahash_tdata(n, i);
 		if (type_pf_data_equal(data, d, &multi))
 			return !type_pf_data_expired(data);
@@ -1006,7 +1081,9 @@ type_pf_tlist(const struct ip_set *set,
 	for (; cb->args[2] < jhash_size(t->htable_bits); cb->args[2]++) {
 		incomplete = skb_tail_pointer(skb);
 		n = hbucket(t, cb->args[2]);
-		for (i = 0; i < n->pos; i++) {
+		for (i = 0; n && i < n->pos; i++) {
+			if (!test_bit(i, n->used))
+				continue;
 			data = ahash_tdata(n, i);
 			pr_debug("list %p %u\n", n, i);
 			if (type_pf_data_expired(data))
@@ -1057,6 +1134,9 @@ static const struct ip_set_type_variant type_pf_tvariant = {
 	.list	= type_pf_tlist,
 	.resize	= type_pf_tresize,
 	.same_set = type_pf_same_set,
+#ifndef IP_SET_HASH_WITH_RBTREE
+	.lockless_test = true,
+#endif
 };
 
 static void
@@ -108,6 +108,10 @@ enum pageflags {
 	PG_compound_lock,
 #endif
 	PG_readaheadunused,	/* user oriented readahead as yet unused*/
+#ifdef CONFIG_IDLE_PAGE_TRACKING
+	PG_young,		/* Idle tracking took a pte young bit reclaim wants */
+	PG_idle,		/* Not accessed since marked idle */
+#endif
 	__NR_PAGEFLAGS,
 
 	/* Filesystems */
@@ -233,6 +237,14 @@ PAGEFLAG(Readahead, reclaim)		/* Reminder to do async read-ahead */
 
 PAGEFLAG(ReadaheadUnused, readaheadunused)
 
+#ifdef CONFIG_IDLE_PAGE_TRACKING
+PAGEFLAG(Young, young) TESTCLEARFLAG(Young, young)
+PAGEFLAG(Idle, idle)
+#else
+PAGEFLAG_FALSE(Young) SETPAGEFLAG_NOOP(Young) TESTCLEARFLAG_FALSE(Young)
+PAGEFLAG_FALSE(Idle) SETPAGEFLAG_NOOP(Idle) CLEARPAGEFLAG_NOOP(Idle)
+#endif
+
 #ifdef CONFIG_HIGHMEM
 /*
  * Must use a macro here due to header dependency issues. page_zone() is not
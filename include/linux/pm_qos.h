@@ -21,6 +21,7 @@
 #define PM_QOS_NETWORK_LAT_DEFAULT_VALUE	(2000 * USEC_PER_SEC)
 #define PM_QOS_NETWORK_THROUGHPUT_DEFAULT_VALUE	0
 #define PM_QOS_DEV_LAT_DEFAULT_VALUE		0
+#define PM_QOS_CPU_RESUME_LAT_DEFAULT_VALUE	PM_QOS_CPU_DMA_LAT_DEFAULT_VALUE
 
 struct pm_qos_request {
 	struct plist_node node;
@@ -32,6 +33,12 @@ struct dev_pm_qos_request {
 	struct device *dev;
 };
 
+/* Resume latency limit of a single CPU, in usec */
+struct cpu_pm_qos_request {
+	struct plist_node node;
+	struct pm_qos_constraints *constraints;
+};
+
 enum pm_qos_type {
 	PM_QOS_UNITIALIZED,
 	PM_QOS_MAX,		/* return the largest value */
@@ -63,6 +70,11 @@ static inline int dev_pm_qos_request_active(struct dev_pm_qos_request *req)
 	return req->dev != 0;
 }
 
+static inline int cpu_pm_qos_request_active(struct cpu_pm_qos_request *req)
+{
+	return req->constraints != NULL;
+}
+
 #ifdef CONFIG_PM
 int pm_qos_update_target(struct pm_qos_constraints *c, struct plist_node *node,
 			 enum pm_qos_req_action action, int value);
@@ -91,6 +103,14 @@ int dev_pm_qos_add_global_notifier(struct notifier_block *notifier);
 int dev_pm_qos_remove_global_notifier(struct notifier_block *notifier);
 void dev_pm_qos_constraints_init(struct device *dev);
 void dev_pm_qos_constraints_destroy(struct device *dev);
+
+s32 cpu_pm_qos_read_value(int cpu);
+void cpu_pm_qos_add_request(struct cpu_pm_qos_request *req, int cpu,
+			    s32 value);
+void cpu_pm_qos_update_request(struct cpu_pm_qos_request *req, s32 new_value);
+void cpu_pm_qos_remove_request(struct cpu_pm_qos_request *req);
+int cpu_pm_qos_add_notifier(struct notifier_block *notifier);
+int cpu_pm_qos_remove_notifier(struct notifier_block *notifier);
 #else
 static inline int pm_qos_update_target(struct pm_qos_constraints *c,
 				       struct plist_node *node,
@@ -162,6 +182,21 @@ static inline void dev_pm_qos_constraints_destroy(struct device *dev)
 {
 	dev->power.power_state = PMSG_INVALID;
 }
+
+static inline s32 cpu_pm_qos_read_value(int cpu)
+			{ return PM_QOS_CPU_RESUME_LAT_DEFAULT_VALUE; }
+static inline void cpu_pm_qos_add_request(struct cpu_pm_qos_request *req,
+					  int cpu, s32 value)
+			{ return; }
+static inline void cpu_pm_qos_update_request(struct cpu_pm_qos_request *req,
+					     s32 new_value)
+			{ return; }
+static inline void cpu_pm_qos_remove_request(struct cpu_pm_qos_request *req)
+			{ return; }
+static inline int cpu_pm_qos_add_notifier(struct notifier_block *notifier)
+			{ return 0; }
+static inline int cpu_pm_qos_remove_notifier(struct notifier_block *notifier)
+			{ return 0; }
 #endif
 
 #endif
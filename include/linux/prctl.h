@@ -136,4 +136,14 @@
 #define PR_SET_NO_NEW_PRIVS 38
 #define PR_GET_NO_NEW_PRIVS 39
 
+/*
+ * Share the page tables of private anonymous memory copy-on-write with
+ * children instead of copying them on fork: fork then takes time in
+ * proportion to the address space size in 2MB units instead of the
+ * resident set size.  Each page table is copied on the first fault on
+ * it in either process.  Not inherited, and cleared by execve.
+ */
+#define PR_SET_FORK_SHARE_PTE 40
+#define PR_GET_FORK_SHARE_PTE 41
+
 #endif /* _LINUX_PRCTL_H */
@@ -72,6 +72,12 @@ void srandom32(u32 seed);
 
 u32 prandom32(struct rnd_state *);
 
+/* Pseudo random number generator from numerical recipes. */
+static inline u32 next_pseudo_random32(u32 seed)
+{
+	return seed * 1664525 + 1013904223;
+}
+
 /*
  * Handle minimum values for seeds
  */
@@ -180,6 +180,7 @@ enum ttu_flags {
 	TTU_IGNORE_MLOCK = (1 << 8),	/* ignore mlock */
 	TTU_IGNORE_ACCESS = (1 << 9),	/* don't age */
 	TTU_IGNORE_HWPOISON = (1 << 10),/* corrupted page is recoverable */
+	TTU_LAZYFREE = (1 << 11),	/* discard clean anon, see MADV_FREE */
 };
 #define TTU_ACTION(x) ((x) & TTU_ACTION_MASK)
 
@@ -269,5 +270,6 @@ static inline int page_mkclean(struct page *page)
 #define SWAP_AGAIN	1
 #define SWAP_FAIL	2
 #define SWAP_MLOCK	3
+#define SWAP_DIRTY	4
 
 #endif	/* _LINUX_RMAP_H */
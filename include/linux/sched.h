@@ -39,6 +39,7 @@
 #define SCHED_BATCH		3
 /* SCHED_ISO: reserved but not implemented yet */
 #define SCHED_IDLE		5
+#define SCHED_DEADLINE		6
 /* Can be ORed in to make sure the process is reverted back to SCHED_NORMAL on fork */
 #define SCHED_RESET_ON_FORK     0x40000000
 
@@ -101,6 +102,7 @@ struct bio_list;
 struct fs_struct;
 struct perf_event_context;
 struct blk_plug;
+struct uprobe_task;
 
 extern int disable_nx;
 extern int print_fatal_signals;
@@ -277,6 +279,7 @@ extern int runqueue_is_locked(int cpu);
 
 #if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ)
 extern void select_nohz_load_balancer(int stop_tick);
+extern bool nohz_timer_should_migrate(int cpu);
 extern int get_nohz_timer_target(void);
 #else
 static inline void select_nohz_load_balancer(int stop_tick) { }
@@ -447,6 +450,9 @@ extern int get_dumpable(struct mm_struct *mm);
 					/* leave room for more dump flags */
 #define MMF_VM_MERGEABLE	16	/* KSM may merge identical pages */
 #define MMF_VM_HUGEPAGE		17	/* set when VM_HUGEPAGE is set on vma */
+#define MMF_FORK_SHARE_PTE	18	/* share page tables with forked children */
+#define MMF_SHARED_PTE		19	/* may map page tables shared by fork */
+#define MMF_HAS_UPROBES		20	/* might have uprobe breakpoints */
 
 #define MMF_INIT_MASK		(MMF_DUMPABLE_MASK | MMF_DUMP_FILTER_MASK)
 
@@ -756,6 +762,17 @@ struct sched_info {
 #endif /* defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT) */
 
 #ifdef CONFIG_TASK_DELAY_ACCT
+enum delayacct_class {
+	DELAYACCT_BLKIO,
+	DELAYACCT_SWAPIN,
+	DELAYACCT_FREEPAGES,
+	DELAYACCT_READ,
+	DELAYACCT_THROTTLE,
+	DELAYACCT_NR_CLASSES,
+};
+
+#define DELAYACCT_HIST_BUCKETS	24
+
 struct task_delay_info {
 	spinlock_t	lock;
 	unsigned int	flags;	/* Private per-task flags */
@@ -775,7 +792,8 @@ struct task_delay_info {
 	 * associated with the operation is added to XXX_delay.
 	 * XXX_delay contains the accumulated delay time in nanoseconds.
 	 */
-	struct timespec blkio_start, blkio_end;	/* Shared by blkio, swapin */
+	struct timespec blkio_start, blkio_end;	/* Shared by blkio, swapin, */
+						/* read, dirty throttle */
 	u64 blkio_delay;	/* wait for sync block io completion */
 	u64 swapin_delay;	/* wait for swapin block io completion */
 	u32 blkio_count;	/* total count of the number of sync block */
@@ -786,6 +804,14 @@ struct task_delay_info {
 	struct timespec freepages_start, freepages_end;
 	u64 freepages_delay;	/* wait for memory reclaim */
 	u32 freepages_count;	/* total count of memory reclaim */
+
+	u64 read_delay;		/* wait for page cache miss reads */
+	u32 read_count;
+	u64 throttle_delay;	/* wait in balance_dirty_pages() */
+	u32 throttle_count;
+
+	/* log2 distribution of each delay, see delayacct_hist_bucket() */
+	u32 hist[DELAYACCT_NR_CLASSES][DELAYACCT_HIST_BUCKETS];
 };
 #endif	/* CONFIG_TASK_DELAY_ACCT */
 
@@ -1035,6 +1061,9 @@ extern void partition_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
 cpumask_var_t *alloc_sched_domains(unsigned int ndoms);
 void free_sched_domains(cpumask_var_t doms[], unsigned int ndoms);
 
+/* Isolate cpus at runtime, on top of isolcpus= */
+extern void sched_set_isolated_cpus(const struct cpumask *cpus);
+
 /* Test a flag in parent sched domain */
 static inline int test_sd_parent(struct sched_domain *sd, int flag)
 {
@@ -1056,8 +1085,32 @@ partition_sched_domains(int ndoms_new, cpumask_var_t doms_new[],
 			struct sched_domain_attr *dattr_new)
 {
 }
+
+static inline void sched_set_isolated_cpus(const struct cpumask *cpus)
+{
+}
 #endif	/* !CONFIG_SMP */
 
+#ifdef CONFIG_CPU_FREQ
+/*
+ * Called by the scheduler with the rq lock of @cpu held whenever the
+ * number of runnable tasks on it changes and on every tick.  @time is
+ * the rq clock, @busy_time the total time the cpu has had runnable
+ * tasks, both in ns.
+ */
+struct update_util_data {
+	void (*func)(struct update_util_data *data, u64 time, u64 busy_time,
+		     unsigned int flags);
+};
+
+#define SCHED_CPUFREQ_RT	(1U << 0)	/* RT or deadline tasks queued */
+
+extern void cpufreq_add_update_util_hook(int cpu,
+		struct update_util_data *data,
+		void (*func)(struct update_util_data *data, u64 time,
+			     u64 busy_time, unsigned int flags));
+extern void cpufreq_remove_update_util_hook(int cpu);
+#endif
 
 struct io_context;			/* See blkdev.h */
 
@@ -1133,6 +1186,8 @@ struct sched_class {
 	unsigned int (*get_rr_interval) (struct rq *rq,
 					 struct task_struct *task);
 
+	void (*task_dead) (struct task_struct *p);
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	void (*task_move_group) (struct task_struct *p, int on_rq);
 #endif
@@ -1221,6 +1276,62 @@ struct sched_rt_entity {
 #endif
 };
 
+/*
+ * Extended scheduling parameters, see sys_sched_setattr(). Times are in
+ * nanoseconds and only used by SCHED_DEADLINE: the task gets up to
+ * @sched_runtime of CPU time every @sched_period, to be consumed before
+ * @sched_deadline from the start of the period. A zero @sched_period
+ * means it equals @sched_deadline.
+ */
+#define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
+
+#define SCHED_FLAG_RESET_ON_FORK	0x01
+
+struct sched_attr {
+	u32 size;
+
+	u32 sched_policy;
+	u64 sched_flags;
+
+	/* SCHED_NORMAL, SCHED_BATCH */
+	s32 sched_nice;
+
+	/* SCHED_FIFO, SCHED_RR */
+	u32 sched_priority;
+
+	/* SCHED_DEADLINE */
+	u64 sched_runtime;
+	u64 sched_deadline;
+	u64 sched_period;
+};
+
+/*
+ * SCHED_DEADLINE entity. The dl_* fields are the parameters set by
+ * sched_setattr(), @runtime and @deadline the current CBS budget and
+ * absolute deadline (rq->clock based).
+ */
+struct sched_dl_entity {
+	struct rb_node	rb_node;
+
+	u64 dl_runtime;		/* maximum runtime for each instance	*/
+	u64 dl_deadline;	/* relative deadline of each instance	*/
+	u64 dl_period;		/* separation of two instances		*/
+	u64 dl_bw;		/* dl_runtime / dl_period, << 20	*/
+
+	s64 runtime;		/* remaining runtime for this instance	*/
+	u64 deadline;		/* absolute deadline for this instance	*/
+
+	/*
+	 * @dl_new: the parameters were just set, start a new instance at
+	 * the next enqueue. @dl_throttled: the budget is exhausted, the
+	 * entity waits for dl_timer to replenish it. @dl_yielded: the
+	 * task gave up the rest of this instance.
+	 */
+	int dl_new, dl_throttled, dl_yielded;
+
+	struct hrtimer dl_timer;
+};
+
 struct rcu_node;
 
 enum perf_event_task_context {
@@ -1248,6 +1359,7 @@ struct task_struct {
 	const struct sched_class *sched_class;
 	struct sched_entity se;
 	struct sched_rt_entity rt;
+	struct sched_dl_entity dl;
 #ifdef CONFIG_CGROUP_SCHED
 	struct task_group *sched_task_group;
 #endif
@@ -1288,6 +1400,9 @@ struct task_struct {
 #if defined(CONFIG_SCHEDSTATS) || defined(CONFIG_TASK_DELAY_ACCT)
 	struct sched_info sched_info;
 #endif
+#ifdef CONFIG_LATENCY_HIST
+	u64 wakeup_timestamp_hist;	/* see kernel/trace/latency_hist.c */
+#endif
 
 	struct list_head tasks;
 #ifdef CONFIG_SMP
@@ -1526,6 +1641,14 @@ struct task_struct {
 	struct mempolicy *mempolicy;	/* Protected by alloc_lock */
 	short il_next;
 	short pref_node_fork;
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	int numa_scan_seq;		/* mm->numa_scan_seq last seen */
+	unsigned int numa_scan_period;	/* ms of runtime between scans */
+	u64 node_stamp;			/* runtime at the last scan request */
+	int numa_work_pending;		/* scan on the way back to user */
+	int numa_preferred_nid;		/* node holding most of our faults */
+	unsigned long *numa_faults;	/* hinting faults per node */
 #endif
 	struct rcu_head rcu;
 
@@ -1590,6 +1713,9 @@ struct task_struct {
 #ifdef CONFIG_HAVE_HW_BREAKPOINT
 	atomic_t ptrace_bp_refcnt;
 #endif
+#ifdef CONFIG_UPROBES
+	struct uprobe_task *utask;
+#endif
 };
 
 /* Future-safe accessor for struct task_struct's cpus_allowed. */
@@ -1606,14 +1732,31 @@ struct task_struct {
  * user-space.  This allows kernel threads to set their
  * priority to a value higher than any user task. Note:
  * MAX_RT_PRIO must not be smaller than MAX_USER_RT_PRIO.
+ *
+ * SCHED_DEADLINE tasks run at prio MAX_DL_PRIO-1, above every RT
+ * priority.
  */
 
+#define MAX_DL_PRIO		0
+
 #define MAX_USER_RT_PRIO	100
 #define MAX_RT_PRIO		MAX_USER_RT_PRIO
 
 #define MAX_PRIO		(MAX_RT_PRIO + 40)
 #define DEFAULT_PRIO		(MAX_RT_PRIO + 20)
 
+static inline int dl_prio(int prio)
+{
+	if (unlikely(prio < MAX_DL_PRIO))
+		return 1;
+	return 0;
+}
+
+static inline int dl_task(struct task_struct *p)
+{
+	return dl_prio(p->prio);
+}
+
 static inline int rt_prio(int prio)
 {
 	if (unlikely(prio < MAX_RT_PRIO))
@@ -2011,6 +2154,19 @@ extern void sched_exec(void);
 #define sched_exec()   {}
 #endif
 
+#ifdef CONFIG_NUMA_BALANCING
+extern void task_numa_fault(int node, int pages);
+extern void task_numa_work(void);
+extern void task_numa_free(struct task_struct *p);
+#else
+static inline void task_numa_fault(int node, int pages)
+{
+}
+static inline void task_numa_free(struct task_struct *p)
+{
+}
+#endif
+
 extern void sched_clock_idle_sleep_event(void);
 extern void sched_clock_idle_wakeup_event(u64 delta_ns);
 
@@ -2026,6 +2182,14 @@ extern void wake_up_idle_cpu(int cpu);
 static inline void wake_up_idle_cpu(int cpu) { }
 #endif
 
+#ifdef CONFIG_NO_HZ_FULL
+extern bool sched_cpu_isolated(int cpu);
+extern bool sched_can_stop_tick(void);
+#else
+static inline bool sched_cpu_isolated(int cpu) { return false; }
+static inline bool sched_can_stop_tick(void) { return false; }
+#endif
+
 extern unsigned int sysctl_sched_latency;
 extern unsigned int sysctl_sched_min_granularity;
 extern unsigned int sysctl_sched_wakeup_granularity;
@@ -2050,6 +2214,13 @@ int sched_proc_update_handler(struct ctl_table *table, int write,
 		void __user *buffer, size_t *length,
 		loff_t *ppos);
 #endif
+#ifdef CONFIG_NUMA_BALANCING
+extern unsigned int sysctl_numa_balancing;
+extern unsigned int sysctl_numa_balancing_scan_delay;
+extern unsigned int sysctl_numa_balancing_scan_period_min;
+extern unsigned int sysctl_numa_balancing_scan_period_max;
+extern unsigned int sysctl_numa_balancing_scan_size;
+#endif
 #ifdef CONFIG_SCHED_DEBUG
 static inline unsigned int get_sysctl_timer_migration(void)
 {
@@ -2113,6 +2284,7 @@ extern int sched_setscheduler(struct task_struct *, int,
 			      const struct sched_param *);
 extern int sched_setscheduler_nocheck(struct task_struct *, int,
 				      const struct sched_param *);
+extern int sched_setattr(struct task_struct *, const struct sched_attr *);
 extern struct task_struct *idle_task(int cpu);
 extern struct task_struct *curr_task(int cpu);
 extern void set_curr_task(int cpu, struct task_struct *p);
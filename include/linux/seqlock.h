@@ -165,6 +165,22 @@ static inline unsigned read_seqcount_begin(const seqcount_t *s)
 	return ret;
 }
 
+/**
+ * raw_read_seqcount - read the seqcount without waiting for writers
+ * @s: pointer to seqcount_t
+ * Returns: count to be passed to read_seqcount_retry
+ *
+ * raw_read_seqcount is like read_seqcount_begin, but does not spin while
+ * a write is in progress: the caller has to check the low bit of the
+ * count itself, and typically gives up rather than waits when it is set.
+ */
+static inline unsigned raw_read_seqcount(const seqcount_t *s)
+{
+	unsigned ret = ACCESS_ONCE(s->sequence);
+	smp_rmb();
+	return ret;
+}
+
 /**
  * __read_seqcount_retry - end a seq-read critical section (without barrier)
  * @s: pointer to seqcount_t
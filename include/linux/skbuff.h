@@ -220,12 +220,22 @@ enum {
 /*
  * The callback notifies userspace to release buffers when skb DMA is done in
  * lower device, the skb last reference should be 0 when calling this.
+ * The zerocopy_success argument is true if zero copy transmit occurred,
+ * false on data copy or out of memory error caused by data copy attempt.
  * The desc is used to track userspace buffer index.
+ *
+ * Socket zerocopy (MSG_ZEROCOPY) buffers live in the cb of a notification
+ * skb and are shared by all skbs built from one sendmsg call: refcnt counts
+ * those skbs, and id/len give the range of sends reported on completion.
  */
 struct ubuf_info {
-	void (*callback)(void *);
+	void (*callback)(struct ubuf_info *, bool zerocopy_success);
 	void *arg;
 	unsigned long desc;
+	u32 id;
+	u16 len;
+	u16 zerocopy:1;
+	atomic_t refcnt;
 };
 
 /* This data is invariant across clones and lives at
@@ -289,6 +299,12 @@ enum {
 	SKB_GSO_TCPV6 = 1 << 4,
 
 	SKB_GSO_FCOE = 1 << 5,
+
+	/* This indicates a UDP payload to be cut into gso_size datagrams. */
+	SKB_GSO_UDP_L4 = 1 << 6,
+
+	/* This indicates the payload is carried inside a GRE tunnel. */
+	SKB_GSO_GRE = 1 << 7,
 };
 
 #if BITS_PER_LONG > 32
@@ -349,8 +365,11 @@ typedef unsigned char *sk_buff_data_t;
  *	@ooo_okay: allow the mapping of a socket to a queue to be changed
  *	@l4_rxhash: indicate rxhash is a canonical 4-tuple hash over transport
  *		ports.
+ *	@head_frag: skb->head is a page fragment (see build_skb()), not
+ *		kmalloc()ed memory
  *	@dma_cookie: a cookie to one of several possible DMA operations
  *		done by skb DMA functions
+ *	@napi_id: id of the NAPI struct this skb came from
  *	@secmark: security marking
  *	@mark: Generic packet mark
  *	@dropcount: total number of sk_receive_queue overflows
@@ -442,13 +461,17 @@ struct sk_buff {
 #endif
 	__u8			ooo_okay:1;
 	__u8			l4_rxhash:1;
+	__u8			head_frag:1;
 	kmemcheck_bitfield_end(flags2);
 
-	/* 0/13 bit hole */
+	/* 0/12 bit hole */
 
 #ifdef CONFIG_NET_DMA
 	dma_cookie_t		dma_cookie;
 #endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	unsigned int		napi_id;
+#endif
 #ifdef CONFIG_NETWORK_SECMARK
 	__u32			secmark;
 #endif
@@ -538,6 +561,7 @@ extern void consume_skb(struct sk_buff *skb);
 extern void	       __kfree_skb(struct sk_buff *skb);
 extern struct sk_buff *__alloc_skb(unsigned int size,
 				   gfp_t priority, int fclone, int node);
+extern struct sk_buff *build_skb(void *data, unsigned int frag_size);
 static inline struct sk_buff *alloc_skb(unsigned int size,
 					gfp_t priority)
 {
@@ -1632,6 +1656,63 @@ static inline void skb_orphan(struct sk_buff *skb)
 	skb->sk		= NULL;
 }
 
+extern struct ubuf_info *sock_zerocopy_alloc(struct sock *sk);
+extern void sock_zerocopy_callback(struct ubuf_info *uarg, bool success);
+extern void sock_zerocopy_put(struct ubuf_info *uarg);
+extern void sock_zerocopy_put_abort(struct ubuf_info *uarg);
+extern int skb_zerocopy_from_user(struct sk_buff *skb,
+				  const char __user *from, int len,
+				  struct ubuf_info *uarg);
+extern int skb_zerocopy_clone(struct sk_buff *nskb, struct sk_buff *orig,
+			      gfp_t gfp_mask);
+
+static inline struct ubuf_info *skb_uarg(struct sk_buff *skb)
+{
+	return skb_shinfo(skb)->destructor_arg;
+}
+
+/* Return the ubuf_info of a zerocopy skb, or NULL */
+static inline struct ubuf_info *skb_zcopy(struct sk_buff *skb)
+{
+	if (likely(!(skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY)))
+		return NULL;
+	return skb_uarg(skb);
+}
+
+/* True for buffers queued by MSG_ZEROCOPY sends: those may be cloned and
+ * split freely, the last reference reports the completion.
+ */
+static inline bool skb_zcopy_is_sock(struct sk_buff *skb)
+{
+	struct ubuf_info *uarg = skb_zcopy(skb);
+
+	return uarg && uarg->callback == sock_zerocopy_callback;
+}
+
+static inline void skb_zcopy_set(struct sk_buff *skb, struct ubuf_info *uarg)
+{
+	atomic_inc(&uarg->refcnt);
+	skb_shinfo(skb)->destructor_arg = uarg;
+	skb_shinfo(skb)->tx_flags |= SKBTX_DEV_ZEROCOPY;
+}
+
+/* Release the reference on the user buffers, notifying their owner */
+static inline void skb_zcopy_clear(struct sk_buff *skb, bool zerocopy)
+{
+	struct ubuf_info *uarg = skb_zcopy(skb);
+
+	if (!uarg)
+		return;
+
+	if (uarg->callback == sock_zerocopy_callback) {
+		uarg->zerocopy = uarg->zerocopy && zerocopy;
+		sock_zerocopy_put(uarg);
+	} else {
+		uarg->callback(uarg, zerocopy);
+	}
+	skb_shinfo(skb)->tx_flags &= ~SKBTX_DEV_ZEROCOPY;
+}
+
 /**
  *	skb_orphan_frags - orphan the frags contained in a buffer
  *	@skb: buffer to orphan frags from
@@ -1639,9 +1720,22 @@ static inline void skb_orphan(struct sk_buff *skb)
  *
  *	For each frag in the SKB which needs a destructor (i.e. has an
  *	owner) create a copy of that frag and release the original
- *	page by calling the destructor.
+ *	page by calling the destructor.  Frags of MSG_ZEROCOPY sends are
+ *	left alone: their reference is shared by clones and segments.
  */
 static inline int skb_orphan_frags(struct sk_buff *skb, gfp_t gfp_mask)
+{
+	if (likely(!(skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY)))
+		return 0;
+	if (skb_zcopy_is_sock(skb))
+		return 0;
+	return skb_copy_ubufs(skb, gfp_mask);
+}
+
+/* Frags headed for a local receive queue may sit there indefinitely,
+ * so user pages are always replaced by kernel copies.
+ */
+static inline int skb_orphan_frags_rx(struct sk_buff *skb, gfp_t gfp_mask)
 {
 	if (likely(!(skb_shinfo(skb)->tx_flags & SKBTX_DEV_ZEROCOPY)))
 		return 0;
@@ -2523,6 +2617,23 @@ static inline int skb_is_gso_v6(const struct sk_buff *skb)
 	return skb_shinfo(skb)->gso_type & SKB_GSO_TCPV6;
 }
 
+/* Keeps track of the outermost mac header while a tunnelled skb is being
+ * segmented, so that skb_segment() can copy the tunnel headers as well.
+ * Lives past the start of cb[] to leave room for the users holding the
+ * skb around skb_gso_segment().
+ */
+struct skb_gso_cb {
+	int	mac_offset;
+};
+#define SKB_GSO_CB_OFFSET	32
+#define SKB_GSO_CB(skb) ((struct skb_gso_cb *)((skb)->cb + SKB_GSO_CB_OFFSET))
+
+static inline int skb_tnl_header_len(const struct sk_buff *inner_skb)
+{
+	return (skb_mac_header(inner_skb) - inner_skb->head) -
+		SKB_GSO_CB(inner_skb)->mac_offset;
+}
+
 extern void __skb_warn_lro_forwarding(const struct sk_buff *skb);
 
 static inline bool skb_warn_if_lro(const struct sk_buff *skb)
@@ -2574,6 +2685,9 @@ static inline bool skb_is_recycleable(const struct sk_buff *skb, int skb_size)
 	if (skb_is_nonlinear(skb) || skb->fclone != SKB_FCLONE_UNAVAILABLE)
 		return false;
 
+	if (skb->head_frag)
+		return false;
+
 	skb_size = SKB_DATA_ALIGN(skb_size + NET_SKB_PAD);
 	if (skb_end_offset(skb) < skb_size)
 		return false;
@@ -75,6 +75,7 @@
 #else
 # define SLAB_FAILSLAB		0x00000000UL
 #endif
+#define SLAB_NOMERGE		0x04000000UL	/* Never share slabs with other caches */
 
 /* The following flags affect the page allocator grouping pages by mobility */
 #define SLAB_RECLAIM_ACCOUNT	0x00020000UL		/* Objects are reclaimable */
@@ -55,6 +55,7 @@ struct kmem_cache_node {
 	spinlock_t list_lock;	/* Protect partial list and nr_partial */
 	unsigned long nr_partial;
 	struct list_head partial;
+	atomic_long_t list_lock_contended;	/* Waits for list_lock */
 #ifdef CONFIG_SLUB_DEBUG
 	atomic_long_t nr_slabs;
 	atomic_long_t total_objects;
@@ -96,6 +97,9 @@ struct kmem_cache {
 	int reserved;		/* Reserved bytes at the end of slabs */
 	const char *name;	/* Name (only for display!) */
 	struct list_head list;	/* List of slab caches */
+	int cpu_partial_min;	/* Floor of the tuned cpu_partial */
+	int cpu_partial_auto;	/* Tune cpu_partial from list_lock waits */
+	unsigned long cpu_partial_stamp; /* jiffies of last cpu_partial change */
 #ifdef CONFIG_SYSFS
 	struct kobject kobj;	/* For sysfs */
 #endif
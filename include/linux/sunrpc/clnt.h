@@ -27,6 +27,11 @@
 
 struct rpc_inode;
 
+/*
+ * Maximum number of transports a client may spread its requests over
+ */
+#define RPC_MAX_CONNECT		16
+
 /*
  * The high-level client handle
  */
@@ -36,6 +41,10 @@ struct rpc_clnt {
 	struct list_head	cl_tasks;	/* List of tasks */
 	spinlock_t		cl_lock;	/* spinlock */
 	struct rpc_xprt *	cl_xprt;	/* transport */
+	struct rpc_xprt *	cl_xprts[RPC_MAX_CONNECT];
+						/* all transports, cl_xprt first */
+	unsigned int		cl_nconnect;	/* number of transports */
+	atomic_t		cl_xprt_next;	/* round-robin cursor */
 	struct rpc_procinfo *	cl_procinfo;	/* procedure info */
 	u32			cl_prog,	/* RPC program number */
 				cl_vers,	/* RPC version number */
@@ -117,6 +126,7 @@ struct rpc_create_args {
 	unsigned long		flags;
 	char			*client_name;
 	struct svc_xprt		*bc_xprt;	/* NFSv4.1 backchannel */
+	unsigned int		nconnect;	/* number of transports to open */
 };
 
 /* Values for "flags" field */
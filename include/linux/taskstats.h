@@ -33,9 +33,10 @@
  */
 
 
-#define TASKSTATS_VERSION	8
+#define TASKSTATS_VERSION	9
 #define TS_COMM_LEN		32	/* should be >= TASK_COMM_LEN
 					 * in linux/sched.h */
+#define TASKSTATS_DELAY_HIST_BUCKETS	24
 
 struct taskstats {
 
@@ -163,6 +164,27 @@ struct taskstats {
 	/* Delay waiting for memory reclaim */
 	__u64	freepages_count;
 	__u64	freepages_delay_total;
+	/* version 8 ends here */
+
+	/* Split of the blkio delay, which keeps including both */
+
+	/* Delay waiting for file data read in on a page cache miss */
+	__u64	read_count;
+	__u64	read_delay_total;
+
+	/* Delay throttled in balance_dirty_pages() for dirtying pages */
+	__u64	throttle_count;
+	__u64	throttle_delay_total;
+
+	/* log2 distributions of the delays: bucket 0 counts delays below
+	 * 1us, bucket n those in [2^(n-1), 2^n) us, the last bucket all
+	 * longer ones.  blkio_hist only counts the blkio not split out.
+	 */
+	__u64	blkio_hist[TASKSTATS_DELAY_HIST_BUCKETS];
+	__u64	swapin_hist[TASKSTATS_DELAY_HIST_BUCKETS];
+	__u64	freepages_hist[TASKSTATS_DELAY_HIST_BUCKETS];
+	__u64	read_hist[TASKSTATS_DELAY_HIST_BUCKETS];
+	__u64	throttle_hist[TASKSTATS_DELAY_HIST_BUCKETS];
 };
 
 
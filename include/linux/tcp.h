@@ -106,6 +106,7 @@ enum {
 #define TCP_THIN_LINEAR_TIMEOUTS 16      /* Use linear timeouts for thin streams*/
 #define TCP_THIN_DUPACK         17      /* Fast retrans. after 1 dupack */
 #define TCP_USER_TIMEOUT	18	/* How long for loss retry before timeout */
+#define TCP_FASTOPEN		23	/* Enable FastOpen on listeners */
 
 /* for TCP_INFO socket option */
 #define TCPI_OPT_TIMESTAMPS	1
@@ -273,6 +274,20 @@ static inline void tcp_clear_options(struct tcp_options_received *rx_opt)
 #define TCP_NUM_SACKS 4
 
 struct tcp_cookie_values;
+
+/* TCP Fast Open cookie. A length of zero is a cookie request and a
+ * negative length means no Fast Open option at all.
+ */
+#define TCP_FASTOPEN_COOKIE_MIN	4	/* Min Fast Open Cookie size in bytes */
+#define TCP_FASTOPEN_COOKIE_MAX	16	/* Max Fast Open Cookie size in bytes */
+#define TCP_FASTOPEN_COOKIE_SIZE 8	/* the size employed by this impl. */
+
+struct tcp_fastopen_cookie {
+	s8	len;
+	u8	val[TCP_FASTOPEN_COOKIE_MAX];
+};
+
+struct tcp_fastopen_request;
 struct tcp_request_sock_ops;
 
 struct tcp_request_sock {
@@ -297,6 +312,9 @@ struct tcp_sock {
 	u16	tcp_header_len;	/* Bytes of tcp header to send		*/
 	u16	xmit_size_goal_segs; /* Goal for segmenting output packets */
 
+	unsigned long	tsq_flags;	/* TCP Small Queues state, see below	*/
+	struct list_head tsq_node;	/* anchor in tsq_tasklet.head list	*/
+
 /*
  *	Header prediction flags
  *	0x5?10 << 16 + snd_wnd in net byte order
@@ -366,6 +384,10 @@ struct tcp_sock {
 	u32	snd_up;		/* Urgent pointer		*/
 
 	u8	keepalive_probes; /* num of allowed keep alive probes	*/
+	u8	syn_fastopen:1,	/* SYN includes Fast Open option	*/
+		syn_data:1,	/* SYN includes data			*/
+		syn_data_acked:1,/* data in SYN is acked by SYN-ACK	*/
+		fastopen_child:1;/* passively opened by a Fast Open SYN	*/
 /*
  *      Options received (usually on last packet, some only on SYN packets).
  */
@@ -466,6 +488,19 @@ struct tcp_sock {
 	 * contains related tcp_cookie_transactions fields.
 	 */
 	struct tcp_cookie_values  *cookie_values;
+
+	/* MSG_FASTOPEN data of an active open in progress, see
+	 * tcp_sendmsg_fastopen().
+	 */
+	struct tcp_fastopen_request *fastopen_req;
+	/* Listener: accept backlog below which Fast Open SYNs are accepted */
+	int	fastopen_qlen;
+};
+
+enum tsq_flags {
+	TSQ_THROTTLED,		/* tcp_write_xmit() hit the queued bytes limit */
+	TSQ_QUEUED,		/* socket is on a per-cpu tsq_tasklet list */
+	TCP_TSQ_DEFERRED,	/* tasklet found the socket owned by user */
 };
 
 static inline struct tcp_sock *tcp_sk(const struct sock *sk)
@@ -473,6 +508,14 @@ static inline struct tcp_sock *tcp_sk(const struct sock *sk)
 	return (struct tcp_sock *)sk;
 }
 
+/* A Fast Open child may send and receive data before the peer has
+ * acknowledged its SYN-ACK.
+ */
+static inline bool tcp_passive_fastopen(const struct sock *sk)
+{
+	return sk->sk_state == TCP_SYN_RECV && tcp_sk(sk)->fastopen_child;
+}
+
 struct tcp_timewait_sock {
 	struct inet_timewait_sock tw_sk;
 	u32			  tw_rcv_nxt;
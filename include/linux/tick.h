@@ -45,6 +45,9 @@ enum tick_nohz_mode {
  * @iowait_sleeptime:	Sum of the time slept in idle with sched tick stopped, with IO outstanding
  * @sleep_length:	Duration of the current idle sleep
  * @do_timer_lst:	CPU was the last one doing do_timer before going idle
+ * @full_stretched:	The busy tick was deferred because a single task runs
+ *			on this isolated CPU (CONFIG_NO_HZ_FULL)
+ * @full_jiffies:	jiffies of the last tick which accounted the busy task
  */
 struct tick_sched {
 	struct hrtimer			sched_timer;
@@ -67,6 +70,10 @@ struct tick_sched {
 	unsigned long			next_jiffies;
 	ktime_t				idle_expires;
 	int				do_timer_last;
+#ifdef CONFIG_NO_HZ_FULL
+	int				full_stretched;
+	unsigned long			full_jiffies;
+#endif
 };
 
 extern void __init tick_init(void);
@@ -139,4 +146,12 @@ static inline u64 get_cpu_idle_time_us(int cpu, u64 *unused) { return -1; }
 static inline u64 get_cpu_iowait_time_us(int cpu, u64 *unused) { return -1; }
 # endif /* !NO_HZ */
 
+# ifdef CONFIG_NO_HZ_FULL
+extern void tick_nohz_full_kick_cpu(int cpu);
+extern void tick_nohz_full_check(void);
+# else
+static inline void tick_nohz_full_kick_cpu(int cpu) { }
+static inline void tick_nohz_full_check(void) { }
+# endif /* !NO_HZ_FULL */
+
 #endif
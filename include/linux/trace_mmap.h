@@ -0,0 +1,39 @@
+#ifndef _LINUX_TRACE_MMAP_H
+#define _LINUX_TRACE_MMAP_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+/*
+ * Layout of the per-cpu trace_pipe_raw mapping: this meta page first,
+ * then nr_subbufs pages of the ring buffer, each with the page header
+ * described by events/header_page, ordered by id.
+ *
+ * The page with id reader.id is owned by the reader.  Its events from
+ * offset reader.read up to the page's commit field can be read without
+ * a system call; the writer only ever appends to it.  Once they have
+ * been read, TRACE_MMAP_IOCTL_GET_READER, with the offset read up to as
+ * argument, consumes them and, if the page is done, swaps in the next
+ * one and updates this page.
+ */
+struct trace_buffer_meta {
+	__u32	meta_page_size;
+	__u32	meta_struct_len;
+
+	__u32	subbuf_size;
+	__u32	nr_subbufs;
+
+	struct {
+		__u64	lost_events;	/* overwritten before this page */
+		__u32	id;
+		__u32	read;
+	} reader;
+
+	__u64	entries;
+	__u64	overrun;
+	__u64	read;
+};
+
+#define TRACE_MMAP_IOCTL_GET_READER	_IO('T', 0x1)
+
+#endif /* _LINUX_TRACE_MMAP_H */
@@ -29,6 +29,7 @@ struct udphdr {
 /* UDP socket options */
 #define UDP_CORK	1	/* Never send partially complete segments */
 #define UDP_ENCAP	100	/* Set the socket to accept encapsulated packets */
+#define UDP_SEGMENT	103	/* Set GSO segmentation size */
 
 /* UDP encapsulation types */
 #define UDP_ENCAP_ESPINUDP_NON_IKE	1 /* draft-ietf-ipsec-nat-t-ike-00/01 */
@@ -47,6 +48,9 @@ static inline struct udphdr *udp_hdr(const struct sk_buff *skb)
 
 #define UDP_HTABLE_SIZE_MIN		(CONFIG_BASE_SMALL ? 128 : 256)
 
+/* Upper bound on the number of datagrams one UDP_SEGMENT send may produce */
+#define UDP_MAX_SEGMENTS		(1 << 6)
+
 static inline int udp_hashfn(struct net *net, unsigned num, unsigned mask)
 {
 	return (num + net_hash_mix(net)) & mask;
@@ -76,11 +80,18 @@ struct udp_sock {
 #define UDPLITE_SEND_CC  0x2  		/* set via udplite setsockopt         */
 #define UDPLITE_RECV_CC  0x4		/* set via udplite setsocktopt        */
 	__u8		 pcflag;        /* marks socket as UDP-Lite if > 0    */
-	__u8		 unused[3];
+	__u8		 unused[1];
+	__u16		 gso_size;	/* UDP_SEGMENT payload size, 0 if off */
 	/*
 	 * For encapsulation sockets.
 	 */
 	int (*encap_rcv)(struct sock *sk, struct sk_buff *skb);
+	/*
+	 * Route of the last unconnected send of a sendmmsg() batch, and
+	 * the flow it was looked up with.  Protected by sk_dst_lock.
+	 */
+	struct rtable	*batch_rt;
+	struct flowi4	 batch_fl4;
 };
 
 static inline struct udp_sock *udp_sk(const struct sock *sk)
@@ -0,0 +1,132 @@
+#ifndef _LINUX_UPROBES_H
+#define _LINUX_UPROBES_H
+/*
+ * User-space Probes (UProbes)
+ *
+ * A uprobe is identified by an inode and a file offset.  While it has
+ * consumers, every private executable mapping of that offset carries a
+ * breakpoint; a task that hits it runs the consumers' handlers on its
+ * way back to user space and then single-steps a copy of the original
+ * instruction in a per-mm "execute out of line" (XOL) page.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include <linux/errno.h>
+#include <linux/types.h>
+
+struct vm_area_struct;
+struct mm_struct;
+struct inode;
+struct pt_regs;
+struct task_struct;
+struct notifier_block;
+
+struct uprobe_consumer {
+	/*
+	 * Called in the probed task's context with the instruction
+	 * pointer at the probed instruction, may not be NULL.
+	 */
+	int (*handler)(struct uprobe_consumer *self, struct pt_regs *regs);
+	struct uprobe_consumer *next;
+};
+
+#ifdef CONFIG_UPROBES
+#include <asm/uprobes.h>
+
+enum uprobe_task_state {
+	UTASK_RUNNING,
+	UTASK_BP_HIT,
+	UTASK_SSTEP,
+	UTASK_SSTEP_ACK,
+	UTASK_SSTEP_TRAPPED,
+};
+
+/*
+ * uprobe_task: per-task state, allocated on the first breakpoint hit.
+ */
+struct uprobe_task {
+	enum uprobe_task_state		state;
+	struct arch_uprobe_task		autask;
+
+	struct uprobe			*active_uprobe;
+
+	unsigned long			xol_vaddr;	/* slot in use */
+	unsigned long			vaddr;		/* probed address */
+};
+
+struct xol_area;
+
+struct uprobes_state {
+	struct xol_area			*xol_area;
+};
+
+extern int uprobe_register(struct inode *inode, loff_t offset,
+			   struct uprobe_consumer *uc);
+extern void uprobe_unregister(struct inode *inode, loff_t offset,
+			      struct uprobe_consumer *uc);
+extern void uprobe_mmap(struct vm_area_struct *vma);
+extern void uprobe_dup_mmap(struct mm_struct *oldmm, struct mm_struct *newmm);
+extern void uprobe_clear_state(struct mm_struct *mm);
+extern void uprobe_copy_process(struct task_struct *t);
+extern void uprobe_free_utask(struct task_struct *t);
+extern bool uprobe_deny_signal(void);
+extern int uprobe_pre_sstep_notifier(struct pt_regs *regs);
+extern int uprobe_post_sstep_notifier(struct pt_regs *regs);
+extern void uprobe_notify_resume(struct pt_regs *regs);
+
+/* Provided by the architecture */
+extern int arch_uprobe_analyze_insn(struct arch_uprobe *auprobe,
+				    struct mm_struct *mm, unsigned long addr);
+extern int arch_uprobe_pre_xol(struct arch_uprobe *auprobe,
+			       struct pt_regs *regs);
+extern int arch_uprobe_post_xol(struct arch_uprobe *auprobe,
+				struct pt_regs *regs);
+extern void arch_uprobe_abort_xol(struct arch_uprobe *auprobe,
+				  struct pt_regs *regs);
+extern bool arch_uprobe_xol_was_trapped(struct task_struct *tsk);
+extern int arch_uprobe_exception_notify(struct notifier_block *self,
+					unsigned long val, void *data);
+
+#else /* !CONFIG_UPROBES */
+
+struct uprobes_state {
+};
+
+static inline int uprobe_register(struct inode *inode, loff_t offset,
+				  struct uprobe_consumer *uc)
+{
+	return -ENOSYS;
+}
+static inline void uprobe_unregister(struct inode *inode, loff_t offset,
+				     struct uprobe_consumer *uc)
+{
+}
+static inline void uprobe_mmap(struct vm_area_struct *vma)
+{
+}
+static inline void uprobe_dup_mmap(struct mm_struct *oldmm,
+				   struct mm_struct *newmm)
+{
+}
+static inline void uprobe_clear_state(struct mm_struct *mm)
+{
+}
+static inline void uprobe_copy_process(struct task_struct *t)
+{
+}
+static inline void uprobe_free_utask(struct task_struct *t)
+{
+}
+static inline bool uprobe_deny_signal(void)
+{
+	return false;
+}
+static inline void uprobe_notify_resume(struct pt_regs *regs)
+{
+}
+#endif /* !CONFIG_UPROBES */
+#endif	/* _LINUX_UPROBES_H */
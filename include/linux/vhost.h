@@ -113,6 +113,15 @@ struct vhost_memory {
 /* Set eventfd to signal an error */
 #define VHOST_SET_VRING_ERR _IOW(VHOST_VIRTIO, 0x22, struct vhost_vring_file)
 
+/* Time in microseconds the backend keeps polling an empty ring (and, for
+ * vhost-net receive, an empty socket) before it goes back to waiting for
+ * a notification.  0, the default, disables polling. */
+#define VHOST_SET_VRING_BUSYLOOP_TIMEOUT _IOW(VHOST_VIRTIO, 0x23,	\
+					 struct vhost_vring_state)
+/* Get accessor: reads index, writes timeout in num */
+#define VHOST_GET_VRING_BUSYLOOP_TIMEOUT _IOWR(VHOST_VIRTIO, 0x24,	\
+					 struct vhost_vring_state)
+
 /* VHOST_NET specific defines */
 
 /* Attach virtio net ring to a raw socket, or tap device.
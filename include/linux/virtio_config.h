@@ -102,6 +102,11 @@
  *	vdev: the virtio_device
  *	This gives the final feature bits for the device: it can change
  *	the dev->feature bits if it wants.
+ * @set_vq_affinity: steer the interrupt of a virtqueue (optional).
+ *	vq: the virtqueue
+ *	mask: the cpus that should handle its interrupt
+ *	Returns 0 on success or error status, e.g. if the virtqueue shares
+ *	its interrupt with others.
  */
 typedef void vq_callback_t(struct virtqueue *);
 struct virtio_config_ops {
@@ -119,6 +124,8 @@ struct virtio_config_ops {
 	void (*del_vqs)(struct virtio_device *);
 	u32 (*get_features)(struct virtio_device *vdev);
 	void (*finalize_features)(struct virtio_device *vdev);
+	int (*set_vq_affinity)(struct virtqueue *vq,
+			       const struct cpumask *mask);
 };
 
 /* If driver didn't advertise the feature, it will never appear. */
@@ -184,5 +191,23 @@ struct virtqueue *virtio_find_single_vq(struct virtio_device *vdev,
 		return ERR_PTR(err);
 	return vq;
 }
+
+/**
+ * virtqueue_set_affinity - steer a virtqueue's interrupt to some cpus
+ * @vq: the virtqueue
+ * @mask: the cpus that should handle it
+ *
+ * A hint only: returns -ENOSYS if the transport can't do it and another
+ * error if this virtqueue has no interrupt of its own.
+ */
+static inline
+int virtqueue_set_affinity(struct virtqueue *vq, const struct cpumask *mask)
+{
+	struct virtio_device *vdev = vq->vdev;
+
+	if (!vdev->config->set_vq_affinity)
+		return -ENOSYS;
+	return vdev->config->set_vq_affinity(vq, mask);
+}
 #endif /* __KERNEL__ */
 #endif /* _LINUX_VIRTIO_CONFIG_H */
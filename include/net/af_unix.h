@@ -6,10 +6,13 @@
 #include <linux/mutex.h>
 #include <net/sock.h>
 
+struct scm_fp_list;
+
 extern void unix_inflight(struct file *fp);
 extern void unix_notinflight(struct file *fp);
 extern void unix_gc(void);
-extern void wait_for_unix_gc(void);
+extern void wait_for_unix_gc(struct scm_fp_list *fpl);
+extern void unix_update_graph(struct sock *other);
 extern struct sock *unix_get_socket(struct file *filp);
 
 #define UNIX_HASH_SIZE	256
@@ -30,6 +33,7 @@ struct unix_skb_parms {
 #ifdef CONFIG_SECURITY_NETWORK
 	u32			secid;		/* Security ID		*/
 #endif
+	u32			consumed;	/* Bytes read (stream)	*/
 };
 
 #define UNIXCB(skb) 	(*(struct unix_skb_parms *)&((skb)->cb))
@@ -53,6 +57,7 @@ struct unix_sock {
 	struct sock		*other;
 	struct list_head	link;
 	atomic_long_t		inflight;
+	long			gc_refs;	/* unix_graph_cyclic() */
 	spinlock_t		lock;
 	unsigned int		gc_candidate : 1;
 	unsigned int		gc_maybe_cycle : 1;
@@ -106,6 +106,8 @@ struct inet_cork {
 	struct page		*page;
 	u32			off;
 	u8			tx_flags;
+	__u16			gso_size;
+	u64			transmit_time;
 };
 
 struct inet_cork_full {
@@ -170,6 +172,7 @@ struct inet_sock {
 	int			mc_index;
 	__be32			mc_addr;
 	struct ip_mc_socklist __rcu	*mc_list;
+	int			rx_dst_ifindex;	/* skb_iif of sk_rx_dst */
 	struct inet_cork_full	cork;
 };
 
@@ -54,6 +54,8 @@ struct ipcm_cookie {
 	int			oif;
 	struct ip_options_rcu	*opt;
 	__u8			tx_flags;
+	__u16			gso_size;
+	struct sockcm_cookie	sockc;
 };
 
 #define IPCB(skb) ((struct inet_skb_parm*)((skb)->cb))
@@ -233,6 +235,9 @@ extern int inet_peer_maxttl;
 /* From ip_output.c */
 extern int sysctl_ip_dynaddr;
 
+/* From ip_input.c */
+extern int sysctl_ip_early_demux;
+
 extern void ipfrag_init(void);
 
 extern void ip_static_sysctl_init(void);
@@ -453,7 +458,7 @@ extern int ip_options_rcv_srr(struct sk_buff *skb);
 
 extern int	ip_queue_rcv_skb(struct sock *sk, struct sk_buff *skb);
 extern void	ip_cmsg_recv(struct msghdr *msg, struct sk_buff *skb);
-extern int	ip_cmsg_send(struct net *net,
+extern int	ip_cmsg_send(struct sock *sk,
 			     struct msghdr *msg, struct ipcm_cookie *ipc);
 extern int	ip_setsockopt(struct sock *sk, int level, int optname, char __user *optval, unsigned int optlen);
 extern int	ip_getsockopt(struct sock *sk, int level, int optname, char __user *optval, int __user *optlen);
@@ -112,6 +112,10 @@ struct rt6_info {
 	struct inet6_dev		*rt6i_idev;
 	struct inet_peer		*rt6i_peer;
 
+	/* per-cpu copies used for forwarding, see rt6_alloc_pcpu() */
+	struct rt6_info * __percpu	*rt6i_pcpu;
+	struct rt6_info			*rt6i_from;
+
 #ifdef CONFIG_XFRM
 	u32				rt6i_flow_cache_genid;
 #endif
@@ -74,6 +74,20 @@ print_tuple(struct seq_file *s, const struct nf_conntrack_tuple *tuple,
             const struct nf_conntrack_l3proto *l3proto,
             const struct nf_conntrack_l4proto *proto);
 
+/* nf_conntrack_lock protects expectations and helper assignment, the
+ * conntrack hash table is protected by the per-bucket locks below.
+ * Lock order: nf_conntrack_lock, bucket locks, per-cpu list locks.
+ */
 extern spinlock_t nf_conntrack_lock ;
 
+#define CONNTRACK_LOCKS 1024
+
+extern spinlock_t nf_conntrack_locks[CONNTRACK_LOCKS];
+extern void nf_conntrack_lock_bucket(unsigned int bucket);
+
+static inline void nf_conntrack_unlock_bucket(unsigned int bucket)
+{
+	spin_unlock(&nf_conntrack_locks[bucket % CONNTRACK_LOCKS]);
+}
+
 #endif /* _NF_CONNTRACK_CORE_H */
@@ -6,6 +6,7 @@
 #include <linux/types.h>
 #include <linux/workqueue.h>
 #include <linux/mutex.h>
+#include <linux/atomic.h>
 #include <scsi/scsi.h>
 
 struct request_queue;
@@ -587,11 +588,12 @@ struct Scsi_Host {
 	struct blk_queue_tag	*bqt;
 
 	/*
-	 * The following two fields are protected with host_lock;
-	 * however, eh routines can safely access during eh processing
-	 * without acquiring the lock.
+	 * host_busy is updated locklessly by the midlayer's issue and
+	 * completion paths.  host_failed and host_eh_scheduled are
+	 * protected with host_lock; however, eh routines can safely access
+	 * during eh processing without acquiring the lock.
 	 */
-	unsigned int host_busy;		   /* commands actually active on low-level */
+	atomic_t host_busy;		   /* commands actually active on low-level */
 	unsigned int host_failed;	   /* commands that failed. */
 	unsigned int host_eh_scheduled;    /* EH scheduled without command */
     
@@ -678,7 +680,7 @@ struct Scsi_Host {
 	/*
 	 * Host has rejected a command because it was busy.
 	 */
-	unsigned int host_blocked;
+	atomic_t host_blocked;
 
 	/*
 	 * Value host_blocked counts down from
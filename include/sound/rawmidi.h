@@ -78,6 +78,10 @@ struct snd_rawmidi_runtime {
 	/* misc */
 	spinlock_t lock;
 	wait_queue_head_t sleep;
+	/* mmap'ed ring (input only) */
+	struct snd_rawmidi_mmap_status *mmap_status;
+	u32 mmap_appl_pos;	/* appl_pos already applied to appl_ptr */
+	atomic_t mmap_count;
 	/* event handler (new bytes, input only) */
 	void (*event)(struct snd_rawmidi_substream *substream);
 	/* defers calls to event [input] or ops->trigger [output] */
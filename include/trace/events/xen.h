@@ -405,18 +405,20 @@ TRACE_EVENT(xen_mmu_flush_tlb_single,
 
 TRACE_EVENT(xen_mmu_flush_tlb_others,
 	    TP_PROTO(const struct cpumask *cpus, struct mm_struct *mm,
-		     unsigned long addr),
-	    TP_ARGS(cpus, mm, addr),
+		     unsigned long start, unsigned long end),
+	    TP_ARGS(cpus, mm, start, end),
 	    TP_STRUCT__entry(
 		    __field(unsigned, ncpus)
 		    __field(struct mm_struct *, mm)
-		    __field(unsigned long, addr)
+		    __field(unsigned long, start)
+		    __field(unsigned long, end)
 		    ),
 	    TP_fast_assign(__entry->ncpus = cpumask_weight(cpus);
 			   __entry->mm = mm;
-			   __entry->addr = addr),
-	    TP_printk("ncpus %d mm %p addr %lx",
-		      __entry->ncpus, __entry->mm, __entry->addr)
+			   __entry->start = start;
+			   __entry->end = end),
+	    TP_printk("ncpus %d mm %p start %lx end %lx",
+		      __entry->ncpus, __entry->mm, __entry->start, __entry->end)
 	);
 
 TRACE_EVENT(xen_mmu_write_cr3,
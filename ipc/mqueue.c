@@ -33,6 +33,7 @@
 #include <linux/pid.h>
 #include <linux/ipc_namespace.h>
 #include <linux/slab.h>
+#include <linux/rbtree.h>
 
 #include <net/sock.h>
 #include "util.h"
@@ -55,12 +56,20 @@ struct ext_wait_queue {		/* queue of sleeping tasks */
 	int state;		/* one of STATE_* values */
 };
 
+/* Messages of one priority, kept in FIFO order in the msg_tree. */
+struct posix_msg_tree_node {
+	struct rb_node		rb_node;
+	struct list_head	msg_list;
+	int			priority;
+};
+
 struct mqueue_inode_info {
 	spinlock_t lock;
 	struct inode vfs_inode;
 	wait_queue_head_t wait_q;
 
-	struct msg_msg **messages;
+	struct rb_root msg_tree;
+	struct posix_msg_tree_node *node_cache; /* spare node, may be NULL */
 	struct mq_attr attr;
 
 	struct sigevent notify;
@@ -89,6 +98,21 @@ static inline struct mqueue_inode_info *MQUEUE_I(struct inode *inode)
 	return container_of(inode, struct mqueue_inode_info, vfs_inode);
 }
 
+/*
+ * Memory charged against RLIMIT_MSGQUEUE for a queue: the message
+ * headers, at most one tree node per priority, and the payload.
+ */
+static unsigned long mq_queue_bytes(struct mq_attr *attr)
+{
+	unsigned long mq_treesize;
+
+	mq_treesize = attr->mq_maxmsg * sizeof(struct msg_msg) +
+		min_t(unsigned int, attr->mq_maxmsg, MQ_PRIO_MAX) *
+		sizeof(struct posix_msg_tree_node);
+
+	return mq_treesize + attr->mq_maxmsg * attr->mq_msgsize;
+}
+
 /*
  * This routine should be called with the mq_lock held.
  */
@@ -128,7 +152,7 @@ static struct inode *mqueue_get_inode(struct super_block *sb,
 	if (S_ISREG(mode)) {
 		struct mqueue_inode_info *info;
 		struct task_struct *p = current;
-		unsigned long mq_bytes, mq_msg_tblsz;
+		unsigned long mq_bytes;
 
 		inode->i_fop = &mqueue_file_operations;
 		inode->i_size = FILENT_SIZE;
@@ -141,26 +165,24 @@ static struct inode *mqueue_get_inode(struct super_block *sb,
 		info->notify_owner = NULL;
 		info->qsize = 0;
 		info->user = NULL;	/* set when all is ok */
+		info->msg_tree = RB_ROOT;
+		info->node_cache = NULL;
 		memset(&info->attr, 0, sizeof(info->attr));
-		info->attr.mq_maxmsg = ipc_ns->mq_msg_max;
-		info->attr.mq_msgsize = ipc_ns->mq_msgsize_max;
+		info->attr.mq_maxmsg = min(ipc_ns->mq_msg_max,
+					   ipc_ns->mq_msg_default);
+		info->attr.mq_msgsize = min(ipc_ns->mq_msgsize_max,
+					    ipc_ns->mq_msgsize_default);
 		if (attr) {
 			info->attr.mq_maxmsg = attr->mq_maxmsg;
 			info->attr.mq_msgsize = attr->mq_msgsize;
 		}
-		mq_msg_tblsz = info->attr.mq_maxmsg * sizeof(struct msg_msg *);
-		info->messages = kmalloc(mq_msg_tblsz, GFP_KERNEL);
-		if (!info->messages)
-			goto out_inode;
 
-		mq_bytes = (mq_msg_tblsz +
-			(info->attr.mq_maxmsg * info->attr.mq_msgsize));
+		mq_bytes = mq_queue_bytes(&info->attr);
 
 		spin_lock(&mq_lock);
 		if (u->mq_bytes + mq_bytes < u->mq_bytes ||
 		    u->mq_bytes + mq_bytes > task_rlimit(p, RLIMIT_MSGQUEUE)) {
 			spin_unlock(&mq_lock);
-			/* mqueue_evict_inode() releases info->messages */
 			ret = -EMFILE;
 			goto out_inode;
 		}
@@ -252,12 +274,14 @@ static void mqueue_destroy_inode(struct inode *inode)
 	call_rcu(&inode->i_rcu, mqueue_i_callback);
 }
 
+static inline struct msg_msg *msg_get(struct mqueue_inode_info *info);
+
 static void mqueue_evict_inode(struct inode *inode)
 {
 	struct mqueue_inode_info *info;
 	struct user_struct *user;
 	unsigned long mq_bytes;
-	int i;
+	struct msg_msg *msg;
 	struct ipc_namespace *ipc_ns;
 
 	end_writeback(inode);
@@ -268,14 +292,14 @@ static void mqueue_evict_inode(struct inode *inode)
 	ipc_ns = get_ns_from_inode(inode);
 	info = MQUEUE_I(inode);
 	spin_lock(&info->lock);
-	for (i = 0; i < info->attr.mq_curmsgs; i++)
-		free_msg(info->messages[i]);
-	kfree(info->messages);
+	while ((msg = msg_get(info)) != NULL)
+		free_msg(msg);
+	kfree(info->node_cache);
+	info->node_cache = NULL;
 	spin_unlock(&info->lock);
 
 	/* Total amount of bytes accounted for the mqueue */
-	mq_bytes = info->attr.mq_maxmsg * (sizeof(struct msg_msg *)
-	    + info->attr.mq_msgsize);
+	mq_bytes = mq_queue_bytes(&info->attr);
 	user = info->user;
 	if (user) {
 		spin_lock(&mq_lock);
@@ -494,25 +518,86 @@ static struct ext_wait_queue *wq_get_first_waiter(
 	return list_entry(ptr, struct ext_wait_queue, list);
 }
 
-/* Auxiliary functions to manipulate messages' list */
-static void msg_insert(struct msg_msg *ptr, struct mqueue_inode_info *info)
+/*
+ * Auxiliary functions to manipulate messages' tree: one node per priority
+ * in use, each holding its messages in FIFO order.  A node that becomes
+ * empty is kept in info->node_cache, so the common case of a queue with a
+ * single priority does not allocate on send.
+ */
+static int msg_insert(struct msg_msg *ptr, struct mqueue_inode_info *info)
 {
-	int k;
-
-	k = info->attr.mq_curmsgs - 1;
-	while (k >= 0 && info->messages[k]->m_type >= ptr->m_type) {
-		info->messages[k + 1] = info->messages[k];
-		k--;
+	struct rb_node **p, *parent = NULL;
+	struct posix_msg_tree_node *leaf;
+
+	p = &info->msg_tree.rb_node;
+	while (*p) {
+		parent = *p;
+		leaf = rb_entry(parent, struct posix_msg_tree_node, rb_node);
+
+		if (likely(leaf->priority == ptr->m_type))
+			goto insert_msg;
+		else if (ptr->m_type < leaf->priority)
+			p = &(*p)->rb_left;
+		else
+			p = &(*p)->rb_right;
+	}
+	if (info->node_cache) {
+		leaf = info->node_cache;
+		info->node_cache = NULL;
+	} else {
+		leaf = kmalloc(sizeof(*leaf), GFP_ATOMIC);
+		if (!leaf)
+			return -ENOMEM;
+		INIT_LIST_HEAD(&leaf->msg_list);
 	}
+	leaf->priority = ptr->m_type;
+	rb_link_node(&leaf->rb_node, parent, p);
+	rb_insert_color(&leaf->rb_node, &info->msg_tree);
+insert_msg:
 	info->attr.mq_curmsgs++;
 	info->qsize += ptr->m_ts;
-	info->messages[k + 1] = ptr;
+	list_add_tail(&ptr->m_list, &leaf->msg_list);
+	return 0;
 }
 
 static inline struct msg_msg *msg_get(struct mqueue_inode_info *info)
 {
-	info->qsize -= info->messages[--info->attr.mq_curmsgs]->m_ts;
-	return info->messages[info->attr.mq_curmsgs];
+	struct rb_node *parent;
+	struct posix_msg_tree_node *leaf;
+	struct msg_msg *msg;
+
+	/* The highest priority is the rightmost node. */
+	parent = rb_last(&info->msg_tree);
+	if (!parent)
+		return NULL;
+	leaf = rb_entry(parent, struct posix_msg_tree_node, rb_node);
+	msg = list_first_entry(&leaf->msg_list, struct msg_msg, m_list);
+	list_del(&msg->m_list);
+	if (list_empty(&leaf->msg_list)) {
+		rb_erase(&leaf->rb_node, &info->msg_tree);
+		if (info->node_cache)
+			kfree(leaf);
+		else
+			info->node_cache = leaf;
+	}
+	info->attr.mq_curmsgs--;
+	info->qsize -= msg->m_ts;
+	return msg;
+}
+
+/*
+ * Refill the node cache with a node allocated outside of the spinlock.
+ * Returns the node back if the cache was refilled meanwhile.
+ */
+static inline struct posix_msg_tree_node *
+msg_cache_node(struct mqueue_inode_info *info, struct posix_msg_tree_node *leaf)
+{
+	if (leaf && !info->node_cache) {
+		INIT_LIST_HEAD(&leaf->msg_list);
+		info->node_cache = leaf;
+		leaf = NULL;
+	}
+	return leaf;
 }
 
 static inline void set_cookie(struct sk_buff *skb, char code)
@@ -587,10 +672,13 @@ static void remove_notification(struct mqueue_inode_info *info)
 
 static int mq_attr_ok(struct ipc_namespace *ipc_ns, struct mq_attr *attr)
 {
+	unsigned long mq_treesize, total_size;
+
 	if (attr->mq_maxmsg <= 0 || attr->mq_msgsize <= 0)
 		return 0;
 	if (capable(CAP_SYS_RESOURCE)) {
-		if (attr->mq_maxmsg > HARD_MSGMAX)
+		if (attr->mq_maxmsg > HARD_MSGMAX ||
+		    attr->mq_msgsize > HARD_MSGSIZEMAX)
 			return 0;
 	} else {
 		if (attr->mq_maxmsg > ipc_ns->mq_msg_max ||
@@ -600,9 +688,11 @@ static int mq_attr_ok(struct ipc_namespace *ipc_ns, struct mq_attr *attr)
 	/* check for overflow */
 	if (attr->mq_msgsize > ULONG_MAX/attr->mq_maxmsg)
 		return 0;
-	if ((unsigned long)(attr->mq_maxmsg * (attr->mq_msgsize
-	    + sizeof (struct msg_msg *))) <
-	    (unsigned long)(attr->mq_maxmsg * attr->mq_msgsize))
+	mq_treesize = attr->mq_maxmsg * sizeof(struct msg_msg) +
+		min_t(unsigned int, attr->mq_maxmsg, MQ_PRIO_MAX) *
+		sizeof(struct posix_msg_tree_node);
+	total_size = attr->mq_maxmsg * attr->mq_msgsize;
+	if (total_size + mq_treesize < total_size)
 		return 0;
 	return 1;
 }
@@ -839,7 +929,9 @@ static inline void pipelined_receive(struct mqueue_inode_info *info)
 		wake_up_interruptible(&info->wait_q);
 		return;
 	}
-	msg_insert(sender->msg, info);
+	/* no node for a new priority: the sender keeps waiting */
+	if (msg_insert(sender->msg, info))
+		return;
 	list_del(&sender->list);
 	sender->state = STATE_PENDING;
 	wake_up_process(sender->task);
@@ -857,6 +949,7 @@ SYSCALL_DEFINE5(mq_timedsend, mqd_t, mqdes, const char __user *, u_msg_ptr,
 	struct ext_wait_queue *receiver;
 	struct msg_msg *msg_ptr;
 	struct mqueue_inode_info *info;
+	struct posix_msg_tree_node *new_leaf = NULL;
 	ktime_t expires, *timeout = NULL;
 	struct timespec ts;
 	int ret;
@@ -907,7 +1000,15 @@ SYSCALL_DEFINE5(mq_timedsend, mqd_t, mqdes, const char __user *, u_msg_ptr,
 	msg_ptr->m_ts = msg_len;
 	msg_ptr->m_type = msg_prio;
 
+	/*
+	 * msg_insert() needs a tree node for a new priority. Allocate it
+	 * here, where we may sleep, unless the cache already holds one.
+	 */
+	if (!info->node_cache)
+		new_leaf = kmalloc(sizeof(*new_leaf), GFP_KERNEL);
+
 	spin_lock(&info->lock);
+	new_leaf = msg_cache_node(info, new_leaf);
 
 	if (info->attr.mq_curmsgs == info->attr.mq_maxmsg) {
 		if (filp->f_flags & O_NONBLOCK) {
@@ -925,16 +1026,21 @@ SYSCALL_DEFINE5(mq_timedsend, mqd_t, mqdes, const char __user *, u_msg_ptr,
 		receiver = wq_get_first_waiter(info, RECV);
 		if (receiver) {
 			pipelined_send(info, msg_ptr, receiver);
+			ret = 0;
 		} else {
 			/* adds message to the queue */
-			msg_insert(msg_ptr, info);
-			__do_notify(info);
+			ret = msg_insert(msg_ptr, info);
+			if (!ret)
+				__do_notify(info);
 		}
-		inode->i_atime = inode->i_mtime = inode->i_ctime =
-				CURRENT_TIME;
+		if (!ret)
+			inode->i_atime = inode->i_mtime = inode->i_ctime =
+					CURRENT_TIME;
 		spin_unlock(&info->lock);
-		ret = 0;
+		if (ret)
+			free_msg(msg_ptr);
 	}
+	kfree(new_leaf);
 out_fput:
 	fput(filp);
 out:
@@ -951,6 +1057,7 @@ SYSCALL_DEFINE5(mq_timedreceive, mqd_t, mqdes, char __user *, u_msg_ptr,
 	struct inode *inode;
 	struct mqueue_inode_info *info;
 	struct ext_wait_queue wait;
+	struct posix_msg_tree_node *new_leaf = NULL;
 	ktime_t expires, *timeout = NULL;
 	struct timespec ts;
 
@@ -988,7 +1095,16 @@ SYSCALL_DEFINE5(mq_timedreceive, mqd_t, mqdes, char __user *, u_msg_ptr,
 		goto out_fput;
 	}
 
+	/*
+	 * pipelined_receive() may insert the message of a waiting sender,
+	 * make sure a tree node is available for it.
+	 */
+	if (!info->node_cache)
+		new_leaf = kmalloc(sizeof(*new_leaf), GFP_KERNEL);
+
 	spin_lock(&info->lock);
+	new_leaf = msg_cache_node(info, new_leaf);
+
 	if (info->attr.mq_curmsgs == 0) {
 		if (filp->f_flags & O_NONBLOCK) {
 			spin_unlock(&info->lock);
@@ -1019,6 +1135,7 @@ SYSCALL_DEFINE5(mq_timedreceive, mqd_t, mqdes, char __user *, u_msg_ptr,
 		}
 		free_msg(msg_ptr);
 	}
+	kfree(new_leaf);
 out_fput:
 	fput(filp);
 out:
@@ -1252,6 +1369,8 @@ int mq_init_ns(struct ipc_namespace *ns)
 	ns->mq_queues_max    = DFLT_QUEUESMAX;
 	ns->mq_msg_max       = DFLT_MSGMAX;
 	ns->mq_msgsize_max   = DFLT_MSGSIZEMAX;
+	ns->mq_msg_default   = DFLT_MSG;
+	ns->mq_msgsize_default = DFLT_MSGSIZE;
 
 	ns->mq_mnt = kern_mount_data(&mqueue_fs_type, ns);
 	if (IS_ERR(ns->mq_mnt)) {
@@ -44,9 +44,15 @@
  *   - semop() calls and semctl(RMID) are synchronized by RCU.
  *   - most operations do write operations (actually: spin_lock calls) to
  *     the per-semaphore array structure.
+ *   - semop() calls that operate on a single semaphore only take the
+ *     spinlock of that semaphore, as long as no complex operation is
+ *     pending on the array. Everything else takes the array spinlock,
+ *     and then waits until all per-semaphore lock holders have left.
+ *     (see semop_lock(), sem_wait_array())
  *   Thus: Perfect SMP scaling between independent semaphore arrays.
- *         If multiple semaphores in one array are used, then cache line
- *         trashing on the semaphore array spinlock will limit the scaling.
+ *         If independent semaphores in one array are used with simple
+ *         semop() calls, then they scale as well. Complex operations
+ *         still serialize on the semaphore array spinlock.
  * - semncnt and semzcnt are calculated on demand in count_semncnt() and
  *   count_semzcnt()
  * - the task that performs a successful semop() scans the list of all
@@ -67,9 +73,11 @@
  *   semaphore array, lazily allocated). For backwards compatibility, multiple
  *   modes for the UNDO variables are supported (per process, per thread)
  *   (see copy_semundo, CLONE_SYSVSEM)
- * - There are two lists of the pending operations: a per-array list
- *   and per-semaphore list (stored in the array). This allows to achieve FIFO
- *   ordering without always scanning all pending operations.
+ * - There are two kinds of lists of the pending operations: operations on
+ *   a single semaphore are queued on the per-semaphore list (stored in the
+ *   array), complex operations on the per-array list. Within each list the
+ *   ordering is FIFO. This allows to complete simple operations without
+ *   scanning all pending operations, and without the array spinlock.
  *   The worst-case behavior is nevertheless O(N^2) for N wakeups.
  */
 
@@ -94,12 +102,12 @@
 struct sem {
 	int	semval;		/* current value */
 	int	sempid;		/* pid of last operation */
+	spinlock_t	lock;	/* spinlock for single-sop operations */
 	struct list_head sem_pending; /* pending single-sop operations */
 };
 
 /* One queue for each sleeping process in the system. */
 struct sem_queue {
-	struct list_head	simple_list; /* queue of pending operations */
 	struct list_head	list;	 /* queue of pending operations */
 	struct task_struct	*sleeper; /* this process */
 	struct sem_undo		*undo;	 /* undo structure */
@@ -155,6 +163,7 @@ static int sysvipc_sem_proc_show(struct seq_file *s, void *it);
  *	sem_undo.id_next,
  *	sem_array.sem_pending{,last},
  *	sem_array.sem_undo: sem_lock() for read/write
+ *	sem.sem_pending: sem.lock or sem_lock() for read/write
  *	sem_undo.proc_next: only "current" is allowed to read/write that field.
  *	
  */
@@ -190,37 +199,121 @@ void __init sem_init (void)
 				IPC_SEM_IDS, sysvipc_sem_proc_show);
 }
 
+/*
+ * Wait until all currently running simple semop() calls have left their
+ * critical section. The caller must hold the array spinlock: new simple
+ * operations cannot start, because they check that it is unlocked.
+ */
+static void sem_wait_array(struct sem_array *sma)
+{
+	int i;
+
+	/* Pairs with the smp_mb() in semop_lock(). */
+	smp_mb();
+	for (i = 0; i < sma->sem_nsems; i++)
+		spin_unlock_wait(&sma->sem_base[i].lock);
+	/* Do not read semaphore state before the owners dropped the locks. */
+	smp_rmb();
+}
+
 /*
  * sem_lock_(check_) routines are called in the paths where the rw_mutex
- * is not held.
+ * is not held. They lock the whole array.
  */
 static inline struct sem_array *sem_lock(struct ipc_namespace *ns, int id)
 {
 	struct kern_ipc_perm *ipcp = ipc_lock(&sem_ids(ns), id);
+	struct sem_array *sma;
 
 	if (IS_ERR(ipcp))
 		return (struct sem_array *)ipcp;
 
-	return container_of(ipcp, struct sem_array, sem_perm);
+	sma = container_of(ipcp, struct sem_array, sem_perm);
+	sem_wait_array(sma);
+	return sma;
 }
 
 static inline struct sem_array *sem_lock_check(struct ipc_namespace *ns,
 						int id)
 {
 	struct kern_ipc_perm *ipcp = ipc_lock_check(&sem_ids(ns), id);
+	struct sem_array *sma;
 
 	if (IS_ERR(ipcp))
 		return (struct sem_array *)ipcp;
 
-	return container_of(ipcp, struct sem_array, sem_perm);
+	sma = container_of(ipcp, struct sem_array, sem_perm);
+	sem_wait_array(sma);
+	return sma;
 }
 
 static inline void sem_lock_and_putref(struct sem_array *sma)
 {
 	ipc_lock_by_ptr(&sma->sem_perm);
+	sem_wait_array(sma);
 	ipc_rcu_putref(sma);
 }
 
+/*
+ * Must be called with rcu_read_lock() held; the array is not locked.
+ */
+static inline struct sem_array *sem_obtain_object(struct ipc_namespace *ns,
+						int id)
+{
+	struct kern_ipc_perm *ipcp = ipc_obtain_object(&sem_ids(ns), id);
+
+	if (IS_ERR(ipcp))
+		return (struct sem_array *)ipcp;
+
+	return container_of(ipcp, struct sem_array, sem_perm);
+}
+
+/*
+ * semop_lock - lock what a semop() call needs
+ * If the request contains only one semaphore operation and there are no
+ * complex operations pending, only the spinlock of that semaphore is taken.
+ * Otherwise the whole array is locked: either our own operation spans
+ * several semaphores, or pending complex operations must be looked at.
+ *
+ * Returns the number of the locked semaphore, or -1 if the array spinlock
+ * is held. The caller must hold rcu_read_lock(), the array is not checked
+ * for deletion.
+ */
+static int semop_lock(struct sem_array *sma, struct sembuf *sops, int nsops)
+{
+	struct sem *sem;
+
+	if (nsops != 1 || sops->sem_num >= sma->sem_nsems)
+		goto lock_array;
+
+	sem = sma->sem_base + sops->sem_num;
+	while (!sma->complex_count) {
+		spin_lock(&sem->lock);
+		/* Pairs with the smp_mb() in sem_wait_array(). */
+		smp_mb();
+		if (likely(!spin_is_locked(&sma->sem_perm.lock) &&
+			   !sma->complex_count))
+			return sops->sem_num;
+
+		/* Someone operates on the whole array, wait for him. */
+		spin_unlock(&sem->lock);
+		spin_unlock_wait(&sma->sem_perm.lock);
+	}
+
+lock_array:
+	spin_lock(&sma->sem_perm.lock);
+	sem_wait_array(sma);
+	return -1;
+}
+
+static inline void semop_unlock(struct sem_array *sma, int locknum)
+{
+	if (locknum == -1)
+		spin_unlock(&sma->sem_perm.lock);
+	else
+		spin_unlock(&sma->sem_base[locknum].lock);
+}
+
 static inline void sem_getref_and_unlock(struct sem_array *sma)
 {
 	ipc_rcu_getref(sma);
@@ -314,24 +407,31 @@ static int newary(struct ipc_namespace *ns, struct ipc_params *params)
 		return retval;
 	}
 
-	id = ipc_addid(&sem_ids(ns), &sma->sem_perm, ns->sc_semmni);
-	if (id < 0) {
-		security_sem_free(sma);
-		ipc_rcu_putref(sma);
-		return id;
-	}
-	ns->used_sems += nsems;
-
+	/*
+	 * semop() looks at the semaphores without the array spinlock,
+	 * thus they must be set up before the array becomes visible.
+	 */
 	sma->sem_base = (struct sem *) &sma[1];
 
-	for (i = 0; i < nsems; i++)
+	for (i = 0; i < nsems; i++) {
+		spin_lock_init(&sma->sem_base[i].lock);
 		INIT_LIST_HEAD(&sma->sem_base[i].sem_pending);
+	}
 
 	sma->complex_count = 0;
 	INIT_LIST_HEAD(&sma->sem_pending);
 	INIT_LIST_HEAD(&sma->list_id);
 	sma->sem_nsems = nsems;
 	sma->sem_ctime = get_seconds();
+
+	id = ipc_addid(&sem_ids(ns), &sma->sem_perm, ns->sc_semmni);
+	if (id < 0) {
+		security_sem_free(sma);
+		ipc_rcu_putref(sma);
+		return id;
+	}
+	ns->used_sems += nsems;
+
 	sem_unlock(sma);
 
 	return sma->sem_perm.id;
@@ -471,7 +571,7 @@ static void wake_up_sem_queue_prepare(struct list_head *pt,
 	q->status = IN_WAKEUP;
 	q->pid = error;
 
-	list_add_tail(&q->simple_list, pt);
+	list_add_tail(&q->list, pt);
 }
 
 /**
@@ -489,7 +589,7 @@ static void wake_up_sem_queue_do(struct list_head *pt)
 	int did_something;
 
 	did_something = !list_empty(pt);
-	list_for_each_entry_safe(q, t, pt, simple_list) {
+	list_for_each_entry_safe(q, t, pt, list) {
 		wake_up_process(q->sleeper);
 		/* q can disappear immediately after writing q->status. */
 		smp_wmb();
@@ -502,9 +602,7 @@ static void wake_up_sem_queue_do(struct list_head *pt)
 static void unlink_queue(struct sem_array *sma, struct sem_queue *q)
 {
 	list_del(&q->list);
-	if (q->nsops == 1)
-		list_del(&q->simple_list);
-	else
+	if (q->nsops > 1)
 		sma->complex_count--;
 }
 
@@ -559,7 +657,7 @@ static int check_restart(struct sem_array *sma, struct sem_queue *q)
 	 * semval is 0. Check if there are wait-for-zero semops.
 	 * They must be the first entries in the per-semaphore simple queue
 	 */
-	h = list_first_entry(&curr->sem_pending, struct sem_queue, simple_list);
+	h = list_first_entry(&curr->sem_pending, struct sem_queue, list);
 	BUG_ON(h->nsops != 1);
 	BUG_ON(h->sops[0].sem_num != q->sops[0].sem_num);
 
@@ -579,8 +677,8 @@ static int check_restart(struct sem_array *sma, struct sem_queue *q)
  * @pt: list head for the tasks that must be woken up.
  *
  * update_queue must be called after a semaphore in a semaphore array
- * was modified. If multiple semaphore were modified, then @semnum
- * must be set to -1.
+ * was modified. With @semnum set to -1, the queue of the pending complex
+ * operations is scanned, otherwise the queue of the given semaphore.
  * The tasks that must be woken up are added to @pt. The return code
  * is stored in q->pid.
  * The function return 1 if at least one semop was completed successfully.
@@ -590,30 +688,19 @@ static int update_queue(struct sem_array *sma, int semnum, struct list_head *pt)
 	struct sem_queue *q;
 	struct list_head *walk;
 	struct list_head *pending_list;
-	int offset;
 	int semop_completed = 0;
 
-	/* if there are complex operations around, then knowing the semaphore
-	 * that was modified doesn't help us. Assume that multiple semaphores
-	 * were modified.
-	 */
-	if (sma->complex_count)
-		semnum = -1;
-
-	if (semnum == -1) {
+	if (semnum == -1)
 		pending_list = &sma->sem_pending;
-		offset = offsetof(struct sem_queue, list);
-	} else {
+	else
 		pending_list = &sma->sem_base[semnum].sem_pending;
-		offset = offsetof(struct sem_queue, simple_list);
-	}
 
 again:
 	walk = pending_list->next;
 	while (walk != pending_list) {
 		int error, restart;
 
-		q = (struct sem_queue *)((char *)walk - offset);
+		q = list_entry(walk, struct sem_queue, list);
 		walk = walk->next;
 
 		/* If we are scanning the single sop, per-semaphore list of
@@ -667,11 +754,22 @@ again:
 static void do_smart_update(struct sem_array *sma, struct sembuf *sops, int nsops,
 			int otime, struct list_head *pt)
 {
-	int i;
+	int i, progress;
 
 	if (sma->complex_count || sops == NULL) {
-		if (update_queue(sma, -1, pt))
-			otime = 1;
+		/*
+		 * Complex operations and semctl() change several semaphores
+		 * at once, and simple and complex operations are queued
+		 * separately: scan all queues until nothing completes anymore.
+		 * This is only done with the array spinlock held.
+		 */
+		do {
+			progress = update_queue(sma, -1, pt);
+			for (i = 0; i < sma->sem_nsems; i++)
+				progress |= update_queue(sma, i, pt);
+			if (progress)
+				otime = 1;
+		} while (progress);
 		goto done;
 	}
 
@@ -703,6 +801,11 @@ static int count_semncnt (struct sem_array * sma, ushort semnum)
 	struct sem_queue * q;
 
 	semncnt = 0;
+	list_for_each_entry(q, &sma->sem_base[semnum].sem_pending, list) {
+		struct sembuf * sop = q->sops;
+		if ((sop->sem_op < 0) && !(sop->sem_flg & IPC_NOWAIT))
+			semncnt++;
+	}
 	list_for_each_entry(q, &sma->sem_pending, list) {
 		struct sembuf * sops = q->sops;
 		int nsops = q->nsops;
@@ -722,6 +825,11 @@ static int count_semzcnt (struct sem_array * sma, ushort semnum)
 	struct sem_queue * q;
 
 	semzcnt = 0;
+	list_for_each_entry(q, &sma->sem_base[semnum].sem_pending, list) {
+		struct sembuf * sop = q->sops;
+		if ((sop->sem_op == 0) && !(sop->sem_flg & IPC_NOWAIT))
+			semzcnt++;
+	}
 	list_for_each_entry(q, &sma->sem_pending, list) {
 		struct sembuf * sops = q->sops;
 		int nsops = q->nsops;
@@ -745,9 +853,11 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 	struct sem_queue *q, *tq;
 	struct sem_array *sma = container_of(ipcp, struct sem_array, sem_perm);
 	struct list_head tasks;
+	int i;
 
 	/* Free the existing undo structures for this semaphore set.  */
 	assert_spin_locked(&sma->sem_perm.lock);
+	sem_wait_array(sma);
 	list_for_each_entry_safe(un, tu, &sma->list_id, list_id) {
 		list_del(&un->list_id);
 		spin_lock(&un->ulp->lock);
@@ -763,6 +873,13 @@ static void freeary(struct ipc_namespace *ns, struct kern_ipc_perm *ipcp)
 		unlink_queue(sma, q);
 		wake_up_sem_queue_prepare(&tasks, q, -EIDRM);
 	}
+	for (i = 0; i < sma->sem_nsems; i++) {
+		struct sem *sem = sma->sem_base + i;
+		list_for_each_entry_safe(q, tq, &sem->sem_pending, list) {
+			unlink_queue(sma, q);
+			wake_up_sem_queue_prepare(&tasks, q, -EIDRM);
+		}
+	}
 
 	/* Remove the semaphore set from the IDR */
 	sem_rmid(ns, sma);
@@ -1335,7 +1452,7 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	struct sembuf fast_sops[SEMOPM_FAST];
 	struct sembuf* sops = fast_sops, *sop;
 	struct sem_undo *un;
-	int undos = 0, alter = 0, max;
+	int undos = 0, alter = 0, max, locknum;
 	struct sem_queue queue;
 	unsigned long jiffies_left = 0;
 	struct ipc_namespace *ns;
@@ -1380,48 +1497,53 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	}
 
 	if (undos) {
+		/* On success, find_alloc_undo returns with rcu_read_lock held */
 		un = find_alloc_undo(ns, semid);
 		if (IS_ERR(un)) {
 			error = PTR_ERR(un);
 			goto out_free;
 		}
-	} else
+	} else {
 		un = NULL;
+		rcu_read_lock();
+	}
 
 	INIT_LIST_HEAD(&tasks);
 
-	sma = sem_lock_check(ns, semid);
+	/*
+	 * The array is protected by rcu until semop_unlock(). Depending on
+	 * the operations, only one semaphore or the whole array is locked.
+	 */
+	sma = sem_obtain_object(ns, semid);
 	if (IS_ERR(sma)) {
-		if (un)
-			rcu_read_unlock();
+		rcu_read_unlock();
 		error = PTR_ERR(sma);
 		goto out_free;
 	}
 
+	locknum = semop_lock(sma, sops, nsops);
+
+	error = -EINVAL;
+	if (sma->sem_perm.deleted)
+		goto out_unlock_free;
+
+	error = -EIDRM;
+	if (sem_checkid(sma, semid))
+		goto out_unlock_free;
+
 	/*
 	 * semid identifiers are not unique - find_alloc_undo may have
 	 * allocated an undo structure, it was invalidated by an RMID
 	 * and now a new array with received the same id. Check and fail.
 	 * This case can be detected checking un->semid. The existence of
-	 * "un" itself is guaranteed by rcu.
+	 * "un" itself is guaranteed by rcu, and it cannot be freed while
+	 * we hold a lock on the array:
+	 * - IPC_RMID waits for all semaphore locks, see freeary().
+	 * - exit_sem is impossible, it always operates on current
+	 *   (or a dead task).
 	 */
-	error = -EIDRM;
-	if (un) {
-		if (un->semid == -1) {
-			rcu_read_unlock();
-			goto out_unlock_free;
-		} else {
-			/*
-			 * rcu lock can be released, "un" cannot disappear:
-			 * - sem_lock is acquired, thus IPC_RMID is
-			 *   impossible.
-			 * - exit_sem is impossible, it always operates on
-			 *   current (or a dead task).
-			 */
-
-			rcu_read_unlock();
-		}
-	}
+	if (un && un->semid == -1)
+		goto out_unlock_free;
 
 	error = -EFBIG;
 	if (max >= sma->sem_nsems)
@@ -1452,21 +1574,19 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 	queue.undo = un;
 	queue.pid = task_tgid_vnr(current);
 	queue.alter = alter;
-	if (alter)
-		list_add_tail(&queue.list, &sma->sem_pending);
-	else
-		list_add(&queue.list, &sma->sem_pending);
-
 	if (nsops == 1) {
 		struct sem *curr;
 		curr = &sma->sem_base[sops->sem_num];
 
 		if (alter)
-			list_add_tail(&queue.simple_list, &curr->sem_pending);
+			list_add_tail(&queue.list, &curr->sem_pending);
 		else
-			list_add(&queue.simple_list, &curr->sem_pending);
+			list_add(&queue.list, &curr->sem_pending);
 	} else {
-		INIT_LIST_HEAD(&queue.simple_list);
+		if (alter)
+			list_add_tail(&queue.list, &sma->sem_pending);
+		else
+			list_add(&queue.list, &sma->sem_pending);
 		sma->complex_count++;
 	}
 
@@ -1475,7 +1595,8 @@ SYSCALL_DEFINE4(semtimedop, int, semid, struct sembuf __user *, tsops,
 
 sleep_again:
 	current->state = TASK_INTERRUPTIBLE;
-	sem_unlock(sma);
+	semop_unlock(sma, locknum);
+	rcu_read_unlock();
 
 	if (timeout)
 		jiffies_left = schedule_timeout(jiffies_left);
@@ -1497,7 +1618,10 @@ sleep_again:
 		goto out_free;
 	}
 
-	sma = sem_lock(ns, semid);
+	rcu_read_lock();
+	sma = sem_obtain_object(ns, semid);
+	if (!IS_ERR(sma))
+		locknum = semop_lock(sma, sops, nsops);
 
 	/*
 	 * Wait until it's guaranteed that no wakeup_sem_queue_do() is ongoing.
@@ -1505,9 +1629,15 @@ sleep_again:
 	error = get_queue_result(&queue);
 
 	/*
-	 * Array removed? If yes, leave without sem_unlock().
+	 * Array removed? If yes, leave without unlink_queue().
 	 */
 	if (IS_ERR(sma)) {
+		rcu_read_unlock();
+		goto out_free;
+	}
+	if (sma->sem_perm.deleted) {
+		semop_unlock(sma, locknum);
+		rcu_read_unlock();
 		goto out_free;
 	}
 
@@ -1536,7 +1666,8 @@ sleep_again:
 	unlink_queue(sma, &queue);
 
 out_unlock_free:
-	sem_unlock(sma);
+	semop_unlock(sma, locknum);
+	rcu_read_unlock();
 
 	wake_up_sem_queue_do(&tasks);
 out_free:
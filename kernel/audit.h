@@ -162,6 +162,21 @@ static inline int audit_signal_info(int sig, struct task_struct *t)
 }
 extern void audit_filter_inodes(struct task_struct *, struct audit_context *);
 extern struct list_head *audit_killed_trees(void);
+
+extern u32 audit_syscall_mask[AUDIT_BITMASK_SIZE];
+
+/*
+ * Cheap test whether any entry or exit rule covers syscall @major.  The
+ * mask only ever over-approximates the loaded rules, see
+ * audit_update_syscall_mask().
+ */
+static inline bool audit_syscall_may_match(int major)
+{
+	if ((unsigned int)major >= AUDIT_BITMASK_SIZE * 32)
+		return true;
+	return ACCESS_ONCE(audit_syscall_mask[AUDIT_WORD(major)]) &
+	       AUDIT_BIT(major);
+}
 #else
 #define audit_signal_info(s,t) AUDIT_DISABLED
 #define audit_filter_inodes(t,c) AUDIT_DISABLED
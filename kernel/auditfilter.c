@@ -859,6 +859,45 @@ out:
 static u64 prio_low = ~0ULL/2;
 static u64 prio_high = ~0ULL/2 - 1;
 
+#ifdef CONFIG_AUDITSYSCALL
+static inline int audit_rule_filters_syscall(struct audit_krule *rule)
+{
+	return rule->listnr == AUDIT_FILTER_ENTRY ||
+	       rule->listnr == AUDIT_FILTER_EXIT;
+}
+
+/*
+ * Keep audit_syscall_mask a superset of the syscalls the loaded rules can
+ * match.  A new rule's bits are added before the rule becomes visible and
+ * the mask is only narrowed after a rule is gone, so syscall entry never
+ * skips a syscall that a visible rule covers.  Called with
+ * audit_filter_mutex held.
+ */
+static void audit_update_syscall_mask(struct audit_krule *new)
+{
+	u32 mask[AUDIT_BITMASK_SIZE];
+	struct audit_krule *r;
+	int i;
+
+	if (new) {
+		if (audit_rule_filters_syscall(new))
+			for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+				audit_syscall_mask[i] |= new->mask[i];
+		return;
+	}
+
+	memset(mask, 0, sizeof(mask));
+	list_for_each_entry(r, &audit_rules_list[AUDIT_FILTER_ENTRY], list)
+		for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+			mask[i] |= r->mask[i];
+	list_for_each_entry(r, &audit_rules_list[AUDIT_FILTER_EXIT], list)
+		for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+			mask[i] |= r->mask[i];
+	for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+		audit_syscall_mask[i] = mask[i];
+}
+#endif
+
 /* Add rule to given filterlist if not a duplicate. */
 static inline int audit_add_rule(struct audit_entry *entry)
 {
@@ -911,6 +950,9 @@ static inline int audit_add_rule(struct audit_entry *entry)
 			entry->rule.prio = --prio_low;
 	}
 
+#ifdef CONFIG_AUDITSYSCALL
+	audit_update_syscall_mask(&entry->rule);
+#endif
 	if (entry->rule.flags & AUDIT_FILTER_PREPEND) {
 		list_add(&entry->rule.list,
 			 &audit_rules_list[entry->rule.listnr]);
@@ -979,6 +1021,8 @@ static inline int audit_del_rule(struct audit_entry *entry)
 
 	if (!audit_match_signal(entry))
 		audit_signals--;
+
+	audit_update_syscall_mask(NULL);
 #endif
 	mutex_unlock(&audit_filter_mutex);
 
@@ -84,6 +84,9 @@
 /* number of audit rules */
 int audit_n_rules;
 
+/* union of the syscall masks of all entry and exit rules */
+u32 audit_syscall_mask[AUDIT_BITMASK_SIZE];
+
 /* determines whether we collect data for signals sent */
 int audit_signals;
 
@@ -1657,8 +1660,16 @@ void audit_syscall_entry(int arch, int major,
 	state = context->state;
 	context->dummy = !audit_n_rules;
 	if (!context->dummy && state == AUDIT_BUILD_CONTEXT) {
-		context->prio = 0;
-		state = audit_filter_syscall(tsk, context, &audit_filter_list[AUDIT_FILTER_ENTRY]);
+		/*
+		 * No entry or exit rule can match this syscall, so there is
+		 * nothing to collect for the exit filters either.
+		 */
+		if (!audit_syscall_may_match(major))
+			context->dummy = 1;
+		else {
+			context->prio = 0;
+			state = audit_filter_syscall(tsk, context, &audit_filter_list[AUDIT_FILTER_ENTRY]);
+		}
 	}
 	if (likely(state == AUDIT_DISABLED))
 		return;
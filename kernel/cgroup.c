@@ -299,9 +299,12 @@ static struct cg_cgroup_link init_css_set_link;
 static int cgroup_init_idr(struct cgroup_subsys *ss,
 			   struct cgroup_subsys_state *css);
 
-/* css_set_lock protects the list of css_set objects, and the
- * chain of tasks off each css_set.  Nests outside task->alloc_lock
- * due to cgroup_iter_start() */
+/* css_set_lock protects the list of css_set objects and their links
+ * to cgroups.  The chain of tasks off each css_set is protected by the
+ * css_set's own tasks_lock, so that fork and exit only touch the
+ * css_set of the task concerned; moving a task between css_sets takes
+ * css_set_lock for writing as well, to keep iterators consistent.
+ * Both nest outside task->alloc_lock due to cgroup_iter_start() */
 static DEFINE_RWLOCK(css_set_lock);
 static int css_set_count;
 
@@ -401,6 +404,48 @@ static inline void put_css_set_taskexit(struct css_set *cg)
 	__put_css_set(cg, 1);
 }
 
+/*
+ * Lock the task list of the css_set @tsk is using.  A task only changes
+ * css_set with the tasks_lock of the old one held, or while exiting, so
+ * once the lock is taken on the css_set the task still points to, the
+ * task stays on it until the lock is dropped.
+ */
+static struct css_set *lock_task_css_set(struct task_struct *tsk)
+{
+	struct css_set *cg;
+
+	rcu_read_lock();
+	for (;;) {
+		cg = rcu_dereference(tsk->cgroups);
+		spin_lock(&cg->tasks_lock);
+		if (likely(cg == tsk->cgroups))
+			break;
+		spin_unlock(&cg->tasks_lock);
+	}
+	rcu_read_unlock();
+	return cg;
+}
+
+/* Lock the task lists of two css_sets, in address order */
+static void lock_css_set_pair(struct css_set *a, struct css_set *b)
+{
+	if (a == b) {
+		spin_lock(&a->tasks_lock);
+		return;
+	}
+	if (a > b)
+		swap(a, b);
+	spin_lock(&a->tasks_lock);
+	spin_lock_nested(&b->tasks_lock, SINGLE_DEPTH_NESTING);
+}
+
+static void unlock_css_set_pair(struct css_set *a, struct css_set *b)
+{
+	if (a != b)
+		spin_unlock(&b->tasks_lock);
+	spin_unlock(&a->tasks_lock);
+}
+
 /*
  * compare_css_sets - helper function for find_existing_css_set().
  * @cg: candidate css_set being tested
@@ -626,6 +671,7 @@ static struct css_set *find_css_set(
 
 	atomic_set(&res->refcount, 1);
 	INIT_LIST_HEAD(&res->cg_links);
+	spin_lock_init(&res->tasks_lock);
 	INIT_LIST_HEAD(&res->tasks);
 	INIT_HLIST_NODE(&res->hlist);
 
@@ -1788,31 +1834,40 @@ static int cgroup_task_migrate(struct cgroup *cgrp, struct cgroup *oldcgrp,
 			return -ENOMEM;
 		}
 	}
-	put_css_set(oldcg);
 
-	/* if PF_EXITING is set, the tsk->cgroups pointer is no longer safe. */
+	/*
+	 * Switch css_set and task list together, so that fork and exit
+	 * find the task on the list of the css_set it points to.  If
+	 * PF_EXITING is set, the tsk->cgroups pointer is no longer safe.
+	 */
+	write_lock(&css_set_lock);
+	lock_css_set_pair(oldcg, newcg);
 	task_lock(tsk);
 	if (tsk->flags & PF_EXITING) {
 		task_unlock(tsk);
+		unlock_css_set_pair(oldcg, newcg);
+		write_unlock(&css_set_lock);
 		put_css_set(newcg);
+		put_css_set(oldcg);
 		return -ESRCH;
 	}
 	rcu_assign_pointer(tsk->cgroups, newcg);
-	task_unlock(tsk);
-
 	/* Update the css_set linked lists if we're using them */
-	write_lock(&css_set_lock);
 	if (!list_empty(&tsk->cg_list))
 		list_move(&tsk->cg_list, &newcg->tasks);
+	task_unlock(tsk);
+	unlock_css_set_pair(oldcg, newcg);
 	write_unlock(&css_set_lock);
 
 	/*
 	 * We just gained a reference on oldcg by taking it from the task. As
 	 * trading it for newcg is protected by cgroup_mutex, we're safe to drop
-	 * it here; it will be freed under RCU.
+	 * it here, along with the one we took above; it will be freed under
+	 * RCU.
 	 */
 	set_bit(CGRP_RELEASABLE, &oldcgrp->flags);
 	put_css_set(oldcg);
+	put_css_set(oldcg);
 	return 0;
 }
 
@@ -2751,8 +2806,11 @@ static void cgroup_advance_iter(struct cgroup *cgrp,
 	struct cg_cgroup_link *link;
 	struct css_set *cg;
 
-	/* Advance to the next non-empty css_set */
-	do {
+	/*
+	 * Advance to the next non-empty css_set, and keep its task list
+	 * locked while the iterator is on it.
+	 */
+	for (;;) {
 		l = l->next;
 		if (l == &cgrp->css_sets) {
 			it->cg_link = NULL;
@@ -2760,7 +2818,11 @@ static void cgroup_advance_iter(struct cgroup *cgrp,
 		}
 		link = list_entry(l, struct cg_cgroup_link, cgrp_link_list);
 		cg = link->cg;
-	} while (list_empty(&cg->tasks));
+		spin_lock(&cg->tasks_lock);
+		if (!list_empty(&cg->tasks))
+			break;
+		spin_unlock(&cg->tasks_lock);
+	}
 	it->cg_link = l;
 	it->task = cg->tasks.next;
 }
@@ -2777,23 +2839,29 @@ static void cgroup_advance_iter(struct cgroup *cgrp,
 static void cgroup_enable_task_cg_lists(void)
 {
 	struct task_struct *p, *g;
+	struct css_set *cg;
+
 	write_lock(&css_set_lock);
 	use_task_css_set_links = 1;
 	do_each_thread(g, p) {
+		cg = lock_task_css_set(p);
 		task_lock(p);
 		/*
 		 * We should check if the process is exiting, otherwise
 		 * it will race with cgroup_exit() in that the list
 		 * entry won't be deleted though the process has exited.
 		 * Do it while holding siglock so that we don't end up
-		 * racing against cgroup_exit().
+		 * racing against cgroup_exit().  An exiting task may also
+		 * have switched to init_css_set since we looked.
 		 */
 		spin_lock_irq(&p->sighand->siglock);
-		if (!(p->flags & PF_EXITING) && list_empty(&p->cg_list))
-			list_add(&p->cg_list, &p->cgroups->tasks);
+		if (!(p->flags & PF_EXITING) && p->cgroups == cg &&
+		    list_empty(&p->cg_list))
+			list_add(&p->cg_list, &cg->tasks);
 		spin_unlock_irq(&p->sighand->siglock);
 
 		task_unlock(p);
+		spin_unlock(&cg->tasks_lock);
 	} while_each_thread(g, p);
 	write_unlock(&css_set_lock);
 }
@@ -2830,6 +2898,7 @@ struct task_struct *cgroup_iter_next(struct cgroup *cgrp,
 	if (l == &link->cg->tasks) {
 		/* We reached the end of this task list - move on to
 		 * the next cg_cgroup_link */
+		spin_unlock(&link->cg->tasks_lock);
 		cgroup_advance_iter(cgrp, it);
 	} else {
 		it->task = l;
@@ -2839,6 +2908,13 @@ struct task_struct *cgroup_iter_next(struct cgroup *cgrp,
 
 void cgroup_iter_end(struct cgroup *cgrp, struct cgroup_iter *it)
 {
+	if (it->cg_link) {
+		struct cg_cgroup_link *link;
+
+		link = list_entry(it->cg_link, struct cg_cgroup_link,
+				  cgrp_link_list);
+		spin_unlock(&link->cg->tasks_lock);
+	}
 	read_unlock(&css_set_lock);
 }
 
@@ -4307,6 +4383,7 @@ int __init cgroup_init_early(void)
 	int i;
 	atomic_set(&init_css_set.refcount, 1);
 	INIT_LIST_HEAD(&init_css_set.cg_links);
+	spin_lock_init(&init_css_set.tasks_lock);
 	INIT_LIST_HEAD(&init_css_set.tasks);
 	INIT_HLIST_NODE(&init_css_set.hlist);
 	css_set_count = 1;
@@ -4522,15 +4599,24 @@ static const struct file_operations proc_cgroupstats_operations = {
  * have already changed current->cgroups, allowing the previously
  * referenced cgroup group to be removed and freed.
  *
+ * css_sets are freed under RCU and only once their refcount has
+ * dropped to zero, so the parent's css_set is looked up under RCU and
+ * only used if a reference can still be taken on it; otherwise
+ * cgroup_attach_task() has just switched it and we look again.
+ *
  * At the point that cgroup_fork() is called, 'current' is the parent
  * task, and the passed argument 'child' points to the child task.
  */
 void cgroup_fork(struct task_struct *child)
 {
-	task_lock(current);
-	child->cgroups = current->cgroups;
-	get_css_set(child->cgroups);
-	task_unlock(current);
+	struct css_set *cg;
+
+	rcu_read_lock();
+	do {
+		cg = rcu_dereference(current->cgroups);
+	} while (!atomic_inc_not_zero(&cg->refcount));
+	rcu_read_unlock();
+	child->cgroups = cg;
 	INIT_LIST_HEAD(&child->cg_list);
 }
 
@@ -4549,12 +4635,11 @@ void cgroup_post_fork(struct task_struct *child)
 	int i;
 
 	if (use_task_css_set_links) {
-		write_lock(&css_set_lock);
-		task_lock(child);
+		struct css_set *cg = lock_task_css_set(child);
+
 		if (list_empty(&child->cg_list))
-			list_add(&child->cg_list, &child->cgroups->tasks);
-		task_unlock(child);
-		write_unlock(&css_set_lock);
+			list_add(&child->cg_list, &cg->tasks);
+		spin_unlock(&cg->tasks_lock);
 	}
 
 	/*
@@ -4614,13 +4699,13 @@ void cgroup_exit(struct task_struct *tsk, int run_callbacks)
 	/*
 	 * Unlink from the css_set task list if necessary.
 	 * Optimistically check cg_list before taking
-	 * css_set_lock
+	 * the css_set's tasks_lock
 	 */
 	if (!list_empty(&tsk->cg_list)) {
-		write_lock(&css_set_lock);
+		cg = lock_task_css_set(tsk);
 		if (!list_empty(&tsk->cg_list))
 			list_del_init(&tsk->cg_list);
-		write_unlock(&css_set_lock);
+		spin_unlock(&cg->tasks_lock);
 	}
 
 	/* Reassign the task to the init_css_set. */
@@ -5175,6 +5260,7 @@ static int cgroup_css_links_read(struct cgroup *cont,
 		struct task_struct *task;
 		int count = 0;
 		seq_printf(seq, "css_set %p\n", cg);
+		spin_lock(&cg->tasks_lock);
 		list_for_each_entry(task, &cg->tasks, cg_list) {
 			if (count++ > MAX_TASKS_SHOWN_PER_CSS) {
 				seq_puts(seq, "  ...\n");
@@ -5184,6 +5270,7 @@ static int cgroup_css_links_read(struct cgroup *cont,
 					   task_pid_vnr(task));
 			}
 		}
+		spin_unlock(&cg->tasks_lock);
 	}
 	read_unlock(&css_set_lock);
 	return 0;
@@ -0,0 +1,122 @@
+/*
+ * cgroup_timer_slack.c - control group timer slack subsystem
+ *
+ * Sets the hrtimer slack of every task in a cgroup, so that a group of
+ * background jobs can be given a large slack without each of them
+ * calling prctl(PR_SET_TIMERSLACK).
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published
+ * by the Free Software Foundation.
+ */
+
+#include <linux/cgroup.h>
+#include <linux/err.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+
+struct cgroup_subsys timer_slack_subsys;
+
+struct timer_slack_cgroup {
+	struct cgroup_subsys_state css;
+	unsigned long timer_slack_ns;
+};
+
+static inline struct timer_slack_cgroup *cgroup_timer_slack(
+		struct cgroup *cgroup)
+{
+	return container_of(
+		cgroup_subsys_state(cgroup, timer_slack_subsys_id),
+		struct timer_slack_cgroup, css);
+}
+
+static void tslack_set_task(struct task_struct *tsk, unsigned long slack_ns)
+{
+	/*
+	 * Both are plain words only ever written whole, racing with the
+	 * task's own prctl() just picks one of the two values.
+	 */
+	tsk->timer_slack_ns = slack_ns;
+	tsk->default_timer_slack_ns = slack_ns;
+}
+
+static struct cgroup_subsys_state *tslack_create(struct cgroup_subsys *ss,
+						 struct cgroup *cgroup)
+{
+	struct timer_slack_cgroup *tslack;
+
+	tslack = kzalloc(sizeof(struct timer_slack_cgroup), GFP_KERNEL);
+	if (!tslack)
+		return ERR_PTR(-ENOMEM);
+
+	if (cgroup->parent)
+		tslack->timer_slack_ns =
+			cgroup_timer_slack(cgroup->parent)->timer_slack_ns;
+	else
+		tslack->timer_slack_ns = init_task.default_timer_slack_ns;
+
+	return &tslack->css;
+}
+
+static void tslack_destroy(struct cgroup_subsys *ss, struct cgroup *cgroup)
+{
+	kfree(cgroup_timer_slack(cgroup));
+}
+
+static void tslack_attach_task(struct cgroup *cgroup, struct task_struct *tsk)
+{
+	tslack_set_task(tsk, cgroup_timer_slack(cgroup)->timer_slack_ns);
+}
+
+static u64 tslack_read(struct cgroup *cgroup, struct cftype *cft)
+{
+	return cgroup_timer_slack(cgroup)->timer_slack_ns;
+}
+
+static int tslack_write(struct cgroup *cgroup, struct cftype *cft, u64 val)
+{
+	struct timer_slack_cgroup *tslack;
+	struct cgroup_iter it;
+	struct task_struct *tsk;
+
+	if (val > ULONG_MAX)
+		return -EINVAL;
+
+	if (!cgroup_lock_live_group(cgroup))
+		return -ENODEV;
+
+	tslack = cgroup_timer_slack(cgroup);
+	tslack->timer_slack_ns = val;
+
+	cgroup_iter_start(cgroup, &it);
+	while ((tsk = cgroup_iter_next(cgroup, &it)))
+		tslack_set_task(tsk, val);
+	cgroup_iter_end(cgroup, &it);
+
+	cgroup_unlock();
+	return 0;
+}
+
+static struct cftype files[] = {
+	{
+		.name = "timer_slack_ns",
+		.read_u64 = tslack_read,
+		.write_u64 = tslack_write,
+	},
+};
+
+static int tslack_populate(struct cgroup_subsys *ss, struct cgroup *cgroup)
+{
+	if (!cgroup->parent)
+		return 0;
+	return cgroup_add_files(cgroup, ss, files, ARRAY_SIZE(files));
+}
+
+struct cgroup_subsys timer_slack_subsys = {
+	.name		= "timer_slack",
+	.create		= tslack_create,
+	.destroy	= tslack_destroy,
+	.populate	= tslack_populate,
+	.subsys_id	= timer_slack_subsys_id,
+	.attach_task	= tslack_attach_task,
+};
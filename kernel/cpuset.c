@@ -33,6 +33,7 @@
 #include <linux/interrupt.h>
 #include <linux/kernel.h>
 #include <linux/kmod.h>
+#include <linux/kthread.h>
 #include <linux/list.h>
 #include <linux/mempolicy.h>
 #include <linux/mm.h>
@@ -145,6 +146,7 @@ typedef enum {
 	CS_SCHED_LOAD_BALANCE,
 	CS_SPREAD_PAGE,
 	CS_SPREAD_SLAB,
+	CS_ISOLATE,
 } cpuset_flagbits_t;
 
 /* convenient tests for these bits */
@@ -183,6 +185,11 @@ static inline int is_spread_slab(const struct cpuset *cs)
 	return test_bit(CS_SPREAD_SLAB, &cs->flags);
 }
 
+static inline int is_isolate(const struct cpuset *cs)
+{
+	return test_bit(CS_ISOLATE, &cs->flags);
+}
+
 static struct cpuset top_cpuset = {
 	.flags = ((1 << CS_CPU_EXCLUSIVE) | (1 << CS_MEM_EXCLUSIVE)),
 };
@@ -228,6 +235,13 @@ static struct cpuset top_cpuset = {
 
 static DEFINE_MUTEX(callback_mutex);
 
+/*
+ * Cpus of all cpusets with the 'isolate' flag, and scratch space for
+ * computing them.  Both protected by cgroup_mutex.
+ */
+static cpumask_var_t isolated_cpus;
+static cpumask_var_t isolated_tmp;
+
 /*
  * cpuset_buffer_lock protects both the cpuset_name and cpuset_nodelist
  * buffers.  They are statically allocated to prevent using excess stack
@@ -578,7 +592,10 @@ static int generate_sched_domains(cpumask_var_t **domains,
 			*dattr = SD_ATTR_INIT;
 			update_domain_attr_tree(dattr, &top_cpuset);
 		}
-		cpumask_copy(doms[0], top_cpuset.cpus_allowed);
+		cpumask_andnot(doms[0], top_cpuset.cpus_allowed,
+			       isolated_cpus);
+		if (cpumask_empty(doms[0]))
+			cpumask_copy(doms[0], top_cpuset.cpus_allowed);
 
 		goto done;
 	}
@@ -855,6 +872,70 @@ static void update_tasks_cpumask(struct cpuset *cs, struct ptr_heap *heap)
 	cgroup_scan_tasks(&scan);
 }
 
+/*
+ * generate_isolated_cpus()
+ *
+ * Compute into isolated_tmp the union of the cpus of all cpusets with
+ * the 'isolate' flag set, with @trial standing in for @cs.  Fails with
+ * -EINVAL if no active cpu would be left to run everything else.
+ *
+ * Call with cgroup_mutex held.
+ */
+static int generate_isolated_cpus(const struct cpuset *cs,
+				  const struct cpuset *trial)
+{
+	LIST_HEAD(q);
+	struct cpuset *cp;
+	struct cgroup *cont;
+
+	cpumask_clear(isolated_tmp);
+
+	list_add(&top_cpuset.stack_list, &q);
+	while (!list_empty(&q)) {
+		const struct cpuset *c;
+
+		cp = list_first_entry(&q, struct cpuset, stack_list);
+		list_del(q.next);
+
+		c = cp == cs ? trial : cp;
+		if (is_isolate(c))
+			cpumask_or(isolated_tmp, isolated_tmp, c->cpus_allowed);
+
+		list_for_each_entry(cont, &cp->css.cgroup->children, sibling)
+			list_add_tail(&cgroup_cs(cont)->stack_list, &q);
+	}
+
+	if (cpumask_subset(cpu_active_mask, isolated_tmp))
+		return -EINVAL;
+	return 0;
+}
+
+/*
+ * update_isolated_cpus()
+ *
+ * Make the cpus computed by generate_isolated_cpus() the isolated ones:
+ * steer new timers and all balanceable irqs off them, move unbound
+ * kernel threads to the rest, and take them out of load balancing.
+ * Cpus no longer isolated get kernel threads back right away; irqs and
+ * timers find them again as they are rebalanced.
+ *
+ * Call with cgroup_mutex held.
+ */
+static void update_isolated_cpus(void)
+{
+	if (cpumask_equal(isolated_cpus, isolated_tmp))
+		return;
+
+	cpumask_copy(isolated_cpus, isolated_tmp);
+	sched_set_isolated_cpus(isolated_cpus);
+	irq_move_off_cpus(isolated_cpus);
+
+	cpumask_andnot(isolated_tmp, cpu_possible_mask, isolated_cpus);
+	kthread_set_affinity(isolated_tmp);
+
+	async_rebuild_sched_domains();
+}
+
 /**
  * update_cpumask - update the cpus_allowed mask of a cpuset and all tasks in it
  * @cs: the cpuset to consider
@@ -895,6 +976,12 @@ static int update_cpumask(struct cpuset *cs, struct cpuset *trialcs,
 	if (cpumask_equal(cs->cpus_allowed, trialcs->cpus_allowed))
 		return 0;
 
+	if (is_isolate(cs)) {
+		retval = generate_isolated_cpus(cs, trialcs);
+		if (retval < 0)
+			return retval;
+	}
+
 	retval = heap_init(&heap, PAGE_SIZE, GFP_KERNEL, NULL);
 	if (retval)
 		return retval;
@@ -913,7 +1000,9 @@ static int update_cpumask(struct cpuset *cs, struct cpuset *trialcs,
 
 	heap_free(&heap);
 
-	if (is_load_balanced)
+	if (is_isolate(cs))
+		update_isolated_cpus();
+	else if (is_load_balanced)
 		async_rebuild_sched_domains();
 	return 0;
 }
@@ -1233,6 +1322,7 @@ static int update_flag(cpuset_flagbits_t bit, struct cpuset *cs,
 	struct cpuset *trialcs;
 	int balance_flag_changed;
 	int spread_flag_changed;
+	int isolate_flag_changed;
 	struct ptr_heap heap;
 	int err;
 
@@ -1249,6 +1339,13 @@ static int update_flag(cpuset_flagbits_t bit, struct cpuset *cs,
 	if (err < 0)
 		goto out;
 
+	isolate_flag_changed = is_isolate(cs) != is_isolate(trialcs);
+	if (isolate_flag_changed) {
+		err = generate_isolated_cpus(cs, trialcs);
+		if (err < 0)
+			goto out;
+	}
+
 	err = heap_init(&heap, PAGE_SIZE, GFP_KERNEL, NULL);
 	if (err < 0)
 		goto out;
@@ -1266,6 +1363,9 @@ static int update_flag(cpuset_flagbits_t bit, struct cpuset *cs,
 	if (!cpumask_empty(trialcs->cpus_allowed) && balance_flag_changed)
 		async_rebuild_sched_domains();
 
+	if (isolate_flag_changed)
+		update_isolated_cpus();
+
 	if (spread_flag_changed)
 		update_tasks_flags(cs, &heap);
 	heap_free(&heap);
@@ -1477,6 +1577,7 @@ typedef enum {
 	FILE_MEMORY_PRESSURE,
 	FILE_SPREAD_PAGE,
 	FILE_SPREAD_SLAB,
+	FILE_ISOLATE,
 } cpuset_filetype_t;
 
 static int cpuset_write_u64(struct cgroup *cgrp, struct cftype *cft, u64 val)
@@ -1516,6 +1617,9 @@ static int cpuset_write_u64(struct cgroup *cgrp, struct cftype *cft, u64 val)
 	case FILE_SPREAD_SLAB:
 		retval = update_flag(CS_SPREAD_SLAB, cs, val);
 		break;
+	case FILE_ISOLATE:
+		retval = update_flag(CS_ISOLATE, cs, val);
+		break;
 	default:
 		retval = -EINVAL;
 		break;
@@ -1675,6 +1779,8 @@ static u64 cpuset_read_u64(struct cgroup *cont, struct cftype *cft)
 		return is_spread_page(cs);
 	case FILE_SPREAD_SLAB:
 		return is_spread_slab(cs);
+	case FILE_ISOLATE:
+		return is_isolate(cs);
 	default:
 		BUG();
 	}
@@ -1783,6 +1889,13 @@ static struct cftype files[] = {
 		.write_u64 = cpuset_write_u64,
 		.private = FILE_SPREAD_SLAB,
 	},
+
+	{
+		.name = "isolate",
+		.read_u64 = cpuset_read_u64,
+		.write_u64 = cpuset_write_u64,
+		.private = FILE_ISOLATE,
+	},
 };
 
 static struct cftype cft_memory_pressure_enabled = {
@@ -1897,6 +2010,8 @@ static void cpuset_destroy(struct cgroup_subsys *ss, struct cgroup *cont)
 
 	if (is_sched_load_balance(cs))
 		update_flag(CS_SCHED_LOAD_BALANCE, cs, 0);
+	if (is_isolate(cs))
+		update_flag(CS_ISOLATE, cs, 0);
 
 	number_of_cpusets--;
 	free_cpumask_var(cs->cpus_allowed);
@@ -1944,6 +2059,10 @@ int __init cpuset_init(void)
 
 	if (!alloc_cpumask_var(&cpus_attach, GFP_KERNEL))
 		BUG();
+	if (!zalloc_cpumask_var(&isolated_cpus, GFP_KERNEL))
+		BUG();
+	if (!alloc_cpumask_var(&isolated_tmp, GFP_KERNEL))
+		BUG();
 
 	number_of_cpusets = 1;
 	return 0;
@@ -20,6 +20,7 @@
 #include <linux/sysctl.h>
 #include <linux/delayacct.h>
 #include <linux/module.h>
+#include <linux/seq_file.h>
 
 int delayacct_on __read_mostly = 1;	/* Delay accounting turned on/off */
 EXPORT_SYMBOL_GPL(delayacct_on);
@@ -55,13 +56,23 @@ static inline void delayacct_start(struct timespec *start)
 	do_posix_clock_monotonic_gettime(start);
 }
 
+/*
+ * Bucket 0 holds delays below 1us, bucket n those of [2^(n-1), 2^n) us
+ * and the last one everything longer; microseconds are taken as 1024ns.
+ */
+static inline unsigned int delayacct_hist_bucket(s64 ns)
+{
+	return min_t(unsigned int, fls64(ns >> 10), DELAYACCT_HIST_BUCKETS - 1);
+}
+
 /*
  * Finish delay accounting for a statistic using
- * its timestamps (@start, @end), accumalator (@total) and @count
+ * its timestamps (@start, @end), accumalator (@total) and @count,
+ * and record it in the distribution of delay class @class
  */
 
 static void delayacct_end(struct timespec *start, struct timespec *end,
-				u64 *total, u32 *count)
+				u64 *total, u32 *count, int class)
 {
 	struct timespec ts;
 	s64 ns;
@@ -76,6 +87,7 @@ static void delayacct_end(struct timespec *start, struct timespec *end,
 	spin_lock_irqsave(&current->delays->lock, flags);
 	*total += ns;
 	(*count)++;
+	current->delays->hist[class][delayacct_hist_bucket(ns)]++;
 	spin_unlock_irqrestore(&current->delays->lock, flags);
 }
 
@@ -86,17 +98,27 @@ void __delayacct_blkio_start(void)
 
 void __delayacct_blkio_end(void)
 {
-	if (current->delays->flags & DELAYACCT_PF_SWAPIN)
+	struct task_delay_info *delays = current->delays;
+
+	if (delays->flags & DELAYACCT_PF_SWAPIN)
 		/* Swapin block I/O */
-		delayacct_end(&current->delays->blkio_start,
-			&current->delays->blkio_end,
-			&current->delays->swapin_delay,
-			&current->delays->swapin_count);
+		delayacct_end(&delays->blkio_start, &delays->blkio_end,
+			&delays->swapin_delay, &delays->swapin_count,
+			DELAYACCT_SWAPIN);
+	else if (delays->flags & DELAYACCT_PF_THROTTLE)
+		/* Sleeping off dirtied pages in balance_dirty_pages() */
+		delayacct_end(&delays->blkio_start, &delays->blkio_end,
+			&delays->throttle_delay, &delays->throttle_count,
+			DELAYACCT_THROTTLE);
+	else if (delays->flags & DELAYACCT_PF_READ)
+		/* Page cache miss on read() or a file page fault */
+		delayacct_end(&delays->blkio_start, &delays->blkio_end,
+			&delays->read_delay, &delays->read_count,
+			DELAYACCT_READ);
 	else	/* Other block I/O */
-		delayacct_end(&current->delays->blkio_start,
-			&current->delays->blkio_end,
-			&current->delays->blkio_delay,
-			&current->delays->blkio_count);
+		delayacct_end(&delays->blkio_start, &delays->blkio_end,
+			&delays->blkio_delay, &delays->blkio_count,
+			DELAYACCT_BLKIO);
 }
 
 int __delayacct_add_tsk(struct taskstats *d, struct task_struct *tsk)
@@ -106,6 +128,9 @@ int __delayacct_add_tsk(struct taskstats *d, struct task_struct *tsk)
 	unsigned long long t2, t3;
 	unsigned long flags;
 	struct timespec ts;
+	int i;
+
+	BUILD_BUG_ON(TASKSTATS_DELAY_HIST_BUCKETS != DELAYACCT_HIST_BUCKETS);
 
 	/* Though tsk->delays accessed later, early exit avoids
 	 * unnecessary returning of other data
@@ -144,15 +169,35 @@ int __delayacct_add_tsk(struct taskstats *d, struct task_struct *tsk)
 	/* zero XXX_total, non-zero XXX_count implies XXX stat overflowed */
 
 	spin_lock_irqsave(&tsk->delays->lock, flags);
-	tmp = d->blkio_delay_total + tsk->delays->blkio_delay;
+	/*
+	 * blkio_delay_total predates the read and dirty throttle split
+	 * and keeps covering them, as it always did.
+	 */
+	tmp = d->blkio_delay_total + tsk->delays->blkio_delay +
+		tsk->delays->read_delay + tsk->delays->throttle_delay;
 	d->blkio_delay_total = (tmp < d->blkio_delay_total) ? 0 : tmp;
 	tmp = d->swapin_delay_total + tsk->delays->swapin_delay;
 	d->swapin_delay_total = (tmp < d->swapin_delay_total) ? 0 : tmp;
 	tmp = d->freepages_delay_total + tsk->delays->freepages_delay;
 	d->freepages_delay_total = (tmp < d->freepages_delay_total) ? 0 : tmp;
-	d->blkio_count += tsk->delays->blkio_count;
+	tmp = d->read_delay_total + tsk->delays->read_delay;
+	d->read_delay_total = (tmp < d->read_delay_total) ? 0 : tmp;
+	tmp = d->throttle_delay_total + tsk->delays->throttle_delay;
+	d->throttle_delay_total = (tmp < d->throttle_delay_total) ? 0 : tmp;
+	d->blkio_count += tsk->delays->blkio_count +
+		tsk->delays->read_count + tsk->delays->throttle_count;
 	d->swapin_count += tsk->delays->swapin_count;
 	d->freepages_count += tsk->delays->freepages_count;
+	d->read_count += tsk->delays->read_count;
+	d->throttle_count += tsk->delays->throttle_count;
+	for (i = 0; i < TASKSTATS_DELAY_HIST_BUCKETS; i++) {
+		d->blkio_hist[i] += tsk->delays->hist[DELAYACCT_BLKIO][i];
+		d->swapin_hist[i] += tsk->delays->hist[DELAYACCT_SWAPIN][i];
+		d->freepages_hist[i] +=
+			tsk->delays->hist[DELAYACCT_FREEPAGES][i];
+		d->read_hist[i] += tsk->delays->hist[DELAYACCT_READ][i];
+		d->throttle_hist[i] += tsk->delays->hist[DELAYACCT_THROTTLE][i];
+	}
 	spin_unlock_irqrestore(&tsk->delays->lock, flags);
 
 done:
@@ -166,7 +211,9 @@ __u64 __delayacct_blkio_ticks(struct task_struct *tsk)
 
 	spin_lock_irqsave(&tsk->delays->lock, flags);
 	ret = nsec_to_clock_t(tsk->delays->blkio_delay +
-				tsk->delays->swapin_delay);
+				tsk->delays->swapin_delay +
+				tsk->delays->read_delay +
+				tsk->delays->throttle_delay);
 	spin_unlock_irqrestore(&tsk->delays->lock, flags);
 	return ret;
 }
@@ -181,6 +228,67 @@ void __delayacct_freepages_end(void)
 	delayacct_end(&current->delays->freepages_start,
 			&current->delays->freepages_end,
 			&current->delays->freepages_delay,
-			&current->delays->freepages_count);
+			&current->delays->freepages_count,
+			DELAYACCT_FREEPAGES);
 }
 
+static const char * const delayacct_class_names[DELAYACCT_NR_CLASSES] = {
+	[DELAYACCT_BLKIO]	= "blkio",
+	[DELAYACCT_SWAPIN]	= "swapin",
+	[DELAYACCT_FREEPAGES]	= "reclaim",
+	[DELAYACCT_READ]	= "read",
+	[DELAYACCT_THROTTLE]	= "dirty_throttle",
+};
+
+/*
+ * Provides /proc/PID/delayacct: a line per delay class with its count,
+ * total delay in nanoseconds and the log2 distribution of the delays.
+ */
+int proc_delayacct_show(struct seq_file *m, struct task_struct *tsk)
+{
+	struct task_delay_info *delays = tsk->delays;
+	u32 hist[DELAYACCT_HIST_BUCKETS];
+	unsigned long flags;
+	u64 total;
+	u32 count;
+	int class, i;
+
+	if (!delays)
+		return 0;
+
+	for (class = 0; class < DELAYACCT_NR_CLASSES; class++) {
+		spin_lock_irqsave(&delays->lock, flags);
+		switch (class) {
+		case DELAYACCT_BLKIO:
+			total = delays->blkio_delay;
+			count = delays->blkio_count;
+			break;
+		case DELAYACCT_SWAPIN:
+			total = delays->swapin_delay;
+			count = delays->swapin_count;
+			break;
+		case DELAYACCT_FREEPAGES:
+			total = delays->freepages_delay;
+			count = delays->freepages_count;
+			break;
+		case DELAYACCT_READ:
+			total = delays->read_delay;
+			count = delays->read_count;
+			break;
+		default:
+			total = delays->throttle_delay;
+			count = delays->throttle_count;
+			break;
+		}
+		memcpy(hist, delays->hist[class], sizeof(hist));
+		spin_unlock_irqrestore(&delays->lock, flags);
+
+		seq_printf(m, "%-15s %u %llu", delayacct_class_names[class],
+			   count, (unsigned long long)total);
+		for (i = 0; i < DELAYACCT_HIST_BUCKETS; i++)
+			seq_printf(m, " %u", hist[i]);
+		seq_putc(m, '\n');
+	}
+
+	return 0;
+}
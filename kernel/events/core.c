@@ -37,6 +37,7 @@
 #include <linux/ftrace_event.h>
 #include <linux/hw_breakpoint.h>
 #include <linux/compat.h>
+#include <linux/perf_regs.h>
 
 #include "internal.h"
 
@@ -4149,6 +4150,131 @@ static void perf_output_read(struct perf_output_handle *handle,
 		perf_output_read_one(handle, event, enabled, running);
 }
 
+static void
+perf_output_sample_regs(struct perf_output_handle *handle,
+			struct pt_regs *regs, u64 mask)
+{
+	int bit;
+
+	for_each_set_bit(bit, (const unsigned long *) &mask,
+			 sizeof(mask) * BITS_PER_BYTE) {
+		u64 val;
+
+		val = perf_reg_value(regs, bit);
+		perf_output_put(handle, val);
+	}
+}
+
+/*
+ * The user registers of the sampled task: the interrupted ones if the
+ * sample hit user mode, the ones saved on kernel entry otherwise.
+ * Kernel threads have none.
+ */
+static void perf_sample_regs_user(struct perf_regs_user *regs_user,
+				  struct pt_regs *regs)
+{
+	if (!user_mode(regs)) {
+		if (current->mm)
+			regs = task_pt_regs(current);
+		else
+			regs = NULL;
+	}
+
+	if (regs) {
+		regs_user->regs = regs;
+		regs_user->abi  = perf_reg_abi(current);
+	} else {
+		regs_user->regs = NULL;
+		regs_user->abi  = PERF_SAMPLE_REGS_ABI_NONE;
+	}
+}
+
+#ifdef CONFIG_HAVE_PERF_USER_STACK_DUMP
+/*
+ * How much stack there can be above the user stack pointer.  The stack
+ * vma would be a tighter bound but can't be looked up from NMI.
+ */
+static u64 perf_ustack_task_size(struct pt_regs *regs)
+{
+	unsigned long addr = perf_user_stack_pointer(regs);
+
+	if (!addr || addr >= TASK_SIZE)
+		return 0;
+
+	return TASK_SIZE - addr;
+}
+
+/*
+ * Trim the requested dump to what is there and to what still fits in
+ * the u16 record size after the header and the two size fields.
+ */
+static u16
+perf_sample_ustack_size(u16 stack_size, u16 header_size,
+			struct pt_regs *regs)
+{
+	u64 task_size;
+
+	if (!regs)
+		return 0;
+
+	task_size  = min((u64) USHRT_MAX, perf_ustack_task_size(regs));
+	stack_size = min(stack_size, (u16) task_size);
+
+	header_size += 2 * sizeof(u64);
+	if ((u16) (header_size + stack_size) < header_size)
+		stack_size = USHRT_MAX - header_size;
+
+	return round_down(stack_size, sizeof(u64));
+}
+
+/*
+ * The dump is the size reserved for it, that many bytes copied from
+ * the stack pointer up, and how many of those actually could be.  A
+ * copy that faults leaves the rest of the reserved space as it was.
+ */
+static void
+perf_output_sample_ustack(struct perf_output_handle *handle, u64 dump_size,
+			  struct pt_regs *regs)
+{
+	unsigned long sp;
+	unsigned int rem;
+	u64 dyn_size;
+
+	if (!regs || !dump_size) {
+		u64 size = 0;
+
+		perf_output_put(handle, size);
+		return;
+	}
+
+	perf_output_put(handle, dump_size);
+
+	sp = perf_user_stack_pointer(regs);
+	rem = __output_copy_user(handle, (void __user *) sp, dump_size);
+	dyn_size = dump_size - rem;
+	if (rem)
+		__output_skip(handle, rem);
+
+	perf_output_put(handle, dyn_size);
+}
+#else
+static inline u16
+perf_sample_ustack_size(u16 stack_size, u16 header_size,
+			struct pt_regs *regs)
+{
+	return 0;
+}
+
+static inline void
+perf_output_sample_ustack(struct perf_output_handle *handle, u64 dump_size,
+			  struct pt_regs *regs)
+{
+	u64 size = 0;
+
+	perf_output_put(handle, size);
+}
+#endif /* CONFIG_HAVE_PERF_USER_STACK_DUMP */
+
 void perf_output_sample(struct perf_output_handle *handle,
 			struct perf_event_header *header,
 			struct perf_sample_data *data,
@@ -4218,6 +4344,24 @@ void perf_output_sample(struct perf_output_handle *handle,
 		}
 	}
 
+	if (sample_type & PERF_SAMPLE_REGS_USER) {
+		u64 abi = data->regs_user.abi;
+
+		/* ABI_NONE says there are no regs following. */
+		perf_output_put(handle, abi);
+
+		if (abi) {
+			u64 mask = event->attr.sample_regs_user;
+
+			perf_output_sample_regs(handle, data->regs_user.regs,
+						mask);
+		}
+	}
+
+	if (sample_type & PERF_SAMPLE_STACK_USER)
+		perf_output_sample_ustack(handle, data->stack_user_size,
+					  data->regs_user.regs);
+
 	if (!event->attr.watermark) {
 		int wakeup_events = event->attr.wakeup_events;
 
@@ -4273,6 +4417,37 @@ void perf_prepare_sample(struct perf_event_header *header,
 		WARN_ON_ONCE(size & (sizeof(u64)-1));
 		header->size += size;
 	}
+
+	if (sample_type & PERF_SAMPLE_REGS_USER) {
+		int size = sizeof(u64);
+
+		perf_sample_regs_user(&data->regs_user, regs);
+		if (data->regs_user.regs)
+			size += hweight64(event->attr.sample_regs_user) *
+				sizeof(u64);
+
+		header->size += size;
+	}
+
+	/*
+	 * The stack dump takes whatever room is left in the record, so
+	 * it has to be sized last.
+	 */
+	if (sample_type & PERF_SAMPLE_STACK_USER) {
+		u16 stack_size = event->attr.sample_stack_user;
+		u16 size = sizeof(u64);
+
+		if (!(sample_type & PERF_SAMPLE_REGS_USER))
+			perf_sample_regs_user(&data->regs_user, regs);
+
+		stack_size = perf_sample_ustack_size(stack_size, header->size,
+						     data->regs_user.regs);
+		if (stack_size)
+			size += sizeof(u64) + stack_size;
+
+		data->stack_user_size = stack_size;
+		header->size += size;
+	}
 }
 
 static void perf_event_output(struct perf_event *event,
@@ -6226,7 +6401,7 @@ static int perf_copy_attr(struct perf_event_attr __user *uattr,
 	if (ret)
 		return -EFAULT;
 
-	if (attr->__reserved_1)
+	if (attr->__reserved_1 || attr->__reserved_2)
 		return -EINVAL;
 
 	if (attr->sample_type & ~(PERF_SAMPLE_MAX-1))
@@ -6235,6 +6410,22 @@ static int perf_copy_attr(struct perf_event_attr __user *uattr,
 	if (attr->read_format & ~(PERF_FORMAT_MAX-1))
 		return -EINVAL;
 
+	if (attr->sample_type & PERF_SAMPLE_REGS_USER) {
+		ret = perf_reg_validate(attr->sample_regs_user);
+		if (ret)
+			return ret;
+	}
+
+	if (attr->sample_type & PERF_SAMPLE_STACK_USER) {
+		if (!IS_ENABLED(CONFIG_HAVE_PERF_USER_STACK_DUMP))
+			return -ENOSYS;
+
+		/* The record size is a u16, and the dump keeps u64 alignment. */
+		if (attr->sample_stack_user >= USHRT_MAX ||
+		    !IS_ALIGNED(attr->sample_stack_user, sizeof(u64)))
+			return -EINVAL;
+	}
+
 out:
 	return ret;
 
@@ -100,4 +100,64 @@ __output_copy(struct perf_output_handle *handle,
 	} while (len);
 }
 
+#ifndef arch_perf_out_copy_user
+#define arch_perf_out_copy_user __copy_from_user_inatomic
+#endif
+
+/*
+ * Like __output_copy() but from user memory, which may fault; returns
+ * the number of bytes that could not be copied and leaves the handle
+ * just past what was.
+ */
+static inline unsigned int
+__output_copy_user(struct perf_output_handle *handle,
+		   const void __user *buf, unsigned int len)
+{
+	do {
+		unsigned long size = min_t(unsigned long, handle->size, len);
+		unsigned long left;
+
+		left = arch_perf_out_copy_user(handle->addr, buf, size);
+		size -= left;
+
+		len -= size;
+		handle->addr += size;
+		buf += size;
+		handle->size -= size;
+		if (!handle->size) {
+			struct ring_buffer *rb = handle->rb;
+
+			handle->page++;
+			handle->page &= rb->nr_pages - 1;
+			handle->addr = rb->data_pages[handle->page];
+			handle->size = PAGE_SIZE << page_order(rb);
+		}
+		if (left)
+			break;
+	} while (len);
+
+	return len;
+}
+
+/* Move the handle past len bytes without writing them. */
+static inline void
+__output_skip(struct perf_output_handle *handle, unsigned int len)
+{
+	do {
+		unsigned long size = min_t(unsigned long, handle->size, len);
+
+		len -= size;
+		handle->addr += size;
+		handle->size -= size;
+		if (!handle->size) {
+			struct ring_buffer *rb = handle->rb;
+
+			handle->page++;
+			handle->page &= rb->nr_pages - 1;
+			handle->addr = rb->data_pages[handle->page];
+			handle->size = PAGE_SIZE << page_order(rb);
+		}
+	} while (len);
+}
+
 #endif /* _KERNEL_EVENTS_INTERNAL_H */
@@ -45,6 +45,7 @@
 #include <linux/debugobjects.h>
 #include <linux/sched.h>
 #include <linux/timer.h>
+#include <linux/latency_hist.h>
 
 #include <asm/uaccess.h>
 
@@ -160,7 +161,8 @@ struct hrtimer_clock_base *lock_hrtimer_base(const struct hrtimer *timer,
 static int hrtimer_get_target(int this_cpu, int pinned)
 {
 #ifdef CONFIG_NO_HZ
-	if (!pinned && get_sysctl_timer_migration() && idle_cpu(this_cpu))
+	if (!pinned && get_sysctl_timer_migration() &&
+	    nohz_timer_should_migrate(this_cpu))
 		return get_nohz_timer_target();
 #endif
 	return this_cpu;
@@ -1273,6 +1275,34 @@ static void __run_hrtimer(struct hrtimer *timer, ktime_t *now)
 
 #ifdef CONFIG_HIGH_RES_TIMERS
 
+/*
+ * Number of timers right of the first not yet soft expired one which
+ * the interrupt checks for a soft expiry that has been reached.
+ */
+#define HRTIMER_COALESCE_SCAN	8
+
+/*
+ * Find a soft expired timer among the few timers following @node, so
+ * that timers whose slack windows overlap the current interrupt are run
+ * now instead of needing an interrupt of their own.
+ */
+static struct hrtimer *hrtimer_coalesce_next(struct timerqueue_node *node,
+					     ktime_t basenow)
+{
+	struct hrtimer *timer;
+	int i;
+
+	for (i = 0; i < HRTIMER_COALESCE_SCAN; i++) {
+		node = timerqueue_iterate_next(node);
+		if (!node)
+			break;
+		timer = container_of(node, struct hrtimer, node);
+		if (basenow.tv64 >= hrtimer_get_softexpires_tv64(timer))
+			return timer;
+	}
+	return NULL;
+}
+
 /*
  * High resolution timer interrupt
  * Called with interrupts disabled
@@ -1324,25 +1354,36 @@ retry:
 			 * Tree, which can answer a stabbing querry for
 			 * overlapping intervals and instead use the simple
 			 * BST we already have.
-			 * We don't add extra wakeups by delaying timers that
-			 * are right-of a not yet expired timer, because that
-			 * timer will have to trigger a wakeup anyway.
+			 * Timers right-of a not yet expired timer are only
+			 * looked at a few deep: those whose window has been
+			 * reached are run now rather than in an interrupt of
+			 * their own, the rest wait for the wakeup which the
+			 * not yet expired timer triggers anyway.
 			 */
 
 			if (basenow.tv64 < hrtimer_get_softexpires_tv64(timer)) {
-				ktime_t expires;
-
-				expires = ktime_sub(hrtimer_get_expires(timer),
-						    base->offset);
-				if (expires.tv64 < 0)
-					expires.tv64 = KTIME_MAX;
-				if (expires.tv64 < expires_next.tv64)
-					expires_next = expires;
-				break;
+				timer = hrtimer_coalesce_next(node, basenow);
+				if (!timer)
+					break;
 			}
 
+			latency_hist_timer(basenow, hrtimer_get_expires(timer));
 			__run_hrtimer(timer, &basenow);
 		}
+
+		node = timerqueue_getnext(&base->active);
+		if (node) {
+			struct hrtimer *timer;
+			ktime_t expires;
+
+			timer = container_of(node, struct hrtimer, node);
+			expires = ktime_sub(hrtimer_get_expires(timer),
+					    base->offset);
+			if (expires.tv64 < 0)
+				expires.tv64 = KTIME_MAX;
+			if (expires.tv64 < expires_next.tv64)
+				expires_next = expires;
+		}
 	}
 
 	/*
@@ -1478,6 +1519,15 @@ void hrtimer_run_pending(void)
 		hrtimer_switch_to_hres();
 }
 
+/*
+ * Whether hrtimer_run_pending() still has anything to do on this cpu,
+ * i.e. the switch to highres mode hasn't happened yet.
+ */
+int hrtimer_run_pending_needed(void)
+{
+	return !hrtimer_hres_active();
+}
+
 /*
  * Called from hardirq context every jiffy
  */
@@ -15,6 +15,7 @@
 #include <linux/sched.h>
 #include <linux/interrupt.h>
 #include <linux/kernel_stat.h>
+#include <linux/cpuidle.h>
 
 #include <trace/events/irq.h>
 
@@ -157,6 +158,7 @@ handle_irq_event_percpu(struct irq_desc *desc, struct irqaction *action)
 	} while (action);
 
 	add_interrupt_randomness(irq, flags);
+	cpuidle_note_irq();
 
 	if (!noirqdebug)
 		note_interrupt(irq, desc, retval);
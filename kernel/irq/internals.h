@@ -24,6 +24,7 @@ extern int noirqdebug;
  * IRQTF_WARNED    - warning "IRQ_WAKE_THREAD w/o thread_fn" has been printed
  * IRQTF_AFFINITY  - irq thread is requested to adjust affinity
  * IRQTF_FORCED_THREAD  - irq action is force threaded
+ * IRQTF_SCHED     - irq thread is requested to adjust policy/priority
  */
 enum {
 	IRQTF_RUNTHREAD,
@@ -31,6 +32,7 @@ enum {
 	IRQTF_WARNED,
 	IRQTF_AFFINITY,
 	IRQTF_FORCED_THREAD,
+	IRQTF_SCHED,
 };
 
 /*
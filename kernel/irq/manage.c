@@ -117,6 +117,52 @@ void irq_set_thread_affinity(struct irq_desc *desc)
 	}
 }
 
+/**
+ *	irq_set_thread_sched - Set the scheduling policy of the irq threads
+ *	@irq:		Interrupt to set the policy for
+ *	@policy:	SCHED_FIFO, SCHED_RR or SCHED_NORMAL
+ *	@prio:		RT priority, must be 0 for SCHED_NORMAL
+ *
+ *	Like the affinity, the new setting is applied by the interrupt
+ *	threads themselves before they handle the next interrupt. Threads
+ *	created later start with it.
+ */
+int irq_set_thread_sched(unsigned int irq, int policy, int prio)
+{
+	struct irq_desc *desc = irq_to_desc(irq);
+	struct irqaction *action;
+	unsigned long flags;
+
+	if (!desc)
+		return -EINVAL;
+
+	switch (policy) {
+	case SCHED_FIFO:
+	case SCHED_RR:
+		if (prio < 1 || prio > MAX_USER_RT_PRIO-1)
+			return -EINVAL;
+		break;
+	case SCHED_NORMAL:
+		if (prio)
+			return -EINVAL;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	raw_spin_lock_irqsave(&desc->lock, flags);
+	desc->thread_policy = policy;
+	desc->thread_prio = prio;
+	for (action = desc->action; action; action = action->next) {
+		if (action->thread)
+			set_bit(IRQTF_SCHED, &action->thread_flags);
+	}
+	raw_spin_unlock_irqrestore(&desc->lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(irq_set_thread_sched);
+
 #ifdef CONFIG_GENERIC_PENDING_IRQ
 static inline bool irq_can_move_pcntxt(struct irq_data *data)
 {
@@ -198,6 +244,45 @@ int irq_set_affinity(unsigned int irq, const struct cpumask *mask)
 	return ret;
 }
 
+/**
+ *	irq_move_off_cpus - Steer device interrupts away from some cpus
+ *	@mask:		cpus which should stop receiving interrupts
+ *
+ *	Narrows the affinity of every balanceable interrupt which targets
+ *	a cpu in @mask to its remaining online targets, or to all online
+ *	cpus outside @mask if none remain.  Per-cpu and NO_BALANCE
+ *	interrupts are left alone.  Must be called from process context.
+ */
+void irq_move_off_cpus(const struct cpumask *mask)
+{
+	struct irq_desc *desc;
+	cpumask_var_t new;
+	unsigned long flags;
+	unsigned int irq;
+
+	if (!alloc_cpumask_var(&new, GFP_KERNEL))
+		return;
+
+	for_each_irq_desc(irq, desc) {
+		if (!desc || !irq_can_set_affinity(irq))
+			continue;
+
+		raw_spin_lock_irqsave(&desc->lock, flags);
+		if (desc->action &&
+		    cpumask_intersects(desc->irq_data.affinity, mask)) {
+			cpumask_andnot(new, desc->irq_data.affinity, mask);
+			cpumask_and(new, new, cpu_online_mask);
+			if (cpumask_empty(new))
+				cpumask_andnot(new, cpu_online_mask, mask);
+			if (!cpumask_empty(new))
+				__irq_set_affinity_locked(&desc->irq_data, new);
+		}
+		raw_spin_unlock_irqrestore(&desc->lock, flags);
+	}
+
+	free_cpumask_var(new);
+}
+
 int irq_set_affinity_hint(unsigned int irq, const struct cpumask *m)
 {
 	unsigned long flags;
@@ -741,6 +826,29 @@ static inline void
 irq_thread_check_affinity(struct irq_desc *desc, struct irqaction *action) { }
 #endif
 
+/*
+ * Apply the policy and priority set with irq_set_thread_sched().
+ */
+static void irq_thread_set_sched(struct irq_desc *desc)
+{
+	struct sched_param param;
+	int policy;
+
+	raw_spin_lock_irq(&desc->lock);
+	policy = desc->thread_policy;
+	param.sched_priority = desc->thread_prio;
+	raw_spin_unlock_irq(&desc->lock);
+
+	sched_setscheduler(current, policy, &param);
+}
+
+static void
+irq_thread_check_sched(struct irq_desc *desc, struct irqaction *action)
+{
+	if (test_and_clear_bit(IRQTF_SCHED, &action->thread_flags))
+		irq_thread_set_sched(desc);
+}
+
 /*
  * Interrupts which are not explicitely requested as threaded
  * interrupts rely on the implicit bh/preempt disable of the hard irq
@@ -779,9 +887,6 @@ static irqreturn_t irq_thread_fn(struct irq_desc *desc,
  */
 static int irq_thread(void *data)
 {
-	static const struct sched_param param = {
-		.sched_priority = MAX_USER_RT_PRIO/2,
-	};
 	struct irqaction *action = data;
 	struct irq_desc *desc = irq_to_desc(action->irq);
 	irqreturn_t (*handler_fn)(struct irq_desc *desc,
@@ -794,12 +899,14 @@ static int irq_thread(void *data)
 	else
 		handler_fn = irq_thread_fn;
 
-	sched_setscheduler(current, SCHED_FIFO, &param);
+	clear_bit(IRQTF_SCHED, &action->thread_flags);
+	irq_thread_set_sched(desc);
 	current->irqaction = action;
 
 	while (!irq_wait_for_interrupt(action)) {
 
 		irq_thread_check_affinity(desc, action);
+		irq_thread_check_sched(desc, action);
 
 		atomic_inc(&desc->threads_active);
 
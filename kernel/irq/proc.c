@@ -12,6 +12,8 @@
 #include <linux/seq_file.h>
 #include <linux/interrupt.h>
 #include <linux/kernel_stat.h>
+#include <linux/sched.h>
+#include <linux/uaccess.h>
 
 #include "internals.h"
 
@@ -283,6 +285,102 @@ static const struct file_operations irq_spurious_proc_fops = {
 	.release	= single_release,
 };
 
+static const char * const irq_thread_policy_names[] = {
+	[SCHED_NORMAL]	= "normal",
+	[SCHED_FIFO]	= "fifo",
+	[SCHED_RR]	= "rr",
+};
+
+static int irq_thread_policy_proc_show(struct seq_file *m, void *v)
+{
+	struct irq_desc *desc = irq_to_desc((long) m->private);
+
+	seq_printf(m, "%s\n", irq_thread_policy_names[desc->thread_policy]);
+	return 0;
+}
+
+static ssize_t irq_thread_policy_proc_write(struct file *file,
+		const char __user *buffer, size_t count, loff_t *pos)
+{
+	unsigned int irq = (int)(long)PDE(file->f_path.dentry->d_inode)->data;
+	struct irq_desc *desc = irq_to_desc(irq);
+	char buf[16];
+	int policy, prio, err;
+
+	if (count >= sizeof(buf))
+		return -EINVAL;
+	if (copy_from_user(buf, buffer, count))
+		return -EFAULT;
+	buf[count] = '\0';
+
+	for (policy = 0; policy < ARRAY_SIZE(irq_thread_policy_names); policy++) {
+		if (irq_thread_policy_names[policy] &&
+		    sysfs_streq(buf, irq_thread_policy_names[policy]))
+			break;
+	}
+	if (policy == ARRAY_SIZE(irq_thread_policy_names))
+		return -EINVAL;
+
+	/* Keep the RT priority, or pick the default one when leaving normal */
+	prio = desc->thread_prio;
+	if (policy == SCHED_NORMAL)
+		prio = 0;
+	else if (!prio)
+		prio = MAX_USER_RT_PRIO/2;
+
+	err = irq_set_thread_sched(irq, policy, prio);
+	return err ? err : count;
+}
+
+static int irq_thread_policy_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, irq_thread_policy_proc_show, PDE(inode)->data);
+}
+
+static const struct file_operations irq_thread_policy_proc_fops = {
+	.open		= irq_thread_policy_proc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+	.write		= irq_thread_policy_proc_write,
+};
+
+static int irq_thread_priority_proc_show(struct seq_file *m, void *v)
+{
+	struct irq_desc *desc = irq_to_desc((long) m->private);
+
+	seq_printf(m, "%d\n", desc->thread_prio);
+	return 0;
+}
+
+static ssize_t irq_thread_priority_proc_write(struct file *file,
+		const char __user *buffer, size_t count, loff_t *pos)
+{
+	unsigned int irq = (int)(long)PDE(file->f_path.dentry->d_inode)->data;
+	struct irq_desc *desc = irq_to_desc(irq);
+	int prio, err;
+
+	err = kstrtoint_from_user(buffer, count, 0, &prio);
+	if (err)
+		return err;
+
+	err = irq_set_thread_sched(irq, desc->thread_policy, prio);
+	return err ? err : count;
+}
+
+static int irq_thread_priority_proc_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, irq_thread_priority_proc_show, PDE(inode)->data);
+}
+
+static const struct file_operations irq_thread_priority_proc_fops = {
+	.open		= irq_thread_priority_proc_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+	.write		= irq_thread_priority_proc_write,
+};
+
 #define MAX_NAMELEN 128
 
 static int name_unique(unsigned int irq, struct irqaction *new_action)
@@ -358,6 +456,13 @@ void register_irq_proc(unsigned int irq, struct irq_desc *desc)
 
 	proc_create_data("spurious", 0444, desc->dir,
 			 &irq_spurious_proc_fops, (void *)(long)irq);
+
+	/* create /proc/irq/<irq>/thread_policy and thread_priority */
+	proc_create_data("thread_policy", 0600, desc->dir,
+			 &irq_thread_policy_proc_fops, (void *)(long)irq);
+
+	proc_create_data("thread_priority", 0600, desc->dir,
+			 &irq_thread_priority_proc_fops, (void *)(long)irq);
 }
 
 void unregister_irq_proc(unsigned int irq, struct irq_desc *desc)
@@ -373,6 +478,8 @@ void unregister_irq_proc(unsigned int irq, struct irq_desc *desc)
 	remove_proc_entry("node", desc->dir);
 #endif
 	remove_proc_entry("spurious", desc->dir);
+	remove_proc_entry("thread_policy", desc->dir);
+	remove_proc_entry("thread_priority", desc->dir);
 
 	memset(name, 0, MAX_NAMELEN);
 	sprintf(name, "%u", irq);
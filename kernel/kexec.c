@@ -12,6 +12,7 @@
 #include <linux/slab.h>
 #include <linux/fs.h>
 #include <linux/kexec.h>
+#include <linux/kexec_preserve.h>
 #include <linux/mutex.h>
 #include <linux/list.h>
 #include <linux/highmem.h>
@@ -179,6 +180,8 @@ static int do_kimage_alloc(struct kimage **rimage, unsigned long entry,
 			goto out;
 		if (mend >= KEXEC_DESTINATION_MEMORY_LIMIT)
 			goto out;
+		if (kexec_preserve_overlaps(mstart, mend))
+			goto out;
 	}
 
 	/* Verify our destination addresses do not overlap.
@@ -1559,6 +1562,7 @@ int kernel_kexec(void)
 		kernel_restart_prepare(NULL);
 		printk(KERN_EMERG "Starting new kernel\n");
 		machine_shutdown();
+		kexec_preserve_handover();
 	}
 
 	machine_kexec(kexec_image);
@@ -0,0 +1,318 @@
+/*
+ * kexec_preserve.c - memory that survives a kexec reboot
+ *
+ * This source code is licensed under the GNU General Public License,
+ * Version 2.  See the file COPYING for more details.
+ *
+ * The range given with kexec_preserve=size@start is reserved by the
+ * architecture before the page allocator sees it.  Its first page holds
+ * a table of named extents; the rest is handed out to user space, which
+ * mmaps the extents from /dev/kexec_preserve.
+ *
+ * On kexec the table is sealed with a checksum and marked as handed
+ * over.  The next kernel, booted with the same parameter, adopts the
+ * table only if it finds it sealed: after a firmware reboot, or if the
+ * previous kernel died without going through kernel_kexec(), the range
+ * starts out empty.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/mm.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/mutex.h>
+#include <linux/uaccess.h>
+#include <linux/crc32.h>
+#include <linux/kexec_preserve.h>
+
+#define KPRES_MAGIC		0x4b50524553455256ULL	/* "KPRESERV" */
+#define KPRES_VERSION		1
+#define KPRES_MAX_EXTENTS	64
+
+enum {
+	KPRES_LIVE = 1,		/* in use by the running kernel */
+	KPRES_HANDED_OVER,	/* sealed by kexec_preserve_handover() */
+};
+
+struct kpres_header {
+	u64	magic;
+	u32	version;
+	u32	state;
+	u64	size;
+	u64	generation;
+	u32	nr_extents;
+	u32	crc;
+	/* sorted by offset, none overlaps the header page */
+	struct kexec_preserve_extent extents[KPRES_MAX_EXTENTS];
+};
+
+unsigned long long kexec_preserve_base;
+unsigned long long kexec_preserve_size;
+
+static struct kpres_header *kpres_hdr;
+static bool kpres_adopted;
+static DEFINE_MUTEX(kpres_mutex);
+
+static int __init parse_kexec_preserve(char *arg)
+{
+	unsigned long long size, base;
+	char *cur = arg;
+
+	if (!arg)
+		return -EINVAL;
+	size = memparse(cur, &cur);
+	if (*cur != '@')
+		return -EINVAL;
+	base = memparse(cur + 1, &cur);
+
+	if ((base | size) & ~PAGE_MASK || size < 2 * PAGE_SIZE) {
+		pr_warning("kexec_preserve: range must be page aligned "
+			   "and at least two pages\n");
+		return -EINVAL;
+	}
+	kexec_preserve_base = base;
+	kexec_preserve_size = size;
+	return 0;
+}
+early_param("kexec_preserve", parse_kexec_preserve);
+
+static u32 kpres_crc(struct kpres_header *hdr)
+{
+	u32 saved = hdr->crc, crc;
+
+	hdr->crc = 0;
+	crc = crc32(~0, hdr, sizeof(*hdr));
+	hdr->crc = saved;
+	return crc;
+}
+
+static bool __init kpres_header_valid(struct kpres_header *hdr)
+{
+	u64 prev_end = PAGE_SIZE;
+	unsigned int i;
+
+	if (hdr->magic != KPRES_MAGIC || hdr->version != KPRES_VERSION ||
+	    hdr->state != KPRES_HANDED_OVER)
+		return false;
+	if (hdr->size != kexec_preserve_size ||
+	    hdr->nr_extents > KPRES_MAX_EXTENTS)
+		return false;
+	if (hdr->crc != kpres_crc(hdr))
+		return false;
+
+	for (i = 0; i < hdr->nr_extents; i++) {
+		struct kexec_preserve_extent *ext = &hdr->extents[i];
+
+		if (ext->offset < prev_end || ext->size > hdr->size ||
+		    ext->offset > hdr->size - ext->size)
+			return false;
+		prev_end = ext->offset + ext->size;
+	}
+	return true;
+}
+
+/*
+ * Only true for a kernel that reserved the range; kexec_load() uses it
+ * to refuse segments that would be copied over preserved data.
+ */
+bool kexec_preserve_overlaps(unsigned long start, unsigned long end)
+{
+	if (!kexec_preserve_size)
+		return false;
+	return end > kexec_preserve_base &&
+	       start < kexec_preserve_base + kexec_preserve_size;
+}
+
+/*
+ * Called by kernel_kexec() once the other cpus are stopped.  A table
+ * caught in the middle of an update is not sealed, so the next kernel
+ * starts with an empty range rather than a torn one.
+ */
+void kexec_preserve_handover(void)
+{
+	if (!kpres_hdr)
+		return;
+	if (!mutex_trylock(&kpres_mutex)) {
+		printk(KERN_EMERG "kexec_preserve: table busy, "
+		       "not handing over preserved memory\n");
+		return;
+	}
+	kpres_hdr->state = KPRES_HANDED_OVER;
+	kpres_hdr->crc = kpres_crc(kpres_hdr);
+	mutex_unlock(&kpres_mutex);
+}
+
+static struct kexec_preserve_extent *kpres_find(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < kpres_hdr->nr_extents; i++)
+		if (!strcmp(kpres_hdr->extents[i].name, name))
+			return &kpres_hdr->extents[i];
+	return NULL;
+}
+
+/* First fit, the table is kept sorted by offset. */
+static int kpres_create(struct kexec_preserve_extent *req)
+{
+	struct kpres_header *hdr = kpres_hdr;
+	u64 size = PAGE_ALIGN(req->size);
+	u64 prev_end = PAGE_SIZE;
+	unsigned int i;
+
+	if (!size || size < req->size)
+		return -EINVAL;
+	if (kpres_find(req->name))
+		return -EEXIST;
+	if (hdr->nr_extents == KPRES_MAX_EXTENTS)
+		return -ENOSPC;
+
+	for (i = 0; i < hdr->nr_extents; i++) {
+		if (hdr->extents[i].offset - prev_end >= size)
+			break;
+		prev_end = hdr->extents[i].offset + hdr->extents[i].size;
+	}
+	if (hdr->size - prev_end < size)
+		return -ENOSPC;
+
+	memmove(&hdr->extents[i + 1], &hdr->extents[i],
+		(hdr->nr_extents - i) * sizeof(hdr->extents[0]));
+	req->offset = prev_end;
+	req->size = size;
+	hdr->extents[i] = *req;
+	hdr->nr_extents++;
+	return 0;
+}
+
+static long kpres_ioctl(struct file *file, unsigned int cmd,
+			unsigned long arg)
+{
+	void __user *argp = (void __user *)arg;
+	struct kexec_preserve_extent ext, *found;
+	struct kexec_preserve_info info;
+	long ret = 0;
+
+	switch (cmd) {
+	case KEXEC_PRESERVE_INFO:
+		mutex_lock(&kpres_mutex);
+		info.size = kpres_hdr->size;
+		info.generation = kpres_hdr->generation;
+		info.adopted = kpres_adopted;
+		info.nr_extents = kpres_hdr->nr_extents;
+		mutex_unlock(&kpres_mutex);
+		if (copy_to_user(argp, &info, sizeof(info)))
+			return -EFAULT;
+		return 0;
+	case KEXEC_PRESERVE_CREATE:
+	case KEXEC_PRESERVE_LOOKUP:
+	case KEXEC_PRESERVE_REMOVE:
+		break;
+	default:
+		return -ENOTTY;
+	}
+
+	if (copy_from_user(&ext, argp, sizeof(ext)))
+		return -EFAULT;
+	if (!ext.name[0] || strnlen(ext.name, sizeof(ext.name)) ==
+	    sizeof(ext.name))
+		return -EINVAL;
+
+	mutex_lock(&kpres_mutex);
+	switch (cmd) {
+	case KEXEC_PRESERVE_CREATE:
+		ret = kpres_create(&ext);
+		break;
+	case KEXEC_PRESERVE_LOOKUP:
+		found = kpres_find(ext.name);
+		if (found)
+			ext = *found;
+		else
+			ret = -ENOENT;
+		break;
+	case KEXEC_PRESERVE_REMOVE:
+		found = kpres_find(ext.name);
+		if (found) {
+			struct kexec_preserve_extent *last;
+
+			last = &kpres_hdr->extents[kpres_hdr->nr_extents - 1];
+			memmove(found, found + 1, (last - found) * sizeof(*found));
+			memset(last, 0, sizeof(*last));
+			kpres_hdr->nr_extents--;
+		} else
+			ret = -ENOENT;
+		break;
+	}
+	mutex_unlock(&kpres_mutex);
+
+	if (!ret && cmd != KEXEC_PRESERVE_REMOVE &&
+	    copy_to_user(argp, &ext, sizeof(ext)))
+		ret = -EFAULT;
+	return ret;
+}
+
+/*
+ * Extents are not reference counted: removing one that is still mapped
+ * only frees its name, the pages stay reserved for good.
+ */
+static int kpres_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	unsigned long size = vma->vm_end - vma->vm_start;
+	u64 offset = (u64)vma->vm_pgoff << PAGE_SHIFT;
+
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+	if (offset < PAGE_SIZE || offset >= kexec_preserve_size ||
+	    size > kexec_preserve_size - offset)
+		return -EINVAL;
+
+	return remap_pfn_range(vma, vma->vm_start,
+			       (kexec_preserve_base + offset) >> PAGE_SHIFT,
+			       size, vma->vm_page_prot);
+}
+
+static const struct file_operations kpres_fops = {
+	.unlocked_ioctl	= kpres_ioctl,
+	.compat_ioctl	= kpres_ioctl,
+	.mmap		= kpres_mmap,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice kpres_dev = {
+	.minor	= MISC_DYNAMIC_MINOR,
+	.name	= "kexec_preserve",
+	.fops	= &kpres_fops,
+};
+
+static int __init kexec_preserve_init(void)
+{
+	struct kpres_header *hdr;
+	int ret;
+
+	BUILD_BUG_ON(sizeof(struct kpres_header) > PAGE_SIZE);
+
+	/* cleared by the architecture when the range could not be reserved */
+	if (!kexec_preserve_size)
+		return 0;
+
+	hdr = __va(kexec_preserve_base);
+	if (kpres_header_valid(hdr)) {
+		hdr->generation++;
+		kpres_adopted = true;
+		pr_info("kexec_preserve: adopted %u extents, generation %llu\n",
+			hdr->nr_extents, (unsigned long long)hdr->generation);
+	} else {
+		memset(hdr, 0, PAGE_SIZE);
+		hdr->magic = KPRES_MAGIC;
+		hdr->version = KPRES_VERSION;
+		hdr->size = kexec_preserve_size;
+	}
+	hdr->state = KPRES_LIVE;
+
+	ret = misc_register(&kpres_dev);
+	if (ret)
+		return ret;
+	kpres_hdr = hdr;
+	return 0;
+}
+device_initcall(kexec_preserve_init);
@@ -22,6 +22,11 @@ static DEFINE_SPINLOCK(kthread_create_lock);
 static LIST_HEAD(kthread_create_list);
 struct task_struct *kthreadd_task;
 
+/* cpus unbound kernel threads may run on, see kthread_set_affinity() */
+static DEFINE_MUTEX(kthread_affinity_lock);
+static DECLARE_BITMAP(kthread_cpus_bits, CONFIG_NR_CPUS) = CPU_BITS_ALL;
+#define kthread_cpus	to_cpumask(kthread_cpus_bits)
+
 struct kthread_create_info
 {
 	/* Information passed to kthread() from kthreadd. */
@@ -179,7 +184,9 @@ struct task_struct *kthread_create_on_node(int (*threadfn)(void *data),
 		 * The kernel thread should not inherit these properties.
 		 */
 		sched_setscheduler_nocheck(create.result, SCHED_NORMAL, &param);
-		set_cpus_allowed_ptr(create.result, cpu_all_mask);
+		mutex_lock(&kthread_affinity_lock);
+		set_cpus_allowed_ptr(create.result, kthread_cpus);
+		mutex_unlock(&kthread_affinity_lock);
 	}
 	return create.result;
 }
@@ -247,6 +254,83 @@ int kthread_stop(struct task_struct *k)
 }
 EXPORT_SYMBOL(kthread_stop);
 
+/*
+ * Unbound kernel threads follow kthread_cpus.  Threads pinned to a single
+ * cpu by whoever created them are left alone, unless that single cpu is
+ * just what kthread_cpus used to be.
+ */
+static bool kthread_follows_affinity(struct task_struct *p,
+				     const struct cpumask *old)
+{
+	if (!(p->flags & PF_KTHREAD) || (p->flags & PF_THREAD_BOUND) ||
+	    p->exit_state)
+		return false;
+	return p->rt.nr_cpus_allowed > 1 ||
+	       cpumask_equal(tsk_cpus_allowed(p), old);
+}
+
+/**
+ * kthread_set_affinity - move unbound kernel threads to @mask.
+ * @mask: cpus unbound kernel threads may run on.
+ *
+ * Description: Sets the cpus allowed of kthreadd, of all existing kernel
+ * threads not bound with kthread_bind(), and of kernel threads created
+ * from now on.  Used to keep housekeeping threads off isolated cpus.
+ *
+ * Returns 0 or -EINVAL if @mask contains no active cpu.
+ */
+int kthread_set_affinity(const struct cpumask *mask)
+{
+	struct task_struct *p, **tasks;
+	cpumask_var_t old;
+	int i, n = 0, nr = 0, ret = 0;
+
+	if (!cpumask_intersects(mask, cpu_active_mask))
+		return -EINVAL;
+	if (!alloc_cpumask_var(&old, GFP_KERNEL))
+		return -ENOMEM;
+
+	mutex_lock(&kthread_affinity_lock);
+	cpumask_copy(old, kthread_cpus);
+	cpumask_copy(kthread_cpus, mask);
+	set_cpus_allowed_ptr(kthreadd_task, mask);
+
+	/*
+	 * set_cpus_allowed_ptr() sleeps, so take references under the
+	 * tasklist lock first.  Threads forked meanwhile inherit the new
+	 * mask from kthreadd or get it in kthread_create_on_node().
+	 */
+	read_lock(&tasklist_lock);
+	for_each_process(p)
+		nr++;
+	read_unlock(&tasklist_lock);
+
+	tasks = kmalloc(nr * sizeof(*tasks), GFP_KERNEL);
+	if (tasks) {
+		read_lock(&tasklist_lock);
+		for_each_process(p) {
+			if (n == nr)
+				break;
+			if (kthread_follows_affinity(p, old)) {
+				get_task_struct(p);
+				tasks[n++] = p;
+			}
+		}
+		read_unlock(&tasklist_lock);
+	} else
+		ret = -ENOMEM;
+
+	for (i = 0; i < n; i++) {
+		set_cpus_allowed_ptr(tasks[i], mask);
+		put_task_struct(tasks[i]);
+	}
+	mutex_unlock(&kthread_affinity_lock);
+
+	kfree(tasks);
+	free_cpumask_var(old);
+	return ret;
+}
+
 int kthreadd(void *unused)
 {
 	struct task_struct *tsk = current;
@@ -254,7 +338,7 @@ int kthreadd(void *unused)
 	/* Setup a clean context for our children to inherit. */
 	set_task_comm(tsk, "kthreadd");
 	ignore_signals(tsk);
-	set_cpus_allowed_ptr(tsk, cpu_all_mask);
+	set_cpus_allowed_ptr(tsk, kthread_cpus);
 	set_mems_allowed(node_states[N_HIGH_MEMORY]);
 
 	current->flags |= PF_NOFREEZE | PF_FREEZER_NOSIG;
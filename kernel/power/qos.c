@@ -352,6 +352,129 @@ int pm_qos_remove_notifier(int pm_qos_class, struct notifier_block *notifier)
 }
 EXPORT_SYMBOL_GPL(pm_qos_remove_notifier);
 
+/*
+ * Per-CPU resume latency constraints.  Unlike PM_QOS_CPU_DMA_LATENCY these
+ * only limit the idle states of one CPU, so a latency sensitive CPU does not
+ * keep all the others out of deep C-states.  All CPUs share one notifier
+ * chain.
+ */
+static BLOCKING_NOTIFIER_HEAD(cpu_resume_lat_notifier);
+static DEFINE_PER_CPU(struct pm_qos_constraints, cpu_resume_lat_constraints) = {
+	.target_value = PM_QOS_CPU_RESUME_LAT_DEFAULT_VALUE,
+	.default_value = PM_QOS_CPU_RESUME_LAT_DEFAULT_VALUE,
+	.type = PM_QOS_MIN,
+	.notifiers = &cpu_resume_lat_notifier,
+};
+
+/**
+ * cpu_pm_qos_read_value - returns the resume latency limit of a CPU
+ * @cpu: CPU to return the limit for
+ *
+ * Lockless, for use from the idle loop.
+ */
+s32 cpu_pm_qos_read_value(int cpu)
+{
+	return pm_qos_read_value(&per_cpu(cpu_resume_lat_constraints, cpu));
+}
+EXPORT_SYMBOL_GPL(cpu_pm_qos_read_value);
+
+/**
+ * cpu_pm_qos_add_request - inserts new resume latency request for a CPU
+ * @req: pointer to a preallocated handle
+ * @cpu: CPU the request applies to
+ * @value: defines the qos request
+ */
+void cpu_pm_qos_add_request(struct cpu_pm_qos_request *req, int cpu,
+			    s32 value)
+{
+	if (!req) /*guard against callers passing in null */
+		return;
+
+	if (cpu_pm_qos_request_active(req)) {
+		WARN(1, KERN_ERR "cpu_pm_qos_add_request() called for already added request\n");
+		return;
+	}
+	req->constraints = &per_cpu(cpu_resume_lat_constraints, cpu);
+	pm_qos_update_target(req->constraints, &req->node, PM_QOS_ADD_REQ,
+			     value);
+}
+EXPORT_SYMBOL_GPL(cpu_pm_qos_add_request);
+
+/**
+ * cpu_pm_qos_update_request - modifies an existing CPU resume latency request
+ * @req : handle to list element holding a request
+ * @new_value: defines the qos request
+ */
+void cpu_pm_qos_update_request(struct cpu_pm_qos_request *req, s32 new_value)
+{
+	if (!req) /*guard against callers passing in null */
+		return;
+
+	if (!cpu_pm_qos_request_active(req)) {
+		WARN(1, KERN_ERR "cpu_pm_qos_update_request() called for unknown object\n");
+		return;
+	}
+
+	if (new_value != req->node.prio)
+		pm_qos_update_target(req->constraints, &req->node,
+				     PM_QOS_UPDATE_REQ, new_value);
+}
+EXPORT_SYMBOL_GPL(cpu_pm_qos_update_request);
+
+/**
+ * cpu_pm_qos_remove_request - removes a CPU resume latency request
+ * @req: handle to request list element
+ */
+void cpu_pm_qos_remove_request(struct cpu_pm_qos_request *req)
+{
+	if (!req) /*guard against callers passing in null */
+		return;
+
+	if (!cpu_pm_qos_request_active(req)) {
+		WARN(1, KERN_ERR "cpu_pm_qos_remove_request() called for unknown object\n");
+		return;
+	}
+
+	pm_qos_update_target(req->constraints, &req->node, PM_QOS_REMOVE_REQ,
+			     PM_QOS_DEFAULT_VALUE);
+	memset(req, 0, sizeof(*req));
+}
+EXPORT_SYMBOL_GPL(cpu_pm_qos_remove_request);
+
+/**
+ * cpu_pm_qos_add_notifier - sets notification entry for changes to the
+ *  resume latency limit of any CPU
+ * @notifier: notifier block managed by caller.
+ */
+int cpu_pm_qos_add_notifier(struct notifier_block *notifier)
+{
+	return blocking_notifier_chain_register(&cpu_resume_lat_notifier,
+						notifier);
+}
+EXPORT_SYMBOL_GPL(cpu_pm_qos_add_notifier);
+
+/**
+ * cpu_pm_qos_remove_notifier - deletes notification entry from chain.
+ * @notifier: notifier block to be removed.
+ */
+int cpu_pm_qos_remove_notifier(struct notifier_block *notifier)
+{
+	return blocking_notifier_chain_unregister(&cpu_resume_lat_notifier,
+						  notifier);
+}
+EXPORT_SYMBOL_GPL(cpu_pm_qos_remove_notifier);
+
+/* The plist heads can't be initialized statically in per-cpu data */
+static int __init cpu_pm_qos_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		plist_head_init(&per_cpu(cpu_resume_lat_constraints, cpu).list);
+	return 0;
+}
+early_initcall(cpu_pm_qos_init);
+
 /* User space interface to PM QoS classes via misc devices */
 static int register_pm_qos_misc(struct pm_qos_object *qos)
 {
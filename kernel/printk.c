@@ -41,6 +41,7 @@
 #include <linux/cpu.h>
 #include <linux/notifier.h>
 #include <linux/rculist.h>
+#include <linux/kthread.h>
 
 #include <asm/uaccess.h>
 
@@ -62,6 +63,15 @@ void asmlinkage __attribute__((weak)) early_printk(const char *fmt, ...)
 
 DECLARE_WAIT_QUEUE_HEAD(log_wait);
 
+/* bits of the per-cpu printk_pending, acted upon by printk_tick() */
+#define PRINTK_PENDING_WAKEUP	0x01	/* wake up klogd */
+#define PRINTK_PENDING_OUTPUT	0x02	/* wake up printk_kthread */
+
+static DEFINE_PER_CPU(int, printk_pending);
+
+/* console output thread of printk.async=1 */
+static struct task_struct *printk_kthread;
+
 int console_printk[4] = {
 	DEFAULT_CONSOLE_LOGLEVEL,	/* console_loglevel */
 	DEFAULT_MESSAGE_LOGLEVEL,	/* default_message_loglevel */
@@ -772,6 +782,52 @@ asmlinkage int printk(const char *fmt, ...)
 /* cpu currently holding logbuf_lock */
 static volatile unsigned int printk_cpu = UINT_MAX;
 
+/*
+ * With printk.async=1, printk() only logs the message and a kernel thread
+ * writes it to the consoles, so that callers don't wait for slow (serial)
+ * consoles.  Oopses and panics, and everything printed before the thread
+ * runs or while the system goes down, still go out synchronously.
+ */
+static bool printk_async;
+module_param_named(async, printk_async, bool, S_IRUGO);
+
+static inline bool printk_async_output(void)
+{
+	return printk_async && printk_kthread && !oops_in_progress &&
+		system_state == SYSTEM_RUNNING;
+}
+
+static int printk_kthread_func(void *unused)
+{
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (con_start == log_end)
+			schedule();
+		__set_current_state(TASK_RUNNING);
+
+		console_lock();
+		console_unlock();
+	}
+	return 0;
+}
+
+static int __init printk_kthread_init(void)
+{
+	struct task_struct *p;
+
+	if (!printk_async)
+		return 0;
+
+	p = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(p)) {
+		printk(KERN_ERR "printk: failed to start output thread\n");
+		return PTR_ERR(p);
+	}
+	printk_kthread = p;
+	return 0;
+}
+late_initcall(printk_kthread_init);
+
 /*
  * Can we actually use the console at this time on this cpu?
  *
@@ -971,7 +1027,12 @@ asmlinkage int vprintk(const char *fmt, va_list args)
 	 * will release 'logbuf_lock' regardless of whether it
 	 * actually gets the semaphore or not.
 	 */
-	if (console_trylock_for_printk(this_cpu))
+	if (printk_async_output()) {
+		/* printk_tick() wakes the thread, we may hold rq locks here */
+		printk_cpu = UINT_MAX;
+		raw_spin_unlock(&logbuf_lock);
+		__this_cpu_or(printk_pending, PRINTK_PENDING_OUTPUT);
+	} else if (console_trylock_for_printk(this_cpu))
 		console_unlock();
 
 	lockdep_on();
@@ -1222,13 +1283,16 @@ int is_console_locked(void)
 	return console_locked;
 }
 
-static DEFINE_PER_CPU(int, printk_pending);
-
 void printk_tick(void)
 {
-	if (__this_cpu_read(printk_pending)) {
+	int pending = __this_cpu_read(printk_pending);
+
+	if (pending) {
 		__this_cpu_write(printk_pending, 0);
-		wake_up_interruptible(&log_wait);
+		if ((pending & PRINTK_PENDING_OUTPUT) && printk_kthread)
+			wake_up_process(printk_kthread);
+		if (pending & PRINTK_PENDING_WAKEUP)
+			wake_up_interruptible(&log_wait);
 	}
 }
 
@@ -1242,7 +1306,7 @@ int printk_needs_cpu(int cpu)
 void wake_up_klogd(void)
 {
 	if (waitqueue_active(&log_wait))
-		this_cpu_write(printk_pending, 1);
+		this_cpu_or(printk_pending, PRINTK_PENDING_WAKEUP);
 }
 
 /**
@@ -1285,6 +1285,13 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 			rdp->nxttail[count] = &rdp->nxtlist;
 	local_irq_restore(flags);
 
+	/* No-CBs CPUs hand the whole list to their rcu_node's kthread. */
+	count = rcu_nocb_offload(rdp, list, tail);
+	if (count) {
+		list = NULL;
+		goto requeue;
+	}
+
 	/* Invoke callbacks. */
 	count = 0;
 	while (list) {
@@ -1297,6 +1304,7 @@ static void rcu_do_batch(struct rcu_state *rsp, struct rcu_data *rdp)
 			break;
 	}
 
+requeue:
 	local_irq_save(flags);
 	trace_rcu_batch_end(rsp->name, count);
 
@@ -2134,6 +2142,7 @@ static void __init rcu_init_one(struct rcu_state *rsp,
 			}
 			rnp->level = i;
 			INIT_LIST_HEAD(&rnp->blkd_tasks);
+			rcu_init_one_nocb(rsp, rnp);
 		}
 	}
 
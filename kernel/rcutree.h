@@ -187,6 +187,20 @@ struct rcu_node {
 				/*  per-CPU kthreads as needed. */
 	unsigned int node_kthread_status;
 				/* State of node_kthread_task for tracing. */
+#ifdef CONFIG_RCU_NOCB_CPU
+	raw_spinlock_t nocb_lock;
+				/* Protects the nocb_head list. */
+	struct rcu_head *nocb_head;
+				/* Ready CBs handed off by no-CBs CPUs. */
+	struct rcu_head **nocb_tail;
+	wait_queue_head_t nocb_wq;
+				/* nocb_kthread waits here for CBs. */
+	struct task_struct *nocb_kthread;
+				/* kthread invoking the no-CBs CPUs' CBs, */
+				/*  NULL until spawned. */
+	char *nocb_name;
+				/* Name of the RCU flavor, for tracing. */
+#endif /* #ifdef CONFIG_RCU_NOCB_CPU */
 } ____cacheline_internodealigned_in_smp;
 
 /*
@@ -473,5 +487,9 @@ static void rcu_yield(void (*f)(unsigned long), unsigned long arg);
 #endif /* #ifdef CONFIG_RCU_BOOST */
 static void rcu_cpu_kthread_setrt(int cpu, int to_rt);
 static void __cpuinit rcu_prepare_kthreads(int cpu);
+static void __init rcu_init_one_nocb(struct rcu_state *rsp,
+				     struct rcu_node *rnp);
+static long rcu_nocb_offload(struct rcu_data *rdp, struct rcu_head *list,
+			     struct rcu_head **tail);
 
 #endif /* #ifndef RCU_TREE_NONCORE */
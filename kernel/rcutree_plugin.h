@@ -2024,3 +2024,163 @@ int rcu_needs_cpu(int cpu)
 }
 
 #endif /* #else #if !defined(CONFIG_RCU_FAST_NO_HZ) */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback invocation from the CPUs listed in rcu_nocbs= to
+ * one kthread per leaf rcu_node structure and RCU flavor.  Grace-period
+ * detection is unchanged, only the ready-to-invoke callbacks leave the
+ * RCU_SOFTIRQ of these CPUs.  The kthreads may be affined to
+ * housekeeping CPUs, by default they avoid the no-CBs CPUs.
+ */
+static cpumask_var_t rcu_nocb_mask;
+static bool have_rcu_nocb_mask;
+
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+static void __init rcu_init_one_nocb(struct rcu_state *rsp,
+				     struct rcu_node *rnp)
+{
+	raw_spin_lock_init(&rnp->nocb_lock);
+	rnp->nocb_head = NULL;
+	rnp->nocb_tail = &rnp->nocb_head;
+	init_waitqueue_head(&rnp->nocb_wq);
+	rnp->nocb_kthread = NULL;
+	rnp->nocb_name = rsp->name;
+}
+
+/*
+ * Hand the list of ready callbacks extracted by rcu_do_batch() over to
+ * the rcu_node's kthread.  Returns the number of callbacks handed over,
+ * zero if this CPU invokes its own callbacks.
+ */
+static long rcu_nocb_offload(struct rcu_data *rdp, struct rcu_head *list,
+			     struct rcu_head **tail)
+{
+	struct rcu_node *rnp = rdp->mynode;
+	struct rcu_head *rhp;
+	unsigned long flags;
+	long count = 0;
+
+	if (!have_rcu_nocb_mask || !cpumask_test_cpu(rdp->cpu, rcu_nocb_mask))
+		return 0;
+	if (ACCESS_ONCE(rnp->nocb_kthread) == NULL)
+		return 0;
+
+	/* Count before handing off, the kthread may free them at once. */
+	for (rhp = list; rhp; rhp = rhp->next)
+		count++;
+
+	raw_spin_lock_irqsave(&rnp->nocb_lock, flags);
+	*rnp->nocb_tail = list;
+	rnp->nocb_tail = tail;
+	raw_spin_unlock_irqrestore(&rnp->nocb_lock, flags);
+	wake_up(&rnp->nocb_wq);
+	return count;
+}
+
+/*
+ * Invoke the callbacks handed over by this rcu_node's no-CBs CPUs,
+ * in order, with bottom halves disabled as RCU_SOFTIRQ would.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	struct rcu_node *rnp = arg;
+	struct rcu_head *list, *next;
+	unsigned long flags;
+
+	for (;;) {
+		wait_event_interruptible(rnp->nocb_wq,
+					 ACCESS_ONCE(rnp->nocb_head) != NULL);
+		raw_spin_lock_irqsave(&rnp->nocb_lock, flags);
+		list = rnp->nocb_head;
+		rnp->nocb_head = NULL;
+		rnp->nocb_tail = &rnp->nocb_head;
+		raw_spin_unlock_irqrestore(&rnp->nocb_lock, flags);
+
+		while (list) {
+			next = list->next;
+			prefetch(next);
+			local_bh_disable();
+			debug_rcu_head_unqueue(list);
+			__rcu_reclaim(rnp->nocb_name, list);
+			local_bh_enable();
+			list = next;
+			cond_resched();
+		}
+	}
+	return 0;
+}
+
+static void __init rcu_spawn_nocb_kthreads(struct rcu_state *rsp,
+					   cpumask_var_t cm)
+{
+	int rnp_index;
+	struct rcu_node *rnp;
+	struct task_struct *t;
+
+	rcu_for_each_leaf_node(rsp, rnp) {
+		int cpu;
+		bool nocb = false;
+
+		for (cpu = rnp->grplo; cpu <= rnp->grphi; cpu++)
+			if (cpumask_test_cpu(cpu, rcu_nocb_mask))
+				nocb = true;
+		if (!nocb)
+			continue;
+		rnp_index = rnp - &rsp->node[0];
+		t = kthread_create(rcu_nocb_kthread, (void *)rnp,
+				   "rcuo%c/%d", rsp->name[4], rnp_index);
+		if (IS_ERR(t))
+			continue;
+		if (!cpumask_empty(cm))
+			set_cpus_allowed_ptr(t, cm);
+		ACCESS_ONCE(rnp->nocb_kthread) = t;
+		wake_up_process(t);
+	}
+}
+
+static int __init rcu_spawn_all_nocb_kthreads(void)
+{
+	static char buf[80];
+	cpumask_var_t cm;
+
+	if (!have_rcu_nocb_mask)
+		return 0;
+	if (!zalloc_cpumask_var(&cm, GFP_KERNEL))
+		return 0;
+	cpumask_andnot(cm, cpu_possible_mask, rcu_nocb_mask);
+	cpulist_scnprintf(buf, sizeof(buf), rcu_nocb_mask);
+	printk(KERN_INFO "\tOffload RCU callbacks from CPUs: %s.\n", buf);
+	rcu_spawn_nocb_kthreads(&rcu_sched_state, cm);
+	rcu_spawn_nocb_kthreads(&rcu_bh_state, cm);
+#ifdef CONFIG_TREE_PREEMPT_RCU
+	rcu_spawn_nocb_kthreads(&rcu_preempt_state, cm);
+#endif /* #ifdef CONFIG_TREE_PREEMPT_RCU */
+	free_cpumask_var(cm);
+	return 0;
+}
+early_initcall(rcu_spawn_all_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static void __init rcu_init_one_nocb(struct rcu_state *rsp,
+				     struct rcu_node *rnp)
+{
+}
+
+static long rcu_nocb_offload(struct rcu_data *rdp, struct rcu_head *list,
+			     struct rcu_head **tail)
+{
+	return 0;
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
@@ -150,11 +150,22 @@ static inline bool unlock_rt_mutex_safe(struct rt_mutex *lock)
  */
 int rt_mutex_getprio(struct task_struct *task)
 {
+	int prio;
+
 	if (likely(!task_has_pi_waiters(task)))
 		return task->normal_prio;
 
-	return min(task_top_pi_waiter(task)->pi_list_entry.prio,
+	prio = min(task_top_pi_waiter(task)->pi_list_entry.prio,
 		   task->normal_prio);
+
+	/*
+	 * A SCHED_DEADLINE waiter can not lend its parameters, boost
+	 * the owner to the highest RT priority instead.
+	 */
+	if (dl_prio(prio) && !dl_task(task))
+		prio = 0;
+
+	return prio;
 }
 
 /*
@@ -138,6 +138,18 @@ static inline int task_has_rt_policy(struct task_struct *p)
 	return rt_policy(p->policy);
 }
 
+static inline int dl_policy(int policy)
+{
+	if (unlikely(policy == SCHED_DEADLINE))
+		return 1;
+	return 0;
+}
+
+static inline int task_has_dl_policy(struct task_struct *p)
+{
+	return dl_policy(p->policy);
+}
+
 /*
  * This is the priority-queue data structure of the RT scheduling class:
  */
@@ -251,21 +263,28 @@ struct cfs_rq;
 
 static LIST_HEAD(task_groups);
 
+/* Throttle durations are counted in buckets of <1ms, <2ms, ... >=64ms */
+#define CFS_THROTTLE_HIST	8
+
 struct cfs_bandwidth {
 #ifdef CONFIG_CFS_BANDWIDTH
 	raw_spinlock_t lock;
 	ktime_t period;
 	u64 quota, runtime;
+	u64 burst;		/* unused quota that may carry over */
+	u64 slice_max;		/* bound on the slice handed to a cpu */
 	s64 hierarchal_quota;
 	u64 runtime_expires;
+	s64 runtime_snap;	/* runtime at the start of the period */
 
 	int idle, timer_active;
 	struct hrtimer period_timer, slack_timer;
 	struct list_head throttled_cfs_rq;
 
 	/* statistics */
-	int nr_periods, nr_throttled;
-	u64 throttled_time;
+	int nr_periods, nr_throttled, nr_bursts;
+	u64 throttled_time, burst_time;
+	unsigned int throttled_hist[CFS_THROTTLE_HIST];
 #endif
 };
 
@@ -459,6 +478,8 @@ static void init_cfs_bandwidth(struct cfs_bandwidth *cfs_b)
 	raw_spin_lock_init(&cfs_b->lock);
 	cfs_b->runtime = 0;
 	cfs_b->quota = RUNTIME_INF;
+	cfs_b->burst = 0;
+	cfs_b->slice_max = RUNTIME_INF;
 	cfs_b->period = ns_to_ktime(default_cfs_period());
 
 	INIT_LIST_HEAD(&cfs_b->throttled_cfs_rq);
@@ -515,6 +536,14 @@ static inline struct cfs_bandwidth *tg_cfs_bandwidth(struct task_group *tg)
 #endif /* CONFIG_CFS_BANDWIDTH */
 #endif /* CONFIG_FAIR_GROUP_SCHED */
 
+/* Deadline class' related fields in a runqueue: EDF ordered tasks */
+struct dl_rq {
+	struct rb_root rb_root;
+	struct rb_node *rb_leftmost;
+
+	unsigned long dl_nr_running;
+};
+
 /* Real-Time classes' related field in a runqueue: */
 struct rt_rq {
 	struct rt_prio_array active;
@@ -532,6 +561,7 @@ struct rt_rq {
 	unsigned long rt_nr_total;
 	int overloaded;
 	struct plist_head pushable_tasks;
+	int push_pending;	/* asked to push, see tell_cpu_to_push() */
 #endif
 	int rt_throttled;
 	u64 rt_time;
@@ -613,6 +643,7 @@ struct rq {
 
 	struct cfs_rq cfs;
 	struct rt_rq rt;
+	struct dl_rq dl;
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this cpu: */
@@ -664,6 +695,11 @@ struct rq {
 #ifdef CONFIG_IRQ_TIME_ACCOUNTING
 	u64 prev_irq_time;
 #endif
+#ifdef CONFIG_CPU_FREQ
+	/* time with nr_running > 0, for cpufreq governors */
+	u64 busy_time;
+	u64 busy_stamp;
+#endif
 #ifdef CONFIG_PARAVIRT
 	u64 prev_steal_time;
 #endif
@@ -700,6 +736,10 @@ struct rq {
 	/* try_to_wake_up() stats */
 	unsigned int ttwu_count;
 	unsigned int ttwu_local;
+
+	/* remote wakeups queued on wake_list, and the IPIs they cost */
+	unsigned int ttwu_queued;
+	unsigned int ttwu_queued_ipi;
 #endif
 
 #ifdef CONFIG_SMP
@@ -1334,7 +1374,40 @@ static void resched_cpu(int cpu)
 	raw_spin_unlock_irqrestore(&rq->lock, flags);
 }
 
+/* cpus with isolated domains */
+static cpumask_var_t cpu_isolated_map;
+
 #ifdef CONFIG_NO_HZ
+/*
+ * Whether non-pinned timers armed on @cpu are better placed elsewhere:
+ * @cpu is idle, or isolated with isolcpus= and thus supposed to be left
+ * alone by other subsystems' housekeeping.
+ */
+bool nohz_timer_should_migrate(int cpu)
+{
+	return idle_cpu(cpu) || cpumask_test_cpu(cpu, cpu_isolated_map);
+}
+
+/*
+ * Isolated cpus are not part of any sched domain.  Pick a busy
+ * housekeeping cpu for their timers, preferring the local node.
+ */
+static int get_housekeeping_timer_target(int cpu)
+{
+	const struct cpumask *node = cpumask_of_node(cpu_to_node(cpu));
+	int i, remote = -1;
+
+	for_each_online_cpu(i) {
+		if (cpumask_test_cpu(i, cpu_isolated_map) || idle_cpu(i))
+			continue;
+		if (cpumask_test_cpu(i, node))
+			return i;
+		if (remote < 0)
+			remote = i;
+	}
+	return remote >= 0 ? remote : cpu;
+}
+
 /*
  * In the semi idle case, use the nearest busy cpu for migrating timers
  * from an idle cpu.  This is good for power-savings.
@@ -1342,6 +1415,8 @@ static void resched_cpu(int cpu)
  * We don't do similar optimization for completely idle system, as
  * selecting an idle cpu will add more delays to the timers than intended
  * (as that cpu's timer base may not be uptodate wrt jiffies etc).
+ *
+ * Timers armed on an isolated cpu go to a busy housekeeping cpu instead.
  */
 int get_nohz_timer_target(void)
 {
@@ -1349,6 +1424,9 @@ int get_nohz_timer_target(void)
 	int i;
 	struct sched_domain *sd;
 
+	if (cpumask_test_cpu(cpu, cpu_isolated_map))
+		return get_housekeeping_timer_target(cpu);
+
 	rcu_read_lock();
 	for_each_domain(cpu, sd) {
 		for_each_cpu(i, sched_domain_span(sd)) {
@@ -1901,6 +1979,60 @@ static inline void __set_task_cpu(struct task_struct *p, unsigned int cpu)
 }
 
 static const struct sched_class rt_sched_class;
+static const struct sched_class dl_sched_class;
+
+/*
+ * Bandwidth admitted to SCHED_DEADLINE tasks, as runtime/period << 20
+ * ratios like to_ratio(). The total may not exceed the RT bandwidth of
+ * all online CPUs, and a single task can not need more than one CPU.
+ */
+static DEFINE_RAW_SPINLOCK(dl_bw_lock);
+static u64 dl_total_bw;
+
+static inline u64 dl_to_ratio(u64 period, u64 runtime)
+{
+	return div64_u64(runtime << 20, period);
+}
+
+/*
+ * Account the bandwidth @p needs under @policy/@attr instead of what it
+ * holds now. Fails with -EBUSY when that does not fit.
+ */
+static int dl_bw_update(struct task_struct *p, int policy,
+			const struct sched_attr *attr)
+{
+	u64 new_bw = 0, cpu_bw, period;
+	int ret = 0;
+
+	if (dl_policy(policy)) {
+		period = attr->sched_period ?: attr->sched_deadline;
+		new_bw = dl_to_ratio(period, attr->sched_runtime);
+	}
+
+	raw_spin_lock(&dl_bw_lock);
+	if (new_bw > p->dl.dl_bw && global_rt_runtime() != RUNTIME_INF) {
+		cpu_bw = dl_to_ratio(global_rt_period(), global_rt_runtime());
+		if (new_bw > cpu_bw || dl_total_bw - p->dl.dl_bw + new_bw >
+				       cpu_bw * num_online_cpus()) {
+			ret = -EBUSY;
+			goto unlock;
+		}
+	}
+	dl_total_bw = dl_total_bw - p->dl.dl_bw + new_bw;
+	p->dl.dl_bw = new_bw;
+unlock:
+	raw_spin_unlock(&dl_bw_lock);
+
+	return ret;
+}
+
+static void dl_bw_release(struct sched_dl_entity *dl_se)
+{
+	raw_spin_lock(&dl_bw_lock);
+	dl_total_bw -= dl_se->dl_bw;
+	dl_se->dl_bw = 0;
+	raw_spin_unlock(&dl_bw_lock);
+}
 
 #define sched_class_highest (&stop_sched_class)
 #define for_each_class(class) \
@@ -1908,13 +2040,82 @@ static const struct sched_class rt_sched_class;
 
 #include "sched_stats.h"
 
+#ifdef CONFIG_CPU_FREQ
+static DEFINE_PER_CPU(struct update_util_data *, cpufreq_update_util_data);
+
+/**
+ * cpufreq_add_update_util_hook - let a cpufreq governor follow a cpu's load
+ * @cpu: the cpu to be followed
+ * @data: handed back to @func
+ * @func: called with the rq lock of @cpu held, see struct update_util_data
+ *
+ * The caller must make sure that @data stays around until
+ * cpufreq_remove_update_util_hook() has been called for @cpu and a
+ * synchronize_sched() has passed.
+ */
+void cpufreq_add_update_util_hook(int cpu, struct update_util_data *data,
+			void (*func)(struct update_util_data *data, u64 time,
+				     u64 busy_time, unsigned int flags))
+{
+	if (WARN_ON(!data || !func))
+		return;
+
+	if (WARN_ON(per_cpu(cpufreq_update_util_data, cpu)))
+		return;
+
+	data->func = func;
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), data);
+}
+EXPORT_SYMBOL_GPL(cpufreq_add_update_util_hook);
+
+void cpufreq_remove_update_util_hook(int cpu)
+{
+	rcu_assign_pointer(per_cpu(cpufreq_update_util_data, cpu), NULL);
+}
+EXPORT_SYMBOL_GPL(cpufreq_remove_update_util_hook);
+
+/* Must be called before nr_running changes */
+static inline void update_rq_busy(struct rq *rq)
+{
+	if (rq->nr_running)
+		rq->busy_time += rq->clock - rq->busy_stamp;
+	rq->busy_stamp = rq->clock;
+}
+
+static inline void cpufreq_update_util(struct rq *rq)
+{
+	struct update_util_data *data;
+	unsigned int flags = 0;
+
+	data = rcu_dereference_sched(per_cpu(cpufreq_update_util_data,
+					     cpu_of(rq)));
+	if (!data)
+		return;
+
+	update_rq_busy(rq);
+	if (rq->rt.rt_nr_running || rq->dl.dl_nr_running)
+		flags |= SCHED_CPUFREQ_RT;
+	data->func(data, rq->clock, rq->busy_time, flags);
+}
+#else
+static inline void update_rq_busy(struct rq *rq) { }
+static inline void cpufreq_update_util(struct rq *rq) { }
+#endif
+
 static void inc_nr_running(struct rq *rq)
 {
+	update_rq_busy(rq);
 	rq->nr_running++;
+#ifdef CONFIG_NO_HZ_FULL
+	/* A second runnable task needs the tick back for preemption */
+	if (rq->nr_running == 2)
+		tick_nohz_full_kick_cpu(cpu_of(rq));
+#endif
 }
 
 static void dec_nr_running(struct rq *rq)
 {
+	update_rq_busy(rq);
 	rq->nr_running--;
 }
 
@@ -1941,6 +2142,7 @@ static void enqueue_task(struct rq *rq, struct task_struct *p, int flags)
 	update_rq_clock(rq);
 	sched_info_queued(p);
 	p->sched_class->enqueue_task(rq, p, flags);
+	cpufreq_update_util(rq);
 }
 
 static void dequeue_task(struct rq *rq, struct task_struct *p, int flags)
@@ -1948,6 +2150,7 @@ static void dequeue_task(struct rq *rq, struct task_struct *p, int flags)
 	update_rq_clock(rq);
 	sched_info_dequeued(p);
 	p->sched_class->dequeue_task(rq, p, flags);
+	cpufreq_update_util(rq);
 }
 
 /*
@@ -2196,6 +2399,7 @@ static void unthrottle_offline_cfs_rqs(struct rq *rq);
 #include "sched_idletask.c"
 #include "sched_fair.c"
 #include "sched_rt.c"
+#include "sched_dl.c"
 #include "sched_autogroup.c"
 #include "sched_stoptask.c"
 #ifdef CONFIG_SCHED_DEBUG
@@ -2251,7 +2455,9 @@ static inline int normal_prio(struct task_struct *p)
 {
 	int prio;
 
-	if (task_has_rt_policy(p))
+	if (task_has_dl_policy(p))
+		prio = MAX_DL_PRIO-1;
+	else if (task_has_rt_policy(p))
 		prio = MAX_RT_PRIO-1 - p->rt_priority;
 	else
 		prio = __normal_prio(p);
@@ -2730,7 +2936,10 @@ static void sched_ttwu_pending(void)
 
 void scheduler_ipi(void)
 {
-	if (llist_empty(&this_rq()->wake_list) && !got_nohz_idle_kick())
+	tick_nohz_full_check();
+
+	if (llist_empty(&this_rq()->wake_list) && !got_nohz_idle_kick() &&
+	    !this_rq()->rt.push_pending)
 		return;
 
 	/*
@@ -2749,6 +2958,9 @@ void scheduler_ipi(void)
 	irq_enter();
 	sched_ttwu_pending();
 
+	if (this_rq()->rt.push_pending)
+		rt_push_ipi(this_rq());
+
 	/*
 	 * Check if someone kicked us for doing the nohz idle load balance.
 	 */
@@ -2759,10 +2971,31 @@ void scheduler_ipi(void)
 	irq_exit();
 }
 
+/* id of the last level cache domain, see update_top_cache_domain() */
+static DEFINE_PER_CPU(int, sd_llc_id);
+
+/*
+ * Wakeups within a cache domain are cheaper done directly on the remote
+ * runqueue than bounced through the wake_list and an IPI.
+ */
+static bool cpus_share_cache(int this_cpu, int that_cpu)
+{
+	return per_cpu(sd_llc_id, this_cpu) == per_cpu(sd_llc_id, that_cpu);
+}
+
+/*
+ * Only the first wakeup queued on an empty wake_list sends the IPI, the
+ * ones queued until the target drains its list ride along with it.
+ */
 static void ttwu_queue_remote(struct task_struct *p, int cpu)
 {
-	if (llist_add(&p->wake_entry, &cpu_rq(cpu)->wake_list))
+	struct rq *rq = cpu_rq(cpu);
+
+	schedstat_inc(rq, ttwu_queued);
+	if (llist_add(&p->wake_entry, &rq->wake_list)) {
+		schedstat_inc(rq, ttwu_queued_ipi);
 		smp_send_reschedule(cpu);
+	}
 }
 
 #ifdef __ARCH_WANT_INTERRUPTS_ON_CTXSW
@@ -2790,7 +3023,7 @@ static void ttwu_queue(struct task_struct *p, int cpu)
 	struct rq *rq = cpu_rq(cpu);
 
 #if defined(CONFIG_SMP)
-	if (sched_feat(TTWU_QUEUE) && cpu != smp_processor_id()) {
+	if (sched_feat(TTWU_QUEUE) && !cpus_share_cache(smp_processor_id(), cpu)) {
 		sched_clock_cpu(cpu); /* sync clocks x-cpu */
 		ttwu_queue_remote(p, cpu);
 		return;
@@ -2964,9 +3197,24 @@ static void __sched_fork(struct task_struct *p)
 
 	INIT_LIST_HEAD(&p->rt.run_list);
 
+	RB_CLEAR_NODE(&p->dl.rb_node);
+	init_dl_task_timer(&p->dl);
+	p->dl.dl_bw = 0;
+	p->dl.dl_throttled = 0;
+	p->dl.dl_yielded = 0;
+
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	INIT_HLIST_HEAD(&p->preempt_notifiers);
 #endif
+
+#ifdef CONFIG_NUMA_BALANCING
+	p->numa_scan_seq = p->mm ? p->mm->numa_scan_seq : 0;
+	p->numa_scan_period = sysctl_numa_balancing_scan_delay;
+	p->node_stamp = 0;
+	p->numa_work_pending = 0;
+	p->numa_preferred_nid = -1;
+	p->numa_faults = NULL;
+#endif
 }
 
 /*
@@ -2991,10 +3239,12 @@ void sched_fork(struct task_struct *p)
 	p->prio = current->normal_prio;
 
 	/*
-	 * Revert to default priority/policy on fork if requested.
+	 * Revert to default priority/policy on fork if requested. The
+	 * bandwidth of a deadline task is not inherited, its children
+	 * always start as SCHED_NORMAL.
 	 */
-	if (unlikely(p->sched_reset_on_fork)) {
-		if (task_has_rt_policy(p)) {
+	if (unlikely(p->sched_reset_on_fork || task_has_dl_policy(p))) {
+		if (task_has_dl_policy(p) || task_has_rt_policy(p)) {
 			p->policy = SCHED_NORMAL;
 			p->static_prio = NICE_TO_PRIO(0);
 			p->rt_priority = 0;
@@ -3217,6 +3467,8 @@ static void finish_task_switch(struct rq *rq, struct task_struct *prev)
 		 * task and put them back on the free list.
 		 */
 		kprobe_flush_task(prev);
+		if (prev->sched_class->task_dead)
+			prev->sched_class->task_dead(prev);
 		put_task_struct(prev);
 	}
 }
@@ -4444,6 +4696,7 @@ void scheduler_tick(void)
 	update_rq_clock(rq);
 	update_cpu_load_active(rq);
 	curr->sched_class->task_tick(rq, curr, 0);
+	cpufreq_update_util(rq);
 	raw_spin_unlock(&rq->lock);
 
 	perf_event_task_tick();
@@ -5208,7 +5461,7 @@ void rt_mutex_setprio(struct task_struct *p, int prio)
 	struct rq *rq;
 	const struct sched_class *prev_class;
 
-	BUG_ON(prio < 0 || prio > MAX_PRIO);
+	BUG_ON(prio < MAX_DL_PRIO-1 || prio > MAX_PRIO);
 
 	rq = __task_rq_lock(p);
 
@@ -5222,7 +5475,9 @@ void rt_mutex_setprio(struct task_struct *p, int prio)
 	if (running)
 		p->sched_class->put_prev_task(rq, p);
 
-	if (rt_prio(prio))
+	if (dl_prio(prio))
+		p->sched_class = &dl_sched_class;
+	else if (rt_prio(prio))
 		p->sched_class = &rt_sched_class;
 	else
 		p->sched_class = &fair_sched_class;
@@ -5259,7 +5514,7 @@ void set_user_nice(struct task_struct *p, long nice)
 	 * it wont have any effect on scheduling until the task is
 	 * SCHED_FIFO/SCHED_RR:
 	 */
-	if (task_has_rt_policy(p)) {
+	if (task_has_dl_policy(p) || task_has_rt_policy(p)) {
 		p->static_prio = NICE_TO_PRIO(nice);
 		goto out_unlock;
 	}
@@ -5415,13 +5670,45 @@ __setscheduler(struct rq *rq, struct task_struct *p, int policy, int prio)
 	p->normal_prio = normal_prio(p);
 	/* we are holding p->pi_lock already */
 	p->prio = rt_mutex_getprio(p);
-	if (rt_prio(p->prio))
+	if (dl_prio(p->prio))
+		p->sched_class = &dl_sched_class;
+	else if (rt_prio(p->prio))
 		p->sched_class = &rt_sched_class;
 	else
 		p->sched_class = &fair_sched_class;
 	set_load_weight(p);
 }
 
+/*
+ * SCHED_DEADLINE parameters: the runtime has to fit in the deadline and
+ * the deadline in the period. Runtimes below 1us are not enforceable.
+ */
+static bool __checkparam_dl(const struct sched_attr *attr)
+{
+	u64 period = attr->sched_period ?: attr->sched_deadline;
+
+	if (attr->sched_deadline == 0 || attr->sched_runtime < (1ULL << 10))
+		return false;
+
+	/* keep the << 20 bandwidth ratios and the deadlines from wrapping */
+	if (period & (1ULL << 63) || attr->sched_runtime >= (1ULL << 44))
+		return false;
+
+	return attr->sched_runtime <= attr->sched_deadline &&
+	       attr->sched_deadline <= period;
+}
+
+static void __setparam_dl(struct task_struct *p, const struct sched_attr *attr)
+{
+	struct sched_dl_entity *dl_se = &p->dl;
+
+	dl_se->dl_runtime = attr->sched_runtime;
+	dl_se->dl_deadline = attr->sched_deadline;
+	dl_se->dl_period = attr->sched_period ?: attr->sched_deadline;
+	dl_se->dl_new = 1;
+	dl_se->dl_yielded = 0;
+}
+
 /*
  * check the target process has a UID that matches the current process's
  */
@@ -5442,7 +5729,8 @@ static bool check_same_owner(struct task_struct *p)
 }
 
 static int __sched_setscheduler(struct task_struct *p, int policy,
-				const struct sched_param *param, bool user)
+				const struct sched_param *param,
+				const struct sched_attr *attr, bool user)
 {
 	int retval, oldprio, oldpolicy = -1, on_rq, running;
 	unsigned long flags;
@@ -5461,12 +5749,17 @@ recheck:
 		reset_on_fork = !!(policy & SCHED_RESET_ON_FORK);
 		policy &= ~SCHED_RESET_ON_FORK;
 
-		if (policy != SCHED_FIFO && policy != SCHED_RR &&
+		if (policy != SCHED_DEADLINE &&
+				policy != SCHED_FIFO && policy != SCHED_RR &&
 				policy != SCHED_NORMAL && policy != SCHED_BATCH &&
 				policy != SCHED_IDLE)
 			return -EINVAL;
 	}
 
+	/* SCHED_DEADLINE can only be set through sched_setattr() */
+	if (dl_policy(policy) && (!attr || !__checkparam_dl(attr)))
+		return -EINVAL;
+
 	/*
 	 * Valid priorities for SCHED_FIFO and SCHED_RR are
 	 * 1..MAX_USER_RT_PRIO-1, valid priority for SCHED_NORMAL,
@@ -5483,6 +5776,9 @@ recheck:
 	 * Allow unprivileged RT tasks to decrease priority:
 	 */
 	if (user && !capable(CAP_SYS_NICE)) {
+		if (dl_policy(policy))
+			return -EPERM;
+
 		if (rt_policy(policy)) {
 			unsigned long rlim_rtprio =
 					task_rlimit(p, RLIMIT_RTPRIO);
@@ -5541,8 +5837,9 @@ recheck:
 	/*
 	 * If not changing anything there's no need to proceed further:
 	 */
-	if (unlikely(policy == p->policy && (!rt_policy(policy) ||
-			param->sched_priority == p->rt_priority))) {
+	if (unlikely(policy == p->policy && !dl_policy(policy) &&
+			(!rt_policy(policy) ||
+			 param->sched_priority == p->rt_priority))) {
 
 		__task_rq_unlock(rq);
 		raw_spin_unlock_irqrestore(&p->pi_lock, flags);
@@ -5570,6 +5867,15 @@ recheck:
 		task_rq_unlock(rq, p, &flags);
 		goto recheck;
 	}
+
+	/* admission control for the deadline bandwidth */
+	if (dl_policy(policy) || task_has_dl_policy(p)) {
+		if (dl_bw_update(p, policy, attr)) {
+			task_rq_unlock(rq, p, &flags);
+			return -EBUSY;
+		}
+	}
+
 	on_rq = p->on_rq;
 	running = task_current(rq, p);
 	if (on_rq)
@@ -5581,6 +5887,14 @@ recheck:
 
 	oldprio = p->prio;
 	prev_class = p->sched_class;
+	if (dl_policy(policy)) {
+		/* new parameters start a new instance */
+		if (task_has_dl_policy(p)) {
+			cancel_dl_timer(&p->dl);
+			p->dl.dl_throttled = 0;
+		}
+		__setparam_dl(p, attr);
+	}
 	__setscheduler(rq, p, policy, param->sched_priority);
 
 	if (running)
@@ -5607,10 +5921,51 @@ recheck:
 int sched_setscheduler(struct task_struct *p, int policy,
 		       const struct sched_param *param)
 {
-	return __sched_setscheduler(p, policy, param, true);
+	return __sched_setscheduler(p, policy, param, NULL, true);
 }
 EXPORT_SYMBOL_GPL(sched_setscheduler);
 
+/**
+ * sched_setattr - change the scheduling policy and parameters of a thread.
+ * @p: the task in question.
+ * @attr: the new policy and its parameters.
+ *
+ * Like sched_setscheduler(), but also sets SCHED_DEADLINE parameters and
+ * the nice value of SCHED_NORMAL/SCHED_BATCH tasks.
+ */
+int sched_setattr(struct task_struct *p, const struct sched_attr *attr)
+{
+	struct sched_param param = { .sched_priority = attr->sched_priority };
+	int policy = attr->sched_policy;
+	int nice = attr->sched_nice;
+	int retval;
+
+	if (attr->sched_flags & ~SCHED_FLAG_RESET_ON_FORK)
+		return -EINVAL;
+	if (attr->sched_flags & SCHED_FLAG_RESET_ON_FORK)
+		policy |= SCHED_RESET_ON_FORK;
+
+	if (policy == SCHED_NORMAL || policy == SCHED_BATCH) {
+		if (nice < -20 || nice > 19)
+			return -EINVAL;
+		if (nice < TASK_NICE(p) && !can_nice(p, nice))
+			return -EPERM;
+		retval = security_task_setnice(p, nice);
+		if (retval)
+			return retval;
+	}
+
+	retval = __sched_setscheduler(p, policy, &param, attr, true);
+	if (retval)
+		return retval;
+
+	if (policy == SCHED_NORMAL || policy == SCHED_BATCH)
+		set_user_nice(p, nice);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(sched_setattr);
+
 /**
  * sched_setscheduler_nocheck - change the scheduling policy and/or RT priority of a thread from kernelspace.
  * @p: the task in question.
@@ -5625,7 +5980,7 @@ EXPORT_SYMBOL_GPL(sched_setscheduler);
 int sched_setscheduler_nocheck(struct task_struct *p, int policy,
 			       const struct sched_param *param)
 {
-	return __sched_setscheduler(p, policy, param, false);
+	return __sched_setscheduler(p, policy, param, NULL, false);
 }
 
 static int
@@ -5666,6 +6021,142 @@ SYSCALL_DEFINE3(sched_setscheduler, pid_t, pid, int, policy,
 	return do_sched_setscheduler(pid, policy, param);
 }
 
+/*
+ * Copy a struct sched_attr from userspace. Older userspace may pass a
+ * shorter structure, newer one a longer: then the tail we do not know
+ * about has to be zero.
+ */
+static int sched_copy_attr(struct sched_attr __user *uattr,
+			   struct sched_attr *attr)
+{
+	u32 size;
+	int ret;
+
+	memset(attr, 0, sizeof(*attr));
+
+	ret = get_user(size, &uattr->size);
+	if (ret)
+		return ret;
+
+	if (size > PAGE_SIZE)
+		goto err_size;
+	if (!size)
+		size = SCHED_ATTR_SIZE_VER0;
+	if (size < SCHED_ATTR_SIZE_VER0)
+		goto err_size;
+
+	if (size > sizeof(*attr)) {
+		unsigned char __user *addr = (void __user *)uattr + sizeof(*attr);
+		unsigned char __user *end = (void __user *)uattr + size;
+		unsigned char val;
+
+		for (; addr < end; addr++) {
+			ret = get_user(val, addr);
+			if (ret)
+				return ret;
+			if (val)
+				goto err_size;
+		}
+		size = sizeof(*attr);
+	}
+
+	if (copy_from_user(attr, uattr, size))
+		return -EFAULT;
+
+	return 0;
+
+err_size:
+	put_user(sizeof(*attr), &uattr->size);
+	return -E2BIG;
+}
+
+/**
+ * sys_sched_setattr - set/change the scheduling policy and parameters
+ * @pid: the pid in question.
+ * @uattr: structure containing the extended parameters.
+ * @flags: for future extension, must be zero.
+ */
+SYSCALL_DEFINE3(sched_setattr, pid_t, pid, struct sched_attr __user *, uattr,
+		unsigned int, flags)
+{
+	struct sched_attr attr;
+	struct task_struct *p;
+	int retval;
+
+	if (!uattr || pid < 0 || flags)
+		return -EINVAL;
+
+	retval = sched_copy_attr(uattr, &attr);
+	if (retval)
+		return retval;
+
+	if ((int)attr.sched_policy < 0)
+		return -EINVAL;
+
+	rcu_read_lock();
+	retval = -ESRCH;
+	p = find_process_by_pid(pid);
+	if (p != NULL)
+		retval = sched_setattr(p, &attr);
+	rcu_read_unlock();
+
+	return retval;
+}
+
+/**
+ * sys_sched_getattr - get the scheduling policy and parameters of a thread
+ * @pid: the pid in question.
+ * @uattr: structure to fill in.
+ * @size: sizeof(attr) known to userspace.
+ * @flags: for future extension, must be zero.
+ */
+SYSCALL_DEFINE4(sched_getattr, pid_t, pid, struct sched_attr __user *, uattr,
+		unsigned int, size, unsigned int, flags)
+{
+	struct sched_attr attr = {
+		.size = sizeof(struct sched_attr),
+	};
+	struct task_struct *p;
+	int retval;
+
+	if (!uattr || pid < 0 || flags ||
+	    size > PAGE_SIZE || size < SCHED_ATTR_SIZE_VER0)
+		return -EINVAL;
+
+	rcu_read_lock();
+	p = find_process_by_pid(pid);
+	retval = -ESRCH;
+	if (!p)
+		goto out_unlock;
+
+	retval = security_task_getscheduler(p);
+	if (retval)
+		goto out_unlock;
+
+	attr.sched_policy = p->policy;
+	if (p->sched_reset_on_fork)
+		attr.sched_flags |= SCHED_FLAG_RESET_ON_FORK;
+	if (task_has_dl_policy(p)) {
+		attr.sched_runtime = p->dl.dl_runtime;
+		attr.sched_deadline = p->dl.dl_deadline;
+		attr.sched_period = p->dl.dl_period;
+	} else if (task_has_rt_policy(p))
+		attr.sched_priority = p->rt_priority;
+	else
+		attr.sched_nice = TASK_NICE(p);
+	rcu_read_unlock();
+
+	if (size < attr.size)
+		attr.size = size;
+	if (copy_to_user(uattr, &attr, attr.size))
+		return -EFAULT;
+	return 0;
+
+out_unlock:
+	rcu_read_unlock();
+	return retval;
+}
+
 /**
  * sys_sched_setparam - set/change the RT priority of a thread
  * @pid: the pid in question.
@@ -6115,6 +6606,7 @@ SYSCALL_DEFINE1(sched_get_priority_max, int, policy)
 	case SCHED_RR:
 		ret = MAX_USER_RT_PRIO-1;
 		break;
+	case SCHED_DEADLINE:
 	case SCHED_NORMAL:
 	case SCHED_BATCH:
 	case SCHED_IDLE:
@@ -6140,6 +6632,7 @@ SYSCALL_DEFINE1(sched_get_priority_min, int, policy)
 	case SCHED_RR:
 		ret = 1;
 		break;
+	case SCHED_DEADLINE:
 	case SCHED_NORMAL:
 	case SCHED_BATCH:
 	case SCHED_IDLE:
@@ -7257,6 +7750,26 @@ static void destroy_sched_domains(struct sched_domain *sd, int cpu)
 		destroy_sched_domain(sd, cpu);
 }
 
+/*
+ * Keep the id of the last level cache domain of each cpu: the first cpu
+ * of its widest domain sharing package resources.
+ */
+static void update_top_cache_domain(int cpu)
+{
+	struct sched_domain *sd, *llc = NULL;
+	int id = cpu;
+
+	for (sd = cpu_rq(cpu)->sd; sd; sd = sd->parent) {
+		if (!(sd->flags & SD_SHARE_PKG_RESOURCES))
+			break;
+		llc = sd;
+	}
+	if (llc)
+		id = cpumask_first(sched_domain_span(llc));
+
+	per_cpu(sd_llc_id, cpu) = id;
+}
+
 /*
  * Attach the domain 'sd' to 'cpu' as its base domain. Callers must
  * hold the hotplug lock.
@@ -7296,10 +7809,9 @@ cpu_attach_domain(struct sched_domain *sd, struct root_domain *rd, int cpu)
 	tmp = rq->sd;
 	rcu_assign_pointer(rq->sd, sd);
 	destroy_sched_domains(tmp, cpu);
-}
 
-/* cpus with isolated domains */
-static cpumask_var_t cpu_isolated_map;
+	update_top_cache_domain(cpu);
+}
 
 /* Setup the mask of cpus configured for isolated domains */
 static int __init isolated_cpu_setup(char *str)
@@ -7311,6 +7823,41 @@ static int __init isolated_cpu_setup(char *str)
 
 __setup("isolcpus=", isolated_cpu_setup);
 
+/* cpus given with isolcpus=, saved by sched_init_smp() */
+static cpumask_var_t cpu_isolated_boot_map;
+
+/*
+ * Make @cpus, in addition to the isolcpus= ones, isolated.  Non-pinned
+ * timers armed from now on stay off them; timers already queued there
+ * expire where they are.  Sched domains pick the change up at their
+ * next rebuild.
+ */
+void sched_set_isolated_cpus(const struct cpumask *cpus)
+{
+	mutex_lock(&sched_domains_mutex);
+	cpumask_or(cpu_isolated_map, cpu_isolated_boot_map, cpus);
+	mutex_unlock(&sched_domains_mutex);
+}
+
+#ifdef CONFIG_NO_HZ_FULL
+bool sched_cpu_isolated(int cpu)
+{
+	return cpumask_test_cpu(cpu, cpu_isolated_map);
+}
+
+/*
+ * Called from the tick with interrupts disabled. An isolated CPU which
+ * runs a single task has nobody to preempt it, so the periodic tick has
+ * nothing to do for the scheduler.
+ */
+bool sched_can_stop_tick(void)
+{
+	int cpu = smp_processor_id();
+
+	return sched_cpu_isolated(cpu) && cpu_rq(cpu)->nr_running == 1;
+}
+#endif /* CONFIG_NO_HZ_FULL */
+
 #ifdef CONFIG_NUMA
 
 /**
@@ -8303,6 +8850,8 @@ void __init sched_init_smp(void)
 	mutex_lock(&sched_domains_mutex);
 	init_sched_domains(cpu_active_mask);
 	cpumask_andnot(non_isolated_cpus, cpu_possible_mask, cpu_isolated_map);
+	alloc_cpumask_var(&cpu_isolated_boot_map, GFP_KERNEL);
+	cpumask_copy(cpu_isolated_boot_map, cpu_isolated_map);
 	if (cpumask_empty(non_isolated_cpus))
 		cpumask_set_cpu(smp_processor_id(), non_isolated_cpus);
 	mutex_unlock(&sched_domains_mutex);
@@ -8508,6 +9057,7 @@ void __init sched_init(void)
 		rq->calc_load_update = jiffies + LOAD_FREQ;
 		init_cfs_rq(&rq->cfs);
 		init_rt_rq(&rq->rt, rq);
+		init_dl_rq(&rq->dl);
 #ifdef CONFIG_FAIR_GROUP_SCHED
 		root_task_group.shares = root_task_group_load;
 		INIT_LIST_HEAD(&rq->leaf_cfs_rq_list);
@@ -9454,7 +10004,8 @@ const u64 min_cfs_quota_period = 1 * NSEC_PER_MSEC; /* 1ms */
 
 static int __cfs_schedulable(struct task_group *tg, u64 period, u64 runtime);
 
-static int tg_set_cfs_bandwidth(struct task_group *tg, u64 period, u64 quota)
+static int tg_set_cfs_bandwidth(struct task_group *tg, u64 period, u64 quota,
+				u64 burst)
 {
 	int i, ret = 0, runtime_enabled;
 	struct cfs_bandwidth *cfs_b = tg_cfs_bandwidth(tg);
@@ -9478,6 +10029,10 @@ static int tg_set_cfs_bandwidth(struct task_group *tg, u64 period, u64 quota)
 	if (period > max_cfs_quota_period)
 		return -EINVAL;
 
+	/* A burst can at most carry over one period's worth of quota */
+	if (quota != RUNTIME_INF && burst > quota)
+		return -EINVAL;
+
 	mutex_lock(&cfs_constraints_mutex);
 	ret = __cfs_schedulable(tg, period, quota);
 	if (ret)
@@ -9487,7 +10042,19 @@ static int tg_set_cfs_bandwidth(struct task_group *tg, u64 period, u64 quota)
 	raw_spin_lock_irq(&cfs_b->lock);
 	cfs_b->period = ns_to_ktime(period);
 	cfs_b->quota = quota;
+	cfs_b->burst = burst;
+	/*
+	 * Don't let the cpus of a small group hold more than its quota in
+	 * slices between them: what sits unused on one cpu throttles the
+	 * others until the slack timer hands it back.
+	 */
+	cfs_b->slice_max = RUNTIME_INF;
+	if (runtime_enabled)
+		cfs_b->slice_max = max(div_u64(quota, num_online_cpus()),
+				       min_cfs_rq_runtime);
 
+	cfs_b->runtime = 0;
+	cfs_b->runtime_snap = 0;
 	__refill_cfs_bandwidth_runtime(cfs_b);
 	/* restart the period timer (if active) to handle new period expiry */
 	if (runtime_enabled && cfs_b->timer_active) {
@@ -9517,15 +10084,16 @@ out_unlock:
 
 int tg_set_cfs_quota(struct task_group *tg, long cfs_quota_us)
 {
-	u64 quota, period;
+	u64 quota, period, burst;
 
 	period = ktime_to_ns(tg_cfs_bandwidth(tg)->period);
+	burst = tg_cfs_bandwidth(tg)->burst;
 	if (cfs_quota_us < 0)
 		quota = RUNTIME_INF;
 	else
 		quota = (u64)cfs_quota_us * NSEC_PER_USEC;
 
-	return tg_set_cfs_bandwidth(tg, period, quota);
+	return tg_set_cfs_bandwidth(tg, period, quota, burst);
 }
 
 long tg_get_cfs_quota(struct task_group *tg)
@@ -9543,15 +10111,16 @@ long tg_get_cfs_quota(struct task_group *tg)
 
 int tg_set_cfs_period(struct task_group *tg, long cfs_period_us)
 {
-	u64 quota, period;
+	u64 quota, period, burst;
 
 	period = (u64)cfs_period_us * NSEC_PER_USEC;
 	quota = tg_cfs_bandwidth(tg)->quota;
+	burst = tg_cfs_bandwidth(tg)->burst;
 
 	if (period <= 0)
 		return -EINVAL;
 
-	return tg_set_cfs_bandwidth(tg, period, quota);
+	return tg_set_cfs_bandwidth(tg, period, quota, burst);
 }
 
 long tg_get_cfs_period(struct task_group *tg)
@@ -9564,6 +10133,30 @@ long tg_get_cfs_period(struct task_group *tg)
 	return cfs_period_us;
 }
 
+int tg_set_cfs_burst(struct task_group *tg, long cfs_burst_us)
+{
+	u64 quota, period, burst;
+
+	if (cfs_burst_us < 0)
+		return -EINVAL;
+
+	burst = (u64)cfs_burst_us * NSEC_PER_USEC;
+	period = ktime_to_ns(tg_cfs_bandwidth(tg)->period);
+	quota = tg_cfs_bandwidth(tg)->quota;
+
+	return tg_set_cfs_bandwidth(tg, period, quota, burst);
+}
+
+long tg_get_cfs_burst(struct task_group *tg)
+{
+	u64 burst_us;
+
+	burst_us = tg_cfs_bandwidth(tg)->burst;
+	do_div(burst_us, NSEC_PER_USEC);
+
+	return burst_us;
+}
+
 static s64 cpu_cfs_quota_read_s64(struct cgroup *cgrp, struct cftype *cft)
 {
 	return tg_get_cfs_quota(cgroup_tg(cgrp));
@@ -9586,6 +10179,17 @@ static int cpu_cfs_period_write_u64(struct cgroup *cgrp, struct cftype *cftype,
 	return tg_set_cfs_period(cgroup_tg(cgrp), cfs_period_us);
 }
 
+static u64 cpu_cfs_burst_read_u64(struct cgroup *cgrp, struct cftype *cft)
+{
+	return tg_get_cfs_burst(cgroup_tg(cgrp));
+}
+
+static int cpu_cfs_burst_write_u64(struct cgroup *cgrp, struct cftype *cftype,
+				   u64 cfs_burst_us)
+{
+	return tg_set_cfs_burst(cgroup_tg(cgrp), cfs_burst_us);
+}
+
 struct cfs_schedulable_data {
 	struct task_group *tg;
 	u64 period, quota;
@@ -9669,10 +10273,21 @@ static int cpu_stats_show(struct cgroup *cgrp, struct cftype *cft,
 {
 	struct task_group *tg = cgroup_tg(cgrp);
 	struct cfs_bandwidth *cfs_b = tg_cfs_bandwidth(tg);
+	char key[24];
+	int i;
 
 	cb->fill(cb, "nr_periods", cfs_b->nr_periods);
 	cb->fill(cb, "nr_throttled", cfs_b->nr_throttled);
 	cb->fill(cb, "throttled_time", cfs_b->throttled_time);
+	cb->fill(cb, "nr_bursts", cfs_b->nr_bursts);
+	cb->fill(cb, "burst_time", cfs_b->burst_time);
+
+	for (i = 0; i < CFS_THROTTLE_HIST - 1; i++) {
+		snprintf(key, sizeof(key), "throttled_lt_%ums", 1U << i);
+		cb->fill(cb, key, cfs_b->throttled_hist[i]);
+	}
+	snprintf(key, sizeof(key), "throttled_ge_%ums", 1U << (i - 1));
+	cb->fill(cb, key, cfs_b->throttled_hist[i]);
 
 	return 0;
 }
@@ -9722,6 +10337,11 @@ static struct cftype cpu_files[] = {
 		.read_u64 = cpu_cfs_period_read_u64,
 		.write_u64 = cpu_cfs_period_write_u64,
 	},
+	{
+		.name = "cfs_burst_us",
+		.read_u64 = cpu_cfs_burst_read_u64,
+		.write_u64 = cpu_cfs_burst_write_u64,
+	},
 	{
 		.name = "stat",
 		.read_map = cpu_stats_show,
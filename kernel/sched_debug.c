@@ -303,6 +303,8 @@ static void print_cpu(struct seq_file *m, int cpu)
 
 	P(ttwu_count);
 	P(ttwu_local);
+	P(ttwu_queued);
+	P(ttwu_queued_ipi);
 
 #undef P
 #undef P64
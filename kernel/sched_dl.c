@@ -0,0 +1,449 @@
+/*
+ * Deadline Scheduling Class (SCHED_DEADLINE)
+ *
+ * Earliest Deadline First (EDF) scheduling of tasks with a runtime,
+ * deadline and period, with the Constant Bandwidth Server (CBS) keeping
+ * each task within its reserved bandwidth: a task which exhausts its
+ * runtime is throttled until its next period, so it can not starve the
+ * other tasks even if it overruns.
+ *
+ * Tasks are not migrated by this class, they run on the CPU they were
+ * woken on; partition them with CPU affinity. Admission control in
+ * sched_setattr() keeps the total bandwidth of all deadline tasks below
+ * sysctl_sched_rt_runtime/sysctl_sched_rt_period per online CPU.
+ */
+
+static inline struct task_struct *dl_task_of(struct sched_dl_entity *dl_se)
+{
+	return container_of(dl_se, struct task_struct, dl);
+}
+
+static inline struct rq *rq_of_dl_rq(struct dl_rq *dl_rq)
+{
+	return container_of(dl_rq, struct rq, dl);
+}
+
+static inline int on_dl_rq(struct sched_dl_entity *dl_se)
+{
+	return !RB_EMPTY_NODE(&dl_se->rb_node);
+}
+
+static inline int dl_time_before(u64 a, u64 b)
+{
+	return (s64)(a - b) < 0;
+}
+
+static inline int dl_entity_preempt(struct sched_dl_entity *a,
+				    struct sched_dl_entity *b)
+{
+	return dl_time_before(a->deadline, b->deadline);
+}
+
+static inline int is_leftmost(struct task_struct *p, struct dl_rq *dl_rq)
+{
+	return dl_rq->rb_leftmost == &p->dl.rb_node;
+}
+
+static void init_dl_rq(struct dl_rq *dl_rq)
+{
+	dl_rq->rb_root = RB_ROOT;
+	dl_rq->rb_leftmost = NULL;
+	dl_rq->dl_nr_running = 0;
+}
+
+/*
+ * Start a new instance: full runtime, deadline relative to now.
+ */
+static void setup_new_dl_entity(struct sched_dl_entity *dl_se, struct rq *rq)
+{
+	dl_se->deadline = rq->clock + dl_se->dl_deadline;
+	dl_se->runtime = dl_se->dl_runtime;
+	dl_se->dl_new = 0;
+	dl_se->dl_yielded = 0;
+}
+
+/*
+ * The budget ran out: postpone the deadline by one period per refill
+ * until there is runtime again. If we lag so much that the new deadline
+ * is already in the past, start over.
+ */
+static void replenish_dl_entity(struct sched_dl_entity *dl_se, struct rq *rq)
+{
+	if (dl_se->dl_yielded && dl_se->runtime > 0)
+		dl_se->runtime = 0;
+	dl_se->dl_yielded = 0;
+
+	while (dl_se->runtime <= 0) {
+		dl_se->deadline += dl_se->dl_period;
+		dl_se->runtime += dl_se->dl_runtime;
+	}
+
+	if (dl_time_before(dl_se->deadline, rq->clock)) {
+		dl_se->deadline = rq->clock + dl_se->dl_deadline;
+		dl_se->runtime = dl_se->dl_runtime;
+	}
+}
+
+/*
+ * CBS wakeup rule: the current deadline and remaining runtime can only
+ * be kept if using them from @t on does not exceed the reserved
+ * bandwidth, i.e. runtime / (deadline - t) <= dl_runtime / dl_period.
+ * Both sides are scaled down to avoid overflowing the multiplication.
+ */
+static bool dl_entity_overflow(struct sched_dl_entity *dl_se, u64 t)
+{
+	u64 left, right;
+
+	left = (dl_se->dl_period >> 10) * (dl_se->runtime >> 10);
+	right = ((dl_se->deadline - t) >> 10) * (dl_se->dl_runtime >> 10);
+
+	return dl_time_before(right, left);
+}
+
+static void update_dl_entity(struct sched_dl_entity *dl_se, struct rq *rq)
+{
+	if (dl_se->dl_new) {
+		setup_new_dl_entity(dl_se, rq);
+		return;
+	}
+
+	if (dl_time_before(dl_se->deadline, rq->clock) ||
+	    dl_entity_overflow(dl_se, rq->clock)) {
+		dl_se->deadline = rq->clock + dl_se->dl_deadline;
+		dl_se->runtime = dl_se->dl_runtime;
+	}
+}
+
+static void __enqueue_dl_entity(struct sched_dl_entity *dl_se)
+{
+	struct dl_rq *dl_rq = &task_rq(dl_task_of(dl_se))->dl;
+	struct rb_node **link = &dl_rq->rb_root.rb_node;
+	struct rb_node *parent = NULL;
+	struct sched_dl_entity *entry;
+	int leftmost = 1;
+
+	BUG_ON(on_dl_rq(dl_se));
+
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct sched_dl_entity, rb_node);
+		if (dl_time_before(dl_se->deadline, entry->deadline))
+			link = &parent->rb_left;
+		else {
+			link = &parent->rb_right;
+			leftmost = 0;
+		}
+	}
+
+	if (leftmost)
+		dl_rq->rb_leftmost = &dl_se->rb_node;
+
+	rb_link_node(&dl_se->rb_node, parent, link);
+	rb_insert_color(&dl_se->rb_node, &dl_rq->rb_root);
+
+	dl_rq->dl_nr_running++;
+	inc_nr_running(rq_of_dl_rq(dl_rq));
+}
+
+static void __dequeue_dl_entity(struct sched_dl_entity *dl_se)
+{
+	struct dl_rq *dl_rq = &task_rq(dl_task_of(dl_se))->dl;
+
+	if (!on_dl_rq(dl_se))
+		return;
+
+	if (dl_rq->rb_leftmost == &dl_se->rb_node)
+		dl_rq->rb_leftmost = rb_next(&dl_se->rb_node);
+
+	rb_erase(&dl_se->rb_node, &dl_rq->rb_root);
+	RB_CLEAR_NODE(&dl_se->rb_node);
+
+	dl_rq->dl_nr_running--;
+	dec_nr_running(rq_of_dl_rq(dl_rq));
+}
+
+/*
+ * Arm the replenishment timer for the start of the next period. The
+ * timer holds a reference on the task. Returns 0 if that moment has
+ * already passed, the caller replenishes right away then.
+ */
+static int start_dl_timer(struct sched_dl_entity *dl_se, struct rq *rq)
+{
+	struct task_struct *p = dl_task_of(dl_se);
+	ktime_t now, act;
+	s64 delta;
+
+	act = ns_to_ktime(dl_se->deadline - dl_se->dl_deadline +
+			  dl_se->dl_period);
+	now = hrtimer_cb_get_time(&dl_se->dl_timer);
+	delta = ktime_to_ns(now) - rq->clock;
+	act = ktime_add_ns(act, delta);
+
+	if (ktime_us_delta(act, now) < 0)
+		return 0;
+
+	/* A running callback drops the reference of its own expiry */
+	if (!hrtimer_is_queued(&dl_se->dl_timer))
+		get_task_struct(p);
+	__hrtimer_start_range_ns(&dl_se->dl_timer, act, 0,
+				 HRTIMER_MODE_ABS, 0);
+
+	return 1;
+}
+
+static void cancel_dl_timer(struct sched_dl_entity *dl_se)
+{
+	if (hrtimer_try_to_cancel(&dl_se->dl_timer) == 1)
+		put_task_struct(dl_task_of(dl_se));
+}
+
+static enum hrtimer_restart dl_task_timer(struct hrtimer *timer)
+{
+	struct sched_dl_entity *dl_se = container_of(timer,
+						     struct sched_dl_entity,
+						     dl_timer);
+	struct task_struct *p = dl_task_of(dl_se);
+	unsigned long flags;
+	struct rq *rq;
+
+	rq = task_rq_lock(p, &flags);
+
+	/* The task left SCHED_DEADLINE or got new parameters meanwhile */
+	if (!dl_se->dl_throttled || p->sched_class != &dl_sched_class)
+		goto unlock;
+
+	update_rq_clock(rq);
+	dl_se->dl_throttled = 0;
+	replenish_dl_entity(dl_se, rq);
+	if (p->on_rq) {
+		__enqueue_dl_entity(dl_se);
+		if (!dl_task(rq->curr) ||
+		    dl_entity_preempt(dl_se, &rq->curr->dl))
+			resched_task(rq->curr);
+	}
+unlock:
+	task_rq_unlock(rq, p, &flags);
+	put_task_struct(p);
+
+	return HRTIMER_NORESTART;
+}
+
+static void init_dl_task_timer(struct sched_dl_entity *dl_se)
+{
+	hrtimer_init(&dl_se->dl_timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	dl_se->dl_timer.function = dl_task_timer;
+}
+
+#ifdef CONFIG_SCHED_HRTICK
+static void start_hrtick_dl(struct rq *rq, struct task_struct *p)
+{
+	s64 delta = p->dl.runtime;
+
+	if (delta > 10000)
+		hrtick_start(rq, delta);
+}
+#else
+static void start_hrtick_dl(struct rq *rq, struct task_struct *p)
+{
+}
+#endif
+
+/*
+ * Charge the running time to the current instance and throttle the
+ * task once its budget is gone.
+ */
+static void update_curr_dl(struct rq *rq)
+{
+	struct task_struct *curr = rq->curr;
+	struct sched_dl_entity *dl_se = &curr->dl;
+	u64 delta_exec;
+
+	if (curr->sched_class != &dl_sched_class || !on_dl_rq(dl_se))
+		return;
+
+	delta_exec = rq->clock_task - curr->se.exec_start;
+	if (unlikely((s64)delta_exec < 0))
+		delta_exec = 0;
+
+	schedstat_set(curr->se.statistics.exec_max,
+		      max(curr->se.statistics.exec_max, delta_exec));
+
+	curr->se.sum_exec_runtime += delta_exec;
+	account_group_exec_runtime(curr, delta_exec);
+
+	curr->se.exec_start = rq->clock_task;
+	cpuacct_charge(curr, delta_exec);
+
+	sched_rt_avg_update(rq, delta_exec);
+
+	dl_se->runtime -= delta_exec;
+	if (dl_se->runtime > 0 && !dl_se->dl_yielded)
+		return;
+
+	__dequeue_dl_entity(dl_se);
+	if (start_dl_timer(dl_se, rq))
+		dl_se->dl_throttled = 1;
+	else {
+		replenish_dl_entity(dl_se, rq);
+		__enqueue_dl_entity(dl_se);
+	}
+
+	if (!is_leftmost(curr, &rq->dl))
+		resched_task(curr);
+}
+
+static void enqueue_task_dl(struct rq *rq, struct task_struct *p, int flags)
+{
+	struct sched_dl_entity *dl_se = &p->dl;
+
+	/* dl_task_timer() enqueues it once the budget is refilled */
+	if (dl_se->dl_throttled)
+		return;
+
+	if (dl_se->dl_new || (flags & ENQUEUE_WAKEUP))
+		update_dl_entity(dl_se, rq);
+
+	__enqueue_dl_entity(dl_se);
+}
+
+static void dequeue_task_dl(struct rq *rq, struct task_struct *p, int flags)
+{
+	update_curr_dl(rq);
+	__dequeue_dl_entity(&p->dl);
+}
+
+/*
+ * Yielding ends the current instance: the task sleeps until its next
+ * period and starts it with a fresh budget.
+ */
+static void yield_task_dl(struct rq *rq)
+{
+	struct task_struct *p = rq->curr;
+
+	if (p->dl.runtime > 0) {
+		p->dl.dl_yielded = 1;
+		p->dl.runtime = 0;
+	}
+	update_curr_dl(rq);
+}
+
+static void check_preempt_curr_dl(struct rq *rq, struct task_struct *p,
+				  int flags)
+{
+	if (dl_entity_preempt(&p->dl, &rq->curr->dl))
+		resched_task(rq->curr);
+}
+
+static struct task_struct *pick_next_task_dl(struct rq *rq)
+{
+	struct dl_rq *dl_rq = &rq->dl;
+	struct sched_dl_entity *dl_se;
+	struct task_struct *p;
+
+	if (!dl_rq->dl_nr_running)
+		return NULL;
+
+	dl_se = rb_entry(dl_rq->rb_leftmost, struct sched_dl_entity, rb_node);
+	p = dl_task_of(dl_se);
+	p->se.exec_start = rq->clock_task;
+
+	if (hrtick_enabled(rq))
+		start_hrtick_dl(rq, p);
+
+	return p;
+}
+
+static void put_prev_task_dl(struct rq *rq, struct task_struct *p)
+{
+	update_curr_dl(rq);
+}
+
+static void task_tick_dl(struct rq *rq, struct task_struct *p, int queued)
+{
+	update_curr_dl(rq);
+
+	if (hrtick_enabled(rq) && queued && p->dl.runtime > 0)
+		start_hrtick_dl(rq, p);
+}
+
+static void set_curr_task_dl(struct rq *rq)
+{
+	struct task_struct *p = rq->curr;
+
+	p->se.exec_start = rq->clock_task;
+}
+
+#ifdef CONFIG_SMP
+static int
+select_task_rq_dl(struct task_struct *p, int sd_flag, int flags)
+{
+	return task_cpu(p);
+}
+#endif
+
+static void switched_from_dl(struct rq *rq, struct task_struct *p)
+{
+	cancel_dl_timer(&p->dl);
+	p->dl.dl_throttled = 0;
+}
+
+static void switched_to_dl(struct rq *rq, struct task_struct *p)
+{
+	if (!p->on_rq || rq->curr == p)
+		return;
+
+	if (!dl_task(rq->curr) || dl_entity_preempt(&p->dl, &rq->curr->dl))
+		resched_task(rq->curr);
+}
+
+static void prio_changed_dl(struct rq *rq, struct task_struct *p,
+			    int oldprio)
+{
+	if (!p->on_rq)
+		return;
+
+	if (rq->curr == p) {
+		if (!is_leftmost(p, &rq->dl))
+			resched_task(p);
+	} else
+		switched_to_dl(rq, p);
+}
+
+static unsigned int get_rr_interval_dl(struct rq *rq, struct task_struct *p)
+{
+	return 0;
+}
+
+static void task_dead_dl(struct task_struct *p)
+{
+	cancel_dl_timer(&p->dl);
+	dl_bw_release(&p->dl);
+}
+
+static const struct sched_class dl_sched_class = {
+	.next			= &rt_sched_class,
+
+	.enqueue_task		= enqueue_task_dl,
+	.dequeue_task		= dequeue_task_dl,
+	.yield_task		= yield_task_dl,
+
+	.check_preempt_curr	= check_preempt_curr_dl,
+
+	.pick_next_task		= pick_next_task_dl,
+	.put_prev_task		= put_prev_task_dl,
+
+#ifdef CONFIG_SMP
+	.select_task_rq		= select_task_rq_dl,
+#endif
+
+	.set_curr_task		= set_curr_task_dl,
+	.task_tick		= task_tick_dl,
+
+	.get_rr_interval	= get_rr_interval_dl,
+
+	.prio_changed		= prio_changed_dl,
+	.switched_from		= switched_from_dl,
+	.switched_to		= switched_to_dl,
+
+	.task_dead		= task_dead_dl,
+};
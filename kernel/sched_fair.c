@@ -23,6 +23,7 @@
 #include <linux/latencytop.h>
 #include <linux/sched.h>
 #include <linux/cpumask.h>
+#include <linux/mempolicy.h>
 
 /*
  * Targeted preemption latency for CPU-bound tasks:
@@ -662,6 +663,273 @@ update_stats_curr_start(struct cfs_rq *cfs_rq, struct sched_entity *se)
 	se->exec_start = rq_of(cfs_rq)->clock_task;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Automatic NUMA balancing.
+ *
+ * Every scan period a task marks a chunk of its address space with
+ * PROT_NONE hinting entries (see task_numa_work()).  The next access to
+ * such a page traps into do_numa_page(), which moves the page to the
+ * node of the task and reports the fault here.  The node the task faults
+ * on most becomes its preferred node, which the wakeup and load balancing
+ * paths then try to keep it on.
+ */
+unsigned int sysctl_numa_balancing = 1;
+
+/* ms before the first scan of a new address space */
+unsigned int sysctl_numa_balancing_scan_delay = 1000;
+
+/* ms of task runtime between scans, adapted within these bounds */
+unsigned int sysctl_numa_balancing_scan_period_min = 1000;
+unsigned int sysctl_numa_balancing_scan_period_max = 60000;
+
+/* MB of address space marked per scan */
+unsigned int sysctl_numa_balancing_scan_size = 256;
+
+static inline int numa_balancing_enabled(void)
+{
+	return sysctl_numa_balancing && nr_online_nodes > 1;
+}
+
+static void task_numa_placement(struct task_struct *p)
+{
+	unsigned long faults, max_faults = 0, total_faults = 0;
+	int seq, nid, max_nid = -1;
+
+	seq = ACCESS_ONCE(p->mm->numa_scan_seq);
+	if (p->numa_scan_seq == seq)
+		return;
+	p->numa_scan_seq = seq;
+
+	/*
+	 * Once per pass over the address space: pick the node with the
+	 * most faults and decay the counts, so that the preference follows
+	 * the working set as it moves.
+	 */
+	for_each_online_node(nid) {
+		faults = p->numa_faults[nid];
+		p->numa_faults[nid] = faults >> 1;
+		total_faults += faults;
+		if (faults > max_faults) {
+			max_faults = faults;
+			max_nid = nid;
+		}
+	}
+
+	/* Without a clear majority, leave placement to the load balancer */
+	if (max_faults * 2 <= total_faults)
+		max_nid = -1;
+	p->numa_preferred_nid = max_nid;
+
+	/*
+	 * A task whose memory is already local needs little scanning; one
+	 * that is not gets its pages looked at more often.
+	 */
+	if (max_nid == cpu_to_node(task_cpu(p)))
+		p->numa_scan_period = min(p->numa_scan_period * 2,
+					  sysctl_numa_balancing_scan_period_max);
+	else
+		p->numa_scan_period = max(p->numa_scan_period / 2,
+					  sysctl_numa_balancing_scan_period_min);
+}
+
+/*
+ * Got a NUMA hinting fault on @pages pages, now residing on @node.
+ */
+void task_numa_fault(int node, int pages)
+{
+	struct task_struct *p = current;
+
+	if (!numa_balancing_enabled())
+		return;
+
+	if (unlikely(!p->numa_faults)) {
+		p->numa_faults = kzalloc(sizeof(*p->numa_faults) * nr_node_ids,
+					 GFP_KERNEL | __GFP_NOWARN);
+		if (!p->numa_faults)
+			return;
+	}
+
+	task_numa_placement(p);
+	p->numa_faults[node] += pages;
+}
+
+void task_numa_free(struct task_struct *p)
+{
+	kfree(p->numa_faults);
+}
+
+static void reset_ptenuma_scan(struct mm_struct *mm)
+{
+	ACCESS_ONCE(mm->numa_scan_seq)++;
+	mm->numa_scan_offset = 0;
+}
+
+static inline int vma_numa_scannable(struct vm_area_struct *vma)
+{
+	/* Private anonymous memory only, and not PROT_NONE vmas */
+	return vma_migratable(vma) && vma->anon_vma && !vma->vm_file &&
+	       (vma->vm_flags & (VM_READ | VM_WRITE | VM_EXEC)) &&
+	       !(vma->vm_flags & VM_MIXEDMAP);
+}
+
+/*
+ * Mark the next sysctl_numa_balancing_scan_size MB of the address space
+ * for hinting faults.  Called on the way back to user space after
+ * task_tick_numa() asked for it; one thread per mm scans per period.
+ */
+void task_numa_work(void)
+{
+	unsigned long migrate, next_scan, now = jiffies;
+	struct task_struct *p = current;
+	struct mm_struct *mm = p->mm;
+	struct vm_area_struct *vma;
+	unsigned long start, end;
+	long pages;
+
+	p->numa_work_pending = 0;
+
+	if (!mm || (p->flags & PF_EXITING))
+		return;
+
+	migrate = mm->numa_next_scan;
+	if (time_before(now, migrate))
+		return;
+
+	next_scan = now + msecs_to_jiffies(p->numa_scan_period);
+	if (cmpxchg(&mm->numa_next_scan, migrate, next_scan) != migrate)
+		return;
+
+	pages = sysctl_numa_balancing_scan_size;
+	pages <<= 20 - PAGE_SHIFT; /* MB in pages */
+	if (!pages)
+		return;
+
+	down_read(&mm->mmap_sem);
+	start = mm->numa_scan_offset;
+	vma = find_vma(mm, start);
+	if (!vma) {
+		reset_ptenuma_scan(mm);
+		start = 0;
+		vma = mm->mmap;
+	}
+	for (; vma; vma = vma->vm_next) {
+		if (!vma_numa_scannable(vma))
+			continue;
+
+		do {
+			start = max(start, vma->vm_start);
+			end = min(vma->vm_end, start + (pages << PAGE_SHIFT));
+			change_prot_numa(vma, start, end);
+			pages -= (end - start) >> PAGE_SHIFT;
+			start = end;
+			if (pages <= 0)
+				goto out;
+		} while (end != vma->vm_end);
+	}
+
+out:
+	/*
+	 * It is possible to reach the end of the VMA list but the last few
+	 * VMAs are not guaranteed to be scannable: restart from the start
+	 * on the next run.
+	 */
+	if (vma)
+		mm->numa_scan_offset = start;
+	else
+		reset_ptenuma_scan(mm);
+	up_read(&mm->mmap_sem);
+}
+
+/*
+ * Drive the scan from task runtime rather than wall time: only tasks
+ * that actually run get scanned, and they need to have done some work
+ * before their placement is worth looking at.
+ */
+static void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+	u64 period, now;
+
+	if (!curr->mm || (curr->flags & PF_EXITING) || curr->numa_work_pending)
+		return;
+
+	if (!numa_balancing_enabled())
+		return;
+
+	now = curr->se.sum_exec_runtime;
+	period = (u64)curr->numa_scan_period * NSEC_PER_MSEC;
+
+	if (now - curr->node_stamp > period) {
+		if (!curr->node_stamp)
+			curr->numa_scan_period =
+				sysctl_numa_balancing_scan_period_min;
+		curr->node_stamp = now;
+
+		if (!time_before(jiffies, curr->mm->numa_next_scan)) {
+			curr->numa_work_pending = 1;
+			set_tsk_thread_flag(curr, TIF_NOTIFY_RESUME);
+		}
+	}
+}
+
+/*
+ * How moving @p from @src_cpu to @dst_cpu changes its NUMA locality:
+ * positive if it leaves its preferred node, negative if it reaches it,
+ * zero if it makes no difference.
+ */
+static int task_numa_locality(struct task_struct *p, int src_cpu, int dst_cpu)
+{
+	int nid = p->numa_preferred_nid;
+	int src_nid, dst_nid;
+
+	if (nid < 0 || !sysctl_numa_balancing)
+		return 0;
+
+	src_nid = cpu_to_node(src_cpu);
+	dst_nid = cpu_to_node(dst_cpu);
+	if (src_nid == dst_nid)
+		return 0;
+	if (src_nid == nid)
+		return 1;
+	if (dst_nid == nid)
+		return -1;
+	return 0;
+}
+
+/*
+ * An idle cpu on the preferred node of @p, if it is waking up elsewhere.
+ */
+static int task_numa_wake_cpu(struct task_struct *p, int prev_cpu)
+{
+	int nid = p->numa_preferred_nid;
+	int cpu;
+
+	if (nid < 0 || !sysctl_numa_balancing || cpu_to_node(prev_cpu) == nid)
+		return -1;
+
+	for_each_cpu_and(cpu, cpumask_of_node(nid), tsk_cpus_allowed(p)) {
+		if (idle_cpu(cpu))
+			return cpu;
+	}
+	return -1;
+}
+#else
+static inline void task_tick_numa(struct rq *rq, struct task_struct *curr)
+{
+}
+
+static inline int task_numa_locality(struct task_struct *p, int src_cpu,
+				     int dst_cpu)
+{
+	return 0;
+}
+
+static inline int task_numa_wake_cpu(struct task_struct *p, int prev_cpu)
+{
+	return -1;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /**************************************************
  * Scheduling class queueing methods:
  */
@@ -1296,13 +1564,16 @@ static inline u64 default_cfs_period(void)
 	return 100000000ULL;
 }
 
-static inline u64 sched_cfs_bandwidth_slice(void)
+static inline u64 sched_cfs_bandwidth_slice(struct cfs_bandwidth *cfs_b)
 {
-	return (u64)sysctl_sched_cfs_bandwidth_slice * NSEC_PER_USEC;
+	return min(cfs_b->slice_max,
+		   (u64)sysctl_sched_cfs_bandwidth_slice * NSEC_PER_USEC);
 }
 
 /*
  * Replenish runtime according to assigned quota and update expiration time.
+ * Runtime left unused in the global pool carries over, up to the group's
+ * burst on top of its quota; using any of it counts as a burst.
  * We use sched_clock_cpu directly instead of rq->clock to avoid adding
  * additional synchronization around rq->lock.
  *
@@ -1310,13 +1581,21 @@ static inline u64 sched_cfs_bandwidth_slice(void)
  */
 static void __refill_cfs_bandwidth_runtime(struct cfs_bandwidth *cfs_b)
 {
+	s64 overrun;
 	u64 now;
 
 	if (cfs_b->quota == RUNTIME_INF)
 		return;
 
 	now = sched_clock_cpu(smp_processor_id());
-	cfs_b->runtime = cfs_b->quota;
+	cfs_b->runtime += cfs_b->quota;
+	overrun = cfs_b->runtime_snap - (s64)cfs_b->runtime;
+	if (overrun > 0) {
+		cfs_b->burst_time += overrun;
+		cfs_b->nr_bursts++;
+	}
+	cfs_b->runtime = min(cfs_b->runtime, cfs_b->quota + cfs_b->burst);
+	cfs_b->runtime_snap = cfs_b->runtime;
 	cfs_b->runtime_expires = now + ktime_to_ns(cfs_b->period);
 }
 
@@ -1328,7 +1607,7 @@ static int assign_cfs_rq_runtime(struct cfs_rq *cfs_rq)
 	u64 amount = 0, min_amount, expires;
 
 	/* note: this is a positive sum as runtime_remaining <= 0 */
-	min_amount = sched_cfs_bandwidth_slice() - cfs_rq->runtime_remaining;
+	min_amount = sched_cfs_bandwidth_slice(cfs_b) - cfs_rq->runtime_remaining;
 
 	raw_spin_lock(&cfs_b->lock);
 	if (cfs_b->quota == RUNTIME_INF)
@@ -1520,8 +1799,10 @@ static void throttle_cfs_rq(struct cfs_rq *cfs_rq)
 			dequeue = 0;
 	}
 
-	if (!se)
+	if (!se) {
+		update_rq_busy(rq);
 		rq->nr_running -= task_delta;
+	}
 
 	cfs_rq->throttled = 1;
 	cfs_rq->throttled_timestamp = rq->clock;
@@ -1539,12 +1820,16 @@ static void unthrottle_cfs_rq(struct cfs_rq *cfs_rq)
 	struct sched_entity *se;
 	int enqueue = 1;
 	long task_delta;
+	u64 throttled;
 
 	se = cfs_rq->tg->se[cpu_of(rq_of(cfs_rq))];
 
 	cfs_rq->throttled = 0;
+	throttled = rq->clock - cfs_rq->throttled_timestamp;
 	raw_spin_lock(&cfs_b->lock);
-	cfs_b->throttled_time += rq->clock - cfs_rq->throttled_timestamp;
+	cfs_b->throttled_time += throttled;
+	cfs_b->throttled_hist[min_t(int, fls(div_u64(throttled, NSEC_PER_MSEC)),
+				    CFS_THROTTLE_HIST - 1)]++;
 	list_del_rcu(&cfs_rq->throttled_list);
 	raw_spin_unlock(&cfs_b->lock);
 	cfs_rq->throttled_timestamp = 0;
@@ -1570,8 +1855,10 @@ static void unthrottle_cfs_rq(struct cfs_rq *cfs_rq)
 			break;
 	}
 
-	if (!se)
+	if (!se) {
+		update_rq_busy(rq);
 		rq->nr_running += task_delta;
+	}
 
 	/* determine whether we need to wake up potentially idle cpu */
 	if (rq->curr == rq->idle && rq->cfs.nr_running)
@@ -1746,7 +2033,7 @@ static void __return_cfs_rq_runtime(struct cfs_rq *cfs_rq)
 		cfs_b->runtime += slack_runtime;
 
 		/* we are under rq->lock, defer unthrottling using a timer */
-		if (cfs_b->runtime > sched_cfs_bandwidth_slice() &&
+		if (cfs_b->runtime > sched_cfs_bandwidth_slice(cfs_b) &&
 		    !list_empty(&cfs_b->throttled_cfs_rq))
 			start_cfs_slack_bandwidth(cfs_b);
 	}
@@ -1770,7 +2057,7 @@ static __always_inline void return_cfs_rq_runtime(struct cfs_rq *cfs_rq)
  */
 static void do_sched_cfs_slack_timer(struct cfs_bandwidth *cfs_b)
 {
-	u64 runtime = 0, slice = sched_cfs_bandwidth_slice();
+	u64 runtime = 0, slice = sched_cfs_bandwidth_slice(cfs_b);
 	u64 expires;
 
 	/* confirm we're still not at a refresh boundary */
@@ -2411,6 +2698,11 @@ select_task_rq_fair(struct task_struct *p, int sd_flag, int wake_flags)
 	int sync = wake_flags & WF_SYNC;
 
 	if (sd_flag & SD_BALANCE_WAKE) {
+		/* Bring a task back to the node its memory is on */
+		new_cpu = task_numa_wake_cpu(p, prev_cpu);
+		if (new_cpu >= 0)
+			return new_cpu;
+
 		if (cpumask_test_cpu(cpu, tsk_cpus_allowed(p)))
 			want_affine = 1;
 		new_cpu = prev_cpu;
@@ -2466,7 +2758,9 @@ select_task_rq_fair(struct task_struct *p, int sd_flag, int wake_flags)
 	}
 
 	if (affine_sd) {
-		if (cpu == prev_cpu || wake_affine(affine_sd, p, sync))
+		if (cpu == prev_cpu ||
+		    (task_numa_locality(p, prev_cpu, cpu) <= 0 &&
+		     wake_affine(affine_sd, p, sync)))
 			prev_cpu = cpu;
 
 		new_cpu = select_idle_sibling(p, prev_cpu);
@@ -2786,6 +3080,7 @@ int can_migrate_task(struct task_struct *p, struct rq *rq, int this_cpu,
 		     int *all_pinned)
 {
 	int tsk_cache_hot = 0;
+	int numa_locality;
 	/*
 	 * We do not migrate tasks that are:
 	 * 1) running (obviously), or
@@ -2807,9 +3102,16 @@ int can_migrate_task(struct task_struct *p, struct rq *rq, int this_cpu,
 	 * Aggressive migration if:
 	 * 1) task is cache cold, or
 	 * 2) too many balance attempts have failed.
+	 *
+	 * NUMA locality counts like cache affinity: moving a task to its
+	 * preferred node is always fine, moving it away is resisted.
 	 */
 
-	tsk_cache_hot = task_hot(p, rq->clock_task, sd);
+	numa_locality = task_numa_locality(p, task_cpu(p), this_cpu);
+	if (numa_locality < 0)
+		return 1;
+
+	tsk_cache_hot = task_hot(p, rq->clock_task, sd) || numa_locality > 0;
 	if (!tsk_cache_hot ||
 		sd->nr_balance_failed > sd->cache_nice_tries) {
 #ifdef CONFIG_SCHEDSTATS
@@ -4876,6 +5178,8 @@ static void task_tick_fair(struct rq *rq, struct task_struct *curr, int queued)
 		cfs_rq = cfs_rq_of(se);
 		entity_tick(cfs_rq, se, queued);
 	}
+
+	task_tick_numa(rq, curr);
 }
 
 /*
@@ -63,8 +63,16 @@ SCHED_FEAT(NONTASK_POWER, 1)
 /*
  * Queue remote wakeups on the target CPU and process them
  * using the scheduler IPI. Reduces rq->lock contention/bounces.
+ * Only used when the target CPU is in another cache domain.
  */
 SCHED_FEAT(TTWU_QUEUE, 1)
 
 SCHED_FEAT(FORCE_SD_OVERLAP, 0)
 SCHED_FEAT(RT_RUNTIME_SHARE, 1)
+
+/*
+ * Instead of pulling RT tasks from overloaded CPUs, taking each of
+ * their rq->locks in turn, send an IPI to those CPUs that have a
+ * task to give and let them push it away themselves.
+ */
+SCHED_FEAT(RT_PUSH_IPI, 1)
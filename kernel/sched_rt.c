@@ -1512,6 +1512,50 @@ static void push_rt_tasks(struct rq *rq)
 		;
 }
 
+/*
+ * Rather than taking the lock of every overloaded runqueue in turn, ask
+ * the CPUs that have a task able to preempt ours to push it away. The
+ * pusher only needs its own lock and the one of the runqueue cpupri
+ * picks for the task.
+ */
+static void tell_cpu_to_push(struct rq *this_rq)
+{
+	int this_cpu = this_rq->cpu, cpu;
+	struct rq *src_rq;
+
+	for_each_cpu(cpu, this_rq->rd->rto_mask) {
+		if (this_cpu == cpu)
+			continue;
+
+		src_rq = cpu_rq(cpu);
+
+		/* Same lockless test as in pull_rt_task() */
+		if (src_rq->rt.highest_prio.next >=
+		    this_rq->rt.highest_prio.curr)
+			continue;
+
+		/* Already asked, one push covers all pullers */
+		if (xchg(&src_rq->rt.push_pending, 1))
+			continue;
+
+		smp_send_reschedule(cpu);
+	}
+}
+
+/*
+ * Called from scheduler_ipi() on a CPU that tell_cpu_to_push() asked to
+ * push its overflow of RT tasks.
+ */
+static void rt_push_ipi(struct rq *rq)
+{
+	raw_spin_lock(&rq->lock);
+	/* Requests made from here on need another IPI */
+	rq->rt.push_pending = 0;
+	if (has_pushable_tasks(rq))
+		push_rt_tasks(rq);
+	raw_spin_unlock(&rq->lock);
+}
+
 static int pull_rt_task(struct rq *this_rq)
 {
 	int this_cpu = this_rq->cpu, ret = 0, cpu;
@@ -1521,6 +1565,11 @@ static int pull_rt_task(struct rq *this_rq)
 	if (likely(!rt_overloaded(this_rq)))
 		return 0;
 
+	if (sched_feat(RT_PUSH_IPI)) {
+		tell_cpu_to_push(this_rq);
+		return 0;
+	}
+
 	for_each_cpu(cpu, this_rq->rd->rto_mask) {
 		if (this_cpu == cpu)
 			continue;
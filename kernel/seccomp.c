@@ -39,8 +39,7 @@
  *         outside of a lifetime-guarded section.  In general, this
  *         is only needed for handling filters shared across tasks.
  * @prev: points to a previously installed, or inherited, filter
- * @len: the number of instructions in the program
- * @insns: the BPF program instructions to evaluate
+ * @prog: the BPF program to evaluate, JIT compiled when possible
  *
  * seccomp_filter objects are organized in a tree linked via the @prev
  * pointer.  For any task, it appears to be a singly-linked list starting
@@ -55,8 +54,7 @@
 struct seccomp_filter {
 	atomic_t usage;
 	struct seccomp_filter *prev;
-	unsigned short len;  /* Instruction count */
-	struct sock_filter insns[];
+	struct sk_filter *prog;
 };
 
 /* Limit any path through the tree to 256KB worth of instructions. */
@@ -208,13 +206,20 @@ static u32 seccomp_run_filters(int syscall)
 	 * BPF return value (ignoring the DATA) always takes priority.
 	 */
 	for (f = current->seccomp.filter; f; f = f->prev) {
-		u32 cur_ret = sk_run_filter(NULL, f->insns);
+		u32 cur_ret = SK_RUN_FILTER(f->prog, NULL);
 		if ((cur_ret & SECCOMP_RET_ACTION) < (ret & SECCOMP_RET_ACTION))
 			ret = cur_ret;
 	}
 	return ret;
 }
 
+static void seccomp_filter_free(struct seccomp_filter *filter)
+{
+	bpf_jit_free(filter->prog);
+	kfree(filter->prog);
+	kfree(filter);
+}
+
 /**
  * seccomp_attach_filter: Attaches a seccomp filter to current.
  * @fprog: BPF program to install
@@ -232,7 +237,7 @@ static long seccomp_attach_filter(struct sock_fprog *fprog)
 		return -EINVAL;
 
 	for (filter = current->seccomp.filter; filter; filter = filter->prev)
-		total_insns += filter->len + 4;  /* include a 4 instr penalty */
+		total_insns += filter->prog->len + 4;  /* include a 4 instr penalty */
 	if (total_insns > MAX_INSNS_PER_PATH)
 		return -ENOMEM;
 
@@ -248,27 +253,36 @@ static long seccomp_attach_filter(struct sock_fprog *fprog)
 		return -EACCES;
 
 	/* Allocate a new seccomp_filter */
-	filter = kzalloc(sizeof(struct seccomp_filter) + fp_size, GFP_KERNEL);
+	filter = kzalloc(sizeof(struct seccomp_filter), GFP_KERNEL);
 	if (!filter)
 		return -ENOMEM;
+	filter->prog = kzalloc(sizeof(struct sk_filter) + fp_size, GFP_KERNEL);
+	if (!filter->prog) {
+		kfree(filter);
+		return -ENOMEM;
+	}
 	atomic_set(&filter->usage, 1);
-	filter->len = fprog->len;
+	atomic_set(&filter->prog->refcnt, 1);
+	filter->prog->len = fprog->len;
+	filter->prog->bpf_func = sk_run_filter;
 
 	/* Copy the instructions from fprog. */
 	ret = -EFAULT;
-	if (copy_from_user(filter->insns, fprog->filter, fp_size))
+	if (copy_from_user(filter->prog->insns, fprog->filter, fp_size))
 		goto fail;
 
 	/* Check and rewrite the fprog via the skb checker */
-	ret = sk_chk_filter(filter->insns, filter->len);
+	ret = sk_chk_filter(filter->prog->insns, filter->prog->len);
 	if (ret)
 		goto fail;
 
 	/* Check and rewrite the fprog for seccomp use */
-	ret = seccomp_chk_filter(filter->insns, filter->len);
+	ret = seccomp_chk_filter(filter->prog->insns, filter->prog->len);
 	if (ret)
 		goto fail;
 
+	bpf_jit_compile(filter->prog);
+
 	/*
 	 * If there is an existing filter, make it the prev and don't drop its
 	 * task reference.
@@ -277,7 +291,7 @@ static long seccomp_attach_filter(struct sock_fprog *fprog)
 	current->seccomp.filter = filter;
 	return 0;
 fail:
-	kfree(filter);
+	seccomp_filter_free(filter);
 	return ret;
 }
 
@@ -326,7 +340,7 @@ void put_seccomp_filter(struct task_struct *tsk)
 	while (orig && atomic_dec_and_test(&orig->usage)) {
 		struct seccomp_filter *freeme = orig;
 		orig = orig->prev;
-		kfree(freeme);
+		seccomp_filter_free(freeme);
 	}
 }
 
@@ -24,6 +24,7 @@
 #include <linux/ftrace.h>
 #include <linux/smp.h>
 #include <linux/tick.h>
+#include <linux/moduleparam.h>
 
 #define CREATE_TRACE_POINTS
 #include <trace/events/irq.h>
@@ -61,6 +62,81 @@ char *softirq_to_name[NR_SOFTIRQS] = {
 	"TASKLET", "SCHED", "HRTIMER", "RCU"
 };
 
+#ifdef CONFIG_SOFTIRQ_THREADS
+/*
+ * With "threadsoftirqs" on the command line, every softirq vector is
+ * served by its own per-cpu thread instead of irq exit and ksoftirqd.
+ * Pending vectors are handed over from local_softirq_pending() to
+ * softirq_thread_pending and the threads run at the SCHED_FIFO
+ * priorities below, so e.g. timer work is picked up as soon as the
+ * NET_RX action in progress returns instead of after all vectors.
+ * The priorities can be set with softirq.thread_prio= on the command
+ * line, 0 meaning SCHED_NORMAL, and changed later with chrt.
+ */
+__read_mostly bool softirq_threads;
+
+static int __init setup_softirq_threads(char *arg)
+{
+	softirq_threads = true;
+	return 0;
+}
+early_param("threadsoftirqs", setup_softirq_threads);
+
+static int softirq_thread_prio[NR_SOFTIRQS] = {
+	[HI_SOFTIRQ]		= 45,
+	[TIMER_SOFTIRQ]		= 48,
+	[NET_TX_SOFTIRQ]	= 41,
+	[NET_RX_SOFTIRQ]	= 40,
+	[BLOCK_SOFTIRQ]		= 43,
+	[BLOCK_IOPOLL_SOFTIRQ]	= 42,
+	[TASKLET_SOFTIRQ]	= 44,
+	[SCHED_SOFTIRQ]		= 46,
+	[HRTIMER_SOFTIRQ]	= 49,
+	[RCU_SOFTIRQ]		= 47,
+};
+module_param_array_named(thread_prio, softirq_thread_prio, int, NULL, 0444);
+
+static const char * const softirq_thread_name[NR_SOFTIRQS] = {
+	"hi", "timer", "net-tx", "net-rx", "block", "blk-iopoll",
+	"tasklet", "sched", "hrtimer", "rcu"
+};
+
+struct softirq_thread {
+	struct task_struct	*tsk;
+	unsigned int		cpu;
+	unsigned int		nr;
+};
+
+static DEFINE_PER_CPU(struct softirq_thread [NR_SOFTIRQS], softirq_thread);
+static DEFINE_PER_CPU(__u32, softirq_thread_pending);
+
+/*
+ * Hand the pending vectors over to their threads.  Must be called
+ * with interrupts disabled.  Returns %false if this cpu has no
+ * threads yet, in which case softirqs are processed as usual.
+ */
+static bool softirq_threads_kick(void)
+{
+	struct softirq_thread *st = __get_cpu_var(softirq_thread);
+	__u32 pending;
+
+	if (!st->tsk)
+		return false;
+
+	pending = local_softirq_pending();
+	set_softirq_pending(0);
+	__this_cpu_or(softirq_thread_pending, pending);
+
+	for (; pending; pending >>= 1, st++) {
+		if ((pending & 1) && st->tsk && st->tsk->state != TASK_RUNNING)
+			wake_up_process(st->tsk);
+	}
+	return true;
+}
+#else
+static inline bool softirq_threads_kick(void) { return false; }
+#endif /* CONFIG_SOFTIRQ_THREADS */
+
 /*
  * we cannot loop indefinitely here to avoid userspace starvation,
  * but we also don't want to introduce a worst case 1/HZ latency
@@ -72,6 +148,9 @@ static void wakeup_softirqd(void)
 	/* Interrupts are disabled: no need to stop preemption */
 	struct task_struct *tsk = __this_cpu_read(ksoftirqd);
 
+	if (softirq_threads && softirq_threads_kick())
+		return;
+
 	if (tsk && tsk->state != TASK_RUNNING)
 		wake_up_process(tsk);
 }
@@ -204,6 +283,28 @@ EXPORT_SYMBOL(local_bh_enable_ip);
  */
 #define MAX_SOFTIRQ_RESTART 10
 
+static inline void handle_softirq(struct softirq_action *h, int cpu)
+{
+	unsigned int vec_nr = h - softirq_vec;
+	int prev_count = preempt_count();
+
+	kstat_incr_softirqs_this_cpu(vec_nr);
+
+	trace_softirq_entry(vec_nr);
+	h->action(h);
+	trace_softirq_exit(vec_nr);
+	if (unlikely(prev_count != preempt_count())) {
+		printk(KERN_ERR "huh, entered softirq %u %s %p"
+		       "with preempt_count %08x,"
+		       " exited with %08x?\n", vec_nr,
+		       softirq_to_name[vec_nr], h->action,
+		       prev_count, preempt_count());
+		preempt_count() = prev_count;
+	}
+
+	rcu_bh_qs(cpu);
+}
+
 asmlinkage void __do_softirq(void)
 {
 	struct softirq_action *h;
@@ -211,6 +312,10 @@ asmlinkage void __do_softirq(void)
 	int max_restart = MAX_SOFTIRQ_RESTART;
 	int cpu;
 
+	/* the softirq threads do the work */
+	if (softirq_threads && softirq_threads_kick())
+		return;
+
 	pending = local_softirq_pending();
 	account_system_vtime(current);
 
@@ -228,26 +333,8 @@ restart:
 	h = softirq_vec;
 
 	do {
-		if (pending & 1) {
-			unsigned int vec_nr = h - softirq_vec;
-			int prev_count = preempt_count();
-
-			kstat_incr_softirqs_this_cpu(vec_nr);
-
-			trace_softirq_entry(vec_nr);
-			h->action(h);
-			trace_softirq_exit(vec_nr);
-			if (unlikely(prev_count != preempt_count())) {
-				printk(KERN_ERR "huh, entered softirq %u %s %p"
-				       "with preempt_count %08x,"
-				       " exited with %08x?\n", vec_nr,
-				       softirq_to_name[vec_nr], h->action,
-				       prev_count, preempt_count());
-				preempt_count() = prev_count;
-			}
-
-			rcu_bh_qs(cpu);
-		}
+		if (pending & 1)
+			handle_softirq(h, cpu);
 		h++;
 		pending >>= 1;
 	} while (pending);
@@ -784,6 +871,147 @@ wait_to_die:
 	return 0;
 }
 
+#ifdef CONFIG_SOFTIRQ_THREADS
+/*
+ * Run the action of @st's vector once.  Called with interrupts and
+ * preemption disabled, like __do_softirq() but for a single vector.
+ * Whatever the action raised again goes back to the threads.
+ */
+static void softirq_thread_handle(struct softirq_thread *st)
+{
+	__this_cpu_and(softirq_thread_pending, ~(1U << st->nr));
+	account_system_vtime(current);
+
+	__local_bh_disable((unsigned long)__builtin_return_address(0),
+				SOFTIRQ_OFFSET);
+	lockdep_softirq_enter();
+	local_irq_enable();
+
+	handle_softirq(softirq_vec + st->nr, st->cpu);
+
+	local_irq_disable();
+	if (local_softirq_pending())
+		softirq_threads_kick();
+	lockdep_softirq_exit();
+
+	account_system_vtime(current);
+	__local_bh_enable(SOFTIRQ_OFFSET);
+}
+
+static int run_softirq_thread(void *data)
+{
+	struct softirq_thread *st = data;
+	__u32 mask = 1U << st->nr;
+
+	set_current_state(TASK_INTERRUPTIBLE);
+
+	while (!kthread_should_stop()) {
+		preempt_disable();
+		if (!(__this_cpu_read(softirq_thread_pending) & mask)) {
+			preempt_enable_no_resched();
+			schedule();
+			preempt_disable();
+		}
+
+		__set_current_state(TASK_RUNNING);
+
+		while (__this_cpu_read(softirq_thread_pending) & mask) {
+			/* see run_ksoftirqd() */
+			if (cpu_is_offline(st->cpu))
+				goto wait_to_die;
+			local_irq_disable();
+			if (__this_cpu_read(softirq_thread_pending) & mask)
+				softirq_thread_handle(st);
+			local_irq_enable();
+			/* let a higher priority vector in */
+			preempt_enable_no_resched();
+			cond_resched();
+			preempt_disable();
+			rcu_note_context_switch(st->cpu);
+		}
+		preempt_enable();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+
+wait_to_die:
+	preempt_enable();
+	/* Wait for kthread_stop */
+	set_current_state(TASK_INTERRUPTIBLE);
+	while (!kthread_should_stop()) {
+		schedule();
+		set_current_state(TASK_INTERRUPTIBLE);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static void __cpuinit stop_softirq_threads(int cpu, bool unbind)
+{
+	struct softirq_thread *st = per_cpu(softirq_thread, cpu);
+	int nr;
+
+	for (nr = 0; nr < NR_SOFTIRQS; nr++, st++) {
+		struct task_struct *p = st->tsk;
+
+		if (!p)
+			continue;
+		/* never woken up, unbind so it can run */
+		if (unbind)
+			kthread_bind(p, cpumask_any(cpu_online_mask));
+		st->tsk = NULL;
+		kthread_stop(p);
+	}
+	per_cpu(softirq_thread_pending, cpu) = 0;
+}
+
+static int __cpuinit create_softirq_threads(int cpu)
+{
+	struct softirq_thread *st = per_cpu(softirq_thread, cpu);
+	int nr;
+
+	for (nr = 0; nr < NR_SOFTIRQS; nr++, st++) {
+		struct sched_param param = {
+			.sched_priority = softirq_thread_prio[nr]
+		};
+		struct task_struct *p;
+
+		st->cpu = cpu;
+		st->nr = nr;
+		p = kthread_create_on_node(run_softirq_thread, st,
+					   cpu_to_node(cpu), "sirq-%s/%d",
+					   softirq_thread_name[nr], cpu);
+		if (IS_ERR(p)) {
+			printk("sirq-%s for %i failed\n",
+			       softirq_thread_name[nr], cpu);
+			stop_softirq_threads(cpu, true);
+			return PTR_ERR(p);
+		}
+		kthread_bind(p, cpu);
+		if (param.sched_priority > 0 &&
+		    param.sched_priority < MAX_USER_RT_PRIO)
+			sched_setscheduler_nocheck(p, SCHED_FIFO, &param);
+		st->tsk = p;
+	}
+	return 0;
+}
+
+static void __cpuinit wake_softirq_threads(int cpu)
+{
+	struct softirq_thread *st = per_cpu(softirq_thread, cpu);
+	int nr;
+
+	for (nr = 0; nr < NR_SOFTIRQS; nr++, st++)
+		if (st->tsk)
+			wake_up_process(st->tsk);
+}
+#else
+static inline int create_softirq_threads(int cpu) { return 0; }
+static inline void wake_softirq_threads(int cpu) { }
+static inline void stop_softirq_threads(int cpu, bool unbind) { }
+#endif /* CONFIG_SOFTIRQ_THREADS */
+
 #ifdef CONFIG_HOTPLUG_CPU
 /*
  * tasklet_kill_immediate is called to remove a tasklet which can already be
@@ -863,14 +1091,22 @@ static int __cpuinit cpu_callback(struct notifier_block *nfb,
 		}
 		kthread_bind(p, hotcpu);
   		per_cpu(ksoftirqd, hotcpu) = p;
+		if (softirq_threads) {
+			int err = create_softirq_threads(hotcpu);
+
+			if (err)
+				return notifier_from_errno(err);
+		}
  		break;
 	case CPU_ONLINE:
 	case CPU_ONLINE_FROZEN:
 		wake_up_process(per_cpu(ksoftirqd, hotcpu));
+		wake_softirq_threads(hotcpu);
 		break;
 #ifdef CONFIG_HOTPLUG_CPU
 	case CPU_UP_CANCELED:
 	case CPU_UP_CANCELED_FROZEN:
+		stop_softirq_threads(hotcpu, true);
 		if (!per_cpu(ksoftirqd, hotcpu))
 			break;
 		/* Unbind so it can run.  Fall thru. */
@@ -886,6 +1122,7 @@ static int __cpuinit cpu_callback(struct notifier_block *nfb,
 		per_cpu(ksoftirqd, hotcpu) = NULL;
 		sched_setscheduler_nocheck(p, SCHED_FIFO, &param);
 		kthread_stop(p);
+		stop_softirq_threads(hotcpu, false);
 		takeover_tasklets(hotcpu);
 		break;
 	}
@@ -1886,6 +1886,21 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 			if (arg2 || arg3 || arg4 || arg5)
 				return -EINVAL;
 			return current->no_new_privs ? 1 : 0;
+		case PR_SET_FORK_SHARE_PTE:
+			if (!IS_ENABLED(CONFIG_FORK_SHARE_PTE))
+				return -EINVAL;
+			if (arg2 > 1 || arg3 || arg4 || arg5)
+				return -EINVAL;
+			if (arg2)
+				set_bit(MMF_FORK_SHARE_PTE, &me->mm->flags);
+			else
+				clear_bit(MMF_FORK_SHARE_PTE, &me->mm->flags);
+			error = 0;
+			break;
+		case PR_GET_FORK_SHARE_PTE:
+			if (arg2 || arg3 || arg4 || arg5)
+				return -EINVAL;
+			return test_bit(MMF_FORK_SHARE_PTE, &me->mm->flags);
 		default:
 			error = -EINVAL;
 			break;
@@ -30,6 +30,7 @@
 #include <linux/sched.h> /* for spin_unlock_irq() using preempt_count() m68k */
 #include <linux/tick.h>
 #include <linux/kthread.h>
+#include <linux/ratelimit.h>
 
 void timecounter_init(struct timecounter *tc,
 		      const struct cyclecounter *cc,
@@ -197,6 +198,13 @@ static void __clocksource_change_rating(struct clocksource *cs, int rating);
 #define WATCHDOG_INTERVAL (HZ >> 1)
 #define WATCHDOG_THRESHOLD (NSEC_PER_SEC >> 4)
 
+/*
+ * Longest the two watchdog reads around a clocksource read may be
+ * apart before the sample is retried, e.g. because of an SMI.
+ */
+#define WATCHDOG_MAX_SKEW (100 * NSEC_PER_USEC)
+#define WATCHDOG_MAX_RETRIES 3
+
 static void clocksource_watchdog_work(struct work_struct *work)
 {
 	/*
@@ -243,6 +251,37 @@ void clocksource_mark_unstable(struct clocksource *cs)
 	spin_unlock_irqrestore(&watchdog_lock, flags);
 }
 
+/*
+ * Read the clocksource between two reads of the watchdog. A sample
+ * that took too long is retried, as comparing it would blame the
+ * clocksource for the delay; returns false if no good sample was got.
+ */
+static bool clocksource_watchdog_read(struct clocksource *cs,
+				      cycle_t *csnow, cycle_t *wdnow)
+{
+	cycle_t wdend;
+	int64_t wd_delay;
+	int retries;
+
+	for (retries = 0; retries < WATCHDOG_MAX_RETRIES; retries++) {
+		local_irq_disable();
+		*wdnow = watchdog->read(watchdog);
+		*csnow = cs->read(cs);
+		wdend = watchdog->read(watchdog);
+		local_irq_enable();
+
+		wd_delay = clocksource_cyc2ns((wdend - *wdnow) & watchdog->mask,
+					      watchdog->mult, watchdog->shift);
+		if (wd_delay <= WATCHDOG_MAX_SKEW)
+			return true;
+	}
+
+	printk_ratelimited(KERN_WARNING "Clocksource %s: watchdog %s read "
+			   "delayed by %Ld ns, skipping check\n",
+			   cs->name, watchdog->name, wd_delay);
+	return false;
+}
+
 static void clocksource_watchdog(unsigned long data)
 {
 	struct clocksource *cs;
@@ -265,10 +304,8 @@ static void clocksource_watchdog(unsigned long data)
 			continue;
 		}
 
-		local_irq_disable();
-		csnow = cs->read(cs);
-		wdnow = watchdog->read(watchdog);
-		local_irq_enable();
+		if (!clocksource_watchdog_read(cs, &csnow, &wdnow))
+			continue;
 
 		/* Clocksource initialized ? */
 		if (!(cs->flags & CLOCK_SOURCE_WATCHDOG) ||
@@ -880,6 +917,38 @@ sysfs_show_available_clocksources(struct sys_device *dev,
 	return count;
 }
 
+/**
+ * sysfs_show_unstable_clocksources - sysfs interface for unstable clocksources
+ * @dev:	unused
+ * @attr:	unused
+ * @buf:	char buffer to be filled with clocksource list
+ *
+ * Provides sysfs interface for listing clocksources which were rejected
+ * by the watchdog or marked unstable by their driver
+ */
+static ssize_t
+sysfs_show_unstable_clocksources(struct sys_device *dev,
+				 struct sysdev_attribute *attr,
+				 char *buf)
+{
+	struct clocksource *src;
+	ssize_t count = 0;
+
+	mutex_lock(&clocksource_mutex);
+	list_for_each_entry(src, &clocksource_list, list) {
+		if (src->flags & CLOCK_SOURCE_UNSTABLE)
+			count += snprintf(buf + count,
+				  max((ssize_t)PAGE_SIZE - count, (ssize_t)0),
+				  "%s ", src->name);
+	}
+	mutex_unlock(&clocksource_mutex);
+
+	count += snprintf(buf + count,
+			  max((ssize_t)PAGE_SIZE - count, (ssize_t)0), "\n");
+
+	return count;
+}
+
 /*
  * Sysfs setup bits:
  */
@@ -889,6 +958,9 @@ static SYSDEV_ATTR(current_clocksource, 0644, sysfs_show_current_clocksources,
 static SYSDEV_ATTR(available_clocksource, 0444,
 		   sysfs_show_available_clocksources, NULL);
 
+static SYSDEV_ATTR(unstable_clocksource, 0444,
+		   sysfs_show_unstable_clocksources, NULL);
+
 static struct sysdev_class clocksource_sysclass = {
 	.name = "clocksource",
 };
@@ -912,6 +984,10 @@ static int __init init_clocksource_sysfs(void)
 		error = sysdev_create_file(
 				&device_clocksource,
 				&attr_available_clocksource);
+	if (!error)
+		error = sysdev_create_file(
+				&device_clocksource,
+				&attr_unstable_clocksource);
 	return error;
 }
 
@@ -123,6 +123,97 @@ static int __init setup_tick_nohz(char *str)
 
 __setup("nohz=", setup_tick_nohz);
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Set when at least one CPU is isolated. The CPU which has the do_timer
+ * duty then keeps its tick, so jiffies stay fresh while the isolated
+ * CPUs defer theirs.
+ */
+static bool tick_nohz_full_running __read_mostly;
+
+static int __init tick_nohz_full_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (sched_cpu_isolated(cpu)) {
+			tick_nohz_full_running = true;
+			break;
+		}
+	}
+	return 0;
+}
+core_initcall(tick_nohz_full_init);
+
+static inline bool tick_nohz_full_keep_tick(int cpu)
+{
+	return tick_nohz_full_running && cpu == tick_do_timer_cpu;
+}
+
+/*
+ * Bring a deferred busy tick back to the next jiffy boundary. The timer
+ * expiry stays on the tick grid. Interrupts are disabled and we might
+ * hold the runqueue lock, so the timer must not raise the softirq.
+ */
+static void tick_nohz_full_restart(struct tick_sched *ts)
+{
+	ktime_t now = ktime_get();
+	ktime_t expires = hrtimer_get_expires(&ts->sched_timer);
+	s64 delta = ktime_to_ns(ktime_sub(expires, now));
+	s64 incr = ktime_to_ns(tick_period);
+
+	ts->full_stretched = 0;
+	if (delta > incr)
+		expires = ktime_sub_ns(expires, incr * div_s64(delta - 1, incr));
+
+	__hrtimer_start_range_ns(&ts->sched_timer, expires, 0,
+				 HRTIMER_MODE_ABS_PINNED, 0);
+}
+
+/**
+ * tick_nohz_full_kick_cpu - a second task became runnable on @cpu
+ *
+ * Called with the runqueue lock of @cpu held. A deferred busy tick has to
+ * come back, otherwise the new task would wait for the current one to
+ * block.
+ */
+void tick_nohz_full_kick_cpu(int cpu)
+{
+	struct tick_sched *ts = &per_cpu(tick_cpu_sched, cpu);
+
+	/* Pairs with the barrier in tick_nohz_full_defer() */
+	smp_mb();
+	if (!ts->full_stretched)
+		return;
+
+	if (cpu == smp_processor_id())
+		tick_nohz_full_restart(ts);
+	else
+		smp_send_reschedule(cpu);
+}
+
+/*
+ * Called from the reschedule IPI with interrupts disabled.
+ */
+void tick_nohz_full_check(void)
+{
+	struct tick_sched *ts = &__get_cpu_var(tick_cpu_sched);
+
+	if (ts->full_stretched && !sched_can_stop_tick())
+		tick_nohz_full_restart(ts);
+}
+
+static void tick_nohz_full_enter_idle(struct tick_sched *ts)
+{
+	if (ts->full_stretched)
+		tick_nohz_full_restart(ts);
+	ts->full_jiffies = 0;
+}
+#else
+static inline bool tick_nohz_full_keep_tick(int cpu) { return false; }
+static inline void tick_nohz_full_enter_idle(struct tick_sched *ts) { }
+#endif /* CONFIG_NO_HZ_FULL */
+
 /**
  * tick_nohz_update_jiffies - update jiffies when idle was interrupted
  *
@@ -310,6 +401,7 @@ void tick_nohz_stop_sched_tick(int inidle)
 	 * update of the idle time accounting in tick_nohz_start_idle().
 	 */
 	ts->inidle = 1;
+	tick_nohz_full_enter_idle(ts);
 
 	now = tick_nohz_start_idle(cpu, ts);
 
@@ -354,7 +446,7 @@ void tick_nohz_stop_sched_tick(int inidle)
 	} while (read_seqretry(&xtime_lock, seq));
 
 	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu) ||
-	    arch_needs_cpu(cpu)) {
+	    arch_needs_cpu(cpu) || tick_nohz_full_keep_tick(cpu)) {
 		next_jiffies = last_jiffies + 1;
 		delta_jiffies = 1;
 	} else {
@@ -737,6 +829,82 @@ void tick_check_idle(int cpu)
  * High resolution timer specific code
  */
 #ifdef CONFIG_HIGH_RES_TIMERS
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Number of jiffies the busy tick of an isolated CPU can be deferred by:
+ * until the next timer wheel event, at most one second. Returns 1 when
+ * the tick has to run at the next jiffy.
+ */
+static unsigned long tick_nohz_full_defer(struct tick_sched *ts, int cpu)
+{
+	unsigned long last_jiffies, delta_jiffies;
+
+	if (!tick_nohz_full_running || ts->inidle || ts->tick_stopped)
+		return 1;
+
+	/* Somebody else has to keep jiffies up to date */
+	if (cpu == tick_do_timer_cpu || tick_do_timer_cpu == TICK_DO_TIMER_NONE)
+		return 1;
+
+	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu) || arch_needs_cpu(cpu))
+		return 1;
+
+	last_jiffies = jiffies;
+	delta_jiffies = get_next_timer_interrupt(last_jiffies) - last_jiffies;
+	if ((long)delta_jiffies <= 1)
+		return 1;
+
+	/*
+	 * Publish the deferral before looking at the runqueue, pairs with
+	 * the barrier in tick_nohz_full_kick_cpu(): either the enqueue of a
+	 * second task sees full_stretched or we see the second task.
+	 */
+	ts->full_stretched = 1;
+	smp_mb();
+	if (!sched_can_stop_tick()) {
+		ts->full_stretched = 0;
+		return 1;
+	}
+
+	ts->full_jiffies = last_jiffies;
+	return min_t(unsigned long, delta_jiffies, HZ);
+}
+
+/*
+ * Account the jiffies which passed without a tick to the running task.
+ * The current tick is accounted by update_process_times().
+ */
+static void tick_nohz_full_account(struct tick_sched *ts, int user_tick)
+{
+	unsigned long ticks;
+
+	if (!ts->full_jiffies)
+		return;
+
+	ticks = jiffies - ts->full_jiffies;
+	ts->full_jiffies = 0;
+	while (ticks-- > 1)
+		account_process_tick(current, user_tick);
+}
+
+static ktime_t tick_nohz_full_period(struct tick_sched *ts, int cpu)
+{
+	unsigned long ticks = tick_nohz_full_defer(ts, cpu);
+
+	if (ticks == 1)
+		return tick_period;
+	return ktime_set(0, ktime_to_ns(tick_period) * ticks);
+}
+#else
+static inline void tick_nohz_full_account(struct tick_sched *ts,
+					  int user_tick) { }
+
+static inline ktime_t tick_nohz_full_period(struct tick_sched *ts, int cpu)
+{
+	return tick_period;
+}
+#endif /* CONFIG_NO_HZ_FULL */
+
 /*
  * We rearm the timer until we get disabled by the idle code.
  * Called with interrupts disabled and timer->base->cpu_base->lock held.
@@ -760,6 +928,9 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	if (unlikely(tick_do_timer_cpu == TICK_DO_TIMER_NONE))
 		tick_do_timer_cpu = cpu;
 #endif
+#ifdef CONFIG_NO_HZ_FULL
+	ts->full_stretched = 0;
+#endif
 
 	/* Check, if the jiffies need an update */
 	if (tick_do_timer_cpu == cpu)
@@ -782,11 +953,12 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 			touch_softlockup_watchdog();
 			ts->idle_jiffies++;
 		}
+		tick_nohz_full_account(ts, user_mode(regs));
 		update_process_times(user_mode(regs));
 		profile_tick(CPU_PROFILING);
 	}
 
-	hrtimer_forward(timer, now, tick_period);
+	hrtimer_forward(timer, now, tick_nohz_full_period(ts, cpu));
 
 	return HRTIMER_RESTART;
 }
@@ -1203,6 +1203,16 @@ struct timespec __current_kernel_time(void)
 	return xtime;
 }
 
+struct timespec __current_raw_time(void)
+{
+	return raw_time;
+}
+
+struct timespec __current_sleep_time(void)
+{
+	return total_sleep_time;
+}
+
 struct timespec current_kernel_time(void)
 {
 	struct timespec now;
@@ -78,6 +78,8 @@ struct tvec_base {
 	struct timer_list *running_timer;
 	unsigned long timer_jiffies;
 	unsigned long next_timer;
+	/* tv1 slots which may hold timers, cleared lazily on expiry */
+	DECLARE_BITMAP(tv1_pending, TVR_SIZE);
 	struct tvec_root tv1;
 	struct tvec tv2;
 	struct tvec tv3;
@@ -342,6 +344,7 @@ static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 	if (idx < TVR_SIZE) {
 		int i = expires & TVR_MASK;
 		vec = base->tv1.vec + i;
+		__set_bit(i, base->tv1_pending);
 	} else if (idx < 1 << (TVR_BITS + TVN_BITS)) {
 		int i = (expires >> TVR_BITS) & TVN_MASK;
 		vec = base->tv2.vec + i;
@@ -356,7 +359,9 @@ static void internal_add_timer(struct tvec_base *base, struct timer_list *timer)
 		 * Can happen if you add a timer with expires == jiffies,
 		 * or you set a timer to go off in the past
 		 */
-		vec = base->tv1.vec + (base->timer_jiffies & TVR_MASK);
+		int i = base->timer_jiffies & TVR_MASK;
+		vec = base->tv1.vec + i;
+		__set_bit(i, base->tv1_pending);
 	} else {
 		int i;
 		/* If the timeout is larger than MAX_TVAL (on 64-bit
@@ -686,7 +691,8 @@ __mod_timer(struct timer_list *timer, unsigned long expires,
 	cpu = smp_processor_id();
 
 #if defined(CONFIG_NO_HZ) && defined(CONFIG_SMP)
-	if (!pinned && get_sysctl_timer_migration() && idle_cpu(cpu))
+	if (!pinned && get_sysctl_timer_migration() &&
+	    nohz_timer_should_migrate(cpu))
 		cpu = get_nohz_timer_target();
 #endif
 	new_base = per_cpu(tvec_bases, cpu);
@@ -1111,6 +1117,21 @@ static inline void __run_timers(struct tvec_base *base)
 				(!cascade(base, &base->tv3, INDEX(1))) &&
 					!cascade(base, &base->tv4, INDEX(2)))
 			cascade(base, &base->tv5, INDEX(3));
+
+		/*
+		 * Skip empty tv1 slots in one go, but no further than
+		 * the next cascade or the current jiffy.
+		 */
+		if (!test_bit(index, base->tv1_pending)) {
+			unsigned long skip;
+
+			skip = find_next_bit(base->tv1_pending, TVR_SIZE, index);
+			skip = min(skip - index, jiffies - base->timer_jiffies + 1);
+			base->timer_jiffies += skip;
+			continue;
+		}
+		__clear_bit(index, base->tv1_pending);
+
 		++base->timer_jiffies;
 		list_replace_init(base->tv1.vec + index, &work_list);
 		while (!list_empty(head)) {
@@ -1318,13 +1339,36 @@ static void run_timer_softirq(struct softirq_action *h)
 		__run_timers(base);
 }
 
+/*
+ * Whether the timer softirq has anything to do: a tv1 slot to run up
+ * to the current jiffy, a cascade, or hrtimers still checking for the
+ * switch to highres mode.  Lockless, a timer queued here from another
+ * cpu meanwhile is run on the next tick.
+ */
+static bool timer_softirq_due(struct tvec_base *base)
+{
+	unsigned long timer_jiffies = ACCESS_ONCE(base->timer_jiffies);
+	unsigned long index = timer_jiffies & TVR_MASK;
+	unsigned long ticks = jiffies - timer_jiffies;
+
+	if (hrtimer_run_pending_needed())
+		return true;
+	if (time_before(jiffies, timer_jiffies))
+		return false;
+	if (ticks >= TVR_SIZE - index)
+		return true;
+	return find_next_bit(base->tv1_pending, TVR_SIZE, index) <=
+		index + ticks;
+}
+
 /*
  * Called by the local, per-CPU timer interrupt on SMP.
  */
 void run_local_timers(void)
 {
 	hrtimer_run_queues();
-	raise_softirq(TIMER_SOFTIRQ);
+	if (timer_softirq_due(__this_cpu_read(tvec_bases)))
+		raise_softirq(TIMER_SOFTIRQ);
 }
 
 #ifdef __ARCH_WANT_SYS_ALARM
@@ -1647,6 +1691,7 @@ static int __cpuinit init_timers_cpu(int cpu)
 	}
 	for (j = 0; j < TVR_SIZE; j++)
 		INIT_LIST_HEAD(base->tv1.vec + j);
+	bitmap_zero(base->tv1_pending, TVR_SIZE);
 
 	base->timer_jiffies = jiffies;
 	base->next_timer = base->timer_jiffies;
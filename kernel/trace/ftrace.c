@@ -26,6 +26,7 @@
 #include <linux/ftrace.h>
 #include <linux/sysctl.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <linux/ctype.h>
 #include <linux/list.h>
 #include <linux/hash.h>
@@ -3105,7 +3106,26 @@ __setup("ftrace_filter=", set_ftrace_filter);
 
 #ifdef CONFIG_FUNCTION_GRAPH_TRACER
 static char ftrace_graph_buf[FTRACE_FILTER_SIZE] __initdata;
-static int ftrace_set_func(unsigned long *array, int *idx, char *buffer);
+static char ftrace_graph_notrace_buf[FTRACE_FILTER_SIZE] __initdata;
+
+/*
+ * set_graph_function and set_graph_notrace.  The hashes are looked up
+ * on every traced function entry, so they are replaced under RCU rather
+ * than changed in place; graph_lock serializes the writers.
+ */
+struct ftrace_graph_filter {
+	struct ftrace_hash __rcu	*hash;
+	int				*enabled;
+	const char			*all;	/* shown when empty */
+};
+
+static struct ftrace_graph_filter ftrace_graph_filter;
+static struct ftrace_graph_filter ftrace_graph_notrace;
+static int ftrace_set_func(struct ftrace_hash *hash, char *buffer);
+static void ftrace_graph_publish(struct ftrace_graph_filter *filter,
+				 struct ftrace_hash *hash);
+static struct ftrace_hash *
+ftrace_graph_copy(struct ftrace_graph_filter *filter);
 
 static int __init set_graph_function(char *str)
 {
@@ -3114,20 +3134,34 @@ static int __init set_graph_function(char *str)
 }
 __setup("ftrace_graph_filter=", set_graph_function);
 
-static void __init set_ftrace_early_graph(char *buf)
+static int __init set_graph_notrace_function(char *str)
+{
+	strlcpy(ftrace_graph_notrace_buf, str, FTRACE_FILTER_SIZE);
+	return 1;
+}
+__setup("ftrace_graph_notrace=", set_graph_notrace_function);
+
+static void __init
+set_ftrace_early_graph(struct ftrace_graph_filter *filter, char *buf)
 {
+	struct ftrace_hash *hash;
 	int ret;
 	char *func;
 
+	hash = ftrace_graph_copy(filter);
+	if (!hash)
+		return;
+
 	while (buf) {
 		func = strsep(&buf, ",");
 		/* we allow only one expression at a time */
-		ret = ftrace_set_func(ftrace_graph_funcs, &ftrace_graph_count,
-				      func);
+		ret = ftrace_set_func(hash, func);
 		if (ret)
 			printk(KERN_DEBUG "ftrace: function %s not "
 					  "traceable\n", func);
 	}
+
+	ftrace_graph_publish(filter, hash);
 }
 #endif /* CONFIG_FUNCTION_GRAPH_TRACER */
 
@@ -3150,7 +3184,10 @@ static void __init set_ftrace_early_filters(void)
 		set_ftrace_early_filter(&global_ops, ftrace_notrace_buf, 0);
 #ifdef CONFIG_FUNCTION_GRAPH_TRACER
 	if (ftrace_graph_buf[0])
-		set_ftrace_early_graph(ftrace_graph_buf);
+		set_ftrace_early_graph(&ftrace_graph_filter, ftrace_graph_buf);
+	if (ftrace_graph_notrace_buf[0])
+		set_ftrace_early_graph(&ftrace_graph_notrace,
+				       ftrace_graph_notrace_buf);
 #endif /* CONFIG_FUNCTION_GRAPH_TRACER */
 }
 
@@ -3238,16 +3275,83 @@ static const struct file_operations ftrace_notrace_fops = {
 
 static DEFINE_MUTEX(graph_lock);
 
-int ftrace_graph_count;
 int ftrace_graph_filter_enabled;
-unsigned long ftrace_graph_funcs[FTRACE_GRAPH_MAX_FUNCS] __read_mostly;
+int ftrace_graph_notrace_enabled;
+
+static struct ftrace_graph_filter ftrace_graph_filter = {
+	.hash		= EMPTY_HASH,
+	.enabled	= &ftrace_graph_filter_enabled,
+	.all		= "#### all functions enabled ####\n",
+};
+
+static struct ftrace_graph_filter ftrace_graph_notrace = {
+	.hash		= EMPTY_HASH,
+	.enabled	= &ftrace_graph_notrace_enabled,
+	.all		= "#### no functions disabled ####\n",
+};
+
+static int ftrace_graph_lookup(struct ftrace_graph_filter *filter,
+			       unsigned long addr)
+{
+	int ret;
+
+	preempt_disable_notrace();
+	ret = !!ftrace_lookup_ip(rcu_dereference_raw(filter->hash), addr);
+	preempt_enable_notrace();
+
+	return ret;
+}
+
+int __ftrace_graph_addr(unsigned long addr)
+{
+	return ftrace_graph_lookup(&ftrace_graph_filter, addr);
+}
+
+int __ftrace_graph_notrace_addr(unsigned long addr)
+{
+	return ftrace_graph_lookup(&ftrace_graph_notrace, addr);
+}
+
+static struct ftrace_hash *
+ftrace_graph_copy(struct ftrace_graph_filter *filter)
+{
+	return alloc_and_copy_ftrace_hash(FTRACE_HASH_DEFAULT_BITS,
+					  rcu_dereference_raw(filter->hash));
+}
+
+static void ftrace_graph_publish(struct ftrace_graph_filter *filter,
+				 struct ftrace_hash *hash)
+{
+	struct ftrace_hash *old = rcu_dereference_raw(filter->hash);
+
+	if (ftrace_hash_empty(hash)) {
+		free_ftrace_hash(hash);
+		hash = EMPTY_HASH;
+	}
+
+	rcu_assign_pointer(filter->hash, hash);
+	*filter->enabled = hash != EMPTY_HASH;
+	free_ftrace_hash_rcu(old);
+}
 
 static void *
 __g_next(struct seq_file *m, loff_t *pos)
 {
-	if (*pos >= ftrace_graph_count)
-		return NULL;
-	return &ftrace_graph_funcs[*pos];
+	struct ftrace_graph_filter *filter = m->private;
+	struct ftrace_hash *hash = rcu_dereference_raw(filter->hash);
+	struct ftrace_func_entry *entry;
+	struct hlist_node *n;
+	loff_t i = 0;
+	int b;
+
+	for (b = 0; b < 1 << hash->size_bits; b++) {
+		hlist_for_each_entry(entry, n, &hash->buckets[b], hlist) {
+			if (i++ == *pos)
+				return entry;
+		}
+	}
+
+	return NULL;
 }
 
 static void *
@@ -3259,10 +3363,12 @@ g_next(struct seq_file *m, void *v, loff_t *pos)
 
 static void *g_start(struct seq_file *m, loff_t *pos)
 {
+	struct ftrace_graph_filter *filter = m->private;
+
 	mutex_lock(&graph_lock);
 
 	/* Nothing, tell g_show to print all functions are enabled */
-	if (!ftrace_graph_filter_enabled && !*pos)
+	if (!*filter->enabled && !*pos)
 		return (void *)1;
 
 	return __g_next(m, pos);
@@ -3275,17 +3381,18 @@ static void g_stop(struct seq_file *m, void *p)
 
 static int g_show(struct seq_file *m, void *v)
 {
-	unsigned long *ptr = v;
+	struct ftrace_graph_filter *filter = m->private;
+	struct ftrace_func_entry *entry = v;
 
-	if (!ptr)
+	if (!entry)
 		return 0;
 
-	if (ptr == (unsigned long *)1) {
-		seq_printf(m, "#### all functions enabled ####\n");
+	if (v == (void *)1) {
+		seq_printf(m, "%s", filter->all);
 		return 0;
 	}
 
-	seq_printf(m, "%ps\n", (void *)*ptr);
+	seq_printf(m, "%ps\n", (void *)entry->ip);
 
 	return 0;
 }
@@ -3300,6 +3407,7 @@ static const struct seq_operations ftrace_graph_seq_ops = {
 static int
 ftrace_graph_open(struct inode *inode, struct file *file)
 {
+	struct ftrace_graph_filter *filter = inode->i_private;
 	int ret = 0;
 
 	if (unlikely(ftrace_disabled))
@@ -3307,15 +3415,17 @@ ftrace_graph_open(struct inode *inode, struct file *file)
 
 	mutex_lock(&graph_lock);
 	if ((file->f_mode & FMODE_WRITE) &&
-	    (file->f_flags & O_TRUNC)) {
-		ftrace_graph_filter_enabled = 0;
-		ftrace_graph_count = 0;
-		memset(ftrace_graph_funcs, 0, sizeof(ftrace_graph_funcs));
-	}
+	    (file->f_flags & O_TRUNC))
+		ftrace_graph_publish(filter, EMPTY_HASH);
 	mutex_unlock(&graph_lock);
 
-	if (file->f_mode & FMODE_READ)
+	if (file->f_mode & FMODE_READ) {
 		ret = seq_open(file, &ftrace_graph_seq_ops);
+		if (!ret)
+			((struct seq_file *)file->private_data)->private =
+				filter;
+	} else
+		file->private_data = filter;
 
 	return ret;
 }
@@ -3329,21 +3439,19 @@ ftrace_graph_release(struct inode *inode, struct file *file)
 }
 
 static int
-ftrace_set_func(unsigned long *array, int *idx, char *buffer)
+ftrace_set_func(struct ftrace_hash *hash, char *buffer)
 {
+	struct ftrace_func_entry *entry;
 	struct dyn_ftrace *rec;
 	struct ftrace_page *pg;
 	int search_len;
 	int fail = 1;
 	int type, not;
 	char *search;
-	bool exists;
-	int i;
+	int ret = 0;
 
 	/* decode regex */
 	type = filter_parse_regex(buffer, strlen(buffer), &search, &not);
-	if (!not && *idx >= FTRACE_GRAPH_MAX_FUNCS)
-		return -EBUSY;
 
 	search_len = strlen(search);
 
@@ -3360,26 +3468,18 @@ ftrace_set_func(unsigned long *array, int *idx, char *buffer)
 			continue;
 
 		if (ftrace_match_record(rec, NULL, search, search_len, type)) {
-			/* if it is in the array */
-			exists = false;
-			for (i = 0; i < *idx; i++) {
-				if (array[i] == rec->ip) {
-					exists = true;
-					break;
-				}
-			}
+			entry = ftrace_lookup_ip(hash, rec->ip);
 
 			if (!not) {
 				fail = 0;
-				if (!exists) {
-					array[(*idx)++] = rec->ip;
-					if (*idx >= FTRACE_GRAPH_MAX_FUNCS)
+				if (!entry) {
+					ret = add_hash_entry(hash, rec->ip);
+					if (ret < 0)
 						goto out;
 				}
 			} else {
-				if (exists) {
-					array[i] = array[--(*idx)];
-					array[*idx] = 0;
+				if (entry) {
+					free_hash_entry(hash, entry);
 					fail = 0;
 				}
 			}
@@ -3388,11 +3488,11 @@ ftrace_set_func(unsigned long *array, int *idx, char *buffer)
 out:
 	mutex_unlock(&ftrace_lock);
 
+	if (ret)
+		return ret;
 	if (fail)
 		return -EINVAL;
 
-	ftrace_graph_filter_enabled = !!(*idx);
-
 	return 0;
 }
 
@@ -3400,12 +3500,19 @@ static ssize_t
 ftrace_graph_write(struct file *file, const char __user *ubuf,
 		   size_t cnt, loff_t *ppos)
 {
+	struct ftrace_graph_filter *filter;
 	struct trace_parser parser;
+	struct ftrace_hash *hash;
 	ssize_t read, ret;
 
 	if (!cnt)
 		return 0;
 
+	if (file->f_mode & FMODE_READ)
+		filter = ((struct seq_file *)file->private_data)->private;
+	else
+		filter = file->private_data;
+
 	mutex_lock(&graph_lock);
 
 	if (trace_parser_get_init(&parser, FTRACE_BUFF_MAX)) {
@@ -3418,11 +3525,19 @@ ftrace_graph_write(struct file *file, const char __user *ubuf,
 	if (read >= 0 && trace_parser_loaded((&parser))) {
 		parser.buffer[parser.idx] = 0;
 
+		ret = -ENOMEM;
+		hash = ftrace_graph_copy(filter);
+		if (!hash)
+			goto out_free;
+
 		/* we allow only one expression at a time */
-		ret = ftrace_set_func(ftrace_graph_funcs, &ftrace_graph_count,
-					parser.buffer);
-		if (ret)
+		ret = ftrace_set_func(hash, parser.buffer);
+		if (ret) {
+			free_ftrace_hash(hash);
 			goto out_free;
+		}
+
+		ftrace_graph_publish(filter, hash);
 	}
 
 	ret = read;
@@ -3461,7 +3576,10 @@ static __init int ftrace_init_dyn_debugfs(struct dentry *d_tracer)
 
 #ifdef CONFIG_FUNCTION_GRAPH_TRACER
 	trace_create_file("set_graph_function", 0444, d_tracer,
-				    NULL,
+				    &ftrace_graph_filter,
+				    &ftrace_graph_fops);
+	trace_create_file("set_graph_notrace", 0444, d_tracer,
+				    &ftrace_graph_notrace,
 				    &ftrace_graph_fops);
 #endif /* CONFIG_FUNCTION_GRAPH_TRACER */
 
@@ -4058,19 +4176,119 @@ trace_func_graph_ret_t ftrace_graph_return =
 trace_func_graph_ent_t ftrace_graph_entry = ftrace_graph_entry_stub;
 static trace_func_graph_ent_t __ftrace_graph_entry = ftrace_graph_entry_stub;
 
-/* Try to assign a return stack array on FTRACE_RETSTACK_ALLOC_SIZE tasks. */
-static int alloc_retstack_tasklist(struct ftrace_ret_stack **ret_stack_list)
+#define FTRACE_RETSTACK_BYTES \
+	(FTRACE_RETFUNC_DEPTH * sizeof(struct ftrace_ret_stack))
+
+/*
+ * Per-cpu pools of return stacks, topped up when the graph tracer
+ * starts, so that fork takes a stack without going to the allocator and
+ * exit hands it back.  Filling reaches into other cpus' pools, hence
+ * the lock.
+ */
+struct ret_stack_pool {
+	raw_spinlock_t		lock;
+	int			nr;
+	struct ftrace_ret_stack	*stacks[FTRACE_RETSTACK_POOL_SIZE];
+};
+
+static DEFINE_PER_CPU(struct ret_stack_pool, ret_stack_pool) = {
+	.lock	= __RAW_SPIN_LOCK_UNLOCKED(ret_stack_pool.lock),
+};
+
+/* Returns false if the pool of @cpu is full */
+static bool ret_stack_pool_put(int cpu, struct ftrace_ret_stack *ret_stack)
+{
+	struct ret_stack_pool *pool = &per_cpu(ret_stack_pool, cpu);
+	unsigned long flags;
+	bool ret = false;
+
+	raw_spin_lock_irqsave(&pool->lock, flags);
+	if (pool->nr < FTRACE_RETSTACK_POOL_SIZE) {
+		pool->stacks[pool->nr++] = ret_stack;
+		ret = true;
+	}
+	raw_spin_unlock_irqrestore(&pool->lock, flags);
+
+	return ret;
+}
+
+static struct ftrace_ret_stack *ret_stack_alloc(void)
+{
+	struct ftrace_ret_stack *ret_stack = NULL;
+	struct ret_stack_pool *pool;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	pool = &__get_cpu_var(ret_stack_pool);
+	raw_spin_lock(&pool->lock);
+	if (pool->nr)
+		ret_stack = pool->stacks[--pool->nr];
+	raw_spin_unlock(&pool->lock);
+	local_irq_restore(flags);
+
+	if (!ret_stack)
+		ret_stack = kmalloc(FTRACE_RETSTACK_BYTES, GFP_KERNEL);
+
+	return ret_stack;
+}
+
+static void ret_stack_free(struct ftrace_ret_stack *ret_stack)
+{
+	if (!ret_stack_pool_put(raw_smp_processor_id(), ret_stack))
+		kfree(ret_stack);
+}
+
+static void ret_stack_pools_fill(void)
+{
+	struct ftrace_ret_stack *ret_stack;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		for (;;) {
+			ret_stack = kmalloc_node(FTRACE_RETSTACK_BYTES,
+						 GFP_KERNEL, cpu_to_node(cpu));
+			if (!ret_stack)
+				return;
+			if (!ret_stack_pool_put(cpu, ret_stack)) {
+				kfree(ret_stack);
+				break;
+			}
+		}
+	}
+}
+
+static int nr_tasks_without_retstack(void)
+{
+	struct task_struct *g, *t;
+	unsigned long flags;
+	int nr = 0;
+
+	read_lock_irqsave(&tasklist_lock, flags);
+	do_each_thread(g, t) {
+		if (t->ret_stack == NULL)
+			nr++;
+	} while_each_thread(g, t);
+	read_unlock_irqrestore(&tasklist_lock, flags);
+
+	return nr;
+}
+
+/*
+ * Try to assign a return stack array to the tasks that have none, with
+ * @nr of them allocated up front so the tasklist is walked only once in
+ * the common case; the stacks left over go to the pools.
+ */
+static int alloc_retstack_tasklist(struct ftrace_ret_stack **ret_stack_list,
+				   int nr)
 {
 	int i;
 	int ret = 0;
 	unsigned long flags;
-	int start = 0, end = FTRACE_RETSTACK_ALLOC_SIZE;
+	int start = 0, end = nr;
 	struct task_struct *g, *t;
 
-	for (i = 0; i < FTRACE_RETSTACK_ALLOC_SIZE; i++) {
-		ret_stack_list[i] = kmalloc(FTRACE_RETFUNC_DEPTH
-					* sizeof(struct ftrace_ret_stack),
-					GFP_KERNEL);
+	for (i = 0; i < nr; i++) {
+		ret_stack_list[i] = kmalloc(FTRACE_RETSTACK_BYTES, GFP_KERNEL);
 		if (!ret_stack_list[i]) {
 			start = 0;
 			end = i;
@@ -4098,6 +4316,10 @@ static int alloc_retstack_tasklist(struct ftrace_ret_stack **ret_stack_list)
 
 unlock:
 	read_unlock_irqrestore(&tasklist_lock, flags);
+	if (!ret) {
+		for (; start < end; start++)
+			ret_stack_free(ret_stack_list[start]);
+	}
 free:
 	for (i = start; i < end; i++)
 		kfree(ret_stack_list[i]);
@@ -4140,14 +4362,7 @@ ftrace_graph_probe_sched_switch(void *ignore,
 static int start_graph_tracing(void)
 {
 	struct ftrace_ret_stack **ret_stack_list;
-	int ret, cpu;
-
-	ret_stack_list = kmalloc(FTRACE_RETSTACK_ALLOC_SIZE *
-				sizeof(struct ftrace_ret_stack *),
-				GFP_KERNEL);
-
-	if (!ret_stack_list)
-		return -ENOMEM;
+	int ret, cpu, nr;
 
 	/* The cpu_boot init_task->ret_stack will never be freed */
 	for_each_online_cpu(cpu) {
@@ -4155,8 +4370,16 @@ static int start_graph_tracing(void)
 			ftrace_graph_init_idle_task(idle_task(cpu), cpu);
 	}
 
+	ret_stack_pools_fill();
+
 	do {
-		ret = alloc_retstack_tasklist(ret_stack_list);
+		/* Leave some room for tasks forked meanwhile */
+		nr = nr_tasks_without_retstack() + FTRACE_RETSTACK_ALLOC_SIZE;
+		ret_stack_list = vmalloc(nr * sizeof(*ret_stack_list));
+		if (!ret_stack_list)
+			return -ENOMEM;
+		ret = alloc_retstack_tasklist(ret_stack_list, nr);
+		vfree(ret_stack_list);
 	} while (ret == -EAGAIN);
 
 	if (!ret) {
@@ -4166,7 +4389,6 @@ static int start_graph_tracing(void)
 				" probe to kernel_sched_switch\n");
 	}
 
-	kfree(ret_stack_list);
 	return ret;
 }
 
@@ -4335,9 +4557,7 @@ void ftrace_graph_init_task(struct task_struct *t)
 	if (ftrace_graph_active) {
 		struct ftrace_ret_stack *ret_stack;
 
-		ret_stack = kmalloc(FTRACE_RETFUNC_DEPTH
-				* sizeof(struct ftrace_ret_stack),
-				GFP_KERNEL);
+		ret_stack = ret_stack_alloc();
 		if (!ret_stack)
 			return;
 		graph_init_task(t, ret_stack);
@@ -4352,7 +4572,8 @@ void ftrace_graph_exit_task(struct task_struct *t)
 	/* NULL must become visible to IRQs before we free it: */
 	barrier();
 
-	kfree(ret_stack);
+	if (ret_stack)
+		ret_stack_free(ret_stack);
 }
 
 void ftrace_graph_stop(void)
@@ -0,0 +1,364 @@
+/*
+ * Latency histograms
+ *
+ * Per-cpu log2 histograms of the length of irqs-off and preemption-off
+ * sections, of the wakeup latency of all and of RT tasks, and of the
+ * time hrtimers expire late. Unlike the latency tracers, which keep
+ * only the worst case, they give the whole distribution and are cheap
+ * enough to be left enabled.
+ *
+ * Each histogram lives in tracing/latency_hist/<type>/ with an enable
+ * and a reset file and one CPU<n> file per cpu. Bucket n counts the
+ * latencies of 2^n up to 2^(n+1)-1 nanoseconds.
+ */
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/percpu.h>
+#include <linux/bitops.h>
+#include <linux/sched.h>
+#include <linux/latency_hist.h>
+#include <trace/events/sched.h>
+
+#include "trace.h"
+
+#define LATENCY_HIST_BUCKETS	40	/* up to ~18 minutes */
+
+struct hist_data {
+	unsigned long	hist[LATENCY_HIST_BUCKETS];
+	unsigned long	count;
+	u64		total;
+	u64		min;
+	u64		max;
+};
+
+struct hist_type {
+	const char	*name;
+	bool		available;
+};
+
+static const struct hist_type hist_types[LATENCY_HIST_NR_TYPES] = {
+	[LATENCY_HIST_IRQSOFF] = {
+		.name = "irqsoff",
+		.available = IS_ENABLED(CONFIG_IRQSOFF_TRACER),
+	},
+	[LATENCY_HIST_PREEMPTOFF] = {
+		.name = "preemptoff",
+		.available = IS_ENABLED(CONFIG_PREEMPT_TRACER),
+	},
+	[LATENCY_HIST_WAKEUP] = {
+		.name = "wakeup",
+		.available = true,
+	},
+	[LATENCY_HIST_WAKEUP_RT] = {
+		.name = "wakeup_rt",
+		.available = true,
+	},
+	[LATENCY_HIST_TIMER_OFFSET] = {
+		.name = "timer_offsets",
+		.available = IS_ENABLED(CONFIG_HIGH_RES_TIMERS),
+	},
+};
+
+int latency_hist_enabled[LATENCY_HIST_NR_TYPES] __read_mostly;
+EXPORT_SYMBOL_GPL(latency_hist_enabled);
+
+static DEFINE_PER_CPU(struct hist_data [LATENCY_HIST_NR_TYPES], hist_data);
+static DEFINE_PER_CPU(u64 [LATENCY_HIST_NR_TYPES], hist_start);
+static DEFINE_MUTEX(hist_mutex);
+
+/*
+ * Only the local cpu updates its histograms, always with preemption or
+ * interrupts disabled, so no locking. A reader may see a sample half
+ * way through being accounted.
+ */
+notrace void __latency_hist_record(int type, s64 latency)
+{
+	struct hist_data *data;
+	int bucket;
+
+	if (latency < 0)
+		return;
+
+	data = &per_cpu(hist_data, raw_smp_processor_id())[type];
+	bucket = latency ? fls64(latency) - 1 : 0;
+	if (bucket >= LATENCY_HIST_BUCKETS)
+		bucket = LATENCY_HIST_BUCKETS - 1;
+
+	data->hist[bucket]++;
+	if (!data->count || latency < data->min)
+		data->min = latency;
+	if (latency > data->max)
+		data->max = latency;
+	data->total += latency;
+	data->count++;
+}
+EXPORT_SYMBOL_GPL(__latency_hist_record);
+
+/*
+ * These are called from the irq flag and preempt count tracing hooks,
+ * so they must not enable interrupts or touch the preempt count
+ * themselves. Redundant starts and stops are ignored.
+ */
+notrace void __latency_hist_start(int type)
+{
+	u64 *start = &per_cpu(hist_start, raw_smp_processor_id())[type];
+
+	if (!*start)
+		*start = trace_clock_local();
+}
+EXPORT_SYMBOL_GPL(__latency_hist_start);
+
+notrace void __latency_hist_stop(int type)
+{
+	u64 *start = &per_cpu(hist_start, raw_smp_processor_id())[type];
+	u64 stop;
+
+	if (!*start)
+		return;
+
+	stop = trace_clock_local();
+	__latency_hist_record(type, stop - *start);
+	*start = 0;
+}
+EXPORT_SYMBOL_GPL(__latency_hist_stop);
+
+static notrace void
+probe_wakeup_hist(void *ignore, struct task_struct *p, int success)
+{
+	if (!success)
+		return;
+
+	p->wakeup_timestamp_hist = local_clock();
+}
+
+static notrace void
+probe_switch_hist(void *ignore, struct task_struct *prev,
+		  struct task_struct *next)
+{
+	u64 latency;
+
+	if (!next->wakeup_timestamp_hist)
+		return;
+
+	latency = local_clock() - next->wakeup_timestamp_hist;
+	next->wakeup_timestamp_hist = 0;
+
+	if (latency_hist_enabled[LATENCY_HIST_WAKEUP])
+		__latency_hist_record(LATENCY_HIST_WAKEUP, latency);
+	if (latency_hist_enabled[LATENCY_HIST_WAKEUP_RT] && rt_task(next))
+		__latency_hist_record(LATENCY_HIST_WAKEUP_RT, latency);
+}
+
+static int wakeup_hist_users;
+
+static int wakeup_hist_register(void)
+{
+	int ret;
+
+	if (wakeup_hist_users++)
+		return 0;
+
+	ret = register_trace_sched_wakeup(probe_wakeup_hist, NULL);
+	if (ret)
+		goto fail;
+	ret = register_trace_sched_wakeup_new(probe_wakeup_hist, NULL);
+	if (ret)
+		goto fail_wakeup;
+	ret = register_trace_sched_switch(probe_switch_hist, NULL);
+	if (ret)
+		goto fail_wakeup_new;
+	return 0;
+
+fail_wakeup_new:
+	unregister_trace_sched_wakeup_new(probe_wakeup_hist, NULL);
+fail_wakeup:
+	unregister_trace_sched_wakeup(probe_wakeup_hist, NULL);
+fail:
+	wakeup_hist_users--;
+	return ret;
+}
+
+static void wakeup_hist_unregister(void)
+{
+	if (--wakeup_hist_users)
+		return;
+
+	unregister_trace_sched_switch(probe_switch_hist, NULL);
+	unregister_trace_sched_wakeup_new(probe_wakeup_hist, NULL);
+	unregister_trace_sched_wakeup(probe_wakeup_hist, NULL);
+}
+
+static bool hist_is_wakeup(int type)
+{
+	return type == LATENCY_HIST_WAKEUP || type == LATENCY_HIST_WAKEUP_RT;
+}
+
+static void hist_reset(int type)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		memset(&per_cpu(hist_data, cpu)[type], 0,
+		       sizeof(struct hist_data));
+}
+
+static int hist_set_enabled(int type, int enable)
+{
+	int cpu, ret = 0;
+
+	mutex_lock(&hist_mutex);
+	if (enable == latency_hist_enabled[type])
+		goto out;
+
+	if (enable) {
+		/* forget sections started while we were disabled */
+		for_each_possible_cpu(cpu)
+			per_cpu(hist_start, cpu)[type] = 0;
+		if (hist_is_wakeup(type)) {
+			ret = wakeup_hist_register();
+			if (ret)
+				goto out;
+		}
+		latency_hist_enabled[type] = 1;
+	} else {
+		latency_hist_enabled[type] = 0;
+		if (hist_is_wakeup(type))
+			wakeup_hist_unregister();
+	}
+out:
+	mutex_unlock(&hist_mutex);
+	return ret;
+}
+
+static int hist_show(struct seq_file *m, void *v)
+{
+	long idx = (long)m->private;
+	int cpu = idx / LATENCY_HIST_NR_TYPES;
+	int type = idx % LATENCY_HIST_NR_TYPES;
+	struct hist_data *data = &per_cpu(hist_data, cpu)[type];
+	int i;
+
+	seq_printf(m, "#Minimum latency: %llu nanoseconds\n"
+		      "#Average latency: %llu nanoseconds\n"
+		      "#Maximum latency: %llu nanoseconds\n"
+		      "#Total samples: %lu\n"
+		      "#nsecs(>=)\tsamples\n",
+		   data->min,
+		   data->count ? div64_u64(data->total, data->count) : 0,
+		   data->max, data->count);
+
+	for (i = 0; i < LATENCY_HIST_BUCKETS; i++)
+		seq_printf(m, "%llu\t%lu\n", i ? 1ULL << i : 0, data->hist[i]);
+
+	return 0;
+}
+
+static int hist_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, hist_show, inode->i_private);
+}
+
+static const struct file_operations hist_fops = {
+	.open		= hist_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static ssize_t hist_enable_read(struct file *file, char __user *ubuf,
+				size_t cnt, loff_t *ppos)
+{
+	long type = (long)file->private_data;
+	char buf[4];
+	int r;
+
+	r = snprintf(buf, sizeof(buf), "%d\n", latency_hist_enabled[type]);
+	return simple_read_from_buffer(ubuf, cnt, ppos, buf, r);
+}
+
+static ssize_t hist_enable_write(struct file *file, const char __user *ubuf,
+				 size_t cnt, loff_t *ppos)
+{
+	long type = (long)file->private_data;
+	unsigned long val;
+	int ret;
+
+	ret = kstrtoul_from_user(ubuf, cnt, 10, &val);
+	if (ret)
+		return ret;
+
+	ret = hist_set_enabled(type, !!val);
+	if (ret)
+		return ret;
+
+	*ppos += cnt;
+	return cnt;
+}
+
+static const struct file_operations hist_enable_fops = {
+	.open		= tracing_open_generic,
+	.read		= hist_enable_read,
+	.write		= hist_enable_write,
+	.llseek		= generic_file_llseek,
+};
+
+static ssize_t hist_reset_write(struct file *file, const char __user *ubuf,
+				size_t cnt, loff_t *ppos)
+{
+	long type = (long)file->private_data;
+
+	hist_reset(type);
+
+	*ppos += cnt;
+	return cnt;
+}
+
+static const struct file_operations hist_reset_fops = {
+	.open		= tracing_open_generic,
+	.write		= hist_reset_write,
+	.llseek		= generic_file_llseek,
+};
+
+static __init int latency_hist_init(void)
+{
+	struct dentry *d_tracer, *d_hist, *d_type;
+	char name[16];
+	long type;
+	int cpu;
+
+	d_tracer = tracing_init_dentry();
+	if (!d_tracer)
+		return 0;
+
+	d_hist = debugfs_create_dir("latency_hist", d_tracer);
+	if (!d_hist) {
+		pr_warning("Could not create debugfs 'latency_hist' entry\n");
+		return 0;
+	}
+
+	for (type = 0; type < LATENCY_HIST_NR_TYPES; type++) {
+		if (!hist_types[type].available)
+			continue;
+
+		d_type = debugfs_create_dir(hist_types[type].name, d_hist);
+		if (!d_type)
+			continue;
+
+		debugfs_create_file("enable", 0644, d_type, (void *)type,
+				    &hist_enable_fops);
+		debugfs_create_file("reset", 0200, d_type, (void *)type,
+				    &hist_reset_fops);
+
+		for_each_possible_cpu(cpu) {
+			snprintf(name, sizeof(name), "CPU%d", cpu);
+			debugfs_create_file(name, 0444, d_type,
+				(void *)(long)(cpu * LATENCY_HIST_NR_TYPES + type),
+				&hist_fops);
+		}
+	}
+
+	return 0;
+}
+fs_initcall(latency_hist_init);
@@ -19,6 +19,7 @@
 #include <linux/list.h>
 #include <linux/cpu.h>
 #include <linux/fs.h>
+#include <linux/trace_mmap.h>
 
 #include <asm/local.h>
 #include "trace.h"
@@ -381,6 +382,7 @@ struct buffer_page {
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
 	struct buffer_data_page *page;	/* Actual data page */
+	unsigned	 id;		/* page index in a user mapping */
 };
 
 /*
@@ -498,6 +500,10 @@ struct ring_buffer_per_cpu {
 	unsigned long			read_bytes;
 	u64				write_stamp;
 	u64				read_stamp;
+	/* user space mappings, changed under buffer->mutex */
+	unsigned			mapped;
+	struct trace_buffer_meta	*meta_page;
+	unsigned long			*subbuf_ids;	/* data pages by id */
 };
 
 struct ring_buffer {
@@ -1351,6 +1357,16 @@ int ring_buffer_resize(struct ring_buffer *buffer, unsigned long size)
 	mutex_lock(&buffer->mutex);
 	get_online_cpus();
 
+	/* User space maps the pages by index, they must stay put */
+	for_each_buffer_cpu(buffer, cpu) {
+		if (buffer->buffers[cpu]->mapped) {
+			put_online_cpus();
+			mutex_unlock(&buffer->mutex);
+			atomic_dec(&buffer->record_disabled);
+			return -EBUSY;
+		}
+	}
+
 	nr_pages = DIV_ROUND_UP(size, BUF_PAGE_SIZE);
 
 	if (size < buffer_size) {
@@ -3771,6 +3787,10 @@ int ring_buffer_swap_cpu(struct ring_buffer *buffer_a,
 	if (atomic_read(&cpu_buffer_b->record_disabled))
 		goto out;
 
+	ret = -EBUSY;
+	if (cpu_buffer_a->mapped || cpu_buffer_b->mapped)
+		goto out;
+
 	/*
 	 * We can't do a synchronize_sched here because this
 	 * function can be called in atomic context.
@@ -3932,12 +3952,14 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 	/*
 	 * If this page has been partially read or
 	 * if len is not big enough to read the rest of the page or
-	 * a writer is still on the page, then
+	 * a writer is still on the page, or
+	 * the pages are mapped to user space, then
 	 * we must copy the data from the page to the buffer.
 	 * Otherwise, we can simply swap the page with the one passed in.
 	 */
 	if (read || (len < (commit - read)) ||
-	    cpu_buffer->reader_page == cpu_buffer->commit_page) {
+	    cpu_buffer->reader_page == cpu_buffer->commit_page ||
+	    cpu_buffer->mapped) {
 		struct buffer_data_page *rpage = cpu_buffer->reader_page->page;
 		unsigned int rpos = read;
 		unsigned int pos = 0;
@@ -4046,6 +4068,225 @@ int ring_buffer_read_page(struct ring_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->reader.read = cpu_buffer->reader_page->read;
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+}
+
+/*
+ * Number the reader page 0 and the ring pages after it, in ring order,
+ * and note where their data pages are.
+ */
+static void rb_setup_ids(struct ring_buffer_per_cpu *cpu_buffer,
+			 unsigned long *subbuf_ids)
+{
+	struct list_head *head = cpu_buffer->pages;
+	struct list_head *p = head;
+	struct buffer_page *bpage;
+	unsigned id = 0;
+
+	cpu_buffer->reader_page->id = id;
+	subbuf_ids[id++] = (unsigned long)cpu_buffer->reader_page->page;
+
+	do {
+		if (RB_WARN_ON(cpu_buffer, id > cpu_buffer->buffer->pages))
+			break;
+		bpage = list_entry(p, struct buffer_page, list);
+		bpage->id = id;
+		subbuf_ids[id++] = (unsigned long)bpage->page;
+		p = rb_list_head(p->next);
+	} while (p != head);
+}
+
+/**
+ * ring_buffer_map - make a cpu buffer mappable to user space
+ * @buffer: the buffer
+ * @cpu: the cpu buffer to map
+ *
+ * Sets up the meta page described in <linux/trace_mmap.h> and pins the
+ * buffer pages: while a cpu buffer is mapped, the buffer can not be
+ * resized nor have that cpu buffer swapped, and ring_buffer_read_page()
+ * copies instead of swapping pages.  Calls nest, and each must be paired
+ * with ring_buffer_unmap().
+ */
+int ring_buffer_map(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	unsigned long *subbuf_ids;
+	unsigned long flags;
+	int ret = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+
+	if (cpu_buffer->mapped) {
+		cpu_buffer->mapped++;
+		goto out;
+	}
+
+	ret = -ENOMEM;
+	meta = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!meta)
+		goto out;
+	subbuf_ids = kcalloc(buffer->pages + 1, sizeof(*subbuf_ids),
+			     GFP_KERNEL);
+	if (!subbuf_ids) {
+		free_page((unsigned long)meta);
+		goto out;
+	}
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = buffer->pages + 1;
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	rb_setup_ids(cpu_buffer, subbuf_ids);
+	cpu_buffer->meta_page = meta;
+	cpu_buffer->subbuf_ids = subbuf_ids;
+	cpu_buffer->mapped = 1;
+	rb_update_meta_page(cpu_buffer);
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	ret = 0;
+ out:
+	mutex_unlock(&buffer->mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+/**
+ * ring_buffer_unmap - drop a mapping taken with ring_buffer_map()
+ * @buffer: the buffer
+ * @cpu: the mapped cpu buffer
+ */
+void ring_buffer_unmap(struct ring_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
+	struct trace_buffer_meta *meta;
+	unsigned long *subbuf_ids;
+	unsigned long flags;
+
+	mutex_lock(&buffer->mutex);
+
+	if (RB_WARN_ON(cpu_buffer, !cpu_buffer->mapped) ||
+	    --cpu_buffer->mapped) {
+		mutex_unlock(&buffer->mutex);
+		return;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	meta = cpu_buffer->meta_page;
+	subbuf_ids = cpu_buffer->subbuf_ids;
+	cpu_buffer->meta_page = NULL;
+	cpu_buffer->subbuf_ids = NULL;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	mutex_unlock(&buffer->mutex);
+
+	free_page((unsigned long)meta);
+	kfree(subbuf_ids);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_fault - find the page behind a mapping offset
+ * @buffer: the buffer
+ * @cpu: the mapped cpu buffer
+ * @pgoff: page offset into the mapping
+ *
+ * Page 0 is the meta page, page n the buffer page with id n - 1.
+ * Returns NULL past the end.  Only valid while the caller holds a
+ * mapping, which keeps the pages in place.
+ */
+struct page *ring_buffer_map_fault(struct ring_buffer *buffer, int cpu,
+				   unsigned long pgoff)
+{
+	struct ring_buffer_per_cpu *cpu_buffer = buffer->buffers[cpu];
+
+	if (RB_WARN_ON(cpu_buffer, !cpu_buffer->mapped))
+		return NULL;
+
+	if (!pgoff)
+		return virt_to_page(cpu_buffer->meta_page);
+
+	if (--pgoff > buffer->pages)
+		return NULL;
+
+	return virt_to_page((void *)cpu_buffer->subbuf_ids[pgoff]);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_fault);
+
+/**
+ * ring_buffer_map_get_reader - consume from a mapped cpu buffer
+ * @buffer: the buffer
+ * @cpu: the mapped cpu buffer
+ * @consumed: offset into the reader page user space has read up to
+ *
+ * Consumes the events of the reader page before @consumed and, if that
+ * was all of them and the writer has moved on, swaps in the next page
+ * of the ring as reader page.  The meta page is updated either way.
+ */
+int ring_buffer_map_get_reader(struct ring_buffer *buffer, int cpu,
+			       unsigned long consumed)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct ring_buffer_event *event;
+	struct buffer_page *reader;
+	unsigned long flags;
+	int ret = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	if (!cpu_buffer->mapped) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	reader = cpu_buffer->reader_page;
+	if (consumed > rb_page_commit(reader))
+		consumed = rb_page_commit(reader);
+
+	while (reader->read < consumed) {
+		event = rb_reader_event(cpu_buffer);
+		if (event->type_len <= RINGBUF_TYPE_DATA_TYPE_LEN_MAX)
+			cpu_buffer->read++;
+		rb_update_read_stamp(cpu_buffer, event);
+		reader->read += rb_event_length(event);
+	}
+
+	rb_get_reader_page(cpu_buffer);
+	if (cpu_buffer->reader_page != reader) {
+		cpu_buffer->meta_page->reader.lost_events =
+			cpu_buffer->lost_events;
+		cpu_buffer->lost_events = 0;
+	}
+	rb_update_meta_page(cpu_buffer);
+
+ out:
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
 #ifdef CONFIG_TRACING
 static ssize_t
 rb_simple_read(struct file *filp, char __user *ubuf,
@@ -37,6 +37,7 @@
 #include <linux/init.h>
 #include <linux/poll.h>
 #include <linux/fs.h>
+#include <linux/trace_mmap.h>
 
 #include "trace.h"
 #include "trace_output.h"
@@ -3902,6 +3903,7 @@ struct ftrace_buffer_info {
 	void			*spare;
 	int			cpu;
 	unsigned int		read;
+	struct ring_buffer	*mapped;	/* buffer of the mmap()s */
 };
 
 static int tracing_buffers_open(struct inode *inode, struct file *filp)
@@ -4150,11 +4152,98 @@ out:
 	return ret;
 }
 
+static long tracing_buffers_ioctl(struct file *file, unsigned int cmd,
+				  unsigned long arg)
+{
+	struct ftrace_buffer_info *info = file->private_data;
+	int ret;
+
+	if (cmd != TRACE_MMAP_IOCTL_GET_READER)
+		return -ENOTTY;
+
+	if (!info->mapped)
+		return -EINVAL;
+
+	trace_access_lock(info->cpu);
+	ret = ring_buffer_map_get_reader(info->mapped, info->cpu, arg);
+	trace_access_unlock(info->cpu);
+
+	return ret;
+}
+
+static int tracing_buffers_mmap_fault(struct vm_area_struct *vma,
+				      struct vm_fault *vmf)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct page *page;
+
+	page = ring_buffer_map_fault(info->mapped, info->cpu, vmf->pgoff);
+	if (!page)
+		return VM_FAULT_SIGBUS;
+
+	get_page(page);
+	vmf->page = page;
+
+	return 0;
+}
+
+static void tracing_buffers_mmap_open(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+
+	/* Can't fail, the buffer is mapped already */
+	WARN_ON(ring_buffer_map(info->mapped, info->cpu));
+}
+
+static void tracing_buffers_mmap_close(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+
+	ring_buffer_unmap(info->mapped, info->cpu);
+}
+
+static const struct vm_operations_struct tracing_buffers_vmops = {
+	.open		= tracing_buffers_mmap_open,
+	.close		= tracing_buffers_mmap_close,
+	.fault		= tracing_buffers_mmap_fault,
+};
+
+/*
+ * Map the meta page and the pages of the cpu buffer read-only, see
+ * <linux/trace_mmap.h>.  The buffer is pinned to the file on the first
+ * mmap, so that a latency tracer swapping buffers later on doesn't pull
+ * it away from under the mappings; a mapped buffer can't be resized or
+ * have its cpu buffers swapped, and is never freed.
+ */
+static int tracing_buffers_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	struct ring_buffer *buffer;
+	int ret;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+
+	buffer = info->mapped ? info->mapped : info->tr->buffer;
+	ret = ring_buffer_map(buffer, info->cpu);
+	if (ret)
+		return ret;
+
+	info->mapped = buffer;
+	vma->vm_flags &= ~VM_MAYWRITE;
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND;
+	vma->vm_ops = &tracing_buffers_vmops;
+
+	return 0;
+}
+
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
+	.unlocked_ioctl	= tracing_buffers_ioctl,
+	.mmap		= tracing_buffers_mmap,
 	.llseek		= no_llseek,
 };
 
@@ -97,6 +97,11 @@ struct kretprobe_trace_entry_head {
 	unsigned long		ret_ip;
 };
 
+struct uprobe_trace_entry_head {
+	struct trace_entry	ent;
+	unsigned long		ip;
+};
+
 /*
  * trace_flag_type is an enumeration that holds different
  * states when a trace occurs. These are:
@@ -529,41 +534,49 @@ extern void __trace_graph_return(struct trace_array *tr,
 
 
 #ifdef CONFIG_DYNAMIC_FTRACE
-/* TODO: make this variable */
-#define FTRACE_GRAPH_MAX_FUNCS		32
 extern int ftrace_graph_filter_enabled;
-extern int ftrace_graph_count;
-extern unsigned long ftrace_graph_funcs[FTRACE_GRAPH_MAX_FUNCS];
+extern int ftrace_graph_notrace_enabled;
+extern int __ftrace_graph_addr(unsigned long addr);
+extern int __ftrace_graph_notrace_addr(unsigned long addr);
 
 static inline int ftrace_graph_addr(unsigned long addr)
 {
-	int i;
-
 	if (!ftrace_graph_filter_enabled)
 		return 1;
 
-	for (i = 0; i < ftrace_graph_count; i++) {
-		if (addr == ftrace_graph_funcs[i]) {
-			/*
-			 * If no irqs are to be traced, but a set_graph_function
-			 * is set, and called by an interrupt handler, we still
-			 * want to trace it.
-			 */
-			if (in_irq())
-				trace_recursion_set(TRACE_IRQ_BIT);
-			else
-				trace_recursion_clear(TRACE_IRQ_BIT);
-			return 1;
-		}
+	if (__ftrace_graph_addr(addr)) {
+		/*
+		 * If no irqs are to be traced, but a set_graph_function
+		 * is set, and called by an interrupt handler, we still
+		 * want to trace it.
+		 */
+		if (in_irq())
+			trace_recursion_set(TRACE_IRQ_BIT);
+		else
+			trace_recursion_clear(TRACE_IRQ_BIT);
+		return 1;
 	}
 
 	return 0;
 }
+
+static inline int ftrace_graph_notrace_addr(unsigned long addr)
+{
+	if (!ftrace_graph_notrace_enabled)
+		return 0;
+
+	return __ftrace_graph_notrace_addr(addr);
+}
 #else
 static inline int ftrace_graph_addr(unsigned long addr)
 {
 	return 1;
 }
+
+static inline int ftrace_graph_notrace_addr(unsigned long addr)
+{
+	return 0;
+}
 #endif /* CONFIG_DYNAMIC_FTRACE */
 #else /* CONFIG_FUNCTION_GRAPH_TRACER */
 static inline enum print_line_t
@@ -793,15 +806,38 @@ extern int apply_subsystem_event_filter(struct event_subsystem *system,
 extern void print_subsystem_event_filter(struct event_subsystem *system,
 					 struct trace_seq *s);
 extern int filter_assign_type(const char *type);
+extern int create_event_filter(struct ftrace_event_call *call,
+			       char *filter_str, struct event_filter **filterp);
+extern void free_event_filter(struct event_filter *filter);
+extern struct ftrace_event_field *
+trace_find_event_field(struct ftrace_event_call *call, char *name);
 
 struct list_head *
 trace_get_fields(struct ftrace_event_call *event_call);
 
+#ifdef CONFIG_EVENT_HIST
+extern bool event_hist_update(struct ftrace_event_call *call, void *rec);
+extern void event_hist_destroy(struct ftrace_event_call *call);
+extern const struct file_operations event_hist_fops;
+#else
+static inline bool event_hist_update(struct ftrace_event_call *call, void *rec)
+{
+	return false;
+}
+static inline void event_hist_destroy(struct ftrace_event_call *call) { }
+#endif
+
 static inline int
 filter_check_discard(struct ftrace_event_call *call, void *rec,
 		     struct ring_buffer *buffer,
 		     struct ring_buffer_event *event)
 {
+	if (unlikely(call->flags & TRACE_EVENT_FL_HIST) &&
+	    event_hist_update(call, rec)) {
+		ring_buffer_discard_commit(buffer, event);
+		return 1;
+	}
+
 	if (unlikely(call->flags & TRACE_EVENT_FL_FILTERED) &&
 	    !filter_match_preds(call->filter, rec)) {
 		ring_buffer_discard_commit(buffer, event);
@@ -1187,6 +1187,12 @@ event_create_dir(struct ftrace_event_call *call, struct dentry *d_events,
 	trace_create_file("format", 0444, call->dir, call,
 			  format);
 
+#ifdef CONFIG_EVENT_HIST
+	if (call->class->reg)
+		trace_create_file("hist", 0644, call->dir, call,
+				  &event_hist_fops);
+#endif
+
 	return 0;
 }
 
@@ -1264,6 +1270,7 @@ static void remove_subsystem_dir(const char *name)
 static void __trace_remove_event_call(struct ftrace_event_call *call)
 {
 	ftrace_event_enable_disable(call, 0);
+	event_hist_destroy(call);
 	if (call->event.funcs)
 		__unregister_ftrace_event(&call->event);
 	debugfs_remove_recursive(call->dir);
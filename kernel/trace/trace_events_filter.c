@@ -677,6 +677,12 @@ find_event_field(struct ftrace_event_call *call, char *name)
 	return __find_event_field(head, name);
 }
 
+struct ftrace_event_field *
+trace_find_event_field(struct ftrace_event_call *call, char *name)
+{
+	return find_event_field(call, name);
+}
+
 static int __alloc_pred_stack(struct pred_stack *stack, int n_preds)
 {
 	stack->preds = kzalloc(sizeof(*stack->preds)*(n_preds + 1), GFP_KERNEL);
@@ -1871,6 +1877,52 @@ out_unlock:
 	return err;
 }
 
+/*
+ * Build a filter for @call that isn't attached to it, for users that
+ * match records against their own filter.  Called with event_mutex held.
+ */
+int create_event_filter(struct ftrace_event_call *call, char *filter_str,
+			struct event_filter **filterp)
+{
+	struct filter_parse_state *ps;
+	struct event_filter *filter;
+	int err;
+
+	filter = __alloc_filter();
+	if (!filter)
+		return -ENOMEM;
+
+	err = -ENOMEM;
+	ps = kzalloc(sizeof(*ps), GFP_KERNEL);
+	if (!ps)
+		goto free_filter;
+
+	parse_init(ps, filter_ops, filter_str);
+	err = filter_parse(ps);
+	if (err)
+		goto free_ps;
+
+	err = replace_preds(call, filter, ps, filter_str, false);
+	if (!err)
+		*filterp = filter;
+
+free_ps:
+	filter_opstack_clear(ps);
+	postfix_clear(ps);
+	kfree(ps);
+
+free_filter:
+	if (err)
+		__free_filter(filter);
+
+	return err;
+}
+
+void free_event_filter(struct event_filter *filter)
+{
+	__free_filter(filter);
+}
+
 #ifdef CONFIG_PERF_EVENTS
 
 void ftrace_profile_free_filter(struct perf_event *event)
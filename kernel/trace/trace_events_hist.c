@@ -0,0 +1,778 @@
+/*
+ * Event histograms
+ *
+ * Aggregates the records of a trace event in the kernel instead of
+ * shipping each of them through the ring buffer.  A histogram is set up
+ * by writing its definition to events/<system>/<event>/hist:
+ *
+ *   keys=<field>[,<field>...][:vals=<field>[,<field>...]][:log2=<field>]
+ *	[:size=<entries>][:keep] [if <filter>]
+ *
+ * Every record that passes the optional filter (same syntax as the
+ * event's filter file) is accounted to the entry of its key: a hit count,
+ * the sums of the vals fields and a log2 histogram of the log2 field.  A
+ * key is up to three numeric fields, and "stacktrace" keys on the kernel
+ * stack of the event.  Records are dropped after being accounted, unless
+ * "keep" asks for them to be traced as well.
+ *
+ * Each cpu fills its own open addressed hash table, without locks.
+ * Reading the hist file merges them, biggest hit counts first.  Writing
+ * "clear" zeroes the histogram and writing an empty line removes it.
+ */
+#include <linux/module.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+#include <linux/jhash.h>
+#include <linux/kref.h>
+#include <linux/sort.h>
+#include <linux/slab.h>
+#include <linux/stacktrace.h>
+#include <linux/log2.h>
+#include <asm/local64.h>
+
+#include "trace.h"
+
+#define HIST_KEYS_MAX		3
+#define HIST_VALS_MAX		3
+#define HIST_STACK_DEPTH	8
+#define HIST_STACK_SKIP		4	/* the tracepoint and us */
+#define HIST_KEY_WORDS_MAX	(HIST_KEYS_MAX + HIST_STACK_DEPTH)
+#define HIST_LOG2_BUCKETS	32
+#define HIST_SIZE_DEFAULT	1024
+#define HIST_SIZE_MAX		65536
+
+enum {
+	HIST_ELT_FREE,
+	HIST_ELT_CLAIMED,	/* key being written, maybe by an interrupted context */
+	HIST_ELT_READY,
+};
+
+/*
+ * An entry: the state, key_words of key and nr_counters local64_t
+ * counters, the hit count first, then the vals sums and the log2 buckets.
+ */
+struct hist_elt {
+	unsigned long		state;
+	u64			key[0];
+};
+
+struct hist_field {
+	char			*name;
+	int			offset;
+	int			size;
+	int			is_signed;
+};
+
+struct hist_cpu {
+	void			*elts;
+	local_t			nr;
+	local_t			dropped;
+} ____cacheline_aligned_in_smp;
+
+struct event_hist {
+	struct kref		kref;
+	char			*spec;
+	struct hist_field	keys[HIST_KEYS_MAX];
+	int			nr_keys;
+	bool			stack_key;
+	struct hist_field	vals[HIST_VALS_MAX];
+	int			nr_vals;
+	struct hist_field	log2;
+	bool			has_log2;
+	bool			keep;
+	struct event_filter	*filter;
+	unsigned int		size;
+	unsigned int		key_words;
+	unsigned int		nr_counters;
+	size_t			elt_size;
+	struct hist_cpu		*cpus;
+};
+
+static inline struct hist_elt *hist_elt(struct event_hist *hist, void *elts,
+					unsigned int idx)
+{
+	return elts + idx * hist->elt_size;
+}
+
+static inline local64_t *hist_counters(struct event_hist *hist,
+				       struct hist_elt *elt)
+{
+	return (local64_t *)(elt->key + hist->key_words);
+}
+
+static u64 hist_field_value(struct hist_field *field, void *rec)
+{
+	void *addr = rec + field->offset;
+
+	switch (field->size) {
+	case 1:
+		return field->is_signed ? (u64)*(s8 *)addr : *(u8 *)addr;
+	case 2:
+		return field->is_signed ? (u64)*(s16 *)addr : *(u16 *)addr;
+	case 4:
+		return field->is_signed ? (u64)*(s32 *)addr : *(u32 *)addr;
+	default:
+		return *(u64 *)addr;
+	}
+}
+
+static void hist_build_key(struct event_hist *hist, void *rec, u64 *key)
+{
+	int i;
+
+	for (i = 0; i < hist->nr_keys; i++)
+		key[i] = hist_field_value(&hist->keys[i], rec);
+
+#ifdef CONFIG_STACKTRACE
+	if (hist->stack_key) {
+		unsigned long entries[HIST_STACK_DEPTH] = { 0, };
+		struct stack_trace trace = {
+			.max_entries	= HIST_STACK_DEPTH,
+			.entries	= entries,
+			.skip		= HIST_STACK_SKIP,
+		};
+
+		save_stack_trace(&trace);
+		for (i = 0; i < HIST_STACK_DEPTH; i++)
+			key[hist->nr_keys + i] = entries[i];
+	}
+#endif
+}
+
+/*
+ * Find the entry of @key in this cpu's table, or claim a free one for it.
+ * Only this cpu writes the table, but an interrupt or NMI may do so while
+ * we are at it; a slot it claimed and hasn't finished is skipped, which
+ * at worst splits a key over two entries that the read side merges.
+ */
+static struct hist_elt *
+hist_find_or_insert(struct event_hist *hist, struct hist_cpu *hc, u64 *key)
+{
+	size_t key_size = hist->key_words * sizeof(u64);
+	unsigned int mask = hist->size - 1;
+	unsigned int idx, i;
+	struct hist_elt *elt;
+
+	idx = jhash2((u32 *)key, key_size / sizeof(u32), 0);
+
+	for (i = 0; i < hist->size; i++) {
+		elt = hist_elt(hist, hc->elts, (idx + i) & mask);
+
+		switch (ACCESS_ONCE(elt->state)) {
+		case HIST_ELT_READY:
+			if (!memcmp(elt->key, key, key_size))
+				return elt;
+			break;
+		case HIST_ELT_FREE:
+			/* keep probe sequences short */
+			if (local_read(&hc->nr) >= hist->size - hist->size / 4)
+				return NULL;
+			if (cmpxchg_local(&elt->state, HIST_ELT_FREE,
+					  HIST_ELT_CLAIMED) != HIST_ELT_FREE)
+				break;
+			memcpy(elt->key, key, key_size);
+			barrier();
+			elt->state = HIST_ELT_READY;
+			local_inc(&hc->nr);
+			return elt;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Called for every record of an event with a histogram, from
+ * filter_check_discard().  Returns whether the record should be dropped.
+ */
+bool event_hist_update(struct ftrace_event_call *call, void *rec)
+{
+	u64 key[HIST_KEY_WORDS_MAX];
+	struct event_hist *hist;
+	struct hist_elt *elt;
+	struct hist_cpu *hc;
+	local64_t *counters;
+	int i;
+
+	hist = rcu_dereference_sched(call->hist);
+	if (!hist)
+		return false;
+
+	if (hist->filter && !filter_match_preds(hist->filter, rec))
+		return !hist->keep;
+
+	hc = &hist->cpus[smp_processor_id()];
+
+	hist_build_key(hist, rec, key);
+	elt = hist_find_or_insert(hist, hc, key);
+	if (!elt) {
+		local_inc(&hc->dropped);
+		return !hist->keep;
+	}
+
+	counters = hist_counters(hist, elt);
+	local64_inc(&counters[0]);
+	for (i = 0; i < hist->nr_vals; i++)
+		local64_add(hist_field_value(&hist->vals[i], rec),
+			    &counters[1 + i]);
+	if (hist->has_log2) {
+		u64 val = hist_field_value(&hist->log2, rec);
+		int bucket = val ? min(ilog2(val) + 1, HIST_LOG2_BUCKETS - 1) : 0;
+
+		local64_inc(&counters[1 + hist->nr_vals + bucket]);
+	}
+
+	return !hist->keep;
+}
+
+static void event_hist_free(struct event_hist *hist)
+{
+	int i;
+
+	if (hist->cpus) {
+		for_each_possible_cpu(i)
+			vfree(hist->cpus[i].elts);
+		kfree(hist->cpus);
+	}
+	for (i = 0; i < hist->nr_keys; i++)
+		kfree(hist->keys[i].name);
+	for (i = 0; i < hist->nr_vals; i++)
+		kfree(hist->vals[i].name);
+	kfree(hist->log2.name);
+	if (hist->filter)
+		free_event_filter(hist->filter);
+	kfree(hist->spec);
+	kfree(hist);
+}
+
+static void event_hist_release(struct kref *kref)
+{
+	event_hist_free(container_of(kref, struct event_hist, kref));
+}
+
+static int hist_field_init(struct ftrace_event_call *call,
+			   struct hist_field *field, char *name)
+{
+	struct ftrace_event_field *f;
+
+	f = trace_find_event_field(call, name);
+	if (!f || f->filter_type != FILTER_OTHER ||
+	    (f->size != 1 && f->size != 2 && f->size != 4 && f->size != 8))
+		return -EINVAL;
+
+	field->name = kstrdup(name, GFP_KERNEL);
+	if (!field->name)
+		return -ENOMEM;
+	field->offset = f->offset;
+	field->size = f->size;
+	field->is_signed = f->is_signed;
+
+	return 0;
+}
+
+static int hist_parse_keys(struct ftrace_event_call *call,
+			   struct event_hist *hist, char *str)
+{
+	char *name;
+	int ret;
+
+	while ((name = strsep(&str, ",")) != NULL) {
+		if (!strcmp(name, "stacktrace")) {
+			if (!IS_ENABLED(CONFIG_STACKTRACE) || hist->stack_key)
+				return -EINVAL;
+			hist->stack_key = true;
+			continue;
+		}
+		if (hist->nr_keys == HIST_KEYS_MAX)
+			return -EINVAL;
+		ret = hist_field_init(call, &hist->keys[hist->nr_keys], name);
+		if (ret)
+			return ret;
+		hist->nr_keys++;
+	}
+
+	return 0;
+}
+
+static int hist_parse_vals(struct ftrace_event_call *call,
+			   struct event_hist *hist, char *str)
+{
+	char *name;
+	int ret;
+
+	while ((name = strsep(&str, ",")) != NULL) {
+		if (hist->nr_vals == HIST_VALS_MAX)
+			return -EINVAL;
+		ret = hist_field_init(call, &hist->vals[hist->nr_vals], name);
+		if (ret)
+			return ret;
+		hist->nr_vals++;
+	}
+
+	return 0;
+}
+
+static struct event_hist *
+event_hist_create(struct ftrace_event_call *call, const char *spec)
+{
+	struct event_hist *hist;
+	char *buf, *str, *tok, *filter_str;
+	unsigned long size;
+	int cpu, ret = -ENOMEM;
+
+	hist = kzalloc(sizeof(*hist), GFP_KERNEL);
+	if (!hist)
+		return ERR_PTR(-ENOMEM);
+	kref_init(&hist->kref);
+	hist->size = HIST_SIZE_DEFAULT;
+
+	hist->spec = kstrdup(spec, GFP_KERNEL);
+	buf = kstrdup(spec, GFP_KERNEL);
+	if (!hist->spec || !buf)
+		goto out_free;
+
+	str = buf;
+	filter_str = strstr(str, " if ");
+	if (filter_str) {
+		*filter_str = '\0';
+		filter_str += 4;
+	}
+
+	ret = -EINVAL;
+	while ((tok = strsep(&str, ":")) != NULL) {
+		char *val = tok;
+
+		tok = strsep(&val, "=");
+		if (!strcmp(tok, "keep") && !val)
+			hist->keep = true;
+		else if (!val || !*val)
+			goto out_free;
+		else if (!strcmp(tok, "keys"))
+			ret = hist_parse_keys(call, hist, val);
+		else if (!strcmp(tok, "vals"))
+			ret = hist_parse_vals(call, hist, val);
+		else if (!strcmp(tok, "log2") && !hist->has_log2) {
+			ret = hist_field_init(call, &hist->log2, val);
+			hist->has_log2 = !ret;
+		} else if (!strcmp(tok, "size")) {
+			ret = kstrtoul(val, 0, &size);
+			if (!ret && (size < 1 || size > HIST_SIZE_MAX))
+				ret = -EINVAL;
+			if (!ret)
+				hist->size = roundup_pow_of_two(size);
+		} else
+			ret = -EINVAL;
+		if (ret)
+			goto out_free;
+	}
+
+	ret = -EINVAL;
+	if (!hist->nr_keys && !hist->stack_key)
+		goto out_free;
+
+	if (filter_str) {
+		ret = create_event_filter(call, filter_str, &hist->filter);
+		if (ret)
+			goto out_free;
+	}
+
+	hist->key_words = hist->nr_keys +
+			  (hist->stack_key ? HIST_STACK_DEPTH : 0);
+	hist->nr_counters = 1 + hist->nr_vals +
+			    (hist->has_log2 ? HIST_LOG2_BUCKETS : 0);
+	hist->elt_size = sizeof(struct hist_elt) +
+			 hist->key_words * sizeof(u64) +
+			 hist->nr_counters * sizeof(local64_t);
+
+	ret = -ENOMEM;
+	hist->cpus = kcalloc(nr_cpu_ids, sizeof(*hist->cpus), GFP_KERNEL);
+	if (!hist->cpus)
+		goto out_free;
+	for_each_possible_cpu(cpu) {
+		hist->cpus[cpu].elts = vzalloc_node(hist->size * hist->elt_size,
+						    cpu_to_node(cpu));
+		if (!hist->cpus[cpu].elts)
+			goto out_free;
+	}
+
+	kfree(buf);
+	return hist;
+
+out_free:
+	kfree(buf);
+	event_hist_free(hist);
+	return ERR_PTR(ret);
+}
+
+/* Called with event_mutex held. */
+static void event_hist_replace(struct ftrace_event_call *call,
+			       struct event_hist *hist)
+{
+	struct event_hist *old;
+
+	old = rcu_dereference_protected(call->hist,
+					lockdep_is_held(&event_mutex));
+	rcu_assign_pointer(call->hist, hist);
+	if (hist)
+		call->flags |= TRACE_EVENT_FL_HIST;
+	else
+		call->flags &= ~TRACE_EVENT_FL_HIST;
+
+	if (old) {
+		/* event_hist_update() runs with preemption disabled */
+		synchronize_sched();
+		kref_put(&old->kref, event_hist_release);
+	}
+}
+
+/* Called with event_mutex held, when the event goes away. */
+void event_hist_destroy(struct ftrace_event_call *call)
+{
+	event_hist_replace(call, NULL);
+}
+
+static bool event_call_alive(struct ftrace_event_call *call)
+{
+	struct ftrace_event_call *pos;
+
+	list_for_each_entry(pos, &ftrace_events, list) {
+		if (pos == call)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Reading: a snapshot of the merged tables, sorted by hit count.
+ */
+struct hist_snapshot {
+	struct event_hist	*hist;
+	void			*elts;
+	struct hist_elt		**sorted;
+	unsigned int		nr;
+	unsigned long		dropped;
+	u64			hits;
+};
+
+static struct hist_snapshot *hist_snapshot_cmp_snap;
+
+static int hist_snapshot_cmp(const void *a, const void *b)
+{
+	struct event_hist *hist = hist_snapshot_cmp_snap->hist;
+	u64 l = local64_read(hist_counters(hist, *(struct hist_elt **)a));
+	u64 r = local64_read(hist_counters(hist, *(struct hist_elt **)b));
+
+	return l < r ? 1 : l > r ? -1 : 0;
+}
+
+static void hist_snapshot_add(struct hist_snapshot *snap, unsigned int size,
+			      struct hist_elt *src)
+{
+	struct event_hist *hist = snap->hist;
+	size_t key_size = hist->key_words * sizeof(u64);
+	unsigned int idx, i;
+	struct hist_elt *elt;
+	local64_t *from, *to;
+
+	idx = jhash2((u32 *)src->key, key_size / sizeof(u32), 0);
+	for (i = 0; i < size; i++) {
+		elt = hist_elt(hist, snap->elts, (idx + i) & (size - 1));
+		if (!elt->state) {
+			elt->state = HIST_ELT_READY;
+			memcpy(elt->key, src->key, key_size);
+			snap->sorted[snap->nr++] = elt;
+			break;
+		}
+		if (!memcmp(elt->key, src->key, key_size))
+			break;
+	}
+
+	from = hist_counters(hist, src);
+	to = hist_counters(hist, elt);
+	for (i = 0; i < hist->nr_counters; i++)
+		local64_add(local64_read(&from[i]), &to[i]);
+}
+
+static struct hist_snapshot *hist_snapshot_create(struct event_hist *hist)
+{
+	struct hist_snapshot *snap;
+	unsigned int total = 0, size, i;
+	int cpu;
+
+	snap = kzalloc(sizeof(*snap), GFP_KERNEL);
+	if (!snap)
+		return NULL;
+	snap->hist = hist;
+
+	for_each_possible_cpu(cpu) {
+		total += local_read(&hist->cpus[cpu].nr);
+		snap->dropped += local_read(&hist->cpus[cpu].dropped);
+	}
+	size = roundup_pow_of_two(max(2 * total, 2U));
+
+	snap->elts = vzalloc(size * hist->elt_size);
+	snap->sorted = vmalloc(max(total, 1U) * sizeof(*snap->sorted));
+	if (!snap->elts || !snap->sorted)
+		goto out_free;
+
+	for_each_possible_cpu(cpu) {
+		struct hist_cpu *hc = &hist->cpus[cpu];
+
+		for (i = 0; i < hist->size; i++) {
+			struct hist_elt *elt = hist_elt(hist, hc->elts, i);
+
+			/* entries added since we counted them wait for the next read */
+			if (ACCESS_ONCE(elt->state) != HIST_ELT_READY ||
+			    snap->nr == total)
+				continue;
+			smp_rmb();
+			hist_snapshot_add(snap, size, elt);
+		}
+	}
+
+	for (i = 0; i < snap->nr; i++)
+		snap->hits += local64_read(hist_counters(hist, snap->sorted[i]));
+
+	hist_snapshot_cmp_snap = snap;
+	sort(snap->sorted, snap->nr, sizeof(*snap->sorted),
+	     hist_snapshot_cmp, NULL);
+
+	return snap;
+
+out_free:
+	vfree(snap->sorted);
+	vfree(snap->elts);
+	kfree(snap);
+	return NULL;
+}
+
+static void hist_snapshot_free(struct hist_snapshot *snap)
+{
+	kref_put(&snap->hist->kref, event_hist_release);
+	vfree(snap->sorted);
+	vfree(snap->elts);
+	kfree(snap);
+}
+
+static void hist_show_key(struct seq_file *m, struct event_hist *hist,
+			  struct hist_elt *elt)
+{
+	int i;
+
+	seq_puts(m, "{");
+	for (i = 0; i < hist->nr_keys; i++) {
+		if (hist->keys[i].is_signed)
+			seq_printf(m, "%s %s: %10lld", i ? "," : "",
+				   hist->keys[i].name, (s64)elt->key[i]);
+		else
+			seq_printf(m, "%s %s: %10llu", i ? "," : "",
+				   hist->keys[i].name, elt->key[i]);
+	}
+	if (hist->stack_key) {
+		seq_printf(m, "%s stacktrace:\n", hist->nr_keys ? "," : "");
+		for (i = 0; i < HIST_STACK_DEPTH; i++) {
+			unsigned long ip = elt->key[hist->nr_keys + i];
+
+			if (!ip)
+				break;
+			seq_printf(m, "         %pS\n", (void *)ip);
+		}
+	}
+	seq_puts(m, " }");
+}
+
+static int hist_seq_show(struct seq_file *m, void *v)
+{
+	struct hist_snapshot *snap = m->private;
+	struct event_hist *hist = snap->hist;
+	struct hist_elt *elt;
+	local64_t *counters;
+	int i;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_printf(m, "# event histogram\n#\n# %s\n#\n\n", hist->spec);
+		return 0;
+	}
+
+	if (v == (void *)m) {
+		seq_printf(m, "\nTotals:\n    Hits: %llu\n    Entries: %u\n"
+			   "    Dropped: %lu\n", snap->hits, snap->nr,
+			   snap->dropped);
+		return 0;
+	}
+
+	elt = *(struct hist_elt **)v;
+	counters = hist_counters(hist, elt);
+
+	hist_show_key(m, hist, elt);
+	seq_printf(m, " hitcount: %10llu", (u64)local64_read(&counters[0]));
+	for (i = 0; i < hist->nr_vals; i++)
+		seq_printf(m, "  %s: %10llu", hist->vals[i].name,
+			   (u64)local64_read(&counters[1 + i]));
+	seq_putc(m, '\n');
+
+	if (hist->has_log2) {
+		local64_t *buckets = &counters[1 + hist->nr_vals];
+
+		for (i = 0; i < HIST_LOG2_BUCKETS; i++) {
+			u64 count = local64_read(&buckets[i]);
+
+			if (!count)
+				continue;
+			if (i == HIST_LOG2_BUCKETS - 1)
+				seq_printf(m, "    %s >= %llu: %llu\n",
+					   hist->log2.name, 1ULL << (i - 1),
+					   count);
+			else
+				seq_printf(m, "    %s < %llu: %llu\n",
+					   hist->log2.name, i ? 1ULL << i : 1,
+					   count);
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Position 0 is the header, 1..nr the entries, and nr + 1 the totals,
+ * for which the seq_file itself serves as a token.
+ */
+static void *hist_seq_start(struct seq_file *m, loff_t *pos)
+{
+	struct hist_snapshot *snap = m->private;
+
+	if (*pos == 0)
+		return SEQ_START_TOKEN;
+	if (*pos <= snap->nr)
+		return &snap->sorted[*pos - 1];
+	if (*pos == snap->nr + 1)
+		return m;
+	return NULL;
+}
+
+static void *hist_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	(*pos)++;
+	return hist_seq_start(m, pos);
+}
+
+static void hist_seq_stop(struct seq_file *m, void *v)
+{
+}
+
+static const struct seq_operations hist_seq_ops = {
+	.start		= hist_seq_start,
+	.next		= hist_seq_next,
+	.stop		= hist_seq_stop,
+	.show		= hist_seq_show,
+};
+
+static int event_hist_open(struct inode *inode, struct file *file)
+{
+	struct ftrace_event_call *call = inode->i_private;
+	struct hist_snapshot *snap = NULL;
+	struct event_hist *hist;
+	int ret;
+
+	if (!(file->f_mode & FMODE_READ))
+		return 0;
+
+	mutex_lock(&event_mutex);
+	hist = event_call_alive(call) ?
+		rcu_dereference_protected(call->hist,
+					  lockdep_is_held(&event_mutex)) : NULL;
+	if (hist) {
+		kref_get(&hist->kref);
+		snap = hist_snapshot_create(hist);
+		if (!snap)
+			kref_put(&hist->kref, event_hist_release);
+	}
+	mutex_unlock(&event_mutex);
+
+	if (!hist)
+		return -ENOENT;
+	if (!snap)
+		return -ENOMEM;
+
+	ret = seq_open(file, &hist_seq_ops);
+	if (ret) {
+		hist_snapshot_free(snap);
+		return ret;
+	}
+	((struct seq_file *)file->private_data)->private = snap;
+
+	return 0;
+}
+
+static int event_hist_release_file(struct inode *inode, struct file *file)
+{
+	struct seq_file *m;
+
+	if (!(file->f_mode & FMODE_READ))
+		return 0;
+
+	m = file->private_data;
+	hist_snapshot_free(m->private);
+	return seq_release(inode, file);
+}
+
+static ssize_t event_hist_write(struct file *file, const char __user *ubuf,
+				size_t cnt, loff_t *ppos)
+{
+	struct ftrace_event_call *call = file->f_path.dentry->d_inode->i_private;
+	struct event_hist *hist = NULL, *cur;
+	char *buf, *spec;
+	int ret;
+
+	if (cnt >= PAGE_SIZE)
+		return -EINVAL;
+
+	buf = memdup_user(ubuf, cnt + 1);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+	buf[cnt] = '\0';
+	spec = strstrip(buf);
+
+	mutex_lock(&event_mutex);
+	ret = -ENODEV;
+	if (!event_call_alive(call))
+		goto out_unlock;
+
+	if (!strcmp(spec, "clear")) {
+		cur = rcu_dereference_protected(call->hist,
+						lockdep_is_held(&event_mutex));
+		ret = 0;
+		if (!cur)
+			goto out_unlock;
+		spec = cur->spec;
+	}
+
+	if (*spec) {
+		hist = event_hist_create(call, spec);
+		ret = PTR_ERR(hist);
+		if (IS_ERR(hist))
+			goto out_unlock;
+	}
+
+	event_hist_replace(call, hist);
+	ret = 0;
+
+out_unlock:
+	mutex_unlock(&event_mutex);
+	kfree(buf);
+
+	if (ret)
+		return ret;
+	*ppos += cnt;
+	return cnt;
+}
+
+const struct file_operations event_hist_fops = {
+	.open		= event_hist_open,
+	.read		= seq_read,
+	.write		= event_hist_write,
+	.llseek		= seq_lseek,
+	.release	= event_hist_release_file,
+};
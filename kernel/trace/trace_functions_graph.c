@@ -106,6 +106,14 @@ ftrace_push_return_trace(unsigned long ret, unsigned long func, int *depth,
 	 */
 	smp_rmb();
 
+	/*
+	 * Below a function in set_graph_notrace, curr_ret_stack is
+	 * offset by -FTRACE_NOTRACE_DEPTH, and nothing is traced until
+	 * that function returns.
+	 */
+	if (current->curr_ret_stack < -1)
+		return -EBUSY;
+
 	/* The return trace stack is full */
 	if (current->curr_ret_stack == FTRACE_RETFUNC_DEPTH - 1) {
 		atomic_inc(&current->trace_overrun);
@@ -115,13 +123,15 @@ ftrace_push_return_trace(unsigned long ret, unsigned long func, int *depth,
 	calltime = trace_clock_local();
 
 	index = ++current->curr_ret_stack;
+	if (ftrace_graph_notrace_addr(func))
+		current->curr_ret_stack -= FTRACE_NOTRACE_DEPTH;
 	barrier();
 	current->ret_stack[index].ret = ret;
 	current->ret_stack[index].func = func;
 	current->ret_stack[index].calltime = calltime;
 	current->ret_stack[index].subtime = 0;
 	current->ret_stack[index].fp = frame_pointer;
-	*depth = index;
+	*depth = current->curr_ret_stack;
 
 	return 0;
 }
@@ -135,6 +145,10 @@ ftrace_pop_return_trace(struct ftrace_graph_ret *trace, unsigned long *ret,
 
 	index = current->curr_ret_stack;
 
+	/* Returning from a function in set_graph_notrace */
+	if (index < -1)
+		index += FTRACE_NOTRACE_DEPTH;
+
 	if (unlikely(index < 0)) {
 		ftrace_graph_stop();
 		WARN_ON(1);
@@ -186,9 +200,14 @@ unsigned long ftrace_return_to_handler(unsigned long frame_pointer)
 
 	ftrace_pop_return_trace(&trace, &ret, frame_pointer);
 	trace.rettime = trace_clock_local();
-	ftrace_graph_return(&trace);
-	barrier();
-	current->curr_ret_stack--;
+	if (likely(current->curr_ret_stack >= 0)) {
+		ftrace_graph_return(&trace);
+		barrier();
+		current->curr_ret_stack--;
+	} else {
+		/* Leaving a set_graph_notrace function, trace again */
+		current->curr_ret_stack += FTRACE_NOTRACE_DEPTH - 1;
+	}
 
 	if (unlikely(!ret)) {
 		ftrace_graph_stop();
@@ -233,6 +252,32 @@ static inline int ftrace_graph_ignore_irqs(void)
 	return in_irq();
 }
 
+/*
+ * Returns 1 to record a function and hook its return: the task is
+ * traced and the function is nested in, or is, a function to trace.
+ * A negative depth means we are below a function in set_graph_notrace.
+ *
+ * A function in set_graph_notrace isn't recorded, but its return is
+ * hooked (-1): ftrace_push_return_trace() hides everything it calls
+ * until then.  Archs that push the return before calling us hand us
+ * the offset depth for it, so check it first.
+ */
+static inline int trace_graph_want(struct ftrace_graph_ent *trace)
+{
+	if (ftrace_graph_notrace_addr(trace->func))
+		return -1;
+
+	if (!ftrace_trace_task(current))
+		return 0;
+
+	/* trace it when it is-nested-in or is a function enabled. */
+	if (!(trace->depth || ftrace_graph_addr(trace->func)) ||
+	      ftrace_graph_ignore_irqs() || trace->depth < 0)
+		return 0;
+
+	return 1;
+}
+
 int trace_graph_entry(struct ftrace_graph_ent *trace)
 {
 	struct trace_array *tr = graph_array;
@@ -243,13 +288,9 @@ int trace_graph_entry(struct ftrace_graph_ent *trace)
 	int cpu;
 	int pc;
 
-	if (!ftrace_trace_task(current))
-		return 0;
-
-	/* trace it when it is-nested-in or is a function enabled. */
-	if (!(trace->depth || ftrace_graph_addr(trace->func)) ||
-	      ftrace_graph_ignore_irqs())
-		return 0;
+	ret = trace_graph_want(trace);
+	if (ret <= 0)
+		return !!ret;
 
 	local_irq_save(flags);
 	cpu = raw_smp_processor_id();
@@ -268,12 +309,13 @@ int trace_graph_entry(struct ftrace_graph_ent *trace)
 	return ret;
 }
 
+/*
+ * With tracing_thresh set, no entry is recorded and only the returns
+ * of the functions that ran for longer are, whatever their depth.
+ */
 int trace_graph_thresh_entry(struct ftrace_graph_ent *trace)
 {
-	if (tracing_thresh)
-		return 1;
-	else
-		return trace_graph_entry(trace);
+	return !!trace_graph_want(trace);
 }
 
 static void
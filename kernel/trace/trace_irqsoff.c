@@ -15,6 +15,7 @@
 #include <linux/module.h>
 #include <linux/ftrace.h>
 #include <linux/fs.h>
+#include <linux/latency_hist.h>
 
 #include "trace.h"
 
@@ -424,6 +425,11 @@ stop_critical_timing(unsigned long ip, unsigned long parent_ip)
 /* start and stop critical timings used to for stoppage (in idle) */
 void start_critical_timings(void)
 {
+	if (irqs_disabled())
+		latency_hist_start(LATENCY_HIST_IRQSOFF);
+	if (preempt_count())
+		latency_hist_start(LATENCY_HIST_PREEMPTOFF);
+
 	if (preempt_trace() || irq_trace())
 		start_critical_timing(CALLER_ADDR0, CALLER_ADDR1);
 }
@@ -431,6 +437,9 @@ EXPORT_SYMBOL_GPL(start_critical_timings);
 
 void stop_critical_timings(void)
 {
+	latency_hist_stop(LATENCY_HIST_IRQSOFF);
+	latency_hist_stop(LATENCY_HIST_PREEMPTOFF);
+
 	if (preempt_trace() || irq_trace())
 		stop_critical_timing(CALLER_ADDR0, CALLER_ADDR1);
 }
@@ -440,12 +449,14 @@ EXPORT_SYMBOL_GPL(stop_critical_timings);
 #ifdef CONFIG_PROVE_LOCKING
 void time_hardirqs_on(unsigned long a0, unsigned long a1)
 {
+	latency_hist_stop(LATENCY_HIST_IRQSOFF);
 	if (!preempt_trace() && irq_trace())
 		stop_critical_timing(a0, a1);
 }
 
 void time_hardirqs_off(unsigned long a0, unsigned long a1)
 {
+	latency_hist_start(LATENCY_HIST_IRQSOFF);
 	if (!preempt_trace() && irq_trace())
 		start_critical_timing(a0, a1);
 }
@@ -473,6 +484,7 @@ inline void print_irqtrace_events(struct task_struct *curr)
  */
 void trace_hardirqs_on(void)
 {
+	latency_hist_stop(LATENCY_HIST_IRQSOFF);
 	if (!preempt_trace() && irq_trace())
 		stop_critical_timing(CALLER_ADDR0, CALLER_ADDR1);
 }
@@ -480,6 +492,7 @@ EXPORT_SYMBOL(trace_hardirqs_on);
 
 void trace_hardirqs_off(void)
 {
+	latency_hist_start(LATENCY_HIST_IRQSOFF);
 	if (!preempt_trace() && irq_trace())
 		start_critical_timing(CALLER_ADDR0, CALLER_ADDR1);
 }
@@ -487,6 +500,7 @@ EXPORT_SYMBOL(trace_hardirqs_off);
 
 void trace_hardirqs_on_caller(unsigned long caller_addr)
 {
+	latency_hist_stop(LATENCY_HIST_IRQSOFF);
 	if (!preempt_trace() && irq_trace())
 		stop_critical_timing(CALLER_ADDR0, caller_addr);
 }
@@ -494,6 +508,7 @@ EXPORT_SYMBOL(trace_hardirqs_on_caller);
 
 void trace_hardirqs_off_caller(unsigned long caller_addr)
 {
+	latency_hist_start(LATENCY_HIST_IRQSOFF);
 	if (!preempt_trace() && irq_trace())
 		start_critical_timing(CALLER_ADDR0, caller_addr);
 }
@@ -505,12 +520,14 @@ EXPORT_SYMBOL(trace_hardirqs_off_caller);
 #ifdef CONFIG_PREEMPT_TRACER
 void trace_preempt_on(unsigned long a0, unsigned long a1)
 {
+	latency_hist_stop(LATENCY_HIST_PREEMPTOFF);
 	if (preempt_trace() && !irq_trace())
 		stop_critical_timing(a0, a1);
 }
 
 void trace_preempt_off(unsigned long a0, unsigned long a1)
 {
+	latency_hist_start(LATENCY_HIST_PREEMPTOFF);
 	if (preempt_trace() && !irq_trace())
 		start_critical_timing(a0, a1);
 }
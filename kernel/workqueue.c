@@ -17,8 +17,8 @@
  * This is the generic async execution mechanism.  Work items as are
  * executed in process context.  The worker pool is shared and
  * automatically managed.  There is one worker pool for each CPU and
- * one extra for works which are better served by workers which are
- * not bound to any specific CPU.
+ * one extra for each NUMA node for works which are better served by
+ * workers which are not bound to any specific CPU.
  *
  * Please read Documentation/workqueue.txt for details.
  */
@@ -41,6 +41,7 @@
 #include <linux/debug_locks.h>
 #include <linux/lockdep.h>
 #include <linux/idr.h>
+#include <linux/moduleparam.h>
 
 #include "workqueue_sched.h"
 
@@ -112,6 +113,8 @@ enum {
  * F: wq->flush_mutex protected.
  *
  * W: workqueue_lock protected.
+ *
+ * U: wq_unbound_mutex protected.
  */
 
 struct global_cwq;
@@ -138,6 +141,7 @@ struct worker {
 	unsigned int		flags;		/* X: flags */
 	int			id;		/* I: worker id */
 	struct work_struct	rebind_work;	/* L: rebind worker to cpu */
+	unsigned int		attrs_gen;	/* U: unbound attrs applied */
 };
 
 /*
@@ -269,6 +273,23 @@ EXPORT_SYMBOL_GPL(system_nrt_freezable_wq);
 	for (i = 0; i < BUSY_WORKER_HASH_SIZE; i++)			\
 		hlist_for_each_entry(worker, pos, &gcwq->busy_hash[i], hentry)
 
+/* is @cpu one of the WORK_CPU_UNBOUND + node gcwq IDs? */
+static inline bool gcwq_cpu_unbound(unsigned int cpu)
+{
+	return cpu >= WORK_CPU_UNBOUND && cpu < WORK_CPU_UNBOUND + nr_node_ids;
+}
+
+/*
+ * Map @cpu, either a cpu number or WORK_CPU_UNBOUND for "don't care",
+ * to the ID of the unbound gcwq of its node.
+ */
+static inline unsigned int unbound_gcwq_cpu(unsigned int cpu)
+{
+	if (cpu >= nr_cpu_ids)
+		cpu = raw_smp_processor_id();
+	return WORK_CPU_UNBOUND + cpu_to_node(cpu);
+}
+
 static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
 				  unsigned int sw)
 {
@@ -280,6 +301,9 @@ static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
 		}
 		if (sw & 2)
 			return WORK_CPU_UNBOUND;
+	} else if (sw & 4) {
+		if (gcwq_cpu_unbound(++cpu))
+			return cpu;
 	}
 	return WORK_CPU_NONE;
 }
@@ -287,31 +311,41 @@ static inline int __next_gcwq_cpu(int cpu, const struct cpumask *mask,
 static inline int __next_wq_cpu(int cpu, const struct cpumask *mask,
 				struct workqueue_struct *wq)
 {
-	return __next_gcwq_cpu(cpu, mask, !(wq->flags & WQ_UNBOUND) ? 1 : 2);
+	unsigned int sw;
+
+	if (!(wq->flags & WQ_UNBOUND))
+		sw = 1;
+	else if (wq->flags & WQ_ORDERED)
+		sw = 2;
+	else
+		sw = 6;
+	return __next_gcwq_cpu(cpu, mask, sw);
 }
 
 /*
  * CPU iterators
  *
- * An extra gcwq is defined for an invalid cpu number
- * (WORK_CPU_UNBOUND) to host workqueues which are not bound to any
- * specific CPU.  The following iterators are similar to
- * for_each_*_cpu() iterators but also considers the unbound gcwq.
+ * Extra gcwqs are defined for invalid cpu numbers starting at
+ * WORK_CPU_UNBOUND, one per NUMA node, to host workqueues which are
+ * not bound to any specific CPU.  The following iterators are
+ * similar to for_each_*_cpu() iterators but also consider the
+ * unbound gcwqs.
  *
- * for_each_gcwq_cpu()		: possible CPUs + WORK_CPU_UNBOUND
- * for_each_online_gcwq_cpu()	: online CPUs + WORK_CPU_UNBOUND
+ * for_each_gcwq_cpu()		: possible CPUs + unbound gcwqs
+ * for_each_online_gcwq_cpu()	: online CPUs + unbound gcwqs
  * for_each_cwq_cpu()		: possible CPUs for bound workqueues,
- *				  WORK_CPU_UNBOUND for unbound workqueues
+ *				  unbound gcwqs for unbound workqueues,
+ *				  WORK_CPU_UNBOUND for ordered workqueues
  */
 #define for_each_gcwq_cpu(cpu)						\
-	for ((cpu) = __next_gcwq_cpu(-1, cpu_possible_mask, 3);		\
+	for ((cpu) = __next_gcwq_cpu(-1, cpu_possible_mask, 7);		\
 	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_gcwq_cpu((cpu), cpu_possible_mask, 3))
+	     (cpu) = __next_gcwq_cpu((cpu), cpu_possible_mask, 7))
 
 #define for_each_online_gcwq_cpu(cpu)					\
-	for ((cpu) = __next_gcwq_cpu(-1, cpu_online_mask, 3);		\
+	for ((cpu) = __next_gcwq_cpu(-1, cpu_online_mask, 7);		\
 	     (cpu) < WORK_CPU_NONE;					\
-	     (cpu) = __next_gcwq_cpu((cpu), cpu_online_mask, 3))
+	     (cpu) = __next_gcwq_cpu((cpu), cpu_online_mask, 7))
 
 #define for_each_cwq_cpu(cpu, wq)					\
 	for ((cpu) = __next_wq_cpu(-1, cpu_possible_mask, (wq));	\
@@ -448,31 +482,60 @@ static DEFINE_PER_CPU(struct global_cwq, global_cwq);
 static DEFINE_PER_CPU_SHARED_ALIGNED(atomic_t, gcwq_nr_running);
 
 /*
- * Global cpu workqueue and nr_running counter for unbound gcwq.  The
- * gcwq is always online, has GCWQ_DISASSOCIATED set, and all its
+ * Global cpu workqueues and nr_running counter for unbound gcwqs.
+ * There's one unbound gcwq per NUMA node, allocated during init.
+ * They're always online, have GCWQ_DISASSOCIATED set, and all their
  * workers have WORKER_UNBOUND set.
  */
-static struct global_cwq unbound_global_cwq;
+static struct global_cwq *unbound_global_cwq;
 static atomic_t unbound_gcwq_nr_running = ATOMIC_INIT(0);	/* always 0 */
 
+/*
+ * Attributes of unbound workers.  A worker of the unbound gcwq of a
+ * node is allowed to run on the cpus of the node which are also in
+ * wq_unbound_cpumask, or on any cpu in wq_unbound_cpumask if there's
+ * none, at wq_unbound_nice.  Changes bump wq_unbound_attrs_gen and
+ * each worker applies them to itself on its next wake up.
+ */
+static DEFINE_MUTEX(wq_unbound_mutex);
+static struct cpumask wq_unbound_cpumask;	/* U: allowed cpus */
+static struct cpumask wq_unbound_scratch;	/* U: scratch mask */
+static int wq_unbound_nice;			/* U: nice level */
+static unsigned int wq_unbound_attrs_gen;	/* U: attrs generation */
+
 static int worker_thread(void *__worker);
 
 static struct global_cwq *get_gcwq(unsigned int cpu)
 {
-	if (cpu != WORK_CPU_UNBOUND)
+	if (cpu < WORK_CPU_UNBOUND)
 		return &per_cpu(global_cwq, cpu);
 	else
-		return &unbound_global_cwq;
+		return &unbound_global_cwq[cpu - WORK_CPU_UNBOUND];
 }
 
 static atomic_t *get_gcwq_nr_running(unsigned int cpu)
 {
-	if (cpu != WORK_CPU_UNBOUND)
+	if (cpu < WORK_CPU_UNBOUND)
 		return &per_cpu(gcwq_nr_running, cpu);
 	else
 		return &unbound_gcwq_nr_running;
 }
 
+/*
+ * Unbound workqueues have a cwq per node laid out in a single chunk,
+ * each at an offset aligned according to WORK_STRUCT_FLAG_BITS.
+ * Ordered ones have only one, which lives on WORK_CPU_UNBOUND, so
+ * that all their works are executed by the same gcwq.
+ */
+#define CWQ_ALIGN	max_t(size_t, 1 << WORK_STRUCT_FLAG_BITS,	\
+			      __alignof__(unsigned long long))
+#define CWQ_STRIDE	ALIGN(sizeof(struct cpu_workqueue_struct), CWQ_ALIGN)
+
+static unsigned int wq_nr_unbound_cwqs(struct workqueue_struct *wq)
+{
+	return wq->flags & WQ_ORDERED ? 1 : nr_node_ids;
+}
+
 static struct cpu_workqueue_struct *get_cwq(unsigned int cpu,
 					    struct workqueue_struct *wq)
 {
@@ -484,8 +547,12 @@ static struct cpu_workqueue_struct *get_cwq(unsigned int cpu,
 			return wq->cpu_wq.single;
 #endif
 		}
-	} else if (likely(cpu == WORK_CPU_UNBOUND))
-		return wq->cpu_wq.single;
+	} else if (likely(gcwq_cpu_unbound(cpu))) {
+		unsigned int node = cpu - WORK_CPU_UNBOUND;
+
+		if (likely(node < wq_nr_unbound_cwqs(wq)))
+			return (void *)wq->cpu_wq.single + node * CWQ_STRIDE;
+	}
 	return NULL;
 }
 
@@ -567,7 +634,7 @@ static struct global_cwq *get_work_gcwq(struct work_struct *work)
 	if (cpu == WORK_CPU_NONE)
 		return NULL;
 
-	BUG_ON(cpu >= nr_cpu_ids && cpu != WORK_CPU_UNBOUND);
+	BUG_ON(cpu >= nr_cpu_ids && !gcwq_cpu_unbound(cpu));
 	return get_gcwq(cpu);
 }
 
@@ -1004,7 +1071,7 @@ static bool is_chained_work(struct workqueue_struct *wq)
 static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 			 struct work_struct *work)
 {
-	struct global_cwq *gcwq;
+	struct global_cwq *gcwq, *last_gcwq;
 	struct cpu_workqueue_struct *cwq;
 	struct list_head *worklist;
 	unsigned int work_flags;
@@ -1019,39 +1086,39 @@ static void __queue_work(unsigned int cpu, struct workqueue_struct *wq,
 
 	/* determine gcwq to use */
 	if (!(wq->flags & WQ_UNBOUND)) {
-		struct global_cwq *last_gcwq;
-
 		if (unlikely(cpu == WORK_CPU_UNBOUND))
 			cpu = raw_smp_processor_id();
-
-		/*
-		 * It's multi cpu.  If @wq is non-reentrant and @work
-		 * was previously on a different cpu, it might still
-		 * be running there, in which case the work needs to
-		 * be queued on that cpu to guarantee non-reentrance.
-		 */
 		gcwq = get_gcwq(cpu);
-		if (wq->flags & WQ_NON_REENTRANT &&
-		    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
-			struct worker *worker;
+	} else if (!(wq->flags & WQ_ORDERED)) {
+		/* use the unbound gcwq of the node @cpu belongs to */
+		gcwq = get_gcwq(unbound_gcwq_cpu(cpu));
+	} else
+		gcwq = get_gcwq(WORK_CPU_UNBOUND);
 
-			spin_lock_irqsave(&last_gcwq->lock, flags);
+	/*
+	 * If @wq is non-reentrant and @work was previously on a
+	 * different gcwq, it might still be running there, in which
+	 * case the work needs to be queued on that gcwq to guarantee
+	 * non-reentrance.  Unbound wqs are spread across per-node gcwqs
+	 * and always need this.
+	 */
+	if (wq->flags & (WQ_NON_REENTRANT | WQ_UNBOUND) &&
+	    (last_gcwq = get_work_gcwq(work)) && last_gcwq != gcwq) {
+		struct worker *worker;
 
-			worker = find_worker_executing_work(last_gcwq, work);
+		spin_lock_irqsave(&last_gcwq->lock, flags);
 
-			if (worker && worker->current_cwq->wq == wq)
-				gcwq = last_gcwq;
-			else {
-				/* meh... not running there, queue here */
-				spin_unlock_irqrestore(&last_gcwq->lock, flags);
-				spin_lock_irqsave(&gcwq->lock, flags);
-			}
-		} else
+		worker = find_worker_executing_work(last_gcwq, work);
+
+		if (worker && worker->current_cwq->wq == wq)
+			gcwq = last_gcwq;
+		else {
+			/* meh... not running there, queue here */
+			spin_unlock_irqrestore(&last_gcwq->lock, flags);
 			spin_lock_irqsave(&gcwq->lock, flags);
-	} else {
-		gcwq = get_gcwq(WORK_CPU_UNBOUND);
+		}
+	} else
 		spin_lock_irqsave(&gcwq->lock, flags);
-	}
 
 	/* gcwq determined, get cwq and queue */
 	cwq = get_cwq(gcwq->cpu, wq);
@@ -1179,12 +1246,18 @@ int queue_delayed_work_on(int cpu, struct workqueue_struct *wq,
 		if (!(wq->flags & WQ_UNBOUND)) {
 			struct global_cwq *gcwq = get_work_gcwq(work);
 
-			if (gcwq && gcwq->cpu != WORK_CPU_UNBOUND)
+			if (gcwq && !gcwq_cpu_unbound(gcwq->cpu))
 				lcpu = gcwq->cpu;
 			else
 				lcpu = raw_smp_processor_id();
-		} else
-			lcpu = WORK_CPU_UNBOUND;
+		} else {
+			struct global_cwq *gcwq = get_work_gcwq(work);
+
+			if (gcwq && get_cwq(gcwq->cpu, wq))
+				lcpu = gcwq->cpu;
+			else
+				lcpu = WORK_CPU_UNBOUND;
+		}
 
 		set_work_cwq(work, get_cwq(lcpu, wq), 0);
 
@@ -1347,6 +1420,136 @@ static void worker_rebind_fn(struct work_struct *work)
 	spin_unlock_irq(&gcwq->lock);
 }
 
+/**
+ * worker_apply_unbound_attrs - apply unbound attributes to a worker
+ * @worker: worker of an unbound gcwq
+ *
+ * Restrict @worker to the cpus of its node allowed by
+ * wq_unbound_cpumask, or to all of wq_unbound_cpumask if the node has
+ * no such cpu online, and set its nice level to wq_unbound_nice.
+ *
+ * CONTEXT:
+ * Might sleep.  Called from @worker itself or before @worker's task
+ * gets PF_THREAD_BOUND.
+ */
+static void worker_apply_unbound_attrs(struct worker *worker)
+{
+	int node = worker->gcwq->cpu - WORK_CPU_UNBOUND;
+	struct cpumask *mask = &wq_unbound_scratch;
+
+	mutex_lock(&wq_unbound_mutex);
+
+	cpumask_and(mask, cpumask_of_node(node), &wq_unbound_cpumask);
+	if (!cpumask_intersects(mask, cpu_online_mask))
+		mask = &wq_unbound_cpumask;
+
+	set_cpus_allowed_ptr(worker->task, mask);
+	set_user_nice(worker->task, wq_unbound_nice);
+	worker->attrs_gen = wq_unbound_attrs_gen;
+
+	mutex_unlock(&wq_unbound_mutex);
+}
+
+/**
+ * wq_unbound_attrs_changed - propagate new unbound attributes
+ *
+ * Bump wq_unbound_attrs_gen and kick the idle workers of all unbound
+ * gcwqs so that they pick up the new attributes.  Busy ones will do
+ * so when they go idle and are woken up next time.
+ *
+ * CONTEXT:
+ * mutex_lock(wq_unbound_mutex).
+ */
+static void wq_unbound_attrs_changed(void)
+{
+	unsigned int cpu;
+
+	wq_unbound_attrs_gen++;
+
+	/* not initialized yet, the first workers will pick them up */
+	if (!unbound_global_cwq)
+		return;
+
+	for (cpu = WORK_CPU_UNBOUND; gcwq_cpu_unbound(cpu); cpu++) {
+		struct global_cwq *gcwq = get_gcwq(cpu);
+		struct worker *worker;
+
+		spin_lock_irq(&gcwq->lock);
+		list_for_each_entry(worker, &gcwq->idle_list, entry)
+			wake_up_process(worker->task);
+		spin_unlock_irq(&gcwq->lock);
+	}
+}
+
+/*
+ * workqueue.unbound_cpumask and workqueue.unbound_nice, settable on the
+ * kernel command line and through /sys/module/workqueue/parameters/.
+ */
+static int wq_unbound_cpumask_set(const char *val,
+				  const struct kernel_param *kp)
+{
+	int ret;
+
+	mutex_lock(&wq_unbound_mutex);
+
+	ret = cpulist_parse(val, &wq_unbound_scratch);
+	if (!ret) {
+		cpumask_and(&wq_unbound_scratch, &wq_unbound_scratch,
+			    cpu_possible_mask);
+		if (!cpumask_empty(&wq_unbound_scratch)) {
+			cpumask_copy(&wq_unbound_cpumask, &wq_unbound_scratch);
+			wq_unbound_attrs_changed();
+		} else
+			ret = -EINVAL;
+	}
+
+	mutex_unlock(&wq_unbound_mutex);
+	return ret;
+}
+
+static int wq_unbound_cpumask_get(char *buffer,
+				  const struct kernel_param *kp)
+{
+	int len;
+
+	mutex_lock(&wq_unbound_mutex);
+	len = cpulist_scnprintf(buffer, PAGE_SIZE, &wq_unbound_cpumask);
+	mutex_unlock(&wq_unbound_mutex);
+	return len;
+}
+
+static struct kernel_param_ops wq_unbound_cpumask_ops = {
+	.set	= wq_unbound_cpumask_set,
+	.get	= wq_unbound_cpumask_get,
+};
+module_param_cb(unbound_cpumask, &wq_unbound_cpumask_ops, NULL, 0644);
+MODULE_PARM_DESC(unbound_cpumask, "cpus unbound workers may run on");
+
+static int wq_unbound_nice_set(const char *val,
+			       const struct kernel_param *kp)
+{
+	int nice, ret;
+
+	ret = kstrtoint(val, 0, &nice);
+	if (ret)
+		return ret;
+	if (nice < -20 || nice > 19)
+		return -EINVAL;
+
+	mutex_lock(&wq_unbound_mutex);
+	wq_unbound_nice = nice;
+	wq_unbound_attrs_changed();
+	mutex_unlock(&wq_unbound_mutex);
+	return 0;
+}
+
+static struct kernel_param_ops wq_unbound_nice_ops = {
+	.set	= wq_unbound_nice_set,
+	.get	= param_get_int,
+};
+module_param_cb(unbound_nice, &wq_unbound_nice_ops, &wq_unbound_nice, 0644);
+MODULE_PARM_DESC(unbound_nice, "nice level of unbound workers");
+
 static struct worker *alloc_worker(void)
 {
 	struct worker *worker;
@@ -1379,7 +1582,7 @@ static struct worker *alloc_worker(void)
  */
 static struct worker *create_worker(struct global_cwq *gcwq, bool bind)
 {
-	bool on_unbound_cpu = gcwq->cpu == WORK_CPU_UNBOUND;
+	bool on_unbound_cpu = gcwq_cpu_unbound(gcwq->cpu);
 	struct worker *worker = NULL;
 	int id = -1;
 
@@ -1404,9 +1607,13 @@ static struct worker *create_worker(struct global_cwq *gcwq, bool bind)
 						      worker,
 						      cpu_to_node(gcwq->cpu),
 						      "kworker/%u:%d", gcwq->cpu, id);
-	else
-		worker->task = kthread_create(worker_thread, worker,
-					      "kworker/u:%d", id);
+	else {
+		int node = gcwq->cpu - WORK_CPU_UNBOUND;
+
+		worker->task = kthread_create_on_node(worker_thread, worker,
+				node_online(node) ? node : NUMA_NO_NODE,
+				"kworker/u%d:%d", node, id);
+	}
 	if (IS_ERR(worker->task))
 		goto fail;
 
@@ -1418,6 +1625,9 @@ static struct worker *create_worker(struct global_cwq *gcwq, bool bind)
 	if (bind && !on_unbound_cpu)
 		kthread_bind(worker->task, gcwq->cpu);
 	else {
+		/* must precede PF_THREAD_BOUND which blocks affinity changes */
+		if (on_unbound_cpu)
+			worker_apply_unbound_attrs(worker);
 		worker->task->flags |= PF_THREAD_BOUND;
 		if (on_unbound_cpu)
 			worker->flags |= WORKER_UNBOUND;
@@ -1530,8 +1740,8 @@ static bool send_mayday(struct work_struct *work)
 
 	/* mayday mayday mayday */
 	cpu = cwq->gcwq->cpu;
-	/* WORK_CPU_UNBOUND can't be set in cpumask, use cpu 0 instead */
-	if (cpu == WORK_CPU_UNBOUND)
+	/* unbound gcwqs can't be set in cpumask, use cpu 0 instead */
+	if (gcwq_cpu_unbound(cpu))
 		cpu = 0;
 	if (!mayday_test_and_set_cpu(cpu, wq->mayday_mask))
 		wake_up_process(wq->rescuer->task);
@@ -1989,6 +2199,11 @@ static int worker_thread(void *__worker)
 	/* tell the scheduler that this is a workqueue worker */
 	worker->task->flags |= PF_WQ_WORKER;
 woke_up:
+	/* unbound attributes changed while we were asleep? */
+	if (unlikely(worker->flags & WORKER_UNBOUND) &&
+	    worker->attrs_gen != ACCESS_ONCE(wq_unbound_attrs_gen))
+		worker_apply_unbound_attrs(worker);
+
 	spin_lock_irq(&gcwq->lock);
 
 	/* DIE can be set only while we're idle, checking here is enough */
@@ -2057,6 +2272,43 @@ sleep:
 	goto woke_up;
 }
 
+/*
+ * Process all works issued via @cwq's workqueue which are pending on
+ * @cwq's gcwq.  Helper for rescuer_thread().
+ */
+static void rescue_cwq(struct worker *rescuer,
+		       struct cpu_workqueue_struct *cwq)
+{
+	struct global_cwq *gcwq = cwq->gcwq;
+	struct list_head *scheduled = &rescuer->scheduled;
+	struct work_struct *work, *n;
+
+	/* migrate to the target cpu if possible */
+	rescuer->gcwq = gcwq;
+	worker_maybe_bind_and_lock(rescuer);
+
+	/*
+	 * Slurp in all works issued via this workqueue and
+	 * process'em.
+	 */
+	BUG_ON(!list_empty(&rescuer->scheduled));
+	list_for_each_entry_safe(work, n, &gcwq->worklist, entry)
+		if (get_work_cwq(work) == cwq)
+			move_linked_works(work, scheduled, &n);
+
+	process_scheduled_works(rescuer);
+
+	/*
+	 * Leave this gcwq.  If keep_working() is %true, notify a
+	 * regular worker; otherwise, we end up with 0 concurrency
+	 * and stalling the execution.
+	 */
+	if (keep_working(gcwq))
+		wake_up_worker(gcwq);
+
+	spin_unlock_irq(&gcwq->lock);
+}
+
 /**
  * rescuer_thread - the rescuer thread function
  * @__wq: the associated workqueue
@@ -2080,7 +2332,6 @@ static int rescuer_thread(void *__wq)
 {
 	struct workqueue_struct *wq = __wq;
 	struct worker *rescuer = wq->rescuer;
-	struct list_head *scheduled = &rescuer->scheduled;
 	bool is_unbound = wq->flags & WQ_UNBOUND;
 	unsigned int cpu;
 
@@ -2095,41 +2346,22 @@ repeat:
 
 	/*
 	 * See whether any cpu is asking for help.  Unbounded
-	 * workqueues use cpu 0 in mayday_mask for CPU_UNBOUND.
+	 * workqueues use cpu 0 in mayday_mask for all their unbound
+	 * gcwqs, check each of them.
 	 */
 	for_each_mayday_cpu(cpu, wq->mayday_mask) {
-		unsigned int tcpu = is_unbound ? WORK_CPU_UNBOUND : cpu;
-		struct cpu_workqueue_struct *cwq = get_cwq(tcpu, wq);
-		struct global_cwq *gcwq = cwq->gcwq;
-		struct work_struct *work, *n;
+		unsigned int tcpu;
 
 		__set_current_state(TASK_RUNNING);
 		mayday_clear_cpu(cpu, wq->mayday_mask);
 
-		/* migrate to the target cpu if possible */
-		rescuer->gcwq = gcwq;
-		worker_maybe_bind_and_lock(rescuer);
-
-		/*
-		 * Slurp in all works issued via this workqueue and
-		 * process'em.
-		 */
-		BUG_ON(!list_empty(&rescuer->scheduled));
-		list_for_each_entry_safe(work, n, &gcwq->worklist, entry)
-			if (get_work_cwq(work) == cwq)
-				move_linked_works(work, scheduled, &n);
-
-		process_scheduled_works(rescuer);
-
-		/*
-		 * Leave this gcwq.  If keep_working() is %true, notify a
-		 * regular worker; otherwise, we end up with 0 concurrency
-		 * and stalling the execution.
-		 */
-		if (keep_working(gcwq))
-			wake_up_worker(gcwq);
+		if (!is_unbound) {
+			rescue_cwq(rescuer, get_cwq(cpu, wq));
+			continue;
+		}
 
-		spin_unlock_irq(&gcwq->lock);
+		for_each_cwq_cpu(tcpu, wq)
+			rescue_cwq(rescuer, get_cwq(tcpu, wq));
 	}
 
 	schedule();
@@ -2953,6 +3185,12 @@ int keventd_up(void)
 	return system_wq != NULL;
 }
 
+/* number of cwqs in a non-percpu chunk, see get_cwq() */
+static unsigned int wq_nr_single_cwqs(struct workqueue_struct *wq)
+{
+	return wq->flags & WQ_UNBOUND ? wq_nr_unbound_cwqs(wq) : 1;
+}
+
 static int alloc_cwqs(struct workqueue_struct *wq)
 {
 	/*
@@ -2961,8 +3199,7 @@ static int alloc_cwqs(struct workqueue_struct *wq)
 	 * unsigned long long.
 	 */
 	const size_t size = sizeof(struct cpu_workqueue_struct);
-	const size_t align = max_t(size_t, 1 << WORK_STRUCT_FLAG_BITS,
-				   __alignof__(unsigned long long));
+	const size_t align = CWQ_ALIGN;
 #ifdef CONFIG_SMP
 	bool percpu = !(wq->flags & WQ_UNBOUND);
 #else
@@ -2972,17 +3209,18 @@ static int alloc_cwqs(struct workqueue_struct *wq)
 	if (percpu)
 		wq->cpu_wq.pcpu = __alloc_percpu(size, align);
 	else {
+		size_t chunk = wq_nr_single_cwqs(wq) * CWQ_STRIDE;
 		void *ptr;
 
 		/*
-		 * Allocate enough room to align cwq and put an extra
+		 * Allocate enough room to align cwqs and put an extra
 		 * pointer at the end pointing back to the originally
 		 * allocated pointer which will be used for free.
 		 */
-		ptr = kzalloc(size + align + sizeof(void *), GFP_KERNEL);
+		ptr = kzalloc(chunk + align + sizeof(void *), GFP_KERNEL);
 		if (ptr) {
 			wq->cpu_wq.single = PTR_ALIGN(ptr, align);
-			*(void **)(wq->cpu_wq.single + 1) = ptr;
+			*(void **)((void *)wq->cpu_wq.single + chunk) = ptr;
 		}
 	}
 
@@ -3002,8 +3240,10 @@ static void free_cwqs(struct workqueue_struct *wq)
 	if (percpu)
 		free_percpu(wq->cpu_wq.pcpu);
 	else if (wq->cpu_wq.single) {
-		/* the pointer to free is stored right after the cwq */
-		kfree(*(void **)(wq->cpu_wq.single + 1));
+		/* the pointer to free is stored right after the cwqs */
+		size_t chunk = wq_nr_single_cwqs(wq) * CWQ_STRIDE;
+
+		kfree(*(void **)((void *)wq->cpu_wq.single + chunk));
 	}
 }
 
@@ -3038,10 +3278,14 @@ struct workqueue_struct *__alloc_workqueue_key(const char *name,
 
 	/*
 	 * Unbound workqueues aren't concurrency managed and should be
-	 * dispatched to workers immediately.
+	 * dispatched to workers immediately.  Ordered ones get a single
+	 * cwq so that all works go through the same gcwq in order.
 	 */
-	if (flags & WQ_UNBOUND)
+	if (flags & WQ_UNBOUND) {
 		flags |= WQ_HIGHPRI;
+		if (max_active == 1)
+			flags |= WQ_ORDERED;
+	}
 
 	max_active = max_active ?: WQ_DFL_ACTIVE;
 	max_active = wq_clamp_max_active(max_active, flags, name);
@@ -3205,7 +3449,8 @@ EXPORT_SYMBOL_GPL(workqueue_set_max_active);
  * @cpu: CPU in question
  * @wq: target workqueue
  *
- * Test whether @wq's cpu workqueue for @cpu is congested.  There is
+ * Test whether @wq's cpu workqueue for @cpu is congested.  For unbound
+ * @wq, @cpu selects the node, WORK_CPU_UNBOUND the local one.  There is
  * no synchronization around this function and the test result is
  * unreliable and only useful as advisory hints or for debugging.
  *
@@ -3214,7 +3459,13 @@ EXPORT_SYMBOL_GPL(workqueue_set_max_active);
  */
 bool workqueue_congested(unsigned int cpu, struct workqueue_struct *wq)
 {
-	struct cpu_workqueue_struct *cwq = get_cwq(cpu, wq);
+	struct cpu_workqueue_struct *cwq;
+
+	/* unbound wqs are tested on the cwq for @cpu's node */
+	if (wq->flags & WQ_UNBOUND)
+		cpu = wq->flags & WQ_ORDERED ? WORK_CPU_UNBOUND :
+					       unbound_gcwq_cpu(cpu);
+	cwq = get_cwq(cpu, wq);
 
 	return !list_empty(&cwq->delayed_works);
 }
@@ -3225,13 +3476,16 @@ EXPORT_SYMBOL_GPL(workqueue_congested);
  * @work: the work of interest
  *
  * RETURNS:
- * CPU number if @work was ever queued.  WORK_CPU_NONE otherwise.
+ * CPU number if @work was ever queued, WORK_CPU_UNBOUND if it was last
+ * on an unbound gcwq.  WORK_CPU_NONE otherwise.
  */
 unsigned int work_cpu(struct work_struct *work)
 {
 	struct global_cwq *gcwq = get_work_gcwq(work);
 
-	return gcwq ? gcwq->cpu : WORK_CPU_NONE;
+	if (!gcwq)
+		return WORK_CPU_NONE;
+	return gcwq_cpu_unbound(gcwq->cpu) ? WORK_CPU_UNBOUND : gcwq->cpu;
 }
 EXPORT_SYMBOL_GPL(work_cpu);
 
@@ -3645,6 +3899,13 @@ static int __devinit workqueue_cpu_callback(struct notifier_block *nfb,
 
 	spin_unlock_irqrestore(&gcwq->lock, flags);
 
+	/* node cpumasks changed, let the unbound workers follow */
+	if (action == CPU_ONLINE || action == CPU_POST_DEAD) {
+		mutex_lock(&wq_unbound_mutex);
+		wq_unbound_attrs_changed();
+		mutex_unlock(&wq_unbound_mutex);
+	}
+
 	return notifier_from_errno(0);
 }
 
@@ -3870,6 +4131,14 @@ static int __init init_workqueues(void)
 	cpu_notifier(workqueue_cpu_up_callback, CPU_PRI_WORKQUEUE_UP);
 	cpu_notifier(workqueue_cpu_down_callback, CPU_PRI_WORKQUEUE_DOWN);
 
+	unbound_global_cwq = kcalloc(nr_node_ids, sizeof(struct global_cwq),
+				     GFP_KERNEL);
+	BUG_ON(!unbound_global_cwq);
+
+	/* unless restricted on the command line, unbound workers go anywhere */
+	if (cpumask_empty(&wq_unbound_cpumask))
+		cpumask_copy(&wq_unbound_cpumask, cpu_possible_mask);
+
 	/* initialize gcwqs */
 	for_each_gcwq_cpu(cpu) {
 		struct global_cwq *gcwq = get_gcwq(cpu);
@@ -3901,7 +4170,7 @@ static int __init init_workqueues(void)
 		struct global_cwq *gcwq = get_gcwq(cpu);
 		struct worker *worker;
 
-		if (cpu != WORK_CPU_UNBOUND)
+		if (!gcwq_cpu_unbound(cpu))
 			gcwq->flags &= ~GCWQ_DISASSOCIATED;
 		worker = create_worker(gcwq, true);
 		BUG_ON(!worker);
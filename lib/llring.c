@@ -0,0 +1,170 @@
+/*
+ * Lock-less bounded ring of pointers
+ *
+ * Indices are free running u32 counters, masked on use, so the number
+ * of used slots is always prod.tail - cons.tail and the ring can be
+ * filled completely.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/log2.h>
+#include <linux/preempt.h>
+#include <linux/llring.h>
+
+#include <asm/system.h>
+#include <asm/processor.h>
+
+/**
+ * llring_alloc - allocate an empty ring
+ * @count:	number of slots, rounded up to a power of two
+ * @flags:	LLRING_F_SP_ENQ and/or LLRING_F_SC_DEQ
+ * @gfp:	allocation mask
+ *
+ * Returns the ring or NULL.
+ */
+struct llring *llring_alloc(unsigned int count, unsigned int flags,
+			    gfp_t gfp)
+{
+	struct llring *r;
+
+	if (!count || count > (1U << 31))
+		return NULL;
+	count = roundup_pow_of_two(count);
+
+	r = kzalloc(sizeof(*r) + count * sizeof(void *), gfp);
+	if (!r)
+		return NULL;
+
+	r->size = count;
+	r->mask = count - 1;
+	r->flags = flags;
+	return r;
+}
+EXPORT_SYMBOL_GPL(llring_alloc);
+
+/**
+ * llring_free - free a ring
+ * @r:		the ring, may be NULL
+ *
+ * Objects still in the ring are not touched.
+ */
+void llring_free(struct llring *r)
+{
+	kfree(r);
+}
+EXPORT_SYMBOL_GPL(llring_free);
+
+/**
+ * __llring_enqueue - add objects to a ring
+ * @r:		the ring
+ * @objs:	objects to add, oldest first
+ * @n:		number of objects
+ * @fixed:	add all @n objects or none
+ *
+ * Returns the number of objects added.
+ */
+unsigned int __llring_enqueue(struct llring *r, void * const *objs,
+			      unsigned int n, bool fixed)
+{
+	bool single = r->flags & LLRING_F_SP_ENQ;
+	u32 head, next, free, i;
+	unsigned int cnt;
+
+	preempt_disable();
+	do {
+		head = ACCESS_ONCE(r->prod.head);
+		smp_rmb();
+		free = r->size + ACCESS_ONCE(r->cons.tail) - head;
+
+		cnt = n;
+		if (unlikely(cnt > free)) {
+			if (fixed || !free) {
+				cnt = 0;
+				goto out;
+			}
+			cnt = free;
+		}
+		next = head + cnt;
+
+		if (single) {
+			r->prod.head = next;
+			/* order the slot stores after the cons.tail load */
+			smp_mb();
+			break;
+		}
+	} while (cmpxchg(&r->prod.head, head, next) != head);
+
+	for (i = 0; i < cnt; i++)
+		r->ring[(head + i) & r->mask] = objs[i];
+	smp_wmb();
+
+	/* earlier reservations are published first */
+	if (!single)
+		while (ACCESS_ONCE(r->prod.tail) != head)
+			cpu_relax();
+	ACCESS_ONCE(r->prod.tail) = next;
+out:
+	preempt_enable();
+	return cnt;
+}
+EXPORT_SYMBOL_GPL(__llring_enqueue);
+
+/**
+ * __llring_dequeue - take objects from a ring
+ * @r:		the ring
+ * @objs:	where to store the objects, oldest first
+ * @n:		number of objects wanted
+ * @fixed:	take all @n objects or none
+ *
+ * Returns the number of objects taken.
+ */
+unsigned int __llring_dequeue(struct llring *r, void **objs,
+			      unsigned int n, bool fixed)
+{
+	bool single = r->flags & LLRING_F_SC_DEQ;
+	u32 head, next, avail, i;
+	unsigned int cnt;
+
+	preempt_disable();
+	do {
+		head = ACCESS_ONCE(r->cons.head);
+		smp_rmb();
+		avail = ACCESS_ONCE(r->prod.tail) - head;
+
+		cnt = n;
+		if (unlikely(cnt > avail)) {
+			if (fixed || !avail) {
+				cnt = 0;
+				goto out;
+			}
+			cnt = avail;
+		}
+		next = head + cnt;
+
+		if (single) {
+			r->cons.head = next;
+			/* order the slot loads after the prod.tail load */
+			smp_rmb();
+			break;
+		}
+	} while (cmpxchg(&r->cons.head, head, next) != head);
+
+	for (i = 0; i < cnt; i++)
+		objs[i] = r->ring[(head + i) & r->mask];
+	/* the slots must be read before producers may reuse them */
+	smp_mb();
+
+	if (!single)
+		while (ACCESS_ONCE(r->cons.tail) != head)
+			cpu_relax();
+	ACCESS_ONCE(r->cons.tail) = next;
+out:
+	preempt_enable();
+	return cnt;
+}
+EXPORT_SYMBOL_GPL(__llring_dequeue);
@@ -0,0 +1,251 @@
+/*
+ * Dynamic interrupt moderation.  See include/linux/net_dim.h
+ */
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+#include <linux/hrtimer.h>
+#include <linux/net_dim.h>
+
+/* Interrupt intervals in usecs, shortest first */
+static const u16 net_dim_table[NET_DIM_NR_PROFILES][NET_DIM_NR_LEVELS] = {
+	[NET_DIM_PROFILE_LATENCY]	= {  4,  8,  16,  32,  64 },
+	[NET_DIM_PROFILE_BALANCED]	= { 10, 25,  50, 100, 200 },
+	[NET_DIM_PROFILE_THROUGHPUT]	= { 25, 50, 100, 200, 250 },
+};
+
+static const u8 net_dim_default_level[NET_DIM_NR_PROFILES] = {
+	[NET_DIM_PROFILE_LATENCY]	= 1,
+	[NET_DIM_PROFILE_BALANCED]	= 2,
+	[NET_DIM_PROFILE_THROUGHPUT]	= 2,
+};
+
+enum {
+	NET_DIM_PARKING_ON_TOP,
+	NET_DIM_PARKING_TIRED,
+	NET_DIM_GOING_RIGHT,
+	NET_DIM_GOING_LEFT,
+};
+
+enum {
+	NET_DIM_STATS_WORSE,
+	NET_DIM_STATS_SAME,
+	NET_DIM_STATS_BETTER,
+};
+
+enum {
+	NET_DIM_STEPPED,
+	NET_DIM_TOO_TIRED,
+	NET_DIM_ON_EDGE,
+};
+
+/* A change of more than 10% counts, anything less is noise */
+#define IS_SIGNIFICANT_DIFF(val, ref) \
+	(((100UL * abs((int)(val) - (int)(ref))) / (ref)) > 10)
+
+static int net_dim_stats_compare(const struct net_dim_stats *curr,
+				 const struct net_dim_stats *prev)
+{
+	if (!prev->bpms)
+		return curr->bpms ? NET_DIM_STATS_BETTER : NET_DIM_STATS_SAME;
+
+	if (IS_SIGNIFICANT_DIFF(curr->bpms, prev->bpms))
+		return (curr->bpms > prev->bpms) ? NET_DIM_STATS_BETTER :
+						   NET_DIM_STATS_WORSE;
+
+	if (!prev->ppms)
+		return curr->ppms ? NET_DIM_STATS_BETTER : NET_DIM_STATS_SAME;
+
+	if (IS_SIGNIFICANT_DIFF(curr->ppms, prev->ppms))
+		return (curr->ppms > prev->ppms) ? NET_DIM_STATS_BETTER :
+						   NET_DIM_STATS_WORSE;
+
+	if (!prev->epms)
+		return NET_DIM_STATS_SAME;
+
+	if (IS_SIGNIFICANT_DIFF(curr->epms, prev->epms))
+		return (curr->epms < prev->epms) ? NET_DIM_STATS_BETTER :
+						   NET_DIM_STATS_WORSE;
+
+	return NET_DIM_STATS_SAME;
+}
+
+/* Did the last step overshoot a level we had already been at? */
+static bool net_dim_on_top(const struct net_dim *dim)
+{
+	switch (dim->tune_state) {
+	case NET_DIM_PARKING_ON_TOP:
+	case NET_DIM_PARKING_TIRED:
+		return true;
+	case NET_DIM_GOING_RIGHT:
+		return (dim->steps_left > 1) && (dim->steps_right == 1);
+	default: /* NET_DIM_GOING_LEFT */
+		return (dim->steps_right > 1) && (dim->steps_left == 1);
+	}
+}
+
+static void net_dim_turn(struct net_dim *dim)
+{
+	switch (dim->tune_state) {
+	case NET_DIM_GOING_RIGHT:
+		dim->tune_state = NET_DIM_GOING_LEFT;
+		dim->steps_left = 0;
+		break;
+	case NET_DIM_GOING_LEFT:
+		dim->tune_state = NET_DIM_GOING_RIGHT;
+		dim->steps_right = 0;
+		break;
+	}
+}
+
+static int net_dim_step(struct net_dim *dim)
+{
+	if (dim->tired == (NET_DIM_NR_LEVELS * 2))
+		return NET_DIM_TOO_TIRED;
+
+	switch (dim->tune_state) {
+	case NET_DIM_GOING_RIGHT:
+		if (dim->level == NET_DIM_NR_LEVELS - 1)
+			return NET_DIM_ON_EDGE;
+		dim->level++;
+		dim->steps_right++;
+		break;
+	case NET_DIM_GOING_LEFT:
+		if (dim->level == 0)
+			return NET_DIM_ON_EDGE;
+		dim->level--;
+		dim->steps_left++;
+		break;
+	}
+
+	dim->tired++;
+	return NET_DIM_STEPPED;
+}
+
+static void net_dim_park_on_top(struct net_dim *dim)
+{
+	dim->steps_right = 0;
+	dim->steps_left = 0;
+	dim->tired = 0;
+	dim->tune_state = NET_DIM_PARKING_ON_TOP;
+}
+
+static void net_dim_park_tired(struct net_dim *dim)
+{
+	dim->steps_right = 0;
+	dim->steps_left = 0;
+	dim->tune_state = NET_DIM_PARKING_TIRED;
+}
+
+static void net_dim_exit_parking(struct net_dim *dim)
+{
+	dim->tune_state = dim->level ? NET_DIM_GOING_LEFT :
+				       NET_DIM_GOING_RIGHT;
+	net_dim_step(dim);
+}
+
+static bool net_dim_decision(struct net_dim *dim,
+			     const struct net_dim_stats *curr)
+{
+	int prev_state = dim->tune_state;
+	int prev_level = dim->level;
+
+	switch (dim->tune_state) {
+	case NET_DIM_PARKING_ON_TOP:
+		if (net_dim_stats_compare(curr, &dim->prev_stats) !=
+		    NET_DIM_STATS_SAME)
+			net_dim_exit_parking(dim);
+		break;
+
+	case NET_DIM_PARKING_TIRED:
+		dim->tired--;
+		if (!dim->tired)
+			net_dim_exit_parking(dim);
+		break;
+
+	case NET_DIM_GOING_RIGHT:
+	case NET_DIM_GOING_LEFT:
+		if (net_dim_stats_compare(curr, &dim->prev_stats) !=
+		    NET_DIM_STATS_BETTER)
+			net_dim_turn(dim);
+
+		if (net_dim_on_top(dim)) {
+			net_dim_park_on_top(dim);
+			break;
+		}
+
+		switch (net_dim_step(dim)) {
+		case NET_DIM_ON_EDGE:
+			net_dim_park_on_top(dim);
+			break;
+		case NET_DIM_TOO_TIRED:
+			net_dim_park_tired(dim);
+			break;
+		}
+		break;
+	}
+
+	/* While parked on top, keep comparing against the parking window */
+	if (prev_state != NET_DIM_PARKING_ON_TOP ||
+	    dim->tune_state != NET_DIM_PARKING_ON_TOP)
+		dim->prev_stats = *curr;
+
+	return dim->level != prev_level;
+}
+
+static void net_dim_start_window(struct net_dim *dim, ktime_t now)
+{
+	dim->start = now;
+	dim->bytes = 0;
+	dim->packets = 0;
+	dim->events = 0;
+}
+
+/* Records a poll completion and re-evaluates moderation once per window */
+bool net_dim_update(struct net_dim *dim, unsigned int packets,
+		    unsigned int bytes)
+{
+	struct net_dim_stats curr;
+	ktime_t now;
+	u32 delta_us;
+
+	dim->packets += packets;
+	dim->bytes += bytes;
+	if (++dim->events < NET_DIM_NEVENTS)
+		return false;
+
+	now = ktime_get();
+	delta_us = ktime_us_delta(now, dim->start);
+	if (!delta_us) {
+		net_dim_start_window(dim, now);
+		return false;
+	}
+
+	curr.ppms = div_u64((u64)dim->packets * USEC_PER_MSEC + delta_us - 1,
+			    delta_us);
+	curr.bpms = div_u64(dim->bytes * USEC_PER_MSEC + delta_us - 1,
+			    delta_us);
+	curr.epms = DIV_ROUND_UP(NET_DIM_NEVENTS * USEC_PER_MSEC, delta_us);
+
+	net_dim_start_window(dim, now);
+
+	return net_dim_decision(dim, &curr);
+}
+EXPORT_SYMBOL(net_dim_update);
+
+unsigned int net_dim_usecs(const struct net_dim *dim)
+{
+	return net_dim_table[dim->profile][dim->level];
+}
+EXPORT_SYMBOL(net_dim_usecs);
+
+void net_dim_init(struct net_dim *dim, enum net_dim_profile profile)
+{
+	memset(dim, 0, sizeof(*dim));
+	dim->profile = profile;
+	dim->level = net_dim_default_level[profile];
+	dim->tune_state = NET_DIM_GOING_RIGHT;
+	net_dim_start_window(dim, ktime_get());
+}
+EXPORT_SYMBOL(net_dim_init);
@@ -33,18 +33,12 @@
 #include <linux/rcupdate.h>
 
 
-#ifdef __KERNEL__
-#define RADIX_TREE_MAP_SHIFT	(CONFIG_BASE_SMALL ? 4 : 6)
-#else
-#define RADIX_TREE_MAP_SHIFT	3	/* For more stressful testing */
-#endif
-
-#define RADIX_TREE_MAP_SIZE	(1UL << RADIX_TREE_MAP_SHIFT)
-#define RADIX_TREE_MAP_MASK	(RADIX_TREE_MAP_SIZE-1)
-
-#define RADIX_TREE_TAG_LONGS	\
-	((RADIX_TREE_MAP_SIZE + BITS_PER_LONG - 1) / BITS_PER_LONG)
-
+/*
+ * A slot holds NULL, an item, or an indirect pointer: either to a child
+ * node, or, for the slots after the first one of a multi-order entry, to
+ * that first slot.  An item in a node of height h covers
+ * 1 << ((h - 1) * RADIX_TREE_MAP_SHIFT) indices per slot it occupies.
+ */
 struct radix_tree_node {
 	unsigned int	height;		/* Height from the bottom */
 	unsigned int	count;
@@ -92,6 +86,33 @@ static inline void *indirect_to_ptr(void *ptr)
 	return (void *)((unsigned long)ptr & ~RADIX_TREE_INDIRECT_PTR);
 }
 
+/* Is @entry, found in @node, a sibling slot of a multi-order entry? */
+static inline int is_sibling_entry(struct radix_tree_node *node, void *entry)
+{
+	void **ptr = indirect_to_ptr(entry);
+
+	return radix_tree_is_indirect_ptr(entry) &&
+		ptr >= (void **)node->slots &&
+		ptr < (void **)node->slots + RADIX_TREE_MAP_SIZE;
+}
+
+static inline int sibling_offset(struct radix_tree_node *node, void *entry)
+{
+	return (void **)indirect_to_ptr(entry) - (void **)node->slots;
+}
+
+/* Number of slots taken by the entry in @node at @offset, siblings included */
+static unsigned int entry_slots(struct radix_tree_node *node, int offset)
+{
+	void *sibling = ptr_to_indirect(&node->slots[offset]);
+	unsigned int nr = 1;
+
+	while (offset + nr < RADIX_TREE_MAP_SIZE &&
+	       node->slots[offset + nr] == sibling)
+		nr++;
+	return nr;
+}
+
 static inline gfp_t root_gfp_mask(struct radix_tree_root *root)
 {
 	return root->gfp_mask & __GFP_BITS_MASK;
@@ -251,9 +272,10 @@ static inline unsigned long radix_tree_maxindex(unsigned int height)
 }
 
 /*
- *	Extend a radix tree so it can store key @index.
+ *	Extend a radix tree so it can store an entry of @order at key @index.
  */
-static int radix_tree_extend(struct radix_tree_root *root, unsigned long index)
+static int radix_tree_extend(struct radix_tree_root *root, unsigned long index,
+			     unsigned int order)
 {
 	struct radix_tree_node *node;
 	unsigned int height;
@@ -261,7 +283,8 @@ static int radix_tree_extend(struct radix_tree_root *root, unsigned long index)
 
 	/* Figure out what the height should be.  */
 	height = root->height + 1;
-	while (index > radix_tree_maxindex(height))
+	while (index > radix_tree_maxindex(height) ||
+	       height <= order / RADIX_TREE_MAP_SHIFT)
 		height++;
 
 	if (root->rnode == NULL) {
@@ -275,7 +298,7 @@ static int radix_tree_extend(struct radix_tree_root *root, unsigned long index)
 			return -ENOMEM;
 
 		/* Increase the height.  */
-		node->slots[0] = indirect_to_ptr(root->rnode);
+		node->slots[0] = root->rnode;
 
 		/* Propagate the aggregated tag info into the new root */
 		for (tag = 0; tag < RADIX_TREE_MAX_TAGS; tag++) {
@@ -295,26 +318,38 @@ out:
 }
 
 /**
- *	radix_tree_insert    -    insert into a radix tree
+ *	__radix_tree_insert    -    insert into a radix tree
  *	@root:		radix tree root
  *	@index:		index key
+ *	@order:		log2 of the number of indices the item covers
  *	@item:		item to insert
  *
- *	Insert an item into the radix tree at position @index.
+ *	Insert an item into the radix tree covering the positions @index to
+ *	@index + (1 << @order) - 1, @index being aligned on 1 << @order.
+ *
+ *	A multi-order item takes a single slot of a higher node when @order is
+ *	a multiple of RADIX_TREE_MAP_SHIFT, else that slot and the sibling
+ *	slots following it.  Lookups of any index in its range find it, tags
+ *	apply to it as a whole, gang lookups and iterators return it once.
  */
-int radix_tree_insert(struct radix_tree_root *root,
-			unsigned long index, void *item)
+int __radix_tree_insert(struct radix_tree_root *root, unsigned long index,
+			unsigned int order, void *item)
 {
 	struct radix_tree_node *node = NULL, *slot;
-	unsigned int height, shift;
+	unsigned int height, shift, leaf_height;
+	unsigned int i, nr;
 	int offset;
 	int error;
 
 	BUG_ON(radix_tree_is_indirect_ptr(item));
+	BUG_ON(order >= RADIX_TREE_INDEX_BITS);
+	BUG_ON(index & ((1UL << order) - 1));
 
 	/* Make sure the tree is high enough.  */
-	if (index > radix_tree_maxindex(root->height)) {
-		error = radix_tree_extend(root, index);
+	leaf_height = order / RADIX_TREE_MAP_SHIFT + 1;
+	if (index > radix_tree_maxindex(root->height) ||
+	    (order && root->height < leaf_height)) {
+		error = radix_tree_extend(root, index, order);
 		if (error)
 			return error;
 	}
@@ -332,7 +367,8 @@ int radix_tree_insert(struct radix_tree_root *root,
 				return -ENOMEM;
 			slot->height = height;
 			if (node) {
-				rcu_assign_pointer(node->slots[offset], slot);
+				rcu_assign_pointer(node->slots[offset],
+						   ptr_to_indirect(slot));
 				node->count++;
 			} else
 				rcu_assign_pointer(root->rnode, ptr_to_indirect(slot));
@@ -342,27 +378,42 @@ int radix_tree_insert(struct radix_tree_root *root,
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
 		node = slot;
 		slot = node->slots[offset];
+		if (height == leaf_height)
+			break;
+		/* an item above us already covers index */
+		if (slot && (!radix_tree_is_indirect_ptr(slot) ||
+			     is_sibling_entry(node, slot)))
+			return -EEXIST;
+		slot = indirect_to_ptr(slot);
 		shift -= RADIX_TREE_MAP_SHIFT;
 		height--;
 	}
 
-	if (slot != NULL)
-		return -EEXIST;
-
-	if (node) {
-		node->count++;
-		rcu_assign_pointer(node->slots[offset], item);
-		BUG_ON(tag_get(node, 0, offset));
-		BUG_ON(tag_get(node, 1, offset));
-	} else {
+	if (!node) {
+		if (slot != NULL)
+			return -EEXIST;
 		rcu_assign_pointer(root->rnode, item);
 		BUG_ON(root_tag_get(root, 0));
 		BUG_ON(root_tag_get(root, 1));
+		return 0;
+	}
+
+	nr = 1U << (order % RADIX_TREE_MAP_SHIFT);
+	for (i = 0; i < nr; i++) {
+		if (node->slots[offset + i])
+			return -EEXIST;
+		BUG_ON(tag_get(node, 0, offset + i));
+		BUG_ON(tag_get(node, 1, offset + i));
 	}
+	for (i = 1; i < nr; i++)
+		rcu_assign_pointer(node->slots[offset + i],
+				   ptr_to_indirect(&node->slots[offset]));
+	rcu_assign_pointer(node->slots[offset], item);
+	node->count += nr;
 
 	return 0;
 }
-EXPORT_SYMBOL(radix_tree_insert);
+EXPORT_SYMBOL(__radix_tree_insert);
 
 /*
  * is_slot == 1 : search for the slot.
@@ -372,7 +423,8 @@ static void *radix_tree_lookup_element(struct radix_tree_root *root,
 				unsigned long index, int is_slot)
 {
 	unsigned int height, shift;
-	struct radix_tree_node *node, **slot;
+	struct radix_tree_node *node;
+	void *entry, **slot;
 
 	node = rcu_dereference_raw(root->rnode);
 	if (node == NULL)
@@ -391,18 +443,26 @@ static void *radix_tree_lookup_element(struct radix_tree_root *root,
 
 	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
 
-	do {
-		slot = (struct radix_tree_node **)
-			(node->slots + ((index>>shift) & RADIX_TREE_MAP_MASK));
-		node = rcu_dereference_raw(*slot);
-		if (node == NULL)
+	for (;;) {
+		slot = (void **)(node->slots +
+				 ((index >> shift) & RADIX_TREE_MAP_MASK));
+		entry = rcu_dereference_raw(*slot);
+		if (entry == NULL)
 			return NULL;
+		if (is_sibling_entry(node, entry)) {
+			slot = indirect_to_ptr(entry);
+			entry = rcu_dereference_raw(*slot);
+		}
+		/* a leaf, or a multi-order item above the leaves */
+		if (height == 1 || !radix_tree_is_indirect_ptr(entry))
+			break;
+		node = indirect_to_ptr(entry);
 
 		shift -= RADIX_TREE_MAP_SHIFT;
 		height--;
-	} while (height > 0);
+	}
 
-	return is_slot ? (void *)slot : indirect_to_ptr(node);
+	return is_slot ? (void *)slot : indirect_to_ptr(entry);
 }
 
 /**
@@ -459,22 +519,36 @@ void *radix_tree_tag_set(struct radix_tree_root *root,
 			unsigned long index, unsigned int tag)
 {
 	unsigned int height, shift;
-	struct radix_tree_node *slot;
+	struct radix_tree_node *node;
+	void *slot;
 
 	height = root->height;
 	BUG_ON(index > radix_tree_maxindex(height));
 
-	slot = indirect_to_ptr(root->rnode);
+	slot = root->rnode;
 	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
 
 	while (height > 0) {
+		unsigned int i, nr = 1;
 		int offset;
 
+		node = indirect_to_ptr(slot);
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
-		if (!tag_get(slot, tag, offset))
-			tag_set(slot, tag, offset);
-		slot = slot->slots[offset];
+		slot = node->slots[offset];
 		BUG_ON(slot == NULL);
+		if (is_sibling_entry(node, slot)) {
+			offset = sibling_offset(node, slot);
+			slot = node->slots[offset];
+		}
+		/* an item: tag its sibling slots too */
+		if (height == 1 || !radix_tree_is_indirect_ptr(slot))
+			nr = entry_slots(node, offset);
+		for (i = 0; i < nr; i++) {
+			if (!tag_get(node, tag, offset + i))
+				tag_set(node, tag, offset + i);
+		}
+		if (height == 1 || !radix_tree_is_indirect_ptr(slot))
+			break;
 		shift -= RADIX_TREE_MAP_SHIFT;
 		height--;
 	}
@@ -509,8 +583,10 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 	 * since the "list" is null terminated.
 	 */
 	struct radix_tree_path path[RADIX_TREE_MAX_PATH + 1], *pathp = path;
-	struct radix_tree_node *slot = NULL;
+	struct radix_tree_node *node;
+	void *slot = NULL;
 	unsigned int height, shift;
+	unsigned int i, nr = 1;
 
 	height = root->height;
 	if (index > radix_tree_maxindex(height))
@@ -518,7 +594,7 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 
 	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
 	pathp->node = NULL;
-	slot = indirect_to_ptr(root->rnode);
+	slot = root->rnode;
 
 	while (height > 0) {
 		int offset;
@@ -526,11 +602,21 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 		if (slot == NULL)
 			goto out;
 
+		node = indirect_to_ptr(slot);
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		slot = node->slots[offset];
+		if (is_sibling_entry(node, slot)) {
+			offset = sibling_offset(node, slot);
+			slot = node->slots[offset];
+		}
 		pathp[1].offset = offset;
-		pathp[1].node = slot;
-		slot = slot->slots[offset];
+		pathp[1].node = node;
 		pathp++;
+		if (height == 1 || !radix_tree_is_indirect_ptr(slot)) {
+			if (slot)
+				nr = entry_slots(node, offset);
+			break;
+		}
 		shift -= RADIX_TREE_MAP_SHIFT;
 		height--;
 	}
@@ -541,7 +627,10 @@ void *radix_tree_tag_clear(struct radix_tree_root *root,
 	while (pathp->node) {
 		if (!tag_get(pathp->node, tag, pathp->offset))
 			goto out;
-		tag_clear(pathp->node, tag, pathp->offset);
+		/* the item's sibling slots first, then the path up */
+		for (i = 0; i < nr; i++)
+			tag_clear(pathp->node, tag, pathp->offset + i);
+		nr = 1;
 		if (any_tag_set(pathp->node, tag))
 			goto out;
 		pathp--;
@@ -596,17 +685,22 @@ int radix_tree_tag_get(struct radix_tree_root *root,
 	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
 
 	for ( ; ; ) {
+		void *entry;
 		int offset;
 
-		if (node == NULL)
-			return 0;
-
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
 		if (!tag_get(node, tag, offset))
 			return 0;
 		if (height == 1)
 			return 1;
-		node = rcu_dereference_raw(node->slots[offset]);
+		entry = rcu_dereference_raw(node->slots[offset]);
+		if (entry == NULL)
+			return 0;
+		/* a multi-order item carries its tags on all its slots */
+		if (!radix_tree_is_indirect_ptr(entry) ||
+		    is_sibling_entry(node, entry))
+			return 1;
+		node = indirect_to_ptr(entry);
 		shift -= RADIX_TREE_MAP_SHIFT;
 		height--;
 	}
@@ -652,6 +746,8 @@ unsigned long radix_tree_range_tag_if_tagged(struct radix_tree_root *root,
 	unsigned int shift;
 	unsigned long tagged = 0;
 	unsigned long index = *first_indexp;
+	unsigned int i, nr;
+	void *entry;
 
 	last_index = min(last_index, radix_tree_maxindex(height));
 	if (index > last_index)
@@ -682,26 +778,34 @@ unsigned long radix_tree_range_tag_if_tagged(struct radix_tree_root *root,
 		int offset;
 
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
-		if (!slot->slots[offset])
+		entry = slot->slots[offset];
+		if (!entry)
 			goto next;
 		if (!tag_get(slot, iftag, offset))
 			goto next;
-		if (height > 1) {
+		if (height > 1 && radix_tree_is_indirect_ptr(entry) &&
+		    !is_sibling_entry(slot, entry)) {
 			/* Go down one level */
 			height--;
 			shift -= RADIX_TREE_MAP_SHIFT;
 			path[height - 1].node = slot;
 			path[height - 1].offset = offset;
-			slot = slot->slots[offset];
+			slot = indirect_to_ptr(entry);
 			continue;
 		}
 
-		/* tag the leaf */
+		/* tag the item, all its slots, and skip past it */
+		if (is_sibling_entry(slot, entry))
+			offset = sibling_offset(slot, entry);
+		nr = entry_slots(slot, offset);
 		tagged++;
-		tag_set(slot, settag, offset);
+		for (i = 0; i < nr; i++)
+			tag_set(slot, settag, offset + i);
+		index &= ~((RADIX_TREE_MAP_SIZE << shift) - 1);
+		index |= (unsigned long)(offset + nr - 1) << shift;
 
 		/* walk back up the path tagging interior nodes */
-		pathp = &path[0];
+		pathp = &path[height - 1];
 		while (pathp->node) {
 			/* stop if we find a node with the tag already set */
 			if (tag_get(pathp->node, settag, pathp->offset))
@@ -816,56 +920,140 @@ unsigned long radix_tree_prev_hole(struct radix_tree_root *root,
 }
 EXPORT_SYMBOL(radix_tree_prev_hole);
 
-static unsigned int
-__lookup(struct radix_tree_node *slot, void ***results, unsigned long *indices,
-	unsigned long index, unsigned int max_items, unsigned long *next_index)
+/**
+ * radix_tree_next_chunk - find next chunk of slots for iteration
+ *
+ * @root:		radix tree root
+ * @iter:		iterator state
+ * @flags:		RADIX_TREE_ITER_* flags and tag index
+ * Returns:		pointer to chunk first slot, or NULL if iteration is over
+ */
+void **radix_tree_next_chunk(struct radix_tree_root *root,
+			     struct radix_tree_iter *iter, unsigned flags)
 {
-	unsigned int nr_found = 0;
-	unsigned int shift, height;
-	unsigned long i;
+	unsigned shift, tag = flags & RADIX_TREE_ITER_TAG_MASK;
+	struct radix_tree_node *rnode, *node;
+	unsigned long index, offset;
+	void *entry;
 
-	height = slot->height;
-	if (height == 0)
-		goto out;
-	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
+	if ((flags & RADIX_TREE_ITER_TAGGED) && !root_tag_get(root, tag))
+		return NULL;
 
-	for ( ; height > 1; height--) {
-		i = (index >> shift) & RADIX_TREE_MAP_MASK;
-		for (;;) {
-			if (slot->slots[i] != NULL)
-				break;
-			index &= ~((1UL << shift) - 1);
-			index += 1UL << shift;
-			if (index == 0)
-				goto out;	/* 32-bit wraparound */
-			i++;
-			if (i == RADIX_TREE_MAP_SIZE)
-				goto out;
+	/*
+	 * Catch next_index overflow after ~0UL. iter->index never overflows
+	 * during iterating; it can be zero only at the beginning.
+	 * And we cannot overflow iter->next_index in a single step,
+	 * because RADIX_TREE_MAP_SHIFT < BITS_PER_LONG.
+	 */
+	index = iter->next_index;
+	if (!index && iter->index)
+		return NULL;
+
+	rnode = rcu_dereference_raw(root->rnode);
+	if (radix_tree_is_indirect_ptr(rnode)) {
+		rnode = indirect_to_ptr(rnode);
+	} else if (rnode && !index) {
+		/* Single-slot tree */
+		iter->index = 0;
+		iter->next_index = 1;
+		iter->tags = 1;
+		iter->shift = 0;
+		return (void **)&root->rnode;
+	} else
+		return NULL;
+
+restart:
+	shift = (rnode->height - 1) * RADIX_TREE_MAP_SHIFT;
+	offset = index >> shift;
+
+	/* Index outside of the tree */
+	if (offset >= RADIX_TREE_MAP_SIZE)
+		return NULL;
+
+	node = rnode;
+	while (1) {
+		if ((flags & RADIX_TREE_ITER_TAGGED) ?
+				!test_bit(offset, node->tags[tag]) :
+				!node->slots[offset]) {
+			/* Hole detected */
+			if (flags & RADIX_TREE_ITER_CONTIG)
+				return NULL;
+
+			if (flags & RADIX_TREE_ITER_TAGGED)
+				offset = find_next_bit(node->tags[tag],
+						RADIX_TREE_MAP_SIZE,
+						offset + 1);
+			else
+				while (++offset	< RADIX_TREE_MAP_SIZE) {
+					if (node->slots[offset])
+						break;
+				}
+			index &= ~((RADIX_TREE_MAP_SIZE << shift) - 1);
+			index += offset << shift;
+			/* Overflow after ~0UL */
+			if (!index)
+				return NULL;
+			if (offset == RADIX_TREE_MAP_SIZE)
+				goto restart;
 		}
 
+		/* Started inside a multi-order item: back up to its start */
+		entry = rcu_dereference_raw(node->slots[offset]);
+		if (is_sibling_entry(node, entry)) {
+			offset = sibling_offset(node, entry);
+			entry = rcu_dereference_raw(node->slots[offset]);
+			index &= ~((RADIX_TREE_MAP_SIZE << shift) - 1);
+			index += offset << shift;
+		}
+
+		/* This is leaf-node */
+		if (!shift)
+			break;
+
+		if (entry == NULL)
+			goto restart;
+		/* A multi-order item above the leaves is a chunk of its own */
+		if (!radix_tree_is_indirect_ptr(entry)) {
+			unsigned int nr = entry_slots(node, offset);
+
+			index &= ~((1UL << shift) - 1);
+			iter->index = index;
+			iter->shift = shift + __ffs(nr);
+			iter->next_index = index + ((unsigned long)nr << shift);
+			iter->tags = 1;
+			return node->slots + offset;
+		}
+		node = indirect_to_ptr(entry);
 		shift -= RADIX_TREE_MAP_SHIFT;
-		slot = rcu_dereference_raw(slot->slots[i]);
-		if (slot == NULL)
-			goto out;
+		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
 	}
 
-	/* Bottom level: grab some items */
-	for (i = index & RADIX_TREE_MAP_MASK; i < RADIX_TREE_MAP_SIZE; i++) {
-		if (slot->slots[i]) {
-			results[nr_found] = &(slot->slots[i]);
-			if (indices)
-				indices[nr_found] = index;
-			if (++nr_found == max_items) {
-				index++;
-				goto out;
-			}
+	/* Update the iterator state */
+	iter->index = index;
+	iter->next_index = (index | RADIX_TREE_MAP_MASK) + 1;
+	iter->shift = 0;
+
+	/* Construct iter->tags bit-mask from node->tags[tag] array */
+	if (flags & RADIX_TREE_ITER_TAGGED) {
+		unsigned tag_long, tag_bit;
+
+		tag_long = offset / BITS_PER_LONG;
+		tag_bit  = offset % BITS_PER_LONG;
+		iter->tags = node->tags[tag][tag_long] >> tag_bit;
+		/* This never happens if RADIX_TREE_TAG_LONGS == 1 */
+		if (tag_long < RADIX_TREE_TAG_LONGS - 1) {
+			/* Pick tags from next element */
+			if (tag_bit)
+				iter->tags |= node->tags[tag][tag_long + 1] <<
+						(BITS_PER_LONG - tag_bit);
+			/* Clip chunk size, here only BITS_PER_LONG tags */
+			iter->next_index = index + BITS_PER_LONG;
 		}
-		index++;
 	}
-out:
-	*next_index = index;
-	return nr_found;
+
+	return node->slots + offset;
 }
+EXPORT_SYMBOL(radix_tree_next_chunk);
 
 /**
  *	radix_tree_gang_lookup - perform multiple lookup on a radix tree
@@ -878,8 +1066,6 @@ out:
  *	them at *@results and returns the number of items which were placed at
  *	*@results.
  *
- *	The implementation is naive.
- *
  *	Like radix_tree_lookup, radix_tree_gang_lookup may be called under
  *	rcu_read_lock. In this case, rather than the returned results being
  *	an atomic snapshot of the tree at a single point in time, the semantics
@@ -890,48 +1076,19 @@ unsigned int
 radix_tree_gang_lookup(struct radix_tree_root *root, void **results,
 			unsigned long first_index, unsigned int max_items)
 {
-	unsigned long max_index;
-	struct radix_tree_node *node;
-	unsigned long cur_index = first_index;
-	unsigned int ret;
+	struct radix_tree_iter iter;
+	void **slot;
+	unsigned int ret = 0;
 
-	node = rcu_dereference_raw(root->rnode);
-	if (!node)
+	if (unlikely(!max_items))
 		return 0;
 
-	if (!radix_tree_is_indirect_ptr(node)) {
-		if (first_index > 0)
-			return 0;
-		results[0] = node;
-		return 1;
-	}
-	node = indirect_to_ptr(node);
-
-	max_index = radix_tree_maxindex(node->height);
-
-	ret = 0;
-	while (ret < max_items) {
-		unsigned int nr_found, slots_found, i;
-		unsigned long next_index;	/* Index of next search */
-
-		if (cur_index > max_index)
-			break;
-		slots_found = __lookup(node, (void ***)results + ret, NULL,
-				cur_index, max_items - ret, &next_index);
-		nr_found = 0;
-		for (i = 0; i < slots_found; i++) {
-			struct radix_tree_node *slot;
-			slot = *(((void ***)results)[ret + i]);
-			if (!slot)
-				continue;
-			results[ret + nr_found] =
-				indirect_to_ptr(rcu_dereference_raw(slot));
-			nr_found++;
-		}
-		ret += nr_found;
-		if (next_index == 0)
+	radix_tree_for_each_slot(slot, root, &iter, first_index) {
+		results[ret] = indirect_to_ptr(rcu_dereference_raw(*slot));
+		if (!results[ret])
+			continue;
+		if (++ret == max_items)
 			break;
-		cur_index = next_index;
 	}
 
 	return ret;
@@ -950,8 +1107,6 @@ EXPORT_SYMBOL(radix_tree_gang_lookup);
  *	their slots at *@results and returns the number of items which were
  *	placed at *@results.
  *
- *	The implementation is naive.
- *
  *	Like radix_tree_gang_lookup as far as RCU and locking goes. Slots must
  *	be dereferenced with radix_tree_deref_slot, and if using only RCU
  *	protection, radix_tree_deref_slot may fail requiring a retry.
@@ -961,112 +1116,25 @@ radix_tree_gang_lookup_slot(struct radix_tree_root *root,
 			void ***results, unsigned long *indices,
 			unsigned long first_index, unsigned int max_items)
 {
-	unsigned long max_index;
-	struct radix_tree_node *node;
-	unsigned long cur_index = first_index;
-	unsigned int ret;
+	struct radix_tree_iter iter;
+	void **slot;
+	unsigned int ret = 0;
 
-	node = rcu_dereference_raw(root->rnode);
-	if (!node)
+	if (unlikely(!max_items))
 		return 0;
 
-	if (!radix_tree_is_indirect_ptr(node)) {
-		if (first_index > 0)
-			return 0;
-		results[0] = (void **)&root->rnode;
+	radix_tree_for_each_slot(slot, root, &iter, first_index) {
+		results[ret] = slot;
 		if (indices)
-			indices[0] = 0;
-		return 1;
-	}
-	node = indirect_to_ptr(node);
-
-	max_index = radix_tree_maxindex(node->height);
-
-	ret = 0;
-	while (ret < max_items) {
-		unsigned int slots_found;
-		unsigned long next_index;	/* Index of next search */
-
-		if (cur_index > max_index)
+			indices[ret] = iter.index;
+		if (++ret == max_items)
 			break;
-		slots_found = __lookup(node, results + ret,
-				indices ? indices + ret : NULL,
-				cur_index, max_items - ret, &next_index);
-		ret += slots_found;
-		if (next_index == 0)
-			break;
-		cur_index = next_index;
 	}
 
 	return ret;
 }
 EXPORT_SYMBOL(radix_tree_gang_lookup_slot);
 
-/*
- * FIXME: the two tag_get()s here should use find_next_bit() instead of
- * open-coding the search.
- */
-static unsigned int
-__lookup_tag(struct radix_tree_node *slot, void ***results, unsigned long index,
-	unsigned int max_items, unsigned long *next_index, unsigned int tag)
-{
-	unsigned int nr_found = 0;
-	unsigned int shift, height;
-
-	height = slot->height;
-	if (height == 0)
-		goto out;
-	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
-
-	while (height > 0) {
-		unsigned long i = (index >> shift) & RADIX_TREE_MAP_MASK ;
-
-		for (;;) {
-			if (tag_get(slot, tag, i))
-				break;
-			index &= ~((1UL << shift) - 1);
-			index += 1UL << shift;
-			if (index == 0)
-				goto out;	/* 32-bit wraparound */
-			i++;
-			if (i == RADIX_TREE_MAP_SIZE)
-				goto out;
-		}
-		height--;
-		if (height == 0) {	/* Bottom level: grab some items */
-			unsigned long j = index & RADIX_TREE_MAP_MASK;
-
-			for ( ; j < RADIX_TREE_MAP_SIZE; j++) {
-				index++;
-				if (!tag_get(slot, tag, j))
-					continue;
-				/*
-				 * Even though the tag was found set, we need to
-				 * recheck that we have a non-NULL node, because
-				 * if this lookup is lockless, it may have been
-				 * subsequently deleted.
-				 *
-				 * Similar care must be taken in any place that
-				 * lookup ->slots[x] without a lock (ie. can't
-				 * rely on its value remaining the same).
-				 */
-				if (slot->slots[j]) {
-					results[nr_found++] = &(slot->slots[j]);
-					if (nr_found == max_items)
-						goto out;
-				}
-			}
-		}
-		shift -= RADIX_TREE_MAP_SHIFT;
-		slot = rcu_dereference_raw(slot->slots[i]);
-		if (slot == NULL)
-			break;
-	}
-out:
-	*next_index = index;
-	return nr_found;
-}
-
 /**
  *	radix_tree_gang_lookup_tag - perform multiple lookup on a radix tree
  *	                             based on a tag
@@ -1085,52 +1153,19 @@ radix_tree_gang_lookup_tag(struct radix_tree_root *root, void **results,
 		unsigned long first_index, unsigned int max_items,
 		unsigned int tag)
 {
-	struct radix_tree_node *node;
-	unsigned long max_index;
-	unsigned long cur_index = first_index;
-	unsigned int ret;
+	struct radix_tree_iter iter;
+	void **slot;
+	unsigned int ret = 0;
 
-	/* check the root's tag bit */
-	if (!root_tag_get(root, tag))
-		return 0;
-
-	node = rcu_dereference_raw(root->rnode);
-	if (!node)
+	if (unlikely(!max_items))
 		return 0;
 
-	if (!radix_tree_is_indirect_ptr(node)) {
-		if (first_index > 0)
-			return 0;
-		results[0] = node;
-		return 1;
-	}
-	node = indirect_to_ptr(node);
-
-	max_index = radix_tree_maxindex(node->height);
-
-	ret = 0;
-	while (ret < max_items) {
-		unsigned int nr_found, slots_found, i;
-		unsigned long next_index;	/* Index of next search */
-
-		if (cur_index > max_index)
-			break;
-		slots_found = __lookup_tag(node, (void ***)results + ret,
-				cur_index, max_items - ret, &next_index, tag);
-		nr_found = 0;
-		for (i = 0; i < slots_found; i++) {
-			struct radix_tree_node *slot;
-			slot = *(((void ***)results)[ret + i]);
-			if (!slot)
-				continue;
-			results[ret + nr_found] =
-				indirect_to_ptr(rcu_dereference_raw(slot));
-			nr_found++;
-		}
-		ret += nr_found;
-		if (next_index == 0)
+	radix_tree_for_each_tagged(slot, root, &iter, first_index, tag) {
+		results[ret] = indirect_to_ptr(rcu_dereference_raw(*slot));
+		if (!results[ret])
+			continue;
+		if (++ret == max_items)
 			break;
-		cur_index = next_index;
 	}
 
 	return ret;
@@ -1155,42 +1190,17 @@ radix_tree_gang_lookup_tag_slot(struct radix_tree_root *root, void ***results,
 		unsigned long first_index, unsigned int max_items,
 		unsigned int tag)
 {
-	struct radix_tree_node *node;
-	unsigned long max_index;
-	unsigned long cur_index = first_index;
-	unsigned int ret;
+	struct radix_tree_iter iter;
+	void **slot;
+	unsigned int ret = 0;
 
-	/* check the root's tag bit */
-	if (!root_tag_get(root, tag))
-		return 0;
-
-	node = rcu_dereference_raw(root->rnode);
-	if (!node)
+	if (unlikely(!max_items))
 		return 0;
 
-	if (!radix_tree_is_indirect_ptr(node)) {
-		if (first_index > 0)
-			return 0;
-		results[0] = (void **)&root->rnode;
-		return 1;
-	}
-	node = indirect_to_ptr(node);
-
-	max_index = radix_tree_maxindex(node->height);
-
-	ret = 0;
-	while (ret < max_items) {
-		unsigned int slots_found;
-		unsigned long next_index;	/* Index of next search */
-
-		if (cur_index > max_index)
+	radix_tree_for_each_tagged(slot, root, &iter, first_index, tag) {
+		results[ret] = slot;
+		if (++ret == max_items)
 			break;
-		slots_found = __lookup_tag(node, results + ret,
-				cur_index, max_items - ret, &next_index, tag);
-		ret += slots_found;
-		if (next_index == 0)
-			break;
-		cur_index = next_index;
 	}
 
 	return ret;
@@ -1200,51 +1210,6 @@ EXPORT_SYMBOL(radix_tree_gang_lookup_tag_slot);
 #if defined(CONFIG_SHMEM) && defined(CONFIG_SWAP)
 #include <linux/sched.h> /* for cond_resched() */
 
-/*
- * This linear search is at present only useful to shmem_unuse_inode().
- */
-static unsigned long __locate(struct radix_tree_node *slot, void *item,
-			      unsigned long index, unsigned long *found_index)
-{
-	unsigned int shift, height;
-	unsigned long i;
-
-	height = slot->height;
-	shift = (height-1) * RADIX_TREE_MAP_SHIFT;
-
-	for ( ; height > 1; height--) {
-		i = (index >> shift) & RADIX_TREE_MAP_MASK;
-		for (;;) {
-			if (slot->slots[i] != NULL)
-				break;
-			index &= ~((1UL << shift) - 1);
-			index += 1UL << shift;
-			if (index == 0)
-				goto out;	/* 32-bit wraparound */
-			i++;
-			if (i == RADIX_TREE_MAP_SIZE)
-				goto out;
-		}
-
-		shift -= RADIX_TREE_MAP_SHIFT;
-		slot = rcu_dereference_raw(slot->slots[i]);
-		if (slot == NULL)
-			goto out;
-	}
-
-	/* Bottom level: check items */
-	for (i = 0; i < RADIX_TREE_MAP_SIZE; i++) {
-		if (slot->slots[i] == item) {
-			*found_index = index + i;
-			index = 0;
-			goto out;
-		}
-	}
-	index += RADIX_TREE_MAP_SIZE;
-out:
-	return index;
-}
-
 /**
  *	radix_tree_locate_item - search through radix tree for item
  *	@root:		radix tree root
@@ -1253,34 +1218,30 @@ out:
  *	Returns index where item was found, or -1 if not found.
  *	Caller must hold no lock (since this time-consuming function needs
  *	to be preemptible), and must check afterwards if item is still there.
+ *
+ *	This linear search is at present only useful to shmem_unuse_inode().
  */
 unsigned long radix_tree_locate_item(struct radix_tree_root *root, void *item)
 {
-	struct radix_tree_node *node;
-	unsigned long max_index;
-	unsigned long cur_index = 0;
+	struct radix_tree_iter iter;
+	void **slot;
 	unsigned long found_index = -1;
 
-	do {
-		rcu_read_lock();
-		node = rcu_dereference_raw(root->rnode);
-		if (!radix_tree_is_indirect_ptr(node)) {
-			rcu_read_unlock();
-			if (node == item)
-				found_index = 0;
-			break;
+	rcu_read_lock();
+	radix_tree_for_each_chunk(slot, root, &iter, 0, 0) {
+		radix_tree_for_each_chunk_slot(slot, &iter, 0) {
+			if (rcu_dereference_raw(*slot) == item) {
+				found_index = iter.index;
+				goto out;
+			}
 		}
-
-		node = indirect_to_ptr(node);
-		max_index = radix_tree_maxindex(node->height);
-		if (cur_index > max_index)
-			break;
-
-		cur_index = __locate(node, item, cur_index, &found_index);
+		/* the iterator resumes from iter.next_index */
 		rcu_read_unlock();
 		cond_resched();
-	} while (cur_index != 0 && cur_index <= max_index);
-
+		rcu_read_lock();
+	}
+out:
+	rcu_read_unlock();
 	return found_index;
 }
 #else
@@ -1313,6 +1274,14 @@ static inline void radix_tree_shrink(struct radix_tree_root *root)
 		if (!to_free->slots[0])
 			break;
 
+		/*
+		 * Only an item at index 0 can be kept directly in the root:
+		 * a multi-order item above the leaves has to stay in a node.
+		 */
+		newptr = to_free->slots[0];
+		if (root->height > 1 && !radix_tree_is_indirect_ptr(newptr))
+			break;
+
 		/*
 		 * We don't need rcu_assign_pointer(), since we are simply
 		 * moving the node from one part of the tree to another: if it
@@ -1320,9 +1289,6 @@ static inline void radix_tree_shrink(struct radix_tree_root *root)
 		 * (to_free->slots[0]), it will be safe to dereference the new
 		 * one (root->rnode) as far as dependent read barriers go.
 		 */
-		newptr = to_free->slots[0];
-		if (root->height > 1)
-			newptr = ptr_to_indirect(newptr);
 		root->rnode = newptr;
 		root->height--;
 
@@ -1368,9 +1334,11 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 	 * since the "list" is null terminated.
 	 */
 	struct radix_tree_path path[RADIX_TREE_MAX_PATH + 1], *pathp = path;
-	struct radix_tree_node *slot = NULL;
+	struct radix_tree_node *node;
 	struct radix_tree_node *to_free;
+	void *slot = NULL;
 	unsigned int height, shift;
+	unsigned int nr;
 	int tag;
 	int offset;
 
@@ -1384,7 +1352,6 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 		root->rnode = NULL;
 		goto out;
 	}
-	slot = indirect_to_ptr(slot);
 
 	shift = (height - 1) * RADIX_TREE_MAP_SHIFT;
 	pathp->node = NULL;
@@ -1393,17 +1360,23 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 		if (slot == NULL)
 			goto out;
 
+		node = indirect_to_ptr(slot);
 		pathp++;
 		offset = (index >> shift) & RADIX_TREE_MAP_MASK;
+		slot = node->slots[offset];
+		if (is_sibling_entry(node, slot)) {
+			offset = sibling_offset(node, slot);
+			slot = node->slots[offset];
+		}
 		pathp->offset = offset;
-		pathp->node = slot;
-		slot = slot->slots[offset];
+		pathp->node = node;
 		shift -= RADIX_TREE_MAP_SHIFT;
 		height--;
-	} while (height > 0);
+	} while (height > 0 && radix_tree_is_indirect_ptr(slot));
 
 	if (slot == NULL)
 		goto out;
+	nr = entry_slots(pathp->node, pathp->offset);
 
 	/*
 	 * Clear all tags associated with the just-deleted item
@@ -1416,8 +1389,11 @@ void *radix_tree_delete(struct radix_tree_root *root, unsigned long index)
 	to_free = NULL;
 	/* Now free the nodes we do not need anymore */
 	while (pathp->node) {
-		pathp->node->slots[pathp->offset] = NULL;
-		pathp->node->count--;
+		/* the item's sibling slots first, then the path up */
+		pathp->node->count -= nr;
+		while (nr--)
+			pathp->node->slots[pathp->offset + nr] = NULL;
+		nr = 1;
 		/*
 		 * Queue the node for deferred freeing after the
 		 * last reference to it disappears (set NULL, above).
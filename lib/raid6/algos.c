@@ -33,6 +33,12 @@ EXPORT_SYMBOL(raid6_empty_zero_page);
 struct raid6_calls raid6_call;
 EXPORT_SYMBOL_GPL(raid6_call);
 
+void (*raid6_2data_recov)(int, size_t, int, int, void **);
+EXPORT_SYMBOL_GPL(raid6_2data_recov);
+
+void (*raid6_datap_recov)(int, size_t, int, void **);
+EXPORT_SYMBOL_GPL(raid6_datap_recov);
+
 const struct raid6_calls * const raid6_algos[] = {
 	&raid6_intx1,
 	&raid6_intx2,
@@ -55,6 +61,14 @@ const struct raid6_calls * const raid6_algos[] = {
 	&raid6_sse2x2,
 	&raid6_sse2x4,
 #endif
+#if (defined(__i386__) || defined(__x86_64__)) && !defined(__arch_um__) && \
+	defined(CONFIG_AS_AVX2)
+	&raid6_avx2x1,
+	&raid6_avx2x2,
+#ifdef __x86_64__
+	&raid6_avx2x4,
+#endif
+#endif
 #ifdef CONFIG_ALTIVEC
 	&raid6_altivec1,
 	&raid6_altivec2,
@@ -64,6 +78,24 @@ const struct raid6_calls * const raid6_algos[] = {
 	NULL
 };
 
+const struct raid6_recov_calls * const raid6_recov_algos[] = {
+#if (defined(__i386__) || defined(__x86_64__)) && !defined(__arch_um__)
+#ifdef CONFIG_AS_AVX2
+	&raid6_recov_avx2,
+#endif
+#ifdef CONFIG_AS_SSSE3
+	&raid6_recov_ssse3,
+#endif
+#endif
+	&raid6_recov_intx1,
+	NULL
+};
+
+/* Measured speeds in MB/s, 0 for routines that are not usable */
+static unsigned long raid6_gen_speed[ARRAY_SIZE(raid6_algos)];
+static unsigned long raid6_recov_speed[ARRAY_SIZE(raid6_recov_algos)];
+static const struct raid6_recov_calls *raid6_recov_best;
+
 #ifdef __KERNEL__
 #define RAID6_TIME_JIFFIES_LG2	4
 #else
@@ -72,6 +104,52 @@ const struct raid6_calls * const raid6_algos[] = {
 #define time_before(x, y) ((x) < (y))
 #endif
 
+/* Try to pick the best recovery routine, with the syndrome routine
+   already chosen.  Timed on a four disk set: two data pages rebuilt from
+   P and Q. */
+static void __init raid6_choose_recov(void **dptrs)
+{
+	const struct raid6_recov_calls * const * algo;
+	const struct raid6_recov_calls * best;
+	unsigned long perf, bestperf;
+	unsigned long j0, j1;
+
+	bestperf = 0;  best = NULL;
+
+	for ( algo = raid6_recov_algos ; *algo ; algo++ ) {
+		if ( !(*algo)->valid || (*algo)->valid() ) {
+			perf = 0;
+
+			preempt_disable();
+			j0 = jiffies;
+			while ( (j1 = jiffies) == j0 )
+				cpu_relax();
+			while (time_before(jiffies,
+					    j1 + (1<<RAID6_TIME_JIFFIES_LG2))) {
+				(*algo)->data2(4, PAGE_SIZE, 0, 1, dptrs);
+				perf++;
+			}
+			preempt_enable();
+
+			if ( !best || perf > bestperf ) {
+				best = *algo;
+				bestperf = perf;
+			}
+			raid6_recov_speed[algo - raid6_recov_algos] =
+				(perf*HZ*(2*PAGE_SIZE/1024)) >>
+				(10+RAID6_TIME_JIFFIES_LG2);
+			printk("raid6: %-8s %5ld MB/s (recovery)\n",
+			       (*algo)->name,
+			       raid6_recov_speed[algo - raid6_recov_algos]);
+		}
+	}
+
+	printk("raid6: using %s recovery algorithm\n", best->name);
+	raid6_2data_recov = best->data2;
+	raid6_datap_recov = best->datap;
+	raid6_recov_best = best;
+}
+
 /* Try to pick the best algorithm */
 /* This code uses the gfmul table as convenient data set to abuse */
 
@@ -91,8 +169,9 @@ int __init raid6_select_algo(void)
 		dptrs[i] = ((char *)raid6_gfmul) + PAGE_SIZE*i;
 	}
 
-	/* Normal code - use a 2-page allocation to avoid D$ conflict */
-	syndromes = (void *) __get_free_pages(GFP_KERNEL, 1);
+	/* Normal code - use a 2-page allocation to avoid D$ conflict;
+	   two more pages serve as writable data for the recovery test */
+	syndromes = (void *) __get_free_pages(GFP_KERNEL, 2);
 
 	if ( !syndromes ) {
 		printk("raid6: Yikes!  No memory available.\n");
@@ -126,8 +205,10 @@ int __init raid6_select_algo(void)
 				bestprefer = best->prefer;
 				bestperf = perf;
 			}
+			raid6_gen_speed[algo - raid6_algos] =
+				(perf*HZ) >> (20-16+RAID6_TIME_JIFFIES_LG2);
 			printk("raid6: %-8s %5ld MB/s\n", (*algo)->name,
-			       (perf*HZ) >> (20-16+RAID6_TIME_JIFFIES_LG2));
+			       raid6_gen_speed[algo - raid6_algos]);
 		}
 	}
 
@@ -136,14 +217,54 @@ int __init raid6_select_algo(void)
 		       best->name,
 		       (bestperf*HZ) >> (20-16+RAID6_TIME_JIFFIES_LG2));
 		raid6_call = *best;
+
+		dptrs[0] = syndromes + 2*PAGE_SIZE;
+		dptrs[1] = syndromes + 3*PAGE_SIZE;
+		dptrs[2] = syndromes;
+		dptrs[3] = syndromes + PAGE_SIZE;
+		raid6_choose_recov(dptrs);
 	} else
 		printk("raid6: Yikes!  No algorithm found!\n");
 
-	free_pages((unsigned long)syndromes, 1);
+	free_pages((unsigned long)syndromes, 2);
 
 	return best ? 0 : -EINVAL;
 }
 
+#ifdef __KERNEL__
+/* /sys/module/raid6_pq/parameters/speeds: one line per usable routine */
+static int raid6_speeds_get(char *buffer, const struct kernel_param *kp)
+{
+	int i, len = 0;
+
+	for (i = 0; raid6_algos[i]; i++)
+		if (raid6_gen_speed[i])
+			len += snprintf(buffer + len, PAGE_SIZE - len,
+					"gen\t%-8s %5lu MB/s%s\n",
+					raid6_algos[i]->name,
+					raid6_gen_speed[i],
+					raid6_algos[i]->gen_syndrome ==
+					raid6_call.gen_syndrome ? " *" : "");
+
+	for (i = 0; raid6_recov_algos[i]; i++)
+		if (raid6_recov_speed[i])
+			len += snprintf(buffer + len, PAGE_SIZE - len,
+					"recov\t%-8s %5lu MB/s%s\n",
+					raid6_recov_algos[i]->name,
+					raid6_recov_speed[i],
+					raid6_recov_algos[i] ==
+					raid6_recov_best ? " *" : "");
+
+	return len;
+}
+
+static struct kernel_param_ops raid6_speeds_ops = {
+	.get = raid6_speeds_get,
+};
+module_param_cb(speeds, &raid6_speeds_ops, NULL, 0444);
+MODULE_PARM_DESC(speeds, "Measured RAID-6 routine speeds");
+#endif
+
 static void raid6_exit(void)
 {
 	do { } while (0);
@@ -0,0 +1,172 @@
+/* -*- linux-c -*- ------------------------------------------------------- *
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, Inc., 53 Temple Place Ste 330,
+ *   Boston MA 02111-1307, USA; either version 2 of the License, or
+ *   (at your option) any later version; incorporated herein by reference.
+ *
+ * ----------------------------------------------------------------------- */
+
+/*
+ * raid6/recov_avx2.c
+ *
+ * AVX2 implementation of RAID-6 dual failure recovery.  Same nibble table
+ * scheme as the SSSE3 version, 32 bytes at a time, with the lookup tables
+ * broadcast into both lanes and kept in registers.  Requires bytes to be a
+ * multiple of 32.
+ */
+
+#if (defined(__i386__) || defined(__x86_64__)) && !defined(__arch_um__) && \
+	defined(CONFIG_AS_AVX2)
+
+#include <linux/raid/pq.h>
+#include "x86.h"
+
+static const u8 raid6_avx2_x0f[32] __attribute__((aligned(32))) = {
+	0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f,
+	0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f,
+	0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f,
+	0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f,
+};
+
+static int raid6_has_avx2(void)
+{
+	return boot_cpu_has(X86_FEATURE_AVX2) && raid6_have_ymm();
+}
+
+static void raid6_2data_recov_avx2(int disks, size_t bytes, int faila,
+		int failb, void **ptrs)
+{
+	u8 *p, *q, *dp, *dq;
+	const u8 *pbmul;	/* P multiplier table for B data */
+	const u8 *qmul;		/* Q multiplier table (for both) */
+	size_t d;
+
+	p = (u8 *)ptrs[disks-2];
+	q = (u8 *)ptrs[disks-1];
+
+	/* Compute syndrome with zero for the missing data pages
+	   Use the dead data pages as temporary storage for
+	   delta p and delta q */
+	dp = (u8 *)ptrs[faila];
+	ptrs[faila] = (void *)raid6_empty_zero_page;
+	ptrs[disks-2] = dp;
+	dq = (u8 *)ptrs[failb];
+	ptrs[failb] = (void *)raid6_empty_zero_page;
+	ptrs[disks-1] = dq;
+
+	raid6_call.gen_syndrome(disks, bytes, ptrs);
+
+	/* Restore pointer table */
+	ptrs[faila]   = dp;
+	ptrs[failb]   = dq;
+	ptrs[disks-2] = p;
+	ptrs[disks-1] = q;
+
+	/* Now, pick the proper data tables */
+	pbmul = raid6_vgfmul[raid6_gfexi[failb-faila]];
+	qmul  = raid6_vgfmul[raid6_gfinv[raid6_gfexp[faila] ^
+		raid6_gfexp[failb]]];
+
+	kernel_fpu_begin();
+
+	asm volatile("vmovdqa %0,%%ymm7" : : "m" (raid6_avx2_x0f[0]));
+	asm volatile("vbroadcasti128 %0,%%ymm3" : : "m" (pbmul[0]));
+	asm volatile("vbroadcasti128 %0,%%ymm4" : : "m" (pbmul[16]));
+	asm volatile("vbroadcasti128 %0,%%ymm5" : : "m" (qmul[0]));
+	asm volatile("vbroadcasti128 %0,%%ymm6" : : "m" (qmul[16]));
+
+	for (d = 0; d < bytes; d += 32) {
+		asm volatile("vmovdqa %0,%%ymm1" : : "m" (q[d]));
+		asm volatile("vmovdqa %0,%%ymm0" : : "m" (p[d]));
+		asm volatile("vpxor %0,%%ymm1,%%ymm1" : : "m" (dq[d]));
+		asm volatile("vpxor %0,%%ymm0,%%ymm0" : : "m" (dp[d]));
+
+		/* ymm1 = qx = qmul[q ^ dq] */
+		asm volatile("vpsrlw $4,%ymm1,%ymm2");
+		asm volatile("vpand %ymm7,%ymm1,%ymm1");
+		asm volatile("vpand %ymm7,%ymm2,%ymm2");
+		asm volatile("vpshufb %ymm1,%ymm5,%ymm1");
+		asm volatile("vpshufb %ymm2,%ymm6,%ymm2");
+		asm volatile("vpxor %ymm2,%ymm1,%ymm1");
+
+		/* ymm1 = db = pbmul[px] ^ qx */
+		asm volatile("vpand %ymm7,%ymm0,%ymm2");
+		asm volatile("vpshufb %ymm2,%ymm3,%ymm2");
+		asm volatile("vpxor %ymm2,%ymm1,%ymm1");
+		asm volatile("vpsrlw $4,%ymm0,%ymm2");
+		asm volatile("vpand %ymm7,%ymm2,%ymm2");
+		asm volatile("vpshufb %ymm2,%ymm4,%ymm2");
+		asm volatile("vpxor %ymm2,%ymm1,%ymm1");
+
+		/* Reconstructed B, then reconstructed A = db ^ px */
+		asm volatile("vmovdqa %%ymm1,%0" : "=m" (dq[d]));
+		asm volatile("vpxor %ymm1,%ymm0,%ymm0");
+		asm volatile("vmovdqa %%ymm0,%0" : "=m" (dp[d]));
+	}
+
+	asm volatile("vzeroupper");
+	kernel_fpu_end();
+}
+
+static void raid6_datap_recov_avx2(int disks, size_t bytes, int faila,
+		void **ptrs)
+{
+	u8 *p, *q, *dq;
+	const u8 *qmul;		/* Q multiplier table */
+	size_t d;
+
+	p = (u8 *)ptrs[disks-2];
+	q = (u8 *)ptrs[disks-1];
+
+	/* Compute syndrome with zero for the missing data page
+	   Use the dead data page as temporary storage for delta q */
+	dq = (u8 *)ptrs[faila];
+	ptrs[faila] = (void *)raid6_empty_zero_page;
+	ptrs[disks-1] = dq;
+
+	raid6_call.gen_syndrome(disks, bytes, ptrs);
+
+	/* Restore pointer table */
+	ptrs[faila]   = dq;
+	ptrs[disks-1] = q;
+
+	/* Now, pick the proper data tables */
+	qmul  = raid6_vgfmul[raid6_gfinv[raid6_gfexp[faila]]];
+
+	kernel_fpu_begin();
+
+	asm volatile("vmovdqa %0,%%ymm7" : : "m" (raid6_avx2_x0f[0]));
+	asm volatile("vbroadcasti128 %0,%%ymm5" : : "m" (qmul[0]));
+	asm volatile("vbroadcasti128 %0,%%ymm6" : : "m" (qmul[16]));
+
+	for (d = 0; d < bytes; d += 32) {
+		asm volatile("vmovdqa %0,%%ymm1" : : "m" (q[d]));
+		asm volatile("vpxor %0,%%ymm1,%%ymm1" : : "m" (dq[d]));
+
+		/* ymm1 = qmul[q ^ dq] */
+		asm volatile("vpsrlw $4,%ymm1,%ymm2");
+		asm volatile("vpand %ymm7,%ymm1,%ymm1");
+		asm volatile("vpand %ymm7,%ymm2,%ymm2");
+		asm volatile("vpshufb %ymm1,%ymm5,%ymm1");
+		asm volatile("vpshufb %ymm2,%ymm6,%ymm2");
+		asm volatile("vpxor %ymm2,%ymm1,%ymm1");
+
+		asm volatile("vmovdqa %%ymm1,%0" : "=m" (dq[d]));
+		asm volatile("vpxor %0,%%ymm1,%%ymm1" : : "m" (p[d]));
+		asm volatile("vmovdqa %%ymm1,%0" : "=m" (p[d]));
+	}
+
+	asm volatile("vzeroupper");
+	kernel_fpu_end();
+}
+
+const struct raid6_recov_calls raid6_recov_avx2 = {
+	.data2 = raid6_2data_recov_avx2,
+	.datap = raid6_datap_recov_avx2,
+	.valid = raid6_has_avx2,
+	.name = "avx2",
+};
+
+#endif
@@ -24,6 +24,22 @@
 #ifdef __KERNEL__ /* Real code */
 
 #include <asm/i387.h>
+#include <asm/xcr.h>
+#include <asm/xsave.h>
+
+/* AVX also needs the OS to save and restore the YMM state */
+static inline int raid6_have_ymm(void)
+{
+	u64 xcr0;
+
+	if (!boot_cpu_has(X86_FEATURE_AVX) ||
+	    !boot_cpu_has(X86_FEATURE_OSXSAVE))
+		return 0;
+
+	xcr0 = xgetbv(XCR_XFEATURE_ENABLED_MASK);
+	return (xcr0 & (XSTATE_SSE | XSTATE_YMM)) ==
+		(XSTATE_SSE | XSTATE_YMM);
+}
 
 #else /* Dummy code for user space testing */
 
@@ -41,18 +57,50 @@ static inline void kernel_fpu_end(void)
 #define X86_FEATURE_XMM		(0*32+25) /* Streaming SIMD Extensions */
 #define X86_FEATURE_XMM2	(0*32+26) /* Streaming SIMD Extensions-2 */
 #define X86_FEATURE_MMXEXT	(1*32+22) /* AMD MMX extensions */
+#define X86_FEATURE_SSSE3	(4*32+ 9) /* Supplemental SSE-3 */
+#define X86_FEATURE_AVX		(4*32+28) /* Advanced Vector Extensions */
+#define X86_FEATURE_AVX2	(9*32+ 5) /* AVX2 instructions */
 
 /* Should work well enough on modern CPUs for testing */
 static inline int boot_cpu_has(int flag)
 {
-	u32 eax = (flag >> 5) ? 0x80000001 : 1;
-	u32 edx;
+	u32 eax, ebx, ecx, edx;
+	u32 reg;
+
+	switch (flag >> 5) {
+	case 1:
+		eax = 0x80000001;
+		break;
+	case 9:
+		eax = 7;
+		break;
+	default:
+		eax = 1;
+		break;
+	}
+	ecx = 0;
 
 	asm volatile("cpuid"
-		     : "+a" (eax), "=d" (edx)
-		     : : "ecx", "ebx");
+		     : "+a" (eax), "=b" (ebx), "+c" (ecx), "=d" (edx));
+
+	switch (flag >> 5) {
+	case 4:
+		reg = ecx;
+		break;
+	case 9:
+		reg = ebx;
+		break;
+	default:
+		reg = edx;
+		break;
+	}
 
-	return (edx >> (flag & 31)) & 1;
+	return (reg >> (flag & 31)) & 1;
+}
+
+static inline int raid6_have_ymm(void)
+{
+	return boot_cpu_has(X86_FEATURE_AVX);
 }
 
 #endif /* ndef __KERNEL__ */
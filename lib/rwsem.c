@@ -7,6 +7,7 @@
 #include <linux/sched.h>
 #include <linux/init.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 
 /*
  * Initialize an rwsem:
@@ -24,6 +25,9 @@ void __init_rwsem(struct rw_semaphore *sem, const char *name,
 	sem->count = RWSEM_UNLOCKED_VALUE;
 	raw_spin_lock_init(&sem->wait_lock);
 	INIT_LIST_HEAD(&sem->wait_list);
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+	sem->owner = NULL;
+#endif
 }
 
 EXPORT_SYMBOL(__init_rwsem);
@@ -201,7 +205,7 @@ rwsem_down_failed_common(struct rw_semaphore *sem,
 	if (count == RWSEM_WAITING_BIAS)
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_NO_ACTIVE);
 	else if (count > RWSEM_WAITING_BIAS &&
-		 adjustment == -RWSEM_ACTIVE_WRITE_BIAS)
+		 (flags & RWSEM_WAITING_FOR_WRITE))
 		sem = __rwsem_do_wake(sem, RWSEM_WAKE_READ_OWNED);
 
 	raw_spin_unlock_irq(&sem->wait_lock);
@@ -228,6 +232,115 @@ struct rw_semaphore __sched *rwsem_down_read_failed(struct rw_semaphore *sem)
 					-RWSEM_ACTIVE_READ_BIAS);
 }
 
+#ifdef CONFIG_RWSEM_SPIN_ON_OWNER
+/*
+ * Try to take the write lock without queueing: possible when there are no
+ * active lockers, whether or not others are waiting.  Taking the lock from
+ * under the waiters is what makes spinning pay off; the queue is woken as
+ * usual when we release it.
+ */
+static inline int rwsem_try_write_lock_unqueued(struct rw_semaphore *sem)
+{
+	long old, count = ACCESS_ONCE(sem->count);
+
+	while (count == 0 || count == RWSEM_WAITING_BIAS) {
+		old = cmpxchg(&sem->count, count,
+			      count + RWSEM_ACTIVE_WRITE_BIAS);
+		if (old == count)
+			return 1;
+		count = old;
+	}
+	return 0;
+}
+
+static inline int rwsem_owner_running(struct rw_semaphore *sem,
+				      struct task_struct *owner)
+{
+	if (sem->owner != owner)
+		return 0;
+
+	/*
+	 * Ensure we emit the owner->on_cpu dereference _after_ checking
+	 * sem->owner still matches owner; see owner_running() in sched.c.
+	 */
+	barrier();
+
+	return owner->on_cpu;
+}
+
+/*
+ * Spin while @owner holds the lock and is running.  Returns true when
+ * the lock was released, false on need_resched() or an owner change.
+ */
+static int rwsem_spin_on_owner(struct rw_semaphore *sem,
+			       struct task_struct *owner)
+{
+	rcu_read_lock();
+	while (rwsem_owner_running(sem, owner)) {
+		if (need_resched())
+			break;
+
+		arch_mutex_cpu_relax();
+	}
+	rcu_read_unlock();
+
+	return sem->owner == NULL;
+}
+
+/*
+ * Like __mutex_lock_common(), spin rather than sleep as long as the write
+ * owner is running: it is likely to release the lock soon, and a handoff
+ * through the wait queue costs a wakeup and two context switches.
+ */
+static int rwsem_optimistic_spin(struct rw_semaphore *sem)
+{
+	struct task_struct *owner;
+	int taken = 0;
+
+	preempt_disable();
+	for (;;) {
+		owner = ACCESS_ONCE(sem->owner);
+		if (owner && !rwsem_spin_on_owner(sem, owner))
+			break;
+
+		if (rwsem_try_write_lock_unqueued(sem)) {
+			taken = 1;
+			break;
+		}
+
+		/*
+		 * No owner: either readers hold the lock, which may take
+		 * arbitrarily long, or a writer is between acquiring it and
+		 * setting ->owner.  Only keep spinning for the latter, and
+		 * not at all if an RT task could live-lock that writer.
+		 */
+		if (!owner && (ACCESS_ONCE(sem->count) > 0 ||
+			       need_resched() || rt_task(current)))
+			break;
+
+		arch_mutex_cpu_relax();
+	}
+	preempt_enable();
+
+	return taken;
+}
+
+/*
+ * wait for the write lock to be granted
+ */
+struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
+{
+	/*
+	 * Drop the active bias our failed fast path added, so we don't
+	 * hold off the owner's release, then try spinning before queueing.
+	 */
+	rwsem_atomic_update(-RWSEM_ACTIVE_WRITE_BIAS, sem);
+	if (rwsem_optimistic_spin(sem))
+		return sem;
+
+	return rwsem_down_failed_common(sem, RWSEM_WAITING_FOR_WRITE, 0);
+}
+#else
 /*
  * wait for the write lock to be granted
  */
@@ -236,6 +349,7 @@ struct rw_semaphore __sched *rwsem_down_write_failed(struct rw_semaphore *sem)
 	return rwsem_down_failed_common(sem, RWSEM_WAITING_FOR_WRITE,
 					-RWSEM_ACTIVE_WRITE_BIAS);
 }
+#endif
 
 /*
  * handle waking up a waiter on the semaphore
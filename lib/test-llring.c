@@ -0,0 +1,205 @@
+/*
+ * Lock-less ring benchmark and stress test
+ *
+ * Runs producers and consumers against one ring for each of the
+ * single/multi producer and consumer combinations, checks that every
+ * consumer sees the objects of every producer in order, and reports
+ * the throughput.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License version
+ * 2 as published by the Free Software Foundation.
+ */
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/kthread.h>
+#include <linux/delay.h>
+#include <linux/sched.h>
+#include <linux/llring.h>
+
+#define LLRING_TEST_MAX_THREADS	64
+#define LLRING_TEST_MAX_BATCH	256
+
+static unsigned int ring_size = 1024;
+module_param(ring_size, uint, 0444);
+MODULE_PARM_DESC(ring_size, "number of ring slots");
+
+static unsigned int batch = 16;
+module_param(batch, uint, 0444);
+MODULE_PARM_DESC(batch, "objects moved per call");
+
+static unsigned int run_secs = 5;
+module_param(run_secs, uint, 0444);
+MODULE_PARM_DESC(run_secs, "seconds to run each variant");
+
+static unsigned int nr_workers;
+module_param(nr_workers, uint, 0444);
+MODULE_PARM_DESC(nr_workers, "producers and consumers of the multi variants (default: online cpus / 2)");
+
+struct llring_test_thread {
+	struct llring		*ring;
+	struct task_struct	*task;
+	unsigned int		id;
+	unsigned int		nr_producers;
+	unsigned long		count;
+	unsigned long		errors;
+	unsigned long		*last;	/* consumer: last seq per producer */
+};
+
+/*
+ * Objects are (seq << 8 | producer id), seq starting at 1 and wrapping
+ * at ULONG_MAX >> 8.
+ */
+#define LLRING_TEST_SEQ_MASK	(ULONG_MAX >> 8)
+
+static int llring_test_producer(void *data)
+{
+	struct llring_test_thread *t = data;
+	void *objs[LLRING_TEST_MAX_BATCH];
+	unsigned long seq = 1;
+	unsigned int i, n;
+
+	while (!kthread_should_stop()) {
+		for (i = 0; i < batch; i++)
+			objs[i] = (void *)((seq + i) << 8 | t->id);
+		n = llring_enqueue_burst(t->ring, objs, batch);
+		seq += n;
+		t->count += n;
+		if (!n)
+			cond_resched();
+	}
+	return 0;
+}
+
+static int llring_test_consumer(void *data)
+{
+	struct llring_test_thread *t = data;
+	void *objs[LLRING_TEST_MAX_BATCH];
+	unsigned long v, seq, diff;
+	unsigned int i, n;
+
+	while (!kthread_should_stop()) {
+		n = llring_dequeue_burst(t->ring, objs, batch);
+		for (i = 0; i < n; i++) {
+			v = (unsigned long)objs[i];
+			seq = v >> 8;
+			v &= 0xff;
+			if (v >= t->nr_producers) {
+				t->errors++;
+				continue;
+			}
+			diff = (seq - t->last[v]) & LLRING_TEST_SEQ_MASK;
+			if (!diff || diff > LLRING_TEST_SEQ_MASK / 2)
+				t->errors++;
+			else
+				t->last[v] = seq;
+		}
+		t->count += n;
+		if (!n)
+			cond_resched();
+	}
+	return 0;
+}
+
+static int __init llring_test_run(const char *name, unsigned int flags,
+				  unsigned int nr_prod, unsigned int nr_cons)
+{
+	struct llring_test_thread *threads;
+	struct llring *ring;
+	unsigned long produced = 0, consumed = 0, errors = 0;
+	unsigned int i, nr = nr_prod + nr_cons;
+	int ret = 0;
+
+	ring = llring_alloc(ring_size, flags, GFP_KERNEL);
+	threads = kcalloc(nr, sizeof(*threads), GFP_KERNEL);
+	if (!ring || !threads) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < nr; i++) {
+		struct llring_test_thread *t = &threads[i];
+
+		t->ring = ring;
+		t->nr_producers = nr_prod;
+		if (i < nr_prod) {
+			t->id = i;
+			t->task = kthread_run(llring_test_producer, t,
+					      "llring_prod/%u", i);
+		} else {
+			t->last = kcalloc(nr_prod, sizeof(*t->last),
+					  GFP_KERNEL);
+			if (!t->last) {
+				ret = -ENOMEM;
+				break;
+			}
+			t->task = kthread_run(llring_test_consumer, t,
+					      "llring_cons/%u", i - nr_prod);
+		}
+		if (IS_ERR(t->task)) {
+			ret = PTR_ERR(t->task);
+			t->task = NULL;
+			break;
+		}
+	}
+
+	if (!ret)
+		msleep(run_secs * 1000);
+
+	/* producers stop first, what they leave in the ring is counted below */
+	for (i = 0; i < nr; i++)
+		if (threads[i].task)
+			kthread_stop(threads[i].task);
+
+	for (i = 0; i < nr; i++) {
+		if (i < nr_prod)
+			produced += threads[i].count;
+		else
+			consumed += threads[i].count;
+		errors += threads[i].errors;
+		kfree(threads[i].last);
+	}
+	if (ret)
+		goto out;
+
+	consumed += llring_count(ring);
+	if (errors || produced != consumed) {
+		pr_err("llring test %s: %lu produced, %lu consumed, %lu out of order\n",
+		       name, produced, consumed, errors);
+		ret = -EINVAL;
+	} else
+		pr_info("llring test %s (%u/%u threads): %lu objects/sec\n",
+			name, nr_prod, nr_cons, produced / max(run_secs, 1U));
+out:
+	kfree(threads);
+	llring_free(ring);
+	return ret;
+}
+
+static int __init llring_test_init(void)
+{
+	unsigned int nr = nr_workers;
+	int ret;
+
+	if (!nr)
+		nr = max(num_online_cpus() / 2, 1U);
+	nr = min_t(unsigned int, nr, LLRING_TEST_MAX_THREADS);
+	batch = clamp_t(unsigned int, batch, 1, LLRING_TEST_MAX_BATCH);
+
+	ret = llring_test_run("spsc", LLRING_F_SP_ENQ | LLRING_F_SC_DEQ, 1, 1);
+	if (!ret)
+		ret = llring_test_run("mpsc", LLRING_F_SC_DEQ, nr, 1);
+	if (!ret)
+		ret = llring_test_run("mpmc", 0, nr, nr);
+	return ret;
+}
+
+static void __exit llring_test_exit(void)
+{
+}
+
+module_init(llring_test_init);
+module_exit(llring_test_exit);
+MODULE_LICENSE("GPL");
@@ -100,6 +100,12 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "BdiDirtied:         %10lu kB\n"
 		   "BdiWritten:         %10lu kB\n"
 		   "BdiWriteBandwidth:  %10lu kBps\n"
+		   "BdiReadaheadHit:    %10lu\n"
+		   "BdiReadaheadMiss:   %10lu\n"
+		   "BdiReadahead:       %10lu kB\n"
+		   "BdiReadLatency:     %10lu us\n"
+		   "BdiReadBandwidth:   %10lu kBps\n"
+		   "BdiReadaheadAuto:   %10lu kB\n"
 		   "b_dirty:            %10lu\n"
 		   "b_io:               %10lu\n"
 		   "b_more_io:          %10lu\n"
@@ -113,6 +119,12 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   (unsigned long) K(bdi_stat(bdi, BDI_DIRTIED)),
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITTEN)),
 		   (unsigned long) K(bdi->write_bandwidth),
+		   (unsigned long) bdi_stat(bdi, BDI_RA_HIT),
+		   (unsigned long) bdi_stat(bdi, BDI_RA_MISS),
+		   (unsigned long) K(bdi_stat(bdi, BDI_RA_PAGES)),
+		   bdi->ra_latency,
+		   K(bdi->ra_bandwidth),
+		   K(bdi->ra_auto_pages),
 		   nr_dirty,
 		   nr_io,
 		   nr_more_io,
@@ -188,6 +200,7 @@ static ssize_t name##_show(struct device *dev,				\
 }
 
 BDI_SHOW(read_ahead_kb, K(bdi->ra_pages))
+BDI_SHOW(read_ahead_auto_kb, K(bdi->ra_auto_pages))
 
 static ssize_t min_ratio_store(struct device *dev,
 		struct device_attribute *attr, const char *buf, size_t count)
@@ -229,6 +242,7 @@ BDI_SHOW(max_ratio, bdi->max_ratio)
 
 static struct device_attribute bdi_dev_attrs[] = {
 	__ATTR_RW(read_ahead_kb),
+	__ATTR(read_ahead_auto_kb, 0444, read_ahead_auto_kb_show, NULL),
 	__ATTR_RW(min_ratio),
 	__ATTR_RW(max_ratio),
 	__ATTR_NULL,
@@ -34,6 +34,7 @@
 #include <linux/hardirq.h> /* for BUG_ON(!in_atomic()) only */
 #include <linux/memcontrol.h>
 #include <linux/cleancache.h>
+#include <linux/delayacct.h>
 #include "internal.h"
 
 /*
@@ -814,20 +815,19 @@ EXPORT_SYMBOL(find_or_create_page);
 unsigned find_get_pages(struct address_space *mapping, pgoff_t start,
 			    unsigned int nr_pages, struct page **pages)
 {
-	unsigned int i;
-	unsigned int ret;
-	unsigned int nr_found, nr_skip;
+	struct radix_tree_iter iter;
+	void **slot;
+	unsigned ret = 0;
+
+	if (unlikely(!nr_pages))
+		return 0;
 
 	rcu_read_lock();
 restart:
-	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, NULL, start, nr_pages);
-	ret = 0;
-	nr_skip = 0;
-	for (i = 0; i < nr_found; i++) {
+	radix_tree_for_each_slot(slot, &mapping->page_tree, &iter, start) {
 		struct page *page;
 repeat:
-		page = radix_tree_deref_slot((void **)pages[i]);
+		page = radix_tree_deref_slot(slot);
 		if (unlikely(!page))
 			continue;
 
@@ -838,7 +838,7 @@ repeat:
 				 * when entry at index 0 moves out of or back
 				 * to root: none yet gotten, safe to restart.
 				 */
-				WARN_ON(start | i);
+				WARN_ON(iter.index);
 				goto restart;
 			}
 			/*
@@ -846,7 +846,6 @@ repeat:
 			 * here as an exceptional entry: so skip over it -
 			 * we only reach this from invalidate_mapping_pages().
 			 */
-			nr_skip++;
 			continue;
 		}
 
@@ -854,21 +853,16 @@ repeat:
 			goto repeat;
 
 		/* Has the page moved? */
-		if (unlikely(page != *((void **)pages[i]))) {
+		if (unlikely(page != *slot)) {
 			page_cache_release(page);
 			goto repeat;
 		}
 
 		pages[ret] = page;
-		ret++;
+		if (++ret == nr_pages)
+			break;
 	}
 
-	/*
-	 * If all entries were removed before we could secure them,
-	 * try again, because callers stop trying once 0 is returned.
-	 */
-	if (unlikely(!ret && nr_found > nr_skip))
-		goto restart;
 	rcu_read_unlock();
 	return ret;
 }
@@ -888,21 +882,22 @@ repeat:
 unsigned find_get_pages_contig(struct address_space *mapping, pgoff_t index,
 			       unsigned int nr_pages, struct page **pages)
 {
-	unsigned int i;
-	unsigned int ret;
-	unsigned int nr_found;
+	struct radix_tree_iter iter;
+	void **slot;
+	unsigned int ret = 0;
+
+	if (unlikely(!nr_pages))
+		return 0;
 
 	rcu_read_lock();
 restart:
-	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, NULL, index, nr_pages);
-	ret = 0;
-	for (i = 0; i < nr_found; i++) {
+	radix_tree_for_each_contig(slot, &mapping->page_tree, &iter, index) {
 		struct page *page;
 repeat:
-		page = radix_tree_deref_slot((void **)pages[i]);
+		page = radix_tree_deref_slot(slot);
+		/* The hole, there no reason to continue */
 		if (unlikely(!page))
-			continue;
+			break;
 
 		if (radix_tree_exception(page)) {
 			if (radix_tree_deref_retry(page)) {
@@ -925,7 +920,7 @@ repeat:
 			goto repeat;
 
 		/* Has the page moved? */
-		if (unlikely(page != *((void **)pages[i]))) {
+		if (unlikely(page != *slot)) {
 			page_cache_release(page);
 			goto repeat;
 		}
@@ -935,14 +930,14 @@ repeat:
 		 * otherwise we can get both false positives and false
 		 * negatives, which is just confusing to the caller.
 		 */
-		if (page->mapping == NULL || page->index != index) {
+		if (page->mapping == NULL || page->index != iter.index) {
 			page_cache_release(page);
 			break;
 		}
 
 		pages[ret] = page;
-		ret++;
-		index++;
+		if (++ret == nr_pages)
+			break;
 	}
 	rcu_read_unlock();
 	return ret;
@@ -963,19 +958,20 @@ EXPORT_SYMBOL(find_get_pages_contig);
 unsigned find_get_pages_tag(struct address_space *mapping, pgoff_t *index,
 			int tag, unsigned int nr_pages, struct page **pages)
 {
-	unsigned int i;
-	unsigned int ret;
-	unsigned int nr_found;
+	struct radix_tree_iter iter;
+	void **slot;
+	unsigned ret = 0;
+
+	if (unlikely(!nr_pages))
+		return 0;
 
 	rcu_read_lock();
 restart:
-	nr_found = radix_tree_gang_lookup_tag_slot(&mapping->page_tree,
-				(void ***)pages, *index, nr_pages, tag);
-	ret = 0;
-	for (i = 0; i < nr_found; i++) {
+	radix_tree_for_each_tagged(slot, &mapping->page_tree,
+				   &iter, *index, tag) {
 		struct page *page;
 repeat:
-		page = radix_tree_deref_slot((void **)pages[i]);
+		page = radix_tree_deref_slot(slot);
 		if (unlikely(!page))
 			continue;
 
@@ -999,21 +995,16 @@ repeat:
 			goto repeat;
 
 		/* Has the page moved? */
-		if (unlikely(page != *((void **)pages[i]))) {
+		if (unlikely(page != *slot)) {
 			page_cache_release(page);
 			goto repeat;
 		}
 
 		pages[ret] = page;
-		ret++;
+		if (++ret == nr_pages)
+			break;
 	}
 
-	/*
-	 * If all entries were removed before we could secure them,
-	 * try again, because callers stop trying once 0 is returned.
-	 */
-	if (unlikely(!ret && nr_found))
-		goto restart;
 	rcu_read_unlock();
 
 	if (ret)
@@ -1101,6 +1092,8 @@ static void do_generic_file_read(struct file *filp, loff_t *ppos,
 	pgoff_t prev_index;
 	unsigned long offset;      /* offset into pagecache page */
 	unsigned int prev_offset;
+	unsigned long ra_nr = 0;	/* pages of a pending sync readahead */
+	ktime_t ra_start = ktime_set(0, 0);
 	int error;
 
 	index = *ppos >> PAGE_CACHE_SHIFT;
@@ -1109,6 +1102,7 @@ static void do_generic_file_read(struct file *filp, loff_t *ppos,
 	last_index = (*ppos + desc->count + PAGE_CACHE_SIZE-1) >> PAGE_CACHE_SHIFT;
 	offset = *ppos & ~PAGE_CACHE_MASK;
 
+	delayacct_read_start();
 	for (;;) {
 		struct page *page;
 		pgoff_t end_index;
@@ -1119,7 +1113,8 @@ static void do_generic_file_read(struct file *filp, loff_t *ppos,
 find_page:
 		page = find_get_page(mapping, index);
 		if (!page) {
-			page_cache_sync_readahead(mapping,
+			ra_start = ktime_get();
+			ra_nr = page_cache_sync_readahead(mapping,
 					ra, filp,
 					index, last_index - index);
 			page = find_get_page(mapping, index);
@@ -1146,6 +1141,8 @@ find_page:
 			unlock_page(page);
 		}
 page_ok:
+		ra_nr = 0;
+
 		/*
 		 * i_size must be checked after we know the page is Uptodate.
 		 *
@@ -1215,6 +1212,12 @@ page_not_up_to_date:
 		if (unlikely(error))
 			goto readpage_error;
 
+		/* Time spent waiting on our readahead, see readahead.c */
+		if (ra_nr && PageUptodate(page))
+			bdi_update_read_bandwidth(mapping->backing_dev_info,
+				ra_nr, ktime_us_delta(ktime_get(), ra_start));
+		ra_nr = 0;
+
 page_not_up_to_date_locked:
 		/* Did it get truncated before we got the lock? */
 		if (!page->mapping) {
@@ -1299,6 +1302,7 @@ no_cached_page:
 	}
 
 out:
+	delayacct_read_end();
 	ra->prev_pos = prev_index;
 	ra->prev_pos <<= PAGE_CACHE_SHIFT;
 	ra->prev_pos |= prev_offset;
@@ -1632,19 +1636,12 @@ static void do_async_mmap_readahead(struct vm_area_struct *vma,
 					   page, offset, ra->ra_pages);
 }
 
-/**
- * filemap_fault - read in file data for page fault handling
- * @vma:	vma in which the fault was taken
- * @vmf:	struct vm_fault containing details of the fault
- *
- * filemap_fault() is invoked via the vma operations vector for a
- * mapped memory region to read in file data during a page fault.
- *
+/*
  * The goto's are kind of ugly, but this streamlines the normal case of having
  * it in the page cache, and handles the special cases reasonably without
  * having a lot of duplicated code.
  */
-int filemap_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+static int __filemap_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 {
 	int error;
 	struct file *file = vma->vm_file;
@@ -1763,10 +1760,103 @@ page_not_uptodate:
 	shrink_readahead_size_eio(file, ra);
 	return VM_FAULT_SIGBUS;
 }
+
+/**
+ * filemap_fault - read in file data for page fault handling
+ * @vma:	vma in which the fault was taken
+ * @vmf:	struct vm_fault containing details of the fault
+ *
+ * filemap_fault() is invoked via the vma operations vector for a
+ * mapped memory region to read in file data during a page fault.
+ */
+int filemap_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	int ret;
+
+	delayacct_read_start();
+	ret = __filemap_fault(vma, vmf);
+	delayacct_read_end();
+
+	return ret;
+}
 EXPORT_SYMBOL(filemap_fault);
 
+/**
+ * filemap_map_pages - map the cached neighbours of a faulting page
+ * @vma:	vma in which the fault was taken
+ * @vmf:	pgoff to max_pgoff range, and the pte of pgoff
+ *
+ * Maps every page between vmf->pgoff and vmf->max_pgoff that is uptodate
+ * in the page cache and whose pte is still empty.  Called with the pte
+ * lock held, so nothing here may sleep: pages that are missing, locked,
+ * under readahead or beyond i_size are simply left for ->fault.
+ */
+void filemap_map_pages(struct vm_area_struct *vma, struct vm_fault *vmf)
+{
+	struct file *file = vma->vm_file;
+	struct address_space *mapping = file->f_mapping;
+	struct file_ra_state *ra = &file->f_ra;
+	struct inode *inode = mapping->host;
+	struct page *pages[PAGEVEC_SIZE];
+	pgoff_t index = vmf->pgoff;
+	pgoff_t size;
+	unsigned long address;
+	unsigned int nr, i;
+	pte_t *pte;
+
+	while (index <= vmf->max_pgoff) {
+		nr = min_t(unsigned long, PAGEVEC_SIZE,
+			   vmf->max_pgoff - index + 1);
+		nr = find_get_pages(mapping, index, nr, pages);
+		if (!nr)
+			break;
+
+		for (i = 0; i < nr; i++) {
+			struct page *page = pages[i];
+
+			index = page->index;
+			if (index > vmf->max_pgoff)
+				goto skip;
+			pte = vmf->pte + index - vmf->pgoff;
+			if (!pte_none(*pte))
+				goto skip;
+			if (PageLocked(page) || !PageUptodate(page) ||
+			    PageReadahead(page) || PageHWPoison(page))
+				goto skip;
+			if (!trylock_page(page))
+				goto skip;
+			if (page->mapping != mapping || !PageUptodate(page))
+				goto unlock;
+			size = (i_size_read(inode) + PAGE_CACHE_SIZE - 1) >>
+				PAGE_CACHE_SHIFT;
+			if (index >= size)
+				goto unlock;
+
+			if (ra->mmap_miss > 0)
+				ra->mmap_miss--;
+			if (PageReadaheadUnused(page))
+				ClearPageReadaheadUnused(page);
+			address = (unsigned long)vmf->virtual_address +
+				((index - vmf->pgoff) << PAGE_SHIFT);
+			/* the pte takes over our reference */
+			do_set_pte(vma, address, page, pte);
+			unlock_page(page);
+			continue;
+unlock:
+			unlock_page(page);
+skip:
+			page_cache_release(page);
+		}
+		if (index >= vmf->max_pgoff)
+			break;
+		index++;
+	}
+}
+EXPORT_SYMBOL(filemap_map_pages);
+
 const struct vm_operations_struct generic_file_vm_ops = {
 	.fault		= filemap_fault,
+	.map_pages	= filemap_map_pages,
 };
 
 /* This is used for a general mmap of a disk file */
@@ -210,6 +210,10 @@ SYSCALL_DEFINE5(remap_file_pages, unsigned long, start, unsigned long, size,
 			}
 			goto out;
 		}
+		/* huge pmds can only map the file linearly */
+		if (vma->vm_ops->pmd_fault)
+			zap_page_range(vma, vma->vm_start,
+				       vma->vm_end - vma->vm_start, NULL);
 		mutex_lock(&mapping->i_mmap_mutex);
 		flush_dcache_mmap_lock(mapping);
 		vma->vm_flags |= VM_NONLINEAR;
@@ -17,6 +17,8 @@
 #include <linux/khugepaged.h>
 #include <linux/freezer.h>
 #include <linux/mman.h>
+#include <linux/shmem_fs.h>
+#include <linux/file.h>
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
 #include "internal.h"
@@ -36,7 +38,8 @@ unsigned long transparent_hugepage_flags __read_mostly =
 	(1<<TRANSPARENT_HUGEPAGE_REQ_MADV_FLAG)|
 #endif
 	(1<<TRANSPARENT_HUGEPAGE_DEFRAG_FLAG)|
-	(1<<TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG);
+	(1<<TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG)|
+	(1<<TRANSPARENT_HUGEPAGE_USE_ZERO_PAGE_FLAG);
 
 /* default scan 8*512 pte (or vmas) every 30 second */
 static unsigned int khugepaged_pages_to_scan __read_mostly = HPAGE_PMD_NR*8;
@@ -56,6 +59,15 @@ static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
  */
 static unsigned int khugepaged_max_ptes_none __read_mostly = HPAGE_PMD_NR-1;
 
+/*
+ * The huge zero page is allocated on the first read fault that wants it,
+ * and each huge pmd mapping it holds a reference on huge_zero_refcount.
+ * One more reference is held until the shrinker finds nobody else using
+ * it, and frees it.
+ */
+unsigned long huge_zero_pfn __read_mostly;
+static atomic_t huge_zero_refcount;
+
 static int khugepaged(void *none);
 static int mm_slots_hash_init(void);
 static int khugepaged_slab_init(void);
@@ -294,6 +306,22 @@ static ssize_t defrag_store(struct kobject *kobj,
 static struct kobj_attribute defrag_attr =
 	__ATTR(defrag, 0644, defrag_show, defrag_store);
 
+static ssize_t use_zero_page_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return single_flag_show(kobj, attr, buf,
+				TRANSPARENT_HUGEPAGE_USE_ZERO_PAGE_FLAG);
+}
+static ssize_t use_zero_page_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	return single_flag_store(kobj, attr, buf, count,
+				 TRANSPARENT_HUGEPAGE_USE_ZERO_PAGE_FLAG);
+}
+static struct kobj_attribute use_zero_page_attr =
+	__ATTR(use_zero_page, 0644, use_zero_page_show, use_zero_page_store);
+
 #ifdef CONFIG_DEBUG_VM
 static ssize_t debug_cow_show(struct kobject *kobj,
 				struct kobj_attribute *attr, char *buf)
@@ -315,8 +343,12 @@ static struct kobj_attribute debug_cow_attr =
 static struct attribute *hugepage_attr[] = {
 	&enabled_attr.attr,
 	&defrag_attr.attr,
+	&use_zero_page_attr.attr,
 #ifdef CONFIG_DEBUG_VM
 	&debug_cow_attr.attr,
+#endif
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+	&shmem_enabled_attr.attr,
 #endif
 	NULL,
 };
@@ -489,6 +521,62 @@ static struct attribute_group khugepaged_attr_group = {
 };
 #endif /* CONFIG_SYSFS */
 
+static unsigned long get_huge_zero_page(void)
+{
+	struct page *zero_page;
+retry:
+	if (likely(atomic_inc_not_zero(&huge_zero_refcount)))
+		return ACCESS_ONCE(huge_zero_pfn);
+
+	zero_page = alloc_pages((GFP_TRANSHUGE | __GFP_ZERO) & ~__GFP_MOVABLE,
+				HPAGE_PMD_ORDER);
+	if (!zero_page) {
+		count_vm_event(THP_ZERO_PAGE_ALLOC_FAILED);
+		return 0;
+	}
+	count_vm_event(THP_ZERO_PAGE_ALLOC);
+	preempt_disable();
+	if (cmpxchg(&huge_zero_pfn, 0, page_to_pfn(zero_page))) {
+		/* somebody else installed one first */
+		preempt_enable();
+		__free_pages(zero_page, HPAGE_PMD_ORDER);
+		goto retry;
+	}
+
+	/* one reference for the caller, one for the shrinker to put */
+	atomic_set(&huge_zero_refcount, 2);
+	preempt_enable();
+	return ACCESS_ONCE(huge_zero_pfn);
+}
+
+static void put_huge_zero_page(void)
+{
+	/* only the shrinker may drop the last reference */
+	BUG_ON(atomic_dec_and_test(&huge_zero_refcount));
+}
+
+static int shrink_huge_zero_page(struct shrinker *shrink,
+				 struct shrink_control *sc)
+{
+	if (!sc->nr_to_scan)
+		/* the page can go only when nothing maps it any more */
+		return atomic_read(&huge_zero_refcount) == 1 ? HPAGE_PMD_NR : 0;
+
+	if (atomic_cmpxchg(&huge_zero_refcount, 1, 0) == 1) {
+		unsigned long zero_pfn = xchg(&huge_zero_pfn, 0);
+
+		BUG_ON(zero_pfn == 0);
+		__free_pages(pfn_to_page(zero_pfn), HPAGE_PMD_ORDER);
+	}
+
+	return 0;
+}
+
+static struct shrinker huge_zero_page_shrinker = {
+	.shrink = shrink_huge_zero_page,
+	.seeks = DEFAULT_SEEKS,
+};
+
 static int __init hugepage_init(void)
 {
 	int err;
@@ -533,6 +621,8 @@ static int __init hugepage_init(void)
 		goto out;
 	}
 
+	register_shrinker(&huge_zero_page_shrinker);
+
 	/*
 	 * By default disable transparent hugepages on smaller systems,
 	 * where the extra memory used could hurt more than TLB overhead
@@ -602,6 +692,25 @@ static inline pmd_t maybe_pmd_mkwrite(pmd_t pmd, struct vm_area_struct *vma)
 	return pmd;
 }
 
+static bool set_huge_zero_page(pgtable_t pgtable, struct mm_struct *mm,
+			       struct vm_area_struct *vma, unsigned long haddr,
+			       pmd_t *pmd, unsigned long zero_pfn)
+{
+	pmd_t entry;
+
+	assert_spin_locked(&mm->page_table_lock);
+
+	if (!pmd_none(*pmd))
+		return false;
+	entry = pfn_pmd(zero_pfn, vma->vm_page_prot);
+	entry = pmd_wrprotect(entry);
+	entry = pmd_mkhuge(entry);
+	set_pmd_at(mm, haddr, pmd, entry);
+	prepare_pmd_huge_pte(pgtable, mm);
+	mm->nr_ptes++;
+	return true;
+}
+
 static int __do_huge_pmd_anonymous_page(struct mm_struct *mm,
 					struct vm_area_struct *vma,
 					unsigned long haddr, pmd_t *pmd,
@@ -684,6 +793,32 @@ int do_huge_pmd_anonymous_page(struct mm_struct *mm, struct vm_area_struct *vma,
 			return VM_FAULT_OOM;
 		if (unlikely(khugepaged_enter(vma, vma->vm_flags)))
 			return VM_FAULT_OOM;
+		if (!(flags & FAULT_FLAG_WRITE) &&
+		    transparent_hugepage_use_zero_page()) {
+			/* map the huge zero page until the first write */
+			pgtable_t pgtable;
+			unsigned long zero_pfn;
+			bool set;
+
+			pgtable = pte_alloc_one(mm, haddr);
+			if (unlikely(!pgtable))
+				return VM_FAULT_OOM;
+			zero_pfn = get_huge_zero_page();
+			if (unlikely(!zero_pfn)) {
+				pte_free(mm, pgtable);
+				count_vm_event(THP_FAULT_FALLBACK);
+				goto out;
+			}
+			spin_lock(&mm->page_table_lock);
+			set = set_huge_zero_page(pgtable, mm, vma, haddr, pmd,
+						 zero_pfn);
+			spin_unlock(&mm->page_table_lock);
+			if (!set) {
+				pte_free(mm, pgtable);
+				put_huge_zero_page();
+			}
+			return 0;
+		}
 		page = alloc_hugepage_vma(transparent_hugepage_defrag(vma),
 					  vma, haddr, numa_node_id(), 0);
 		if (unlikely(!page)) {
@@ -719,6 +854,76 @@ out:
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+/*
+ * Map the HPAGE_PMD_NR page cache pages starting at @page, which are
+ * physically contiguous and naturally aligned, with a single huge pmd.
+ * They stay small pages as far as the page cache, the LRU and reclaim
+ * are concerned: each of them keeps its own reference and mapcount for
+ * the mapping, exactly as if it was mapped by a pte.  The caller holds
+ * the pages locked, and its references on them are taken over on success.
+ */
+int do_huge_pmd_file_map(struct vm_area_struct *vma, unsigned long haddr,
+			 pmd_t *pmd, struct page *page)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	pgtable_t pgtable;
+	pmd_t entry;
+	int i;
+
+	VM_BUG_ON(PageCompound(page) || PageAnon(page));
+	VM_BUG_ON(page_to_pfn(page) & (HPAGE_PMD_NR - 1));
+
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable))
+		return -ENOMEM;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, pgtable);
+		return -EBUSY;
+	}
+	entry = mk_pmd(page, vma->vm_page_prot);
+	entry = maybe_pmd_mkwrite(pmd_mkdirty(entry), vma);
+	entry = pmd_mkhuge(entry);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		page_add_file_rmap(page + i);
+	set_pmd_at(mm, haddr, pmd, entry);
+	prepare_pmd_huge_pte(pgtable, mm);
+	add_mm_counter(mm, MM_FILEPAGES, HPAGE_PMD_NR);
+	mm->nr_ptes++;
+	spin_unlock(&mm->page_table_lock);
+
+	count_vm_event(THP_FILE_MAPPED);
+	return 0;
+}
+
+/*
+ * Drop what a page cache pmd held on each of its pages, transferring the
+ * dirty and young bits like zap_pte_range() does.  The references go to
+ * @tlb to be freed after the TLB flush, or are dropped right away when
+ * the caller has flushed the TLB already.
+ */
+static void release_file_pmd(struct mmu_gather *tlb, struct mm_struct *mm,
+			     pmd_t pmd)
+{
+	struct page *page = pmd_page(pmd);
+	int i;
+
+	for (i = 0; i < HPAGE_PMD_NR; i++, page++) {
+		if (pmd_dirty(pmd))
+			set_page_dirty(page);
+		if (pmd_young(pmd))
+			mark_page_accessed(page);
+		page_remove_rmap(page);
+		if (tlb)
+			tlb_remove_page(tlb, page);
+		else
+			put_page(page);
+	}
+	add_mm_counter(mm, MM_FILEPAGES, -HPAGE_PMD_NR);
+}
+
 int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
 		  struct vm_area_struct *vma)
@@ -751,7 +956,25 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		wait_split_huge_page(vma->anon_vma, src_pmd); /* src_vma */
 		goto out;
 	}
+	if (is_huge_zero_pmd(pmd)) {
+		unsigned long zero_pfn;
+		bool set;
+
+		/* the reference held by the parent's pmd keeps it around */
+		zero_pfn = get_huge_zero_page();
+		set = set_huge_zero_page(pgtable, dst_mm, vma, addr, dst_pmd,
+					 zero_pfn);
+		BUG_ON(!set); /* unexpected !pmd_none(dst_pmd) */
+		ret = 0;
+		goto out_unlock;
+	}
 	src_page = pmd_page(pmd);
+	if (!PageAnon(src_page)) {
+		/* page cache pmd: the child will fault it in as it needs */
+		pte_free(dst_mm, pgtable);
+		ret = 0;
+		goto out_unlock;
+	}
 	VM_BUG_ON(!PageHead(src_page));
 	get_page(src_page);
 	page_dup_rmap(src_page);
@@ -883,21 +1106,89 @@ out_free_pages:
 	goto out;
 }
 
+/*
+ * No huge page to break the huge zero page's COW with: give the faulting
+ * address a page of its own, and leave the rest of the range unmapped, to
+ * be faulted in again as small zero pages or real ones.
+ */
+static int do_huge_pmd_wp_zero_page_fallback(struct mm_struct *mm,
+					     struct vm_area_struct *vma,
+					     unsigned long address,
+					     pmd_t *pmd, pmd_t orig_pmd,
+					     unsigned long haddr)
+{
+	pgtable_t pgtable;
+	pmd_t _pmd;
+	struct page *page;
+	pte_t *pte, entry;
+	int ret = 0;
+
+	page = alloc_page_vma(GFP_HIGHUSER_MOVABLE, vma, address);
+	if (unlikely(!page)) {
+		ret |= VM_FAULT_OOM;
+		goto out;
+	}
+	if (unlikely(mem_cgroup_newpage_charge(page, mm, GFP_KERNEL))) {
+		put_page(page);
+		ret |= VM_FAULT_OOM;
+		goto out;
+	}
+	clear_user_highpage(page, address);
+	__SetPageUptodate(page);
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_same(*pmd, orig_pmd)))
+		goto out_free_page;
+
+	pmdp_clear_flush_notify(vma, haddr, pmd);
+	/* leave pmd empty until pte is filled */
+
+	pgtable = get_pmd_huge_pte(mm);
+	pmd_populate(mm, &_pmd, pgtable);
+
+	address &= PAGE_MASK;
+	entry = mk_pte(page, vma->vm_page_prot);
+	entry = maybe_mkwrite(pte_mkdirty(entry), vma);
+	page_add_new_anon_rmap(page, vma, address);
+	pte = pte_offset_map(&_pmd, address);
+	VM_BUG_ON(!pte_none(*pte));
+	set_pte_at(mm, address, pte, entry);
+	pte_unmap(pte);
+	inc_mm_counter(mm, MM_ANONPAGES);
+
+	smp_wmb(); /* make pte visible before pmd */
+	pmd_populate(mm, pmd, pgtable);
+	spin_unlock(&mm->page_table_lock);
+	put_huge_zero_page();
+
+	ret |= VM_FAULT_WRITE;
+out:
+	return ret;
+
+out_free_page:
+	spin_unlock(&mm->page_table_lock);
+	mem_cgroup_uncharge_page(page);
+	put_page(page);
+	goto out;
+}
+
 int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 			unsigned long address, pmd_t *pmd, pmd_t orig_pmd)
 {
 	int ret = 0;
-	struct page *page, *new_page;
+	struct page *page = NULL, *new_page;
 	unsigned long haddr;
 
 	VM_BUG_ON(!vma->anon_vma);
+	haddr = address & HPAGE_PMD_MASK;
+	if (is_huge_zero_pmd(orig_pmd))
+		goto alloc;
 	spin_lock(&mm->page_table_lock);
 	if (unlikely(!pmd_same(*pmd, orig_pmd)))
 		goto out_unlock;
 
 	page = pmd_page(orig_pmd);
 	VM_BUG_ON(!PageCompound(page) || !PageHead(page));
-	haddr = address & HPAGE_PMD_MASK;
 	if (page_mapcount(page) == 1) {
 		pmd_t entry;
 		entry = pmd_mkyoung(orig_pmd);
@@ -909,7 +1200,7 @@ int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 	}
 	get_page(page);
 	spin_unlock(&mm->page_table_lock);
-
+alloc:
 	if (transparent_hugepage_enabled(vma) &&
 	    !transparent_hugepage_debug_cow())
 		new_page = alloc_hugepage_vma(transparent_hugepage_defrag(vma),
@@ -919,6 +1210,9 @@ int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	if (unlikely(!new_page)) {
 		count_vm_event(THP_FAULT_FALLBACK);
+		if (!page)
+			return do_huge_pmd_wp_zero_page_fallback(mm, vma,
+						address, pmd, orig_pmd, haddr);
 		ret = do_huge_pmd_wp_page_fallback(mm, vma, address,
 						   pmd, orig_pmd, page, haddr);
 		if (ret & VM_FAULT_OOM)
@@ -930,23 +1224,29 @@ int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 
 	if (unlikely(mem_cgroup_newpage_charge(new_page, mm, GFP_KERNEL))) {
 		put_page(new_page);
-		split_huge_page(page);
-		put_page(page);
+		if (page) {
+			split_huge_page(page);
+			put_page(page);
+		} else
+			split_huge_page_pmd(mm, pmd);
 		ret |= VM_FAULT_OOM;
 		goto out;
 	}
 
-	copy_user_huge_page(new_page, page, haddr, vma, HPAGE_PMD_NR);
+	if (!page)
+		clear_huge_page(new_page, haddr, HPAGE_PMD_NR);
+	else
+		copy_user_huge_page(new_page, page, haddr, vma, HPAGE_PMD_NR);
 	__SetPageUptodate(new_page);
 
 	spin_lock(&mm->page_table_lock);
-	put_page(page);
+	if (page)
+		put_page(page);
 	if (unlikely(!pmd_same(*pmd, orig_pmd))) {
 		mem_cgroup_uncharge_page(new_page);
 		put_page(new_page);
 	} else {
 		pmd_t entry;
-		VM_BUG_ON(!PageHead(page));
 		entry = mk_pmd(new_page, vma->vm_page_prot);
 		entry = maybe_pmd_mkwrite(pmd_mkdirty(entry), vma);
 		entry = pmd_mkhuge(entry);
@@ -954,8 +1254,14 @@ int do_huge_pmd_wp_page(struct mm_struct *mm, struct vm_area_struct *vma,
 		page_add_new_anon_rmap(new_page, vma, haddr);
 		set_pmd_at(mm, haddr, pmd, entry);
 		update_mmu_cache(vma, address, entry);
-		page_remove_rmap(page);
-		put_page(page);
+		if (!page) {
+			add_mm_counter(mm, MM_ANONPAGES, HPAGE_PMD_NR);
+			put_huge_zero_page();
+		} else {
+			VM_BUG_ON(!PageHead(page));
+			page_remove_rmap(page);
+			put_page(page);
+		}
 		ret |= VM_FAULT_WRITE;
 	}
 out_unlock:
@@ -970,14 +1276,21 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 				   unsigned int flags)
 {
 	struct page *page = NULL;
+	bool anon;
 
 	assert_spin_locked(&mm->page_table_lock);
 
 	if (flags & FOLL_WRITE && !pmd_write(*pmd))
 		goto out;
 
+	/* Avoid dumping the huge zero page, as for the small one */
+	if ((flags & FOLL_DUMP) && is_huge_zero_pmd(*pmd))
+		return ERR_PTR(-EFAULT);
+
 	page = pmd_page(*pmd);
-	VM_BUG_ON(!PageHead(page));
+	/* a page cache pmd maps small pages, see do_huge_pmd_file_map() */
+	anon = PageAnon(page);
+	VM_BUG_ON(anon && !PageHead(page));
 	if (flags & FOLL_TOUCH) {
 		pmd_t _pmd;
 		/*
@@ -992,7 +1305,7 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		set_pmd_at(mm, addr & HPAGE_PMD_MASK, pmd, _pmd);
 	}
 	page += (addr & ~HPAGE_PMD_MASK) >> PAGE_SHIFT;
-	VM_BUG_ON(!PageCompound(page));
+	VM_BUG_ON(anon && !PageCompound(page));
 	if (flags & FOLL_GET)
 		get_page_foll(page);
 
@@ -1014,9 +1327,26 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 		} else {
 			struct page *page;
 			pgtable_t pgtable;
+			pmd_t orig_pmd = *pmd;
+			/* the pmd is not part of the gathered range */
+			tlb->need_flush_all = 1;
 			pgtable = get_pmd_huge_pte(tlb->mm);
-			page = pmd_page(*pmd);
+			page = pmd_page(orig_pmd);
 			pmd_clear(pmd);
+			if (is_huge_zero_pmd(orig_pmd)) {
+				tlb->mm->nr_ptes--;
+				spin_unlock(&tlb->mm->page_table_lock);
+				put_huge_zero_page();
+				pte_free(tlb->mm, pgtable);
+				return 1;
+			}
+			if (!PageAnon(page)) {
+				tlb->mm->nr_ptes--;
+				spin_unlock(&tlb->mm->page_table_lock);
+				release_file_pmd(tlb, tlb->mm, orig_pmd);
+				pte_free(tlb->mm, pgtable);
+				return 1;
+			}
 			page_remove_rmap(page);
 			VM_BUG_ON(page_mapcount(page) < 0);
 			add_mm_counter(tlb->mm, MM_ANONPAGES, -HPAGE_PMD_NR);
@@ -1206,7 +1536,6 @@ static void __split_huge_page_refcount(struct page *page)
 	int i;
 	unsigned long head_index = page->index;
 	struct zone *zone = page_zone(page);
-	int zonestat;
 	int tail_count = 0;
 
 	/* prevent PageLRU to go away from under us, and freeze lru stats */
@@ -1254,6 +1583,12 @@ static void __split_huge_page_refcount(struct page *page)
 				      (1L << PG_uptodate)));
 		page_tail->flags |= (1L << PG_dirty);
 
+		/* Idle tracking state covers the whole huge page */
+		if (PageYoung(page))
+			SetPageYoung(page_tail);
+		if (PageIdle(page))
+			SetPageIdle(page_tail);
+
 		/* clear PageTail before overwriting first_page */
 		smp_wmb();
 
@@ -1293,15 +1628,6 @@ static void __split_huge_page_refcount(struct page *page)
 	__dec_zone_page_state(page, NR_ANON_TRANSPARENT_HUGEPAGES);
 	__mod_zone_page_state(zone, NR_ANON_PAGES, HPAGE_PMD_NR);
 
-	/*
-	 * A hugepage counts for HPAGE_PMD_NR pages on the LRU statistics,
-	 * so adjust those appropriately if this page is on the LRU.
-	 */
-	if (PageLRU(page)) {
-		zonestat = NR_LRU_BASE + page_lru(page);
-		__mod_zone_page_state(zone, zonestat, -(HPAGE_PMD_NR-1));
-	}
-
 	ClearPageCompound(page);
 	compound_unlock(page);
 	spin_unlock_irq(&zone->lru_lock);
@@ -1479,12 +1805,18 @@ out:
 int hugepage_madvise(struct vm_area_struct *vma,
 		     unsigned long *vm_flags, int advice)
 {
+	unsigned long no_thp = VM_NO_THP;
+
+	/* shared shmem mappings get their huge pages from the page cache */
+	if (vma_is_shmem(vma))
+		no_thp &= ~(VM_SHARED | VM_MAYSHARE);
+
 	switch (advice) {
 	case MADV_HUGEPAGE:
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & (VM_HUGEPAGE | VM_NO_THP))
+		if (*vm_flags & (VM_HUGEPAGE | no_thp))
 			return -EINVAL;
 		*vm_flags &= ~VM_NOHUGEPAGE;
 		*vm_flags |= VM_HUGEPAGE;
@@ -1500,7 +1832,7 @@ int hugepage_madvise(struct vm_area_struct *vma,
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & (VM_NOHUGEPAGE | VM_NO_THP))
+		if (*vm_flags & (VM_NOHUGEPAGE | no_thp))
 			return -EINVAL;
 		*vm_flags &= ~VM_HUGEPAGE;
 		*vm_flags |= VM_NOHUGEPAGE;
@@ -1629,20 +1961,22 @@ int khugepaged_enter_vma_merge(struct vm_area_struct *vma,
 			       unsigned long vm_flags)
 {
 	unsigned long hstart, hend;
-	if (!vma->anon_vma)
+	if (!vma_is_shmem(vma)) {
+		if (!vma->anon_vma)
+			/*
+			 * Not yet faulted in so we will register later in
+			 * the page fault if needed.
+			 */
+			return 0;
+		if (vma->vm_ops)
+			/* khugepaged only works on shmem among file mappings */
+			return 0;
 		/*
-		 * Not yet faulted in so we will register later in the
-		 * page fault if needed.
+		 * If is_pfn_mapping() is true is_learn_pfn_mapping() must
+		 * be true too, verify it here.
 		 */
-		return 0;
-	if (vma->vm_ops)
-		/* khugepaged not yet working on file or special mappings */
-		return 0;
-	/*
-	 * If is_pfn_mapping() is true is_learn_pfn_mapping() must be
-	 * true too, verify it here.
-	 */
-	VM_BUG_ON(is_linear_pfn_mapping(vma) || vm_flags & VM_NO_THP);
+		VM_BUG_ON(is_linear_pfn_mapping(vma) || vm_flags & VM_NO_THP);
+	}
 	hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
 	hend = vma->vm_end & HPAGE_PMD_MASK;
 	if (hstart < hend)
@@ -1733,7 +2067,11 @@ static int __collapse_huge_page_isolate(struct vm_area_struct *vma,
 		}
 		VM_BUG_ON(PageCompound(page));
 		BUG_ON(!PageAnon(page));
-		VM_BUG_ON(!PageSwapBacked(page));
+		/* given up with MADV_FREE, reclaim may drop it */
+		if (!PageSwapBacked(page)) {
+			release_pte_pages(pte, _pte);
+			goto out;
+		}
 
 		/* cannot use mapcount: can't collapse if there's a gup pin */
 		if (page_count(page) != 1) {
@@ -1914,9 +2252,11 @@ static void collapse_huge_page(struct mm_struct *mm,
 
 	pmd = pmd_offset(pud, address);
 	/* pmd can't go away or become huge under us */
-	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd) ||
+	    pmd_shared_pte(*pmd))
 		goto out;
 
+	vm_write_begin(vma);
 	anon_vma_lock(vma->anon_vma);
 
 	pte = pte_offset_map(pmd, address);
@@ -1948,6 +2288,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 		pmd_populate(mm, pmd, pmd_pgtable(_pmd));
 		spin_unlock(&mm->page_table_lock);
 		anon_vma_unlock(vma->anon_vma);
+		vm_write_end(vma);
 		goto out;
 	}
 
@@ -1982,6 +2323,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 	update_mmu_cache(vma, address, _pmd);
 	prepare_pmd_huge_pte(pgtable, mm);
 	spin_unlock(&mm->page_table_lock);
+	vm_write_end(vma);
 
 #ifndef CONFIG_NUMA
 	*hpage = NULL;
@@ -2025,7 +2367,8 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 		goto out;
 
 	pmd = pmd_offset(pud, address);
-	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd) ||
+	    pmd_shared_pte(*pmd))
 		goto out;
 
 	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
@@ -2094,6 +2437,111 @@ static void collect_mm_slot(struct mm_slot *mm_slot)
 	}
 }
 
+/* Find the pmd of a page table that maps address, if there is one */
+static pmd_t *khugepaged_file_pmd(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		return NULL;
+	return pmd;
+}
+
+/*
+ * Free the page table under a huge page cache extent of a shared vma if
+ * it is empty, so that the next fault maps the extent with a pmd.  The
+ * mmap_sem held for write keeps page faults out and i_mmap_mutex the rmap
+ * walkers, so nothing else can be looking at the ptes.
+ */
+static bool retract_file_pmd(struct mm_struct *mm, struct vm_area_struct *vma,
+			     unsigned long address)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	pmd_t *pmd, _pmd;
+	pte_t *pte;
+	spinlock_t *ptl;
+	int i;
+
+	pmd = khugepaged_file_pmd(mm, address);
+	if (!pmd)
+		return false;
+
+	mutex_lock(&mapping->i_mmap_mutex);
+	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		if (!pte_none(pte[i]))
+			break;
+	pte_unmap_unlock(pte, ptl);
+	if (i == HPAGE_PMD_NR) {
+		spin_lock(&mm->page_table_lock);
+		/* after the flush gup_fast can't be walking the ptes either */
+		_pmd = pmdp_clear_flush(vma, address, pmd);
+		mm->nr_ptes--;
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, pmd_pgtable(_pmd));
+	}
+	mutex_unlock(&mapping->i_mmap_mutex);
+
+	return i == HPAGE_PMD_NR;
+}
+
+/*
+ * Make the page cache behind the huge page aligned address of a shmem
+ * mapping one huge extent, then replace the ptes mapping it so that it
+ * can be mapped by a pmd.  Returns 1 if mmap_sem was released.
+ */
+static int khugepaged_scan_file(struct mm_struct *mm,
+				struct vm_area_struct *vma,
+				unsigned long address)
+{
+	struct file *file = vma->vm_file;
+	struct address_space *mapping = file->f_mapping;
+	pgoff_t index = linear_page_index(vma, address);
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	if (index & (HPAGE_PMD_NR - 1))
+		return 0;
+	/* nothing mapped by ptes: the next fault can map a pmd already */
+	if (!khugepaged_file_pmd(mm, address))
+		return 0;
+
+	get_file(file);
+	up_read(&mm->mmap_sem);
+
+	if (!shmem_collapse_huge_extent(mapping, index)) {
+		unmap_mapping_range(mapping, (loff_t)index << PAGE_SHIFT,
+				    HPAGE_PMD_SIZE, 0);
+
+		down_write(&mm->mmap_sem);
+		if (unlikely(khugepaged_test_exit(mm)))
+			goto out;
+		vma = find_vma(mm, address);
+		if (!vma || vma->vm_file != file ||
+		    address < vma->vm_start ||
+		    address + HPAGE_PMD_SIZE > vma->vm_end ||
+		    linear_page_index(vma, address) != index ||
+		    !shmem_huge_enabled(vma))
+			goto out;
+		if (retract_file_pmd(mm, vma, address))
+			khugepaged_pages_collapsed++;
+out:
+		up_write(&mm->mmap_sem);
+	}
+	fput(file);
+
+	return 1;
+}
+
 static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 					    struct page **hpage)
 	__releases(&khugepaged_mm_lock)
@@ -2127,6 +2575,7 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 	progress++;
 	for (; vma; vma = vma->vm_next) {
 		unsigned long hstart, hend;
+		bool file;
 
 		cond_resched();
 		if (unlikely(khugepaged_test_exit(mm))) {
@@ -2134,14 +2583,17 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			break;
 		}
 
-		if ((!(vma->vm_flags & VM_HUGEPAGE) &&
-		     !khugepaged_always()) ||
-		    (vma->vm_flags & VM_NOHUGEPAGE)) {
+		/* shmem has its own policy, see shmem_huge_enabled() */
+		file = vma_is_shmem(vma);
+		if (file ? !shmem_huge_enabled(vma) :
+		    ((!(vma->vm_flags & VM_HUGEPAGE) &&
+		      !khugepaged_always()) ||
+		     (vma->vm_flags & VM_NOHUGEPAGE))) {
 		skip:
 			progress++;
 			continue;
 		}
-		if (!vma->anon_vma || vma->vm_ops)
+		if (!file && (!vma->anon_vma || vma->vm_ops))
 			goto skip;
 		if (is_vma_temporary_stack(vma))
 			goto skip;
@@ -2150,7 +2602,7 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 		 * must be true too, verify it here.
 		 */
 		VM_BUG_ON(is_linear_pfn_mapping(vma) ||
-			  vma->vm_flags & VM_NO_THP);
+			  (!file && vma->vm_flags & VM_NO_THP));
 
 		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
 		hend = vma->vm_end & HPAGE_PMD_MASK;
@@ -2171,9 +2623,13 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			ret = khugepaged_scan_pmd(mm, vma,
-						  khugepaged_scan.address,
-						  hpage);
+			if (file)
+				ret = khugepaged_scan_file(mm, vma,
+						khugepaged_scan.address);
+			else
+				ret = khugepaged_scan_pmd(mm, vma,
+						khugepaged_scan.address,
+						hpage);
 			/* move to next address */
 			khugepaged_scan.address += HPAGE_PMD_SIZE;
 			progress += HPAGE_PMD_NR;
@@ -2375,7 +2831,39 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 		spin_unlock(&mm->page_table_lock);
 		return;
 	}
+	if (is_huge_zero_pmd(*pmd)) {
+		/*
+		 * Nothing was written there yet: dropping the huge zero
+		 * page lets the next faults map small zero pages instead.
+		 */
+		pgtable_t pgtable = get_pmd_huge_pte(mm);
+
+		pmd_clear(pmd);
+		mm->nr_ptes--;
+		spin_unlock(&mm->page_table_lock);
+		flush_tlb_mm(mm);
+		put_huge_zero_page();
+		pte_free(mm, pgtable);
+		return;
+	}
 	page = pmd_page(*pmd);
+	if (!PageAnon(page)) {
+		/*
+		 * There is nothing to split in the page cache: the pages
+		 * are small already, so just let them be faulted back in
+		 * through ->fault, by ptes.
+		 */
+		pgtable_t pgtable = get_pmd_huge_pte(mm);
+		pmd_t orig_pmd = *pmd;
+
+		pmd_clear(pmd);
+		mm->nr_ptes--;
+		spin_unlock(&mm->page_table_lock);
+		flush_tlb_mm(mm);
+		release_file_pmd(NULL, mm, orig_pmd);
+		pte_free(mm, pgtable);
+		return;
+	}
 	VM_BUG_ON(!page_count(page));
 	get_page(page);
 	spin_unlock(&mm->page_table_lock);
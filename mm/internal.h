@@ -16,6 +16,15 @@
 void free_pgtables(struct mmu_gather *tlb, struct vm_area_struct *start_vma,
 		unsigned long floor, unsigned long ceiling);
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+extern void put_vma(struct vm_area_struct *vma);
+#else
+static inline void put_vma(struct vm_area_struct *vma)
+{
+	kmem_cache_free(vm_area_cachep, vma);
+}
+#endif
+
 static inline void set_page_count(struct page *page, int v)
 {
 	atomic_set(&page->_count, v);
@@ -57,6 +57,7 @@
 #include <linux/swapops.h>
 #include <linux/elf.h>
 #include <linux/gfp.h>
+#include <linux/migrate.h>
 
 #include <asm/io.h>
 #include <asm/pgalloc.h>
@@ -234,6 +235,7 @@ void tlb_gather_mmu(struct mmu_gather *tlb, struct mm_struct *mm, bool fullmm)
 
 	tlb->fullmm     = fullmm;
 	tlb->need_flush = 0;
+	__tlb_reset_range(tlb);
 	tlb->fast_mode  = (num_possible_cpus() == 1);
 	tlb->local.next = NULL;
 	tlb->local.nr   = 0;
@@ -254,6 +256,7 @@ void tlb_flush_mmu(struct mmu_gather *tlb)
 		return;
 	tlb->need_flush = 0;
 	tlb_flush(tlb);
+	__tlb_reset_range(tlb);
 #ifdef CONFIG_HAVE_RCU_TABLE_FREE
 	tlb_table_flush(tlb);
 #endif
@@ -992,6 +995,501 @@ again:
 	return 0;
 }
 
+#ifdef CONFIG_FORK_SHARE_PTE
+/*
+ * Page tables shared on fork.
+ *
+ * Forking a process with a large resident set spends its time in
+ * copy_pte_range(), taking a reference and a mapcount on every page.  A
+ * process that asked for it with prctl(PR_SET_FORK_SHARE_PTE) instead has
+ * the page tables of its private anonymous memory shared with the child:
+ * each pmd mapping a table that lies entirely in such a vma is copied into
+ * the child, and both the parent's and the child's pmd are write-protected.
+ *
+ * The pages stay mapped, and counted by page_mapcount(), once: through the
+ * shared table.  Before an mm changes any pte of a shared table, the first
+ * fault on it included, __unshare_pte_table() gives it a copy of its own,
+ * made with copy_one_pte() just as fork would have done, or hands the
+ * table back to it if all the other sharers have gone.  Unmapping a whole
+ * shared table only drops the mm's reference to it.  Callers that unmap or
+ * mprotect part of one unshare it first with unshare_pte_range().
+ *
+ * The mms sharing a table are linked in a ring of struct pte_sharer, and
+ * the number of other mms in its _mapcount (-1 with a single user, as for
+ * any page table).  Both only change under its split pte lock, which all
+ * sharers have in common.  One of them owns the table, page->index points
+ * to its record: the RSS of the pages is accounted to the owner, which is
+ * also the only mm reverse map walks reach the table through.  When the
+ * owner unshares or unmaps the table, the next sharer in the ring takes
+ * it over together with its RSS.  A pte cleared through the owner is
+ * flushed out of the TLBs of the other sharers by flush_shared_pte_table().
+ */
+
+struct pte_sharer {
+	struct list_head list;		/* ring of the mms sharing a table */
+	struct mm_struct *mm;
+};
+
+static inline struct pte_sharer *pte_owner(struct page *table)
+{
+	return (struct pte_sharer *)table->index;
+}
+
+static bool can_share_pte(struct vm_area_struct *vma, unsigned long addr,
+			  unsigned long end)
+{
+	if (!USE_SPLIT_PTLOCKS)
+		return false;
+	if (!test_bit(MMF_FORK_SHARE_PTE, &vma->vm_mm->flags))
+		return false;
+	if (vma->vm_file || vma->vm_ops || !vma->anon_vma ||
+	    !is_cow_mapping(vma->vm_flags))
+		return false;
+	if (vma->vm_flags & (VM_HUGETLB | VM_NONLINEAR | VM_PFNMAP |
+			     VM_MIXEDMAP | VM_INSERTPAGE | VM_IO |
+			     VM_MERGEABLE))
+		return false;
+	return !(addr & ~PMD_MASK) && end - addr == PMD_SIZE;
+}
+
+/*
+ * Map the page table src_pmd points to into the child instead of copying
+ * it.  Called with the parent's mmap_sem held for writing, so src_pmd
+ * cannot be shared or unshared meanwhile; its TLB is flushed by
+ * dup_mmap().  Returns -ENOMEM if the table has to be copied after all.
+ */
+static int share_pte_table(struct mm_struct *dst_mm,
+			   struct mm_struct *src_mm, pmd_t *dst_pmd,
+			   pmd_t *src_pmd, unsigned long addr)
+{
+	struct page *table = pmd_page(*src_pmd);
+	spinlock_t *ptl = pte_lockptr(src_mm, src_pmd);
+	struct pte_sharer *owner = NULL, *sharer;
+
+	if (!pmd_shared_pte(*src_pmd)) {
+		owner = kmalloc(sizeof(*owner), GFP_KERNEL);
+		if (!owner)
+			return -ENOMEM;
+		INIT_LIST_HEAD(&owner->list);
+		owner->mm = src_mm;
+	}
+	sharer = kmalloc(sizeof(*sharer), GFP_KERNEL);
+	if (!sharer) {
+		kfree(owner);
+		return -ENOMEM;
+	}
+	sharer->mm = dst_mm;
+
+	spin_lock(ptl);
+	if (owner) {
+		table->index = (unsigned long)owner;
+		set_pmd_at(src_mm, addr, src_pmd, pmd_wrprotect(*src_pmd));
+	}
+	list_add_tail(&sharer->list, &pte_owner(table)->list);
+	atomic_inc(&table->_mapcount);
+	spin_unlock(ptl);
+
+	dst_mm->nr_ptes++;
+	pmd_populate(dst_mm, dst_pmd, table);
+	set_pmd_at(dst_mm, addr, dst_pmd, pmd_wrprotect(*dst_pmd));
+
+	set_bit(MMF_SHARED_PTE, &src_mm->flags);
+	set_bit(MMF_SHARED_PTE, &dst_mm->flags);
+	return 0;
+}
+
+/**
+ * pte_table_owner - may reverse map walks reach a page table through an mm
+ * @mm: mm being walked
+ * @pmd: pmd of the mm
+ * @pmde: value of *@pmd the walk found the table with
+ *
+ * Called with the pte lock of the table held.  False if the mm no longer
+ * maps the table, or shares it with an mm that owns it.
+ */
+bool pte_table_owner(struct mm_struct *mm, pmd_t *pmd, pmd_t pmde)
+{
+	pmd_t cur = *pmd;
+
+	if (!pmd_present(cur) || pmd_trans_huge(cur) ||
+	    pmd_page(cur) != pmd_page(pmde))
+		return false;
+	return !pmd_shared_pte(cur) || pte_owner(pmd_page(cur))->mm == mm;
+}
+
+/**
+ * flush_shared_pte_table - flush a cleared pte out of the other sharers
+ * @mm: mm the pte was cleared through
+ * @address: address of the pte
+ *
+ * ptep_clear_flush() only flushes the TLB of the mm the pte was reached
+ * through, the other mms sharing the table may still cache it.  Called
+ * with the pte lock held.
+ */
+void flush_shared_pte_table(struct mm_struct *mm, unsigned long address)
+{
+	struct pte_sharer *owner, *sharer;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	if (!test_bit(MMF_SHARED_PTE, &mm->flags))
+		return;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return;
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return;
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd) ||
+	    !pmd_shared_pte(*pmd))
+		return;
+
+	owner = pte_owner(pmd_page(*pmd));
+	VM_BUG_ON(owner->mm != mm);
+	list_for_each_entry(sharer, &owner->list, list) {
+		flush_tlb_mm(sharer->mm);
+		mmu_notifier_invalidate_page(sharer->mm, address);
+	}
+}
+
+/* Add @sign times the RSS of the table pmd points to to rss */
+static void pte_table_rss(struct vm_area_struct *vma, pmd_t *pmd,
+			  unsigned long addr, int *rss, int sign)
+{
+	pte_t *start_pte, *pte;
+
+	start_pte = pte = pte_offset_map(pmd, addr);
+	do {
+		pte_t ptent = *pte;
+
+		if (pte_none(ptent))
+			continue;
+		if (pte_present(ptent)) {
+			struct page *page = vm_normal_page(vma, addr, ptent);
+
+			if (page)
+				rss[PageAnon(page) ? MM_ANONPAGES :
+						     MM_FILEPAGES] += sign;
+		} else if (!pte_file(ptent) &&
+			   !non_swap_entry(pte_to_swp_entry(ptent)))
+			rss[MM_SWAPENTS] += sign;
+	} while (pte++, addr += PAGE_SIZE, addr & ~PMD_MASK);
+	pte_unmap(start_pte);
+}
+
+/*
+ * The mm stops sharing the table with the others.  If it owned it, the
+ * next sharer takes over the RSS of its pages and is put on the mmlist,
+ * for swapoff to find its swap entries.  Returns the mm's record, to be
+ * freed once the pte lock is dropped.
+ */
+static struct pte_sharer *leave_pte_table(struct vm_area_struct *vma,
+					  pmd_t *pmd, unsigned long addr)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *table = pmd_page(*pmd);
+	struct pte_sharer *owner = pte_owner(table), *sharer = owner;
+
+	while (sharer->mm != mm)
+		sharer = list_entry(sharer->list.next, struct pte_sharer, list);
+
+	if (sharer == owner) {
+		int rss[NR_MM_COUNTERS];
+
+		owner = list_entry(sharer->list.next, struct pte_sharer, list);
+		table->index = (unsigned long)owner;
+
+		init_rss_vec(rss);
+		pte_table_rss(vma, pmd, addr, rss, 1);
+		add_mm_rss_vec(owner->mm, rss);
+
+		if (unlikely(list_empty(&owner->mm->mmlist))) {
+			spin_lock(&mmlist_lock);
+			if (list_empty(&owner->mm->mmlist))
+				list_add(&owner->mm->mmlist, &init_mm.mmlist);
+			spin_unlock(&mmlist_lock);
+		}
+	}
+	list_del(&sharer->list);
+	return sharer;
+}
+
+/*
+ * The mm is the last user of the shared table, and so its owner: take it
+ * back.  Returns the mm's record, to be freed once the pte lock is dropped.
+ */
+static struct pte_sharer *reclaim_pte_table(struct vm_area_struct *vma,
+					    pmd_t *pmd, unsigned long addr)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *table = pmd_page(*pmd);
+	struct pte_sharer *owner = pte_owner(table);
+
+	VM_BUG_ON(owner->mm != mm || !list_empty(&owner->list));
+	table->index = 0;
+	set_pmd_at(mm, addr, pmd, pmd_mkwrite(*pmd));
+	return owner;
+}
+
+/* Drop the references a partial copy of a table took */
+static void unshare_pte_undo(struct vm_area_struct *vma, pte_t *pte,
+			     unsigned long addr, int nr)
+{
+	for (; nr; nr--, pte++, addr += PAGE_SIZE) {
+		pte_t ptent = *pte;
+
+		if (pte_none(ptent))
+			continue;
+		if (pte_present(ptent)) {
+			struct page *page = vm_normal_page(vma, addr, ptent);
+
+			if (page) {
+				page_remove_rmap(page);
+				put_page(page);
+			}
+		} else if (!pte_file(ptent)) {
+			swp_entry_t entry = pte_to_swp_entry(ptent);
+
+			if (!non_swap_entry(entry))
+				free_swap_and_cache(entry);
+		}
+		pte_clear(vma->vm_mm, addr, pte);
+	}
+}
+
+/**
+ * __unshare_pte_table - give an mm its own copy of a shared page table
+ * @vma: vma of the mm being changed, covering @address
+ * @pmd: pmd pointing to the shared table
+ * @address: address within the table
+ *
+ * Called with mmap_sem held.  Returns -ENOMEM if the copy could not be
+ * made, the table being left shared.
+ */
+int __unshare_pte_table(struct vm_area_struct *vma, pmd_t *pmd,
+			unsigned long address)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long start = address & PMD_MASK;
+	unsigned long addr = start;
+	struct pte_sharer *sharer = NULL;
+	int rss[NR_MM_COUNTERS];
+	pte_t *src_pte, *dst_pte;
+	struct page *table;
+	spinlock_t *ptl;
+	pgtable_t new;
+	int i, ret = 0;
+
+	new = pte_alloc_one(mm, start);
+	if (!new)
+		return -ENOMEM;
+
+	spin_lock(&mm->page_table_lock);
+	/* Another thread may have unshared it meanwhile */
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd) ||
+	    !pmd_shared_pte(*pmd))
+		goto out;
+
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock(ptl);
+	table = pmd_page(*pmd);
+	if (atomic_read(&table->_mapcount) < 0) {
+		sharer = reclaim_pte_table(vma, pmd, start);
+		goto out_unlock;
+	}
+
+	/* Make sure swapoff finds our copies of swap entries */
+	if (unlikely(list_empty(&mm->mmlist))) {
+		spin_lock(&mmlist_lock);
+		if (list_empty(&mm->mmlist))
+			list_add(&mm->mmlist, &init_mm.mmlist);
+		spin_unlock(&mmlist_lock);
+	}
+
+	init_rss_vec(rss);
+	src_pte = pte_offset_map(pmd, start);
+	dst_pte = kmap_atomic(new);
+	for (i = 0; i < PTRS_PER_PTE; i++, addr += PAGE_SIZE) {
+		swp_entry_t entry;
+
+		if (pte_none(src_pte[i]))
+			continue;
+		entry.val = copy_one_pte(mm, mm, dst_pte + i, src_pte + i,
+					 vma, addr, rss);
+		if (likely(!entry.val))
+			continue;
+		if (add_swap_count_continuation(entry, GFP_ATOMIC) < 0 ||
+		    copy_one_pte(mm, mm, dst_pte + i, src_pte + i,
+				 vma, addr, rss)) {
+			unshare_pte_undo(vma, dst_pte, start, i);
+			ret = -ENOMEM;
+			break;
+		}
+	}
+	kunmap_atomic(dst_pte);
+	pte_unmap(src_pte);
+	if (ret)
+		goto out_unlock;
+
+	/* The copy keeps the accounting of the pages it maps */
+	if (pte_owner(table)->mm != mm)
+		add_mm_rss_vec(mm, rss);
+	sharer = leave_pte_table(vma, pmd, start);
+
+	smp_wmb(); /* See comment in __pte_alloc */
+	pmd_populate(mm, pmd, new);
+	new = NULL;
+	/* Nobody may still walk the shared table through our pmd ... */
+	flush_tlb_range(vma, start, start + PMD_SIZE);
+	/* ... before the last other user can free it */
+	atomic_dec(&table->_mapcount);
+out_unlock:
+	spin_unlock(ptl);
+out:
+	spin_unlock(&mm->page_table_lock);
+	if (new)
+		pte_free(mm, new);
+	kfree(sharer);
+	return ret;
+}
+
+/*
+ * Unmapping a whole shared page table: drop this mm's reference to it.
+ * Returns false if the mm turned out to be its last user and took it
+ * back, the caller then zaps it as usual.
+ */
+static bool zap_shared_pte(struct vm_area_struct *vma, pmd_t *pmd,
+			   unsigned long addr)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long start = addr & PMD_MASK;
+	struct pte_sharer *sharer = NULL;
+	struct page *table;
+	spinlock_t *ptl;
+	bool dropped = true;
+
+	spin_lock(&mm->page_table_lock);
+	if (pmd_none(*pmd))
+		goto out;
+	if (!pmd_shared_pte(*pmd)) {
+		dropped = false;
+		goto out;
+	}
+
+	ptl = pte_lockptr(mm, pmd);
+	spin_lock(ptl);
+	table = pmd_page(*pmd);
+	if (atomic_read(&table->_mapcount) < 0) {
+		sharer = reclaim_pte_table(vma, pmd, start);
+		dropped = false;
+	} else {
+		if (pte_owner(table)->mm == mm) {
+			int rss[NR_MM_COUNTERS];
+
+			init_rss_vec(rss);
+			pte_table_rss(vma, pmd, start, rss, -1);
+			add_mm_rss_vec(mm, rss);
+		}
+		sharer = leave_pte_table(vma, pmd, start);
+		pmd_clear(pmd);
+		mm->nr_ptes--;
+		flush_tlb_range(vma, start, start + PMD_SIZE);
+		atomic_dec(&table->_mapcount);
+	}
+	spin_unlock(ptl);
+out:
+	spin_unlock(&mm->page_table_lock);
+	kfree(sharer);
+	return dropped;
+}
+
+/* Unshare the page table mapping addr, if any */
+static int unshare_pte_at(struct mm_struct *mm, unsigned long addr)
+{
+	unsigned long start = addr & PMD_MASK;
+	struct vm_area_struct *vma;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	vma = find_vma(mm, start);
+	if (!vma || vma->vm_start >= start + PMD_SIZE)
+		return 0;
+
+	pgd = pgd_offset(mm, addr);
+	if (!pgd_present(*pgd))
+		return 0;
+	pud = pud_offset(pgd, addr);
+	if (!pud_present(*pud))
+		return 0;
+	pmd = pmd_offset(pud, addr);
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		return 0;
+	return unshare_pte_table(vma, pmd, max(start, vma->vm_start));
+}
+
+/**
+ * unshare_pte_range - unshare the page tables of a range
+ * @mm: mm about to change the range
+ * @start: start of the range
+ * @end: end of the range
+ * @edges: only the tables the range covers part of
+ *
+ * Unmapping drops whole shared tables and only needs the tables at the
+ * edges of the range unshared, changing the ptes of a range needs all of
+ * them unshared.  Called with mmap_sem held.
+ */
+int unshare_pte_range(struct mm_struct *mm, unsigned long start,
+		      unsigned long end, bool edges)
+{
+	unsigned long addr;
+	int err;
+
+	if (!test_bit(MMF_SHARED_PTE, &mm->flags))
+		return 0;
+
+	if (edges) {
+		err = 0;
+		if (start & ~PMD_MASK)
+			err = unshare_pte_at(mm, start);
+		if (!err && (end & ~PMD_MASK))
+			err = unshare_pte_at(mm, end);
+		return err;
+	}
+
+	for (addr = start; addr < end; addr = (addr + PMD_SIZE) & PMD_MASK) {
+		err = unshare_pte_at(mm, addr);
+		if (err)
+			return err;
+		if (!((addr + PMD_SIZE) & PMD_MASK))
+			break;
+	}
+	return 0;
+}
+#else
+static inline bool can_share_pte(struct vm_area_struct *vma,
+				 unsigned long addr, unsigned long end)
+{
+	return false;
+}
+
+static inline int share_pte_table(struct mm_struct *dst_mm,
+				  struct mm_struct *src_mm, pmd_t *dst_pmd,
+				  pmd_t *src_pmd, unsigned long addr)
+{
+	return -EINVAL;
+}
+
+static inline bool zap_shared_pte(struct vm_area_struct *vma, pmd_t *pmd,
+				  unsigned long addr)
+{
+	return false;
+}
+#endif /* CONFIG_FORK_SHARE_PTE */
+
 static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		pud_t *dst_pud, pud_t *src_pud, struct vm_area_struct *vma,
 		unsigned long addr, unsigned long end)
@@ -1018,6 +1516,9 @@ static inline int copy_pmd_range(struct mm_struct *dst_mm, struct mm_struct *src
 		}
 		if (pmd_none_or_clear_bad(src_pmd))
 			continue;
+		if (can_share_pte(vma, addr, next) &&
+		    !share_pte_table(dst_mm, src_mm, dst_pmd, src_pmd, addr))
+			continue;
 		if (copy_pte_range(dst_mm, src_mm, dst_pmd, src_pmd,
 						vma, addr, next))
 			return -ENOMEM;
@@ -1236,7 +1737,9 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		next = pmd_addr_end(addr, end);
 		if (pmd_trans_huge(*pmd)) {
 			if (next - addr != HPAGE_PMD_SIZE) {
-				VM_BUG_ON(!rwsem_is_locked(&tlb->mm->mmap_sem));
+				/* truncation zaps page cache pmds as well */
+				VM_BUG_ON(!vma->vm_ops &&
+					  !rwsem_is_locked(&tlb->mm->mmap_sem));
 				split_huge_page_pmd(vma->vm_mm, pmd);
 			} else if (zap_huge_pmd(tlb, vma, pmd))
 				goto next;
@@ -1251,6 +1754,9 @@ static inline unsigned long zap_pmd_range(struct mmu_gather *tlb,
 		 */
 		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			goto next;
+		/* callers unshare the tables they only unmap part of */
+		if (pmd_shared_pte(*pmd) && zap_shared_pte(vma, pmd, addr))
+			goto next;
 		next = zap_pte_range(tlb, vma, pmd, addr, next, details);
 next:
 		cond_resched();
@@ -1501,7 +2007,11 @@ struct page *follow_page(struct vm_area_struct *vma, unsigned long address,
 		/* fall through */
 	}
 split_fallthrough:
-	if (unlikely(pmd_bad(*pmd)))
+	/* splitting a page cache pmd leaves nothing mapped */
+	if (unlikely(pmd_none(*pmd) || pmd_bad(*pmd)))
+		goto no_page_table;
+	/* writing through a page table shared on fork must unshare it */
+	if ((flags & FOLL_WRITE) && pmd_shared_pte(*pmd))
 		goto no_page_table;
 
 	ptep = pte_offset_map_lock(mm, pmd, address, &ptl);
@@ -3206,6 +3716,31 @@ oom:
 	return VM_FAULT_OOM;
 }
 
+/**
+ * do_set_pte - map a page cache page read-only at address
+ * @vma:	vma of the mapping
+ * @address:	user virtual address to map it at
+ * @page:	locked, uptodate page; the pte takes over the caller's reference
+ * @pte:	empty pte for address, with the pte lock held
+ *
+ * For ->map_pages(): the page is never written through this pte, a write
+ * fault on it goes through do_wp_page() as usual.
+ */
+void do_set_pte(struct vm_area_struct *vma, unsigned long address,
+		struct page *page, pte_t *pte)
+{
+	pte_t entry;
+
+	flush_icache_page(vma, page);
+	entry = mk_pte(page, vma->vm_page_prot);
+	inc_mm_counter_fast(vma->vm_mm, MM_FILEPAGES);
+	page_add_file_rmap(page);
+	set_pte_at(vma->vm_mm, address, pte, entry);
+
+	/* no need to invalidate: a not-present page won't be cached */
+	update_mmu_cache(vma, address, pte);
+}
+
 /*
  * __do_fault() tries to create a new page mapping. It aggressively
  * tries to share with existing pages, but makes a separate copy if
@@ -3409,17 +3944,164 @@ uncharge_out:
 	return ret;
 }
 
+/*
+ * How much of a file mapping around a read fault is mapped from the page
+ * cache along with the faulting page.  Rounded down to a power of two
+ * number of pages, at most one page table; one page or less disables it.
+ */
+unsigned long sysctl_fault_around_bytes __read_mostly = 65536;
+
+static unsigned long fault_around_pages(void)
+{
+	unsigned long pages = ACCESS_ONCE(sysctl_fault_around_bytes) >> PAGE_SHIFT;
+
+	if (pages <= 1)
+		return 1;
+	return min_t(unsigned long, rounddown_pow_of_two(pages), PTRS_PER_PTE);
+}
+
+/*
+ * Map the cached pages around address, within its page table and vma,
+ * through ->map_pages().  pte is the pte of address, locked; pgoff is
+ * the file offset of address.
+ */
+static void do_fault_around(struct vm_area_struct *vma, unsigned long address,
+		pte_t *pte, pgoff_t pgoff, unsigned int flags)
+{
+	unsigned long nr_pages = fault_around_pages();
+	unsigned long start_addr;
+	pgoff_t max_pgoff;
+	struct vm_fault vmf;
+	int off;
+
+	start_addr = max(address & ~((nr_pages << PAGE_SHIFT) - 1) & PAGE_MASK,
+			 vma->vm_start);
+	off = ((address - start_addr) >> PAGE_SHIFT) & (PTRS_PER_PTE - 1);
+	pte -= off;
+	pgoff -= off;
+
+	/* stop at the end of the page table, of the vma or of the window */
+	max_pgoff = pgoff - ((start_addr >> PAGE_SHIFT) & (PTRS_PER_PTE - 1)) +
+		PTRS_PER_PTE - 1;
+	max_pgoff = min3(max_pgoff, vma_pages(vma) + vma->vm_pgoff - 1,
+			 pgoff + nr_pages - 1);
+
+	/* skip what is already mapped before bothering ->map_pages */
+	while (!pte_none(*pte)) {
+		if (++pgoff > max_pgoff)
+			return;
+		start_addr += PAGE_SIZE;
+		if (start_addr >= vma->vm_end)
+			return;
+		pte++;
+	}
+
+	vmf.virtual_address = (void __user *)start_addr;
+	vmf.pte = pte;
+	vmf.pgoff = pgoff;
+	vmf.max_pgoff = max_pgoff;
+	vmf.flags = flags;
+	vma->vm_ops->map_pages(vma, &vmf);
+}
+
 static int do_linear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 		unsigned long address, pte_t *page_table, pmd_t *pmd,
 		unsigned int flags, pte_t orig_pte)
 {
 	pgoff_t pgoff = (((address & PAGE_MASK)
 			- vma->vm_start) >> PAGE_SHIFT) + vma->vm_pgoff;
+	spinlock_t *ptl;
 
 	pte_unmap(page_table);
+
+	/*
+	 * A read fault is likely to be followed by faults on its neighbours:
+	 * map those already in the page cache now, and the faulting page
+	 * too if it was one of them.
+	 */
+	if (!(flags & FAULT_FLAG_WRITE) && vma->vm_ops->map_pages &&
+	    fault_around_pages() > 1) {
+		page_table = pte_offset_map_lock(mm, pmd, address, &ptl);
+		do_fault_around(vma, address, page_table, pgoff, flags);
+		if (!pte_same(*page_table, orig_pte)) {
+			pte_unmap_unlock(page_table, ptl);
+			return 0;
+		}
+		pte_unmap_unlock(page_table, ptl);
+	}
+
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
+/* Whether exec maps the cached text of an ELF binary up front */
+int sysctl_exec_prefault __read_mostly = 1;
+
+/**
+ * map_cached_pages - map the cached pages of a file range into an mm
+ * @mm:		mm to populate
+ * @start:	start of the user range
+ * @end:	end of the user range
+ *
+ * Maps, read-only, whatever of [start, end) is already uptodate in the
+ * page cache, without reading anything in: the rest is left to page
+ * faults.  Used at exec to save the binary's text the fault per page it
+ * would otherwise take while starting up.  Takes mmap_sem for read.
+ */
+void map_cached_pages(struct mm_struct *mm, unsigned long start,
+		      unsigned long end)
+{
+	struct vm_area_struct *vma;
+	struct vm_fault vmf;
+	unsigned long addr, next;
+	spinlock_t *ptl;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+	pte_t *pte;
+
+	start &= PAGE_MASK;
+	down_read(&mm->mmap_sem);
+	for (vma = find_vma(mm, start); vma && vma->vm_start < end;
+	     vma = vma->vm_next) {
+		if (!vma->vm_ops || !vma->vm_ops->map_pages ||
+		    (vma->vm_flags & VM_NONLINEAR))
+			continue;
+
+		addr = max(start, vma->vm_start);
+		for (; addr < min(end, vma->vm_end); addr = next) {
+			next = pmd_addr_end(addr, min(end, vma->vm_end));
+
+			pgd = pgd_offset(mm, addr);
+			pud = pud_alloc(mm, pgd, addr);
+			if (!pud)
+				goto out;
+			pmd = pmd_alloc(mm, pud, addr);
+			if (!pmd)
+				goto out;
+			if (pmd_none(*pmd) && __pte_alloc(mm, vma, pmd, addr))
+				goto out;
+			if (pmd_trans_huge(*pmd))
+				continue;
+			if (unshare_pte_table(vma, pmd, addr))
+				goto out;
+
+			pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+			vmf.virtual_address = (void __user *)addr;
+			vmf.pte = pte;
+			vmf.pgoff = ((addr - vma->vm_start) >> PAGE_SHIFT) +
+				vma->vm_pgoff;
+			vmf.max_pgoff = vmf.pgoff +
+				((next - addr) >> PAGE_SHIFT) - 1;
+			vmf.flags = 0;
+			vma->vm_ops->map_pages(vma, &vmf);
+			pte_unmap_unlock(pte, ptl);
+			cond_resched();
+		}
+	}
+out:
+	up_read(&mm->mmap_sem);
+}
+
 /*
  * Fault of a previously existing named mapping. Repopulate the pte
  * from the encoded file_pte if possible. This enables swappable
@@ -3452,6 +4134,51 @@ static int do_nonlinear_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return __do_fault(mm, vma, address, pmd, pgoff, flags, orig_pte);
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * NUMA hinting fault on a pte that change_prot_numa() made PROT_NONE.
+ * The mapping is restored first, then the fault is accounted to the task
+ * and the page moved next to it if it lives on another node.  Pages under
+ * an explicit memory policy stay where the policy put them.
+ *
+ * We enter with the pte mapped and locked, and return with it unlocked.
+ */
+static int do_numa_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			unsigned long address, pte_t *page_table,
+			spinlock_t *ptl, pte_t entry)
+{
+	struct page *page;
+	int page_nid, this_nid;
+
+	entry = pte_mkyoung(pte_modify(entry, vma->vm_page_prot));
+	set_pte_at(mm, address, page_table, entry);
+	update_mmu_cache(vma, address, page_table);
+
+	page = vm_normal_page(vma, address, entry);
+	if (!page) {
+		pte_unmap_unlock(page_table, ptl);
+		return 0;
+	}
+	get_page(page);
+	pte_unmap_unlock(page_table, ptl);
+
+	count_vm_event(NUMA_HINT_FAULTS);
+	page_nid = page_to_nid(page);
+	this_nid = numa_node_id();
+	if (page_nid == this_nid) {
+		count_vm_event(NUMA_HINT_FAULTS_LOCAL);
+		put_page(page);
+	} else if (vma->vm_policy || current->mempolicy) {
+		put_page(page);
+	} else if (migrate_misplaced_page(page, this_nid)) {
+		page_nid = this_nid;
+	}
+
+	task_numa_fault(page_nid, 1);
+	return 0;
+}
+#endif
+
 /*
  * These routines also need to handle stuff like marking pages dirty
  * and/or accessed for architectures that don't do it in hardware (most
@@ -3494,6 +4221,10 @@ int handle_pte_fault(struct mm_struct *mm,
 	spin_lock(ptl);
 	if (unlikely(!pte_same(*pte, entry)))
 		goto unlock;
+#ifdef CONFIG_NUMA_BALANCING
+	if (pte_numa(vma, entry))
+		return do_numa_page(mm, vma, address, pte, ptl, entry);
+#endif
 	if (flags & FAULT_FLAG_WRITE) {
 		if (!pte_write(entry))
 			return do_wp_page(mm, vma, address,
@@ -3548,19 +4279,29 @@ retry:
 	pmd = pmd_alloc(mm, pud, address);
 	if (!pmd)
 		return VM_FAULT_OOM;
-	if (pmd_none(*pmd) && transparent_hugepage_enabled(vma)) {
-		if (!vma->vm_ops)
-			return do_huge_pmd_anonymous_page(mm, vma, address,
-							  pmd, flags);
+	if (pmd_none(*pmd)) {
+		if (!vma->vm_ops) {
+			if (transparent_hugepage_enabled(vma))
+				return do_huge_pmd_anonymous_page(mm, vma,
+							address, pmd, flags);
+		} else if (vma->vm_ops->pmd_fault) {
+			int ret;
+
+			ret = vma->vm_ops->pmd_fault(vma, address, pmd, flags);
+			if (!(ret & VM_FAULT_FALLBACK))
+				return ret;
+		}
 	} else {
 		pmd_t orig_pmd = *pmd;
 		int ret;
 
 		barrier();
 		if (pmd_trans_huge(orig_pmd)) {
-			if (flags & FAULT_FLAG_WRITE &&
-			    !pmd_write(orig_pmd) &&
-			    !pmd_trans_splitting(orig_pmd)) {
+			if (!(flags & FAULT_FLAG_WRITE) ||
+			    pmd_write(orig_pmd) ||
+			    pmd_trans_splitting(orig_pmd))
+				return 0;
+			if (!vma->vm_ops) {
 				ret = do_huge_pmd_wp_page(mm, vma, address, pmd,
 							  orig_pmd);
 				/*
@@ -3572,7 +4313,11 @@ retry:
 					goto retry;
 				return ret;
 			}
-			return 0;
+			/*
+			 * Page cache pmds are never copied on write: drop it
+			 * and let the pte fault below deal with the write.
+			 */
+			split_huge_page_pmd(mm, pmd);
 		}
 	}
 
@@ -3586,6 +4331,8 @@ retry:
 	/* if an huge pmd materialized from under us just retry later */
 	if (unlikely(pmd_trans_huge(*pmd)))
 		return 0;
+	if (unlikely(unshare_pte_table(vma, pmd, address)))
+		return VM_FAULT_OOM;
 	/*
 	 * A regular pmd is established and it can't morph into a huge pmd
 	 * from under us anymore at this point because we hold the mmap_sem
@@ -3597,6 +4344,176 @@ retry:
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+/*
+ * Bound on the depth of the lockless rbtree walk below: a tree of
+ * sysctl_max_map_count vmas is much shallower than that, but a walk
+ * racing with rotations could otherwise go round in circles.
+ */
+#define SPECULATIVE_WALK_DEPTH	64
+
+/*
+ * Find the vma covering address without mmap_sem, and take a reference
+ * on it so that it is not freed under us.  The rbtree is not RCU safe:
+ * a walk racing with a rebalance may miss the vma, which only costs a
+ * trip through the classic fault path.
+ */
+static struct vm_area_struct *find_vma_speculative(struct mm_struct *mm,
+						   unsigned long address)
+{
+	struct vm_area_struct *vma = NULL;
+	struct rb_node *rb_node;
+	int depth = 0;
+
+	rcu_read_lock();
+	rb_node = ACCESS_ONCE(mm->mm_rb.rb_node);
+	while (rb_node && depth++ < SPECULATIVE_WALK_DEPTH) {
+		struct vm_area_struct *tmp;
+
+		tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+		if (address < tmp->vm_start)
+			rb_node = ACCESS_ONCE(rb_node->rb_left);
+		else if (address >= tmp->vm_end)
+			rb_node = ACCESS_ONCE(rb_node->rb_right);
+		else {
+			vma = tmp;
+			break;
+		}
+	}
+	if (vma && !atomic_add_unless(&vma->vm_ref_count, 1, -1))
+		vma = NULL;
+	rcu_read_unlock();
+
+	return vma;
+}
+
+/*
+ * Handle the first touch of a page of private anonymous memory without
+ * taking mmap_sem, so that the faults of a threaded application do not
+ * queue up behind an mmap, munmap or mprotect of some other part of its
+ * address space.
+ *
+ * Everything the classic path needs mmap_sem for is validated instead:
+ * the vma is snapshotted against its sequence count, which is checked
+ * again under the pte lock before the pte is set; and the page tables
+ * are walked with interrupts disabled, which holds off their freeing
+ * as it does for get_user_pages_fast().  Only a pte_none entry in an
+ * existing page table of a vma that already has its anon_vma is
+ * handled here, anything else returns VM_FAULT_RETRY and is left to
+ * handle_mm_fault() under mmap_sem.
+ */
+int handle_speculative_fault(struct mm_struct *mm, unsigned long address,
+			     unsigned int flags)
+{
+	struct vm_area_struct *vma;
+	struct page *page = NULL;
+	unsigned long vm_flags;
+	pgprot_t page_prot;
+	unsigned int seq;
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, orig_pmd;
+	pte_t *page_table, entry;
+	spinlock_t *ptl;
+	int ret = VM_FAULT_RETRY;
+
+	vma = find_vma_speculative(mm, address);
+	if (!vma)
+		return ret;
+
+	seq = raw_read_seqcount(&vma->vm_sequence);
+	if (seq & 1)
+		goto out_put;
+
+	vm_flags = ACCESS_ONCE(vma->vm_flags);
+	page_prot = vma->vm_page_prot;
+	if (vma->vm_ops || !vma->anon_vma || vma_policy(vma))
+		goto out_put;
+	if (vm_flags & (VM_SHARED | VM_LOCKED | VM_HUGETLB |
+			VM_GROWSDOWN | VM_GROWSUP))
+		goto out_put;
+	if (address < vma->vm_start || address >= vma->vm_end)
+		goto out_put;
+	if (flags & FAULT_FLAG_WRITE) {
+		if (!(vm_flags & VM_WRITE))
+			goto out_put;
+	} else if (!(vm_flags & (VM_READ | VM_WRITE | VM_EXEC)))
+		goto out_put;
+
+	if (flags & FAULT_FLAG_WRITE) {
+		/* The vma has no policy: the task's one applies */
+		page = alloc_page_vma(GFP_HIGHUSER_MOVABLE | __GFP_ZERO,
+				      NULL, address);
+		if (!page)
+			goto out_put;
+		__SetPageUptodate(page);
+		if (mem_cgroup_newpage_charge(page, mm, GFP_KERNEL)) {
+			page_cache_release(page);
+			goto out_put;
+		}
+		entry = mk_pte(page, page_prot);
+		if (vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+	} else
+		entry = pte_mkspecial(pfn_pte(my_zero_pfn(address), page_prot));
+
+	local_irq_disable();
+	pgd = pgd_offset(mm, address);
+	if (pgd_none(*pgd) || unlikely(pgd_bad(*pgd)))
+		goto out_walk;
+	pud = pud_offset(pgd, address);
+	if (pud_none(*pud) || unlikely(pud_bad(*pud)))
+		goto out_walk;
+	pmd = pmd_offset(pud, address);
+	orig_pmd = ACCESS_ONCE(*pmd);
+	if (pmd_none(orig_pmd) || pmd_trans_huge(orig_pmd) ||
+	    unlikely(pmd_bad(orig_pmd)) || pmd_shared_pte(orig_pmd))
+		goto out_walk;
+
+	/*
+	 * Never spin on the pte lock with interrupts disabled: its holder
+	 * may be waiting for us to answer a TLB flush.
+	 */
+	page_table = pte_offset_map(&orig_pmd, address);
+	ptl = pte_lockptr(mm, &orig_pmd);
+	if (!spin_trylock(ptl)) {
+		pte_unmap(page_table);
+		goto out_walk;
+	}
+	if (!pmd_same(*pmd, orig_pmd) ||
+	    read_seqcount_retry(&vma->vm_sequence, seq) ||
+	    !pte_none(*page_table))
+		goto out_unlock;
+
+	if (page) {
+		inc_mm_counter_fast(mm, MM_ANONPAGES);
+		page_add_new_anon_rmap(page, vma, address);
+	}
+	set_pte_at(mm, address, page_table, entry);
+
+	/* No need to invalidate - it was non-present before */
+	update_mmu_cache(vma, address, page_table);
+	page = NULL;
+	ret = 0;
+out_unlock:
+	pte_unmap_unlock(page_table, ptl);
+out_walk:
+	local_irq_enable();
+	if (page) {
+		mem_cgroup_uncharge_page(page);
+		page_cache_release(page);
+	}
+	if (!ret) {
+		count_vm_event(PGFAULT);
+		mem_cgroup_count_vm_event(mm, PGFAULT);
+		check_sync_rss_stat(current);
+	}
+out_put:
+	put_vma(vma);
+	return ret;
+}
+#endif /* CONFIG_SPECULATIVE_PAGE_FAULT */
+
 #ifndef __PAGETABLE_PUD_FOLDED
 /*
  * Allocate page upper directory.
@@ -90,6 +90,7 @@
 #include <linux/syscalls.h>
 #include <linux/ctype.h>
 #include <linux/mm_inline.h>
+#include <linux/mmu_notifier.h>
 
 #include <asm/tlbflush.h>
 #include <asm/uaccess.h>
@@ -561,6 +562,103 @@ static inline int check_pgd_range(struct vm_area_struct *vma,
 	return 0;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Turn the private anonymous pages of a range into PROT_NONE hinting
+ * entries, so that the next access traps into do_numa_page().  Huge pmds
+ * are left alone rather than split.  Returns the number of ptes changed.
+ */
+static unsigned long change_pte_numa(struct vm_area_struct *vma, pmd_t *pmd,
+				     unsigned long addr, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long pages = 0;
+	pte_t *orig_pte;
+	pte_t *pte;
+	spinlock_t *ptl;
+
+	orig_pte = pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	arch_enter_lazy_mmu_mode();
+	do {
+		struct page *page;
+		pte_t ptent = *pte;
+
+		if (!pte_present(ptent) || pte_numa(vma, ptent))
+			continue;
+		page = vm_normal_page(vma, addr, ptent);
+		if (!page || PageReserved(page) || PageKsm(page))
+			continue;
+		/* Shared pages are not migrated, don't fault on them */
+		if (page_mapcount(page) != 1)
+			continue;
+
+		ptent = ptep_modify_prot_start(mm, addr, pte);
+		ptent = pte_modify(ptent, PAGE_NONE);
+		ptep_modify_prot_commit(mm, addr, pte, ptent);
+		pages++;
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+	arch_leave_lazy_mmu_mode();
+	pte_unmap_unlock(orig_pte, ptl);
+	return pages;
+}
+
+static unsigned long change_pmd_numa(struct vm_area_struct *vma, pud_t *pud,
+				     unsigned long addr, unsigned long end)
+{
+	unsigned long next, pages = 0;
+	pmd_t *pmd;
+
+	pmd = pmd_offset(pud, addr);
+	do {
+		next = pmd_addr_end(addr, end);
+		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+			continue;
+		pages += change_pte_numa(vma, pmd, addr, next);
+	} while (pmd++, addr = next, addr != end);
+	return pages;
+}
+
+static unsigned long change_pud_numa(struct vm_area_struct *vma, pgd_t *pgd,
+				     unsigned long addr, unsigned long end)
+{
+	unsigned long next, pages = 0;
+	pud_t *pud;
+
+	pud = pud_offset(pgd, addr);
+	do {
+		next = pud_addr_end(addr, end);
+		if (pud_none_or_clear_bad(pud))
+			continue;
+		pages += change_pmd_numa(vma, pud, addr, next);
+	} while (pud++, addr = next, addr != end);
+	return pages;
+}
+
+unsigned long change_prot_numa(struct vm_area_struct *vma,
+			       unsigned long start, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long next, addr = start, pages = 0;
+	pgd_t *pgd;
+
+	mmu_notifier_invalidate_range_start(mm, start, end);
+	pgd = pgd_offset(mm, addr);
+	flush_cache_range(vma, addr, end);
+	do {
+		next = pgd_addr_end(addr, end);
+		if (pgd_none_or_clear_bad(pgd))
+			continue;
+		pages += change_pud_numa(vma, pgd, addr, next);
+	} while (pgd++, addr = next, addr != end);
+	if (pages)
+		flush_tlb_range(vma, start, end);
+	mmu_notifier_invalidate_range_end(mm, start, end);
+
+	count_vm_events(NUMA_PTE_UPDATES, pages);
+	return pages;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * Check if all pages in a range are on a set of nodes.
  * If pagelist != NULL then isolate pages from the LRU and
@@ -631,7 +729,9 @@ static int vma_replace_policy(struct vm_area_struct *vma,
 	}
 
 	old = vma->vm_policy;
+	vm_write_begin(vma);
 	vma->vm_policy = new; /* protected by mmap_sem */
+	vm_write_end(vma);
 	mpol_put(old);
 
 	return 0;
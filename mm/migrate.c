@@ -448,6 +448,10 @@ void migrate_page_copy(struct page *newpage, struct page *page)
 		SetPageChecked(newpage);
 	if (PageMappedToDisk(page))
 		SetPageMappedToDisk(newpage);
+	if (PageYoung(page))
+		SetPageYoung(newpage);
+	if (PageIdle(page))
+		SetPageIdle(newpage);
 
 	if (PageDirty(page)) {
 		clear_page_dirty_for_io(page);
@@ -1446,3 +1450,53 @@ int migrate_vmas(struct mm_struct *mm, const nodemask_t *to,
  	return err;
 }
 #endif
+
+#ifdef CONFIG_NUMA_BALANCING
+static struct page *alloc_misplaced_dst_page(struct page *page,
+					   unsigned long data,
+					   int **result)
+{
+	int nid = (int) data;
+
+	return alloc_pages_exact_node(nid, GFP_HIGHUSER_MOVABLE |
+					   GFP_THISNODE | __GFP_NOMEMALLOC |
+					   __GFP_NORETRY | __GFP_NOWARN, 0);
+}
+
+/*
+ * Move a page found by a NUMA hinting fault to the node of the task that
+ * touched it.  Only pages mapped by a single pte are moved, shared pages
+ * would bounce between the nodes of their users.  Hinting faults must not
+ * stall, so the migration is asynchronous and the target node is not
+ * reclaimed from.
+ *
+ * The caller's reference on the page is dropped.  Returns 1 if the page
+ * was migrated.
+ */
+int migrate_misplaced_page(struct page *page, int node)
+{
+	LIST_HEAD(migratepages);
+	int nr_remaining;
+
+	if (page_mapcount(page) != 1 || PageTransHuge(page) ||
+	    isolate_lru_page(page)) {
+		put_page(page);
+		return 0;
+	}
+
+	inc_zone_page_state(page, NR_ISOLATED_ANON + page_is_file_cache(page));
+	list_add(&page->lru, &migratepages);
+	/* The LRU isolation now holds a reference of its own */
+	put_page(page);
+
+	nr_remaining = migrate_pages(&migratepages, alloc_misplaced_dst_page,
+				     node, false, MIGRATE_ASYNC);
+	if (nr_remaining) {
+		putback_lru_pages(&migratepages);
+		return 0;
+	}
+
+	count_vm_event(NUMA_PAGE_MIGRATE);
+	return 1;
+}
+#endif /* CONFIG_NUMA_BALANCING */
@@ -31,6 +31,7 @@
 #include <linux/audit.h>
 #include <linux/khugepaged.h>
 #include <linux/random.h>
+#include <linux/uprobes.h>
 
 #include <asm/uaccess.h>
 #include <asm/cacheflush.h>
@@ -233,6 +234,28 @@ void unlink_file_vma(struct vm_area_struct *vma)
 	}
 }
 
+#ifdef CONFIG_SPECULATIVE_PAGE_FAULT
+static void __free_vma(struct rcu_head *head)
+{
+	struct vm_area_struct *vma;
+
+	vma = container_of(head, struct vm_area_struct, vm_rcu);
+	kmem_cache_free(vm_area_cachep, vma);
+}
+
+/*
+ * Drop a reference on a vma that is no longer linked into its mm.
+ * handle_speculative_fault() may still be looking at it without
+ * mmap_sem: it is freed after a grace period once the last of them
+ * is done with it.
+ */
+void put_vma(struct vm_area_struct *vma)
+{
+	if (atomic_dec_return(&vma->vm_ref_count) < 0)
+		call_rcu(&vma->vm_rcu, __free_vma);
+}
+#endif
+
 /*
  * Close a vm structure and free it, returning the next.
  */
@@ -249,7 +272,7 @@ static struct vm_area_struct *remove_vma(struct vm_area_struct *vma)
 			removed_exe_file_vma(vma->vm_mm);
 	}
 	mpol_put(vma_policy(vma));
-	kmem_cache_free(vm_area_cachep, vma);
+	put_vma(vma);
 	return next;
 }
 
@@ -515,6 +538,7 @@ int vma_adjust(struct vm_area_struct *vma, unsigned long start,
 	long adjust_next = 0;
 	int remove_next = 0;
 
+	vm_write_begin(vma);
 	if (next && !insert) {
 		struct vm_area_struct *exporter = NULL;
 
@@ -558,9 +582,14 @@ again:			remove_next = 1 + (end > next->vm_end);
 			error = anon_vma_clone(importer, exporter);
 			if (error) {
 				importer->anon_vma = NULL;
+				vm_write_end(vma);
 				return error;
 			}
 		}
+
+		/* A next that is removed is left odd for good */
+		if (remove_next || adjust_next)
+			vm_write_begin(next);
 	}
 
 	if (file) {
@@ -646,7 +675,7 @@ again:			remove_next = 1 + (end > next->vm_end);
 			anon_vma_merge(vma, next);
 		mm->map_count--;
 		mpol_put(vma_policy(next));
-		kmem_cache_free(vm_area_cachep, next);
+		put_vma(next);
 		/*
 		 * In mprotect's case 6 (see comments on vma_merge),
 		 * we must remove another next too. It would clutter
@@ -658,6 +687,10 @@ again:			remove_next = 1 + (end > next->vm_end);
 		}
 	}
 
+	if (adjust_next)
+		vm_write_end(next);
+	vm_write_end(vma);
+
 	validate_mm(mm);
 
 	return 0;
@@ -1352,6 +1385,9 @@ out:
 			mm->locked_vm += (len >> PAGE_SHIFT);
 	} else if ((flags & MAP_POPULATE) && !(flags & MAP_NONBLOCK))
 		make_pages_present(addr, addr + len);
+
+	if (file)
+		uprobe_mmap(vma);
 	return addr;
 
 unmap_and_free_vma:
@@ -1840,7 +1876,9 @@ int expand_upwards(struct vm_area_struct *vma, unsigned long address)
 		if (vma->vm_pgoff + (size >> PAGE_SHIFT) >= vma->vm_pgoff) {
 			error = acct_stack_growth(vma, size, grow);
 			if (!error) {
+				vm_write_begin(vma);
 				vma->vm_end = address;
+				vm_write_end(vma);
 				perf_event_mmap(vma);
 			}
 		}
@@ -1890,8 +1928,10 @@ int expand_downwards(struct vm_area_struct *vma,
 		if (grow <= vma->vm_pgoff) {
 			error = acct_stack_growth(vma, size, grow);
 			if (!error) {
+				vm_write_begin(vma);
 				vma->vm_start = address;
 				vma->vm_pgoff -= grow;
+				vm_write_end(vma);
 				perf_event_mmap(vma);
 			}
 		}
@@ -2011,6 +2051,8 @@ detach_vmas_to_be_unmapped(struct mm_struct *mm, struct vm_area_struct *vma,
 	insertion_point = (prev ? &prev->vm_next : &mm->mmap);
 	vma->vm_prev = NULL;
 	do {
+		/* Never ended: the vma is on its way to be freed */
+		vm_write_begin(vma);
 		rb_erase(&vma->vm_rb, &mm->mm_rb);
 		mm->map_count--;
 		tail_vma = vma;
@@ -2049,6 +2091,7 @@ static int __split_vma(struct mm_struct * mm, struct vm_area_struct * vma,
 
 	/* most fields are the same, copy all, and then fixup */
 	*new = *vma;
+	vm_sequence_init(new);
 
 	INIT_LIST_HEAD(&new->anon_vma_chain);
 
@@ -2131,6 +2174,7 @@ int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
 {
 	unsigned long end;
 	struct vm_area_struct *vma, *prev, *last;
+	int error;
 
 	if ((start & ~PAGE_MASK) || start > TASK_SIZE || len > TASK_SIZE-start)
 		return -EINVAL;
@@ -2150,6 +2194,11 @@ int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
 	if (vma->vm_start >= end)
 		return 0;
 
+	/* Page tables shared on fork are dropped whole, or not at all */
+	error = unshare_pte_range(mm, start, end, true);
+	if (error)
+		return error;
+
 	/*
 	 * If we need to split any vma, do it now to save pain later.
 	 *
@@ -2158,8 +2207,6 @@ int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
 	 * places tmp vma above, and higher split_vma places tmp vma below.
 	 */
 	if (start > vma->vm_start) {
-		int error;
-
 		/*
 		 * Make sure that map_count on return from munmap() will
 		 * not exceed its limit; but let map_count go just above
@@ -2177,7 +2224,7 @@ int do_munmap(struct mm_struct *mm, unsigned long start, size_t len)
 	/* Does it split the last one? */
 	last = find_vma(mm, end);
 	if (last && end > last->vm_start) {
-		int error = __split_vma(mm, last, end, 1);
+		error = __split_vma(mm, last, end, 1);
 		if (error)
 			return error;
 	}
@@ -2455,6 +2502,7 @@ struct vm_area_struct *copy_vma(struct vm_area_struct **vmap,
 		new_vma = kmem_cache_alloc(vm_area_cachep, GFP_KERNEL);
 		if (new_vma) {
 			*new_vma = *vma;
+			vm_sequence_init(new_vma);
 			pol = mpol_dup(vma_policy(vma));
 			if (IS_ERR(pol))
 				goto out_free_vma;
@@ -23,6 +23,7 @@
 #include <linux/init.h>
 #include <linux/backing-dev.h>
 #include <linux/task_io_accounting_ops.h>
+#include <linux/delayacct.h>
 #include <linux/blkdev.h>
 #include <linux/mpage.h>
 #include <linux/rmap.h>
@@ -1138,7 +1139,9 @@ pause:
 					  pause,
 					  start_time);
 		__set_current_state(TASK_KILLABLE);
+		delayacct_throttle_start();
 		io_schedule_timeout(pause);
+		delayacct_throttle_end();
 
 		/*
 		 * This is typically equal to (nr_dirty < dirty_thresh) and can
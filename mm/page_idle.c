@@ -0,0 +1,189 @@
+/*
+ * Idle page tracking
+ *
+ * /sys/kernel/mm/page_idle/bitmap has one bit per page frame.  Writing a
+ * 1 bit marks the page idle; reading returns 1 for the pages which are
+ * still idle, i.e. have not been accessed since they were marked.  Only
+ * user memory pages on the LRU lists can be tracked, the bits of all
+ * other pages read as 0 and writes to them are ignored.
+ *
+ * Accesses through page tables are found by clearing the young bits of
+ * the ptes mapping the page when it is marked and testing them when it
+ * is read; other accesses clear PG_idle in mark_page_accessed().  The
+ * young bits taken from reclaim are handed back through PG_young, which
+ * page_referenced() counts, so that idle tracking does not make pages
+ * look cold to reclaim.
+ */
+#include <linux/init.h>
+#include <linux/bootmem.h>
+#include <linux/fs.h>
+#include <linux/sysfs.h>
+#include <linux/kobject.h>
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/pagemap.h>
+#include <linux/rmap.h>
+#include <linux/mm_inline.h>
+
+#define BITMAP_CHUNK_SIZE	sizeof(u64)
+#define BITMAP_CHUNK_BITS	(BITMAP_CHUNK_SIZE * BITS_PER_BYTE)
+
+/*
+ * Idle page tracking only considers user memory pages, for other types of
+ * pages the idle flag is always unset and an attempt to set it is silently
+ * ignored.
+ *
+ * We treat a page as a user memory page if it is on an LRU list, because it
+ * is always safe to pass such a page to page_referenced(), which is
+ * essential for idle page tracking.  Returns the page with a reference
+ * held, or NULL.
+ */
+static struct page *page_idle_get_page(unsigned long pfn)
+{
+	struct page *page;
+	struct zone *zone;
+
+	if (!pfn_valid(pfn))
+		return NULL;
+
+	page = pfn_to_page(pfn);
+	if (!PageLRU(page) || !get_page_unless_zero(page))
+		return NULL;
+
+	zone = page_zone(page);
+	spin_lock_irq(&zone->lru_lock);
+	if (unlikely(!PageLRU(page))) {
+		put_page(page);
+		page = NULL;
+	}
+	spin_unlock_irq(&zone->lru_lock);
+	return page;
+}
+
+/*
+ * Clear the young bits of all ptes mapping @page, clearing PG_idle if any
+ * was set.  Whatever page_referenced() finds is kept for reclaim in
+ * PG_young; a PG_young left by an earlier pass must not count as an
+ * access, so it is taken out of page_referenced()'s sight first.
+ */
+static void page_idle_clear_pte_refs(struct page *page)
+{
+	unsigned long vm_flags;
+	int young;
+
+	young = TestClearPageYoung(page);
+	if (page_referenced(page, 0, NULL, &vm_flags) || young)
+		SetPageYoung(page);
+}
+
+static ssize_t page_idle_bitmap_read(struct file *file, struct kobject *kobj,
+				     struct bin_attribute *attr, char *buf,
+				     loff_t pos, size_t count)
+{
+	u64 *out = (u64 *)buf;
+	struct page *page;
+	unsigned long pfn, end_pfn;
+	int bit;
+
+	if (pos % BITMAP_CHUNK_SIZE || count % BITMAP_CHUNK_SIZE)
+		return -EINVAL;
+
+	pfn = pos * BITS_PER_BYTE;
+	if (pfn >= max_pfn)
+		return 0;
+
+	end_pfn = pfn + count * BITS_PER_BYTE;
+	if (end_pfn > max_pfn)
+		end_pfn = ALIGN(max_pfn, BITMAP_CHUNK_BITS);
+
+	for (; pfn < end_pfn; pfn++) {
+		bit = pfn % BITMAP_CHUNK_BITS;
+		if (!bit)
+			*out = 0ULL;
+		page = page_idle_get_page(pfn);
+		if (page) {
+			if (PageIdle(page)) {
+				/*
+				 * The page might have been referenced via a
+				 * pte, in which case it is not idle.  Clear
+				 * refs and recheck.
+				 */
+				page_idle_clear_pte_refs(page);
+				if (PageIdle(page))
+					*out |= 1ULL << bit;
+			}
+			put_page(page);
+		}
+		if (bit == BITMAP_CHUNK_BITS - 1)
+			out++;
+		cond_resched();
+	}
+	return (char *)out - buf;
+}
+
+static ssize_t page_idle_bitmap_write(struct file *file, struct kobject *kobj,
+				      struct bin_attribute *attr, char *buf,
+				      loff_t pos, size_t count)
+{
+	const u64 *in = (u64 *)buf;
+	struct page *page;
+	unsigned long pfn, end_pfn;
+	int bit;
+
+	if (pos % BITMAP_CHUNK_SIZE || count % BITMAP_CHUNK_SIZE)
+		return -EINVAL;
+
+	pfn = pos * BITS_PER_BYTE;
+	if (pfn >= max_pfn)
+		return -ENXIO;
+
+	end_pfn = pfn + count * BITS_PER_BYTE;
+	if (end_pfn > max_pfn)
+		end_pfn = ALIGN(max_pfn, BITMAP_CHUNK_BITS);
+
+	for (; pfn < end_pfn; pfn++) {
+		bit = pfn % BITMAP_CHUNK_BITS;
+		if ((*in >> bit) & 1) {
+			page = page_idle_get_page(pfn);
+			if (page) {
+				page_idle_clear_pte_refs(page);
+				SetPageIdle(page);
+				put_page(page);
+			}
+		}
+		if (bit == BITMAP_CHUNK_BITS - 1)
+			in++;
+		cond_resched();
+	}
+	return (char *)in - buf;
+}
+
+static struct bin_attribute page_idle_bitmap_attr = {
+	.attr = {
+		.name = "bitmap",
+		.mode = S_IRUSR | S_IWUSR,
+	},
+	.read = page_idle_bitmap_read,
+	.write = page_idle_bitmap_write,
+};
+
+static int __init page_idle_init(void)
+{
+	struct kobject *page_idle_kobj;
+	int err;
+
+	page_idle_kobj = kobject_create_and_add("page_idle", mm_kobj);
+	if (!page_idle_kobj) {
+		printk(KERN_ERR "page_idle: failed to create sysfs kobject\n");
+		return -ENOMEM;
+	}
+
+	err = sysfs_create_bin_file(page_idle_kobj, &page_idle_bitmap_attr);
+	if (err) {
+		printk(KERN_ERR "page_idle: failed to register sysfs file\n");
+		kobject_put(page_idle_kobj);
+		return err;
+	}
+	return 0;
+}
+subsys_initcall(page_idle_init);
@@ -104,6 +104,8 @@ struct pcpu_chunk {
 	int			map_used;	/* # of map entries used */
 	int			map_alloc;	/* # of map entries allocated */
 	int			*map;		/* allocation map */
+	int			first_free;	/* no free map entry below this */
+	int			first_free_off;	/* offset of map[first_free] */
 	void			*data;		/* chunk data */
 	bool			immutable;	/* no [de]population allowed */
 	unsigned long		populated[];	/* populated bitmap */
@@ -481,9 +483,15 @@ static int pcpu_alloc_area(struct pcpu_chunk *chunk, int size, int align)
 {
 	int oslot = pcpu_chunk_slot(chunk);
 	int max_contig = 0;
+	bool seen_free = false;
 	int i, off;
 
-	for (i = 0, off = 0; i < chunk->map_used; off += abs(chunk->map[i++])) {
+	/*
+	 * Everything below first_free is allocated, so starting there
+	 * still scans every free block.
+	 */
+	for (i = chunk->first_free, off = chunk->first_free_off;
+	     i < chunk->map_used; off += abs(chunk->map[i++])) {
 		bool is_last = i + 1 == chunk->map_used;
 		int head, tail;
 
@@ -495,6 +503,7 @@ static int pcpu_alloc_area(struct pcpu_chunk *chunk, int size, int align)
 			continue;
 		if (chunk->map[i] < head + size) {
 			max_contig = max(chunk->map[i], max_contig);
+			seen_free = true;
 			continue;
 		}
 
@@ -540,6 +549,12 @@ static int pcpu_alloc_area(struct pcpu_chunk *chunk, int size, int align)
 			chunk->contig_hint = max(chunk->contig_hint,
 						 max_contig);
 
+		/* allocated the lowest free block without leaving a head? */
+		if (!seen_free && !head) {
+			chunk->first_free = i + 1;
+			chunk->first_free_off = off + chunk->map[i];
+		}
+
 		chunk->free_size -= chunk->map[i];
 		chunk->map[i] = -chunk->map[i];
 
@@ -571,7 +586,13 @@ static void pcpu_free_area(struct pcpu_chunk *chunk, int freeme)
 	int oslot = pcpu_chunk_slot(chunk);
 	int i, off;
 
-	for (i = 0, off = 0; i < chunk->map_used; off += abs(chunk->map[i++]))
+	if (freeme >= chunk->first_free_off) {
+		i = chunk->first_free;
+		off = chunk->first_free_off;
+	} else
+		i = off = 0;
+
+	for (; i < chunk->map_used; off += abs(chunk->map[i++]))
 		if (off == freeme)
 			break;
 	BUG_ON(off != freeme);
@@ -582,6 +603,7 @@ static void pcpu_free_area(struct pcpu_chunk *chunk, int freeme)
 
 	/* merge with previous? */
 	if (i > 0 && chunk->map[i - 1] >= 0) {
+		off -= chunk->map[i - 1];
 		chunk->map[i - 1] += chunk->map[i];
 		chunk->map_used--;
 		memmove(&chunk->map[i], &chunk->map[i + 1],
@@ -596,6 +618,11 @@ static void pcpu_free_area(struct pcpu_chunk *chunk, int freeme)
 			(chunk->map_used - (i + 1)) * sizeof(chunk->map[0]));
 	}
 
+	if (i < chunk->first_free) {
+		chunk->first_free = i;
+		chunk->first_free_off = off;
+	}
+
 	chunk->contig_hint = max(chunk->map[i], chunk->contig_hint);
 	pcpu_chunk_relocate(chunk, oslot);
 }
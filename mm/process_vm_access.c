@@ -21,6 +21,29 @@
 #include <linux/compat.h>
 #endif
 
+/*
+ * Returns how many of the @nr_pages pinned pages starting at @pages can be
+ * copied through a single mapping.  Lowmem pages with consecutive pfns are
+ * contiguous in the kernel direct map, which is what the subpages of a
+ * transparent huge page look like, so a THP backed range is copied in
+ * huge page sized pieces instead of one page at a time.  Highmem pages
+ * have to be kmapped one by one.
+ */
+static unsigned int process_vm_contig_pages(struct page **pages,
+					    unsigned int nr_pages)
+{
+	unsigned long pfn = page_to_pfn(pages[0]);
+	unsigned int i;
+
+	if (PageHighMem(pages[0]))
+		return 1;
+
+	for (i = 1; i < nr_pages; i++)
+		if (page_to_pfn(pages[i]) != pfn + i || PageHighMem(pages[i]))
+			break;
+	return i;
+}
+
 /**
  * process_vm_rw_pages - read/write pages from task specified
  * @task: task to read/write from
@@ -60,6 +83,8 @@ static int process_vm_rw_pages(struct task_struct *task,
 	int ret;
 	ssize_t bytes_to_copy;
 	ssize_t rc = 0;
+	unsigned long offset, end;
+	unsigned int pg, run;
 
 	*bytes_copied = 0;
 
@@ -75,10 +100,17 @@ static int process_vm_rw_pages(struct task_struct *task,
 		goto end;
 	}
 
-	/* Do the copy for each page */
-	for (pgs_copied = 0;
-	     (pgs_copied < nr_pages_to_copy) && (*lvec_current < lvec_cnt);
-	     pgs_copied++) {
+	/*
+	 * Do the copy.  offset runs over the pinned pages as if they were
+	 * one buffer starting at pa; each step copies the smallest of:
+	 * - bytes remaining in the run of pages that can be copied at once
+	 * - bytes remaining to be copied
+	 * - bytes remaining in destination iovec
+	 */
+	offset = start_offset;
+	end = min(start_offset + len,
+		  (unsigned long)nr_pages_to_copy << PAGE_SHIFT);
+	while (offset < end && *lvec_current < lvec_cnt) {
 		/* Make sure we have a non zero length iovec */
 		while (*lvec_current < lvec_cnt
 		       && lvec[*lvec_current].iov_len == 0)
@@ -86,18 +118,18 @@ static int process_vm_rw_pages(struct task_struct *task,
 		if (*lvec_current == lvec_cnt)
 			break;
 
-		/*
-		 * Will copy smallest of:
-		 * - bytes remaining in page
-		 * - bytes remaining in destination iovec
-		 */
-		bytes_to_copy = min_t(ssize_t, PAGE_SIZE - start_offset,
-				      len - *bytes_copied);
+		pg = offset >> PAGE_SHIFT;
+		run = process_vm_contig_pages(process_pages + pg,
+					      nr_pages_to_copy - pg);
+		bytes_to_copy = min_t(ssize_t,
+				      ((unsigned long)run << PAGE_SHIFT)
+				      - (offset & ~PAGE_MASK),
+				      end - offset);
 		bytes_to_copy = min_t(ssize_t, bytes_to_copy,
 				      lvec[*lvec_current].iov_len
 				      - *lvec_offset);
 
-		target_kaddr = kmap(process_pages[pgs_copied]) + start_offset;
+		target_kaddr = kmap(process_pages[pg]) + (offset & ~PAGE_MASK);
 
 		if (vm_write)
 			ret = copy_from_user(target_kaddr,
@@ -108,28 +140,19 @@ static int process_vm_rw_pages(struct task_struct *task,
 			ret = copy_to_user(lvec[*lvec_current].iov_base
 					   + *lvec_offset,
 					   target_kaddr, bytes_to_copy);
-		kunmap(process_pages[pgs_copied]);
+		kunmap(process_pages[pg]);
+		offset += bytes_to_copy;
+		pgs_copied = DIV_ROUND_UP(offset, PAGE_SIZE);
 		if (ret) {
 			*bytes_copied += bytes_to_copy - ret;
-			pgs_copied++;
 			rc = -EFAULT;
 			goto end;
 		}
 		*bytes_copied += bytes_to_copy;
 		*lvec_offset += bytes_to_copy;
 		if (*lvec_offset == lvec[*lvec_current].iov_len) {
-			/*
-			 * Need to copy remaining part of page into the
-			 * next iovec if there are any bytes left in page
-			 */
 			(*lvec_current)++;
 			*lvec_offset = 0;
-			start_offset = (start_offset + bytes_to_copy)
-				% PAGE_SIZE;
-			if (start_offset)
-				pgs_copied--;
-		} else {
-			start_offset = 0;
 		}
 	}
 
@@ -148,8 +171,14 @@ end:
 	return rc;
 }
 
-/* Maximum number of pages kmalloc'd to hold struct page's during copy */
-#define PVM_MAX_KMALLOC_PAGES (PAGE_SIZE * 2)
+/*
+ * Maximum number of bytes kmalloc'd to hold struct page's during copy.
+ * Each batch is pinned under one mmap_sem hold; 4 pages worth of
+ * pointers covers a few huge pages per get_user_pages() call.  If that
+ * much cannot be had, fall back to PVM_MIN_KMALLOC_PAGES.
+ */
+#define PVM_MAX_KMALLOC_PAGES (PAGE_SIZE * 4)
+#define PVM_MIN_KMALLOC_PAGES PAGE_SIZE
 
 /**
  * process_vm_rw_single_vec - read/write pages from task specified
@@ -161,6 +190,7 @@ end:
  * @lvec_offset: offset in bytes from current iovec iov_base we are up to
  * @process_pages: struct pages area that can store at least
  *  nr_pages_to_copy struct page pointers
+ * @max_pages_per_loop: number of struct page pointers @process_pages holds
  * @mm: mm for task
  * @task: task to read/write from
  * @vm_write: 0 means copy from, 1 means copy to
@@ -174,6 +204,7 @@ static int process_vm_rw_single_vec(unsigned long addr,
 				    unsigned long *lvec_current,
 				    size_t *lvec_offset,
 				    struct page **process_pages,
+				    unsigned long max_pages_per_loop,
 				    struct mm_struct *mm,
 				    struct task_struct *task,
 				    int vm_write,
@@ -186,8 +217,6 @@ static int process_vm_rw_single_vec(unsigned long addr,
 	ssize_t rc = 0;
 	unsigned long nr_pages_copied = 0;
 	unsigned long nr_pages_to_copy;
-	unsigned long max_pages_per_loop = PVM_MAX_KMALLOC_PAGES
-		/ sizeof(struct pages *);
 
 	*bytes_copied = 0;
 
@@ -247,6 +276,8 @@ static ssize_t process_vm_rw_core(pid_t pid, const struct iovec *lvec,
 	struct task_struct *task;
 	struct page *pp_stack[PVM_MAX_PP_ARRAY_COUNT];
 	struct page **process_pages = pp_stack;
+	unsigned long max_pages = PVM_MAX_PP_ARRAY_COUNT;
+	size_t pp_size;
 	struct mm_struct *mm;
 	unsigned long i;
 	ssize_t rc = 0;
@@ -278,13 +309,18 @@ static ssize_t process_vm_rw_core(pid_t pid, const struct iovec *lvec,
 
 	if (nr_pages > PVM_MAX_PP_ARRAY_COUNT) {
 		/* For reliability don't try to kmalloc more than
-		   2 pages worth */
-		process_pages = kmalloc(min_t(size_t, PVM_MAX_KMALLOC_PAGES,
-					      sizeof(struct pages *)*nr_pages),
-					GFP_KERNEL);
+		   4 pages worth, and settle for 1 page if that fails */
+		pp_size = min_t(size_t, PVM_MAX_KMALLOC_PAGES,
+				sizeof(struct page *) * nr_pages);
+		process_pages = kmalloc(pp_size, GFP_KERNEL | __GFP_NOWARN);
+		if (!process_pages && pp_size > PVM_MIN_KMALLOC_PAGES) {
+			pp_size = PVM_MIN_KMALLOC_PAGES;
+			process_pages = kmalloc(pp_size, GFP_KERNEL);
+		}
 
 		if (!process_pages)
 			return -ENOMEM;
+		max_pages = pp_size / sizeof(struct page *);
 	}
 
 	/* Get process information */
@@ -319,7 +355,8 @@ static ssize_t process_vm_rw_core(pid_t pid, const struct iovec *lvec,
 		rc = process_vm_rw_single_vec(
 			(unsigned long)rvec[i].iov_base, rvec[i].iov_len,
 			lvec, liovcnt, &iov_l_curr_idx, &iov_l_curr_offset,
-			process_pages, mm, task, vm_write, &bytes_copied_loop);
+			process_pages, max_pages, mm, task, vm_write,
+			&bytes_copied_loop);
 		bytes_copied += bytes_copied_loop;
 		if (rc != 0) {
 			/* If we have managed to copy any data at all then
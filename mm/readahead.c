@@ -196,8 +196,10 @@ __do_page_cache_readahead(struct address_space *mapping, struct file *filp,
 	 * uptodate then the caller will launch readpage again, and
 	 * will then handle the error.
 	 */
-	if (ret)
+	if (ret) {
 		read_pages(mapping, filp, &page_pool, ret);
+		__add_bdi_stat(mapping->backing_dev_info, BDI_RA_PAGES, ret);
+	}
 	BUG_ON(!list_empty(&page_pool));
 out:
 	return ret;
@@ -337,6 +339,65 @@ static unsigned long get_next_ra_size(struct file_ra_state *ra,
  * it approaches max_readhead.
  */
 
+/*
+ * Interleaved streams.
+ *
+ * One file_ra_state follows one sequential stream.  When several readers
+ * interleave on a single struct file, each of them keeps knocking the
+ * others' window out of the state and every stream degrades to small
+ * context or random reads.  Windows displaced by a new stream are kept
+ * in ra->streams[] and swapped back in when a read continues them.
+ */
+static bool ra_stream_expects(pgoff_t start, unsigned int size,
+			      unsigned int async_size, pgoff_t offset)
+{
+	return size && (offset == start + size - async_size ||
+			offset == start + size);
+}
+
+/*
+ * About to reuse the state for a read at @offset: stash the current
+ * window unless @offset falls into it, i.e. it is the same stream.
+ */
+static void ra_stream_save(struct file_ra_state *ra, pgoff_t offset)
+{
+	struct file_ra_stream *s;
+
+	if (!ra->size || ra_has_index(ra, offset))
+		return;
+
+	s = &ra->streams[ra->stream_next++ % RA_STREAMS];
+	s->start = ra->start;
+	s->size = ra->size;
+	s->async_size = ra->async_size;
+}
+
+/*
+ * Look for a stashed stream expecting a read at @offset and swap it with
+ * the current window.
+ */
+static bool ra_stream_switch(struct file_ra_state *ra, pgoff_t offset)
+{
+	struct file_ra_stream *s, cur;
+	int i;
+
+	for (i = 0; i < RA_STREAMS; i++) {
+		s = &ra->streams[i];
+		if (!ra_stream_expects(s->start, s->size, s->async_size, offset))
+			continue;
+
+		cur.start = ra->start;
+		cur.size = ra->size;
+		cur.async_size = ra->async_size;
+		ra->start = s->start;
+		ra->size = s->size;
+		ra->async_size = s->async_size;
+		*s = cur;
+		return true;
+	}
+	return false;
+}
+
 /*
  * Count contiguously cached pages from @offset-1 to @offset-@max,
  * this count is a conservative estimation of
@@ -383,6 +444,7 @@ static int try_context_readahead(struct address_space *mapping,
 	if (size >= offset)
 		size *= 2;
 
+	ra_stream_save(ra, offset);
 	ra->start = offset;
 	ra->size = get_init_ra_size(size + req_size, max);
 	ra->async_size = ra->size;
@@ -390,6 +452,25 @@ static int try_context_readahead(struct address_space *mapping,
 	return 1;
 }
 
+/*
+ * Readahead limit for @ra: the per-file maximum, raised to the bdi's
+ * auto-tuned window for files still using the bdi default.  Files which
+ * had their window cut down by fadvise or by read_ahead_kb keep it.
+ */
+static unsigned long ra_max_pages(struct address_space *mapping,
+				  struct file_ra_state *ra)
+{
+	struct backing_dev_info *bdi = mapping->backing_dev_info;
+	unsigned long max = ra->ra_pages;
+	unsigned long auto_pages = ACCESS_ONCE(bdi->ra_auto_pages);
+
+	if (max >= bdi->ra_pages) {
+		auto_pages = min(auto_pages, bdi->ra_pages * RA_AUTO_SCALE);
+		max = max(max, auto_pages);
+	}
+	return max_sane_readahead(max);
+}
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
@@ -399,7 +480,7 @@ ondemand_readahead(struct address_space *mapping,
 		   bool hit_readahead_marker, pgoff_t offset,
 		   unsigned long req_size)
 {
-	unsigned long max = max_sane_readahead(ra->ra_pages);
+	unsigned long max = ra_max_pages(mapping, ra);
 
 	/*
 	 * start of file
@@ -410,9 +491,11 @@ ondemand_readahead(struct address_space *mapping,
 	/*
 	 * It's the expected callback offset, assume sequential access.
 	 * Ramp up sizes, and push forward the readahead window.
+	 * The offset may also continue one of the interleaved streams,
+	 * which then becomes the current one.
 	 */
-	if ((offset == (ra->start + ra->size - ra->async_size) ||
-	     offset == (ra->start + ra->size))) {
+	if (ra_stream_expects(ra->start, ra->size, ra->async_size, offset) ||
+	    ra_stream_switch(ra, offset)) {
 		ra->start += ra->size;
 		ra->size = get_next_ra_size(ra, max);
 		ra->async_size = ra->size;
@@ -435,6 +518,7 @@ ondemand_readahead(struct address_space *mapping,
 		if (!start || start - offset > max)
 			return 0;
 
+		ra_stream_save(ra, offset);
 		ra->start = start;
 		ra->size = start - offset;	/* old async_size */
 		ra->size += req_size;
@@ -469,6 +553,7 @@ ondemand_readahead(struct address_space *mapping,
 	return __do_page_cache_readahead(mapping, filp, offset, req_size, 0);
 
 initial_readahead:
+	ra_stream_save(ra, offset);
 	ra->start = offset;
 	ra->size = get_init_ra_size(req_size, max);
 	ra->async_size = ra->size > req_size ? ra->size - req_size : ra->size;
@@ -500,23 +585,28 @@ readit:
  * it will submit the read.  The readahead logic may decide to piggyback more
  * pages onto the read request if access patterns suggest it will improve
  * performance.
+ *
+ * Returns the number of pages submitted by the readahead window, for use
+ * with bdi_update_read_bandwidth().
  */
-void page_cache_sync_readahead(struct address_space *mapping,
+unsigned long page_cache_sync_readahead(struct address_space *mapping,
 			       struct file_ra_state *ra, struct file *filp,
 			       pgoff_t offset, unsigned long req_size)
 {
 	/* no read-ahead */
 	if (!ra->ra_pages)
-		return;
+		return 0;
+
+	__inc_bdi_stat(mapping->backing_dev_info, BDI_RA_MISS);
 
 	/* be dumb */
 	if (filp && (filp->f_mode & FMODE_RANDOM)) {
 		force_page_cache_readahead(mapping, filp, offset, req_size);
-		return;
+		return 0;
 	}
 
 	/* do read-ahead */
-	ondemand_readahead(mapping, ra, filp, false, offset, req_size);
+	return ondemand_readahead(mapping, ra, filp, false, offset, req_size);
 }
 EXPORT_SYMBOL_GPL(page_cache_sync_readahead);
 
@@ -559,7 +649,62 @@ page_cache_async_readahead(struct address_space *mapping,
 	if (bdi_read_congested(mapping->backing_dev_info))
 		return;
 
+	__inc_bdi_stat(mapping->backing_dev_info, BDI_RA_HIT);
+
 	/* do read-ahead */
 	ondemand_readahead(mapping, ra, filp, true, offset, req_size);
 }
 EXPORT_SYMBOL_GPL(page_cache_async_readahead);
+
+/*
+ * Small reads mostly measure the device's request latency, large ones
+ * its streaming bandwidth.
+ */
+#define RA_LATENCY_PAGES	4
+#define RA_BANDWIDTH_PAGES	32
+
+/**
+ * bdi_update_read_bandwidth - feed back a synchronous readahead wait
+ * @bdi: the device the pages were read from
+ * @nr_pages: pages submitted by page_cache_sync_readahead()
+ * @wait_us: time from submission until the first page was uptodate
+ *
+ * Keeps running averages of the read latency and bandwidth of @bdi and
+ * derives ra_auto_pages from them: a window of about four latencies worth
+ * of transfer keeps the device streaming rather than waiting on requests.
+ * Updates are racy; the estimates only need to be roughly right.
+ */
+void bdi_update_read_bandwidth(struct backing_dev_info *bdi,
+				unsigned long nr_pages, s64 wait_us)
+{
+	unsigned long latency, bandwidth, old;
+	u64 window;
+
+	if (wait_us <= 0)
+		wait_us = 1;
+
+	if (nr_pages <= RA_LATENCY_PAGES) {
+		old = ACCESS_ONCE(bdi->ra_latency);
+		latency = min_t(s64, wait_us, ULONG_MAX);
+		if (old)
+			latency = (old * 7 + latency) / 8;
+		bdi->ra_latency = latency;
+	} else if (nr_pages >= RA_BANDWIDTH_PAGES) {
+		old = ACCESS_ONCE(bdi->ra_bandwidth);
+		bandwidth = div64_u64((u64)nr_pages * USEC_PER_SEC, wait_us);
+		if (old)
+			bandwidth = (old * 7 + bandwidth) / 8;
+		bdi->ra_bandwidth = bandwidth;
+	} else
+		return;
+
+	latency = ACCESS_ONCE(bdi->ra_latency);
+	bandwidth = ACCESS_ONCE(bdi->ra_bandwidth);
+	if (!latency || !bandwidth)
+		return;
+
+	window = div_u64((u64)4 * latency * bandwidth, USEC_PER_SEC);
+	window = clamp_t(u64, window, bdi->ra_pages,
+			 bdi->ra_pages * RA_AUTO_SCALE);
+	bdi->ra_auto_pages = window;
+}
@@ -618,7 +618,7 @@ pte_t *__page_check_address(struct page *page, struct mm_struct *mm,
 {
 	pgd_t *pgd;
 	pud_t *pud;
-	pmd_t *pmd;
+	pmd_t *pmd, pmde;
 	pte_t *pte;
 	spinlock_t *ptl;
 
@@ -629,6 +629,7 @@ pte_t *__page_check_address(struct page *page, struct mm_struct *mm,
 			return NULL;
 
 		ptl = &mm->page_table_lock;
+		spin_lock(ptl);
 		goto check;
 	}
 
@@ -641,21 +642,28 @@ pte_t *__page_check_address(struct page *page, struct mm_struct *mm,
 		return NULL;
 
 	pmd = pmd_offset(pud, address);
-	if (!pmd_present(*pmd))
+	pmde = *pmd;
+	barrier();
+	if (!pmd_present(pmde))
 		return NULL;
-	if (pmd_trans_huge(*pmd))
+	if (pmd_trans_huge(pmde))
 		return NULL;
 
-	pte = pte_offset_map(pmd, address);
+	pte = pte_offset_map(&pmde, address);
 	/* Make a quick check before getting the lock */
 	if (!sync && !pte_present(*pte)) {
 		pte_unmap(pte);
 		return NULL;
 	}
 
-	ptl = pte_lockptr(mm, pmd);
-check:
+	ptl = pte_lockptr(mm, &pmde);
 	spin_lock(ptl);
+	/* a page table shared on fork is only walked through its owner */
+	if (unlikely(!pte_table_owner(mm, pmd, pmde))) {
+		pte_unmap_unlock(pte, ptl);
+		return NULL;
+	}
+check:
 	if (pte_present(*pte) && page_to_pfn(page) == pte_pfn(*pte)) {
 		*ptlp = ptl;
 		return pte;
@@ -921,6 +929,11 @@ int page_referenced(struct page *page,
 			referenced++;
 	}
 out:
+	/* Keep idle page tracking and reclaim from hiding accesses to each other */
+	if (referenced)
+		ClearPageIdle(page);
+	if (TestClearPageYoung(page))
+		referenced++;
 	return referenced;
 }
 
@@ -1255,9 +1268,16 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 		}
   	}
 
+	/* Written to since MADV_FREE, so it has to be swapped out after all */
+	if ((flags & TTU_LAZYFREE) && (pte_dirty(*pte) || PageDirty(page))) {
+		ret = SWAP_DIRTY;
+		goto out_unmap;
+	}
+
 	/* Nuke the page table entry. */
 	flush_cache_page(vma, address, page_to_pfn(page));
 	pteval = ptep_clear_flush_notify(vma, address, pte);
+	flush_shared_pte_table(mm, address);
 
 	/* Move the dirty bit to the physical page now the pte is gone. */
 	if (pte_dirty(pteval))
@@ -1276,6 +1296,17 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else if (PageAnon(page)) {
 		swp_entry_t entry = { .val = page_private(page) };
 
+		if (flags & TTU_LAZYFREE) {
+			/* Lost a race with a write through another TLB */
+			if (PageDirty(page)) {
+				set_pte_at(mm, address, pte, pteval);
+				ret = SWAP_DIRTY;
+				goto out_unmap;
+			}
+			dec_mm_counter(mm, MM_ANONPAGES);
+			goto discard;
+		}
+
 		if (PageSwapCache(page)) {
 			/*
 			 * Store the swap location in the pte.
@@ -1313,6 +1344,7 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else
 		dec_mm_counter(mm, MM_FILEPAGES);
 
+discard:
 	page_remove_rmap(page);
 	page_cache_release(page);
 
@@ -63,6 +63,7 @@ static struct vfsmount *shm_mnt;
 #include <linux/highmem.h>
 #include <linux/seq_file.h>
 #include <linux/magic.h>
+#include <linux/khugepaged.h>
 
 #include <asm/uaccess.h>
 #include <asm/pgtable.h>
@@ -100,8 +101,44 @@ enum sgp_type {
 	SGP_CACHE,	/* don't exceed i_size, may allocate page */
 	SGP_DIRTY,	/* like SGP_CACHE, but set new page dirty */
 	SGP_WRITE,	/* may exceed i_size, may allocate page */
+	SGP_HUGE,	/* like SGP_CACHE, but may allocate a huge extent */
 };
 
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+/*
+ * Definitions for the huge= mount option of tmpfs:
+ *
+ * SHMEM_HUGE_NEVER:
+ *	disables huge pages for the mount;
+ * SHMEM_HUGE_ALWAYS:
+ *	allocates the page cache in huge extents wherever possible;
+ * SHMEM_HUGE_WITHIN_SIZE:
+ *	only allocates a huge extent if it lies fully within i_size,
+ *	or if it is for a madvise(MADV_HUGEPAGE) mapping;
+ * SHMEM_HUGE_ADVISE:
+ *	only allocates huge extents for madvise(MADV_HUGEPAGE) mappings.
+ */
+#define SHMEM_HUGE_NEVER	0
+#define SHMEM_HUGE_ALWAYS	1
+#define SHMEM_HUGE_WITHIN_SIZE	2
+#define SHMEM_HUGE_ADVISE	3
+
+/*
+ * Special values, which can only be written to
+ * /sys/kernel/mm/transparent_hugepage/shmem_enabled:
+ *
+ * SHMEM_HUGE_DENY:
+ *	disables huge pages on all mounts, for emergency use;
+ * SHMEM_HUGE_FORCE:
+ *	enables huge pages on all mounts without the option, for testing.
+ */
+#define SHMEM_HUGE_DENY		(-1)
+#define SHMEM_HUGE_FORCE	(-2)
+
+/* policy of the internal mount, and of all mounts if DENY or FORCE */
+static int shmem_huge __read_mostly;
+#endif
+
 #ifdef CONFIG_TMPFS
 static unsigned long shmem_default_max_blocks(void)
 {
@@ -153,10 +190,10 @@ static inline void shmem_unacct_size(unsigned long flags, loff_t size)
  * shmem_getpage reports shmem_acct_block failure as -ENOSPC not -ENOMEM,
  * so that a failure on a sparse tmpfs mapping will give SIGBUS not OOM.
  */
-static inline int shmem_acct_block(unsigned long flags)
+static inline int shmem_acct_block(unsigned long flags, long pages)
 {
 	return (flags & VM_NORESERVE) ?
-		security_vm_enough_memory_kern(VM_ACCT(PAGE_CACHE_SIZE)) : 0;
+		security_vm_enough_memory_kern(pages * VM_ACCT(PAGE_CACHE_SIZE)) : 0;
 }
 
 static inline void shmem_unacct_blocks(unsigned long flags, long pages)
@@ -327,19 +364,19 @@ static unsigned shmem_find_get_pages_and_swap(struct address_space *mapping,
 					pgoff_t start, unsigned int nr_pages,
 					struct page **pages, pgoff_t *indices)
 {
-	unsigned int i;
-	unsigned int ret;
-	unsigned int nr_found;
+	struct radix_tree_iter iter;
+	void **slot;
+	unsigned int ret = 0;
+
+	if (unlikely(!nr_pages))
+		return 0;
 
 	rcu_read_lock();
 restart:
-	nr_found = radix_tree_gang_lookup_slot(&mapping->page_tree,
-				(void ***)pages, indices, start, nr_pages);
-	ret = 0;
-	for (i = 0; i < nr_found; i++) {
+	radix_tree_for_each_slot(slot, &mapping->page_tree, &iter, start) {
 		struct page *page;
 repeat:
-		page = radix_tree_deref_slot((void **)pages[i]);
+		page = radix_tree_deref_slot(slot);
 		if (unlikely(!page))
 			continue;
 		if (radix_tree_exception(page)) {
@@ -356,17 +393,16 @@ repeat:
 			goto repeat;
 
 		/* Has the page moved? */
-		if (unlikely(page != *((void **)pages[i]))) {
+		if (unlikely(page != *slot)) {
 			page_cache_release(page);
 			goto repeat;
 		}
 export:
-		indices[ret] = indices[i];
+		indices[ret] = iter.index;
 		pages[ret] = page;
-		ret++;
+		if (++ret == nr_pages)
+			break;
 	}
-	if (unlikely(!ret && nr_found))
-		goto restart;
 	rcu_read_unlock();
 	return ret;
 }
@@ -878,6 +914,224 @@ static inline struct mempolicy *shmem_get_sbmpol(struct shmem_sb_info *sbinfo)
 }
 #endif
 
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+/*
+ * Huge tmpfs keeps its page cache in small pages, as everywhere else: but
+ * where the policy allows, the HPAGE_PMD_NR pages of a naturally aligned
+ * extent of the file are allocated together as one split huge page, so
+ * that shmem_pmd_fault() can then map them with a single pmd.  Anything
+ * which works on the page cache keeps seeing small pages: truncation,
+ * swapout or migration of any one of them just breaks up the extent,
+ * rather than having to split a compound page.
+ */
+static int shmem_parse_huge(const char *str)
+{
+	if (!strcmp(str, "never"))
+		return SHMEM_HUGE_NEVER;
+	if (!strcmp(str, "always"))
+		return SHMEM_HUGE_ALWAYS;
+	if (!strcmp(str, "within_size"))
+		return SHMEM_HUGE_WITHIN_SIZE;
+	if (!strcmp(str, "advise"))
+		return SHMEM_HUGE_ADVISE;
+	if (!strcmp(str, "deny"))
+		return SHMEM_HUGE_DENY;
+	if (!strcmp(str, "force"))
+		return SHMEM_HUGE_FORCE;
+	return -EINVAL;
+}
+
+static const char *shmem_format_huge(int huge)
+{
+	switch (huge) {
+	case SHMEM_HUGE_NEVER:
+		return "never";
+	case SHMEM_HUGE_ALWAYS:
+		return "always";
+	case SHMEM_HUGE_WITHIN_SIZE:
+		return "within_size";
+	case SHMEM_HUGE_ADVISE:
+		return "advise";
+	case SHMEM_HUGE_DENY:
+		return "deny";
+	case SHMEM_HUGE_FORCE:
+		return "force";
+	default:
+		VM_BUG_ON(1);
+		return "bad_val";
+	}
+}
+
+/*
+ * May the file have huge extents, up to byte offset end of it?  advised
+ * is set when asked for by a madvise(MADV_HUGEPAGE) mapping.
+ */
+static bool shmem_huge_policy(struct inode *inode, loff_t end, bool advised)
+{
+	if (shmem_huge == SHMEM_HUGE_DENY)
+		return false;
+	if (shmem_huge == SHMEM_HUGE_FORCE)
+		return true;
+
+	switch (SHMEM_SB(inode->i_sb)->huge) {
+	case SHMEM_HUGE_ALWAYS:
+		return true;
+	case SHMEM_HUGE_WITHIN_SIZE:
+		if (end <= round_up(i_size_read(inode), PAGE_CACHE_SIZE))
+			return true;
+		/* fall through */
+	case SHMEM_HUGE_ADVISE:
+		return advised;
+	default:
+		return false;
+	}
+}
+
+/*
+ * Could huge pmds map this shmem vma?  Only shared mappings get them: a
+ * private one would have to COW the extent, and instead keeps its ptes.
+ */
+bool shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+
+	if (!(vma->vm_flags & VM_SHARED) ||
+	    (vma->vm_flags & (VM_NOHUGEPAGE | VM_LOCKED | VM_NONLINEAR)))
+		return false;
+	return shmem_huge_policy(inode, HPAGE_PMD_SIZE,
+				 vma->vm_flags & VM_HUGEPAGE);
+}
+
+static struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+#ifdef CONFIG_NUMA
+	struct vm_area_struct pvma;
+	struct page *page;
+
+	/* Create a pseudo vma that just contains the policy */
+	pvma.vm_start = 0;
+	pvma.vm_pgoff = index;
+	pvma.vm_ops = NULL;
+	pvma.vm_policy = mpol_shared_policy_lookup(&info->policy, index);
+
+	page = alloc_pages_vma(gfp, HPAGE_PMD_ORDER, &pvma, 0,
+			       numa_node_id());
+
+	/* Drop reference taken by mpol_shared_policy_lookup() */
+	mpol_cond_put(pvma.vm_policy);
+
+	return page;
+#else
+	return alloc_pages(gfp, HPAGE_PMD_ORDER);
+#endif
+}
+
+/*
+ * Allocate the whole empty huge extent around index at once, leaving all
+ * but the page at index unlocked in the page cache.  Returns that page
+ * locked, or NULL when the caller should allocate just the one page:
+ * when something is already cached or swapped in the extent, or when no
+ * huge page is to be had quickly.
+ */
+static struct page *shmem_alloc_huge_extent(struct inode *inode,
+					    pgoff_t index, gfp_t gfp)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+	pgoff_t hindex = round_down(index, HPAGE_PMD_NR);
+	gfp_t huge_gfp;
+	struct page *page;
+	unsigned long found;
+	void **slot;
+	int error = 0;
+	int i, nr;
+
+	if (hindex + HPAGE_PMD_NR - 1 > (MAX_LFS_FILESIZE >> PAGE_CACHE_SHIFT))
+		return NULL;
+
+	rcu_read_lock();
+	nr = radix_tree_gang_lookup_slot(&mapping->page_tree, &slot, &found,
+					 hindex, 1);
+	rcu_read_unlock();
+	if (nr && found < hindex + HPAGE_PMD_NR)
+		return NULL;
+
+	if (shmem_acct_block(info->flags, HPAGE_PMD_NR))
+		return NULL;
+	if (sbinfo->max_blocks) {
+		if (sbinfo->max_blocks < HPAGE_PMD_NR ||
+		    percpu_counter_compare(&sbinfo->used_blocks,
+				sbinfo->max_blocks - HPAGE_PMD_NR) > 0)
+			goto unacct;
+		percpu_counter_add(&sbinfo->used_blocks, HPAGE_PMD_NR);
+	}
+
+	/* small pages will do: don't try hard, unless defrag is wanted */
+	huge_gfp = gfp | __GFP_NORETRY | __GFP_NOWARN | __GFP_NOMEMALLOC |
+		   __GFP_NO_KSWAPD;
+	if (!(transparent_hugepage_flags &
+	      (1 << TRANSPARENT_HUGEPAGE_DEFRAG_FLAG)))
+		huge_gfp &= ~__GFP_WAIT;
+
+	page = shmem_alloc_hugepage(huge_gfp, info, hindex);
+	if (!page)
+		goto decused;
+	count_vm_event(THP_FILE_ALLOC);
+	split_page(page, HPAGE_PMD_ORDER);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		SetPageSwapBacked(page + i);
+		__set_page_locked(page + i);
+	}
+	for (nr = 0; nr < HPAGE_PMD_NR; nr++) {
+		error = mem_cgroup_cache_charge(page + nr, current->mm,
+						gfp & GFP_RECLAIM_MASK);
+		if (!error)
+			error = shmem_add_to_page_cache(page + nr, mapping,
+						hindex + nr, gfp, NULL);
+		if (error)
+			break;
+	}
+	if (error) {
+		/* Raced with another allocation in the extent, or no memcg room */
+		for (i = 0; i < nr; i++)
+			delete_from_page_cache(page + i);
+		for (i = 0; i < HPAGE_PMD_NR; i++) {
+			__clear_page_locked(page + i);
+			page_cache_release(page + i);
+		}
+		goto decused;
+	}
+
+	spin_lock(&info->lock);
+	info->alloced += HPAGE_PMD_NR;
+	inode->i_blocks += BLOCKS_PER_PAGE * HPAGE_PMD_NR;
+	shmem_recalc_inode(inode);
+	spin_unlock(&info->lock);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		lru_cache_add_anon(page + i);
+		clear_highpage(page + i);
+		flush_dcache_page(page + i);
+		SetPageUptodate(page + i);
+		if (hindex + i != index) {
+			unlock_page(page + i);
+			page_cache_release(page + i);
+		}
+	}
+	return page + (index - hindex);
+
+decused:
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, -HPAGE_PMD_NR);
+unacct:
+	shmem_unacct_blocks(info->flags, HPAGE_PMD_NR);
+	return NULL;
+}
+#endif /* CONFIG_TRANSPARENT_HUGE_PAGECACHE */
+
 /*
  * shmem_getpage_gfp - find page in cache, or get from swap, or allocate
  *
@@ -979,7 +1233,20 @@ repeat:
 		swap_free(swap);
 
 	} else {
-		if (shmem_acct_block(info->flags)) {
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+		pgoff_t hend = round_down(index, HPAGE_PMD_NR) + HPAGE_PMD_NR;
+
+		if (sgp == SGP_HUGE || shmem_huge_policy(inode,
+				(loff_t)hend << PAGE_CACHE_SHIFT, false)) {
+			page = shmem_alloc_huge_extent(inode, index, gfp);
+			if (page) {
+				if (sgp == SGP_DIRTY)
+					set_page_dirty(page);
+				goto done;
+			}
+		}
+#endif
+		if (shmem_acct_block(info->flags, 1)) {
 			error = -ENOSPC;
 			goto failed;
 		}
@@ -1145,6 +1412,186 @@ static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	return ret;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+/*
+ * Map a huge extent of the page cache with a pmd, if the huge page aligned
+ * range around address is one: otherwise leave it to shmem_fault() to map
+ * a pte.  The pmd holds a reference on, and a mapcount of, each of the
+ * HPAGE_PMD_NR pages, so that truncation and reclaim see them as mapped.
+ */
+static int shmem_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd, unsigned int flags)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	struct address_space *mapping = inode->i_mapping;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pgoff_t hindex = linear_page_index(vma, haddr);
+	struct page *page;
+	int error, i, nr;
+	int ret = 0;
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end ||
+	    (hindex & (HPAGE_PMD_NR - 1)) || !shmem_huge_enabled(vma))
+		return VM_FAULT_FALLBACK;
+	/* a hole is being punched: let shmem_fault() wait for it */
+	if (unlikely(inode->i_private))
+		return VM_FAULT_FALLBACK;
+	/* nor may a pmd reach beyond i_size, where a pte fault gives SIGBUS */
+	if (((loff_t)(hindex + HPAGE_PMD_NR) << PAGE_CACHE_SHIFT) >
+	    i_size_read(inode))
+		return VM_FAULT_FALLBACK;
+
+	error = shmem_getpage(inode, hindex, &page, SGP_HUGE, &ret);
+	if (error)
+		return VM_FAULT_FALLBACK;
+
+	if (ret & VM_FAULT_MAJOR) {
+		count_vm_event(PGMAJFAULT);
+		mem_cgroup_count_vm_event(vma->vm_mm, PGMAJFAULT);
+	}
+
+	/*
+	 * The first page is locked: trylock the rest, in index order, and
+	 * check that they are still the page cache of the extent.
+	 */
+	nr = 1;
+	if (!(page_to_pfn(page) & (HPAGE_PMD_NR - 1))) {
+		for (; nr < HPAGE_PMD_NR; nr++) {
+			struct page *subpage = page + nr;
+
+			if (!get_page_unless_zero(subpage))
+				break;
+			if (!trylock_page(subpage)) {
+				put_page(subpage);
+				break;
+			}
+			if (subpage->mapping != mapping ||
+			    subpage->index != hindex + nr ||
+			    !PageUptodate(subpage)) {
+				unlock_page(subpage);
+				put_page(subpage);
+				break;
+			}
+		}
+	}
+
+	error = -EAGAIN;
+	if (nr == HPAGE_PMD_NR)
+		error = do_huge_pmd_file_map(vma, haddr, pmd, page);
+	if (!error) {
+		/* the references are the pmd's now */
+		for (i = 0; i < HPAGE_PMD_NR; i++)
+			unlock_page(page + i);
+		return ret;
+	}
+
+	for (i = 0; i < nr; i++) {
+		unlock_page(page + i);
+		page_cache_release(page + i);
+	}
+	/* -EBUSY: a racing fault has just mapped the pmd itself */
+	return error == -EBUSY ? ret : VM_FAULT_FALLBACK;
+}
+
+/*
+ * Called by khugepaged, without mmap_sem, to turn the small pages cached
+ * in the huge page aligned extent of the file at index into one extent
+ * which shmem_pmd_fault() can map, by copying them all into a huge page.
+ * Gives up (and khugepaged tries again on a later scan) if there is a
+ * hole in the extent, or a page swapped out, mapped or otherwise in use.
+ * Returns 0 if the page cache of the extent is now a huge extent.
+ */
+int shmem_collapse_huge_extent(struct address_space *mapping, pgoff_t index)
+{
+	struct inode *inode = mapping->host;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct page *page, *old;
+	int error = -EBUSY;
+	int i, nr = 0;
+
+	VM_BUG_ON(index & (HPAGE_PMD_NR - 1));
+
+	if (((loff_t)(index + HPAGE_PMD_NR) << PAGE_CACHE_SHIFT) >
+	    i_size_read(inode))
+		return -EINVAL;
+
+	/* Is it a huge extent already? */
+	old = find_get_page(mapping, index);
+	if (old && !radix_tree_exceptional_entry(old)) {
+		unsigned long pfn = page_to_pfn(old);
+
+		page_cache_release(old);
+		if (!(pfn & (HPAGE_PMD_NR - 1))) {
+			for (i = 1; i < HPAGE_PMD_NR; i++) {
+				old = find_get_page(mapping, index + i);
+				if (!old || radix_tree_exceptional_entry(old))
+					break;
+				page_cache_release(old);
+				if (page_to_pfn(old) != pfn + i)
+					break;
+			}
+			if (i == HPAGE_PMD_NR)
+				return 0;
+		}
+	}
+
+	page = shmem_alloc_hugepage(mapping_gfp_mask(mapping) |
+			__GFP_NORETRY | __GFP_NOWARN | __GFP_NO_KSWAPD,
+			info, index);
+	if (!page) {
+		count_vm_event(THP_COLLAPSE_ALLOC_FAILED);
+		return -ENOMEM;
+	}
+	count_vm_event(THP_COLLAPSE_ALLOC);
+	split_page(page, HPAGE_PMD_ORDER);
+
+	/* the pages must not be mapped, nor sitting in a pagevec */
+	lru_add_drain();
+	unmap_mapping_range(mapping, (loff_t)index << PAGE_CACHE_SHIFT,
+			    HPAGE_PMD_SIZE, 0);
+
+	for (; nr < HPAGE_PMD_NR; nr++) {
+		struct page *new = page + nr;
+
+		old = find_lock_page(mapping, index + nr);
+		if (!old || radix_tree_exceptional_entry(old))
+			break;
+		/* one reference from the page cache, one from us */
+		if (page_mapped(old) || page_count(old) != 2) {
+			unlock_page(old);
+			page_cache_release(old);
+			break;
+		}
+
+		copy_highpage(new, old);
+		SetPageSwapBacked(new);
+		__set_page_locked(new);
+		SetPageUptodate(new);
+		if (replace_page_cache_page(old, new, GFP_KERNEL)) {
+			__clear_page_locked(new);
+			unlock_page(old);
+			page_cache_release(old);
+			break;
+		}
+		set_page_dirty(new);
+		lru_cache_add_anon(new);
+		unlock_page(new);
+		page_cache_release(new);
+
+		ClearPageDirty(old);
+		unlock_page(old);
+		page_cache_release(old);
+	}
+	if (nr == HPAGE_PMD_NR)
+		error = 0;
+
+	/* What was not copied is freed: what was stays behind as small pages */
+	for (i = nr; i < HPAGE_PMD_NR; i++)
+		put_page(page + i);
+	return error;
+}
+#endif /* CONFIG_TRANSPARENT_HUGE_PAGECACHE */
+
 int vmtruncate_range(struct inode *inode, loff_t lstart, loff_t lend)
 {
 	/*
@@ -1234,9 +1681,71 @@ static int shmem_mmap(struct file *file, struct vm_area_struct *vma)
 	file_accessed(file);
 	vma->vm_ops = &shmem_vm_ops;
 	vma->vm_flags |= VM_CAN_NONLINEAR;
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+	if (shmem_huge_enabled(vma) && khugepaged_enter(vma, vma->vm_flags))
+		return -ENOMEM;
+#endif
 	return 0;
 }
 
+bool vma_is_shmem(struct vm_area_struct *vma)
+{
+	return vma->vm_ops == &shmem_vm_ops;
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+/*
+ * Place a shared mapping which may get huge pmds so that its file offset
+ * and its address agree modulo HPAGE_PMD_SIZE: otherwise no extent of the
+ * file could ever be mapped huge.  Done by asking for a larger area and
+ * then picking the right alignment inside it.
+ */
+static unsigned long shmem_get_unmapped_area(struct file *file,
+		unsigned long uaddr, unsigned long len,
+		unsigned long pgoff, unsigned long flags)
+{
+	unsigned long addr, offset, inflated_len;
+	unsigned long inflated_addr, inflated_offset;
+
+	addr = current->mm->get_unmapped_area(file, uaddr, len, pgoff, flags);
+	if (IS_ERR_VALUE(addr) || (addr & ~PAGE_MASK))
+		return addr;
+	if (addr > TASK_SIZE - len || len < HPAGE_PMD_SIZE)
+		return addr;
+	if ((flags & MAP_FIXED) || !(flags & MAP_SHARED) || addr == uaddr)
+		return addr;
+	if (shmem_huge == SHMEM_HUGE_DENY)
+		return addr;
+	if (shmem_huge != SHMEM_HUGE_FORCE &&
+	    SHMEM_SB(file->f_path.dentry->d_sb)->huge == SHMEM_HUGE_NEVER)
+		return addr;
+
+	offset = (pgoff << PAGE_SHIFT) & (HPAGE_PMD_SIZE - 1);
+	if (offset && offset + len < 2 * HPAGE_PMD_SIZE)
+		return addr;
+	if ((addr & (HPAGE_PMD_SIZE - 1)) == offset)
+		return addr;
+
+	inflated_len = len + HPAGE_PMD_SIZE - PAGE_SIZE;
+	if (inflated_len > TASK_SIZE || inflated_len < len)
+		return addr;
+
+	inflated_addr = current->mm->get_unmapped_area(NULL, 0, inflated_len,
+						       0, flags);
+	if (IS_ERR_VALUE(inflated_addr) || (inflated_addr & ~PAGE_MASK))
+		return addr;
+
+	inflated_offset = inflated_addr & (HPAGE_PMD_SIZE - 1);
+	inflated_addr += offset - inflated_offset;
+	if (inflated_offset > offset)
+		inflated_addr += HPAGE_PMD_SIZE;
+
+	if (inflated_addr > TASK_SIZE - len)
+		return addr;
+	return inflated_addr;
+}
+#endif
+
 static struct inode *shmem_get_inode(struct super_block *sb, const struct inode *dir,
 				     int mode, dev_t dev, unsigned long flags)
 {
@@ -2216,6 +2725,15 @@ static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 		} else if (!strcmp(this_char,"mpol")) {
 			if (mpol_parse_str(value, &sbinfo->mpol, 1))
 				goto bad_val;
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+		} else if (!strcmp(this_char,"huge")) {
+			int huge = shmem_parse_huge(value);
+
+			/* deny and force are for the sysfs knob only */
+			if (huge < 0)
+				goto bad_val;
+			sbinfo->huge = huge;
+#endif
 		} else {
 			printk(KERN_ERR "tmpfs: Bad mount option %s\n",
 			       this_char);
@@ -2262,6 +2780,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 	sbinfo->max_blocks  = config.max_blocks;
 	sbinfo->max_inodes  = config.max_inodes;
 	sbinfo->free_inodes = config.max_inodes - inodes;
+	sbinfo->huge = config.huge;
 
 	/*
 	 * Preserve previous mempolicy unless mpol remount option was specified.
@@ -2290,6 +2809,11 @@ static int shmem_show_options(struct seq_file *seq, struct vfsmount *vfs)
 		seq_printf(seq, ",uid=%u", sbinfo->uid);
 	if (sbinfo->gid != 0)
 		seq_printf(seq, ",gid=%u", sbinfo->gid);
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+	/* Rightly or wrongly, show huge mount option unmasked by shmem_huge */
+	if (sbinfo->huge)
+		seq_printf(seq, ",huge=%s", shmem_format_huge(sbinfo->huge));
+#endif
 	shmem_show_mpol(seq, sbinfo->mpol);
 	return 0;
 }
@@ -2434,6 +2958,9 @@ static const struct address_space_operations shmem_aops = {
 
 static const struct file_operations shmem_file_operations = {
 	.mmap		= shmem_mmap,
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+	.get_unmapped_area = shmem_get_unmapped_area,
+#endif
 #ifdef CONFIG_TMPFS
 	.llseek		= generic_file_llseek,
 	.read		= do_sync_read,
@@ -2507,6 +3034,9 @@ static const struct super_operations shmem_ops = {
 
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+	.pmd_fault	= shmem_pmd_fault,
+#endif
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
@@ -2519,6 +3049,59 @@ static struct dentry *shmem_mount(struct file_system_type *fs_type,
 	return mount_nodev(fs_type, flags, data, shmem_fill_super);
 }
 
+#if defined(CONFIG_TRANSPARENT_HUGE_PAGECACHE) && defined(CONFIG_SYSFS)
+static ssize_t shmem_enabled_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	int values[] = {
+		SHMEM_HUGE_ALWAYS,
+		SHMEM_HUGE_WITHIN_SIZE,
+		SHMEM_HUGE_ADVISE,
+		SHMEM_HUGE_NEVER,
+		SHMEM_HUGE_DENY,
+		SHMEM_HUGE_FORCE,
+	};
+	int i, count;
+
+	for (i = 0, count = 0; i < ARRAY_SIZE(values); i++) {
+		const char *fmt = shmem_huge == values[i] ? "[%s] " : "%s ";
+
+		count += sprintf(buf + count, fmt,
+				 shmem_format_huge(values[i]));
+	}
+	buf[count - 1] = '\n';
+	return count;
+}
+
+static ssize_t shmem_enabled_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	char tmp[16];
+	int huge;
+
+	if (count + 1 > sizeof(tmp))
+		return -EINVAL;
+	memcpy(tmp, buf, count);
+	tmp[count] = '\0';
+	if (count && tmp[count - 1] == '\n')
+		tmp[count - 1] = '\0';
+
+	huge = shmem_parse_huge(tmp);
+	if (huge == -EINVAL)
+		return -EINVAL;
+
+	shmem_huge = huge;
+	/* the internal mount, behind SysV shm and shared anon, follows it */
+	if (shmem_huge >= SHMEM_HUGE_NEVER && !IS_ERR_OR_NULL(shm_mnt))
+		SHMEM_SB(shm_mnt->mnt_sb)->huge = shmem_huge;
+	return count;
+}
+
+struct kobj_attribute shmem_enabled_attr =
+	__ATTR(shmem_enabled, 0644, shmem_enabled_show, shmem_enabled_store);
+#endif /* CONFIG_TRANSPARENT_HUGE_PAGECACHE && CONFIG_SYSFS */
+
 static struct file_system_type shmem_fs_type = {
 	.owner		= THIS_MODULE,
 	.name		= "tmpfs",
@@ -2711,6 +3294,10 @@ int shmem_zero_setup(struct vm_area_struct *vma)
 	vma->vm_file = file;
 	vma->vm_ops = &shmem_vm_ops;
 	vma->vm_flags |= VM_CAN_NONLINEAR;
+#ifdef CONFIG_TRANSPARENT_HUGE_PAGECACHE
+	if (shmem_huge_enabled(vma) && khugepaged_enter(vma, vma->vm_flags))
+		return -ENOMEM;
+#endif
 	return 0;
 }
 
@@ -162,7 +162,7 @@ static inline int kmem_cache_debug(struct kmem_cache *s)
  */
 #define SLUB_NEVER_MERGE (SLAB_RED_ZONE | SLAB_POISON | SLAB_STORE_USER | \
 		SLAB_TRACE | SLAB_DESTROY_BY_RCU | SLAB_NOLEAKTRACE | \
-		SLAB_FAILSLAB)
+		SLAB_FAILSLAB | SLAB_NOMERGE)
 
 #define SLUB_MERGE_SAME (SLAB_DEBUG_FREE | SLAB_RECLAIM_ACCOUNT | \
 		SLAB_CACHE_DMA | SLAB_NOTRACK)
@@ -171,6 +171,11 @@ static inline int kmem_cache_debug(struct kmem_cache *s)
 #define OO_MASK		((1 << OO_SHIFT) - 1)
 #define MAX_OBJS_PER_PAGE	32767 /* since page.objects is u15 */
 
+/*
+ * Auto-tuning lets cpu_partial grow up to this multiple of its floor.
+ */
+#define CPU_PARTIAL_AUTO_SCALE	8
+
 /* Internal SLUB flags */
 #define __OBJECT_POISON		0x80000000UL /* Poison object */
 #define __CMPXCHG_DOUBLE	0x40000000UL /* Use cmpxchg_double */
@@ -1481,6 +1486,57 @@ static inline void remove_partial(struct kmem_cache_node *n,
 	n->nr_partial--;
 }
 
+/*
+ * Having to wait for list_lock means the per cpu partial lists are too
+ * short to absorb the current alloc/free bursts. Let cpu_partial grow,
+ * at most once per jiffy so that the kmem_cache cacheline is not written
+ * on every contended acquisition.
+ */
+static void list_lock_contended(struct kmem_cache *s,
+				struct kmem_cache_node *n)
+{
+	int cpu_partial = ACCESS_ONCE(s->cpu_partial);
+	int max = s->cpu_partial_min * CPU_PARTIAL_AUTO_SCALE;
+
+	atomic_long_inc(&n->list_lock_contended);
+
+	if (!s->cpu_partial_auto || kmem_cache_debug(s) ||
+			cpu_partial >= max || s->cpu_partial_stamp == jiffies)
+		return;
+
+	s->cpu_partial = min(cpu_partial + max(s->cpu_partial_min / 2, 1), max);
+	s->cpu_partial_stamp = jiffies;
+}
+
+/*
+ * Shrink an auto-tuned cpu_partial back towards its floor, one step per
+ * second without list_lock contention.
+ */
+static void cpu_partial_decay(struct kmem_cache *s)
+{
+	int cpu_partial = ACCESS_ONCE(s->cpu_partial);
+
+	if (!s->cpu_partial_auto || cpu_partial <= s->cpu_partial_min ||
+			!time_after(jiffies, s->cpu_partial_stamp + HZ))
+		return;
+
+	s->cpu_partial = max(cpu_partial - max(s->cpu_partial_min / 2, 1),
+			     s->cpu_partial_min);
+	s->cpu_partial_stamp = jiffies;
+}
+
+/*
+ * Take list_lock, accounting for the time spent waiting on it.
+ */
+static inline void lock_list(struct kmem_cache *s, struct kmem_cache_node *n)
+{
+	if (likely(spin_trylock(&n->list_lock)))
+		return;
+
+	list_lock_contended(s, n);
+	spin_lock(&n->list_lock);
+}
+
 /*
  * Lock slab, remove from the partial list and put the object into the
  * per cpu freelist.
@@ -1545,7 +1601,7 @@ static void *get_partial_node(struct kmem_cache *s,
 	if (!n || !n->nr_partial)
 		return NULL;
 
-	spin_lock(&n->list_lock);
+	lock_list(s, n);
 	list_for_each_entry_safe(page, page2, &n->partial, lru) {
 		void *t = acquire_slab(s, n, page, object == NULL);
 		int available;
@@ -1815,7 +1871,7 @@ redo:
 			 * that acquire_slab() will see a slab page that
 			 * is frozen
 			 */
-			spin_lock(&n->list_lock);
+			lock_list(s, n);
 		}
 	} else {
 		m = M_FULL;
@@ -1826,7 +1882,7 @@ redo:
 			 * slabs from diagnostic functions will not see
 			 * any frozen slabs.
 			 */
-			spin_lock(&n->list_lock);
+			lock_list(s, n);
 		}
 	}
 
@@ -1909,7 +1965,7 @@ static void unfreeze_partials(struct kmem_cache *s)
 						spin_unlock(&n->list_lock);
 
 					n = n2;
-					spin_lock(&n->list_lock);
+					lock_list(s, n);
 				}
 			}
 
@@ -1979,6 +2035,7 @@ int put_cpu_partial(struct kmem_cache *s, struct page *page, int drain)
 				local_irq_save(flags);
 				unfreeze_partials(s);
 				local_irq_restore(flags);
+				cpu_partial_decay(s);
 				pobjects = 0;
 				pages = 0;
 			}
@@ -2449,7 +2506,8 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 				 * Otherwise the list_lock will synchronize with
 				 * other processors updating the list of slabs.
 				 */
-				spin_lock_irqsave(&n->list_lock, flags);
+				local_irq_save(flags);
+				lock_list(s, n);
 
 			}
 		}
@@ -2606,6 +2664,27 @@ static int slub_min_objects;
  * (Could be removed. This was introduced to pacify the merge skeptics.)
  */
 static int slub_nomerge;
+static char slub_nomerge_caches[256];
+
+/*
+ * Is the cache named in the slub_nomerge= list?
+ */
+static int slab_nomerge_name(const char *name)
+{
+	const char *p = slub_nomerge_caches;
+	size_t len = strlen(name);
+
+	while (*p) {
+		size_t n = strcspn(p, ",");
+
+		if (n == len && !strncmp(p, name, len))
+			return 1;
+		p += n;
+		if (*p)
+			p++;
+	}
+	return 0;
+}
 
 /*
  * Calculate the order of allocation given an slab object size.
@@ -2743,6 +2822,7 @@ init_kmem_cache_node(struct kmem_cache_node *n, struct kmem_cache *s)
 	n->nr_partial = 0;
 	spin_lock_init(&n->list_lock);
 	INIT_LIST_HEAD(&n->partial);
+	atomic_long_set(&n->list_lock_contended, 0);
 #ifdef CONFIG_SLUB_DEBUG
 	atomic_long_set(&n->nr_slabs, 0);
 	atomic_long_set(&n->total_objects, 0);
@@ -3045,6 +3125,10 @@ static int kmem_cache_open(struct kmem_cache *s,
 	 * B) The number of objects in cpu partial slabs to extract from the
 	 *    per node list when we run out of per cpu objects. We only fetch 50%
 	 *    to keep some capacity around for frees.
+	 *
+	 * The value chosen here is a floor. Contention on list_lock lets
+	 * cpu_partial grow up to CPU_PARTIAL_AUTO_SCALE times that, and it
+	 * decays back once the contention is gone.
 	 */
 	if (s->size >= PAGE_SIZE)
 		s->cpu_partial = 2;
@@ -3054,6 +3138,8 @@ static int kmem_cache_open(struct kmem_cache *s,
 		s->cpu_partial = 13;
 	else
 		s->cpu_partial = 30;
+	s->cpu_partial_min = s->cpu_partial;
+	s->cpu_partial_auto = 1;
 
 	s->refcount = 1;
 #ifdef CONFIG_NUMA
@@ -3217,9 +3303,17 @@ static int __init setup_slub_min_objects(char *str)
 
 __setup("slub_min_objects=", setup_slub_min_objects);
 
+/*
+ * "slub_nomerge" disables merging for all caches, "slub_nomerge=a,b"
+ * only for the caches named a and b.
+ */
 static int __init setup_slub_nomerge(char *str)
 {
-	slub_nomerge = 1;
+	if (*str == '=' && str[1])
+		strlcpy(slub_nomerge_caches, str + 1,
+			sizeof(slub_nomerge_caches));
+	else
+		slub_nomerge = 1;
 	return 1;
 }
 
@@ -3896,6 +3990,9 @@ struct kmem_cache *kmem_cache_create(const char *name, size_t size,
 	if (WARN_ON(!name))
 		return NULL;
 
+	if (slab_nomerge_name(name))
+		flags |= SLAB_NOMERGE;
+
 	down_write(&slub_lock);
 	s = find_mergeable(size, align, flags, name, ctor);
 	if (s) {
@@ -4661,11 +4758,62 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 		return err;
 
 	s->cpu_partial = objects;
+	s->cpu_partial_min = objects;
 	flush_all(s);
 	return length;
 }
 SLAB_ATTR(cpu_partial);
 
+static ssize_t cpu_partial_auto_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%d\n", s->cpu_partial_auto);
+}
+
+static ssize_t cpu_partial_auto_store(struct kmem_cache *s, const char *buf,
+				      size_t length)
+{
+	unsigned long enable;
+	int err;
+
+	err = strict_strtoul(buf, 10, &enable);
+	if (err)
+		return err;
+
+	s->cpu_partial_auto = !!enable;
+	if (!enable && s->cpu_partial > s->cpu_partial_min) {
+		s->cpu_partial = s->cpu_partial_min;
+		flush_all(s);
+	}
+	return length;
+}
+SLAB_ATTR(cpu_partial_auto);
+
+static ssize_t list_lock_contended_show(struct kmem_cache *s, char *buf)
+{
+	unsigned long total = 0;
+	int node;
+	int len;
+
+	for_each_node_state(node, N_NORMAL_MEMORY) {
+		struct kmem_cache_node *n = get_node(s, node);
+
+		if (n)
+			total += atomic_long_read(&n->list_lock_contended);
+	}
+	len = sprintf(buf, "%lu", total);
+#ifdef CONFIG_NUMA
+	for_each_node_state(node, N_NORMAL_MEMORY) {
+		struct kmem_cache_node *n = get_node(s, node);
+
+		if (n && len < PAGE_SIZE - 20)
+			len += sprintf(buf + len, " N%d=%lu", node,
+				atomic_long_read(&n->list_lock_contended));
+	}
+#endif
+	return len + sprintf(buf + len, "\n");
+}
+SLAB_ATTR_RO(list_lock_contended);
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -5068,6 +5216,8 @@ static struct attribute *slab_attrs[] = {
 	&order_attr.attr,
 	&min_partial_attr.attr,
 	&cpu_partial_attr.attr,
+	&cpu_partial_auto_attr.attr,
+	&list_lock_contended_attr.attr,
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
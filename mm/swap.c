@@ -38,9 +38,27 @@
 /* How many pages do we try to swap or page in/out together? */
 int page_cluster;
 
-static DEFINE_PER_CPU(struct pagevec[NR_LRU_LISTS], lru_add_pvecs);
+/*
+ * Every drain of an LRU addition batch takes zone->lru_lock with interrupts
+ * disabled.  When a drain finds the lock held by someone else, the batch of
+ * that cpu and list is doubled in size, up to PAGEVEC_SIZE << LRU_ADD_SHIFT
+ * pages, so that the lock is taken less often; whenever a drain gets the
+ * lock right away, it is halved again.
+ */
+#define LRU_ADD_SHIFT	2
+
+struct lru_add_batch {
+	unsigned int nr;
+	unsigned int shift;	/* the batch is drained at PAGEVEC_SIZE << shift */
+	struct page *pages[PAGEVEC_SIZE << LRU_ADD_SHIFT];
+};
+
+static DEFINE_PER_CPU(struct lru_add_batch[NR_LRU_LISTS], lru_add_batches);
+
+static void lru_add_batch_drain(struct lru_add_batch *batch, enum lru_list lru);
 static DEFINE_PER_CPU(struct pagevec, lru_rotate_pvecs);
 static DEFINE_PER_CPU(struct pagevec, lru_deactivate_pvecs);
+static DEFINE_PER_CPU(struct pagevec, lru_lazyfree_pvecs);
 
 /*
  * This path almost never happens for VM activity - pages are normally
@@ -308,12 +326,14 @@ static void pagevec_lru_move_fn(struct pagevec *pvec,
 static void pagevec_move_tail_fn(struct page *page, void *arg)
 {
 	int *pgmoved = arg;
-	struct zone *zone = page_zone(page);
 
 	if (PageLRU(page) && !PageActive(page) && !PageUnevictable(page)) {
 		enum lru_list lru = page_lru_base_type(page);
-		list_move_tail(&page->lru, &zone->lru[lru].list);
-		mem_cgroup_rotate_reclaimable_page(page);
+		struct lruvec *lruvec;
+
+		lruvec = mem_cgroup_lru_move_lists(page_zone(page),
+						   page, lru, lru);
+		list_move_tail(&page->lru, &lruvec->lists[lru]);
 		(*pgmoved)++;
 	}
 }
@@ -436,6 +456,8 @@ void activate_page(struct page *page)
  */
 void mark_page_accessed(struct page *page)
 {
+	if (PageIdle(page))
+		ClearPageIdle(page);
 	if (!PageActive(page) && !PageUnevictable(page) &&
 			PageReferenced(page) && PageLRU(page)) {
 		activate_page(page);
@@ -449,12 +471,13 @@ EXPORT_SYMBOL(mark_page_accessed);
 
 void __lru_cache_add(struct page *page, enum lru_list lru)
 {
-	struct pagevec *pvec = &get_cpu_var(lru_add_pvecs)[lru];
+	struct lru_add_batch *batch = &get_cpu_var(lru_add_batches)[lru];
 
 	page_cache_get(page);
-	if (!pagevec_add(pvec, page))
-		____pagevec_lru_add(pvec, lru);
-	put_cpu_var(lru_add_pvecs);
+	batch->pages[batch->nr++] = page;
+	if (batch->nr >= PAGEVEC_SIZE << batch->shift)
+		lru_add_batch_drain(batch, lru);
+	put_cpu_var(lru_add_batches);
 }
 EXPORT_SYMBOL(__lru_cache_add);
 
@@ -524,6 +547,7 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 	int lru, file;
 	bool active;
 	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
 
 	if (!PageLRU(page))
 		return;
@@ -556,8 +580,8 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 		 * The page's writeback ends up during pagevec
 		 * We moves tha page into tail of inactive.
 		 */
-		list_move_tail(&page->lru, &zone->lru[lru].list);
-		mem_cgroup_rotate_reclaimable_page(page);
+		lruvec = mem_cgroup_lru_move_lists(zone, page, lru, lru);
+		list_move_tail(&page->lru, &lruvec->lists[lru]);
 		__count_vm_event(PGROTATED);
 	}
 
@@ -566,6 +590,37 @@ static void lru_deactivate_fn(struct page *page, void *arg)
 	update_page_reclaim_stat(zone, page, file, 0);
 }
 
+/*
+ * Mark a page given up with MADV_FREE by clearing PG_swapbacked, which
+ * makes it a clean page reclaim can drop without swap, and move it to
+ * the tail of the inactive file list that such pages belong on now.
+ * Unlike lru_deactivate_fn() this is for pages that are still mapped.
+ */
+static void lru_lazyfree_fn(struct page *page, void *arg)
+{
+	struct zone *zone = page_zone(page);
+	struct lruvec *lruvec;
+	bool active;
+
+	if (!PageLRU(page) || !PageAnon(page) || !PageSwapBacked(page) ||
+	    PageSwapCache(page) || PageUnevictable(page))
+		return;
+
+	active = PageActive(page);
+	del_page_from_lru_list(zone, page, LRU_INACTIVE_ANON + active);
+	ClearPageActive(page);
+	ClearPageReferenced(page);
+	ClearPageSwapBacked(page);
+	add_page_to_lru_list(zone, page, LRU_INACTIVE_FILE);
+	lruvec = mem_cgroup_lru_move_lists(zone, page, LRU_INACTIVE_FILE,
+					   LRU_INACTIVE_FILE);
+	list_move_tail(&page->lru, &lruvec->lists[LRU_INACTIVE_FILE]);
+
+	if (active)
+		__count_vm_event(PGDEACTIVATE);
+	update_page_reclaim_stat(zone, page, 1, 0);
+}
+
 /*
  * Drain pages out of the cpu's pagevecs.
  * Either "cpu" is the current CPU, and preemption has already been
@@ -573,14 +628,15 @@ static void lru_deactivate_fn(struct page *page, void *arg)
  */
 static void drain_cpu_pagevecs(int cpu)
 {
-	struct pagevec *pvecs = per_cpu(lru_add_pvecs, cpu);
+	struct lru_add_batch *batches = per_cpu(lru_add_batches, cpu);
 	struct pagevec *pvec;
 	int lru;
 
 	for_each_lru(lru) {
-		pvec = &pvecs[lru - LRU_BASE];
-		if (pagevec_count(pvec))
-			____pagevec_lru_add(pvec, lru);
+		struct lru_add_batch *batch = &batches[lru - LRU_BASE];
+
+		if (batch->nr)
+			lru_add_batch_drain(batch, lru);
 	}
 
 	pvec = &per_cpu(lru_rotate_pvecs, cpu);
@@ -597,6 +653,10 @@ static void drain_cpu_pagevecs(int cpu)
 	if (pagevec_count(pvec))
 		pagevec_lru_move_fn(pvec, lru_deactivate_fn, NULL);
 
+	pvec = &per_cpu(lru_lazyfree_pvecs, cpu);
+	if (pagevec_count(pvec))
+		pagevec_lru_move_fn(pvec, lru_lazyfree_fn, NULL);
+
 	activate_page_drain(cpu);
 }
 
@@ -626,6 +686,24 @@ void deactivate_page(struct page *page)
 	}
 }
 
+/**
+ * lazyfree_page - mark a page lazily freed and queue it for reclaim
+ * @page: anonymous page given up with MADV_FREE
+ */
+void lazyfree_page(struct page *page)
+{
+	if (PageUnevictable(page))
+		return;
+
+	if (likely(get_page_unless_zero(page))) {
+		struct pagevec *pvec = &get_cpu_var(lru_lazyfree_pvecs);
+
+		if (!pagevec_add(pvec, page))
+			pagevec_lru_move_fn(pvec, lru_lazyfree_fn, NULL);
+		put_cpu_var(lru_lazyfree_pvecs);
+	}
+}
+
 void lru_add_drain(void)
 {
 	drain_cpu_pagevecs(get_cpu());
@@ -738,7 +816,6 @@ void lru_add_page_tail(struct zone* zone,
 	int active;
 	enum lru_list lru;
 	const int file = 0;
-	struct list_head *head;
 
 	VM_BUG_ON(!PageHead(page));
 	VM_BUG_ON(PageCompound(page_tail));
@@ -757,15 +834,27 @@ void lru_add_page_tail(struct zone* zone,
 			lru = LRU_INACTIVE_ANON;
 		}
 		update_page_reclaim_stat(zone, page_tail, file, active);
-		if (likely(PageLRU(page)))
-			head = page->lru.prev;
-		else
-			head = &zone->lru[lru].list;
-		__add_page_to_lru_list(zone, page_tail, lru, head);
 	} else {
 		SetPageUnevictable(page_tail);
-		add_page_to_lru_list(zone, page_tail, LRU_UNEVICTABLE);
+		lru = LRU_UNEVICTABLE;
 	}
+
+	if (likely(PageLRU(page))) {
+		enum lru_list head_lru = page_lru(page);
+
+		/*
+		 * A hugepage on the LRU counts for HPAGE_PMD_NR pages in
+		 * the zone and memcg LRU statistics already, so the tail
+		 * only needs to be linked next to it, on its lruvec.
+		 */
+		if (likely(lru == head_lru)) {
+			list_add_tail(&page_tail->lru, &page->lru);
+			return;
+		}
+		__mod_zone_page_state(zone, NR_LRU_BASE + head_lru, -1);
+		mem_cgroup_lru_del_list(page_tail, head_lru);
+	}
+	add_page_to_lru_list(zone, page_tail, lru);
 }
 
 static void ____pagevec_lru_add_fn(struct page *page, void *arg)
@@ -799,6 +888,48 @@ void ____pagevec_lru_add(struct pagevec *pvec, enum lru_list lru)
 
 EXPORT_SYMBOL(____pagevec_lru_add);
 
+/*
+ * Add the pages of a per-cpu LRU addition batch to the LRU and drop the
+ * references the batch held on them, then resize the batch according to
+ * whether zone->lru_lock was contended.
+ */
+static void lru_add_batch_drain(struct lru_add_batch *batch, enum lru_list lru)
+{
+	struct zone *zone = NULL;
+	unsigned long flags = 0;
+	bool contended = false;
+	int i;
+
+	VM_BUG_ON(is_unevictable_lru(lru));
+
+	for (i = 0; i < batch->nr; i++) {
+		struct page *page = batch->pages[i];
+		struct zone *pagezone = page_zone(page);
+
+		if (pagezone != zone) {
+			if (zone)
+				spin_unlock_irqrestore(&zone->lru_lock, flags);
+			zone = pagezone;
+			local_irq_save(flags);
+			if (!spin_trylock(&zone->lru_lock)) {
+				contended = true;
+				spin_lock(&zone->lru_lock);
+			}
+		}
+
+		____pagevec_lru_add_fn(page, (void *)lru);
+	}
+	if (zone)
+		spin_unlock_irqrestore(&zone->lru_lock, flags);
+	release_pages(batch->pages, batch->nr, 0);
+	batch->nr = 0;
+
+	if (contended && batch->shift < LRU_ADD_SHIFT)
+		batch->shift++;
+	else if (!contended && batch->shift)
+		batch->shift--;
+}
+
 /*
  * Try to drop buffers from the pages in a pagevec
  */
@@ -18,6 +18,7 @@
 #include <linux/pagevec.h>
 #include <linux/migrate.h>
 #include <linux/page_cgroup.h>
+#include <linux/export.h>
 
 #include <asm/pgtable.h>
 
@@ -413,3 +414,65 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
+
+static int swapin_walk_pmd_entry(pmd_t *pmd, unsigned long start,
+				 unsigned long end, struct mm_walk *walk)
+{
+	struct vm_area_struct *vma = walk->private;
+	unsigned long index;
+
+	if (pmd_none_or_trans_huge_or_clear_bad(pmd))
+		return 0;
+
+	for (index = start; index != end; index += PAGE_SIZE) {
+		pte_t *orig_pte, pte;
+		swp_entry_t entry;
+		struct page *page;
+		spinlock_t *ptl;
+
+		orig_pte = pte_offset_map_lock(vma->vm_mm, pmd, start, &ptl);
+		pte = *(orig_pte + ((index - start) / PAGE_SIZE));
+		pte_unmap_unlock(orig_pte, ptl);
+
+		if (pte_present(pte) || pte_none(pte) || pte_file(pte))
+			continue;
+		entry = pte_to_swp_entry(pte);
+		if (unlikely(non_swap_entry(entry)))
+			continue;
+
+		page = read_swap_cache_async(entry, GFP_HIGHUSER_MOVABLE,
+					     vma, index);
+		if (page)
+			page_cache_release(page);
+	}
+
+	return 0;
+}
+
+/**
+ * swapin_readahead_range - queue swapin of the swapped out pages in a range
+ * @vma: anonymous vma containing the range
+ * @start: start address of the range
+ * @end: end address of the range
+ *
+ * Unlike swapin_readahead(), which reads neighbours in the swap area,
+ * this reads the neighbours in the address space, for users that know
+ * they are about to touch a range of their own memory.  The reads are
+ * only queued; the pages are not mapped.
+ *
+ * Caller must hold down_read on vma->vm_mm.
+ */
+void swapin_readahead_range(struct vm_area_struct *vma,
+			    unsigned long start, unsigned long end)
+{
+	struct mm_walk walk = {
+		.mm = vma->vm_mm,
+		.pmd_entry = swapin_walk_pmd_entry,
+		.private = vma,
+	};
+
+	walk_page_range(start, end, &walk);
+
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+}
+EXPORT_SYMBOL_GPL(swapin_readahead_range);
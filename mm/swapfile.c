@@ -31,6 +31,8 @@
 #include <linux/memcontrol.h>
 #include <linux/poll.h>
 #include <linux/oom.h>
+#include <linux/frontswap.h>
+#include <linux/swapfile.h>
 
 #include <asm/pgtable.h>
 #include <asm/tlbflush.h>
@@ -42,7 +44,7 @@ static bool swap_count_continued(struct swap_info_struct *, pgoff_t,
 static void free_swap_count_continuations(struct swap_info_struct *);
 static sector_t map_swap_entry(swp_entry_t, struct block_device**);
 
-static DEFINE_SPINLOCK(swap_lock);
+DEFINE_SPINLOCK(swap_lock);
 static unsigned int nr_swapfiles;
 long nr_swap_pages;
 long total_swap_pages;
@@ -53,9 +55,9 @@ static const char Unused_file[] = "Unused swap file entry ";
 static const char Bad_offset[] = "Bad swap offset entry ";
 static const char Unused_offset[] = "Unused swap offset entry ";
 
-static struct swap_list_t swap_list = {-1, -1};
+struct swap_list_t swap_list = {-1, -1};
 
-static struct swap_info_struct *swap_info[MAX_SWAPFILES];
+struct swap_info_struct *swap_info[MAX_SWAPFILES];
 
 static DEFINE_MUTEX(swapon_mutex);
 
@@ -187,6 +189,8 @@ static unsigned long scan_swap_map(struct swap_info_struct *si,
 	unsigned long last_in_cluster = 0;
 	int latency_ration = LATENCY_LIMIT;
 	int found_free_cluster = 0;
+	unsigned int *cluster_next = &si->cluster_next;
+	unsigned int *cluster_nr = &si->cluster_nr;
 
 	/*
 	 * We try to cluster swap pages by allocating them sequentially
@@ -199,12 +203,19 @@ static unsigned long scan_swap_map(struct swap_info_struct *si,
 	 * And we let swap pages go all over an SSD partition.  Hugh
 	 */
 
+	if (si->percpu_cluster) {
+		struct swap_cluster *pc = this_cpu_ptr(si->percpu_cluster);
+
+		cluster_next = &pc->next;
+		cluster_nr = &pc->nr;
+	}
+
 	si->flags += SWP_SCANNING;
-	scan_base = offset = si->cluster_next;
+	scan_base = offset = *cluster_next;
 
-	if (unlikely(!si->cluster_nr--)) {
+	if (unlikely(!*cluster_nr--)) {
 		if (si->pages - si->inuse_pages < SWAPFILE_CLUSTER) {
-			si->cluster_nr = SWAPFILE_CLUSTER - 1;
+			*cluster_nr = SWAPFILE_CLUSTER - 1;
 			goto checks;
 		}
 		if (si->flags & SWP_DISCARDABLE) {
@@ -241,8 +252,8 @@ static unsigned long scan_swap_map(struct swap_info_struct *si,
 			else if (offset == last_in_cluster) {
 				spin_lock(&swap_lock);
 				offset -= SWAPFILE_CLUSTER - 1;
-				si->cluster_next = offset;
-				si->cluster_nr = SWAPFILE_CLUSTER - 1;
+				*cluster_next = offset;
+				*cluster_nr = SWAPFILE_CLUSTER - 1;
 				found_free_cluster = 1;
 				goto checks;
 			}
@@ -262,8 +273,8 @@ static unsigned long scan_swap_map(struct swap_info_struct *si,
 			else if (offset == last_in_cluster) {
 				spin_lock(&swap_lock);
 				offset -= SWAPFILE_CLUSTER - 1;
-				si->cluster_next = offset;
-				si->cluster_nr = SWAPFILE_CLUSTER - 1;
+				*cluster_next = offset;
+				*cluster_nr = SWAPFILE_CLUSTER - 1;
 				found_free_cluster = 1;
 				goto checks;
 			}
@@ -275,7 +286,7 @@ static unsigned long scan_swap_map(struct swap_info_struct *si,
 
 		offset = scan_base;
 		spin_lock(&swap_lock);
-		si->cluster_nr = SWAPFILE_CLUSTER - 1;
+		*cluster_nr = SWAPFILE_CLUSTER - 1;
 		si->lowest_alloc = 0;
 	}
 
@@ -312,7 +323,7 @@ checks:
 		si->highest_bit = 0;
 	}
 	si->swap_map[offset] = usage;
-	si->cluster_next = offset + 1;
+	*cluster_next = offset + 1;
 	si->flags -= SWP_SCANNING;
 
 	if (si->lowest_alloc) {
@@ -567,6 +578,9 @@ static unsigned char swap_entry_free(struct swap_info_struct *p,
 				p->notify_swap_entry_free_fn(offset);
 	}
 
+	if (!usage)
+		frontswap_flush_page(p->type, offset);
+
 	return usage;
 }
 
@@ -939,6 +953,9 @@ static inline int unuse_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 		next = pmd_addr_end(addr, end);
 		if (pmd_none_or_trans_huge_or_clear_bad(pmd))
 			continue;
+		ret = unshare_pte_table(vma, pmd, addr);
+		if (ret)
+			return ret;
 		ret = unuse_pte_range(vma, pmd, addr, next, entry, page);
 		if (ret)
 			return ret;
@@ -1025,7 +1042,7 @@ static int unuse_mm(struct mm_struct *mm,
  * Recycle to start on reaching the end, returning 0 when empty.
  */
 static unsigned int find_next_to_unuse(struct swap_info_struct *si,
-					unsigned int prev)
+					unsigned int prev, bool frontswap)
 {
 	unsigned int max = si->max;
 	unsigned int i = prev;
@@ -1053,7 +1070,8 @@ static unsigned int find_next_to_unuse(struct swap_info_struct *si,
 		}
 		count = si->swap_map[i];
 		if (count && swap_count(count) != SWAP_MAP_BAD)
-			break;
+			if (!frontswap || frontswap_test(si, i))
+				break;
 	}
 	return i;
 }
@@ -1062,8 +1080,12 @@ static unsigned int find_next_to_unuse(struct swap_info_struct *si,
  * We completely avoid races by reading each swap page in advance,
  * and then search for the process using it.  All the necessary
  * page table adjustments can then be made atomically.
+ *
+ * if the boolean frontswap is true, only unuse pages_to_unuse pages;
+ * pages_to_unuse==0 means all pages; ignored if frontswap is false
  */
-static int try_to_unuse(unsigned int type)
+int try_to_unuse(unsigned int type, bool frontswap,
+		 unsigned long pages_to_unuse)
 {
 	struct swap_info_struct *si = swap_info[type];
 	struct mm_struct *start_mm;
@@ -1096,7 +1118,7 @@ static int try_to_unuse(unsigned int type)
 	 * one pass through swap_map is enough, but not necessarily:
 	 * there are races when an instance of an entry might be missed.
 	 */
-	while ((i = find_next_to_unuse(si, i)) != 0) {
+	while ((i = find_next_to_unuse(si, i, frontswap)) != 0) {
 		if (signal_pending(current)) {
 			retval = -EINTR;
 			break;
@@ -1263,6 +1285,10 @@ static int try_to_unuse(unsigned int type)
 		 * interactive performance.
 		 */
 		cond_resched();
+		if (frontswap && pages_to_unuse > 0) {
+			if (!--pages_to_unuse)
+				break;
+		}
 	}
 
 	mmput(start_mm);
@@ -1522,7 +1548,8 @@ bad_bmap:
 }
 
 static void enable_swap_info(struct swap_info_struct *p, int prio,
-				unsigned char *swap_map)
+				unsigned char *swap_map,
+				unsigned long *frontswap_map)
 {
 	int i, prev;
 
@@ -1532,6 +1559,7 @@ static void enable_swap_info(struct swap_info_struct *p, int prio,
 	else
 		p->prio = --least_priority;
 	p->swap_map = swap_map;
+	frontswap_map_set(p, frontswap_map);
 	p->flags |= SWP_WRITEOK;
 	nr_swap_pages += p->pages;
 	total_swap_pages += p->pages;
@@ -1555,6 +1583,8 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 {
 	struct swap_info_struct *p = NULL;
 	unsigned char *swap_map;
+	unsigned long *frontswap_map;
+	struct swap_cluster __percpu *percpu_cluster;
 	struct file *swap_file, *victim;
 	struct address_space *mapping;
 	struct inode *inode;
@@ -1619,7 +1649,7 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	spin_unlock(&swap_lock);
 
 	oom_score_adj = test_set_oom_score_adj(OOM_SCORE_ADJ_MAX);
-	err = try_to_unuse(type);
+	err = try_to_unuse(type, false, 0);
 	compare_swap_oom_score_adj(OOM_SCORE_ADJ_MAX, oom_score_adj);
 
 	if (err) {
@@ -1630,7 +1660,8 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 		 * sys_swapoff for this swap_info_struct at this point.
 		 */
 		/* re-insert swap space back into swap_list */
-		enable_swap_info(p, p->prio, p->swap_map);
+		enable_swap_info(p, p->prio, p->swap_map,
+				 frontswap_map_get(p));
 		goto out_dput;
 	}
 
@@ -1655,9 +1686,16 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->max = 0;
 	swap_map = p->swap_map;
 	p->swap_map = NULL;
+	percpu_cluster = p->percpu_cluster;
+	p->percpu_cluster = NULL;
+	frontswap_map = frontswap_map_get(p);
 	spin_unlock(&swap_lock);
+	frontswap_flush_area(type);
+	frontswap_map_set(p, NULL);
 	mutex_unlock(&swapon_mutex);
 	vfree(swap_map);
+	vfree(frontswap_map);
+	free_percpu(percpu_cluster);
 	/* Destroy swap account informatin */
 	swap_cgroup_swapoff(type);
 
@@ -2027,6 +2065,7 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 	sector_t span;
 	unsigned long maxpages;
 	unsigned char *swap_map = NULL;
+	unsigned long *frontswap_map = NULL;
 	struct page *page = NULL;
 	struct inode *inode = NULL;
 
@@ -2117,12 +2156,38 @@ SYSCALL_DEFINE2(swapon, const char __user *, specialfile, int, swap_flags)
 			p->flags |= SWP_DISCARDABLE;
 	}
 
+	/*
+	 * Without discard, a solid state area lets each cpu fill its own
+	 * cluster; the discard of a new cluster is tracked per area, so
+	 * discardable ones keep sharing one cursor.
+	 */
+	if ((p->flags & (SWP_SOLIDSTATE | SWP_DISCARDABLE)) == SWP_SOLIDSTATE) {
+		p->percpu_cluster = alloc_percpu(struct swap_cluster);
+		if (p->percpu_cluster) {
+			int cpu;
+
+			for_each_possible_cpu(cpu) {
+				struct swap_cluster *pc;
+
+				pc = per_cpu_ptr(p->percpu_cluster, cpu);
+				pc->next = 1 + (random32() % p->highest_bit);
+				pc->nr = 0;
+			}
+		}
+	}
+
+	/* frontswap is optional: swap just goes to the device without it */
+	if (frontswap_enabled)
+		frontswap_map = vzalloc(BITS_TO_LONGS(maxpages) * sizeof(long));
+
 	mutex_lock(&swapon_mutex);
 	prio = -1;
 	if (swap_flags & SWAP_FLAG_PREFER)
 		prio =
 		  (swap_flags & SWAP_FLAG_PRIO_MASK) >> SWAP_FLAG_PRIO_SHIFT;
-	enable_swap_info(p, prio, swap_map);
+	frontswap_map_set(p, frontswap_map);
+	frontswap_init(p->type);
+	enable_swap_info(p, prio, swap_map, frontswap_map);
 
 	printk(KERN_INFO "Adding %uk swap on %s.  "
 			"Priority:%d extents:%d across:%lluk %s%s\n",
@@ -0,0 +1,428 @@
+/*
+ * zswap.c - compressed cache for swap pages
+ *
+ * zswap is a frontswap backend that takes pages in the process of being
+ * swapped out, compresses them with LZO and keeps them in a RAM-based
+ * pool, one pool per swap area.  Reclaim no longer has to wait for the
+ * swap device for those pages, and swapping them back in is a
+ * decompression rather than a read.  A page only goes to the swap
+ * device when the pool has hit its size limit, when it does not
+ * compress, or when there is no memory for its compressed copy.
+ *
+ * The total size of the pools is limited to zswap.max_pool_percent of
+ * RAM.  Statistics are in debugfs, as zswap/ for the global ones and
+ * zswap/swap<type>/ for those of each pool.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <linux/mm.h>
+#include <linux/highmem.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/spinlock.h>
+#include <linux/rbtree.h>
+#include <linux/percpu.h>
+#include <linux/swap.h>
+#include <linux/lzo.h>
+#include <linux/debugfs.h>
+#include <linux/frontswap.h>
+
+/* Enable/disable zswap, only at boot (zswap.enabled=1) */
+static bool zswap_enabled;
+module_param_named(enabled, zswap_enabled, bool, 0444);
+
+/* The maximum percentage of memory that the compressed pools can occupy */
+static unsigned int zswap_max_pool_percent = 20;
+module_param_named(max_pool_percent, zswap_max_pool_percent, uint, 0644);
+
+/*
+ * The maximum size of a compressed page that is worth keeping: anything
+ * larger saves too little memory for the copy it costs.
+ */
+#define ZSWAP_MAX_COMPRESSED	(PAGE_SIZE * 3 / 4)
+
+/* Total bytes taken by all the pools, compared against the limit */
+static atomic_long_t zswap_pool_bytes = ATOMIC_LONG_INIT(0);
+
+/* Global statistics, racy but only informational */
+static u64 zswap_pool_limit_hit;
+static u64 zswap_reject_compress_fail;
+static u64 zswap_reject_compress_poor;
+static u64 zswap_reject_alloc_fail;
+static u64 zswap_duplicate_entry;
+
+/*
+ * One compressed page.  The compressed data follows the entry in the
+ * same allocation.
+ */
+struct zswap_entry {
+	struct rb_node rbnode;
+	pgoff_t offset;
+	unsigned int length;
+	u8 data[0];
+};
+
+/*
+ * The pool of one swap area: its entries indexed by swap offset.  The
+ * lock only protects the tree itself.  frontswap never has a store, load
+ * or invalidation in flight for the same offset at the same time, all of
+ * them being done either with the swap cache page locked or after the
+ * last reference to the swap entry is gone, so an entry found under the
+ * lock can be used after it is dropped.
+ */
+struct zswap_tree {
+	struct rb_root rbroot;
+	spinlock_t lock;
+	u64 stored_pages;
+	u64 pool_bytes;
+	struct dentry *debugfs_dir;
+};
+
+static struct zswap_tree *zswap_trees[MAX_SWAPFILES];
+
+/* Per-cpu compression buffers, in use with preemption disabled */
+static DEFINE_PER_CPU(u8 *, zswap_dstmem);
+static DEFINE_PER_CPU(void *, zswap_workmem);
+
+static struct dentry *zswap_debugfs_root;
+
+static bool zswap_is_full(void)
+{
+	unsigned long limit = totalram_pages * zswap_max_pool_percent / 100;
+
+	return DIV_ROUND_UP(atomic_long_read(&zswap_pool_bytes), PAGE_SIZE)
+		>= limit;
+}
+
+static struct zswap_entry *zswap_rb_search(struct rb_root *root,
+					   pgoff_t offset)
+{
+	struct rb_node *node = root->rb_node;
+	struct zswap_entry *entry;
+
+	while (node) {
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		if (entry->offset > offset)
+			node = node->rb_left;
+		else if (entry->offset < offset)
+			node = node->rb_right;
+		else
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * Insert the entry into the tree.  If an entry with the same offset is
+ * already there, it is replaced and returned for the caller to free.
+ */
+static struct zswap_entry *zswap_rb_insert(struct rb_root *root,
+					   struct zswap_entry *entry)
+{
+	struct rb_node **link = &root->rb_node, *parent = NULL;
+	struct zswap_entry *myentry;
+
+	while (*link) {
+		parent = *link;
+		myentry = rb_entry(parent, struct zswap_entry, rbnode);
+		if (myentry->offset > entry->offset)
+			link = &(*link)->rb_left;
+		else if (myentry->offset < entry->offset)
+			link = &(*link)->rb_right;
+		else {
+			rb_replace_node(&myentry->rbnode, &entry->rbnode, root);
+			return myentry;
+		}
+	}
+	rb_link_node(&entry->rbnode, parent, link);
+	rb_insert_color(&entry->rbnode, root);
+	return NULL;
+}
+
+/* Called with tree->lock held, after the entry left the tree */
+static void zswap_free_entry(struct zswap_tree *tree,
+			     struct zswap_entry *entry)
+{
+	size_t size = ksize(entry);
+
+	tree->stored_pages--;
+	tree->pool_bytes -= size;
+	atomic_long_sub(size, &zswap_pool_bytes);
+	kfree(entry);
+}
+
+/*
+ * frontswap hooks
+ */
+
+static int zswap_frontswap_store(unsigned type, pgoff_t offset,
+				 struct page *page)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry, *dupentry;
+	size_t dlen, size;
+	u8 *src, *dst;
+	int ret;
+
+	if (!tree)
+		return -ENODEV;
+
+	if (zswap_is_full()) {
+		zswap_pool_limit_hit++;
+		return -ENOMEM;
+	}
+
+	dst = get_cpu_var(zswap_dstmem);
+	src = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_1_compress(src, PAGE_SIZE, dst, &dlen,
+			       __get_cpu_var(zswap_workmem));
+	kunmap_atomic(src, KM_USER0);
+	if (ret != LZO_E_OK) {
+		zswap_reject_compress_fail++;
+		ret = -EINVAL;
+		goto put_dstmem;
+	}
+	if (dlen > ZSWAP_MAX_COMPRESSED) {
+		zswap_reject_compress_poor++;
+		ret = -E2BIG;
+		goto put_dstmem;
+	}
+
+	/* we are in reclaim with preemption disabled: don't try hard */
+	entry = kmalloc(sizeof(*entry) + dlen, __GFP_NORETRY | __GFP_NOWARN);
+	if (!entry) {
+		zswap_reject_alloc_fail++;
+		ret = -ENOMEM;
+		goto put_dstmem;
+	}
+	entry->offset = offset;
+	entry->length = dlen;
+	memcpy(entry->data, dst, dlen);
+	put_cpu_var(zswap_dstmem);
+
+	size = ksize(entry);
+	atomic_long_add(size, &zswap_pool_bytes);
+
+	spin_lock(&tree->lock);
+	tree->stored_pages++;
+	tree->pool_bytes += size;
+	dupentry = zswap_rb_insert(&tree->rbroot, entry);
+	if (dupentry) {
+		zswap_duplicate_entry++;
+		zswap_free_entry(tree, dupentry);
+	}
+	spin_unlock(&tree->lock);
+
+	return 0;
+
+put_dstmem:
+	put_cpu_var(zswap_dstmem);
+	return ret;
+}
+
+static int zswap_frontswap_load(unsigned type, pgoff_t offset,
+				struct page *page)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+	size_t dlen = PAGE_SIZE;
+	u8 *dst;
+	int ret;
+
+	if (!tree)
+		return -ENODEV;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	spin_unlock(&tree->lock);
+	if (!entry)
+		return -ENOENT;
+
+	dst = kmap_atomic(page, KM_USER0);
+	ret = lzo1x_decompress_safe(entry->data, entry->length, dst, &dlen);
+	kunmap_atomic(dst, KM_USER0);
+
+	/* the page is not on the swap device: there is no way back */
+	BUG_ON(ret != LZO_E_OK || dlen != PAGE_SIZE);
+
+	return 0;
+}
+
+static void zswap_frontswap_invalidate_page(unsigned type, pgoff_t offset)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct zswap_entry *entry;
+
+	if (!tree)
+		return;
+
+	spin_lock(&tree->lock);
+	entry = zswap_rb_search(&tree->rbroot, offset);
+	if (entry) {
+		rb_erase(&entry->rbnode, &tree->rbroot);
+		zswap_free_entry(tree, entry);
+	}
+	spin_unlock(&tree->lock);
+}
+
+static void zswap_frontswap_invalidate_area(unsigned type)
+{
+	struct zswap_tree *tree = zswap_trees[type];
+	struct rb_node *node;
+
+	if (!tree)
+		return;
+
+	spin_lock(&tree->lock);
+	while ((node = rb_first(&tree->rbroot)) != NULL) {
+		struct zswap_entry *entry;
+
+		entry = rb_entry(node, struct zswap_entry, rbnode);
+		rb_erase(node, &tree->rbroot);
+		zswap_free_entry(tree, entry);
+	}
+	spin_unlock(&tree->lock);
+
+	debugfs_remove_recursive(tree->debugfs_dir);
+	zswap_trees[type] = NULL;
+	kfree(tree);
+}
+
+static void zswap_debugfs_tree_init(struct zswap_tree *tree, unsigned type)
+{
+	char name[16];
+
+	if (!zswap_debugfs_root)
+		return;
+
+	snprintf(name, sizeof(name), "swap%u", type);
+	tree->debugfs_dir = debugfs_create_dir(name, zswap_debugfs_root);
+	if (!tree->debugfs_dir)
+		return;
+
+	debugfs_create_u64("stored_pages", S_IRUGO,
+			   tree->debugfs_dir, &tree->stored_pages);
+	debugfs_create_u64("pool_bytes", S_IRUGO,
+			   tree->debugfs_dir, &tree->pool_bytes);
+}
+
+static void zswap_frontswap_init(unsigned type)
+{
+	struct zswap_tree *tree;
+
+	tree = kzalloc(sizeof(*tree), GFP_KERNEL);
+	if (!tree) {
+		pr_err("alloc failed, zswap disabled for swap type %d\n", type);
+		return;
+	}
+	tree->rbroot = RB_ROOT;
+	spin_lock_init(&tree->lock);
+	zswap_debugfs_tree_init(tree, type);
+	zswap_trees[type] = tree;
+}
+
+static struct frontswap_ops zswap_frontswap_ops = {
+	.put_page = zswap_frontswap_store,
+	.get_page = zswap_frontswap_load,
+	.flush_page = zswap_frontswap_invalidate_page,
+	.flush_area = zswap_frontswap_invalidate_area,
+	.init = zswap_frontswap_init
+};
+
+/*
+ * debugfs functions
+ */
+
+static int zswap_pool_pages_get(void *data, u64 *val)
+{
+	*val = DIV_ROUND_UP(atomic_long_read(&zswap_pool_bytes), PAGE_SIZE);
+	return 0;
+}
+DEFINE_SIMPLE_ATTRIBUTE(zswap_pool_pages_fops, zswap_pool_pages_get,
+			NULL, "%llu\n");
+
+static void __init zswap_debugfs_init(void)
+{
+	if (!debugfs_initialized())
+		return;
+
+	zswap_debugfs_root = debugfs_create_dir("zswap", NULL);
+	if (!zswap_debugfs_root)
+		return;
+
+	debugfs_create_u64("pool_limit_hit", S_IRUGO,
+			   zswap_debugfs_root, &zswap_pool_limit_hit);
+	debugfs_create_u64("reject_compress_fail", S_IRUGO,
+			   zswap_debugfs_root, &zswap_reject_compress_fail);
+	debugfs_create_u64("reject_compress_poor", S_IRUGO,
+			   zswap_debugfs_root, &zswap_reject_compress_poor);
+	debugfs_create_u64("reject_alloc_fail", S_IRUGO,
+			   zswap_debugfs_root, &zswap_reject_alloc_fail);
+	debugfs_create_u64("duplicate_entry", S_IRUGO,
+			   zswap_debugfs_root, &zswap_duplicate_entry);
+	debugfs_create_file("pool_pages", S_IRUGO,
+			    zswap_debugfs_root, NULL, &zswap_pool_pages_fops);
+}
+
+/*
+ * module init
+ */
+
+static void zswap_cpu_buffers_free(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		kfree(per_cpu(zswap_dstmem, cpu));
+		per_cpu(zswap_dstmem, cpu) = NULL;
+		vfree(per_cpu(zswap_workmem, cpu));
+		per_cpu(zswap_workmem, cpu) = NULL;
+	}
+}
+
+static int __init zswap_cpu_buffers_alloc(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		/* LZO can expand incompressible data a little */
+		per_cpu(zswap_dstmem, cpu) = kmalloc_node(PAGE_SIZE * 2,
+						GFP_KERNEL, cpu_to_node(cpu));
+		per_cpu(zswap_workmem, cpu) = vmalloc_node(LZO1X_MEM_COMPRESS,
+						cpu_to_node(cpu));
+		if (!per_cpu(zswap_dstmem, cpu) ||
+		    !per_cpu(zswap_workmem, cpu)) {
+			zswap_cpu_buffers_free();
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+static int __init init_zswap(void)
+{
+	struct frontswap_ops old_ops;
+
+	if (!zswap_enabled)
+		return 0;
+
+	if (zswap_cpu_buffers_alloc()) {
+		pr_err("per-cpu buffer allocation failed\n");
+		return -ENOMEM;
+	}
+	zswap_debugfs_init();
+
+	old_ops = frontswap_register_ops(&zswap_frontswap_ops);
+	if (old_ops.init != NULL)
+		pr_warn("frontswap_ops overridden\n");
+	pr_info("compressed swap cache enabled, pool limit %u%% of RAM\n",
+		zswap_max_pool_percent);
+	return 0;
+}
+module_init(init_zswap)
@@ -84,6 +84,12 @@ static int br_dev_init(struct net_device *dev)
 	if (!br->stats)
 		return -ENOMEM;
 
+	if (br_fdb_hash_init(br)) {
+		free_percpu(br->stats);
+		br->stats = NULL;
+		return -ENOMEM;
+	}
+
 	return 0;
 }
 
@@ -319,6 +325,7 @@ static void br_dev_free(struct net_device *dev)
 	struct net_bridge *br = netdev_priv(dev);
 
 	free_percpu(br->stats);
+	br_fdb_hash_free(br);
 	free_netdev(dev);
 }
 
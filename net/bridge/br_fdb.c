@@ -21,6 +21,8 @@
 #include <linux/jhash.h>
 #include <linux/random.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/module.h>
 #include <linux/atomic.h>
 #include <asm/unaligned.h>
 #include "br_private.h"
@@ -32,6 +34,10 @@ static void fdb_notify(const struct net_bridge_fdb_entry *, int);
 
 static u32 fdb_salt __read_mostly;
 
+static unsigned int fdb_hash_bits __read_mostly = BR_HASH_BITS;
+module_param(fdb_hash_bits, uint, 0644);
+MODULE_PARM_DESC(fdb_hash_bits, "log2 of the forwarding database hash size of new bridges");
+
 int __init br_fdb_init(void)
 {
 	br_fdb_cache = kmem_cache_create("bridge_fdb_cache",
@@ -50,6 +56,31 @@ void br_fdb_fini(void)
 	kmem_cache_destroy(br_fdb_cache);
 }
 
+int br_fdb_hash_init(struct net_bridge *br)
+{
+	unsigned int bits = clamp_t(unsigned int, fdb_hash_bits,
+				    BR_HASH_BITS_MIN, BR_HASH_BITS_MAX);
+	size_t size = sizeof(struct hlist_head) << bits;
+
+	if (size <= PAGE_SIZE)
+		br->hash = kzalloc(size, GFP_KERNEL);
+	else
+		br->hash = vzalloc(size);
+	if (!br->hash)
+		return -ENOMEM;
+
+	br->hash_size = 1 << bits;
+	return 0;
+}
+
+void br_fdb_hash_free(struct net_bridge *br)
+{
+	if (is_vmalloc_addr(br->hash))
+		vfree(br->hash);
+	else
+		kfree(br->hash);
+}
+
 
 /* if topology_changing then use forward_delay (default 15 sec)
  * otherwise keep longer (default 5 minutes)
@@ -66,11 +97,12 @@ static inline int has_expired(const struct net_bridge *br,
 		time_before_eq(fdb->updated + hold_time(br), jiffies);
 }
 
-static inline int br_mac_hash(const unsigned char *mac)
+static inline int br_mac_hash(const struct net_bridge *br,
+			      const unsigned char *mac)
 {
 	/* use 1 byte of OUI cnd 3 bytes of NIC */
 	u32 key = get_unaligned((u32 *)(mac + 2));
-	return jhash_1word(key, fdb_salt) & (BR_HASH_SIZE - 1);
+	return jhash_1word(key, fdb_salt) & (br->hash_size - 1);
 }
 
 static void fdb_rcu_free(struct rcu_head *head)
@@ -95,7 +127,7 @@ void br_fdb_changeaddr(struct net_bridge_port *p, const unsigned char *newaddr)
 	spin_lock_bh(&br->hash_lock);
 
 	/* Search all chains since old address/hash is unknown */
-	for (i = 0; i < BR_HASH_SIZE; i++) {
+	for (i = 0; i < br->hash_size; i++) {
 		struct hlist_node *h;
 		hlist_for_each(h, &br->hash[i]) {
 			struct net_bridge_fdb_entry *f;
@@ -134,7 +166,7 @@ void br_fdb_cleanup(unsigned long _data)
 	int i;
 
 	spin_lock_bh(&br->hash_lock);
-	for (i = 0; i < BR_HASH_SIZE; i++) {
+	for (i = 0; i < br->hash_size; i++) {
 		struct net_bridge_fdb_entry *f;
 		struct hlist_node *h, *n;
 
@@ -160,7 +192,7 @@ void br_fdb_flush(struct net_bridge *br)
 	int i;
 
 	spin_lock_bh(&br->hash_lock);
-	for (i = 0; i < BR_HASH_SIZE; i++) {
+	for (i = 0; i < br->hash_size; i++) {
 		struct net_bridge_fdb_entry *f;
 		struct hlist_node *h, *n;
 		hlist_for_each_entry_safe(f, h, n, &br->hash[i], hlist) {
@@ -181,7 +213,7 @@ void br_fdb_delete_by_port(struct net_bridge *br,
 	int i;
 
 	spin_lock_bh(&br->hash_lock);
-	for (i = 0; i < BR_HASH_SIZE; i++) {
+	for (i = 0; i < br->hash_size; i++) {
 		struct hlist_node *h, *g;
 
 		hlist_for_each_safe(h, g, &br->hash[i]) {
@@ -223,7 +255,7 @@ struct net_bridge_fdb_entry *__br_fdb_get(struct net_bridge *br,
 	struct hlist_node *h;
 	struct net_bridge_fdb_entry *fdb;
 
-	hlist_for_each_entry_rcu(fdb, h, &br->hash[br_mac_hash(addr)], hlist) {
+	hlist_for_each_entry_rcu(fdb, h, &br->hash[br_mac_hash(br, addr)], hlist) {
 		if (!compare_ether_addr(fdb->addr.addr, addr)) {
 			if (unlikely(has_expired(br, fdb)))
 				break;
@@ -273,7 +305,7 @@ int br_fdb_fillbuf(struct net_bridge *br, void *buf,
 	memset(buf, 0, maxnum*sizeof(struct __fdb_entry));
 
 	rcu_read_lock();
-	for (i = 0; i < BR_HASH_SIZE; i++) {
+	for (i = 0; i < br->hash_size; i++) {
 		hlist_for_each_entry_rcu(f, h, &br->hash[i], hlist) {
 			if (num >= maxnum)
 				goto out;
@@ -355,7 +387,7 @@ static struct net_bridge_fdb_entry *fdb_create(struct hlist_head *head,
 static int fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 		  const unsigned char *addr)
 {
-	struct hlist_head *head = &br->hash[br_mac_hash(addr)];
+	struct hlist_head *head = &br->hash[br_mac_hash(br, addr)];
 	struct net_bridge_fdb_entry *fdb;
 
 	if (!is_valid_ether_addr(addr))
@@ -397,7 +429,7 @@ int br_fdb_insert(struct net_bridge *br, struct net_bridge_port *source,
 void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 		   const unsigned char *addr)
 {
-	struct hlist_head *head = &br->hash[br_mac_hash(addr)];
+	struct hlist_head *head = &br->hash[br_mac_hash(br, addr)];
 	struct net_bridge_fdb_entry *fdb;
 
 	/* some users want to always flood. */
@@ -418,9 +450,18 @@ void br_fdb_update(struct net_bridge *br, struct net_bridge_port *source,
 					"own address as source address\n",
 					source->dev->name);
 		} else {
-			/* fastpath: update of existing entry */
-			fdb->dst = source;
-			fdb->updated = jiffies;
+			/* fastpath: update of existing entry.  Every rx cpu
+			 * passes here for every frame, so only write to the
+			 * shared entry when something changed or the
+			 * timestamp has become noticeably stale.
+			 */
+			unsigned long now = jiffies;
+
+			if (unlikely(source != fdb->dst))
+				fdb->dst = source;
+			if (unlikely(time_after(now, fdb->updated +
+						BR_FDB_REFRESH_INTERVAL)))
+				fdb->updated = now;
 		}
 	} else {
 		spin_lock(&br->hash_lock);
@@ -530,7 +571,7 @@ int br_fdb_dump(struct sk_buff *skb, struct netlink_callback *cb)
 		if (!(dev->priv_flags & IFF_EBRIDGE))
 			continue;
 
-		for (i = 0; i < BR_HASH_SIZE; i++) {
+		for (i = 0; i < br->hash_size; i++) {
 			struct hlist_node *h;
 			struct net_bridge_fdb_entry *f;
 
@@ -561,7 +602,7 @@ static int fdb_add_entry(struct net_bridge_port *source, const __u8 *addr,
 			 __u16 state, __u16 flags)
 {
 	struct net_bridge *br = source->br;
-	struct hlist_head *head = &br->hash[br_mac_hash(addr)];
+	struct hlist_head *head = &br->hash[br_mac_hash(br, addr)];
 	struct net_bridge_fdb_entry *fdb;
 
 	fdb = fdb_find(head, addr);
@@ -644,7 +685,7 @@ int br_fdb_add(struct sk_buff *skb, struct nlmsghdr *nlh, void *arg)
 static int fdb_delete_by_addr(struct net_bridge_port *p, const u8 *addr)
 {
 	struct net_bridge *br = p->br;
-	struct hlist_head *head = &br->hash[br_mac_hash(addr)];
+	struct hlist_head *head = &br->hash[br_mac_hash(br, addr)];
 	struct net_bridge_fdb_entry *fdb;
 
 	fdb = fdb_find(head, addr);
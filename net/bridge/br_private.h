@@ -21,6 +21,11 @@
 
 #define BR_HASH_BITS 8
 #define BR_HASH_SIZE (1 << BR_HASH_BITS)
+#define BR_HASH_BITS_MIN 4
+#define BR_HASH_BITS_MAX 16
+
+/* granularity of the ageing timestamp refreshed by received frames */
+#define BR_FDB_REFRESH_INTERVAL (HZ / 10)
 
 #define BR_HOLD_TIME (1*HZ)
 
@@ -184,7 +189,8 @@ struct net_bridge
 
 	struct br_cpu_netstats __percpu *stats;
 	spinlock_t			hash_lock;
-	struct hlist_head		hash[BR_HASH_SIZE];
+	struct hlist_head		*hash;
+	unsigned int			hash_size;
 #ifdef CONFIG_BRIDGE_NETFILTER
 	struct rtable 			fake_rtable;
 	bool				nf_call_iptables;
@@ -341,6 +347,8 @@ static inline void br_netpoll_disable(struct net_bridge_port *p)
 /* br_fdb.c */
 extern int br_fdb_init(void);
 extern void br_fdb_fini(void);
+extern int br_fdb_hash_init(struct net_bridge *br);
+extern void br_fdb_hash_free(struct net_bridge *br);
 extern void br_fdb_flush(struct net_bridge *br);
 extern void br_fdb_changeaddr(struct net_bridge_port *p,
 			      const unsigned char *newaddr);
@@ -827,14 +827,6 @@ static void __register_request(struct ceph_osd_client *osdc,
 	}
 }
 
-static void register_request(struct ceph_osd_client *osdc,
-			     struct ceph_osd_request *req)
-{
-	mutex_lock(&osdc->request_mutex);
-	__register_request(osdc, req);
-	mutex_unlock(&osdc->request_mutex);
-}
-
 /*
  * called under osdc->request_mutex
  */
@@ -1703,15 +1695,14 @@ int ceph_osdc_start_request(struct ceph_osd_client *osdc,
 #endif
 	req->r_request->trail = req->r_trail;
 
-	register_request(osdc, req);
-
-	down_read(&osdc->map_sem);
-	mutex_lock(&osdc->request_mutex);
 	/*
-	 * a racing kick_requests() may have sent the message for us
-	 * while we dropped request_mutex above, so only send now if
-	 * the request still han't been touched yet.
+	 * register, map and send in one request_mutex section; every
+	 * in-flight request of every rbd image and cephfs file passes
+	 * through here.
 	 */
+	down_read(&osdc->map_sem);
+	mutex_lock(&osdc->request_mutex);
+	__register_request(osdc, req);
 	if (req->r_sent == 0) {
 		rc = __map_request(osdc, req, 0);
 		if (rc < 0) {
@@ -61,6 +61,9 @@ static void neigh_update_notify(struct neighbour *neigh);
 static int pneigh_ifdown(struct neigh_table *tbl, struct net_device *dev);
 
 static struct neigh_table *neigh_tables;
+
+/* Number of neigh_periodic_work() runs needed to walk the whole table */
+#define NEIGH_GC_SLICES		16
 #ifdef CONFIG_PROC_FS
 static const struct file_operations neigh_stat_seq_fops;
 #endif
@@ -313,20 +316,21 @@ out_entries:
 	goto out;
 }
 
-static struct neigh_hash_table *neigh_hash_alloc(unsigned int shift)
+static struct neigh_hash_table *neigh_hash_alloc(unsigned int shift,
+						 gfp_t gfp)
 {
 	size_t size = (1 << shift) * sizeof(struct neighbour *);
 	struct neigh_hash_table *ret;
 	struct neighbour __rcu **buckets;
 
-	ret = kmalloc(sizeof(*ret), GFP_ATOMIC);
+	ret = kmalloc(sizeof(*ret), gfp);
 	if (!ret)
 		return NULL;
 	if (size <= PAGE_SIZE)
-		buckets = kzalloc(size, GFP_ATOMIC);
+		buckets = kzalloc(size, gfp);
 	else
 		buckets = (struct neighbour __rcu **)
-			  __get_free_pages(GFP_ATOMIC | __GFP_ZERO,
+			  __get_free_pages(gfp | __GFP_ZERO,
 					   get_order(size));
 	if (!buckets) {
 		kfree(ret);
@@ -354,19 +358,16 @@ static void neigh_hash_free_rcu(struct rcu_head *head)
 	kfree(nht);
 }
 
-static struct neigh_hash_table *neigh_hash_grow(struct neigh_table *tbl,
-						unsigned long new_shift)
+static void neigh_hash_grow(struct neigh_table *tbl,
+			    struct neigh_hash_table *new_nht)
 {
 	unsigned int i, hash;
-	struct neigh_hash_table *new_nht, *old_nht;
+	struct neigh_hash_table *old_nht;
 
 	NEIGH_CACHE_STAT_INC(tbl, hash_grows);
 
 	old_nht = rcu_dereference_protected(tbl->nht,
 					    lockdep_is_held(&tbl->lock));
-	new_nht = neigh_hash_alloc(new_shift);
-	if (!new_nht)
-		return old_nht;
 
 	for (i = 0; i < (1 << old_nht->hash_shift); i++) {
 		struct neighbour *n, *next;
@@ -392,7 +393,39 @@ static struct neigh_hash_table *neigh_hash_grow(struct neigh_table *tbl,
 
 	rcu_assign_pointer(tbl->nht, new_nht);
 	call_rcu(&old_nht->rcu, neigh_hash_free_rcu);
-	return new_nht;
+}
+
+/*
+ * Growing the hash table is deferred to process context: the new table
+ * is sized for the current population in one step and allocated without
+ * tbl->lock held, so a burst of neigh_create() calls from softirq never
+ * has to rehash the table or do a high order GFP_ATOMIC allocation.
+ * Lookups are RCU protected and keep using the old table until the new
+ * one is published.
+ */
+static void neigh_hash_work(struct work_struct *work)
+{
+	struct neigh_table *tbl = container_of(work, struct neigh_table,
+					       hash_work);
+	struct neigh_hash_table *nht, *new_nht;
+	unsigned int shift;
+
+	shift = fls(atomic_read(&tbl->entries));
+	new_nht = neigh_hash_alloc(shift, GFP_KERNEL);
+	if (!new_nht)
+		return;
+
+	write_lock_bh(&tbl->lock);
+	nht = rcu_dereference_protected(tbl->nht,
+					lockdep_is_held(&tbl->lock));
+	if (nht->hash_shift < shift) {
+		neigh_hash_grow(tbl, new_nht);
+		new_nht = NULL;
+	}
+	write_unlock_bh(&tbl->lock);
+
+	if (new_nht)
+		neigh_hash_free_rcu(&new_nht->rcu);
 }
 
 struct neighbour *neigh_lookup(struct neigh_table *tbl, const void *pkey,
@@ -494,7 +527,7 @@ struct neighbour *neigh_create(struct neigh_table *tbl, const void *pkey,
 					lockdep_is_held(&tbl->lock));
 
 	if (atomic_read(&tbl->entries) > (1 << nht->hash_shift))
-		nht = neigh_hash_grow(tbl, nht->hash_shift + 1);
+		schedule_work(&tbl->hash_work);
 
 	hash_val = tbl->hash(pkey, dev, nht->hash_rnd) >> (32 - nht->hash_shift);
 
@@ -744,7 +777,7 @@ static void neigh_periodic_work(struct work_struct *work)
 	struct neigh_table *tbl = container_of(work, struct neigh_table, gc_work.work);
 	struct neighbour *n;
 	struct neighbour __rcu **np;
-	unsigned int i;
+	unsigned int budget;
 	struct neigh_hash_table *nht;
 
 	NEIGH_CACHE_STAT_INC(tbl, periodic_gc_runs);
@@ -765,8 +798,16 @@ static void neigh_periodic_work(struct work_struct *work)
 				neigh_rand_reach_time(p->base_reachable_time);
 	}
 
-	for (i = 0 ; i < (1 << nht->hash_shift); i++) {
-		np = &nht->hash_buckets[i];
+	/* Only a slice of the buckets is scanned per run, so that a large
+	 * table does not hold tbl->lock for a full pass at once.
+	 */
+	budget = max_t(unsigned int,
+		       (1 << nht->hash_shift) / NEIGH_GC_SLICES, 1);
+	if (tbl->gc_bucket >= (1 << nht->hash_shift))
+		tbl->gc_bucket = 0;
+
+	for (; budget; budget--) {
+		np = &nht->hash_buckets[tbl->gc_bucket];
 
 		while ((n = rcu_dereference_protected(*np,
 				lockdep_is_held(&tbl->lock))) != NULL) {
@@ -806,13 +847,19 @@ next_elt:
 		write_lock_bh(&tbl->lock);
 		nht = rcu_dereference_protected(tbl->nht,
 						lockdep_is_held(&tbl->lock));
+		if (++tbl->gc_bucket >= (1 << nht->hash_shift)) {
+			tbl->gc_bucket = 0;
+			break;
+		}
 	}
 	/* Cycle through all hash buckets every base_reachable_time/2 ticks.
 	 * ARP entry timeouts range from 1/2 base_reachable_time to 3/2
 	 * base_reachable_time.
 	 */
 	schedule_delayed_work(&tbl->gc_work,
-			      tbl->parms.base_reachable_time >> 1);
+			      max_t(unsigned long,
+				    (tbl->parms.base_reachable_time >> 1) /
+				    NEIGH_GC_SLICES, 1));
 	write_unlock_bh(&tbl->lock);
 }
 
@@ -1494,7 +1541,7 @@ void neigh_table_init_no_netlink(struct neigh_table *tbl)
 		panic("cannot create neighbour proc dir entry");
 #endif
 
-	RCU_INIT_POINTER(tbl->nht, neigh_hash_alloc(3));
+	RCU_INIT_POINTER(tbl->nht, neigh_hash_alloc(3, GFP_KERNEL));
 
 	phsize = (PNEIGH_HASHMASK + 1) * sizeof(struct pneigh_entry *);
 	tbl->phash_buckets = kzalloc(phsize, GFP_KERNEL);
@@ -1504,6 +1551,7 @@ void neigh_table_init_no_netlink(struct neigh_table *tbl)
 
 	rwlock_init(&tbl->lock);
 	INIT_DELAYED_WORK_DEFERRABLE(&tbl->gc_work, neigh_periodic_work);
+	INIT_WORK(&tbl->hash_work, neigh_hash_work);
 	schedule_delayed_work(&tbl->gc_work, tbl->parms.reachable_time);
 	setup_timer(&tbl->proxy_timer, neigh_proxy_process, (unsigned long)tbl);
 	skb_queue_head_init_class(&tbl->proxy_queue,
@@ -1542,6 +1590,7 @@ int neigh_table_clear(struct neigh_table *tbl)
 
 	/* It is not clean... Fix it to unload IPv6 module safely */
 	cancel_delayed_work_sync(&tbl->gc_work);
+	cancel_work_sync(&tbl->hash_work);
 	del_timer_sync(&tbl->proxy_timer);
 	pneigh_queue_purge(&tbl->proxy_queue);
 	neigh_ifdown(tbl, NULL);
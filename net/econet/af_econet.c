@@ -287,7 +287,7 @@ static int econet_sendmsg(struct kiocb *iocb, struct socket *sock,
 	 *	Check the flags.
 	 */
 
-	if (msg->msg_flags & ~(MSG_DONTWAIT|MSG_CMSG_COMPAT))
+	if (msg->msg_flags & ~(MSG_DONTWAIT|MSG_BATCH|MSG_CMSG_COMPAT))
 		return -EINVAL;
 
 	/*
@@ -17,6 +17,8 @@
 #include <linux/in.h>
 #include <linux/ip.h>
 #include <linux/netdevice.h>
+#include <linux/etherdevice.h>
+#include <linux/if_tunnel.h>
 #include <linux/spinlock.h>
 #include <net/protocol.h>
 #include <net/gre.h>
@@ -110,10 +112,221 @@ static void gre_err(struct sk_buff *skb, u32 info)
 	rcu_read_unlock();
 }
 
+static struct sk_buff *gre_gso_segment(struct sk_buff *skb, u32 features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	const struct gre_base_hdr *greh;
+	__be16 protocol = skb->protocol;
+	int mac_len = skb->mac_len;
+	int mac_offset = skb_mac_header(skb) - skb->data;
+	int nh_offset = skb_network_offset(skb);
+	unsigned int ghl = sizeof(*greh);
+	unsigned int inner_mac_len = 0;
+	unsigned int tnl_hlen;
+	u32 enc_features;
+
+	if (unlikely(skb_shinfo(skb)->gso_type &
+		     ~(SKB_GSO_TCPV4 |
+		       SKB_GSO_TCPV6 |
+		       SKB_GSO_DODGY |
+		       SKB_GSO_TCP_ECN |
+		       SKB_GSO_GRE |
+		       0)))
+		goto out;
+
+	if (unlikely(!pskb_may_pull(skb, ghl)))
+		goto out;
+
+	/* Every segment gets a copy of the same GRE header, so neither
+	 * checksums nor sequence numbers can be generated here.
+	 */
+	greh = (struct gre_base_hdr *)skb->data;
+	if (greh->flags & ~GRE_KEY)
+		goto out;
+
+	if (greh->flags & GRE_KEY)
+		ghl += GRE_HEADER_SECTION;
+	if (greh->protocol == htons(ETH_P_TEB))
+		inner_mac_len = ETH_HLEN;
+
+	if (unlikely(!pskb_may_pull(skb, ghl + inner_mac_len)))
+		goto out;
+
+	greh = (struct gre_base_hdr *)skb->data;
+	if (inner_mac_len)
+		skb->protocol = ((struct ethhdr *)(skb->data + ghl))->h_proto;
+	else
+		skb->protocol = greh->protocol;
+
+	/* Set up the inner packet as if it were the whole skb */
+	skb_shinfo(skb)->gso_type &= ~SKB_GSO_GRE;
+	__skb_pull(skb, ghl);
+	skb_reset_mac_header(skb);
+	skb_set_network_header(skb, inner_mac_len);
+	skb->mac_len = inner_mac_len;
+	tnl_hlen = skb_tnl_header_len(skb);
+
+	/* Only hardware that takes csum_start literally can complete the
+	 * inner checksum behind our headers; otherwise have it done now.
+	 */
+	if (features & NETIF_F_GEN_CSUM)
+		enc_features = features & (NETIF_F_SG | NETIF_F_GEN_CSUM);
+	else
+		enc_features = 0;
+
+	segs = skb_mac_gso_segment(skb, enc_features);
+	if (!segs || IS_ERR(segs)) {
+		__skb_push(skb, ghl);
+		skb_set_mac_header(skb, mac_offset);
+		skb_set_network_header(skb, nh_offset);
+		skb_reset_transport_header(skb);
+		skb->mac_len = mac_len;
+		skb->protocol = protocol;
+		skb_shinfo(skb)->gso_type |= SKB_GSO_GRE;
+		goto out;
+	}
+
+	skb = segs;
+	do {
+		__skb_push(skb, tnl_hlen);
+		skb_reset_mac_header(skb);
+		skb_set_network_header(skb, mac_len);
+		skb->mac_len = mac_len;
+		skb->protocol = protocol;
+	} while ((skb = skb->next));
+out:
+	return segs;
+}
+
+static struct sk_buff **gre_gro_receive(struct sk_buff **head,
+					struct sk_buff *skb)
+{
+	struct sk_buff **pp = NULL;
+	struct sk_buff *p;
+	const struct gre_base_hdr *greh;
+	const struct ethhdr *eh = NULL;
+	struct packet_type *ptype;
+	unsigned int hlen, grehlen;
+	unsigned int off;
+	int flush = 1;
+	__be16 type;
+	__wsum csum;
+
+	off = skb_gro_offset(skb);
+	hlen = off + sizeof(*greh);
+	greh = skb_gro_header_fast(skb, off);
+	if (skb_gro_header_hard(skb, hlen)) {
+		greh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!greh))
+			goto out;
+	}
+
+	/* Only version 0 with an optional key is aggregated: checksum and
+	 * sequence number would otherwise have to be checked per packet.
+	 */
+	if (greh->flags & ~GRE_KEY)
+		goto out;
+
+	grehlen = sizeof(*greh);
+	if (greh->flags & GRE_KEY)
+		grehlen += GRE_HEADER_SECTION;
+	type = greh->protocol;
+	if (type == htons(ETH_P_TEB))
+		hlen = off + grehlen + ETH_HLEN;
+	else
+		hlen = off + grehlen;
+
+	if (skb_gro_header_hard(skb, hlen)) {
+		greh = skb_gro_header_slow(skb, hlen, off);
+		if (unlikely(!greh))
+			goto out;
+	}
+
+	if (type == htons(ETH_P_TEB)) {
+		eh = (const struct ethhdr *)((u8 *)greh + grehlen);
+		type = eh->h_proto;
+	}
+
+	rcu_read_lock();
+	ptype = gro_find_receive_by_type(type);
+	if (!ptype)
+		goto out_unlock;
+
+	flush = 0;
+
+	for (p = *head; p; p = p->next) {
+		const struct gre_base_hdr *greh2;
+
+		if (!NAPI_GRO_CB(p)->same_flow)
+			continue;
+
+		greh2 = (struct gre_base_hdr *)(p->data + off);
+
+		if (greh2->flags != greh->flags ||
+		    greh2->protocol != greh->protocol ||
+		    ((greh->flags & GRE_KEY) &&
+		     *(__be32 *)(greh2 + 1) != *(__be32 *)(greh + 1)) ||
+		    (eh && compare_ether_header((u8 *)greh2 + grehlen, eh))) {
+			NAPI_GRO_CB(p)->same_flow = 0;
+			continue;
+		}
+	}
+
+	skb_gro_pull(skb, hlen - off);
+
+	/* The inner checksum is verified against skb->csum */
+	csum = skb->csum;
+	skb_postpull_rcsum(skb, greh, hlen - off);
+
+	pp = ptype->gro_receive(head, skb);
+
+	skb->csum = csum;
+
+out_unlock:
+	rcu_read_unlock();
+out:
+	NAPI_GRO_CB(skb)->flush |= flush;
+
+	return pp;
+}
+
+static int gre_gro_complete(struct sk_buff *skb, int nhoff)
+{
+	struct gre_base_hdr *greh = (struct gre_base_hdr *)(skb->data + nhoff);
+	struct packet_type *ptype;
+	unsigned int grehlen = sizeof(*greh);
+	__be16 type = greh->protocol;
+	int err = -ENOENT;
+
+	if (greh->flags & GRE_KEY)
+		grehlen += GRE_HEADER_SECTION;
+
+	if (type == htons(ETH_P_TEB)) {
+		struct ethhdr *eh = (struct ethhdr *)(skb->data + nhoff +
+						      grehlen);
+
+		type = eh->h_proto;
+		grehlen += ETH_HLEN;
+	}
+
+	rcu_read_lock();
+	ptype = gro_find_complete_by_type(type);
+	if (ptype)
+		err = ptype->gro_complete(skb, nhoff + grehlen);
+	rcu_read_unlock();
+
+	skb_shinfo(skb)->gso_type |= SKB_GSO_GRE;
+
+	return err;
+}
+
 static const struct net_protocol net_gre_protocol = {
-	.handler     = gre_rcv,
-	.err_handler = gre_err,
-	.netns_ok    = 1,
+	.handler      = gre_rcv,
+	.err_handler  = gre_err,
+	.gso_segment  = gre_gso_segment,
+	.gro_receive  = gre_gro_receive,
+	.gro_complete = gre_gro_complete,
+	.netns_ok     = 1,
 };
 
 static int __init gre_init(void)
@@ -481,6 +481,9 @@ relookup:
 		p->pmtu_expires = 0;
 		p->pmtu_orig = 0;
 		memset(&p->redirect_learned, 0, sizeof(p->redirect_learned));
+		p->tcp_fastopen_mss = 0;
+		p->tcp_fastopen_syn_loss = 0;
+		p->tcp_fastopen_cookie.len = 0;
 		INIT_LIST_HEAD(&p->gc_list);
 
 		/* Link the node. */
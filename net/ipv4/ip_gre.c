@@ -123,6 +123,15 @@ static int ipgre_tunnel_init(struct net_device *dev);
 static void ipgre_tunnel_setup(struct net_device *dev);
 static int ipgre_tunnel_bind_dev(struct net_device *dev);
 
+/* Offloads a tunnel can take from the stack: GSO frames are marked
+ * SKB_GSO_GRE and cut on the underlying device, and gso_max_size leaves
+ * room for the outer IP, GRE+key and inner Ethernet headers within the
+ * 64K an outer IP header can describe.
+ */
+#define GRE_FEATURES	(NETIF_F_SG | NETIF_F_HW_CSUM | NETIF_F_HIGHDMA | \
+			 NETIF_F_ALL_TSO)
+#define GRE_GSO_MAX_SIZE (GSO_MAX_SIZE - sizeof(struct iphdr) - 8 - ETH_HLEN)
+
 /* Fallback tunnel: no source, no destination, no key, no options */
 
 #define HASH_SIZE  16
@@ -626,6 +635,8 @@ static int ipgre_rcv(struct sk_buff *skb)
 		__pskb_pull(skb, offset);
 		skb_postpull_rcsum(skb, skb_transport_header(skb), offset);
 		skb->pkt_type = PACKET_HOST;
+		/* A GRO aggregate is an ordinary GSO frame once decapsulated */
+		skb_shinfo(skb)->gso_type &= ~SKB_GSO_GRE;
 #ifdef CONFIG_NET_IPGRE_BROADCAST
 		if (ipv4_is_multicast(iph->daddr)) {
 			/* Looped back packet, drop it! */
@@ -716,6 +727,29 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 		tiph = &tunnel->parms.iph;
 	}
 
+	/* Send an aggregate on as individual segments if the outer tot_len
+	 * cannot describe it (e.g. forwarded GRO traffic) or the GRE header
+	 * differs per segment (options changed after the features were set).
+	 */
+	if (skb_is_gso(skb) &&
+	    (skb->len + gre_hlen > 0xFFFF ||
+	     (tunnel->parms.o_flags & (GRE_CSUM | GRE_SEQ)))) {
+		struct sk_buff *segs;
+
+		segs = skb_gso_segment(skb, dev->features & ~NETIF_F_GSO_MASK);
+		if (IS_ERR(segs) || !segs)
+			goto tx_error;
+		dev_kfree_skb(skb);
+
+		while (segs) {
+			skb = segs;
+			segs = segs->next;
+			skb->next = NULL;
+			ipgre_tunnel_xmit(skb, dev);
+		}
+		return NETDEV_TX_OK;
+	}
+
 	memset(&(IPCB(skb)->opt), 0, sizeof(IPCB(skb)->opt));
 	if ((dst = tiph->daddr) == 0) {
 		/* NBMA tunnel */
@@ -793,7 +827,7 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 	if (skb->protocol == htons(ETH_P_IP)) {
 		df |= (old_iph->frag_off&htons(IP_DF));
 
-		if ((old_iph->frag_off&htons(IP_DF)) &&
+		if ((old_iph->frag_off&htons(IP_DF)) && !skb_is_gso(skb) &&
 		    mtu < ntohs(old_iph->tot_len)) {
 			icmp_send(skb, ICMP_DEST_UNREACH, ICMP_FRAG_NEEDED, htonl(mtu));
 			ip_rt_put(rt);
@@ -813,7 +847,8 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 			}
 		}
 
-		if (mtu >= IPV6_MIN_MTU && mtu < skb->len - tunnel->hlen + gre_hlen) {
+		if (mtu >= IPV6_MIN_MTU && !skb_is_gso(skb) &&
+		    mtu < skb->len - tunnel->hlen + gre_hlen) {
 			icmpv6_send(skb, ICMPV6_PKT_TOOBIG, 0, mtu);
 			ip_rt_put(rt);
 			goto tx_error;
@@ -831,6 +866,24 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 			tunnel->err_count = 0;
 	}
 
+	if (skb_is_gso(skb)) {
+		/* gso_type lives in the shared info, keep clones out of it */
+		if (skb_cloned(skb) && pskb_expand_head(skb, 0, 0, GFP_ATOMIC)) {
+			ip_rt_put(rt);
+			dev->stats.tx_dropped++;
+			dev_kfree_skb(skb);
+			return NETDEV_TX_OK;
+		}
+		skb_shinfo(skb)->gso_type |= SKB_GSO_GRE;
+		old_iph = ip_hdr(skb);
+	} else if (skb->ip_summed == CHECKSUM_PARTIAL &&
+		   skb_checksum_help(skb)) {
+		ip_rt_put(rt);
+		dev->stats.tx_dropped++;
+		dev_kfree_skb(skb);
+		return NETDEV_TX_OK;
+	}
+
 	max_headroom = LL_RESERVED_SPACE(tdev) + gre_hlen + rt->dst.header_len;
 
 	if (skb_headroom(skb) < max_headroom || skb_shared(skb)||
@@ -1262,6 +1315,24 @@ static void ipgre_tunnel_setup(struct net_device *dev)
 	dev->priv_flags		&= ~IFF_XMIT_DST_RELEASE;
 }
 
+/* Segmentation offload needs an identical GRE header on every segment,
+ * which rules out checksums and sequence numbers.  Broadcast and NBMA
+ * tunnels build the outer header in header_ops and are left alone too.
+ */
+static void ipgre_tunnel_set_features(struct net_device *dev)
+{
+	struct ip_tunnel *tunnel = netdev_priv(dev);
+
+	if (tunnel->parms.o_flags & (GRE_CSUM | GRE_SEQ))
+		return;
+	if (dev->type == ARPHRD_IPGRE && dev->header_ops)
+		return;
+
+	dev->features		|= GRE_FEATURES;
+	dev->hw_features	|= GRE_FEATURES;
+	netif_set_gso_max_size(dev, GRE_GSO_MAX_SIZE);
+}
+
 static int ipgre_tunnel_init(struct net_device *dev)
 {
 	struct ip_tunnel *tunnel;
@@ -1288,6 +1359,8 @@ static int ipgre_tunnel_init(struct net_device *dev)
 	} else
 		dev->header_ops = &ipgre_header_ops;
 
+	ipgre_tunnel_set_features(dev);
+
 	dev->tstats = alloc_percpu(struct pcpu_tstats);
 	if (!dev->tstats)
 		return -ENOMEM;
@@ -1477,6 +1550,7 @@ static int ipgre_tap_init(struct net_device *dev)
 	strcpy(tunnel->parms.name, dev->name);
 
 	ipgre_tunnel_bind_dev(dev);
+	ipgre_tunnel_set_features(dev);
 
 	dev->tstats = alloc_percpu(struct pcpu_tstats);
 	if (!dev->tstats)
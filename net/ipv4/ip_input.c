@@ -314,11 +314,29 @@ drop:
 	return -1;
 }
 
+int sysctl_ip_early_demux __read_mostly = 1;
+
 static int ip_rcv_finish(struct sk_buff *skb)
 {
 	const struct iphdr *iph = ip_hdr(skb);
 	struct rtable *rt;
 
+	/*
+	 *	Let the transport protocol find the socket first; it may
+	 *	attach the input route cached by that socket.
+	 */
+	if (sysctl_ip_early_demux && !skb_dst(skb) && !skb->sk) {
+		const struct net_protocol *ipprot;
+
+		rcu_read_lock();
+		ipprot = rcu_dereference(inet_protos[iph->protocol]);
+		if (ipprot && ipprot->early_demux)
+			ipprot->early_demux(skb);
+		rcu_read_unlock();
+		/* pskb_may_pull() may have moved the header */
+		iph = ip_hdr(skb);
+	}
+
 	/*
 	 *	Initialise the virtual path cache for the packet. It describes
 	 *	how the packet travels inside Linux networking.
@@ -518,12 +518,14 @@ static int ping_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 	ipc.opt = NULL;
 	ipc.oif = sk->sk_bound_dev_if;
 	ipc.tx_flags = 0;
+	ipc.gso_size = 0;
+	ipc.sockc.transmit_time = 0;
 	err = sock_tx_timestamp(sk, &ipc.tx_flags);
 	if (err)
 		return err;
 
 	if (msg->msg_controllen) {
-		err = ip_cmsg_send(sock_net(sk), msg, &ipc);
+		err = ip_cmsg_send(sk, msg, &ipc);
 		if (err)
 			return err;
 		if (ipc.opt)
@@ -133,6 +133,7 @@ static int ip_rt_mtu_expires __read_mostly	= 10 * 60 * HZ;
 static int ip_rt_min_pmtu __read_mostly		= 512 + 20 + 20;
 static int ip_rt_min_advmss __read_mostly	= 256;
 static int rt_chain_length_max __read_mostly	= 20;
+static int ip_rt_nocache __read_mostly;
 static int redirect_genid;
 
 static struct delayed_work expires_work;
@@ -729,6 +730,16 @@ static inline bool rt_caching(const struct net *net)
 		net->ipv4.sysctl_rt_cache_rebuild_count;
 }
 
+/*
+ * Input routes bypass the hash when the administrator asked for it, or when
+ * emergency rebuilds disabled caching for this namespace.  Forwarded
+ * traffic then relies on the per-cpu dst kept in each nexthop.
+ */
+static inline bool rt_input_nocache(const struct net *net)
+{
+	return ip_rt_nocache || !rt_caching(net);
+}
+
 static inline bool compare_hash_inputs(const struct rtable *rt1,
 				       const struct rtable *rt2)
 {
@@ -1187,7 +1198,8 @@ restart:
 	candp = NULL;
 	now = jiffies;
 
-	if (!rt_caching(dev_net(rt->dst.dev))) {
+	if (!rt_caching(dev_net(rt->dst.dev)) ||
+	    (ip_rt_nocache && rt_is_input_route(rt))) {
 		/*
 		 * If we're not caching, just tell the caller we
 		 * were successful and don't touch the route.  The
@@ -2163,6 +2175,51 @@ static void ip_handle_martian_source(struct net_device *dev,
 #endif
 }
 
+/*
+ * A forwarding dst can be shared by every flow using a nexthop only if
+ * nothing in it depends on the source address: the nexthop must be a
+ * gateway (rt_gateway would otherwise be the packet's destination),
+ * no redirect may be pending and no source based classid applies.
+ */
+static bool rt_nh_cacheable(const struct fib_result *res,
+			    unsigned int flags, u32 itag)
+{
+	if (!res->fi || !FIB_RES_GW(*res) ||
+	    FIB_RES_NH(*res).nh_scope != RT_SCOPE_LINK)
+		return false;
+	if (flags & RTCF_DOREDIRECT)
+		return false;
+#ifdef CONFIG_IP_ROUTE_CLASSID
+	if (itag)
+		return false;
+#ifdef CONFIG_IP_MULTIPLE_TABLES
+	if (fib_rules_tclass(res))
+		return false;
+#endif
+#endif
+	return true;
+}
+
+/* called in rcu_read_lock() section */
+static struct rtable *rt_nh_cache_get(struct fib_nh *nh)
+{
+	return rcu_dereference(*__this_cpu_ptr(nh->nh_pcpu_rth_input));
+}
+
+static bool rt_nh_cache_set(struct fib_nh *nh, struct rtable *rt)
+{
+	struct rtable **p = (struct rtable **)__this_cpu_ptr(nh->nh_pcpu_rth_input);
+	struct rtable *orig, *prev;
+
+	orig = *p;
+	prev = cmpxchg(p, orig, rt);
+	if (prev != orig)
+		return false;
+	if (orig)
+		rt_free(orig);
+	return true;
+}
+
 /* called in rcu_read_lock() section */
 static int __mkroute_input(struct sk_buff *skb,
 			   const struct fib_result *res,
@@ -2176,6 +2233,7 @@ static int __mkroute_input(struct sk_buff *skb,
 	unsigned int flags = 0;
 	__be32 spec_dst;
 	u32 itag = 0;
+	bool do_cache;
 
 	/* get a working reference to the output device */
 	out_dev = __in_dev_get_rcu(FIB_RES_DEV(*res));
@@ -2219,6 +2277,22 @@ static int __mkroute_input(struct sk_buff *skb,
 		}
 	}
 
+	do_cache = rt_input_nocache(dev_net(in_dev->dev)) &&
+		   rt_nh_cacheable(res, flags, itag);
+	if (do_cache) {
+		rth = rt_nh_cache_get(&FIB_RES_NH(*res));
+		if (rth && !rt_is_expired(rth) &&
+		    rth->rt_iif == in_dev->dev->ifindex &&
+		    rth->rt_flags == flags &&
+		    rth->rt_spec_dst == spec_dst) {
+			dst_use(&rth->dst, jiffies);
+			skb_dst_set(skb, &rth->dst);
+			RT_CACHE_STAT_INC(in_hit);
+			*result = NULL;
+			return 0;
+		}
+	}
+
 	rth = rt_dst_alloc(out_dev->dev,
 			   IN_DEV_CONF_GET(in_dev, NOPOLICY),
 			   IN_DEV_CONF_GET(out_dev, NOXFRM));
@@ -2250,6 +2324,23 @@ static int __mkroute_input(struct sk_buff *skb,
 
 	rt_set_nexthop(rth, NULL, res, res->fi, res->type, itag);
 
+	if (do_cache) {
+		/* Shared by all flows: key the inetpeer on the gateway. */
+		rth->rt_key_dst	= rth->rt_dst = FIB_RES_GW(*res);
+		rth->rt_key_src	= rth->rt_src = 0;
+
+		err = rt_bind_neighbour(rth);
+		if (err) {
+			rth->dst.flags |= DST_NOCACHE;
+			ip_rt_put(rth);
+			goto cleanup;
+		}
+		if (!rt_nh_cache_set(&FIB_RES_NH(*res), rth))
+			rth->dst.flags |= DST_NOCACHE;
+		skb_dst_set(skb, &rth->dst);
+		rth = NULL;
+	}
+
 	*result = rth;
 	err = 0;
  cleanup:
@@ -2276,6 +2367,10 @@ static int ip_mkroute_input(struct sk_buff *skb,
 	if (err)
 		return err;
 
+	/* attached from the nexthop's per-cpu dst */
+	if (!rth)
+		return 0;
+
 	/* put it into the cache */
 	hash = rt_hash(daddr, saddr, fl4->flowi4_iif,
 		       rt_genid(dev_net(rth->dst.dev)));
@@ -2490,7 +2585,7 @@ int ip_route_input_common(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 
 	rcu_read_lock();
 
-	if (!rt_caching(net))
+	if (rt_input_nocache(net))
 		goto skip_cache;
 
 	tos &= IPTOS_RT_MASK;
@@ -3377,6 +3472,13 @@ static ctl_table ipv4_route_table[] = {
 		.mode		= 0644,
 		.proc_handler	= proc_dointvec,
 	},
+	{
+		.procname	= "nocache",
+		.data		= &ip_rt_nocache,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec,
+	},
 	{ }
 };
 
@@ -0,0 +1,121 @@
+/*
+ * TCP Fast Open: send and accept data in the SYN of a repeat connection.
+ *
+ * A server hands out a cookie bound to the client address in the SYN-ACK
+ * of a regular handshake.  A client that presents a valid cookie in a
+ * later SYN has the data carried in that SYN delivered to the listener
+ * right away, saving a round trip.  Clients keep the cookies they are
+ * given in the inet_peer cache, together with the MSS of the server.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/random.h>
+#include <linux/cryptohash.h>
+#include <linux/seqlock.h>
+#include <net/inetpeer.h>
+#include <net/tcp.h>
+
+int sysctl_tcp_fastopen __read_mostly = TFO_CLIENT_ENABLE;
+
+static u32 tcp_fastopen_secret[MD5_MESSAGE_BYTES / 4] ____cacheline_aligned;
+
+static __init int tcp_fastopen_init(void)
+{
+	get_random_bytes(tcp_fastopen_secret, sizeof(tcp_fastopen_secret));
+	return 0;
+}
+__initcall(tcp_fastopen_init);
+
+/* The cookie is a keyed hash of the address pair, so it proves that the
+ * client has seen a SYN-ACK sent to its address before.
+ */
+void tcp_fastopen_cookie_gen(__be32 saddr, __be32 daddr,
+			     struct tcp_fastopen_cookie *foc)
+{
+	u32 hash[MD5_DIGEST_WORDS];
+
+	hash[0] = (__force u32)saddr;
+	hash[1] = (__force u32)daddr;
+	hash[2] = tcp_fastopen_secret[14];
+	hash[3] = tcp_fastopen_secret[15];
+
+	md5_transform(hash, tcp_fastopen_secret);
+
+	BUILD_BUG_ON(TCP_FASTOPEN_COOKIE_SIZE > sizeof(hash));
+	memcpy(foc->val, hash, TCP_FASTOPEN_COOKIE_SIZE);
+	foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+}
+
+bool tcp_fastopen_cookie_check(__be32 saddr, __be32 daddr,
+			       const struct tcp_fastopen_cookie *foc)
+{
+	struct tcp_fastopen_cookie valid;
+
+	if (foc->len != TCP_FASTOPEN_COOKIE_SIZE)
+		return false;
+
+	tcp_fastopen_cookie_gen(saddr, daddr, &valid);
+	return memcmp(foc->val, valid.val, TCP_FASTOPEN_COOKIE_SIZE) == 0;
+}
+
+/* Readers run locklessly in connect(), writers in softirq on SYN-ACK. */
+static DEFINE_SEQLOCK(tcp_fastopen_seqlock);
+
+void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+			    struct tcp_fastopen_cookie *cookie,
+			    int *syn_loss, unsigned long *last_syn_loss)
+{
+	const struct inet_connection_sock *icsk = inet_csk(sk);
+	struct inet_peer *peer;
+	bool release_it;
+	unsigned int seq;
+
+	peer = icsk->icsk_af_ops->get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	do {
+		seq = read_seqbegin(&tcp_fastopen_seqlock);
+		if (peer->tcp_fastopen_mss)
+			*mss = peer->tcp_fastopen_mss;
+		*cookie = peer->tcp_fastopen_cookie;
+		*syn_loss = peer->tcp_fastopen_syn_loss;
+		*last_syn_loss = *syn_loss ? peer->tcp_fastopen_syn_loss_ts : 0;
+	} while (read_seqretry(&tcp_fastopen_seqlock, seq));
+
+	if (release_it)
+		inet_putpeer(peer);
+}
+
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *cookie, bool syn_lost)
+{
+	const struct inet_connection_sock *icsk = inet_csk(sk);
+	struct inet_peer *peer;
+	bool release_it;
+
+	peer = icsk->icsk_af_ops->get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	write_seqlock_bh(&tcp_fastopen_seqlock);
+	peer->tcp_fastopen_mss = mss;
+	if (cookie->len > 0)
+		peer->tcp_fastopen_cookie = *cookie;
+	if (syn_lost) {
+		++peer->tcp_fastopen_syn_loss;
+		peer->tcp_fastopen_syn_loss_ts = jiffies;
+	} else {
+		peer->tcp_fastopen_syn_loss = 0;
+	}
+	write_sequnlock_bh(&tcp_fastopen_seqlock);
+
+	if (release_it)
+		inet_putpeer(peer);
+}
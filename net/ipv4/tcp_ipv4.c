@@ -82,6 +82,7 @@
 
 #include <linux/crypto.h>
 #include <linux/scatterlist.h>
+#include <net/busy_poll.h>
 
 int sysctl_tcp_tw_reuse __read_mostly;
 int sysctl_tcp_low_latency __read_mostly;
@@ -1248,6 +1249,62 @@ static const struct tcp_request_sock_ops tcp_request_sock_ipv4_ops = {
 };
 #endif
 
+/* A SYN with a valid Fast Open cookie: create the child right away and
+ * queue it, along with the data of the SYN, for accept(). The child sends
+ * and retransmits the SYN-ACK itself, and may send data before the final
+ * ACK of the handshake comes in.
+ */
+static int tcp_v4_conn_req_fastopen(struct sock *sk, struct sk_buff *skb,
+				    struct request_sock *req,
+				    struct dst_entry *dst)
+{
+	struct tcp_sock *tp;
+	struct sock *child;
+
+	child = inet_csk(sk)->icsk_af_ops->syn_recv_sock(sk, skb, req, dst);
+	if (child == NULL) {
+		NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+		return -1;
+	}
+
+	tp = tcp_sk(child);
+	tp->fastopen_child = 1;
+
+	/* RFC1323: The window in SYN & SYN/ACK segments is never scaled. */
+	tp->snd_wnd = ntohs(tcp_hdr(skb)->window);
+	tp->max_window = tp->snd_wnd;
+
+	/* What the final ACK of the handshake does for a regular child */
+	tcp_init_metrics(child);
+	tcp_init_congestion_control(child);
+	tcp_mtup_init(child);
+	tcp_init_buffer_space(child);
+	tp->lsndtime = tcp_time_stamp;
+
+	/* Queue the data carried in the SYN. We need to first bump the
+	 * refcnt of skb because the caller will free it.
+	 */
+	if (TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1) {
+		skb = skb_get(skb);
+		skb_dst_drop(skb);
+		__skb_pull(skb, tcp_hdr(skb)->doff * 4);
+		skb_set_owner_r(skb, child);
+		__skb_queue_tail(&child->sk_receive_queue, skb);
+		tp->syn_data_acked = 1;
+	}
+	tp->rcv_nxt = tp->rcv_wup = TCP_SKB_CB(skb)->end_seq;
+
+	tcp_send_fastopen_synack(child, tcp_rsk(req)->snt_isn);
+
+	inet_csk_reqsk_queue_add(sk, req, child);
+	sk->sk_data_ready(sk, 0);
+
+	bh_unlock_sock(child);
+	sock_put(child);
+	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVE);
+	return 0;
+}
+
 int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 {
 	struct tcp_extend_values tmp_ext;
@@ -1261,6 +1318,8 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	__be32 daddr = ip_hdr(skb)->daddr;
 	__u32 isn = TCP_SKB_CB(skb)->when;
 	int want_cookie = 0;
+	struct tcp_fastopen_cookie foc = { .len = -1 };
+	struct tcp_fastopen_cookie valid_foc;
 
 	/* Never answer to SYNs send to broadcast or multicast */
 	if (skb_rtable(skb)->rt_flags & (RTCF_BROADCAST | RTCF_MULTICAST))
@@ -1295,7 +1354,7 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tcp_clear_options(&tmp_opt);
 	tmp_opt.mss_clamp = TCP_MSS_DEFAULT;
 	tmp_opt.user_mss  = tp->rx_opt.user_mss;
-	tcp_parse_options(skb, &tmp_opt, &hash_location, 0);
+	tcp_parse_options(skb, &tmp_opt, &hash_location, 0, &foc);
 
 	if (tmp_opt.cookie_plus > 0 &&
 	    tmp_opt.saw_tstamp &&
@@ -1330,6 +1389,7 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 		goto drop_and_release;
 	}
 	tmp_ext.cookie_in_always = tp->rx_opt.cookie_in_always;
+	tmp_ext.fastopen_cookie = NULL;
 
 	if (want_cookie && !tmp_opt.saw_tstamp)
 		tcp_clear_options(&tmp_opt);
@@ -1401,6 +1461,27 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tcp_rsk(req)->snt_isn = isn;
 	tcp_rsk(req)->snt_synack = tcp_time_stamp;
 
+	if (!want_cookie && foc.len >= 0 && tp->fastopen_qlen > 0 &&
+	    (sysctl_tcp_fastopen & TFO_SERVER_ENABLE)) {
+		if (tcp_fastopen_cookie_check(saddr, daddr, &foc)) {
+			if (sk->sk_ack_backlog < tp->fastopen_qlen) {
+				if (!tcp_v4_conn_req_fastopen(sk, skb, req, dst))
+					return 0;
+				/* dst was released, do a regular handshake */
+				dst = NULL;
+			} else {
+				NET_INC_STATS_BH(sock_net(sk),
+					LINUX_MIB_TCPFASTOPENLISTENOVERFLOW);
+			}
+		} else if (foc.len == 0) {
+			NET_INC_STATS_BH(sock_net(sk),
+					 LINUX_MIB_TCPFASTOPENCOOKIEREQD);
+		}
+		/* Hand out a (fresh) cookie for the next connection */
+		tcp_fastopen_cookie_gen(saddr, daddr, &valid_foc);
+		tmp_ext.fastopen_cookie = &valid_foc;
+	}
+
 	if (tcp_v4_send_synack(sk, dst, req,
 			       (struct request_values *)&tmp_ext) ||
 	    want_cookie)
@@ -1574,6 +1655,33 @@ static __sum16 tcp_v4_checksum_init(struct sk_buff *skb)
 }
 
 
+/*
+ * Remember the input route of an established socket for
+ * tcp_v4_early_demux(), dropping it once it is stale.  Routes that are
+ * not in the route cache are freed without an RCU grace period and are
+ * never kept, as early demux reads sk_rx_dst without the socket lock.
+ */
+static void tcp_v4_rx_dst_update(struct sock *sk, const struct sk_buff *skb)
+{
+	struct dst_entry *dst = sk->sk_rx_dst;
+
+	if (dst && (inet_sk(sk)->rx_dst_ifindex != skb->skb_iif ||
+		    !dst_check(dst, 0))) {
+		sk->sk_rx_dst = NULL;
+		dst_release(dst);
+		dst = NULL;
+	}
+
+	if (!dst) {
+		dst = skb_dst(skb);
+		if (dst && !(dst->flags & DST_NOCACHE)) {
+			dst_hold(dst);
+			inet_sk(sk)->rx_dst_ifindex = skb->skb_iif;
+			sk->sk_rx_dst = dst;
+		}
+	}
+}
+
 /* The socket must have it's spinlock held when we get
  * here.
  *
@@ -1598,6 +1706,7 @@ int tcp_v4_do_rcv(struct sock *sk, struct sk_buff *skb)
 
 	if (sk->sk_state == TCP_ESTABLISHED) { /* Fast path */
 		sock_rps_save_rxhash(sk, skb);
+		tcp_v4_rx_dst_update(sk, skb);
 		if (tcp_rcv_established(sk, skb, tcp_hdr(skb), skb->len)) {
 			rsk = sk;
 			goto reset;
@@ -1647,6 +1756,56 @@ csum_err:
 }
 EXPORT_SYMBOL(tcp_v4_do_rcv);
 
+/*
+ * Called from ip_rcv_finish() before the route lookup: find the
+ * established socket of the segment and, if it has a valid cached input
+ * route for this interface, attach that route so the lookup is skipped.
+ * The socket is passed on to tcp_v4_rcv() through skb->sk.
+ */
+void tcp_v4_early_demux(struct sk_buff *skb)
+{
+	const struct iphdr *iph;
+	const struct tcphdr *th;
+	struct dst_entry *dst;
+	struct sock *sk;
+
+	/* fragments are only demuxed after reassembly */
+	if (skb->pkt_type != PACKET_HOST || ip_is_fragment(ip_hdr(skb)))
+		return;
+
+	if (!pskb_may_pull(skb, ip_hdrlen(skb) + sizeof(struct tcphdr)))
+		return;
+
+	iph = ip_hdr(skb);
+	th = (struct tcphdr *)((char *)iph + ip_hdrlen(skb));
+
+	if (th->doff < sizeof(struct tcphdr) / 4)
+		return;
+
+	sk = __inet_lookup_established(dev_net(skb->dev), &tcp_hashinfo,
+				       iph->saddr, th->source,
+				       iph->daddr, ntohs(th->dest),
+				       skb->skb_iif);
+	if (!sk)
+		return;
+
+	if (sk->sk_state == TCP_TIME_WAIT) {
+		inet_twsk_put(inet_twsk(sk));
+		return;
+	}
+
+	skb->sk = sk;
+	skb->destructor = sock_edemux;
+
+	dst = ACCESS_ONCE(sk->sk_rx_dst);
+	if (dst && inet_sk(sk)->rx_dst_ifindex == skb->skb_iif)
+		dst = dst_check(dst, 0);
+	else
+		dst = NULL;
+	if (dst)
+		skb_dst_set_noref(skb, dst);
+}
+
 /*
  *	From tcp_input.c
  */
@@ -1712,6 +1871,7 @@ process:
 	if (sk_filter(sk, skb))
 		goto discard_and_relse;
 
+	sk_mark_napi_id(sk, skb);
 	skb->dev = NULL;
 
 	bh_lock_sock_nested(sk);
@@ -1775,6 +1935,7 @@ do_time_wait:
 	case TCP_TW_SYN: {
 		struct sock *sk2 = inet_lookup_listener(dev_net(skb->dev),
 							&tcp_hashinfo,
+							iph->saddr, th->source,
 							iph->daddr, th->dest,
 							inet_iif(skb));
 		if (sk2) {
@@ -2586,13 +2747,12 @@ struct sk_buff **tcp4_gro_receive(struct sk_buff **head, struct sk_buff *skb)
 	return tcp_gro_receive(head, skb);
 }
 
-int tcp4_gro_complete(struct sk_buff *skb)
+int tcp4_gro_complete(struct sk_buff *skb, int thoff)
 {
 	const struct iphdr *iph = ip_hdr(skb);
 	struct tcphdr *th = tcp_hdr(skb);
 
-	th->check = ~tcp_v4_check(skb->len - skb_transport_offset(skb),
-				  iph->saddr, iph->daddr, 0);
+	th->check = ~tcp_v4_check(skb->len - thoff, iph->saddr, iph->daddr, 0);
 	skb_shinfo(skb)->gso_type = SKB_GSO_TCPV4;
 
 	return tcp_gro_complete(skb);
@@ -2615,6 +2775,7 @@ struct proto tcp_prot = {
 	.sendmsg		= tcp_sendmsg,
 	.sendpage		= tcp_sendpage,
 	.backlog_rcv		= tcp_v4_do_rcv,
+	.release_cb		= tcp_release_cb,
 	.hash			= inet_hash,
 	.unhash			= inet_unhash,
 	.get_port		= inet_csk_get_port,
@@ -176,7 +176,11 @@ static int tcp_write_timeout(struct sock *sk)
 	if ((1 << sk->sk_state) & (TCPF_SYN_SENT | TCPF_SYN_RECV)) {
 		if (icsk->icsk_retransmits)
 			dst_negative_advice(sk);
-		retry_until = icsk->icsk_syn_retries ? : sysctl_tcp_syn_retries;
+		if (tcp_passive_fastopen(sk))
+			retry_until = sysctl_tcp_synack_retries;
+		else
+			retry_until = icsk->icsk_syn_retries ? :
+				      sysctl_tcp_syn_retries;
 		syn_set = 1;
 	} else {
 		if (retransmits_timed_out(sk, sysctl_tcp_retries1, 0, 0)) {
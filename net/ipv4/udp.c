@@ -96,6 +96,7 @@
 #include <linux/inet.h>
 #include <linux/netdevice.h>
 #include <linux/slab.h>
+#include <linux/random.h>
 #include <net/tcp_states.h>
 #include <linux/skbuff.h>
 #include <linux/proc_fs.h>
@@ -106,6 +107,7 @@
 #include <net/checksum.h>
 #include <net/xfrm.h>
 #include <trace/events/udp.h>
+#include <net/busy_poll.h>
 #include "udp_impl.h"
 
 struct udp_table udp_table __read_mostly;
@@ -136,6 +138,7 @@ static int udp_lib_lport_inuse(struct net *net, __u16 num,
 {
 	struct sock *sk2;
 	struct hlist_nulls_node *node;
+	uid_t uid = sock_i_uid(sk);
 
 	sk_nulls_for_each(sk2, node, &hslot->head)
 		if (net_eq(sock_net(sk2), net) &&
@@ -144,6 +147,8 @@ static int udp_lib_lport_inuse(struct net *net, __u16 num,
 		    (!sk2->sk_reuse || !sk->sk_reuse) &&
 		    (!sk2->sk_bound_dev_if || !sk->sk_bound_dev_if ||
 		     sk2->sk_bound_dev_if == sk->sk_bound_dev_if) &&
+		    (!sk2->sk_reuseport || !sk->sk_reuseport ||
+		     uid != sock_i_uid(sk2)) &&
 		    (*saddr_comp)(sk, sk2)) {
 			if (bitmap)
 				__set_bit(udp_sk(sk2)->udp_port_hash >> log,
@@ -166,6 +171,7 @@ static int udp_lib_lport_inuse2(struct net *net, __u16 num,
 {
 	struct sock *sk2;
 	struct hlist_nulls_node *node;
+	uid_t uid = sock_i_uid(sk);
 	int res = 0;
 
 	spin_lock(&hslot2->lock);
@@ -176,6 +182,8 @@ static int udp_lib_lport_inuse2(struct net *net, __u16 num,
 		    (!sk2->sk_reuse || !sk->sk_reuse) &&
 		    (!sk2->sk_bound_dev_if || !sk->sk_bound_dev_if ||
 		     sk2->sk_bound_dev_if == sk->sk_bound_dev_if) &&
+		    (!sk2->sk_reuseport || !sk->sk_reuseport ||
+		     uid != sock_i_uid(sk2)) &&
 		    (*saddr_comp)(sk, sk2)) {
 			res = 1;
 			break;
@@ -406,7 +414,8 @@ static struct sock *udp4_lib_lookup2(struct net *net,
 {
 	struct sock *sk, *result;
 	struct hlist_nulls_node *node;
-	int score, badness;
+	int score, badness, matches = 0, reuseport = 0;
+	u32 hash = 0;
 
 begin:
 	result = NULL;
@@ -417,8 +426,18 @@ begin:
 		if (score > badness) {
 			result = sk;
 			badness = score;
-			if (score == SCORE2_MAX)
+			reuseport = sk->sk_reuseport;
+			if (reuseport) {
+				hash = inet_ehashfn(net, daddr, hnum,
+						    saddr, sport);
+				matches = 1;
+			} else if (score == SCORE2_MAX)
 				goto exact_match;
+		} else if (score == badness && reuseport) {
+			matches++;
+			if (((u64)hash * matches) >> 32 == 0)
+				result = sk;
+			hash = next_pseudo_random32(hash);
 		}
 	}
 	/*
@@ -454,7 +473,8 @@ static struct sock *__udp4_lib_lookup(struct net *net, __be32 saddr,
 	unsigned short hnum = ntohs(dport);
 	unsigned int hash2, slot2, slot = udp_hashfn(net, hnum, udptable->mask);
 	struct udp_hslot *hslot2, *hslot = &udptable->hash[slot];
-	int score, badness;
+	int score, badness, matches = 0, reuseport = 0;
+	u32 hash = 0;
 
 	rcu_read_lock();
 	if (hslot->count > 10) {
@@ -490,6 +510,21 @@ begin:
 		if (score > badness) {
 			result = sk;
 			badness = score;
+			reuseport = sk->sk_reuseport;
+			if (reuseport) {
+				hash = inet_ehashfn(net, daddr, hnum,
+						    saddr, sport);
+				matches = 1;
+			}
+		} else if (score == badness && reuseport) {
+			/*
+			 * Spread datagrams over the SO_REUSEPORT group by
+			 * flow hash, each member with probability 1/matches.
+			 */
+			matches++;
+			if (((u64)hash * matches) >> 32 == 0)
+				result = sk;
+			hash = next_pseudo_random32(hash);
 		}
 	}
 	/*
@@ -707,7 +742,8 @@ static void udp4_hwcsum(struct sk_buff *skb, __be32 src, __be32 dst)
 	}
 }
 
-static int udp_send_skb(struct sk_buff *skb, struct flowi4 *fl4)
+static int udp_send_skb(struct sk_buff *skb, struct flowi4 *fl4,
+			u16 gso_size)
 {
 	struct sock *sk = skb->sk;
 	struct inet_sock *inet = inet_sk(sk);
@@ -718,6 +754,28 @@ static int udp_send_skb(struct sk_buff *skb, struct flowi4 *fl4)
 	int len = skb->len - offset;
 	__wsum csum = 0;
 
+	if (gso_size && len - (int)sizeof(*uh) > gso_size) {
+		struct dst_entry *dst = skb_dst(skb);
+		unsigned int mtu = inet->pmtudisc == IP_PMTUDISC_PROBE ?
+				   dst->dev->mtu : dst_mtu(dst);
+
+		if (offset + sizeof(*uh) + gso_size > mtu ||
+		    len - sizeof(*uh) > gso_size * UDP_MAX_SEGMENTS) {
+			kfree_skb(skb);
+			return -EINVAL;
+		}
+		/* Segments are checksummed by the device or by GSO. */
+		if (sk->sk_no_check == UDP_CSUM_NOXMIT || is_udplite ||
+		    skb->ip_summed != CHECKSUM_PARTIAL || dst->xfrm) {
+			kfree_skb(skb);
+			return -EIO;
+		}
+		skb_shinfo(skb)->gso_size = gso_size;
+		skb_shinfo(skb)->gso_type = SKB_GSO_UDP_L4;
+		skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(len - sizeof(*uh),
+							 gso_size);
+	}
+
 	/*
 	 * Create a UDP header
 	 */
@@ -778,7 +836,7 @@ int udp_push_pending_frames(struct sock *sk)
 	if (!skb)
 		goto out;
 
-	err = udp_send_skb(skb, fl4);
+	err = udp_send_skb(skb, fl4, inet->cork.base.gso_size);
 
 out:
 	up->len = 0;
@@ -787,6 +845,97 @@ out:
 }
 EXPORT_SYMBOL(udp_push_pending_frames);
 
+static int udp_cmsg_send(struct sock *sk, struct msghdr *msg, u16 *gso_size)
+{
+	struct cmsghdr *cmsg;
+
+	for (cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		if (!CMSG_OK(msg, cmsg))
+			return -EINVAL;
+		if (cmsg->cmsg_level != SOL_UDP)
+			continue;
+		switch (cmsg->cmsg_type) {
+		case UDP_SEGMENT:
+			if (sk->sk_family != AF_INET ||
+			    cmsg->cmsg_len != CMSG_LEN(sizeof(__u16)))
+				return -EINVAL;
+			*gso_size = *(__u16 *)CMSG_DATA(cmsg);
+			break;
+		default:
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Unconnected senders have no sk_dst_cache to lean on, so the route of
+ * a datagram sent with MSG_BATCH (all but the last of a sendmmsg() call)
+ * is kept for the next one.  The stash is keyed on the complete flow
+ * before lookup, so the next datagram only reuses it if the lookup
+ * would have been identical.
+ */
+static bool udp_batch_flow_equal(const struct flowi4 *a,
+				 const struct flowi4 *b)
+{
+	return a->flowi4_oif == b->flowi4_oif &&
+	       a->flowi4_mark == b->flowi4_mark &&
+	       a->flowi4_tos == b->flowi4_tos &&
+	       a->flowi4_scope == b->flowi4_scope &&
+	       a->flowi4_proto == b->flowi4_proto &&
+	       a->flowi4_flags == b->flowi4_flags &&
+	       a->flowi4_secid == b->flowi4_secid &&
+	       a->daddr == b->daddr &&
+	       a->saddr == b->saddr &&
+	       a->fl4_dport == b->fl4_dport &&
+	       a->fl4_sport == b->fl4_sport;
+}
+
+static struct rtable *udp_batch_route_get(struct sock *sk, struct flowi4 *fl4)
+{
+	struct udp_sock *up = udp_sk(sk);
+	struct rtable *rt;
+	bool match;
+
+	if (!up->batch_rt)
+		return NULL;
+
+	spin_lock_bh(&sk->sk_dst_lock);
+	rt = up->batch_rt;
+	up->batch_rt = NULL;
+	match = rt && udp_batch_flow_equal(&up->batch_fl4, fl4);
+	spin_unlock_bh(&sk->sk_dst_lock);
+
+	if (!rt)
+		return NULL;
+	if (!match || !dst_check(&rt->dst, 0)) {
+		ip_rt_put(rt);
+		return NULL;
+	}
+
+	if (!fl4->saddr)
+		fl4->saddr = rt->rt_src;
+	if (!fl4->daddr)
+		fl4->daddr = rt->rt_dst;
+	return rt;
+}
+
+static void udp_batch_route_set(struct sock *sk, const struct flowi4 *key,
+				struct rtable *rt)
+{
+	struct udp_sock *up = udp_sk(sk);
+	struct rtable *old;
+
+	spin_lock_bh(&sk->sk_dst_lock);
+	old = up->batch_rt;
+	up->batch_rt = rt;
+	if (rt)
+		up->batch_fl4 = *key;
+	spin_unlock_bh(&sk->sk_dst_lock);
+
+	ip_rt_put(old);
+}
+
 int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 		size_t len)
 {
@@ -807,6 +956,7 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 	int (*getfrag)(void *, char *, int, int, int, struct sk_buff *);
 	struct sk_buff *skb;
 	struct ip_options_data opt_copy;
+	struct flowi4 batch_key;
 
 	if (len > 0xFFFF)
 		return -EMSGSIZE;
@@ -820,6 +970,8 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 
 	ipc.opt = NULL;
 	ipc.tx_flags = 0;
+	ipc.gso_size = up->gso_size;
+	ipc.sockc.transmit_time = 0;
 
 	getfrag = is_udplite ? udplite_getfrag : ip_generic_getfrag;
 
@@ -874,7 +1026,10 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 	if (err)
 		return err;
 	if (msg->msg_controllen) {
-		err = ip_cmsg_send(sock_net(sk), msg, &ipc);
+		err = udp_cmsg_send(sk, msg, &ipc.gso_size);
+		if (err)
+			return err;
+		err = ip_cmsg_send(sk, msg, &ipc);
 		if (err)
 			return err;
 		if (ipc.opt)
@@ -932,7 +1087,11 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 				   faddr, saddr, dport, inet->inet_sport);
 
 		security_sk_classify_flow(sk, flowi4_to_flowi(fl4));
-		rt = ip_route_output_flow(net, fl4, sk);
+		if (msg->msg_flags & MSG_BATCH)
+			batch_key = *fl4;
+		rt = udp_batch_route_get(sk, fl4);
+		if (!rt)
+			rt = ip_route_output_flow(net, fl4, sk);
 		if (IS_ERR(rt)) {
 			err = PTR_ERR(rt);
 			rt = NULL;
@@ -947,6 +1106,10 @@ int udp_sendmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 			goto out;
 		if (connected)
 			sk_dst_set(sk, dst_clone(&rt->dst));
+		else if ((msg->msg_flags & MSG_BATCH) &&
+			 sk->sk_family == AF_INET && !rt->dst.xfrm)
+			udp_batch_route_set(sk, &batch_key,
+					    (struct rtable *)dst_clone(&rt->dst));
 	}
 
 	if (msg->msg_flags&MSG_CONFIRM)
@@ -964,7 +1127,7 @@ back_from_confirm:
 				  msg->msg_flags);
 		err = PTR_ERR(skb);
 		if (skb && !IS_ERR(skb))
-			err = udp_send_skb(skb, fl4);
+			err = udp_send_skb(skb, fl4, ipc.gso_size);
 		goto out;
 	}
 
@@ -1356,6 +1519,7 @@ static int __udp_queue_rcv_skb(struct sock *sk, struct sk_buff *skb)
 
 	if (inet_sk(sk)->inet_daddr)
 		sock_rps_save_rxhash(sk, skb);
+	sk_mark_napi_id(sk, skb);
 
 	rc = ip_queue_rcv_skb(sk, skb);
 	if (rc < 0) {
@@ -1722,6 +1886,7 @@ void udp_destroy_sock(struct sock *sk)
 	bool slow = lock_sock_fast(sk);
 	udp_flush_pending_frames(sk);
 	unlock_sock_fast(sk, slow);
+	udp_batch_route_set(sk, NULL, NULL);
 }
 
 /*
@@ -1770,6 +1935,15 @@ int udp_lib_setsockopt(struct sock *sk, int level, int optname,
 		}
 		break;
 
+	/* Segmentation offload is only implemented for IPv4 UDP. */
+	case UDP_SEGMENT:
+		if (is_udplite || sk->sk_family != AF_INET)
+			return -ENOPROTOOPT;
+		if (val < 0 || val > USHRT_MAX)
+			return -EINVAL;
+		up->gso_size = val;
+		break;
+
 	/*
 	 * 	UDP-Lite's partial checksum coverage (RFC 3828).
 	 */
@@ -1852,6 +2026,10 @@ int udp_lib_getsockopt(struct sock *sk, int level, int optname,
 		val = up->encap_type;
 		break;
 
+	case UDP_SEGMENT:
+		val = up->gso_size;
+		break;
+
 	/* The following two cannot be changed on UDP sockets, the return is
 	 * always 0 (which corresponds to the full checksum coverage of UDP). */
 	case UDPLITE_SEND_CSCOV:
@@ -2246,6 +2424,62 @@ int udp4_ufo_send_check(struct sk_buff *skb)
 	return 0;
 }
 
+static struct sk_buff *udp4_gso_segment(struct sk_buff *skb, u32 features)
+{
+	struct sk_buff *segs = ERR_PTR(-EINVAL);
+	struct udphdr *uh;
+	unsigned int oldlen;
+	unsigned int ulen;
+	unsigned int mss;
+
+	if (!pskb_may_pull(skb, sizeof(*uh)))
+		goto out;
+
+	oldlen = (u16)~skb->len;
+	__skb_pull(skb, sizeof(*uh));
+
+	mss = skb_shinfo(skb)->gso_size;
+	if (unlikely(skb->len <= mss))
+		goto out;
+
+	if (skb_gso_ok(skb, features | NETIF_F_GSO_ROBUST)) {
+		/* Packet is from an untrusted source, reset gso_segs. */
+		int type = skb_shinfo(skb)->gso_type;
+
+		if (unlikely(type & ~(SKB_GSO_UDP_L4 | SKB_GSO_DODGY) ||
+			     !(type & SKB_GSO_UDP_L4)))
+			goto out;
+
+		skb_shinfo(skb)->gso_segs = DIV_ROUND_UP(skb->len, mss);
+
+		segs = NULL;
+		goto out;
+	}
+
+	segs = skb_segment(skb, features);
+	if (IS_ERR(segs))
+		goto out;
+
+	/* Each segment is a datagram of its own: patch the length and
+	 * adjust the pseudo header checksum for it.
+	 */
+	for (skb = segs; skb; skb = skb->next) {
+		uh = udp_hdr(skb);
+		ulen = skb->len - skb_transport_offset(skb);
+		uh->len = htons(ulen);
+		uh->check = ~csum_fold((__force __wsum)((__force u32)uh->check +
+				       (__force u32)htonl(oldlen + ulen)));
+		if (skb->ip_summed != CHECKSUM_PARTIAL) {
+			uh->check = csum_fold(csum_partial(uh, sizeof(*uh),
+							   skb->csum));
+			if (uh->check == 0)
+				uh->check = CSUM_MANGLED_0;
+		}
+	}
+out:
+	return segs;
+}
+
 struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, u32 features)
 {
 	struct sk_buff *segs = ERR_PTR(-EINVAL);
@@ -2253,6 +2487,9 @@ struct sk_buff *udp4_ufo_fragment(struct sk_buff *skb, u32 features)
 	int offset;
 	__wsum csum;
 
+	if (skb_shinfo(skb)->gso_type & SKB_GSO_UDP_L4)
+		return udp4_gso_segment(skb, features);
+
 	mss = skb_shinfo(skb)->gso_size;
 	if (unlikely(skb->len <= mss))
 		goto out;
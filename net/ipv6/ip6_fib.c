@@ -1116,6 +1116,7 @@ static void fib6_del_route(struct fib6_node *fn, struct rt6_info **rtp,
 	/* Unlink it */
 	*rtp = rt->dst.rt6_next;
 	rt->rt6i_node = NULL;
+	rt6_free_pcpu(rt);
 	net->ipv6.rt6_stats->fib_rt_entries--;
 	net->ipv6.rt6_stats->fib_discarded_routes++;
 
@@ -271,6 +271,9 @@ static void ip6_dst_destroy(struct dst_entry *dst)
 		rt->rt6i_peer = NULL;
 		inet_putpeer(peer);
 	}
+	free_percpu(rt->rt6i_pcpu);
+	if (rt->rt6i_from)
+		dst_release(&rt->rt6i_from->dst);
 }
 
 static atomic_t __rt6_peer_genid = ATOMIC_INIT(0);
@@ -793,6 +796,89 @@ static struct rt6_info *rt6_alloc_clone(struct rt6_info *ort,
 	return rt;
 }
 
+/*
+ * Forwarding through a gateway route needs nothing from the destination
+ * address, so rather than cloning a host route into the tree for every
+ * destination seen, each cpu keeps a single copy of the route.  A copy
+ * shares the metrics of its route and holds it until the copy is freed;
+ * the copies are dropped as soon as the route leaves the tree.
+ */
+static struct rt6_info *rt6_alloc_pcpu(struct rt6_info *ort)
+{
+	struct net *net = dev_net(ort->rt6i_dev);
+	struct rt6_info *rt = ip6_dst_alloc(&net->ipv6.ip6_dst_ops,
+					    ort->dst.dev, 0);
+
+	if (rt) {
+		rt->dst.input = ort->dst.input;
+		rt->dst.output = ort->dst.output;
+		dst_init_metrics(&rt->dst, dst_metrics_ptr(&ort->dst), true);
+		rt->dst.error = ort->dst.error;
+		rt->dst.lastuse = jiffies;
+		dst_set_neighbour(&rt->dst, neigh_clone(dst_get_neighbour_raw(&ort->dst)));
+
+		memcpy(&rt->rt6i_dst, &ort->rt6i_dst, sizeof(struct rt6key));
+#ifdef CONFIG_IPV6_SUBTREES
+		memcpy(&rt->rt6i_src, &ort->rt6i_src, sizeof(struct rt6key));
+#endif
+		memcpy(&rt->rt6i_prefsrc, &ort->rt6i_prefsrc, sizeof(struct rt6key));
+		ipv6_addr_copy(&rt->rt6i_gateway, &ort->rt6i_gateway);
+		rt->rt6i_flags = ort->rt6i_flags & ~RTF_EXPIRES;
+		rt->rt6i_idev = ort->rt6i_idev;
+		if (rt->rt6i_idev)
+			in6_dev_hold(rt->rt6i_idev);
+		rt->rt6i_table = ort->rt6i_table;
+
+		dst_hold(&ort->dst);
+		rt->rt6i_from = ort;
+	}
+	return rt;
+}
+
+/*
+ * Publish @rt as this cpu's copy of @ort, unless another copy won the race
+ * or @ort was deleted meanwhile.  Consumes the caller's reference on @ort
+ * and returns the route to use, held.
+ */
+static struct rt6_info *rt6_install_pcpu(struct fib6_table *table,
+					 struct rt6_info *ort,
+					 struct rt6_info *rt)
+{
+	struct rt6_info **p;
+
+	read_lock_bh(&table->tb6_lock);
+	p = this_cpu_ptr(ort->rt6i_pcpu);
+	if (*p || !ort->rt6i_node || !rt) {
+		if (rt)
+			dst_free(&rt->dst);
+		rt = *p ? : ort;
+	} else
+		*p = rt;
+	dst_hold(&rt->dst);
+	read_unlock_bh(&table->tb6_lock);
+
+	dst_release(&ort->dst);
+	return rt;
+}
+
+/* Called with table->tb6_lock write held when @rt leaves the tree */
+void rt6_free_pcpu(struct rt6_info *rt)
+{
+	int cpu;
+
+	if (!rt->rt6i_pcpu)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct rt6_info **p = per_cpu_ptr(rt->rt6i_pcpu, cpu);
+
+		if (*p) {
+			dst_free(&(*p)->dst);
+			*p = NULL;
+		}
+	}
+}
+
 static struct rt6_info *ip6_pol_route(struct net *net, struct fib6_table *table, int oif,
 				      struct flowi6 *fl6, int flags, bool input)
 {
@@ -822,13 +908,24 @@ restart:
 	    rt->rt6i_flags & RTF_CACHE)
 		goto out;
 
+	if (input && rt->rt6i_pcpu) {
+		nrt = *this_cpu_ptr(rt->rt6i_pcpu);
+		if (nrt) {
+			rt = nrt;
+			goto out_hold;
+		}
+	}
+
 	dst_hold(&rt->dst);
 	read_unlock_bh(&table->tb6_lock);
 
 	if (!dst_get_neighbour_raw(&rt->dst)
 	    && !(rt->rt6i_flags & local))
 		nrt = rt6_alloc_cow(rt, &fl6->daddr, &fl6->saddr);
-	else if (!(rt->dst.flags & DST_HOST))
+	else if (input && rt->rt6i_pcpu) {
+		rt = rt6_install_pcpu(table, rt, rt6_alloc_pcpu(rt));
+		goto out2;
+	} else if (!(rt->dst.flags & DST_HOST))
 		nrt = rt6_alloc_clone(rt, &fl6->daddr);
 	else
 		goto out2;
@@ -858,6 +955,7 @@ out:
 		reachable = 0;
 		goto restart_2;
 	}
+out_hold:
 	dst_hold(&rt->dst);
 	read_unlock_bh(&table->tb6_lock);
 out2:
@@ -1398,6 +1496,16 @@ int ip6_route_add(struct fib6_config *cfg)
 		dst_set_neighbour(&rt->dst, n);
 	}
 
+	/* percpu allocation sleeps, routes added from softirq (RA) go without */
+	if ((cfg->fc_flags & RTF_GATEWAY) && !(rt->dst.flags & DST_HOST) &&
+	    !in_softirq()) {
+		rt->rt6i_pcpu = alloc_percpu(struct rt6_info *);
+		if (!rt->rt6i_pcpu) {
+			err = -ENOMEM;
+			goto out;
+		}
+	}
+
 	rt->rt6i_flags = cfg->fc_flags;
 
 install_route:
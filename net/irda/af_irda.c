@@ -1296,7 +1296,7 @@ static int irda_sendmsg(struct kiocb *iocb, struct socket *sock,
 
 	/* Note : socket.c set MSG_EOR on SEQPACKET sockets */
 	if (msg->msg_flags & ~(MSG_DONTWAIT | MSG_EOR | MSG_CMSG_COMPAT |
-			       MSG_NOSIGNAL)) {
+			       MSG_NOSIGNAL | MSG_BATCH)) {
 		return -EINVAL;
 	}
 
@@ -1557,7 +1557,7 @@ static int irda_sendmsg_dgram(struct kiocb *iocb, struct socket *sock,
 
 	IRDA_DEBUG(4, "%s(), len=%zd\n", __func__, len);
 
-	if (msg->msg_flags & ~(MSG_DONTWAIT|MSG_CMSG_COMPAT))
+	if (msg->msg_flags & ~(MSG_DONTWAIT|MSG_BATCH|MSG_CMSG_COMPAT))
 		return -EINVAL;
 
 	lock_sock(sk);
@@ -1640,7 +1640,7 @@ static int irda_sendmsg_ultra(struct kiocb *iocb, struct socket *sock,
 	IRDA_DEBUG(4, "%s(), len=%zd\n", __func__, len);
 
 	err = -EINVAL;
-	if (msg->msg_flags & ~(MSG_DONTWAIT|MSG_CMSG_COMPAT))
+	if (msg->msg_flags & ~(MSG_DONTWAIT|MSG_BATCH|MSG_CMSG_COMPAT))
 		return -EINVAL;
 
 	lock_sock(sk);
@@ -341,9 +341,15 @@ ip_set_test(ip_set_id_t index, const struct sk_buff *skb,
 	    !(opt->family == set->family || set->family == AF_UNSPEC))
 		return 0;
 
-	read_lock_bh(&set->lock);
-	ret = set->variant->kadt(set, skb, par, IPSET_TEST, opt);
-	read_unlock_bh(&set->lock);
+	if (set->variant->lockless_test) {
+		rcu_read_lock_bh();
+		ret = set->variant->kadt(set, skb, par, IPSET_TEST, opt);
+		rcu_read_unlock_bh();
+	} else {
+		read_lock_bh(&set->lock);
+		ret = set->variant->kadt(set, skb, par, IPSET_TEST, opt);
+		read_unlock_bh(&set->lock);
+	}
 
 	if (ret == -EAGAIN) {
 		/* Type requests element to be completed */
@@ -942,6 +948,12 @@ ip_set_swap(struct sock *ctnl, struct sk_buff *skb,
 	ip_set_list[to_id] = from;
 	write_unlock_bh(&ip_set_ref_lock);
 
+	/* Kernel side tests may run without the set lock: make sure
+	 * nobody uses the swapped out set anymore, so that it can be
+	 * flushed or destroyed right away. This makes "restore into a
+	 * new set, swap, destroy" an atomic bulk update of the set. */
+	synchronize_rcu_bh();
+
 	return 0;
 }
 
@@ -478,7 +478,7 @@ hash_ipport_create(struct ip_set *set, struct nlattr *tb[], u32 flags)
 	hbits = htable_bits(hashsize);
 	h->table = ip_set_alloc(
 			sizeof(struct htable)
-			+ jhash_size(hbits) * sizeof(struct hbucket));
+			+ jhash_size(hbits) * sizeof(struct hbucket *));
 	if (!h->table) {
 		kfree(h);
 		return -ENOMEM;
@@ -549,6 +549,8 @@ static void __exit
 hash_ipport_fini(void)
 {
 	ip_set_type_unregister(&hash_ipport_type);
+	/* Wait for the buckets freed by call_rcu_bh */
+	rcu_barrier_bh();
 }
 
 module_init(hash_ipport_init);
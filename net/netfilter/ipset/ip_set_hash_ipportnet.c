@@ -584,7 +584,7 @@ hash_ipportnet_create(struct ip_set *set, struct nlattr *tb[], u32 flags)
 	hbits = htable_bits(hashsize);
 	h->table = ip_set_alloc(
 			sizeof(struct htable)
-			+ jhash_size(hbits) * sizeof(struct hbucket));
+			+ jhash_size(hbits) * sizeof(struct hbucket *));
 	if (!h->table) {
 		kfree(h);
 		return -ENOMEM;
@@ -659,6 +659,8 @@ static void __exit
 hash_ipportnet_fini(void)
 {
 	ip_set_type_unregister(&hash_ipportnet_type);
+	/* Wait for the buckets freed by call_rcu_bh */
+	rcu_barrier_bh();
 }
 
 module_init(hash_ipportnet_init);
@@ -436,7 +436,7 @@ hash_net_create(struct ip_set *set, struct nlattr *tb[], u32 flags)
 	hbits = htable_bits(hashsize);
 	h->table = ip_set_alloc(
 			sizeof(struct htable)
-			+ jhash_size(hbits) * sizeof(struct hbucket));
+			+ jhash_size(hbits) * sizeof(struct hbucket *));
 	if (!h->table) {
 		kfree(h);
 		return -ENOMEM;
@@ -502,6 +502,8 @@ static void __exit
 hash_net_fini(void)
 {
 	ip_set_type_unregister(&hash_net_type);
+	/* Wait for the buckets freed by call_rcu_bh */
+	rcu_barrier_bh();
 }
 
 module_init(hash_net_init);
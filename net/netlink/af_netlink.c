@@ -75,6 +75,7 @@ struct netlink_sock {
 	u32			ngroups;
 	unsigned long		*groups;
 	unsigned long		state;
+	size_t			max_recvmsg_len;
 	wait_queue_head_t	wait;
 	struct netlink_callback	*cb;
 	struct mutex		*cb_mutex;
@@ -93,6 +94,9 @@ struct listeners {
 #define NETLINK_BROADCAST_SEND_ERROR	0x4
 #define NETLINK_RECV_NO_ENOBUFS	0x8
 
+/* upper bound of the skbs netlink_dump sizes after the reader's buffers */
+#define NETLINK_DUMP_MAX_ALLOC	16384
+
 static inline struct netlink_sock *nlk_sk(struct sock *sk)
 {
 	return container_of(sk, struct netlink_sock, sk);
@@ -1422,6 +1426,11 @@ static int netlink_recvmsg(struct kiocb *kiocb, struct socket *sock,
 
 	copied = 0;
 
+	/* dumps fill skbs as large as the reader's buffers, see netlink_dump */
+	nlk->max_recvmsg_len = max(nlk->max_recvmsg_len, len);
+	nlk->max_recvmsg_len = min_t(size_t, nlk->max_recvmsg_len,
+				     NETLINK_DUMP_MAX_ALLOC);
+
 	skb = skb_recv_datagram(sk, flags, noblock, &err);
 	if (skb == NULL)
 		goto out;
@@ -1689,7 +1698,22 @@ static int netlink_dump(struct sock *sk)
 
 	alloc_size = max_t(int, cb->min_dump_alloc, NLMSG_GOODSIZE);
 
-	skb = sock_rmalloc(sk, alloc_size, 0, GFP_KERNEL);
+	/*
+	 * Put as many messages into one skb as the reader takes per
+	 * recvmsg, a page at a time makes large dumps syscall bound.  The
+	 * larger allocation is opportunistic, and the tailroom is trimmed
+	 * to what was asked for so that a message never gets truncated.
+	 */
+	if (alloc_size < nlk->max_recvmsg_len) {
+		skb = sock_rmalloc(sk, nlk->max_recvmsg_len, 0,
+				   GFP_KERNEL | __GFP_NOWARN | __GFP_NORETRY);
+		if (skb) {
+			alloc_size = nlk->max_recvmsg_len;
+			skb_reserve(skb, skb_tailroom(skb) - alloc_size);
+		}
+	}
+	if (!skb)
+		skb = sock_rmalloc(sk, alloc_size, 0, GFP_KERNEL);
 	if (!skb)
 		goto errout_skb;
 
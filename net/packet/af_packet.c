@@ -269,12 +269,21 @@ static void prb_clear_rxhash(struct tpacket_kbdq_core *,
 static void prb_fill_vlan_info(struct tpacket_kbdq_core *,
 		struct tpacket3_hdr *);
 static void packet_flush_mclist(struct sock *sk);
+static int tpacket_rcv(struct sk_buff *skb, struct net_device *dev,
+		       struct packet_type *pt, struct net_device *orig_dev);
 
 struct packet_fanout;
+
+struct packet_rollover {
+	int			sock;
+	atomic_long_t		num;
+	atomic_long_t		num_failed;
+};
 struct packet_sock {
 	/* struct sock has to be the first member of packet_sock */
 	struct sock		sk;
 	struct packet_fanout	*fanout;
+	struct packet_rollover	rollover;
 	struct tpacket_stats	stats;
 	union  tpacket_stats_u	stats_u;
 	struct packet_ring_buffer	rx_ring;
@@ -296,6 +305,7 @@ struct packet_sock {
 	unsigned int		tp_loss:1;
 	unsigned int		tp_tstamp;
 	struct net_device __rcu	*cached_dev;
+	int			(*xmit)(struct sk_buff *skb);
 	struct packet_type	prot_hook ____cacheline_aligned_in_smp;
 };
 
@@ -309,8 +319,10 @@ struct packet_fanout {
 	u16			id;
 	u8			type;
 	u8			defrag;
+	u8			rollover;
 	atomic_t		rr_cur;
 	struct list_head	list;
+	struct sk_filter __rcu	*bpf_prog;
 	struct sock		*arr[PACKET_FANOUT_MAX];
 	spinlock_t		lock;
 	atomic_t		sk_ref;
@@ -336,11 +348,18 @@ struct packet_skb_cb {
 	(((x)->kactive_blk_num < ((x)->knum_blocks-1)) ? \
 	((x)->kactive_blk_num+1) : 0)
 
+static int packet_direct_xmit(struct sk_buff *skb);
+
 static struct packet_sock *pkt_sk(struct sock *sk)
 {
 	return (struct packet_sock *)sk;
 }
 
+static bool packet_use_direct_xmit(const struct packet_sock *po)
+{
+	return po->xmit == packet_direct_xmit;
+}
+
 static void __fanout_unlink(struct sock *sk, struct packet_sock *po);
 static void __fanout_link(struct sock *sk, struct packet_sock *po);
 
@@ -408,11 +427,54 @@ static inline __pure struct page *pgv_to_page(void *addr)
 	return virt_to_page(addr);
 }
 
+/* Transmit straight to the device, bypassing the qdisc layer and the
+ * taps.  Frames that cannot be queued are dropped, not requeued.
+ */
+static int packet_direct_xmit(struct sk_buff *skb)
+{
+	struct net_device *dev = skb->dev;
+	const struct net_device_ops *ops = dev->netdev_ops;
+	struct netdev_queue *txq;
+	u32 features;
+	int ret;
+
+	if (unlikely(!netif_running(dev) || !netif_carrier_ok(dev)))
+		goto drop;
+
+	features = netif_skb_features(skb);
+	if (skb_needs_linearize(skb, features) && __skb_linearize(skb))
+		goto drop;
+
+	skb_set_queue_mapping(skb, raw_smp_processor_id() %
+				   dev->real_num_tx_queues);
+	txq = netdev_get_tx_queue(dev, skb_get_queue_mapping(skb));
+
+	__netif_tx_lock_bh(txq);
+	if (unlikely(netif_xmit_frozen_or_stopped(txq))) {
+		ret = NETDEV_TX_BUSY;
+		kfree_skb(skb);
+		goto out;
+	}
+
+	ret = ops->ndo_start_xmit(skb, dev);
+	if (likely(dev_xmit_complete(ret)))
+		txq_trans_update(txq);
+	else
+		kfree_skb(skb);
+out:
+	__netif_tx_unlock_bh(txq);
+	return ret;
+drop:
+	kfree_skb(skb);
+	return NET_XMIT_DROP;
+}
+
 static void __packet_set_status(struct packet_sock *po, void *frame, int status)
 {
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
+		struct tpacket3_hdr *h3;
 		void *raw;
 	} h;
 
@@ -427,6 +489,9 @@ static void __packet_set_status(struct packet_sock *po, void *frame, int status)
 		flush_dcache_page(pgv_to_page(&h.h2->tp_status));
 		break;
 	case TPACKET_V3:
+		h.h3->tp_status = status;
+		flush_dcache_page(pgv_to_page(&h.h3->tp_status));
+		break;
 	default:
 		WARN(1, "TPACKET version not supported.\n");
 		BUG();
@@ -440,6 +505,7 @@ static int __packet_get_status(struct packet_sock *po, void *frame)
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
+		struct tpacket3_hdr *h3;
 		void *raw;
 	} h;
 
@@ -454,6 +520,8 @@ static int __packet_get_status(struct packet_sock *po, void *frame)
 		flush_dcache_page(pgv_to_page(&h.h2->tp_status));
 		return h.h2->tp_status;
 	case TPACKET_V3:
+		flush_dcache_page(pgv_to_page(&h.h3->tp_status));
+		return h.h3->tp_status;
 	default:
 		WARN(1, "TPACKET version not supported.\n");
 		BUG();
@@ -1180,16 +1248,34 @@ static int fanout_rr_next(struct packet_fanout *f, unsigned int num)
 	return x;
 }
 
-static struct sock *fanout_demux_hash(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
+static bool packet_rcv_has_room(struct packet_sock *po, struct sk_buff *skb)
 {
-	u32 idx, hash = skb->rxhash;
+	struct sock *sk = &po->sk;
+	bool has_room;
+
+	if (po->prot_hook.func != tpacket_rcv)
+		return (atomic_read(&sk->sk_rmem_alloc) + skb->truesize)
+			<= sk->sk_rcvbuf;
+
+	spin_lock(&sk->sk_receive_queue.lock);
+	if (po->tp_version == TPACKET_V3)
+		has_room = prb_lookup_block(po, &po->rx_ring,
+				po->rx_ring.prb_bdqc.kactive_blk_num,
+				TP_STATUS_KERNEL) != NULL;
+	else
+		has_room = packet_lookup_frame(po, &po->rx_ring,
+				po->rx_ring.head, TP_STATUS_KERNEL) != NULL;
+	spin_unlock(&sk->sk_receive_queue.lock);
 
-	idx = ((u64)hash * num) >> 32;
+	return has_room;
+}
 
-	return f->arr[idx];
+static unsigned int fanout_demux_hash(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
+{
+	return ((u64)skb->rxhash * num) >> 32;
 }
 
-static struct sock *fanout_demux_lb(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
+static unsigned int fanout_demux_lb(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
 {
 	int cur, old;
 
@@ -1197,14 +1283,61 @@ static struct sock *fanout_demux_lb(struct packet_fanout *f, struct sk_buff *skb
 	while ((old = atomic_cmpxchg(&f->rr_cur, cur,
 				     fanout_rr_next(f, num))) != cur)
 		cur = old;
-	return f->arr[cur];
+	return cur;
 }
 
-static struct sock *fanout_demux_cpu(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
+static unsigned int fanout_demux_cpu(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
 {
 	unsigned int cpu = smp_processor_id();
 
-	return f->arr[cpu % num];
+	return cpu % num;
+}
+
+/* Pick the first member after the last successful one that has room,
+ * starting with @idx itself if @try_self.  Counters are kept on the
+ * member the packet was originally steered to.
+ */
+static unsigned int fanout_demux_rollover(struct packet_fanout *f,
+					  struct sk_buff *skb,
+					  unsigned int idx, bool try_self,
+					  unsigned int num)
+{
+	struct packet_sock *po = pkt_sk(f->arr[idx]), *po_next;
+	unsigned int i, j;
+
+	if (try_self && packet_rcv_has_room(po, skb))
+		return idx;
+
+	i = j = min_t(int, po->rollover.sock, num - 1);
+	do {
+		po_next = pkt_sk(f->arr[i]);
+		if (po_next != po && packet_rcv_has_room(po_next, skb)) {
+			if (i != j)
+				po->rollover.sock = i;
+			atomic_long_inc(&po->rollover.num);
+			return i;
+		}
+		if (++i == num)
+			i = 0;
+	} while (i != j);
+
+	atomic_long_inc(&po->rollover.num_failed);
+	return idx;
+}
+
+/* The group's classic BPF program returns the member index. */
+static unsigned int fanout_demux_bpf(struct packet_fanout *f, struct sk_buff *skb, unsigned int num)
+{
+	struct sk_filter *prog;
+	unsigned int ret = 0;
+
+	rcu_read_lock();
+	prog = rcu_dereference(f->bpf_prog);
+	if (prog)
+		ret = SK_RUN_FILTER(prog, skb) % num;
+	rcu_read_unlock();
+
+	return ret;
 }
 
 static int packet_rcv_fanout(struct sk_buff *skb, struct net_device *dev,
@@ -1213,7 +1346,7 @@ static int packet_rcv_fanout(struct sk_buff *skb, struct net_device *dev,
 	struct packet_fanout *f = pt->af_packet_priv;
 	unsigned int num = f->num_members;
 	struct packet_sock *po;
-	struct sock *sk;
+	unsigned int idx;
 
 	if (!net_eq(dev_net(dev), read_pnet(&f->net)) ||
 	    !num) {
@@ -1230,17 +1363,26 @@ static int packet_rcv_fanout(struct sk_buff *skb, struct net_device *dev,
 				return 0;
 		}
 		skb_get_rxhash(skb);
-		sk = fanout_demux_hash(f, skb, num);
+		idx = fanout_demux_hash(f, skb, num);
 		break;
 	case PACKET_FANOUT_LB:
-		sk = fanout_demux_lb(f, skb, num);
+		idx = fanout_demux_lb(f, skb, num);
 		break;
 	case PACKET_FANOUT_CPU:
-		sk = fanout_demux_cpu(f, skb, num);
+		idx = fanout_demux_cpu(f, skb, num);
+		break;
+	case PACKET_FANOUT_ROLLOVER:
+		idx = fanout_demux_rollover(f, skb, 0, true, num);
+		break;
+	case PACKET_FANOUT_CBPF:
+		idx = fanout_demux_bpf(f, skb, num);
 		break;
 	}
 
-	po = pkt_sk(sk);
+	if (f->rollover)
+		idx = fanout_demux_rollover(f, skb, idx, true, num);
+
+	po = pkt_sk(f->arr[idx]);
 
 	return po->prot_hook.func(skb, dev, &po->prot_hook, orig_dev);
 }
@@ -1289,12 +1431,18 @@ static int fanout_add(struct sock *sk, u16 id, u16 type_flags)
 	struct packet_fanout *f, *match;
 	u8 type = type_flags & 0xff;
 	u8 defrag = (type_flags & PACKET_FANOUT_FLAG_DEFRAG) ? 1 : 0;
+	u8 rollover = (type_flags & PACKET_FANOUT_FLAG_ROLLOVER) ? 1 : 0;
 	int err;
 
 	switch (type) {
+	case PACKET_FANOUT_ROLLOVER:
+		if (rollover)
+			return -EINVAL;
+		/* fall through */
 	case PACKET_FANOUT_HASH:
 	case PACKET_FANOUT_LB:
 	case PACKET_FANOUT_CPU:
+	case PACKET_FANOUT_CBPF:
 		break;
 	default:
 		return -EINVAL;
@@ -1316,7 +1464,7 @@ static int fanout_add(struct sock *sk, u16 id, u16 type_flags)
 		}
 	}
 	err = -EINVAL;
-	if (match && match->defrag != defrag)
+	if (match && (match->defrag != defrag || match->rollover != rollover))
 		goto out;
 	if (!match) {
 		err = -ENOMEM;
@@ -1327,6 +1475,7 @@ static int fanout_add(struct sock *sk, u16 id, u16 type_flags)
 		match->id = id;
 		match->type = type;
 		match->defrag = defrag;
+		match->rollover = rollover;
 		atomic_set(&match->rr_cur, 0);
 		INIT_LIST_HEAD(&match->list);
 		spin_lock_init(&match->lock);
@@ -1357,6 +1506,56 @@ out:
 	return err;
 }
 
+static int fanout_set_data(struct packet_sock *po, char __user *data,
+			   unsigned int len)
+{
+	struct packet_fanout *f = po->fanout;
+	struct sk_filter *fp, *old_fp;
+	struct sock_fprog fprog;
+	unsigned int fsize;
+	int err;
+
+	if (!f || f->type != PACKET_FANOUT_CBPF)
+		return -EINVAL;
+	if (len != sizeof(fprog))
+		return -EINVAL;
+	if (copy_from_user(&fprog, data, len))
+		return -EFAULT;
+	if (fprog.filter == NULL || fprog.len > BPF_MAXINSNS)
+		return -EINVAL;
+
+	fsize = sizeof(struct sock_filter) * fprog.len;
+	fp = kmalloc(fsize + sizeof(*fp), GFP_KERNEL);
+	if (!fp)
+		return -ENOMEM;
+	if (copy_from_user(fp->insns, fprog.filter, fsize)) {
+		kfree(fp);
+		return -EFAULT;
+	}
+
+	atomic_set(&fp->refcnt, 1);
+	fp->len = fprog.len;
+	fp->bpf_func = sk_run_filter;
+
+	err = sk_chk_filter(fp->insns, fp->len);
+	if (err) {
+		kfree(fp);
+		return err;
+	}
+
+	bpf_jit_compile(fp);
+
+	spin_lock(&f->lock);
+	old_fp = rcu_dereference_protected(f->bpf_prog,
+					   lockdep_is_held(&f->lock));
+	rcu_assign_pointer(f->bpf_prog, fp);
+	spin_unlock(&f->lock);
+
+	if (old_fp)
+		sk_filter_release(old_fp);
+	return 0;
+}
+
 static void fanout_release(struct sock *sk)
 {
 	struct packet_sock *po = pkt_sk(sk);
@@ -1372,6 +1571,8 @@ static void fanout_release(struct sock *sk)
 	if (atomic_dec_and_test(&f->sk_ref)) {
 		list_del(&f->list);
 		dev_remove_pack(&f->prot_hook);
+		if (f->bpf_prog)
+			sk_filter_release(rcu_dereference_protected(f->bpf_prog, 1));
 		kfree(f);
 	}
 	mutex_unlock(&fanout_mutex);
@@ -1949,6 +2150,7 @@ static int tpacket_fill_skb(struct packet_sock *po, struct sk_buff *skb,
 	union {
 		struct tpacket_hdr *h1;
 		struct tpacket2_hdr *h2;
+		struct tpacket3_hdr *h3;
 		void *raw;
 	} ph;
 	int to_write, offset, len, tp_len, nr_frags, len_max;
@@ -1966,6 +2168,14 @@ static int tpacket_fill_skb(struct packet_sock *po, struct sk_buff *skb,
 	skb_shinfo(skb)->destructor_arg = ph.raw;
 
 	switch (po->tp_version) {
+	case TPACKET_V3:
+		/* Variable sized slots are not supported on the Tx-ring */
+		if (unlikely(ph.h3->tp_next_offset != 0)) {
+			pr_warn_once("variable sized slot not supported\n");
+			return -EINVAL;
+		}
+		tp_len = ph.h3->tp_len;
+		break;
 	case TPACKET_V2:
 		tp_len = ph.h2->tp_len;
 		break;
@@ -2141,7 +2351,7 @@ static int tpacket_snd(struct packet_sock *po, struct msghdr *msg)
 		atomic_inc(&po->tx_ring.pending);
 
 		status = TP_STATUS_SEND_REQUEST;
-		err = dev_queue_xmit(skb);
+		err = po->xmit(skb);
 		if (unlikely(err > 0)) {
 			err = net_xmit_errno(err);
 			if (err && __packet_get_status(po, ph) ==
@@ -2360,7 +2570,7 @@ static int packet_snd(struct socket *sock,
 	 *	Now send it
 	 */
 
-	err = dev_queue_xmit(skb);
+	err = po->xmit(skb);
 	if (err > 0 && (err = net_xmit_errno(err)) != 0)
 		goto out_unlock;
 
@@ -2588,6 +2798,7 @@ static int packet_create(struct net *net, struct socket *sock, int protocol,
 	po = pkt_sk(sk);
 	sk->sk_family = PF_PACKET;
 	po->num = proto;
+	po->xmit = dev_queue_xmit;
 	RCU_INIT_POINTER(po->cached_dev, NULL);
 
 	sk->sk_destruct = packet_sock_destruct;
@@ -3194,6 +3405,22 @@ packet_setsockopt(struct socket *sock, int level, int optname, char __user *optv
 
 		return fanout_add(sk, val & 0xffff, val >> 16);
 	}
+	case PACKET_FANOUT_DATA:
+		return fanout_set_data(po, optval, optlen);
+	case PACKET_QDISC_BYPASS:
+	{
+		int val;
+
+		if (optlen != sizeof(val))
+			return -EINVAL;
+		if (po->rx_ring.pg_vec || po->tx_ring.pg_vec)
+			return -EBUSY;
+		if (copy_from_user(&val, optval, sizeof(val)))
+			return -EFAULT;
+
+		po->xmit = val ? packet_direct_xmit : dev_queue_xmit;
+		return 0;
+	}
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -3209,6 +3436,7 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 	void *data;
 	struct tpacket_stats st;
 	union tpacket_stats_u st_u;
+	struct tpacket_rollover_stats rstats;
 
 	if (level != SOL_PACKET)
 		return -ENOPROTOOPT;
@@ -3313,10 +3541,27 @@ static int packet_getsockopt(struct socket *sock, int level, int optname,
 			len = sizeof(int);
 		val = (po->fanout ?
 		       ((u32)po->fanout->id |
-			((u32)po->fanout->type << 16)) :
+			((u32)po->fanout->type << 16) |
+			(po->fanout->defrag ?
+			 (u32)PACKET_FANOUT_FLAG_DEFRAG << 16 : 0) |
+			(po->fanout->rollover ?
+			 (u32)PACKET_FANOUT_FLAG_ROLLOVER << 16 : 0)) :
 		       0);
 		data = &val;
 		break;
+	case PACKET_ROLLOVER_STATS:
+		if (len > sizeof(rstats))
+			len = sizeof(rstats);
+		rstats.tp_all = atomic_long_read(&po->rollover.num);
+		rstats.tp_failed = atomic_long_read(&po->rollover.num_failed);
+		data = &rstats;
+		break;
+	case PACKET_QDISC_BYPASS:
+		if (len > sizeof(int))
+			len = sizeof(int);
+		val = packet_use_direct_xmit(po);
+		data = &val;
+		break;
 	default:
 		return -ENOPROTOOPT;
 	}
@@ -3574,12 +3819,6 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 	/* Added to avoid minimal code churn */
 	struct tpacket_req *req = &req_u->req;
 
-	/* Opening a Tx-ring is NOT supported in TPACKET_V3 */
-	if (!closing && tx_ring && (po->tp_version > TPACKET_V2)) {
-		WARN(1, "Tx-ring is not supported.\n");
-		goto out;
-	}
-
 	rb = tx_ring ? &po->tx_ring : &po->rx_ring;
 	rb_queue = tx_ring ? &sk->sk_write_queue : &sk->sk_receive_queue;
 
@@ -3626,6 +3865,12 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 		if (unlikely((rb->frames_per_block * req->tp_block_nr) !=
 					req->tp_frame_nr))
 			goto out;
+		/* The V3 Tx-ring is frame based, it has no block options. */
+		if (tx_ring && po->tp_version == TPACKET_V3 &&
+		    (req_u->req3.tp_retire_blk_tov ||
+		     req_u->req3.tp_sizeof_priv ||
+		     req_u->req3.tp_feature_req_word))
+			goto out;
 
 		err = -ENOMEM;
 		order = get_order(req->tp_block_size);
@@ -3634,12 +3879,10 @@ static int packet_set_ring(struct sock *sk, union tpacket_req_u *req_u,
 			goto out;
 		switch (po->tp_version) {
 		case TPACKET_V3:
-		/* Transmit path is not supported. We checked
-		 * it above but just being paranoid
-		 */
+			/* Block transmit is not supported. */
 			if (!tx_ring)
 				init_prb_bdqc(po, rb, pg_vec, req_u, tx_ring);
-				break;
+			break;
 		default:
 			break;
 		}
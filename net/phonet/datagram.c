@@ -90,7 +90,7 @@ static int pn_sendmsg(struct kiocb *iocb, struct sock *sk,
 	struct sk_buff *skb;
 	int err;
 
-	if (msg->msg_flags & ~(MSG_DONTWAIT|MSG_EOR|MSG_NOSIGNAL|
+	if (msg->msg_flags & ~(MSG_DONTWAIT|MSG_BATCH|MSG_EOR|MSG_NOSIGNAL|
 				MSG_CMSG_COMPAT))
 		return -EOPNOTSUPP;
 
@@ -1049,7 +1049,7 @@ static int pep_sendmsg(struct kiocb *iocb, struct sock *sk,
 	if (len > USHRT_MAX)
 		return -EMSGSIZE;
 
-	if ((msg->msg_flags & ~(MSG_DONTWAIT|MSG_EOR|MSG_NOSIGNAL|
+	if ((msg->msg_flags & ~(MSG_DONTWAIT|MSG_BATCH|MSG_EOR|MSG_NOSIGNAL|
 				MSG_CMSG_COMPAT)) ||
 			!(msg->msg_flags & MSG_EOR))
 		return -EOPNOTSUPP;
@@ -1063,7 +1063,7 @@ static int rose_sendmsg(struct kiocb *iocb, struct socket *sock,
 	unsigned char *asmptr;
 	int n, size, qbit = 0;
 
-	if (msg->msg_flags & ~(MSG_DONTWAIT|MSG_EOR|MSG_CMSG_COMPAT))
+	if (msg->msg_flags & ~(MSG_DONTWAIT|MSG_BATCH|MSG_EOR|MSG_CMSG_COMPAT))
 		return -EINVAL;
 
 	if (sock_flag(sk, SOCK_ZAPPED))
@@ -0,0 +1,280 @@
+/*
+ * net/sched/sch_etf.c	Earliest TxTime First queueing discipline.
+ *
+ *		This program is free software; you can redistribute it and/or
+ *		modify it under the terms of the GNU General Public License
+ *		as published by the Free Software Foundation; either version
+ *		2 of the License, or (at your option) any later version.
+ *
+ * Packets carry their transmit time in skb->tstamp, set from the
+ * SCM_TXTIME control message of a socket with SO_TXTIME enabled.  They
+ * are kept sorted by that time and each one is released to the device
+ * at most delta nanoseconds before it is due, with an hrtimer on the
+ * socket's clock waking the queue up in between.
+ *
+ * In deadline mode the time is a deadline rather than a launch time:
+ * packets leave as soon as possible, earliest deadline first.
+ */
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/string.h>
+#include <linux/errno.h>
+#include <linux/skbuff.h>
+#include <linux/ktime.h>
+#include <linux/hrtimer.h>
+#include <net/netlink.h>
+#include <net/sch_generic.h>
+#include <net/pkt_sched.h>
+#include <net/sock.h>
+
+struct etf_sched_data {
+	bool		deadline_mode;
+	int		clockid;
+	s32		delta;		/* in ns */
+	ktime_t		last;		/* txtime of the last skb dequeued */
+	u32		drop_count;	/* expired skbs not yet reported */
+	struct qdisc_watchdog watchdog;
+	ktime_t		(*get_time)(void);
+};
+
+static const struct nla_policy etf_policy[TCA_ETF_MAX + 1] = {
+	[TCA_ETF_PARMS]	= { .len = sizeof(struct tc_etf_qopt) },
+};
+
+static int validate_input_params(const struct tc_etf_qopt *qopt)
+{
+	/* The watchdog hrtimer has to run on the clock the txtimes are
+	 * in, and there is no cross-timestamping: only the clocks an
+	 * hrtimer can be based on are accepted.
+	 */
+	if (qopt->clockid != CLOCK_MONOTONIC &&
+	    qopt->clockid != CLOCK_REALTIME)
+		return -EINVAL;
+
+	if (qopt->delta < 0)
+		return -EINVAL;
+
+	return 0;
+}
+
+static bool is_packet_valid(struct Qdisc *sch, struct sk_buff *nskb)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+	ktime_t txtime = nskb->tstamp;
+	struct sock *sk = nskb->sk;
+	ktime_t now;
+
+	if (!sk || !sock_flag(sk, SOCK_TXTIME))
+		return false;
+
+	if (sk->sk_clockid != q->clockid)
+		return false;
+
+	if (sk->sk_txtime_deadline_mode != q->deadline_mode)
+		return false;
+
+	now = q->get_time();
+	if (ktime_to_ns(txtime) < ktime_to_ns(now) ||
+	    ktime_to_ns(txtime) < ktime_to_ns(q->last))
+		return false;
+
+	return true;
+}
+
+static int etf_enqueue(struct sk_buff *nskb, struct Qdisc *sch)
+{
+	struct sk_buff_head *list = &sch->q;
+	s64 tnext = ktime_to_ns(nskb->tstamp);
+	struct sk_buff *skb;
+
+	if (!is_packet_valid(sch, nskb))
+		return qdisc_drop(nskb, sch);
+
+	if (unlikely(skb_queue_len(list) >= sch->limit))
+		return qdisc_drop(nskb, sch);
+
+	/* Optimize for add at tail, periodic senders queue in order */
+	skb = skb_peek_tail(list);
+	if (likely(!skb || tnext >= ktime_to_ns(skb->tstamp)))
+		return qdisc_enqueue_tail(nskb, sch);
+
+	skb_queue_reverse_walk(list, skb) {
+		if (tnext >= ktime_to_ns(skb->tstamp))
+			break;
+	}
+
+	__skb_queue_after(list, skb, nskb);
+	sch->qstats.backlog += qdisc_pkt_len(nskb);
+
+	return NET_XMIT_SUCCESS;
+}
+
+static struct sk_buff *etf_dequeue(struct Qdisc *sch)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+	struct sk_buff *skb;
+	ktime_t now;
+
+	now = q->get_time();
+
+	/* Drop the packets that expired while in the queue */
+	while ((skb = qdisc_peek_head(sch)) != NULL &&
+	       ktime_to_ns(skb->tstamp) < ktime_to_ns(now)) {
+		__qdisc_dequeue_head(sch, &sch->q);
+		sch->qstats.backlog -= qdisc_pkt_len(skb);
+		sch->qstats.overlimits++;
+		qdisc_drop(skb, sch);
+		q->drop_count++;
+	}
+
+	/* We cant call qdisc_tree_decrease_qlen() if our qlen is 0,
+	 * or HTB crashes. Defer it for next round.
+	 */
+	if (q->drop_count && sch->q.qlen) {
+		qdisc_tree_decrease_qlen(sch, q->drop_count);
+		q->drop_count = 0;
+	}
+
+	if (!skb)
+		return NULL;
+
+	/* In deadline mode the packet goes now, and what it carries to
+	 * the device is the time it was actually sent at.
+	 */
+	if (q->deadline_mode) {
+		skb->tstamp = now;
+	} else {
+		ktime_t next = ktime_sub_ns(skb->tstamp, q->delta);
+
+		/* Release the packet only within [txtime - delta, txtime] */
+		if (ktime_to_ns(now) < ktime_to_ns(next)) {
+			qdisc_watchdog_schedule_ns(&q->watchdog,
+						   ktime_to_ns(next));
+			return NULL;
+		}
+	}
+
+	skb = __qdisc_dequeue_head(sch, &sch->q);
+	sch->qstats.backlog -= qdisc_pkt_len(skb);
+	qdisc_unthrottled(sch);
+	qdisc_bstats_update(sch, skb);
+	q->last = skb->tstamp;
+
+	return skb;
+}
+
+static int etf_init(struct Qdisc *sch, struct nlattr *opt)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+	struct nlattr *tb[TCA_ETF_MAX + 1];
+	struct tc_etf_qopt *qopt;
+	int err;
+
+	if (!opt)
+		return -EINVAL;
+
+	err = nla_parse_nested(tb, TCA_ETF_MAX, opt, etf_policy);
+	if (err < 0)
+		return err;
+
+	if (!tb[TCA_ETF_PARMS])
+		return -EINVAL;
+
+	qopt = nla_data(tb[TCA_ETF_PARMS]);
+	err = validate_input_params(qopt);
+	if (err < 0)
+		return err;
+
+	q->delta = qopt->delta;
+	q->clockid = qopt->clockid;
+	q->deadline_mode = !!(qopt->flags & TC_ETF_DEADLINE_MODE_ON);
+	q->last = ktime_set(0, 0);
+	q->drop_count = 0;
+
+	switch (q->clockid) {
+	case CLOCK_REALTIME:
+		q->get_time = ktime_get_real;
+		break;
+	case CLOCK_MONOTONIC:
+		q->get_time = ktime_get;
+		break;
+	}
+
+	sch->limit = max_t(u32, qdisc_dev(sch)->tx_queue_len, 1);
+
+	qdisc_watchdog_init_clockid(&q->watchdog, sch, q->clockid);
+
+	return 0;
+}
+
+static void etf_reset(struct Qdisc *sch)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+
+	qdisc_reset_queue(sch);
+	qdisc_watchdog_cancel(&q->watchdog);
+	q->last = ktime_set(0, 0);
+	q->drop_count = 0;
+}
+
+static void etf_destroy(struct Qdisc *sch)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+
+	qdisc_watchdog_cancel(&q->watchdog);
+}
+
+static int etf_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct etf_sched_data *q = qdisc_priv(sch);
+	struct tc_etf_qopt opt = { };
+	struct nlattr *nest;
+
+	nest = nla_nest_start(skb, TCA_OPTIONS);
+	if (nest == NULL)
+		goto nla_put_failure;
+
+	opt.delta = q->delta;
+	opt.clockid = q->clockid;
+	if (q->deadline_mode)
+		opt.flags |= TC_ETF_DEADLINE_MODE_ON;
+
+	NLA_PUT(skb, TCA_ETF_PARMS, sizeof(opt), &opt);
+
+	return nla_nest_end(skb, nest);
+
+nla_put_failure:
+	nla_nest_cancel(skb, nest);
+	return -1;
+}
+
+static struct Qdisc_ops etf_qdisc_ops __read_mostly = {
+	.id		=	"etf",
+	.priv_size	=	sizeof(struct etf_sched_data),
+	.enqueue	=	etf_enqueue,
+	.dequeue	=	etf_dequeue,
+	.peek		=	qdisc_peek_head,
+	.init		=	etf_init,
+	.reset		=	etf_reset,
+	.destroy	=	etf_destroy,
+	.dump		=	etf_dump,
+	.owner		=	THIS_MODULE,
+};
+
+static int __init etf_module_init(void)
+{
+	return register_qdisc(&etf_qdisc_ops);
+}
+
+static void __exit etf_module_exit(void)
+{
+	unregister_qdisc(&etf_qdisc_ops);
+}
+
+module_init(etf_module_init)
+module_exit(etf_module_exit)
+
+MODULE_DESCRIPTION("Earliest TxTime First queueing discipline");
+MODULE_LICENSE("GPL");
@@ -2067,6 +2067,7 @@ SCTP_STATIC int sctp_recvmsg(struct kiocb *iocb, struct sock *sk,
 	int copied;
 	int err = 0;
 	int skb_len;
+	int unlocked;
 
 	SCTP_DEBUG_PRINTK("sctp_recvmsg(%s: %p, %s: %p, %s: %zd, %s: %d, %s: "
 			  "0x%x, %s: %p)\n", "sk", sk, "msghdr", msg,
@@ -2089,16 +2090,33 @@ SCTP_STATIC int sctp_recvmsg(struct kiocb *iocb, struct sock *sk,
 	 */
 	skb_len = skb->len;
 
+	/* A one-to-many socket carries all of its associations, so do not
+	 * hold the socket lock while copying to user space: other readers
+	 * and the receive path can proceed meanwhile.  The skb is off the
+	 * receive queue and its event holds a reference on the association.
+	 * A partial read keeps the lock, as the rest of the skb goes back
+	 * to the head of the queue and must not be overtaken by another
+	 * reader; so does a partial delivery fragment, whose successors
+	 * must not be handed to another reader in between.
+	 */
+	event = sctp_skb2event(skb);
+	unlocked = sctp_style(sk, UDP) && !(flags & MSG_PEEK) &&
+		   skb_len <= len &&
+		   (event->msg_flags & (MSG_EOR | MSG_NOTIFICATION));
+	if (unlocked)
+		sctp_release_sock(sk);
+
 	copied = skb_len;
 	if (copied > len)
 		copied = len;
 
 	err = skb_copy_datagram_iovec(skb, 0, msg->msg_iov, copied);
 
-	event = sctp_skb2event(skb);
-
-	if (err)
+	if (err) {
+		if (unlocked)
+			sctp_lock_sock(sk);
 		goto out_free;
+	}
 
 	sock_recv_ts_and_drops(msg, sk, skb);
 	if (sctp_ulpevent_is_notification(event)) {
@@ -2117,6 +2135,9 @@ SCTP_STATIC int sctp_recvmsg(struct kiocb *iocb, struct sock *sk,
 		ip_cmsg_recv(msg, skb);
 #endif
 
+	if (unlocked)
+		sctp_lock_sock(sk);
+
 	err = copied;
 
 	/* If skb's length exceeds the user's buffer, update the skb and
@@ -37,6 +37,9 @@ static LIST_HEAD(svc_xprt_class_list);
 /* SMP locking strategy:
  *
  *	svc_pool->sp_lock protects most of the fields of that pool.
+ *	svc_pool->sp_all_threads is walked under rcu by svc_xprt_enqueue
+ *	to find an idle thread; svc_rqst->rq_lock and the RQ_BUSY bit
+ *	serialize handing a transport to that thread.
  *	svc_serv->sv_lock protects sv_tempsocks, sv_permsocks, sv_tmpcnt.
  *	when both need to be taken (rare), svc_serv->sv_lock is first.
  *	BKL protects svc_serv->sv_nrthread.
@@ -280,25 +283,6 @@ char *svc_print_addr(struct svc_rqst *rqstp, char *buf, size_t len)
 }
 EXPORT_SYMBOL_GPL(svc_print_addr);
 
-/*
- * Queue up an idle server thread.  Must have pool->sp_lock held.
- * Note: this is really a stack rather than a queue, so that we only
- * use as many different threads as we need, and the rest don't pollute
- * the cache.
- */
-static void svc_thread_enqueue(struct svc_pool *pool, struct svc_rqst *rqstp)
-{
-	list_add(&rqstp->rq_list, &pool->sp_threads);
-}
-
-/*
- * Dequeue an nfsd thread.  Must have pool->sp_lock held.
- */
-static void svc_thread_dequeue(struct svc_pool *pool, struct svc_rqst *rqstp)
-{
-	list_del(&rqstp->rq_list);
-}
-
 static bool svc_xprt_has_something_to_do(struct svc_xprt *xprt)
 {
 	if (xprt->xpt_flags & ((1<<XPT_CONN)|(1<<XPT_CLOSE)))
@@ -312,30 +296,21 @@ static bool svc_xprt_has_something_to_do(struct svc_xprt *xprt)
  * Queue up a transport with data pending. If there are idle nfsd
  * processes, wake 'em up.
  *
+ * Neither the busy check nor the search for an idle thread takes the
+ * pool lock: idle threads are found by walking sp_all_threads under rcu
+ * and claimed by atomically setting their RQ_BUSY bit. sp_lock is only
+ * taken to queue the transport when every thread is busy.
  */
 void svc_xprt_enqueue(struct svc_xprt *xprt)
 {
 	struct svc_pool *pool;
 	struct svc_rqst	*rqstp;
 	int cpu;
+	bool queued = false;
 
 	if (!svc_xprt_has_something_to_do(xprt))
 		return;
 
-	cpu = get_cpu();
-	pool = svc_pool_for_cpu(xprt->xpt_server, cpu);
-	put_cpu();
-
-	spin_lock_bh(&pool->sp_lock);
-
-	if (!list_empty(&pool->sp_threads) &&
-	    !list_empty(&pool->sp_sockets))
-		printk(KERN_ERR
-		       "svc_xprt_enqueue: "
-		       "threads and transports both waiting??\n");
-
-	pool->sp_stats.packets++;
-
 	/* Mark transport as busy. It will remain in this state until
 	 * the provider calls svc_xprt_received. We update XPT_BUSY
 	 * atomically because it also guards against trying to enqueue
@@ -344,51 +319,87 @@ void svc_xprt_enqueue(struct svc_xprt *xprt)
 	if (test_and_set_bit(XPT_BUSY, &xprt->xpt_flags)) {
 		/* Don't enqueue transport while already enqueued */
 		dprintk("svc: transport %p busy, not enqueued\n", xprt);
-		goto out_unlock;
+		return;
 	}
 
-	if (!list_empty(&pool->sp_threads)) {
-		rqstp = list_entry(pool->sp_threads.next,
-				   struct svc_rqst,
-				   rq_list);
-		dprintk("svc: transport %p served by daemon %p\n",
-			xprt, rqstp);
-		svc_thread_dequeue(pool, rqstp);
-		if (rqstp->rq_xprt)
-			printk(KERN_ERR
-				"svc_xprt_enqueue: server %p, rq_xprt=%p!\n",
-				rqstp, rqstp->rq_xprt);
-		rqstp->rq_xprt = xprt;
-		svc_xprt_get(xprt);
-		pool->sp_stats.threads_woken++;
-		wake_up(&rqstp->rq_wait);
-	} else {
+	cpu = get_cpu();
+	pool = svc_pool_for_cpu(xprt->xpt_server, cpu);
+
+	atomic_long_inc(&pool->sp_stats.packets);
+
+redo_search:
+	rcu_read_lock();
+	list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
+		/* Do a lockless check first */
+		if (test_bit(RQ_BUSY, &rqstp->rq_flags))
+			continue;
+
+		/*
+		 * Once the transport has been queued, it can only be
+		 * dequeued by the thread that is going to serve it. All
+		 * we can do then is to wake an idle thread to pick it up.
+		 */
+		if (!queued) {
+			spin_lock_bh(&rqstp->rq_lock);
+			if (test_and_set_bit(RQ_BUSY, &rqstp->rq_flags)) {
+				/* already busy, move on... */
+				spin_unlock_bh(&rqstp->rq_lock);
+				continue;
+			}
+			dprintk("svc: transport %p served by daemon %p\n",
+				xprt, rqstp);
+			rqstp->rq_xprt = xprt;
+			svc_xprt_get(xprt);
+			spin_unlock_bh(&rqstp->rq_lock);
+		}
+		atomic_long_inc(&pool->sp_stats.threads_woken);
+		wake_up_process(rqstp->rq_task);
+		rcu_read_unlock();
+		goto out;
+	}
+	rcu_read_unlock();
+
+	/*
+	 * No idle thread: queue the transport, then search once more in
+	 * case a thread went idle meanwhile and missed the queued entry.
+	 */
+	if (!queued) {
+		queued = true;
 		dprintk("svc: transport %p put into queue\n", xprt);
+		spin_lock_bh(&pool->sp_lock);
 		list_add_tail(&xprt->xpt_ready, &pool->sp_sockets);
 		pool->sp_stats.sockets_queued++;
+		spin_unlock_bh(&pool->sp_lock);
+		/* Pairs with the smp_mb() in svc_recv() */
+		smp_mb();
+		goto redo_search;
 	}
-
-out_unlock:
-	spin_unlock_bh(&pool->sp_lock);
+out:
+	put_cpu();
 }
 EXPORT_SYMBOL_GPL(svc_xprt_enqueue);
 
 /*
- * Dequeue the first transport.  Must be called with the pool->sp_lock held.
+ * Dequeue the first transport, if any.
  */
 static struct svc_xprt *svc_xprt_dequeue(struct svc_pool *pool)
 {
-	struct svc_xprt	*xprt;
+	struct svc_xprt	*xprt = NULL;
 
 	if (list_empty(&pool->sp_sockets))
 		return NULL;
 
-	xprt = list_entry(pool->sp_sockets.next,
-			  struct svc_xprt, xpt_ready);
-	list_del_init(&xprt->xpt_ready);
+	spin_lock_bh(&pool->sp_lock);
+	if (likely(!list_empty(&pool->sp_sockets))) {
+		xprt = list_first_entry(&pool->sp_sockets,
+					struct svc_xprt, xpt_ready);
+		list_del_init(&xprt->xpt_ready);
+		svc_xprt_get(xprt);
 
-	dprintk("svc: transport %p dequeued, inuse=%d\n",
-		xprt, atomic_read(&xprt->xpt_ref.refcount));
+		dprintk("svc: transport %p dequeued, inuse=%d\n",
+			xprt, atomic_read(&xprt->xpt_ref.refcount));
+	}
+	spin_unlock_bh(&pool->sp_lock);
 
 	return xprt;
 }
@@ -482,19 +493,22 @@ void svc_wake_up(struct svc_serv *serv)
 	for (i = 0; i < serv->sv_nrpools; i++) {
 		pool = &serv->sv_pools[i];
 
-		spin_lock_bh(&pool->sp_lock);
-		if (!list_empty(&pool->sp_threads)) {
-			rqstp = list_entry(pool->sp_threads.next,
-					   struct svc_rqst,
-					   rq_list);
+		rcu_read_lock();
+		list_for_each_entry_rcu(rqstp, &pool->sp_all_threads, rq_all) {
+			/* skip any that aren't idle */
+			if (test_bit(RQ_BUSY, &rqstp->rq_flags))
+				continue;
 			dprintk("svc: daemon %p woken up.\n", rqstp);
-			/*
-			svc_thread_dequeue(pool, rqstp);
-			rqstp->rq_xprt = NULL;
-			 */
-			wake_up(&rqstp->rq_wait);
+			wake_up_process(rqstp->rq_task);
+			rcu_read_unlock();
+			goto next;
 		}
-		spin_unlock_bh(&pool->sp_lock);
+		rcu_read_unlock();
+
+		/* No idle thread: make the next one not to sleep. */
+		set_bit(SP_TASK_PENDING, &pool->sp_flags);
+next:
+		;
 	}
 }
 EXPORT_SYMBOL_GPL(svc_wake_up);
@@ -567,6 +581,33 @@ static void svc_check_conn_limits(struct svc_serv *serv)
 	}
 }
 
+/*
+ * Check whether an idle thread may go to sleep, or whether work
+ * slipped in while it was marking itself idle.
+ */
+static bool svc_rqst_should_sleep(struct svc_rqst *rqstp)
+{
+	struct svc_pool *pool = rqstp->rq_pool;
+
+	/* did someone call svc_wake_up? */
+	if (test_and_clear_bit(SP_TASK_PENDING, &pool->sp_flags))
+		return false;
+
+	/* was a transport queued? */
+	if (!list_empty(&pool->sp_sockets))
+		return false;
+
+	/* are we shutting down? */
+	if (signalled() || kthread_should_stop())
+		return false;
+
+	/* are we freezing? */
+	if (freezing(current))
+		return false;
+
+	return true;
+}
+
 /*
  * Receive the next request on any transport.  This code is carefully
  * organised not to touch any cachelines in the shared svc_serv
@@ -580,8 +621,7 @@ int svc_recv(struct svc_rqst *rqstp, long timeout)
 	int			len, i;
 	int			pages;
 	struct xdr_buf		*arg;
-	DECLARE_WAITQUEUE(wait, current);
-	long			time_left;
+	long			time_left = 0;
 
 	dprintk("svc: server %p waiting for data (to = %ld)\n",
 		rqstp, timeout);
@@ -590,10 +630,6 @@ int svc_recv(struct svc_rqst *rqstp, long timeout)
 		printk(KERN_ERR
 			"svc_recv: service %p, transport not NULL!\n",
 			 rqstp);
-	if (waitqueue_active(&rqstp->rq_wait))
-		printk(KERN_ERR
-			"svc_recv: service %p, wait queue active!\n",
-			 rqstp);
 
 	/* now allocate needed pages.  If we get a failure, sleep briefly */
 	pages = (serv->sv_max_mesg + PAGE_SIZE) / PAGE_SIZE;
@@ -634,56 +670,42 @@ int svc_recv(struct svc_rqst *rqstp, long timeout)
 	 */
 	rqstp->rq_chandle.thread_wait = 5*HZ;
 
-	spin_lock_bh(&pool->sp_lock);
 	xprt = svc_xprt_dequeue(pool);
 	if (xprt) {
 		rqstp->rq_xprt = xprt;
-		svc_xprt_get(xprt);
 
 		/* As there is a shortage of threads and this request
 		 * had to be queued, don't allow the thread to wait so
 		 * long for cache updates.
 		 */
 		rqstp->rq_chandle.thread_wait = 1*HZ;
+		clear_bit(SP_TASK_PENDING, &pool->sp_flags);
 	} else {
-		/* No data pending. Go to sleep */
-		svc_thread_enqueue(pool, rqstp);
-
 		/*
-		 * We have to be able to interrupt this wait
-		 * to bring down the daemons ...
+		 * No data pending. Go idle: from now on svc_xprt_enqueue()
+		 * may hand us a transport. We have to be able to interrupt
+		 * this wait to bring down the daemons ...
 		 */
 		set_current_state(TASK_INTERRUPTIBLE);
+		clear_bit(RQ_BUSY, &rqstp->rq_flags);
+		/* Pairs with the smp_mb() in svc_xprt_enqueue() */
+		smp_mb();
 
-		/*
-		 * checking kthread_should_stop() here allows us to avoid
-		 * locking and signalling when stopping kthreads that call
-		 * svc_recv. If the thread has already been woken up, then
-		 * we can exit here without sleeping. If not, then it
-		 * it'll be woken up quickly during the schedule_timeout
-		 */
-		if (kthread_should_stop()) {
-			set_current_state(TASK_RUNNING);
-			spin_unlock_bh(&pool->sp_lock);
-			return -EINTR;
-		}
-
-		add_wait_queue(&rqstp->rq_wait, &wait);
-		spin_unlock_bh(&pool->sp_lock);
-
-		time_left = schedule_timeout(timeout);
+		if (likely(svc_rqst_should_sleep(rqstp)))
+			time_left = schedule_timeout(timeout);
+		else
+			__set_current_state(TASK_RUNNING);
 
 		try_to_freeze();
 
-		spin_lock_bh(&pool->sp_lock);
-		remove_wait_queue(&rqstp->rq_wait, &wait);
-		if (!time_left)
-			pool->sp_stats.threads_timedout++;
+		spin_lock_bh(&rqstp->rq_lock);
+		set_bit(RQ_BUSY, &rqstp->rq_flags);
+		spin_unlock_bh(&rqstp->rq_lock);
 
 		xprt = rqstp->rq_xprt;
 		if (!xprt) {
-			svc_thread_dequeue(pool, rqstp);
-			spin_unlock_bh(&pool->sp_lock);
+			if (!time_left)
+				atomic_long_inc(&pool->sp_stats.threads_timedout);
 			dprintk("svc: server %p, no data yet\n", rqstp);
 			if (signalled() || kthread_should_stop())
 				return -EINTR;
@@ -691,7 +713,6 @@ int svc_recv(struct svc_rqst *rqstp, long timeout)
 				return -EAGAIN;
 		}
 	}
-	spin_unlock_bh(&pool->sp_lock);
 
 	len = 0;
 	if (test_bit(XPT_CLOSE, &xprt->xpt_flags)) {
@@ -1220,10 +1241,10 @@ static int svc_pool_stats_show(struct seq_file *m, void *p)
 
 	seq_printf(m, "%u %lu %lu %lu %lu\n",
 		pool->sp_id,
-		pool->sp_stats.packets,
+		atomic_long_read(&pool->sp_stats.packets),
 		pool->sp_stats.sockets_queued,
-		pool->sp_stats.threads_woken,
-		pool->sp_stats.threads_timedout);
+		atomic_long_read(&pool->sp_stats.threads_woken),
+		atomic_long_read(&pool->sp_stats.threads_timedout));
 
 	return 0;
 }
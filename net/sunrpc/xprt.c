@@ -1139,13 +1139,9 @@ void xprt_release(struct rpc_task *task)
 	struct rpc_rqst	*req = task->tk_rqstp;
 
 	if (req == NULL) {
-		if (task->tk_client) {
-			rcu_read_lock();
-			xprt = rcu_dereference(task->tk_client->cl_xprt);
-			if (xprt->snd_task == task)
-				xprt_release_write(xprt, task);
-			rcu_read_unlock();
-		}
+		xprt = task->tk_xprt;
+		if (xprt && xprt->snd_task == task)
+			xprt_release_write(xprt, task);
 		return;
 	}
 
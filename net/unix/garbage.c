@@ -95,6 +95,13 @@ static DECLARE_WAIT_QUEUE_HEAD(unix_gc_wait);
 
 unsigned int unix_tot_inflight;
 
+/*
+ * Cleared when a collection starts, set again if it leaves cycles behind
+ * or when an edge which might close a new one is added.  While it is
+ * clear no in-flight socket can be garbage and unix_gc() does nothing.
+ */
+static bool unix_graph_maybe_cyclic;
+
 
 struct sock *unix_get_socket(struct file *filp)
 {
@@ -148,6 +155,12 @@ void unix_notinflight(struct file *fp)
 		BUG_ON(list_empty(&u->link));
 		if (atomic_long_dec_and_test(&u->inflight))
 			list_del_init(&u->link);
+		else
+			/*
+			 * Still in flight elsewhere: the collector may have
+			 * counted this reference as an edge from outside.
+			 */
+			unix_graph_maybe_cyclic = true;
 		unix_tot_inflight--;
 		spin_unlock(&unix_gc_lock);
 	}
@@ -258,11 +271,97 @@ static void inc_inflight_move_tail(struct unix_sock *u)
 		list_move_tail(&u->link, &gc_candidates);
 }
 
+static void dec_gc_refs(struct unix_sock *u)
+{
+	u->gc_refs--;
+}
+
+static void inc_gc_refs_move_tail(struct unix_sock *u)
+{
+	u->gc_refs++;
+	if (u->gc_maybe_cycle)
+		list_move_tail(&u->link, &gc_inflight_list);
+}
+
+/*
+ * Does the in-flight graph contain a cycle, whether or not it is
+ * still referenced from outside?  This is the same trial deletion
+ * unix_gc() does, but over all in-flight sockets and on a copy of the
+ * counts, as sockets with external references may be received from
+ * meanwhile.  An edge received in the middle can only make the answer
+ * "yes"; one received before it was seen is reported by
+ * unix_notinflight().
+ */
+static bool unix_graph_cyclic(void)
+{
+	struct unix_sock *u;
+	struct list_head cursor;
+	LIST_HEAD(rooted);
+	bool cyclic;
+
+	list_for_each_entry(u, &gc_inflight_list, link) {
+		u->gc_refs = atomic_long_read(&u->inflight);
+		u->gc_candidate = 1;
+		u->gc_maybe_cycle = 1;
+	}
+
+	list_for_each_entry(u, &gc_inflight_list, link)
+		scan_children(&u->sk, dec_gc_refs, NULL);
+
+	list_add(&cursor, &gc_inflight_list);
+	while (cursor.next != &gc_inflight_list) {
+		u = list_entry(cursor.next, struct unix_sock, link);
+
+		/* Move cursor to after the current position. */
+		list_move(&cursor, &u->link);
+
+		if (u->gc_refs > 0) {
+			list_move_tail(&u->link, &rooted);
+			u->gc_maybe_cycle = 0;
+			scan_children(&u->sk, inc_gc_refs_move_tail, NULL);
+		}
+	}
+	list_del(&cursor);
+
+	/* Whatever is left is only referenced from within the graph */
+	cyclic = !list_empty(&gc_inflight_list);
+
+	list_splice_tail(&rooted, &gc_inflight_list);
+	list_for_each_entry(u, &gc_inflight_list, link) {
+		u->gc_candidate = 0;
+		u->gc_maybe_cycle = 0;
+	}
+	return cyclic;
+}
+
+/*
+ * Called after an skb carrying descriptors was queued on @other.  The
+ * edges it adds can only close a cycle if @other is in flight itself,
+ * or is an embryo, whose queue is scanned through its listener.
+ */
+void unix_update_graph(struct sock *other)
+{
+	if (ACCESS_ONCE(unix_graph_maybe_cyclic))
+		return;
+
+	spin_lock(&unix_gc_lock);
+	if (!other->sk_socket || atomic_long_read(&unix_sk(other)->inflight))
+		unix_graph_maybe_cyclic = true;
+	spin_unlock(&unix_gc_lock);
+}
+
 static bool gc_in_progress = false;
 #define UNIX_INFLIGHT_TRIGGER_GC 16000
 
-void wait_for_unix_gc(void)
+void wait_for_unix_gc(struct scm_fp_list *fpl)
 {
+	/*
+	 * Only senders of descriptors add to the collector's work, the
+	 * others have no reason to wait for it.
+	 */
+	if (!fpl)
+		return;
+
 	/*
 	 * If number of inflight sockets is insane,
 	 * force a garbage collect right now.
@@ -287,7 +386,12 @@ void unix_gc(void)
 	if (gc_in_progress)
 		goto out;
 
+	/* Nothing can have become garbage since the graph was acyclic. */
+	if (!unix_graph_maybe_cyclic)
+		goto out;
+
 	gc_in_progress = true;
+	unix_graph_maybe_cyclic = false;
 	/*
 	 * First, select candidates for garbage collection.  Only
 	 * in-flight sockets are considered, and from those only ones
@@ -378,6 +482,14 @@ void unix_gc(void)
 
 	/* All candidates should have been detached by now. */
 	BUG_ON(!list_empty(&gc_candidates));
+
+	/*
+	 * Cycles still referenced from outside become garbage when that
+	 * reference is dropped, without any new edge: keep collecting.
+	 */
+	if (unix_graph_cyclic())
+		unix_graph_maybe_cyclic = true;
+
 	gc_in_progress = false;
 	wake_up(&unix_gc_wait);
 
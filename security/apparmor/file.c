@@ -12,6 +12,10 @@
  * License.
  */
 
+#include <linux/hash.h>
+#include <linux/mnt_namespace.h>
+#include <linux/nsproxy.h>
+
 #include "include/apparmor.h"
 #include "include/audit.h"
 #include "include/file.h"
@@ -260,6 +264,155 @@ static inline bool is_deleted(struct dentry *dentry)
 	return 0;
 }
 
+/*
+ * Path decision cache
+ *
+ * Mediating a path means building its name with d_path and walking it
+ * through the profile's dfa, which dominates the cost of opening files
+ * for confined tasks that touch the same files over and over.  Each
+ * profile keeps a small per cpu table of recent (path, permission)
+ * decisions so a repeat request that was fully granted and needs no
+ * audit can skip both.
+ *
+ * An entry is only valid as long as the name of its object can not have
+ * changed, which is checked with counters sampled before the name was
+ * built: the rename_lock sequence (any d_move), the mount namespace
+ * event count (any mount change visible to the task) and
+ * aa_path_cache_gen, bumped whenever a dentry is instantiated so a
+ * recycled dentry can not inherit an old entry.  Negative and unlinked
+ * dentries are never cached.
+ */
+#define AA_PATH_CACHE_BITS	3
+#define AA_PATH_CACHE_SIZE	(1 << AA_PATH_CACHE_BITS)
+
+struct aa_path_cache_key {
+	struct vfsmount *mnt;
+	struct dentry *dentry;
+	struct inode *inode;
+	struct mnt_namespace *ns;
+	unsigned int rename_seq;
+	unsigned int gen;
+	int ns_event;
+	int flags;
+	bool owner;
+};
+
+struct aa_path_cache_ent {
+	struct aa_path_cache_key key;
+	u32 allow;
+};
+
+struct aa_path_cache {
+	struct aa_path_cache_ent ent[AA_PATH_CACHE_SIZE];
+};
+
+static atomic_t aa_path_cache_gen = ATOMIC_INIT(0);
+
+/**
+ * aa_path_cache_invalidate - invalidate all cached path decisions
+ */
+void aa_path_cache_invalidate(void)
+{
+	atomic_inc(&aa_path_cache_gen);
+}
+
+/**
+ * path_cache_key - build the cache key for a path request
+ * @key: key to fill in  (NOT NULL)
+ * @profile: profile being enforced  (NOT NULL)
+ * @path: path being checked  (NOT NULL)
+ * @flags: path flags of the request
+ * @cond: conditional info for this request  (NOT NULL)
+ *
+ * Must be called before the name of @path is built.
+ *
+ * Returns: %1 if the request may use the cache else %0
+ */
+static bool path_cache_key(struct aa_path_cache_key *key,
+			   struct aa_profile *profile, struct path *path,
+			   int flags, struct path_cond *cond)
+{
+	struct mnt_namespace *ns = current->nsproxy->mnt_ns;
+
+	if ((flags & PATH_CHROOT_REL) ||
+	    unlikely(AUDIT_MODE(profile) == AUDIT_ALL) ||
+	    !path->dentry->d_inode || d_unlinked(path->dentry) || !ns)
+		return 0;
+
+	/* zeroed so that the padding compares equal */
+	memset(key, 0, sizeof(*key));
+	key->mnt = path->mnt;
+	key->dentry = path->dentry;
+	key->inode = path->dentry->d_inode;
+	key->ns = ns;
+	key->rename_seq = read_seqbegin(&rename_lock);
+	key->gen = atomic_read(&aa_path_cache_gen);
+	key->ns_event = ACCESS_ONCE(ns->event);
+	key->flags = flags;
+	key->owner = current_fsuid() == cond->uid;
+	smp_rmb();
+
+	return 1;
+}
+
+/**
+ * path_cache_lookup - check @request against the cached decision for @key
+ * @profile: profile being enforced  (NOT NULL)
+ * @key: key of the request  (NOT NULL)
+ * @request: requested permissions
+ *
+ * Returns: %1 if @request is known to be granted without audit else %0
+ */
+static bool path_cache_lookup(struct aa_profile *profile,
+			      struct aa_path_cache_key *key, u32 request)
+{
+	struct aa_path_cache *cache = ACCESS_ONCE(profile->file.cache);
+	struct aa_path_cache_ent *ent;
+	bool hit;
+
+	if (!cache)
+		return 0;
+
+	ent = &get_cpu_ptr(cache)->ent[hash_ptr(key->dentry,
+						AA_PATH_CACHE_BITS)];
+	hit = !memcmp(&ent->key, key, sizeof(*key)) &&
+	      !(request & ~ent->allow);
+	put_cpu_ptr(cache);
+
+	return hit;
+}
+
+/**
+ * path_cache_insert - remember the decision computed for @key
+ * @profile: profile being enforced  (NOT NULL)
+ * @key: key of the request  (NOT NULL)
+ * @perms: permissions computed for the name of @key  (NOT NULL)
+ */
+static void path_cache_insert(struct aa_profile *profile,
+			      struct aa_path_cache_key *key,
+			      struct file_perms *perms)
+{
+	struct aa_path_cache *cache = ACCESS_ONCE(profile->file.cache);
+	struct aa_path_cache_ent *ent;
+
+	if (!cache) {
+		cache = alloc_percpu(struct aa_path_cache);
+		if (!cache)
+			return;
+		if (cmpxchg(&profile->file.cache, NULL, cache)) {
+			free_percpu(cache);
+			cache = profile->file.cache;
+		}
+	}
+
+	ent = &get_cpu_ptr(cache)->ent[hash_ptr(key->dentry,
+						AA_PATH_CACHE_BITS)];
+	ent->key = *key;
+	/* permissions that are force audited must always take the slow path */
+	ent->allow = perms->allow & ~perms->audit;
+	put_cpu_ptr(cache);
+}
+
 /**
  * aa_path_perm - do permissions check & audit for @path
  * @op: operation being checked
@@ -276,10 +429,16 @@ int aa_path_perm(int op, struct aa_profile *profile, struct path *path,
 {
 	char *buffer = NULL;
 	struct file_perms perms = {};
+	struct aa_path_cache_key key;
 	const char *name, *info = NULL;
+	bool cacheable;
 	int error;
 
 	flags |= profile->path_flags | (S_ISDIR(cond->mode) ? PATH_IS_DIR : 0);
+	cacheable = path_cache_key(&key, profile, path, flags, cond);
+	if (cacheable && path_cache_lookup(profile, &key, request))
+		return 0;
+
 	error = aa_path_name(path, flags, &buffer, &name, &info);
 	if (error) {
 		if (error == -ENOENT && is_deleted(path->dentry)) {
@@ -295,6 +454,8 @@ int aa_path_perm(int op, struct aa_profile *profile, struct path *path,
 			     &perms);
 		if (request & ~perms.allow)
 			error = -EACCES;
+		else if (cacheable)
+			path_cache_insert(profile, &key, &perms);
 	}
 	error = aa_audit_file(profile, &perms, GFP_KERNEL, op, request, name,
 			      NULL, cond->uid, info, error);
@@ -15,10 +15,13 @@
 #ifndef __AA_FILE_H
 #define __AA_FILE_H
 
+#include <linux/percpu.h>
+
 #include "domain.h"
 #include "match.h"
 
 struct aa_profile;
+struct aa_path_cache;
 struct path;
 
 /*
@@ -158,6 +161,10 @@ int aa_audit_file(struct aa_profile *profile, struct file_perms *perms,
  * then using the value of the accept entry for the matching state as
  * an index into @perms.  If a named exec transition is required it is
  * looked up in the transition table.
+ *
+ * @cache holds recent path decisions of this profile, per cpu.  It is
+ * allocated on first use and dies with the profile, so replacing policy
+ * starts the replacement profile with an empty cache.
  */
 struct aa_file_rules {
 	unsigned int start;
@@ -165,6 +172,7 @@ struct aa_file_rules {
 	/* struct perms perms; */
 	struct aa_domain trans;
 	/* TODO: add delegate table */
+	struct aa_path_cache __percpu *cache;
 };
 
 unsigned int aa_str_perms(struct aa_dfa *dfa, unsigned int start,
@@ -174,6 +182,8 @@ unsigned int aa_str_perms(struct aa_dfa *dfa, unsigned int start,
 int aa_path_perm(int op, struct aa_profile *profile, struct path *path,
 		 int flags, u32 request, struct path_cond *cond);
 
+void aa_path_cache_invalidate(void);
+
 int aa_path_link(struct aa_profile *profile, struct dentry *old_dentry,
 		 struct path *new_dir, struct dentry *new_dentry);
 
@@ -184,6 +194,7 @@ static inline void aa_free_file_rules(struct aa_file_rules *rules)
 {
 	aa_put_dfa(rules->dfa);
 	aa_free_domain_entries(&rules->trans);
+	free_percpu(rules->cache);
 }
 
 #define ACC_FMODE(x) (("\000\004\002\006"[(x)&O_ACCMODE]) | (((x) << 1) & 0x40))
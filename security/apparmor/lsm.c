@@ -567,6 +567,16 @@ static int apparmor_sb_pivotroot(struct path *old_path, struct path *new_path)
 	return error;
 }
 
+/*
+ * A dentry can be freed and its memory reused for another name, make sure
+ * the new dentry does not match path decisions cached for the old one.
+ */
+static void apparmor_d_instantiate(struct dentry *dentry, struct inode *inode)
+{
+	if (inode)
+		aa_path_cache_invalidate();
+}
+
 static int apparmor_getprocattr(struct task_struct *task, char *name,
 				char **value)
 {
@@ -806,6 +816,7 @@ static struct security_operations apparmor_ops = {
 	.file_mprotect =		apparmor_file_mprotect,
 	.file_lock =			apparmor_file_lock,
 
+	.d_instantiate =		apparmor_d_instantiate,
 	.getprocattr =			apparmor_getprocattr,
 	.setprocattr =			apparmor_setprocattr,
 
@@ -22,6 +22,8 @@
 #include <linux/init.h>
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
+#include <linux/log2.h>
+#include <linux/hardirq.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -33,9 +35,12 @@
 #include "avc_ss.h"
 #include "classmap.h"
 
-#define AVC_CACHE_SLOTS			512
+#define AVC_CACHE_SLOTS_MIN		512
+#define AVC_CACHE_SLOTS_MAX		8192
+#define AVC_CACHE_SLOTS_PER_CPU		128
 #define AVC_DEF_CACHE_THRESHOLD		512
 #define AVC_CACHE_RECLAIM		16
+#define AVC_PCPU_SLOTS			16
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 #define avc_cache_stats_incr(field)	this_cpu_inc(avc_cache_stats.field)
@@ -57,13 +62,27 @@ struct avc_node {
 };
 
 struct avc_cache {
-	struct hlist_head	slots[AVC_CACHE_SLOTS]; /* head for avc_node->list */
-	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
+	struct hlist_head	*slots; /* head for avc_node->list */
+	spinlock_t		*slots_lock; /* lock for writes */
 	atomic_t		lru_hint;	/* LRU hint for reclaim scan */
 	atomic_t		active_nodes;
 	u32			latest_notif;	/* latest revocation notification */
+	atomic_t		generation;	/* see avc_generation() */
 };
 
+/*
+ * A few recent decisions per cpu in front of the hash table, so that
+ * repeated checks touch no cache lines shared with other cpus but
+ * avc_cache.generation.  Only used in process context, an interrupt
+ * could otherwise find an entry half written.
+ */
+struct avc_pcpu_entry {
+	struct avc_entry	ae;
+	u32			generation;
+};
+
+static DEFINE_PER_CPU(struct avc_pcpu_entry [AVC_PCPU_SLOTS], avc_pcpu_cache);
+
 struct avc_callback_node {
 	int (*callback) (u32 event, u32 ssid, u32 tsid,
 			 u16 tclass, u32 perms,
@@ -87,9 +106,17 @@ static struct avc_cache avc_cache;
 static struct avc_callback_node *avc_callbacks;
 static struct kmem_cache *avc_node_cachep;
 
+/* Number of hash slots, a power of two sized by the number of cpus */
+static unsigned int avc_cache_slots __read_mostly;
+
 static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
 {
-	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
+	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (avc_cache_slots - 1);
+}
+
+static inline int avc_pcpu_hash(u32 ssid, u32 tsid, u16 tclass)
+{
+	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_PCPU_SLOTS - 1);
 }
 
 /**
@@ -168,12 +195,29 @@ void __init avc_init(void)
 {
 	int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
+	avc_cache_slots = roundup_pow_of_two(num_possible_cpus()) *
+			  AVC_CACHE_SLOTS_PER_CPU;
+	avc_cache_slots = clamp_t(unsigned int, avc_cache_slots,
+				  AVC_CACHE_SLOTS_MIN, AVC_CACHE_SLOTS_MAX);
+	avc_cache.slots = kcalloc(avc_cache_slots, sizeof(*avc_cache.slots),
+				  GFP_KERNEL);
+	avc_cache.slots_lock = kcalloc(avc_cache_slots,
+				       sizeof(*avc_cache.slots_lock),
+				       GFP_KERNEL);
+	if (!avc_cache.slots || !avc_cache.slots_lock)
+		panic("SELinux: avc: cannot allocate the cache\n");
+
+	for (i = 0; i < avc_cache_slots; i++) {
 		INIT_HLIST_HEAD(&avc_cache.slots[i]);
 		spin_lock_init(&avc_cache.slots_lock[i]);
 	}
 	atomic_set(&avc_cache.active_nodes, 0);
 	atomic_set(&avc_cache.lru_hint, 0);
+	/* 0 is what the unused per-cpu entries have */
+	atomic_set(&avc_cache.generation, 1);
+
+	/* Aim at about one entry per slot */
+	avc_cache_threshold = avc_cache_slots;
 
 	avc_node_cachep = kmem_cache_create("avc_node", sizeof(struct avc_node),
 					     0, SLAB_PANIC, NULL);
@@ -191,7 +235,7 @@ int avc_get_hash_stats(char *page)
 
 	slots_used = 0;
 	max_chain_len = 0;
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
+	for (i = 0; i < avc_cache_slots; i++) {
 		head = &avc_cache.slots[i];
 		if (!hlist_empty(head)) {
 			struct hlist_node *next;
@@ -210,7 +254,7 @@ int avc_get_hash_stats(char *page)
 	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
 			 "longest chain: %d\n",
 			 atomic_read(&avc_cache.active_nodes),
-			 slots_used, AVC_CACHE_SLOTS, max_chain_len);
+			 slots_used, avc_cache_slots, max_chain_len);
 }
 
 static void avc_node_free(struct rcu_head *rhead)
@@ -250,8 +294,9 @@ static inline int avc_reclaim_node(void)
 	struct hlist_node *next;
 	spinlock_t *lock;
 
-	for (try = 0, ecx = 0; try < AVC_CACHE_SLOTS; try++) {
-		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (AVC_CACHE_SLOTS - 1);
+	for (try = 0, ecx = 0; try < avc_cache_slots; try++) {
+		hvalue = atomic_inc_return(&avc_cache.lru_hint) &
+			 (avc_cache_slots - 1);
 		head = &avc_cache.slots[hvalue];
 		lock = &avc_cache.slots_lock[hvalue];
 
@@ -349,6 +394,69 @@ static struct avc_node *avc_lookup(u32 ssid, u32 tsid, u16 tclass)
 	return NULL;
 }
 
+/**
+ * avc_generation - Return the current generation of cached decisions.
+ *
+ * The generation changes whenever a decision in the AVC is flushed or
+ * modified.  A copy of a decision taken after reading the generation
+ * stays valid as long as the generation does not change.
+ */
+u32 avc_generation(void)
+{
+	u32 gen = atomic_read(&avc_cache.generation);
+
+	smp_rmb();
+	return gen;
+}
+
+/* Called after decisions were removed or changed in the hash table */
+static void avc_generation_bump(void)
+{
+	smp_mb__before_atomic_inc();
+	atomic_inc(&avc_cache.generation);
+}
+
+static bool avc_pcpu_lookup(u32 ssid, u32 tsid, u16 tclass, u32 gen,
+			    struct av_decision *avd)
+{
+	struct avc_pcpu_entry *e;
+	bool hit = false;
+
+	if (in_interrupt())
+		return false;
+
+	preempt_disable();
+	e = &__get_cpu_var(avc_pcpu_cache)[avc_pcpu_hash(ssid, tsid, tclass)];
+	if (e->generation == gen && e->ae.ssid == ssid &&
+	    e->ae.tsid == tsid && e->ae.tclass == tclass) {
+		memcpy(avd, &e->ae.avd, sizeof(*avd));
+		hit = true;
+	}
+	preempt_enable();
+
+	if (hit)
+		avc_cache_stats_incr(lookups);
+	return hit;
+}
+
+static void avc_pcpu_insert(u32 ssid, u32 tsid, u16 tclass, u32 gen,
+			    struct av_decision *avd)
+{
+	struct avc_pcpu_entry *e;
+
+	if (in_interrupt())
+		return;
+
+	preempt_disable();
+	e = &__get_cpu_var(avc_pcpu_cache)[avc_pcpu_hash(ssid, tsid, tclass)];
+	e->ae.ssid = ssid;
+	e->ae.tsid = tsid;
+	e->ae.tclass = tclass;
+	memcpy(&e->ae.avd, avd, sizeof(e->ae.avd));
+	e->generation = gen;
+	preempt_enable();
+}
+
 static int avc_latest_notif_update(int seqno, int is_insert)
 {
 	int ret = 0;
@@ -668,6 +776,7 @@ static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 		break;
 	}
 	avc_node_replace(node, orig);
+	avc_generation_bump();
 out_unlock:
 	spin_unlock_irqrestore(lock, flag);
 out:
@@ -686,7 +795,7 @@ static void avc_flush(void)
 	unsigned long flag;
 	int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
+	for (i = 0; i < avc_cache_slots; i++) {
 		head = &avc_cache.slots[i];
 		lock = &avc_cache.slots_lock[i];
 
@@ -701,6 +810,7 @@ static void avc_flush(void)
 		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flag);
 	}
+	avc_generation_bump();
 }
 
 /**
@@ -757,11 +867,16 @@ int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 	struct avc_node *node;
 	int rc = 0;
 	u32 denied;
+	u32 gen;
 
 	BUG_ON(!requested);
 
+	gen = avc_generation();
 	rcu_read_lock();
 
+	if (avc_pcpu_lookup(ssid, tsid, tclass, gen, avd))
+		goto decided;
+
 	node = avc_lookup(ssid, tsid, tclass);
 	if (unlikely(!node)) {
 		rcu_read_unlock();
@@ -772,7 +887,11 @@ int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 		memcpy(avd, &node->ae.avd, sizeof(*avd));
 		avd = &node->ae.avd;
 	}
+	/* Only decisions the AVC holds, see avc_latest_notif_update() */
+	if (node)
+		avc_pcpu_insert(ssid, tsid, tclass, gen, avd);
 
+decided:
 	denied = requested & ~(avd->allowed);
 
 	if (denied) {
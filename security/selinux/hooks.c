@@ -207,6 +207,7 @@ static int inode_alloc_security(struct inode *inode)
 		return -ENOMEM;
 
 	mutex_init(&isec->lock);
+	seqlock_init(&isec->avc_lock);
 	INIT_LIST_HEAD(&isec->list);
 	isec->inode = inode;
 	isec->sid = SECINITSID_UNLABELED;
@@ -1500,6 +1501,44 @@ static int task_has_system(struct task_struct *tsk,
 /* Check whether a task has a particular permission to an inode.
    The 'adp' parameter is optional and allows other audit
    data to be passed (e.g. the dentry). */
+/*
+ * Repeated checks of the same task against the same inode are common
+ * (e.g. path walks and opens of hot files), so each inode remembers the
+ * permissions last granted to one sid without anything to audit.
+ */
+static bool inode_avc_cached(struct inode_security_struct *isec, u32 ssid,
+			     u32 tsid, u16 tclass, u32 gen, u32 perms)
+{
+	unsigned seq;
+	bool hit;
+
+	do {
+		seq = read_seqbegin(&isec->avc_lock);
+		hit = isec->avc_gen == gen &&
+		      isec->avc_ssid == ssid &&
+		      isec->avc_tsid == tsid &&
+		      isec->avc_tclass == tclass &&
+		      !(perms & ~isec->avc_allowed);
+	} while (read_seqretry(&isec->avc_lock, seq));
+
+	return hit;
+}
+
+static void inode_avc_store(struct inode_security_struct *isec, u32 ssid,
+			    u32 tsid, u16 tclass, u32 gen,
+			    struct av_decision *avd)
+{
+	/* Someone else is filling it in, theirs is as good */
+	if (!write_tryseqlock(&isec->avc_lock))
+		return;
+	isec->avc_gen = gen;
+	isec->avc_ssid = ssid;
+	isec->avc_tsid = tsid;
+	isec->avc_tclass = tclass;
+	isec->avc_allowed = avd->allowed & ~avd->auditallow;
+	write_sequnlock(&isec->avc_lock);
+}
+
 static int inode_has_perm(const struct cred *cred,
 			  struct inode *inode,
 			  u32 perms,
@@ -1507,7 +1546,10 @@ static int inode_has_perm(const struct cred *cred,
 			  unsigned flags)
 {
 	struct inode_security_struct *isec;
-	u32 sid;
+	struct av_decision avd;
+	u32 sid, tsid, gen;
+	u16 tclass;
+	int rc, rc2;
 
 	validate_creds(cred);
 
@@ -1516,8 +1558,21 @@ static int inode_has_perm(const struct cred *cred,
 
 	sid = cred_sid(cred);
 	isec = inode->i_security;
+	tsid = isec->sid;
+	tclass = isec->sclass;
 
-	return avc_has_perm_flags(sid, isec->sid, isec->sclass, perms, adp, flags);
+	gen = avc_generation();
+	if (inode_avc_cached(isec, sid, tsid, tclass, gen, perms))
+		return 0;
+
+	rc = avc_has_perm_noaudit(sid, tsid, tclass, perms, 0, &avd);
+	if (!rc)
+		inode_avc_store(isec, sid, tsid, tclass, gen, &avd);
+
+	rc2 = avc_audit(sid, tsid, tclass, perms, &avd, rc, adp, flags);
+	if (rc2)
+		return rc2;
+	return rc;
 }
 
 static int inode_has_perm_noadp(const struct cred *cred,
@@ -78,6 +78,7 @@ static inline int avc_has_perm(u32 ssid, u32 tsid,
 }
 
 u32 avc_policy_seqno(void);
+u32 avc_generation(void);
 
 #define AVC_CALLBACK_GRANT		1
 #define AVC_CALLBACK_TRY_REVOKE		2
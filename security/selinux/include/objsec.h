@@ -47,6 +47,13 @@ struct inode_security_struct {
 	u16 sclass;		/* security class of this object */
 	unsigned char initialized;	/* initialization flag */
 	struct mutex lock;
+	/* last granted decision for this inode, see inode_has_perm() */
+	seqlock_t avc_lock;
+	u32 avc_ssid;
+	u32 avc_tsid;
+	u16 avc_tclass;
+	u32 avc_gen;		/* avc_generation() it was taken at */
+	u32 avc_allowed;	/* allowed and not audited */
 };
 
 struct file_security_struct {
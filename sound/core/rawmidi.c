@@ -29,6 +29,8 @@
 #include <linux/mutex.h>
 #include <linux/module.h>
 #include <linux/delay.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
 #include <sound/rawmidi.h>
 #include <sound/info.h>
 #include <sound/control.h>
@@ -121,6 +123,14 @@ static int snd_rawmidi_runtime_create(struct snd_rawmidi_substream *substream)
 		kfree(runtime);
 		return -ENOMEM;
 	}
+	if (substream->stream == SNDRV_RAWMIDI_STREAM_INPUT) {
+		runtime->mmap_status = (void *)get_zeroed_page(GFP_KERNEL);
+		if (!runtime->mmap_status) {
+			kfree(runtime->buffer);
+			kfree(runtime);
+			return -ENOMEM;
+		}
+	}
 	runtime->appl_ptr = runtime->hw_ptr = 0;
 	substream->runtime = runtime;
 	return 0;
@@ -130,6 +140,7 @@ static int snd_rawmidi_runtime_free(struct snd_rawmidi_substream *substream)
 {
 	struct snd_rawmidi_runtime *runtime = substream->runtime;
 
+	free_page((unsigned long)runtime->mmap_status);
 	kfree(runtime->buffer);
 	kfree(runtime);
 	substream->runtime = NULL;
@@ -205,6 +216,11 @@ int snd_rawmidi_drain_input(struct snd_rawmidi_substream *substream)
 	spin_lock_irqsave(&runtime->lock, flags);
 	runtime->appl_ptr = runtime->hw_ptr = 0;
 	runtime->avail = 0;
+	if (runtime->mmap_status) {
+		runtime->mmap_status->hw_pos = 0;
+		runtime->mmap_status->appl_pos = 0;
+		runtime->mmap_appl_pos = 0;
+	}
 	spin_unlock_irqrestore(&runtime->lock, flags);
 	return 0;
 }
@@ -653,6 +669,10 @@ int snd_rawmidi_input_params(struct snd_rawmidi_substream *substream,
 	char *newbuf;
 	struct snd_rawmidi_runtime *runtime = substream->runtime;
 
+	/* the mapped ring can not move */
+	if (atomic_read(&runtime->mmap_count) &&
+	    params->buffer_size != runtime->buffer_size)
+		return -EBUSY;
 	snd_rawmidi_drain_input(substream);
 	if (params->buffer_size < 32 || params->buffer_size > 1024L * 1024L) {
 		return -EINVAL;
@@ -855,6 +875,43 @@ static int snd_rawmidi_control_ioctl(struct snd_card *card,
 	return -ENOIOCTLCMD;
 }
 
+/*
+ * Take the bytes the application consumed from the mmap'ed ring into
+ * account. Called with runtime->lock held.
+ */
+static void snd_rawmidi_mmap_sync(struct snd_rawmidi_runtime *runtime)
+{
+	u32 count;
+
+	if (!atomic_read(&runtime->mmap_count))
+		return;
+	count = ACCESS_ONCE(runtime->mmap_status->appl_pos) -
+		runtime->mmap_appl_pos;
+	/* a confused application can not consume more than there is */
+	if (count > runtime->avail)
+		count = runtime->avail;
+	runtime->appl_ptr = (runtime->appl_ptr + count) % runtime->buffer_size;
+	runtime->avail -= count;
+	runtime->mmap_appl_pos += count;
+}
+
+/*
+ * Publish @count received bytes in the status page. The data has to be
+ * visible before hw_pos moves. Called with runtime->lock held.
+ */
+static void snd_rawmidi_mmap_update(struct snd_rawmidi_runtime *runtime,
+				    int count)
+{
+	struct snd_rawmidi_mmap_status *status = runtime->mmap_status;
+	struct timespec ts;
+
+	ktime_get_ts(&ts);
+	status->tstamp = timespec_to_ns(&ts);
+	status->xruns = runtime->xruns;
+	smp_wmb();
+	status->hw_pos += count;
+}
+
 /**
  * snd_rawmidi_receive - receive the input data from the device
  * @substream: the rawmidi substream
@@ -879,6 +936,7 @@ int snd_rawmidi_receive(struct snd_rawmidi_substream *substream,
 		return -EINVAL;
 	}
 	spin_lock_irqsave(&runtime->lock, flags);
+	snd_rawmidi_mmap_sync(runtime);
 	if (count == 1) {	/* special case, faster code */
 		substream->bytes++;
 		if (runtime->avail < runtime->buffer_size) {
@@ -917,6 +975,8 @@ int snd_rawmidi_receive(struct snd_rawmidi_substream *substream,
 			}
 		}
 	}
+	if (runtime->mmap_status)
+		snd_rawmidi_mmap_update(runtime, result);
 	if (result > 0) {
 		if (runtime->event)
 			schedule_work(&runtime->event_work);
@@ -955,6 +1015,11 @@ static long snd_rawmidi_kernel_read1(struct snd_rawmidi_substream *substream,
 		runtime->appl_ptr += count1;
 		runtime->appl_ptr %= runtime->buffer_size;
 		runtime->avail -= count1;
+		/* keep a mapped ring in step with read() */
+		if (atomic_read(&runtime->mmap_count)) {
+			runtime->mmap_appl_pos += count1;
+			runtime->mmap_status->appl_pos += count1;
+		}
 		spin_unlock_irqrestore(&runtime->lock, flags);
 		result += count1;
 		count -= count1;
@@ -987,6 +1052,7 @@ static ssize_t snd_rawmidi_read(struct file *file, char __user *buf, size_t coun
 	result = 0;
 	while (count > 0) {
 		spin_lock_irq(&runtime->lock);
+		snd_rawmidi_mmap_sync(runtime);
 		while (!snd_rawmidi_ready(substream)) {
 			wait_queue_t wait;
 			if ((file->f_flags & O_NONBLOCK) != 0 || result > 0) {
@@ -1295,6 +1361,9 @@ static unsigned int snd_rawmidi_poll(struct file *file, poll_table * wait)
 		runtime = rfile->input->runtime;
 		snd_rawmidi_input_trigger(rfile->input, 1);
 		poll_wait(file, &runtime->sleep, wait);
+		spin_lock_irq(&runtime->lock);
+		snd_rawmidi_mmap_sync(runtime);
+		spin_unlock_irq(&runtime->lock);
 	}
 	if (rfile->output != NULL) {
 		runtime = rfile->output->runtime;
@@ -1312,6 +1381,74 @@ static unsigned int snd_rawmidi_poll(struct file *file, poll_table * wait)
 	return mask;
 }
 
+static void snd_rawmidi_mmap_open(struct vm_area_struct *area)
+{
+	struct snd_rawmidi_runtime *runtime = area->vm_private_data;
+
+	atomic_inc(&runtime->mmap_count);
+}
+
+static void snd_rawmidi_mmap_close(struct vm_area_struct *area)
+{
+	struct snd_rawmidi_runtime *runtime = area->vm_private_data;
+
+	atomic_dec(&runtime->mmap_count);
+}
+
+static const struct vm_operations_struct snd_rawmidi_vm_ops = {
+	.open =		snd_rawmidi_mmap_open,
+	.close =	snd_rawmidi_mmap_close,
+};
+
+/*
+ * Map the input ring and its status page. Only the status page is
+ * writable, for appl_pos.
+ */
+static int snd_rawmidi_mmap(struct file *file, struct vm_area_struct *area)
+{
+	struct snd_rawmidi_file *rfile = file->private_data;
+	struct snd_rawmidi_runtime *runtime;
+	unsigned long offset = area->vm_pgoff << PAGE_SHIFT;
+	unsigned long size = area->vm_end - area->vm_start;
+	void *addr;
+	int err;
+
+	if (rfile->input == NULL)
+		return -ENXIO;
+	runtime = rfile->input->runtime;
+
+	switch (offset) {
+	case SNDRV_RAWMIDI_MMAP_OFFSET_DATA:
+		if (area->vm_flags & VM_WRITE)
+			return -EINVAL;
+		if (size != runtime->buffer_size ||
+		    !is_power_of_2(runtime->buffer_size) ||
+		    runtime->buffer_size < PAGE_SIZE ||
+		    offset_in_page(runtime->buffer))
+			return -EINVAL;
+		addr = runtime->buffer;
+		break;
+	case SNDRV_RAWMIDI_MMAP_OFFSET_STATUS:
+		if (size != PAGE_SIZE)
+			return -EINVAL;
+		addr = runtime->mmap_status;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	area->vm_flags |= VM_RESERVED | VM_DONTEXPAND;
+	err = remap_pfn_range(area, area->vm_start,
+			      virt_to_phys(addr) >> PAGE_SHIFT,
+			      size, area->vm_page_prot);
+	if (err < 0)
+		return err;
+	area->vm_ops = &snd_rawmidi_vm_ops;
+	area->vm_private_data = runtime;
+	snd_rawmidi_mmap_open(area);
+	return 0;
+}
+
 /*
  */
 #ifdef CONFIG_COMPAT
@@ -1398,6 +1535,7 @@ static const struct file_operations snd_rawmidi_f_ops =
 	.release =	snd_rawmidi_release,
 	.llseek =	no_llseek,
 	.poll =		snd_rawmidi_poll,
+	.mmap =		snd_rawmidi_mmap,
 	.unlocked_ioctl =	snd_rawmidi_ioctl,
 	.compat_ioctl =	snd_rawmidi_ioctl_compat,
 };
@@ -271,9 +271,19 @@ int snd_usb_init_substream_urbs(struct snd_usb_substream *subs,
 			minsize -= minsize >> 3;
 		minsize = max(minsize, 1u);
 		total_packs = (period_bytes + minsize - 1) / minsize;
+		/*
+		 * In low latency mode no urb may span more than a period,
+		 * down to a single (micro)frame per urb for tiny periods,
+		 * so that every completion can report a period.
+		 */
+		if (chip->lowlatency)
+			urb_packs = clamp(period_bytes / maxsize, 1u, urb_packs);
 		/* we need at least two URBs for queueing */
 		if (total_packs < 2) {
 			total_packs = 2;
+		} else if (chip->lowlatency) {
+			/* queue no more than one period, but two urbs */
+			total_packs = max(total_packs, urb_packs * 2);
 		} else {
 			/* and we don't want too long a queue either */
 			maxpacks = max(MAX_QUEUE * packs_per_ms, urb_packs * 2);
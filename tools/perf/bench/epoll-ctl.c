@@ -0,0 +1,188 @@
+/*
+ *
+ * epoll-ctl.c
+ *
+ * ctl: A number of threads add, modify and remove their own file
+ * descriptors on one shared epoll instance, hammering its locks.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+static unsigned int nthreads;
+static unsigned int nfds = 64;
+static unsigned int runtime = 5;
+
+static volatile int done;
+static int epollfd;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+struct worker {
+	pthread_t thread;
+	int *fds;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: online cpus)"),
+	OPT_UINTEGER('f', "fds", &nfds,
+		     "Specify number of eventfds per thread"),
+	OPT_UINTEGER('r', "runtime", &runtime,
+		     "Specify runtime in seconds"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_ctl_usage[] = {
+	"perf bench epoll ctl <options>",
+	NULL
+};
+
+static void do_ctl(int op, int fd, unsigned int events)
+{
+	struct epoll_event ev;
+
+	ev.events = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(epollfd, op, fd, &ev))
+		die("epoll_ctl: %s", strerror(errno));
+}
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long ops = 0;
+	unsigned int i;
+
+	pthread_mutex_lock(&thread_lock);
+	if (!--threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		for (i = 0; i < nfds; i++, ops += 3) {
+			do_ctl(EPOLL_CTL_ADD, w->fds[i], EPOLLIN);
+			do_ctl(EPOLL_CTL_MOD, w->fds[i], EPOLLIN | EPOLLOUT);
+			do_ctl(EPOLL_CTL_DEL, w->fds[i], 0);
+		}
+	} while (!done);
+
+	w->ops = ops;
+	return NULL;
+}
+
+int bench_epoll_ctl(int argc, const char **argv,
+		    const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long total = 0, min = ~0ULL, max = 0;
+	struct worker *workers;
+	unsigned int i, j;
+	double secs;
+
+	argc = parse_options(argc, argv, options, bench_epoll_ctl_usage, 0);
+	if (argc || !nfds || !runtime)
+		usage_with_options(bench_epoll_ctl_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	epollfd = epoll_create(nthreads * nfds);
+	if (epollfd < 0)
+		die("epoll_create: %s", strerror(errno));
+
+	workers = zalloc(nthreads * sizeof(*workers));
+	if (!workers)
+		die("zalloc");
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++) {
+		workers[i].fds = zalloc(nfds * sizeof(int));
+		if (!workers[i].fds)
+			die("zalloc");
+		for (j = 0; j < nfds; j++) {
+			workers[i].fds[j] = eventfd(0, EFD_NONBLOCK);
+			if (workers[i].fds[j] < 0)
+				die("eventfd: %s", strerror(errno));
+		}
+		if (pthread_create(&workers[i].thread, NULL, worker,
+				   &workers[i]))
+			die("pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	gettimeofday(&start, NULL);
+	sleep(runtime);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++)
+		if (pthread_join(workers[i].thread, NULL))
+			die("pthread_join");
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+
+	for (i = 0; i < nthreads; i++) {
+		total += workers[i].ops;
+		if (workers[i].ops < min)
+			min = workers[i].ops;
+		if (workers[i].ops > max)
+			max = workers[i].ops;
+		for (j = 0; j < nfds; j++)
+			close(workers[i].fds[j]);
+		free(workers[i].fds);
+	}
+	free(workers);
+	close(epollfd);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads operating on %u eventfds each for %u secs\n\n",
+		       nthreads, nfds, runtime);
+		printf(" %14.0lf ops/sec in total\n", total / secs);
+		printf(" %14.0lf ops/sec per thread (average)\n",
+		       total / secs / nthreads);
+		printf(" %14.0lf ops/sec per thread (min)\n", min / secs);
+		printf(" %14.0lf ops/sec per thread (max)\n", max / secs);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0lf\n", total / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
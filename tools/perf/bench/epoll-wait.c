@@ -0,0 +1,212 @@
+/*
+ *
+ * epoll-wait.c
+ *
+ * wait: A number of threads wait on one shared epoll instance while a
+ * writer thread keeps its edge-triggered eventfds firing, measuring how
+ * many events per second get delivered.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+static unsigned int nthreads;
+static unsigned int nfds = 64;
+static unsigned int runtime = 5;
+
+static volatile int done;
+static int epollfd;
+static int *fds;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+struct worker {
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of waiter threads (default: online cpus)"),
+	OPT_UINTEGER('f', "fds", &nfds,
+		     "Specify number of eventfds to watch"),
+	OPT_UINTEGER('r', "runtime", &runtime,
+		     "Specify runtime in seconds"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wait_usage[] = {
+	"perf bench epoll wait <options>",
+	NULL
+};
+
+static void thread_ready(void)
+{
+	pthread_mutex_lock(&thread_lock);
+	if (!--threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+}
+
+static void *waiter(void *arg)
+{
+	struct worker *w = arg;
+	struct epoll_event ev;
+	unsigned long ops = 0;
+	u_int64_t val;
+	int ret;
+
+	thread_ready();
+
+	while (!done) {
+		/* Time out now and then to notice the end of the run. */
+		ret = epoll_wait(epollfd, &ev, 1, 100);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			die("epoll_wait: %s", strerror(errno));
+		}
+		if (!ret)
+			continue;
+
+		/* Drain the counter so the next write is a new edge. */
+		if (read(ev.data.fd, &val, sizeof(val)) == sizeof(val))
+			ops++;
+	}
+
+	w->ops = ops;
+	return NULL;
+}
+
+static void *writer(void *arg __used)
+{
+	u_int64_t val = 1;
+	unsigned int i = 0;
+
+	thread_ready();
+
+	while (!done) {
+		if (write(fds[i], &val, sizeof(val)) != sizeof(val))
+			die("write: %s", strerror(errno));
+		if (++i == nfds)
+			i = 0;
+	}
+	return NULL;
+}
+
+int bench_epoll_wait(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long total = 0;
+	struct epoll_event ev;
+	struct worker *workers;
+	pthread_t wthread;
+	unsigned int i;
+	double secs;
+
+	argc = parse_options(argc, argv, options, bench_epoll_wait_usage, 0);
+	if (argc || !nfds || !runtime)
+		usage_with_options(bench_epoll_wait_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	epollfd = epoll_create(nfds);
+	if (epollfd < 0)
+		die("epoll_create: %s", strerror(errno));
+
+	fds = zalloc(nfds * sizeof(int));
+	workers = zalloc(nthreads * sizeof(*workers));
+	if (!fds || !workers)
+		die("zalloc");
+
+	for (i = 0; i < nfds; i++) {
+		fds[i] = eventfd(0, EFD_NONBLOCK);
+		if (fds[i] < 0)
+			die("eventfd: %s", strerror(errno));
+
+		ev.events = EPOLLIN | EPOLLET;
+		ev.data.fd = fds[i];
+		if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fds[i], &ev))
+			die("epoll_ctl: %s", strerror(errno));
+	}
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads + 1;
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&workers[i].thread, NULL, waiter,
+				   &workers[i]))
+			die("pthread_create");
+	if (pthread_create(&wthread, NULL, writer, NULL))
+		die("pthread_create");
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	gettimeofday(&start, NULL);
+	sleep(runtime);
+	done = 1;
+
+	if (pthread_join(wthread, NULL))
+		die("pthread_join");
+	for (i = 0; i < nthreads; i++) {
+		if (pthread_join(workers[i].thread, NULL))
+			die("pthread_join");
+		total += workers[i].ops;
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+
+	for (i = 0; i < nfds; i++)
+		close(fds[i]);
+	close(epollfd);
+	free(fds);
+	free(workers);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads waiting on %u eventfds for %u secs\n\n",
+		       nthreads, nfds, runtime);
+		printf(" %14.0lf events/sec in total\n", total / secs);
+		printf(" %14.0lf events/sec per thread (average)\n",
+		       total / secs / nthreads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0lf\n", total / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
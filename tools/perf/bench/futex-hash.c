@@ -0,0 +1,172 @@
+/*
+ *
+ * futex-hash.c
+ *
+ * hash: Stress the futex hash table, each thread operating on its own
+ * set of futexes.  A FUTEX_WAIT with a stale value takes the hash bucket
+ * lock and returns right away, so the threads only meet on the buckets.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static unsigned int nthreads;
+static unsigned int nfutexes = 1024;
+static unsigned int runtime = 5;
+static bool fshared;
+
+static volatile int done;
+static int futex_flag;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+struct worker {
+	pthread_t thread;
+	u_int32_t *futex;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: online cpus)"),
+	OPT_UINTEGER('f', "futexes", &nfutexes,
+		     "Specify number of futexes per thread"),
+	OPT_UINTEGER('r', "runtime", &runtime,
+		     "Specify runtime in seconds"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use shared futexes instead of private ones"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+static void *worker(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long ops = 0;
+	unsigned int i;
+
+	pthread_mutex_lock(&thread_lock);
+	if (!--threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		for (i = 0; i < nfutexes; i++, ops++) {
+			/* The value is never 1234, so this never blocks. */
+			futex_wait(&w->futex[i], 1234, NULL, futex_flag);
+		}
+	} while (!done);
+
+	w->ops = ops;
+	return NULL;
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long total = 0, min = ~0ULL, max = 0;
+	double secs;
+	struct worker *workers;
+	unsigned int i;
+
+	argc = parse_options(argc, argv, options, bench_futex_hash_usage, 0);
+	if (argc || !nfutexes || !runtime)
+		usage_with_options(bench_futex_hash_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	workers = zalloc(nthreads * sizeof(*workers));
+	if (!workers)
+		die("zalloc");
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++) {
+		workers[i].futex = zalloc(nfutexes * sizeof(u_int32_t));
+		if (!workers[i].futex)
+			die("zalloc");
+		if (pthread_create(&workers[i].thread, NULL, worker,
+				   &workers[i]))
+			die("pthread_create");
+	}
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	gettimeofday(&start, NULL);
+	sleep(runtime);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++)
+		if (pthread_join(workers[i].thread, NULL))
+			die("pthread_join");
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+
+	for (i = 0; i < nthreads; i++) {
+		total += workers[i].ops;
+		if (workers[i].ops < min)
+			min = workers[i].ops;
+		if (workers[i].ops > max)
+			max = workers[i].ops;
+		free(workers[i].futex);
+	}
+	free(workers);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads operating on %u %s futexes each for %u secs\n\n",
+		       nthreads, nfutexes, fshared ? "shared" : "private",
+		       runtime);
+		printf(" %14.0lf ops/sec in total\n", total / secs);
+		printf(" %14.0lf ops/sec per thread (average)\n",
+		       total / secs / nthreads);
+		printf(" %14.0lf ops/sec per thread (min)\n", min / secs);
+		printf(" %14.0lf ops/sec per thread (max)\n", max / secs);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0lf\n", total / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ *
+ * futex-wake.c
+ *
+ * wake: Block a number of threads on one futex and time how long the
+ * waker takes to wake them all, a few at a time.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static unsigned int nthreads;
+static unsigned int nwakes = 1;
+static unsigned int iterations = 10;
+static bool fshared;
+
+/* all threads wait on this one */
+static u_int32_t futex1;
+static int futex_flag;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: online cpus)"),
+	OPT_UINTEGER('w', "nwakes", &nwakes,
+		     "Specify number of threads to wake at once"),
+	OPT_UINTEGER('i', "iterations", &iterations,
+		     "Specify number of rounds"),
+	OPT_BOOLEAN('S', "shared", &fshared,
+		    "Use a shared futex instead of a private one"),
+	OPT_END()
+};
+
+static const char * const bench_futex_wake_usage[] = {
+	"perf bench futex wake <options>",
+	NULL
+};
+
+static void *waiter(void *arg __used)
+{
+	pthread_mutex_lock(&thread_lock);
+	if (!--threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	/* The waker counts us, so a signal must not let us go early. */
+	while (futex_wait(&futex1, 0, NULL, futex_flag) && errno == EINTR)
+		;
+	return NULL;
+}
+
+/*
+ * Start the waiters and give them time to block: there is no way to
+ * tell from userspace that a thread sleeps in the kernel.
+ */
+static void block_threads(pthread_t *w)
+{
+	unsigned int i;
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&w[i], NULL, waiter, NULL))
+			die("pthread_create");
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	usleep(100000);
+}
+
+int bench_futex_wake(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long usecs, total_usecs = 0;
+	unsigned int i, j, woken;
+	pthread_t *w;
+	int ret;
+
+	argc = parse_options(argc, argv, options, bench_futex_wake_usage, 0);
+	if (argc || !nwakes || !iterations)
+		usage_with_options(bench_futex_wake_usage, options);
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (!fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	w = zalloc(nthreads * sizeof(pthread_t));
+	if (!w)
+		die("zalloc");
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %u threads on a %s futex, waking %u at a time\n\n",
+		       nthreads, fshared ? "shared" : "private", nwakes);
+
+	for (j = 0; j < iterations; j++) {
+		block_threads(w);
+
+		woken = 0;
+		gettimeofday(&start, NULL);
+		while (woken != nthreads) {
+			ret = futex_wake(&futex1, nwakes, futex_flag);
+			if (ret < 0)
+				die("futex_wake: %s", strerror(errno));
+			woken += ret;
+		}
+		gettimeofday(&stop, NULL);
+		timersub(&stop, &start, &diff);
+		usecs = diff.tv_sec * 1000000ULL + diff.tv_usec;
+		total_usecs += usecs;
+
+		if (bench_format == BENCH_FORMAT_DEFAULT)
+			printf(" [Run %u]: woke %u threads in %.4f ms\n",
+			       j + 1, woken, usecs / 1000.0);
+
+		for (i = 0; i < nthreads; i++)
+			if (pthread_join(w[i], NULL))
+				die("pthread_join");
+	}
+	free(w);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("\n %14.4f ms to wake %u threads (average)\n",
+		       total_usecs / 1000.0 / iterations, nthreads);
+		printf(" %14.4f usecs/wakeup\n",
+		       (double)total_usecs / iterations / nthreads);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.4f\n", total_usecs / 1000.0 / iterations);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,252 @@
+/*
+ *
+ * mem-page-fault.c
+ *
+ * page-fault: A number of threads sharing one mm fault in pages of their
+ * own anonymous mappings, measuring page fault scalability.
+ *
+ * mmap: A number of threads sharing one mm map, touch and unmap small
+ * regions, measuring mmap()/munmap() scalability.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+
+static unsigned int nthreads;
+static unsigned int runtime = 5;
+static const char *length_str;
+
+static volatile int done;
+static size_t length;
+static size_t page_size;
+
+static pthread_mutex_t thread_lock;
+static pthread_cond_t thread_parent, thread_worker;
+static unsigned int threads_starting;
+
+struct worker {
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static const struct option page_fault_options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: online cpus)"),
+	OPT_STRING('l', "length", &length_str, "16MB",
+		   "Specify length of each thread's mapping"),
+	OPT_UINTEGER('r', "runtime", &runtime,
+		     "Specify runtime in seconds"),
+	OPT_END()
+};
+
+static const char * const bench_mem_page_fault_usage[] = {
+	"perf bench mem page-fault <options>",
+	NULL
+};
+
+static const struct option mmap_options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: online cpus)"),
+	OPT_STRING('l', "length", &length_str, "4KB",
+		   "Specify length of each mapping"),
+	OPT_UINTEGER('r', "runtime", &runtime,
+		     "Specify runtime in seconds"),
+	OPT_END()
+};
+
+static const char * const bench_mem_mmap_usage[] = {
+	"perf bench mem mmap <options>",
+	NULL
+};
+
+static void *map_anon(void)
+{
+	void *p;
+
+	p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		die("mmap: %s", strerror(errno));
+	return p;
+}
+
+static void thread_ready(void)
+{
+	pthread_mutex_lock(&thread_lock);
+	if (!--threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+}
+
+/*
+ * Fault in the whole mapping, then throw it away and start over.  Only
+ * the faults count; the unmap is there to get fresh pages to fault on.
+ */
+static void *page_fault_worker(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long ops = 0;
+	size_t off;
+	char *p;
+
+	thread_ready();
+
+	while (!done) {
+		p = map_anon();
+		for (off = 0; off < length && !done; off += page_size, ops++)
+			p[off] = 1;
+		munmap(p, length);
+	}
+
+	w->ops = ops;
+	return NULL;
+}
+
+static void *mmap_worker(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long ops = 0;
+	char *p;
+
+	thread_ready();
+
+	while (!done) {
+		p = map_anon();
+		p[0] = 1;
+		munmap(p, length);
+		ops++;
+	}
+
+	w->ops = ops;
+	return NULL;
+}
+
+static double run_workers(void *(*fn)(void *), struct worker *workers)
+{
+	struct timeval start, stop, diff;
+	unsigned int i;
+
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	for (i = 0; i < nthreads; i++)
+		if (pthread_create(&workers[i].thread, NULL, fn, &workers[i]))
+			die("pthread_create");
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	gettimeofday(&start, NULL);
+	sleep(runtime);
+	done = 1;
+
+	for (i = 0; i < nthreads; i++)
+		if (pthread_join(workers[i].thread, NULL))
+			die("pthread_join");
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	return diff.tv_sec + diff.tv_usec / 1000000.0;
+}
+
+static int bench_mem_threads(int argc, const char **argv,
+			     const struct option *options,
+			     const char * const *usage,
+			     const char *default_length,
+			     void *(*fn)(void *), const char *what)
+{
+	unsigned long long total = 0, min = ~0ULL, max = 0;
+	struct worker *workers;
+	unsigned int i;
+	double secs;
+
+	argc = parse_options(argc, argv, options, usage, 0);
+	if (argc || !runtime)
+		usage_with_options(usage, options);
+
+	if (!length_str)
+		length_str = default_length;
+	page_size = sysconf(_SC_PAGESIZE);
+	length = (size_t)perf_atoll((char *)length_str);
+	if ((s64)length <= 0) {
+		fprintf(stderr, "Invalid length:%s\n", length_str);
+		return 1;
+	}
+
+	if (!nthreads)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	workers = zalloc(nthreads * sizeof(*workers));
+	if (!workers)
+		die("zalloc");
+
+	secs = run_workers(fn, workers);
+
+	for (i = 0; i < nthreads; i++) {
+		total += workers[i].ops;
+		if (workers[i].ops < min)
+			min = workers[i].ops;
+		if (workers[i].ops > max)
+			max = workers[i].ops;
+	}
+	free(workers);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u threads on %s Bytes mappings for %u secs\n\n",
+		       nthreads, length_str, runtime);
+		printf(" %14.0lf %s/sec in total\n", total / secs, what);
+		printf(" %14.0lf %s/sec per thread (average)\n",
+		       total / secs / nthreads, what);
+		printf(" %14.0lf %s/sec per thread (min)\n", min / secs, what);
+		printf(" %14.0lf %s/sec per thread (max)\n", max / secs, what);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.0lf\n", total / secs);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
+
+int bench_mem_page_fault(int argc, const char **argv,
+			 const char *prefix __used)
+{
+	return bench_mem_threads(argc, argv, page_fault_options,
+				 bench_mem_page_fault_usage, "16MB",
+				 page_fault_worker, "faults");
+}
+
+int bench_mem_mmap(int argc, const char **argv,
+		   const char *prefix __used)
+{
+	return bench_mem_threads(argc, argv, mmap_options,
+				 bench_mem_mmap_usage, "4KB",
+				 mmap_worker, "ops");
+}
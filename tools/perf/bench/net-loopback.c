@@ -0,0 +1,406 @@
+/*
+ *
+ * net-loopback.c
+ *
+ * pingpong: A client and a server thread bounce one message back and
+ * forth over the loopback device, measuring round trip latency.
+ *
+ * stream: A client thread sends as fast as it can and a server thread
+ * receives, measuring loopback throughput.
+ *
+ * Both work over TCP or UDP.
+ *
+ */
+
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../builtin.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define UDP_MAX_SIZE	65507
+
+static const char *proto_str = "tcp";
+static unsigned int msg_size;
+static unsigned int iterations = 100000;
+static unsigned int runtime = 5;
+
+static bool use_udp;
+static volatile int done;
+static struct sockaddr_in server_addr;
+
+static const struct option pingpong_options[] = {
+	OPT_STRING('p', "proto", &proto_str, "tcp|udp",
+		   "Specify protocol to use (default: tcp)"),
+	OPT_UINTEGER('s', "size", &msg_size,
+		     "Specify message size in bytes (default: 1)"),
+	OPT_UINTEGER('i', "iterations", &iterations,
+		     "Specify number of round trips"),
+	OPT_END()
+};
+
+static const char * const bench_net_pingpong_usage[] = {
+	"perf bench net pingpong <options>",
+	NULL
+};
+
+static const struct option stream_options[] = {
+	OPT_STRING('p', "proto", &proto_str, "tcp|udp",
+		   "Specify protocol to use (default: tcp)"),
+	OPT_UINTEGER('s', "size", &msg_size,
+		     "Specify size of each send in bytes (default: 16384, 1472 for udp)"),
+	OPT_UINTEGER('r', "runtime", &runtime,
+		     "Specify runtime in seconds"),
+	OPT_END()
+};
+
+static const char * const bench_net_stream_usage[] = {
+	"perf bench net stream <options>",
+	NULL
+};
+
+static int parse_proto(void)
+{
+	if (!strcmp(proto_str, "tcp"))
+		use_udp = false;
+	else if (!strcmp(proto_str, "udp"))
+		use_udp = true;
+	else
+		return -1;
+
+	if (use_udp && msg_size > UDP_MAX_SIZE)
+		return -1;
+	return 0;
+}
+
+/* A TCP read may return less than asked for, a datagram never does. */
+static ssize_t read_msg(int fd, char *buf, size_t len)
+{
+	size_t got = 0;
+	ssize_t ret;
+
+	if (use_udp)
+		return recv(fd, buf, len, 0);
+
+	while (got < len) {
+		ret = read(fd, buf + got, len - got);
+		if (ret <= 0)
+			return ret;
+		got += ret;
+	}
+	return got;
+}
+
+static ssize_t write_msg(int fd, const char *buf, size_t len)
+{
+	size_t sent = 0;
+	ssize_t ret;
+
+	if (use_udp)
+		return send(fd, buf, len, 0);
+
+	while (sent < len) {
+		ret = write(fd, buf + sent, len - sent);
+		if (ret <= 0)
+			return ret;
+		sent += ret;
+	}
+	return sent;
+}
+
+/*
+ * Bind the server socket to an ephemeral loopback port and note it in
+ * server_addr for the client.
+ */
+static int server_socket(void)
+{
+	socklen_t len = sizeof(server_addr);
+	int fd, one = 1;
+
+	fd = socket(AF_INET, use_udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket: %s", strerror(errno));
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	memset(&server_addr, 0, sizeof(server_addr));
+	server_addr.sin_family = AF_INET;
+	server_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)))
+		die("bind: %s", strerror(errno));
+	if (getsockname(fd, (struct sockaddr *)&server_addr, &len))
+		die("getsockname: %s", strerror(errno));
+	if (!use_udp && listen(fd, 1))
+		die("listen: %s", strerror(errno));
+
+	return fd;
+}
+
+static int client_socket(void)
+{
+	int fd, one = 1;
+
+	fd = socket(AF_INET, use_udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+	if (fd < 0)
+		die("socket: %s", strerror(errno));
+	if (connect(fd, (struct sockaddr *)&server_addr, sizeof(server_addr)))
+		die("connect: %s", strerror(errno));
+	if (!use_udp)
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	return fd;
+}
+
+/*
+ * Hand the server the socket it serves.  For UDP that is the bound socket
+ * itself, which has to time out now and then to notice the end of the
+ * run; a TCP server sees the client close instead.
+ */
+static int server_accept(int lfd)
+{
+	struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+	int fd, one = 1;
+
+	if (use_udp) {
+		setsockopt(lfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		return lfd;
+	}
+
+	fd = accept(lfd, NULL, NULL);
+	if (fd < 0)
+		die("accept: %s", strerror(errno));
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return fd;
+}
+
+struct server {
+	pthread_t thread;
+	int fd;
+	unsigned long long bytes;
+};
+
+static void *pingpong_server(void *arg)
+{
+	struct server *s = arg;
+	struct sockaddr_in peer;
+	socklen_t len = sizeof(peer);
+	char *buf;
+	int fd;
+
+	buf = malloc(msg_size);
+	if (!buf)
+		die("malloc");
+
+	fd = server_accept(s->fd);
+	while (!done) {
+		ssize_t ret;
+
+		if (use_udp) {
+			ret = recvfrom(fd, buf, msg_size, 0,
+				       (struct sockaddr *)&peer, &len);
+			if (ret > 0)
+				ret = sendto(fd, buf, ret, 0,
+					     (struct sockaddr *)&peer, len);
+		} else {
+			ret = read_msg(fd, buf, msg_size);
+			if (ret > 0)
+				ret = write_msg(fd, buf, ret);
+		}
+		if (!ret)
+			break;
+		if (ret < 0 && errno != EAGAIN && errno != EINTR)
+			die("server: %s", strerror(errno));
+	}
+
+	if (fd != s->fd)
+		close(fd);
+	free(buf);
+	return NULL;
+}
+
+int bench_net_pingpong(int argc, const char **argv,
+		       const char *prefix __used)
+{
+	struct timeval start, stop, diff;
+	unsigned long long usecs;
+	struct server server;
+	unsigned int i;
+	char *buf;
+	int fd;
+
+	argc = parse_options(argc, argv, pingpong_options,
+			     bench_net_pingpong_usage, 0);
+	if (!msg_size)
+		msg_size = 1;
+	if (argc || !iterations || parse_proto())
+		usage_with_options(bench_net_pingpong_usage, pingpong_options);
+
+	buf = zalloc(msg_size);
+	if (!buf)
+		die("zalloc");
+
+	server.fd = server_socket();
+	if (pthread_create(&server.thread, NULL, pingpong_server, &server))
+		die("pthread_create");
+	fd = client_socket();
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < iterations; i++) {
+		if (write_msg(fd, buf, msg_size) != (ssize_t)msg_size)
+			die("client write: %s", strerror(errno));
+		if (read_msg(fd, buf, msg_size) != (ssize_t)msg_size)
+			die("client read: %s", strerror(errno));
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+	usecs = diff.tv_sec * 1000000ULL + diff.tv_usec;
+
+	done = 1;
+	close(fd);
+	if (pthread_join(server.thread, NULL))
+		die("pthread_join");
+	close(server.fd);
+	free(buf);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u round trips of %u bytes over %s loopback\n\n",
+		       iterations, msg_size, use_udp ? "udp" : "tcp");
+		printf(" %14lf usecs/op\n", (double)usecs / iterations);
+		printf(" %14.0lf ops/sec\n", iterations * 1000000.0 / usecs);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", (double)usecs / iterations);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
+
+static void *stream_server(void *arg)
+{
+	struct server *s = arg;
+	unsigned long long bytes = 0;
+	char *buf;
+	int fd;
+
+	buf = malloc(msg_size);
+	if (!buf)
+		die("malloc");
+
+	fd = server_accept(s->fd);
+	while (!done) {
+		ssize_t ret = recv(fd, buf, msg_size, 0);
+
+		if (!ret && !use_udp)
+			break;
+		if (ret < 0) {
+			if (errno != EAGAIN && errno != EINTR)
+				die("server: %s", strerror(errno));
+			continue;
+		}
+		bytes += ret;
+	}
+
+	s->bytes = bytes;
+	if (fd != s->fd)
+		close(fd);
+	free(buf);
+	return NULL;
+}
+
+int bench_net_stream(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	struct timeval start, now, end, diff;
+	unsigned long long sent = 0;
+	struct server server;
+	double secs;
+	char *buf;
+	int fd;
+
+	argc = parse_options(argc, argv, stream_options,
+			     bench_net_stream_usage, 0);
+	if (!msg_size)
+		msg_size = !strcmp(proto_str, "udp") ? 1472 : 16384;
+	if (argc || !runtime || parse_proto())
+		usage_with_options(bench_net_stream_usage, stream_options);
+
+	buf = zalloc(msg_size);
+	if (!buf)
+		die("zalloc");
+
+	server.fd = server_socket();
+	server.bytes = 0;
+	if (pthread_create(&server.thread, NULL, stream_server, &server))
+		die("pthread_create");
+	fd = client_socket();
+
+	gettimeofday(&start, NULL);
+	end = start;
+	end.tv_sec += runtime;
+	do {
+		/* A full UDP socket buffer drops, it doesn't block. */
+		if (write_msg(fd, buf, msg_size) >= 0)
+			sent += msg_size;
+		else if (errno != ENOBUFS && errno != ECONNREFUSED)
+			die("client write: %s", strerror(errno));
+		gettimeofday(&now, NULL);
+	} while (timercmp(&now, &end, <));
+
+	/* Let the server drain what is already queued. */
+	close(fd);
+	if (use_udp) {
+		usleep(100000);
+		done = 1;
+	}
+	if (pthread_join(server.thread, NULL))
+		die("pthread_join");
+	timersub(&now, &start, &diff);
+	secs = diff.tv_sec + diff.tv_usec / 1000000.0;
+
+	close(server.fd);
+	free(buf);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# %u byte sends over %s loopback for %u secs\n\n",
+		       msg_size, use_udp ? "udp" : "tcp", runtime);
+		printf(" %14lf MB/sec received\n",
+		       server.bytes / secs / 1024 / 1024);
+		if (use_udp)
+			printf(" %14lf MB/sec sent\n",
+			       sent / secs / 1024 / 1024);
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", server.bytes / secs / 1024 / 1024);
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	return 0;
+}
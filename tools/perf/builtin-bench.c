@@ -13,6 +13,9 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  futex ... futex hashing, wakeup and requeue
+ *  epoll ... epoll wait and ctl scalability
+ *  net   ... loopback networking
  *
  */
 
@@ -52,6 +55,54 @@ static struct bench_suite mem_suites[] = {
 	{ "memcpy",
 	  "Simple memory copy in various ways",
 	  bench_mem_memcpy },
+	{ "page-fault",
+	  "Many threads faulting in anonymous memory",
+	  bench_mem_page_fault },
+	{ "mmap",
+	  "Many threads mapping and unmapping anonymous memory",
+	  bench_mem_mmap },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite futex_suites[] = {
+	{ "hash",
+	  "Futex hash table contention across threads",
+	  bench_futex_hash },
+	{ "wake",
+	  "Waking threads blocked on one futex",
+	  bench_futex_wake },
+	{ "requeue",
+	  "Requeuing threads from one futex to another",
+	  bench_futex_requeue },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite epoll_suites[] = {
+	{ "wait",
+	  "Threads waiting on one epoll instance",
+	  bench_epoll_wait },
+	{ "ctl",
+	  "Threads adding, modifying and removing fds on one epoll instance",
+	  bench_epoll_ctl },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite net_suites[] = {
+	{ "pingpong",
+	  "Round trip latency over loopback TCP or UDP",
+	  bench_net_pingpong },
+	{ "stream",
+	  "Throughput over loopback TCP or UDP",
+	  bench_net_stream },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -71,6 +122,15 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "futex",
+	  "futex hashing, wakeup and requeue",
+	  futex_suites },
+	{ "epoll",
+	  "epoll wait and ctl scalability",
+	  epoll_suites },
+	{ "net",
+	  "loopback networking",
+	  net_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },
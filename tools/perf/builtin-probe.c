@@ -62,6 +62,7 @@ static struct {
 	struct strlist *dellist;
 	struct line_range line_range;
 	const char *target_module;
+	const char *exec;
 	int max_probe_points;
 	struct strfilter *filter;
 } params;
@@ -258,6 +259,8 @@ static const struct option options[] = {
 		 "Set how many probe points can be found for a probe."),
 	OPT_BOOLEAN('F', "funcs", &params.show_funcs,
 		    "Show potential probe-able functions."),
+	OPT_STRING('x', "exec", &params.exec, "executable|path",
+		   "target executable name or path (user space probes)"),
 	OPT_CALLBACK('\0', "filter", NULL,
 		     "[!]FILTER", "Set a filter (with --vars/funcs only)\n"
 		     "\t\t\t(default: \"" DEFAULT_VAR_FILTER "\" for --vars,\n"
@@ -287,6 +290,19 @@ int cmd_probe(int argc, const char **argv, const char *prefix __used)
 	if (params.max_probe_points == 0)
 		params.max_probe_points = MAX_PROBES;
 
+	if (params.exec) {
+		int i;
+
+		if (params.target_module || params.show_lines ||
+		    params.show_vars || params.show_funcs) {
+			pr_err("  Error: --exec only works with --add and "
+			       "--del.\n");
+			usage_with_options(probe_usage, options);
+		}
+		for (i = 0; i < params.nevents; i++)
+			params.events[i].uprobes = true;
+	}
+
 	if ((!params.nevents && !params.dellist && !params.list_events &&
 	     !params.show_lines && !params.show_funcs))
 		usage_with_options(probe_usage, options);
@@ -396,7 +412,7 @@ int cmd_probe(int argc, const char **argv, const char *prefix __used)
 	if (params.nevents) {
 		ret = add_perf_probe_events(params.events, params.nevents,
 					    params.max_probe_points,
-					    params.target_module,
+					    params.exec ?: params.target_module,
 					    params.force_add);
 		if (ret < 0) {
 			pr_err("  Error: Failed to add events. (%d)\n", ret);
@@ -25,9 +25,13 @@
 #include "util/symbol.h"
 #include "util/cpumap.h"
 #include "util/thread_map.h"
+#include "util/perf_regs.h"
 
 #include <unistd.h>
 #include <sched.h>
+#include <poll.h>
+#include <dirent.h>
+#include <pthread.h>
 #include <sys/mman.h>
 
 enum write_mode_t {
@@ -57,12 +61,15 @@ static pid_t			child_pid			=     -1;
 static bool			no_inherit			=  false;
 static enum write_mode_t	write_mode			= WRITE_FORCE;
 static bool			call_graph			=  false;
+static bool			call_graph_dwarf		=  false;
+static u32			stack_dump_size			=   8192;
 static bool			inherit_stat			=  false;
 static bool			no_samples			=  false;
 static bool			sample_address			=  false;
 static bool			sample_time			=  false;
 static bool			no_buildid			=  false;
 static bool			no_buildid_cache		=  false;
+static int			nr_readers			=      1;
 static struct perf_evlist	*evsel_list;
 
 static long			samples				=      0;
@@ -75,6 +82,14 @@ static struct perf_session	*session;
 static const char		*cpu_list;
 static const char               *progname;
 
+/*
+ * With more than one reader thread, the output file position is kept
+ * here instead: writers reserve a range under output_lock and then fill
+ * it with pwrite(), in parallel.
+ */
+static pthread_mutex_t		output_lock = PTHREAD_MUTEX_INITIALIZER;
+static off_t			output_pos			=     -1;
+
 static void advance_output(size_t size)
 {
 	bytes_written += size;
@@ -82,16 +97,38 @@ static void advance_output(size_t size)
 
 static void write_output(void *buf, size_t size)
 {
+	off_t pos;
+
+	if (output_pos < 0) {
+		while (size) {
+			int ret = write(output, buf, size);
+
+			if (ret < 0)
+				die("failed to write");
+
+			size -= ret;
+			buf += ret;
+
+			bytes_written += ret;
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&output_lock);
+	pos = output_pos;
+	output_pos += size;
+	bytes_written += size;
+	pthread_mutex_unlock(&output_lock);
+
 	while (size) {
-		int ret = write(output, buf, size);
+		int ret = pwrite(output, buf, size, pos);
 
 		if (ret < 0)
 			die("failed to write");
 
 		size -= ret;
 		buf += ret;
-
-		bytes_written += ret;
+		pos += ret;
 	}
 }
 
@@ -103,7 +140,8 @@ static int process_synthesized_event(union perf_event *event,
 	return 0;
 }
 
-static void mmap_read(struct perf_mmap *md)
+/* Returns whether there was anything to read. */
+static bool mmap_read(struct perf_mmap *md)
 {
 	unsigned int head = perf_mmap__read_head(md);
 	unsigned int old = md->prev;
@@ -112,9 +150,7 @@ static void mmap_read(struct perf_mmap *md)
 	void *buf;
 
 	if (old == head)
-		return;
-
-	samples++;
+		return false;
 
 	size = head - old;
 
@@ -134,6 +170,7 @@ static void mmap_read(struct perf_mmap *md)
 
 	md->prev = old;
 	perf_mmap__write_tail(md, old);
+	return true;
 }
 
 static volatile int done = 0;
@@ -211,9 +248,17 @@ static void config_attr(struct perf_evsel *evsel, struct perf_evlist *evlist)
 		attr->mmap_data = track;
 	}
 
-	if (call_graph)
+	if (call_graph) {
 		attr->sample_type	|= PERF_SAMPLE_CALLCHAIN;
 
+		if (call_graph_dwarf) {
+			attr->sample_type	|= PERF_SAMPLE_REGS_USER;
+			attr->sample_type	|= PERF_SAMPLE_STACK_USER;
+			attr->sample_regs_user	 = PERF_REGS_MASK;
+			attr->sample_stack_user	 = stack_dump_size;
+		}
+	}
+
 	if (system_wide)
 		attr->sample_type	|= PERF_SAMPLE_CPU;
 
@@ -447,14 +492,239 @@ static void mmap_read_all(void)
 	int i;
 
 	for (i = 0; i < evsel_list->nr_mmaps; i++) {
-		if (evsel_list->mmap[i].base)
-			mmap_read(&evsel_list->mmap[i]);
+		if (evsel_list->mmap[i].base && mmap_read(&evsel_list->mmap[i]))
+			samples++;
 	}
 
 	if (perf_header__has_feat(&session->header, HEADER_TRACE_INFO))
 		write_output(&finished_round_event, sizeof(finished_round_event));
 }
 
+/*
+ * Draining all the mmaps from one thread loses events on big machines,
+ * so --threads splits them between reader threads, each polling and
+ * draining its own group, bound to the CPUs of that group.
+ *
+ * A PERF_RECORD_FINISHED_ROUND promises that everything before the
+ * previous one has been written out, so it can only go out once every
+ * reader has completed a pass started after the last one.  The main
+ * thread writes them, as rounds complete.
+ */
+struct mmap_reader {
+	pthread_t		thread;
+	int			*idx;
+	int			nr;
+	struct pollfd		*pollfd;
+	cpu_set_t		cpus;
+	bool			bind;
+	unsigned long		round_done;
+	long			samples;
+	unsigned long		waking;
+};
+
+static struct mmap_reader	*readers;
+static unsigned long		round_nr;
+static volatile int		readers_stop;
+static pthread_cond_t		round_cond = PTHREAD_COND_INITIALIZER;
+
+/* poll timeout, so idle readers still complete rounds */
+#define READER_POLL_MS		100
+
+static void *mmap_reader__run(void *arg)
+{
+	struct mmap_reader *r = arg;
+	unsigned long round;
+	bool stop, hits;
+	int i;
+
+	if (r->bind)
+		pthread_setaffinity_np(pthread_self(), sizeof(r->cpus),
+				       &r->cpus);
+
+	for (;;) {
+		pthread_mutex_lock(&output_lock);
+		round = round_nr;
+		pthread_mutex_unlock(&output_lock);
+
+		/* read the flag before draining, so the last pass is complete */
+		stop = readers_stop;
+		__sync_synchronize();
+
+		hits = false;
+		for (i = 0; i < r->nr; i++) {
+			if (mmap_read(&evsel_list->mmap[r->idx[i]])) {
+				r->samples++;
+				hits = true;
+			}
+		}
+
+		pthread_mutex_lock(&output_lock);
+		r->round_done = round + 1;
+		pthread_cond_broadcast(&round_cond);
+		pthread_mutex_unlock(&output_lock);
+
+		if (hits)
+			continue;
+		if (stop)
+			break;
+		poll(r->pollfd, r->nr, READER_POLL_MS);
+		r->waking++;
+	}
+
+	return NULL;
+}
+
+static int cpu__get_node(int cpu)
+{
+	char path[PATH_MAX];
+	struct dirent *dent;
+	int node = 0;
+	DIR *dir;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	while ((dent = readdir(dir)) != NULL) {
+		if (!strncmp(dent->d_name, "node", 4) &&
+		    isdigit(dent->d_name[4])) {
+			node = atoi(dent->d_name + 4);
+			break;
+		}
+	}
+	closedir(dir);
+
+	return node;
+}
+
+/*
+ * Split the mmaps between the readers: by NUMA node for --threads=0,
+ * in contiguous runs otherwise.  Returns the number of readers.
+ */
+static int mmap_readers__init(void)
+{
+	int nr_mmaps = evsel_list->nr_mmaps;
+	bool per_cpu = evsel_list->cpus->map[0] != -1;
+	int *group, i, r, nr = nr_readers;
+
+	group = zalloc(nr_mmaps * sizeof(int));
+	if (!group)
+		return -ENOMEM;
+
+	if (nr_readers == 0) {
+		for (i = 0; i < nr_mmaps; i++) {
+			group[i] = per_cpu ?
+				cpu__get_node(evsel_list->cpus->map[i]) : 0;
+			if (group[i] >= nr)
+				nr = group[i] + 1;
+		}
+	} else {
+		if (nr > nr_mmaps)
+			nr = nr_mmaps;
+		for (i = 0; i < nr_mmaps; i++)
+			group[i] = (long)i * nr / nr_mmaps;
+	}
+
+	readers = zalloc(nr * sizeof(*readers));
+	if (!readers)
+		goto out_free;
+
+	for (i = 0; i < nr_mmaps; i++) {
+		struct mmap_reader *reader = &readers[group[i]];
+
+		if (!reader->idx) {
+			reader->idx = zalloc(nr_mmaps * sizeof(int));
+			reader->pollfd = zalloc(nr_mmaps * sizeof(struct pollfd));
+			if (!reader->idx || !reader->pollfd)
+				goto out_free;
+			CPU_ZERO(&reader->cpus);
+			reader->bind = per_cpu;
+		}
+		reader->idx[reader->nr] = i;
+		/* mmap i is fed by pollfd i */
+		reader->pollfd[reader->nr] = evsel_list->pollfd[i];
+		reader->nr++;
+		if (per_cpu)
+			CPU_SET(evsel_list->cpus->map[i], &reader->cpus);
+	}
+
+	/* NUMA nodes without recorded CPUs get no reader */
+	for (i = r = 0; i < nr; i++) {
+		if (readers[i].nr)
+			readers[r++] = readers[i];
+	}
+
+	free(group);
+	return r;
+
+out_free:
+	free(group);
+	return -ENOMEM;
+}
+
+static bool mmap_readers__round_done(int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		if (readers[i].round_done <= round_nr)
+			return false;
+	}
+	return true;
+}
+
+static unsigned long mmap_readers__run(int nr)
+{
+	bool trace = perf_header__has_feat(&session->header, HEADER_TRACE_INFO);
+	unsigned long waking = 0;
+	int i;
+
+	output_pos = lseek(output, 0, SEEK_CUR);
+
+	for (i = 0; i < nr; i++) {
+		if (pthread_create(&readers[i].thread, NULL, mmap_reader__run,
+				   &readers[i]))
+			die("failed to create mmap reader thread");
+	}
+
+	pthread_mutex_lock(&output_lock);
+	while (!done) {
+		while (!done && !mmap_readers__round_done(nr))
+			pthread_cond_wait(&round_cond, &output_lock);
+		if (done)
+			break;
+		round_nr++;
+		pthread_mutex_unlock(&output_lock);
+
+		if (trace)
+			write_output(&finished_round_event,
+				     sizeof(finished_round_event));
+
+		pthread_mutex_lock(&output_lock);
+	}
+	pthread_mutex_unlock(&output_lock);
+
+	perf_evlist__disable(evsel_list);
+	readers_stop = 1;
+
+	for (i = 0; i < nr; i++) {
+		pthread_join(readers[i].thread, NULL);
+		samples += readers[i].samples;
+		waking += readers[i].waking;
+	}
+
+	if (trace)
+		write_output(&finished_round_event,
+			     sizeof(finished_round_event));
+
+	/* back to plain write()s, at the end of what the readers wrote */
+	lseek(output, output_pos, SEEK_SET);
+	output_pos = -1;
+
+	return waking;
+}
+
 static int __cmd_record(int argc, const char **argv)
 {
 	struct stat st;
@@ -715,6 +985,19 @@ static int __cmd_record(int argc, const char **argv)
 	if (forks)
 		close(go_pipe[1]);
 
+	/* a pipe has no offsets to pwrite() at */
+	if (nr_readers != 1 && !pipe_output) {
+		err = mmap_readers__init();
+		if (err < 0) {
+			pr_err("Not enough memory for mmap reader threads\n");
+			return err;
+		}
+		if (err > 1) {
+			waking = mmap_readers__run(err);
+			goto out_report;
+		}
+	}
+
 	for (;;) {
 		int hits = samples;
 
@@ -731,6 +1014,7 @@ static int __cmd_record(int argc, const char **argv)
 			perf_evlist__disable(evsel_list);
 	}
 
+out_report:
 	if (quiet || signr == SIGUSR1)
 		return 0;
 
@@ -752,6 +1036,55 @@ out_delete_session:
 	return err;
 }
 
+static int parse_callchain_opt(const struct option *opt __used,
+			       const char *arg, int unset)
+{
+	char *buf, *tok, *saveptr = NULL;
+	unsigned long size;
+	char *endptr;
+	int ret = 0;
+
+	call_graph = !unset;
+	call_graph_dwarf = false;
+
+	/* --call-graph without a mode means frame pointers */
+	if (unset || !arg)
+		return 0;
+
+	buf = strdup(arg);
+	if (buf == NULL)
+		return -ENOMEM;
+
+	tok = strtok_r(buf, ",", &saveptr);
+	if (tok && !strcmp(tok, "fp")) {
+		if (strtok_r(NULL, ",", &saveptr)) {
+			pr_err("callchain: No more arguments needed for fp\n");
+			ret = -1;
+		}
+	} else if (tok && !strcmp(tok, "dwarf")) {
+		call_graph_dwarf = true;
+
+		tok = strtok_r(NULL, ",", &saveptr);
+		if (tok) {
+			size = strtoul(tok, &endptr, 0);
+			/* the kernel records at most a u16 worth of sample */
+			size = ALIGN(size, sizeof(u64));
+			if (*endptr || !size || size > USHRT_MAX - 7) {
+				pr_err("callchain: Incorrect stack dump size: %s\n",
+				       tok);
+				ret = -1;
+			} else
+				stack_dump_size = size;
+		}
+	} else {
+		pr_err("callchain: Unknown mode %s, use fp or dwarf\n", arg);
+		ret = -1;
+	}
+
+	free(buf);
+	return ret;
+}
+
 static const char * const record_usage[] = {
 	"perf record [<options>] [<command>]",
 	"perf record [<options>] -- <command> [<options>]",
@@ -791,10 +1124,16 @@ const struct option record_options[] = {
 		    "child tasks do not inherit counters"),
 	OPT_UINTEGER('F', "freq", &user_freq, "profile at this frequency"),
 	OPT_UINTEGER('m', "mmap-pages", &mmap_pages, "number of mmap data pages"),
+	OPT_INTEGER(0, "threads", &nr_readers,
+		    "drain the mmap buffers from this many threads (0: one per NUMA node)"),
 	OPT_BOOLEAN(0, "group", &group,
 		    "put the counters into a counter group"),
-	OPT_BOOLEAN('g', "call-graph", &call_graph,
+	OPT_BOOLEAN('g', NULL, &call_graph,
 		    "do call-graph (stack chain/backtrace) recording"),
+	OPT_CALLBACK_OPTARG(0, "call-graph", NULL, "mode[,dump_size]",
+		    "call-graph recording mode: fp (frame pointers, default) or "
+		    "dwarf (copy dump_size bytes of user stack, default 8192)",
+		    parse_callchain_opt),
 	OPT_INCR('v', "verbose", &verbose,
 		    "be more verbose (show counter open errors, etc)"),
 	OPT_BOOLEAN('q', "quiet", &quiet, "don't print any message"),
@@ -842,6 +1181,11 @@ int cmd_record(int argc, const char **argv, const char *prefix __used)
 		write_mode = WRITE_FORCE;
 	}
 
+	if (nr_readers < 0) {
+		fprintf(stderr, "the number of threads can't be negative\n");
+		usage_with_options(record_usage, record_options);
+	}
+
 	if (nr_cgroups && !system_wide) {
 		fprintf(stderr, "cgroup monitoring only available in"
 			" system-wide mode\n");
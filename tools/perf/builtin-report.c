@@ -51,6 +51,7 @@ static const char	*pretty_printing_style = default_pretty_printing_style;
 static char		callchain_default_opt[] = "fractal,0.5,callee";
 static bool		inverted_callchain;
 static symbol_filter_t	annotate_init;
+static int		nr_jobs;
 
 static const char	*cpu_list;
 static DECLARE_BITMAP(cpu_bitmap, MAX_NR_CPUS);
@@ -66,7 +67,8 @@ static int perf_session__add_hist_entry(struct perf_session *session,
 
 	if ((sort__has_parent || symbol_conf.use_callchain) && sample->callchain) {
 		err = perf_session__resolve_callchain(session, al->thread,
-						      sample->callchain, &parent);
+						      sample->callchain, sample,
+						      &parent);
 		if (err)
 			return err;
 	}
@@ -284,6 +286,11 @@ static int __cmd_report(void)
 	if (ret)
 		goto out_delete;
 
+	if (nr_jobs <= 0)
+		nr_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	__dsos__load_parallel(&session->host_machine.user_dsos, MAP__FUNCTION,
+			      annotate_init, nr_jobs);
+
 	ret = perf_session__process_events(session, &event_ops);
 	if (ret)
 		goto out_delete;
@@ -450,6 +457,8 @@ static const struct option options[] = {
 	OPT_STRING(0, "kallsyms", &symbol_conf.kallsyms_name,
 		   "file", "kallsyms pathname"),
 	OPT_BOOLEAN('f', "force", &force, "don't complain, do it"),
+	OPT_INTEGER('j', "jobs", &nr_jobs,
+		    "load symbols from this many threads (default: online cpus)"),
 	OPT_BOOLEAN('m', "modules", &symbol_conf.use_modules,
 		    "load module symbols - WARNING: use only with -k and LIVE kernel"),
 	OPT_BOOLEAN('n', "show-nr-samples", &symbol_conf.show_nr_samples,
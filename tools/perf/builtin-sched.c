@@ -12,6 +12,7 @@
 #include "util/trace-event.h"
 
 #include "util/debug.h"
+#include "util/strbuf.h"
 
 #include <sys/prctl.h>
 #include <sys/resource.h>
@@ -27,6 +28,11 @@ static const char		*sort_order = default_sort_order;
 
 static int			profile_cpu = -1;
 
+static bool			lat_histogram;
+static bool			max_lat_details;
+static bool			offcpu_folded;
+static bool			offcpu_preempted;
+
 #define PR_SET_NAME		15               /* Set process name */
 #define MAX_CPUS		4096
 
@@ -131,6 +137,12 @@ struct work_atom {
 	u64			wake_up_time;
 	u64			sched_in_time;
 	u64			runtime;
+	int			cpu;
+	u32			waker_pid;
+	u32			preempt_pid;
+	/* only kept with --max-latency-details, and only for the max */
+	struct ip_callchain	*wakeup_chain;
+	struct ip_callchain	*switch_chain;
 };
 
 struct work_atoms {
@@ -139,6 +151,7 @@ struct work_atoms {
 	struct rb_node		node;
 	u64			max_lat;
 	u64			max_lat_at;
+	struct work_atom	*max_lat_atom;
 	u64			total_lat;
 	u64			nb_atoms;
 	u64			total_runtime;
@@ -989,8 +1002,39 @@ add_runtime_event(struct work_atoms *atoms, u64 delta, u64 timestamp __used)
 	atoms->total_runtime += delta;
 }
 
+/*
+ * The callchain of the sample being processed, if it was recorded with
+ * one; it goes away with the sample, so keep a copy of what we need.
+ */
+static struct ip_callchain	*sample_callchain;
+
+static struct ip_callchain *copy_sample_callchain(void)
+{
+	struct ip_callchain *chain;
+	size_t size;
+
+	if (!sample_callchain)
+		return NULL;
+
+	size = sizeof(*chain) + sample_callchain->nr * sizeof(u64);
+	chain = malloc(size);
+	if (!chain)
+		die("No memory");
+	memcpy(chain, sample_callchain, size);
+
+	return chain;
+}
+
+static void free_atom_callchains(struct work_atom *atom)
+{
+	free(atom->wakeup_chain);
+	free(atom->switch_chain);
+	atom->wakeup_chain = atom->switch_chain = NULL;
+}
+
 static void
-add_sched_in_event(struct work_atoms *atoms, u64 timestamp)
+add_sched_in_event(struct work_atoms *atoms, u64 timestamp, int cpu,
+		   u32 preempt_pid)
 {
 	struct work_atom *atom;
 	u64 delta;
@@ -1005,17 +1049,27 @@ add_sched_in_event(struct work_atoms *atoms, u64 timestamp)
 
 	if (timestamp < atom->wake_up_time) {
 		atom->state = THREAD_IGNORE;
+		free_atom_callchains(atom);
 		return;
 	}
 
 	atom->state = THREAD_SCHED_IN;
 	atom->sched_in_time = timestamp;
+	atom->cpu = cpu;
+	atom->preempt_pid = preempt_pid;
 
 	delta = atom->sched_in_time - atom->wake_up_time;
 	atoms->total_lat += delta;
-	if (delta > atoms->max_lat) {
+	if (delta > atoms->max_lat || !atoms->max_lat_atom) {
 		atoms->max_lat = delta;
 		atoms->max_lat_at = timestamp;
+		if (atoms->max_lat_atom)
+			free_atom_callchains(atoms->max_lat_atom);
+		atoms->max_lat_atom = atom;
+		if (max_lat_details)
+			atom->switch_chain = copy_sample_callchain();
+	} else {
+		free_atom_callchains(atom);
 	}
 	atoms->nb_atoms++;
 }
@@ -1070,7 +1124,7 @@ latency_switch_event(struct trace_switch_event *switch_event,
 		 */
 		add_sched_out_event(in_events, 'R', timestamp);
 	}
-	add_sched_in_event(in_events, timestamp);
+	add_sched_in_event(in_events, timestamp, cpu, switch_event->prev_pid);
 }
 
 static void
@@ -1142,6 +1196,11 @@ latency_wakeup_event(struct trace_wakeup_event *wakeup_event,
 
 	atom->state = THREAD_WAIT_CPU;
 	atom->wake_up_time = timestamp;
+	atom->waker_pid = wakeup_event->common_pid;
+	if (max_lat_details) {
+		free(atom->wakeup_chain);
+		atom->wakeup_chain = copy_sample_callchain();
+	}
 }
 
 static void
@@ -1624,8 +1683,11 @@ static int process_sample_event(union perf_event *event,
 	if (profile_cpu != -1 && profile_cpu != (int)sample->cpu)
 		return 0;
 
+	if (session->sample_type & PERF_SAMPLE_CALLCHAIN)
+		sample_callchain = sample->callchain;
 	process_raw_event(event, session, sample->raw_data, sample->cpu,
 			  sample->time, thread);
+	sample_callchain = NULL;
 
 	return 0;
 }
@@ -1693,6 +1755,252 @@ static void print_bad_events(void)
 	}
 }
 
+/*
+ * Wakeup latency distributions, for --histogram and --max-latency-details:
+ */
+struct lat_vec {
+	u64			*lat;
+	u64			nr;
+	u64			alloc;
+};
+
+static void lat_vec__add(struct lat_vec *vec, u64 lat)
+{
+	if (vec->nr == vec->alloc) {
+		vec->alloc = vec->alloc ? vec->alloc * 2 : 64;
+		vec->lat = realloc(vec->lat, vec->alloc * sizeof(u64));
+		if (!vec->lat)
+			die("No memory");
+	}
+	vec->lat[vec->nr++] = lat;
+}
+
+static int u64_cmp(const void *a, const void *b)
+{
+	u64 l = *(const u64 *)a, r = *(const u64 *)b;
+
+	return l < r ? -1 : l > r;
+}
+
+/* nearest rank, on a sorted vector */
+static double lat_vec__percentile(struct lat_vec *vec, double pct)
+{
+	u64 rank = ceil(pct / 100.0 * vec->nr);
+
+	if (!rank)
+		rank = 1;
+	return (double)vec->lat[rank - 1] / 1e6;
+}
+
+#define LAT_HIST_BUCKETS	24
+
+static void lat_vec__print_hist(struct lat_vec *vec)
+{
+	u64 hist[LAT_HIST_BUCKETS] = { 0, }, max_count = 0;
+	int first = LAT_HIST_BUCKETS, last = 0;
+	u64 i;
+	int b;
+
+	/* bucket b holds [2^(b-1), 2^b) usecs, bucket 0 anything below 1 */
+	for (i = 0; i < vec->nr; i++) {
+		u64 usecs = vec->lat[i] / 1000;
+
+		for (b = 0; usecs && b < LAT_HIST_BUCKETS - 1; b++)
+			usecs >>= 1;
+		hist[b]++;
+	}
+
+	for (b = 0; b < LAT_HIST_BUCKETS; b++) {
+		if (!hist[b])
+			continue;
+		if (b < first)
+			first = b;
+		last = b;
+		if (hist[b] > max_count)
+			max_count = hist[b];
+	}
+
+	printf("  %10s -> %-10s : %-9s\n", "usecs", "", "count");
+	for (b = first; b <= last; b++) {
+		u64 lo = b ? 1ULL << (b - 1) : 0, hi = 1ULL << b;
+		int stars = hist[b] * 40 / max_count;
+
+		printf("  %10" PRIu64 " -> %-10" PRIu64 " : %-9" PRIu64 " |%-40.*s|\n",
+		       lo, hi - 1, hist[b], stars,
+		       "****************************************");
+	}
+	printf("\n");
+}
+
+static void print_lat_percentiles(const char *name, struct lat_vec *vec,
+				  const char *preempt_by)
+{
+	int i, ret;
+
+	qsort(vec->lat, vec->nr, sizeof(u64), u64_cmp);
+
+	ret = printf("  %s ", name);
+	for (i = 0; i < 24 - ret; i++)
+		printf(" ");
+
+	printf("|%9" PRIu64 " | p50:%9.3f ms | p99:%9.3f ms | p99.9:%9.3f ms | max:%9.3f ms |",
+	       vec->nr, lat_vec__percentile(vec, 50),
+	       lat_vec__percentile(vec, 99), lat_vec__percentile(vec, 99.9),
+	       (double)vec->lat[vec->nr - 1] / 1e6);
+	if (preempt_by)
+		printf(" %s", preempt_by);
+	printf("\n");
+}
+
+static bool output_lat_skip(struct work_atoms *work_list)
+{
+	return !work_list->nb_atoms ||
+	       !strcmp(work_list->thread->comm, "swapper");
+}
+
+static void output_lat_distribution(struct perf_session *session)
+{
+	static struct lat_vec cpu_lats[MAX_CPUS];
+	struct lat_vec task_lats = { .nr = 0, };
+	struct rb_node *next;
+	struct work_atom *atom;
+	char name[64], by[64];
+	int cpu;
+
+	printf("\n ----------------------------------------------------------------------------------------------------------------------\n");
+	printf("  Task                  | Switches | 50th percentile  | 99th percentile  | 99.9th percentile  | Maximum delay    | Max delayed by\n");
+	printf(" ----------------------------------------------------------------------------------------------------------------------\n");
+
+	for (next = rb_first(&sorted_atom_root); next; next = rb_next(next)) {
+		struct work_atoms *work_list;
+		struct thread *preempt;
+
+		work_list = rb_entry(next, struct work_atoms, node);
+		if (output_lat_skip(work_list))
+			continue;
+
+		task_lats.nr = 0;
+		list_for_each_entry(atom, &work_list->work_list, list) {
+			u64 lat;
+
+			if (atom->state != THREAD_SCHED_IN)
+				continue;
+			lat = atom->sched_in_time - atom->wake_up_time;
+			lat_vec__add(&task_lats, lat);
+			if (atom->cpu >= 0 && atom->cpu < MAX_CPUS)
+				lat_vec__add(&cpu_lats[atom->cpu], lat);
+		}
+
+		preempt = perf_session__findnew(session,
+				work_list->max_lat_atom->preempt_pid);
+		snprintf(by, sizeof(by), "%s:%d",
+			 preempt ? preempt->comm : "<unknown>",
+			 work_list->max_lat_atom->preempt_pid);
+		snprintf(name, sizeof(name), "%s:%d", work_list->thread->comm,
+			 work_list->thread->pid);
+
+		print_lat_percentiles(name, &task_lats, by);
+	}
+
+	printf("\n ---------------------------------------------------------------------------------------------------------\n");
+	printf("  CPU                   | Switches | 50th percentile  | 99th percentile  | 99.9th percentile  | Maximum delay    |\n");
+	printf(" ---------------------------------------------------------------------------------------------------------\n");
+
+	for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+		if (!cpu_lats[cpu].nr)
+			continue;
+		snprintf(name, sizeof(name), "%d", cpu);
+		print_lat_percentiles(name, &cpu_lats[cpu], NULL);
+	}
+	printf("\n");
+
+	for (next = rb_first(&sorted_atom_root); next; next = rb_next(next)) {
+		struct work_atoms *work_list;
+
+		work_list = rb_entry(next, struct work_atoms, node);
+		if (output_lat_skip(work_list))
+			continue;
+
+		task_lats.nr = 0;
+		list_for_each_entry(atom, &work_list->work_list, list)
+			if (atom->state == THREAD_SCHED_IN)
+				lat_vec__add(&task_lats, atom->sched_in_time -
+						       atom->wake_up_time);
+
+		printf("  %s:%d\n", work_list->thread->comm,
+		       work_list->thread->pid);
+		lat_vec__print_hist(&task_lats);
+	}
+
+	free(task_lats.lat);
+	for (cpu = 0; cpu < MAX_CPUS; cpu++)
+		free(cpu_lats[cpu].lat);
+}
+
+static void print_lat_callchain(struct perf_session *session, u32 pid,
+				struct ip_callchain *chain)
+{
+	struct callchain_cursor *cursor = &session->callchain_cursor;
+	struct callchain_cursor_node *node;
+	struct symbol *parent = NULL;
+	struct thread *thread;
+
+	thread = perf_session__findnew(session, pid);
+	if (!chain || !thread) {
+		printf("\t(no callchain, record with -g)\n");
+		return;
+	}
+
+	if (perf_session__resolve_callchain(session, thread, chain, NULL,
+					    &parent)) {
+		printf("\t(failed to resolve callchain)\n");
+		return;
+	}
+
+	callchain_cursor_commit(cursor);
+	while ((node = callchain_cursor_current(cursor))) {
+		printf("\t%16" PRIx64 " %s\n", node->ip,
+		       node->sym ? node->sym->name : "");
+		callchain_cursor_advance(cursor);
+	}
+}
+
+static void output_max_lat_details(struct perf_session *session)
+{
+	struct rb_node *next;
+
+	symbol_conf.use_callchain = true;
+
+	for (next = rb_first(&sorted_atom_root); next; next = rb_next(next)) {
+		struct work_atoms *work_list;
+		struct work_atom *atom;
+		struct thread *waker, *preempt;
+
+		work_list = rb_entry(next, struct work_atoms, node);
+		if (output_lat_skip(work_list))
+			continue;
+
+		atom = work_list->max_lat_atom;
+		waker = perf_session__findnew(session, atom->waker_pid);
+		preempt = perf_session__findnew(session, atom->preempt_pid);
+
+		printf("  %s:%d: max delay %.3f ms on CPU %d\n",
+		       work_list->thread->comm, work_list->thread->pid,
+		       (double)work_list->max_lat / 1e6, atom->cpu);
+		printf("    woken at %.6f s by %s:%d\n",
+		       (double)atom->wake_up_time / 1e9,
+		       waker ? waker->comm : "<unknown>", atom->waker_pid);
+		print_lat_callchain(session, atom->waker_pid,
+				    atom->wakeup_chain);
+		printf("    switched in at %.6f s, replacing %s:%d\n",
+		       (double)atom->sched_in_time / 1e9,
+		       preempt ? preempt->comm : "<unknown>", atom->preempt_pid);
+		print_lat_callchain(session, atom->preempt_pid,
+				    atom->switch_chain);
+		printf("\n");
+	}
+}
+
 static void __cmd_lat(void)
 {
 	struct rb_node *next;
@@ -1722,6 +2030,11 @@ static void __cmd_lat(void)
 
 	printf(" ---------------------------------------------------\n");
 
+	if (lat_histogram)
+		output_lat_distribution(session);
+	if (max_lat_details)
+		output_max_lat_details(session);
+
 	print_bad_events();
 	printf("\n");
 
@@ -1744,6 +2057,256 @@ static void __cmd_map(void)
 	print_bad_events();
 }
 
+/*
+ * Off-CPU time: a task's callchain at the sched_switch that took it off
+ * the CPU says why it blocked, the switch that brings it back says for
+ * how long.  Sum that time per task and stack.
+ */
+struct offcpu_task {
+	struct rb_node		node;
+	u32			pid;
+	u64			sched_out_time;
+	struct ip_callchain	*chain;
+};
+
+struct offcpu_stack {
+	struct rb_node		node;
+	char			*key;
+	u64			total;
+	u64			max;
+	unsigned long		count;
+};
+
+static struct rb_root		offcpu_tasks;
+static struct rb_root		offcpu_stacks, sorted_offcpu_stacks;
+static u64			offcpu_total;
+
+static struct offcpu_task *offcpu_task__findnew(u32 pid)
+{
+	struct rb_node **p = &offcpu_tasks.rb_node, *parent = NULL;
+	struct offcpu_task *task;
+
+	while (*p) {
+		parent = *p;
+		task = rb_entry(parent, struct offcpu_task, node);
+		if (pid == task->pid)
+			return task;
+		if (pid < task->pid)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	task = zalloc(sizeof(*task));
+	if (!task)
+		die("No memory");
+	task->pid = pid;
+	rb_link_node(&task->node, parent, p);
+	rb_insert_color(&task->node, &offcpu_tasks);
+
+	return task;
+}
+
+/*
+ * Fold the task name and its callchain into one flame graph line key,
+ * outermost caller first: "comm;caller;...;callee".
+ */
+static char *offcpu_stack_key(struct perf_session *session,
+			      struct thread *thread, struct ip_callchain *chain)
+{
+	struct callchain_cursor *cursor = &session->callchain_cursor;
+	struct callchain_cursor_node *node, **frames = NULL;
+	struct symbol *parent = NULL;
+	struct strbuf sb;
+	u64 i, nr = 0;
+
+	strbuf_init(&sb, 128);
+	strbuf_addstr(&sb, thread->comm ?: "<unknown>");
+
+	if (chain && !perf_session__resolve_callchain(session, thread,
+						      chain, NULL, &parent) &&
+	    cursor->nr) {
+		callchain_cursor_commit(cursor);
+		frames = malloc(cursor->nr * sizeof(*frames));
+		if (!frames)
+			die("No memory");
+		while ((node = callchain_cursor_current(cursor))) {
+			frames[nr++] = node;
+			callchain_cursor_advance(cursor);
+		}
+	}
+
+	for (i = nr; i > 0; i--) {
+		node = frames[i - 1];
+		if (node->sym)
+			strbuf_addf(&sb, ";%s", node->sym->name);
+		else
+			strbuf_addf(&sb, ";%#" PRIx64, node->ip);
+	}
+	free(frames);
+
+	return strbuf_detach(&sb, NULL);
+}
+
+static void offcpu_stack__add(char *key, u64 delta)
+{
+	struct rb_node **p = &offcpu_stacks.rb_node, *parent = NULL;
+	struct offcpu_stack *stack;
+	int cmp;
+
+	while (*p) {
+		parent = *p;
+		stack = rb_entry(parent, struct offcpu_stack, node);
+		cmp = strcmp(key, stack->key);
+		if (!cmp) {
+			free(key);
+			goto found;
+		}
+		if (cmp < 0)
+			p = &parent->rb_left;
+		else
+			p = &parent->rb_right;
+	}
+
+	stack = zalloc(sizeof(*stack));
+	if (!stack)
+		die("No memory");
+	stack->key = key;
+	rb_link_node(&stack->node, parent, p);
+	rb_insert_color(&stack->node, &offcpu_stacks);
+found:
+	stack->total += delta;
+	stack->count++;
+	if (delta > stack->max)
+		stack->max = delta;
+	offcpu_total += delta;
+}
+
+static void
+offcpu_switch_event(struct trace_switch_event *switch_event,
+		    struct perf_session *session,
+		    struct event *event __used,
+		    int cpu __used,
+		    u64 timestamp,
+		    struct thread *thread __used)
+{
+	struct offcpu_task *task;
+
+	/* The idle task is never blocked, it only gets preempted. */
+	if (switch_event->next_pid) {
+		task = offcpu_task__findnew(switch_event->next_pid);
+		if (task->sched_out_time && task->sched_out_time <= timestamp) {
+			struct thread *sched_in;
+
+			sched_in = perf_session__findnew(session, task->pid);
+			if (sched_in)
+				offcpu_stack__add(offcpu_stack_key(session, sched_in,
+								   task->chain),
+						  timestamp - task->sched_out_time);
+		}
+		free(task->chain);
+		task->chain = NULL;
+		task->sched_out_time = 0;
+	}
+
+	if (!switch_event->prev_pid)
+		return;
+	if (!switch_event->prev_state && !offcpu_preempted)
+		return;
+
+	task = offcpu_task__findnew(switch_event->prev_pid);
+	free(task->chain);
+	task->chain = copy_sample_callchain();
+	task->sched_out_time = timestamp;
+}
+
+static struct trace_sched_handler offcpu_ops  = {
+	.switch_event		= offcpu_switch_event,
+};
+
+static void sort_offcpu(void)
+{
+	struct rb_node *node;
+
+	while ((node = rb_first(&offcpu_stacks))) {
+		struct rb_node **p = &sorted_offcpu_stacks.rb_node, *parent = NULL;
+		struct offcpu_stack *stack, *this;
+
+		rb_erase(node, &offcpu_stacks);
+		stack = rb_entry(node, struct offcpu_stack, node);
+
+		while (*p) {
+			parent = *p;
+			this = rb_entry(parent, struct offcpu_stack, node);
+			if (stack->total > this->total)
+				p = &parent->rb_left;
+			else
+				p = &parent->rb_right;
+		}
+		rb_link_node(&stack->node, parent, p);
+		rb_insert_color(&stack->node, &sorted_offcpu_stacks);
+	}
+}
+
+static void output_offcpu_stack(struct offcpu_stack *stack)
+{
+	char *frame, *end;
+
+	if (offcpu_folded) {
+		/* flamegraph.pl wants integer counts, use microseconds. */
+		printf("%s %" PRIu64 "\n", stack->key, stack->total / 1000);
+		return;
+	}
+
+	end = strchr(stack->key, ';');
+	printf("  %11.3f ms | %6.2f%% | %8lu | %11.3f ms | %.*s\n",
+	       (double)stack->total / 1e6,
+	       offcpu_total ? 100.0 * stack->total / offcpu_total : 0.0,
+	       stack->count, (double)stack->max / 1e6,
+	       end ? (int)(end - stack->key) : (int)strlen(stack->key),
+	       stack->key);
+
+	/* Print the callchain the way round the other reports do, callee first. */
+	while (end) {
+		frame = strrchr(stack->key, ';');
+		*frame = '\0';
+		printf("\t%s\n", frame + 1);
+		if (frame == end)
+			end = NULL;
+	}
+	printf("\n");
+}
+
+static void __cmd_offcpu(void)
+{
+	struct perf_session *session;
+	struct rb_node *next;
+
+	symbol_conf.use_callchain = true;
+
+	setup_pager();
+	read_events(false, &session);
+	sort_offcpu();
+
+	if (!offcpu_folded) {
+		printf("\n ----------------------------------------------------------------------\n");
+		printf("  Off-CPU time   |  Share  |  Count   |   Maximum      | Task\n");
+		printf(" ----------------------------------------------------------------------\n");
+	}
+
+	for (next = rb_first(&sorted_offcpu_stacks); next; next = rb_next(next))
+		output_offcpu_stack(rb_entry(next, struct offcpu_stack, node));
+
+	if (!offcpu_folded) {
+		printf(" ----------------------------------------------------------------------\n");
+		printf("  TOTAL: %11.3f ms\n", (double)offcpu_total / 1e6);
+		print_bad_events();
+		printf("\n");
+	}
+
+	perf_session__delete(session);
+}
+
 static void __cmd_replay(void)
 {
 	unsigned long i;
@@ -1778,7 +2341,7 @@ static void __cmd_replay(void)
 
 
 static const char * const sched_usage[] = {
-	"perf sched [<options>] {record|latency|map|replay|script}",
+	"perf sched [<options>] {record|latency|map|replay|offcpu|script}",
 	NULL
 };
 
@@ -1806,6 +2369,27 @@ static const struct option latency_options[] = {
 		    "CPU to profile on"),
 	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
 		    "dump raw trace in ASCII"),
+	OPT_BOOLEAN('H', "histogram", &lat_histogram,
+		    "show delay percentiles per task and per CPU, and histograms"),
+	OPT_BOOLEAN(0, "max-latency-details", &max_lat_details,
+		    "show waker, preempting task and callchains of each task's max delay"),
+	OPT_END()
+};
+
+static const char * const offcpu_usage[] = {
+	"perf sched offcpu [<options>]",
+	NULL
+};
+
+static const struct option offcpu_options[] = {
+	OPT_BOOLEAN('f', "folded", &offcpu_folded,
+		    "print folded stacks with microseconds, for flame graphs"),
+	OPT_BOOLEAN(0, "preempted", &offcpu_preempted,
+		    "also count time spent runnable after being preempted"),
+	OPT_INCR('v', "verbose", &verbose,
+		    "be more verbose (show symbol address, etc)"),
+	OPT_BOOLEAN('D', "dump-raw-trace", &dump_trace,
+		    "dump raw trace in ASCII"),
 	OPT_END()
 };
 
@@ -1918,6 +2502,14 @@ int cmd_sched(int argc, const char **argv, const char *prefix __used)
 				usage_with_options(replay_usage, replay_options);
 		}
 		__cmd_replay();
+	} else if (!strncmp(argv[0], "off", 3)) {
+		trace_handler = &offcpu_ops;
+		if (argc > 1) {
+			argc = parse_options(argc, argv, offcpu_options, offcpu_usage, 0);
+			if (argc)
+				usage_with_options(offcpu_usage, offcpu_options);
+		}
+		__cmd_offcpu();
 	} else {
 		usage_with_options(sched_usage, sched_options);
 	}
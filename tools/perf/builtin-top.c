@@ -779,7 +779,8 @@ static void perf_event__process_sample(const union perf_event *event,
 		if ((sort__has_parent || symbol_conf.use_callchain) &&
 		    sample->callchain) {
 			err = perf_session__resolve_callchain(session, al.thread,
-							      sample->callchain, &parent);
+							      sample->callchain, sample,
+							      &parent);
 			if (err)
 				return;
 		}
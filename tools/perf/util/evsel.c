@@ -8,6 +8,7 @@
  */
 
 #include <byteswap.h>
+#include <linux/bitops.h>
 #include "asm/bug.h"
 #include "evsel.h"
 #include "evlist.h"
@@ -373,7 +374,7 @@ static bool sample_overlap(const union perf_event *event,
 }
 
 int perf_event__parse_sample(const union perf_event *event, u64 type,
-			     int sample_size, bool sample_id_all,
+			     u64 regs_user, int sample_size, bool sample_id_all,
 			     struct perf_sample *data, bool swapped)
 {
 	const u64 *array;
@@ -501,6 +502,48 @@ int perf_event__parse_sample(const union perf_event *event, u64 type,
 			return -EFAULT;
 
 		data->raw_data = (void *) pdata;
+		array = (void *) pdata + data->raw_size;
+	}
+
+	data->user_regs.abi = PERF_SAMPLE_REGS_ABI_NONE;
+	data->user_regs.regs = NULL;
+	if (type & PERF_SAMPLE_REGS_USER) {
+		if (sample_overlap(event, array, sizeof(u64)))
+			return -EFAULT;
+
+		data->user_regs.abi = *array++;
+		if (data->user_regs.abi) {
+			u64 size = hweight64(regs_user) * sizeof(u64);
+
+			if (sample_overlap(event, array, size))
+				return -EFAULT;
+
+			data->user_regs.regs = (u64 *) array;
+			array = (void *) array + size;
+		}
+	}
+
+	data->user_stack.size = 0;
+	data->user_stack.data = NULL;
+	if (type & PERF_SAMPLE_STACK_USER) {
+		u64 size;
+
+		if (sample_overlap(event, array, sizeof(u64)))
+			return -EFAULT;
+
+		size = *array++;
+		if (size) {
+			if (sample_overlap(event, array, size + sizeof(u64)))
+				return -EFAULT;
+
+			data->user_stack.data = (char *) array;
+			array = (void *) array + size;
+
+			/* Only dyn_size bytes of the dump are the stack. */
+			data->user_stack.size = *array++;
+			if (data->user_stack.size > size)
+				return -EFAULT;
+		}
 	}
 
 	return 0;
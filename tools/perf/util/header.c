@@ -1677,6 +1677,17 @@ out_free:
 	return err;
 }
 
+/*
+ * Files written before perf_event_attr last grew have shorter attrs;
+ * they read fine with the new fields left zeroed.
+ */
+static bool perf_file_attr_size_ok(u64 attr_size)
+{
+	return attr_size >= PERF_ATTR_SIZE_VER0 + sizeof(struct perf_file_section) &&
+	       attr_size <= sizeof(struct perf_file_attr) &&
+	       !(attr_size % sizeof(u64));
+}
+
 int perf_file_header__read(struct perf_file_header *header,
 			   struct perf_header *ph, int fd)
 {
@@ -1686,10 +1697,10 @@ int perf_file_header__read(struct perf_file_header *header,
 	    memcmp(&header->magic, __perf_magic, sizeof(header->magic)))
 		return -1;
 
-	if (header->attr_size != sizeof(struct perf_file_attr)) {
+	if (!perf_file_attr_size_ok(header->attr_size)) {
 		u64 attr_size = bswap_64(header->attr_size);
 
-		if (attr_size != sizeof(struct perf_file_attr))
+		if (!perf_file_attr_size_ok(attr_size))
 			return -1;
 
 		mem_bswap_64(header, offsetof(struct perf_file_header,
@@ -1982,6 +1993,7 @@ int perf_session__read_header(struct perf_session *session, int fd)
 	struct perf_file_header	f_header;
 	struct perf_file_attr	f_attr;
 	u64			f_id;
+	size_t			attr_size;
 	int nr_attrs, nr_ids, i, j;
 
 	session->evlist = perf_evlist__new(NULL, NULL);
@@ -1996,14 +2008,17 @@ int perf_session__read_header(struct perf_session *session, int fd)
 		return -EINVAL;
 	}
 
-	nr_attrs = f_header.attrs.size / sizeof(f_attr);
+	attr_size = f_header.attr_size - sizeof(f_attr.ids);
+	nr_attrs = f_header.attrs.size / f_header.attr_size;
 	lseek(fd, f_header.attrs.offset, SEEK_SET);
 
 	for (i = 0; i < nr_attrs; i++) {
 		struct perf_evsel *evsel;
 		off_t tmp;
 
-		if (readn(fd, &f_attr, sizeof(f_attr)) <= 0)
+		memset(&f_attr, 0, sizeof(f_attr));
+		if (readn(fd, &f_attr.attr, attr_size) <= 0 ||
+		    readn(fd, &f_attr.ids, sizeof(f_attr.ids)) <= 0)
 			goto out_errno;
 
 		if (header->needs_swap)
@@ -0,0 +1,9 @@
+#ifndef __PERF_REGS_H
+#define __PERF_REGS_H
+
+#ifdef HAVE_PERF_REGS
+#include <perf_regs.h>
+#else
+#define PERF_REGS_MASK	0
+#endif /* HAVE_PERF_REGS */
+#endif /* __PERF_REGS_H */
@@ -32,6 +32,8 @@
 #include <stdarg.h>
 #include <limits.h>
 #include <elf.h>
+#include <libelf.h>
+#include <gelf.h>
 
 #undef _GNU_SOURCE
 #include "util.h"
@@ -1344,11 +1346,16 @@ char *synthesize_probe_trace_command(struct probe_trace_event *tev)
 	if (buf == NULL)
 		return NULL;
 
-	len = e_snprintf(buf, MAX_CMDLEN, "%c:%s/%s %s%s%s+%lu",
-			 tp->retprobe ? 'r' : 'p',
-			 tev->group, tev->event,
-			 tp->module ?: "", tp->module ? ":" : "",
-			 tp->symbol, tp->offset);
+	if (tev->uprobes)
+		len = e_snprintf(buf, MAX_CMDLEN, "p:%s/%s %s:0x%lx",
+				 tev->group, tev->event,
+				 tp->module, tp->offset);
+	else
+		len = e_snprintf(buf, MAX_CMDLEN, "%c:%s/%s %s%s%s+%lu",
+				 tp->retprobe ? 'r' : 'p',
+				 tev->group, tev->event,
+				 tp->module ?: "", tp->module ? ":" : "",
+				 tp->symbol, tp->offset);
 	if (len <= 0)
 		goto error;
 
@@ -1379,9 +1386,19 @@ static int convert_to_perf_probe_event(struct probe_trace_event *tev,
 		return -ENOMEM;
 
 	/* Convert trace_point to probe_point */
-	ret = kprobe_convert_to_perf_probe(&tev->point, &pev->point);
-	if (ret < 0)
-		return ret;
+	if (tev->uprobes) {
+		/* uprobe_events only knows the file offset */
+		pev->uprobes = true;
+		pev->point.function = strdup(tev->point.symbol);
+		pev->point.file = strdup(tev->point.module);
+		if (pev->point.function == NULL || pev->point.file == NULL)
+			return -ENOMEM;
+		ret = 0;
+	} else {
+		ret = kprobe_convert_to_perf_probe(&tev->point, &pev->point);
+		if (ret < 0)
+			return ret;
+	}
 
 	/* Convert trace_arg to probe_arg */
 	pev->nargs = tev->nargs;
@@ -1475,7 +1492,8 @@ static void clear_probe_trace_event(struct probe_trace_event *tev)
 	memset(tev, 0, sizeof(*tev));
 }
 
-static int open_kprobe_events(bool readwrite)
+static int open_probe_events(const char *trace_file, const char *config,
+			     bool readwrite, bool quiet)
 {
 	char buf[PATH_MAX];
 	const char *__debugfs;
@@ -1487,7 +1505,7 @@ static int open_kprobe_events(bool readwrite)
 		return -ENOENT;
 	}
 
-	ret = e_snprintf(buf, PATH_MAX, "%stracing/kprobe_events", __debugfs);
+	ret = e_snprintf(buf, PATH_MAX, "%stracing/%s", __debugfs, trace_file);
 	if (ret >= 0) {
 		pr_debug("Opening %s write=%d\n", buf, readwrite);
 		if (readwrite && !probe_event_dry_run)
@@ -1496,17 +1514,30 @@ static int open_kprobe_events(bool readwrite)
 			ret = open(buf, O_RDONLY, 0);
 	}
 
-	if (ret < 0) {
+	if (ret < 0 && !(quiet && errno == ENOENT)) {
 		if (errno == ENOENT)
-			pr_warning("kprobe_events file does not exist - please"
-				 " rebuild kernel with CONFIG_KPROBE_EVENT.\n");
+			pr_warning("%s file does not exist - please rebuild"
+				   " kernel with %s.\n", trace_file, config);
 		else
-			pr_warning("Failed to open kprobe_events file: %s\n",
-				   strerror(errno));
+			pr_warning("Failed to open %s file: %s\n",
+				   trace_file, strerror(errno));
 	}
 	return ret;
 }
 
+static int open_kprobe_events(bool readwrite)
+{
+	return open_probe_events("kprobe_events", "CONFIG_KPROBE_EVENT",
+				 readwrite, false);
+}
+
+/* A kernel without uprobe events is not an error unless asked for */
+static int open_uprobe_events(bool readwrite, bool quiet)
+{
+	return open_probe_events("uprobe_events", "CONFIG_UPROBE_EVENT",
+				 readwrite, quiet);
+}
+
 /* Get raw string list of current kprobe_events */
 static struct strlist *get_probe_trace_command_rawlist(int fd)
 {
@@ -1572,35 +1603,25 @@ static int show_perf_probe_event(struct perf_probe_event *pev)
 	return ret;
 }
 
-/* List up current perf-probe events */
-int show_perf_probe_events(void)
+static int __show_perf_probe_events(int fd, bool uprobes)
 {
-	int fd, ret;
+	int ret = 0;
 	struct probe_trace_event tev;
 	struct perf_probe_event pev;
 	struct strlist *rawlist;
 	struct str_node *ent;
 
-	setup_pager();
-	ret = init_vmlinux();
-	if (ret < 0)
-		return ret;
-
 	memset(&tev, 0, sizeof(tev));
 	memset(&pev, 0, sizeof(pev));
 
-	fd = open_kprobe_events(false);
-	if (fd < 0)
-		return fd;
-
 	rawlist = get_probe_trace_command_rawlist(fd);
-	close(fd);
 	if (!rawlist)
 		return -ENOENT;
 
 	strlist__for_each(ent, rawlist) {
 		ret = parse_probe_trace_command(ent->s, &tev);
 		if (ret >= 0) {
+			tev.uprobes = uprobes;
 			ret = convert_to_perf_probe_event(&tev, &pev);
 			if (ret >= 0)
 				ret = show_perf_probe_event(&pev);
@@ -1615,6 +1636,32 @@ int show_perf_probe_events(void)
 	return ret;
 }
 
+/* List up current perf-probe events */
+int show_perf_probe_events(void)
+{
+	int fd, ret;
+
+	setup_pager();
+	ret = init_vmlinux();
+	if (ret < 0)
+		return ret;
+
+	fd = open_kprobe_events(false);
+	if (fd < 0)
+		return fd;
+
+	ret = __show_perf_probe_events(fd, false);
+	close(fd);
+
+	fd = open_uprobe_events(false, true);
+	if (ret >= 0 && fd >= 0)
+		ret = __show_perf_probe_events(fd, true);
+	if (fd >= 0)
+		close(fd);
+
+	return ret;
+}
+
 /* Get current perf-probe event names */
 static struct strlist *get_probe_trace_event_names(int fd, bool include_group)
 {
@@ -1710,17 +1757,39 @@ static int get_new_event_name(char *buf, size_t len, const char *base,
 	return ret;
 }
 
+/* Events on an executable go to "probe_<basename>" */
+static int get_uprobe_group_name(char *buf, size_t len, const char *exec)
+{
+	const char *base = strrchr(exec, '/');
+	char *p;
+	int ret;
+
+	ret = e_snprintf(buf, len, "%s_%s", PERFPROBE_GROUP,
+			 base ? base + 1 : exec);
+	if (ret < 0)
+		return ret;
+
+	/* Group names must follow the C symbol-naming rule, too */
+	for (p = buf; *p; p++)
+		if (!isalnum(*p))
+			*p = '_';
+	return 0;
+}
+
 static int __add_probe_trace_events(struct perf_probe_event *pev,
 				     struct probe_trace_event *tevs,
 				     int ntevs, bool allow_suffix)
 {
 	int i, fd, ret;
 	struct probe_trace_event *tev = NULL;
-	char buf[64];
+	char buf[64], gbuf[64];
 	const char *event, *group;
 	struct strlist *namelist;
 
-	fd = open_kprobe_events(true);
+	if (pev->uprobes)
+		fd = open_uprobe_events(true, false);
+	else
+		fd = open_kprobe_events(true);
 	if (fd < 0)
 		return fd;
 	/* Get current event names */
@@ -1743,7 +1812,13 @@ static int __add_probe_trace_events(struct perf_probe_event *pev,
 				event = tev->point.symbol;
 		if (pev->group)
 			group = pev->group;
-		else
+		else if (pev->uprobes) {
+			ret = get_uprobe_group_name(gbuf, 64,
+						    tev->point.module);
+			if (ret < 0)
+				break;
+			group = gbuf;
+		} else
 			group = PERFPROBE_GROUP;
 
 		/* Get an unused new event name */
@@ -1796,6 +1871,155 @@ static int __add_probe_trace_events(struct perf_probe_event *pev,
 	return ret;
 }
 
+/*
+ * Find the file offset of function @func in @exec: the symbol value is a
+ * virtual address, convert it through its section.
+ */
+static int find_uprobe_offset(const char *exec, const char *func,
+			      unsigned long *offset)
+{
+	Elf *elf;
+	Elf_Scn *scn = NULL, *sec;
+	GElf_Shdr shdr;
+	GElf_Sym sym;
+	Elf_Data *data;
+	int fd, i, nsyms, ret = -ENOENT;
+	Elf64_Word type = SHT_SYMTAB;
+
+	fd = open(exec, O_RDONLY);
+	if (fd < 0) {
+		pr_warning("Failed to open %s: %s\n", exec, strerror(errno));
+		return -errno;
+	}
+
+	elf_version(EV_CURRENT);
+	elf = elf_begin(fd, PERF_ELF_C_READ_MMAP, NULL);
+	if (elf == NULL) {
+		pr_warning("%s is not an ELF file.\n", exec);
+		close(fd);
+		return -EINVAL;
+	}
+
+again:
+	while ((scn = elf_nextscn(elf, scn)) != NULL) {
+		if (gelf_getshdr(scn, &shdr) == NULL || shdr.sh_type != type)
+			continue;
+
+		data = elf_getdata(scn, NULL);
+		if (data == NULL || shdr.sh_entsize == 0)
+			continue;
+
+		nsyms = shdr.sh_size / shdr.sh_entsize;
+		for (i = 0; i < nsyms; i++) {
+			const char *name;
+			GElf_Shdr sym_shdr;
+
+			if (gelf_getsym(data, i, &sym) == NULL)
+				continue;
+			if (GELF_ST_TYPE(sym.st_info) != STT_FUNC ||
+			    sym.st_shndx == SHN_UNDEF)
+				continue;
+			name = elf_strptr(elf, shdr.sh_link, sym.st_name);
+			if (name == NULL || strcmp(name, func))
+				continue;
+
+			sec = elf_getscn(elf, sym.st_shndx);
+			if (sec == NULL || gelf_getshdr(sec, &sym_shdr) == NULL)
+				continue;
+
+			*offset = sym.st_value - sym_shdr.sh_addr +
+				  sym_shdr.sh_offset;
+			ret = 0;
+			goto out;
+		}
+	}
+	/* Stripped binaries still have their dynamic symbols */
+	if (type == SHT_SYMTAB) {
+		type = SHT_DYNSYM;
+		goto again;
+	}
+out:
+	elf_end(elf);
+	close(fd);
+
+	if (ret < 0)
+		pr_warning("Function \'%s\' not found in %s.\n", func, exec);
+	return ret;
+}
+
+static int convert_to_uprobe_trace_events(struct perf_probe_event *pev,
+					  struct probe_trace_event **tevs,
+					  const char *exec)
+{
+	struct probe_trace_event *tev;
+	unsigned long offset;
+	int ret, i;
+
+	if (!exec) {
+		semantic_error("An executable must be given for uprobes.\n");
+		return -EINVAL;
+	}
+	if (!pev->point.function || pev->point.file || pev->point.line ||
+	    pev->point.lazy_line || pev->point.retprobe) {
+		semantic_error("Uprobes only support FUNC[+OFFS].\n");
+		return -EINVAL;
+	}
+	for (i = 0; i < pev->nargs; i++)
+		if (pev->args[i].var[0] != '%' || pev->args[i].field ||
+		    pev->args[i].type) {
+			semantic_error("Uprobes only support %%REG arguments.\n");
+			return -EINVAL;
+		}
+
+	ret = find_uprobe_offset(exec, pev->point.function, &offset);
+	if (ret < 0)
+		return ret;
+
+	tev = *tevs = zalloc(sizeof(struct probe_trace_event));
+	if (tev == NULL)
+		return -ENOMEM;
+
+	tev->uprobes = true;
+	tev->point.symbol = strdup(pev->point.function);
+	tev->point.module = strdup(exec);
+	tev->point.offset = offset + pev->point.offset;
+	if (tev->point.symbol == NULL || tev->point.module == NULL) {
+		ret = -ENOMEM;
+		goto error;
+	}
+
+	tev->nargs = pev->nargs;
+	if (tev->nargs) {
+		tev->args = zalloc(sizeof(struct probe_trace_arg)
+				   * tev->nargs);
+		if (tev->args == NULL) {
+			ret = -ENOMEM;
+			goto error;
+		}
+		for (i = 0; i < tev->nargs; i++) {
+			if (pev->args[i].name) {
+				tev->args[i].name = strdup(pev->args[i].name);
+				if (tev->args[i].name == NULL) {
+					ret = -ENOMEM;
+					goto error;
+				}
+			}
+			tev->args[i].value = strdup(pev->args[i].var);
+			if (tev->args[i].value == NULL) {
+				ret = -ENOMEM;
+				goto error;
+			}
+		}
+	}
+
+	return 1;
+error:
+	clear_probe_trace_event(tev);
+	free(tev);
+	*tevs = NULL;
+	return ret;
+}
+
 static int convert_to_probe_trace_events(struct perf_probe_event *pev,
 					  struct probe_trace_event **tevs,
 					  int max_tevs, const char *module)
@@ -1804,6 +2028,9 @@ static int convert_to_probe_trace_events(struct perf_probe_event *pev,
 	int ret = 0, i;
 	struct probe_trace_event *tev;
 
+	if (pev->uprobes)
+		return convert_to_uprobe_trace_events(pev, tevs, module);
+
 	/* Convert perf_probe_event with debuginfo */
 	ret = try_to_find_probe_trace_events(pev, tevs, max_tevs, module);
 	if (ret != 0)
@@ -1886,7 +2113,7 @@ struct __event_package {
 };
 
 int add_perf_probe_events(struct perf_probe_event *pevs, int npevs,
-			  int max_tevs, const char *module, bool force_add)
+			  int max_tevs, const char *target, bool force_add)
 {
 	int i, j, ret;
 	struct __event_package *pkgs;
@@ -1895,11 +2122,13 @@ int add_perf_probe_events(struct perf_probe_event *pevs, int npevs,
 	if (pkgs == NULL)
 		return -ENOMEM;
 
-	/* Init vmlinux path */
-	ret = init_vmlinux();
-	if (ret < 0) {
-		free(pkgs);
-		return ret;
+	/* Init vmlinux path, user space probes don't need it */
+	if (!pevs->uprobes) {
+		ret = init_vmlinux();
+		if (ret < 0) {
+			free(pkgs);
+			return ret;
+		}
 	}
 
 	/* Loop 1: convert all events */
@@ -1909,7 +2138,7 @@ int add_perf_probe_events(struct perf_probe_event *pevs, int npevs,
 		ret  = convert_to_probe_trace_events(pkgs[i].pev,
 						     &pkgs[i].tevs,
 						     max_tevs,
-						     module);
+						     target);
 		if (ret < 0)
 			goto end;
 		pkgs[i].ntevs = ret;
@@ -1968,19 +2197,13 @@ error:
 	return ret;
 }
 
-static int del_trace_probe_event(int fd, const char *group,
-				  const char *event, struct strlist *namelist)
+/* Returns the number of events deleted or a negative error */
+static int del_trace_probe_event(int fd, const char *buf,
+				  struct strlist *namelist)
 {
-	char buf[128];
 	struct str_node *ent, *n;
 	int found = 0, ret = 0;
 
-	ret = e_snprintf(buf, 128, "%s:%s", group, event);
-	if (ret < 0) {
-		pr_err("Failed to copy event.\n");
-		return ret;
-	}
-
 	if (strpbrk(buf, "*?")) { /* Glob-exp */
 		strlist__for_each_safe(ent, n, namelist)
 			if (strglobmatch(ent->s, buf)) {
@@ -1999,19 +2222,16 @@ static int del_trace_probe_event(int fd, const char *group,
 				strlist__remove(namelist, ent);
 		}
 	}
-	if (found == 0 && ret >= 0)
-		pr_info("Info: Event \"%s\" does not exist.\n", buf);
-
-	return ret;
+	return ret < 0 ? ret : found;
 }
 
 int del_perf_probe_events(struct strlist *dellist)
 {
-	int fd, ret = 0;
+	int fd, ufd, ret = 0, ret2;
 	const char *group, *event;
-	char *p, *str;
+	char *p, *str, buf[128];
 	struct str_node *ent;
-	struct strlist *namelist;
+	struct strlist *namelist, *unamelist = NULL;
 
 	fd = open_kprobe_events(true);
 	if (fd < 0)
@@ -2022,6 +2242,16 @@ int del_perf_probe_events(struct strlist *dellist)
 	if (namelist == NULL)
 		return -EINVAL;
 
+	/* The events on executables, if the kernel has them */
+	ufd = open_uprobe_events(true, true);
+	if (ufd >= 0) {
+		unamelist = get_probe_trace_event_names(ufd, true);
+		if (unamelist == NULL) {
+			ret = -EINVAL;
+			goto out;
+		}
+	}
+
 	strlist__for_each(ent, dellist) {
 		str = strdup(ent->s);
 		if (str == NULL) {
@@ -2039,15 +2269,32 @@ int del_perf_probe_events(struct strlist *dellist)
 			event = str;
 		}
 		pr_debug("Group: %s, Event: %s\n", group, event);
-		ret = del_trace_probe_event(fd, group, event, namelist);
+		ret = e_snprintf(buf, 128, "%s:%s", group, event);
 		free(str);
+		if (ret < 0) {
+			pr_err("Failed to copy event.\n");
+			break;
+		}
+
+		ret = del_trace_probe_event(fd, buf, namelist);
+		if (ret >= 0 && unamelist) {
+			ret2 = del_trace_probe_event(ufd, buf, unamelist);
+			ret = ret2 < 0 ? ret2 : ret + ret2;
+		}
 		if (ret < 0)
 			break;
+		if (ret == 0)
+			pr_info("Info: Event \"%s\" does not exist.\n", buf);
 	}
+out:
+	if (unamelist)
+		strlist__delete(unamelist);
+	if (ufd >= 0)
+		close(ufd);
 	strlist__delete(namelist);
 	close(fd);
 
-	return ret;
+	return ret < 0 ? ret : 0;
 }
 /* TODO: don't use a global variable for filter ... */
 static struct strfilter *available_func_filter;
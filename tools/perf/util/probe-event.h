@@ -10,8 +10,8 @@ extern bool probe_event_dry_run;
 /* kprobe-tracer tracing point */
 struct probe_trace_point {
 	char		*symbol;	/* Base symbol */
-	char		*module;	/* Module name */
-	unsigned long	offset;		/* Offset from symbol */
+	char		*module;	/* Module name, or executable path */
+	unsigned long	offset;		/* Offset from symbol, or in file */
 	bool		retprobe;	/* Return probe flag */
 };
 
@@ -36,6 +36,7 @@ struct probe_trace_event {
 	struct probe_trace_point	point;	/* Trace point */
 	int				nargs;	/* Number of args */
 	struct probe_trace_arg		*args;	/* Arguments */
+	bool				uprobes;	/* uprobe-tracer event */
 };
 
 /* Perf probe probing point */
@@ -71,6 +72,7 @@ struct perf_probe_event {
 	struct perf_probe_point	point;	/* Probe point */
 	int			nargs;	/* Number of arguments */
 	struct perf_probe_arg	*args;	/* Arguments */
+	bool			uprobes;	/* Probe a user executable */
 };
 
 
@@ -121,7 +123,7 @@ extern int parse_line_range_desc(const char *cmd, struct line_range *lr);
 extern const char *kernel_get_module_path(const char *module);
 
 extern int add_perf_probe_events(struct perf_probe_event *pevs, int npevs,
-				 int max_probe_points, const char *module,
+				 int max_probe_points, const char *target,
 				 bool force_add);
 extern int del_perf_probe_events(struct strlist *dellist);
 extern int show_perf_probe_events(void);
@@ -13,6 +13,7 @@
 #include "sort.h"
 #include "util.h"
 #include "cpumap.h"
+#include "unwind.h"
 
 static int perf_session__open(struct perf_session *self, bool force)
 {
@@ -110,6 +111,7 @@ void perf_session__update_sample_type(struct perf_session *self)
 	self->sample_type = perf_evlist__sample_type(self->evlist);
 	self->sample_size = __perf_evsel__sample_size(self->sample_type);
 	self->sample_id_all = perf_evlist__sample_id_all(self->evlist);
+	self->sample_regs_user = perf_evlist__sample_regs_user(self->evlist);
 	perf_session__id_header_size(self);
 }
 
@@ -236,25 +238,110 @@ static bool symbol__match_parent_regex(struct symbol *sym)
 	return 0;
 }
 
+struct unwind_frames {
+	struct unwind_entry	*entries;
+	unsigned int		nr;
+	unsigned int		alloc;
+};
+
+static int unwind_frames__add(struct unwind_entry *entry, void *arg)
+{
+	struct unwind_frames *frames = arg;
+
+	if (frames->nr == frames->alloc) {
+		unsigned int alloc = frames->alloc ? frames->alloc * 2 : 64;
+		struct unwind_entry *entries;
+
+		entries = realloc(frames->entries, alloc * sizeof(*entries));
+		if (entries == NULL)
+			return -ENOMEM;
+		frames->entries = entries;
+		frames->alloc = alloc;
+	}
+
+	frames->entries[frames->nr++] = *entry;
+	return 0;
+}
+
+/*
+ * Unwind the user stack dump of @sample and append the frames to the
+ * callchain cursor in callchain_param.order.
+ */
+static int perf_session__unwind_user(struct perf_session *self,
+				     struct thread *thread,
+				     struct perf_sample *sample,
+				     struct symbol **parent)
+{
+	struct unwind_frames frames = { .entries = NULL, };
+	unsigned int i;
+	int err = 0;
+
+	/* A stack that can't be unwound all the way still has frames. */
+	unwind__get_entries(unwind_frames__add, &frames, self, thread,
+			    self->sample_regs_user, sample);
+
+	for (i = 0; i < frames.nr; i++) {
+		struct unwind_entry *e;
+
+		if (callchain_param.order == ORDER_CALLEE)
+			e = &frames.entries[i];
+		else
+			e = &frames.entries[frames.nr - i - 1];
+
+		if (e->sym && sort__has_parent && parent && !*parent &&
+		    symbol__match_parent_regex(e->sym))
+			*parent = e->sym;
+
+		err = callchain_cursor_append(&self->callchain_cursor,
+					      e->ip, e->map, e->sym);
+		if (err)
+			break;
+	}
+
+	free(frames.entries);
+	return err;
+}
+
 int perf_session__resolve_callchain(struct perf_session *self,
 				    struct thread *thread,
 				    struct ip_callchain *chain,
+				    struct perf_sample *sample,
 				    struct symbol **parent)
 {
 	u8 cpumode = PERF_RECORD_MISC_USER;
+	bool unwind = false;
+	u64 nr = chain->nr;
 	unsigned int i;
 	int err;
 
 	callchain_cursor_reset(&self->callchain_cursor);
 
-	for (i = 0; i < chain->nr; i++) {
+	/*
+	 * With a user stack dump to unwind, the user part of the frame
+	 * pointer chain is superseded: keep only what comes before it.
+	 */
+	if (sample && symbol_conf.use_callchain &&
+	    unwind__has_user_stack(sample)) {
+		unwind = true;
+		for (nr = 0; nr < chain->nr; nr++)
+			if (chain->ips[nr] == PERF_CONTEXT_USER)
+				break;
+	}
+
+	if (unwind && callchain_param.order != ORDER_CALLEE) {
+		err = perf_session__unwind_user(self, thread, sample, parent);
+		if (err)
+			return err;
+	}
+
+	for (i = 0; i < nr; i++) {
 		u64 ip;
 		struct addr_location al;
 
 		if (callchain_param.order == ORDER_CALLEE)
 			ip = chain->ips[i];
 		else
-			ip = chain->ips[chain->nr - i - 1];
+			ip = chain->ips[nr - i - 1];
 
 		if (ip >= PERF_CONTEXT_MAX) {
 			switch (ip) {
@@ -287,6 +374,9 @@ int perf_session__resolve_callchain(struct perf_session *self,
 			return err;
 	}
 
+	if (unwind && callchain_param.order == ORDER_CALLEE)
+		return perf_session__unwind_user(self, thread, sample, parent);
+
 	return 0;
 }
 
@@ -426,6 +516,8 @@ void perf_event__attr_swap(struct perf_event_attr *attr)
 	attr->bp_type		= bswap_32(attr->bp_type);
 	attr->bp_addr		= bswap_64(attr->bp_addr);
 	attr->bp_len		= bswap_64(attr->bp_len);
+	attr->sample_regs_user	= bswap_64(attr->sample_regs_user);
+	attr->sample_stack_user	= bswap_32(attr->sample_stack_user);
 }
 
 static void perf_event__hdr_attr_swap(union perf_event *event)
@@ -688,6 +780,28 @@ static void callchain__printf(struct perf_sample *sample)
 		       i, sample->callchain->ips[i]);
 }
 
+static void regs_user__printf(struct perf_sample *sample, u64 mask)
+{
+	struct regs_dump *user_regs = &sample->user_regs;
+	unsigned int i = 0, r;
+
+	printf("... user regs: mask 0x%" PRIx64 " ABI %" PRIu64 "\n",
+	       mask, user_regs->abi);
+
+	if (!user_regs->regs)
+		return;
+
+	for (r = 0; r < sizeof(mask) * 8; r++)
+		if (mask & (1ULL << r))
+			printf(".... %-5d 0x%" PRIx64 "\n", r,
+			       user_regs->regs[i++]);
+}
+
+static void stack_user__printf(struct perf_sample *sample)
+{
+	printf("... ustack: size %" PRIu64 "\n", sample->user_stack.size);
+}
+
 static void perf_session__print_tstamp(struct perf_session *session,
 				       union perf_event *event,
 				       struct perf_sample *sample)
@@ -735,6 +849,12 @@ static void dump_sample(struct perf_session *session, union perf_event *event,
 
 	if (session->sample_type & PERF_SAMPLE_CALLCHAIN)
 		callchain__printf(sample);
+
+	if (session->sample_type & PERF_SAMPLE_REGS_USER)
+		regs_user__printf(sample, session->sample_regs_user);
+
+	if (session->sample_type & PERF_SAMPLE_STACK_USER)
+		stack_user__printf(sample);
 }
 
 static int perf_session_deliver_event(struct perf_session *session,
@@ -1256,7 +1376,8 @@ void perf_session__print_ip(union perf_event *event,
 	if (symbol_conf.use_callchain && sample->callchain) {
 
 		if (perf_session__resolve_callchain(session, al.thread,
-						sample->callchain, NULL) != 0) {
+						sample->callchain, sample,
+						NULL) != 0) {
 			if (verbose)
 				error("Failed to resolve callchain. Skipping\n");
 			return;
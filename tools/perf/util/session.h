@@ -44,6 +44,7 @@ struct perf_session {
 	 */
 	struct hists		hists;
 	u64			sample_type;
+	u64			sample_regs_user;
 	int			sample_size;
 	int			fd;
 	bool			fd_pipe;
@@ -104,6 +105,7 @@ int perf_session__process_events(struct perf_session *self,
 int perf_session__resolve_callchain(struct perf_session *self,
 				    struct thread *thread,
 				    struct ip_callchain *chain,
+				    struct perf_sample *sample,
 				    struct symbol **parent);
 
 bool perf_session__has_traces(struct perf_session *self, const char *msg);
@@ -162,6 +164,7 @@ static inline int perf_session__parse_sample(struct perf_session *session,
 					     struct perf_sample *sample)
 {
 	return perf_event__parse_sample(event, session->sample_type,
+					session->sample_regs_user,
 					session->sample_size,
 					session->sample_id_all, sample,
 					session->header.needs_swap);
@@ -21,6 +21,7 @@
 #include <gelf.h>
 #include <elf.h>
 #include <limits.h>
+#include <pthread.h>
 #include <sys/utsname.h>
 
 #ifndef KSYM_NAME_LEN
@@ -938,6 +939,29 @@ static Elf_Scn *elf_section_by_name(Elf *elf, GElf_Ehdr *ep,
 	return sec;
 }
 
+/*
+ * File offset of section @name in the ELF file behind @fd, 0 if it has
+ * none.
+ */
+u64 elf_section_offset(int fd, const char *name)
+{
+	GElf_Ehdr ehdr;
+	GElf_Shdr shdr;
+	u64 offset = 0;
+	Elf *elf;
+
+	elf = elf_begin(fd, PERF_ELF_C_READ_MMAP, NULL);
+	if (elf == NULL)
+		return 0;
+
+	if (gelf_getehdr(elf, &ehdr) != NULL &&
+	    elf_section_by_name(elf, &ehdr, &shdr, name, NULL) != NULL)
+		offset = shdr.sh_offset;
+
+	elf_end(elf);
+	return offset;
+}
+
 #define elf_section__for_each_rel(reldata, pos, pos_mem, idx, nr_entries) \
 	for (idx = 0, pos = gelf_getrel(reldata, 0, &pos_mem); \
 	     idx < nr_entries; \
@@ -1400,6 +1424,106 @@ bool __dsos__read_build_ids(struct list_head *head, bool with_hits)
 	return have_build_id;
 }
 
+struct dsos_loader {
+	pthread_mutex_t		lock;
+	struct list_head	*head;
+	struct dso		*next;
+	enum map_type		type;
+	symbol_filter_t		filter;
+};
+
+static bool dso__wants_preload(struct dso *dso, enum map_type type)
+{
+	return !dso->kernel && dso->has_build_id &&
+	       dso->long_name[0] == '/' && !dso__loaded(dso, type);
+}
+
+static void *dsos_loader__run(void *arg)
+{
+	struct dsos_loader *loader = arg;
+	struct dso *dso;
+	struct map map;
+
+	for (;;) {
+		pthread_mutex_lock(&loader->lock);
+		dso = loader->next;
+		if (dso) {
+			list_for_each_entry_continue(loader->next, loader->head,
+						     node) {
+				if (dso__wants_preload(loader->next,
+						       loader->type))
+					break;
+			}
+			if (&loader->next->node == loader->head)
+				loader->next = NULL;
+		}
+		pthread_mutex_unlock(&loader->lock);
+
+		if (!dso)
+			break;
+
+		/* a host user DSO needs nothing from its map but the type */
+		map__init(&map, loader->type, 0, 0, 0, dso);
+		map__load(&map, loader->filter);
+	}
+
+	return NULL;
+}
+
+/*
+ * Load the symbols of the user DSOs in @head that had hits when recorded,
+ * i.e. those the build-id table put there, from @nr_threads threads, so
+ * processing the samples doesn't stop to load them one by one.  Each DSO
+ * is loaded by a single thread; the kernel is left to the usual lazy
+ * path.
+ */
+void __dsos__load_parallel(struct list_head *head, enum map_type type,
+			   symbol_filter_t filter, int nr_threads)
+{
+	struct dsos_loader loader = {
+		.head	= head,
+		.next	= NULL,
+		.type	= type,
+		.filter	= filter,
+	};
+	pthread_t *threads;
+	struct dso *pos;
+	int i, nr = 0;
+
+	list_for_each_entry(pos, head, node) {
+		if (dso__wants_preload(pos, type)) {
+			if (!loader.next)
+				loader.next = pos;
+			nr++;
+		}
+	}
+
+	if (nr_threads > nr)
+		nr_threads = nr;
+	if (nr_threads < 2)
+		return;
+
+	threads = calloc(nr_threads, sizeof(pthread_t));
+	if (threads == NULL)
+		return;
+
+	pthread_mutex_init(&loader.lock, NULL);
+	for (i = 0; i < nr_threads; i++) {
+		if (pthread_create(&threads[i], NULL, dsos_loader__run,
+				   &loader))
+			break;
+	}
+	/* whatever couldn't be started, the threads we have will do */
+	nr_threads = i;
+	if (!nr_threads)
+		dsos_loader__run(&loader);
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&loader.lock);
+	free(threads);
+}
+
 /*
  * Align offset to 4 bytes as needed for note name and descriptor data.
  */
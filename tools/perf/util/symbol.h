@@ -29,6 +29,7 @@ static inline char *bfd_demangle(void __used *v, const char __used *c,
 #endif
 
 int hex2u64(const char *ptr, u64 *val);
+u64 elf_section_offset(int fd, const char *name);
 char *strxfrchar(char *s, char from, char to);
 
 /*
@@ -225,6 +226,8 @@ struct symbol *dso__find_symbol_by_name(struct dso *dso, enum map_type type,
 int filename__read_build_id(const char *filename, void *bf, size_t size);
 int sysfs__read_build_id(const char *filename, void *bf, size_t size);
 bool __dsos__read_build_ids(struct list_head *head, bool with_hits);
+void __dsos__load_parallel(struct list_head *head, enum map_type type,
+			   symbol_filter_t filter, int nr_threads);
 int build_id__sprintf(const u8 *build_id, int len, char *bf);
 int kallsyms__parse(const char *filename, void *arg,
 		    int (*process_symbol)(void *arg, const char *name,
@@ -43,6 +43,8 @@ struct slabinfo {
 	unsigned long cmpxchg_double_cpu_fail, cmpxchg_double_fail;
 	unsigned long alloc_node_mismatch, deactivate_bypass;
 	unsigned long cpu_partial_alloc, cpu_partial_free;
+	int cpu_partial, cpu_partial_auto;
+	unsigned long list_lock_contended;
 	int numa[MAX_NODES];
 	int numa_partial[MAX_NODES];
 } slabinfo[MAX_SLABS];
@@ -533,6 +535,9 @@ static void report(struct slabinfo *s)
 			s->align, s->objs_per_slab, onoff(s->trace),
 			((page_size << s->order) - s->objs_per_slab * s->slab_size) *
 			s->slabs);
+	printf("CpuPart: %7d  Tuning : %7s   List lock waits: %lu\n",
+			s->cpu_partial, s->cpu_partial_auto ? "auto" : "fixed",
+			s->list_lock_contended);
 
 	ops(s);
 	show_tracking(s);
@@ -1217,6 +1222,9 @@ static void read_slab_dir(void)
 			slab->cmpxchg_double_fail = get_obj("cmpxchg_double_fail");
 			slab->cpu_partial_alloc = get_obj("cpu_partial_alloc");
 			slab->cpu_partial_free = get_obj("cpu_partial_free");
+			slab->cpu_partial = get_obj("cpu_partial");
+			slab->cpu_partial_auto = get_obj("cpu_partial_auto");
+			slab->list_lock_contended = get_obj("list_lock_contended");
 			slab->alloc_node_mismatch = get_obj("alloc_node_mismatch");
 			slab->deactivate_bypass = get_obj("deactivate_bypass");
 			chdir("..");
@@ -452,13 +452,13 @@ static unsigned long long au_iarray_cb(void *a,
 {
 	unsigned long long n;
 	struct inode **p, *inode;
-	struct list_head *head;
+	struct super_block *sb;
 
 	n = 0;
 	p = a;
-	head = arg;
-	spin_lock(&inode_sb_list_lock);
-	list_for_each_entry(inode, head, i_sb_list) {
+	sb = arg;
+	spin_lock(&sb->s_inode_list_lock);
+	list_for_each_entry(inode, &sb->s_inodes, i_sb_list) {
 		if (!is_bad_inode(inode)
 		    && au_ii(inode)->ii_bstart >= 0) {
 			spin_lock(&inode->i_lock);
@@ -471,7 +471,7 @@ static unsigned long long au_iarray_cb(void *a,
 			spin_unlock(&inode->i_lock);
 		}
 	}
-	spin_unlock(&inode_sb_list_lock);
+	spin_unlock(&sb->s_inode_list_lock);
 
 	return n;
 }
@@ -479,7 +479,7 @@ static unsigned long long au_iarray_cb(void *a,
 struct inode **au_iarray_alloc(struct super_block *sb, unsigned long long *max)
 {
 	*max = atomic_long_read(&au_sbi(sb)->si_ninodes);
-	return au_array_alloc(max, au_iarray_cb, &sb->s_inodes);
+	return au_array_alloc(max, au_iarray_cb, sb);
 }
 
 void au_iarray_free(struct inode **a, unsigned long long max)
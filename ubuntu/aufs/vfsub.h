@@ -33,7 +33,6 @@
 /* todo: BAD approach!! */
 DECLARE_BRLOCK(vfsmount_lock);
 extern void file_sb_list_del(struct file *f);
-extern spinlock_t inode_sb_list_lock;
 
 /* copied from linux/fs/file_table.c */
 DECLARE_LGLOCK(files_lglock);
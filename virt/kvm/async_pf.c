@@ -24,12 +24,42 @@
 #include <linux/slab.h>
 #include <linux/module.h>
 #include <linux/mmu_context.h>
+#include <linux/swap.h>
+#include <linux/ktime.h>
 
 #include "async_pf.h"
 #include <trace/events/kvm.h>
 
 static struct kmem_cache *async_pf_cache;
 
+/*
+ * Number of guest frames, aligned around the faulting one, whose swapin
+ * is queued together with it.  A guest that touched one swapped out page
+ * is likely to touch its neighbours next, and the host would otherwise
+ * bring them back one async fault at a time.  0 disables it.
+ */
+static unsigned int async_pf_readahead = 16;
+module_param(async_pf_readahead, uint, S_IRUGO | S_IWUSR);
+
+static void async_pf_swapin_readahead(struct mm_struct *mm,
+				      unsigned long addr)
+{
+	unsigned long window = (unsigned long)async_pf_readahead << PAGE_SHIFT;
+	struct vm_area_struct *vma;
+	unsigned long start, end;
+
+	if (!is_power_of_2(window))
+		return;
+
+	vma = find_vma(mm, addr);
+	if (!vma || vma->vm_start > addr || vma->vm_file)
+		return;
+
+	start = max(addr & ~(window - 1), vma->vm_start);
+	end = min((addr & ~(window - 1)) + window, vma->vm_end);
+	swapin_readahead_range(vma, start, end);
+}
+
 int kvm_async_pf_init(void)
 {
 	async_pf_cache = KMEM_CACHE(kvm_async_pf, 0);
@@ -68,6 +98,7 @@ static void async_pf_execute(struct work_struct *work)
 
 	use_mm(mm);
 	down_read(&mm->mmap_sem);
+	async_pf_swapin_readahead(mm, addr);
 	get_user_pages(current, mm, addr, 1, 1, 0, &page, NULL);
 	up_read(&mm->mmap_sem);
 	unuse_mm(mm);
@@ -82,7 +113,8 @@ static void async_pf_execute(struct work_struct *work)
 	 * this point
 	 */
 
-	trace_kvm_async_pf_completed(addr, page, gva);
+	trace_kvm_async_pf_completed(addr, page, gva,
+			ktime_to_ns(ktime_sub(ktime_get(), apf->start)));
 
 	if (waitqueue_active(&vcpu->wq))
 		wake_up_interruptible(&vcpu->wq);
@@ -142,6 +174,7 @@ void kvm_check_async_pf_completion(struct kvm_vcpu *vcpu)
 		if (work->page)
 			put_page(work->page);
 		kmem_cache_free(async_pf_cache, work);
+		++vcpu->stat.async_pf_completed;
 	}
 }
 
@@ -166,6 +199,7 @@ int kvm_setup_async_pf(struct kvm_vcpu *vcpu, gva_t gva, gfn_t gfn,
 	work->page = NULL;
 	work->vcpu = vcpu;
 	work->gva = gva;
+	work->start = ktime_get();
 	work->addr = gfn_to_hva(vcpu->kvm, gfn);
 	work->arch = *arch;
 	work->mm = current->mm;
@@ -183,6 +217,7 @@ int kvm_setup_async_pf(struct kvm_vcpu *vcpu, gva_t gva, gfn_t gfn,
 
 	list_add_tail(&work->queue, &vcpu->async_pf.queue);
 	vcpu->async_pf.queued++;
+	++vcpu->stat.async_pf_queued;
 	kvm_arch_async_page_not_present(vcpu, work);
 	return 1;
 retry_sync:
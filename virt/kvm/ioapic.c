@@ -116,8 +116,38 @@ static void update_handled_vectors(struct kvm_ioapic *ioapic)
 	memcpy(ioapic->handled_vectors, handled_vectors,
 	       sizeof(handled_vectors));
 	smp_wmb();
+	kvm_ioapic_make_eoibitmap_request(ioapic->kvm);
 }
 
+#ifdef CONFIG_X86
+/*
+ * Collect the vectors whose EOI the ioapic has to see: level-triggered
+ * pins, and pins somebody registered an ack notifier for.  The
+ * destination is not decoded, so every vcpu exits on these vectors;
+ * that only costs exits on vcpus that never receive them.
+ */
+void kvm_ioapic_scan_entry(struct kvm_vcpu *vcpu, u64 *eoi_exit_bitmap)
+{
+	struct kvm_ioapic *ioapic = vcpu->kvm->arch.vioapic;
+	union kvm_ioapic_redirect_entry *e;
+	int index;
+
+	if (!ioapic)
+		return;
+
+	spin_lock(&ioapic->lock);
+	for (index = 0; index < IOAPIC_NUM_PINS; index++) {
+		e = &ioapic->redirtbl[index];
+		if (e->fields.trig_mode == IOAPIC_LEVEL_TRIG ||
+		    kvm_irq_has_notifier(ioapic->kvm, KVM_IRQCHIP_IOAPIC,
+					 index))
+			__set_bit(e->fields.vector,
+				  (unsigned long *)eoi_exit_bitmap);
+	}
+	spin_unlock(&ioapic->lock);
+}
+#endif
+
 static void ioapic_write_indirect(struct kvm_ioapic *ioapic, u32 val)
 {
 	unsigned index;
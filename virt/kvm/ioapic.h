@@ -80,4 +80,22 @@ int kvm_irq_delivery_to_apic(struct kvm *kvm, struct kvm_lapic *src,
 int kvm_get_ioapic(struct kvm *kvm, struct kvm_ioapic_state *state);
 int kvm_set_ioapic(struct kvm *kvm, struct kvm_ioapic_state *state);
 
+#ifdef CONFIG_X86
+void kvm_ioapic_scan_entry(struct kvm_vcpu *vcpu, u64 *eoi_exit_bitmap);
+
+/*
+ * With virtual interrupt delivery the EOI-exit bitmap of every vcpu
+ * depends on the redirection table and on the registered ack notifiers;
+ * ask the vcpus to recompute it whenever either changes.
+ */
+static inline void kvm_ioapic_make_eoibitmap_request(struct kvm *kvm)
+{
+	kvm_make_scan_ioapic_request(kvm);
+}
+#else
+static inline void kvm_ioapic_make_eoibitmap_request(struct kvm *kvm)
+{
+}
+#endif
+
 #endif
@@ -65,6 +65,18 @@
 MODULE_AUTHOR("Qumranet");
 MODULE_LICENSE("GPL");
 
+/* Upper bound of the per-vCPU halt-poll window, 0 disables polling */
+static unsigned int halt_poll_ns = 500000;
+module_param(halt_poll_ns, uint, S_IRUGO | S_IWUSR);
+
+/* Factor by which the window grows after a short halt */
+static unsigned int halt_poll_ns_grow = 2;
+module_param(halt_poll_ns_grow, uint, S_IRUGO | S_IWUSR);
+
+/* Divisor by which the window shrinks after a long halt, 0 resets it */
+static unsigned int halt_poll_ns_shrink;
+module_param(halt_poll_ns_shrink, uint, S_IRUGO | S_IWUSR);
+
 /*
  * Ordering of locks:
  *
@@ -217,6 +229,11 @@ void kvm_reload_remote_mmus(struct kvm *kvm)
 	make_all_cpus_request(kvm, KVM_REQ_MMU_RELOAD);
 }
 
+void kvm_make_scan_ioapic_request(struct kvm *kvm)
+{
+	make_all_cpus_request(kvm, KVM_REQ_SCAN_IOAPIC);
+}
+
 int kvm_vcpu_init(struct kvm_vcpu *vcpu, struct kvm *kvm, unsigned id)
 {
 	struct page *page;
@@ -1524,7 +1541,8 @@ void mark_page_dirty_in_slot(struct kvm *kvm, struct kvm_memory_slot *memslot,
 	if (memslot && memslot->dirty_bitmap) {
 		unsigned long rel_gfn = gfn - memslot->base_gfn;
 
-		__set_bit_le(rel_gfn, memslot->dirty_bitmap);
+		/* x86's fast page fault path marks pages without mmu_lock. */
+		set_bit_le(rel_gfn, memslot->dirty_bitmap);
 	}
 }
 
@@ -1539,26 +1557,105 @@ void mark_page_dirty(struct kvm *kvm, gfn_t gfn)
 /*
  * The vCPU has executed a HLT instruction with in-kernel mode enabled.
  */
+static void grow_halt_poll_ns(struct kvm_vcpu *vcpu)
+{
+	unsigned int val = vcpu->halt_poll_ns;
+
+	/* 10us base */
+	if (val == 0 && halt_poll_ns_grow)
+		val = 10000;
+	else
+		val *= halt_poll_ns_grow;
+
+	vcpu->halt_poll_ns = min(val, halt_poll_ns);
+}
+
+static void shrink_halt_poll_ns(struct kvm_vcpu *vcpu)
+{
+	unsigned int val = vcpu->halt_poll_ns;
+
+	if (halt_poll_ns_shrink == 0)
+		val = 0;
+	else
+		val /= halt_poll_ns_shrink;
+
+	vcpu->halt_poll_ns = val;
+}
+
+static int kvm_vcpu_check_block(struct kvm_vcpu *vcpu)
+{
+	if (kvm_arch_vcpu_runnable(vcpu)) {
+		kvm_make_request(KVM_REQ_UNHALT, vcpu);
+		return -EINTR;
+	}
+	if (kvm_cpu_has_pending_timer(vcpu))
+		return -EINTR;
+	if (signal_pending(current))
+		return -EINTR;
+
+	return 0;
+}
+
+/*
+ * The vCPU has executed a HLT instruction with in-kernel mode enabled.
+ *
+ * Before scheduling out, busy-wait for up to vcpu->halt_poll_ns in case
+ * a wakeup event arrives shortly, which saves the host wakeup and
+ * reschedule latency. The window grows while halts end soon after they
+ * start and shrinks once they last longer than halt_poll_ns.
+ */
 void kvm_vcpu_block(struct kvm_vcpu *vcpu)
 {
+	ktime_t start, cur;
 	DEFINE_WAIT(wait);
+	u64 block_ns;
+
+	start = cur = ktime_get();
+	if (vcpu->halt_poll_ns) {
+		s64 stop = ktime_to_ns(start) + vcpu->halt_poll_ns;
+
+		++vcpu->stat.halt_attempted_poll;
+		do {
+			/*
+			 * This sets KVM_REQ_UNHALT if an interrupt
+			 * arrives.
+			 */
+			if (kvm_vcpu_check_block(vcpu) < 0) {
+				++vcpu->stat.halt_successful_poll;
+				goto out;
+			}
+			cpu_relax();
+			cur = ktime_get();
+		} while (!need_resched() && ktime_to_ns(cur) < stop);
+	}
 
 	for (;;) {
 		prepare_to_wait(&vcpu->wq, &wait, TASK_INTERRUPTIBLE);
 
-		if (kvm_arch_vcpu_runnable(vcpu)) {
-			kvm_make_request(KVM_REQ_UNHALT, vcpu);
-			break;
-		}
-		if (kvm_cpu_has_pending_timer(vcpu))
-			break;
-		if (signal_pending(current))
+		if (kvm_vcpu_check_block(vcpu) < 0)
 			break;
 
 		schedule();
 	}
 
 	finish_wait(&vcpu->wq, &wait);
+	cur = ktime_get();
+
+out:
+	block_ns = ktime_to_ns(cur) - ktime_to_ns(start);
+
+	if (halt_poll_ns) {
+		if (block_ns <= vcpu->halt_poll_ns)
+			;
+		/* we had a long block, shrink polling */
+		else if (vcpu->halt_poll_ns && block_ns > halt_poll_ns)
+			shrink_halt_poll_ns(vcpu);
+		/* we had a short halt and our poll time is too small */
+		else if (vcpu->halt_poll_ns < halt_poll_ns &&
+			 block_ns < halt_poll_ns)
+			grow_halt_poll_ns(vcpu);
+	} else
+		vcpu->halt_poll_ns = 0;
 }
 
 void kvm_resched(struct kvm_vcpu *vcpu)
@@ -1569,7 +1666,7 @@ void kvm_resched(struct kvm_vcpu *vcpu)
 }
 EXPORT_SYMBOL_GPL(kvm_resched);
 
-void kvm_vcpu_on_spin(struct kvm_vcpu *me)
+void kvm_vcpu_on_spin(struct kvm_vcpu *me, bool yield_to_kernel_mode)
 {
 	struct kvm *kvm = me->kvm;
 	struct kvm_vcpu *vcpu;
@@ -1578,12 +1675,20 @@ void kvm_vcpu_on_spin(struct kvm_vcpu *me)
 	int pass;
 	int i;
 
+	++me->stat.directed_yield_attempted;
+	me->in_spin_loop = true;
+
 	/*
 	 * We boost the priority of a VCPU that is runnable but not
 	 * currently running, because it got preempted by something
 	 * else and called schedule in __vcpu_run.  Hopefully that
 	 * VCPU is holding the lock that we need and will release it.
 	 * We approximate round-robin by starting at the last boosted VCPU.
+	 *
+	 * Only VCPUs that were preempted while runnable are candidates,
+	 * and of those we skip VCPUs that were themselves spinning.  A
+	 * VCPU spinning in the guest kernel waits on a kernel lock, so
+	 * only VCPUs preempted in kernel mode can be holding it.
 	 */
 	for (pass = 0; pass < 2 && !yielded; pass++) {
 		kvm_for_each_vcpu(i, vcpu, kvm) {
@@ -1594,10 +1699,17 @@ void kvm_vcpu_on_spin(struct kvm_vcpu *me)
 				continue;
 			} else if (pass && i > last_boosted_vcpu)
 				break;
+			if (!ACCESS_ONCE(vcpu->preempted))
+				continue;
 			if (vcpu == me)
 				continue;
+			if (ACCESS_ONCE(vcpu->in_spin_loop))
+				continue;
 			if (waitqueue_active(&vcpu->wq))
 				continue;
+			if (yield_to_kernel_mode &&
+			    !kvm_arch_vcpu_in_kernel(vcpu))
+				continue;
 			rcu_read_lock();
 			pid = rcu_dereference(vcpu->pid);
 			if (pid)
@@ -1605,19 +1717,18 @@ void kvm_vcpu_on_spin(struct kvm_vcpu *me)
 			rcu_read_unlock();
 			if (!task)
 				continue;
-			if (task->flags & PF_VCPU) {
-				put_task_struct(task);
-				continue;
-			}
 			if (yield_to(task, 1)) {
 				put_task_struct(task);
 				kvm->last_boosted_vcpu = i;
+				++me->stat.directed_yield_successful;
 				yielded = 1;
 				break;
 			}
 			put_task_struct(task);
 		}
 	}
+
+	me->in_spin_loop = false;
 }
 EXPORT_SYMBOL_GPL(kvm_vcpu_on_spin);
 
@@ -2708,6 +2819,9 @@ static void kvm_sched_in(struct preempt_notifier *pn, int cpu)
 {
 	struct kvm_vcpu *vcpu = preempt_notifier_to_vcpu(pn);
 
+	if (vcpu->preempted)
+		vcpu->preempted = false;
+
 	kvm_arch_vcpu_load(vcpu, cpu);
 }
 
@@ -2716,6 +2830,10 @@ static void kvm_sched_out(struct preempt_notifier *pn,
 {
 	struct kvm_vcpu *vcpu = preempt_notifier_to_vcpu(pn);
 
+	/* Only a vcpu that still wants to run can be holding a lock. */
+	if (current->state == TASK_RUNNING)
+		vcpu->preempted = true;
+
 	kvm_arch_vcpu_put(vcpu);
 }
 